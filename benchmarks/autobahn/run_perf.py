@@ -0,0 +1,209 @@
+#!/usr/bin/env python3
+#
+# Runs the performance cases of the Autobahn testsuite against testee_server
+# and testee_client and records how long each case took.
+#
+#   plain    testee_server over ws://, cases 9.*
+#   tls      testee_server over wss:// with a throwaway certificate, cases 9.*
+#   deflate  testee_server with permessage-deflate offered, cases 12.*
+#   client   testee_client against the fuzzing server, cases 9.*
+#
+# Durations are written to --out as JSON:
+#
+#   {"version": 1, "runs": {"plain": {"9.1.1": {"duration": 12,
+#       "behavior": "OK"}, ...}, ...}}
+#
+# With --baseline the run is compared to an earlier --out file and fails if
+# a case got slower by more than --tolerance, ignoring changes below
+# --min-delta milliseconds, or no longer passes. --update-baseline writes the
+# baseline instead. wstest comes from the autobahntestsuite package, pass
+# --wstest to use another command, such as a wrapper around its docker image.
+
+import argparse
+import json
+import os
+import shlex
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+RUNS = {
+    'plain': {'role': 'server', 'cases': ['9.*']},
+    'tls': {'role': 'server', 'cases': ['9.*'], 'tls': True},
+    'deflate': {'role': 'server', 'cases': ['12.*']},
+    'client': {'role': 'client', 'cases': ['9.*']},
+}
+
+PASSING = ('OK', 'NON-STRICT', 'INFORMATIONAL')
+
+
+def wait_for_port(port, timeout=30):
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        try:
+            socket.create_connection(('127.0.0.1', port), 1).close()
+            return
+        except OSError:
+            time.sleep(0.1)
+    raise RuntimeError('nothing listening on port %d' % port)
+
+
+def make_certificate(workdir):
+    cert = os.path.join(workdir, 'cert.pem')
+    key = os.path.join(workdir, 'key.pem')
+    subprocess.check_call(['openssl', 'req', '-x509', '-newkey', 'rsa:2048',
+        '-nodes', '-days', '1', '-subj', '/CN=localhost',
+        '-keyout', key, '-out', cert], stderr=subprocess.DEVNULL)
+    return cert, key
+
+
+def read_report(outdir):
+    with open(os.path.join(outdir, 'index.json')) as f:
+        index = json.load(f)
+
+    cases = {}
+    for agent_cases in index.values():
+        for case, result in agent_cases.items():
+            cases[case] = {
+                'duration': result.get('duration', 0),
+                'behavior': result.get('behavior', 'UNKNOWN'),
+            }
+    return cases
+
+
+def run_server(args, name, run, workdir):
+    outdir = os.path.join(workdir, name)
+    command = [args.testee_server, str(args.port), '1']
+    scheme = 'ws'
+    if run.get('tls'):
+        command += make_certificate(workdir)
+        scheme = 'wss'
+
+    spec = {
+        'outdir': outdir,
+        'servers': [{'agent': name,
+            'url': '%s://127.0.0.1:%d' % (scheme, args.port)}],
+        'cases': run['cases'],
+        'exclude-cases': [],
+        'exclude-agent-cases': {},
+    }
+    spec_file = os.path.join(workdir, name + '.json')
+    with open(spec_file, 'w') as f:
+        json.dump(spec, f)
+
+    testee = subprocess.Popen(command, stdout=subprocess.DEVNULL)
+    try:
+        wait_for_port(args.port)
+        subprocess.check_call(shlex.split(args.wstest) +
+            ['-m', 'fuzzingclient', '-s', spec_file], cwd=workdir)
+    finally:
+        testee.terminate()
+        testee.wait()
+
+    return read_report(outdir)
+
+
+def run_client(args, name, run, workdir):
+    outdir = os.path.join(workdir, name)
+    url = 'ws://127.0.0.1:%d' % args.fuzzing_port
+    spec = {
+        'url': url,
+        'outdir': outdir,
+        'cases': run['cases'],
+        'exclude-cases': [],
+        'exclude-agent-cases': {},
+    }
+    spec_file = os.path.join(workdir, name + '.json')
+    with open(spec_file, 'w') as f:
+        json.dump(spec, f)
+
+    fuzzer = subprocess.Popen(shlex.split(args.wstest) +
+        ['-m', 'fuzzingserver', '-s', spec_file], cwd=workdir,
+        stdout=subprocess.DEVNULL)
+    try:
+        wait_for_port(args.fuzzing_port)
+        subprocess.check_call([args.testee_client, url],
+            stdout=subprocess.DEVNULL)
+        # the report is written as the last case ends
+        time.sleep(1)
+    finally:
+        fuzzer.terminate()
+        fuzzer.wait()
+
+    return read_report(outdir)
+
+
+def compare(results, baseline, tolerance, min_delta):
+    failures = []
+    for name, cases in sorted(results.items()):
+        base_cases = baseline.get('runs', {}).get(name, {})
+        for case, result in sorted(cases.items()):
+            if result['behavior'] not in PASSING:
+                failures.append('%s %s: %s' % (name, case,
+                    result['behavior']))
+                continue
+            base = base_cases.get(case)
+            if base is None:
+                continue
+            before = base['duration']
+            after = result['duration']
+            if after - before > min_delta and after > before * tolerance:
+                failures.append('%s %s: %d ms, was %d ms' % (name, case,
+                    after, before))
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Run the Autobahn performance cases')
+    parser.add_argument('--testee-server', required=True)
+    parser.add_argument('--testee-client', required=True)
+    parser.add_argument('--wstest', default='wstest')
+    parser.add_argument('--runs', default=','.join(RUNS),
+        help='comma separated runs out of ' + ', '.join(RUNS))
+    parser.add_argument('--port', type=int, default=9002)
+    parser.add_argument('--fuzzing-port', type=int, default=9001)
+    parser.add_argument('--out', default='autobahn_perf.json')
+    parser.add_argument('--baseline')
+    parser.add_argument('--update-baseline', action='store_true')
+    parser.add_argument('--tolerance', type=float, default=1.25)
+    parser.add_argument('--min-delta', type=int, default=20)
+    args = parser.parse_args()
+
+    results = {}
+    with tempfile.TemporaryDirectory() as workdir:
+        for name in args.runs.split(','):
+            run = RUNS[name]
+            if run['role'] == 'server':
+                results[name] = run_server(args, name, run, workdir)
+            else:
+                results[name] = run_client(args, name, run, workdir)
+            total = sum(c['duration'] for c in results[name].values())
+            print('%-8s %4d cases %8d ms' % (name, len(results[name]),
+                total))
+
+    output = {'version': 1, 'runs': results}
+    with open(args.out, 'w') as f:
+        json.dump(output, f, indent=2, sort_keys=True)
+
+    if not args.baseline:
+        return 0
+
+    if args.update_baseline:
+        with open(args.baseline, 'w') as f:
+            json.dump(output, f, indent=2, sort_keys=True)
+        return 0
+
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+
+    failures = compare(results, baseline, args.tolerance, args.min_delta)
+    for failure in failures:
+        print(failure)
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
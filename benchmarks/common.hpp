@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_BENCHMARKS_COMMON_HPP
+#define WEBSOCKETPP_BENCHMARKS_COMMON_HPP
+
+#include <websocketpp/processors/hybi13.hpp>
+
+#include <websocketpp/http/request.hpp>
+#include <websocketpp/http/response.hpp>
+#include <websocketpp/message_buffer/alloc.hpp>
+#include <websocketpp/message_buffer/message.hpp>
+#include <websocketpp/random/none.hpp>
+
+#include <websocketpp/extensions/permessage_deflate/disabled.hpp>
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+
+#include <string>
+
+namespace bench {
+
+/// Processor config without extensions, as in the processor tests
+struct config {
+    typedef websocketpp::http::parser::request request_type;
+    typedef websocketpp::http::parser::response response_type;
+
+    typedef websocketpp::message_buffer::message
+        <websocketpp::message_buffer::alloc::con_msg_manager> message_type;
+    typedef websocketpp::message_buffer::alloc::con_msg_manager<message_type>
+        con_msg_manager_type;
+
+    typedef websocketpp::random::none::int_generator<uint32_t> rng_type;
+
+    struct permessage_deflate_config {
+        typedef config::request_type request_type;
+    };
+
+    typedef websocketpp::extensions::permessage_deflate::disabled
+        <permessage_deflate_config> permessage_deflate_type;
+
+    static const size_t max_message_size = 16000000;
+    static const size_t message_reserve_step = 65536;
+    static const bool enable_extensions = false;
+};
+
+/// Processor config with permessage-deflate
+struct deflate_config : public config {
+    struct permessage_deflate_config {
+        typedef config::request_type request_type;
+    };
+
+    typedef websocketpp::extensions::permessage_deflate::enabled
+        <permessage_deflate_config> permessage_deflate_type;
+
+    static const bool enable_extensions = true;
+};
+
+/// A processor with the support structures it needs
+template <typename config_type>
+struct processor {
+    typedef typename config_type::con_msg_manager_type msg_manager_type;
+    typedef typename config_type::message_type::ptr message_ptr;
+
+    explicit processor(bool server)
+      : msg_manager(new msg_manager_type())
+      , p(false, server, msg_manager, rng) {}
+
+    typename msg_manager_type::ptr msg_manager;
+    typename config_type::rng_type rng;
+    websocketpp::processor::hybi13<config_type> p;
+};
+
+/// Text that is mostly ASCII with some two, three and four byte sequences
+inline std::string mixed_text(size_t size) {
+    static char const sample[] = "The quick brown fox \xc3\xa9 jumps over "
+        "\xe2\x82\xac the lazy \xf0\x9f\x98\x80 dog. ";
+    std::string s;
+    while (s.size() < size) {
+        s += sample;
+    }
+    // cut at a code point boundary
+    size_t n = size;
+    while (n > 0 && (static_cast<unsigned char>(s[n]) & 0xc0) == 0x80) {
+        --n;
+    }
+    s.resize(n);
+    return s;
+}
+
+} // namespace bench
+
+#endif // WEBSOCKETPP_BENCHMARKS_COMMON_HPP
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+// The read, dispatch and write path of an open connection
+
+#include <benchmark/benchmark.h>
+
+#include <websocketpp/config/core.hpp>
+#include <websocketpp/server.hpp>
+
+#include <string>
+
+namespace {
+
+struct config : public websocketpp::config::core {
+    static constexpr websocketpp::log::level elog_level =
+        websocketpp::log::elevel::none;
+    static constexpr websocketpp::log::level alog_level =
+        websocketpp::log::alevel::none;
+};
+
+typedef websocketpp::server<config> server;
+
+std::string const handshake = "GET / HTTP/1.1\r\nHost: localhost\r\n"
+    "Connection: Upgrade\r\nUpgrade: websocket\r\n"
+    "Sec-WebSocket-Version: 13\r\n"
+    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+/// A masked binary frame as a client sends it, with an all zero key
+std::string client_frame(size_t size) {
+    std::string f(1, char(0x82));
+    if (size < 126) {
+        f += char(0x80 | size);
+    } else {
+        f += char(0x80 | 126);
+        f += char(size >> 8);
+        f += char(size & 0xff);
+    }
+    f += std::string(4, '\0');
+    f += std::string(size, 'x');
+    return f;
+}
+
+} // namespace
+
+// Each frame read is handed to the message handler, which echoes it back
+static void echo(benchmark::State & state) {
+    server s;
+    size_t written = 0;
+
+    s.set_write_handler([&](websocketpp::connection_hdl, char const *,
+        size_t len)
+    {
+        written += len;
+        return websocketpp::lib::error_code();
+    });
+    s.set_message_handler([&](websocketpp::connection_hdl hdl,
+        server::message_ptr msg)
+    {
+        s.send(hdl, msg);
+    });
+
+    server::connection_ptr con = s.get_connection();
+    con->start();
+    con->read_some(handshake.data(), handshake.size());
+
+    std::string const frame = client_frame(size_t(state.range(0)));
+    for (auto _ : state) {
+        // a read takes at most what the connection asked for
+        for (size_t done = 0; done < frame.size(); ) {
+            size_t n = con->read_some(frame.data() + done,
+                frame.size() - done);
+            if (n == 0) {
+                break;
+            }
+            done += n;
+        }
+    }
+    if (con->get_state() != websocketpp::session::state::open) {
+        state.SkipWithError("connection closed");
+    }
+    benchmark::DoNotOptimize(written);
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(echo)->Range(16, 32 << 10);
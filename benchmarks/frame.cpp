@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// Masking and unmasking of frame payloads
+
+#include <benchmark/benchmark.h>
+
+#include <websocketpp/frame.hpp>
+
+#include <vector>
+
+namespace frame = websocketpp::frame;
+
+static frame::masking_key_type key() {
+    frame::masking_key_type k;
+    k.c[0] = 0x12;
+    k.c[1] = 0x34;
+    k.c[2] = 0x56;
+    k.c[3] = 0x78;
+    return k;
+}
+
+static void mask_byte(benchmark::State & state) {
+    std::vector<uint8_t> data(state.range(0), 'x');
+    frame::masking_key_type k = key();
+
+    for (auto _ : state) {
+        frame::byte_mask(data.begin(), data.end(), k);
+        benchmark::DoNotOptimize(data.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(mask_byte)->Range(16, 64 << 10);
+
+static void mask_word_exact(benchmark::State & state) {
+    std::vector<uint8_t> data(state.range(0), 'x');
+    frame::masking_key_type k = key();
+
+    for (auto _ : state) {
+        frame::word_mask_exact(data.data(), data.size(), k);
+        benchmark::DoNotOptimize(data.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(mask_word_exact)->Range(16, 64 << 10);
+
+static void mask_word_circ(benchmark::State & state) {
+    std::vector<uint8_t> in(state.range(0), 'x');
+    std::vector<uint8_t> out(state.range(0));
+    size_t prepared = frame::prepare_masking_key(key());
+
+    for (auto _ : state) {
+        // odd sized pieces, as when a payload spans several reads
+        size_t k = prepared;
+        size_t p = 0;
+        while (p < in.size()) {
+            size_t n = std::min(in.size() - p, size_t(1021));
+            k = frame::word_mask_circ(in.data() + p, out.data() + p, n, k);
+            p += n;
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(mask_word_circ)->Range(16, 64 << 10);
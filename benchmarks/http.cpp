@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// Opening handshake parsing and serialization
+
+#include "common.hpp"
+
+#include <benchmark/benchmark.h>
+
+static std::string const client_handshake = "GET /chat HTTP/1.1\r\n"
+    "Host: localhost:5000\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:120.0) Gecko/20100101 "
+    "Firefox/120.0\r\n"
+    "Accept: */*\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Sec-WebSocket-Version: 13\r\n"
+    "Origin: http://localhost:5000\r\n"
+    "Sec-WebSocket-Extensions: permessage-deflate\r\n"
+    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+    "Connection: keep-alive, Upgrade\r\n"
+    "Pragma: no-cache\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Upgrade: websocket\r\n\r\n";
+
+static void handshake_parse(benchmark::State & state) {
+    for (auto _ : state) {
+        bench::config::request_type req;
+        websocketpp::lib::error_code ec;
+        req.consume(client_handshake.data(), client_handshake.size(), ec);
+        benchmark::DoNotOptimize(req.ready());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) *
+        client_handshake.size());
+}
+BENCHMARK(handshake_parse);
+
+static void handshake_process(benchmark::State & state) {
+    bench::processor<bench::config> server(true);
+    bench::config::request_type req;
+    websocketpp::lib::error_code ec;
+    req.consume(client_handshake.data(), client_handshake.size(), ec);
+
+    for (auto _ : state) {
+        bench::config::response_type res;
+        ec = server.p.validate_handshake(req);
+        if (!ec) {
+            ec = server.p.process_handshake(req, "", res);
+        }
+        benchmark::DoNotOptimize(ec);
+    }
+}
+BENCHMARK(handshake_process);
+
+static void handshake_serialize(benchmark::State & state) {
+    bench::processor<bench::config> server(true);
+    bench::config::request_type req;
+    bench::config::response_type res;
+    websocketpp::lib::error_code ec;
+    req.consume(client_handshake.data(), client_handshake.size(), ec);
+    res.set_status(websocketpp::http::status_code::switching_protocols);
+    server.p.process_handshake(req, "", res);
+    res.replace_header("Server", "WebSocket++/0.9.0");
+
+    for (auto _ : state) {
+        std::string raw = server.p.get_raw(res);
+        benchmark::DoNotOptimize(raw.data());
+    }
+}
+BENCHMARK(handshake_serialize);
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// Cost of logging on enabled and disabled channels
+
+#include <benchmark/benchmark.h>
+
+#include <websocketpp/concurrency/basic.hpp>
+#include <websocketpp/logger/async.hpp>
+#include <websocketpp/logger/basic.hpp>
+#include <websocketpp/logger/lazy.hpp>
+#include <websocketpp/logger/levels.hpp>
+#include <websocketpp/logger/stub.hpp>
+
+#include <sstream>
+
+namespace log = websocketpp::log;
+
+typedef log::basic<websocketpp::concurrency::basic, log::alevel> basic_log;
+typedef log::async<websocketpp::concurrency::basic, log::alevel> async_log;
+
+/// A stream that discards what is written to it
+class null_buffer : public std::streambuf {
+protected:
+    int overflow(int c) {
+        return c;
+    }
+    std::streamsize xsputn(char const *, std::streamsize n) {
+        return n;
+    }
+};
+
+static void log_disabled(benchmark::State & state) {
+    null_buffer buf;
+    std::ostream out(&buf);
+    basic_log l(&out);
+    l.clear_channels(log::alevel::all);
+
+    for (auto _ : state) {
+        WEBSOCKETPP_LOG(l, log::alevel::frame_header,
+            "Dispatching write containing " << 3 << " message(s)");
+    }
+}
+BENCHMARK(log_disabled);
+
+static void log_stub(benchmark::State & state) {
+    log::stub l;
+
+    for (auto _ : state) {
+        WEBSOCKETPP_LOG(l, log::alevel::frame_header,
+            "Dispatching write containing " << 3 << " message(s)");
+    }
+}
+BENCHMARK(log_stub);
+
+static void log_basic(benchmark::State & state) {
+    null_buffer buf;
+    std::ostream out(&buf);
+    basic_log l(&out);
+    l.set_channels(log::alevel::all);
+
+    for (auto _ : state) {
+        WEBSOCKETPP_LOG(l, log::alevel::frame_header,
+            "Dispatching write containing " << 3 << " message(s)");
+    }
+}
+BENCHMARK(log_basic)->Threads(1)->Threads(4);
+
+static void log_async(benchmark::State & state) {
+    static null_buffer buf;
+    static std::ostream out(&buf);
+    static async_log * l = NULL;
+    if (state.thread_index() == 0) {
+        l = new async_log(&out);
+        l->set_channels(log::alevel::all);
+    }
+
+    for (auto _ : state) {
+        WEBSOCKETPP_LOG(*l, log::alevel::frame_header,
+            "Dispatching write containing " << 3 << " message(s)");
+    }
+
+    if (state.thread_index() == 0) {
+        delete l;
+        l = NULL;
+    }
+}
+BENCHMARK(log_async)->Threads(1)->Threads(4);
@@ -0,0 +1,891 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+// End to end echo benchmark over loopback
+//
+// Runs a sharded_server and a client_ramp in the same process and measures
+// round trips through the full stack for every combination of the given
+// parameters. Each option takes a comma separated list:
+//
+//   --connections 1,100   connections to open
+//   --rate 0,1000         messages per second per connection, 0 sends the
+//                         next message as soon as the previous one is echoed
+//   --size 64,65536       payload bytes, at least 8
+//   --threads 1,4         io_context threads of the server and of the client
+//   --tls off,on          use config::asio_tls / asio_tls_client
+//   --deflate off,on      negotiate permessage-deflate
+//   --nodelay off,on      set TCP_NODELAY on both ends
+//   --transport asio,epoll  the transport of both ends, epoll is Linux only
+//
+// --duration and --warmup set the measured and the unmeasured seconds of each
+// run, --port the loopback port. CPU time and RSS are those of the whole
+// process, so they cover both ends of each connection. With a fixed rate,
+// latency is measured from when a message was due rather than when it was
+// sent, so a stalled sender shows up in the percentiles. Senders are paced
+// by a one millisecond timer, which adds up to that much to each sample.
+//
+// The epoll transport is the reference for how much of a run the asio
+// transport costs. It runs a plain server and client, each on a loop of its
+// own thread, and always sets TCP_NODELAY. Cells with TLS or more than one
+// thread are skipped for it.
+
+#include <websocketpp/config/asio.hpp>
+#include <websocketpp/config/asio_client.hpp>
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+
+#include <websocketpp/client_ramp.hpp>
+#include <websocketpp/sharded_server.hpp>
+
+#include <websocketpp/common/histogram.hpp>
+
+#ifdef __linux__
+#include <websocketpp/config/epoll.hpp>
+#include <websocketpp/client.hpp>
+#include <websocketpp/server.hpp>
+#endif
+
+#include <openssl/evp.h>
+#include <openssl/ec.h>
+#include <openssl/obj_mac.h>
+#include <openssl/x509.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+namespace lib = websocketpp::lib;
+
+using websocketpp::connection_hdl;
+using lib::placeholders::_1;
+using lib::placeholders::_2;
+
+typedef lib::chrono::steady_clock steady_clock;
+typedef lib::shared_ptr<lib::asio::ssl::context> context_ptr;
+
+/// Disable logging, which would otherwise dominate the profile
+template <typename base>
+struct quiet_config : public base {
+    static constexpr websocketpp::log::level elog_level =
+        websocketpp::log::elevel::none;
+    static constexpr websocketpp::log::level alog_level =
+        websocketpp::log::alevel::none;
+};
+
+template <typename base>
+struct deflate_config : public quiet_config<base> {
+    struct permessage_deflate_config {};
+
+    typedef websocketpp::extensions::permessage_deflate::enabled
+        <permessage_deflate_config> permessage_deflate_type;
+};
+
+/// One combination of parameters
+struct cell {
+    size_t connections;
+    double rate;
+    size_t size;
+    size_t threads;
+    bool tls;
+    bool deflate;
+    bool nodelay;
+    bool epoll;
+};
+
+struct result {
+    size_t opened;
+    size_t failed;
+    double seconds;
+    uint64_t messages;
+    websocketpp::latency_histogram latency;
+    double cpu_seconds;
+    long rss_bytes;
+};
+
+static long resident_bytes() {
+#ifdef __linux__
+    std::ifstream statm("/proc/self/statm");
+    long size = 0;
+    long resident = 0;
+    if (statm >> size >> resident) {
+        return resident * sysconf(_SC_PAGESIZE);
+    }
+#endif
+    return 0;
+}
+
+static int64_t now_ns() {
+    return lib::chrono::duration_cast<lib::chrono::nanoseconds>(
+        steady_clock::now().time_since_epoch()).count();
+}
+
+/// Self signed certificate for the TLS runs, created once
+class certificate {
+public:
+    certificate() : m_key(NULL), m_cert(NULL) {
+        EVP_PKEY_CTX * kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+        EVP_PKEY_keygen_init(kctx);
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid(kctx, NID_X9_62_prime256v1);
+        EVP_PKEY_keygen(kctx, &m_key);
+        EVP_PKEY_CTX_free(kctx);
+
+        m_cert = X509_new();
+        X509_set_version(m_cert, 2);
+        ASN1_INTEGER_set(X509_get_serialNumber(m_cert), 1);
+        X509_gmtime_adj(X509_getm_notBefore(m_cert), 0);
+        X509_gmtime_adj(X509_getm_notAfter(m_cert), 86400);
+        X509_set_pubkey(m_cert, m_key);
+
+        X509_NAME * name = X509_get_subject_name(m_cert);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+            reinterpret_cast<unsigned char const *>("localhost"), -1, -1, 0);
+        X509_set_issuer_name(m_cert, name);
+        X509_sign(m_cert, m_key, EVP_sha256());
+    }
+
+    ~certificate() {
+        X509_free(m_cert);
+        EVP_PKEY_free(m_key);
+    }
+
+    context_ptr server_context() const {
+        context_ptr ctx = lib::make_shared<lib::asio::ssl::context>(
+            lib::asio::ssl::context::sslv23);
+        SSL_CTX_use_certificate(ctx->native_handle(), m_cert);
+        SSL_CTX_use_PrivateKey(ctx->native_handle(), m_key);
+        return ctx;
+    }
+
+    static context_ptr client_context() {
+        context_ptr ctx = lib::make_shared<lib::asio::ssl::context>(
+            lib::asio::ssl::context::sslv23);
+        ctx->set_verify_mode(lib::asio::ssl::verify_none);
+        return ctx;
+    }
+private:
+    certificate(certificate const &);
+    certificate & operator=(certificate const &);
+
+    EVP_PKEY * m_key;
+    X509 * m_cert;
+};
+
+static context_ptr get_context(context_ptr ctx, websocketpp::connection_hdl_ref)
+{
+    return ctx;
+}
+
+template <typename endpoint>
+void set_tls(endpoint &, context_ptr, std::false_type) {}
+
+template <typename endpoint>
+void set_tls(endpoint & e, context_ptr ctx, std::true_type) {
+    e.set_tls_init_handler(lib::bind(&get_context, ctx, _1));
+}
+
+/// Echo server and pacing clients for a single cell
+template <typename server_config, typename client_config, bool secure>
+class harness {
+public:
+    typedef websocketpp::sharded_server<server_config> server_type;
+    typedef websocketpp::client_ramp<client_config> ramp_type;
+    typedef typename server_type::message_ptr server_message_ptr;
+    typedef typename ramp_type::shard_type::message_ptr client_message_ptr;
+    typedef std::integral_constant<bool, secure> secure_type;
+
+    harness(cell const & c, certificate const & cert)
+      : m_cell(c)
+      , m_server(c.threads)
+      , m_ramp(c.threads)
+      , m_shards(c.threads)
+      , m_payload(std::max(c.size, sizeof(int64_t)), 'a')
+      , m_running(false)
+      , m_measuring(false)
+      , m_done(false)
+      , m_failed(0)
+      , m_messages(0)
+    {
+        websocketpp::transport::asio::socket_options options;
+        options.no_delay = c.nodelay;
+
+        // mildly compressible, like typical text payloads
+        uint32_t x = 1;
+        for (size_t i = 0; i < m_payload.size(); ++i) {
+            x = x * 1103515245u + 12345u;
+            m_payload[i] = char('a' + (x >> 16) % 16);
+        }
+
+        m_server.init_asio();
+        for (size_t i = 0; i < m_server.size(); ++i) {
+            typename server_type::shard_type & s = m_server.get_shard(i);
+            s.clear_access_channels(websocketpp::log::alevel::all);
+            s.clear_error_channels(websocketpp::log::elevel::all);
+            s.set_reuse_addr(true);
+            s.set_socket_options(options);
+            s.set_message_handler(lib::bind(&harness::on_echo, this, i, _1,
+                _2));
+            set_tls(s, cert.server_context(), secure_type());
+        }
+
+        m_ramp.init_asio();
+        for (size_t i = 0; i < m_ramp.size(); ++i) {
+            typename ramp_type::shard_type & s = m_ramp.get_shard(i);
+            s.clear_access_channels(websocketpp::log::alevel::all);
+            s.clear_error_channels(websocketpp::log::elevel::all);
+            s.set_socket_options(options);
+            s.set_message_handler(lib::bind(&harness::on_reply, this, i, _1,
+                _2));
+            set_tls(s, certificate::client_context(), secure_type());
+            m_shards[i].payload = m_payload;
+        }
+        m_ramp.set_max_pending(256);
+        m_ramp.set_open_handler(lib::bind(&harness::on_open, this, _1, _2));
+        m_ramp.set_fail_handler(lib::bind(&harness::on_fail, this));
+        m_ramp.set_done_handler(lib::bind(&harness::on_done, this));
+    }
+
+    result run(uint16_t port, double warmup, double duration) {
+        result r;
+
+        m_server.listen(port);
+        m_server.start_accept();
+        lib::thread server_thread(&server_type::run, &m_server);
+
+        long const rss_before = resident_bytes();
+
+        std::stringstream uri;
+        uri << (secure ? "wss" : "ws") << "://127.0.0.1:" << port;
+        m_ramp.add_target(uri.str());
+        m_ramp.start(m_cell.connections);
+        lib::thread client_thread(&ramp_type::run, &m_ramp);
+
+        while (!m_done) {
+            std::this_thread::sleep_for(lib::chrono::milliseconds(10));
+        }
+        r.rss_bytes = resident_bytes() - rss_before;
+        r.failed = m_failed;
+        r.opened = m_cell.connections - r.failed;
+
+        m_running = true;
+        for (size_t i = 0; i < m_ramp.size(); ++i) {
+            m_ramp.get_shard(i).get_io_context().post(
+                lib::bind(&harness::begin, this, i));
+        }
+
+        sleep(warmup);
+
+        std::clock_t const cpu_start = std::clock();
+        steady_clock::time_point const start = steady_clock::now();
+        m_measuring = true;
+
+        sleep(duration);
+
+        m_measuring = false;
+        r.seconds = lib::chrono::duration<double>(
+            steady_clock::now() - start).count();
+        r.cpu_seconds = double(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+        r.messages = m_messages;
+        r.latency = m_latency.snapshot();
+
+        m_running = false;
+        for (size_t i = 0; i < m_ramp.size(); ++i) {
+            m_ramp.get_shard(i).get_io_context().post(
+                lib::bind(&harness::end, this, i));
+        }
+        sleep(0.2);
+
+        m_ramp.stop();
+        m_server.stop();
+        client_thread.join();
+        server_thread.join();
+
+        return r;
+    }
+private:
+    /// State of a client shard, only touched by its thread
+    struct shard_state {
+        shard_state() : sent(0) {}
+
+        std::vector<connection_hdl> hdls;
+        std::string payload;
+        lib::shared_ptr<lib::asio::steady_timer> timer;
+        steady_clock::time_point start;
+        steady_clock::time_point next_tick;
+        // messages sent on each connection so far at a fixed rate
+        uint64_t sent;
+    };
+
+    static void sleep(double seconds) {
+        std::this_thread::sleep_for(lib::chrono::duration<double>(seconds));
+    }
+
+    void on_echo(size_t index, connection_hdl hdl, server_message_ptr msg) {
+        lib::error_code ec;
+        m_server.get_shard(index).send(hdl, msg->get_payload(),
+            msg->get_opcode(), ec);
+    }
+
+    void on_open(size_t index, connection_hdl hdl) {
+        m_shards[index].hdls.push_back(hdl);
+    }
+
+    void on_fail() {
+        ++m_failed;
+    }
+
+    void on_done() {
+        m_done = true;
+    }
+
+    void send(size_t index, connection_hdl hdl, int64_t stamp) {
+        shard_state & state = m_shards[index];
+        std::memcpy(&state.payload[0], &stamp, sizeof(stamp));
+
+        lib::error_code ec;
+        m_ramp.get_shard(index).send(hdl, state.payload,
+            websocketpp::frame::opcode::binary, ec);
+    }
+
+    void on_reply(size_t index, connection_hdl hdl, client_message_ptr msg) {
+        int64_t stamp;
+        std::string const & payload = msg->get_payload();
+        if (payload.size() < sizeof(stamp)) {
+            return;
+        }
+        std::memcpy(&stamp, payload.data(), sizeof(stamp));
+
+        int64_t const now = now_ns();
+        if (m_measuring) {
+            m_latency.record(lib::chrono::duration_cast<
+                websocketpp::latency_histogram::duration>(
+                    lib::chrono::nanoseconds(now - stamp)));
+            ++m_messages;
+        }
+
+        if (m_running && m_cell.rate <= 0) {
+            this->send(index, hdl, now);
+        }
+    }
+
+    void begin(size_t index) {
+        shard_state & state = m_shards[index];
+
+        if (m_cell.rate <= 0) {
+            for (size_t i = 0; i < state.hdls.size(); ++i) {
+                this->send(index, state.hdls[i], now_ns());
+            }
+            return;
+        }
+
+        state.timer = lib::make_shared<lib::asio::steady_timer>(
+            m_ramp.get_shard(index).get_io_context());
+        state.start = steady_clock::now();
+        state.next_tick = state.start;
+        this->tick(index, lib::asio::error_code());
+    }
+
+    /// Send every message that is due by now on each connection
+    void tick(size_t index, lib::asio::error_code const & ec) {
+        shard_state & state = m_shards[index];
+
+        if (ec || !m_running) {
+            return;
+        }
+
+        double const elapsed = lib::chrono::duration<double>(
+            steady_clock::now() - state.start).count();
+        // message n is due n/rate seconds after the start
+        uint64_t const due = uint64_t(elapsed * m_cell.rate) + 1;
+
+        for (; state.sent < due; ++state.sent) {
+            int64_t const at = lib::chrono::duration_cast<
+                lib::chrono::nanoseconds>(state.start.time_since_epoch() +
+                    lib::chrono::duration_cast<steady_clock::duration>(
+                        lib::chrono::duration<double>(double(state.sent) /
+                            m_cell.rate))).count();
+
+            for (size_t i = 0; i < state.hdls.size(); ++i) {
+                this->send(index, state.hdls[i], at);
+            }
+        }
+
+        state.next_tick += lib::chrono::milliseconds(1);
+        state.timer->expires_at(state.next_tick);
+        state.timer->async_wait(lib::bind(&harness::tick, this, index, _1));
+    }
+
+    void end(size_t index) {
+        shard_state & state = m_shards[index];
+
+        if (state.timer) {
+            state.timer->cancel();
+        }
+        for (size_t i = 0; i < state.hdls.size(); ++i) {
+            lib::error_code ec;
+            m_ramp.get_shard(index).close(state.hdls[i],
+                websocketpp::close::status::going_away, "", ec);
+        }
+    }
+
+    cell const m_cell;
+    server_type m_server;
+    ramp_type m_ramp;
+    std::vector<shard_state> m_shards;
+    std::string m_payload;
+
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_measuring;
+    std::atomic<bool> m_done;
+    std::atomic<size_t> m_failed;
+    std::atomic<uint64_t> m_messages;
+    websocketpp::atomic_histogram m_latency;
+};
+
+template <typename server_config, typename client_config, bool secure>
+result run_cell(cell const & c, certificate const & cert, uint16_t port,
+    double warmup, double duration)
+{
+    harness<server_config, client_config, secure> h(c, cert);
+    return h.run(port, warmup, duration);
+}
+
+#ifdef __linux__
+/// Echo server and pacing client for a single cell over the epoll transport
+template <typename server_config, typename client_config>
+class epoll_harness {
+public:
+    typedef websocketpp::server<server_config> server_type;
+    typedef websocketpp::client<client_config> client_type;
+    typedef typename server_type::message_ptr server_message_ptr;
+    typedef typename client_type::message_ptr client_message_ptr;
+
+    explicit epoll_harness(cell const & c)
+      : m_cell(c)
+      , m_payload(std::max(c.size, sizeof(int64_t)), 'a')
+      , m_sent(0)
+      , m_running(false)
+      , m_measuring(false)
+      , m_opened(0)
+      , m_failed(0)
+      , m_messages(0)
+    {
+        // mildly compressible, like typical text payloads
+        uint32_t x = 1;
+        for (size_t i = 0; i < m_payload.size(); ++i) {
+            x = x * 1103515245u + 12345u;
+            m_payload[i] = char('a' + (x >> 16) % 16);
+        }
+
+        m_server.init_epoll();
+        m_server.set_reuse_addr(true);
+        m_server.set_message_handler(lib::bind(&epoll_harness::on_echo, this,
+            _1, _2));
+
+        m_client.init_epoll();
+        m_client.set_message_handler(lib::bind(&epoll_harness::on_reply,
+            this, _1, _2));
+        m_client.set_open_handler(lib::bind(&epoll_harness::on_open, this,
+            _1));
+        m_client.set_fail_handler(lib::bind(&epoll_harness::on_fail, this));
+    }
+
+    result run(uint16_t port, double warmup, double duration) {
+        result r;
+
+        m_server.listen(port);
+        m_server.start_accept();
+        lib::thread server_thread(&server_type::run, &m_server);
+
+        long const rss_before = resident_bytes();
+
+        std::stringstream uri;
+        uri << "ws://127.0.0.1:" << port;
+        for (size_t i = 0; i < m_cell.connections; ++i) {
+            lib::error_code ec;
+            typename client_type::connection_ptr con =
+                m_client.get_connection(uri.str(), ec);
+            if (ec) {
+                ++m_failed;
+                continue;
+            }
+            m_client.connect(con);
+        }
+        lib::thread client_thread(&client_type::run, &m_client);
+
+        while (m_opened + m_failed < m_cell.connections) {
+            std::this_thread::sleep_for(lib::chrono::milliseconds(10));
+        }
+        r.rss_bytes = resident_bytes() - rss_before;
+        r.failed = m_failed;
+        r.opened = m_opened;
+
+        m_running = true;
+        m_client.get_loop()->post(lib::bind(&epoll_harness::begin, this));
+
+        sleep(warmup);
+
+        std::clock_t const cpu_start = std::clock();
+        steady_clock::time_point const start = steady_clock::now();
+        m_measuring = true;
+
+        sleep(duration);
+
+        m_measuring = false;
+        r.seconds = lib::chrono::duration<double>(
+            steady_clock::now() - start).count();
+        r.cpu_seconds = double(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+        r.messages = m_messages;
+        r.latency = m_latency.snapshot();
+
+        m_running = false;
+        m_client.get_loop()->post(lib::bind(&epoll_harness::end, this));
+        sleep(0.2);
+
+        m_client.stop();
+        m_server.stop();
+        client_thread.join();
+        server_thread.join();
+
+        return r;
+    }
+private:
+    static void sleep(double seconds) {
+        std::this_thread::sleep_for(lib::chrono::duration<double>(seconds));
+    }
+
+    void on_echo(connection_hdl hdl, server_message_ptr msg) {
+        lib::error_code ec;
+        m_server.send(hdl, msg->get_payload(), msg->get_opcode(), ec);
+    }
+
+    void on_open(connection_hdl hdl) {
+        m_hdls.push_back(hdl);
+        ++m_opened;
+    }
+
+    void on_fail() {
+        ++m_failed;
+    }
+
+    void send(connection_hdl hdl, int64_t stamp) {
+        std::memcpy(&m_payload[0], &stamp, sizeof(stamp));
+
+        lib::error_code ec;
+        m_client.send(hdl, m_payload, websocketpp::frame::opcode::binary,
+            ec);
+    }
+
+    void on_reply(connection_hdl hdl, client_message_ptr msg) {
+        int64_t stamp;
+        std::string const & payload = msg->get_payload();
+        if (payload.size() < sizeof(stamp)) {
+            return;
+        }
+        std::memcpy(&stamp, payload.data(), sizeof(stamp));
+
+        int64_t const now = now_ns();
+        if (m_measuring) {
+            m_latency.record(lib::chrono::duration_cast<
+                websocketpp::latency_histogram::duration>(
+                    lib::chrono::nanoseconds(now - stamp)));
+            ++m_messages;
+        }
+
+        if (m_running && m_cell.rate <= 0) {
+            this->send(hdl, now);
+        }
+    }
+
+    void begin() {
+        if (m_cell.rate <= 0) {
+            for (size_t i = 0; i < m_hdls.size(); ++i) {
+                this->send(m_hdls[i], now_ns());
+            }
+            return;
+        }
+
+        m_start = steady_clock::now();
+        m_next_tick = m_start;
+        this->tick(lib::error_code());
+    }
+
+    /// Send every message that is due by now on each connection
+    void tick(lib::error_code const & ec) {
+        if (ec || !m_running) {
+            return;
+        }
+
+        double const elapsed = lib::chrono::duration<double>(
+            steady_clock::now() - m_start).count();
+        // message n is due n/rate seconds after the start
+        uint64_t const due = uint64_t(elapsed * m_cell.rate) + 1;
+
+        for (; m_sent < due; ++m_sent) {
+            int64_t const at = lib::chrono::duration_cast<
+                lib::chrono::nanoseconds>(m_start.time_since_epoch() +
+                    lib::chrono::duration_cast<steady_clock::duration>(
+                        lib::chrono::duration<double>(double(m_sent) /
+                            m_cell.rate))).count();
+
+            for (size_t i = 0; i < m_hdls.size(); ++i) {
+                this->send(m_hdls[i], at);
+            }
+        }
+
+        m_next_tick += lib::chrono::milliseconds(1);
+        long const wait = long(lib::chrono::duration_cast<
+            lib::chrono::milliseconds>(m_next_tick -
+                steady_clock::now()).count());
+        m_timer = m_client.get_loop()->set_timer(std::max(wait, 0L),
+            lib::bind(&epoll_harness::tick, this, _1));
+    }
+
+    void end() {
+        if (m_timer) {
+            m_timer->cancel();
+        }
+        for (size_t i = 0; i < m_hdls.size(); ++i) {
+            lib::error_code ec;
+            m_client.close(m_hdls[i], websocketpp::close::status::going_away,
+                "", ec);
+        }
+    }
+
+    cell const m_cell;
+    server_type m_server;
+    client_type m_client;
+    std::string m_payload;
+
+    // only touched by the client's loop
+    std::vector<connection_hdl> m_hdls;
+    websocketpp::transport::epoll::loop::timer_ptr m_timer;
+    steady_clock::time_point m_start;
+    steady_clock::time_point m_next_tick;
+    // messages sent on each connection so far at a fixed rate
+    uint64_t m_sent;
+
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_measuring;
+    std::atomic<size_t> m_opened;
+    std::atomic<size_t> m_failed;
+    std::atomic<uint64_t> m_messages;
+    websocketpp::atomic_histogram m_latency;
+};
+
+template <typename server_config, typename client_config>
+result run_epoll_cell(cell const & c, uint16_t port, double warmup,
+    double duration)
+{
+    epoll_harness<server_config, client_config> h(c);
+    return h.run(port, warmup, duration);
+}
+#endif
+
+static result run_cell(cell const & c, certificate const & cert,
+    uint16_t port, double warmup, double duration)
+{
+    namespace config = websocketpp::config;
+
+#ifdef __linux__
+    if (c.epoll && c.deflate) {
+        return run_epoll_cell<deflate_config<config::epoll>,
+            deflate_config<config::epoll_client> >(c, port, warmup, duration);
+    } else if (c.epoll) {
+        return run_epoll_cell<quiet_config<config::epoll>,
+            quiet_config<config::epoll_client> >(c, port, warmup, duration);
+    }
+#endif
+
+    if (c.tls && c.deflate) {
+        return run_cell<deflate_config<config::asio_tls>,
+            deflate_config<config::asio_tls_client>, true>(c, cert, port,
+                warmup, duration);
+    } else if (c.tls) {
+        return run_cell<quiet_config<config::asio_tls>,
+            quiet_config<config::asio_tls_client>, true>(c, cert, port,
+                warmup, duration);
+    } else if (c.deflate) {
+        return run_cell<deflate_config<config::asio>,
+            deflate_config<config::asio_client>, false>(c, cert, port,
+                warmup, duration);
+    } else {
+        return run_cell<quiet_config<config::asio>,
+            quiet_config<config::asio_client>, false>(c, cert, port,
+                warmup, duration);
+    }
+}
+
+template <typename T>
+static std::vector<T> parse_list(std::string const & s) {
+    std::vector<T> values;
+    std::stringstream in(s);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        std::stringstream v(item);
+        T value;
+        if (!(v >> value)) {
+            std::cerr << "invalid value: " << item << std::endl;
+            std::exit(1);
+        }
+        values.push_back(value);
+    }
+    return values;
+}
+
+static std::vector<bool> parse_flags(std::string const & s) {
+    std::vector<bool> values;
+    std::stringstream in(s);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        if (item == "on" || item == "1") {
+            values.push_back(true);
+        } else if (item == "off" || item == "0") {
+            values.push_back(false);
+        } else {
+            std::cerr << "invalid flag: " << item << std::endl;
+            std::exit(1);
+        }
+    }
+    return values;
+}
+
+int main(int argc, char * argv[]) {
+    std::vector<size_t> connections(1, 1);
+    std::vector<double> rates(1, 0);
+    std::vector<size_t> sizes(1, 64);
+    std::vector<size_t> threads(1, 1);
+    std::vector<bool> tls(1, false);
+    std::vector<bool> deflate(1, false);
+    std::vector<bool> nodelay(1, false);
+    std::vector<bool> epoll(1, false);
+    double duration = 5;
+    double warmup = 1;
+    uint16_t port = 9400;
+
+    for (int i = 1; i+1 < argc; i += 2) {
+        std::string const name = argv[i];
+        std::string const value = argv[i+1];
+
+        if (name == "--connections") {
+            connections = parse_list<size_t>(value);
+        } else if (name == "--rate") {
+            rates = parse_list<double>(value);
+        } else if (name == "--size") {
+            sizes = parse_list<size_t>(value);
+        } else if (name == "--threads") {
+            threads = parse_list<size_t>(value);
+        } else if (name == "--tls") {
+            tls = parse_flags(value);
+        } else if (name == "--deflate") {
+            deflate = parse_flags(value);
+        } else if (name == "--nodelay") {
+            nodelay = parse_flags(value);
+        } else if (name == "--transport") {
+            epoll.clear();
+            std::stringstream in(value);
+            std::string item;
+            while (std::getline(in, item, ',')) {
+                if (item == "asio") {
+                    epoll.push_back(false);
+#ifdef __linux__
+                } else if (item == "epoll") {
+                    epoll.push_back(true);
+#endif
+                } else {
+                    std::cerr << "invalid transport: " << item << std::endl;
+                    return 1;
+                }
+            }
+        } else if (name == "--duration") {
+            duration = parse_list<double>(value).at(0);
+        } else if (name == "--warmup") {
+            warmup = parse_list<double>(value).at(0);
+        } else if (name == "--port") {
+            port = uint16_t(parse_list<unsigned>(value).at(0));
+        } else {
+            std::cerr << "unknown option: " << name << std::endl;
+            return 1;
+        }
+    }
+
+    certificate cert;
+
+    std::printf("%6s %8s %7s %3s %3s %3s %7s %5s | %10s %10s %9s %9s %9s"
+        " %11s %10s %6s\n", "conns", "rate", "size", "tls", "pmd", "ndl",
+        "threads", "tport",
+        "msgs/s",
+        "MB/s", "p50 us", "p99 us", "p999 us", "cpu us/msg", "rss KB/con",
+        "failed");
+
+    for (size_t a = 0; a < connections.size(); ++a)
+    for (size_t b = 0; b < rates.size(); ++b)
+    for (size_t c = 0; c < sizes.size(); ++c)
+    for (size_t d = 0; d < threads.size(); ++d)
+    for (size_t e = 0; e < tls.size(); ++e)
+    for (size_t f = 0; f < deflate.size(); ++f)
+    for (size_t g = 0; g < nodelay.size(); ++g)
+    for (size_t h = 0; h < epoll.size(); ++h) {
+        cell const x = {connections[a], rates[b], sizes[c],
+            std::max(threads[d], size_t(1)), tls[e], deflate[f], nodelay[g],
+            epoll[h]};
+
+        if (x.epoll && (x.tls || x.threads > 1)) {
+            continue;
+        }
+
+        result const r = run_cell(x, cert, port, warmup, duration);
+
+        double const per_second = double(r.messages) / r.seconds;
+        std::printf("%6zu %8.0f %7zu %3s %3s %3s %7zu %5s | %10.0f %10.2f"
+            " %9lld %9lld %9lld %11.2f %10.1f %6zu\n", x.connections, x.rate,
+            x.size, x.tls ? "on" : "off", x.deflate ? "on" : "off",
+            x.nodelay ? "on" : "off", x.threads, x.epoll ? "epoll" : "asio",
+            per_second, per_second * double(x.size) / 1e6,
+            (long long)r.latency.percentile(50).count(),
+            (long long)r.latency.percentile(99).count(),
+            (long long)r.latency.percentile(99.9).count(),
+            r.messages ? r.cpu_seconds * 1e6 / double(r.messages) : 0.0,
+            r.opened ? double(r.rss_bytes) / 1024 / double(r.opened) : 0.0,
+            r.failed);
+        std::fflush(stdout);
+    }
+
+    return 0;
+}
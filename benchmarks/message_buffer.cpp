@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// Allocation of messages by the message managers
+
+#include <benchmark/benchmark.h>
+
+#include <websocketpp/message_buffer/alloc.hpp>
+#include <websocketpp/message_buffer/message.hpp>
+#include <websocketpp/message_buffer/pool.hpp>
+
+namespace mb = websocketpp::message_buffer;
+
+typedef mb::message<mb::alloc::con_msg_manager> alloc_message;
+typedef mb::alloc::con_msg_manager<alloc_message> alloc_manager;
+
+typedef mb::message<mb::pool::con_msg_manager> pool_message;
+typedef mb::pool::con_msg_manager<pool_message> pool_manager;
+
+template <typename manager_type>
+static void get_message(benchmark::State & state) {
+    typename manager_type::ptr manager(new manager_type());
+    size_t const size = state.range(0);
+
+    for (auto _ : state) {
+        typename manager_type::message_ptr msg = manager->get_message(
+            websocketpp::frame::opcode::text, size);
+        msg->get_raw_payload().append(size, 'x');
+        benchmark::DoNotOptimize(msg.get());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(get_message, alloc_manager)->Range(64, 64 << 10);
+BENCHMARK_TEMPLATE(get_message, pool_manager)->Range(64, 64 << 10);
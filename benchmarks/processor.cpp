@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// Frame parsing and preparation by the hybi13 processor
+
+#include "common.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+namespace opcode = websocketpp::frame::opcode;
+
+typedef bench::processor<bench::config> processor_type;
+typedef bench::processor<bench::deflate_config> deflate_processor_type;
+typedef processor_type::message_ptr message_ptr;
+
+/// Kinds of frame streams consumed
+enum frame_mix {
+    small_text = 0,
+    large_binary = 1,
+    fragmented = 2,
+    with_control = 3
+};
+
+/// Append one masked client frame to a wire buffer
+static void add_frame(processor_type & client, std::string & wire,
+    opcode::value op, std::string const & payload, bool fin = true)
+{
+    message_ptr in = client.msg_manager->get_message(op, payload.size());
+    message_ptr out = client.msg_manager->get_message();
+    in->set_payload(payload);
+    in->set_fin(fin);
+
+    websocketpp::lib::error_code ec;
+    if (opcode::is_control(op)) {
+        ec = client.p.prepare_ping(payload, out);
+    } else {
+        ec = client.p.prepare_data_frame(in, out);
+    }
+    if (ec) {
+        return;
+    }
+
+    wire += out->get_header();
+    wire += out->get_payload();
+}
+
+/// Build the bytes of a stream of frames a client sends
+static std::string make_wire(frame_mix mix, size_t * messages) {
+    processor_type client(false);
+    std::string wire;
+    *messages = 0;
+
+    switch (mix) {
+        case small_text:
+            for (size_t i = 0; i < 256; ++i, ++*messages) {
+                add_frame(client, wire, opcode::text, bench::mixed_text(64));
+            }
+            break;
+        case large_binary:
+            for (size_t i = 0; i < 4; ++i, ++*messages) {
+                add_frame(client, wire, opcode::binary,
+                    std::string(64 << 10, 'b'));
+            }
+            break;
+        case fragmented:
+            for (size_t i = 0; i < 16; ++i, ++*messages) {
+                add_frame(client, wire, opcode::text, bench::mixed_text(1000),
+                    false);
+                for (size_t j = 0; j < 6; ++j) {
+                    add_frame(client, wire, opcode::continuation,
+                        bench::mixed_text(1000), false);
+                }
+                add_frame(client, wire, opcode::continuation,
+                    bench::mixed_text(1000));
+            }
+            break;
+        case with_control:
+            for (size_t i = 0; i < 128; ++i, ++*messages) {
+                add_frame(client, wire, opcode::text, bench::mixed_text(200));
+                add_frame(client, wire, opcode::ping, "ping");
+            }
+            break;
+    }
+    return wire;
+}
+
+static void consume(benchmark::State & state) {
+    size_t messages;
+    std::string wire = make_wire(frame_mix(state.range(0)), &messages);
+    size_t const read_size = state.range(1);
+
+    processor_type server(true);
+    std::vector<uint8_t> buf(wire.begin(), wire.end());
+    std::vector<uint8_t> chunk(read_size);
+
+    for (auto _ : state) {
+        size_t delivered = 0;
+        for (size_t r = 0; r < buf.size(); r += read_size) {
+            // consume unmasks in place, so work on a copy of each read
+            size_t len = std::min(read_size, buf.size() - r);
+            std::copy(buf.begin() + r, buf.begin() + r + len, chunk.begin());
+
+            websocketpp::lib::error_code ec;
+            size_t p = 0;
+            while (p < len) {
+                p += server.p.consume(chunk.data() + p, len - p, ec);
+                if (ec) {
+                    state.SkipWithError(ec.message().c_str());
+                    return;
+                }
+                if (server.p.ready()) {
+                    message_ptr msg = server.p.get_message();
+                    if (msg && !opcode::is_control(msg->get_opcode())) {
+                        ++delivered;
+                    }
+                }
+            }
+        }
+        if (delivered != messages) {
+            state.SkipWithError("unexpected message count");
+            return;
+        }
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * wire.size());
+    state.SetItemsProcessed(int64_t(state.iterations()) * messages);
+}
+BENCHMARK(consume)
+    ->ArgNames({"mix", "read"})
+    ->ArgsProduct({{small_text, large_binary, fragmented, with_control},
+        {1500, 16384}});
+
+static void prepare_data_frame(benchmark::State & state) {
+    processor_type server(true);
+    std::string payload = bench::mixed_text(state.range(0));
+
+    message_ptr in = server.msg_manager->get_message(opcode::text,
+        payload.size());
+    message_ptr out = server.msg_manager->get_message();
+    in->set_payload(payload);
+
+    for (auto _ : state) {
+        out->set_prepared(false);
+        websocketpp::lib::error_code ec = server.p.prepare_data_frame(in, out);
+        benchmark::DoNotOptimize(ec);
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * payload.size());
+}
+BENCHMARK(prepare_data_frame)->Range(64, 64 << 10);
+
+static void prepare_data_frame_deflate(benchmark::State & state) {
+    deflate_processor_type server(true);
+    bench::deflate_config::request_type req;
+    req.replace_header("Sec-WebSocket-Extensions", "permessage-deflate");
+    if (server.p.negotiate_extensions(req).first) {
+        state.SkipWithError("permessage-deflate negotiation failed");
+        return;
+    }
+
+    std::string payload = bench::mixed_text(state.range(0));
+
+    deflate_processor_type::message_ptr in = server.msg_manager->get_message(
+        opcode::text, payload.size());
+    deflate_processor_type::message_ptr out =
+        server.msg_manager->get_message();
+    in->set_payload(payload);
+    in->set_compressed(true);
+
+    for (auto _ : state) {
+        out->set_prepared(false);
+        websocketpp::lib::error_code ec = server.p.prepare_data_frame(in, out);
+        benchmark::DoNotOptimize(ec);
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * payload.size());
+}
+BENCHMARK(prepare_data_frame_deflate)->Range(64, 64 << 10);
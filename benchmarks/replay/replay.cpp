@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+// Replay of captured traffic through iostream server connections
+//
+// Reads capture files written through endpoint::set_capture and feeds the
+// inbound bytes of each captured server connection into a new iostream
+// connection, chunk by chunk as they were read, without waiting in between.
+// Outbound bytes are thrown away. This measures parsing, decompression and
+// handler dispatch on real traffic shapes with no network in the way.
+//
+//   websocketpp_replay [options] file...
+//
+//   --raw          treat each file as the raw inbound bytes of one
+//                  connection, for example a fuzzer corpus entry, fed in
+//                  --chunk sized reads
+//   --chunk 4096   read size used for --raw files
+//   --deflate      negotiate permessage-deflate, needed for captures of
+//                  compressed traffic
+//   --repeat 10    number of passes over all connections
+//
+// Client connections in a capture are skipped: their handshake depends on a
+// random key, so the captured responses would not be accepted again.
+
+#include <websocketpp/config/core.hpp>
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+#include <websocketpp/server.hpp>
+
+#include <websocketpp/capture.hpp>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace lib = websocketpp::lib;
+
+using websocketpp::connection_hdl;
+
+typedef lib::chrono::steady_clock steady_clock;
+
+/// Disable logging, which would otherwise dominate the profile
+struct quiet_config : public websocketpp::config::core {
+    static constexpr websocketpp::log::level elog_level =
+        websocketpp::log::elevel::none;
+    static constexpr websocketpp::log::level alog_level =
+        websocketpp::log::alevel::none;
+};
+
+struct deflate_config : public quiet_config {
+    struct permessage_deflate_config {};
+
+    typedef websocketpp::extensions::permessage_deflate::enabled
+        <permessage_deflate_config> permessage_deflate_type;
+};
+
+/// The inbound chunks of one connection, in the order they were read
+typedef std::vector<std::string> chunk_list;
+
+struct totals {
+    totals() : connections(0), chunks(0), bytes(0), messages(0),
+        message_bytes(0) {}
+
+    uint64_t connections;
+    uint64_t chunks;
+    uint64_t bytes;
+    uint64_t messages;
+    uint64_t message_bytes;
+};
+
+static lib::error_code discard(connection_hdl, char const *, size_t) {
+    return lib::error_code();
+}
+
+/// Read the server connections of a capture file
+static bool load_capture(std::string const & path,
+    std::vector<chunk_list> & out)
+{
+    websocketpp::capture_reader reader;
+    lib::error_code ec = reader.open_file(path);
+    if (ec) {
+        std::cerr << path << ": " << ec.message() << std::endl;
+        return false;
+    }
+
+    // ids of server connections and where their chunks go
+    std::map<uint64_t, size_t> index;
+    size_t skipped = 0;
+
+    websocketpp::capture_reader::entry e;
+    while (reader.next(e)) {
+        if (e.kind == websocketpp::capture::open) {
+            if (!e.bytes.empty() && e.bytes[0] == 1) {
+                index[e.id] = out.size();
+                out.push_back(chunk_list());
+            } else {
+                ++skipped;
+            }
+        } else if (e.kind == websocketpp::capture::inbound) {
+            std::map<uint64_t, size_t>::const_iterator it = index.find(e.id);
+            if (it != index.end()) {
+                out[it->second].push_back(e.bytes);
+            }
+        }
+    }
+
+    if (reader.error()) {
+        std::cerr << path << ": truncated or malformed record, using the "
+                  << "records before it" << std::endl;
+    }
+    if (skipped) {
+        std::cerr << path << ": skipped " << skipped
+                  << " client connection(s)" << std::endl;
+    }
+    return true;
+}
+
+/// Read a file as the inbound bytes of one connection
+static bool load_raw(std::string const & path, size_t chunk,
+    std::vector<chunk_list> & out)
+{
+    std::ifstream in(path.c_str(), std::ios::binary);
+    if (!in) {
+        std::cerr << path << ": cannot open" << std::endl;
+        return false;
+    }
+
+    std::string bytes((std::istreambuf_iterator<char>(in)),
+        std::istreambuf_iterator<char>());
+
+    chunk_list chunks;
+    for (size_t i = 0; i < bytes.size(); i += chunk) {
+        chunks.push_back(bytes.substr(i, chunk));
+    }
+    out.push_back(chunks);
+    return true;
+}
+
+template <typename config>
+static void replay(std::vector<chunk_list> const & connections,
+    size_t repeat, totals & t)
+{
+    typedef websocketpp::server<config> server_type;
+    typedef typename server_type::message_ptr message_ptr;
+
+    server_type s;
+    s.set_message_handler([&t](connection_hdl, message_ptr msg) {
+        ++t.messages;
+        t.message_bytes += msg->get_payload().size();
+    });
+
+    for (size_t pass = 0; pass < repeat; ++pass) {
+        for (size_t i = 0; i < connections.size(); ++i) {
+            lib::error_code ec;
+            typename server_type::connection_ptr con = s.get_connection(ec);
+            if (ec) {
+                std::cerr << "get_connection: " << ec.message() << std::endl;
+                return;
+            }
+            con->set_write_handler(&discard);
+            con->start();
+
+            chunk_list const & chunks = connections[i];
+            for (size_t j = 0; j < chunks.size(); ++j) {
+                con->read_all(chunks[j].data(), chunks[j].size());
+                ++t.chunks;
+                t.bytes += chunks[j].size();
+            }
+            con->eof();
+            ++t.connections;
+        }
+    }
+}
+
+int main(int argc, char * argv[]) {
+    bool raw = false;
+    bool deflate = false;
+    size_t chunk = 4096;
+    size_t repeat = 10;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--raw") {
+            raw = true;
+        } else if (arg == "--deflate") {
+            deflate = true;
+        } else if ((arg == "--chunk" || arg == "--repeat") && i + 1 < argc) {
+            size_t value = std::strtoul(argv[++i], NULL, 10);
+            if (value == 0) {
+                std::cerr << arg << " must be at least 1" << std::endl;
+                return 1;
+            }
+            (arg == "--chunk" ? chunk : repeat) = value;
+        } else if (arg.compare(0, 2, "--") == 0) {
+            std::cerr << "unknown option " << arg << std::endl;
+            return 1;
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    if (files.empty()) {
+        std::cerr << "usage: " << argv[0] << " [--raw] [--chunk n] "
+                  << "[--deflate] [--repeat n] file..." << std::endl;
+        return 1;
+    }
+
+    std::vector<chunk_list> connections;
+    for (size_t i = 0; i < files.size(); ++i) {
+        bool ok = raw ? load_raw(files[i], chunk, connections) :
+            load_capture(files[i], connections);
+        if (!ok) {
+            return 1;
+        }
+    }
+
+    totals t;
+    steady_clock::time_point start = steady_clock::now();
+    if (deflate) {
+        replay<deflate_config>(connections, repeat, t);
+    } else {
+        replay<quiet_config>(connections, repeat, t);
+    }
+    double seconds = lib::chrono::duration<double>(steady_clock::now() -
+        start).count();
+    if (seconds <= 0) {
+        seconds = 1e-9;
+    }
+
+    std::cout << "connections " << t.connections << "\n"
+              << "chunks      " << t.chunks << "\n"
+              << "bytes       " << t.bytes << "\n"
+              << "messages    " << t.messages << " ("
+              << t.message_bytes << " payload bytes)\n"
+              << "seconds     " << seconds << "\n"
+              << "MB/s        " << double(t.bytes) / seconds / 1e6 << "\n"
+              << "messages/s  " << double(t.messages) / seconds << "\n"
+              << "ns/chunk    "
+              << (t.chunks ? seconds * 1e9 / double(t.chunks) : 0.0)
+              << std::endl;
+    return 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// UTF-8 validation of text payloads
+
+#include "common.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <websocketpp/utf8_validator.hpp>
+
+static void utf8_ascii(benchmark::State & state) {
+    std::string s(state.range(0), 'x');
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(websocketpp::utf8_validator::validate(s));
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(utf8_ascii)->Range(16, 64 << 10);
+
+static void utf8_mixed(benchmark::State & state) {
+    std::string s = bench::mixed_text(state.range(0));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(websocketpp::utf8_validator::validate(s));
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * s.size());
+}
+BENCHMARK(utf8_mixed)->Range(16, 64 << 10);
+
+static void utf8_incremental(benchmark::State & state) {
+    std::string s = bench::mixed_text(state.range(0));
+
+    for (auto _ : state) {
+        // fed in pieces that split code points, as frames arrive
+        websocketpp::utf8_validator::validator v;
+        bool ok = true;
+        for (size_t p = 0; p < s.size() && ok; p += 509) {
+            size_t n = std::min(s.size() - p, size_t(509));
+            ok = v.decode(s.begin() + p, s.begin() + p + n);
+        }
+        benchmark::DoNotOptimize(ok && v.complete());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * s.size());
+}
+BENCHMARK(utf8_incremental)->Range(1 << 10, 64 << 10);
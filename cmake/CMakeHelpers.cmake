@@ -5,6 +5,8 @@ macro (print_used_build_config)
     message (STATUS "ENABLE_CPP11        = " ${ENABLE_CPP11})
     message (STATUS "BUILD_EXAMPLES      = " ${BUILD_EXAMPLES})
     message (STATUS "BUILD_TESTS         = " ${BUILD_TESTS})
+    message (STATUS "BUILD_BENCHMARKS    = " ${BUILD_BENCHMARKS})
+    message (STATUS "BUILD_PRECOMPILED   = " ${BUILD_PRECOMPILED})
     message (STATUS "")
     message (STATUS "WEBSOCKETPP_ROOT    = " ${WEBSOCKETPP_ROOT})
     message (STATUS "WEBSOCKETPP_BIN     = " ${WEBSOCKETPP_BIN})
@@ -13,6 +13,7 @@
 typedef websocketpp::server<websocketpp::config::asio> server;
 
 using websocketpp::connection_hdl;
+using websocketpp::connection_hdl_ref;
 using websocketpp::lib::placeholders::_1;
 using websocketpp::lib::placeholders::_2;
 using websocketpp::lib::bind;
@@ -132,14 +133,20 @@ public:
                 lock_guard<mutex> guard(m_connection_lock);
                 m_connections.erase(a.hdl);
             } else if (a.type == MESSAGE) {
+                // Frame the message once and share the result between all
+                // recipients rather than re-framing it for each connection.
+                server::message_ptr out = m_server.prepare_broadcast(
+                    a.msg->get_payload(),a.msg->get_opcode(),ec);
+                if (ec) {
+                    continue;
+                }
+
                 lock_guard<mutex> guard(m_connection_lock);
 
                 con_list::iterator it;
                 for (it = m_connections.begin(); it != m_connections.end(); ++it) {
-                    m_server.send(*it,a.msg,ec);
-                    if (ec) {
-                        return;
-                    }
+                    // a failed send only affects that one recipient
+                    m_server.send(*it,out,ec);
                 }
             } else {
                 // undefined.
@@ -8,29 +8,15 @@ struct connection_data {
 };
 
 struct custom_config : public websocketpp::config::asio {
-    // pull default settings from our core config
-    typedef websocketpp::config::asio core;
-    
-    typedef core::concurrency_type concurrency_type;
-    typedef core::request_type request_type;
-    typedef core::response_type response_type;
-    typedef core::message_type message_type;
-    typedef core::con_msg_manager_type con_msg_manager_type;
-    typedef core::endpoint_msg_manager_type endpoint_msg_manager_type;
-    typedef core::alog_type alog_type;
-    typedef core::elog_type elog_type;
-    typedef core::rng_type rng_type;
-    typedef core::transport_type transport_type;
-    typedef core::endpoint_base endpoint_base;
-    
-    // Set a custom connection_base class
-    typedef connection_data connection_base;
+    // Hold a connection_data inside each connection
+    typedef connection_data user_data_type;
 };
 
 typedef websocketpp::server<custom_config> server;
 typedef server::connection_ptr connection_ptr;
 
 using websocketpp::connection_hdl;
+using websocketpp::connection_hdl_ref;
 using websocketpp::lib::placeholders::_1;
 using websocketpp::lib::placeholders::_2;
 using websocketpp::lib::bind;
@@ -47,16 +33,16 @@ public:
     }
     
     void on_open(connection_hdl_ref hdl) {
-        connection_ptr con = m_server.get_con_from_hdl(hdl);
-        
-        con->sessionid = m_next_sessionid++;
+        connection_data & data = m_server.get_con_from_hdl(hdl)->get_user_data();
+
+        data.sessionid = m_next_sessionid++;
     }
     
     void on_close(connection_hdl_ref hdl) {
-        connection_ptr con = m_server.get_con_from_hdl(hdl);
-        
-        std::cout << "Closing connection " << con->name 
-                  << " with sessionid " << con->sessionid << std::endl;
+        connection_data & data = m_server.get_con_from_hdl(hdl)->get_user_data();
+
+        std::cout << "Closing connection " << data.name
+                  << " with sessionid " << data.sessionid << std::endl;
     }
 
     void on_end_accept(error_code lib_ec, error_code trans_ec) {
@@ -65,15 +51,15 @@ public:
     }
     
     void on_message(connection_hdl_ref hdl, server::message_ptr msg) {
-        connection_ptr con = m_server.get_con_from_hdl(hdl);
-        
-        if (con->name.empty()) {
-            con->name = msg->get_payload();
-            std::cout << "Setting name of connection with sessionid " 
-                      << con->sessionid << " to " << con->name << std::endl;
+        connection_data & data = m_server.get_con_from_hdl(hdl)->get_user_data();
+
+        if (data.name.empty()) {
+            data.name = msg->get_payload();
+            std::cout << "Setting name of connection with sessionid "
+                      << data.sessionid << " to " << data.name << std::endl;
         } else {
-            std::cout << "Got a message from connection " << con->name 
-                      << " with sessionid " << con->sessionid << std::endl;
+            std::cout << "Got a message from connection " << data.name
+                      << " with sessionid " << data.sessionid << std::endl;
         }
     }
     
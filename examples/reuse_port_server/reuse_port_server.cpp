@@ -0,0 +1,81 @@
+#include <websocketpp/config/asio_no_tls.hpp>
+
+#include <websocketpp/server.hpp>
+
+#include <websocketpp/common/thread.hpp>
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+// Each thread owns one endpoint, one io_context and one SO_REUSEPORT
+// acceptor bound to the same port. The kernel spreads incoming connections
+// across the acceptors so a connection is accepted, read, written and closed
+// on a single thread. Nothing is shared between the endpoints, so none of
+// them need to be run by more than one thread.
+
+typedef websocketpp::server<websocketpp::config::asio> server;
+
+using websocketpp::lib::placeholders::_1;
+using websocketpp::lib::placeholders::_2;
+using websocketpp::lib::bind;
+
+void on_message(server * s, size_t id, websocketpp::connection_hdl_ref hdl,
+    server::message_ptr msg)
+{
+    std::stringstream reply;
+    reply << "shard " << id << ": " << msg->get_payload();
+
+    websocketpp::lib::error_code ec;
+    s->send(hdl, reply.str(), msg->get_opcode(), ec);
+    if (ec) {
+        std::cout << "Echo failed because: " << ec.message() << std::endl;
+    }
+}
+
+void run_endpoint(server * s) {
+    try {
+        s->run();
+    } catch (websocketpp::exception const & e) {
+        std::cout << e.what() << std::endl;
+    }
+}
+
+int main() {
+    size_t shards = websocketpp::lib::thread::hardware_concurrency();
+    if (shards == 0) {
+        shards = 1;
+    }
+
+    std::vector<server> endpoints(shards);
+    std::vector<websocketpp::lib::thread> threads;
+
+    try {
+        for (size_t i = 0; i < shards; ++i) {
+            server & s = endpoints[i];
+
+            s.clear_access_channels(websocketpp::log::alevel::all);
+            s.set_access_channels(websocketpp::log::alevel::connect |
+                websocketpp::log::alevel::disconnect);
+
+            s.init_asio();
+            s.set_reuse_port(true);
+            s.set_message_handler(bind(&on_message,&s,i,::_1,::_2));
+
+            s.listen(9002);
+            s.start_accept();
+        }
+    } catch (websocketpp::exception const & e) {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+
+    for (size_t i = 0; i < shards; ++i) {
+        threads.push_back(websocketpp::lib::thread(&run_endpoint,
+            &endpoints[i]));
+    }
+
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+}
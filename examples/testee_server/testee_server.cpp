@@ -25,35 +25,42 @@
  *
  */
 
-#include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/config/asio.hpp>
 #include <websocketpp/server.hpp>
 #include <websocketpp/extensions/permessage_deflate/enabled.hpp>
 #include <iostream>
+#include <string>
 
-struct testee_config : public websocketpp::config::asio {
+// Usage: testee_server [port threads [cert.pem key.pem]]
+//
+// With a certificate and key the server speaks TLS, for the wss runs of
+// benchmarks/autobahn.
+
+template <typename base>
+struct testee_config : public base {
     // pull default settings from our core config
-    typedef websocketpp::config::asio core;
+    typedef base core;
 
-    typedef core::concurrency_type concurrency_type;
-    typedef core::request_type request_type;
-    typedef core::response_type response_type;
-    typedef core::message_type message_type;
-    typedef core::con_msg_manager_type con_msg_manager_type;
-    typedef core::endpoint_msg_manager_type endpoint_msg_manager_type;
+    typedef typename core::concurrency_type concurrency_type;
+    typedef typename core::request_type request_type;
+    typedef typename core::response_type response_type;
+    typedef typename core::message_type message_type;
+    typedef typename core::con_msg_manager_type con_msg_manager_type;
+    typedef typename core::endpoint_msg_manager_type endpoint_msg_manager_type;
 
-    typedef core::alog_type alog_type;
-    typedef core::elog_type elog_type;
-    typedef core::rng_type rng_type;
-    typedef core::endpoint_base endpoint_base;
+    typedef typename core::alog_type alog_type;
+    typedef typename core::elog_type elog_type;
+    typedef typename core::rng_type rng_type;
+    typedef typename core::endpoint_base endpoint_base;
 
     static bool const enable_multithreading = true;
 
     struct transport_config : public core::transport_config {
-        typedef core::concurrency_type concurrency_type;
-        typedef core::elog_type elog_type;
-        typedef core::alog_type alog_type;
-        typedef core::request_type request_type;
-        typedef core::response_type response_type;
+        typedef typename core::concurrency_type concurrency_type;
+        typedef typename core::elog_type elog_type;
+        typedef typename core::alog_type alog_type;
+        typedef typename core::request_type request_type;
+        typedef typename core::response_type response_type;
 
         static bool const enable_multithreading = true;
     };
@@ -73,18 +80,23 @@ struct testee_config : public websocketpp::config::asio {
         <permessage_deflate_config> permessage_deflate_type;
 };
 
-typedef websocketpp::server<testee_config> server;
+typedef websocketpp::server<testee_config<websocketpp::config::asio> > server;
+typedef websocketpp::server<testee_config<websocketpp::config::asio_tls> >
+    tls_server;
 
 using websocketpp::lib::placeholders::_1;
 using websocketpp::lib::placeholders::_2;
 using websocketpp::lib::bind;
 using websocketpp::lib::error_code;
 
-// pull out the type of messages sent by our config
-typedef server::message_ptr message_ptr;
+typedef websocketpp::lib::shared_ptr<websocketpp::lib::asio::ssl::context>
+    context_ptr;
 
 // Define a callback to handle incoming messages
-void on_message(server* s, websocketpp::connection_hdl_ref hdl, message_ptr msg) {
+template <typename endpoint_type>
+void on_message(endpoint_type* s, websocketpp::connection_hdl_ref hdl,
+    typename endpoint_type::message_ptr msg)
+{
     s->send(hdl, msg->get_payload(), msg->get_opcode());
 }
 
@@ -93,59 +105,91 @@ void on_socket_init(websocketpp::connection_hdl_ref, boost::asio::ip::tcp::socke
     s.set_option(option);
 }
 
+void on_tls_socket_init(websocketpp::connection_hdl_ref,
+    websocketpp::lib::asio::ssl::stream<boost::asio::ip::tcp::socket> & s)
+{
+    boost::asio::ip::tcp::no_delay option(true);
+    s.lowest_layer().set_option(option);
+}
+
+context_ptr on_tls_init(std::string const & cert, std::string const & key,
+    websocketpp::connection_hdl_ref)
+{
+    namespace asio = websocketpp::lib::asio;
+
+    context_ptr ctx = websocketpp::lib::make_shared<asio::ssl::context>(
+        asio::ssl::context::tls_server);
+    ctx->use_certificate_chain_file(cert);
+    ctx->use_private_key_file(key, asio::ssl::context::pem);
+    return ctx;
+}
+
 // Define a callback to handle failures accepting connections
 void on_end_accept(error_code lib_ec, error_code trans_ec) {
     std::cout << "Accept loop ended "
                 << lib_ec.message() << "/" << trans_ec.message() << std::endl;
 }
 
-int main(int argc, char * argv[]) {
-    // Create a server endpoint
-    server testee_server;
+template <typename endpoint_type>
+void run(endpoint_type & testee_server, short port, size_t num_threads) {
+    // Total silence
+    testee_server.clear_access_channels(websocketpp::log::alevel::all);
+    testee_server.clear_error_channels(websocketpp::log::alevel::all);
+
+    // Initialize ASIO
+    testee_server.init_asio();
+    testee_server.set_reuse_addr(true);
+
+    // Register our message handler
+    testee_server.set_message_handler(bind(&on_message<endpoint_type>,
+        &testee_server,::_1,::_2));
+
+    // Listen on specified port with extended listen backlog
+    testee_server.set_listen_backlog(8192);
+    testee_server.listen(port);
+
+    // Start the server accept loop
+    testee_server.start_accept(&on_end_accept);
+
+    // Start the ASIO io_context run loop
+    if (num_threads == 1) {
+        testee_server.run();
+    } else {
+        typedef websocketpp::lib::shared_ptr<websocketpp::lib::thread> thread_ptr;
+        std::vector<thread_ptr> ts;
+        for (size_t i = 0; i < num_threads; i++) {
+            ts.push_back(websocketpp::lib::make_shared<websocketpp::lib::thread>(&endpoint_type::run, &testee_server));
+        }
+
+        for (size_t i = 0; i < num_threads; i++) {
+            ts[i]->join();
+        }
+    }
+}
 
+int main(int argc, char * argv[]) {
     short port = 9002;
     size_t num_threads = 1;
 
-    if (argc == 3) {
+    if (argc == 3 || argc == 5) {
         port = atoi(argv[1]);
         num_threads = atoi(argv[2]);
     }
 
     try {
-        // Total silence
-        testee_server.clear_access_channels(websocketpp::log::alevel::all);
-        testee_server.clear_error_channels(websocketpp::log::alevel::all);
-
-        // Initialize ASIO
-        testee_server.init_asio();
-        testee_server.set_reuse_addr(true);
-
-        // Register our message handler
-        testee_server.set_message_handler(bind(&on_message,&testee_server,::_1,::_2));
-        testee_server.set_socket_init_handler(bind(&on_socket_init,::_1,::_2));
-
-        // Listen on specified port with extended listen backlog
-        testee_server.set_listen_backlog(8192);
-        testee_server.listen(port);
-
-        // Start the server accept loop
-        testee_server.start_accept(&on_end_accept);
-
-        // Start the ASIO io_context run loop
-        if (num_threads == 1) {
-            testee_server.run();
+        if (argc == 5) {
+            tls_server testee_server;
+            testee_server.set_tls_init_handler(bind(&on_tls_init,
+                std::string(argv[3]),std::string(argv[4]),::_1));
+            testee_server.set_socket_init_handler(bind(&on_tls_socket_init,
+                ::_1,::_2));
+            run(testee_server, port, num_threads);
         } else {
-            typedef websocketpp::lib::shared_ptr<websocketpp::lib::thread> thread_ptr;
-            std::vector<thread_ptr> ts;
-            for (size_t i = 0; i < num_threads; i++) {
-                ts.push_back(websocketpp::lib::make_shared<websocketpp::lib::thread>(&server::run, &testee_server));
-            }
-
-            for (size_t i = 0; i < num_threads; i++) {
-                ts[i]->join();
-            }
+            // Create a server endpoint
+            server testee_server;
+            testee_server.set_socket_init_handler(bind(&on_socket_init,::_1,::_2));
+            run(testee_server, port, num_threads);
         }
-
     } catch (websocketpp::exception const & e) {
         std::cout << "exception: " << e.what() << std::endl;
     }
@@ -28,10 +28,36 @@
 #define BOOST_TEST_MODULE endpoint
 #include <boost/test/unit_test.hpp>
 
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <set>
 #include <sstream>
+#include <thread>
+#include <tuple>
+#include <unordered_set>
+#include <utility>
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/use_awaitable.hpp>
 
 #include <websocketpp/config/asio.hpp>
+#include <websocketpp/config/asio_no_tls_client.hpp>
+#include <websocketpp/config/core.hpp>
+#include <websocketpp/config/lean_server.hpp>
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+#include <websocketpp/http/view_request.hpp>
+#include <websocketpp/message_batch.hpp>
+#include <websocketpp/multiplex.hpp>
+#include <websocketpp/pubsub.hpp>
+#include <websocketpp/reconnect.hpp>
+#include <websocketpp/resume.hpp>
+#include <websocketpp/transport/iostream/netem.hpp>
+#include <websocketpp/awaitable.hpp>
+#include <websocketpp/client.hpp>
 #include <websocketpp/server.hpp>
 
 BOOST_AUTO_TEST_CASE( construct_server_iostream ) {
@@ -156,3 +182,5129 @@ BOOST_AUTO_TEST_CASE( listen_after_listen_failure ) {
     server2.listen(ep2, ec);
     BOOST_CHECK(!ec);
 }
+
+#ifdef SO_REUSEPORT
+BOOST_AUTO_TEST_CASE( listen_reuse_port ) {
+    websocketpp::server<websocketpp::config::asio> server1;
+    websocketpp::server<websocketpp::config::asio> server2;
+
+    websocketpp::lib::error_code ec;
+
+    server1.init_asio();
+    server2.init_asio();
+    server1.set_reuse_port(true);
+    server2.set_reuse_port(true);
+
+    boost::asio::ip::tcp::endpoint ep(boost::asio::ip::address::from_string("127.0.0.1"), 12346);
+
+    server1.listen(ep, ec);
+    BOOST_CHECK(!ec);
+
+    // both acceptors share the port
+    server2.listen(ep, ec);
+    BOOST_CHECK(!ec);
+}
+#endif
+
+BOOST_AUTO_TEST_CASE( single_threaded_io_skips_strand ) {
+    typedef websocketpp::server<websocketpp::config::asio> asio_server;
+
+    asio_server s;
+    s.init_asio();
+
+    asio_server::connection_ptr con = s.get_connection();
+    BOOST_REQUIRE( con );
+    BOOST_CHECK( con->get_strand() );
+
+    s.set_single_threaded_io(true);
+    con = s.get_connection();
+    BOOST_REQUIRE( con );
+    BOOST_CHECK( !con->get_strand() );
+}
+
+BOOST_AUTO_TEST_CASE( read_budget ) {
+    typedef websocketpp::server<websocketpp::config::asio> asio_server;
+
+    size_t const messages = 200;
+    size_t count = 0;
+
+    asio_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    BOOST_CHECK_EQUAL( s.get_read_budget(), 0 );
+    s.set_read_budget(1048576);
+    BOOST_CHECK_EQUAL( s.get_read_budget(), 1048576 );
+
+    s.set_message_handler([&count](websocketpp::connection_hdl,
+        asio_server::message_ptr msg)
+    {
+        if (msg->get_payload() == std::string(1000,'*')) {
+            ++count;
+        }
+    });
+
+    s.init_asio();
+    s.set_reuse_addr(true);
+    s.listen(12347);
+    s.start_accept();
+
+    boost::asio::io_context client_io;
+    boost::asio::ip::tcp::socket client(client_io);
+    client.connect(boost::asio::ip::tcp::endpoint(
+        boost::asio::ip::address::from_string("127.0.0.1"), 12347));
+
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    boost::asio::write(client, boost::asio::buffer(handshake));
+
+    boost::asio::streambuf response;
+    while (response.size() == 0) {
+        s.poll();
+        client.non_blocking(true);
+        boost::system::error_code ec;
+        boost::asio::read_until(client, response, "\r\n\r\n", ec);
+    }
+    client.non_blocking(false);
+
+    // masked (with a zero key) binary frames, written in one go so the server
+    // socket holds several read buffers worth at once
+    std::string frames;
+    for (size_t i = 0; i < messages; ++i) {
+        frames.append("\x82\xfe\x03\xe8\x00\x00\x00\x00",8);
+        frames.append(1000,'*');
+    }
+    boost::asio::write(client, boost::asio::buffer(frames));
+
+    for (size_t i = 0; i < 10000 && count < messages; ++i) {
+        s.poll();
+    }
+    BOOST_CHECK_EQUAL( count, messages );
+}
+
+BOOST_AUTO_TEST_CASE( prepare_broadcast ) {
+    websocketpp::server<websocketpp::config::core> s;
+    websocketpp::lib::error_code ec;
+
+    websocketpp::server<websocketpp::config::core>::message_ptr msg =
+        s.prepare_broadcast("Hello",websocketpp::frame::opcode::text,ec);
+
+    BOOST_REQUIRE( !ec );
+    BOOST_REQUIRE( msg );
+    BOOST_CHECK( msg->get_prepared() );
+    BOOST_CHECK( msg->get_broadcast() );
+    BOOST_CHECK_EQUAL( msg->get_header(), std::string("\x81\x05",2) );
+    BOOST_CHECK_EQUAL( msg->get_payload(), "Hello" );
+
+    std::string large(300,'*');
+    msg = s.prepare_broadcast(large,websocketpp::frame::opcode::binary,ec);
+    BOOST_REQUIRE( !ec );
+    BOOST_CHECK_EQUAL( msg->get_header(), std::string("\x82\x7E\x01\x2C",4) );
+    BOOST_CHECK_EQUAL( msg->get_payload(), large );
+}
+
+BOOST_AUTO_TEST_CASE( prepare_broadcast_errors ) {
+    websocketpp::server<websocketpp::config::core> s;
+    websocketpp::client<websocketpp::config::core> c;
+    websocketpp::lib::error_code ec;
+
+    s.prepare_broadcast("foo",websocketpp::frame::opcode::ping,ec);
+    BOOST_CHECK_EQUAL( ec, websocketpp::processor::error::make_error_code(
+        websocketpp::processor::error::invalid_opcode) );
+
+    s.prepare_broadcast("\xFF",websocketpp::frame::opcode::text,ec);
+    BOOST_CHECK_EQUAL( ec, websocketpp::processor::error::make_error_code(
+        websocketpp::processor::error::invalid_payload) );
+
+    c.prepare_broadcast("foo",websocketpp::frame::opcode::text,ec);
+    BOOST_CHECK_EQUAL( ec, websocketpp::error::make_error_code(
+        websocketpp::error::server_only) );
+}
+
+BOOST_AUTO_TEST_CASE( send_broadcast ) {
+    typedef websocketpp::server<websocketpp::config::core> server;
+
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    std::stringstream out1;
+    std::stringstream out2;
+    websocketpp::lib::error_code ec;
+
+    s.register_ostream(&out1);
+    server::connection_ptr con1 = s.get_connection(ec);
+    con1->start();
+    con1->read_some(handshake.data(),handshake.size());
+
+    s.register_ostream(&out2);
+    server::connection_ptr con2 = s.get_connection(ec);
+    con2->start();
+    con2->read_some(handshake.data(),handshake.size());
+
+    out1.str("");
+    out2.str("");
+
+    server::message_ptr msg = s.prepare_broadcast("Hello",
+        websocketpp::frame::opcode::text);
+
+    BOOST_CHECK( !con1->send(msg) );
+    BOOST_CHECK( !con2->send(msg) );
+
+    BOOST_CHECK_EQUAL( out1.str(), std::string("\x81\x05Hello",7) );
+    BOOST_CHECK_EQUAL( out2.str(), std::string("\x81\x05Hello",7) );
+}
+
+void record_view(std::string * out, websocketpp::connection_hdl,
+    websocketpp::frame::opcode::value, std::string_view payload)
+{
+    out->assign(payload.data(),payload.size());
+}
+
+BOOST_AUTO_TEST_CASE( message_view_handler ) {
+    typedef websocketpp::server<websocketpp::config::core> server;
+
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    // RFC6455 section 5.7 masked "Hello"
+    std::string frame("\x81\x85\x37\xfa\x21\x3d\x7f\x9f\x4d\x51\x58",11);
+
+    server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    std::string received;
+    s.set_message_view_handler(websocketpp::lib::bind(&record_view,&received,
+        websocketpp::lib::placeholders::_1,websocketpp::lib::placeholders::_2,
+        websocketpp::lib::placeholders::_3));
+
+    std::stringstream out;
+    websocketpp::lib::error_code ec;
+
+    s.register_ostream(&out);
+    server::connection_ptr con = s.get_connection(ec);
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    con->read_some(frame.data(),frame.size());
+
+    BOOST_CHECK_EQUAL( received, "Hello" );
+}
+
+BOOST_AUTO_TEST_CASE( slab_allocation ) {
+    typedef websocketpp::server<websocketpp::config::core> server;
+
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    BOOST_CHECK( !s.get_slab_allocation() );
+    s.set_slab_allocation(true);
+    BOOST_CHECK( s.get_slab_allocation() );
+
+    std::stringstream out;
+    s.register_ostream(&out);
+
+    websocketpp::lib::error_code ec;
+    server::connection_ptr con = s.get_connection(ec);
+    BOOST_REQUIRE( con );
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::open );
+
+    // the released connection's block is reused by the next connection
+    server::connection_type * first = con.get();
+    con.reset();
+    con = s.get_connection(ec);
+    BOOST_CHECK( con.get() == first );
+}
+
+BOOST_AUTO_TEST_CASE( reserve_capacity ) {
+    typedef websocketpp::server<websocketpp::config::core> server;
+    typedef websocketpp::slab_cache<
+        websocketpp::config::core::connection_read_buffer_size,
+        alignof(void *)> pool_type;
+
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_slab_allocation(true);
+    s.set_read_on_readiness(true);
+    s.set_timer_wheel(websocketpp::lib::make_shared<websocketpp::timer_wheel>(
+        1));
+    s.set_connection_registry(
+        websocketpp::lib::make_shared<server::registry_type>());
+
+    s.reserve(1000,10000,256);
+
+    // the read buffers this thread can cache are ready
+    size_t const max_free = pool_type::max_free;
+    BOOST_CHECK_EQUAL( pool_type::cached(), max_free );
+
+    // and connections still work as usual
+    std::stringstream out;
+    s.register_ostream(&out);
+
+    websocketpp::lib::error_code ec;
+    server::connection_ptr con = s.get_connection(ec);
+    BOOST_REQUIRE( con );
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::open );
+    BOOST_CHECK_EQUAL( s.get_connection_registry()->size(), 1u );
+}
+
+struct coalesce_config : public websocketpp::config::core {
+    static const size_t write_coalesce_threshold = 64;
+};
+
+typedef websocketpp::server<coalesce_config> coalesce_server;
+
+template <typename server_type>
+struct write_recorder {
+    write_recorder() : writes(0), con(NULL) {}
+
+    websocketpp::lib::error_code write(websocketpp::connection_hdl,
+        char const * buf, size_t len)
+    {
+        output.append(buf,len);
+        return websocketpp::lib::error_code();
+    }
+
+    websocketpp::lib::error_code vector_write(websocketpp::connection_hdl,
+        std::vector<websocketpp::transport::buffer> const & bufs)
+    {
+        buffer_counts.push_back(bufs.size());
+        for (size_t i = 0; i < bufs.size(); ++i) {
+            output.append(bufs[i].buf,bufs[i].len);
+        }
+
+        // queue up several messages while the first write is outstanding so
+        // that they are written as one batch
+        if (++writes == 1) {
+            con->send(std::string("one"),websocketpp::frame::opcode::text);
+            con->send(std::string("two"),websocketpp::frame::opcode::text);
+            con->send(std::string(100,'*'),websocketpp::frame::opcode::binary);
+            con->send(std::string("three"),websocketpp::frame::opcode::text);
+        }
+        return websocketpp::lib::error_code();
+    }
+
+    std::string output;
+    std::vector<size_t> buffer_counts;
+    size_t writes;
+    typename server_type::connection_type * con;
+};
+
+BOOST_AUTO_TEST_CASE( write_coalescing ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    coalesce_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    write_recorder<coalesce_server> r;
+    websocketpp::lib::error_code ec;
+    coalesce_server::connection_ptr con = s.get_connection(ec);
+    r.con = con.get();
+
+    con->set_write_handler(websocketpp::lib::bind(&write_recorder<coalesce_server>::write,&r,
+        websocketpp::lib::placeholders::_1,websocketpp::lib::placeholders::_2,
+        websocketpp::lib::placeholders::_3));
+    con->set_vector_write_handler(websocketpp::lib::bind(
+        &write_recorder<coalesce_server>::vector_write,&r,websocketpp::lib::placeholders::_1,
+        websocketpp::lib::placeholders::_2));
+
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    r.output.clear();
+
+    con->send(std::string("zero"),websocketpp::frame::opcode::text);
+
+    std::string expected = std::string("\x81\x04zero",6) +
+        std::string("\x81\x03one\x81\x03two",10) +
+        std::string("\x82\x64",2) + std::string(100,'*') +
+        std::string("\x81\x05three",7);
+
+    BOOST_CHECK_EQUAL( r.output, expected );
+
+    // [zero] then [one two] [header] [payload] [three]
+    BOOST_REQUIRE_EQUAL( r.buffer_counts.size(), 2 );
+    BOOST_CHECK_EQUAL( r.buffer_counts[0], 1 );
+    BOOST_CHECK_EQUAL( r.buffer_counts[1], 4 );
+
+    BOOST_CHECK_EQUAL( con->get_coalesced_messages(), 4 );
+    BOOST_CHECK_EQUAL( con->get_coalesced_bytes(), 6+10+7 );
+}
+
+BOOST_AUTO_TEST_CASE( write_header_in_place ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    coalesce_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    std::string output;
+    std::vector<size_t> buffer_counts;
+    coalesce_server::connection_ptr con = s.get_connection();
+    con->set_write_handler([&](websocketpp::connection_hdl, char const * buf,
+        size_t len)
+    {
+        output.append(buf, len);
+        return websocketpp::lib::error_code();
+    });
+    con->set_vector_write_handler([&](websocketpp::connection_hdl,
+        std::vector<websocketpp::transport::buffer> const & bufs)
+    {
+        buffer_counts.push_back(bufs.size());
+        for (size_t i = 0; i < bufs.size(); ++i) {
+            output.append(bufs[i].buf, bufs[i].len);
+        }
+        return websocketpp::lib::error_code();
+    });
+
+    con->start();
+    con->read_some(handshake.data(), handshake.size());
+    output.clear();
+
+    // a payload filled in place leaves with its header as one buffer
+    coalesce_server::message_ptr msg =
+        con->get_message(websocketpp::frame::opcode::binary, 0);
+    std::span<char> payload = msg->writable_payload(200);
+    std::fill(payload.begin(), payload.end(), '*');
+    BOOST_CHECK( !con->send(msg) );
+
+    // an ordinary payload keeps header and payload apart
+    con->send(std::string(200, '-'), websocketpp::frame::opcode::binary);
+
+    BOOST_CHECK_EQUAL( output, std::string("\x82\x7e\x00\xc8", 4) +
+        std::string(200, '*') + std::string("\x82\x7e\x00\xc8", 4) +
+        std::string(200, '-') );
+    BOOST_REQUIRE_EQUAL( buffer_counts.size(), 2u );
+    BOOST_CHECK_EQUAL( buffer_counts[0], 1u );
+    BOOST_CHECK_EQUAL( buffer_counts[1], 2u );
+}
+
+struct batch_config : public websocketpp::config::core {
+    static const size_t write_batch_max_messages = 2;
+    static const size_t write_batch_max_bytes = 100;
+};
+
+typedef websocketpp::server<batch_config> batch_server;
+
+BOOST_AUTO_TEST_CASE( write_batch_limits ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    batch_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    write_recorder<batch_server> r;
+    websocketpp::lib::error_code ec;
+    batch_server::connection_ptr con = s.get_connection(ec);
+    r.con = con.get();
+
+    con->set_write_handler(websocketpp::lib::bind(
+        &write_recorder<batch_server>::write,&r,
+        websocketpp::lib::placeholders::_1,websocketpp::lib::placeholders::_2,
+        websocketpp::lib::placeholders::_3));
+    con->set_vector_write_handler(websocketpp::lib::bind(
+        &write_recorder<batch_server>::vector_write,&r,
+        websocketpp::lib::placeholders::_1,websocketpp::lib::placeholders::_2));
+
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    r.output.clear();
+
+    con->send(std::string("zero"),websocketpp::frame::opcode::text);
+
+    std::string expected = std::string("\x81\x04zero",6) +
+        std::string("\x81\x03one\x81\x03two",10) +
+        std::string("\x82\x64",2) + std::string(100,'*') +
+        std::string("\x81\x05three",7);
+
+    BOOST_CHECK_EQUAL( r.output, expected );
+
+    // [zero] then [one two] (message limit) then [binary] (byte limit) then
+    // [three]
+    BOOST_REQUIRE_EQUAL( r.buffer_counts.size(), 4 );
+    BOOST_CHECK_EQUAL( r.buffer_counts[0], 2 );
+    BOOST_CHECK_EQUAL( r.buffer_counts[1], 4 );
+    BOOST_CHECK_EQUAL( r.buffer_counts[2], 2 );
+    BOOST_CHECK_EQUAL( r.buffer_counts[3], 2 );
+}
+
+struct read_buffer_config : public websocketpp::config::core {
+    static const size_t connection_read_buffer_size = 4096;
+    static const size_t connection_read_buffer_min_size = 1024;
+    static const size_t connection_read_buffer_shrink_reads = 2;
+};
+
+typedef websocketpp::server<read_buffer_config> read_buffer_server;
+
+BOOST_AUTO_TEST_CASE( adaptive_read_buffer ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    // masked (with a zero key) binary frame with a 5000 byte payload
+    std::string large = std::string("\x82\xfe\x13\x88\x00\x00\x00\x00",8) +
+        std::string(5000,'*');
+    // masked empty text frame
+    std::string small("\x81\x80\x00\x00\x00\x00",6);
+
+    read_buffer_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    std::stringstream output;
+    websocketpp::lib::error_code ec;
+    read_buffer_server::connection_ptr con = s.get_connection(ec);
+    con->register_ostream(&output);
+
+    BOOST_CHECK_EQUAL( con->get_read_buffer_size(), 0 );
+
+    con->start();
+    BOOST_CHECK_EQUAL( con->get_read_buffer_size(), 1024 );
+
+    con->read_some(handshake.data(),handshake.size());
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::open );
+    BOOST_CHECK_EQUAL( con->get_read_buffer_size(), 1024 );
+
+    // full reads double the buffer up to connection_read_buffer_size
+    BOOST_CHECK_EQUAL( con->read_all(large.data(),large.size()), large.size() );
+    BOOST_CHECK_EQUAL( con->get_read_buffer_size(), 4096 );
+
+    // repeated small reads halve it down to connection_read_buffer_min_size
+    con->read_some(small.data(),small.size());
+    BOOST_CHECK_EQUAL( con->get_read_buffer_size(), 4096 );
+    con->read_some(small.data(),small.size());
+    BOOST_CHECK_EQUAL( con->get_read_buffer_size(), 2048 );
+    con->read_some(small.data(),small.size());
+    con->read_some(small.data(),small.size());
+    BOOST_CHECK_EQUAL( con->get_read_buffer_size(), 1024 );
+    con->read_some(small.data(),small.size());
+    con->read_some(small.data(),small.size());
+    BOOST_CHECK_EQUAL( con->get_read_buffer_size(), 1024 );
+
+    // the buffer is released while reading is paused
+    con->pause_reading();
+    con->read_some(small.data(),small.size());
+    BOOST_CHECK_EQUAL( con->get_read_buffer_size(), 0 );
+
+    con->resume_reading();
+    BOOST_CHECK_EQUAL( con->get_read_buffer_size(), 1024 );
+}
+
+typedef websocketpp::server<websocketpp::config::core> core_server;
+
+struct message_counter {
+    message_counter() : count(0) {}
+
+    void on_message(websocketpp::connection_hdl, core_server::message_ptr msg) {
+        ++count;
+        payload = msg->get_payload();
+    }
+
+    size_t count;
+    std::string payload;
+};
+
+BOOST_AUTO_TEST_CASE( read_on_readiness ) {
+    typedef websocketpp::slab_cache<
+        websocketpp::config::core::connection_read_buffer_size,
+        alignof(void *)> pool_type;
+
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    // masked (with a zero key) text frame "foo"
+    std::string frame("\x81\x83\x00\x00\x00\x00" "foo",9);
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    BOOST_CHECK( !s.get_read_on_readiness() );
+    s.set_read_on_readiness(true);
+    BOOST_CHECK( s.get_read_on_readiness() );
+
+    message_counter mc;
+    s.set_message_handler(websocketpp::lib::bind(&message_counter::on_message,
+        &mc,websocketpp::lib::placeholders::_1,
+        websocketpp::lib::placeholders::_2));
+
+    std::stringstream output;
+    websocketpp::lib::error_code ec;
+    core_server::connection_ptr con = s.get_connection(ec);
+    con->register_ostream(&output);
+
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::open );
+
+    // idle connections hold no read buffer
+    BOOST_CHECK_EQUAL( con->get_read_buffer_size(), 0 );
+
+    // a frame split across two reads, the pooled buffer is returned in between
+    BOOST_CHECK_EQUAL( con->read_some(frame.data(),4), 4 );
+    BOOST_CHECK_EQUAL( mc.count, 0 );
+    size_t cached = pool_type::cached();
+    BOOST_CHECK( cached > 0 );
+
+    BOOST_CHECK_EQUAL( con->read_some(frame.data()+4,frame.size()-4),
+        frame.size()-4 );
+    BOOST_CHECK_EQUAL( mc.count, 1 );
+    BOOST_CHECK_EQUAL( mc.payload, "foo" );
+    BOOST_CHECK_EQUAL( pool_type::cached(), cached );
+    BOOST_CHECK_EQUAL( con->get_read_buffer_size(), 0 );
+
+    // pausing and resuming reading while a wait is outstanding
+    con->pause_reading();
+    con->resume_reading();
+    BOOST_CHECK_EQUAL( con->read_some(frame.data(),frame.size()), frame.size() );
+    BOOST_CHECK_EQUAL( mc.count, 2 );
+}
+
+struct batch_counter {
+    void on_batch(websocketpp::connection_hdl,
+        std::vector<core_server::message_ptr> & msgs)
+    {
+        sizes.push_back(msgs.size());
+        for (size_t i = 0; i < msgs.size(); ++i) {
+            payloads.push_back(msgs[i]->get_payload());
+        }
+    }
+
+    std::vector<size_t> sizes;
+    std::vector<std::string> payloads;
+};
+
+BOOST_AUTO_TEST_CASE( message_batch_handler ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    // masked (with a zero key) text frames "foo", "bar", "baz"
+    std::string frames = std::string("\x81\x83\x00\x00\x00\x00" "foo",9) +
+        std::string("\x81\x83\x00\x00\x00\x00" "bar",9) +
+        std::string("\x81\x83\x00\x00\x00\x00" "baz",9);
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    message_counter mc;
+    s.set_message_handler(websocketpp::lib::bind(&message_counter::on_message,
+        &mc,websocketpp::lib::placeholders::_1,
+        websocketpp::lib::placeholders::_2));
+
+    batch_counter bc;
+    s.set_message_batch_handler(websocketpp::lib::bind(&batch_counter::on_batch,
+        &bc,websocketpp::lib::placeholders::_1,
+        websocketpp::lib::placeholders::_2));
+
+    std::stringstream output;
+    websocketpp::lib::error_code ec;
+    core_server::connection_ptr con = s.get_connection(ec);
+    con->register_ostream(&output);
+
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+
+    // all messages completed by one read arrive in one call
+    con->read_some(frames.data(),frames.size());
+    BOOST_REQUIRE_EQUAL( bc.sizes.size(), 1 );
+    BOOST_CHECK_EQUAL( bc.sizes[0], 3 );
+
+    // a message split across reads is delivered with the read completing it
+    con->read_some(frames.data(),13);
+    BOOST_REQUIRE_EQUAL( bc.sizes.size(), 2 );
+    BOOST_CHECK_EQUAL( bc.sizes[1], 1 );
+    con->read_some(frames.data()+13,frames.size()-13);
+    BOOST_REQUIRE_EQUAL( bc.sizes.size(), 3 );
+    BOOST_CHECK_EQUAL( bc.sizes[2], 2 );
+
+    BOOST_REQUIRE_EQUAL( bc.payloads.size(), 6 );
+    BOOST_CHECK_EQUAL( bc.payloads[0], "foo" );
+    BOOST_CHECK_EQUAL( bc.payloads[2], "baz" );
+    BOOST_CHECK_EQUAL( bc.payloads[3], "foo" );
+    BOOST_CHECK_EQUAL( bc.payloads[5], "baz" );
+    BOOST_CHECK_EQUAL( mc.count, 0 );
+}
+
+struct dispatch_recorder {
+    void on_message(websocketpp::connection_hdl, core_server::message_ptr msg)
+    {
+        // slow enough for the reads to queue up behind the handler
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+        websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(lock);
+        payloads.push_back(msg->get_payload());
+        threads.insert(std::this_thread::get_id());
+        cond.notify_all();
+    }
+
+    void wait(size_t count) {
+        websocketpp::lib::unique_lock<websocketpp::lib::mutex> guard(lock);
+        cond.wait_for(guard, std::chrono::seconds(5), [this, count] {
+            return payloads.size() >= count;
+        });
+    }
+
+    websocketpp::lib::mutex lock;
+    websocketpp::lib::condition_variable cond;
+    std::vector<std::string> payloads;
+    std::set<std::thread::id> threads;
+};
+
+BOOST_AUTO_TEST_CASE( message_dispatch ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    // masked (with a zero key) text frames "foo", "bar", "baz"
+    std::string frames = std::string("\x81\x83\x00\x00\x00\x00" "foo",9) +
+        std::string("\x81\x83\x00\x00\x00\x00" "bar",9) +
+        std::string("\x81\x83\x00\x00\x00\x00" "baz",9);
+
+    websocketpp::lib::shared_ptr<websocketpp::worker_pool> pool =
+        websocketpp::lib::make_shared<websocketpp::worker_pool>(4);
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_message_dispatch(pool, 64);
+
+    dispatch_recorder r;
+    s.set_message_handler(websocketpp::lib::bind(
+        &dispatch_recorder::on_message,&r,websocketpp::lib::placeholders::_1,
+        websocketpp::lib::placeholders::_2));
+
+    std::stringstream output;
+    websocketpp::lib::error_code ec;
+    core_server::connection_ptr con = s.get_connection(ec);
+    con->register_ostream(&output);
+
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+
+    // reads return without waiting for the handler
+    con->read_some(frames.data(),frames.size());
+    con->read_some(frames.data(),frames.size());
+    r.wait(6);
+
+    websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(r.lock);
+    BOOST_REQUIRE_EQUAL( r.payloads.size(), 6 );
+    BOOST_CHECK_EQUAL( r.payloads[0], "foo" );
+    BOOST_CHECK_EQUAL( r.payloads[1], "bar" );
+    BOOST_CHECK_EQUAL( r.payloads[2], "baz" );
+    BOOST_CHECK_EQUAL( r.payloads[5], "baz" );
+    BOOST_CHECK( r.threads.count(std::this_thread::get_id()) == 0 );
+}
+
+struct lock_free_config : public websocketpp::config::core {
+    static const bool lock_free_send_queue = true;
+    static const size_t write_coalesce_threshold = 64;
+};
+
+typedef websocketpp::server<lock_free_config> lock_free_server;
+
+BOOST_AUTO_TEST_CASE( lock_free_send_queue ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    lock_free_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    write_recorder<lock_free_server> r;
+    websocketpp::lib::error_code ec;
+    lock_free_server::connection_ptr con = s.get_connection(ec);
+    r.con = con.get();
+
+    con->set_write_handler(websocketpp::lib::bind(
+        &write_recorder<lock_free_server>::write,&r,
+        websocketpp::lib::placeholders::_1,websocketpp::lib::placeholders::_2,
+        websocketpp::lib::placeholders::_3));
+    con->set_vector_write_handler(websocketpp::lib::bind(
+        &write_recorder<lock_free_server>::vector_write,&r,
+        websocketpp::lib::placeholders::_1,websocketpp::lib::placeholders::_2));
+
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    r.output.clear();
+
+    con->send(std::string("zero"),websocketpp::frame::opcode::text);
+
+    // messages queued during a write are prepared and batched in order
+    std::string expected = std::string("\x81\x04zero",6) +
+        std::string("\x81\x03one\x81\x03two",10) +
+        std::string("\x82\x64",2) + std::string(100,'*') +
+        std::string("\x81\x05three",7);
+
+    BOOST_CHECK_EQUAL( r.output, expected );
+    BOOST_REQUIRE_EQUAL( r.buffer_counts.size(), 2 );
+    BOOST_CHECK_EQUAL( r.buffer_counts[1], 4 );
+    BOOST_CHECK_EQUAL( con->get_buffered_amount(), 0 );
+
+    // framing errors are reported through the error log rather than send
+    r.output.clear();
+    BOOST_CHECK( !con->send(std::string("\xff"),
+        websocketpp::frame::opcode::text) );
+    BOOST_CHECK( r.output.empty() );
+
+    con->ping("ping");
+    BOOST_CHECK_EQUAL( r.output, std::string("\x89\x04ping",6) );
+    BOOST_CHECK_EQUAL( con->get_buffered_amount(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( lock_free_send_queue_threads ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    size_t const threads = 4;
+    size_t const messages = 2000;
+
+    lock_free_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    write_recorder<lock_free_server> r;
+    r.writes = 1; // don't queue the extra messages from vector_write
+    websocketpp::lib::error_code ec;
+    lock_free_server::connection_ptr con = s.get_connection(ec);
+
+    con->set_write_handler(websocketpp::lib::bind(
+        &write_recorder<lock_free_server>::write,&r,
+        websocketpp::lib::placeholders::_1,websocketpp::lib::placeholders::_2,
+        websocketpp::lib::placeholders::_3));
+    con->set_vector_write_handler(websocketpp::lib::bind(
+        &write_recorder<lock_free_server>::vector_write,&r,
+        websocketpp::lib::placeholders::_1,websocketpp::lib::placeholders::_2));
+
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    r.output.clear();
+
+    struct sender {
+        static void run(lock_free_server::connection_ptr con, char id,
+            size_t count)
+        {
+            for (size_t i = 0; i < count; ++i) {
+                std::string payload(1,id);
+                payload.append(reinterpret_cast<char const *>(&i),sizeof(i));
+                con->send(payload,websocketpp::frame::opcode::binary);
+            }
+        }
+    };
+
+    std::vector<websocketpp::lib::shared_ptr<websocketpp::lib::thread> > t;
+    for (size_t i = 0; i < threads; ++i) {
+        t.push_back(websocketpp::lib::make_shared<websocketpp::lib::thread>(
+            &sender::run,con,char(i),messages));
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        t[i]->join();
+    }
+
+    // every frame arrives whole and each sender's frames stay in order
+    size_t const frame_size = 2 + 1 + sizeof(size_t);
+    BOOST_REQUIRE_EQUAL( r.output.size(), threads * messages * frame_size );
+
+    std::vector<size_t> next(threads,0);
+    for (size_t pos = 0; pos < r.output.size(); pos += frame_size) {
+        BOOST_REQUIRE_EQUAL( r.output[pos], '\x82' );
+        size_t id = static_cast<size_t>(r.output[pos+2]);
+        BOOST_REQUIRE( id < threads );
+
+        size_t seq;
+        std::memcpy(&seq,r.output.data()+pos+3,sizeof(seq));
+        BOOST_REQUIRE_EQUAL( seq, next[id] );
+        ++next[id];
+    }
+    BOOST_CHECK_EQUAL( con->get_buffered_amount(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( deflate_memory_settings ) {
+    websocketpp::server<websocketpp::config::core> s;
+
+    BOOST_CHECK_EQUAL( s.get_deflate_mem_level(), 0 );
+    s.set_deflate_mem_level(2);
+    BOOST_CHECK_EQUAL( s.get_deflate_mem_level(), 2 );
+
+    BOOST_CHECK_EQUAL( s.get_deflate_idle_timeout(), 0 );
+    s.set_deflate_idle_timeout(30000);
+    BOOST_CHECK_EQUAL( s.get_deflate_idle_timeout(), 30000 );
+
+    BOOST_CHECK( !s.get_deflate_memory_budget() );
+    s.set_deflate_memory_limit(1048576);
+    BOOST_REQUIRE( s.get_deflate_memory_budget() );
+    BOOST_CHECK_EQUAL( s.get_deflate_memory_budget()->get_limit(), 1048576 );
+    s.set_deflate_memory_limit(0);
+    BOOST_CHECK( !s.get_deflate_memory_budget() );
+}
+
+BOOST_AUTO_TEST_CASE( inbound_memory_settings ) {
+    websocketpp::server<websocketpp::config::core> s;
+
+    BOOST_CHECK( !s.get_inbound_memory_budget() );
+    s.set_inbound_memory_limit(1048576);
+    BOOST_REQUIRE( s.get_inbound_memory_budget() );
+    BOOST_CHECK_EQUAL( s.get_inbound_memory_budget()->get_limit(), 1048576 );
+    s.set_inbound_memory_limit(0);
+    BOOST_CHECK( !s.get_inbound_memory_budget() );
+}
+
+BOOST_AUTO_TEST_CASE( memory_governor_settings ) {
+    websocketpp::server<websocketpp::config::core> s;
+
+    BOOST_CHECK( !s.get_memory_governor() );
+    s.set_memory_limit(1000);
+    BOOST_REQUIRE( s.get_memory_governor() );
+
+    websocketpp::memory_governor & g = *s.get_memory_governor();
+    BOOST_CHECK_EQUAL( g.get_limit(), 1000 );
+    BOOST_CHECK_EQUAL( g.get_granularity(), 3 );
+    BOOST_CHECK_EQUAL( g.get_threshold(
+        websocketpp::memory_pressure::pause_reads), 700 );
+    BOOST_CHECK_EQUAL( g.get_threshold(
+        websocketpp::memory_pressure::reject_handshakes), 1000 );
+
+    // compression contexts count towards the total
+    BOOST_REQUIRE( s.get_deflate_memory_budget() );
+    s.get_deflate_memory_budget()->acquire(100);
+    BOOST_CHECK_EQUAL( g.get_used(), 100 );
+    s.get_deflate_memory_budget()->release(100);
+
+    g.charge(0,850);
+    BOOST_CHECK_EQUAL( g.get_pressure(),
+        websocketpp::memory_pressure::shrink_compression );
+
+    int relieved = 0;
+    BOOST_CHECK( g.wait_for_relief([&relieved] {++relieved;}) );
+    g.charge(850,750);
+    BOOST_CHECK_EQUAL( relieved, 0 );
+    g.charge(750,600);
+    BOOST_CHECK_EQUAL( relieved, 1 );
+    BOOST_CHECK_EQUAL( g.get_pressure(), websocketpp::memory_pressure::normal );
+
+    // below the threshold nothing is stored
+    BOOST_CHECK( !g.wait_for_relief([&relieved] {++relieved;}) );
+    g.charge(600,0);
+    BOOST_CHECK_EQUAL( relieved, 1 );
+
+    s.set_memory_limit(0);
+    BOOST_CHECK( !s.get_memory_governor() );
+    BOOST_CHECK( !s.get_deflate_memory_budget() );
+}
+
+struct deflate_config : public websocketpp::config::core {
+    struct permessage_deflate_config {};
+
+    typedef websocketpp::extensions::permessage_deflate::enabled
+        <permessage_deflate_config> permessage_deflate_type;
+};
+
+typedef websocketpp::server<deflate_config> deflate_server;
+
+BOOST_AUTO_TEST_CASE( compression_policy ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+        "Sec-WebSocket-Extensions: permessage-deflate\r\n\r\n";
+
+    deflate_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    deflate_server::compression_policy policy;
+    policy.set_min_size(16);
+    policy.set_opcode(websocketpp::frame::opcode::binary,false);
+    s.set_compression_policy(policy);
+
+    std::stringstream output;
+    websocketpp::lib::error_code ec;
+    deflate_server::connection_ptr con = s.get_connection(ec);
+    con->register_ostream(&output);
+
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    BOOST_REQUIRE( output.str().find("permessage-deflate") != std::string::npos );
+
+    // too small
+    output.str("");
+    con->send(std::string("hi"),websocketpp::frame::opcode::text);
+    BOOST_CHECK_EQUAL( output.str(), std::string("\x81\x02hi",4) );
+
+    // compressed even though sent without the flag
+    output.str("");
+    con->send(std::string(100,'*').data(),100,websocketpp::frame::opcode::text);
+    BOOST_REQUIRE( !output.str().empty() );
+    BOOST_CHECK_EQUAL( output.str()[0], '\xc1' );
+    BOOST_CHECK( output.str().size() < 100 );
+
+    // binary excluded by opcode
+    output.str("");
+    con->send(std::string(100,'*'),websocketpp::frame::opcode::binary);
+    BOOST_REQUIRE( !output.str().empty() );
+    BOOST_CHECK_EQUAL( output.str().substr(0,2), std::string("\x82\x64",2) );
+}
+
+struct offload_recorder {
+    websocketpp::lib::error_code write(websocketpp::connection_hdl,
+        char const * buf, size_t len)
+    {
+        websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(lock);
+        output.append(buf,len);
+        cond.notify_all();
+        return websocketpp::lib::error_code();
+    }
+
+    // wait until `frames` whole frames have been written, returns them
+    std::vector<std::pair<uint8_t,std::string> > wait_frames(size_t frames) {
+        std::vector<std::pair<uint8_t,std::string> > ret;
+        websocketpp::lib::unique_lock<websocketpp::lib::mutex> guard(lock);
+        for (int tries = 0; tries < 500; ++tries) {
+            ret.clear();
+            size_t pos = 0;
+            while (pos + 2 <= output.size()) {
+                uint8_t b0 = output[pos];
+                uint64_t len = uint8_t(output[pos+1]) & 0x7f;
+                size_t header = 2;
+                if (len == 126 || len == 127) {
+                    size_t bytes = (len == 126 ? 2 : 8);
+                    if (pos + 2 + bytes > output.size()) {
+                        break;
+                    }
+                    len = 0;
+                    for (size_t i = 0; i < bytes; ++i) {
+                        len = (len << 8) | uint8_t(output[pos+2+i]);
+                    }
+                    header += bytes;
+                }
+                if (pos + header + len > output.size()) {
+                    break;
+                }
+                ret.push_back(std::make_pair(b0,output.substr(pos+header,len)));
+                pos += header + len;
+            }
+            if (ret.size() >= frames) {
+                break;
+            }
+            cond.wait_for(guard,std::chrono::milliseconds(10));
+        }
+        return ret;
+    }
+
+    websocketpp::lib::mutex lock;
+    websocketpp::lib::condition_variable cond;
+    std::string output;
+};
+
+std::string inflate_payload(std::string payload) {
+    payload.append("\x00\x00\xff\xff",4);
+
+    z_stream s;
+    s.zalloc = Z_NULL;
+    s.zfree = Z_NULL;
+    s.opaque = Z_NULL;
+    s.avail_in = 0;
+    s.next_in = Z_NULL;
+    inflateInit2(&s,-15);
+
+    std::string out;
+    unsigned char buf[16384];
+    s.avail_in = payload.size();
+    s.next_in = reinterpret_cast<unsigned char *>(&payload[0]);
+    do {
+        s.avail_out = sizeof(buf);
+        s.next_out = buf;
+        if (inflate(&s,Z_SYNC_FLUSH) < Z_OK) {
+            break;
+        }
+        out.append(reinterpret_cast<char *>(buf),sizeof(buf) - s.avail_out);
+    } while (s.avail_out == 0);
+
+    inflateEnd(&s);
+    return out;
+}
+
+BOOST_AUTO_TEST_CASE( compression_offload ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+        "Sec-WebSocket-Extensions: permessage-deflate; "
+        "server_no_context_takeover\r\n\r\n";
+
+    websocketpp::lib::shared_ptr<
+        websocketpp::extensions::permessage_deflate::compression_pool> pool =
+        websocketpp::lib::make_shared<
+        websocketpp::extensions::permessage_deflate::compression_pool>(4);
+
+    deflate_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_compression_offload(pool,1000,4096);
+
+    offload_recorder r;
+    websocketpp::lib::error_code ec;
+    deflate_server::connection_ptr con = s.get_connection(ec);
+    con->set_write_handler(websocketpp::lib::bind(
+        &offload_recorder::write,&r,
+        websocketpp::lib::placeholders::_1,websocketpp::lib::placeholders::_2,
+        websocketpp::lib::placeholders::_3));
+
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    {
+        websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(r.lock);
+        BOOST_REQUIRE( r.output.find("permessage-deflate") != std::string::npos );
+        r.output.clear();
+    }
+
+    std::string large;
+    for (size_t i = 0; large.size() < 100000; ++i) {
+        std::stringstream ss;
+        ss << "message " << i << " of many; ";
+        large += ss.str();
+    }
+    std::string medium = large.substr(0,5000);
+
+    // split in parts, whole on the pool, then one queued behind them
+    con->send(large,websocketpp::frame::opcode::text);
+    con->send(medium,websocketpp::frame::opcode::binary);
+    con->send(std::string("hi"),websocketpp::frame::opcode::text);
+
+    std::vector<std::pair<uint8_t,std::string> > frames = r.wait_frames(3);
+    BOOST_REQUIRE_EQUAL( frames.size(), 3 );
+
+    BOOST_CHECK_EQUAL( frames[0].first, 0xc1 );
+    BOOST_CHECK( frames[0].second.size() < large.size() / 2 );
+    BOOST_CHECK( inflate_payload(frames[0].second) == large );
+
+    BOOST_CHECK_EQUAL( frames[1].first, 0xc2 );
+    BOOST_CHECK( inflate_payload(frames[1].second) == medium );
+
+    BOOST_CHECK_EQUAL( frames[2].first, 0xc1 );
+    BOOST_CHECK_EQUAL( inflate_payload(frames[2].second), "hi" );
+}
+
+struct fragment_recorder {
+    fragment_recorder() : writes(0), con(NULL) {}
+
+    websocketpp::lib::error_code write(websocketpp::connection_hdl,
+        char const * buf, size_t len)
+    {
+        output.append(buf,len);
+
+        // while the first fragment is being written, queue a data message
+        // and a ping behind the rest of the fragments
+        if (++writes == 1) {
+            con->send(std::string("tail"),websocketpp::frame::opcode::text);
+            con->ping("p");
+        }
+        return websocketpp::lib::error_code();
+    }
+
+    std::string output;
+    size_t writes;
+    websocketpp::server<websocketpp::config::core>::connection_type * con;
+};
+
+BOOST_AUTO_TEST_CASE( fragmented_send ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    websocketpp::server<websocketpp::config::core> s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    BOOST_CHECK_EQUAL( s.get_fragment_size(), 0 );
+    s.set_fragment_size(10);
+    BOOST_CHECK_EQUAL( s.get_fragment_size(), 10 );
+
+    websocketpp::lib::error_code ec;
+    websocketpp::server<websocketpp::config::core>::connection_ptr con =
+        s.get_connection(ec);
+    BOOST_CHECK_EQUAL( con->get_fragment_size(), 10 );
+
+    fragment_recorder r;
+    r.con = con.get();
+    r.writes = 1;
+    con->set_write_handler(websocketpp::lib::bind(
+        &fragment_recorder::write,&r,
+        websocketpp::lib::placeholders::_1,websocketpp::lib::placeholders::_2,
+        websocketpp::lib::placeholders::_3));
+
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    r.output.clear();
+
+    // exactly the fragment size goes out whole
+    con->send(std::string(10,'a'),websocketpp::frame::opcode::binary);
+    BOOST_CHECK_EQUAL( r.output, "\x82\x0a" + std::string(10,'a') );
+
+    r.output.clear();
+    r.writes = 0;
+    std::string payload = "0123456789abcdefghijklmnopqrstuvwxy";
+    con->send(payload,websocketpp::frame::opcode::text);
+
+    std::string expected;
+    expected += "\x01\x0a" + payload.substr(0,10);
+    expected += "\x89\x01p";
+    expected += std::string("\x00\x0a",2) + payload.substr(10,10);
+    expected += std::string("\x00\x0a",2) + payload.substr(20,10);
+    expected += "\x80\x05" + payload.substr(30);
+    expected += "\x81\x04tail";
+    BOOST_CHECK_EQUAL( r.output, expected );
+    // one frame per write, each written as header then payload
+    BOOST_CHECK_EQUAL( r.writes, 12 );
+    BOOST_CHECK_EQUAL( con->get_buffered_amount(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( streamed_send ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    websocketpp::server<websocketpp::config::core> s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    std::stringstream output;
+    websocketpp::lib::error_code ec;
+    websocketpp::server<websocketpp::config::core>::connection_ptr con =
+        s.get_connection(ec);
+    con->register_ostream(&output);
+
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    output.str("");
+
+    websocketpp::server<websocketpp::config::core>::connection_type::stream_ptr
+        stream = con->create_stream(websocketpp::frame::opcode::text,ec);
+    BOOST_REQUIRE( !ec );
+    BOOST_REQUIRE( stream );
+    BOOST_CHECK( stream->is_writable() );
+
+    // one stream at a time
+    BOOST_CHECK( !con->create_stream(websocketpp::frame::opcode::text,ec) );
+    BOOST_CHECK_EQUAL( ec, websocketpp::error::invalid_state );
+
+    BOOST_CHECK( !stream->write(std::string("foo")) );
+    BOOST_CHECK_EQUAL( output.str(), "\x01\x03" "foo" );
+
+    // data waits for the stream, pings do not
+    output.str("");
+    con->send(std::string("held"),websocketpp::frame::opcode::text);
+    BOOST_CHECK_EQUAL( output.str(), "" );
+    con->ping("p");
+    BOOST_CHECK_EQUAL( output.str(), "\x89\x01p" );
+
+    output.str("");
+    BOOST_CHECK( !stream->write(std::string("bar")) );
+    BOOST_CHECK_EQUAL( output.str(), std::string("\x00\x03" "bar",5) );
+
+    output.str("");
+    BOOST_CHECK( !stream->finish() );
+    BOOST_CHECK_EQUAL( output.str(), std::string("\x80\x00\x81\x04held",8) );
+    BOOST_CHECK( stream->is_finished() );
+    BOOST_CHECK_EQUAL( stream->write(std::string("baz")),
+        websocketpp::error::invalid_state );
+
+    // a stream finished without any chunks is an empty message
+    stream = con->create_stream(websocketpp::frame::opcode::binary,ec);
+    BOOST_REQUIRE( !ec );
+    output.str("");
+    stream.reset();
+    BOOST_CHECK_EQUAL( output.str(), std::string("\x82\x00",2) );
+}
+
+BOOST_AUTO_TEST_CASE( streamed_send_compressed ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+        "Sec-WebSocket-Extensions: permessage-deflate; "
+        "server_no_context_takeover\r\n\r\n";
+
+    deflate_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    offload_recorder r;
+    websocketpp::lib::error_code ec;
+    deflate_server::connection_ptr con = s.get_connection(ec);
+    con->set_write_handler(websocketpp::lib::bind(
+        &offload_recorder::write,&r,
+        websocketpp::lib::placeholders::_1,websocketpp::lib::placeholders::_2,
+        websocketpp::lib::placeholders::_3));
+
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    BOOST_REQUIRE( r.output.find("permessage-deflate") != std::string::npos );
+    r.output.clear();
+
+    std::string chunk;
+    for (size_t i = 0; chunk.size() < 2000; ++i) {
+        std::stringstream ss;
+        ss << "row " << i << ", ";
+        chunk += ss.str();
+    }
+
+    deflate_server::connection_type::stream_ptr stream =
+        con->create_stream(websocketpp::frame::opcode::text,ec);
+    BOOST_REQUIRE( !ec );
+    BOOST_CHECK( !stream->write(chunk) );
+    BOOST_CHECK( !stream->write(chunk) );
+    BOOST_CHECK( !stream->write(chunk) );
+    con->send(std::string("after"),websocketpp::frame::opcode::text);
+    BOOST_CHECK( !stream->finish() );
+
+    std::vector<std::pair<uint8_t,std::string> > frames = r.wait_frames(5);
+    BOOST_REQUIRE_EQUAL( frames.size(), 5 );
+
+    // only the first frame has RSV1, later chunks refer back to earlier ones
+    BOOST_CHECK_EQUAL( frames[0].first, 0x41 );
+    BOOST_CHECK_EQUAL( frames[1].first, 0x00 );
+    BOOST_CHECK_EQUAL( frames[2].first, 0x00 );
+    BOOST_CHECK_EQUAL( frames[3].first, 0x80 );
+    BOOST_CHECK( frames[1].second.size() < chunk.size() / 4 );
+
+    std::string payload;
+    for (size_t i = 0; i < 4; ++i) {
+        payload += frames[i].second;
+    }
+    BOOST_CHECK( inflate_payload(payload) == chunk + chunk + chunk );
+
+    // the context was reset at the end of the stream
+    BOOST_CHECK_EQUAL( frames[4].first, 0xc1 );
+    BOOST_CHECK_EQUAL( inflate_payload(frames[4].second), "after" );
+}
+
+BOOST_AUTO_TEST_CASE( streamed_send_lock_free ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    lock_free_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    std::stringstream output;
+    websocketpp::lib::error_code ec;
+    lock_free_server::connection_ptr con = s.get_connection(ec);
+    con->register_ostream(&output);
+
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    output.str("");
+
+    lock_free_server::connection_type::stream_ptr stream =
+        con->create_stream(websocketpp::frame::opcode::binary,ec);
+    BOOST_REQUIRE( !ec );
+
+    // the writer holds back data popped between the stream's frames
+    BOOST_CHECK( !stream->write(std::string("foo")) );
+    con->send(std::string("held"),websocketpp::frame::opcode::text);
+    BOOST_CHECK( !stream->write(std::string("bar")) );
+    BOOST_CHECK( !stream->finish() );
+    con->send(std::string("next"),websocketpp::frame::opcode::text);
+
+    std::string expected = std::string("\x02\x03" "foo",5) +
+        std::string("\x00\x03" "bar",5) + std::string("\x80\x00",2) +
+        "\x81\x04held" + "\x81\x04next";
+    BOOST_CHECK_EQUAL( output.str(), expected );
+    BOOST_CHECK_EQUAL( con->get_buffered_amount(), 0 );
+}
+
+struct chunk_recorder {
+    void chunk(websocketpp::connection_hdl, websocketpp::frame::opcode::value,
+        std::string_view data, bool first, bool last)
+    {
+        std::stringstream ss;
+        ss << (first ? "[" : "") << data << (last ? "]" : "|");
+        output += ss.str();
+    }
+
+    std::string output;
+};
+
+BOOST_AUTO_TEST_CASE( message_chunk_handler ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+        "Sec-WebSocket-Extensions: permessage-deflate\r\n\r\n";
+    // RFC6455 section 5.7 masked "Hello"
+    std::string frame("\x81\x85\x37\xfa\x21\x3d\x7f\x9f\x4d\x51\x58",11);
+    // RFC7692 section 7.2.3.1 compressed "Hello", under an all zero mask
+    std::string compressed("\xc1\x87\x00\x00\x00\x00"
+        "\xf2\x48\xcd\xc9\xc9\x07\x00",13);
+
+    deflate_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    chunk_recorder r;
+    s.set_message_chunk_handler(websocketpp::lib::bind(&chunk_recorder::chunk,
+        &r,websocketpp::lib::placeholders::_1,
+        websocketpp::lib::placeholders::_2,websocketpp::lib::placeholders::_3,
+        websocketpp::lib::placeholders::_4,websocketpp::lib::placeholders::_5));
+
+    std::stringstream out;
+    websocketpp::lib::error_code ec;
+    deflate_server::connection_ptr con = s.get_connection(ec);
+    con->register_ostream(&out);
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    BOOST_REQUIRE( out.str().find("permessage-deflate") != std::string::npos );
+
+    // one chunk per read
+    con->read_some(frame.data(),8);
+    con->read_some(frame.data()+8,3);
+    BOOST_CHECK_EQUAL( r.output, "[He|llo]" );
+
+    r.output.clear();
+    con->read_some(compressed.data(),compressed.size());
+    BOOST_CHECK_EQUAL( r.output, "[Hello]" );
+}
+
+struct watermark_recorder {
+    watermark_recorder() : writes(0), high(0), drains(0), con(NULL) {}
+
+    websocketpp::lib::error_code write(websocketpp::connection_hdl,
+        char const *, size_t)
+    {
+        // while the first message is being written, queue three more
+        if (con && ++writes == 1) {
+            for (int i = 0; i < 3; ++i) {
+                con->send(std::string(10,'x'),
+                    websocketpp::frame::opcode::binary);
+            }
+            BOOST_CHECK( con->is_above_high_watermark() );
+        }
+        return websocketpp::lib::error_code();
+    }
+
+    void on_high(websocketpp::connection_hdl, size_t buffered) {
+        high = buffered;
+    }
+
+    void on_drain(websocketpp::connection_hdl) {
+        ++drains;
+    }
+
+    size_t writes;
+    size_t high;
+    size_t drains;
+    websocketpp::server<websocketpp::config::core>::connection_type * con;
+};
+
+BOOST_AUTO_TEST_CASE( send_watermarks ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    websocketpp::server<websocketpp::config::core> s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    // the low watermark is kept at or below the high one
+    s.set_send_watermarks(10,50);
+    BOOST_CHECK_EQUAL( s.get_low_watermark(), 10 );
+
+    s.set_send_watermarks(25,5);
+    BOOST_CHECK_EQUAL( s.get_high_watermark(), 25 );
+    BOOST_CHECK_EQUAL( s.get_low_watermark(), 5 );
+
+    watermark_recorder r;
+    s.set_high_watermark_handler(websocketpp::lib::bind(
+        &watermark_recorder::on_high,&r,
+        websocketpp::lib::placeholders::_1,websocketpp::lib::placeholders::_2));
+    s.set_drain_handler(websocketpp::lib::bind(
+        &watermark_recorder::on_drain,&r,websocketpp::lib::placeholders::_1));
+
+    websocketpp::lib::error_code ec;
+    websocketpp::server<websocketpp::config::core>::connection_ptr con =
+        s.get_connection(ec);
+    BOOST_CHECK_EQUAL( con->get_high_watermark(), 25 );
+
+    con->set_write_handler(websocketpp::lib::bind(
+        &watermark_recorder::write,&r,
+        websocketpp::lib::placeholders::_1,websocketpp::lib::placeholders::_2,
+        websocketpp::lib::placeholders::_3));
+
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    r.con = con.get();
+
+    con->send(std::string("first"),websocketpp::frame::opcode::text);
+
+    // crossed once with everything queued behind the first message, and
+    // drained once those were written
+    BOOST_CHECK_EQUAL( r.high, 30 );
+    BOOST_CHECK_EQUAL( r.drains, 1 );
+    BOOST_CHECK( !con->is_above_high_watermark() );
+    BOOST_CHECK_EQUAL( con->get_buffered_amount(), 0 );
+}
+
+struct message_keeper {
+    void on_message(websocketpp::connection_hdl, core_server::message_ptr msg) {
+        messages.push_back(msg);
+    }
+
+    std::vector<core_server::message_ptr> messages;
+};
+
+BOOST_AUTO_TEST_CASE( inbound_flow_control ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    // masked (with a zero key) text frame "foo"
+    std::string frame("\x81\x83\x00\x00\x00\x00" "foo",9);
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_inbound_flow_control(2,0);
+
+    message_keeper mk;
+    s.set_message_handler(websocketpp::lib::bind(&message_keeper::on_message,
+        &mk,websocketpp::lib::placeholders::_1,
+        websocketpp::lib::placeholders::_2));
+
+    std::stringstream output;
+    websocketpp::lib::error_code ec;
+    core_server::connection_ptr con = s.get_connection(ec);
+    con->register_ostream(&output);
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+
+    BOOST_CHECK_EQUAL( con->read_some(frame.data(),frame.size()), 9 );
+    BOOST_CHECK_EQUAL( con->read_some(frame.data(),frame.size()), 9 );
+    BOOST_CHECK_EQUAL( con->get_unreleased_messages(), 2 );
+    BOOST_CHECK_EQUAL( con->get_unreleased_bytes(), 6 );
+
+    // paused at the limit, nothing is read
+    BOOST_CHECK_EQUAL( con->read_some(frame.data(),frame.size()), 0 );
+    BOOST_CHECK_EQUAL( mk.messages.size(), 2 );
+
+    BOOST_CHECK( !con->release_message(mk.messages[0]) );
+    BOOST_CHECK_EQUAL( con->get_unreleased_messages(), 1 );
+    BOOST_CHECK_EQUAL( con->read_some(frame.data(),frame.size()), 9 );
+    BOOST_CHECK_EQUAL( mk.messages.size(), 3 );
+
+    // a manual pause is not lifted by releasing
+    con->pause_reading();
+    BOOST_CHECK( !con->release_message(mk.messages[1]) );
+    BOOST_CHECK( !con->release_message(mk.messages[2]) );
+    BOOST_CHECK_EQUAL( con->get_unreleased_messages(), 0 );
+    BOOST_CHECK_EQUAL( con->read_some(frame.data(),frame.size()), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( inbound_rate_limit ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    // masked (with a zero key) text frame "foo"
+    std::string frame("\x81\x83\x00\x00\x00\x00" "foo",9);
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    core_server::timer_wheel_ptr wheel =
+        websocketpp::lib::make_shared<websocketpp::timer_wheel>(1);
+    s.set_timer_wheel(wheel);
+    s.set_inbound_rate_limit(2,0);
+
+    message_keeper mk;
+    s.set_message_handler(websocketpp::lib::bind(&message_keeper::on_message,
+        &mk,websocketpp::lib::placeholders::_1,
+        websocketpp::lib::placeholders::_2));
+
+    std::stringstream output;
+    websocketpp::lib::error_code ec;
+    core_server::connection_ptr con = s.get_connection(ec);
+    con->register_ostream(&output);
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    BOOST_CHECK( wheel->empty() );
+
+    // the burst allows one second's worth, the read going over is delivered
+    BOOST_CHECK_EQUAL( con->read_some(frame.data(),frame.size()), 9 );
+    BOOST_CHECK_EQUAL( con->read_some(frame.data(),frame.size()), 9 );
+    BOOST_CHECK( !con->is_rate_limited() );
+    BOOST_CHECK_EQUAL( con->read_some(frame.data(),frame.size()), 9 );
+    BOOST_CHECK_EQUAL( mk.messages.size(), 3 );
+    BOOST_CHECK( con->is_rate_limited() );
+    BOOST_CHECK_EQUAL( wheel->size(), 1 );
+
+    // paused until the debt is paid off
+    BOOST_CHECK_EQUAL( con->read_some(frame.data(),frame.size()), 0 );
+    wheel->advance(websocketpp::timer_wheel::clock::now() +
+        websocketpp::lib::chrono::seconds(1));
+    BOOST_CHECK( !con->is_rate_limited() );
+    BOOST_CHECK_EQUAL( con->read_some(frame.data(),frame.size()), 9 );
+    BOOST_CHECK_EQUAL( mk.messages.size(), 4 );
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::open );
+
+    // or closed with a policy violation
+    std::stringstream output2;
+    core_server::connection_ptr con2 = s.get_connection(ec);
+    con2->set_inbound_rate_limit(0, 12, websocketpp::rate_limit::close);
+    con2->register_ostream(&output2);
+    con2->start();
+    con2->read_some(handshake.data(),handshake.size());
+    output2.str("");
+    con2->read_some(frame.data(),frame.size());
+    BOOST_CHECK_EQUAL( con2->get_state(), websocketpp::session::state::open );
+    con2->read_some(frame.data(),frame.size());
+    BOOST_CHECK( con2->get_state() != websocketpp::session::state::open );
+    BOOST_CHECK_EQUAL( output2.str().substr(0,4), std::string("\x88\x15\x03\xf0",4) );
+}
+
+struct backlog_recorder {
+    backlog_recorder() : writes(0), ping(false), con(NULL) {}
+
+    websocketpp::lib::error_code write(websocketpp::connection_hdl,
+        char const * buf, size_t len)
+    {
+        if (!con) {
+            return websocketpp::lib::error_code();
+        }
+        output.append(buf,len);
+
+        // while the first message is being written, queue up a backlog
+        if (++writes == 1) {
+            for (size_t i = 0; i < backlog.size(); ++i) {
+                core_server::message_ptr msg = con->get_message(
+                    websocketpp::frame::opcode::text,3);
+                msg->append_payload(backlog[i].first);
+                msg->set_conflation_key(backlog[i].second);
+                if (i < priorities.size()) {
+                    msg->set_priority(priorities[i]);
+                }
+                con->send(msg);
+            }
+            if (ping) {
+                con->ping("p");
+            }
+        }
+        return websocketpp::lib::error_code();
+    }
+
+    std::string output;
+    size_t writes;
+    std::vector<std::pair<std::string,std::string> > backlog;
+    std::vector<websocketpp::priority::value> priorities;
+    bool ping;
+    core_server::connection_type * con;
+};
+
+static core_server::connection_ptr backlog_connection(core_server & s,
+    backlog_recorder & r)
+{
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    websocketpp::lib::error_code ec;
+    core_server::connection_ptr con = s.get_connection(ec);
+    con->set_write_handler(websocketpp::lib::bind(
+        &backlog_recorder::write,&r,
+        websocketpp::lib::placeholders::_1,websocketpp::lib::placeholders::_2,
+        websocketpp::lib::placeholders::_3));
+
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    r.con = con.get();
+    return con;
+}
+
+BOOST_AUTO_TEST_CASE( slow_consumer_drop_oldest ) {
+    core_server s;
+    s.set_slow_consumer_policy(websocketpp::slow_consumer::drop_oldest,7);
+    BOOST_CHECK_EQUAL( s.get_slow_consumer_policy(),
+        websocketpp::slow_consumer::drop_oldest );
+
+    backlog_recorder r;
+    r.backlog.push_back(std::make_pair("aaa",""));
+    r.backlog.push_back(std::make_pair("bbb",""));
+    r.backlog.push_back(std::make_pair("ccc",""));
+    core_server::connection_ptr con = backlog_connection(s,r);
+
+    con->send(std::string("x"),websocketpp::frame::opcode::text);
+
+    // at most 7 bytes stay queued, so "aaa" makes room for "ccc"
+    BOOST_CHECK_EQUAL( r.output, "\x81\x01x\x81\x03" "bbb\x81\x03" "ccc" );
+    BOOST_CHECK_EQUAL( con->get_dropped_messages(), 1 );
+}
+
+BOOST_AUTO_TEST_CASE( slow_consumer_conflate ) {
+    core_server s;
+    s.set_slow_consumer_policy(websocketpp::slow_consumer::conflate,0);
+
+    backlog_recorder r;
+    r.backlog.push_back(std::make_pair("a=1","a"));
+    r.backlog.push_back(std::make_pair("b=1","b"));
+    r.backlog.push_back(std::make_pair("a=2","a"));
+    r.backlog.push_back(std::make_pair("yyy",""));
+    core_server::connection_ptr con = backlog_connection(s,r);
+
+    con->send(std::string("x"),websocketpp::frame::opcode::text);
+
+    // the newest value per key is sent in place of the stale one
+    BOOST_CHECK_EQUAL( r.output, "\x81\x01x\x81\x03" "a=2\x81\x03" "b=1"
+        "\x81\x03yyy" );
+    BOOST_CHECK_EQUAL( con->get_dropped_messages(), 1 );
+}
+
+BOOST_AUTO_TEST_CASE( slow_consumer_disconnect ) {
+    core_server s;
+    s.set_slow_consumer_policy(websocketpp::slow_consumer::disconnect,5);
+
+    backlog_recorder r;
+    r.backlog.push_back(std::make_pair("aaa",""));
+    r.backlog.push_back(std::make_pair("bbb",""));
+    core_server::connection_ptr con = backlog_connection(s,r);
+
+    con->send(std::string("x"),websocketpp::frame::opcode::text);
+
+    // the backlog is still sent, followed by a 1008 close
+    BOOST_CHECK_EQUAL( r.output, "\x81\x01x\x81\x03" "aaa\x81\x03" "bbb"
+        "\x88\x0f\x03\xf0slow consumer" );
+    BOOST_CHECK( con->get_state() != websocketpp::session::state::open );
+}
+
+BOOST_AUTO_TEST_CASE( memory_governor_drops_slow_consumers ) {
+    core_server s;
+    s.set_memory_limit(10);
+
+    backlog_recorder r;
+    r.backlog.push_back(std::make_pair("aaa",""));
+    r.backlog.push_back(std::make_pair("bbb",""));
+    r.backlog.push_back(std::make_pair("ccc",""));
+    r.backlog.push_back(std::make_pair("ddd",""));
+    core_server::connection_ptr con = backlog_connection(s,r);
+
+    con->send(std::string("x"),websocketpp::frame::opcode::text);
+
+    // 9 queued bytes reach 90% of the limit, "aaa" makes room for "ddd"
+    BOOST_CHECK_EQUAL( r.output, "\x81\x01x\x81\x03" "bbb\x81\x03" "ccc"
+        "\x81\x03" "ddd" );
+    BOOST_CHECK_EQUAL( con->get_dropped_messages(), 1 );
+    BOOST_CHECK_EQUAL( s.get_memory_governor()->get_used(), 0 );
+}
+
+static core_server::connection_ptr governed_connection(core_server & s,
+    std::stringstream & output)
+{
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    websocketpp::lib::error_code ec;
+    core_server::connection_ptr con = s.get_connection(ec);
+    con->register_ostream(&output);
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    return con;
+}
+
+// masked (with a zero key) first fragment of a text message
+static std::string first_fragment(size_t len) {
+    std::string frame("\x01\xfe\x00\x00\x00\x00\x00\x00",8);
+    frame[2] = char(len >> 8);
+    frame[3] = char(len & 0xff);
+    return frame + std::string(len,'a');
+}
+
+BOOST_AUTO_TEST_CASE( memory_governor_pauses_largest_reader ) {
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_memory_limit(1000);
+
+    message_keeper mk;
+    s.set_message_handler(websocketpp::lib::bind(&message_keeper::on_message,
+        &mk,websocketpp::lib::placeholders::_1,
+        websocketpp::lib::placeholders::_2));
+
+    std::stringstream out1, out2;
+    core_server::connection_ptr con1 = governed_connection(s,out1);
+    core_server::connection_ptr con2 = governed_connection(s,out2);
+    BOOST_CHECK_EQUAL( s.get_memory_governor()->get_connections(), 2 );
+
+    std::string const part = first_fragment(400);
+    std::string const last("\x80\x81\x00\x00\x00\x00" "b",7);
+
+    BOOST_CHECK_EQUAL( con2->read_some(part.data(),part.size()),
+        part.size() );
+    BOOST_CHECK_EQUAL( con1->read_some(part.data(),part.size()),
+        part.size() );
+    BOOST_CHECK( s.get_memory_governor()->get_used() >= 800 );
+
+    // over 70% of the limit con1 holds its share, so it stops reading
+    BOOST_CHECK_EQUAL( con1->read_some(last.data(),last.size()), 0 );
+
+    // con2 finishing its message eases the pressure
+    BOOST_CHECK_EQUAL( con2->read_some(last.data(),last.size()),
+        last.size() );
+    BOOST_CHECK_EQUAL( con1->read_some(last.data(),last.size()),
+        last.size() );
+    BOOST_CHECK_EQUAL( mk.messages.size(), 2 );
+    BOOST_CHECK_EQUAL( s.get_memory_governor()->get_used(), 0 );
+
+    con1.reset();
+    con2.reset();
+    BOOST_CHECK_EQUAL( s.get_memory_governor()->get_connections(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( memory_governor_rejects_handshakes ) {
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_memory_limit(1000);
+
+    std::stringstream out1, out2;
+    core_server::connection_ptr con1 = governed_connection(s,out1);
+
+    std::string const part = first_fragment(1000);
+    con1->read_some(part.data(),part.size());
+    BOOST_CHECK_EQUAL( s.get_memory_governor()->get_pressure(),
+        websocketpp::memory_pressure::reject_handshakes );
+
+    core_server::connection_ptr con2 = governed_connection(s,out2);
+    BOOST_CHECK_EQUAL( out2.str().substr(0,12), "HTTP/1.1 503" );
+    BOOST_CHECK( out2.str().find("Retry-After: 1") != std::string::npos );
+}
+
+BOOST_AUTO_TEST_CASE( send_priorities ) {
+    core_server s;
+
+    backlog_recorder r;
+    r.backlog.push_back(std::make_pair("b1",""));
+    r.priorities.push_back(websocketpp::priority::bulk);
+    r.backlog.push_back(std::make_pair("b2",""));
+    r.priorities.push_back(websocketpp::priority::bulk);
+    r.backlog.push_back(std::make_pair("n1",""));
+    r.priorities.push_back(websocketpp::priority::normal);
+    r.backlog.push_back(std::make_pair("h1",""));
+    r.priorities.push_back(websocketpp::priority::high);
+    r.backlog.push_back(std::make_pair("h2",""));
+    r.priorities.push_back(websocketpp::priority::control);
+    r.ping = true;
+    core_server::connection_ptr con = backlog_connection(s,r);
+
+    con->send(std::string("x"),websocketpp::frame::opcode::text);
+
+    // the ping first, then one round of the default 4, 2 and 1 weights
+    BOOST_CHECK_EQUAL( r.output, "\x81\x01x\x89\x01p\x81\x02h1\x81\x02h2"
+        "\x81\x02n1\x81\x02" "b1\x81\x02" "b2" );
+}
+
+BOOST_AUTO_TEST_CASE( send_priority_weights ) {
+    core_server s;
+
+    backlog_recorder r;
+    r.backlog.push_back(std::make_pair("h1",""));
+    r.priorities.push_back(websocketpp::priority::high);
+    r.backlog.push_back(std::make_pair("h2",""));
+    r.priorities.push_back(websocketpp::priority::high);
+    r.backlog.push_back(std::make_pair("b1",""));
+    r.priorities.push_back(websocketpp::priority::bulk);
+    r.backlog.push_back(std::make_pair("b2",""));
+    r.priorities.push_back(websocketpp::priority::bulk);
+    core_server::connection_ptr con = backlog_connection(s,r);
+    con->set_priority_weights(1,1,1);
+
+    con->send(std::string("x"),websocketpp::frame::opcode::text);
+
+    // equal weights alternate between the lanes
+    BOOST_CHECK_EQUAL( r.output, "\x81\x01x\x81\x02h1\x81\x02" "b1"
+        "\x81\x02h2\x81\x02" "b2" );
+}
+
+BOOST_AUTO_TEST_CASE( timer_wheel_expiry ) {
+    typedef websocketpp::timer_wheel::clock clock;
+
+    websocketpp::timer_wheel w(1000);
+    int starts = 0;
+    int fired = 0;
+    w.set_start_handler([&] { ++starts; });
+
+    websocketpp::timer_wheel::entry a, b, c;
+    w.arm(a,2500,[&] { ++fired; });
+    w.arm(b,2500,[&] { fired += 10; });
+    BOOST_CHECK_EQUAL( starts, 1 );
+    BOOST_CHECK_EQUAL( w.size(), 2 );
+
+    // rounded up to whole ticks
+    clock::time_point start = clock::now();
+    BOOST_CHECK( w.advance(start + websocketpp::lib::chrono::milliseconds(1500)) );
+    BOOST_CHECK_EQUAL( fired, 0 );
+
+    BOOST_CHECK( b.cancel() );
+    BOOST_CHECK( !b.cancel() );
+    BOOST_CHECK( !w.advance(start + websocketpp::lib::chrono::milliseconds(4000)) );
+    BOOST_CHECK_EQUAL( fired, 1 );
+    BOOST_CHECK( w.empty() );
+
+    // far enough to start on a higher level and cascade down
+    w.arm(c,300000,[&] { ++fired; });
+    BOOST_CHECK_EQUAL( starts, 2 );
+    BOOST_CHECK( w.advance(start + websocketpp::lib::chrono::seconds(250)) );
+    BOOST_CHECK_EQUAL( fired, 1 );
+    BOOST_CHECK( !w.advance(start + websocketpp::lib::chrono::seconds(310)) );
+    BOOST_CHECK_EQUAL( fired, 2 );
+}
+
+struct pong_timeout_counter {
+    pong_timeout_counter() : timeouts(0) {}
+
+    void on_timeout(websocketpp::connection_hdl, std::string payload) {
+        ++timeouts;
+        BOOST_CHECK_EQUAL( payload, "p" );
+    }
+
+    int timeouts;
+};
+
+BOOST_AUTO_TEST_CASE( timer_wheel_timeouts ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    core_server::timer_wheel_ptr wheel =
+        websocketpp::lib::make_shared<websocketpp::timer_wheel>(1000);
+    s.set_timer_wheel(wheel);
+    BOOST_CHECK( s.get_timer_wheel() == wheel );
+    s.set_pong_timeout(5000);
+
+    pong_timeout_counter c;
+    s.set_pong_timeout_handler(websocketpp::lib::bind(
+        &pong_timeout_counter::on_timeout,&c,
+        websocketpp::lib::placeholders::_1,websocketpp::lib::placeholders::_2));
+
+    websocketpp::lib::error_code ec;
+    core_server::connection_ptr con = s.get_connection(ec);
+    std::stringstream output;
+    con->register_ostream(&output);
+    con->start();
+
+    // the open handshake timeout is armed on the wheel until the handshake
+    // completes
+    BOOST_CHECK_EQUAL( wheel->size(), 1 );
+    con->read_some(handshake.data(),handshake.size());
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::open );
+    BOOST_CHECK( wheel->empty() );
+
+    con->ping("p");
+    BOOST_CHECK_EQUAL( wheel->size(), 1 );
+
+    websocketpp::timer_wheel::clock::time_point now =
+        websocketpp::timer_wheel::clock::now();
+    wheel->advance(now + websocketpp::lib::chrono::seconds(3));
+    BOOST_CHECK_EQUAL( c.timeouts, 0 );
+    wheel->advance(now + websocketpp::lib::chrono::seconds(7));
+    BOOST_CHECK_EQUAL( c.timeouts, 1 );
+    BOOST_CHECK( wheel->empty() );
+}
+
+BOOST_AUTO_TEST_CASE( open_handler_sends_with_response ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    std::string welcome;
+    s.set_open_handler([&](websocketpp::connection_hdl hdl) {
+        if (!welcome.empty()) {
+            s.send(hdl, welcome, websocketpp::frame::opcode::text);
+        }
+    });
+
+    for (int i = 0; i < 2; ++i) {
+        welcome = i == 0 ? "hi" : "";
+
+        core_server::connection_ptr con = s.get_connection();
+        std::vector<std::string> writes;
+        con->set_write_handler([&](websocketpp::connection_hdl,
+            char const * buf, size_t len)
+        {
+            writes.push_back(std::string(buf, len));
+            return websocketpp::lib::error_code();
+        });
+        con->set_vector_write_handler([&](websocketpp::connection_hdl,
+            std::vector<websocketpp::transport::buffer> const & bufs)
+        {
+            std::string out;
+            for (size_t j = 0; j < bufs.size(); ++j) {
+                out.append(bufs[j].buf, bufs[j].len);
+            }
+            writes.push_back(out);
+            return websocketpp::lib::error_code();
+        });
+
+        con->start();
+        con->read_some(handshake.data(), handshake.size());
+        BOOST_REQUIRE_EQUAL( con->get_state(),
+            websocketpp::session::state::open );
+
+        // the welcome message leaves in the write of the 101 response
+        BOOST_REQUIRE_EQUAL( writes.size(), 1u );
+        BOOST_CHECK_EQUAL( writes[0].find("HTTP/1.1 101"), 0u );
+        BOOST_CHECK_EQUAL( writes[0].find("\r\n\r\n") + 4 ==
+            writes[0].size(), i == 1 );
+        if (i == 0) {
+            BOOST_CHECK_EQUAL( writes[0].substr(writes[0].size() - 4),
+                "\x81\x02" "hi" );
+        }
+        BOOST_CHECK( !con->is_corked() );
+
+        // later messages are written on their own
+        con->send(std::string("x"), websocketpp::frame::opcode::binary);
+        BOOST_REQUIRE_EQUAL( writes.size(), 2u );
+        BOOST_CHECK_EQUAL( writes[1], "\x82\x01" "x" );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( adaptive_send_coalescing ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    core_server::timer_wheel_ptr wheel =
+        websocketpp::lib::make_shared<websocketpp::timer_wheel>(1);
+    s.set_timer_wheel(wheel);
+    s.set_send_coalescing(50000, 1000);
+    BOOST_CHECK_EQUAL( s.get_send_coalescing_delay(), 50000 );
+
+    // the peer sends another message while each write is in progress
+    core_server::connection_ptr con = s.get_connection();
+    std::string output;
+    std::string follow_up;
+    auto write = [&](char const * buf, size_t len) {
+        output.append(buf, len);
+        if (!follow_up.empty()) {
+            std::string payload;
+            payload.swap(follow_up);
+            con->send(payload, websocketpp::frame::opcode::binary);
+        }
+        return websocketpp::lib::error_code();
+    };
+    con->set_write_handler([&](websocketpp::connection_hdl, char const * buf,
+        size_t len)
+    {
+        return write(buf, len);
+    });
+    con->set_vector_write_handler([&](websocketpp::connection_hdl,
+        std::vector<websocketpp::transport::buffer> const & bufs)
+    {
+        websocketpp::lib::error_code ec;
+        for (size_t i = 0; i < bufs.size(); ++i) {
+            ec = write(bufs[i].buf, bufs[i].len);
+        }
+        return ec;
+    });
+
+    con->start();
+    con->read_some(handshake.data(), handshake.size());
+    BOOST_REQUIRE_EQUAL( con->get_state(), websocketpp::session::state::open );
+    BOOST_CHECK_EQUAL( con->get_send_coalescing_delay(), 50000 );
+    output.clear();
+
+    // a small message queued behind a write waits for company
+    follow_up = "b";
+    con->send(std::string("a"), websocketpp::frame::opcode::binary);
+    BOOST_CHECK_EQUAL( output, "\x82\x01" "a" );
+    BOOST_CHECK_EQUAL( con->get_buffered_amount(), 1u );
+    BOOST_CHECK( !con->is_corked() );
+    BOOST_CHECK_EQUAL( wheel->size(), 1u );
+
+    // which it gets until the wait expires
+    con->send(std::string("c"), websocketpp::frame::opcode::binary);
+    BOOST_CHECK_EQUAL( con->get_buffered_amount(), 2u );
+    wheel->advance(websocketpp::timer_wheel::clock::now() +
+        websocketpp::lib::chrono::milliseconds(100));
+    BOOST_CHECK_EQUAL( output, "\x82\x01" "a" "\x82\x01" "b" "\x82\x01" "c" );
+    BOOST_CHECK_EQUAL( con->get_buffered_amount(), 0u );
+    output.clear();
+
+    // a control frame does not wait
+    follow_up = "d";
+    con->send(std::string("e"), websocketpp::frame::opcode::binary);
+    BOOST_CHECK_EQUAL( con->get_buffered_amount(), 1u );
+    con->ping("");
+    BOOST_CHECK_EQUAL( con->get_buffered_amount(), 0u );
+    BOOST_CHECK_EQUAL( output,
+        std::string("\x82\x01" "e" "\x89\x00" "\x82\x01" "d", 8) );
+    output.clear();
+
+    // nor do the bytes that would have gathered meanwhile
+    follow_up = "f";
+    con->send(std::string("g"), websocketpp::frame::opcode::binary);
+    BOOST_CHECK_EQUAL( con->get_buffered_amount(), 1u );
+    con->send(std::string(1000, 'h'), websocketpp::frame::opcode::binary);
+    BOOST_CHECK_EQUAL( con->get_buffered_amount(), 0u );
+}
+
+BOOST_AUTO_TEST_CASE( timer_wheel_asio_driver ) {
+    websocketpp::server<websocketpp::config::asio> s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.init_asio();
+
+    websocketpp::lib::shared_ptr<websocketpp::timer_wheel> wheel =
+        websocketpp::lib::make_shared<websocketpp::timer_wheel>(5);
+    s.drive_timer_wheel(wheel);
+
+    int fired = 0;
+    websocketpp::timer_wheel::entry e;
+    wheel->arm(e,20,[&] { ++fired; });
+
+    // returns once the wheel is idle
+    s.run();
+    BOOST_CHECK_EQUAL( fired, 1 );
+    BOOST_CHECK( wheel->empty() );
+}
+
+BOOST_AUTO_TEST_CASE( keepalive_pings ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    // masked empty pong from the client
+    std::string pong("\x8A\x80\x00\x00\x00\x00",6);
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    core_server::timer_wheel_ptr wheel =
+        websocketpp::lib::make_shared<websocketpp::timer_wheel>(100);
+    s.set_timer_wheel(wheel);
+    s.set_keepalive(1000);
+    BOOST_CHECK_EQUAL( s.get_keepalive_interval(), 1000 );
+
+    websocketpp::lib::error_code ec;
+    core_server::connection_ptr con = s.get_connection(ec);
+    BOOST_CHECK_EQUAL( con->get_keepalive_interval(), 1000 );
+    std::stringstream output;
+    con->register_ostream(&output);
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::open );
+
+    websocketpp::timer_wheel::clock::time_point now =
+        websocketpp::timer_wheel::clock::now();
+    output.str("");
+
+    // silent peer, so the first check pings it
+    wheel->advance(now + websocketpp::lib::chrono::milliseconds(1500));
+    BOOST_CHECK_EQUAL( output.str(), std::string("\x89\x00",2) );
+    BOOST_CHECK_EQUAL( con->get_rtt(), 0 );
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    con->read_some(pong.data(),pong.size());
+    BOOST_CHECK( con->get_rtt() >= 2000 );
+
+    // anything read since the last check postpones the next ping
+    output.str("");
+    wheel->advance(now + websocketpp::lib::chrono::milliseconds(2700));
+    BOOST_CHECK_EQUAL( output.str(), "" );
+
+    wheel->advance(now + websocketpp::lib::chrono::milliseconds(3900));
+    BOOST_CHECK_EQUAL( output.str(), std::string("\x89\x00",2) );
+}
+
+BOOST_AUTO_TEST_CASE( auto_pong_coalesces_pings ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    // masked pings from the client, with a zero mask
+    std::string ping_a("\x89\x81\x00\x00\x00\x00" "a",7);
+    std::string ping_bb("\x89\x82\x00\x00\x00\x00" "bb",8);
+    std::string ping_ccc("\x89\x83\x00\x00\x00\x00" "ccc",9);
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    core_server::connection_ptr con = s.get_connection();
+    std::stringstream output;
+    con->register_ostream(&output);
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::open );
+    output.str("");
+
+    // pings read while the pong is still queued get one pong, for the
+    // latest, ahead of the data queued before them
+    con->cork();
+    con->send("data");
+    con->read_some(ping_a.data(),ping_a.size());
+    con->read_some(ping_bb.data(),ping_bb.size());
+    con->read_some(ping_ccc.data(),ping_ccc.size());
+    BOOST_CHECK_EQUAL( output.str(), "" );
+    con->uncork();
+    BOOST_CHECK_EQUAL( output.str(), std::string("\x8A\x03" "ccc"
+        "\x81\x04" "data",11) );
+
+    // once written, the next ping gets a pong of its own
+    output.str("");
+    con->read_some(ping_a.data(),ping_a.size());
+    con->read_some(ping_bb.data(),ping_bb.size());
+    BOOST_CHECK_EQUAL( output.str(), std::string("\x8A\x01" "a"
+        "\x8A\x02" "bb",7) );
+}
+
+BOOST_AUTO_TEST_CASE( send_handler_reports_write ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    core_server::connection_ptr con = s.get_connection();
+    std::stringstream output;
+    con->register_ostream(&output);
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::open );
+    output.str("");
+
+    std::vector<websocketpp::lib::error_code> results;
+    core_server::connection_type::send_handler record =
+        [&results](websocketpp::lib::error_code const & ec) {
+            results.push_back(ec);
+        };
+
+    core_server::message_ptr msg = con->get_message(
+        websocketpp::frame::opcode::text,4);
+    msg->set_payload("sent");
+    BOOST_CHECK( !con->send(msg,record) );
+    BOOST_REQUIRE_EQUAL( results.size(), 1 );
+    BOOST_CHECK( !results[0] );
+    BOOST_CHECK_EQUAL( output.str(), std::string("\x81\x04" "sent",6) );
+
+    // a message still queued when the connection ends is canceled
+    con->cork();
+    msg = con->get_message(websocketpp::frame::opcode::text,4);
+    msg->set_payload("left");
+    BOOST_CHECK( !con->send(msg,record) );
+    BOOST_CHECK_EQUAL( results.size(), 1 );
+    con->eof();
+    BOOST_REQUIRE_EQUAL( results.size(), 2 );
+    BOOST_CHECK_EQUAL( results[1], websocketpp::error::operation_canceled );
+}
+
+struct release_handshake_config : public websocketpp::config::core {
+    static const bool release_handshake = true;
+    static constexpr char const * retained_request_headers =
+        "x-session, Origin";
+};
+
+BOOST_AUTO_TEST_CASE( release_handshake_after_open ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+        "X-Session: 42\r\n\r\n";
+
+    typedef websocketpp::server<release_handshake_config> server_type;
+    server_type s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    std::string host_in_open;
+    s.set_open_handler([&](websocketpp::connection_hdl hdl) {
+        host_in_open = s.get_con_from_hdl(hdl)->get_request_header("Host");
+    });
+
+    server_type::connection_ptr con = s.get_connection();
+    std::stringstream output;
+    con->register_ostream(&output);
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::open );
+
+    // the whole handshake is available to the open handler
+    BOOST_CHECK_EQUAL( host_in_open, "www.example.com" );
+
+    // afterwards only the retained headers are
+    BOOST_CHECK_EQUAL( con->get_request_header("Host"), "" );
+    BOOST_CHECK_EQUAL( con->get_request_header("X-Session"), "42" );
+    BOOST_CHECK_EQUAL( con->get_request_header("Origin"), "" );
+    BOOST_CHECK_EQUAL( con->get_response_header("Upgrade"), "" );
+}
+
+BOOST_AUTO_TEST_CASE( http_keep_alive_pipelined ) {
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_max_http_requests(3);
+    s.set_http_handler([&](websocketpp::connection_hdl hdl) {
+        core_server::connection_ptr con = s.get_con_from_hdl(hdl);
+        con->set_status(websocketpp::http::status_code::ok);
+        con->set_body(con->get_resource(), websocketpp::http::body_options());
+    });
+
+    std::stringstream output;
+    core_server::connection_ptr con = s.get_connection();
+    con->register_ostream(&output);
+    con->start();
+
+    // two pipelined requests in one read, both answered on this connection
+    std::string requests = "GET /a HTTP/1.1\r\nHost: www.example.com\r\n\r\n"
+        "GET /b HTTP/1.1\r\nHost: www.example.com\r\n\r\n";
+    con->read_some(requests.data(), requests.size());
+    BOOST_CHECK_EQUAL( con->get_http_request_count(), 2u );
+    BOOST_CHECK_EQUAL( con->get_state(),
+        websocketpp::session::state::connecting );
+    std::string out = output.str();
+    BOOST_CHECK( out.find("\r\n\r\n/a") != std::string::npos );
+    BOOST_CHECK( out.find("\r\n\r\n/b") != std::string::npos );
+    BOOST_CHECK( out.find("Connection: close") == std::string::npos );
+    output.str("");
+
+    // the last request allowed closes the connection
+    std::string last = "GET /c HTTP/1.1\r\nHost: www.example.com\r\n\r\n";
+    con->read_some(last.data(), last.size());
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::closed );
+    out = output.str();
+    BOOST_CHECK( out.find("Connection: close") != std::string::npos );
+    BOOST_CHECK( out.find("\r\n\r\n/c") != std::string::npos );
+
+    // a kept alive connection may still upgrade
+    output.str("");
+    con = s.get_connection();
+    con->register_ostream(&output);
+    con->start();
+    std::string upgrade = "GET /health HTTP/1.1\r\nHost: www.example.com\r\n\r\n"
+        "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    con->read_some(upgrade.data(), upgrade.size());
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::open );
+    BOOST_CHECK( output.str().find("HTTP/1.1 101") != std::string::npos );
+
+    // HTTP/1.0 closes unless asked to keep the connection
+    output.str("");
+    con = s.get_connection();
+    con->register_ostream(&output);
+    con->start();
+    std::string old = "GET /d HTTP/1.0\r\nHost: www.example.com\r\n\r\n";
+    con->read_some(old.data(), old.size());
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::closed );
+}
+
+BOOST_AUTO_TEST_CASE( http_streamed_chunked_response ) {
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_max_http_requests(2);
+
+    websocketpp::connection_hdl deferred;
+    s.set_http_handler([&](websocketpp::connection_hdl hdl) {
+        core_server::connection_ptr con = s.get_con_from_hdl(hdl);
+        if (con->get_resource() == "/later") {
+            con->defer_http_response();
+            deferred = hdl;
+            return;
+        }
+        con->set_status(websocketpp::http::status_code::ok);
+        con->write_http_headers();
+        con->write_http_body("hello", 5);
+        con->write_http_body("", 0);
+        con->write_http_body(" world, streamed", 16);
+        con->end_http_response();
+    });
+
+    std::stringstream output;
+    core_server::connection_ptr con = s.get_connection();
+    con->register_ostream(&output);
+    con->start();
+
+    std::string request = "GET / HTTP/1.1\r\nHost: www.example.com\r\n\r\n";
+    con->read_some(request.data(), request.size());
+    std::string out = output.str();
+    BOOST_CHECK( out.find("Transfer-Encoding: chunked\r\n") !=
+        std::string::npos );
+    BOOST_CHECK( out.find("Content-Length") == std::string::npos );
+    BOOST_CHECK( out.find("\r\n\r\n5\r\nhello\r\n10\r\n"
+        " world, streamed\r\n0\r\n\r\n") != std::string::npos );
+
+    // the chunked body let the connection stay open for one more request
+    BOOST_CHECK_EQUAL( con->get_state(),
+        websocketpp::session::state::connecting );
+
+    // deferred, streamed later, then the last request closes the connection
+    output.str("");
+    std::string later = "GET /later HTTP/1.1\r\nHost: www.example.com\r\n\r\n";
+    con->read_some(later.data(), later.size());
+    BOOST_CHECK( output.str().empty() );
+
+    websocketpp::lib::error_code ec;
+    con->write_http_body("x", 1, ec);
+    BOOST_CHECK_EQUAL( ec, websocketpp::error::make_error_code(
+        websocketpp::error::invalid_state) );
+
+    con->set_status(websocketpp::http::status_code::ok);
+    con->set_body("abc", websocketpp::http::body_options());
+    con->write_http_headers(ec);
+    BOOST_CHECK( !ec );
+    con->end_http_response(ec);
+    BOOST_CHECK( !ec );
+    out = output.str();
+
+    // set_body gave the response a length, so its body is written as is
+    BOOST_CHECK( out.find("Connection: close") != std::string::npos );
+    BOOST_CHECK( out.find("Content-Length: 3\r\n") != std::string::npos );
+    BOOST_CHECK( out.find("chunked") == std::string::npos );
+    BOOST_CHECK_EQUAL( out.substr(out.size() - 7), "\r\n\r\nabc" );
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::closed );
+
+    // HTTP/1.0 has no chunked encoding, the body ends with the connection
+    output.str("");
+    con = s.get_connection();
+    con->register_ostream(&output);
+    con->start();
+    std::string old = "GET / HTTP/1.0\r\nHost: www.example.com\r\n\r\n";
+    con->read_some(old.data(), old.size());
+    out = output.str();
+    BOOST_CHECK( out.find("chunked") == std::string::npos );
+    BOOST_CHECK( out.find("\r\n\r\nhello world, streamed") !=
+        std::string::npos );
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::closed );
+}
+
+BOOST_AUTO_TEST_CASE( http_response_cache_hits ) {
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_max_http_requests(2);
+
+    size_t handled = 0;
+    s.set_http_handler([&](websocketpp::connection_hdl hdl) {
+        ++handled;
+        core_server::connection_ptr con = s.get_con_from_hdl(hdl);
+        con->set_status(websocketpp::http::status_code::not_found);
+    });
+
+    websocketpp::http::parser::response page;
+    page.set_version("HTTP/1.1");
+    page.set_status(websocketpp::http::status_code::ok);
+    page.replace_header("Content-Type", "text/html");
+    page.set_body("<html>cached</html>");
+
+    core_server::response_cache_ptr cache =
+        websocketpp::lib::make_shared<websocketpp::http::response_cache>();
+    BOOST_CHECK( !cache->add("GET", "/index.html", page) );
+    BOOST_CHECK_EQUAL( cache->size(), 1u );
+    s.set_response_cache(cache);
+
+    std::stringstream output;
+    core_server::connection_ptr con = s.get_connection();
+    con->register_ostream(&output);
+    con->start();
+
+    std::string request = "GET /index.html HTTP/1.1\r\n"
+        "Host: www.example.com\r\n\r\n";
+    con->read_some(request.data(), request.size());
+    BOOST_CHECK_EQUAL( handled, 0u );
+    BOOST_CHECK_EQUAL( output.str(), page.raw() );
+    BOOST_CHECK_EQUAL( con->get_state(),
+        websocketpp::session::state::connecting );
+
+    // the last request allowed gets Connection: close in a copy
+    output.str("");
+    con->read_some(request.data(), request.size());
+    std::string out = output.str();
+    BOOST_CHECK_EQUAL( handled, 0u );
+    BOOST_CHECK( out.compare(0, 15, "HTTP/1.1 200 OK") == 0 );
+    BOOST_CHECK( out.find("Connection: close\r\n") != std::string::npos );
+    BOOST_CHECK_EQUAL( out.substr(out.size() - 23),
+        "\r\n\r\n<html>cached</html>" );
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::closed );
+
+    // misses and other methods go to the http handler
+    output.str("");
+    con = s.get_connection();
+    con->register_ostream(&output);
+    con->start();
+    std::string post = "POST /index.html HTTP/1.1\r\n"
+        "Host: www.example.com\r\nConnection: close\r\n\r\n";
+    con->read_some(post.data(), post.size());
+    BOOST_CHECK_EQUAL( handled, 1u );
+    BOOST_CHECK( output.str().find("404") != std::string::npos );
+
+#if WEBSOCKETPP_WITH_GZIP
+    // clients that accept gzip get the precompressed variant
+    page.set_body(std::string(4096, 'a'));
+    BOOST_CHECK( !cache->add("GET", "/big", page,
+        {websocketpp::http::content_encoding::gzip}) );
+
+    output.str("");
+    con = s.get_connection();
+    con->register_ostream(&output);
+    con->start();
+    std::string gzip = "GET /big HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Accept-Encoding: gzip\r\n\r\n";
+    con->read_some(gzip.data(), gzip.size());
+    out = output.str();
+    BOOST_CHECK( out.find("Content-Encoding: gzip\r\n") != std::string::npos );
+    BOOST_CHECK( out.find("Vary: Accept-Encoding\r\n") != std::string::npos );
+    BOOST_CHECK( out.size() < 4096 );
+
+    output.str("");
+    con = s.get_connection();
+    con->register_ostream(&output);
+    con->start();
+    std::string plain = "GET /big HTTP/1.1\r\nHost: www.example.com\r\n\r\n";
+    con->read_some(plain.data(), plain.size());
+    out = output.str();
+    BOOST_CHECK( out.find("Content-Encoding") == std::string::npos );
+    BOOST_CHECK( out.find("Content-Length: 4096\r\n") != std::string::npos );
+    BOOST_CHECK( cache->remove("GET", "/big") );
+#endif
+
+    BOOST_CHECK( cache->remove("GET", "/index.html") );
+    BOOST_CHECK( !cache->remove("GET", "/index.html") );
+    BOOST_CHECK_EQUAL( cache->size(), 0u );
+}
+
+BOOST_AUTO_TEST_CASE( extended_connect_stream ) {
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_validate_handler([&](websocketpp::connection_hdl hdl) {
+        core_server::connection_ptr con = s.get_con_from_hdl(hdl);
+        con->select_subprotocol("chat");
+        return con->get_resource() == "/chat" ?
+            websocketpp::session::validation::accept :
+            websocketpp::session::validation::reject;
+    });
+
+    std::string message;
+    s.set_message_handler([&](websocketpp::connection_hdl,
+        core_server::message_ptr msg)
+    {
+        message = msg->get_payload();
+    });
+
+    // the stream's header block, as handed over by an HTTP/2 stack
+    websocketpp::config::core::request_type req;
+    req.set_uri("/chat");
+    req.replace_header("Host", "www.example.com");
+    req.replace_header("Sec-WebSocket-Version", "13");
+    req.replace_header("Sec-WebSocket-Protocol", "chat");
+
+    std::stringstream output;
+    bool opened = false;
+    int status = 0;
+    std::string accept;
+    std::string protocol;
+    s.set_open_handler([&](websocketpp::connection_hdl) {
+        opened = true;
+    });
+
+    core_server::connection_ptr con = s.get_connection();
+    con->register_ostream(&output);
+    con->start_extended_connect(req, [&](websocketpp::connection_hdl hdl) {
+        core_server::connection_ptr c = s.get_con_from_hdl(hdl);
+        // the response comes before the stream is open
+        BOOST_CHECK( !opened );
+        status = c->get_response_code();
+        accept = c->get_response_header("Sec-WebSocket-Accept");
+        protocol = c->get_response_header("Sec-WebSocket-Protocol");
+    });
+
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::open );
+    BOOST_CHECK( opened );
+    BOOST_CHECK_EQUAL( status, websocketpp::http::status_code::ok );
+    BOOST_CHECK_EQUAL( accept, "" );
+    BOOST_CHECK_EQUAL( protocol, "chat" );
+    // nothing of the handshake reaches the stream's DATA
+    BOOST_CHECK_EQUAL( output.str(), "" );
+
+    std::string frame("\x81\x85\x00\x00\x00\x00hello", 11);
+    con->read_all(frame.data(), frame.size());
+    BOOST_CHECK_EQUAL( message, "hello" );
+
+    // rejected streams get their status and no open
+    req.set_uri("/other");
+    opened = false;
+    status = 0;
+    con = s.get_connection();
+    con->register_ostream(&output);
+    con->start_extended_connect(req, [&](websocketpp::connection_hdl hdl) {
+        status = s.get_con_from_hdl(hdl)->get_response_code();
+    });
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::closed );
+    BOOST_CHECK( !opened );
+    BOOST_CHECK_EQUAL( status, websocketpp::http::status_code::bad_request );
+}
+
+BOOST_AUTO_TEST_CASE( extended_connect_http3_stream ) {
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    std::string message;
+    s.set_message_handler([&](websocketpp::connection_hdl,
+        core_server::message_ptr msg)
+    {
+        message = msg->get_payload();
+    });
+
+    // a bidirectional QUIC stream, as handed over by an HTTP/3 stack
+    websocketpp::config::core::request_type req;
+    req.set_version("HTTP/3");
+    req.set_uri("/chat");
+    req.replace_header("Host", "www.example.com");
+    req.replace_header("Sec-WebSocket-Version", "13");
+
+    std::stringstream output;
+    std::string version;
+    core_server::connection_ptr con = s.get_connection();
+    con->register_ostream(&output);
+    con->start_extended_connect(req, [&](websocketpp::connection_hdl hdl) {
+        version = s.get_con_from_hdl(hdl)->get_response().get_version();
+    });
+
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::open );
+    BOOST_CHECK_EQUAL( version, "HTTP/3" );
+    BOOST_CHECK_EQUAL( con->get_request().get_version(), "HTTP/3" );
+    BOOST_CHECK_EQUAL( output.str(), "" );
+
+    std::string frame("\x81\x85\x00\x00\x00\x00hello", 11);
+    con->read_all(frame.data(), frame.size());
+    BOOST_CHECK_EQUAL( message, "hello" );
+}
+
+BOOST_AUTO_TEST_CASE( extended_connect_over_http1_rejected ) {
+    std::string handshake = "CONNECT /chat HTTP/2\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n\r\n";
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    core_server::connection_ptr con = s.get_connection();
+    std::stringstream output;
+    con->register_ostream(&output);
+    con->start();
+    con->read_some(handshake.data(), handshake.size());
+
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::closed );
+    BOOST_CHECK_EQUAL( output.str().substr(0, 12), "HTTP/1.1 400" );
+}
+
+BOOST_AUTO_TEST_CASE( control_frame_cache ) {
+    typedef websocketpp::config::core::message_type message_type;
+    websocketpp::config::core::con_msg_manager_type::ptr manager =
+        websocketpp::lib::make_shared<
+        websocketpp::config::core::con_msg_manager_type>();
+
+    websocketpp::control_frame_cache<message_type> cache(manager);
+    BOOST_CHECK_EQUAL( cache.get_ping()->get_header(), std::string("\x89\x00",2) );
+    BOOST_CHECK_EQUAL( cache.get_pong()->get_header(), std::string("\x8A\x00",2) );
+
+    message_type::ptr close = cache.get_close(
+        websocketpp::close::status::going_away,true);
+    BOOST_CHECK_EQUAL( close->get_header(), "\x88\x02" );
+    BOOST_CHECK_EQUAL( close->get_payload(), "\x03\xe9" );
+    BOOST_CHECK( close->get_terminal() );
+    BOOST_CHECK( !cache.get_close(websocketpp::close::status::going_away,
+        false)->get_terminal() );
+    BOOST_CHECK( !cache.get_close(websocketpp::close::status::protocol_error,
+        false) );
+
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    // masked empty ping from the client
+    std::string ping("\x89\x80\x00\x00\x00\x00",6);
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    websocketpp::lib::error_code ec;
+    core_server::connection_ptr con = s.get_connection(ec);
+    std::stringstream output;
+    con->register_ostream(&output);
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    output.str("");
+
+    // servers answer and close from the cache, frames are unchanged
+    con->read_some(ping.data(),ping.size());
+    con->ping("");
+    con->close(websocketpp::close::status::normal,"");
+    BOOST_CHECK_EQUAL( output.str(),
+        std::string("\x8A\x00\x89\x00\x88\x02\x03\xe8",8) );
+}
+
+BOOST_AUTO_TEST_CASE( idle_hibernation ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    // masked text message "hi" from the client
+    std::string frame("\x81\x82\x00\x00\x00\x00hi",8);
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    core_server::timer_wheel_ptr wheel =
+        websocketpp::lib::make_shared<websocketpp::timer_wheel>(100);
+    s.set_timer_wheel(wheel);
+    s.set_hibernate_timeout(1000);
+    BOOST_CHECK_EQUAL( s.get_hibernate_timeout(), 1000 );
+
+    websocketpp::lib::error_code ec;
+    core_server::connection_ptr con = s.get_connection(ec);
+    std::stringstream output;
+    con->register_ostream(&output);
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    BOOST_CHECK_EQUAL( con->get_request_header("Host"), "www.example.com" );
+
+    websocketpp::timer_wheel::clock::time_point now =
+        websocketpp::timer_wheel::clock::now();
+
+    wheel->advance(now + websocketpp::lib::chrono::milliseconds(1500));
+    BOOST_CHECK( con->is_hibernating() );
+    BOOST_CHECK_EQUAL( con->get_request_header("Host"), "" );
+    BOOST_CHECK_EQUAL( con->get_resource(), "/" );
+
+    // the next read wakes it, and it keeps working
+    con->read_some(frame.data(),frame.size());
+    BOOST_CHECK( !con->is_hibernating() );
+    output.str("");
+    con->send(std::string("ok"),websocketpp::frame::opcode::text);
+    BOOST_CHECK_EQUAL( output.str(), "\x81\x02ok" );
+
+    wheel->advance(now + websocketpp::lib::chrono::milliseconds(2100));
+    BOOST_CHECK( !con->is_hibernating() );
+    wheel->advance(now + websocketpp::lib::chrono::milliseconds(2700));
+    BOOST_CHECK( con->is_hibernating() );
+}
+
+struct view_request_config : public websocketpp::config::core {
+    typedef websocketpp::http::parser::view_request request_type;
+};
+
+typedef websocketpp::server<view_request_config> view_request_server;
+
+BOOST_AUTO_TEST_CASE( view_request_handshake ) {
+    std::string handshake = "GET /chat HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    view_request_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    websocketpp::lib::error_code ec;
+    view_request_server::connection_ptr con = s.get_connection(ec);
+    std::stringstream output;
+    con->register_ostream(&output);
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::open );
+    BOOST_CHECK_EQUAL( con->get_resource(), "/chat" );
+    BOOST_CHECK_EQUAL( con->get_request_header("host"), "www.example.com" );
+    BOOST_CHECK( output.str().find(
+        "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=") !=
+        std::string::npos );
+}
+
+struct handshake_validator {
+    websocketpp::session::validation::value validate(
+        websocketpp::connection_hdl hdl)
+    {
+        core_server::connection_ptr con = s->get_con_from_hdl(hdl);
+        con->select_subprotocol("chat");
+        if (!header.empty()) {
+            con->append_header(header, "1");
+        }
+        return websocketpp::session::validation::accept;
+    }
+
+    core_server * s;
+    std::string header;
+};
+
+std::string templated_handshake(core_server & s, handshake_validator & v,
+    bool use_template)
+{
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\nSec-WebSocket-Protocol: chat\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    s.set_validate_handler(websocketpp::lib::bind(
+        &handshake_validator::validate,&v,websocketpp::lib::placeholders::_1));
+
+    websocketpp::lib::error_code ec;
+    core_server::connection_ptr con = s.get_connection(ec);
+    if (!use_template) {
+        con->set_handshake_template(core_server::handshake_template_ptr());
+    }
+    std::stringstream output;
+    con->register_ostream(&output);
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::open );
+    return output.str();
+}
+
+BOOST_AUTO_TEST_CASE( handshake_response_template ) {
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_user_agent("test");
+
+    handshake_validator v;
+    v.s = &s;
+
+    std::string expected = "HTTP/1.1 101 Switching Protocols\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n"
+        "Sec-WebSocket-Protocol: chat\r\n"
+        "Server: test\r\n"
+        "Upgrade: websocket\r\n\r\n";
+
+    // the template and the response object give the same bytes
+    BOOST_CHECK_EQUAL( templated_handshake(s,v,true), expected );
+    BOOST_CHECK_EQUAL( templated_handshake(s,v,false), expected );
+
+    // headers added by the application are kept
+    v.header = "X-Extra";
+    std::string extra = templated_handshake(s,v,true);
+    BOOST_CHECK( extra.find("\r\nX-Extra: 1\r\n") != std::string::npos );
+    BOOST_CHECK( extra.find("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n")
+        != std::string::npos );
+}
+
+BOOST_AUTO_TEST_CASE( connection_memory_usage ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    websocketpp::lib::error_code ec;
+    core_server::connection_ptr con = s.get_connection(ec);
+    std::stringstream output;
+    con->register_ostream(&output);
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::open );
+
+    websocketpp::memory_usage usage = con->get_memory_usage();
+    BOOST_CHECK( usage.bytes[websocketpp::memory_usage::connection] > 0 );
+    BOOST_CHECK( usage.bytes[websocketpp::memory_usage::connection] <
+        sizeof(core_server::connection_type) + 1024 );
+    BOOST_CHECK( usage.bytes[websocketpp::memory_usage::read_buffer] > 0 );
+    BOOST_CHECK( usage.bytes[websocketpp::memory_usage::http] >
+        sizeof(core_server::connection_type::request_type) );
+    BOOST_CHECK( usage.bytes[websocketpp::memory_usage::processor] > 0 );
+    BOOST_CHECK_EQUAL( usage.bytes[websocketpp::memory_usage::strand], 0 );
+
+    size_t sum = 0;
+    for (size_t i = 0; i < websocketpp::memory_usage::count; ++i) {
+        sum += usage.bytes[i];
+    }
+    BOOST_CHECK_EQUAL( usage.total(), sum );
+    BOOST_CHECK_EQUAL( std::string(websocketpp::memory_usage::get_name(
+        websocketpp::memory_usage::send_queue)), "send_queue" );
+
+    // the endpoint looks connections up by handle
+    websocketpp::connection_hdl hdl = con->get_handle();
+    BOOST_CHECK_EQUAL( s.get_memory_usage(hdl,ec).total(), usage.total() );
+    BOOST_CHECK( !ec );
+
+    std::vector<websocketpp::connection_hdl> hdls(2, hdl);
+    size_t count = 0;
+    websocketpp::memory_usage both =
+        s.get_memory_usage(hdls.begin(),hdls.end(),&count);
+    BOOST_CHECK_EQUAL( count, 2 );
+    BOOST_CHECK_EQUAL( both.total(), 2 * usage.total() );
+
+    con.reset();
+    BOOST_CHECK_EQUAL( s.get_memory_usage(hdl,ec).total(), 0 );
+    BOOST_CHECK_EQUAL( ec, websocketpp::error::bad_connection );
+}
+
+BOOST_AUTO_TEST_CASE( traffic_capture_round_trip ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    // masked text message "hi" from the client
+    std::string frame("\x81\x82\x00\x00\x00\x00hi",8);
+    std::string path = "/tmp/websocketpp_test_capture";
+
+    core_server::capture_ptr cap =
+        websocketpp::lib::make_shared<websocketpp::capture>();
+    BOOST_REQUIRE( !cap->open_file(path) );
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_capture(cap);
+    BOOST_CHECK( s.get_capture() == cap );
+
+    websocketpp::lib::error_code ec;
+    core_server::connection_ptr con = s.get_connection(ec);
+    BOOST_CHECK_EQUAL( con->get_capture_id(), 1u );
+    std::stringstream output;
+    con->register_ostream(&output);
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    con->read_some(frame.data(),frame.size());
+    con->send(std::string("ok"),websocketpp::frame::opcode::text);
+    std::string response = output.str();
+    con->eof();
+    cap->close_file();
+
+    websocketpp::capture_reader r;
+    BOOST_REQUIRE( !r.open_file(path) );
+
+    websocketpp::capture_reader::entry e;
+    BOOST_REQUIRE( r.next(e) );
+    BOOST_CHECK_EQUAL( e.kind, websocketpp::capture::open );
+    BOOST_CHECK_EQUAL( e.id, 1u );
+    BOOST_CHECK_EQUAL( e.bytes, std::string(1,'\x01') );
+    BOOST_CHECK( e.time >= r.get_start_time() );
+
+    std::string in;
+    std::string out;
+    bool closed = false;
+    while (r.next(e)) {
+        BOOST_CHECK_EQUAL( e.id, 1u );
+        if (e.kind == websocketpp::capture::inbound) {
+            in += e.bytes;
+        } else if (e.kind == websocketpp::capture::outbound) {
+            out += e.bytes;
+        } else if (e.kind == websocketpp::capture::close) {
+            closed = true;
+        }
+    }
+    BOOST_CHECK( !r.error() );
+    BOOST_CHECK( closed );
+    BOOST_CHECK_EQUAL( in, handshake + frame );
+    BOOST_CHECK_EQUAL( out, response );
+
+    // a file that is not a capture is rejected
+    std::string bad = path + "_bad";
+    std::ofstream(bad.c_str()) << "not a capture";
+    BOOST_CHECK( r.open_file(bad) );
+}
+
+BOOST_AUTO_TEST_CASE( connection_registry_lookup ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    core_server::registry_ptr registry =
+        websocketpp::lib::make_shared<core_server::registry_type>(3);
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_connection_registry(registry);
+    BOOST_CHECK( s.get_connection_registry() == registry );
+
+    websocketpp::lib::error_code ec;
+    core_server::connection_ptr a = s.get_connection(ec);
+    core_server::connection_ptr b = s.get_connection(ec);
+    std::stringstream output;
+    a->register_ostream(&output);
+    b->register_ostream(&output);
+
+    // connections join when they open
+    a->start();
+    BOOST_CHECK_EQUAL( a->get_id(), 0u );
+    BOOST_CHECK_EQUAL( registry->size(), 0u );
+    a->read_some(handshake.data(),handshake.size());
+    b->start();
+    b->read_some(handshake.data(),handshake.size());
+    BOOST_CHECK_EQUAL( registry->size(), 2u );
+    BOOST_CHECK( a->get_id() != 0 );
+    BOOST_CHECK( a->get_id() != b->get_id() );
+
+    BOOST_CHECK( s.get_con_from_id(a->get_id(),ec) == a );
+    BOOST_CHECK( !ec );
+    BOOST_CHECK( s.get_con_from_id(b->get_id()) == b );
+
+    size_t visited = 0;
+    registry->for_each([&](core_server::connection_ptr const & con) {
+        BOOST_CHECK( con == a || con == b );
+        ++visited;
+    });
+    BOOST_CHECK_EQUAL( visited, 2u );
+
+    // and leave when they end, keeping their id
+    uint64_t id = a->get_id();
+    a->eof();
+    BOOST_CHECK_EQUAL( registry->size(), 1u );
+    BOOST_CHECK_EQUAL( a->get_id(), id );
+    BOOST_CHECK( !s.get_con_from_id(id,ec) );
+    BOOST_CHECK_EQUAL( ec, websocketpp::error::bad_connection );
+    BOOST_CHECK( !registry->erase(id) );
+
+    b->eof();
+    BOOST_CHECK_EQUAL( registry->size(), 0u );
+}
+
+BOOST_AUTO_TEST_CASE( pubsub_publish ) {
+    typedef websocketpp::server<websocketpp::config::core> server;
+
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    std::stringstream out1;
+    std::stringstream out2;
+    websocketpp::lib::error_code ec;
+
+    s.register_ostream(&out1);
+    server::connection_ptr con1 = s.get_connection(ec);
+    con1->start();
+    con1->read_some(handshake.data(),handshake.size());
+
+    s.register_ostream(&out2);
+    server::connection_ptr con2 = s.get_connection(ec);
+    con2->start();
+    con2->read_some(handshake.data(),handshake.size());
+
+    out1.str("");
+    out2.str("");
+
+    websocketpp::pubsub<server> topics(s, 4);
+    BOOST_CHECK( topics.subscribe(con1->get_handle(),"a") );
+    BOOST_CHECK( !topics.subscribe(con1->get_handle(),"a") );
+    BOOST_CHECK( topics.subscribe(con2->get_handle(),"a") );
+    BOOST_CHECK( topics.subscribe(con2->get_handle(),"b") );
+    BOOST_CHECK_EQUAL( topics.subscriber_count("a"), 2u );
+    BOOST_CHECK_EQUAL( topics.topic_count(), 2u );
+
+    BOOST_CHECK_EQUAL( topics.publish("a","Hi",
+        websocketpp::frame::opcode::text,ec), 2u );
+    BOOST_CHECK( !ec );
+    BOOST_CHECK_EQUAL( topics.publish("b","Yo",
+        websocketpp::frame::opcode::text), 1u );
+    BOOST_CHECK_EQUAL( topics.publish("none","x",
+        websocketpp::frame::opcode::text,ec), 0u );
+
+    BOOST_CHECK_EQUAL( out1.str(), std::string("\x81\x02Hi",4) );
+    BOOST_CHECK_EQUAL( out2.str(), std::string("\x81\x02Hi\x81\x02Yo",8) );
+
+    // control opcodes cannot be published
+    topics.publish("a","x",websocketpp::frame::opcode::ping,ec);
+    BOOST_CHECK( ec );
+
+    BOOST_CHECK( topics.unsubscribe(con1->get_handle(),"a") );
+    BOOST_CHECK( !topics.unsubscribe(con1->get_handle(),"a") );
+    BOOST_CHECK_EQUAL( topics.subscriber_count("a"), 1u );
+
+    BOOST_CHECK_EQUAL( topics.unsubscribe_all(con2->get_handle()), 2u );
+    BOOST_CHECK_EQUAL( topics.topic_count(), 0u );
+    BOOST_CHECK_EQUAL( topics.unsubscribe_all(con2->get_handle()), 0u );
+}
+
+BOOST_AUTO_TEST_CASE( pubsub_cache ) {
+    typedef websocketpp::server<websocketpp::config::core> server;
+
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    std::stringstream out1;
+    std::stringstream out2;
+    websocketpp::lib::error_code ec;
+
+    s.register_ostream(&out1);
+    server::connection_ptr con1 = s.get_connection(ec);
+    con1->start();
+    con1->read_some(handshake.data(),handshake.size());
+
+    s.register_ostream(&out2);
+    server::connection_ptr con2 = s.get_connection(ec);
+    con2->start();
+    con2->read_some(handshake.data(),handshake.size());
+
+    out1.str("");
+    out2.str("");
+
+    websocketpp::pubsub<server> topics(s, 4);
+    topics.set_cache_depth(2);
+
+    // cached with no subscribers, only the last two kept
+    BOOST_CHECK_EQUAL( topics.publish("a","v1",
+        websocketpp::frame::opcode::text,ec), 0u );
+    topics.publish("a","v2",websocketpp::frame::opcode::text,ec);
+    topics.publish("a","v3",websocketpp::frame::opcode::text,ec);
+    BOOST_CHECK_EQUAL( topics.cached("a"), 2u );
+    BOOST_CHECK_EQUAL( topics.cached("b"), 0u );
+
+    // a new subscriber gets the cache, then what is published after
+    BOOST_CHECK( topics.subscribe(con1->get_handle(),"a") );
+    BOOST_CHECK_EQUAL( out1.str(), std::string("\x81\x02v2\x81\x02v3",8) );
+    BOOST_CHECK( !topics.subscribe(con1->get_handle(),"a") );
+    BOOST_CHECK_EQUAL( out1.str().size(), 8u );
+
+    BOOST_CHECK_EQUAL( topics.publish("a","v4",
+        websocketpp::frame::opcode::text,ec), 1u );
+    BOOST_CHECK( topics.subscribe(con2->get_handle(),"a") );
+    BOOST_CHECK_EQUAL( out2.str(), std::string("\x81\x02v3\x81\x02v4",8) );
+
+    // the cache outlives the subscribers
+    topics.unsubscribe_all(con1->get_handle());
+    topics.unsubscribe_all(con2->get_handle());
+    BOOST_CHECK_EQUAL( topics.topic_count(), 0u );
+    BOOST_CHECK_EQUAL( topics.cached("a"), 2u );
+    topics.clear_cache("a");
+    BOOST_CHECK_EQUAL( topics.cached("a"), 0u );
+}
+
+BOOST_AUTO_TEST_CASE( multiplexed_channels ) {
+    typedef websocketpp::multiplexer<core_server::connection_type> mux_type;
+
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Protocol: chat, websocketpp.mux.v1\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_validate_handler([&](websocketpp::connection_hdl hdl) {
+        return mux_type::select(s.get_con_from_hdl(hdl)) ?
+            websocketpp::session::validation::accept :
+            websocketpp::session::validation::reject;
+    });
+
+    core_server::connection_ptr con = s.get_connection();
+    std::stringstream output;
+    con->register_ostream(&output);
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    BOOST_REQUIRE_EQUAL( con->get_state(), websocketpp::session::state::open );
+    BOOST_CHECK_EQUAL( con->get_subprotocol(), mux_type::subprotocol() );
+    output.str("");
+
+    // channel messages as server frames: kind, channel id, payload
+    auto frame = [](std::string const & body) {
+        return std::string("\x82",1) + char(body.size()) + body;
+    };
+
+    mux_type mux(con, 8, 1);
+
+    // one message in flight: channels take turns rather than queue order
+    con->cork();
+    BOOST_CHECK( !mux.send(1, "a1") );
+    BOOST_CHECK( !mux.send(1, "a2") );
+    BOOST_CHECK( !mux.send(1, "a3") );
+    BOOST_CHECK( !mux.send(2, "b", websocketpp::frame::opcode::text) );
+    BOOST_CHECK_EQUAL( mux.get_queued(1), 2u );
+    con->uncork();
+    BOOST_CHECK_EQUAL( output.str(), frame(std::string("\x01\x01" "a1",4)) +
+        frame(std::string("\x01\x01" "a2",4)) +
+        frame(std::string("\x00\x02" "b",3)) +
+        frame(std::string("\x01\x01" "a3",4)) );
+    output.str("");
+
+    // a channel stops at the end of its window until credit arrives
+    BOOST_CHECK( !mux.send(3, "cccc") );
+    BOOST_CHECK( !mux.send(3, "dddd") );
+    BOOST_CHECK( !mux.send(3, "eeee") );
+    BOOST_CHECK_EQUAL( mux.get_send_window(3), 0 );
+    BOOST_CHECK_EQUAL( mux.get_queued(3), 1u );
+    BOOST_CHECK_EQUAL( output.str(), frame(std::string("\x01\x03" "cccc",6)) +
+        frame(std::string("\x01\x03" "dddd",6)) );
+    output.str("");
+
+    auto incoming = [&](std::string const & body) {
+        core_server::message_ptr msg = con->get_message(
+            websocketpp::frame::opcode::binary, body.size());
+        msg->set_payload(body);
+        return mux.on_message(msg);
+    };
+
+    BOOST_CHECK( !incoming(std::string("\x02\x03\x04",3)) );
+    BOOST_CHECK_EQUAL( mux.get_queued(3), 0u );
+    BOOST_CHECK_EQUAL( output.str(), frame(std::string("\x01\x03" "eeee",6)) );
+    output.str("");
+
+    // received messages reach their channel's handler, and consuming half a
+    // window grants it back
+    std::string received;
+    mux.set_handler(5, [&](mux_type::channel_id id,
+        websocketpp::frame::opcode::value op, std::string_view payload)
+    {
+        BOOST_CHECK_EQUAL( id, 5u );
+        BOOST_CHECK_EQUAL( op, websocketpp::frame::opcode::text );
+        received.assign(payload.data(), payload.size());
+    });
+    BOOST_CHECK( !incoming(std::string("\x00\x05" "hello",7)) );
+    BOOST_CHECK_EQUAL( received, "hello" );
+    BOOST_CHECK_EQUAL( output.str(), frame(std::string("\x02\x05\x05",3)) );
+    output.str("");
+
+    // overrunning a window, unknown kinds and bad UTF-8 are violations
+    mux.set_default_handler([](mux_type::channel_id,
+        websocketpp::frame::opcode::value, std::string_view) {});
+    BOOST_CHECK( !incoming(std::string("\x01\x06" "abc",5)) );
+    BOOST_CHECK_EQUAL( incoming(std::string("\x01\x06" "defghi",8)),
+        websocketpp::error::payload_violation );
+    BOOST_CHECK_EQUAL( incoming(std::string("\x09\x06",2)),
+        websocketpp::error::payload_violation );
+    BOOST_CHECK_EQUAL( incoming(std::string("\x00\x07\xff",3)),
+        websocketpp::error::payload_violation );
+    BOOST_CHECK_EQUAL( output.str(), "" );
+
+    std::vector<mux_type::channel_id> closed;
+    mux.set_close_handler([&](mux_type::channel_id id) {
+        closed.push_back(id);
+    });
+    BOOST_CHECK( !incoming(std::string("\x03\x05",2)) );
+    BOOST_REQUIRE_EQUAL( closed.size(), 1u );
+    BOOST_CHECK_EQUAL( closed[0], 5u );
+
+    mux.close_channel(2);
+    BOOST_CHECK_EQUAL( output.str(), frame(std::string("\x03\x02",2)) );
+}
+
+BOOST_AUTO_TEST_CASE( message_batches ) {
+    typedef websocketpp::message_batcher<core_server::connection_type>
+        batcher_type;
+
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Protocol: websocketpp.batch.v1\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_validate_handler([&](websocketpp::connection_hdl hdl) {
+        return batcher_type::select(s.get_con_from_hdl(hdl)) ?
+            websocketpp::session::validation::accept :
+            websocketpp::session::validation::reject;
+    });
+
+    core_server::connection_ptr con = s.get_connection();
+    std::stringstream output;
+    con->register_ostream(&output);
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    BOOST_REQUIRE_EQUAL( con->get_state(), websocketpp::session::state::open );
+    BOOST_CHECK_EQUAL( con->get_subprotocol(), batcher_type::subprotocol() );
+    output.str("");
+
+    auto frame = [](std::string const & body) {
+        return std::string("\x82",1) + char(body.size()) + body;
+    };
+
+    batcher_type batcher(con, 0, 8);
+
+    // the first message leaves at once, the rest collect behind it until it
+    // is written
+    con->cork();
+    BOOST_CHECK( !batcher.send("a") );
+    BOOST_CHECK( !batcher.send("bb", websocketpp::frame::opcode::text) );
+    BOOST_CHECK( !batcher.send("ccc") );
+    BOOST_CHECK_EQUAL( batcher.get_queued(), 2u );
+    con->uncork();
+    BOOST_CHECK_EQUAL( batcher.get_queued(), 0u );
+    BOOST_CHECK_EQUAL( output.str(), frame("\x03" "a") +
+        frame("\x04" "bb" "\x07" "ccc") );
+    output.str("");
+
+    // a full batch does not wait
+    con->cork();
+    BOOST_CHECK( !batcher.send("d") );
+    BOOST_CHECK( !batcher.send("eeeeeeeeee") );
+    BOOST_CHECK_EQUAL( batcher.get_queued(), 0u );
+    BOOST_CHECK( !batcher.send("f") );
+    BOOST_CHECK_EQUAL( batcher.get_queued(), 1u );
+    batcher.flush();
+    BOOST_CHECK_EQUAL( batcher.get_queued(), 0u );
+    con->uncork();
+    BOOST_CHECK_EQUAL( output.str(), frame("\x03" "d") +
+        frame("\x15" "eeeeeeeeee") + frame("\x03" "f") );
+
+    BOOST_CHECK_EQUAL( batcher.send("x", websocketpp::frame::opcode::ping),
+        websocketpp::error::payload_violation );
+
+    // received batches reach the handler in one call
+    std::vector<std::string> received;
+    batcher.set_batch_handler([&](std::vector<batcher_type::record> const & r)
+    {
+        received.clear();
+        for (size_t i = 0; i < r.size(); ++i) {
+            received.push_back(std::string(r[i].payload) +
+                (r[i].op == websocketpp::frame::opcode::text ? "/t" : "/b"));
+        }
+    });
+
+    auto incoming = [&](std::string const & body) {
+        core_server::message_ptr msg = con->get_message(
+            websocketpp::frame::opcode::binary, body.size());
+        msg->set_payload(body);
+        return batcher.on_message(msg);
+    };
+
+    BOOST_CHECK( !incoming(std::string("\x03" "a" "\x04" "bb" "\x01",6)) );
+    BOOST_REQUIRE_EQUAL( received.size(), 3u );
+    BOOST_CHECK_EQUAL( received[0], "a/b" );
+    BOOST_CHECK_EQUAL( received[1], "bb/t" );
+    BOOST_CHECK_EQUAL( received[2], "/b" );
+
+    // a record longer than the batch, or text that is not UTF-8
+    BOOST_CHECK_EQUAL( incoming("\x09" "a"),
+        websocketpp::error::payload_violation );
+    BOOST_CHECK_EQUAL( incoming("\x02" "\xC0"),
+        websocketpp::error::payload_violation );
+}
+
+BOOST_AUTO_TEST_CASE( broadcast_to_registry ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    websocketpp::lib::error_code ec;
+    core_server::message_ptr msg = s.prepare_broadcast("Hello",
+        websocketpp::frame::opcode::text);
+
+    // broadcast needs a registry to find connections
+    BOOST_CHECK_EQUAL( s.broadcast(msg,core_server::broadcast_filter(),ec), 0u );
+    BOOST_CHECK_EQUAL( ec, websocketpp::error::invalid_state );
+
+    s.set_connection_registry(
+        websocketpp::lib::make_shared<core_server::registry_type>());
+
+    std::stringstream out1;
+    std::stringstream out2;
+
+    s.register_ostream(&out1);
+    core_server::connection_ptr con1 = s.get_connection(ec);
+    con1->start();
+    con1->read_some(handshake.data(),handshake.size());
+
+    s.register_ostream(&out2);
+    core_server::connection_ptr con2 = s.get_connection(ec);
+    con2->start();
+    con2->read_some(handshake.data(),handshake.size());
+
+    out1.str("");
+    out2.str("");
+
+    BOOST_CHECK_EQUAL( s.broadcast(msg,core_server::broadcast_filter(),ec), 2u );
+    BOOST_CHECK( !ec );
+    BOOST_CHECK_EQUAL( s.broadcast(msg,
+        [&](core_server::connection_ptr const & con) { return con == con2; }),
+        1u );
+
+    BOOST_CHECK_EQUAL( out1.str(), std::string("\x81\x05Hello",7) );
+    BOOST_CHECK_EQUAL( out2.str(), std::string("\x81\x05Hello\x81\x05Hello",14) );
+}
+
+BOOST_AUTO_TEST_CASE( broadcast_template ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    std::string hybi00 = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: Upgrade\r\nUpgrade: websocket\r\n"
+        "Origin: http://example.com\r\n"
+        "Sec-WebSocket-Key1: 3e6b263  4 17 80\r\n"
+        "Sec-WebSocket-Key2: 17  9 G`ZD9   2 2b 7X 3 /r90\r\n\r\nWjN}|M(6";
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_connection_registry(
+        websocketpp::lib::make_shared<core_server::registry_type>());
+
+    websocketpp::lib::error_code ec;
+    core_server::message_ptr tmpl = s.prepare_broadcast("Hello",
+        websocketpp::frame::opcode::text);
+
+    core_server::message_ptr msg = s.prepare_recipient(tmpl, "7:", ec);
+    BOOST_REQUIRE( !ec );
+    BOOST_CHECK( msg->get_prepared() );
+    BOOST_CHECK_EQUAL( msg->get_header(), std::string("\x81\x07",2) );
+    BOOST_CHECK_EQUAL( msg->get_prefix(), "7:" );
+    // the payload is the template's, not a copy
+    BOOST_CHECK_EQUAL( msg->get_payload_data(), tmpl->get_payload_data() );
+
+    s.prepare_recipient(tmpl, "\xFF", ec);
+    BOOST_CHECK_EQUAL( ec, websocketpp::processor::error::make_error_code(
+        websocketpp::processor::error::invalid_payload) );
+    s.prepare_recipient(msg, "1:", ec);
+    BOOST_CHECK_EQUAL( ec, websocketpp::processor::error::make_error_code(
+        websocketpp::processor::error::invalid_arguments) );
+
+    std::stringstream out1;
+    std::stringstream out2;
+    std::stringstream out3;
+
+    s.register_ostream(&out1);
+    core_server::connection_ptr con1 = s.get_connection(ec);
+    con1->start();
+    con1->read_some(handshake.data(),handshake.size());
+
+    s.register_ostream(&out2);
+    core_server::connection_ptr con2 = s.get_connection(ec);
+    con2->start();
+    con2->read_some(handshake.data(),handshake.size());
+
+    // hybi00 frames the message itself from a copy of prefix and payload
+    s.register_ostream(&out3);
+    core_server::connection_ptr con3 = s.get_connection(ec);
+    con3->start();
+    con3->read_some(hybi00.data(),hybi00.size());
+
+    out1.str("");
+    out2.str("");
+    out3.str("");
+
+    BOOST_CHECK_EQUAL( s.broadcast(tmpl,
+        [&](core_server::connection_ptr const & con) -> std::string {
+            return con == con1 ? "1:" : con == con2 ? "22:" : "3:";
+        }, core_server::broadcast_filter(), ec), 3u );
+    BOOST_CHECK( !ec );
+
+    BOOST_CHECK_EQUAL( out1.str(), std::string("\x81\x07" "1:Hello",9) );
+    BOOST_CHECK_EQUAL( out2.str(), std::string("\x81\x08" "22:Hello",10) );
+    BOOST_CHECK_EQUAL( out3.str(), std::string("\x00" "3:Hello\xFF",9) );
+}
+
+BOOST_AUTO_TEST_CASE( corked_send ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    write_recorder<core_server> r;
+    websocketpp::lib::error_code ec;
+    core_server::connection_ptr con = s.get_connection(ec);
+    // no con, so the recorder does not send from the write handler
+    r.writes = 1;
+
+    con->set_write_handler(websocketpp::lib::bind(&write_recorder<core_server>::write,&r,
+        websocketpp::lib::placeholders::_1,websocketpp::lib::placeholders::_2,
+        websocketpp::lib::placeholders::_3));
+    con->set_vector_write_handler(websocketpp::lib::bind(
+        &write_recorder<core_server>::vector_write,&r,websocketpp::lib::placeholders::_1,
+        websocketpp::lib::placeholders::_2));
+
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    r.output.clear();
+    r.buffer_counts.clear();
+
+    BOOST_CHECK( !con->is_corked() );
+    {
+        core_server::connection_type::cork_guard outer(*con);
+        con->send(std::string("one"),websocketpp::frame::opcode::text);
+        {
+            core_server::connection_type::cork_guard inner(*con);
+            con->send(std::string("two"),websocketpp::frame::opcode::text);
+        }
+        BOOST_CHECK( con->is_corked() );
+        con->send(std::string("three"),websocketpp::frame::opcode::text);
+        BOOST_CHECK( r.output.empty() );
+    }
+    BOOST_CHECK( !con->is_corked() );
+
+    BOOST_CHECK_EQUAL( r.output, std::string("\x81\x03one\x81\x03two"
+        "\x81\x05three",17) );
+    // one gathered write holding a header and payload per message
+    BOOST_REQUIRE_EQUAL( r.buffer_counts.size(), 1u );
+    BOOST_CHECK_EQUAL( r.buffer_counts[0], 6u );
+
+    // uncork without cork does nothing, and sends write right away again
+    con->uncork();
+    con->send(std::string("four"),websocketpp::frame::opcode::text);
+    BOOST_CHECK_EQUAL( r.buffer_counts.size(), 2u );
+}
+
+BOOST_AUTO_TEST_CASE( payload_ref_send ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    std::stringstream out;
+    s.register_ostream(&out);
+
+    websocketpp::lib::error_code ec;
+    core_server::connection_ptr con = s.get_connection(ec);
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    out.str("");
+
+    static char const arena[] = "Hello World";
+    int released = 0;
+    {
+        core_server::message_ptr msg = con->get_message(
+            websocketpp::frame::opcode::text,0);
+        msg->set_payload_ref(arena + 6, 5, [&](void const *) { ++released; });
+        BOOST_CHECK( msg->get_payload_data() == arena + 6 );
+        BOOST_CHECK_EQUAL( msg->get_payload_size(), 5u );
+
+        BOOST_CHECK( !con->send(msg) );
+        BOOST_CHECK_EQUAL( msg->get_payload(), "World" );
+    }
+    BOOST_CHECK_EQUAL( out.str(), std::string("\x81\x05World",7) );
+    BOOST_CHECK_EQUAL( released, 1 );
+
+    // a broadcast frame points at the shared buffer on every connection
+    websocketpp::lib::shared_ptr<std::string> buffer =
+        websocketpp::lib::make_shared<std::string>("Bulk");
+    core_server::message_ptr msg = s.prepare_broadcast(buffer, buffer->data(),
+        buffer->size(), websocketpp::frame::opcode::binary);
+    BOOST_CHECK( msg->get_payload_data() == buffer->data() );
+    BOOST_CHECK( msg->get_payload_owner() == buffer );
+
+    out.str("");
+    BOOST_CHECK( !con->send(msg) );
+    BOOST_CHECK_EQUAL( out.str(), std::string("\x82\x04" "Bulk",6) );
+
+    // changing the payload copies it first
+    msg->append_payload("!",1);
+    BOOST_CHECK( !msg->get_payload_owner() );
+    BOOST_CHECK_EQUAL( msg->get_payload(), "Bulk!" );
+    BOOST_CHECK_EQUAL( buffer.use_count(), 1 );
+
+    s.prepare_broadcast(websocketpp::lib::shared_ptr<void const>(),
+        buffer->data(), buffer->size(), websocketpp::frame::opcode::binary,
+        ec);
+    BOOST_CHECK( ec );
+}
+
+BOOST_AUTO_TEST_CASE( send_file_range ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    // longer than a page so the mapped range starts off a page boundary
+    std::string contents(5000,'a');
+    contents.replace(4100,5,"Hello");
+
+    std::FILE * file = std::tmpfile();
+    BOOST_REQUIRE( file );
+    std::fwrite(contents.data(),1,contents.size(),file);
+    std::fflush(file);
+    int fd = fileno(file);
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    std::stringstream out;
+    s.register_ostream(&out);
+
+    websocketpp::lib::error_code ec;
+    core_server::connection_ptr con = s.get_connection(ec);
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    out.str("");
+
+    BOOST_CHECK( !con->send_file(fd,4100,5) );
+    BOOST_CHECK_EQUAL( out.str(), std::string("\x82\x05Hello",7) );
+
+    out.str("");
+    BOOST_CHECK( !con->send_file(fd,4995,websocketpp::file_map::to_end,
+        websocketpp::frame::opcode::text) );
+    BOOST_CHECK_EQUAL( out.str(), std::string("\x81\x05" "aaaaa",7) );
+
+    BOOST_CHECK( con->send_file(fd,4999,2) );
+    BOOST_CHECK( con->send_file("/nonexistent/websocketpp/file") );
+    std::fclose(file);
+}
+
+BOOST_AUTO_TEST_CASE( connection_id_handle ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_connection_registry(
+        websocketpp::lib::make_shared<core_server::registry_type>());
+
+    std::stringstream out;
+    s.register_ostream(&out);
+
+    websocketpp::lib::error_code ec;
+    core_server::connection_ptr con = s.get_connection(ec);
+    BOOST_CHECK( !con->get_handle_id() );
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    out.str("");
+
+    websocketpp::connection_id id = con->get_handle_id();
+    BOOST_CHECK( id );
+    BOOST_CHECK_EQUAL( sizeof(id), 8u );
+    BOOST_CHECK( s.get_con_from_hdl(id) == con );
+
+    std::unordered_set<websocketpp::connection_id> ids;
+    ids.insert(id);
+    BOOST_CHECK( ids.count(websocketpp::connection_id(id.value)) );
+
+    s.send(id,"Hi",websocketpp::frame::opcode::text,ec);
+    BOOST_CHECK( !ec );
+    s.ping(id,"",ec);
+    BOOST_CHECK( !ec );
+    BOOST_CHECK_EQUAL( out.str(), std::string("\x81\x02Hi\x89\x00",6) );
+
+    s.close(id,websocketpp::close::status::normal,"",ec);
+    BOOST_CHECK( !ec );
+    con->eof();
+
+    // a closed connection's id does not resolve again
+    s.send(id,"Hi",websocketpp::frame::opcode::text,ec);
+    BOOST_CHECK_EQUAL( ec, websocketpp::error::bad_connection );
+    BOOST_CHECK_THROW( s.get_con_from_hdl(id), websocketpp::exception );
+}
+
+struct rfc6455_config : public websocketpp::config::core {
+    static const bool rfc6455_only = true;
+};
+
+typedef websocketpp::server<rfc6455_config> rfc6455_server;
+
+BOOST_AUTO_TEST_CASE( rfc6455_only_processor ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    std::string draft = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 8\r\n"
+        "Sec-WebSocket-Origin: http://www.example.com\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    rfc6455_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_message_handler([&s](websocketpp::connection_hdl hdl,
+        rfc6455_server::message_ptr msg)
+    {
+        s.send(hdl,msg->get_payload(),msg->get_opcode());
+    });
+
+    std::stringstream out;
+    s.register_ostream(&out);
+
+    websocketpp::lib::error_code ec;
+    rfc6455_server::connection_ptr con = s.get_connection(ec);
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::open );
+    out.str("");
+
+    // masked "Hi" echoed back unmasked
+    std::string frame("\x81\x82\x00\x00\x00\x00Hi",8);
+    con->read_some(frame.data(),frame.size());
+    BOOST_CHECK_EQUAL( out.str(), std::string("\x81\x02Hi",4) );
+
+    std::vector<int> const & versions = con->get_supported_versions();
+    BOOST_REQUIRE_EQUAL( versions.size(), 1u );
+    BOOST_CHECK_EQUAL( versions[0], 13 );
+
+    // earlier drafts are refused
+    out.str("");
+    rfc6455_server::connection_ptr old = s.get_connection(ec);
+    old->start();
+    old->read_some(draft.data(),draft.size());
+    BOOST_CHECK( out.str().find("400 Bad Request") != std::string::npos );
+    BOOST_CHECK( out.str().find("Sec-WebSocket-Version: 13\r\n") !=
+        std::string::npos );
+}
+
+BOOST_AUTO_TEST_CASE( close_all_connections ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    websocketpp::lib::error_code ec;
+    s.close_all(websocketpp::close::status::going_away,"",0,0,ec);
+    BOOST_CHECK_EQUAL( ec, websocketpp::error::invalid_state );
+
+    s.set_connection_registry(
+        websocketpp::lib::make_shared<core_server::registry_type>());
+
+    std::stringstream out;
+    s.register_ostream(&out);
+
+    core_server::connection_ptr con[2];
+    for (size_t i = 0; i < 2; ++i) {
+        con[i] = s.get_connection(ec);
+        con[i]->start();
+        con[i]->read_some(handshake.data(),handshake.size());
+    }
+    out.str("");
+
+    // both connections queue the same frame, 1001 and the reason
+    BOOST_CHECK_EQUAL( s.close_all(websocketpp::close::status::going_away,
+        "bye",1000,10,ec), 2u );
+    BOOST_CHECK( !ec );
+    BOOST_CHECK_EQUAL( out.str(), std::string("\x88\x05\x03\xe9" "bye"
+        "\x88\x05\x03\xe9" "bye",14) );
+    for (size_t i = 0; i < 2; ++i) {
+        BOOST_CHECK_EQUAL( con[i]->get_state(),
+            websocketpp::session::state::closing );
+    }
+
+    // closing connections are left alone
+    BOOST_CHECK_EQUAL( s.close_all(websocketpp::close::status::going_away,
+        "",0,0,ec), 0u );
+
+    for (size_t i = 0; i < 2; ++i) {
+        con[i]->eof();
+    }
+}
+
+BOOST_AUTO_TEST_CASE( drain_connections ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_connection_registry(
+        websocketpp::lib::make_shared<core_server::registry_type>());
+
+    std::stringstream out;
+    s.register_ostream(&out);
+
+    core_server::connection_ptr con = s.get_connection();
+    con->start();
+    con->read_some(handshake.data(),handshake.size());
+    out.str("");
+
+    // iostream has no timers, so the close goes out at once with 1012
+    BOOST_CHECK_EQUAL( s.drain(1000), 1u );
+    BOOST_CHECK_EQUAL( out.str(), std::string("\x88\x02\x03\xf4",4) );
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::closing );
+
+    con->eof();
+}
+
+BOOST_AUTO_TEST_CASE( hand_over_listener ) {
+    websocketpp::server<websocketpp::config::asio> server1;
+    websocketpp::server<websocketpp::config::asio> server2;
+
+    websocketpp::lib::error_code ec;
+
+    server1.init_asio();
+    server2.init_asio();
+
+    server1.listen(boost::asio::ip::tcp::v4(), 9119, ec);
+    BOOST_REQUIRE( !ec );
+
+    websocketpp::server<websocketpp::config::asio>::native_handle_type fd =
+        server1.release_listener(ec);
+    BOOST_REQUIRE( !ec );
+    BOOST_CHECK( !server1.is_listening() );
+
+    server2.listen_native(boost::asio::ip::tcp::v4(), fd, ec);
+    BOOST_REQUIRE( !ec );
+    BOOST_CHECK( server2.is_listening() );
+    websocketpp::lib::asio::error_code aec;
+    BOOST_CHECK_EQUAL( server2.get_local_endpoint(aec).port(), 9119 );
+    BOOST_CHECK( !aec );
+
+    server2.stop_listening(ec);
+    BOOST_CHECK( !ec );
+}
+
+BOOST_AUTO_TEST_CASE( lean_server_config ) {
+    typedef websocketpp::server<websocketpp::config::asio> asio_server;
+    typedef websocketpp::server<websocketpp::config::lean_server> lean_server;
+
+    // the proxy settings are compiled out of the transport connection
+    BOOST_CHECK_LT( sizeof(lean_server::transport_con_type),
+        sizeof(asio_server::transport_con_type) );
+
+    lean_server s;
+    s.init_asio();
+    s.set_user_agent("lean");
+
+    lean_server::connection_ptr con = s.get_connection();
+    BOOST_REQUIRE( con );
+    BOOST_CHECK( con->get_proxy().empty() );
+    BOOST_CHECK_GE( con->get_memory_usage().total(),
+        sizeof(lean_server::connection_type) );
+}
+
+void count_timer(int * fired, websocketpp::lib::error_code const & ec) {
+    BOOST_CHECK( !ec );
+    ++*fired;
+}
+
+BOOST_AUTO_TEST_CASE( run_busy ) {
+    typedef websocketpp::server<websocketpp::config::asio> asio_server;
+
+    asio_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.init_asio();
+
+    int fired = 0;
+    for (int i = 0; i < 5; ++i) {
+        s.get_io_context().post([&fired] { ++fired; });
+    }
+    // the timer fires after the spin ran out, from the blocking wait
+    s.set_timer(20, websocketpp::lib::bind(&count_timer, &fired,
+        websocketpp::lib::placeholders::_1));
+
+    BOOST_CHECK_GE( s.run_busy(std::chrono::microseconds(1000)), 6u );
+    BOOST_CHECK_EQUAL( fired, 6 );
+    BOOST_CHECK( s.stopped() );
+}
+
+#ifdef _WEBSOCKETPP_ASIO_LOCAL_SOCKETS_
+BOOST_AUTO_TEST_CASE( local_socket_echo ) {
+    typedef websocketpp::server<websocketpp::config::asio> asio_server;
+    typedef websocketpp::client<websocketpp::config::asio_client> asio_client;
+
+    std::string path = "/tmp/websocketpp_test_" +
+        std::to_string(::getpid()) + ".sock";
+
+    boost::asio::io_context ioc;
+    asio_server s;
+    asio_client c;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    c.clear_access_channels(websocketpp::log::alevel::all);
+    c.clear_error_channels(websocketpp::log::elevel::all);
+    s.init_asio(&ioc);
+    c.init_asio(&ioc);
+
+    std::string server_remote;
+    std::string reply;
+
+    s.set_open_handler([&](websocketpp::connection_hdl hdl) {
+        server_remote = s.get_con_from_hdl(hdl)->get_remote_endpoint();
+    });
+    s.set_message_handler([&](websocketpp::connection_hdl hdl,
+        asio_server::message_ptr msg)
+    {
+        s.send(hdl, msg->get_payload(), msg->get_opcode());
+    });
+    s.set_close_handler([&](websocketpp::connection_hdl) {
+        s.stop_listening();
+    });
+
+    c.set_open_handler([&](websocketpp::connection_hdl hdl) {
+        c.send(hdl, "over unix", websocketpp::frame::opcode::text);
+    });
+    c.set_message_handler([&](websocketpp::connection_hdl hdl,
+        asio_client::message_ptr msg)
+    {
+        reply = msg->get_payload();
+        c.close(hdl, websocketpp::close::status::normal, "");
+    });
+
+    s.listen_local(path);
+    s.start_accept();
+    BOOST_CHECK( std::filesystem::is_socket(path) );
+
+    websocketpp::lib::error_code ec;
+    asio_client::connection_ptr con = c.get_connection("ws://localhost/", ec);
+    BOOST_REQUIRE( !ec );
+    con->set_local_path(path);
+    c.connect(con);
+
+    ioc.run();
+
+    BOOST_CHECK_EQUAL( reply, "over unix" );
+    BOOST_CHECK_EQUAL( server_remote, "unix:" + path );
+    BOOST_CHECK_EQUAL( con->get_remote_endpoint(), "unix:" + path );
+    // stop_listening removed the socket file
+    BOOST_CHECK( !std::filesystem::exists(path) );
+}
+#endif // _WEBSOCKETPP_ASIO_LOCAL_SOCKETS_
+
+/// Copy bytes from one socket to another until the first one ends
+static void relay(boost::asio::ip::tcp::socket & from,
+    boost::asio::ip::tcp::socket & to)
+{
+    char data[4096];
+    boost::system::error_code ec;
+    for (;;) {
+        size_t n = from.read_some(boost::asio::buffer(data), ec);
+        if (ec) {
+            break;
+        }
+        boost::asio::write(to, boost::asio::buffer(data, n), ec);
+        if (ec) {
+            break;
+        }
+    }
+    to.shutdown(boost::asio::ip::tcp::socket::shutdown_send, ec);
+}
+
+BOOST_AUTO_TEST_CASE( proxy_connect_tunnel ) {
+    typedef websocketpp::server<websocketpp::config::asio> asio_server;
+    typedef websocketpp::client<websocketpp::config::asio_client> asio_client;
+    using boost::asio::ip::tcp;
+
+    // a CONNECT proxy that answers in two pieces, then relays the tunnel
+    boost::asio::io_context proxy_ioc;
+    tcp::endpoint loopback(boost::asio::ip::address_v4::loopback(), 9123);
+    tcp::acceptor acceptor(proxy_ioc, loopback);
+    std::string connect_request;
+    std::thread proxy([&] {
+        boost::system::error_code ec;
+        tcp::socket down(proxy_ioc);
+        acceptor.accept(down, ec);
+        boost::asio::streambuf buf;
+        size_t n = boost::asio::read_until(down, buf, "\r\n\r\n", ec);
+        if (ec) {
+            return;
+        }
+        connect_request.assign(boost::asio::buffers_begin(buf.data()),
+            boost::asio::buffers_begin(buf.data()) + n);
+
+        tcp::socket up(proxy_ioc);
+        up.connect(tcp::endpoint(loopback.address(), 9124), ec);
+        boost::asio::write(down, boost::asio::buffer(
+            std::string("HTTP/1.1 200 Connection")), ec);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        boost::asio::write(down, boost::asio::buffer(
+            std::string(" established\r\n\r\n")), ec);
+
+        std::thread back([&] { relay(up, down); });
+        relay(down, up);
+        back.join();
+    });
+
+    boost::asio::io_context ioc;
+    asio_server s;
+    asio_client c;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    c.clear_access_channels(websocketpp::log::alevel::all);
+    c.clear_error_channels(websocketpp::log::elevel::all);
+    s.init_asio(&ioc);
+    c.init_asio(&ioc);
+
+    std::string reply;
+    s.set_message_handler([&](websocketpp::connection_hdl hdl,
+        asio_server::message_ptr msg)
+    {
+        s.send(hdl, msg->get_payload(), msg->get_opcode());
+    });
+    s.set_close_handler([&](websocketpp::connection_hdl) {
+        s.stop_listening();
+    });
+    c.set_open_handler([&](websocketpp::connection_hdl hdl) {
+        c.send(hdl, "through the tunnel", websocketpp::frame::opcode::text);
+    });
+    c.set_message_handler([&](websocketpp::connection_hdl hdl,
+        asio_client::message_ptr msg)
+    {
+        reply = msg->get_payload();
+        c.close(hdl, websocketpp::close::status::normal, "");
+    });
+
+    s.set_reuse_addr(true);
+    s.listen(9124);
+    s.start_accept();
+
+    websocketpp::lib::error_code ec;
+    asio_client::connection_ptr con = c.get_connection(
+        "ws://127.0.0.1:9124/", ec);
+    BOOST_REQUIRE( !ec );
+    con->set_proxy("http://127.0.0.1:9123");
+    c.connect(con);
+
+    ioc.run();
+    proxy.join();
+
+    BOOST_CHECK_EQUAL( reply, "through the tunnel" );
+    BOOST_CHECK_EQUAL( connect_request.substr(0, 33),
+        "CONNECT 127.0.0.1:9124 HTTP/1.1\r\n" );
+}
+
+typedef websocketpp::server<websocketpp::config::asio> awaitable_server;
+typedef websocketpp::client<websocketpp::config::asio_client> awaitable_client;
+
+boost::asio::awaitable<void> echo_messages(
+    websocketpp::awaitable_connection<awaitable_server>::ptr con)
+{
+    for (;;) {
+        auto [ec, msg] = co_await con->async_read_message(
+            boost::asio::use_awaitable);
+        if (ec) {
+            co_return;
+        }
+        co_await con->async_send(msg, boost::asio::use_awaitable);
+    }
+}
+
+boost::asio::awaitable<void> request_replies(awaitable_client & c,
+    std::vector<std::string> & replies, websocketpp::lib::error_code & close)
+{
+    auto [ec, con] = co_await websocketpp::async_connect(c,
+        "ws://127.0.0.1:9120", boost::asio::use_awaitable);
+    if (ec) {
+        close = ec;
+        co_return;
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        ec = co_await con->async_send("request " + std::to_string(i),
+            websocketpp::frame::opcode::text, boost::asio::use_awaitable);
+        if (ec) {
+            close = ec;
+            co_return;
+        }
+        auto [rec, reply] = co_await con->async_read_message(
+            boost::asio::use_awaitable);
+        if (rec) {
+            close = rec;
+            co_return;
+        }
+        replies.push_back(reply->get_payload());
+    }
+
+    close = co_await con->async_close(websocketpp::close::status::normal, "",
+        boost::asio::use_awaitable);
+}
+
+BOOST_AUTO_TEST_CASE( awaitable_request_reply ) {
+    awaitable_server s;
+    awaitable_client c;
+
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.init_asio();
+    s.set_open_handler([&s](websocketpp::connection_hdl hdl) {
+        boost::asio::co_spawn(s.get_io_context(), echo_messages(
+            websocketpp::awaitable_connection<awaitable_server>::attach(
+                s.get_con_from_hdl(hdl))), boost::asio::detached);
+    });
+    s.set_reuse_addr(true);
+    s.listen(9120);
+    s.start_accept();
+    std::thread sthread([&s] { s.run(); });
+
+    std::vector<std::string> replies;
+    websocketpp::lib::error_code close = websocketpp::error::make_error_code(
+        websocketpp::error::test);
+
+    c.clear_access_channels(websocketpp::log::alevel::all);
+    c.clear_error_channels(websocketpp::log::elevel::all);
+    c.init_asio();
+    boost::asio::co_spawn(c.get_io_context(), request_replies(c, replies,
+        close), boost::asio::detached);
+    c.run();
+
+    s.stop();
+    sthread.join();
+
+    BOOST_CHECK( !close );
+    BOOST_REQUIRE_EQUAL( replies.size(), 3u );
+    BOOST_CHECK_EQUAL( replies[0], "request 0" );
+    BOOST_CHECK_EQUAL( replies[2], "request 2" );
+}
+
+boost::asio::awaitable<void> send_and_ping(awaitable_client & c,
+    std::string & pong, size_t & buffered, websocketpp::lib::error_code & close)
+{
+    auto [ec, con] = co_await websocketpp::async_connect(c,
+        "ws://127.0.0.1:9121", boost::asio::use_awaitable);
+    if (ec) {
+        close = ec;
+        co_return;
+    }
+
+    ec = co_await con->async_send(std::string(100000, 'x'),
+        websocketpp::frame::opcode::binary, boost::asio::use_awaitable);
+    // the send completes once the transport wrote it
+    buffered = con->get_connection()->get_buffered_amount();
+    if (!ec) {
+        std::tie(ec, pong) = co_await con->async_ping("probe",
+            boost::asio::use_awaitable);
+    }
+    if (ec) {
+        close = ec;
+        co_return;
+    }
+
+    close = co_await con->async_close(websocketpp::close::status::normal, "",
+        boost::asio::use_awaitable);
+}
+
+BOOST_AUTO_TEST_CASE( awaitable_send_completion_and_ping ) {
+    awaitable_server s;
+    awaitable_client c;
+
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.init_asio();
+    s.set_open_handler([&s](websocketpp::connection_hdl hdl) {
+        boost::asio::co_spawn(s.get_io_context(), echo_messages(
+            websocketpp::awaitable_connection<awaitable_server>::attach(
+                s.get_con_from_hdl(hdl))), boost::asio::detached);
+    });
+    s.set_reuse_addr(true);
+    s.listen(9121);
+    s.start_accept();
+    std::thread sthread([&s] { s.run(); });
+
+    std::string pong;
+    size_t buffered = 1;
+    websocketpp::lib::error_code close = websocketpp::error::make_error_code(
+        websocketpp::error::test);
+
+    c.clear_access_channels(websocketpp::log::alevel::all);
+    c.clear_error_channels(websocketpp::log::elevel::all);
+    c.init_asio();
+    boost::asio::co_spawn(c.get_io_context(), send_and_ping(c, pong,
+        buffered, close), boost::asio::detached);
+    c.run();
+
+    s.stop();
+    sthread.join();
+
+    BOOST_CHECK( !close );
+    BOOST_CHECK_EQUAL( buffered, 0u );
+    BOOST_CHECK_EQUAL( pong, "probe" );
+}
+
+BOOST_AUTO_TEST_CASE( async_validate_with_cache ) {
+    auto handshake = [](std::string const & token) {
+        return "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+            "Connection: upgrade\r\nUpgrade: websocket\r\n"
+            "Sec-WebSocket-Version: 13\r\n"
+            "Authorization: " + token + "\r\n"
+            "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    };
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    int calls = 0;
+    websocketpp::validate_callback pending;
+    s.set_async_validate_handler([&](websocketpp::connection_hdl hdl,
+        websocketpp::validate_callback done)
+    {
+        ++calls;
+        s.get_con_from_hdl(hdl)->set_status(
+            websocketpp::http::status_code::unauthorized);
+        pending = done;
+    });
+    websocketpp::validation_cache::ptr cache =
+        websocketpp::lib::make_shared<websocketpp::validation_cache>(
+            "Authorization", 1, 0);
+    s.set_validation_cache(cache);
+
+    auto start = [&](std::string const & token, std::stringstream & out) {
+        core_server::connection_ptr con = s.get_connection();
+        con->register_ostream(&out);
+        con->start();
+        std::string const req = handshake(token);
+        con->read_some(req.data(), req.size());
+        return con;
+    };
+
+    // the handshake waits for the answer
+    std::stringstream out1;
+    core_server::connection_ptr con1 = start("a", out1);
+    BOOST_CHECK_EQUAL( calls, 1 );
+    BOOST_CHECK_EQUAL( con1->get_state(), websocketpp::session::state::connecting );
+    BOOST_CHECK( out1.str().empty() );
+    pending(true);
+    BOOST_CHECK_EQUAL( con1->get_state(), websocketpp::session::state::open );
+    BOOST_CHECK( out1.str().find("101 Switching Protocols") != std::string::npos );
+
+    // a second answer is ignored
+    pending(false);
+    BOOST_CHECK_EQUAL( con1->get_state(), websocketpp::session::state::open );
+
+    // the same token is accepted from the cache
+    std::stringstream out2;
+    core_server::connection_ptr con2 = start("a", out2);
+    BOOST_CHECK_EQUAL( calls, 1 );
+    BOOST_CHECK_EQUAL( con2->get_state(), websocketpp::session::state::open );
+
+    // rejections keep their status, and push out the least recent result
+    std::stringstream out3;
+    core_server::connection_ptr con3 = start("b", out3);
+    BOOST_CHECK_EQUAL( calls, 2 );
+    pending(false);
+    BOOST_CHECK( out3.str().find("401") != std::string::npos );
+
+    std::stringstream out4;
+    core_server::connection_ptr con4 = start("b", out4);
+    BOOST_CHECK_EQUAL( calls, 2 );
+    BOOST_CHECK( out4.str().find("401") != std::string::npos );
+    BOOST_CHECK_EQUAL( cache->size(), 1u );
+
+    std::stringstream out5;
+    core_server::connection_ptr con5 = start("a", out5);
+    BOOST_CHECK_EQUAL( calls, 3 );
+}
+
+struct session_data {
+    session_data() : messages(0) {}
+
+    int messages;
+    std::string name;
+};
+
+struct user_data_config : public websocketpp::config::core {
+    typedef session_data user_data_type;
+};
+
+BOOST_AUTO_TEST_CASE( inline_user_data ) {
+    typedef websocketpp::server<user_data_config> server_type;
+
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    server_type s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_message_handler([&](websocketpp::connection_hdl hdl,
+        server_type::message_ptr msg)
+    {
+        session_data * data = s.get_user_data(hdl);
+        BOOST_REQUIRE( data );
+        ++data->messages;
+        data->name = msg->get_payload();
+    });
+
+    server_type::connection_ptr con = s.get_connection();
+    std::stringstream output;
+    con->register_ostream(&output);
+    con->start();
+    con->read_some(handshake.data(), handshake.size());
+    BOOST_REQUIRE_EQUAL( con->get_state(), websocketpp::session::state::open );
+    BOOST_CHECK_EQUAL( con->get_user_data().messages, 0 );
+
+    // masked text frames "ab" and "cd"
+    std::string frames("\x81\x82\x00\x00\x00\x00" "ab"
+        "\x81\x82\x00\x00\x00\x00" "cd", 16);
+    con->read_some(frames.data(), frames.size());
+    BOOST_CHECK_EQUAL( con->get_user_data().messages, 2 );
+    BOOST_CHECK_EQUAL( con->get_user_data().name, "cd" );
+
+    // no space is taken by configs without data
+    BOOST_CHECK( std::is_empty<core_server::user_data_type>::value );
+
+    websocketpp::connection_hdl hdl = con->get_handle();
+    con.reset();
+    BOOST_CHECK( s.get_user_data(hdl) == NULL );
+}
+
+BOOST_AUTO_TEST_CASE( reconnect_manager_failover ) {
+    typedef websocketpp::server<websocketpp::config::asio> asio_server;
+    typedef websocketpp::client<websocketpp::config::asio_client> asio_client;
+
+    boost::asio::io_context ioc;
+    asio_server s;
+    asio_client c;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    c.clear_access_channels(websocketpp::log::alevel::all);
+    c.clear_error_channels(websocketpp::log::elevel::all);
+    s.init_asio(&ioc);
+    c.init_asio(&ioc);
+    s.set_reuse_addr(true);
+    s.listen(9125);
+    s.start_accept();
+
+    websocketpp::reconnect_manager<asio_client> link(c, "ws://127.0.0.1:9125");
+    link.set_standby(1);
+    link.set_backoff(10, 50);
+
+    int opens = 0;
+    int closes = 0;
+    size_t standby_after_promote = 99;
+    size_t standby_after_refill = 99;
+    uint64_t attempts = 0;
+    link.set_open_handler([&](websocketpp::connection_hdl hdl) {
+        ++opens;
+        if (opens == 1) {
+            // once the standby opened, lose the active connection
+            c.set_timer(200, [&, hdl](websocketpp::lib::error_code const &) {
+                c.close(hdl, websocketpp::close::status::normal, "");
+            });
+        } else {
+            standby_after_promote = link.get_standby_count();
+            c.set_timer(200, [&](websocketpp::lib::error_code const &) {
+                standby_after_refill = link.get_standby_count();
+                attempts = link.get_attempts();
+                link.stop();
+                s.stop_listening();
+            });
+        }
+    });
+    link.set_close_handler([&](websocketpp::connection_hdl) {
+        ++closes;
+    });
+
+    // retries with nothing listening back off
+    websocketpp::reconnect_manager<asio_client> dead(c, "ws://127.0.0.1:9126");
+    dead.set_backoff(5, 20);
+    BOOST_CHECK_EQUAL( dead.get_backoff_cap(1), 5 );
+    BOOST_CHECK_EQUAL( dead.get_backoff_cap(2), 10 );
+    BOOST_CHECK_EQUAL( dead.get_backoff_cap(10), 20 );
+    c.set_timer(300, [&](websocketpp::lib::error_code const &) {
+        dead.stop();
+    });
+
+    link.start();
+    dead.start();
+    ioc.run_for(std::chrono::seconds(5));
+
+    // the standby took over at once, and a new standby replaced it
+    BOOST_CHECK_EQUAL( opens, 2 );
+    BOOST_CHECK_EQUAL( closes, 2 );
+    BOOST_CHECK_EQUAL( standby_after_promote, 0u );
+    BOOST_CHECK_EQUAL( standby_after_refill, 1u );
+    BOOST_CHECK_EQUAL( attempts, 3u );
+
+    BOOST_CHECK( dead.get_active().expired() );
+    BOOST_CHECK_GE( dead.get_failures(), 2u );
+    BOOST_CHECK_EQUAL( dead.get_attempts(), dead.get_failures() );
+}
+
+namespace {
+
+struct netem_result {
+    uint64_t open_time = 0;
+    uint64_t echo_time = 0;
+    uint64_t end_time = 0;
+    std::string echo;
+    bool closed = false;
+};
+
+// client sends payload, server echoes it, client closes
+netem_result run_netem(websocketpp::transport::iostream::link_profile const & p,
+    std::string const & payload, uint32_t seed = 1)
+{
+    typedef websocketpp::server<websocketpp::config::core> server;
+    typedef websocketpp::client<websocketpp::config::core> client;
+    typedef websocketpp::transport::iostream::emulated_link<
+        server::connection_type> link_type;
+
+    server s;
+    client c;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    c.clear_access_channels(websocketpp::log::alevel::all);
+
+    netem_result ret;
+    link_type * link = NULL;
+
+    s.set_message_handler([&s](websocketpp::connection_hdl hdl,
+        server::message_ptr msg)
+    {
+        s.send(hdl, msg->get_payload(), msg->get_opcode());
+    });
+    c.set_open_handler([&](websocketpp::connection_hdl hdl) {
+        ret.open_time = link->get_time();
+        c.send(hdl, payload, websocketpp::frame::opcode::binary);
+    });
+    c.set_message_handler([&](websocketpp::connection_hdl hdl,
+        client::message_ptr msg)
+    {
+        ret.echo_time = link->get_time();
+        ret.echo = msg->get_payload();
+        c.close(hdl, websocketpp::close::status::normal, "");
+    });
+    c.set_close_handler([&](websocketpp::connection_hdl) {
+        ret.closed = true;
+    });
+
+    websocketpp::lib::error_code ec;
+    client::connection_ptr ccon = c.get_connection("ws://localhost/", ec);
+    BOOST_REQUIRE( !ec );
+    server::connection_ptr scon = s.get_connection();
+
+    link_type l(ccon, scon, seed);
+    l.set_profile(p);
+    link = &l;
+
+    scon->start();
+    c.connect(ccon);
+    l.run();
+
+    ret.end_time = l.get_time();
+    BOOST_CHECK_EQUAL( l.get_in_flight_a_to_b(), 0u );
+    BOOST_CHECK_EQUAL( l.get_in_flight_b_to_a(), 0u );
+    BOOST_CHECK_GT( l.get_bytes_a_to_b(), payload.size() );
+    return ret;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( netem_latency_and_fragmentation ) {
+    websocketpp::transport::iostream::link_profile p;
+    p.latency = 1000;
+    p.max_segment = 1;
+
+    netem_result r = run_netem(p, "hello");
+    BOOST_CHECK_EQUAL( r.echo, "hello" );
+    BOOST_CHECK( r.closed );
+    // request and response, then the message there and back
+    BOOST_CHECK_EQUAL( r.open_time, 2000u );
+    BOOST_CHECK_EQUAL( r.echo_time, 4000u );
+}
+
+BOOST_AUTO_TEST_CASE( netem_bandwidth_and_window ) {
+    websocketpp::transport::iostream::link_profile p;
+    p.bandwidth = 1000000;
+    p.window = 4096;
+
+    std::string payload(100000, 'x');
+    netem_result r = run_netem(p, payload);
+    BOOST_CHECK( r.echo == payload );
+    BOOST_CHECK( r.closed );
+    // 100ms each way at 1MB/s
+    BOOST_CHECK_GE( r.echo_time - r.open_time, 200000u );
+    BOOST_CHECK_LT( r.echo_time - r.open_time, 210000u );
+}
+
+BOOST_AUTO_TEST_CASE( netem_reproducible ) {
+    websocketpp::transport::iostream::link_profile p;
+    p.latency = 5000;
+    p.jitter = 2000;
+    p.max_segment = 100;
+    p.stall_probability = 0.05;
+    p.stall = 20000;
+
+    std::string payload(10000, 'y');
+    netem_result a = run_netem(p, payload, 7);
+    netem_result b = run_netem(p, payload, 7);
+    BOOST_CHECK( a.echo == payload );
+    BOOST_CHECK( a.closed );
+    BOOST_CHECK_EQUAL( a.end_time, b.end_time );
+    BOOST_CHECK_EQUAL( a.echo_time, b.echo_time );
+    BOOST_CHECK_GE( a.echo_time - a.open_time, 10000u );
+}
+
+// masked frame of a payload, a 16 bit length and the mask 0x11223344
+static std::string masked_frame(uint8_t first, std::string const & payload) {
+    std::string frame;
+    frame += char(first);
+    frame += char(0x80 | 126);
+    frame += char(payload.size() >> 8);
+    frame += char(payload.size() & 0xff);
+    char const mask[4] = {0x11, 0x22, 0x33, 0x44};
+    frame.append(mask, 4);
+    for (size_t i = 0; i < payload.size(); ++i) {
+        frame += char(payload[i] ^ mask[i % 4]);
+    }
+    return frame;
+}
+
+BOOST_AUTO_TEST_CASE( direct_payload_reads ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    std::vector<std::string> received;
+    s.set_message_handler([&](websocketpp::connection_hdl,
+        core_server::message_ptr msg)
+    {
+        received.push_back(msg->get_payload());
+    });
+
+    core_server::connection_ptr con = s.get_connection();
+    std::stringstream output;
+    con->register_ostream(&output);
+    con->start();
+    con->read_some(handshake.data(), handshake.size());
+    BOOST_REQUIRE_EQUAL( con->get_state(), websocketpp::session::state::open );
+
+    std::string binary(50000, '\0');
+    for (size_t i = 0; i < binary.size(); ++i) {
+        binary[i] = char(i * 7);
+    }
+    // a two byte character on every odd offset, so reads split some of them
+    std::string text;
+    while (text.size() < 40000) {
+        text += "a\xc3\xa9";
+    }
+
+    // binary message in two fragments, then a text message, fed in reads
+    // that do not line up with frame boundaries
+    std::string frames = masked_frame(0x02, binary.substr(0, 30000)) +
+        masked_frame(0x80, binary.substr(30000)) + masked_frame(0x81, text);
+    for (size_t i = 0; i < frames.size(); i += 7001) {
+        size_t n = (std::min)(size_t(7001), frames.size() - i);
+        BOOST_REQUIRE_EQUAL( con->read_all(frames.data() + i, n), n );
+    }
+
+    BOOST_REQUIRE_EQUAL( received.size(), 2u );
+    BOOST_CHECK( received[0] == binary );
+    BOOST_CHECK( received[1] == text );
+
+    // invalid UTF-8 in the directly read part of a text frame
+    text[30001] = char(0xff);
+    frames = masked_frame(0x81, text);
+    con->read_all(frames.data(), frames.size());
+    BOOST_CHECK_EQUAL( received.size(), 2u );
+    BOOST_CHECK( con->get_state() != websocketpp::session::state::open );
+    BOOST_CHECK_EQUAL( con->get_local_close_code(),
+        websocketpp::close::status::invalid_payload );
+}
+
+BOOST_AUTO_TEST_CASE( ring_queue_inline_slots ) {
+    typedef websocketpp::lib::shared_ptr<int> int_ptr;
+    websocketpp::ring_queue<int_ptr> q;
+    BOOST_CHECK_EQUAL( q.capacity(), 4u );
+
+    // moved in and out without touching the reference count
+    int_ptr value = websocketpp::lib::make_shared<int>(0);
+    q.push_back(std::move(value));
+    BOOST_CHECK( !value );
+    value = std::move(q.front());
+    q.pop_front();
+    BOOST_CHECK_EQUAL( value.use_count(), 1 );
+
+    // wrapping around the inline slots
+    for (int i = 0; i < 10; ++i) {
+        q.push_back(websocketpp::lib::make_shared<int>(i));
+        if (i % 2) {
+            q.pop_front();
+        }
+    }
+    BOOST_CHECK_EQUAL( q.size(), 5u );
+    BOOST_CHECK( q.on_heap() );
+    BOOST_CHECK_EQUAL( q.capacity(), 8u );
+    BOOST_CHECK_EQUAL( *q.front(), 5 );
+
+    websocketpp::ring_queue<int_ptr> small;
+    small.push_back(websocketpp::lib::make_shared<int>(42));
+    BOOST_CHECK( !small.on_heap() );
+
+    // a heap queue hands over its slots, an inline one moves its elements
+    small.swap(q);
+    BOOST_CHECK( small.on_heap() );
+    BOOST_CHECK( !q.on_heap() );
+    BOOST_REQUIRE_EQUAL( q.size(), 1u );
+    BOOST_CHECK_EQUAL( *q.front(), 42 );
+    int expected = 5;
+    for (websocketpp::ring_queue<int_ptr>::iterator it = small.begin();
+        it != small.end(); ++it)
+    {
+        BOOST_CHECK_EQUAL( **it, expected++ );
+    }
+
+    websocketpp::ring_queue<int_ptr>().swap(small);
+    BOOST_CHECK( small.empty() );
+    BOOST_CHECK( !small.on_heap() );
+}
+
+// opening handshake offering subprotocols
+static std::string resume_handshake(std::string const & protocols) {
+    return "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+        "Sec-WebSocket-Protocol: " + protocols + "\r\n\r\n";
+}
+
+BOOST_AUTO_TEST_CASE( resumable_sessions ) {
+    typedef websocketpp::resume::session_store<core_server> store_type;
+    websocketpp::frame::opcode::value const text =
+        websocketpp::frame::opcode::text;
+
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    store_type sessions(s);
+    sessions.set_replay_limit(4, 1024);
+    bool resumed = false;
+    s.set_validate_handler([&](websocketpp::connection_hdl hdl) {
+        websocketpp::lib::error_code ec;
+        resumed = sessions.accept(s.get_con_from_hdl(hdl), ec);
+        return ec ? websocketpp::session::validation::reject :
+            websocketpp::session::validation::accept;
+    });
+    s.set_open_handler([&](websocketpp::connection_hdl hdl) {
+        sessions.attach(hdl);
+    });
+    s.set_close_handler([&](websocketpp::connection_hdl hdl) {
+        sessions.detach(hdl);
+    });
+    s.set_fail_handler([&](websocketpp::connection_hdl hdl) {
+        sessions.detach(hdl);
+    });
+
+    websocketpp::lib::error_code ec;
+    auto frame = [](std::string const & payload) {
+        return std::string("\x81") + char(payload.size()) + payload;
+    };
+
+    // a fresh session
+    std::stringstream out1;
+    core_server::connection_ptr con1 = s.get_connection();
+    con1->register_ostream(&out1);
+    con1->start();
+    std::string handshake = resume_handshake("resume.abc");
+    con1->read_some(handshake.data(), handshake.size());
+    BOOST_REQUIRE_EQUAL( con1->get_state(), websocketpp::session::state::open );
+    BOOST_CHECK( !resumed );
+    BOOST_CHECK_EQUAL( con1->get_subprotocol(), "resume.abc" );
+    BOOST_CHECK_EQUAL( sessions.get_session(con1->get_handle()), "abc" );
+
+    out1.str("");
+    BOOST_CHECK_EQUAL( sessions.send("abc", "m1", text, ec), 1u );
+    BOOST_CHECK_EQUAL( sessions.send("abc", "m2", text, ec), 2u );
+    BOOST_CHECK_EQUAL( sessions.send("abc", "m3", text, ec), 3u );
+    BOOST_CHECK_EQUAL( out1.str(), frame("m1") + frame("m2") + frame("m3") );
+
+    // the connection drops, sends are buffered
+    con1->fatal_error();
+    BOOST_CHECK( sessions.get_session(con1->get_handle()).empty() );
+    BOOST_CHECK_EQUAL( sessions.send("abc", "m4", text, ec), 4u );
+    BOOST_CHECK( !ec );
+    sessions.send("nope", "m", text, ec);
+    BOOST_CHECK_EQUAL( ec, websocketpp::error::bad_connection );
+
+    // the client got m1 and m2, only m3 and m4 are sent again
+    std::stringstream out2;
+    core_server::connection_ptr con2 = s.get_connection();
+    con2->register_ostream(&out2);
+    con2->start();
+    handshake = resume_handshake("resume.abc.2, resume.abc");
+    con2->read_some(handshake.data(), handshake.size());
+    BOOST_REQUIRE_EQUAL( con2->get_state(), websocketpp::session::state::open );
+    BOOST_CHECK( resumed );
+    BOOST_CHECK_EQUAL( con2->get_subprotocol(), "resume.abc.2" );
+    std::string response = out2.str();
+    BOOST_CHECK( response.substr(response.find("\r\n\r\n") + 4) ==
+        frame("m3") + frame("m4") );
+    BOOST_CHECK_EQUAL( sessions.buffered("abc"), 2u );
+
+    // m3 falls out of the four message replay buffer, so a client that got
+    // up to m2 has to start over
+    for (int i = 5; i <= 7; ++i) {
+        sessions.send("abc", "m" + std::to_string(i), text, ec);
+    }
+    BOOST_CHECK_EQUAL( sessions.buffered("abc"), 4u );
+    con2->fatal_error();
+
+    core_server::connection_ptr con3 = s.get_connection();
+    std::stringstream out3;
+    con3->register_ostream(&out3);
+    con3->start();
+    handshake = resume_handshake("resume.abc.2, resume.abc");
+    con3->read_some(handshake.data(), handshake.size());
+    BOOST_REQUIRE_EQUAL( con3->get_state(), websocketpp::session::state::open );
+    BOOST_CHECK( !resumed );
+    BOOST_CHECK_EQUAL( con3->get_subprotocol(), "resume.abc" );
+    BOOST_CHECK_EQUAL( sessions.buffered("abc"), 0u );
+    BOOST_CHECK_EQUAL( sessions.send("abc", "n1", text, ec), 1u );
+
+    // no session offered
+    core_server::connection_ptr con4 = s.get_connection();
+    std::stringstream out4;
+    con4->register_ostream(&out4);
+    con4->start();
+    handshake = resume_handshake("chat");
+    con4->read_some(handshake.data(), handshake.size());
+    BOOST_CHECK( con4->get_state() != websocketpp::session::state::open );
+
+    // detached sessions expire
+    con3->fatal_error();
+    BOOST_CHECK_EQUAL( sessions.size(), 1u );
+    sessions.set_ttl(0);
+    BOOST_CHECK_EQUAL( sessions.expire(), 1u );
+    BOOST_CHECK_EQUAL( sessions.size(), 0u );
+}
+
+BOOST_AUTO_TEST_CASE( resumable_session_cursor ) {
+    typedef websocketpp::client<websocketpp::config::core> client_type;
+    client_type c;
+    websocketpp::resume::session_cursor cursor;
+    BOOST_CHECK_EQUAL( cursor.get_id().size(), 32u );
+
+    websocketpp::lib::error_code ec;
+    client_type::connection_ptr con = c.get_connection("ws://localhost/", ec);
+    BOOST_REQUIRE( !ec );
+    cursor.offer(con);
+    BOOST_REQUIRE_EQUAL( con->get_requested_subprotocols().size(), 1u );
+    BOOST_CHECK_EQUAL( con->get_requested_subprotocols()[0],
+        "resume." + cursor.get_id() );
+    BOOST_CHECK( !cursor.opened(con) );
+
+    cursor.received();
+    cursor.received();
+    con = c.get_connection("ws://localhost/", ec);
+    cursor.offer(con);
+    BOOST_REQUIRE_EQUAL( con->get_requested_subprotocols().size(), 2u );
+    BOOST_CHECK_EQUAL( con->get_requested_subprotocols()[0],
+        "resume." + cursor.get_id() + ".2" );
+
+    std::string id;
+    uint64_t last;
+    bool resuming;
+    BOOST_CHECK( websocketpp::resume::parse_token("resume",
+        con->get_requested_subprotocols()[0], id, last, resuming) );
+    BOOST_CHECK_EQUAL( id, cursor.get_id() );
+    BOOST_CHECK_EQUAL( last, 2u );
+    BOOST_CHECK( resuming );
+    BOOST_CHECK( !websocketpp::resume::parse_token("resume", "resume.a.b", id,
+        last, resuming) );
+    BOOST_CHECK( !websocketpp::resume::parse_token("resume", "resumex.a", id,
+        last, resuming) );
+}
+
+BOOST_AUTO_TEST_CASE( slow_handlers ) {
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    core_server::metrics_ptr m =
+        websocketpp::lib::make_shared<websocketpp::metrics>();
+    s.set_metrics(m);
+    s.set_slow_handler_threshold(1000);
+
+    s.set_open_handler([](websocketpp::connection_hdl) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    });
+    s.set_message_handler([](websocketpp::connection_hdl,
+        core_server::message_ptr) {});
+
+    std::stringstream out;
+    core_server::connection_ptr con = s.get_connection();
+    con->register_ostream(&out);
+    con->start();
+
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    con->read_some(handshake.data(), handshake.size());
+    BOOST_REQUIRE_EQUAL( con->get_state(), websocketpp::session::state::open );
+
+    // a fast handler is not counted
+    std::string frame("\x81\x82\x00\x00\x00\x00hi", 8);
+    con->read_some(frame.data(), frame.size());
+
+    websocketpp::metrics_snapshot ms = m->get_snapshot();
+    BOOST_CHECK_EQUAL( ms.slow_handlers[websocketpp::handler_type::open], 1u );
+    BOOST_CHECK_EQUAL(
+        ms.slow_handlers[websocketpp::handler_type::message], 0u );
+    BOOST_CHECK_EQUAL( ms.slow_handler.count(), 1u );
+    BOOST_CHECK( ms.slow_handler.max() >= std::chrono::milliseconds(5) );
+
+    std::string text = m->get_openmetrics();
+    BOOST_CHECK( text.find(
+        "\nwebsocketpp_slow_handlers_total{handler=\"open\"} 1\n") !=
+        std::string::npos );
+}
+
+BOOST_AUTO_TEST_CASE( loop_lag_probe ) {
+    websocketpp::server<websocketpp::config::asio> s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.init_asio();
+
+    websocketpp::server<websocketpp::config::asio>::metrics_ptr m =
+        websocketpp::lib::make_shared<websocketpp::metrics>();
+    s.set_metrics(m);
+    s.set_loop_lag_probe(1);
+
+    // the probe keeps the loop running until it is stopped
+    s.set_timer(30, [&](websocketpp::lib::error_code const &) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        s.set_loop_lag_probe(0);
+    });
+    s.run();
+
+    websocketpp::metrics_snapshot ms = m->get_snapshot();
+    BOOST_CHECK( ms.loop_lag.count() > 0 );
+    BOOST_CHECK( m->get_openmetrics().find("websocketpp_loop_lag_seconds_count")
+        != std::string::npos );
+}
+
+BOOST_AUTO_TEST_CASE( top_connections ) {
+    core_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    // no registry to walk
+    BOOST_CHECK( s.get_top_connections(websocketpp::usage::bytes_in,
+        2).empty() );
+
+    s.set_connection_registry(
+        websocketpp::lib::make_shared<core_server::registry_type>());
+    s.set_accounting(true);
+    s.set_message_handler([](websocketpp::connection_hdl,
+        core_server::message_ptr)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    });
+
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    std::string frame("\x81\x82\x00\x00\x00\x00hi", 8);
+
+    std::vector<core_server::connection_ptr> cons;
+    std::stringstream out[3];
+    for (int i = 0; i < 3; ++i) {
+        core_server::connection_ptr con = s.get_connection();
+        con->register_ostream(&out[i]);
+        con->start();
+        con->read_some(handshake.data(), handshake.size());
+        BOOST_REQUIRE_EQUAL( con->get_state(),
+            websocketpp::session::state::open );
+        // connection i receives i messages
+        for (int j = 0; j < i; ++j) {
+            con->read_some(frame.data(), frame.size());
+        }
+        cons.push_back(con);
+    }
+
+    typedef std::vector<std::pair<uint64_t, core_server::connection_ptr> >
+        top_type;
+    top_type top = s.get_top_connections(websocketpp::usage::messages_in, 2);
+    BOOST_REQUIRE_EQUAL( top.size(), 2u );
+    BOOST_CHECK_EQUAL( top[0].first, 2u );
+    BOOST_CHECK( top[0].second == cons[2] );
+    BOOST_CHECK_EQUAL( top[1].first, 1u );
+    BOOST_CHECK( top[1].second == cons[1] );
+
+    top = s.get_top_connections(websocketpp::usage::handler_time, 5);
+    BOOST_REQUIRE_EQUAL( top.size(), 3u );
+    BOOST_CHECK( top[0].second == cons[2] );
+    BOOST_CHECK( top[0].first >= 2000000u );
+    BOOST_CHECK_EQUAL( top[2].first, 0u );
+
+    BOOST_CHECK( cons[2]->get_usage(websocketpp::usage::consume_time) > 0 );
+    BOOST_CHECK( cons[2]->get_usage(websocketpp::usage::cpu_time) >=
+        cons[2]->get_usage(websocketpp::usage::handler_time) );
+}
+
+BOOST_AUTO_TEST_CASE( connection_memory_resource ) {
+    websocketpp::counting_resource resource;
+    {
+        core_server s;
+        s.clear_access_channels(websocketpp::log::alevel::all);
+        s.clear_error_channels(websocketpp::log::elevel::all);
+        s.set_memory_resource(&resource);
+        BOOST_CHECK( s.get_memory_resource() == &resource );
+
+        std::string received;
+        s.set_message_handler([&](websocketpp::connection_hdl,
+            core_server::message_ptr msg)
+        {
+            received = msg->get_payload();
+        });
+
+        std::stringstream out;
+        core_server::connection_ptr con = s.get_connection();
+        BOOST_CHECK_EQUAL( resource.blocks(), 1u );
+        BOOST_CHECK( resource.bytes() >= sizeof(core_server::connection_type) );
+
+        con->register_ostream(&out);
+        con->start();
+        std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+            "Connection: upgrade\r\nUpgrade: websocket\r\n"
+            "Sec-WebSocket-Version: 13\r\n"
+            "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+        con->read_some(handshake.data(), handshake.size());
+        BOOST_REQUIRE_EQUAL( con->get_state(),
+            websocketpp::session::state::open );
+
+        // the processor and messages come from the resource too
+        size_t const allocations = resource.allocations();
+        BOOST_CHECK( allocations > 1u );
+        std::string frame("\x81\x82\x00\x00\x00\x00hi", 8);
+        con->read_some(frame.data(), frame.size());
+        BOOST_CHECK_EQUAL( received, "hi" );
+        BOOST_CHECK( resource.allocations() > allocations );
+    }
+    BOOST_CHECK_EQUAL( resource.blocks(), 0u );
+    BOOST_CHECK_EQUAL( resource.bytes(), 0u );
+}
+
+BOOST_AUTO_TEST_CASE( huge_page_resource ) {
+    websocketpp::huge_page_resource r(1,
+        websocketpp::huge_page_resource::regular_pages);
+    BOOST_CHECK_EQUAL( r.get_stats().regions, 0u );
+
+    void * a = r.allocate(100, 8);
+    void * b = r.allocate(100, 64);
+    BOOST_CHECK_EQUAL( reinterpret_cast<size_t>(b) % 64, 0u );
+    BOOST_CHECK( r.owns(a) );
+    BOOST_CHECK( r.owns(b) );
+    BOOST_CHECK( !r.owns(&r) );
+
+    websocketpp::huge_page_resource::stats st = r.get_stats();
+    BOOST_CHECK_EQUAL( st.regions, 1u );
+    BOOST_CHECK_EQUAL( st.reserved_bytes,
+        websocketpp::huge_page_resource::huge_page_size );
+    BOOST_CHECK( st.used_bytes >= 200u );
+    BOOST_CHECK_EQUAL( st.explicit_regions, 0u );
+    BOOST_CHECK_EQUAL( st.transparent_regions, 0u );
+
+    // larger than a region gets a region of its own
+    size_t const large = websocketpp::huge_page_resource::huge_page_size + 1;
+    void * c = r.allocate(large, 8);
+    BOOST_CHECK( r.owns(c) );
+    BOOST_CHECK_EQUAL( r.get_stats().regions, 2u );
+    r.deallocate(c, large, 8);
+    r.deallocate(b, 100, 64);
+    r.deallocate(a, 100, 8);
+
+    // reserved regions are used before new ones are mapped
+    websocketpp::huge_page_resource t;
+    BOOST_CHECK( t.reserve(1) );
+    st = t.get_stats();
+    BOOST_CHECK_EQUAL( st.regions, 1u );
+    BOOST_CHECK_EQUAL( st.used_bytes, 0u );
+    void * d = t.allocate(4096, 4096);
+    BOOST_CHECK( t.owns(d) );
+    BOOST_CHECK_EQUAL( t.get_stats().regions, 1u );
+    t.deallocate(d, 4096, 4096);
+}
+
+BOOST_AUTO_TEST_CASE( huge_page_backed_slab ) {
+    typedef websocketpp::slab_cache<3000, 64> pool_type;
+
+    // outlives the thread caches that hold its blocks
+    static websocketpp::huge_page_resource resource;
+    pool_type::set_backing(&resource);
+
+    size_t const n = pool_type::max_free + 10;
+    std::vector<void *> blocks;
+    for (size_t i = 0; i < n; ++i) {
+        blocks.push_back(pool_type::allocate());
+        BOOST_CHECK( resource.owns(blocks.back()) );
+        BOOST_CHECK_EQUAL( reinterpret_cast<size_t>(blocks.back()) % 64, 0u );
+    }
+    size_t const used = resource.get_stats().used_bytes;
+
+    // what the thread does not cache goes to the shared list
+    for (size_t i = 0; i < n; ++i) {
+        pool_type::release(blocks[i]);
+    }
+    BOOST_CHECK_EQUAL( pool_type::cached(), n - 10 );
+    BOOST_CHECK_EQUAL( pool_type::shared_free(), 10u );
+
+    // and other threads take from it before the resource
+    std::thread t([] {
+        void * p = pool_type::allocate();
+        BOOST_CHECK( resource.owns(p) );
+        pool_type::release(p);
+    });
+    t.join();
+    BOOST_CHECK_EQUAL( pool_type::shared_free(), 10u );
+    BOOST_CHECK_EQUAL( resource.get_stats().used_bytes, used );
+}
+
+BOOST_AUTO_TEST_CASE( paced_broadcast ) {
+    typedef websocketpp::server<websocketpp::config::asio> asio_server;
+    typedef websocketpp::client<websocketpp::config::asio_client> asio_client;
+    typedef std::chrono::steady_clock clock;
+
+    boost::asio::io_context ioc;
+    asio_server s;
+    asio_client c;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    c.clear_access_channels(websocketpp::log::alevel::all);
+    c.clear_error_channels(websocketpp::log::elevel::all);
+    s.init_asio(&ioc);
+    c.init_asio(&ioc);
+    s.set_reuse_addr(true);
+    s.set_connection_registry(
+        websocketpp::lib::make_shared<asio_server::registry_type>());
+
+    // four connections over 60ms are sent to one per tick
+    s.set_broadcast_pacing(60, 0);
+
+    size_t const n = 4;
+    size_t opened = 0;
+    size_t scheduled = 0;
+    s.set_open_handler([&](websocketpp::connection_hdl) {
+        if (++opened == n) {
+            websocketpp::lib::error_code ec;
+            scheduled = s.broadcast(s.prepare_broadcast("tick",
+                websocketpp::frame::opcode::text), asio_server::
+                broadcast_filter(), ec);
+        }
+    });
+
+    std::vector<clock::time_point> received;
+    std::vector<websocketpp::connection_hdl> hdls;
+    c.set_message_handler([&](websocketpp::connection_hdl,
+        asio_client::message_ptr msg)
+    {
+        BOOST_CHECK_EQUAL( msg->get_payload(), "tick" );
+        received.push_back(clock::now());
+        if (received.size() == n) {
+            for (size_t i = 0; i < hdls.size(); ++i) {
+                c.close(hdls[i], websocketpp::close::status::normal, "");
+            }
+            s.stop_listening();
+        }
+    });
+
+    s.listen(9127);
+    s.start_accept();
+
+    for (size_t i = 0; i < n; ++i) {
+        websocketpp::lib::error_code ec;
+        asio_client::connection_ptr con = c.get_connection(
+            "ws://127.0.0.1:9127", ec);
+        BOOST_REQUIRE( !ec );
+        hdls.push_back(con->get_handle());
+        c.connect(con);
+    }
+    ioc.run();
+
+    BOOST_CHECK_EQUAL( scheduled, n );
+    BOOST_REQUIRE_EQUAL( received.size(), n );
+    BOOST_CHECK( received.back() - received.front() >=
+        std::chrono::milliseconds(20) );
+}
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2013, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE delta_extension
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+
+#include <websocketpp/extensions/chain.hpp>
+#include <websocketpp/extensions/delta.hpp>
+#include <websocketpp/http/parser.hpp>
+
+namespace delta = websocketpp::extensions::delta;
+
+// keys messages on their first word
+struct word_key {
+    static std::string_view key(websocketpp::frame::opcode::value,
+        std::string const & payload)
+    {
+        return std::string_view(payload).substr(0, payload.find(' '));
+    }
+};
+
+struct ext_pair {
+    ext_pair(size_t server_max = 16, size_t client_max = 16) {
+        server.set_max_streams(server_max);
+        client.set_max_streams(client_max);
+
+        websocketpp::http::parameter_list offer;
+        websocketpp::http::parser::parser p;
+        p.parse_parameter_list(client.generate_offer(), offer);
+        BOOST_REQUIRE_EQUAL( offer.size(), 1u );
+        neg = server.negotiate(offer[0].second);
+        BOOST_REQUIRE( !neg.first );
+
+        websocketpp::http::parameter_list response;
+        p.parse_parameter_list(neg.second, response);
+        BOOST_REQUIRE_EQUAL( response.size(), 1u );
+        BOOST_REQUIRE( !client.negotiate(response[0].second).first );
+    }
+
+    // sends from server to client, returning the encoded size
+    size_t send(std::string const & payload) {
+        std::string wire = payload;
+        bool transformed = false;
+        BOOST_REQUIRE( !server.encode(websocketpp::frame::opcode::text, wire,
+            transformed) );
+        BOOST_REQUIRE( transformed );
+        size_t size = wire.size();
+        BOOST_REQUIRE( !client.decode(websocketpp::frame::opcode::text,
+            wire) );
+        BOOST_CHECK( wire == payload );
+        return size;
+    }
+
+    delta::extension<word_key>::err_str_pair neg;
+    delta::extension<word_key> server;
+    delta::extension<word_key> client;
+};
+
+static std::string state(int price, int volume) {
+    std::string s = "quote {\"symbol\":\"ACME\",\"exchange\":\"NASDAQ\","
+        "\"currency\":\"USD\",\"price\":" + std::to_string(price) +
+        ",\"volume\":" + std::to_string(volume) + ",\"bid\":100,\"ask\":101,"
+        "\"open\":99,\"close\":102,\"high\":110,\"low\":95}";
+    return s;
+}
+
+BOOST_AUTO_TEST_CASE( negotiation ) {
+    ext_pair e(8, 4);
+    BOOST_CHECK_EQUAL( e.neg.second, "x-websocketpp-delta; max_streams=4" );
+    BOOST_CHECK( e.server.is_enabled() );
+    BOOST_CHECK( e.client.is_enabled() );
+
+    delta::extension<> ext;
+    websocketpp::http::attribute_list bad;
+    bad["window"] = "1";
+    BOOST_CHECK_EQUAL( ext.negotiate(bad).first,
+        delta::error::invalid_attributes );
+    bad.clear();
+    bad["max_streams"] = "x";
+    BOOST_CHECK_EQUAL( ext.negotiate(bad).first,
+        delta::error::invalid_attribute_value );
+}
+
+BOOST_AUTO_TEST_CASE( repeated_state ) {
+    ext_pair e;
+
+    std::string first = state(100, 5000);
+    BOOST_CHECK_EQUAL( e.send(first), first.size() + 2 + 5 );
+
+    // small changes go out as patches
+    std::string second = state(101, 5100);
+    BOOST_CHECK_LT( e.send(second), second.size() / 4 );
+    BOOST_CHECK_LT( e.send(state(102, 5100)), second.size() / 4 );
+
+    // an unrelated payload is sent whole
+    std::string other = "quote " + std::string(200, 'x');
+    BOOST_CHECK_EQUAL( e.send(other), other.size() + 2 + 5 );
+
+    // short payloads too
+    BOOST_CHECK_EQUAL( e.send("quote 1"), 7u + 2 + 5 );
+}
+
+BOOST_AUTO_TEST_CASE( streams ) {
+    ext_pair e(16, 2);
+
+    e.send(state(100, 1));
+    e.send("trade " + std::string(100, 't'));
+    BOOST_CHECK_EQUAL( e.server.get_stream_count(), 2u );
+
+    // each stream patches against its own previous payload
+    BOOST_CHECK_LT( e.send(state(100, 2)), 60u );
+    BOOST_CHECK_LT( e.send("trade " + std::string(99, 't') + "u"), 30u );
+
+    // a third stream evicts the least recently used, on both sides
+    e.send("news " + std::string(100, 'n'));
+    BOOST_CHECK_EQUAL( e.server.get_stream_count(), 2u );
+    std::string again = state(100, 3);
+    BOOST_CHECK_EQUAL( e.send(again), again.size() + 2 + 5 );
+}
+
+BOOST_AUTO_TEST_CASE( bad_patches ) {
+    ext_pair e;
+    e.send(state(100, 1));
+
+    std::string wire = state(100, 2);
+    bool transformed;
+    BOOST_REQUIRE( !e.server.encode(websocketpp::frame::opcode::text, wire,
+        transformed) );
+
+    // a receiver that missed the base refuses the patch
+    delta::extension<> fresh;
+    std::string copy = wire;
+    BOOST_CHECK_EQUAL( fresh.decode(websocketpp::frame::opcode::text, copy),
+        delta::error::base_mismatch );
+
+    copy = wire.substr(0, wire.size() - 1);
+    BOOST_CHECK_EQUAL( e.client.decode(websocketpp::frame::opcode::text,
+        copy), delta::error::malformed_message );
+
+    copy = "\x05";
+    BOOST_CHECK_EQUAL( e.client.decode(websocketpp::frame::opcode::text,
+        copy), delta::error::malformed_message );
+}
+
+BOOST_AUTO_TEST_CASE( in_a_chain ) {
+    typedef websocketpp::extensions::chain<delta::extension<> > chain_type;
+    chain_type server;
+    chain_type client;
+
+    websocketpp::http::parameter_list offer;
+    websocketpp::http::parser::parser p;
+    p.parse_parameter_list(client.generate_offer(), offer);
+    chain_type::err_str_pair neg = server.negotiate(offer, true);
+    BOOST_REQUIRE( !neg.first );
+    websocketpp::http::parameter_list response;
+    p.parse_parameter_list(neg.second, response);
+    BOOST_REQUIRE( !client.negotiate(response, false).first );
+    BOOST_CHECK_EQUAL( server.enabled_bits(), websocketpp::frame::BHB0_RSV2 );
+
+    for (int i = 0; i < 3; ++i) {
+        std::string in = state(100 + i, 1);
+        std::string out;
+        uint8_t bits;
+        BOOST_REQUIRE( !server.encode(websocketpp::frame::opcode::text, in, out,
+            bits) );
+        BOOST_REQUIRE_EQUAL( bits, websocketpp::frame::BHB0_RSV2 );
+        BOOST_REQUIRE( !client.decode(websocketpp::frame::opcode::text, bits,
+            out) );
+        BOOST_CHECK( out == in );
+    }
+}
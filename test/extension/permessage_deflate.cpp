@@ -28,11 +28,13 @@
 #define BOOST_TEST_MODULE permessage_deflate
 #include <boost/test/unit_test.hpp>
 
+#include <websocketpp/common/functional.hpp>
 #include <websocketpp/error.hpp>
 
 #include <websocketpp/extensions/extension.hpp>
 #include <websocketpp/extensions/permessage_deflate/disabled.hpp>
 #include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+#include <websocketpp/extensions/permessage_deflate/compression_policy.hpp>
 
 #include <string>
 
@@ -729,10 +731,580 @@ BOOST_AUTO_TEST_CASE( compress_empty ) {
     BOOST_CHECK_EQUAL( compress_in, decompress_out );
 }
 
-/// @todo: more compression tests
-/**
- * - compress at different compression levels
- */
+BOOST_AUTO_TEST_CASE( compress_shared ) {
+    ext_vars v;
+
+    std::string compress_in = "Hello Hello Hello Hello";
+    std::string compress_out;
+    std::string shared_out;
+    std::string decompress_out;
+
+    // without context takeover the output can be shared
+    v.attr["server_no_context_takeover"].clear();
+    v.esp = v.exts.negotiate(v.attr);
+    BOOST_CHECK_EQUAL( v.esp.first, websocketpp::lib::error_code() );
+
+    v.ec = v.exts.init(true);
+    BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+    BOOST_CHECK_EQUAL( v.exts.get_shared_window_bits(), 15 );
+
+    v.ec = v.exts.compress(compress_in,compress_out);
+    BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+
+    v.ec = enabled_type::compress_shared(15,compress_in,shared_out);
+    BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+    BOOST_CHECK_EQUAL( compress_out, shared_out );
+
+    v.ec = v.exts.decompress(
+        reinterpret_cast<const uint8_t *>(shared_out.data()),
+        shared_out.size(),
+        decompress_out
+    );
+    BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+    BOOST_CHECK_EQUAL( compress_in, decompress_out );
+
+    // with context takeover it can not
+    v.ec = v.extc.init(true);
+    BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+    BOOST_CHECK_EQUAL( v.extc.get_shared_window_bits(), 0 );
+
+    BOOST_CHECK_EQUAL( disabled_type().get_shared_window_bits(), 0 );
+}
+
+struct chunk_collector {
+    void operator()(char const * data, size_t size) {
+        out.append(data,size);
+        ++chunks;
+    }
+
+    chunk_collector() : chunks(0) {}
+
+    std::string out;
+    size_t chunks;
+};
+
+BOOST_AUTO_TEST_CASE( decompress_chunks ) {
+    ext_vars v;
+
+    // decompresses to several chunks worth of output
+    std::string compress_in;
+    for (size_t i = 0; i < 40000; ++i) {
+        compress_in.push_back(char((i * 7919) % 251));
+    }
+    std::string compress_out;
+
+    v.ec = v.exts.init(true);
+    BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+
+    v.ec = v.exts.compress(compress_in,compress_out);
+    BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+
+    chunk_collector collector;
+    v.ec = v.exts.decompress_chunks(
+        reinterpret_cast<const uint8_t *>(compress_out.data()),
+        compress_out.size(),
+        websocketpp::lib::ref(collector)
+    );
+    BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+    BOOST_CHECK_EQUAL( collector.out, compress_in );
+    BOOST_CHECK( collector.chunks > 1 );
+}
+
+/// Backend that forwards to zlib_backend and counts the calls it receives
+struct counting_backend {
+    typedef websocketpp::extensions::permessage_deflate::zlib_backend zlib;
+
+    static int compress_calls;
+    static int decompress_calls;
+    static bool last_reset;
+
+    static size_t compressor_memory(uint8_t bits, int mem_level) {
+        return zlib::compressor_memory(bits,mem_level);
+    }
+    static size_t decompressor_memory(uint8_t bits) {
+        return zlib::decompressor_memory(bits);
+    }
+
+    class compressor {
+    public:
+        websocketpp::lib::error_code init(uint8_t bits, int mem_level) {
+            return m_impl.init(bits,mem_level);
+        }
+        websocketpp::lib::error_code compress(std::string const & in,
+            bool reset, std::string & out)
+        {
+            compress_calls++;
+            last_reset = reset;
+            return m_impl.compress(in,reset,out);
+        }
+        websocketpp::lib::error_code set_dictionary(uint8_t const * data,
+            size_t len)
+        {
+            return m_impl.set_dictionary(data,len);
+        }
+        websocketpp::lib::error_code set_params(int level,
+            websocketpp::extensions::permessage_deflate::strategy::value s)
+        {
+            return m_impl.set_params(level,s);
+        }
+    private:
+        zlib::compressor m_impl;
+    };
+
+    class decompressor {
+    public:
+        websocketpp::lib::error_code init(uint8_t bits) {
+            return m_impl.init(bits);
+        }
+        websocketpp::lib::error_code decompress(uint8_t const *& in,
+            size_t & in_len, unsigned char *& out, size_t & out_len)
+        {
+            decompress_calls++;
+            return m_impl.decompress(in,in_len,out,out_len);
+        }
+        websocketpp::lib::error_code set_dictionary(uint8_t const * data,
+            size_t len)
+        {
+            return m_impl.set_dictionary(data,len);
+        }
+    private:
+        zlib::decompressor m_impl;
+    };
+};
+
+int counting_backend::compress_calls = 0;
+int counting_backend::decompress_calls = 0;
+bool counting_backend::last_reset = false;
+
+BOOST_AUTO_TEST_CASE( custom_backend ) {
+    typedef websocketpp::extensions::permessage_deflate::enabled<config,
+        counting_backend> counted_type;
+
+    counted_type exts;
+    websocketpp::http::attribute_list attr;
+    attr["server_no_context_takeover"].clear();
+    exts.negotiate(attr);
+
+    websocketpp::lib::error_code ec = exts.init(true);
+    BOOST_CHECK_EQUAL( ec, websocketpp::lib::error_code() );
+
+    std::string compress_in = "Hello Hello Hello";
+    std::string compress_out;
+    std::string decompress_out;
+
+    ec = exts.compress(compress_in,compress_out);
+    BOOST_CHECK_EQUAL( ec, websocketpp::lib::error_code() );
+    BOOST_CHECK_EQUAL( counting_backend::compress_calls, 1 );
+    BOOST_CHECK( counting_backend::last_reset );
+    BOOST_CHECK_EQUAL( exts.get_shared_window_bits(), 15 );
+
+    ec = exts.decompress(
+        reinterpret_cast<const uint8_t *>(compress_out.data()),
+        compress_out.size(),decompress_out);
+    BOOST_CHECK_EQUAL( ec, websocketpp::lib::error_code() );
+    BOOST_CHECK_EQUAL( decompress_out, compress_in );
+    BOOST_CHECK( counting_backend::decompress_calls > 0 );
+
+    std::string shared_out;
+    ec = counted_type::compress_shared(15,compress_in,shared_out);
+    BOOST_CHECK_EQUAL( ec, websocketpp::lib::error_code() );
+    BOOST_CHECK_EQUAL( counting_backend::compress_calls, 2 );
+    BOOST_CHECK_EQUAL( shared_out, compress_out );
+}
+
+BOOST_AUTO_TEST_CASE( invalid_set_mem_level ) {
+    ext_vars v;
+
+    v.ec = v.exts.set_mem_level(0);
+    BOOST_CHECK_EQUAL( v.ec, pmde::make_error_code(pmde::invalid_mem_level) );
+
+    v.ec = v.exts.set_mem_level(10);
+    BOOST_CHECK_EQUAL( v.ec, pmde::make_error_code(pmde::invalid_mem_level) );
+
+    v.ec = v.exts.set_mem_level(9);
+    BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+}
+
+BOOST_AUTO_TEST_CASE( contexts_created_on_first_use ) {
+    ext_vars v;
+
+    v.ec = v.exts.init(true);
+    BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+    BOOST_CHECK( !v.exts.has_contexts() );
+
+    std::string compress_out;
+    v.ec = v.exts.compress("Hello",compress_out);
+    BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+    BOOST_CHECK( v.exts.has_contexts() );
+}
+
+BOOST_AUTO_TEST_CASE( memory_budget_limits_compressor ) {
+    typedef websocketpp::extensions::permessage_deflate::memory_budget
+        budget_type;
+    typedef websocketpp::extensions::permessage_deflate::zlib_backend
+        zlib_backend;
+
+    size_t deflate_size = zlib_backend::compressor_memory(15,4);
+    size_t inflate_size = zlib_backend::decompressor_memory(15);
+
+    websocketpp::lib::shared_ptr<budget_type> budget =
+        websocketpp::lib::make_shared<budget_type>(deflate_size);
+
+    std::string compress_in = "Hello";
+    std::string compress_out;
+    std::string decompress_out;
+
+    {
+        ext_vars v;
+        v.exts.set_memory_budget(budget);
+        v.extc.set_memory_budget(budget);
+        v.ec = v.exts.init(true);
+        v.ec = v.extc.init(false);
+
+        // the first compressor fits, the second does not
+        v.ec = v.exts.compress(compress_in,compress_out);
+        BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+        BOOST_CHECK_EQUAL( budget->get_used(), deflate_size );
+
+        v.ec = v.extc.reserve_compressor();
+        BOOST_CHECK_EQUAL( v.ec, pmde::make_error_code(pmde::memory_limit) );
+        v.ec = v.extc.compress(compress_in,compress_out);
+        BOOST_CHECK_EQUAL( v.ec, pmde::make_error_code(pmde::memory_limit) );
+
+        // decompressors are never refused
+        v.ec = v.extc.decompress(
+            reinterpret_cast<const uint8_t *>(compress_out.data()),
+            compress_out.size(),decompress_out);
+        BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+        BOOST_CHECK_EQUAL( decompress_out, compress_in );
+        BOOST_CHECK_EQUAL( budget->get_used(), deflate_size + inflate_size );
+    }
+
+    BOOST_CHECK_EQUAL( budget->get_used(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( release_idle_contexts ) {
+    typedef websocketpp::extensions::permessage_deflate::memory_budget
+        budget_type;
+
+    websocketpp::lib::shared_ptr<budget_type> budget =
+        websocketpp::lib::make_shared<budget_type>(1024*1024);
+
+    ext_vars v;
+    v.attr["server_no_context_takeover"].clear();
+    v.attr["client_no_context_takeover"].clear();
+    v.esp = v.exts.negotiate(v.attr);
+    v.exts.set_memory_budget(budget);
+    v.ec = v.exts.init(true);
+    BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+
+    std::string compress_in = "Hello";
+    std::string compress_out;
+    std::string decompress_out;
+
+    v.ec = v.exts.compress(compress_in,compress_out);
+    v.ec = v.exts.decompress(
+        reinterpret_cast<const uint8_t *>(compress_out.data()),
+        compress_out.size(),decompress_out);
+    BOOST_CHECK_EQUAL( decompress_out, compress_in );
+    BOOST_CHECK( budget->get_used() > 0 );
+
+    // used since the last call, kept
+    v.exts.release_idle(true,true);
+    BOOST_CHECK( v.exts.has_contexts() );
+
+    // idle for a whole period, released
+    v.exts.release_idle(true,true);
+    BOOST_CHECK( !v.exts.has_contexts() );
+    BOOST_CHECK_EQUAL( budget->get_used(), 0 );
+
+    // created again on next use
+    compress_out.clear();
+    v.ec = v.exts.compress(compress_in,compress_out);
+    BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+    BOOST_CHECK( v.exts.has_contexts() );
+}
+
+BOOST_AUTO_TEST_CASE( release_idle_keeps_context_history ) {
+    ext_vars v;
+    v.ec = v.exts.init(true);
+
+    std::string compress_out;
+    v.ec = v.exts.compress("Hello",compress_out);
+
+    // with context takeover the history must be kept
+    v.exts.release_idle(true,true);
+    v.exts.release_idle(true,true);
+    BOOST_CHECK( v.exts.has_contexts() );
+}
+
+BOOST_AUTO_TEST_CASE( compression_policy_rules ) {
+    websocketpp::extensions::permessage_deflate::compression_policy p;
+
+    // defaults compress every data message
+    BOOST_CHECK( p.should_compress(websocketpp::frame::opcode::text,1) );
+    BOOST_CHECK( p.should_compress(websocketpp::frame::opcode::binary,1) );
+    BOOST_CHECK( !p.should_compress(websocketpp::frame::opcode::ping,100) );
+
+    p.set_min_size(64);
+    BOOST_CHECK( !p.should_compress(websocketpp::frame::opcode::text,63) );
+    BOOST_CHECK( p.should_compress(websocketpp::frame::opcode::text,64) );
+
+    p.set_opcode(websocketpp::frame::opcode::binary,false);
+    BOOST_CHECK( !p.should_compress(websocketpp::frame::opcode::binary,100) );
+    BOOST_CHECK( p.should_compress(websocketpp::frame::opcode::text,100) );
+}
+
+BOOST_AUTO_TEST_CASE( compression_policy_backoff ) {
+    websocketpp::extensions::permessage_deflate::compression_policy p;
+    websocketpp::frame::opcode::value bin = websocketpp::frame::opcode::binary;
+    websocketpp::frame::opcode::value text = websocketpp::frame::opcode::text;
+
+    p.set_ratio_threshold(0.9,4);
+
+    // incompressible binary backs off to one message in four
+    p.record(bin,1000,1005);
+    BOOST_CHECK( !p.should_compress(bin,1000) );
+    BOOST_CHECK( !p.should_compress(bin,1000) );
+    BOOST_CHECK( !p.should_compress(bin,1000) );
+    BOOST_CHECK( p.should_compress(bin,1000) );
+    BOOST_CHECK( !p.should_compress(bin,1000) );
+
+    // text is sampled separately
+    p.record(text,1000,100);
+    BOOST_CHECK( p.should_compress(text,1000) );
+
+    // good samples bring the average back under the threshold
+    for (int i = 0; i < 16; ++i) {
+        p.record(bin,1000,100);
+    }
+    BOOST_CHECK( p.get_ratio(bin) < 0.9 );
+    BOOST_CHECK( p.should_compress(bin,1000) );
+    BOOST_CHECK( p.should_compress(bin,1000) );
+}
+
+BOOST_AUTO_TEST_CASE( set_dictionary_invalid ) {
+    ext_vars v;
+    websocketpp::lib::shared_ptr<std::string const> dictionary =
+        websocketpp::lib::make_shared<std::string const>("dictionary");
+
+    v.ec = v.exts.set_dictionary("",dictionary);
+    BOOST_CHECK_EQUAL( v.ec, pmde::make_error_code(pmde::invalid_dictionary) );
+
+    v.ec = v.exts.set_dictionary("a b",dictionary);
+    BOOST_CHECK_EQUAL( v.ec, pmde::make_error_code(pmde::invalid_dictionary) );
+
+    v.ec = v.exts.set_dictionary("json",
+        websocketpp::lib::make_shared<std::string const>());
+    BOOST_CHECK_EQUAL( v.ec, pmde::make_error_code(pmde::invalid_dictionary) );
+
+    v.ec = v.exts.set_dictionary("json",dictionary);
+    BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+}
+
+BOOST_AUTO_TEST_CASE( negotiate_dictionary ) {
+    ext_vars v;
+    websocketpp::lib::shared_ptr<std::string const> dictionary =
+        websocketpp::lib::make_shared<std::string const>("dictionary");
+
+    v.extc.set_dictionary("json",dictionary);
+    BOOST_CHECK_EQUAL( v.extc.generate_offer(), "permessage-deflate; "
+        "client_no_context_takeover; client_max_window_bits; x_dictionary=json" );
+
+    // without a dictionary of our own the parameter is ignored
+    v.attr["x_dictionary"] = "json";
+    v.esp = v.exts.negotiate(v.attr);
+    BOOST_CHECK_EQUAL( v.esp.first, websocketpp::lib::error_code() );
+    BOOST_CHECK_EQUAL( v.esp.second, "permessage-deflate" );
+    BOOST_CHECK( !v.exts.is_dictionary_active() );
+
+    v.exts.set_dictionary("json",dictionary);
+    v.esp = v.exts.negotiate(v.attr);
+    BOOST_CHECK_EQUAL( v.esp.second, "permessage-deflate; x_dictionary=json" );
+    BOOST_CHECK( v.exts.is_dictionary_active() );
+
+    // a later offer without the parameter does not keep it active
+    v.attr.clear();
+    v.esp = v.exts.negotiate(v.attr);
+    BOOST_CHECK( !v.exts.is_dictionary_active() );
+}
+
+BOOST_AUTO_TEST_CASE( compress_with_dictionary ) {
+    ext_vars v;
+    websocketpp::lib::shared_ptr<std::string const> dictionary =
+        websocketpp::lib::make_shared<std::string const>(
+            "{\"temperature\":,\"humidity\":,\"pressure\":}");
+
+    v.exts.set_dictionary("sensor",dictionary);
+    v.extc.set_dictionary("sensor",dictionary);
+
+    // server keeps its context, to check the dictionary is not reapplied
+    v.attr["x_dictionary"] = "sensor";
+    v.esp = v.exts.negotiate(v.attr);
+    v.esp = v.extc.negotiate(v.attr);
+    BOOST_REQUIRE( v.exts.init(true) == websocketpp::lib::error_code() );
+    BOOST_REQUIRE( v.extc.init(false) == websocketpp::lib::error_code() );
+
+    ext_vars plain;
+    BOOST_REQUIRE( plain.exts.init(true) == websocketpp::lib::error_code() );
+
+    std::string in = "{\"temperature\":21,\"humidity\":40,\"pressure\":1013}";
+
+    for (int i = 0; i < 3; ++i) {
+        std::string out;
+        std::string plain_out;
+        std::string decompress_out;
+
+        v.ec = v.exts.compress(in,out);
+        BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+        plain.ec = plain.exts.compress(in,plain_out);
+        if (i == 0) {
+            BOOST_CHECK( out.size() < plain_out.size() );
+        }
+
+        v.ec = v.extc.begin_message();
+        BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+        v.ec = v.extc.decompress(reinterpret_cast<const uint8_t *>(out.data()),
+            out.size(),decompress_out);
+        BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+        BOOST_CHECK_EQUAL( decompress_out, in );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( compress_parts ) {
+    ext_vars v;
+
+    // parts need a context reset after every message
+    BOOST_REQUIRE( v.exts.init(true) == websocketpp::lib::error_code() );
+    BOOST_CHECK( !v.exts.can_compress_parts() );
+
+    ext_vars r;
+    r.attr["server_no_context_takeover"].clear();
+    r.esp = r.exts.negotiate(r.attr);
+    BOOST_REQUIRE( r.exts.init(true) == websocketpp::lib::error_code() );
+    BOOST_REQUIRE( r.extc.init(false) == websocketpp::lib::error_code() );
+    BOOST_REQUIRE( r.exts.can_compress_parts() );
+
+    std::string in;
+    for (int i = 0; i < 1000; ++i) {
+        in += "part of a larger message ";
+    }
+
+    // parts joined in order inflate as one message
+    std::string out;
+    size_t const parts = 3;
+    for (size_t i = 0; i < parts; ++i) {
+        size_t begin = in.size() * i / parts;
+        size_t end = in.size() * (i + 1) / parts;
+        r.ec = r.exts.compress_part(in.substr(begin,end-begin),out);
+        BOOST_CHECK_EQUAL( r.ec, websocketpp::lib::error_code() );
+    }
+    BOOST_CHECK( out.size() < in.size() / 4 );
+
+    std::string decompress_out;
+    r.ec = r.extc.decompress(reinterpret_cast<const uint8_t *>(out.data()),
+        out.size(),decompress_out);
+    BOOST_CHECK_EQUAL( r.ec, websocketpp::lib::error_code() );
+    BOOST_CHECK( decompress_out == in );
+}
+
+BOOST_AUTO_TEST_CASE( invalid_compression_params ) {
+    namespace strategy = websocketpp::extensions::permessage_deflate::strategy;
+    ext_vars v;
+
+    v.ec = v.exts.set_compression_params(10,strategy::default_strategy);
+    BOOST_CHECK_EQUAL( v.ec, pmde::make_error_code(pmde::invalid_compression_params) );
+    v.ec = v.exts.set_compression_params(-2,strategy::default_strategy);
+    BOOST_CHECK_EQUAL( v.ec, pmde::make_error_code(pmde::invalid_compression_params) );
+    v.ec = v.exts.set_compression_params(1,strategy::value(17));
+    BOOST_CHECK_EQUAL( v.ec, pmde::make_error_code(pmde::invalid_compression_params) );
+    BOOST_CHECK_EQUAL( v.exts.get_compression_level(), -1 );
+
+    v.ec = v.exts.set_compression_params(3,strategy::rle);
+    BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+    BOOST_CHECK_EQUAL( v.exts.get_compression_level(), 3 );
+    BOOST_CHECK_EQUAL( v.exts.get_compression_strategy(), strategy::rle );
+}
+
+// compress at different compression levels, changed mid stream
+BOOST_AUTO_TEST_CASE( compression_params_mid_stream ) {
+    namespace strategy = websocketpp::extensions::permessage_deflate::strategy;
+    ext_vars v;
+
+    BOOST_REQUIRE( v.exts.init(true) == websocketpp::lib::error_code() );
+    BOOST_REQUIRE( v.extc.init(false) == websocketpp::lib::error_code() );
+
+    std::string in;
+    for (int i = 0; i < 200; ++i) {
+        in += "abcdefgh";
+    }
+
+    int const levels[] = {-1, 0, 9, 1};
+    strategy::value const strategies[] = {strategy::default_strategy,
+        strategy::default_strategy, strategy::filtered, strategy::huffman_only};
+
+    for (int i = 0; i < 4; ++i) {
+        std::string out;
+        std::string decompress_out;
+
+        v.ec = v.exts.set_compression_params(levels[i],strategies[i]);
+        BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+        v.ec = v.exts.compress(in,out);
+        BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+
+        if (levels[i] == 0) {
+            // stored blocks only
+            BOOST_CHECK( out.size() > in.size() );
+        } else if (strategies[i] != strategy::huffman_only) {
+            BOOST_CHECK( out.size() < in.size() / 4 );
+        }
+
+        // the peer is never told, context takeover still works
+        v.ec = v.extc.decompress(reinterpret_cast<const uint8_t *>(out.data()),
+            out.size(),decompress_out);
+        BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+        BOOST_CHECK_EQUAL( decompress_out, in );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( compression_stats ) {
+    websocketpp::lib::shared_ptr<
+        websocketpp::extensions::permessage_deflate::compression_stats> stats =
+        websocketpp::lib::make_shared<
+            websocketpp::extensions::permessage_deflate::compression_stats>();
+    ext_vars v;
+
+    BOOST_REQUIRE( v.exts.init(true) == websocketpp::lib::error_code() );
+    BOOST_REQUIRE( v.extc.init(false) == websocketpp::lib::error_code() );
+    v.exts.set_stats(stats);
+    v.extc.set_stats(stats);
+
+    BOOST_CHECK_EQUAL( stats->get_compress_ratio(), 0 );
+
+    std::string in(1000,'*');
+    std::string out;
+    std::string decompress_out;
+
+    v.ec = v.exts.compress(in,out);
+    BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+    v.ec = v.extc.decompress(reinterpret_cast<const uint8_t *>(out.data()),
+        out.size(),decompress_out);
+    BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+
+    BOOST_CHECK_EQUAL( stats->get_compress_count(), 1u );
+    BOOST_CHECK_EQUAL( stats->get_compress_in(), 1000u );
+    BOOST_CHECK_EQUAL( stats->get_compress_out(), out.size() );
+    BOOST_CHECK_EQUAL( stats->get_decompress_count(), 1u );
+    BOOST_CHECK_EQUAL( stats->get_decompress_in(), out.size() );
+    BOOST_CHECK_EQUAL( stats->get_decompress_out(), 1000u );
+    BOOST_CHECK_CLOSE( stats->get_compress_ratio(), out.size() / 1000.0, 0.001 );
+    BOOST_CHECK_CLOSE( stats->get_decompress_ratio(), out.size() / 1000.0, 0.001 );
+
+    stats->reset();
+    BOOST_CHECK_EQUAL( stats->get_compress_count(), 0u );
+    BOOST_CHECK_EQUAL( stats->get_decompress_out(), 0u );
+}
+
 
 // Decompression
 BOOST_AUTO_TEST_CASE( decompress_data ) {
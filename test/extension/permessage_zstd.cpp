@@ -0,0 +1,370 @@
+/*
+ * Copyright (c) 2013, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE permessage_zstd
+#include <boost/test/unit_test.hpp>
+
+#include <websocketpp/error.hpp>
+
+#include <websocketpp/extensions/extension.hpp>
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+#include <websocketpp/extensions/permessage_zstd/disabled.hpp>
+#include <websocketpp/extensions/permessage_zstd/enabled.hpp>
+
+#include <websocketpp/http/request.hpp>
+#include <websocketpp/http/response.hpp>
+#include <websocketpp/message_buffer/message.hpp>
+#include <websocketpp/message_buffer/alloc.hpp>
+#include <websocketpp/processors/hybi13.hpp>
+#include <websocketpp/random/none.hpp>
+
+#include <string>
+
+class config {};
+
+typedef websocketpp::extensions::permessage_zstd::enabled<config> enabled_type;
+typedef websocketpp::extensions::permessage_zstd::disabled<config> disabled_type;
+
+namespace pmze = websocketpp::extensions::permessage_zstd::error;
+
+struct ext_vars {
+    enabled_type exts;
+    enabled_type extc;
+    websocketpp::lib::error_code ec;
+    websocketpp::err_str_pair esp;
+    websocketpp::http::attribute_list attr;
+};
+
+static std::string const quote = "{\"timestamp\":1,\"symbol\":\"A\","
+    "\"price\":2,\"volume\":3}";
+
+static enabled_type::dictionary_ptr quote_dictionary(uint32_t id) {
+    websocketpp::lib::error_code ec;
+    enabled_type::dictionary_ptr dict = enabled_type::make_dictionary(
+        "{\"timestamp\":,\"symbol\":\"\",\"price\":,\"volume\":}", id, ec);
+    BOOST_REQUIRE( !ec );
+    return dict;
+}
+
+static websocketpp::lib::shared_ptr<enabled_type::dictionary_list const>
+    dictionaries(enabled_type::dictionary_ptr dict)
+{
+    return websocketpp::lib::make_shared<enabled_type::dictionary_list const>(
+        1, dict);
+}
+
+// Compress with one endpoint and decompress with the other, a few bytes at a
+// time
+static std::string round_trip(enabled_type & from, enabled_type & to,
+    std::string const & payload, std::string & compressed)
+{
+    compressed.clear();
+    BOOST_REQUIRE( !from.compress(payload, compressed) );
+
+    std::string out;
+    BOOST_REQUIRE( !to.begin_message() );
+    uint8_t const * buf = reinterpret_cast<uint8_t const *>(compressed.data());
+    for (size_t i = 0; i < compressed.size(); i += 7) {
+        size_t len = (std::min)(size_t(7), compressed.size() - i);
+        BOOST_REQUIRE( !to.decompress(buf + i, len, out) );
+    }
+    BOOST_REQUIRE( !to.end_message() );
+    return out;
+}
+
+BOOST_AUTO_TEST_CASE( disabled_is_disabled ) {
+    disabled_type exts;
+    BOOST_CHECK( !exts.is_implemented() );
+    BOOST_CHECK( !exts.is_enabled() );
+    BOOST_CHECK_EQUAL( exts.generate_offer(), "" );
+}
+
+BOOST_AUTO_TEST_CASE( enabled_starts_disabled ) {
+    ext_vars v;
+    BOOST_CHECK( v.exts.is_implemented() );
+    BOOST_CHECK( !v.exts.is_enabled() );
+}
+
+BOOST_AUTO_TEST_CASE( negotiation_empty_attr ) {
+    ext_vars v;
+
+    v.esp = v.exts.negotiate(v.attr);
+    BOOST_CHECK( v.exts.is_enabled() );
+    BOOST_CHECK_EQUAL( v.esp.first, websocketpp::lib::error_code() );
+    BOOST_CHECK_EQUAL( v.esp.second, "permessage-zstd" );
+}
+
+BOOST_AUTO_TEST_CASE( negotiation_invalid_attr ) {
+    ext_vars v;
+    v.attr["foo"] = "bar";
+
+    v.esp = v.exts.negotiate(v.attr);
+    BOOST_CHECK( !v.exts.is_enabled() );
+    BOOST_CHECK_EQUAL( v.esp.first,
+        pmze::make_error_code(pmze::invalid_attributes) );
+}
+
+BOOST_AUTO_TEST_CASE( negotiate_dictionary ) {
+    ext_vars v;
+    v.exts.set_dictionaries(dictionaries(quote_dictionary(42)));
+
+    v.attr["dictionary_id"] = "x";
+    v.esp = v.exts.negotiate(v.attr);
+    BOOST_CHECK_EQUAL( v.esp.first,
+        pmze::make_error_code(pmze::invalid_attribute_value) );
+
+    // an offer for a dictionary we do not hold is declined, so that a later
+    // offer may be accepted instead
+    v.attr["dictionary_id"] = "7";
+    v.esp = v.exts.negotiate(v.attr);
+    BOOST_CHECK_EQUAL( v.esp.first,
+        pmze::make_error_code(pmze::unknown_dictionary) );
+    BOOST_CHECK( !v.exts.is_enabled() );
+
+    v.attr["dictionary_id"] = "42";
+    v.esp = v.exts.negotiate(v.attr);
+    BOOST_CHECK( v.exts.is_enabled() );
+    BOOST_CHECK_EQUAL( v.esp.second, "permessage-zstd; dictionary_id=42" );
+    BOOST_CHECK( v.exts.get_dictionary() );
+}
+
+BOOST_AUTO_TEST_CASE( offer_lists_dictionaries_then_none ) {
+    ext_vars v;
+    BOOST_CHECK_EQUAL( v.extc.generate_offer(), "permessage-zstd" );
+
+    v.extc.set_dictionaries(dictionaries(quote_dictionary(42)));
+    BOOST_CHECK_EQUAL( v.extc.generate_offer(),
+        "permessage-zstd; dictionary_id=42, permessage-zstd" );
+}
+
+BOOST_AUTO_TEST_CASE( dictionary_needs_an_id ) {
+    websocketpp::lib::error_code ec;
+
+    enabled_type::make_dictionary("raw content", 0, ec);
+    BOOST_CHECK_EQUAL( ec, pmze::make_error_code(pmze::invalid_dictionary) );
+
+    enabled_type::make_dictionary("", 5, ec);
+    BOOST_CHECK_EQUAL( ec, pmze::make_error_code(pmze::invalid_dictionary) );
+
+    enabled_type::dictionary_ptr dict =
+        enabled_type::make_dictionary("raw content", 5, ec);
+    BOOST_CHECK( !ec );
+    BOOST_REQUIRE( dict );
+    BOOST_CHECK_EQUAL( dict->get_id(), 5u );
+}
+
+BOOST_AUTO_TEST_CASE( compression_level ) {
+    ext_vars v;
+    BOOST_CHECK_EQUAL( v.exts.set_compression_level(ZSTD_maxCLevel() + 1),
+        pmze::make_error_code(pmze::invalid_level) );
+    BOOST_CHECK( !v.exts.set_compression_level(1) );
+    BOOST_CHECK_EQUAL( v.exts.get_compression_level(), 1 );
+}
+
+BOOST_AUTO_TEST_CASE( compress_uninitialized ) {
+    ext_vars v;
+    std::string out;
+    BOOST_CHECK_EQUAL( v.exts.compress(quote, out),
+        pmze::make_error_code(pmze::uninitialized) );
+}
+
+BOOST_AUTO_TEST_CASE( compress_decompress ) {
+    ext_vars v;
+    v.exts.negotiate(v.attr);
+    v.extc.negotiate(v.attr);
+    BOOST_REQUIRE( !v.exts.init(true) );
+    BOOST_REQUIRE( !v.extc.init(false) );
+
+    std::string large;
+    for (int i = 0; i < 1000; ++i) {
+        large += quote;
+    }
+
+    std::string compressed;
+
+    // contexts are reused from message to message
+    for (int i = 0; i < 2; ++i) {
+        BOOST_CHECK_EQUAL( round_trip(v.exts, v.extc, quote, compressed),
+            quote );
+        BOOST_CHECK_EQUAL( round_trip(v.exts, v.extc, large, compressed),
+            large );
+        BOOST_CHECK( compressed.size() < large.size() / 10 );
+        BOOST_CHECK_EQUAL( round_trip(v.exts, v.extc, "", compressed), "" );
+    }
+    BOOST_CHECK( v.exts.get_memory_usage() > 0 );
+
+    v.exts.release_contexts(true, true);
+    BOOST_CHECK_EQUAL( round_trip(v.exts, v.extc, quote, compressed), quote );
+}
+
+BOOST_AUTO_TEST_CASE( compress_decompress_dictionary ) {
+    ext_vars v;
+    ext_vars plain;
+    v.exts.set_dictionaries(dictionaries(quote_dictionary(42)));
+    v.extc.set_dictionaries(dictionaries(quote_dictionary(42)));
+
+    v.attr["dictionary_id"] = "42";
+    BOOST_REQUIRE( !v.exts.negotiate(v.attr).first );
+    BOOST_REQUIRE( !v.extc.negotiate(v.attr).first );
+    BOOST_REQUIRE( !v.exts.init(true) );
+    BOOST_REQUIRE( !v.extc.init(false) );
+    plain.exts.negotiate(plain.attr);
+    plain.extc.negotiate(plain.attr);
+    BOOST_REQUIRE( !plain.exts.init(true) );
+    BOOST_REQUIRE( !plain.extc.init(false) );
+
+    std::string with;
+    std::string without;
+    BOOST_CHECK_EQUAL( round_trip(v.extc, v.exts, quote, with), quote );
+    BOOST_CHECK_EQUAL( round_trip(plain.extc, plain.exts, quote, without),
+        quote );
+    BOOST_CHECK( with.size() < without.size() );
+}
+
+BOOST_AUTO_TEST_CASE( decompress_incomplete_message ) {
+    ext_vars v;
+    v.exts.negotiate(v.attr);
+    v.extc.negotiate(v.attr);
+    BOOST_REQUIRE( !v.exts.init(true) );
+    BOOST_REQUIRE( !v.extc.init(false) );
+
+    std::string compressed;
+    BOOST_REQUIRE( !v.extc.compress(quote, compressed) );
+
+    std::string out;
+    BOOST_REQUIRE( !v.exts.begin_message() );
+    BOOST_CHECK( !v.exts.decompress(
+        reinterpret_cast<uint8_t const *>(compressed.data()),
+        compressed.size() / 2, out) );
+    BOOST_CHECK_EQUAL( v.exts.end_message(),
+        pmze::make_error_code(pmze::incomplete_message) );
+
+    // bytes after the frame are an error
+    compressed += "x";
+    out.clear();
+    BOOST_REQUIRE( !v.exts.begin_message() );
+    BOOST_CHECK_EQUAL( v.exts.decompress(
+        reinterpret_cast<uint8_t const *>(compressed.data()),
+        compressed.size(), out), pmze::make_error_code(pmze::zstd_error) );
+}
+
+// Negotiation and framing through the processor
+
+struct stub_config {
+    typedef websocketpp::http::parser::request request_type;
+    typedef websocketpp::http::parser::response response_type;
+
+    typedef websocketpp::message_buffer::message
+        <websocketpp::message_buffer::alloc::con_msg_manager> message_type;
+    typedef websocketpp::message_buffer::alloc::con_msg_manager<message_type>
+        con_msg_manager_type;
+
+    typedef websocketpp::random::none::int_generator<uint32_t> rng_type;
+
+    struct permessage_deflate_config {
+        typedef stub_config::request_type request_type;
+    };
+
+    typedef websocketpp::extensions::permessage_deflate::enabled
+        <permessage_deflate_config> permessage_deflate_type;
+    typedef websocketpp::extensions::permessage_zstd::enabled
+        <permessage_deflate_config> permessage_zstd_type;
+
+    static const size_t max_message_size = 16000000;
+    static const size_t message_reserve_step = 65536;
+    static const bool enable_extensions = true;
+};
+
+typedef stub_config::con_msg_manager_type con_msg_manager_type;
+typedef stub_config::message_type::ptr message_ptr;
+
+struct processor_setup {
+    processor_setup(bool server)
+      : msg_manager(new con_msg_manager_type())
+      , p(false,server,msg_manager,rng) {}
+
+    websocketpp::lib::error_code ec;
+    con_msg_manager_type::ptr msg_manager;
+    stub_config::rng_type rng;
+    stub_config::request_type req;
+    stub_config::response_type res;
+    websocketpp::processor::hybi13<stub_config> p;
+};
+
+BOOST_AUTO_TEST_CASE( processor_prefers_first_offer ) {
+    processor_setup server(true);
+
+    server.req.replace_header("Sec-WebSocket-Extensions",
+        "permessage-deflate, permessage-zstd");
+    std::pair<websocketpp::lib::error_code,std::string> neg =
+        server.p.negotiate_extensions(server.req);
+    BOOST_CHECK( !neg.first );
+    BOOST_CHECK_EQUAL( neg.second, "permessage-deflate" );
+}
+
+BOOST_AUTO_TEST_CASE( processor_round_trip ) {
+    processor_setup server(true);
+    processor_setup client(false);
+    server.p.set_zstd_params(5, dictionaries(quote_dictionary(42)));
+    client.p.set_zstd_params(0, dictionaries(quote_dictionary(42)));
+
+    websocketpp::uri_ptr u = websocketpp::lib::make_shared<websocketpp::uri>(
+        "ws://localhost/");
+    BOOST_REQUIRE( !client.p.client_handshake_request(client.req, u,
+        std::vector<std::string>()) );
+    std::string offer = client.req.get_header("Sec-WebSocket-Extensions");
+    BOOST_CHECK_EQUAL( offer.find("permessage-zstd; dictionary_id=42"), 0u );
+
+    server.req.replace_header("Sec-WebSocket-Extensions", offer);
+    std::pair<websocketpp::lib::error_code,std::string> neg =
+        server.p.negotiate_extensions(server.req);
+    BOOST_REQUIRE( !neg.first );
+    BOOST_CHECK_EQUAL( neg.second, "permessage-zstd; dictionary_id=42" );
+
+    client.res.replace_header("Sec-WebSocket-Extensions", neg.second);
+    BOOST_REQUIRE( !client.p.negotiate_extensions(client.res).first );
+
+    for (int i = 0; i < 2; ++i) {
+        message_ptr in = client.msg_manager->get_message();
+        message_ptr out = client.msg_manager->get_message();
+        in->set_opcode(websocketpp::frame::opcode::text);
+        in->set_payload(quote);
+        in->set_compressed(true);
+        BOOST_REQUIRE( !client.p.prepare_data_frame(in,out) );
+        BOOST_CHECK( out->get_payload().size() < quote.size() );
+
+        std::string frame = out->get_header() + out->get_payload();
+        BOOST_CHECK( uint8_t(frame[0]) & websocketpp::frame::BHB0_RSV1 );
+
+        size_t ret = server.p.consume(
+            reinterpret_cast<uint8_t *>(&frame[0]),frame.size(),server.ec);
+        BOOST_CHECK_EQUAL( server.ec, websocketpp::lib::error_code() );
+        BOOST_CHECK_EQUAL( ret, frame.size() );
+        BOOST_REQUIRE( server.p.ready() );
+        BOOST_CHECK_EQUAL( server.p.get_message()->get_payload(), quote );
+    }
+}
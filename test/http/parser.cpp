@@ -33,6 +33,7 @@
 
 #include <websocketpp/http/request.hpp>
 #include <websocketpp/http/response.hpp>
+#include <websocketpp/http/view_request.hpp>
 
 BOOST_AUTO_TEST_CASE( is_token_char ) {
     // Valid characters
@@ -123,6 +124,28 @@ BOOST_AUTO_TEST_CASE( extract_token ) {
     BOOST_CHECK( ret.second == d2.begin()+4 );
 }
 
+BOOST_AUTO_TEST_CASE( find_crlf ) {
+    using websocketpp::http::parser::find_crlf;
+
+    std::string d1 = "foo\r\nbar";
+    std::string d2 = "a\rb\r\r\nc";
+    std::string d3 = "foo\r";
+    std::string d4 = "";
+
+    BOOST_CHECK( find_crlf(d1.begin(),d1.end()) == d1.begin()+3 );
+    BOOST_CHECK( find_crlf(d2.begin(),d2.end()) == d2.begin()+4 );
+    BOOST_CHECK( find_crlf(d3.begin(),d3.end()) == d3.end() );
+    BOOST_CHECK( find_crlf(d4.begin(),d4.end()) == d4.end() );
+
+    // a CR at the end of the range is not matched with bytes past it
+    BOOST_CHECK( find_crlf(d1.begin(),d1.begin()+4) == d1.begin()+4 );
+
+    BOOST_CHECK( websocketpp::http::parser::find_char(d1.begin(),d1.end(),'b')
+        == d1.begin()+5 );
+    BOOST_CHECK( websocketpp::http::parser::find_char(d1.begin(),d1.end(),':')
+        == d1.end() );
+}
+
 BOOST_AUTO_TEST_CASE( extract_quoted_string ) {
     std::string d1 = "\"foo\"";
     std::string d2 = "\"foo\\\"bar\\\"baz\"";
@@ -378,6 +401,49 @@ BOOST_AUTO_TEST_CASE( strip_lws ) {
     BOOST_CHECK_EQUAL( websocketpp::http::parser::strip_lws(test9), "" );
 }
 
+BOOST_AUTO_TEST_CASE( header_list_order_and_lookup ) {
+    using websocketpp::http::parser::header_list;
+    using websocketpp::http::parser::header_id::identify;
+    namespace header_id = websocketpp::http::parser::header_id;
+
+    BOOST_CHECK_EQUAL( identify("sec-websocket-key"), header_id::sec_websocket_key );
+    BOOST_CHECK_EQUAL( identify("TRANSFER-ENCODING"), header_id::transfer_encoding );
+    BOOST_CHECK_EQUAL( identify("X-Custom"), header_id::unknown );
+
+    header_list h;
+    h["Upgrade"] = "websocket";
+    h["x-b"] = "2";
+    h["Host"] = "example.com";
+    h["X-A"] = "1";
+    h["sec-websocket-key"] = "key";
+
+    // iteration is sorted case insensitively, as with the previous map
+    std::string order;
+    for (header_list::const_iterator it = h.begin(); it != h.end(); ++it) {
+        order += it->first + ";";
+    }
+    BOOST_CHECK_EQUAL( order, "Host;sec-websocket-key;Upgrade;X-A;x-b;" );
+
+    BOOST_CHECK( h.find(header_id::host)->second == "example.com" );
+    BOOST_CHECK( h.find("SEC-WEBSOCKET-KEY")->second == "key" );
+    BOOST_CHECK( h.find("x-a")->second == "1" );
+    BOOST_CHECK( h.find("X-C") == h.end() );
+    BOOST_CHECK( h.find(header_id::origin) == h.end() );
+
+    // well known positions follow inserts and erases around them
+    BOOST_CHECK( !h.insert(header_list::value_type("HOST","other")).second );
+    h["Connection"] = "Upgrade";
+    BOOST_CHECK_EQUAL( h.erase("host"), 1 );
+    BOOST_CHECK_EQUAL( h.erase("host"), 0 );
+    BOOST_CHECK_EQUAL( h.erase("X-A"), 1 );
+    BOOST_CHECK_EQUAL( h.size(), 4 );
+    BOOST_CHECK( h.find(header_id::host) == h.end() );
+    BOOST_CHECK( h.find("connection")->second == "Upgrade" );
+    BOOST_CHECK( h.find("Sec-WebSocket-Key")->second == "key" );
+    BOOST_CHECK( h.find("upgrade")->second == "websocket" );
+    BOOST_CHECK( h.find("X-B")->second == "2" );
+}
+
 BOOST_AUTO_TEST_CASE( case_insensitive_headers ) {
     websocketpp::http::parser::parser r;
 
@@ -961,6 +1027,197 @@ BOOST_AUTO_TEST_CASE( plain_http_response ) {
     BOOST_CHECK_EQUAL( r.get_body(), "<!doctype html>\n<html>\n<head>\n<title>Thor</title>\n</head>\n<body> \n<p>Thor</p>\n</body>" );
 }
 
+BOOST_AUTO_TEST_CASE( response_body_handler ) {
+    websocketpp::http::parser::response r;
+    std::string received;
+    size_t calls = 0;
+
+    r.set_body_handler([&](std::string_view data) {
+        received.append(data);
+        ++calls;
+    });
+
+    std::string raw = "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\n0123456789";
+    websocketpp::lib::error_code ec;
+
+    // the headers and the first body bytes, then the rest in two parts
+    size_t pos = r.consume(raw.data(), raw.size() - 6, ec);
+    BOOST_CHECK_EQUAL(ec, websocketpp::lib::error_code());
+    pos += r.consume(raw.data() + pos, 3, ec);
+    BOOST_CHECK_EQUAL(ec, websocketpp::lib::error_code());
+    pos += r.consume(raw.data() + pos, raw.size() - pos, ec);
+    BOOST_CHECK_EQUAL(ec, websocketpp::lib::error_code());
+
+    BOOST_CHECK_EQUAL( pos, raw.size() );
+    BOOST_CHECK( r.ready() );
+    BOOST_CHECK_EQUAL( received, "0123456789" );
+    BOOST_CHECK_EQUAL( calls, 3 );
+    BOOST_CHECK( r.get_body().empty() );
+}
+
+BOOST_AUTO_TEST_CASE( response_buffer_sink ) {
+    std::string raw = "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\n0123456789";
+    websocketpp::lib::error_code ec;
+
+    // the sink replaces the max body size limit
+    char region[16];
+    websocketpp::http::parser::response r;
+    r.set_max_body_size(4);
+    r.set_body_sink(websocketpp::lib::make_shared<websocketpp::http::buffer_sink>(
+        region, sizeof(region)));
+    r.consume(raw.data(), raw.size(), ec);
+    BOOST_CHECK_EQUAL(ec, websocketpp::lib::error_code());
+    BOOST_CHECK( r.ready() );
+    BOOST_CHECK_EQUAL( std::string(region, 10), "0123456789" );
+    BOOST_CHECK( r.get_body().empty() );
+
+    // and bounds the body instead
+    websocketpp::http::parser::response small;
+    small.set_body_sink(websocketpp::lib::make_shared<websocketpp::http::buffer_sink>(
+        region, 8));
+    small.consume(raw.data(), raw.size(), ec);
+    BOOST_CHECK_EQUAL(ec, websocketpp::http::error::make_error_code(
+        websocketpp::http::error::body_too_large));
+}
+
+#if !defined(_WIN32)
+BOOST_AUTO_TEST_CASE( response_mmap_sink ) {
+    std::string body(100000, 'x');
+    std::string raw = "HTTP/1.1 200 OK\r\nContent-Length: 100000\r\n\r\n" + body;
+    websocketpp::lib::error_code ec;
+
+    FILE * f = tmpfile();
+    BOOST_REQUIRE( f );
+    int fd = fileno(f);
+
+    // mapped larger than needed, truncated to the body on completion
+    websocketpp::http::parser::response r;
+    r.set_body_sink(websocketpp::lib::make_shared<websocketpp::http::mmap_sink>(
+        fd, 200000));
+    size_t pos = 0;
+    while (pos < raw.size() && !ec) {
+        pos += r.consume(raw.data() + pos, std::min<size_t>(4096, raw.size() - pos), ec);
+    }
+    BOOST_CHECK_EQUAL(ec, websocketpp::lib::error_code());
+    BOOST_CHECK( r.ready() );
+
+    std::string stored(300000, '\0');
+    BOOST_CHECK_EQUAL( pread(fd, &stored[0], stored.size(), 0), 100000 );
+    stored.resize(100000);
+    BOOST_CHECK( stored == body );
+
+    fclose(f);
+}
+#endif
+
+#if WEBSOCKETPP_WITH_GZIP
+BOOST_AUTO_TEST_CASE( response_gzip_streaming ) {
+    std::string body;
+    for (int i = 0; i < 20000; i++) {
+        body += "line " + std::to_string(i) + "\n";
+    }
+
+    websocketpp::lib::error_code ec;
+    std::string encoded = websocketpp::encoding::gzip::compress(body, ec);
+    std::string raw = "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\nContent-Length: "
+        + std::to_string(encoded.size()) + "\r\n\r\n" + encoded;
+
+    // decoded as it arrives, a few bytes at a time
+    websocketpp::http::parser::response r;
+    size_t pos = 0;
+    while (pos < raw.size() && !ec) {
+        pos += r.consume(raw.data() + pos, std::min<size_t>(100, raw.size() - pos), ec);
+    }
+    BOOST_CHECK_EQUAL(ec, websocketpp::lib::error_code());
+    BOOST_CHECK( r.ready() );
+    BOOST_CHECK( r.get_body() == body );
+
+    // a truncated stream is an error once the announced length has arrived
+    raw = "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\nContent-Length: 20\r\n\r\n"
+        + encoded.substr(0, 20);
+    websocketpp::http::parser::response t;
+    t.consume(raw.data(), raw.size(), ec);
+    BOOST_CHECK_EQUAL(ec, websocketpp::http::error::make_error_code(
+        websocketpp::http::error::invalid_content_encoding));
+}
+
+BOOST_AUTO_TEST_CASE( encoding_context_reuse ) {
+    namespace enc = websocketpp::encoding;
+    namespace ce = websocketpp::http::content_encoding;
+    websocketpp::lib::error_code ec;
+
+    std::vector<ce::value> encodings = { ce::gzip };
+#if WEBSOCKETPP_WITH_DEFLATE
+    encodings.push_back(ce::deflate);
+#endif
+#if WEBSOCKETPP_WITH_BROTLI
+    encodings.push_back(ce::brotli);
+#endif
+
+    // repeated calls on one thread reuse the contexts, with alternating
+    // encodings and sizes that do and don't fit the initial output size
+    for (int round = 0; round < 3; round++) {
+        for (ce::value e : encodings) {
+            for (size_t size : {0, 1, 100, 70000}) {
+                std::string body;
+                for (size_t i = 0; i < size; i++) {
+                    body += char('a' + (i * 7 + i / 13) % 26);
+                }
+
+                std::string encoded = enc::compress(e, false, body, ec);
+                BOOST_CHECK(!ec);
+                BOOST_CHECK(enc::decompress(e, false, encoded, ec) == body);
+                // a wrong hint only costs reallocations
+                BOOST_CHECK(enc::decompress(e, false, encoded, ec, 3) == body);
+                BOOST_CHECK(!ec);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( encoder_streaming ) {
+    namespace enc = websocketpp::encoding;
+    namespace ce = websocketpp::http::content_encoding;
+    websocketpp::lib::error_code ec;
+
+    std::string body;
+    for (int i = 0; i < 20000; i++) {
+        body += "line " + std::to_string(i) + "\n";
+    }
+
+    std::vector<ce::value> encodings = { ce::gzip };
+#if WEBSOCKETPP_WITH_DEFLATE
+    encodings.push_back(ce::deflate);
+#endif
+
+    // one encoder reused for each encoding, fed a few bytes at a time
+    enc::encoder e;
+    for (ce::value encoding : encodings) {
+        BOOST_REQUIRE(!e.init(encoding));
+        std::string encoded;
+        for (size_t pos = 0; pos < body.size(); pos += 1000) {
+            BOOST_CHECK(!e.encode(body.data() + pos,
+                std::min<size_t>(1000, body.size() - pos), false, encoded));
+        }
+        BOOST_CHECK(!e.encode(NULL, 0, true, encoded));
+        BOOST_CHECK_LT(encoded.size(), body.size());
+        BOOST_CHECK(enc::decompress(encoding, false, encoded, ec) == body);
+        BOOST_CHECK(!ec);
+    }
+}
+#else
+BOOST_AUTO_TEST_CASE( response_unsupported_content_encoding ) {
+    websocketpp::http::parser::response r;
+
+    std::string raw = "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\nContent-Length: 3\r\n\r\nabc";
+    websocketpp::lib::error_code ec;
+
+    r.consume(raw.data(), raw.size(), ec);
+    BOOST_CHECK_EQUAL(ec, websocketpp::http::error::make_error_code(
+        websocketpp::http::error::unsupported_content_encoding));
+}
+#endif
+
 BOOST_AUTO_TEST_CASE( parse_istream ) {
     websocketpp::http::parser::response r;
 
@@ -1054,3 +1311,112 @@ BOOST_AUTO_TEST_CASE( write_request_with_body ) {
 
     BOOST_CHECK_EQUAL( r.raw(), raw );
 }
+
+BOOST_AUTO_TEST_CASE( view_request_split_handshake ) {
+    websocketpp::http::parser::view_request r;
+
+    std::string raw = "GET /chat HTTP/1.1\r\nHost: www.example.com\r\nUpgrade: websocket\r\nconnection:  Upgrade\t\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\nabcd";
+    websocketpp::lib::error_code ec;
+
+    // feed the request in small pieces, delimiters included
+    size_t pos = 0;
+    for (size_t i = 0; i < raw.size() && !r.ready(); i += 7) {
+        size_t n = std::min<size_t>(7, raw.size() - i);
+        pos += r.consume(raw.data() + i, n, ec);
+        BOOST_CHECK_EQUAL(ec, websocketpp::lib::error_code());
+    }
+
+    BOOST_CHECK( r.ready() );
+    BOOST_CHECK_EQUAL( pos, raw.size() - 4 );
+    BOOST_CHECK_EQUAL( r.get_method(), "GET" );
+    BOOST_CHECK_EQUAL( r.get_uri(), "/chat" );
+    BOOST_CHECK_EQUAL( r.get_version(), "HTTP/1.1" );
+    BOOST_CHECK( r.get_header_view("upgrade") == "websocket" );
+    BOOST_CHECK( r.get_header_view("Connection") == "Upgrade" );
+    BOOST_CHECK( r.get_header_view("Missing").empty() );
+    BOOST_CHECK_EQUAL( r.get_header("SEC-WEBSOCKET-KEY"), "dGhlIHNhbXBsZSBub25jZQ==" );
+    BOOST_CHECK_EQUAL( r.get_header("Missing"), "" );
+    BOOST_CHECK_EQUAL( r.get_headers().size(), 5 );
+    BOOST_CHECK_EQUAL( r.raw(), "GET /chat HTTP/1.1\r\nconnection: Upgrade\r\nHost: www.example.com\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\nUpgrade: websocket\r\n\r\n" );
+}
+
+BOOST_AUTO_TEST_CASE( view_request_repeated_headers ) {
+    websocketpp::http::parser::view_request r;
+
+    std::string raw = "GET / HTTP/1.1\r\nHost: example.com\r\nX-A: 1\r\nx-a: 2\r\nX-A: 3\r\n\r\n";
+    websocketpp::lib::error_code ec;
+
+    BOOST_CHECK_EQUAL( r.consume(raw.data(), raw.size(), ec), raw.size() );
+    BOOST_CHECK_EQUAL(ec, websocketpp::lib::error_code());
+    BOOST_CHECK( r.ready() );
+    BOOST_CHECK( r.get_header_view("X-A") == "1, 2, 3" );
+    BOOST_CHECK_EQUAL( r.get_headers().size(), 2 );
+
+    // modifying the headers moves them into the map
+    ec = r.replace_header("Host", "example.org");
+    BOOST_CHECK_EQUAL(ec, websocketpp::lib::error_code());
+    BOOST_CHECK_EQUAL( r.get_header("host"), "example.org" );
+    BOOST_CHECK_EQUAL( r.get_header("X-A"), "1, 2, 3" );
+}
+
+BOOST_AUTO_TEST_CASE( view_request_many_headers ) {
+    websocketpp::http::parser::view_request r;
+
+    std::stringstream s;
+    s << "GET / HTTP/1.1\r\nHost: example.com\r\n";
+    for (int i = 0; i < 40; ++i) {
+        s << "X-" << i << ": " << i << "\r\n";
+    }
+    s << "\r\n";
+    std::string raw = s.str();
+
+    websocketpp::lib::error_code ec;
+    BOOST_CHECK_EQUAL( r.consume(raw.data(), raw.size(), ec), raw.size() );
+    BOOST_CHECK_EQUAL(ec, websocketpp::lib::error_code());
+    BOOST_CHECK( r.get_header_view("x-0") == "0" );
+    BOOST_CHECK( r.get_header_view("X-39") == "39" );
+    BOOST_CHECK_EQUAL( r.get_header("X-35"), "35" );
+    BOOST_CHECK_EQUAL( r.get_headers().size(), 41 );
+}
+
+BOOST_AUTO_TEST_CASE( view_request_body ) {
+    websocketpp::http::parser::view_request r;
+
+    std::string raw = "POST / HTTP/1.1\r\nHost: example.com\r\nContent-Length: 5\r\n\r\nhelloextra";
+    websocketpp::lib::error_code ec;
+
+    BOOST_CHECK_EQUAL( r.consume(raw.data(), raw.size(), ec), raw.size() - 5 );
+    BOOST_CHECK_EQUAL(ec, websocketpp::lib::error_code());
+    BOOST_CHECK( r.ready() );
+    BOOST_CHECK_EQUAL( r.get_body(), "hello" );
+    BOOST_CHECK( r.get_header_view("Host") == "example.com" );
+}
+
+BOOST_AUTO_TEST_CASE( view_request_errors ) {
+    websocketpp::lib::error_code ec;
+
+    websocketpp::http::parser::view_request r1;
+    std::string raw1 = "GET / HTTP/1.1\r\nHost example.com\r\n\r\n";
+    r1.consume(raw1.data(), raw1.size(), ec);
+    BOOST_CHECK_EQUAL(ec, websocketpp::http::error::make_error_code(
+        websocketpp::http::error::missing_header_separator));
+
+    websocketpp::http::parser::view_request r2;
+    std::string raw2 = "GET / HTTP/1.1\r\nBad Name: x\r\n\r\n";
+    r2.consume(raw2.data(), raw2.size(), ec);
+    BOOST_CHECK_EQUAL(ec, websocketpp::http::error::make_error_code(
+        websocketpp::http::error::invalid_header_name));
+
+    websocketpp::http::parser::view_request r3;
+    std::string raw3 = "GET / HTTP/1.1\r\nUpgrade: websocket\r\n\r\n";
+    r3.consume(raw3.data(), raw3.size(), ec);
+    BOOST_CHECK_EQUAL(ec, websocketpp::http::error::make_error_code(
+        websocketpp::http::error::incomplete_request));
+
+    websocketpp::http::parser::view_request r4;
+    std::string raw4 = "GET / HTTP/1.1\r\nHost: ";
+    raw4.append(websocketpp::http::max_header_size, 'a');
+    r4.consume(raw4.data(), raw4.size(), ec);
+    BOOST_CHECK_EQUAL(ec, websocketpp::http::error::make_error_code(
+        websocketpp::http::error::request_header_fields_too_large));
+}
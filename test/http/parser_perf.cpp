@@ -25,117 +25,108 @@
  *
  */
 
-#include <websocketpp/http/parser.hpp>
+// Standalone throughput benchmark for the HTTP parsers. Not part of the test
+// suite, build it with optimizations, e.g.:
+//
+//     g++ -std=c++20 -O2 -I. test/http/parser_perf.cpp -o parser_perf
+//
+// Each case reports parsed messages per second and input bytes per second.
+
+#include <websocketpp/http/request.hpp>
+#include <websocketpp/http/response.hpp>
+#include <websocketpp/http/view_request.hpp>
 
 #include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
 
 class scoped_timer {
 public:
-    scoped_timer(std::string i) : m_id(i),m_start(std::chrono::steady_clock::now()) {
-        std::cout << "Clock " << i << ": ";
-    }
-    ~scoped_timer() {
-        std::chrono::nanoseconds time_taken = std::chrono::steady_clock::now()-m_start;
-
-        //nanoseconds_per_test
+    scoped_timer(std::string i, size_t iterations, size_t bytes)
+      : m_id(i)
+      , m_iterations(iterations)
+      , m_bytes(bytes)
+      , m_start(std::chrono::steady_clock::now()) {}
 
-        //tests_per_second
-
-        //1000000000.0/(double(time_taken.count())/1000.0)
-
-        std::cout << 1000000000.0/(double(time_taken.count())/1000.0) << std::endl;
+    ~scoped_timer() {
+        std::chrono::duration<double> taken =
+            std::chrono::steady_clock::now() - m_start;
 
-        //std::cout << (1.0/double(time_taken.count())) * double(1000000000*1000) << std::endl;
+        std::cout << m_id << ": "
+                  << double(m_iterations) / taken.count() << " msgs/s, "
+                  << double(m_iterations * m_bytes) / taken.count() / 1e6
+                  << " MB/s" << std::endl;
     }
 
 private:
     std::string m_id;
+    size_t m_iterations;
+    size_t m_bytes;
     std::chrono::steady_clock::time_point m_start;
 };
 
-int main() {
-    std::string raw = "GET / HTTP/1.1\r\nHost: www.example.com\r\n\r\n";
-
-    std::string firefox = "GET / HTTP/1.1\r\nHost: localhost:5000\r\nUser-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10.7; rv:10.0) Gecko/20100101 Firefox/10.0\r\nAccept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\nAccept-Language: en-us,en;q=0.5\r\nAccept-Encoding: gzip, deflate\r\nConnection: keep-alive, Upgrade\r\nSec-WebSocket-Version: 8\r\nSec-WebSocket-Origin: http://zaphoyd.com\r\nSec-WebSocket-Key: pFik//FxwFk0riN4ZiPFjQ==\r\nPragma: no-cache\r\nCache-Control: no-cache\r\nUpgrade: websocket\r\n\r\n";
-
-    std::string firefox1 = "GET / HTTP/1.1\r\nHost: localhost:5000\r\nUser-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10.7; rv:10.0) Gecko/20100101 Firefox/10.0\r\nAccept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\nAccept-Language: en-us,en;q=0.5\r\n";
-
-    std::string firefox2 = "Accept-Encoding: gzip, deflate\r\nConnection: keep-alive, Upgrade\r\nSec-WebSocket-Version: 8\r\nSec-WebSocket-Origin: http://zaphoyd.com\r\nSec-WebSocket-Key: pFik//FxwFk0riN4ZiPFjQ==\r\nPragma: no-cache\r\nCache-Control: no-cache\r\nUpgrade: websocket\r\n\r\n";
-
-    {
-        scoped_timer timer("Simplest 1 chop");
-        for (int i = 0; i < 1000; i++) {
-            websocketpp::http::parser::request r;
-
-            try {
-                r.consume(raw.c_str(),raw.size());
-            } catch (...) {
-                std::cout << "exception" << std::endl;
-            }
-
-            if (!r.ready()) {
-                std::cout << "error" << std::endl;
-                break;
+/// Parse `raw` into a fresh message `iterations` times, `chop` bytes at a time
+template <typename message_type>
+void run(std::string const & name, std::string const & raw, size_t chop,
+    size_t iterations)
+{
+    scoped_timer timer(name, iterations, raw.size());
+
+    for (size_t i = 0; i < iterations; i++) {
+        message_type m;
+        websocketpp::lib::error_code ec;
+
+        for (size_t pos = 0; pos < raw.size() && !m.ready();) {
+            size_t n = std::min(chop, raw.size() - pos);
+            size_t used = m.consume(raw.data() + pos, n, ec);
+            if (ec) {
+                std::cout << name << ": " << ec.message() << std::endl;
+                std::exit(1);
             }
+            pos += used ? used : n;
         }
-    }
 
-    {
-        scoped_timer timer("FireFox, 1 chop, consume old");
-        for (int i = 0; i < 1000; i++) {
-            websocketpp::http::parser::request r;
-
-            try {
-                r.consume2(firefox.c_str(),firefox.size());
-            } catch (...) {
-                std::cout << "exception" << std::endl;
-            }
-
-            if (!r.ready()) {
-                std::cout << "error" << std::endl;
-                break;
-            }
+        if (!m.ready()) {
+            std::cout << name << ": incomplete" << std::endl;
+            std::exit(1);
         }
     }
+}
 
-    {
-        scoped_timer timer("FireFox, 1 chop");
-        for (int i = 0; i < 1000; i++) {
-            websocketpp::http::parser::request r;
-
-            try {
-                r.consume(firefox.c_str(),firefox.size());
-            } catch (...) {
-                std::cout << "exception" << std::endl;
-            }
-
-            if (!r.ready()) {
-                std::cout << "error" << std::endl;
-                break;
-            }
-        }
-    }
+int main() {
+    using websocketpp::http::parser::request;
+    using websocketpp::http::parser::response;
+    using websocketpp::http::parser::view_request;
 
+    size_t const iterations = 200000;
+    size_t const all = std::string::npos;
 
+    std::string simple = "GET / HTTP/1.1\r\nHost: www.example.com\r\n\r\n";
 
-    {
-        scoped_timer timer("FireFox, 2 chop");
-        for (int i = 0; i < 1000; i++) {
-            websocketpp::http::parser::request r;
+    std::string firefox = "GET / HTTP/1.1\r\nHost: localhost:5000\r\nUser-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10.7; rv:10.0) Gecko/20100101 Firefox/10.0\r\nAccept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\nAccept-Language: en-us,en;q=0.5\r\nAccept-Encoding: gzip, deflate\r\nConnection: keep-alive, Upgrade\r\nSec-WebSocket-Version: 13\r\nOrigin: http://zaphoyd.com\r\nSec-WebSocket-Key: pFik//FxwFk0riN4ZiPFjQ==\r\nPragma: no-cache\r\nCache-Control: no-cache\r\nUpgrade: websocket\r\n\r\n";
 
-            try {
-                r.consume(firefox1.c_str(),firefox1.size());
-                r.consume(firefox2.c_str(),firefox2.size());
-            } catch (...) {
-                std::cout << "exception" << std::endl;
-            }
+    std::string handshake_response = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\nServer: WebSocket++/0.9.0\r\n\r\n";
 
-            if (!r.ready()) {
-                std::cout << "error" << std::endl;
-                break;
-            }
-        }
+    std::string chunked = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\nContent-Type: text/plain\r\n\r\n";
+    for (int i = 0; i < 16; i++) {
+        chunked += "40\r\n" + std::string(64, 'x') + "\r\n";
     }
+    chunked += "0\r\n\r\n";
+
+    run<request>("request, simple, 1 chop", simple, all, iterations);
+    run<request>("request, firefox, 1 chop", firefox, all, iterations);
+    run<request>("request, firefox, 64 byte chops", firefox, 64, iterations);
+    run<view_request>("view_request, simple, 1 chop", simple, all, iterations);
+    run<view_request>("view_request, firefox, 1 chop", firefox, all,
+        iterations);
+    run<view_request>("view_request, firefox, 64 byte chops", firefox, 64,
+        iterations);
+    run<response>("response, handshake, 1 chop", handshake_response, all,
+        iterations);
+    run<response>("response, chunked body, 1 chop", chunked, all,
+        iterations / 10);
 
     return 0;
 }
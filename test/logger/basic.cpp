@@ -28,9 +28,16 @@
 #define BOOST_TEST_MODULE basic_log
 #include <boost/test/unit_test.hpp>
 
+#include <cstdio>
+#include <cstring>
 #include <string>
+#include <sstream>
+#include <vector>
 
 #include <websocketpp/logger/basic.hpp>
+#include <websocketpp/logger/async.hpp>
+#include <websocketpp/logger/event_ring.hpp>
+#include <websocketpp/logger/lazy.hpp>
 #include <websocketpp/concurrency/none.hpp>
 #include <websocketpp/concurrency/basic.hpp>
 
@@ -143,3 +150,124 @@ BOOST_AUTO_TEST_CASE( move_assign ) {
 
     logger2 = std::move(logger1);
 }*/
+
+typedef websocketpp::log::async<websocketpp::concurrency::basic,websocketpp::log::alevel> async_access_log_type;
+
+BOOST_AUTO_TEST_CASE( async_write ) {
+    std::stringstream out;
+    async_access_log_type logger(0xffffffff,&out);
+
+    logger.write(websocketpp::log::alevel::devel,"hidden");
+    logger.set_channels(websocketpp::log::alevel::devel);
+    logger.write(websocketpp::log::alevel::devel,"devel");
+    logger.write(websocketpp::log::alevel::connect,std::string("connect"));
+    logger.flush();
+
+    BOOST_CHECK_EQUAL( out.str().find("hidden"), std::string::npos );
+    BOOST_CHECK_NE( out.str().find("[devel] devel\n"), std::string::npos );
+    BOOST_CHECK_EQUAL( out.str().find("connect"), std::string::npos );
+}
+
+void write_lines(async_access_log_type * logger, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        logger->write(websocketpp::log::alevel::devel,"line");
+    }
+}
+
+BOOST_AUTO_TEST_CASE( async_block ) {
+    std::stringstream out;
+    async_access_log_type logger(0xffffffff,&out);
+    logger.set_channels(websocketpp::log::alevel::devel);
+    logger.set_overflow(websocketpp::log::overflow::block);
+
+    // more lines than the rings hold, from several threads
+    std::vector<websocketpp::lib::shared_ptr<websocketpp::lib::thread> > threads;
+    for (size_t i = 0; i < 4; ++i) {
+        threads.push_back(websocketpp::lib::make_shared<websocketpp::lib::thread>(
+            &write_lines,&logger,size_t(5000)));
+    }
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i]->join();
+    }
+    logger.flush();
+
+    std::string line;
+    size_t lines = 0;
+    while (std::getline(out,line)) {
+        ++lines;
+    }
+    BOOST_CHECK_EQUAL( lines, 20000u );
+    BOOST_CHECK_EQUAL( logger.get_dropped(), 0u );
+}
+
+BOOST_AUTO_TEST_CASE( async_destructor_drains ) {
+    std::stringstream out;
+    {
+        async_access_log_type logger(0xffffffff,&out);
+        logger.set_channels(websocketpp::log::alevel::devel);
+        logger.write(websocketpp::log::alevel::devel,"last words");
+    }
+    BOOST_CHECK_NE( out.str().find("last words"), std::string::npos );
+}
+
+int count_call(int * calls) {
+    return ++*calls;
+}
+
+BOOST_AUTO_TEST_CASE( lazy_write ) {
+    std::stringstream out;
+    basic_access_log_type logger(websocketpp::log::alevel::devel,&out);
+    int calls = 0;
+
+    // statically disabled
+    WEBSOCKETPP_LOG(logger, websocketpp::log::alevel::connect,
+        "connect " << count_call(&calls));
+    // dynamically disabled
+    WEBSOCKETPP_LOG(logger, websocketpp::log::alevel::devel,
+        "devel " << count_call(&calls));
+    BOOST_CHECK_EQUAL( calls, 0 );
+    BOOST_CHECK( out.str().empty() );
+
+    logger.set_channels(websocketpp::log::alevel::all);
+    BOOST_CHECK( !websocketpp::log::enabled(logger, websocketpp::log::alevel::connect) );
+    BOOST_CHECK( websocketpp::log::enabled(logger, websocketpp::log::alevel::devel) );
+    WEBSOCKETPP_LOG(logger, websocketpp::log::alevel::devel,
+        "devel " << count_call(&calls));
+    BOOST_CHECK_EQUAL( calls, 1 );
+    BOOST_CHECK_NE( out.str().find("[devel] devel 1\n"), std::string::npos );
+}
+
+BOOST_AUTO_TEST_CASE( event_ring_write ) {
+#ifndef _WIN32
+    websocketpp::log::event_ring ring;
+    BOOST_CHECK( !ring.is_open() );
+
+    std::string path = "/tmp/websocketpp_test_event_ring";
+    BOOST_REQUIRE( !ring.open(path, 4) );
+
+    websocketpp::log::connection_event e;
+    std::memset(&e, 0, sizeof(e));
+    e.size = sizeof(e);
+    e.type = websocketpp::log::event_type::close;
+    websocketpp::log::connection_event::assign(e.user_agent,
+        std::string(200,'a'));
+
+    for (uint16_t i = 0; i < 6; ++i) {
+        e.status = i;
+        ring.write(e);
+    }
+    BOOST_CHECK_EQUAL( ring.size(), 6u );
+
+    websocketpp::log::connection_event out;
+    // the first two were overwritten when the ring wrapped
+    BOOST_CHECK( !ring.read(1, out) );
+    BOOST_REQUIRE( ring.read(5, out) );
+    BOOST_CHECK_EQUAL( out.status, 5 );
+    BOOST_CHECK_EQUAL( out.type, websocketpp::log::event_type::close );
+    BOOST_CHECK_EQUAL( std::string(out.user_agent).size(),
+        sizeof(out.user_agent) - 1 );
+
+    ring.close();
+    std::remove(path.c_str());
+#endif
+}
@@ -94,3 +94,27 @@ BOOST_AUTO_TEST_CASE( basic_get_manager ) {
     BOOST_CHECK(msg->m_size == 512);
 }
 
+
+BOOST_AUTO_TEST_CASE( memory_resource ) {
+    typedef stub<websocketpp::message_buffer::alloc::con_msg_manager>
+        message_type;
+    typedef websocketpp::message_buffer::alloc::con_msg_manager<message_type>
+        con_msg_man_type;
+
+    websocketpp::counting_resource resource;
+    con_msg_man_type::ptr manager(new con_msg_man_type());
+    BOOST_CHECK( websocketpp::set_manager_resource(*manager, &resource) );
+
+    message_type::ptr msg = manager->get_message(
+        websocketpp::frame::opcode::TEXT,512);
+    BOOST_CHECK(msg->m_size == 512);
+    // the message and its control block share one block
+    BOOST_CHECK_EQUAL( resource.blocks(), 1u );
+    BOOST_CHECK( resource.bytes() >= sizeof(message_type) );
+
+    msg.reset();
+    BOOST_CHECK_EQUAL( resource.blocks(), 0u );
+    BOOST_CHECK_EQUAL( resource.bytes(), 0u );
+    BOOST_CHECK_EQUAL( resource.allocations(), 1u );
+    BOOST_CHECK( resource.peak() >= sizeof(message_type) );
+}
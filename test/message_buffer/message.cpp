@@ -70,3 +70,31 @@ BOOST_AUTO_TEST_CASE( recycle ) {
     BOOST_CHECK(s->recycled == true);
 }
 
+
+BOOST_AUTO_TEST_CASE( shared_payload ) {
+    typedef websocketpp::message_buffer::message<stub> message_type;
+    typedef stub<message_type> stub_type;
+
+    stub_type::ptr s(new stub_type());
+    message_type::ptr source(new message_type(s,websocketpp::frame::opcode::TEXT));
+    message_type::ptr msg(new message_type(s,websocketpp::frame::opcode::TEXT));
+
+    source->set_payload("foo");
+    msg->set_payload_source(source);
+
+    BOOST_CHECK_EQUAL( msg->get_payload_source(), source );
+    BOOST_CHECK_EQUAL( msg->get_payload(), "foo" );
+    BOOST_CHECK_EQUAL( msg->get_payload().data(), source->get_payload().data() );
+
+    // mutable access detaches the shared payload
+    msg->get_raw_payload().append("bar");
+    BOOST_CHECK_EQUAL( msg->get_payload(), "foobar" );
+    BOOST_CHECK_EQUAL( source->get_payload(), "foo" );
+    BOOST_CHECK( !msg->get_payload_source() );
+
+    // set_payload replaces the shared payload
+    msg->set_payload_source(source);
+    msg->set_payload("baz");
+    BOOST_CHECK_EQUAL( msg->get_payload(), "baz" );
+    BOOST_CHECK_EQUAL( source->get_payload(), "foo" );
+}
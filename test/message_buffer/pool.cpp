@@ -25,132 +25,134 @@
  *
  */
 //#define BOOST_TEST_DYN_LINK
-#define BOOST_TEST_MODULE hybi_00_processor
+#define BOOST_TEST_MODULE message_buffer_pool
 #include <boost/test/unit_test.hpp>
 
 #include <iostream>
 #include <string>
 
-#include <websocketpp/processors/hybi00.hpp>
-#include <websocketpp/http/request.hpp>
-#include <websocketpp/http/response.hpp>
+#include <websocketpp/message_buffer/message.hpp>
+#include <websocketpp/message_buffer/pool.hpp>
 
+typedef websocketpp::message_buffer::message<
+    websocketpp::message_buffer::pool::con_msg_manager> message_type;
+typedef websocketpp::message_buffer::pool::con_msg_manager<message_type>
+    con_msg_man_type;
 
-BOOST_AUTO_TEST_CASE( exact_match ) {
-    websocketpp::http::parser::request r;
-    websocketpp::http::parser::response response;
-    websocketpp::processor::hybi00<websocketpp::http::parser::request,websocketpp::http::parser::response> p(false);
+BOOST_AUTO_TEST_CASE( basic_get_message ) {
+    con_msg_man_type::ptr manager(new con_msg_man_type());
+    message_type::ptr msg = manager->get_message(websocketpp::frame::opcode::TEXT,512);
 
-    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nOrigin: http://example.com\r\nSec-WebSocket-Key1: 3e6b263  4 17 80\r\nSec-WebSocket-Key2: 17  9 G`ZD9   2 2b 7X 3 /r90\r\n\r\n";
-
-    r.consume(handshake.c_str(),handshake.size());
-    r.replace_header("Sec-WebSocket-Key3","WjN}|M(6");
-
-    BOOST_CHECK(websocketpp::processor::is_websocket_handshake(r));
-    BOOST_CHECK(websocketpp::processor::get_websocket_version(r) == p.get_version());
-    BOOST_CHECK(p.validate_handshake(r));
-
-    websocketpp::uri_ptr u;
-    bool exception;
-
-    try {
-        u = p.get_uri(r);
-    } catch (const websocketpp::uri_exception& e) {
-        exception = true;
-    }
-
-    BOOST_CHECK(exception == false);
-    BOOST_CHECK(u->get_secure() == false);
-    BOOST_CHECK(u->get_host() == "www.example.com");
-    BOOST_CHECK(u->get_resource() == "/");
-    BOOST_CHECK(u->get_port() == websocketpp::URI_DEFAULT_PORT);
-
-    p.process_handshake(r,response);
-
-    BOOST_CHECK(response.get_header("Connection") == "Upgrade");
-    BOOST_CHECK(response.get_header("Upgrade") == "websocket");
-    BOOST_CHECK(response.get_header("Sec-WebSocket-Origin") == "http://example.com");
-
-    BOOST_CHECK(response.get_header("Sec-WebSocket-Location") == "ws://www.example.com/");
-    BOOST_CHECK(response.get_header("Sec-WebSocket-Key3") == "n`9eBk9z$R8pOtVb");
+    BOOST_REQUIRE(msg);
+    BOOST_CHECK(msg->get_opcode() == websocketpp::frame::opcode::TEXT);
+    BOOST_CHECK(msg->get_raw_payload().capacity() >= 512);
+    BOOST_CHECK_EQUAL(manager->get_free_count(), 0);
 }
 
-BOOST_AUTO_TEST_CASE( non_get_method ) {
-    websocketpp::http::parser::request r;
-    websocketpp::processor::hybi00<websocketpp::http::parser::request,websocketpp::http::parser::response> p(false);
-
-    std::string handshake = "POST / HTTP/1.1\r\nHost: www.example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Key1: 3e6b263  4 17 80\r\nSec-WebSocket-Key2: 17  9 G`ZD9   2 2b 7X 3 /r90\r\n\r\n";
-
-    r.consume(handshake.c_str(),handshake.size());
-    r.replace_header("Sec-WebSocket-Key3","janelle!");
-
-    BOOST_CHECK(websocketpp::processor::is_websocket_handshake(r));
-    BOOST_CHECK(websocketpp::processor::get_websocket_version(r) == p.get_version());
-    BOOST_CHECK(!p.validate_handshake(r));
+BOOST_AUTO_TEST_CASE( recycle_message ) {
+    con_msg_man_type::ptr manager(new con_msg_man_type());
+
+    message_type::ptr msg = manager->get_message(websocketpp::frame::opcode::TEXT,1000);
+    message_type * raw = msg.get();
+    msg->set_payload(std::string(1000,'*'));
+    msg->set_header("abc");
+    msg->set_prepared(true);
+    msg->set_terminal(true);
+
+    msg.reset();
+    BOOST_CHECK_EQUAL(manager->get_free_count(), 1);
+
+    // a request in the same size class gets the recycled, reset message
+    msg = manager->get_message(websocketpp::frame::opcode::BINARY,900);
+    BOOST_CHECK(msg.get() == raw);
+    BOOST_CHECK(msg->get_opcode() == websocketpp::frame::opcode::BINARY);
+    BOOST_CHECK(msg->get_payload().empty());
+    BOOST_CHECK(msg->get_header().empty());
+    BOOST_CHECK(!msg->get_prepared());
+    BOOST_CHECK(!msg->get_terminal());
+    BOOST_CHECK(msg->get_fin());
+    BOOST_CHECK(msg->get_raw_payload().capacity() >= 1000);
+    BOOST_CHECK_EQUAL(manager->get_free_count(), 0);
+
+    // a request in a larger size class does not
+    message_type::ptr msg2 = manager->get_message(websocketpp::frame::opcode::BINARY,100);
+    msg.reset();
+    message_type::ptr msg3 = manager->get_message(websocketpp::frame::opcode::BINARY,5000);
+    BOOST_CHECK(msg3.get() != raw);
+    BOOST_CHECK_EQUAL(manager->get_free_count(), 1);
 }
 
-BOOST_AUTO_TEST_CASE( old_http_version ) {
-    websocketpp::http::parser::request r;
-    websocketpp::processor::hybi00<websocketpp::http::parser::request,websocketpp::http::parser::response> p(false);
+BOOST_AUTO_TEST_CASE( recycle_limits ) {
+    con_msg_man_type::ptr manager(new con_msg_man_type(2));
 
-    std::string handshake = "GET / HTTP/1.0\r\nHost: www.example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Key1: 3e6b263  4 17 80\r\nSec-WebSocket-Key2: 17  9 G`ZD9   2 2b 7X 3 /r90\r\n\r\n";
-
-    r.consume(handshake.c_str(),handshake.size());
-    r.replace_header("Sec-WebSocket-Key3","janelle!");
+    {
+        message_type::ptr a = manager->get_message(websocketpp::frame::opcode::TEXT,10);
+        message_type::ptr b = manager->get_message(websocketpp::frame::opcode::TEXT,10);
+        message_type::ptr c = manager->get_message(websocketpp::frame::opcode::TEXT,10);
+    }
+    BOOST_CHECK_EQUAL(manager->get_free_count(), 2);
 
-    BOOST_CHECK(websocketpp::processor::is_websocket_handshake(r));
-    BOOST_CHECK(websocketpp::processor::get_websocket_version(r) == p.get_version());
-    BOOST_CHECK(!p.validate_handshake(r));
+    // messages beyond the largest size class are never pooled
+    size_t large = con_msg_man_type::max_class_size * 2;
+    {
+        message_type::ptr a = manager->get_message(websocketpp::frame::opcode::BINARY,large);
+    }
+    BOOST_CHECK_EQUAL(manager->get_free_count(), 2);
 }
 
-BOOST_AUTO_TEST_CASE( missing_handshake_key1 ) {
-    websocketpp::http::parser::request r;
-    websocketpp::processor::hybi00<websocketpp::http::parser::request,websocketpp::http::parser::response> p(false);
+BOOST_AUTO_TEST_CASE( reserve_messages ) {
+    con_msg_man_type::ptr manager(new con_msg_man_type(4));
 
-    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Key1: 3e6b263  4 17 80\r\n\r\n";
+    manager->reserve(3,1000);
+    BOOST_CHECK_EQUAL(manager->get_free_count(), 3);
 
-    r.consume(handshake.c_str(),handshake.size());
-    r.replace_header("Sec-WebSocket-Key3","janelle!");
+    // reserved messages serve requests of their size class
+    message_type::ptr msg = manager->get_message(websocketpp::frame::opcode::TEXT,900);
+    BOOST_CHECK(msg->get_raw_payload().capacity() >= 1000);
+    BOOST_CHECK_EQUAL(manager->get_free_count(), 2);
+    msg.reset();
 
-    BOOST_CHECK(websocketpp::processor::is_websocket_handshake(r));
-    BOOST_CHECK(websocketpp::processor::get_websocket_version(r) == p.get_version());
-    BOOST_CHECK(!p.validate_handshake(r));
+    // limited by the free list size, and sizes too large are not pooled
+    manager->reserve(10,1000);
+    BOOST_CHECK_EQUAL(manager->get_free_count(), 4);
+    manager->reserve(10,con_msg_man_type::max_class_size * 2);
+    BOOST_CHECK_EQUAL(manager->get_free_count(), 4);
 }
 
-BOOST_AUTO_TEST_CASE( missing_handshake_key2 ) {
-    websocketpp::http::parser::request r;
-    websocketpp::processor::hybi00<websocketpp::http::parser::request,websocketpp::http::parser::response> p(false);
+BOOST_AUTO_TEST_CASE( shared_payload_released ) {
+    con_msg_man_type::ptr manager(new con_msg_man_type());
 
-    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Key2: 17  9 G`ZD9   2 2b 7X 3 /r90\r\n\r\n";
+    message_type::ptr source = manager->get_message(websocketpp::frame::opcode::TEXT,10);
+    source->set_payload("shared");
+    websocketpp::lib::weak_ptr<message_type> weak_source = source;
 
-    r.consume(handshake.c_str(),handshake.size());
-    r.replace_header("Sec-WebSocket-Key3","janelle!");
+    message_type::ptr msg = manager->get_message(websocketpp::frame::opcode::TEXT,10);
+    msg->set_payload_source(source);
+    source.reset();
 
-    BOOST_CHECK(websocketpp::processor::is_websocket_handshake(r));
-    BOOST_CHECK(websocketpp::processor::get_websocket_version(r) == p.get_version());
-    BOOST_CHECK(!p.validate_handshake(r));
+    // recycling msg drops its reference to the source, recycling it too
+    msg.reset();
+    BOOST_CHECK_EQUAL(manager->get_free_count(), 2);
+    BOOST_CHECK(weak_source.expired());
 }
 
-BOOST_AUTO_TEST_CASE( bad_host ) {
-    websocketpp::http::parser::request r;
-    websocketpp::processor::hybi00<websocketpp::http::parser::request,websocketpp::http::parser::response> p(false);
-    websocketpp::uri_ptr u;
-    bool exception = false;
-
-    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com:70000\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Key2: 17  9 G`ZD9   2 2b 7X 3 /r90\r\n\r\n";
+BOOST_AUTO_TEST_CASE( outlive_manager ) {
+    con_msg_man_type::ptr manager(new con_msg_man_type());
+    message_type::ptr msg = manager->get_message(websocketpp::frame::opcode::TEXT,10);
 
-    r.consume(handshake.c_str(),handshake.size());
-    r.replace_header("Sec-WebSocket-Key3","janelle!");
+    manager.reset();
+    msg->set_payload("still valid");
+    BOOST_CHECK_EQUAL(msg->get_payload(), "still valid");
+}
 
-    BOOST_CHECK(websocketpp::processor::is_websocket_handshake(r));
-    BOOST_CHECK(websocketpp::processor::get_websocket_version(r) == p.get_version());
-    BOOST_CHECK(!p.validate_handshake(r));
+BOOST_AUTO_TEST_CASE( basic_get_manager ) {
+    typedef websocketpp::message_buffer::pool::endpoint_msg_manager
+        <con_msg_man_type> endpoint_manager_type;
 
-    try {
-        u = p.get_uri(r);
-    } catch (const websocketpp::uri_exception& e) {
-        exception = true;
-    }
+    endpoint_manager_type em;
+    con_msg_man_type::ptr manager = em.get_manager();
+    message_type::ptr msg = manager->get_message(websocketpp::frame::opcode::TEXT,512);
 
-    BOOST_CHECK(exception == true);
+    BOOST_CHECK(msg);
+    BOOST_CHECK(msg->get_opcode() == websocketpp::frame::opcode::TEXT);
 }
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE message_buffer_steady_state
+#include <boost/test/unit_test.hpp>
+
+#include <websocketpp/config/core.hpp>
+#include <websocketpp/message_buffer/pool.hpp>
+#include <websocketpp/server.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+// Every global allocation in this program is counted
+static std::atomic<size_t> g_allocations(0);
+
+void * operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    void * p = std::malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void * p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void * p, size_t) noexcept {
+    std::free(p);
+}
+
+struct pooled_config : public websocketpp::config::core {
+    typedef websocketpp::message_buffer::message<
+        websocketpp::message_buffer::pool::con_msg_manager> message_type;
+    typedef websocketpp::message_buffer::pool::con_msg_manager<message_type>
+        con_msg_manager_type;
+    typedef websocketpp::message_buffer::pool::endpoint_msg_manager<
+        con_msg_manager_type> endpoint_msg_manager_type;
+
+    static constexpr websocketpp::log::level elog_level =
+        websocketpp::log::elevel::none;
+    static constexpr websocketpp::log::level alog_level =
+        websocketpp::log::alevel::none;
+};
+
+typedef websocketpp::server<pooled_config> server;
+
+static websocketpp::lib::error_code discard(websocketpp::connection_hdl,
+    char const *, size_t)
+{
+    return websocketpp::lib::error_code();
+}
+
+// A masked client frame with a payload of the given size and a zero mask
+static std::string client_frame(size_t size) {
+    std::string frame("\x82", 1);
+    frame += char(0x80 | size);
+    frame.append(4, '\0');
+    frame.append(size, 'x');
+    return frame;
+}
+
+BOOST_AUTO_TEST_CASE( echo_allocates_nothing_once_warm ) {
+    server s;
+    server::connection_ptr con;
+    size_t received = 0;
+
+    s.set_message_handler([&](websocketpp::connection_hdl,
+        server::message_ptr msg)
+    {
+        ++received;
+        con->send(msg);
+    });
+
+    con = s.get_connection();
+    con->set_write_handler(&discard);
+    con->start();
+
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\n"
+        "Connection: upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    con->read_some(handshake.data(), handshake.size());
+    BOOST_REQUIRE_EQUAL(con->get_state(), websocketpp::session::state::open);
+
+    // payloads of bounded size, so every pool size class gets warm
+    std::string frames[3] = {client_frame(3), client_frame(60),
+        client_frame(125)};
+
+    for (size_t i = 0; i < 3000; ++i) {
+        con->read_some(frames[i % 3].data(), frames[i % 3].size());
+    }
+
+    size_t const count = 1000000;
+    size_t before = g_allocations.load();
+    for (size_t i = 0; i < count; ++i) {
+        con->read_some(frames[i % 3].data(), frames[i % 3].size());
+    }
+    size_t allocations = g_allocations.load() - before;
+
+    BOOST_CHECK_EQUAL(received, 3000 + count);
+    BOOST_CHECK_EQUAL(allocations, 0);
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define BOOST_TEST_MODULE precompiled_stock
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+
+#include <websocketpp/precompiled/asio.hpp>
+#include <websocketpp/precompiled/asio_client.hpp>
+
+namespace lib = websocketpp::lib;
+
+typedef websocketpp::server<websocketpp::config::asio> server;
+typedef websocketpp::client<websocketpp::config::asio_client> client;
+
+// Links only if the library provides the members the headers declared extern
+BOOST_AUTO_TEST_CASE( echo_over_loopback ) {
+    server s;
+    client c;
+    std::string echoed;
+
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    c.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    c.clear_error_channels(websocketpp::log::elevel::all);
+
+    s.init_asio();
+    c.init_asio(&s.get_io_context());
+    s.set_reuse_addr(true);
+
+    s.set_message_handler([&](websocketpp::connection_hdl hdl,
+        server::message_ptr msg)
+    {
+        s.send(hdl, msg->get_payload(), msg->get_opcode());
+    });
+    c.set_open_handler([&](websocketpp::connection_hdl hdl) {
+        c.send(hdl, "precompiled", websocketpp::frame::opcode::text);
+    });
+    c.set_message_handler([&](websocketpp::connection_hdl hdl,
+        client::message_ptr msg)
+    {
+        echoed = msg->get_payload();
+        c.close(hdl, websocketpp::close::status::normal, "");
+    });
+    c.set_close_handler([&](websocketpp::connection_hdl) {
+        s.stop_listening();
+    });
+
+    s.listen(9146);
+    s.start_accept();
+
+    lib::error_code ec;
+    client::connection_ptr con = c.get_connection("ws://127.0.0.1:9146", ec);
+    BOOST_REQUIRE( !ec );
+    c.connect(con);
+
+    s.run();
+
+    BOOST_CHECK_EQUAL( echoed, "precompiled" );
+}
@@ -28,6 +28,8 @@
 #define BOOST_TEST_MODULE hybi_13_processor
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <string>
 
@@ -61,6 +63,7 @@ struct stub_config {
         <permessage_deflate_config> permessage_deflate_type;
 
     static const size_t max_message_size = 16000000;
+    static const size_t message_reserve_step = 65536;
     static const bool enable_extensions = false;
 };
 
@@ -83,9 +86,66 @@ struct stub_config_ext {
         <permessage_deflate_config> permessage_deflate_type;
 
     static const size_t max_message_size = 16000000;
+    static const size_t message_reserve_step = 65536;
     static const bool enable_extensions = true;
 };
 
+// Reverses data messages, marking them with RSV2
+struct reverse_extension {
+    typedef std::pair<websocketpp::lib::error_code,std::string> err_str_pair;
+
+    static constexpr uint8_t rsv_bits = websocketpp::frame::BHB0_RSV2;
+
+    reverse_extension() : enabled(false) {}
+
+    static char const * name() {
+        return "x-reverse";
+    }
+
+    std::string generate_offer() const {
+        return name();
+    }
+
+    err_str_pair negotiate(websocketpp::http::attribute_list const &) {
+        enabled = true;
+        return err_str_pair(websocketpp::lib::error_code(), name());
+    }
+
+    websocketpp::lib::error_code init(bool) {
+        return websocketpp::lib::error_code();
+    }
+
+    bool is_enabled() const {
+        return enabled;
+    }
+
+    websocketpp::lib::error_code encode(websocketpp::frame::opcode::value,
+        std::string & payload, bool & transformed)
+    {
+        std::reverse(payload.begin(), payload.end());
+        transformed = true;
+        return websocketpp::lib::error_code();
+    }
+
+    websocketpp::lib::error_code decode(websocketpp::frame::opcode::value,
+        std::string & payload)
+    {
+        std::reverse(payload.begin(), payload.end());
+        return websocketpp::lib::error_code();
+    }
+
+    bool enabled;
+};
+
+struct stub_config_chain : public stub_config_ext {
+    typedef websocketpp::extensions::chain<reverse_extension>
+        extension_chain_type;
+};
+
+struct stub_config_trusted : public stub_config_ext {
+    static const bool enable_trusted_link = true;
+};
+
 typedef stub_config::con_msg_manager_type con_msg_manager_type;
 typedef stub_config::message_type::ptr message_ptr;
 
@@ -117,6 +177,32 @@ struct processor_setup_ext {
     websocketpp::processor::hybi13<stub_config_ext> p;
 };
 
+struct processor_setup_chain {
+    processor_setup_chain(bool server)
+      : msg_manager(new con_msg_manager_type())
+      , p(false,server,msg_manager,rng) {}
+
+    websocketpp::lib::error_code ec;
+    con_msg_manager_type::ptr msg_manager;
+    stub_config::rng_type rng;
+    stub_config::request_type req;
+    stub_config::response_type res;
+    websocketpp::processor::hybi13<stub_config_chain> p;
+};
+
+struct processor_setup_trusted {
+    processor_setup_trusted(bool server)
+      : msg_manager(new con_msg_manager_type())
+      , p(false,server,msg_manager,rng) {}
+
+    websocketpp::lib::error_code ec;
+    con_msg_manager_type::ptr msg_manager;
+    stub_config::rng_type rng;
+    stub_config::request_type req;
+    stub_config::response_type res;
+    websocketpp::processor::hybi13<stub_config_trusted> p;
+};
+
 BOOST_AUTO_TEST_CASE( exact_match ) {
     processor_setup env(true);
 
@@ -425,6 +511,32 @@ BOOST_AUTO_TEST_CASE( fragmented_binary_message ) {
     BOOST_CHECK_EQUAL( env1.ec, websocketpp::processor::error::invalid_continuation );
 }
 
+BOOST_AUTO_TEST_CASE( many_fragment_binary_message ) {
+    processor_setup env(false);
+
+    // 2000 four byte fragments, as a browser streaming an upload might send
+    std::string wire;
+    std::string expected;
+    for (size_t i = 0; i < 2000; ++i) {
+        char const op = i == 0 ? 0x02 : (i == 1999 ? char(0x80) : 0x00);
+        char const payload[4] = {char('a' + i % 26), 'b', 'c', 'd'};
+        wire += op;
+        wire += char(0x04);
+        wire.append(payload, 4);
+        expected.append(payload, 4);
+    }
+
+    uint8_t * buf = reinterpret_cast<uint8_t *>(&wire[0]);
+    BOOST_CHECK_EQUAL( env.p.consume(buf, wire.size(), env.ec), wire.size() );
+    BOOST_CHECK( !env.ec );
+    BOOST_CHECK_EQUAL( env.p.ready(), true );
+
+    message_ptr msg = env.p.get_message();
+    BOOST_REQUIRE( msg );
+    BOOST_CHECK( msg->get_payload() == expected );
+    BOOST_CHECK( msg->get_payload().capacity() < 4 * expected.size() );
+}
+
 BOOST_AUTO_TEST_CASE( unmasked_client_frame ) {
     processor_setup env(true);
 
@@ -473,6 +585,279 @@ BOOST_AUTO_TEST_CASE( masked_fragmented_binary_message ) {
     BOOST_CHECK_EQUAL( env.p.get_message()->get_payload(), "**" );
 }
 
+// Build a masked client frame with the given opcode, fin bit, and payload
+std::string masked_client_frame(websocketpp::frame::opcode::value op, bool fin,
+    std::string const & payload, uint32_t key)
+{
+    websocketpp::frame::basic_header h(op,payload.size(),fin,true);
+    websocketpp::frame::extended_header e(payload.size(),key);
+
+    websocketpp::frame::masking_key_type k;
+    k.i = key;
+
+    std::string masked(payload.size(),'\0');
+    websocketpp::frame::byte_mask(payload.begin(),payload.end(),
+        masked.begin(),k);
+
+    return websocketpp::frame::prepare_header(h,e) + masked;
+}
+
+BOOST_AUTO_TEST_CASE( masked_fragmented_text_message ) {
+    // multi byte sequence split across two frames, each fed one byte at a time
+    std::string text = std::string(37,'a') + "\xE2\x82\xAC" + std::string(29,'b');
+    std::string wire = masked_client_frame(
+        websocketpp::frame::opcode::text,false,text.substr(0,38),0x12345678);
+    wire += masked_client_frame(
+        websocketpp::frame::opcode::continuation,true,text.substr(38),0x9ABCDEF0);
+
+    processor_setup env(true);
+    uint8_t * data = reinterpret_cast<uint8_t *>(&wire[0]);
+
+    for (size_t i = 0; i < wire.size(); ++i) {
+        BOOST_CHECK_EQUAL( env.p.consume(data+i,1,env.ec), 1 );
+        BOOST_CHECK( !env.ec );
+    }
+    BOOST_CHECK_EQUAL( env.p.ready(), true );
+    BOOST_CHECK_EQUAL( env.p.get_message()->get_payload(), text );
+
+    // same message in one read
+    wire = masked_client_frame(
+        websocketpp::frame::opcode::text,false,text.substr(0,38),0x12345678);
+    wire += masked_client_frame(
+        websocketpp::frame::opcode::continuation,true,text.substr(38),0x9ABCDEF0);
+    data = reinterpret_cast<uint8_t *>(&wire[0]);
+
+    BOOST_CHECK_EQUAL( env.p.consume(data,wire.size(),env.ec), wire.size() );
+    BOOST_CHECK( !env.ec );
+    BOOST_CHECK_EQUAL( env.p.ready(), true );
+    BOOST_CHECK_EQUAL( env.p.get_message()->get_payload(), text );
+}
+
+BOOST_AUTO_TEST_CASE( masked_invalid_text_message ) {
+    std::string text = std::string(50,'a') + "\xC0\xAF" + std::string(20,'b');
+    std::string wire = masked_client_frame(
+        websocketpp::frame::opcode::text,true,text,0x0BADF00D);
+
+    processor_setup env(true);
+    uint8_t * data = reinterpret_cast<uint8_t *>(&wire[0]);
+
+    env.p.consume(data,wire.size(),env.ec);
+    BOOST_CHECK_EQUAL( env.ec, websocketpp::processor::error::invalid_utf8 );
+    BOOST_CHECK_EQUAL( env.p.ready(), false );
+}
+
+BOOST_AUTO_TEST_CASE( header_split_across_reads ) {
+    std::string payload(200,'*');
+    std::string frame = masked_client_frame(
+        websocketpp::frame::opcode::BINARY,true,payload,0x12345678);
+
+    // the 8 byte header is decoded in one step when it is all in the first
+    // read, and byte by byte when the read ends inside it
+    for (size_t split = 0; split <= frame.size(); ++split) {
+        processor_setup env(true);
+        std::string wire = frame;
+        uint8_t * buf = reinterpret_cast<uint8_t *>(&wire[0]);
+
+        BOOST_CHECK_EQUAL( env.p.consume(buf,split,env.ec), split );
+        BOOST_CHECK( !env.ec );
+        BOOST_CHECK_EQUAL( env.p.consume(buf+split,wire.size()-split,env.ec),
+            wire.size()-split );
+        BOOST_CHECK( !env.ec );
+        BOOST_REQUIRE( env.p.ready() );
+        BOOST_CHECK_EQUAL( env.p.get_message()->get_payload(), payload );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( message_view ) {
+    std::string text = std::string(40,'a') + "\xE2\x82\xAC";
+    std::string wire = masked_client_frame(
+        websocketpp::frame::opcode::text,true,text,0x12345678);
+
+    processor_setup env(true);
+    env.p.set_message_views(true);
+    uint8_t * data = reinterpret_cast<uint8_t *>(&wire[0]);
+
+    websocketpp::frame::opcode::value op;
+    std::string_view view;
+
+    BOOST_CHECK( !env.p.get_message_view(op,view) );
+    BOOST_CHECK_EQUAL( env.p.consume(data,wire.size(),env.ec), wire.size() );
+    BOOST_CHECK( !env.ec );
+    BOOST_CHECK_EQUAL( env.p.ready(), true );
+    BOOST_REQUIRE( env.p.get_message_view(op,view) );
+    BOOST_CHECK_EQUAL( op, websocketpp::frame::opcode::text );
+    BOOST_CHECK_EQUAL( std::string(view), text );
+    // payload was unmasked in place in the read buffer
+    BOOST_CHECK( view.data() == wire.data() + wire.size() - text.size() );
+    BOOST_CHECK_EQUAL( env.p.ready(), false );
+
+    // a view that isn't retrieved as one is copied into a message
+    wire = masked_client_frame(
+        websocketpp::frame::opcode::binary,true,"**",0x9ABCDEF0);
+    data = reinterpret_cast<uint8_t *>(&wire[0]);
+    BOOST_CHECK_EQUAL( env.p.consume(data,wire.size(),env.ec), wire.size() );
+    BOOST_CHECK_EQUAL( env.p.ready(), true );
+    BOOST_CHECK_EQUAL( env.p.get_message()->get_payload(), "**" );
+}
+
+BOOST_AUTO_TEST_CASE( message_chunks ) {
+    processor_setup env(true);
+    env.p.set_message_chunks(true);
+    env.p.set_message_views(true);
+
+    websocketpp::frame::opcode::value op;
+    std::string_view chunk;
+    bool first;
+    bool last;
+
+    // a frame split across reads comes out one read at a time, then a ping
+    // between the frames of the message and its last frame
+    std::string wire = masked_client_frame(
+        websocketpp::frame::opcode::text,false,"Hello ",0x12345678);
+    wire += masked_client_frame(
+        websocketpp::frame::opcode::ping,true,"p",0x0BADF00D);
+    wire += masked_client_frame(
+        websocketpp::frame::opcode::continuation,true,"world",0x9ABCDEF0);
+    uint8_t * data = reinterpret_cast<uint8_t *>(&wire[0]);
+
+    BOOST_CHECK_EQUAL( env.p.consume(data,8,env.ec), 8 );
+    BOOST_CHECK( !env.ec );
+    BOOST_REQUIRE( env.p.get_message_chunk(op,chunk,first,last) );
+    BOOST_CHECK_EQUAL( op, websocketpp::frame::opcode::text );
+    BOOST_CHECK_EQUAL( std::string(chunk), "He" );
+    BOOST_CHECK( first );
+    BOOST_CHECK( !last );
+    BOOST_CHECK( !env.p.get_message_chunk(op,chunk,first,last) );
+
+    size_t p = 8;
+    p += env.p.consume(data+p,wire.size()-p,env.ec);
+    BOOST_REQUIRE( env.p.get_message_chunk(op,chunk,first,last) );
+    BOOST_CHECK_EQUAL( std::string(chunk), "llo " );
+    BOOST_CHECK( !first );
+    BOOST_CHECK( !last );
+
+    p += env.p.consume(data+p,wire.size()-p,env.ec);
+    BOOST_REQUIRE( env.p.ready() );
+    BOOST_CHECK( !env.p.get_message_chunk(op,chunk,first,last) );
+    BOOST_CHECK_EQUAL( env.p.get_message()->get_payload(), "p" );
+
+    p += env.p.consume(data+p,wire.size()-p,env.ec);
+    BOOST_CHECK_EQUAL( p, wire.size() );
+    BOOST_REQUIRE( env.p.get_message_chunk(op,chunk,first,last) );
+    BOOST_CHECK_EQUAL( op, websocketpp::frame::opcode::text );
+    BOOST_CHECK_EQUAL( std::string(chunk), "world" );
+    BOOST_CHECK( !first );
+    BOOST_CHECK( last );
+    BOOST_CHECK_EQUAL( env.p.ready(), false );
+
+    // an empty message is one empty chunk
+    wire = masked_client_frame(
+        websocketpp::frame::opcode::binary,true,"",0x12345678);
+    data = reinterpret_cast<uint8_t *>(&wire[0]);
+    BOOST_CHECK_EQUAL( env.p.consume(data,wire.size(),env.ec), wire.size() );
+    BOOST_REQUIRE( env.p.get_message_chunk(op,chunk,first,last) );
+    BOOST_CHECK( chunk.empty() );
+    BOOST_CHECK( first );
+    BOOST_CHECK( last );
+
+    // the size limit applies to the whole message
+    env.p.set_max_message_size(6);
+    wire = masked_client_frame(
+        websocketpp::frame::opcode::binary,false,"four",0x12345678);
+    wire += masked_client_frame(
+        websocketpp::frame::opcode::continuation,true,"four",0x12345678);
+    data = reinterpret_cast<uint8_t *>(&wire[0]);
+    p = env.p.consume(data,wire.size(),env.ec);
+    BOOST_REQUIRE( env.p.get_message_chunk(op,chunk,first,last) );
+    env.p.consume(data+p,wire.size()-p,env.ec);
+    BOOST_CHECK_EQUAL( env.ec, websocketpp::processor::error::message_too_big );
+}
+
+BOOST_AUTO_TEST_CASE( message_spill ) {
+    processor_setup env(true);
+    env.p.set_message_spill(16,100,"");
+
+    // a fragmented text message past the threshold comes out of the file
+    std::string text = std::string(30,'a') + "\xE2\x82\xAC" + std::string(20,'b');
+    std::string wire = masked_client_frame(
+        websocketpp::frame::opcode::text,false,text.substr(0,31),0x12345678);
+    wire += masked_client_frame(
+        websocketpp::frame::opcode::continuation,true,text.substr(31),
+        0x9ABCDEF0);
+    uint8_t * data = reinterpret_cast<uint8_t *>(&wire[0]);
+    BOOST_CHECK_EQUAL( env.p.consume(data,wire.size(),env.ec), wire.size() );
+    BOOST_CHECK( !env.ec );
+    BOOST_REQUIRE( env.p.ready() );
+    message_ptr msg = env.p.get_message();
+    BOOST_CHECK_EQUAL( std::string(msg->get_payload_data(),
+        msg->get_payload_size()), text );
+    BOOST_CHECK_EQUAL( msg->get_payload(), text );
+
+    // small messages stay in memory
+    wire = masked_client_frame(
+        websocketpp::frame::opcode::binary,true,"small",0x12345678);
+    data = reinterpret_cast<uint8_t *>(&wire[0]);
+    BOOST_CHECK_EQUAL( env.p.consume(data,wire.size(),env.ec), wire.size() );
+    BOOST_REQUIRE( env.p.ready() );
+    BOOST_CHECK_EQUAL( env.p.get_message()->get_raw_payload(), "small" );
+
+    // spilled messages may pass the maximum message size, up to the spill
+    // limit
+    env.p.set_max_message_size(32);
+    std::string big(90,'x');
+    wire = masked_client_frame(
+        websocketpp::frame::opcode::binary,true,big,0x12345678);
+    data = reinterpret_cast<uint8_t *>(&wire[0]);
+    BOOST_CHECK_EQUAL( env.p.consume(data,wire.size(),env.ec), wire.size() );
+    BOOST_CHECK( !env.ec );
+    BOOST_REQUIRE( env.p.ready() );
+    BOOST_CHECK_EQUAL( env.p.get_message()->get_payload(), big );
+
+    wire = masked_client_frame(
+        websocketpp::frame::opcode::binary,true,std::string(101,'x'),
+        0x12345678);
+    data = reinterpret_cast<uint8_t *>(&wire[0]);
+    env.p.consume(data,wire.size(),env.ec);
+    BOOST_CHECK_EQUAL( env.ec, websocketpp::processor::error::message_too_big );
+}
+
+BOOST_AUTO_TEST_CASE( message_view_fallback ) {
+    processor_setup env(true);
+    env.p.set_message_views(true);
+
+    websocketpp::frame::opcode::value op;
+    std::string_view view;
+
+    // split across reads: delivered as a message
+    std::string wire = masked_client_frame(
+        websocketpp::frame::opcode::text,true,"Hello",0x12345678);
+    uint8_t * data = reinterpret_cast<uint8_t *>(&wire[0]);
+    BOOST_CHECK_EQUAL( env.p.consume(data,wire.size()-1,env.ec), wire.size()-1 );
+    BOOST_CHECK_EQUAL( env.p.consume(data+wire.size()-1,1,env.ec), 1 );
+    BOOST_CHECK_EQUAL( env.p.ready(), true );
+    BOOST_CHECK( !env.p.get_message_view(op,view) );
+    BOOST_CHECK_EQUAL( env.p.get_message()->get_payload(), "Hello" );
+
+    // fragmented: delivered as a message
+    wire = masked_client_frame(
+        websocketpp::frame::opcode::text,false,"Hel",0x12345678);
+    wire += masked_client_frame(
+        websocketpp::frame::opcode::continuation,true,"lo",0x9ABCDEF0);
+    data = reinterpret_cast<uint8_t *>(&wire[0]);
+    BOOST_CHECK_EQUAL( env.p.consume(data,wire.size(),env.ec), wire.size() );
+    BOOST_CHECK_EQUAL( env.p.ready(), true );
+    BOOST_CHECK( !env.p.get_message_view(op,view) );
+    BOOST_CHECK_EQUAL( env.p.get_message()->get_payload(), "Hello" );
+
+    // invalid utf8 is still rejected
+    wire = masked_client_frame(
+        websocketpp::frame::opcode::text,true,"\xC0\xAF",0x0BADF00D);
+    data = reinterpret_cast<uint8_t *>(&wire[0]);
+    env.p.consume(data,wire.size(),env.ec);
+    BOOST_CHECK_EQUAL( env.ec, websocketpp::processor::error::invalid_utf8 );
+    BOOST_CHECK_EQUAL( env.p.ready(), false );
+}
+
 BOOST_AUTO_TEST_CASE( prepare_data_frame ) {
     processor_setup env(true);
 
@@ -502,11 +887,123 @@ BOOST_AUTO_TEST_CASE( prepare_data_frame ) {
     }
 
 
-    //in.set_payload("foo");
+    // unmasked, uncompressed payloads are shared rather than copied
+    in->set_opcode(websocketpp::frame::opcode::binary);
+    in->set_payload("foo");
+
+    env.ec = env.p.prepare_data_frame(in,out);
+    BOOST_CHECK( !env.ec );
+    BOOST_CHECK( out->get_prepared() );
+    BOOST_CHECK_EQUAL( out->get_header(), "\x82\x03" );
+    BOOST_CHECK_EQUAL( out->get_payload(), "foo" );
+    BOOST_CHECK_EQUAL( out->get_payload().data(), in->get_payload().data() );
+}
+
+BOOST_AUTO_TEST_CASE( prepare_data_frame_headroom ) {
+    processor_setup env(true);
+
+    message_ptr in = env.msg_manager->get_message();
+    message_ptr out = env.msg_manager->get_message();
+    message_ptr other = env.msg_manager->get_message();
+
+    in->set_opcode(websocketpp::frame::opcode::binary);
+    std::span<char> payload = in->writable_payload(3);
+    BOOST_REQUIRE_EQUAL( payload.size(), 3u );
+    std::memcpy(payload.data(), "foo", 3);
+
+    // the header is written in front of the payload, making one buffer
+    env.ec = env.p.prepare_data_frame(in,out);
+    BOOST_CHECK( !env.ec );
+    BOOST_CHECK( out->get_header_in_place() );
+    BOOST_CHECK_EQUAL( out->get_payload_data(), payload.data() );
+    BOOST_CHECK_EQUAL( std::string(out->get_payload_data() - 2, 5),
+        "\x82\x03" "foo" );
+
+    // the headroom is taken, a second frame of the payload keeps its own
+    env.ec = env.p.prepare_data_frame(in,other);
+    BOOST_CHECK( !env.ec );
+    BOOST_CHECK( !other->get_header_in_place() );
+    BOOST_CHECK_EQUAL( other->get_header(), "\x82\x03" );
+
+    // a new header or payload is no longer in place
+    out->set_header(std::string("\x02\x03"));
+    BOOST_CHECK( !out->get_header_in_place() );
+}
+
+BOOST_AUTO_TEST_CASE( prepare_data_frame_masked ) {
+    processor_setup env(false);
+
+    message_ptr in = env.msg_manager->get_message();
+    message_ptr out = env.msg_manager->get_message();
+
+    in->set_opcode(websocketpp::frame::opcode::text);
+    in->set_payload("foo");
+
+    // client frames are masked into their own buffer
+    env.ec = env.p.prepare_data_frame(in,out);
+    BOOST_CHECK( !env.ec );
+    BOOST_CHECK( !out->get_payload_source() );
+    BOOST_CHECK_EQUAL( out->get_header().size(), 6 );
+    BOOST_CHECK_EQUAL( out->get_payload().size(), 3 );
+    BOOST_CHECK_EQUAL( in->get_payload(), "foo" );
+}
+
+BOOST_AUTO_TEST_CASE( prepare_fragments ) {
+    processor_setup env(true);
+
+    message_ptr in = env.msg_manager->get_message();
+    message_ptr src = env.msg_manager->get_message();
+    message_ptr out = env.msg_manager->get_message();
 
-    //e = prepare_data_frame(in,out);
+    in->set_opcode(websocketpp::frame::opcode::text);
+    in->set_payload("foobar");
 
+    env.ec = env.p.prepare_fragment_source(in,src);
+    BOOST_CHECK( !env.ec );
+    BOOST_CHECK( !src->get_prepared() );
+    BOOST_CHECK_EQUAL( src->get_payload(), "foobar" );
+
+    env.ec = env.p.prepare_fragment(src,0,4,out);
+    BOOST_CHECK( !env.ec );
+    BOOST_CHECK( out->get_prepared() );
+    BOOST_CHECK_EQUAL( out->get_header(), std::string("\x01\x04",2) );
+    BOOST_CHECK_EQUAL( out->get_payload(), "foob" );
+
+    out = env.msg_manager->get_message();
+    env.ec = env.p.prepare_fragment(src,4,6,out);
+    BOOST_CHECK( !env.ec );
+    BOOST_CHECK_EQUAL( out->get_header(), std::string("\x80\x02",2) );
+    BOOST_CHECK_EQUAL( out->get_payload(), "ar" );
+}
+
+BOOST_AUTO_TEST_CASE( prepare_fragments_masked ) {
+    processor_setup env(false);
+
+    message_ptr in = env.msg_manager->get_message();
+    message_ptr src = env.msg_manager->get_message();
+    message_ptr out = env.msg_manager->get_message();
+
+    in->set_opcode(websocketpp::frame::opcode::binary);
+    in->set_payload("foobar");
+
+    env.ec = env.p.prepare_fragment_source(in,src);
+    BOOST_CHECK( !env.ec );
 
+    // each client fragment is masked with its own key
+    env.ec = env.p.prepare_fragment(src,2,6,out);
+    BOOST_CHECK( !env.ec );
+    std::string const & header = out->get_header();
+    BOOST_REQUIRE_EQUAL( header.size(), 6 );
+    BOOST_CHECK_EQUAL( header[0], '\x80' );
+    BOOST_CHECK_EQUAL( header[1], '\x84' );
+
+    std::string payload = out->get_payload();
+    BOOST_REQUIRE_EQUAL( payload.size(), 4 );
+    for (size_t i = 0; i < payload.size(); ++i) {
+        payload[i] ^= header[2+i%4];
+    }
+    BOOST_CHECK_EQUAL( payload, "obar" );
+    BOOST_CHECK_EQUAL( src->get_payload(), "foobar" );
 }
 
 BOOST_AUTO_TEST_CASE( single_frame_message_too_large ) {
@@ -540,6 +1037,48 @@ BOOST_AUTO_TEST_CASE( multiple_frame_message_too_large ) {
 
 
 
+BOOST_AUTO_TEST_CASE( large_frame_reserves_incrementally ) {
+    processor_setup env(true);
+
+    websocketpp::lib::shared_ptr<websocketpp::memory_budget> budget =
+        websocketpp::lib::make_shared<websocketpp::memory_budget>(1 << 24);
+    env.p.set_inbound_memory_budget(budget);
+
+    // header of a masked frame announcing a 1MB payload
+    uint8_t frame[14] = {0x82, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+    BOOST_CHECK_EQUAL( env.p.consume(frame,14,env.ec), 14 );
+    BOOST_CHECK( !env.ec );
+    BOOST_CHECK( budget->get_used() > 0 );
+    BOOST_CHECK( budget->get_used() < 2 * stub_config::message_reserve_step );
+}
+
+BOOST_AUTO_TEST_CASE( inbound_memory_limit ) {
+    processor_setup env(true);
+
+    websocketpp::lib::shared_ptr<websocketpp::memory_budget> budget =
+        websocketpp::lib::make_shared<websocketpp::memory_budget>(100);
+    env.p.set_inbound_memory_budget(budget);
+
+    uint8_t small[9] = {0x82, 0x83, 0x00, 0x00, 0x00, 0x00, 0x66, 0x6f, 0x6f};
+
+    BOOST_CHECK_EQUAL( env.p.consume(small,9,env.ec), 9 );
+    BOOST_CHECK( !env.ec );
+    BOOST_CHECK( budget->get_used() > 0 );
+
+    message_ptr foo = env.p.get_message();
+    BOOST_CHECK_EQUAL( foo->get_payload(), "foo" );
+    BOOST_CHECK_EQUAL( budget->get_used(), 0 );
+
+    uint8_t large[8] = {0x82, 0xFE, 0x00, 0xC8, 0x00, 0x00, 0x00, 0x00};
+
+    BOOST_CHECK_EQUAL( env.p.consume(large,8,env.ec), 8 );
+    BOOST_CHECK_EQUAL( env.ec, websocketpp::processor::error::inbound_memory_limit );
+    BOOST_CHECK_EQUAL( websocketpp::processor::error::to_ws(env.ec),
+        websocketpp::close::status::try_again_later );
+}
+
 BOOST_AUTO_TEST_CASE( client_handshake_request ) {
     processor_setup env(false);
 
@@ -720,3 +1259,273 @@ BOOST_AUTO_TEST_CASE( extension_negotiation_permessage_deflate ) {
     BOOST_CHECK_EQUAL( neg_results.second, "permessage-deflate" );
 }
 
+
+BOOST_AUTO_TEST_CASE( select_broadcast_frame_shared_compression ) {
+    processor_setup_ext env1(true);
+    processor_setup_ext env2(true);
+    processor_setup_ext env3(true);
+
+    env1.req.replace_header("Sec-WebSocket-Extensions",
+        "permessage-deflate; server_no_context_takeover");
+    env2.req.replace_header("Sec-WebSocket-Extensions",
+        "permessage-deflate; server_no_context_takeover");
+    env3.req.replace_header("Sec-WebSocket-Extensions",
+        "permessage-deflate");
+
+    BOOST_REQUIRE( !env1.p.negotiate_extensions(env1.req).first );
+    BOOST_REQUIRE( !env2.p.negotiate_extensions(env2.req).first );
+    BOOST_REQUIRE( !env3.p.negotiate_extensions(env3.req).first );
+
+    std::string payload(1000,'*');
+
+    message_ptr in = env1.msg_manager->get_message();
+    in->set_opcode(websocketpp::frame::opcode::text);
+    in->set_payload(payload);
+    in->set_header(std::string("\x81\x7e\x03\xe8",4));
+    in->set_prepared(true);
+    in->set_broadcast(true);
+    in->set_compressed(true);
+    in->enable_variants();
+
+    // compressed once and shared between connections negotiating the same
+    // parameters
+    message_ptr out1 = env1.p.select_broadcast_frame(in);
+    message_ptr out2 = env2.p.select_broadcast_frame(in);
+    BOOST_REQUIRE( out1 != in );
+    BOOST_CHECK( out1 == out2 );
+    BOOST_CHECK( out1->get_prepared() );
+    BOOST_CHECK( out1->get_payload().size() < payload.size() );
+    BOOST_CHECK_EQUAL( out1->get_header()[0], '\xc1' );
+
+    // the shared frame matches the connection's own compressor
+    message_ptr own = env1.msg_manager->get_message();
+    message_ptr raw = env1.msg_manager->get_message();
+    raw->set_opcode(websocketpp::frame::opcode::text);
+    raw->set_payload(payload);
+    raw->set_compressed(true);
+    BOOST_REQUIRE( !env1.p.prepare_data_frame(raw,own) );
+    BOOST_CHECK_EQUAL( own->get_header(), out1->get_header() );
+    BOOST_CHECK_EQUAL( own->get_payload(), out1->get_payload() );
+
+    // with context takeover the uncompressed broadcast frame is used
+    BOOST_CHECK( env3.p.select_broadcast_frame(in) == in );
+}
+
+BOOST_AUTO_TEST_CASE( deflate_memory_budget_sends_uncompressed ) {
+    typedef websocketpp::extensions::permessage_deflate::memory_budget
+        budget_type;
+
+    processor_setup_ext env(true);
+    websocketpp::lib::shared_ptr<budget_type> budget =
+        websocketpp::lib::make_shared<budget_type>(1024);
+    env.p.set_deflate_memory(1, budget);
+
+    env.req.replace_header("Sec-WebSocket-Extensions", "permessage-deflate");
+    BOOST_REQUIRE( !env.p.negotiate_extensions(env.req).first );
+
+    message_ptr in = env.msg_manager->get_message();
+    message_ptr out = env.msg_manager->get_message();
+    in->set_opcode(websocketpp::frame::opcode::text);
+    in->set_payload(std::string(1000,'*'));
+    in->set_compressed(true);
+
+    // the compressor does not fit, so the frame is sent without RSV1
+    BOOST_REQUIRE( !env.p.prepare_data_frame(in,out) );
+    BOOST_CHECK_EQUAL( out->get_header()[0], '\x81' );
+    BOOST_CHECK_EQUAL( out->get_payload(), in->get_payload() );
+    BOOST_CHECK_EQUAL( budget->get_used(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( deflate_preset_dictionary ) {
+    websocketpp::lib::shared_ptr<std::string const> dictionary =
+        websocketpp::lib::make_shared<std::string const>(
+            "{\"timestamp\":,\"symbol\":\"\",\"price\":,\"volume\":}");
+
+    processor_setup_ext server(true);
+    processor_setup_ext client(false);
+    processor_setup_ext plain(false);
+    server.p.set_deflate_dictionary("quotes", dictionary);
+    client.p.set_deflate_dictionary("quotes", dictionary);
+
+    server.req.replace_header("Sec-WebSocket-Extensions",
+        "permessage-deflate; client_no_context_takeover; x_dictionary=quotes");
+    std::pair<websocketpp::lib::error_code,std::string> neg =
+        server.p.negotiate_extensions(server.req);
+    BOOST_REQUIRE( !neg.first );
+    BOOST_CHECK( neg.second.find("x_dictionary=quotes") != std::string::npos );
+
+    client.res.replace_header("Sec-WebSocket-Extensions", neg.second);
+    BOOST_REQUIRE( !client.p.negotiate_extensions(client.res).first );
+    plain.res.replace_header("Sec-WebSocket-Extensions",
+        "permessage-deflate; client_no_context_takeover");
+    BOOST_REQUIRE( !plain.p.negotiate_extensions(plain.res).first );
+
+    std::string payload = "{\"timestamp\":1,\"symbol\":\"A\","
+        "\"price\":2,\"volume\":3}";
+
+    // the dictionary is used for every message, as the client resets its
+    // context after each one
+    for (int i = 0; i < 2; ++i) {
+        message_ptr in = client.msg_manager->get_message();
+        message_ptr out = client.msg_manager->get_message();
+        in->set_opcode(websocketpp::frame::opcode::text);
+        in->set_payload(payload);
+        in->set_compressed(true);
+        BOOST_REQUIRE( !client.p.prepare_data_frame(in,out) );
+
+        message_ptr plain_out = plain.msg_manager->get_message();
+        BOOST_REQUIRE( !plain.p.prepare_data_frame(in,plain_out) );
+        BOOST_CHECK( out->get_payload().size() <
+            plain_out->get_payload().size() );
+
+        std::string frame = out->get_header() + out->get_payload();
+        size_t ret = server.p.consume(
+            reinterpret_cast<uint8_t *>(&frame[0]),frame.size(),server.ec);
+        BOOST_CHECK_EQUAL( server.ec, websocketpp::lib::error_code() );
+        BOOST_CHECK_EQUAL( ret, frame.size() );
+        BOOST_REQUIRE( server.p.ready() );
+        BOOST_CHECK_EQUAL( server.p.get_message()->get_payload(), payload );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( deflate_preset_dictionary_mismatch ) {
+    websocketpp::lib::shared_ptr<std::string const> dictionary =
+        websocketpp::lib::make_shared<std::string const>("dictionary");
+
+    processor_setup_ext server(true);
+    server.p.set_deflate_dictionary("mine", dictionary);
+
+    // a different id is not an error, the dictionary is just not used
+    server.req.replace_header("Sec-WebSocket-Extensions",
+        "permessage-deflate; x_dictionary=theirs");
+    std::pair<websocketpp::lib::error_code,std::string> neg =
+        server.p.negotiate_extensions(server.req);
+    BOOST_REQUIRE( !neg.first );
+    BOOST_CHECK_EQUAL( neg.second, "permessage-deflate" );
+}
+
+BOOST_AUTO_TEST_CASE( extension_chain_negotiation ) {
+    processor_setup_chain env(true);
+
+    env.req.replace_header("Sec-WebSocket-Extensions",
+        "permessage-deflate, x-reverse");
+    std::pair<websocketpp::lib::error_code,std::string> neg =
+        env.p.negotiate_extensions(env.req);
+    BOOST_CHECK( !neg.first );
+    BOOST_CHECK_EQUAL( neg.second, "permessage-deflate, x-reverse" );
+    BOOST_CHECK( env.p.get_extension_chain().get<0>().is_enabled() );
+}
+
+BOOST_AUTO_TEST_CASE( extension_chain_send ) {
+    processor_setup_chain env(true);
+    env.p.get_extension_chain().get<0>().enabled = true;
+
+    message_ptr in = env.msg_manager->get_message();
+    message_ptr out = env.msg_manager->get_message();
+    in->set_opcode(websocketpp::frame::opcode::text);
+    in->set_payload("abc");
+
+    env.ec = env.p.prepare_data_frame(in,out);
+    BOOST_CHECK( !env.ec );
+    BOOST_CHECK_EQUAL( out->get_header(), "\xA1\x03" );
+    BOOST_CHECK_EQUAL( out->get_payload(), "cba" );
+    BOOST_CHECK_EQUAL( in->get_payload(), "abc" );
+}
+
+BOOST_AUTO_TEST_CASE( extension_chain_receive ) {
+    processor_setup_chain env(false);
+    env.p.get_extension_chain().get<0>().enabled = true;
+
+    uint8_t frame[5] = {0xA1, 0x03, 'c', 'b', 'a'};
+    BOOST_CHECK_EQUAL( env.p.consume(frame,5,env.ec), 5 );
+    BOOST_CHECK( !env.ec );
+    BOOST_REQUIRE( env.p.ready() );
+    BOOST_CHECK_EQUAL( env.p.get_message()->get_payload(), "abc" );
+
+    // unmarked messages pass through
+    uint8_t plain[5] = {0x81, 0x03, 'c', 'b', 'a'};
+    BOOST_CHECK_EQUAL( env.p.consume(plain,5,env.ec), 5 );
+    BOOST_CHECK( !env.ec );
+    BOOST_REQUIRE( env.p.ready() );
+    BOOST_CHECK_EQUAL( env.p.get_message()->get_payload(), "cba" );
+}
+
+BOOST_AUTO_TEST_CASE( extension_chain_rsv_not_negotiated ) {
+    processor_setup_chain env(false);
+
+    uint8_t frame[5] = {0xA1, 0x03, 'c', 'b', 'a'};
+    env.p.consume(frame,5,env.ec);
+    BOOST_CHECK_EQUAL( env.ec, websocketpp::processor::error::invalid_rsv_bit );
+}
+
+BOOST_AUTO_TEST_CASE( trusted_link_requires_opt_in ) {
+    processor_setup_ext env(true);
+
+    env.req.replace_header("Sec-WebSocket-Extensions",
+        "x-websocketpp-trusted-link");
+    std::pair<websocketpp::lib::error_code,std::string> neg =
+        env.p.negotiate_extensions(env.req);
+    BOOST_CHECK( !neg.first );
+    BOOST_CHECK_EQUAL( neg.second, "" );
+    BOOST_CHECK( !env.p.is_trusted_link() );
+
+    // unmasked client frames are still refused
+    uint8_t frame[5] = {0x81, 0x03, 'f', 'o', 'o'};
+    env.p.consume(frame,5,env.ec);
+    BOOST_CHECK_EQUAL( env.ec, websocketpp::processor::error::masking_required );
+}
+
+BOOST_AUTO_TEST_CASE( trusted_link_negotiation ) {
+    processor_setup_trusted client(false);
+
+    websocketpp::uri_ptr u(new websocketpp::uri("ws://localhost/"));
+    client.p.client_handshake_request(client.req,u,std::vector<std::string>());
+    std::string offer = client.req.get_header("Sec-WebSocket-Extensions");
+    BOOST_CHECK( offer.find(", x-websocketpp-trusted-link") !=
+        std::string::npos );
+
+    processor_setup_trusted server(true);
+    server.req.replace_header("Sec-WebSocket-Extensions",
+        "x-websocketpp-trusted-link");
+    std::pair<websocketpp::lib::error_code,std::string> neg =
+        server.p.negotiate_extensions(server.req);
+    BOOST_CHECK( !neg.first );
+    BOOST_CHECK_EQUAL( neg.second, "x-websocketpp-trusted-link" );
+    BOOST_CHECK( server.p.is_trusted_link() );
+
+    // a server that did not see the offer stays in RFC 6455 mode
+    processor_setup_trusted plain(true);
+    plain.req.replace_header("Sec-WebSocket-Extensions","permessage-deflate");
+    plain.p.negotiate_extensions(plain.req);
+    BOOST_CHECK( !plain.p.is_trusted_link() );
+}
+
+BOOST_AUTO_TEST_CASE( trusted_link_frames ) {
+    processor_setup_trusted client(false);
+    client.res.replace_header("Sec-WebSocket-Extensions",
+        "x-websocketpp-trusted-link");
+    client.p.negotiate_extensions(client.res);
+    BOOST_REQUIRE( client.p.is_trusted_link() );
+
+    // clients send unmasked frames and do not validate text
+    message_ptr in = client.msg_manager->get_message();
+    message_ptr out = client.msg_manager->get_message();
+    in->set_opcode(websocketpp::frame::opcode::text);
+    in->set_payload("\xC0\xAF");
+    client.ec = client.p.prepare_data_frame(in,out);
+    BOOST_CHECK( !client.ec );
+    BOOST_CHECK_EQUAL( out->get_header(), "\x81\x02" );
+    BOOST_CHECK_EQUAL( out->get_payload(), "\xC0\xAF" );
+
+    // servers accept them as they are
+    processor_setup_trusted server(true);
+    server.req.replace_header("Sec-WebSocket-Extensions",
+        "x-websocketpp-trusted-link");
+    server.p.negotiate_extensions(server.req);
+
+    uint8_t frame[4] = {0x81, 0x02, 0xC0, 0xAF};
+    BOOST_CHECK_EQUAL( server.p.consume(frame,4,server.ec), 4 );
+    BOOST_CHECK( !server.ec );
+    BOOST_REQUIRE( server.p.ready() );
+    BOOST_CHECK_EQUAL( server.p.get_message()->get_payload(), "\xC0\xAF" );
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE chacha
+#include <boost/test/unit_test.hpp>
+
+#include <set>
+
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/random/chacha.hpp>
+#include <websocketpp/concurrency/none.hpp>
+
+// RFC 8439 section 2.3.2
+BOOST_AUTO_TEST_CASE( block_test_vector ) {
+    uint32_t const key[8] = {
+        0x03020100, 0x07060504, 0x0b0a0908, 0x0f0e0d0c,
+        0x13121110, 0x17161514, 0x1b1a1918, 0x1f1e1d1c
+    };
+    uint32_t const nonce[3] = {0x09000000, 0x4a000000, 0x00000000};
+    uint32_t const expected[16] = {
+        0xe4e7f110, 0x15593bd1, 0x1fdd0f50, 0xc47120a3,
+        0xc7f4d1c7, 0x0368c033, 0x9aaa2204, 0x4e6cd4c3,
+        0x466482d2, 0x09aa9f07, 0x05d7c214, 0xa2028bd9,
+        0xd19c12b5, 0xb94e16de, 0xe883d0cb, 0x4e3c50a2
+    };
+
+    uint32_t out[16];
+    websocketpp::random::chacha::detail::block(key, 1, nonce, out);
+    for (int i = 0; i < 16; ++i) {
+        BOOST_CHECK_EQUAL( out[i], expected[i] );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( generates ) {
+    websocketpp::random::chacha::int_generator<uint32_t,
+        websocketpp::concurrency::none> rng;
+
+    // across several refills no values repeat
+    std::set<uint32_t> seen;
+    for (int i = 0; i < 1000; ++i) {
+        seen.insert(rng());
+    }
+    BOOST_CHECK_EQUAL( seen.size(), 1000u );
+
+    websocketpp::random::chacha::int_generator<uint64_t,
+        websocketpp::concurrency::none> rng64;
+    BOOST_CHECK( rng64() != rng64() );
+}
@@ -28,7 +28,10 @@
 #define BOOST_TEST_MODULE client
 #include <boost/test/unit_test.hpp>
 
+#include <cstring>
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include <websocketpp/random/random_device.hpp>
 
@@ -36,6 +39,8 @@
 #include <websocketpp/client.hpp>
 
 #include <websocketpp/http/request.hpp>
+#include <websocketpp/base64/base64.hpp>
+#include <websocketpp/sha1/sha1.hpp>
 
 struct stub_config : public websocketpp::config::core {
     typedef core::concurrency_type concurrency_type;
@@ -95,6 +100,37 @@ BOOST_AUTO_TEST_CASE( get_connection ) {
     BOOST_CHECK_EQUAL( con->get_resource() , "/" );
 }
 
+BOOST_AUTO_TEST_CASE( uri_cache ) {
+    client c;
+    websocketpp::lib::error_code ec;
+
+    // without the cache each connection gets its own uri
+    connection_ptr con1 = c.get_connection("ws://localhost:9000/", ec);
+    connection_ptr con2 = c.get_connection("ws://localhost:9000/", ec);
+    BOOST_CHECK( con1->get_uri() != con2->get_uri() );
+
+    c.set_uri_cache_size(1);
+    con1 = c.get_connection("ws://localhost:9000/", ec);
+    con2 = c.get_connection("ws://localhost:9000/", ec);
+    BOOST_CHECK( !ec );
+    BOOST_CHECK_EQUAL( con1->get_uri(), con2->get_uri() );
+    BOOST_CHECK_EQUAL( con2->get_port(), 9000 );
+
+    // the oldest entry makes room for a new one
+    connection_ptr con3 = c.get_connection("ws://localhost:9001/", ec);
+    connection_ptr con4 = c.get_connection("ws://localhost:9000/", ec);
+    BOOST_CHECK( con4->get_uri() != con1->get_uri() );
+
+    // invalid URIs still fail
+    c.get_connection("foo", ec);
+    BOOST_CHECK_EQUAL( ec, websocketpp::error::make_error_code(
+        websocketpp::error::invalid_uri) );
+
+    c.clear_uri_cache();
+    con1 = c.get_connection("ws://localhost:9000/", ec);
+    BOOST_CHECK( con1->get_uri() != con4->get_uri() );
+}
+
 BOOST_AUTO_TEST_CASE( connect_con ) {
     client c;
     websocketpp::lib::error_code ec;
@@ -196,3 +232,545 @@ BOOST_AUTO_TEST_CASE( add_subprotocols ) {
 }
 
 
+
+BOOST_AUTO_TEST_CASE( request_templates ) {
+    client c;
+    websocketpp::lib::error_code ec;
+    c.set_request_templates(4);
+
+    std::vector<std::string> out(4);
+    std::vector<connection_ptr> cons;
+    websocketpp::http::parser::request r[4];
+    for (size_t i = 0; i < 4; ++i) {
+        std::stringstream s;
+        c.register_ostream(&s);
+        connection_ptr con = c.get_connection("ws://localhost:9000/chat",
+            ec);
+        BOOST_REQUIRE( !ec );
+        if (i == 3) {
+            con->append_header("Authorization", "token");
+        }
+        c.connect(con);
+        cons.push_back(con);
+
+        out[i] = s.str();
+        r[i].consume(out[i].data(),out[i].size(),ec);
+        BOOST_CHECK( !ec );
+        BOOST_CHECK( r[i].ready() );
+    }
+
+    // the second and third request are written from the first one's template
+    BOOST_CHECK_EQUAL( c.get_request_templates()->size(), 1u );
+    for (size_t i = 1; i < 3; ++i) {
+        std::string const key = r[i].get_header("Sec-WebSocket-Key");
+        BOOST_CHECK_EQUAL( key.size(), 24u );
+        BOOST_CHECK_NE( key, r[0].get_header("Sec-WebSocket-Key") );
+        BOOST_CHECK_EQUAL( cons[i]->get_request_header("Sec-WebSocket-Key"),
+            key );
+        BOOST_CHECK_EQUAL( cons[i]->get_request_header("Host"),
+            "localhost:9000" );
+
+        std::string expected = out[0];
+        size_t const slot = expected.find(r[0].get_header(
+            "Sec-WebSocket-Key"));
+        expected.replace(slot, 24, key);
+        BOOST_CHECK_EQUAL( out[i], expected );
+    }
+
+    // requests with added headers are built
+    BOOST_CHECK_EQUAL( r[3].get_header("Authorization"), "token" );
+
+    // the accept key is checked against the templated request's key
+    std::string const key = r[1].get_header("Sec-WebSocket-Key") +
+        "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    unsigned char digest[20];
+    websocketpp::sha1::calc(key.data(), key.size(), digest);
+
+    std::string res = "HTTP/1.1 101 Switching Protocols\r\n"
+        "Connection: Upgrade\r\nUpgrade: websocket\r\n"
+        "Sec-WebSocket-Accept: " + websocketpp::base64_encode(digest, 20) +
+        "\r\n\r\n";
+    cons[1]->read_all(res.data(), res.size());
+    BOOST_CHECK_EQUAL( cons[1]->get_state(),
+        websocketpp::session::state::open );
+
+    // a wrong one fails the handshake
+    cons[2]->read_all(res.data(), res.size());
+    BOOST_CHECK_NE( cons[2]->get_state(),
+        websocketpp::session::state::open );
+}
+
+BOOST_AUTO_TEST_CASE( http_connection_pool ) {
+    client c;
+    websocketpp::lib::error_code ec;
+    std::stringstream out;
+    std::vector<std::string> bodies;
+
+    c.register_ostream(&out);
+    c.set_http_pool_size(1);
+    c.set_http_handler([&](websocketpp::connection_hdl hdl) {
+        bodies.push_back(c.get_con_from_hdl(hdl)->get_response().get_body());
+    });
+
+    std::string const ok = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nhi";
+
+    connection_ptr con = c.get_connection("http://localhost/a", ec);
+    BOOST_CHECK_EQUAL(ec, websocketpp::lib::error_code());
+    c.connect(con);
+    BOOST_CHECK_NE( out.str().find("GET /a HTTP/1.1"), std::string::npos );
+
+    con->read_some(ok.data(), ok.size());
+    BOOST_REQUIRE_EQUAL( bodies.size(), 1u );
+    BOOST_CHECK_EQUAL( bodies[0], "hi" );
+    BOOST_CHECK( con->is_http_idle() );
+
+    // the second request to the same host reuses the idle connection
+    out.str("");
+    connection_ptr con2 = c.get_connection("http://localhost/b", ec);
+    BOOST_CHECK_EQUAL(ec, websocketpp::lib::error_code());
+    BOOST_CHECK( con2 == con );
+    BOOST_CHECK( con2->is_http_reused() );
+    c.connect(con2);
+    BOOST_CHECK_NE( out.str().find("GET /b HTTP/1.1"), std::string::npos );
+
+    std::string const close =
+        "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 3\r\n\r\nbye";
+    con2->read_some(close.data(), close.size());
+    BOOST_REQUIRE_EQUAL( bodies.size(), 2u );
+    BOOST_CHECK_EQUAL( bodies[1], "bye" );
+    BOOST_CHECK( !con2->is_http_idle() );
+
+    // the server asked to close the connection, so it is not reused
+    connection_ptr con3 = c.get_connection("http://localhost/c", ec);
+    BOOST_CHECK_EQUAL(ec, websocketpp::lib::error_code());
+    BOOST_CHECK( con3 != con );
+    BOOST_CHECK( !con3->is_http_reused() );
+}
+
+BOOST_AUTO_TEST_CASE( http_redirect_same_origin ) {
+    client c;
+    websocketpp::lib::error_code ec;
+    std::stringstream out;
+    std::vector<std::string> bodies;
+
+    c.register_ostream(&out);
+    c.set_max_redirects(2);
+    c.set_redirect_cache_size(4);
+    c.set_http_handler([&](websocketpp::connection_hdl hdl) {
+        bodies.push_back(c.get_con_from_hdl(hdl)->get_response().get_body());
+    });
+
+    connection_ptr con = c.get_connection("http://localhost/a", ec);
+    BOOST_CHECK_EQUAL(ec, websocketpp::lib::error_code());
+    c.connect(con);
+
+    // the redirect is followed on the same connection
+    out.str("");
+    std::string const moved = "HTTP/1.1 301 Moved Permanently\r\n"
+        "Location: http://localhost/b\r\nContent-Length: 5\r\n\r\nmoved";
+    con->read_some(moved.data(), moved.size());
+    BOOST_CHECK( bodies.empty() );
+    BOOST_CHECK_NE( out.str().find("GET /b HTTP/1.1"), std::string::npos );
+
+    std::string const ok = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nhi";
+    con->read_some(ok.data(), ok.size());
+    BOOST_REQUIRE_EQUAL( bodies.size(), 1u );
+    BOOST_CHECK_EQUAL( bodies[0], "hi" );
+
+    // the permanent redirect is remembered
+    connection_ptr con2 = c.get_connection("http://localhost/a", ec);
+    BOOST_CHECK_EQUAL(ec, websocketpp::lib::error_code());
+    BOOST_CHECK_EQUAL( con2->get_uri()->str(), "http://localhost/b" );
+
+    c.clear_redirect_cache();
+    connection_ptr con3 = c.get_connection("http://localhost/a", ec);
+    BOOST_CHECK_EQUAL( con3->get_uri()->str(), "http://localhost/a" );
+}
+
+BOOST_AUTO_TEST_CASE( http_redirect_other_origin ) {
+    client c;
+    websocketpp::lib::error_code ec;
+    std::stringstream out;
+
+    c.register_ostream(&out);
+    c.set_max_redirects(1);
+
+    connection_ptr con = c.get_connection("http://localhost/a", ec);
+    BOOST_CHECK_EQUAL(ec, websocketpp::lib::error_code());
+    c.connect(con);
+
+    // the request continues on a connection to the other host
+    out.str("");
+    std::string const found = "HTTP/1.1 302 Found\r\n"
+        "Location: http://example.com/c\r\nContent-Length: 0\r\n\r\n";
+    con->read_some(found.data(), found.size());
+
+    std::string const o = out.str();
+    BOOST_CHECK_NE( o.find("GET /c HTTP/1.1"), std::string::npos );
+    BOOST_CHECK_NE( o.find("Host: example.com"), std::string::npos );
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::closed );
+}
+
+BOOST_AUTO_TEST_CASE( http_conditional_cache ) {
+    client c;
+    websocketpp::lib::error_code ec;
+    std::stringstream out;
+    std::vector<std::string> results;
+
+    websocketpp::http::conditional_cache::ptr cache =
+        websocketpp::lib::make_shared<websocketpp::http::conditional_cache>(4);
+    c.register_ostream(&out);
+    c.set_http_cache(cache);
+    c.set_http_handler([&](websocketpp::connection_hdl hdl) {
+        client::connection_type::response_type const & res =
+            c.get_con_from_hdl(hdl)->get_response();
+        results.push_back(std::to_string(res.get_status_code()) + " " +
+            res.get_header("X-Version") + " " + res.get_body());
+    });
+
+    connection_ptr con = c.get_connection("http://localhost/config", ec);
+    BOOST_CHECK_EQUAL(ec, websocketpp::lib::error_code());
+    c.connect(con);
+    BOOST_CHECK_EQUAL( out.str().find("If-None-Match"), std::string::npos );
+
+    std::string const ok = "HTTP/1.1 200 OK\r\nETag: \"v1\"\r\n"
+        "Last-Modified: Thu, 15 Oct 2026 10:00:00 GMT\r\nX-Version: 1\r\n"
+        "Content-Length: 6\r\n\r\nconfig";
+    con->read_some(ok.data(), ok.size());
+    BOOST_REQUIRE_EQUAL( results.size(), 1u );
+    BOOST_CHECK_EQUAL( results[0], "200 1 config" );
+    BOOST_CHECK_EQUAL( cache->size(), 1u );
+
+    // the next poll sends the validators and gets the body from the cache
+    out.str("");
+    con = c.get_connection("http://localhost/config", ec);
+    c.connect(con);
+    std::string const o = out.str();
+    BOOST_CHECK_NE( o.find("If-None-Match: \"v1\""), std::string::npos );
+    BOOST_CHECK_NE( o.find("If-Modified-Since: Thu, 15 Oct 2026 10:00:00 GMT"),
+        std::string::npos );
+
+    std::string const not_modified = "HTTP/1.1 304 Not Modified\r\n"
+        "ETag: \"v1\"\r\nX-Version: 2\r\nContent-Length: 0\r\n\r\n";
+    con->read_some(not_modified.data(), not_modified.size());
+    BOOST_REQUIRE_EQUAL( results.size(), 2u );
+    BOOST_CHECK_EQUAL( results[1], "200 2 config" );
+
+    // validators set by the application are left alone
+    out.str("");
+    con = c.get_connection("http://localhost/config", ec);
+    con->append_header("If-None-Match", "\"v0\"");
+    c.connect(con);
+    BOOST_CHECK_EQUAL( out.str().find("If-Modified-Since"), std::string::npos );
+    con->read_some(not_modified.data(), not_modified.size());
+    BOOST_REQUIRE_EQUAL( results.size(), 3u );
+    BOOST_CHECK_EQUAL( results[2], "304 2 " );
+
+    // a response that must not be stored replaces the stored one
+    con = c.get_connection("http://localhost/config", ec);
+    c.connect(con);
+    std::string const no_store = "HTTP/1.1 200 OK\r\nETag: \"v3\"\r\n"
+        "Cache-Control: no-store\r\nContent-Length: 3\r\n\r\nnew";
+    con->read_some(no_store.data(), no_store.size());
+    BOOST_REQUIRE_EQUAL( results.size(), 4u );
+    BOOST_CHECK_EQUAL( results[3], "200  new" );
+    BOOST_CHECK_EQUAL( cache->size(), 0u );
+}
+
+struct ranged_server {
+    ranged_server(client & c, std::string const & body)
+      : c(c), body(body) {}
+
+    client & c;
+    std::string body;
+    std::vector<std::pair<websocketpp::connection_hdl, std::string> > requests;
+
+    websocketpp::lib::error_code on_write(websocketpp::connection_hdl hdl,
+        char const * data, size_t len)
+    {
+        requests.push_back(std::make_pair(hdl, std::string(data, len)));
+        return websocketpp::lib::error_code();
+    }
+
+    // answer request i with the range it asked for
+    void respond(size_t i) {
+        std::string const & req = requests[i].second;
+        size_t const r = req.find("Range: bytes=");
+        BOOST_REQUIRE_NE( r, std::string::npos );
+        size_t first = std::stoul(req.substr(r + 13));
+        size_t last = std::stoul(req.substr(req.find('-', r) + 1));
+        last = std::min(last, body.size() - 1);
+
+        std::string const res = "HTTP/1.1 206 Partial Content\r\n"
+            "Content-Range: bytes " + std::to_string(first) + "-" +
+            std::to_string(last) + "/" + std::to_string(body.size()) +
+            "\r\nContent-Length: " + std::to_string(last - first + 1) +
+            "\r\n\r\n" + body.substr(first, last - first + 1);
+        c.get_con_from_hdl(requests[i].first)->read_some(res.data(),
+            res.size());
+    }
+};
+
+BOOST_AUTO_TEST_CASE( http_ranged_download ) {
+    client c;
+    websocketpp::lib::error_code ec;
+    ranged_server server(c, "abcdefghijklmnopqrst");
+    c.set_write_handler(websocketpp::lib::bind(&ranged_server::on_write,
+        &server, websocketpp::lib::placeholders::_1,
+        websocketpp::lib::placeholders::_2,
+        websocketpp::lib::placeholders::_3));
+    c.set_download_parts(3);
+    c.set_download_part_size(4);
+
+    std::string file(20, ' ');
+    websocketpp::http::body_sink::ptr sink =
+        websocketpp::lib::make_shared<websocketpp::http::buffer_sink>(
+        &file[0], file.size());
+
+    int done = 0;
+    websocketpp::lib::error_code done_ec;
+    std::vector<std::pair<size_t, size_t> > progress;
+    c.download("http://localhost/f", sink,
+        [&](websocketpp::lib::error_code const & e) { ++done; done_ec = e; },
+        [&](size_t received, size_t total) {
+            progress.push_back(std::make_pair(received, total));
+        }, ec);
+    BOOST_CHECK_EQUAL( ec, websocketpp::lib::error_code() );
+
+    BOOST_REQUIRE_EQUAL( server.requests.size(), 1u );
+    BOOST_CHECK_NE( server.requests[0].second.find("Range: bytes=0-3\r\n"),
+        std::string::npos );
+    BOOST_CHECK_NE( server.requests[0].second.find(
+        "Accept-Encoding: identity\r\n"), std::string::npos );
+
+    // the size of the body is known from the first response, the other 16
+    // bytes are split over the remaining two parts
+    server.respond(0);
+    BOOST_REQUIRE_EQUAL( server.requests.size(), 3u );
+    BOOST_CHECK_NE( server.requests[1].second.find("Range: bytes=4-11\r\n"),
+        std::string::npos );
+    BOOST_CHECK_NE( server.requests[2].second.find("Range: bytes=12-19\r\n"),
+        std::string::npos );
+    BOOST_CHECK_EQUAL( done, 0 );
+
+    server.respond(2);
+    server.respond(1);
+    BOOST_CHECK_EQUAL( done, 1 );
+    BOOST_CHECK_EQUAL( done_ec, websocketpp::lib::error_code() );
+    BOOST_CHECK_EQUAL( file, server.body );
+    BOOST_REQUIRE( !progress.empty() );
+    BOOST_CHECK( progress.back() == std::make_pair(size_t(20), size_t(20)) );
+}
+
+BOOST_AUTO_TEST_CASE( http_ranged_download_without_range_support ) {
+    client c;
+    websocketpp::lib::error_code ec;
+    ranged_server server(c, "");
+    c.set_write_handler(websocketpp::lib::bind(&ranged_server::on_write,
+        &server, websocketpp::lib::placeholders::_1,
+        websocketpp::lib::placeholders::_2,
+        websocketpp::lib::placeholders::_3));
+    c.set_download_part_size(4);
+
+    std::string file(8, ' ');
+    int done = 0;
+    websocketpp::lib::error_code done_ec;
+    c.download("http://localhost/f",
+        websocketpp::lib::make_shared<websocketpp::http::buffer_sink>(
+        &file[0], file.size()),
+        [&](websocketpp::lib::error_code const & e) { ++done; done_ec = e; },
+        client::download_progress_handler(), ec);
+    BOOST_REQUIRE_EQUAL( server.requests.size(), 1u );
+
+    // the whole body comes with the first response
+    std::string const ok = "HTTP/1.1 200 OK\r\nContent-Length: 8\r\n\r\n"
+        "12345678";
+    c.get_con_from_hdl(server.requests[0].first)->read_some(ok.data(),
+        ok.size());
+    BOOST_CHECK_EQUAL( server.requests.size(), 1u );
+    BOOST_CHECK_EQUAL( done, 1 );
+    BOOST_CHECK_EQUAL( done_ec, websocketpp::lib::error_code() );
+    BOOST_CHECK_EQUAL( file, "12345678" );
+}
+
+BOOST_AUTO_TEST_CASE( http_ranged_download_wrong_range ) {
+    client c;
+    websocketpp::lib::error_code ec;
+    ranged_server server(c, "abcdefghijkl");
+    c.set_write_handler(websocketpp::lib::bind(&ranged_server::on_write,
+        &server, websocketpp::lib::placeholders::_1,
+        websocketpp::lib::placeholders::_2,
+        websocketpp::lib::placeholders::_3));
+    c.set_download_parts(2);
+    c.set_download_part_size(4);
+
+    std::string file(12, ' ');
+    int done = 0;
+    websocketpp::lib::error_code done_ec;
+    c.download("http://localhost/f",
+        websocketpp::lib::make_shared<websocketpp::http::buffer_sink>(
+        &file[0], file.size()),
+        [&](websocketpp::lib::error_code const & e) { ++done; done_ec = e; },
+        client::download_progress_handler(), ec);
+    server.respond(0);
+    BOOST_REQUIRE_EQUAL( server.requests.size(), 2u );
+
+    // the second part answers with the start of the body instead
+    std::string const wrong = "HTTP/1.1 206 Partial Content\r\n"
+        "Content-Range: bytes 0-7/12\r\nContent-Length: 8\r\n\r\nabcdefgh";
+    c.get_con_from_hdl(server.requests[1].first)->read_some(wrong.data(),
+        wrong.size());
+    BOOST_CHECK_EQUAL( done, 1 );
+    BOOST_CHECK_EQUAL( done_ec, websocketpp::http::error::make_error_code(
+        websocketpp::http::error::range_not_satisfied) );
+}
+
+BOOST_AUTO_TEST_CASE( http_request_body_source ) {
+    client c;
+    websocketpp::lib::error_code ec;
+    std::stringstream out;
+    c.register_ostream(&out);
+
+    // larger than one part, so it is read and written in several
+    std::string body;
+    for (size_t i = 0; i < 150000; ++i) {
+        body += char('a' + i % 26);
+    }
+
+    connection_ptr con = c.get_connection("http://localhost/up", ec);
+    BOOST_REQUIRE( con );
+    websocketpp::http::parser::request req;
+    req.set_method("PUT");
+    con->set_request(req, ec);
+    con->set_request_body_source(
+        websocketpp::lib::make_shared<websocketpp::http::buffer_source>(
+        body.data(), body.size()));
+
+    bool answered = false;
+    con->set_http_handler([&](websocketpp::connection_hdl) {
+        answered = true;
+    });
+    c.connect(con);
+
+    std::string const o = out.str();
+    size_t const head = o.find("\r\n\r\n");
+    BOOST_REQUIRE_NE( head, std::string::npos );
+    BOOST_CHECK_EQUAL( o.compare(0, 14, "PUT /up HTTP/1"), 0 );
+    BOOST_CHECK_NE( o.find("Content-Length: 150000\r\n"), std::string::npos );
+    BOOST_CHECK_EQUAL( o.find("Transfer-Encoding"), std::string::npos );
+    BOOST_CHECK( o.substr(head + 4) == body );
+
+    std::string const ok = "HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n";
+    con->read_some(ok.data(), ok.size());
+    BOOST_CHECK( answered );
+    BOOST_CHECK_EQUAL( con->get_response().get_status_code(),
+        websocketpp::http::status_code::created );
+}
+
+BOOST_AUTO_TEST_CASE( http_request_body_source_chunked ) {
+    client c;
+    websocketpp::lib::error_code ec;
+    std::stringstream out;
+    c.register_ostream(&out);
+
+    std::vector<std::string> parts = { "hello", std::string(20, 'x'), "!" };
+    size_t next = 0;
+    websocketpp::http::body_source::ptr source =
+        websocketpp::lib::make_shared<websocketpp::http::handler_source>(
+        [&](char * buf, size_t len, size_t & read) {
+            read = 0;
+            if (next < parts.size()) {
+                BOOST_REQUIRE_GE( len, parts[next].size() );
+                std::memcpy(buf, parts[next].data(), parts[next].size());
+                read = parts[next++].size();
+            }
+            return websocketpp::lib::error_code();
+        });
+
+    connection_ptr con = c.get_connection("http://localhost/up", ec);
+    BOOST_REQUIRE( con );
+    con->set_request_body_source(source);
+    c.connect(con);
+
+    // the length is not known, so the body is sent chunked
+    std::string const o = out.str();
+    BOOST_CHECK_NE( o.find("Transfer-Encoding: chunked\r\n"),
+        std::string::npos );
+    BOOST_CHECK_EQUAL( o.find("Content-Length"), std::string::npos );
+    BOOST_CHECK_EQUAL( o.substr(o.find("\r\n\r\n") + 4),
+        "5\r\nhello\r\n14\r\n" + parts[1] + "\r\n1\r\n!\r\n0\r\n\r\n" );
+}
+
+BOOST_AUTO_TEST_CASE( http_request_body_source_short ) {
+    client c;
+    websocketpp::lib::error_code ec;
+    std::stringstream out;
+    c.register_ostream(&out);
+
+    // announces 10 bytes but ends after 4
+    std::string const data = "abcd";
+    size_t sent = 0;
+    websocketpp::http::body_source::ptr source =
+        websocketpp::lib::make_shared<websocketpp::http::handler_source>(
+        [&](char * buf, size_t len, size_t & read) {
+            read = std::min(len, data.size() - sent);
+            std::memcpy(buf, data.data() + sent, read);
+            sent += read;
+            return websocketpp::lib::error_code();
+        }, 10);
+
+    connection_ptr con = c.get_connection("http://localhost/up", ec);
+    BOOST_REQUIRE( con );
+    con->set_request_body_source(source);
+    c.connect(con);
+
+    BOOST_CHECK_EQUAL( con->get_ec(), websocketpp::http::error::make_error_code(
+        websocketpp::http::error::incomplete_request) );
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::closed );
+}
+
+#if WEBSOCKETPP_WITH_GZIP
+BOOST_AUTO_TEST_CASE( http_request_body_source_gzip ) {
+    client c;
+    websocketpp::lib::error_code ec;
+    std::stringstream out;
+    c.register_ostream(&out);
+
+    std::string body;
+    for (int i = 0; i < 20000; i++) {
+        body += "line " + std::to_string(i) + "\n";
+    }
+
+    connection_ptr con = c.get_connection("http://localhost/up", ec);
+    BOOST_REQUIRE( con );
+    con->set_request_body_source(
+        websocketpp::lib::make_shared<websocketpp::http::buffer_source>(
+        body.data(), body.size()),
+        websocketpp::http::content_encoding::gzip);
+    c.connect(con);
+
+    // compressed as it is sent, so the length is not known up front
+    std::string const o = out.str();
+    BOOST_CHECK_NE( o.find("Content-Encoding: gzip\r\n"), std::string::npos );
+    BOOST_CHECK_NE( o.find("Transfer-Encoding: chunked\r\n"),
+        std::string::npos );
+    BOOST_CHECK_LT( o.size(), body.size() );
+
+    std::string encoded;
+    size_t pos = o.find("\r\n\r\n") + 4;
+    for (;;) {
+        size_t const line = o.find("\r\n", pos);
+        BOOST_REQUIRE_NE( line, std::string::npos );
+        size_t const len = std::stoul(o.substr(pos, line - pos), NULL, 16);
+        if (len == 0) {
+            break;
+        }
+        encoded += o.substr(line + 2, len);
+        pos = line + 2 + len + 2;
+    }
+    BOOST_CHECK( websocketpp::encoding::decompress(
+        websocketpp::http::content_encoding::gzip, false, encoded, ec) ==
+        body );
+    BOOST_CHECK_EQUAL( ec, websocketpp::lib::error_code() );
+}
+#endif
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+//#define BOOST_TEST_DYN_LINK
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE client_ramp
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+
+#include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/config/asio_no_tls_client.hpp>
+
+#include <websocketpp/client_ramp.hpp>
+#include <websocketpp/server.hpp>
+
+typedef websocketpp::client_ramp<websocketpp::config::asio_client> ramp;
+typedef websocketpp::server<websocketpp::config::asio> server;
+
+typedef websocketpp::latency_histogram::duration usec;
+
+using websocketpp::lib::placeholders::_1;
+using websocketpp::lib::placeholders::_2;
+using websocketpp::lib::bind;
+
+BOOST_AUTO_TEST_CASE( histogram ) {
+    websocketpp::latency_histogram h;
+    BOOST_CHECK_EQUAL( h.count(), 0 );
+    BOOST_CHECK( h.percentile(50) == usec(0) );
+
+    for (long i = 1; i <= 1000; ++i) {
+        h.record(usec(i));
+    }
+
+    BOOST_CHECK_EQUAL( h.count(), 1000 );
+    BOOST_CHECK( h.min() == usec(1) );
+    BOOST_CHECK( h.max() == usec(1000) );
+    BOOST_CHECK( h.mean() == usec(500) );
+    BOOST_CHECK( h.percentile(0) == usec(1) );
+    BOOST_CHECK( h.percentile(100) == usec(1000) );
+
+    // percentiles are within one bucket, 12.5%, of the exact value
+    BOOST_CHECK( h.percentile(50) >= usec(500) );
+    BOOST_CHECK( h.percentile(50) <= usec(563) );
+    BOOST_CHECK( h.percentile(99) >= usec(990) );
+
+    websocketpp::latency_histogram o;
+    o.record(usec(-5));
+    o.record(usec(5000));
+    h.merge(o);
+
+    BOOST_CHECK_EQUAL( h.count(), 1002 );
+    BOOST_CHECK( h.min() == usec(0) );
+    BOOST_CHECK( h.max() == usec(5000) );
+}
+
+BOOST_AUTO_TEST_CASE( atomic_histogram ) {
+    websocketpp::atomic_histogram h;
+    BOOST_CHECK_EQUAL( h.snapshot().count(), 0 );
+    BOOST_CHECK( h.snapshot().min() == usec(0) );
+
+    for (long i = 1; i <= 1000; ++i) {
+        h.record(usec(i));
+    }
+
+    websocketpp::latency_histogram s = h.snapshot();
+    BOOST_CHECK_EQUAL( s.count(), 1000 );
+    BOOST_CHECK( s.min() == usec(1) );
+    BOOST_CHECK( s.max() == usec(1000) );
+    BOOST_CHECK( s.mean() == usec(500) );
+    BOOST_CHECK( s.percentile(50) >= usec(500) );
+    BOOST_CHECK( s.percentile(50) <= usec(563) );
+}
+
+BOOST_AUTO_TEST_CASE( start_without_targets ) {
+    ramp r(2);
+    r.init_asio();
+
+    websocketpp::lib::error_code ec;
+    r.start(10, ec);
+    BOOST_CHECK_EQUAL( ec,
+        websocketpp::error::make_error_code(websocketpp::error::invalid_uri) );
+}
+
+void run_server(server * s) {
+    s->run();
+}
+
+void count_open(size_t * opened, size_t, websocketpp::connection_hdl) {
+    ++*opened;
+}
+
+BOOST_AUTO_TEST_CASE( ramp_up ) {
+    server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.init_asio();
+    s.set_reuse_addr(true);
+    s.listen(websocketpp::lib::asio::ip::tcp::v4(), 9113);
+    s.start_accept();
+
+    websocketpp::lib::thread sthread(bind(&run_server,&s));
+
+    ramp r(2);
+    for (size_t i = 0; i < r.size(); ++i) {
+        r.get_shard(i).clear_access_channels(websocketpp::log::alevel::all);
+        r.get_shard(i).clear_error_channels(websocketpp::log::elevel::all);
+    }
+
+    size_t opened = 0;
+    r.init_asio();
+    r.add_target("ws://localhost:9113");
+    r.set_rate(500);
+    r.set_max_pending(4);
+    r.set_open_handler(bind(&count_open,&opened,::_1,::_2));
+    r.set_done_handler(bind(&ramp::stop,&r));
+
+    websocketpp::lib::chrono::steady_clock::time_point start =
+        websocketpp::lib::chrono::steady_clock::now();
+    r.start(20);
+    r.run();
+    websocketpp::lib::chrono::steady_clock::duration elapsed =
+        websocketpp::lib::chrono::steady_clock::now() - start;
+
+    s.stop();
+    sthread.join();
+
+    websocketpp::ramp_stats stats = r.get_stats();
+    BOOST_CHECK_EQUAL( stats.opened, 20 );
+    BOOST_CHECK_EQUAL( stats.failed, 0 );
+    BOOST_CHECK_EQUAL( opened, 20 );
+    BOOST_CHECK_EQUAL( stats.dns.count(), 20 );
+    BOOST_CHECK_EQUAL( stats.tcp.count(), 20 );
+    BOOST_CHECK_EQUAL( stats.tls.count(), 0 );
+    BOOST_CHECK_EQUAL( stats.upgrade.count(), 20 );
+    BOOST_CHECK( stats.total.max() >= stats.upgrade.max() );
+
+    // each shard starts its 10 connections 4ms apart
+    BOOST_CHECK( elapsed >= websocketpp::lib::chrono::milliseconds(30) );
+
+    // a second ramp may start once the first one finished
+    websocketpp::lib::error_code ec;
+    r.start(0, ec);
+    BOOST_CHECK( !ec );
+}
+
+BOOST_AUTO_TEST_CASE( ramp_failures ) {
+    ramp r(2);
+    for (size_t i = 0; i < r.size(); ++i) {
+        r.get_shard(i).clear_access_channels(websocketpp::log::alevel::all);
+        r.get_shard(i).clear_error_channels(websocketpp::log::elevel::all);
+    }
+
+    r.init_asio();
+    r.add_target("ws://localhost:9114");
+    r.set_done_handler(bind(&ramp::stop,&r));
+    r.start(5);
+    r.run();
+
+    websocketpp::ramp_stats stats = r.get_stats();
+    BOOST_CHECK_EQUAL( stats.opened, 0 );
+    BOOST_CHECK_EQUAL( stats.failed, 5 );
+}
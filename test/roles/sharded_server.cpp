@@ -0,0 +1,586 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE sharded_server
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <websocketpp/config/asio_shard.hpp>
+#include <websocketpp/config/asio_no_tls_client.hpp>
+
+#include <websocketpp/sharded_server.hpp>
+#include <websocketpp/client.hpp>
+#include <websocketpp/trace/hook.hpp>
+
+struct traced_client_config : public websocketpp::config::asio_client {
+    typedef websocketpp::trace::hook trace_type;
+};
+
+typedef websocketpp::sharded_server<websocketpp::config::asio_shard> server;
+typedef websocketpp::client<websocketpp::config::asio_client> client;
+typedef websocketpp::client<traced_client_config> traced_client;
+
+using websocketpp::lib::placeholders::_1;
+using websocketpp::lib::placeholders::_2;
+using websocketpp::lib::placeholders::_3;
+using websocketpp::lib::placeholders::_4;
+using websocketpp::lib::bind;
+
+BOOST_AUTO_TEST_CASE( construct ) {
+    server s(3);
+    BOOST_CHECK_EQUAL( s.size(), 3 );
+
+    server d;
+    BOOST_CHECK( d.size() >= 1 );
+}
+
+BOOST_AUTO_TEST_CASE( post_expired_handle ) {
+    server s(2);
+    s.init_asio();
+
+    websocketpp::connection_hdl hdl;
+    BOOST_CHECK_EQUAL( s.post(hdl, websocketpp::lib::function<void()>()),
+        websocketpp::error::make_error_code(websocketpp::error::bad_connection) );
+    BOOST_CHECK_EQUAL( s.send(hdl, "foo", websocketpp::frame::opcode::text),
+        websocketpp::error::make_error_code(websocketpp::error::bad_connection) );
+}
+
+void record_thread(websocketpp::lib::mutex * lock,
+    std::set<std::thread::id> * threads, size_t * count, bool slow)
+{
+    if (slow) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(*lock);
+    threads->insert(std::this_thread::get_id());
+    ++*count;
+}
+
+BOOST_AUTO_TEST_CASE( post_any_spreads_work ) {
+    server s(3);
+    s.init_asio();
+
+    websocketpp::lib::mutex lock;
+    std::set<std::thread::id> threads;
+    size_t count = 0;
+
+    // the shard running the slow handler is skipped by the rest
+    s.post_any(bind(&record_thread, &lock, &threads, &count, true));
+    for (int i = 0; i < 99; ++i) {
+        s.post_any(bind(&record_thread, &lock, &threads, &count, false));
+    }
+    s.run();
+
+    BOOST_CHECK_EQUAL( count, 100 );
+    BOOST_CHECK( threads.size() >= 2 );
+}
+
+#ifdef __linux__
+void record_cpu(websocketpp::lib::mutex * lock, std::set<int> * cpus) {
+    websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(*lock);
+    cpus->insert(sched_getcpu());
+}
+
+BOOST_AUTO_TEST_CASE( cpu_affinity ) {
+    // run pins the calling thread too, restored at the end
+    cpu_set_t saved;
+    BOOST_REQUIRE_EQUAL( sched_getaffinity(0, sizeof(saved), &saved), 0 );
+    int cpu = 0;
+    while (!CPU_ISSET(cpu, &saved)) {
+        ++cpu;
+    }
+
+    server s(2);
+    s.init_asio();
+    s.set_cpu_affinity(std::vector<int>(1, cpu));
+
+    websocketpp::lib::mutex lock;
+    std::set<int> cpus;
+    for (int i = 0; i < 20; ++i) {
+        s.post_any(bind(&record_cpu, &lock, &cpus));
+    }
+    s.run();
+    sched_setaffinity(0, sizeof(saved), &saved);
+
+    BOOST_REQUIRE_EQUAL( cpus.size(), 1u );
+    BOOST_CHECK_EQUAL( *cpus.begin(), cpu );
+
+    // the listening sockets prefer connections arriving on that CPU
+    server l(2);
+    l.init_asio();
+    l.set_cpu_affinity(std::vector<int>(1, cpu));
+    websocketpp::lib::error_code ec;
+    l.listen(9122, ec);
+    BOOST_CHECK( !ec );
+}
+#endif
+
+void echo_from_any_thread(server * s, websocketpp::connection_hdl hdl,
+    server::message_ptr msg)
+{
+    BOOST_CHECK( !s->send(hdl, msg->get_payload(), msg->get_opcode()) );
+}
+
+void stop_on_close(server * s, websocketpp::connection_hdl) {
+    s->stop();
+}
+
+void send_on_open(client * c, websocketpp::connection_hdl hdl) {
+    c->send(hdl, std::string("foo"), websocketpp::frame::opcode::text);
+}
+
+void close_on_message(client * c, std::string * out,
+    websocketpp::connection_hdl hdl, client::message_ptr msg)
+{
+    *out = msg->get_payload();
+    c->close(hdl, websocketpp::close::status::normal, "");
+}
+
+void run_server(server * s) {
+    s->run();
+}
+
+void count_sent(size_t * sent, websocketpp::connection_hdl,
+    client::message_ptr, websocketpp::latency_histogram::duration queued,
+    websocketpp::latency_histogram::duration written)
+{
+    BOOST_CHECK( queued.count() >= 0 );
+    BOOST_CHECK( written.count() >= 0 );
+    ++*sent;
+}
+
+void record_event(websocketpp::lib::mutex * lock,
+    std::vector<websocketpp::log::connection_event> * events,
+    websocketpp::log::connection_event const & e)
+{
+    websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(*lock);
+    events->push_back(e);
+}
+
+BOOST_AUTO_TEST_CASE( echo ) {
+    server s(2);
+    client c;
+    websocketpp::lib::mutex events_lock;
+    std::vector<websocketpp::log::connection_event> events;
+
+    for (size_t i = 0; i < s.size(); ++i) {
+        server::shard_type & shard = s.get_shard(i);
+        shard.clear_access_channels(websocketpp::log::alevel::all);
+        shard.clear_error_channels(websocketpp::log::elevel::all);
+        shard.set_message_handler(bind(&echo_from_any_thread,&s,::_1,::_2));
+        shard.set_close_handler(bind(&stop_on_close,&s,::_1));
+        shard.set_event_handler(bind(&record_event,&events_lock,&events,::_1));
+    }
+
+    s.init_asio();
+    s.listen(9112);
+    s.start_accept();
+
+    websocketpp::lib::thread sthread(bind(&run_server,&s));
+
+    std::string out;
+
+    c.clear_access_channels(websocketpp::log::alevel::all);
+    c.clear_error_channels(websocketpp::log::elevel::all);
+    c.init_asio();
+    c.set_open_handler(bind(&send_on_open,&c,::_1));
+    c.set_message_handler(bind(&close_on_message,&c,&out,::_1,::_2));
+
+    client::metrics_ptr m = websocketpp::lib::make_shared<websocketpp::metrics>();
+    c.set_metrics(m);
+
+    size_t sent = 0;
+    c.set_send_latency_handler(bind(&count_sent,&sent,::_1,::_2,::_3,::_4));
+
+    websocketpp::lib::error_code ec;
+    client::connection_ptr con = c.get_connection("ws://127.0.0.1:9112", ec);
+    BOOST_REQUIRE( !ec );
+    c.connect(con);
+    c.run();
+
+    sthread.join();
+
+    BOOST_CHECK_EQUAL( out, "foo" );
+
+    BOOST_REQUIRE_EQUAL( events.size(), 2u );
+    BOOST_CHECK_EQUAL( events[0].type, websocketpp::log::event_type::open );
+    BOOST_CHECK_EQUAL( events[0].version, 13 );
+    BOOST_CHECK_EQUAL( events[0].status, 101 );
+    BOOST_CHECK_EQUAL( events[1].type, websocketpp::log::event_type::close );
+    BOOST_CHECK_EQUAL( events[1].remote_close_code,
+        websocketpp::close::status::normal );
+    BOOST_CHECK( events[1].bytes_in > events[0].bytes_in );
+    BOOST_CHECK( events[1].bytes_out > events[0].bytes_out );
+    BOOST_CHECK( events[1].duration >= events[1].handshake_time );
+
+    websocketpp::metrics_snapshot ms = m->get_snapshot();
+    BOOST_CHECK_EQUAL( ms.connections_opened, 1u );
+    BOOST_CHECK_EQUAL( ms.connections_closed, 1u );
+    BOOST_CHECK_EQUAL( ms.connections_open, 0 );
+    BOOST_CHECK_EQUAL( ms.messages_in, 1u );
+    BOOST_CHECK_EQUAL( ms.messages_out, 1u );
+    BOOST_CHECK_EQUAL( ms.bytes_in, con->get_bytes_received() );
+    BOOST_CHECK_EQUAL( ms.bytes_out, con->get_bytes_sent() );
+    BOOST_CHECK_EQUAL( ms.send_buffer_bytes, 0 );
+    BOOST_CHECK_EQUAL( ms.handshake.count(), 1u );
+    BOOST_CHECK( ms.writes >= 2u );
+    BOOST_CHECK_EQUAL( ms.write.count(), ms.writes );
+
+    std::string text = m->get_openmetrics();
+    BOOST_CHECK( text.find("\nwebsocketpp_connections_opened_total 1\n") !=
+        std::string::npos );
+    BOOST_CHECK( text.find("websocketpp_handshake_seconds_count 1\n") !=
+        std::string::npos );
+    BOOST_CHECK( text.size() > 6 &&
+        text.compare(text.size() - 6, 6, "# EOF\n") == 0 );
+
+    // the message and the close frame
+    BOOST_CHECK_EQUAL( sent, 2u );
+    BOOST_CHECK_EQUAL( con->get_send_queue_latency().count(), sent );
+    BOOST_CHECK_EQUAL( con->get_send_write_latency().count(), sent );
+}
+
+void broadcast_on_open(server * s, websocketpp::connection_hdl) {
+    websocketpp::lib::error_code ec;
+    server::message_ptr msg = s->prepare_broadcast("bar",
+        websocketpp::frame::opcode::text, ec);
+    BOOST_REQUIRE( !ec );
+    s->broadcast(msg);
+}
+
+BOOST_AUTO_TEST_CASE( broadcast ) {
+    server s(2);
+    client c;
+
+    for (size_t i = 0; i < s.size(); ++i) {
+        server::shard_type & shard = s.get_shard(i);
+        shard.clear_access_channels(websocketpp::log::alevel::all);
+        shard.clear_error_channels(websocketpp::log::elevel::all);
+        shard.set_open_handler(bind(&broadcast_on_open,&s,::_1));
+        shard.set_close_handler(bind(&stop_on_close,&s,::_1));
+        BOOST_CHECK( shard.get_connection_registry() );
+    }
+
+    s.init_asio();
+    s.listen(9117);
+    s.start_accept();
+
+    websocketpp::lib::thread sthread(bind(&run_server,&s));
+
+    std::string out;
+
+    c.clear_access_channels(websocketpp::log::alevel::all);
+    c.clear_error_channels(websocketpp::log::elevel::all);
+    c.init_asio();
+    c.set_message_handler(bind(&close_on_message,&c,&out,::_1,::_2));
+
+    websocketpp::lib::error_code ec;
+    client::connection_ptr con = c.get_connection("ws://127.0.0.1:9117", ec);
+    BOOST_REQUIRE( !ec );
+    c.connect(con);
+    c.run();
+
+    sthread.join();
+
+    BOOST_CHECK_EQUAL( out, "bar" );
+}
+
+void send_large_on_open(client * c, std::string const * payload,
+    websocketpp::connection_hdl hdl)
+{
+    c->send(hdl, *payload, websocketpp::frame::opcode::binary);
+}
+
+BOOST_AUTO_TEST_CASE( zerocopy_echo ) {
+    server s(1);
+    client c;
+
+    websocketpp::transport::asio::socket_options options;
+    options.zerocopy_threshold = 65536;
+
+    server::shard_type & shard = s.get_shard(0);
+    shard.clear_access_channels(websocketpp::log::alevel::all);
+    shard.clear_error_channels(websocketpp::log::elevel::all);
+    shard.set_message_handler(bind(&echo_from_any_thread,&s,::_1,::_2));
+    shard.set_close_handler(bind(&stop_on_close,&s,::_1));
+    shard.set_socket_options(options);
+
+    s.init_asio();
+    s.listen(9118);
+    s.start_accept();
+
+    websocketpp::lib::thread sthread(bind(&run_server,&s));
+
+    // large enough for several zero copy sends
+    std::string payload(1 << 20, 'z');
+    for (size_t i = 0; i < payload.size(); i += 4096) {
+        payload[i] = char('a' + (i / 4096) % 26);
+    }
+    std::string out;
+
+    c.clear_access_channels(websocketpp::log::alevel::all);
+    c.clear_error_channels(websocketpp::log::elevel::all);
+    c.init_asio();
+    c.set_socket_options(options);
+    c.set_open_handler(bind(&send_large_on_open,&c,&payload,::_1));
+    c.set_message_handler(bind(&close_on_message,&c,&out,::_1,::_2));
+
+    websocketpp::lib::error_code ec;
+    client::connection_ptr con = c.get_connection("ws://127.0.0.1:9118", ec);
+    BOOST_REQUIRE( !ec );
+    c.connect(con);
+    c.run();
+
+    sthread.join();
+
+    BOOST_CHECK( out == payload );
+}
+
+void record_fail(client * c, int * status, websocketpp::connection_hdl hdl) {
+    *status = c->get_con_from_hdl(hdl)->get_response_code();
+}
+
+BOOST_AUTO_TEST_CASE( handshake_limit_reject ) {
+    server s(1);
+    client c;
+
+    server::shard_type & shard = s.get_shard(0);
+    shard.clear_access_channels(websocketpp::log::alevel::all);
+    shard.clear_error_channels(websocketpp::log::elevel::all);
+    shard.set_max_handshakes(1, websocketpp::overload::reject);
+
+    s.init_asio();
+    s.listen(9115);
+    s.start_accept();
+
+    websocketpp::lib::thread sthread(bind(&run_server,&s));
+
+    // hold the only handshake slot with a connection that never sends one
+    websocketpp::lib::asio::io_context ios;
+    websocketpp::lib::asio::ip::tcp::socket idle(ios);
+    idle.connect(websocketpp::lib::asio::ip::tcp::endpoint(
+        websocketpp::lib::asio::ip::make_address("127.0.0.1"), 9115));
+
+    int status = 0;
+
+    c.clear_access_channels(websocketpp::log::alevel::all);
+    c.clear_error_channels(websocketpp::log::elevel::all);
+    c.init_asio();
+    c.set_fail_handler(bind(&record_fail,&c,&status,::_1));
+
+    websocketpp::lib::error_code ec;
+    client::connection_ptr con = c.get_connection("ws://127.0.0.1:9115", ec);
+    BOOST_REQUIRE( !ec );
+    c.connect(con);
+    c.run();
+
+    s.stop();
+    sthread.join();
+
+    BOOST_CHECK_EQUAL( status, 503 );
+}
+
+size_t trace_hits[websocketpp::trace::point::count];
+
+void count_trace(websocketpp::trace::point::value p, uint64_t id, uint64_t,
+    uint64_t)
+{
+    if (id != 0) {
+        ++trace_hits[p];
+    }
+}
+
+void traced_send_on_open(traced_client * c, websocketpp::connection_hdl hdl) {
+    c->send(hdl, std::string("foo"), websocketpp::frame::opcode::text);
+}
+
+void traced_close_on_message(traced_client * c, websocketpp::connection_hdl hdl,
+    traced_client::message_ptr)
+{
+    c->close(hdl, websocketpp::close::status::normal, "");
+}
+
+BOOST_AUTO_TEST_CASE( trace_hook ) {
+    server s(1);
+    traced_client c;
+
+    server::shard_type & shard = s.get_shard(0);
+    shard.clear_access_channels(websocketpp::log::alevel::all);
+    shard.clear_error_channels(websocketpp::log::elevel::all);
+    shard.set_message_handler(bind(&echo_from_any_thread,&s,::_1,::_2));
+    shard.set_close_handler(bind(&stop_on_close,&s,::_1));
+
+    s.init_asio();
+    s.listen(9116);
+    s.start_accept();
+
+    websocketpp::lib::thread sthread(bind(&run_server,&s));
+
+    websocketpp::trace::hook::set_handler(&count_trace);
+
+    c.clear_access_channels(websocketpp::log::alevel::all);
+    c.clear_error_channels(websocketpp::log::elevel::all);
+    c.init_asio();
+    c.set_open_handler(bind(&traced_send_on_open,&c,::_1));
+    c.set_message_handler(bind(&traced_close_on_message,&c,::_1,::_2));
+
+    websocketpp::lib::error_code ec;
+    traced_client::connection_ptr con =
+        c.get_connection("ws://127.0.0.1:9116", ec);
+    BOOST_REQUIRE( !ec );
+    c.connect(con);
+    c.run();
+
+    websocketpp::trace::hook::set_handler(NULL);
+    sthread.join();
+
+    namespace point = websocketpp::trace::point;
+
+    BOOST_CHECK( trace_hits[point::read] > 0 );
+    // the echo and the close frame
+    BOOST_CHECK_EQUAL( trace_hits[point::frame], 2u );
+    BOOST_CHECK_EQUAL( trace_hits[point::deliver], 1u );
+    // the message and the close frame
+    BOOST_CHECK_EQUAL( trace_hits[point::push], 2u );
+    BOOST_CHECK( trace_hits[point::dispatch] > 0 );
+    BOOST_CHECK_EQUAL( trace_hits[point::write],
+        trace_hits[point::dispatch] );
+    // the open handshake timer at least
+    BOOST_CHECK( trace_hits[point::timer] > 0 );
+}
+
+struct migration_record {
+    websocketpp::lib::mutex lock;
+    std::thread::id opened_on;
+    std::thread::id moved_on;
+    std::thread::id echoed_on;
+    websocketpp::lib::error_code ec;
+};
+
+void tell_moved(server * s, migration_record * m, websocketpp::connection_hdl hdl,
+    websocketpp::lib::error_code const & ec)
+{
+    {
+        websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(m->lock);
+        m->moved_on = std::this_thread::get_id();
+        m->ec = ec;
+    }
+    BOOST_CHECK( !s->send(hdl, "moved", websocketpp::frame::opcode::text) );
+}
+
+void record_open_thread(migration_record * m, websocketpp::connection_hdl) {
+    websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(m->lock);
+    m->opened_on = std::this_thread::get_id();
+}
+
+// the connection is busy until the handshake response is written, so it is
+// moved once the client has said hello
+void migrate_on_hello(server * s, size_t index, migration_record * m,
+    websocketpp::connection_hdl hdl, server::message_ptr msg)
+{
+    if (msg->get_payload() == "hello") {
+        BOOST_CHECK( !s->migrate(hdl, (index + 1) % s->size(),
+            bind(&tell_moved,s,m,hdl,::_1)) );
+        return;
+    }
+
+    {
+        websocketpp::lib::lock_guard<websocketpp::lib::mutex> guard(m->lock);
+        m->echoed_on = std::this_thread::get_id();
+    }
+    BOOST_CHECK( !s->send(hdl, msg->get_payload(), msg->get_opcode()) );
+}
+
+void send_hello(client * c, websocketpp::connection_hdl hdl) {
+    c->send(hdl, std::string("hello"), websocketpp::frame::opcode::text);
+}
+
+void send_after_move(client * c, std::string * out,
+    websocketpp::connection_hdl hdl, client::message_ptr msg)
+{
+    if (msg->get_payload() == "moved") {
+        c->send(hdl, std::string("foo"), websocketpp::frame::opcode::text);
+        return;
+    }
+    *out = msg->get_payload();
+    c->close(hdl, websocketpp::close::status::normal, "");
+}
+
+BOOST_AUTO_TEST_CASE( migrate_connection ) {
+    server s(2);
+    client c;
+    migration_record m;
+
+    for (size_t i = 0; i < s.size(); ++i) {
+        server::shard_type & shard = s.get_shard(i);
+        shard.clear_access_channels(websocketpp::log::alevel::all);
+        shard.clear_error_channels(websocketpp::log::elevel::all);
+        shard.set_open_handler(bind(&record_open_thread,&m,::_1));
+        shard.set_message_handler(bind(&migrate_on_hello,&s,i,&m,::_1,::_2));
+        shard.set_close_handler(bind(&stop_on_close,&s,::_1));
+    }
+
+    // sampled, but no shard lags enough to shed connections
+    s.set_load_sampling(5);
+    s.set_rebalancing(60000000);
+
+    s.init_asio();
+    s.listen(9124);
+    s.start_accept();
+
+    websocketpp::lib::thread sthread(bind(&run_server,&s));
+
+    std::string out;
+
+    c.clear_access_channels(websocketpp::log::alevel::all);
+    c.clear_error_channels(websocketpp::log::elevel::all);
+    c.init_asio();
+    c.set_open_handler(bind(&send_hello,&c,::_1));
+    c.set_message_handler(bind(&send_after_move,&c,&out,::_1,::_2));
+
+    websocketpp::lib::error_code ec;
+    client::connection_ptr con = c.get_connection("ws://127.0.0.1:9124", ec);
+    BOOST_REQUIRE( !ec );
+    c.connect(con);
+    c.run();
+
+    sthread.join();
+
+    BOOST_CHECK_EQUAL( out, "foo" );
+    BOOST_CHECK( !m.ec );
+    BOOST_CHECK( m.moved_on != m.opened_on );
+    BOOST_CHECK( m.echoed_on == m.moved_on );
+    for (size_t i = 0; i < s.size(); ++i) {
+        BOOST_CHECK_EQUAL( s.get_load(i).migrated, 0u );
+    }
+}
@@ -31,6 +31,7 @@
 #include <iostream>
 
 #include <websocketpp/transport/asio/base.hpp>
+#include <websocketpp/transport/asio/socket_options.hpp>
 
 BOOST_AUTO_TEST_CASE( blank_error ) {
     websocketpp::lib::error_code ec;
@@ -47,3 +48,144 @@ BOOST_AUTO_TEST_CASE( asio_error ) {
     BOOST_CHECK( ec == general );
     BOOST_CHECK( ec.value() == 1 );
 }
+
+struct noop_handler {
+    void operator()(websocketpp::lib::asio::error_code const &) {}
+};
+
+BOOST_AUTO_TEST_CASE( custom_alloc_handler_associated_allocator ) {
+    using websocketpp::transport::asio::handler_allocator;
+    using websocketpp::transport::asio::handler_allocator_adaptor;
+    using websocketpp::transport::asio::make_custom_alloc_handler;
+
+    handler_allocator a;
+    char const * begin = reinterpret_cast<char const *>(&a);
+    char const * end = begin + sizeof(a);
+
+    websocketpp::lib::asio::io_context ctx;
+    websocketpp::lib::asio::io_context::strand strand(ctx);
+
+    // the allocator must remain visible through a strand binding
+    handler_allocator_adaptor<char> alloc(
+        websocketpp::lib::asio::get_associated_allocator(
+            websocketpp::lib::asio::bind_executor(strand,
+                make_custom_alloc_handler(a, noop_handler()))));
+
+    char * p1 = alloc.allocate(64);
+    char * p2 = alloc.allocate(64);
+    BOOST_CHECK( p1 >= begin && p1 < end );
+    BOOST_CHECK( p2 < begin || p2 >= end );
+    BOOST_CHECK_EQUAL( a.get_heap_bytes(), 64 );
+    alloc.deallocate(p2,64);
+    alloc.deallocate(p1,64);
+    BOOST_CHECK_EQUAL( a.get_heap_bytes(), 0 );
+
+    BOOST_CHECK( alloc.allocate(64) == p1 );
+    alloc.deallocate(p1,64);
+}
+
+BOOST_AUTO_TEST_CASE( recycling_alloc_handler ) {
+    using websocketpp::transport::asio::recycling_handler_allocator;
+    using websocketpp::transport::asio::make_recycling_alloc_handler;
+
+    recycling_handler_allocator<char> alloc(
+        websocketpp::lib::asio::get_associated_allocator(
+            make_recycling_alloc_handler(noop_handler())));
+
+    char * p1 = alloc.allocate(100);
+    alloc.deallocate(p1,100);
+    BOOST_CHECK( alloc.allocate(100) == p1 );
+    alloc.deallocate(p1,100);
+
+    // timer completions are allocated through the recycling allocator
+    websocketpp::lib::asio::io_context ctx;
+    websocketpp::lib::asio::steady_timer timer(ctx,
+        websocketpp::lib::asio::milliseconds(0));
+    timer.async_wait(make_recycling_alloc_handler(noop_handler()));
+    ctx.run();
+}
+
+BOOST_AUTO_TEST_CASE( socket_options_apply ) {
+    using websocketpp::transport::asio::socket_options;
+    using websocketpp::transport::asio::apply_socket_options;
+    namespace asio = websocketpp::lib::asio;
+
+    asio::io_context ctx;
+    asio::ip::tcp::socket s(ctx);
+    s.open(asio::ip::tcp::v4());
+
+    // the defaults leave the socket alone
+    BOOST_CHECK( !apply_socket_options(s, socket_options()) );
+
+    asio::ip::tcp::no_delay nd;
+    s.get_option(nd);
+    BOOST_CHECK( !nd.value() );
+
+    socket_options o = socket_options::high_throughput();
+    o.send_buffer = 65536;
+    BOOST_CHECK( !apply_socket_options(s, o) );
+
+    s.get_option(nd);
+    BOOST_CHECK( nd.value() );
+
+    // the kernel may round, but not shrink, the requested size
+    asio::socket_base::send_buffer_size sb;
+    s.get_option(sb);
+    BOOST_CHECK( sb.value() >= 65536 );
+}
+
+BOOST_AUTO_TEST_CASE( socket_options_fast_open ) {
+    using websocketpp::transport::asio::socket_options;
+    using websocketpp::transport::asio::apply_fast_open;
+    using websocketpp::transport::asio::apply_fast_open_connect;
+    namespace asio = websocketpp::lib::asio;
+
+    asio::io_context ctx;
+    asio::ip::tcp::acceptor a(ctx);
+    a.open(asio::ip::tcp::v4());
+    asio::ip::tcp::socket s(ctx);
+    s.open(asio::ip::tcp::v4());
+
+    // off by default
+    BOOST_CHECK( !apply_fast_open(a, socket_options()) );
+    BOOST_CHECK( !apply_fast_open_connect(s, socket_options()) );
+
+    socket_options o;
+    o.fast_open = 16;
+    o.fast_open_connect = true;
+#ifdef TCP_FASTOPEN
+    BOOST_CHECK( !apply_fast_open(a, o) );
+    asio::detail::socket_option::integer<IPPROTO_TCP, TCP_FASTOPEN> qlen;
+    a.get_option(qlen);
+    BOOST_CHECK_EQUAL( qlen.value(), 16 );
+#else
+    BOOST_CHECK( apply_fast_open(a, o) );
+#endif
+#ifdef TCP_FASTOPEN_CONNECT
+    BOOST_CHECK( !apply_fast_open_connect(s, o) );
+#else
+    BOOST_CHECK( apply_fast_open_connect(s, o) );
+#endif
+}
+
+#ifdef SO_MAX_PACING_RATE
+BOOST_AUTO_TEST_CASE( socket_options_pacing_rate ) {
+    using websocketpp::transport::asio::socket_options;
+    using websocketpp::transport::asio::apply_socket_options;
+    namespace asio = websocketpp::lib::asio;
+
+    asio::io_context ctx;
+    asio::ip::tcp::socket s(ctx);
+    s.open(asio::ip::tcp::v4());
+
+    socket_options o;
+    o.max_pacing_rate = 1000000;
+    BOOST_CHECK( !apply_socket_options(s, o) );
+
+    typedef asio::detail::socket_option::integer<SOL_SOCKET,
+        SO_MAX_PACING_RATE> max_pacing_rate;
+    max_pacing_rate rate;
+    s.get_option(rate);
+    BOOST_CHECK_EQUAL( rate.value(), 1000000 );
+}
+#endif
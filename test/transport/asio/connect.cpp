@@ -0,0 +1,499 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE transport_asio_connect
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <vector>
+
+#include <websocketpp/transport/asio/endpoint.hpp>
+
+// Concurrency
+#include <websocketpp/concurrency/none.hpp>
+
+// HTTP
+#include <websocketpp/http/request.hpp>
+#include <websocketpp/http/response.hpp>
+
+// Loggers
+#include <websocketpp/logger/stub.hpp>
+
+#include <boost/asio.hpp>
+
+struct config {
+    typedef websocketpp::concurrency::none concurrency_type;
+    typedef websocketpp::log::stub alog_type;
+    typedef websocketpp::log::stub elog_type;
+    typedef websocketpp::http::parser::request request_type;
+    typedef websocketpp::http::parser::response response_type;
+    typedef websocketpp::transport::asio::basic_socket::endpoint socket_type;
+
+    static const bool enable_multithreading = true;
+
+    static const long timeout_socket_pre_init = 1000;
+    static const long timeout_proxy = 1000;
+    static const long timeout_socket_post_init = 1000;
+    static const long timeout_dns_resolve = 1000;
+    static const long timeout_connect = 1000;
+    static const long timeout_socket_shutdown = 1000;
+};
+
+typedef websocketpp::transport::asio::endpoint<config> transport_type;
+typedef websocketpp::transport::asio::connection<config> con_type;
+typedef websocketpp::lib::shared_ptr<con_type> con_ptr;
+typedef boost::asio::ip::tcp tcp;
+typedef websocketpp::lib::chrono::steady_clock test_clock;
+
+long elapsed_ms(test_clock::time_point start) {
+    return long(websocketpp::lib::chrono::duration_cast<
+        websocketpp::lib::chrono::milliseconds>(test_clock::now() - start)
+        .count());
+}
+
+// Resolves every name to the same list of addresses
+struct fake_resolver {
+    fake_resolver() : lookups(0), defer(false) {}
+
+    void resolve(std::string const & host, std::string const & port,
+        transport_type::resolve_callback callback)
+    {
+        ++lookups;
+        if (defer) {
+            pending.push_back(callback);
+            return;
+        }
+        answer(host, port, callback);
+    }
+
+    // Answer the lookups held back while defer was set
+    void complete() {
+        for (size_t i = 0; i < pending.size(); ++i) {
+            answer("localhost", "80", pending[i]);
+        }
+        pending.clear();
+    }
+
+    void answer(std::string const & host, std::string const & port,
+        transport_type::resolve_callback callback)
+    {
+        if (ec) {
+            callback(ec, tcp::resolver::iterator());
+        } else {
+            callback(ec, tcp::resolver::results_type::create(
+                addresses.begin(), addresses.end(), host, port));
+        }
+    }
+
+    std::vector<tcp::endpoint> addresses;
+    boost::system::error_code ec;
+    int lookups;
+    bool defer;
+    std::vector<transport_type::resolve_callback> pending;
+};
+
+// A listener that completes connects without ever accepting them
+struct test_server {
+    explicit test_server(boost::asio::io_context & ios,
+        tcp::endpoint ep = tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0))
+      : acceptor(ios, ep) {}
+
+    tcp::endpoint endpoint() {
+        return acceptor.local_endpoint();
+    }
+
+    tcp::acceptor acceptor;
+};
+
+// A listener with a full accept queue, connects to it neither complete nor
+// fail
+struct black_hole {
+    explicit black_hole(boost::asio::io_context & ios)
+      : acceptor(ios, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0),
+            false)
+      , filler(ios)
+    {
+        acceptor.listen(0);
+        filler.connect(acceptor.local_endpoint());
+    }
+
+    tcp::endpoint endpoint() {
+        return acceptor.local_endpoint();
+    }
+
+    tcp::acceptor acceptor;
+    tcp::socket filler;
+};
+
+// An address nothing listens on
+tcp::endpoint refused_endpoint(boost::asio::io_context & ios) {
+    tcp::acceptor a(ios, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+    return a.local_endpoint();
+}
+
+struct connect_result {
+    connect_result() : calls(0), elapsed(0) {}
+
+    con_ptr con;
+    websocketpp::lib::error_code ec;
+    int calls;
+    long elapsed;
+    test_clock::time_point start;
+};
+typedef websocketpp::lib::shared_ptr<connect_result> result_ptr;
+
+struct test_endpoint : public transport_type {
+    test_endpoint()
+      : alog(websocketpp::lib::make_shared<config::alog_type>())
+      , elog(websocketpp::lib::make_shared<config::elog_type>())
+    {
+        init_logging(alog,elog);
+        init_asio();
+        set_resolve_handler(websocketpp::lib::bind(
+            &fake_resolver::resolve,
+            &resolver,
+            websocketpp::lib::placeholders::_1,
+            websocketpp::lib::placeholders::_2,
+            websocketpp::lib::placeholders::_3
+        ));
+    }
+
+    result_ptr connect(std::string const & u) {
+        result_ptr r = websocketpp::lib::make_shared<connect_result>();
+        r->con = websocketpp::lib::make_shared<con_type>(false,alog,elog);
+        r->start = test_clock::now();
+
+        BOOST_CHECK_EQUAL( transport_type::init(r->con),
+            websocketpp::lib::error_code() );
+
+        transport_type::async_connect(
+            r->con,
+            websocketpp::lib::make_shared<websocketpp::uri>(u),
+            websocketpp::lib::bind(
+                &test_endpoint::handle_connect,
+                this,
+                r,
+                websocketpp::lib::placeholders::_1
+            )
+        );
+        return r;
+    }
+
+    void handle_connect(result_ptr r, websocketpp::lib::error_code const & ec)
+    {
+        ++r->calls;
+        r->ec = ec;
+        r->elapsed = elapsed_ms(r->start);
+    }
+
+    // Run until every operation, including the losing attempts, is done
+    long run_all() {
+        test_clock::time_point start = test_clock::now();
+        transport_type::reset();
+        transport_type::run();
+        return elapsed_ms(start);
+    }
+
+    tcp::endpoint remote(result_ptr r) {
+        return r->con->get_raw_socket().remote_endpoint();
+    }
+
+    fake_resolver resolver;
+    websocketpp::lib::shared_ptr<config::alog_type> alog;
+    websocketpp::lib::shared_ptr<config::elog_type> elog;
+};
+
+BOOST_AUTO_TEST_CASE( connect_race_interleaves_families ) {
+    test_endpoint e;
+    e.set_connect_attempt_delay(50);
+
+    black_hole hole(e.get_io_context());
+    test_server v4(e.get_io_context());
+    test_server v6(e.get_io_context(),
+        tcp::endpoint(boost::asio::ip::address_v6::loopback(), 0));
+
+    // the second attempt goes to the first IPv6 address rather than the
+    // next IPv4 one
+    e.resolver.addresses.push_back(hole.endpoint());
+    e.resolver.addresses.push_back(v4.endpoint());
+    e.resolver.addresses.push_back(v6.endpoint());
+
+    result_ptr r = e.connect("ws://localhost/");
+    e.run_all();
+
+    BOOST_REQUIRE_EQUAL( r->calls, 1 );
+    BOOST_REQUIRE( !r->ec );
+    BOOST_CHECK_EQUAL( e.remote(r), v6.endpoint() );
+}
+
+BOOST_AUTO_TEST_CASE( connect_race_starts_next_attempt_after_delay ) {
+    test_endpoint e;
+    e.set_connect_attempt_delay(100);
+
+    black_hole hole(e.get_io_context());
+    test_server server(e.get_io_context());
+
+    e.resolver.addresses.push_back(hole.endpoint());
+    e.resolver.addresses.push_back(server.endpoint());
+
+    result_ptr r = e.connect("ws://localhost/");
+    e.run_all();
+
+    BOOST_REQUIRE_EQUAL( r->calls, 1 );
+    BOOST_REQUIRE( !r->ec );
+    BOOST_CHECK_EQUAL( e.remote(r), server.endpoint() );
+    BOOST_CHECK( r->elapsed >= 100 );
+    BOOST_CHECK( r->elapsed < config::timeout_connect );
+}
+
+BOOST_AUTO_TEST_CASE( connect_race_fails_over_after_refused ) {
+    test_endpoint e;
+    // longer than timeout_connect, only the failure can start the next one
+    e.set_connect_attempt_delay(10000);
+
+    test_server server(e.get_io_context());
+
+    e.resolver.addresses.push_back(refused_endpoint(e.get_io_context()));
+    e.resolver.addresses.push_back(server.endpoint());
+
+    result_ptr r = e.connect("ws://localhost/");
+    e.run_all();
+
+    BOOST_REQUIRE_EQUAL( r->calls, 1 );
+    BOOST_REQUIRE( !r->ec );
+    BOOST_CHECK_EQUAL( e.remote(r), server.endpoint() );
+    BOOST_CHECK( r->elapsed < config::timeout_connect );
+}
+
+BOOST_AUTO_TEST_CASE( connect_race_closes_losing_attempts ) {
+    test_endpoint e;
+    e.set_connect_attempt_delay(50);
+
+    black_hole hole(e.get_io_context());
+    test_server server(e.get_io_context());
+
+    e.resolver.addresses.push_back(hole.endpoint());
+    e.resolver.addresses.push_back(server.endpoint());
+
+    result_ptr r = e.connect("ws://localhost/");
+
+    // an attempt left open keeps the io_context running until the kernel
+    // gives up on it, minutes later
+    long const ran = e.run_all();
+
+    BOOST_REQUIRE_EQUAL( r->calls, 1 );
+    BOOST_REQUIRE( !r->ec );
+    BOOST_CHECK_EQUAL( e.remote(r), server.endpoint() );
+    BOOST_CHECK( ran < config::timeout_connect );
+}
+
+BOOST_AUTO_TEST_CASE( connect_race_respects_timeout_connect ) {
+    test_endpoint e;
+    e.set_connect_attempt_delay(100);
+
+    black_hole hole(e.get_io_context());
+
+    e.resolver.addresses.push_back(hole.endpoint());
+    e.resolver.addresses.push_back(hole.endpoint());
+    e.resolver.addresses.push_back(hole.endpoint());
+
+    result_ptr r = e.connect("ws://localhost/");
+    long const ran = e.run_all();
+
+    BOOST_REQUIRE_EQUAL( r->calls, 1 );
+    BOOST_CHECK_EQUAL( r->ec, websocketpp::transport::error::make_error_code(
+        websocketpp::transport::error::timeout) );
+    BOOST_CHECK( r->elapsed >= config::timeout_connect );
+    BOOST_CHECK( r->elapsed < 2 * config::timeout_connect );
+    // every attempt was closed when the race timed out
+    BOOST_CHECK( ran < 2 * config::timeout_connect );
+}
+
+void wait_ms(long ms) {
+    websocketpp::lib::this_thread::sleep_for(
+        websocketpp::lib::chrono::milliseconds(ms));
+}
+
+BOOST_AUTO_TEST_CASE( dns_cache_reuses_results_until_ttl ) {
+    test_endpoint e;
+    e.set_dns_cache_ttl(200);
+
+    test_server server(e.get_io_context());
+    e.resolver.addresses.push_back(server.endpoint());
+
+    result_ptr r1 = e.connect("ws://localhost/");
+    e.run_all();
+    result_ptr r2 = e.connect("ws://localhost/");
+    e.run_all();
+
+    BOOST_CHECK_EQUAL( e.resolver.lookups, 1 );
+    BOOST_CHECK( r1->calls == 1 && !r1->ec );
+    BOOST_CHECK( r2->calls == 1 && !r2->ec );
+
+    wait_ms(250);
+    result_ptr r3 = e.connect("ws://localhost/");
+    e.run_all();
+
+    BOOST_CHECK_EQUAL( e.resolver.lookups, 2 );
+    BOOST_CHECK( r3->calls == 1 && !r3->ec );
+}
+
+BOOST_AUTO_TEST_CASE( dns_cache_negative_ttl ) {
+    test_endpoint e;
+    e.set_dns_cache_ttl(10000);
+    e.set_dns_cache_negative_ttl(200);
+    e.resolver.ec = boost::asio::error::host_not_found;
+
+    result_ptr r1 = e.connect("ws://localhost/");
+    e.run_all();
+    result_ptr r2 = e.connect("ws://localhost/");
+    e.run_all();
+
+    BOOST_CHECK_EQUAL( e.resolver.lookups, 1 );
+    BOOST_CHECK( r1->calls == 1 && r1->ec );
+    BOOST_CHECK( r2->calls == 1 && r2->ec );
+
+    wait_ms(250);
+    result_ptr r3 = e.connect("ws://localhost/");
+    e.run_all();
+
+    BOOST_CHECK_EQUAL( e.resolver.lookups, 2 );
+    BOOST_CHECK( r3->calls == 1 && r3->ec );
+
+    // failures aren't cached without a negative ttl
+    e.set_dns_cache_negative_ttl(0);
+    wait_ms(250);
+    e.connect("ws://localhost/");
+    e.run_all();
+    e.connect("ws://localhost/");
+    e.run_all();
+
+    BOOST_CHECK_EQUAL( e.resolver.lookups, 4 );
+}
+
+BOOST_AUTO_TEST_CASE( dns_cache_refreshes_after_three_quarters_of_ttl ) {
+    test_endpoint e;
+    e.set_dns_cache_ttl(800);
+
+    test_server old_server(e.get_io_context());
+    test_server new_server(e.get_io_context());
+    e.resolver.addresses.push_back(old_server.endpoint());
+
+    test_clock::time_point const start = test_clock::now();
+    e.connect("ws://localhost/");
+    e.run_all();
+
+    // before the refresh point the cache is used as is
+    wait_ms(100);
+    e.connect("ws://localhost/");
+    e.run_all();
+    BOOST_CHECK_EQUAL( e.resolver.lookups, 1 );
+
+    // past 600ms the cached addresses are used and refreshed meanwhile
+    e.resolver.addresses[0] = new_server.endpoint();
+    wait_ms(650 - elapsed_ms(start));
+    result_ptr r = e.connect("ws://localhost/");
+    e.run_all();
+
+    BOOST_REQUIRE( elapsed_ms(start) < 800 );
+    BOOST_CHECK_EQUAL( e.resolver.lookups, 2 );
+    BOOST_REQUIRE( r->calls == 1 && !r->ec );
+    BOOST_CHECK_EQUAL( e.remote(r), old_server.endpoint() );
+
+    // the refreshed addresses are used from then on
+    r = e.connect("ws://localhost/");
+    e.run_all();
+
+    BOOST_CHECK_EQUAL( e.resolver.lookups, 2 );
+    BOOST_REQUIRE( r->calls == 1 && !r->ec );
+    BOOST_CHECK_EQUAL( e.remote(r), new_server.endpoint() );
+}
+
+BOOST_AUTO_TEST_CASE( dns_cache_shares_lookups_with_own_timeouts ) {
+    test_endpoint e;
+    e.set_dns_cache_ttl(10000);
+    e.resolver.defer = true;
+
+    test_server server(e.get_io_context());
+    e.resolver.addresses.push_back(server.endpoint());
+
+    result_ptr first = e.connect("ws://localhost/");
+    result_ptr second;
+
+    // the second connect joins the lookup half way into the first one's
+    // timeout, the lookup completes after the first one timed out
+    boost::asio::steady_timer join(e.get_io_context(),
+        std::chrono::milliseconds(config::timeout_dns_resolve / 2));
+    join.async_wait([&](boost::system::error_code const &) {
+        second = e.connect("ws://localhost/");
+    });
+
+    boost::asio::steady_timer answer(e.get_io_context(),
+        std::chrono::milliseconds(config::timeout_dns_resolve * 6 / 5));
+    answer.async_wait([&](boost::system::error_code const &) {
+        BOOST_CHECK_EQUAL( first->calls, 1 );
+        BOOST_CHECK_EQUAL( second->calls, 0 );
+        e.resolver.complete();
+    });
+
+    e.run_all();
+
+    BOOST_CHECK_EQUAL( e.resolver.lookups, 1 );
+
+    BOOST_CHECK_EQUAL( first->calls, 1 );
+    BOOST_CHECK_EQUAL( first->ec, websocketpp::transport::error::make_error_code(
+        websocketpp::transport::error::resolve_failed) );
+
+    BOOST_REQUIRE( second );
+    BOOST_CHECK_EQUAL( second->calls, 1 );
+    BOOST_REQUIRE( !second->ec );
+    BOOST_CHECK_EQUAL( e.remote(second), server.endpoint() );
+}
+
+BOOST_AUTO_TEST_CASE( dns_cache_evicts_expired_entries ) {
+    test_endpoint e;
+    e.set_dns_cache_ttl(100);
+
+    test_server server(e.get_io_context());
+    e.resolver.addresses.push_back(server.endpoint());
+
+    e.connect("ws://a.example/");
+    e.run_all();
+    BOOST_CHECK_EQUAL( e.get_dns_cache_size(), 1 );
+
+    e.connect("ws://b.example/");
+    e.run_all();
+    BOOST_CHECK_EQUAL( e.get_dns_cache_size(), 2 );
+
+    // completing the next lookup drops both expired names
+    wait_ms(150);
+    e.connect("ws://c.example/");
+    e.run_all();
+    BOOST_CHECK_EQUAL( e.get_dns_cache_size(), 1 );
+    BOOST_CHECK_EQUAL( e.resolver.lookups, 3 );
+}
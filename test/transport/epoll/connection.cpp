@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define BOOST_TEST_MODULE transport_epoll_connection
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <websocketpp/config/epoll.hpp>
+#include <websocketpp/client.hpp>
+#include <websocketpp/server.hpp>
+
+namespace lib = websocketpp::lib;
+
+using websocketpp::transport::epoll::loop;
+
+struct server_config : public websocketpp::config::epoll {
+    static constexpr websocketpp::log::level elog_level =
+        websocketpp::log::elevel::none;
+    static constexpr websocketpp::log::level alog_level =
+        websocketpp::log::alevel::none;
+};
+
+struct client_config : public websocketpp::config::epoll_client {
+    static constexpr websocketpp::log::level elog_level =
+        websocketpp::log::elevel::none;
+    static constexpr websocketpp::log::level alog_level =
+        websocketpp::log::alevel::none;
+};
+
+typedef websocketpp::server<server_config> server;
+typedef websocketpp::client<client_config> client;
+
+void record(std::vector<std::string> * out, std::string what,
+    lib::error_code const & ec)
+{
+    out->push_back(ec ? what + " " + ec.message() : what);
+}
+
+BOOST_AUTO_TEST_CASE( loop_handlers_and_timers ) {
+    loop::ptr l = lib::make_shared<loop>();
+    lib::error_code ec;
+    l->open(ec);
+    BOOST_REQUIRE( !ec );
+
+    std::vector<std::string> events;
+    loop::timer_ptr late = l->set_timer(20, lib::bind(&record, &events,
+        "late", lib::placeholders::_1));
+    l->set_timer(10, lib::bind(&record, &events, "early",
+        lib::placeholders::_1));
+    loop::timer_ptr cancelled = l->set_timer(5, lib::bind(&record, &events,
+        "cancelled", lib::placeholders::_1));
+    cancelled->cancel();
+
+    std::thread poster([&] {
+        l->post([&] { events.push_back("posted"); });
+    });
+    poster.join();
+
+    // returns once the timers ran, nothing keeps it going after that
+    l->run();
+
+    BOOST_REQUIRE_EQUAL( events.size(), 4u );
+    BOOST_CHECK_EQUAL( events[0], "cancelled The operation was aborted" );
+    BOOST_CHECK_EQUAL( events[1], "posted" );
+    BOOST_CHECK_EQUAL( events[2], "early" );
+    BOOST_CHECK_EQUAL( events[3], "late" );
+
+    // cancelling after it ran does nothing
+    late->cancel();
+    BOOST_CHECK_EQUAL( l->poll(), 0u );
+    BOOST_CHECK_EQUAL( events.size(), 4u );
+}
+
+struct echo_test {
+    echo_test() : received(0), bytes(0), closed(false) {}
+
+    server s;
+    client c;
+    std::vector<std::string> payloads;
+    size_t received;
+    size_t bytes;
+    bool closed;
+    std::string remote;
+
+    void on_server_message(websocketpp::connection_hdl hdl,
+        server::message_ptr msg)
+    {
+        s.send(hdl, msg->get_payload(), msg->get_opcode());
+    }
+
+    void on_client_open(websocketpp::connection_hdl hdl) {
+        for (size_t i = 0; i < payloads.size(); ++i) {
+            c.send(hdl, payloads[i], websocketpp::frame::opcode::binary);
+        }
+    }
+
+    void on_client_message(websocketpp::connection_hdl hdl,
+        client::message_ptr msg)
+    {
+        BOOST_CHECK( msg->get_payload() == payloads[received] );
+        bytes += msg->get_payload().size();
+        if (++received == payloads.size()) {
+            c.close(hdl, websocketpp::close::status::normal, "");
+        }
+    }
+
+    void on_server_open(websocketpp::connection_hdl hdl) {
+        remote = s.get_con_from_hdl(hdl)->get_remote_endpoint();
+    }
+
+    void on_client_close(websocketpp::connection_hdl) {
+        closed = true;
+        s.stop_listening();
+    }
+};
+
+BOOST_AUTO_TEST_CASE( echo_over_loopback ) {
+    echo_test t;
+    using lib::placeholders::_1;
+    using lib::placeholders::_2;
+
+    // server and client share one loop and one thread
+    t.s.init_epoll();
+    t.c.init_epoll(t.s.get_loop());
+    t.s.set_reuse_addr(true);
+
+    t.s.set_message_handler(lib::bind(&echo_test::on_server_message, &t, _1,
+        _2));
+    t.s.set_open_handler(lib::bind(&echo_test::on_server_open, &t, _1));
+    t.c.set_open_handler(lib::bind(&echo_test::on_client_open, &t, _1));
+    t.c.set_message_handler(lib::bind(&echo_test::on_client_message, &t, _1,
+        _2));
+    t.c.set_close_handler(lib::bind(&echo_test::on_client_close, &t, _1));
+
+    // small messages share writes, the large ones fill the socket buffers
+    // and need several sendmsg calls
+    for (size_t i = 0; i < 50; ++i) {
+        t.payloads.push_back(std::string(i * 37 + 1, char('a' + i % 26)));
+    }
+    t.payloads.push_back(std::string(4 * 1024 * 1024, 'x'));
+    t.payloads.push_back(std::string(300000, 'y'));
+
+    t.s.listen(9140);
+    t.s.start_accept();
+
+    lib::error_code ec;
+    client::connection_ptr con = t.c.get_connection("ws://127.0.0.1:9140",
+        ec);
+    BOOST_REQUIRE( !ec );
+    t.c.connect(con);
+
+    t.s.run();
+
+    BOOST_CHECK_EQUAL( t.received, t.payloads.size() );
+    BOOST_CHECK( t.closed );
+    BOOST_CHECK_EQUAL( t.remote.compare(0, 17, "[::ffff:127.0.0.1"), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( connect_refused ) {
+    client c;
+    c.init_epoll();
+
+    lib::error_code fail_ec;
+    c.set_fail_handler([&](websocketpp::connection_hdl hdl) {
+        fail_ec = c.get_con_from_hdl(hdl)->get_ec();
+    });
+
+    lib::error_code ec;
+    client::connection_ptr con = c.get_connection("ws://127.0.0.1:9141", ec);
+    BOOST_REQUIRE( !ec );
+    c.connect(con);
+    c.run();
+
+    BOOST_CHECK_EQUAL( fail_ec, lib::error_code(ECONNREFUSED,
+        lib::system_category()) );
+}
+
+BOOST_AUTO_TEST_CASE( stop_listening_ends_accept_loop ) {
+    server s;
+    s.init_epoll();
+    s.set_reuse_addr(true);
+    s.listen(9142);
+
+    lib::error_code loop_ec;
+    lib::error_code transport_ec;
+    s.start_accept([&](lib::error_code const & ec,
+        lib::error_code const & tec)
+    {
+        loop_ec = ec;
+        transport_ec = tec;
+    });
+
+    s.get_loop()->post([&] { s.stop_listening(); });
+    s.run();
+
+    BOOST_CHECK( !s.is_listening() );
+    BOOST_CHECK_EQUAL( transport_ec,
+        websocketpp::error::async_accept_not_listening );
+}
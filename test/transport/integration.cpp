@@ -653,3 +653,333 @@ BOOST_AUTO_TEST_CASE( move_construct_transport ) {
     server s2(std::move(s1));
 }
 #endif // _WEBSOCKETPP_MOVE_SEMANTICS_
+
+// A server on an ephemeral loopback port that runs on its own thread. It has
+// no strands, so writes started from its handlers are batched per loop turn.
+struct loopback_server {
+    explicit loopback_server(size_t connections)
+      : expected(connections), closed(0), port(0)
+    {
+        s.clear_access_channels(websocketpp::log::alevel::all);
+        s.clear_error_channels(websocketpp::log::elevel::all);
+        s.init_asio();
+        s.set_single_threaded_io(true);
+        s.set_close_handler(bind(&loopback_server::on_close,this,_1));
+    }
+
+    void start() {
+        s.listen(boost::asio::ip::tcp::endpoint(
+            boost::asio::ip::address_v4::loopback(), 0));
+        s.start_accept();
+
+        boost::system::error_code ec;
+        port = s.get_local_endpoint(ec).port();
+        BOOST_REQUIRE( !ec );
+
+        thread = websocketpp::lib::thread(bind(&server::run,&s));
+    }
+
+    // Record an opened connection, return whether all of them are open
+    bool add(websocketpp::connection_hdl_ref hdl) {
+        open[s.get_con_from_hdl(hdl)->get_resource()] = hdl;
+        return open.size() == expected;
+    }
+
+    void on_close(websocketpp::connection_hdl_ref) {
+        if (++closed == expected) {
+            s.stop_listening();
+        }
+    }
+
+    server s;
+    size_t expected;
+    size_t closed;
+    uint16_t port;
+    std::map<std::string, websocketpp::connection_hdl> open;
+    websocketpp::lib::thread thread;
+};
+
+// A client that records the messages each of its connections receives, by
+// resource, and closes a connection once it has received all it expects
+struct loopback_client {
+    loopback_client() {
+        c.clear_access_channels(websocketpp::log::alevel::all);
+        c.clear_error_channels(websocketpp::log::elevel::all);
+        c.init_asio();
+        c.set_message_handler(bind(&loopback_client::on_message,this,_1,_2));
+        c.set_close_handler(bind(&loopback_client::on_close,this,_1));
+    }
+
+    client::connection_ptr connect(uint16_t port, std::string const & resource,
+        size_t messages)
+    {
+        websocketpp::lib::error_code ec;
+        client::connection_ptr con = c.get_connection("ws://127.0.0.1:" +
+            std::to_string(port) + resource, ec);
+        BOOST_REQUIRE( !ec );
+        expected[resource] = messages;
+        c.connect(con);
+        return con;
+    }
+
+    void on_message(websocketpp::connection_hdl_ref hdl,
+        client::message_ptr msg)
+    {
+        std::string const & resource = c.get_con_from_hdl(hdl)->get_resource();
+        std::vector<std::string> & r = received[resource];
+        r.push_back(msg->get_payload());
+        if (r.size() == expected[resource]) {
+            c.close(hdl,websocketpp::close::status::normal,"");
+        }
+    }
+
+    void on_close(websocketpp::connection_hdl_ref hdl) {
+        client::connection_ptr con = c.get_con_from_hdl(hdl);
+        close_codes[con->get_resource()] = con->get_remote_close_code();
+    }
+
+    // Run until every connection is closed, stop both sides if that takes
+    // longer than limit seconds
+    void run(loopback_server & server, long limit = 10) {
+        c.get_io_context().run_for(std::chrono::seconds(limit));
+        BOOST_CHECK( c.get_io_context().stopped() );
+        if (!c.get_io_context().stopped()) {
+            server.s.stop();
+        }
+        server.thread.join();
+    }
+
+    client c;
+    std::map<std::string, size_t> expected;
+    std::map<std::string, std::vector<std::string> > received;
+    std::map<std::string, websocketpp::close::status::value> close_codes;
+};
+
+std::vector<std::string> numbered(size_t first, size_t last) {
+    std::vector<std::string> v;
+    for (size_t i = first; i < last; ++i) {
+        v.push_back(std::to_string(i));
+    }
+    return v;
+}
+
+BOOST_AUTO_TEST_CASE( batched_writes_in_order ) {
+    size_t const connections = 4;
+    size_t const messages = 200;
+
+    loopback_server server(connections);
+    server.s.set_open_handler([&](websocketpp::connection_hdl_ref hdl) {
+        if (!server.add(hdl)) {
+            return;
+        }
+        // every send joins the write batch of this loop turn
+        for (size_t i = 0; i < messages; ++i) {
+            std::map<std::string, websocketpp::connection_hdl>::iterator it;
+            for (it = server.open.begin(); it != server.open.end(); ++it) {
+                server.s.send(it->second, std::to_string(i),
+                    websocketpp::frame::opcode::text);
+            }
+        }
+    });
+    server.start();
+
+    loopback_client c;
+    for (size_t i = 0; i < connections; ++i) {
+        c.connect(server.port, "/" + std::to_string(i), messages);
+    }
+    c.run(server);
+
+    BOOST_CHECK_EQUAL( server.closed, connections );
+    for (size_t i = 0; i < connections; ++i) {
+        std::vector<std::string> const & r =
+            c.received["/" + std::to_string(i)];
+        std::vector<std::string> const expected = numbered(0, messages);
+        BOOST_CHECK_EQUAL_COLLECTIONS( r.begin(), r.end(),
+            expected.begin(), expected.end() );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( batched_write_connection_closes ) {
+    size_t const connections = 3;
+
+    websocketpp::lib::error_code send_after_close;
+
+    loopback_server server(connections);
+    server.s.set_open_handler([&](websocketpp::connection_hdl_ref hdl) {
+        if (!server.add(hdl)) {
+            return;
+        }
+        for (size_t i = 0; i < 10; ++i) {
+            server.s.send(server.open["/0"], std::to_string(i),
+                websocketpp::frame::opcode::text);
+            server.s.send(server.open["/1"], std::to_string(i),
+                websocketpp::frame::opcode::text);
+            server.s.send(server.open["/2"], std::to_string(i),
+                websocketpp::frame::opcode::text);
+        }
+
+        // /0 closes while its writes are still in the open batch
+        server.s.close(server.open["/0"],
+            websocketpp::close::status::going_away,"");
+        server.s.send(server.open["/0"], "late",
+            websocketpp::frame::opcode::text, send_after_close);
+
+        for (size_t i = 10; i < 20; ++i) {
+            server.s.send(server.open["/1"], std::to_string(i),
+                websocketpp::frame::opcode::text);
+            server.s.send(server.open["/2"], std::to_string(i),
+                websocketpp::frame::opcode::text);
+        }
+    });
+    server.start();
+
+    loopback_client c;
+    c.connect(server.port, "/0", 20);
+    c.connect(server.port, "/1", 20);
+    c.connect(server.port, "/2", 20);
+    c.run(server);
+
+    BOOST_CHECK_EQUAL( server.closed, connections );
+    BOOST_CHECK( send_after_close );
+
+    std::vector<std::string> const first = numbered(0, 10);
+    std::vector<std::string> const all = numbered(0, 20);
+    BOOST_CHECK_EQUAL_COLLECTIONS( c.received["/0"].begin(),
+        c.received["/0"].end(), first.begin(), first.end() );
+    BOOST_CHECK_EQUAL( c.close_codes["/0"],
+        websocketpp::close::status::going_away );
+    BOOST_CHECK_EQUAL_COLLECTIONS( c.received["/1"].begin(),
+        c.received["/1"].end(), all.begin(), all.end() );
+    BOOST_CHECK_EQUAL_COLLECTIONS( c.received["/2"].begin(),
+        c.received["/2"].end(), all.begin(), all.end() );
+}
+
+// Binary data whose bytes depend on their position, so a misplaced chunk
+// doesn't compare equal
+std::string pattern(size_t size, unsigned seed) {
+    std::string s(size, '\0');
+    uint32_t x = seed * 2654435761u + 1;
+    for (size_t i = 0; i < size; ++i) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        s[i] = char(x);
+    }
+    return s;
+}
+
+// Kernel buffers small enough that an inline write of a large message only
+// gets partly through and leaves the rest for the asynchronous write
+websocketpp::transport::asio::socket_options small_buffers() {
+    websocketpp::transport::asio::socket_options o;
+    o.send_buffer = 4096;
+    o.receive_buffer = 4096;
+    return o;
+}
+
+BOOST_AUTO_TEST_CASE( inline_write_short_write ) {
+    std::string const first = pattern(2000000, 1);
+    std::string const second = pattern(1000000, 2);
+
+    loopback_server server(1);
+    server.s.set_socket_options(small_buffers());
+    server.s.set_open_handler([&](websocketpp::connection_hdl_ref hdl) {
+        server.add(hdl);
+        server.s.send(hdl, first, websocketpp::frame::opcode::binary);
+        server.s.send(hdl, "middle", websocketpp::frame::opcode::binary);
+        server.s.send(hdl, second, websocketpp::frame::opcode::binary);
+        server.s.send(hdl, "end", websocketpp::frame::opcode::binary);
+    });
+    server.start();
+
+    loopback_client c;
+    c.c.set_socket_options(small_buffers());
+    c.connect(server.port, "/", 4);
+    c.run(server);
+
+    std::vector<std::string> const & r = c.received["/"];
+    BOOST_REQUIRE_EQUAL( r.size(), 4 );
+    BOOST_CHECK( r[0] == first );
+    BOOST_CHECK_EQUAL( r[1], "middle" );
+    BOOST_CHECK( r[2] == second );
+    BOOST_CHECK_EQUAL( r[3], "end" );
+}
+
+// The client stops reading for a while, so the server's write of a large
+// message stays partial, and action runs on the server while it does
+void write_rest_pending(loopback_server & server, loopback_client & c,
+    std::string const & message,
+    websocketpp::lib::function<void(websocketpp::connection_hdl)> action)
+{
+    server::timer_ptr action_timer;
+    client::timer_ptr resume_timer;
+
+    server.s.set_socket_options(small_buffers());
+    server.s.set_open_handler([&](websocketpp::connection_hdl_ref hdl) {
+        server.add(hdl);
+        server.s.send(hdl, message, websocketpp::frame::opcode::binary);
+
+        websocketpp::connection_hdl h = hdl;
+        action_timer = server.s.set_timer(50,
+            [&action, h](websocketpp::lib::error_code const & ec) {
+                if (!ec) {
+                    action(h);
+                }
+            });
+    });
+    server.start();
+
+    c.c.set_socket_options(small_buffers());
+    c.c.set_open_handler([&](websocketpp::connection_hdl_ref hdl) {
+        c.c.pause_reading(hdl);
+
+        websocketpp::connection_hdl h = hdl;
+        resume_timer = c.c.set_timer(300,
+            [&c, h](websocketpp::lib::error_code const & ec) {
+                if (!ec) {
+                    c.c.resume_reading(h);
+                }
+            });
+    });
+    // A paused connection has no read pending to keep it alive. The second
+    // message is never reached, the server ends the connection first.
+    client::connection_ptr con = c.connect(server.port, "/", 2);
+    c.run(server);
+}
+
+BOOST_AUTO_TEST_CASE( close_with_write_rest_pending ) {
+    std::string const message = pattern(2000000, 3);
+
+    loopback_server server(1);
+    loopback_client c;
+    write_rest_pending(server, c, message,
+        [&](websocketpp::connection_hdl hdl) {
+            server.s.close(hdl,websocketpp::close::status::going_away,"");
+        });
+
+    // the close frame follows the rest of the message
+    BOOST_CHECK_EQUAL( server.closed, 1 );
+    std::vector<std::string> const & r = c.received["/"];
+    BOOST_REQUIRE_EQUAL( r.size(), 1 );
+    BOOST_CHECK( r[0] == message );
+    BOOST_CHECK_EQUAL( c.close_codes["/"],
+        websocketpp::close::status::going_away );
+}
+
+BOOST_AUTO_TEST_CASE( terminate_with_write_rest_pending ) {
+    std::string const message = pattern(2000000, 4);
+
+    loopback_server server(1);
+    loopback_client c;
+    write_rest_pending(server, c, message,
+        [&](websocketpp::connection_hdl hdl) {
+            server.s.get_con_from_hdl(hdl)->terminate(
+                websocketpp::error::make_error_code(
+                websocketpp::error::general));
+        });
+
+    // the pending write is abandoned, the connection ends once
+    BOOST_CHECK_EQUAL( server.closed, 1 );
+    BOOST_CHECK( c.received["/"].empty() );
+    BOOST_CHECK_EQUAL( c.close_codes.count("/"), 1 );
+}
@@ -467,6 +467,89 @@ BOOST_AUTO_TEST_CASE( async_read_at_least2 ) {
     BOOST_CHECK_EQUAL( std::string(buf,10), "abcdefgxxx" );
 }
 
+BOOST_AUTO_TEST_CASE( get_read_buffer_commit_read ) {
+    stub_con::ptr con(new stub_con(true,alogger,elogger));
+
+    size_t len;
+    BOOST_CHECK( con->get_read_buffer(len) == NULL );
+    BOOST_CHECK_EQUAL( len, 0 );
+    BOOST_CHECK_EQUAL( con->commit_read(3), 0 );
+
+    char buf[10];
+    memset(buf,'x',10);
+    con->async_read_at_least(5,buf,8);
+
+    char * in = con->get_read_buffer(len);
+    BOOST_CHECK( in == buf );
+    BOOST_CHECK_EQUAL( len, 8 );
+    memcpy(in,"abc",3);
+    BOOST_CHECK_EQUAL( con->commit_read(3), 3 );
+    BOOST_CHECK_EQUAL( con->ec, make_error_code(websocketpp::error::test) );
+
+    in = con->get_read_buffer(len);
+    BOOST_CHECK( in == buf+3 );
+    BOOST_CHECK_EQUAL( len, 5 );
+    memcpy(in,"defgh",5);
+    BOOST_CHECK_EQUAL( con->commit_read(9), 5 );
+    BOOST_CHECK( !con->ec );
+    BOOST_CHECK_EQUAL( std::string(buf,10), "abcdefghxx" );
+    BOOST_CHECK( con->get_read_buffer(len) == NULL );
+}
+
+BOOST_AUTO_TEST_CASE( pull_output ) {
+    stub_con::ptr con(new stub_con(true,alogger,elogger));
+    std::stringstream output;
+    con->register_ostream(&output);
+    con->set_pull_output(true);
+
+    size_t ready = 0;
+    con->set_output_ready_handler([&ready](websocketpp::connection_hdl) {
+        ++ready;
+    });
+
+    std::string foo = "foo";
+    std::string barbaz = "barbaz";
+    std::vector<websocketpp::transport::buffer> bufs;
+    bufs.push_back(websocketpp::transport::buffer(foo.data(),foo.size()));
+    bufs.push_back(websocketpp::transport::buffer(barbaz.data(),
+        barbaz.size()));
+    con->write(bufs);
+
+    BOOST_CHECK_EQUAL( ready, 1 );
+    BOOST_CHECK_EQUAL( con->ec, make_error_code(websocketpp::error::test) );
+
+    size_t count;
+    websocketpp::transport::buffer const * out = con->get_output(count);
+    BOOST_REQUIRE_EQUAL( count, 2 );
+    BOOST_CHECK( out[0].buf == foo.data() );
+    BOOST_CHECK_EQUAL( out[1].len, 6 );
+
+    // a second write while the first is held is refused
+    con->write("qux");
+    BOOST_CHECK_EQUAL( con->ec, make_error_code(
+        websocketpp::transport::iostream::error::double_write) );
+    con->ec = websocketpp::error::make_error_code(websocketpp::error::test);
+
+    con->consume_output(5);
+    out = con->get_output(count);
+    BOOST_REQUIRE_EQUAL( count, 1 );
+    BOOST_CHECK_EQUAL( std::string(out[0].buf,out[0].len), "rbaz" );
+    BOOST_CHECK_EQUAL( con->ec, make_error_code(websocketpp::error::test) );
+
+    con->consume_output(4);
+    BOOST_CHECK( !con->ec );
+    BOOST_CHECK( con->get_output(count) == NULL );
+    BOOST_CHECK_EQUAL( count, 0 );
+    BOOST_CHECK_EQUAL( output.str(), "" );
+
+    // eof fails held output
+    con->write("qux");
+    con->eof();
+    BOOST_CHECK_EQUAL( con->ec, make_error_code(
+        websocketpp::transport::error::eof) );
+    BOOST_CHECK( con->get_output(count) == NULL );
+}
+
 void timer_callback_stub(websocketpp::lib::error_code const &) {}
 
 BOOST_AUTO_TEST_CASE( set_timer ) {
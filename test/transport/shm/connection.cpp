@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE transport_shm_connection
+#include <boost/test/unit_test.hpp>
+
+#include <cstring>
+#include <sstream>
+#include <string>
+
+#include <unistd.h>
+
+#include <websocketpp/config/shm.hpp>
+#include <websocketpp/client.hpp>
+#include <websocketpp/server.hpp>
+
+namespace lib = websocketpp::lib;
+
+using websocketpp::transport::shm::channel;
+
+struct server_config : public websocketpp::config::shm {
+    static constexpr websocketpp::log::level elog_level =
+        websocketpp::log::elevel::none;
+    static constexpr websocketpp::log::level alog_level =
+        websocketpp::log::alevel::none;
+};
+
+struct client_config : public websocketpp::config::shm_client {
+    static constexpr websocketpp::log::level elog_level =
+        websocketpp::log::elevel::none;
+    static constexpr websocketpp::log::level alog_level =
+        websocketpp::log::alevel::none;
+};
+
+typedef websocketpp::server<server_config> server;
+typedef websocketpp::client<client_config> client;
+
+BOOST_AUTO_TEST_CASE( ring_wraps_and_fills ) {
+    lib::error_code ec;
+    channel::ptr c = channel::create("", 100, ec);
+    BOOST_REQUIRE( !ec );
+    BOOST_CHECK_EQUAL( c->capacity(), 128 );
+
+    char out[256];
+    std::string a(100, 'a');
+    BOOST_CHECK_EQUAL( c->push(0, a.data(), a.size()), 100 );
+    BOOST_CHECK_EQUAL( c->readable(1), 100 );
+    BOOST_CHECK_EQUAL( c->readable(0), 0 );
+    BOOST_CHECK_EQUAL( c->pop(1, out, 90), 90 );
+
+    // wraps around the end of the ring, then stops when it is full
+    std::string b;
+    for (int i = 0; i < 200; ++i) {
+        b.push_back(char('0' + i % 10));
+    }
+    BOOST_CHECK_EQUAL( c->push(0, b.data(), b.size()), 118 );
+    BOOST_CHECK_EQUAL( c->writable(0), 0 );
+
+    BOOST_CHECK_EQUAL( c->pop(1, out, sizeof(out)), 128 );
+    BOOST_CHECK_EQUAL( std::string(out, 10), std::string(10, 'a') );
+    BOOST_CHECK_EQUAL( std::string(out + 10, 118), b.substr(0, 118) );
+    BOOST_CHECK_EQUAL( c->pop(1, out, sizeof(out)), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( invalid_capacity ) {
+    lib::error_code ec;
+    BOOST_CHECK( !channel::create("", 0, ec) );
+    BOOST_CHECK_EQUAL( ec, websocketpp::transport::shm::error::make_error_code(
+        websocketpp::transport::shm::error::invalid_capacity) );
+}
+
+BOOST_AUTO_TEST_CASE( named_channel ) {
+    std::stringstream name;
+    name << "/wspp-test-" << ::getpid();
+
+    lib::error_code ec;
+    channel::ptr created = channel::create(name.str(), 4096, ec);
+    if (ec == lib::errc::function_not_supported ||
+        ec == lib::errc::permission_denied)
+    {
+        // no shm_open in this environment
+        return;
+    }
+    BOOST_REQUIRE( !ec );
+
+    channel::create(name.str(), 4096, ec);
+    BOOST_CHECK( ec == lib::errc::file_exists );
+
+    channel::ptr opened = channel::open(name.str(), ec);
+    BOOST_REQUIRE( !ec );
+    BOOST_CHECK_EQUAL( opened->capacity(), 4096 );
+
+    BOOST_CHECK_EQUAL( opened->push(1, "hello", 5), 5 );
+    char out[8];
+    BOOST_CHECK_EQUAL( created->pop(0, out, sizeof(out)), 5 );
+    BOOST_CHECK_EQUAL( std::string(out, 5), "hello" );
+
+    created.reset();
+    channel::open(name.str(), ec);
+    BOOST_CHECK( ec == lib::errc::no_such_file_or_directory );
+}
+
+BOOST_AUTO_TEST_CASE( wait_wakes_and_times_out ) {
+    lib::error_code ec;
+    channel::ptr c = channel::create("", 64, ec);
+    BOOST_REQUIRE( !ec );
+
+    auto readable = [&c]() { return c->readable(0) != 0; };
+    BOOST_CHECK( !c->wait(0, readable, lib::chrono::milliseconds(10)) );
+
+    lib::thread writer([&c]() {
+        lib::this_thread::sleep_for(lib::chrono::milliseconds(20));
+        c->push(1, "x", 1);
+        c->notify_peer(1);
+    });
+    BOOST_CHECK( c->wait(0, readable, lib::chrono::seconds(10)) );
+    writer.join();
+    BOOST_CHECK_EQUAL( c->readable(0), 1 );
+
+    // ready before sleeping, returns without waiting
+    BOOST_CHECK( c->wait(0, readable, lib::chrono::seconds(10)) );
+}
+
+BOOST_AUTO_TEST_CASE( echo_over_channel ) {
+    lib::error_code ec;
+    // smaller than the message, so writes complete over several polls
+    channel::ptr c = channel::create("", 256, ec);
+    BOOST_REQUIRE( !ec );
+
+    server s;
+    s.set_message_handler([&s](websocketpp::connection_hdl hdl,
+        server::message_ptr msg)
+    {
+        s.send(hdl, msg->get_payload(), msg->get_opcode());
+    });
+
+    client cl;
+    std::string const payload(5000, 'p');
+    std::string echoed;
+    bool opened = false;
+    cl.set_open_handler([&](websocketpp::connection_hdl hdl) {
+        opened = true;
+        cl.send(hdl, payload, websocketpp::frame::opcode::binary);
+    });
+    cl.set_message_handler([&](websocketpp::connection_hdl hdl,
+        client::message_ptr msg)
+    {
+        echoed = msg->get_payload();
+        cl.close(hdl, websocketpp::close::status::normal, "");
+    });
+
+    server::connection_ptr scon = s.get_connection(ec);
+    BOOST_REQUIRE( !ec );
+    scon->set_channel(c, 0);
+    scon->start();
+
+    client::connection_ptr ccon = cl.get_connection("ws://localhost/", ec);
+    BOOST_REQUIRE( !ec );
+    ccon->set_channel(c, 1);
+    cl.connect(ccon);
+
+    for (int i = 0; i < 10000; ++i) {
+        if (scon->get_state() == websocketpp::session::state::closed &&
+            ccon->get_state() == websocketpp::session::state::closed)
+        {
+            break;
+        }
+        scon->poll();
+        ccon->poll();
+    }
+
+    BOOST_CHECK( opened );
+    BOOST_CHECK( echoed == payload );
+    BOOST_CHECK_EQUAL( ccon->get_state(), websocketpp::session::state::closed );
+    BOOST_CHECK_EQUAL( scon->get_state(), websocketpp::session::state::closed );
+    BOOST_CHECK_EQUAL( scon->get_remote_close_code(),
+        websocketpp::close::status::normal );
+}
+
+BOOST_AUTO_TEST_CASE( start_without_channel ) {
+    server s;
+    lib::error_code ec;
+    server::connection_ptr con = s.get_connection(ec);
+    BOOST_REQUIRE( !ec );
+
+    con->start();
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::closed );
+    BOOST_CHECK_EQUAL( con->get_ec(),
+        websocketpp::transport::shm::error::make_error_code(
+        websocketpp::transport::shm::error::channel_required) );
+}
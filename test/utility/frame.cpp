@@ -28,6 +28,7 @@
 #define BOOST_TEST_MODULE frame
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
 #include <iostream>
 #include <string>
 
@@ -536,3 +537,205 @@ BOOST_AUTO_TEST_CASE( continuous_word_mask2 ) {
     frame::word_mask_circ(buffer,12,pkey);
     BOOST_CHECK( std::equal(buffer,buffer+12,unmasked) );
 }
+
+// Signature shared by all of the circular masking kernels
+typedef size_t (*mask_circ_kernel)(uint8_t const *, uint8_t *, size_t, size_t);
+
+// Check a circular masking kernel against the byte by byte reference for a
+// range of lengths, buffer alignments, and split points.
+void check_mask_circ_kernel(mask_circ_kernel kernel) {
+    frame::masking_key_type key;
+    key.c[0] = 0xEE;
+    key.c[1] = 0x70;
+    key.c[2] = 0xFB;
+    key.c[3] = 0xD5;
+
+    uint8_t input[320];
+    uint8_t expected[320];
+    uint8_t output[320];
+
+    for (size_t i = 0; i < sizeof(input); ++i) {
+        input[i] = static_cast<uint8_t>(i * 7 + 3);
+    }
+
+    for (size_t align = 0; align < 8; ++align) {
+        for (size_t length = 0; length + align <= 300; ++length) {
+            frame::byte_mask(input+align,input+align+length,expected,key);
+
+            // One call
+            std::fill_n(output,sizeof(output),0x00);
+            size_t pkey = frame::prepare_masking_key(key);
+            size_t pkey_temp = kernel(input+align,output+align,length,pkey);
+            BOOST_CHECK( std::equal(expected,expected+length,output+align) );
+            BOOST_CHECK_EQUAL( pkey_temp,
+                frame::circshift_prepared_key(pkey,length%sizeof(size_t)) );
+
+            // Bytes outside the range must be left alone
+            BOOST_CHECK( std::count(output,output+align,0x00) ==
+                static_cast<std::ptrdiff_t>(align) );
+            BOOST_CHECK( std::count(output+align+length,output+sizeof(output),
+                0x00) == static_cast<std::ptrdiff_t>(
+                    sizeof(output)-align-length) );
+
+            // Two calls split at an arbitrary point
+            size_t split = length / 3;
+            std::fill_n(output,sizeof(output),0x00);
+            pkey_temp = kernel(input+align,output+align,split,pkey);
+            kernel(input+align+split,output+align+split,length-split,
+                pkey_temp);
+            BOOST_CHECK( std::equal(expected,expected+length,output+align) );
+        }
+    }
+
+    // In place
+    std::copy(input,input+sizeof(input),output);
+    kernel(output+1,output+1,257,frame::prepare_masking_key(key));
+    frame::byte_mask(input+1,input+258,expected,key);
+    BOOST_CHECK( std::equal(expected,expected+257,output+1) );
+}
+
+BOOST_AUTO_TEST_CASE( word_mask_circ_kernel ) {
+    check_mask_circ_kernel(&frame::word_mask_circ);
+}
+
+#ifdef _WEBSOCKETPP_SIMD_SSE2_
+BOOST_AUTO_TEST_CASE( sse2_mask_circ_kernel ) {
+    check_mask_circ_kernel(&frame::sse2_mask_circ);
+}
+#endif
+
+#ifdef _WEBSOCKETPP_SIMD_AVX2_
+BOOST_AUTO_TEST_CASE( avx2_mask_circ_kernel ) {
+    check_mask_circ_kernel(&frame::avx2_mask_circ);
+}
+#endif
+
+#ifdef _WEBSOCKETPP_SIMD_NEON_
+BOOST_AUTO_TEST_CASE( neon_mask_circ_kernel ) {
+    check_mask_circ_kernel(&frame::neon_mask_circ);
+}
+#endif
+
+BOOST_AUTO_TEST_CASE( dispatch_mask_circ_kernel ) {
+    size_t (*kernel)(uint8_t const *, uint8_t *, size_t, size_t) =
+        &frame::mask_circ;
+    check_mask_circ_kernel(kernel);
+}
+
+BOOST_AUTO_TEST_CASE( dispatch_mask_exact ) {
+    uint8_t input[100];
+    uint8_t output[100];
+    uint8_t expected[100];
+
+    frame::masking_key_type key;
+    key.i = 0x12345678;
+
+    for (size_t i = 0; i < sizeof(input); ++i) {
+        input[i] = static_cast<uint8_t>(i);
+    }
+
+    frame::byte_mask(input,input+99,expected,key);
+    frame::mask_exact(input,output,99,key);
+    BOOST_CHECK( std::equal(expected,expected+99,output) );
+
+    frame::word_mask_exact(input,output,99,key);
+    BOOST_CHECK( std::equal(expected,expected+99,output) );
+
+    frame::mask_exact(input,99,key);
+    BOOST_CHECK( std::equal(expected,expected+99,input) );
+}
+
+BOOST_AUTO_TEST_CASE( mask_circ_utf8_valid ) {
+    frame::masking_key_type key;
+    key.i = 0x9A3C17E5;
+
+    // ASCII runs long enough to hit the vector blocks with multi-byte
+    // sequences placed on and across block boundaries.
+    std::string text(40,'a');
+    text += "\xCE\xBA\xE1\xBD\xB9\xCF\x83\xCE\xBC\xCE\xB5";
+    text += std::string(13,'b');
+    text += "\xF0\x9F\x98\x80";
+    text += std::string(70,'c');
+
+    std::string masked(text.size(),'\0');
+    frame::byte_mask(text.begin(),text.end(),masked.begin(),key);
+
+    for (size_t split = 0; split <= masked.size(); ++split) {
+        std::string buf = masked;
+        uint8_t * data = reinterpret_cast<uint8_t *>(&buf[0]);
+        size_t pkey = frame::prepare_masking_key(key);
+        utf8_validator::validator v;
+
+        BOOST_CHECK( frame::mask_circ_utf8(data,data,split,pkey,v) );
+        BOOST_CHECK( frame::mask_circ_utf8(data+split,data+split,
+            buf.size()-split,pkey,v) );
+        BOOST_CHECK( v.complete() );
+        BOOST_CHECK_EQUAL( buf, text );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( mask_circ_utf8_invalid ) {
+    frame::masking_key_type key;
+    key.i = 0x01020304;
+
+    // invalid continuation byte at various offsets in an otherwise ASCII
+    // payload
+    for (size_t pos = 0; pos < 100; ++pos) {
+        std::string text(100,'x');
+        text[pos] = '\x80';
+
+        std::string masked(text.size(),'\0');
+        frame::byte_mask(text.begin(),text.end(),masked.begin(),key);
+
+        uint8_t * data = reinterpret_cast<uint8_t *>(&masked[0]);
+        size_t pkey = frame::prepare_masking_key(key);
+        utf8_validator::validator v;
+
+        BOOST_CHECK( !frame::mask_circ_utf8(data,data,masked.size(),pkey,v) );
+    }
+
+    // truncated sequence is not an error until the message is complete
+    std::string text(33,'x');
+    text += "\xE2\x82";
+    std::string masked(text.size(),'\0');
+    frame::byte_mask(text.begin(),text.end(),masked.begin(),key);
+
+    uint8_t * data = reinterpret_cast<uint8_t *>(&masked[0]);
+    size_t pkey = frame::prepare_masking_key(key);
+    utf8_validator::validator v;
+
+    BOOST_CHECK( frame::mask_circ_utf8(data,data,masked.size(),pkey,v) );
+    BOOST_CHECK( !v.complete() );
+}
+
+BOOST_AUTO_TEST_CASE( header_buffer_encode ) {
+    frame::masking_key_type key;
+    key.c[0] = 0x12;
+    key.c[1] = 0x34;
+    key.c[2] = 0x56;
+    key.c[3] = 0x78;
+
+    uint64_t const sizes[] = {0, 5, 125, 126, 65535, 65536, 0x100000000ull};
+
+    for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); ++i) {
+        uint64_t size = sizes[i];
+
+        frame::header_buffer plain;
+        plain.encode<false>(frame::opcode::binary,size,true,true);
+        frame::basic_header h1(frame::opcode::binary,size,true,false,true);
+        BOOST_CHECK_EQUAL( plain, frame::prepare_header(h1,
+            frame::extended_header(size)) );
+
+        frame::header_buffer masked;
+        masked.encode<true>(frame::opcode::text,size,false,false,key);
+        frame::basic_header h2(frame::opcode::text,size,false,true);
+        BOOST_CHECK_EQUAL( masked, frame::prepare_header(h2,
+            frame::extended_header(size,key.i)) );
+        BOOST_CHECK_EQUAL( masked.size(), plain.size() + 4 );
+    }
+
+    frame::header_buffer h;
+    h.encode<false>(frame::opcode::ping,0,true);
+    BOOST_CHECK_EQUAL( h, std::string("\x89\x00",2) );
+    BOOST_CHECK_EQUAL( std::string(h), std::string("\x89\x00",2) );
+}
@@ -31,6 +31,7 @@
 #include <iostream>
 #include <string>
 
+#include <websocketpp/base64/base64.hpp>
 #include <websocketpp/sha1/sha1.hpp>
 #include <websocketpp/utilities.hpp>
 
@@ -78,4 +79,40 @@ BOOST_AUTO_TEST_CASE( sha1_test_c ) {
     BOOST_CHECK_EQUAL_COLLECTIONS(hash, hash+20, reference, reference+20);
 }
 
+BOOST_AUTO_TEST_CASE( sha1_padding_boundaries ) {
+    // lengths on either side of the one/two padding block split
+    struct { size_t len; char const * hex; } const cases[] = {
+        {55, "C1 C8 BB DC 22 79 6E 28 C0 E1 51 63 D2 08 99 B6 56 21 D6 5A "},
+        {56, "C2 DB 33 0F 60 83 85 4C 99 D4 B5 BF B6 E8 F2 9F 20 1B E6 99 "},
+        {63, "03 F0 9F 5B 15 8A 7A 8C DA D9 20 BD DC 29 B8 1C 18 A5 51 F5 "},
+        {64, "00 98 BA 82 4B 5C 16 42 7B D7 A1 12 2A 5A 44 2A 25 EC 64 4D "},
+        {119, "EE 97 10 65 AA A0 17 E0 63 2A 8C A6 C7 7B B3 BF 8B 1D FC 56 "}
+    };
+
+    for (size_t i = 0; i < sizeof(cases)/sizeof(cases[0]); ++i) {
+        std::string input(cases[i].len, 'a');
+        unsigned char hash[20];
+
+        websocketpp::sha1::calc(input.data(),input.size(),hash);
+
+        BOOST_CHECK_EQUAL(websocketpp::utility::to_hex(hash,20),
+            cases[i].hex);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( sha1_accept_key ) {
+    // RFC 6455 section 1.3 example
+    std::string key = "dGhlIHNhbXBsZSBub25jZQ==258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    unsigned char hash[20];
+    char accept[28];
+
+    websocketpp::sha1::calc(key.data(),key.size(),hash);
+
+    BOOST_CHECK_EQUAL(websocketpp::base64_encoded_size(20), 28u);
+    BOOST_CHECK_EQUAL(websocketpp::base64_encode(hash,20,accept), 28u);
+    BOOST_CHECK_EQUAL(std::string(accept,28), "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+    BOOST_CHECK_EQUAL(websocketpp::base64_encode(hash,20),
+        "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -380,4 +380,18 @@ BOOST_AUTO_TEST_CASE( uri_invalid_no_scheme ) {
     BOOST_CHECK( !uri.get_valid() );
 }
 
+// Percent encoded characters are kept in the host, a bad escape is invalid
+BOOST_AUTO_TEST_CASE( uri_pct_encoded_host ) {
+    websocketpp::uri uri("ws://my%20server:9000/chat");
+
+    BOOST_CHECK( uri.get_valid() );
+    BOOST_CHECK_EQUAL( uri.get_host(), "my%20server" );
+    BOOST_CHECK_EQUAL( uri.get_port(), 9000 );
+    BOOST_CHECK_EQUAL( uri.get_resource(), "/chat" );
+
+    BOOST_CHECK( !websocketpp::uri("ws://my%2server/").get_valid() );
+    BOOST_CHECK( !websocketpp::uri("ws://server%2").get_valid() );
+    BOOST_CHECK( !websocketpp::uri("ws://server:99999/").get_valid() );
+}
+
 // TODO: tests for the other constructors, especially with IP literals
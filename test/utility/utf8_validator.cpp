@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+//#define BOOST_TEST_DYN_LINK
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE utf8_validator
+#include <boost/test/unit_test.hpp>
+
+#include <cstdlib>
+#include <string>
+
+#include <websocketpp/utf8_validator.hpp>
+
+using namespace websocketpp;
+
+// Reference result using the byte at a time state machine
+bool reference_validate(std::string const & s) {
+    utf8_validator::validator v;
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (!v.consume(static_cast<uint8_t>(s[i]))) {
+            return false;
+        }
+    }
+    return v.complete();
+}
+
+// Result using the block validator, fed in two pieces
+bool split_validate(std::string const & s, size_t split) {
+    utf8_validator::validator v;
+    if (!v.decode(s.begin(),s.begin()+split)) {
+        return false;
+    }
+    if (!v.decode(s.begin()+split,s.end())) {
+        return false;
+    }
+    return v.complete();
+}
+
+std::string const samples[] = {
+    "a",
+    "\xCE\xBA\xE1\xBD\xB9\xCF\x83\xCE\xBC\xCE\xB5",  // greek
+    "\xE2\x82\xAC",                                  // euro sign
+    "\xF0\x9F\x98\x80",                              // emoji
+    "\xF4\x8F\xBF\xBF",                              // U+10FFFF
+    "\xC0\xAF",                                      // overlong 2 byte
+    "\xE0\x80\xAF",                                  // overlong 3 byte
+    "\xF0\x80\x80\xAF",                              // overlong 4 byte
+    "\xED\xA0\x80",                                  // surrogate
+    "\xF4\x90\x80\x80",                              // > U+10FFFF
+    "\xF8\x88\x80\x80\x80",                          // 5 byte form
+    "\x80",                                          // lone continuation
+    "\xC2",                                          // truncated
+    "\xE2\x82",                                      // truncated
+    "\xFF"
+};
+
+BOOST_AUTO_TEST_CASE( ascii_prefix ) {
+    std::string s(100,'x');
+    uint8_t const * data = reinterpret_cast<uint8_t const *>(s.data());
+
+    BOOST_CHECK_EQUAL( utf8_validator::ascii_prefix(data,s.size()), 100 );
+
+    for (size_t i = 0; i < s.size(); ++i) {
+        std::string t = s;
+        t[i] = '\xC3';
+        BOOST_CHECK_EQUAL( utf8_validator::ascii_prefix(
+            reinterpret_cast<uint8_t const *>(t.data()),t.size()), i );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( known_sequences ) {
+    size_t const n = sizeof(samples)/sizeof(samples[0]);
+
+    for (size_t i = 0; i < n; ++i) {
+        // alone, embedded in ASCII, and repeated enough to use the full
+        // block validator.
+        std::string alone = samples[i];
+        std::string embedded = std::string(37,'a') + samples[i] +
+            std::string(41,'b');
+        std::string repeated;
+        for (size_t j = 0; j < 40; ++j) {
+            repeated += samples[1];
+            repeated += (j == 23 ? samples[i] : samples[2]);
+        }
+
+        std::string const * inputs[] = {&alone, &embedded, &repeated};
+        for (size_t k = 0; k < 3; ++k) {
+            std::string const & s = *inputs[k];
+            bool expected = reference_validate(s);
+
+            BOOST_CHECK_EQUAL( utf8_validator::validate(s), expected );
+            for (size_t split = 0; split <= s.size(); ++split) {
+                BOOST_CHECK_EQUAL( split_validate(s,split), expected );
+            }
+        }
+    }
+
+    BOOST_CHECK( utf8_validator::validate(samples[1]) );
+    BOOST_CHECK( !utf8_validator::validate(samples[5]) );
+}
+
+BOOST_AUTO_TEST_CASE( random_sequences ) {
+    // random strings built mostly from valid pieces with occasional random
+    // bytes mixed in.
+    std::srand(42);
+    size_t const n = sizeof(samples)/sizeof(samples[0]);
+
+    for (size_t trial = 0; trial < 2000; ++trial) {
+        std::string s;
+        size_t pieces = std::rand() % 80;
+        for (size_t j = 0; j < pieces; ++j) {
+            int r = std::rand() % 100;
+            if (r < 40) {
+                s.append(static_cast<size_t>(std::rand() % 20),'z');
+            } else if (r < 95) {
+                s += samples[std::rand() % 5];
+            } else if (r < 98) {
+                s += samples[std::rand() % n];
+            } else {
+                s += static_cast<char>(std::rand() % 256);
+            }
+        }
+
+        bool expected = reference_validate(s);
+        BOOST_CHECK_EQUAL( utf8_validator::validate(s), expected );
+        BOOST_CHECK_EQUAL( split_validate(s,s.size()/2), expected );
+    }
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+//#define BOOST_TEST_DYN_LINK
+// Microbenchmark for the UTF8 validator. Not a unit test. Build with
+// optimization and optionally with -mssse3/-mavx2 to compare kernels, e.g.
+//   g++ -std=c++20 -O2 -I../.. utf8_validator_perf.cpp -o utf8_perf
+// "byte" is the state machine fed one byte at a time (the previous
+// implementation of validator::decode). "block" is the current decode.
+
+#include <websocketpp/utf8_validator.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+class scoped_timer {
+public:
+    scoped_timer(std::string i, size_t bytes)
+      : m_id(i)
+      , m_bytes(bytes)
+      , m_start(std::chrono::steady_clock::now())
+    {
+        std::cout << "Clock " << i << ": ";
+    }
+    ~scoped_timer() {
+        std::chrono::nanoseconds time_taken =
+            std::chrono::steady_clock::now()-m_start;
+
+        // megabytes per second
+        std::cout << (double(m_bytes)/1000000.0) /
+            (double(time_taken.count())/1000000000.0) << " MB/s" << std::endl;
+    }
+
+private:
+    std::string m_id;
+    size_t m_bytes;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+bool byte_validate(std::string const & s) {
+    websocketpp::utf8_validator::validator v;
+    for (std::string::const_iterator it = s.begin(); it != s.end(); ++it) {
+        if (!v.consume(static_cast<uint8_t>(*it))) {
+            return false;
+        }
+    }
+    return v.complete();
+}
+
+void run(std::string const & name, std::string payload) {
+    int const iterations = 2000;
+    size_t total = payload.size() * iterations;
+    volatile int ok = 0;
+
+    // The first byte is rewritten every iteration so that the compiler can't
+    // hoist validation of the unchanged payload out of the loop.
+    {
+        scoped_timer timer(name + " byte ", total);
+        for (int i = 0; i < iterations; i++) {
+            payload[0] = static_cast<char>('{' + (i & 1));
+            ok = ok + byte_validate(payload);
+        }
+    }
+    {
+        scoped_timer timer(name + " block", total);
+        for (int i = 0; i < iterations; i++) {
+            payload[0] = static_cast<char>('{' + (i & 1));
+            ok = ok + websocketpp::utf8_validator::validate(payload);
+        }
+    }
+
+    if (ok != 2 * iterations) {
+        std::cout << "validation error" << std::endl;
+    }
+}
+
+int main() {
+    std::string json;
+    while (json.size() < 65536) {
+        json += "{\"id\":12345,\"symbol\":\"ABCD\",\"bid\":101.25,\"ask\":101.5,"
+                "\"ts\":\"2014-01-01T00:00:00Z\"},";
+    }
+
+    std::string mixed;
+    while (mixed.size() < 65536) {
+        mixed += "{\"name\":\"\xCE\xBA\xE1\xBD\xB9\xCF\x83\xCE\xBC\xCE\xB5\","
+                 "\"price\":\"\xE2\x82\xAC" "12\"},";
+    }
+
+    std::string greek = "{";
+    while (greek.size() < 65536) {
+        greek += "\xCE\xBA\xE1\xBD\xB9\xCF\x83\xCE\xBC\xCE\xB5";
+    }
+
+    run("ascii json ", json);
+    run("mixed json ", mixed);
+    run("greek      ", greek);
+
+    return 0;
+}
@@ -0,0 +1,666 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_AWAITABLE_HPP
+#define WEBSOCKETPP_AWAITABLE_HPP
+
+#include <websocketpp/close.hpp>
+#include <websocketpp/endpoint.hpp>
+#include <websocketpp/error.hpp>
+#include <websocketpp/frame.hpp>
+
+#include <websocketpp/common/asio.hpp>
+#include <websocketpp/common/connection_hdl.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/system_error.hpp>
+#include <websocketpp/common/thread.hpp>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace websocketpp {
+
+/// A completion handler waiting for the result of an operation
+/**
+ * Holds a handler of any type with the signature `void(Args...)` until
+ * complete posts it, with the results, to its associated executor. The
+ * handler is stored in memory from its associated allocator, and keeps its
+ * executor busy while it waits, as Asio requires of asynchronous operations.
+ *
+ * @since 0.9.0
+ */
+template <typename... Args>
+class parked_handler {
+public:
+    parked_handler() : m_impl(NULL) {}
+
+    template <typename handler_type, typename executor_type>
+    parked_handler(handler_type && h, executor_type const & io)
+      : m_impl(NULL)
+    {
+        typedef typename std::decay<handler_type>::type handler;
+        typedef typename lib::asio::associated_executor<handler,
+            executor_type>::type handler_executor;
+        typedef impl<handler, handler_executor> impl_type;
+        typedef typename std::allocator_traits<typename
+            lib::asio::associated_allocator<handler>::type>::template
+            rebind_alloc<impl_type> alloc_type;
+
+        alloc_type alloc(lib::asio::get_associated_allocator(h));
+        impl_type * p = std::allocator_traits<alloc_type>::allocate(alloc, 1);
+        handler_executor ex = lib::asio::get_associated_executor(h, io);
+        new (p) impl_type(std::forward<handler_type>(h), ex);
+        m_impl = p;
+    }
+
+    parked_handler(parked_handler && o) : m_impl(o.m_impl) {
+        o.m_impl = NULL;
+    }
+
+    parked_handler & operator=(parked_handler && o) {
+        if (this != &o) {
+            reset();
+            m_impl = o.m_impl;
+            o.m_impl = NULL;
+        }
+        return *this;
+    }
+
+    ~parked_handler() {
+        reset();
+    }
+
+    explicit operator bool() const {
+        return m_impl != NULL;
+    }
+
+    /// Post the handler with the results and release it
+    void complete(Args... args) {
+        base * p = m_impl;
+        m_impl = NULL;
+        if (p) {
+            p->complete(std::move(args)...);
+        }
+    }
+
+    /// Release the handler without calling it
+    void reset() {
+        base * p = m_impl;
+        m_impl = NULL;
+        if (p) {
+            p->destroy();
+        }
+    }
+private:
+    parked_handler(parked_handler const &) = delete;
+    parked_handler & operator=(parked_handler const &) = delete;
+
+    struct base {
+        virtual void complete(Args... args) = 0;
+        virtual void destroy() = 0;
+    protected:
+        ~base() {}
+    };
+
+    template <typename handler, typename executor_type>
+    struct impl : public base {
+        typedef typename std::allocator_traits<typename
+            lib::asio::associated_allocator<handler>::type>::template
+            rebind_alloc<impl> alloc_type;
+
+        template <typename handler_arg>
+        impl(handler_arg && h, executor_type const & ex)
+          : m_handler(std::forward<handler_arg>(h))
+          , m_work(ex) {}
+
+        void complete(Args... args) {
+            // the memory is freed before the handler runs, so the next
+            // operation it starts can reuse it
+            handler h(std::move(m_handler));
+            lib::asio::executor_work_guard<executor_type> work(
+                std::move(m_work));
+            this->destroy();
+
+            lib::asio::post(work.get_executor(),
+                [h = std::move(h), args...]() mutable {
+                    h(std::move(args)...);
+                });
+        }
+
+        void destroy() {
+            alloc_type alloc(lib::asio::get_associated_allocator(m_handler));
+            this->~impl();
+            std::allocator_traits<alloc_type>::deallocate(alloc, this, 1);
+        }
+
+        handler m_handler;
+        lib::asio::executor_work_guard<executor_type> m_work;
+    };
+
+    base * m_impl;
+};
+
+/// Completion token based operations on a connection of an Asio endpoint
+/**
+ * Wraps a connection so it can be used with Asio completion tokens instead
+ * of handlers, most usefully with C++20 coroutines and
+ * `lib::asio::use_awaitable`, so that a protocol reads as straight line
+ * code:
+ *
+ *     auto [ec, con] = co_await websocketpp::async_connect(client, uri,
+ *         asio::use_awaitable);
+ *     ec = co_await con->async_send("request",
+ *         websocketpp::frame::opcode::text, asio::use_awaitable);
+ *     auto [rec, reply] = co_await con->async_read_message(
+ *         asio::use_awaitable);
+ *     auto [pec, pong] = co_await con->async_ping("", asio::use_awaitable);
+ *     ec = co_await con->async_close(websocketpp::close::status::normal, "",
+ *         asio::use_awaitable);
+ *
+ * Errors are lib::error_code results rather than exceptions, so with
+ * use_awaitable an operation with a message or connection result yields a
+ * tuple.
+ *
+ * Any completion token works, such as use_future, deferred, or a plain
+ * handler with an associated allocator and executor.
+ *
+ * attach takes over the open, message, close, fail, pong, pong timeout and
+ * write complete handlers of the connection. It may be called before the
+ * connection opens or from its open handler, for example to hand each
+ * accepted connection of a server to its own coroutine.
+ *
+ * Messages that arrive before they are read are queued. Up to the read
+ * limit of them are held before the connection stops reading, see
+ * connection::set_inbound_flow_control. async_send completes once the
+ * transport wrote the message, see connection::set_write_complete_handler,
+ * so a coroutine that awaits each send never has more than one message
+ * queued. A send the connection drops or conflates away, see
+ * connection::set_send_policy, completes with an error when the connection
+ * ends.
+ *
+ * Each operation completes through the associated executor of its handler.
+ * Requires Asio 1.14 (Boost 1.70) or later. Each kind of operation should
+ * have at most one outstanding call at a time, except async_send.
+ *
+ * @since 0.9.0
+ */
+template <typename endpoint_type>
+class awaitable_connection
+  : public lib::enable_shared_from_this<awaitable_connection<endpoint_type> >
+{
+public:
+    typedef awaitable_connection<endpoint_type> type;
+    typedef lib::shared_ptr<type> ptr;
+    typedef typename endpoint_type::connection_ptr connection_ptr;
+    typedef typename endpoint_type::message_ptr message_ptr;
+
+    /// Type of the executor operations complete on by default
+    typedef lib::asio::io_context::executor_type executor_type;
+
+    /// Take over the handlers of a connection
+    /**
+     * @param con A connection that has not closed yet
+     * @param read_limit The number of unread messages to queue before the
+     * connection stops reading, 0 for no limit
+     * @return The connection wrapper
+     */
+    static ptr attach(connection_ptr con, size_t read_limit = 64) {
+        ptr self(new type(con));
+        lib::weak_ptr<type> weak(self);
+
+        // from the open handler, which must not be replaced while it runs
+        if (con->get_state() == session::state::open) {
+            self->m_open = true;
+        } else {
+            con->set_open_handler([weak](connection_hdl_ref) {
+                if (ptr s = weak.lock()) {
+                    s->handle_open();
+                }
+            });
+        }
+        con->set_message_handler([weak](connection_hdl, message_ptr msg) {
+            if (ptr s = weak.lock()) {
+                s->handle_message(std::move(msg));
+            }
+        });
+        con->set_close_handler([weak](connection_hdl_ref) {
+            if (ptr s = weak.lock()) {
+                s->handle_end(false);
+            }
+        });
+        con->set_fail_handler([weak](connection_hdl_ref) {
+            if (ptr s = weak.lock()) {
+                s->handle_end(true);
+            }
+        });
+        con->set_pong_handler([weak](connection_hdl_ref, std::string p) {
+            if (ptr s = weak.lock()) {
+                s->handle_pong(p, lib::error_code());
+            }
+        });
+        con->set_pong_timeout_handler([weak](connection_hdl_ref,
+            std::string p)
+        {
+            if (ptr s = weak.lock()) {
+                s->handle_pong(p, make_error_code(lib::errc::timed_out));
+            }
+        });
+        con->set_write_complete_handler([weak](connection_hdl_ref,
+            uint64_t id)
+        {
+            if (ptr s = weak.lock()) {
+                s->handle_write_complete(id);
+            }
+        });
+        con->set_inbound_flow_control(read_limit, 0);
+        return self;
+    }
+
+    /// Get the wrapped connection
+    connection_ptr get_connection() const {
+        return m_con;
+    }
+
+    /// Wait for the connection to open
+    /**
+     * @param token A completion token with the signature
+     * `void(lib::error_code)`, the error set if the connection failed
+     */
+    template <typename token_type>
+    auto async_wait_open(token_type && token) {
+        return lib::asio::async_initiate<token_type, void(lib::error_code)>(
+            [self = this->shared_from_this()](auto && handler) {
+                lib::unique_lock<lib::mutex> lock(self->m_lock);
+                if (self->m_open || self->m_ended) {
+                    lib::error_code ec = self->m_open ? lib::error_code() :
+                        self->end_error();
+                    lock.unlock();
+                    parked_handler<lib::error_code>(std::move(handler),
+                        self->m_executor).complete(ec);
+                    return;
+                }
+                self->m_open_waiter = parked_handler<lib::error_code>(
+                    std::move(handler), self->m_executor);
+            }, token);
+    }
+
+    /// Read the next message
+    /**
+     * Queued messages are read before the connection's end is reported.
+     *
+     * @param token A completion token with the signature
+     * `void(lib::error_code, message_ptr)`
+     */
+    template <typename token_type>
+    auto async_read_message(token_type && token) {
+        return lib::asio::async_initiate<token_type,
+            void(lib::error_code, message_ptr)>(
+            [self = this->shared_from_this()](auto && handler) {
+                lib::unique_lock<lib::mutex> lock(self->m_lock);
+                if (!self->m_messages.empty() || self->m_ended) {
+                    message_ptr msg;
+                    lib::error_code ec;
+                    if (self->m_messages.empty()) {
+                        ec = self->end_error();
+                    } else {
+                        msg = std::move(self->m_messages.front());
+                        self->m_messages.pop_front();
+                    }
+                    lock.unlock();
+                    if (msg) {
+                        self->m_con->release_message(msg);
+                    }
+                    parked_handler<lib::error_code, message_ptr>(
+                        std::move(handler), self->m_executor).complete(ec,
+                        msg);
+                    return;
+                }
+                self->m_read_waiter = parked_handler<lib::error_code,
+                    message_ptr>(std::move(handler), self->m_executor);
+            }, token);
+    }
+
+    /// Send a message and wait for it to be written
+    /**
+     * The message is given a completion id, see message::set_completion_id,
+     * so it should not be sent again until the send completes. A broadcast
+     * message, which other connections share, completes once it is queued.
+     *
+     * @param msg The message to send
+     * @param token A completion token with the signature
+     * `void(lib::error_code)`
+     */
+    template <typename token_type>
+    auto async_send(message_ptr msg, token_type && token) {
+        return lib::asio::async_initiate<token_type, void(lib::error_code)>(
+            [self = this->shared_from_this()](auto && handler,
+                message_ptr msg)
+            {
+                self->start_send(std::move(msg), std::move(handler));
+            }, token, std::move(msg));
+    }
+
+    /// Send a message with the given payload and opcode
+    /**
+     * Like connection::send, copies the payload into a message from the
+     * connection's message manager.
+     *
+     * @param payload The payload of the message
+     * @param op The opcode of the message
+     * @param token A completion token with the signature
+     * `void(lib::error_code)`
+     */
+    template <typename token_type>
+    auto async_send(std::string const & payload, frame::opcode::value op,
+        token_type && token)
+    {
+        return lib::asio::async_initiate<token_type, void(lib::error_code)>(
+            [self = this->shared_from_this(), &payload, op](auto && handler) {
+                message_ptr msg = self->m_con->get_message(op,
+                    payload.size());
+                msg->append_payload(payload);
+                msg->set_compressed(true);
+                self->start_send(std::move(msg), std::move(handler));
+            }, token);
+    }
+
+    /// Send a ping and wait for its pong
+    /**
+     * Completes when a pong with the same payload arrives, or with
+     * `lib::errc::timed_out` once the `timeout_pong` of the config, see
+     * connection::set_pong_timeout, passes without one.
+     *
+     * @param payload The ping payload, at most 125 bytes
+     * @param token A completion token with the signature
+     * `void(lib::error_code, std::string)`, the string being the pong
+     * payload
+     */
+    template <typename token_type>
+    auto async_ping(std::string const & payload, token_type && token) {
+        return lib::asio::async_initiate<token_type,
+            void(lib::error_code, std::string)>(
+            [self = this->shared_from_this(), &payload](auto && handler) {
+                ping_waiter h(std::move(handler), self->m_executor);
+
+                lib::unique_lock<lib::mutex> lock(self->m_lock);
+                lib::error_code ec;
+                if (self->m_ended) {
+                    ec = self->end_error();
+                } else {
+                    self->m_ping_waiter = std::move(h);
+                    self->m_ping_payload = payload;
+                    lock.unlock();
+
+                    self->m_con->ping(payload, ec);
+                    if (!ec) {
+                        return;
+                    }
+
+                    lock.lock();
+                    h = std::move(self->m_ping_waiter);
+                }
+                lock.unlock();
+                // a pong or the end may have taken it meanwhile
+                h.complete(ec, std::string());
+            }, token);
+    }
+
+    /// Close the connection and wait for it to end
+    /**
+     * @param code The close code to send
+     * @param reason The close reason to send
+     * @param token A completion token with the signature
+     * `void(lib::error_code)`, set if the close could not be started
+     */
+    template <typename token_type>
+    auto async_close(close::status::value code, std::string const & reason,
+        token_type && token)
+    {
+        return lib::asio::async_initiate<token_type, void(lib::error_code)>(
+            [self = this->shared_from_this(), code, &reason](auto && handler) {
+                parked_handler<lib::error_code> h(std::move(handler),
+                    self->m_executor);
+
+                lib::unique_lock<lib::mutex> lock(self->m_lock);
+                if (!self->m_ended) {
+                    self->m_close_waiter = std::move(h);
+                    lock.unlock();
+
+                    lib::error_code ec;
+                    self->m_con->close(code, reason, ec);
+                    if (!ec) {
+                        return;
+                    }
+
+                    lock.lock();
+                    h = std::move(self->m_close_waiter);
+                    lock.unlock();
+                    // the close or fail handler may have taken it meanwhile
+                    h.complete(ec);
+                    return;
+                }
+                lock.unlock();
+                h.complete(lib::error_code());
+            }, token);
+    }
+private:
+    typedef parked_handler<lib::error_code> send_waiter;
+    typedef parked_handler<lib::error_code, std::string> ping_waiter;
+
+    explicit awaitable_connection(connection_ptr con)
+      : m_con(con)
+      , m_executor(con->get_io_context().get_executor())
+      , m_open(false)
+      , m_ended(false)
+      , m_failed(false)
+      , m_next_send(0) {}
+
+    template <typename handler_type>
+    void start_send(message_ptr msg, handler_type && handler) {
+        send_waiter h(std::forward<handler_type>(handler), m_executor);
+        if (msg->get_broadcast()) {
+            h.complete(m_con->send(msg));
+            return;
+        }
+
+        uint64_t id;
+        {
+            // waiters are queued before the send, as the write may complete
+            // before send returns
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            if (m_ended) {
+                lib::error_code ec = end_error();
+                h.complete(ec);
+                return;
+            }
+            id = ++m_next_send;
+            m_send_waiters.push_back(std::make_pair(id, std::move(h)));
+        }
+        msg->set_completion_id(id);
+
+        lib::error_code ec = m_con->send(msg);
+        if (ec) {
+            take_send(id).complete(ec);
+        }
+    }
+
+    /// Remove the waiter of a send, empty if it was completed meanwhile
+    send_waiter take_send(uint64_t id) {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        typename std::deque<std::pair<uint64_t, send_waiter> >::iterator it;
+        for (it = m_send_waiters.begin(); it != m_send_waiters.end(); ++it) {
+            if (it->first == id) {
+                send_waiter h(std::move(it->second));
+                m_send_waiters.erase(it);
+                return h;
+            }
+        }
+        return send_waiter();
+    }
+
+    lib::error_code end_error() const {
+        lib::error_code ec = m_failed ? m_con->get_ec() : lib::error_code();
+        return ec ? ec : error::make_error_code(error::bad_connection);
+    }
+
+    void handle_open() {
+        parked_handler<lib::error_code> h;
+        {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            m_open = true;
+            h = std::move(m_open_waiter);
+        }
+        h.complete(lib::error_code());
+    }
+
+    void handle_message(message_ptr msg) {
+        parked_handler<lib::error_code, message_ptr> h;
+        {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            if (!m_read_waiter) {
+                m_messages.push_back(std::move(msg));
+                return;
+            }
+            h = std::move(m_read_waiter);
+        }
+        m_con->release_message(msg);
+        h.complete(lib::error_code(), std::move(msg));
+    }
+
+    void handle_write_complete(uint64_t id) {
+        // writes complete in send order, so the waiter is usually the front
+        take_send(id).complete(lib::error_code());
+    }
+
+    void handle_pong(std::string const & payload, lib::error_code ec) {
+        ping_waiter h;
+        {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            if (!m_ping_waiter || payload != m_ping_payload) {
+                return;
+            }
+            h = std::move(m_ping_waiter);
+        }
+        h.complete(ec, payload);
+    }
+
+    void handle_end(bool failed) {
+        parked_handler<lib::error_code> open;
+        parked_handler<lib::error_code, message_ptr> read;
+        parked_handler<lib::error_code> close;
+        ping_waiter ping;
+        std::deque<std::pair<uint64_t, send_waiter> > sends;
+        lib::error_code ec;
+        {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            m_ended = true;
+            m_failed = failed;
+            ec = end_error();
+            open = std::move(m_open_waiter);
+            read = std::move(m_read_waiter);
+            close = std::move(m_close_waiter);
+            ping = std::move(m_ping_waiter);
+            sends.swap(m_send_waiters);
+        }
+
+        open.complete(ec);
+        read.complete(ec, message_ptr());
+        close.complete(lib::error_code());
+        ping.complete(ec, std::string());
+        for (size_t i = 0; i < sends.size(); ++i) {
+            sends[i].second.complete(ec);
+        }
+    }
+
+    connection_ptr const m_con;
+    executor_type const m_executor;
+
+    lib::mutex m_lock;
+    bool m_open;
+    bool m_ended;
+    bool m_failed;
+    std::deque<message_ptr> m_messages;
+    parked_handler<lib::error_code> m_open_waiter;
+    parked_handler<lib::error_code, message_ptr> m_read_waiter;
+    parked_handler<lib::error_code> m_close_waiter;
+    ping_waiter m_ping_waiter;
+    std::string m_ping_payload;
+    /// Sends waiting to be written, in send order, by completion id
+    std::deque<std::pair<uint64_t, send_waiter> > m_send_waiters;
+    uint64_t m_next_send;
+};
+
+/// Connect a client and wait for the connection to open
+/**
+ * Usage:
+ *
+ *     auto [ec, con] = co_await websocketpp::async_connect(client,
+ *         "ws://example.com/", asio::use_awaitable);
+ *
+ * @param c The client endpoint, which must use the Asio transport
+ * @param uri The URI to connect to
+ * @param token A completion token with the signature
+ * `void(lib::error_code, awaitable_connection<client_type>::ptr)`
+ *
+ * @since 0.9.0
+ */
+template <typename client_type, typename token_type>
+auto async_connect(client_type & c, std::string const & uri,
+    token_type && token)
+{
+    typedef typename awaitable_connection<client_type>::ptr ptr;
+
+    return lib::asio::async_initiate<token_type, void(lib::error_code, ptr)>(
+        [&c, &uri](auto && handler) {
+            typedef parked_handler<lib::error_code, ptr> result;
+
+            lib::error_code ec;
+            typename client_type::connection_ptr con = c.get_connection(uri,
+                ec);
+            if (ec) {
+                result(std::move(handler), c.get_io_context().get_executor())
+                    .complete(ec, ptr());
+                return;
+            }
+
+            ptr a = awaitable_connection<client_type>::attach(con);
+            c.connect(con);
+
+            // wait for the open through a wrapper that yields the connection
+            lib::shared_ptr<result> r = lib::make_shared<result>(
+                std::move(handler), c.get_io_context().get_executor());
+            a->async_wait_open([r, a](lib::error_code const & ec) {
+                r->complete(ec, ec ? ptr() : a);
+            });
+        }, token);
+}
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_AWAITABLE_HPP
@@ -36,6 +36,7 @@
 #ifndef _BASE64_HPP_
 #define _BASE64_HPP_
 
+#include <cstddef>
 #include <string>
 
 namespace websocketpp {
@@ -57,57 +58,73 @@ static inline bool is_base64(unsigned char c) {
            (c >= 97 && c <= 122)); // a-z
 }
 
-/// Encode a char buffer into a base64 string
+/// Number of characters base64_encode produces for len input bytes
 /**
+ * @since 0.9.0
+ *
+ * @param len The length of the input in bytes
+ * @return The length of the encoded output, including padding
+ */
+inline size_t base64_encoded_size(size_t len) {
+    return (len + 2) / 3 * 4;
+}
+
+/// Encode a char buffer into a caller supplied buffer
+/**
+ * Writes exactly base64_encoded_size(len) characters, without a terminating
+ * null. Used where the output size is known up front, such as the 28
+ * character Sec-WebSocket-Accept value.
+ *
+ * @since 0.9.0
+ *
  * @param input The input data
  * @param len The length of input in bytes
- * @return A base64 encoded string representing input
+ * @param out The output buffer, at least base64_encoded_size(len) bytes
+ * @return The number of characters written
  */
-inline std::string base64_encode(unsigned char const * input, size_t len) {
-    std::string ret;
-    int i = 0;
-    int j = 0;
-    unsigned char char_array_3[3];
-    unsigned char char_array_4[4];
-
-    while (len--) {
-        char_array_3[i++] = *(input++);
-        if (i == 3) {
-            char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-            char_array_4[1] = ((char_array_3[0] & 0x03) << 4) +
-                              ((char_array_3[1] & 0xf0) >> 4);
-            char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) +
-                              ((char_array_3[2] & 0xc0) >> 6);
-            char_array_4[3] = char_array_3[2] & 0x3f;
-
-            for(i = 0; (i <4) ; i++) {
-                ret += base64_chars[char_array_4[i]];
-            }
-            i = 0;
-        }
+inline size_t base64_encode(unsigned char const * input, size_t len,
+    char * out)
+{
+    static char const table[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    char * p = out;
+
+    for (; len >= 3; len -= 3, input += 3) {
+        unsigned int const n = (static_cast<unsigned int>(input[0]) << 16) |
+                               (static_cast<unsigned int>(input[1]) << 8) |
+                               input[2];
+        *p++ = table[(n >> 18) & 0x3f];
+        *p++ = table[(n >> 12) & 0x3f];
+        *p++ = table[(n >> 6) & 0x3f];
+        *p++ = table[n & 0x3f];
     }
 
-    if (i) {
-        for(j = i; j < 3; j++) {
-            char_array_3[j] = '\0';
+    if (len) {
+        unsigned int n = static_cast<unsigned int>(input[0]) << 16;
+        if (len == 2) {
+            n |= static_cast<unsigned int>(input[1]) << 8;
         }
+        *p++ = table[(n >> 18) & 0x3f];
+        *p++ = table[(n >> 12) & 0x3f];
+        *p++ = (len == 2 ? table[(n >> 6) & 0x3f] : '=');
+        *p++ = '=';
+    }
 
-        char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-        char_array_4[1] = ((char_array_3[0] & 0x03) << 4) +
-                          ((char_array_3[1] & 0xf0) >> 4);
-        char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) +
-                          ((char_array_3[2] & 0xc0) >> 6);
-        char_array_4[3] = char_array_3[2] & 0x3f;
-
-        for (j = 0; (j < i + 1); j++) {
-            ret += base64_chars[char_array_4[j]];
-        }
+    return static_cast<size_t>(p - out);
+}
 
-        while((i++ < 3)) {
-            ret += '=';
-        }
+/// Encode a char buffer into a base64 string
+/**
+ * @param input The input data
+ * @param len The length of input in bytes
+ * @return A base64 encoded string representing input
+ */
+inline std::string base64_encode(unsigned char const * input, size_t len) {
+    std::string ret(base64_encoded_size(len), '\0');
+    if (!ret.empty()) {
+        base64_encode(input, len, &ret[0]);
     }
-
     return ret;
 }
 
@@ -0,0 +1,361 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_CAPTURE_HPP
+#define WEBSOCKETPP_CAPTURE_HPP
+
+#include <websocketpp/common/chrono.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+#include <websocketpp/common/thread.hpp>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace websocketpp {
+
+/// Records the wire bytes of connections to a file
+/**
+ * Connections of an endpoint with set_capture append every chunk of bytes
+ * they read from and hand to the transport, so the traffic can be replayed
+ * later through iostream connections, see capture_reader and
+ * benchmarks/replay. With TLS the bytes are the decrypted ones.
+ *
+ * The file starts with the 8 bytes `WSPPCAP1` and the capture start time,
+ * then holds one record per chunk. Numbers are unsigned LEB128 varints, so
+ * the format does not depend on byte order:
+ *
+ *     header: char magic[8], varint start (microseconds since the epoch)
+ *     record: varint delta (microseconds since the previous record),
+ *             varint id << 2 | kind, varint length, char bytes[length]
+ *
+ * kind is one of the record_kind values. Connection ids count from 1 in the
+ * order connections were given the capture. An `open` record with the
+ * connection's role comes before any of its bytes, and `close` ends it.
+ *
+ * Records are written under a lock into a stdio buffer, making capture
+ * suited to sampling traffic rather than to every connection of a busy
+ * server.
+ *
+ * @since 0.9.0
+ */
+class capture {
+public:
+    /// Kinds of records
+    enum record_kind {
+        /// A connection started, payload is 1 for servers and 0 for clients
+        open = 0,
+        /// Bytes read from the transport
+        inbound = 1,
+        /// Bytes handed to the transport for writing
+        outbound = 2,
+        /// A connection ended, no payload
+        close = 3
+    };
+
+    capture() : m_file(NULL), m_last(0), m_next_id(0) {}
+
+    ~capture() {
+        this->close_file();
+    }
+
+    /// Create or replace the capture file
+    /**
+     * @param path The file to write to
+     * @return An error code, empty on success
+     */
+    lib::error_code open_file(std::string const & path) {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        close_locked();
+
+        m_file = std::fopen(path.c_str(), "wb");
+        if (!m_file) {
+            return lib::error_code(errno, lib::system_category());
+        }
+
+        m_last = now();
+        std::fwrite("WSPPCAP1", 1, 8, m_file);
+        put_varint(m_last);
+        return lib::error_code();
+    }
+
+    /// Flush and close the capture file
+    void close_file() {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        close_locked();
+    }
+
+    /// Whether or not a capture file is open
+    bool is_open() const {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        return m_file != NULL;
+    }
+
+    /// Write buffered records to the file
+    void flush() {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        if (m_file) {
+            std::fflush(m_file);
+        }
+    }
+
+    /// Get an id for a new connection
+    uint64_t next_id() {
+        return m_next_id.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    /// Append a record holding one chunk of bytes
+    void record(uint64_t id, record_kind kind, void const * data, size_t len)
+    {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        if (!begin_record(id, kind, len)) {
+            return;
+        }
+        std::fwrite(data, 1, len, m_file);
+    }
+
+    /// Append a record holding the bytes of a buffer sequence
+    /**
+     * @param buffers A sequence of elements with `buf` and `len` members,
+     * such as the transport::buffer list of a gathered write
+     */
+    template <typename buffer_sequence>
+    void record(uint64_t id, record_kind kind, buffer_sequence const & buffers)
+    {
+        size_t len = 0;
+        for (typename buffer_sequence::const_iterator it = buffers.begin();
+            it != buffers.end(); ++it)
+        {
+            len += it->len;
+        }
+
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        if (!begin_record(id, kind, len)) {
+            return;
+        }
+        for (typename buffer_sequence::const_iterator it = buffers.begin();
+            it != buffers.end(); ++it)
+        {
+            std::fwrite(it->buf, 1, it->len, m_file);
+        }
+    }
+private:
+    capture(capture const &) = delete;
+    capture & operator=(capture const &) = delete;
+
+    static uint64_t now() {
+        return uint64_t(lib::chrono::duration_cast<
+            lib::chrono::microseconds>(lib::chrono::system_clock::now()
+            .time_since_epoch()).count());
+    }
+
+    bool begin_record(uint64_t id, record_kind kind, size_t len) {
+        if (!m_file) {
+            return false;
+        }
+
+        uint64_t t = now();
+        put_varint(t > m_last ? t - m_last : 0);
+        put_varint(id << 2 | uint64_t(kind));
+        put_varint(len);
+        if (t > m_last) {
+            m_last = t;
+        }
+        return true;
+    }
+
+    void put_varint(uint64_t value) {
+        unsigned char out[10];
+        size_t n = 0;
+        do {
+            out[n] = static_cast<unsigned char>(value & 0x7f);
+            value >>= 7;
+            if (value) {
+                out[n] |= 0x80;
+            }
+            ++n;
+        } while (value);
+        std::fwrite(out, 1, n, m_file);
+    }
+
+    void close_locked() {
+        if (m_file) {
+            std::fclose(m_file);
+            m_file = NULL;
+        }
+    }
+
+    mutable lib::mutex m_lock;
+    std::FILE * m_file;
+    /// Time of the previous record, under m_lock
+    uint64_t m_last;
+    std::atomic<uint64_t> m_next_id;
+};
+
+/// Reads the records of a capture file
+/**
+ * Usage:
+ *
+ *     capture_reader r;
+ *     lib::error_code ec = r.open_file("traffic.cap");
+ *     capture_reader::entry e;
+ *     while (r.next(e)) { ... }
+ *
+ * next returns false at the end of the file or on a malformed record, which
+ * error tells apart.
+ *
+ * @since 0.9.0
+ */
+class capture_reader {
+public:
+    /// One record of a capture
+    struct entry {
+        /// Time of the record, microseconds since the epoch
+        uint64_t time;
+        /// Connection id
+        uint64_t id;
+        capture::record_kind kind;
+        /// The payload
+        std::string bytes;
+    };
+
+    capture_reader() : m_file(NULL), m_time(0), m_error(false) {}
+
+    ~capture_reader() {
+        if (m_file) {
+            std::fclose(m_file);
+        }
+    }
+
+    /// Open a capture file and check its header
+    /**
+     * @param path The file to read
+     * @return An error code, empty on success
+     */
+    lib::error_code open_file(std::string const & path) {
+        if (m_file) {
+            std::fclose(m_file);
+        }
+        m_error = false;
+
+        m_file = std::fopen(path.c_str(), "rb");
+        if (!m_file) {
+            return lib::error_code(errno, lib::system_category());
+        }
+
+        char magic[8];
+        if (std::fread(magic, 1, 8, m_file) != 8 ||
+            std::memcmp(magic, "WSPPCAP1", 8) != 0 || !get_varint(m_time))
+        {
+            std::fclose(m_file);
+            m_file = NULL;
+            return lib::error_code(EINVAL, lib::system_category());
+        }
+        return lib::error_code();
+    }
+
+    /// Get the time the capture started, microseconds since the epoch
+    uint64_t get_start_time() const {
+        return m_time;
+    }
+
+    /// Read the next record
+    /**
+     * @param [out] e Set to the record on success
+     * @return Whether or not a record was read
+     */
+    bool next(entry & e) {
+        if (!m_file || m_error) {
+            return false;
+        }
+
+        uint64_t delta;
+        if (!get_varint(delta)) {
+            // a clean end of file falls between records
+            return false;
+        }
+
+        uint64_t tag;
+        uint64_t len;
+        if (!get_varint(tag) || !get_varint(len)) {
+            m_error = true;
+            return false;
+        }
+
+        e.bytes.resize(static_cast<size_t>(len));
+        if (len && std::fread(&e.bytes[0], 1, e.bytes.size(), m_file) != len)
+        {
+            m_error = true;
+            return false;
+        }
+
+        m_time += delta;
+        e.time = m_time;
+        e.id = tag >> 2;
+        e.kind = static_cast<capture::record_kind>(tag & 3);
+        return true;
+    }
+
+    /// Whether reading stopped at a malformed record
+    bool error() const {
+        return m_error;
+    }
+private:
+    capture_reader(capture_reader const &) = delete;
+    capture_reader & operator=(capture_reader const &) = delete;
+
+    /// Read a varint, false at the end of the file; a truncated varint is
+    /// an error
+    bool get_varint(uint64_t & value) {
+        value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            int c = std::fgetc(m_file);
+            if (c == EOF) {
+                m_error = m_error || shift > 0;
+                return false;
+            }
+            value |= uint64_t(c & 0x7f) << shift;
+            if (!(c & 0x80)) {
+                return true;
+            }
+        }
+        m_error = true;
+        return false;
+    }
+
+    std::FILE * m_file;
+    uint64_t m_time;
+    bool m_error;
+};
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_CAPTURE_HPP
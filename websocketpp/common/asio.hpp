@@ -42,18 +42,62 @@
 // manager of popular Linux distributions like Ubuntu 12.04 LTS. Once the need
 // for this has passed this should be cleaned up and simplified.
 
+// Defining _WEBSOCKETPP_ASIO_IO_URING_ before including any WebSocket++ header
+// switches the Asio transport to Asio's io_uring backend on Linux. All socket
+// and timer operations are then submitted through io_uring instead of epoll,
+// which batches submissions and completions and reduces the number of system
+// calls per operation on small message workloads. This requires Asio 1.21
+// (Boost 1.78) or later and linking against liburing. Because the macros below
+// change Asio's ABI, every translation unit in a program must agree on them.
+
 #ifdef ASIO_STANDALONE
     #include <asio/version.hpp>
     
     #if (ASIO_VERSION/100000) == 1 && ((ASIO_VERSION/100)%1000) < 8
         static_assert(false, "The minimum version of standalone Asio is 1.8.0");
     #endif
+
+    #ifdef _WEBSOCKETPP_ASIO_IO_URING_
+        #if ASIO_VERSION < 102100
+            static_assert(false, "_WEBSOCKETPP_ASIO_IO_URING_ requires standalone Asio 1.21.0 or later");
+        #endif
+        #ifndef ASIO_HAS_IO_URING
+            #define ASIO_HAS_IO_URING
+        #endif
+        #ifndef ASIO_DISABLE_EPOLL
+            #define ASIO_DISABLE_EPOLL
+        #endif
+    #endif
+
+    // Asio 1.11 introduced executors, bind_executor, and associated_allocator.
+    // Newer versions no longer consult the legacy asio_handler_allocate hooks.
+    #if ASIO_VERSION >= 101100 && !defined(_WEBSOCKETPP_ASIO_EXECUTORS_)
+        #define _WEBSOCKETPP_ASIO_EXECUTORS_
+    #endif
     
     #include <asio.hpp>
     #include <asio/steady_timer.hpp>
     #include <websocketpp/common/chrono.hpp> 
+
+    // unix domain sockets, see transport::asio::endpoint::listen_local
+    #if defined(ASIO_HAS_LOCAL_SOCKETS) && \
+        !defined(_WEBSOCKETPP_ASIO_LOCAL_SOCKETS_)
+        #define _WEBSOCKETPP_ASIO_LOCAL_SOCKETS_
+    #endif
 #else
     #include <boost/version.hpp>
+
+    #ifdef _WEBSOCKETPP_ASIO_IO_URING_
+        #if BOOST_VERSION < 107800
+            static_assert(false, "_WEBSOCKETPP_ASIO_IO_URING_ requires Boost 1.78 or later");
+        #endif
+        #ifndef BOOST_ASIO_HAS_IO_URING
+            #define BOOST_ASIO_HAS_IO_URING
+        #endif
+        #ifndef BOOST_ASIO_DISABLE_EPOLL
+            #define BOOST_ASIO_DISABLE_EPOLL
+        #endif
+    #endif
     
     // See note above about boost <1.49 compatibility. If we are running on 
     // boost > 1.48 pull in the steady timer and chrono library
@@ -64,6 +108,19 @@
     
     #include <boost/asio.hpp>
     #include <boost/system/error_code.hpp>
+
+    // unix domain sockets, see transport::asio::endpoint::listen_local
+    #if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS) && \
+        !defined(_WEBSOCKETPP_ASIO_LOCAL_SOCKETS_)
+        #define _WEBSOCKETPP_ASIO_LOCAL_SOCKETS_
+    #endif
+
+    // Boost 1.66 (Asio 1.11) introduced executors, bind_executor, and
+    // associated_allocator. Newer versions no longer consult the legacy
+    // asio_handler_allocate hooks.
+    #if BOOST_VERSION >= 106600 && !defined(_WEBSOCKETPP_ASIO_EXECUTORS_)
+        #define _WEBSOCKETPP_ASIO_EXECUTORS_
+    #endif
 #endif
 
 namespace websocketpp {
@@ -29,6 +29,9 @@
 #define WEBSOCKETPP_COMMON_CONNECTION_HDL_HPP
 
 #include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+
+#include <functional>
 
 namespace websocketpp {
 
@@ -48,6 +51,57 @@ namespace websocketpp {
 typedef lib::weak_ptr<void> connection_hdl;
 typedef const connection_hdl& connection_hdl_ref;
 
+/// A compact handle to a connection in a connection_registry
+/**
+ * Eight bytes, trivially copyable, and ordered and hashed by value, so
+ * tables holding very many handles stay small and copying one touches no
+ * shared count. It names the connection by its registry id, see
+ * connection::get_handle_id, and is resolved through the registry of the
+ * endpoint, which every endpoint function that takes a connection_hdl also
+ * accepts it in place of. Registry ids count up and are never reused, so a
+ * stale id fails with error::bad_connection rather than reaching a later
+ * connection.
+ *
+ * The zero id refers to no connection.
+ *
+ * @since 0.9.0
+ */
+struct connection_id {
+    connection_id() : value(0) {}
+    explicit connection_id(uint64_t v) : value(v) {}
+
+    explicit operator bool() const {
+        return value != 0;
+    }
+
+    bool operator==(connection_id const & o) const {
+        return value == o.value;
+    }
+    bool operator!=(connection_id const & o) const {
+        return value != o.value;
+    }
+    bool operator<(connection_id const & o) const {
+        return value < o.value;
+    }
+
+    uint64_t value;
+};
+
+} // namespace websocketpp
+
+namespace std {
+
+template <>
+struct hash<websocketpp::connection_id> {
+    size_t operator()(websocketpp::connection_id const & id) const {
+        return std::hash<uint64_t>()(id.value);
+    }
+};
+
+} // namespace std
+
+namespace websocketpp {
+
 } // namespace websocketpp
 
 #endif // WEBSOCKETPP_COMMON_CONNECTION_HDL_HPP
@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_COMMON_FILE_MAP_HPP
+#define WEBSOCKETPP_COMMON_FILE_MAP_HPP
+
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+
+#include <cerrno>
+#include <cstdio>
+#include <limits>
+#include <string>
+
+#if defined(_WIN32)
+    #include <fcntl.h>
+    #include <io.h>
+    #include <sys/stat.h>
+
+    #include <algorithm>
+    #include <vector>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace websocketpp {
+
+/// A read only view of part of a file
+/**
+ * On POSIX systems the range is memory mapped, so its pages come from the
+ * page cache as they are written out rather than from the heap, and nothing
+ * is read up front. Elsewhere the range is read into a buffer.
+ *
+ * Held by shared_ptr as the owner of a message payload, see
+ * connection::send_file; the mapping goes away with the last reference.
+ *
+ * @since 0.9.0
+ */
+class file_map {
+public:
+    typedef lib::shared_ptr<file_map> ptr;
+
+    /// Passed as len to map everything after offset
+    static constexpr uint64_t to_end = uint64_t(-1);
+
+    ~file_map() {
+#if !defined(_WIN32)
+        if (m_base) {
+            ::munmap(m_base, m_mapped);
+        }
+#endif
+    }
+
+    /// Map part of an open file
+    /**
+     * The file descriptor is not kept, it may be closed once this returns.
+     *
+     * @param fd The file to map
+     * @param offset Where the range starts
+     * @param len The length of the range, or to_end
+     * @param ec Set to a system error, or to EINVAL if the range does not
+     * lie within the file
+     * @return The mapping, or a null pointer on error
+     */
+    static ptr map(int fd, uint64_t offset, uint64_t len, lib::error_code & ec)
+    {
+        uint64_t size;
+        ec = file_size(fd, size);
+        if (ec) {
+            return ptr();
+        }
+        if (offset > size || (len != to_end && len > size - offset)) {
+            ec = lib::error_code(EINVAL, lib::system_category());
+            return ptr();
+        }
+        if (len == to_end) {
+            len = size - offset;
+        }
+        if (len > std::numeric_limits<size_t>::max()) {
+            ec = lib::error_code(EFBIG, lib::system_category());
+            return ptr();
+        }
+
+        ptr m(new file_map());
+        m->m_size = static_cast<size_t>(len);
+        if (len == 0) {
+            return m;
+        }
+
+#if defined(_WIN32)
+        m->m_buffer.resize(m->m_size);
+        if (::_lseeki64(fd, offset, SEEK_SET) < 0) {
+            ec = lib::error_code(errno, lib::system_category());
+            return ptr();
+        }
+        for (size_t done = 0; done < m->m_size;) {
+            unsigned int chunk = static_cast<unsigned int>(std::min<size_t>(
+                m->m_size - done, 1 << 30));
+            int n = ::_read(fd, &m->m_buffer[done], chunk);
+            if (n <= 0) {
+                ec = lib::error_code(n < 0 ? errno : EIO,
+                    lib::system_category());
+                return ptr();
+            }
+            done += n;
+        }
+        m->m_data = &m->m_buffer[0];
+#else
+        // mmap offsets must be page aligned
+        uint64_t page = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+        uint64_t start = offset - offset % page;
+        size_t lead = static_cast<size_t>(offset - start);
+        m->m_mapped = lead + m->m_size;
+
+        void * base = ::mmap(NULL, m->m_mapped, PROT_READ, MAP_SHARED, fd,
+            static_cast<off_t>(start));
+        if (base == MAP_FAILED) {
+            ec = lib::error_code(errno, lib::system_category());
+            return ptr();
+        }
+        ::madvise(base, m->m_mapped, MADV_SEQUENTIAL);
+
+        m->m_base = base;
+        m->m_data = static_cast<char const *>(base) + lead;
+#endif
+        return m;
+    }
+
+    /// Map part of a file by path
+    /**
+     * @see map(int, uint64_t, uint64_t, lib::error_code &)
+     */
+    static ptr map(std::string const & path, uint64_t offset, uint64_t len,
+        lib::error_code & ec)
+    {
+#if defined(_WIN32)
+        int fd = ::_open(path.c_str(), _O_RDONLY | _O_BINARY);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+#endif
+        if (fd < 0) {
+            ec = lib::error_code(errno, lib::system_category());
+            return ptr();
+        }
+        ptr m = map(fd, offset, len, ec);
+#if defined(_WIN32)
+        ::_close(fd);
+#else
+        ::close(fd);
+#endif
+        return m;
+    }
+
+    /// Get the first byte of the range
+    char const * data() const {
+        return m_data;
+    }
+
+    /// Get the length of the range in bytes
+    size_t size() const {
+        return m_size;
+    }
+private:
+    file_map() : m_data(NULL), m_size(0), m_base(NULL), m_mapped(0) {}
+
+    file_map(file_map const &) = delete;
+    file_map & operator=(file_map const &) = delete;
+
+    static lib::error_code file_size(int fd, uint64_t & size) {
+#if defined(_WIN32)
+        struct _stat64 st;
+        if (::_fstat64(fd, &st) != 0) {
+#else
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+#endif
+            return lib::error_code(errno, lib::system_category());
+        }
+        size = static_cast<uint64_t>(st.st_size);
+        return lib::error_code();
+    }
+
+    char const * m_data;
+    size_t m_size;
+    void * m_base;
+    size_t m_mapped;
+#if defined(_WIN32)
+    std::vector<char> m_buffer;
+#endif
+};
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_COMMON_FILE_MAP_HPP
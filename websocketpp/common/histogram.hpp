@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_COMMON_HISTOGRAM_HPP
+#define WEBSOCKETPP_COMMON_HISTOGRAM_HPP
+
+#include <websocketpp/common/chrono.hpp>
+#include <websocketpp/common/stdint.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace websocketpp {
+
+/// Histogram of latencies with logarithmic buckets
+/**
+ * Values below 16 microseconds get a bucket each, larger ones are grouped
+ * into 8 buckets per power of two. Percentiles are therefore accurate to
+ * within 12.5% while recording stays constant time and the histogram keeps
+ * a fixed size however many values it holds.
+ *
+ * @since 0.9.0
+ */
+class latency_histogram {
+public:
+    /// Type of the recorded values
+    typedef lib::chrono::microseconds duration;
+
+    latency_histogram()
+      : m_buckets(bucket_count, 0)
+      , m_count(0)
+      , m_sum(0)
+      , m_min(0)
+      , m_max(0) {}
+
+    /// Record one value
+    /**
+     * Negative values are recorded as zero.
+     *
+     * @param value The value to record
+     */
+    void record(duration value) {
+        uint64_t v = value.count() > 0 ? uint64_t(value.count()) : 0;
+
+        ++m_buckets[bucket(v)];
+        if (m_count == 0 || v < m_min) {
+            m_min = v;
+        }
+        if (v > m_max) {
+            m_max = v;
+        }
+        ++m_count;
+        m_sum += v;
+    }
+
+    /// Add the values recorded by another histogram to this one
+    void merge(latency_histogram const & other) {
+        if (other.m_count == 0) {
+            return;
+        }
+
+        for (size_t i = 0; i < bucket_count; ++i) {
+            m_buckets[i] += other.m_buckets[i];
+        }
+        if (m_count == 0 || other.m_min < m_min) {
+            m_min = other.m_min;
+        }
+        if (other.m_max > m_max) {
+            m_max = other.m_max;
+        }
+        m_count += other.m_count;
+        m_sum += other.m_sum;
+    }
+
+    /// Get the number of values recorded
+    uint64_t count() const {
+        return m_count;
+    }
+
+    /// Get the sum of the values recorded
+    uint64_t sum() const {
+        return m_sum;
+    }
+
+    /// Get the smallest value recorded, zero if there are none
+    duration min() const {
+        return duration(m_min);
+    }
+
+    /// Get the largest value recorded, zero if there are none
+    duration max() const {
+        return duration(m_max);
+    }
+
+    /// Get the mean of the values recorded, zero if there are none
+    duration mean() const {
+        return duration(m_count == 0 ? 0 : m_sum / m_count);
+    }
+
+    /// Get a percentile of the values recorded
+    /**
+     * Returns the upper bound of the bucket holding the percentile, clamped
+     * to the range of the values recorded.
+     *
+     * @param p The percentile, between 0 and 100
+     * @return The value at percentile p, zero if there are no values
+     */
+    duration percentile(double p) const {
+        if (m_count == 0) {
+            return duration(0);
+        }
+
+        uint64_t rank = uint64_t(p / 100.0 * double(m_count) + 0.5);
+        rank = std::min(std::max(rank, uint64_t(1)), m_count);
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bucket_count; ++i) {
+            seen += m_buckets[i];
+            if (seen >= rank) {
+                return duration(std::max(std::min(upper_bound(i), m_max),
+                    m_min));
+            }
+        }
+        return duration(m_max);
+    }
+private:
+    friend class atomic_histogram;
+
+    static constexpr size_t linear_buckets = 16;
+    static constexpr size_t sub_buckets = 8;
+    static constexpr size_t bucket_count = linear_buckets + (64-4)*sub_buckets;
+
+    static size_t bucket(uint64_t v) {
+        if (v < linear_buckets) {
+            return size_t(v);
+        }
+
+        size_t e = 0;
+        for (uint64_t x = v; x > 1; x >>= 1) {
+            ++e;
+        }
+        return linear_buckets + (e-4)*sub_buckets +
+            size_t((v >> (e-3)) & (sub_buckets-1));
+    }
+
+    static uint64_t upper_bound(size_t index) {
+        if (index < linear_buckets) {
+            return index;
+        }
+
+        size_t e = 4 + (index-linear_buckets)/sub_buckets;
+        uint64_t s = (index-linear_buckets)%sub_buckets;
+        return ((sub_buckets+s+1) << (e-3)) - 1;
+    }
+
+    std::vector<uint64_t> m_buckets;
+    uint64_t m_count;
+    uint64_t m_sum;
+    uint64_t m_min;
+    uint64_t m_max;
+};
+
+/// Latency histogram that may be recorded into from several threads
+/**
+ * Uses the buckets of latency_histogram, each held in a relaxed atomic, so
+ * recording is lock free and costs a few uncontended atomic operations.
+ * Readings are taken with snapshot, which may be slightly out of step with
+ * values being recorded at the same time.
+ *
+ * @since 0.9.0
+ */
+class atomic_histogram {
+public:
+    /// Type of the recorded values
+    typedef latency_histogram::duration duration;
+
+    atomic_histogram()
+      : m_buckets(new std::atomic<uint64_t>[bucket_count])
+      , m_count(0)
+      , m_sum(0)
+      , m_min(std::numeric_limits<uint64_t>::max())
+      , m_max(0)
+    {
+        for (size_t i = 0; i < bucket_count; ++i) {
+            m_buckets[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /// Record one value
+    /**
+     * Negative values are recorded as zero.
+     *
+     * @param value The value to record
+     */
+    void record(duration value) {
+        uint64_t v = value.count() > 0 ? uint64_t(value.count()) : 0;
+
+        m_buckets[latency_histogram::bucket(v)].fetch_add(1,
+            std::memory_order_relaxed);
+        m_sum.fetch_add(v, std::memory_order_relaxed);
+
+        uint64_t cur = m_min.load(std::memory_order_relaxed);
+        while (v < cur && !m_min.compare_exchange_weak(cur, v,
+            std::memory_order_relaxed)) {}
+        cur = m_max.load(std::memory_order_relaxed);
+        while (v > cur && !m_max.compare_exchange_weak(cur, v,
+            std::memory_order_relaxed)) {}
+
+        m_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// Get the number of values recorded
+    uint64_t count() const {
+        return m_count.load(std::memory_order_relaxed);
+    }
+
+    /// Copy the values recorded so far
+    /**
+     * The count of the copy is the sum of its buckets, so percentiles of the
+     * copy are consistent even while other threads record.
+     *
+     * @return A histogram holding the values recorded so far
+     */
+    latency_histogram snapshot() const {
+        latency_histogram h;
+        for (size_t i = 0; i < bucket_count; ++i) {
+            h.m_buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+            h.m_count += h.m_buckets[i];
+        }
+        if (h.m_count != 0) {
+            h.m_sum = m_sum.load(std::memory_order_relaxed);
+            h.m_min = m_min.load(std::memory_order_relaxed);
+            h.m_max = m_max.load(std::memory_order_relaxed);
+            if (h.m_min > h.m_max) {
+                h.m_min = h.m_max;
+            }
+        }
+        return h;
+    }
+private:
+    static constexpr size_t bucket_count = latency_histogram::bucket_count;
+
+    atomic_histogram(atomic_histogram const &) = delete;
+    atomic_histogram & operator=(atomic_histogram const &) = delete;
+
+    std::unique_ptr<std::atomic<uint64_t>[]> m_buckets;
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_sum;
+    std::atomic<uint64_t> m_min;
+    std::atomic<uint64_t> m_max;
+};
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_COMMON_HISTOGRAM_HPP
@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_COMMON_HUGE_PAGES_HPP
+#define WEBSOCKETPP_COMMON_HUGE_PAGES_HPP
+
+#include <websocketpp/common/thread.hpp>
+
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <vector>
+
+#if !defined(_WIN32)
+    #include <sys/mman.h>
+#endif
+
+namespace websocketpp {
+
+/// Memory resource that hands out memory from large huge page regions
+/**
+ * Memory is reserved in regions of a multiple of 2 MB and handed out from
+ * the current region in order, so blocks that are used together sit on the
+ * same few pages and take few TLB entries. Each region is mapped with
+ * MAP_HUGETLB if the mode allows and the system has huge pages reserved
+ * (vm.nr_hugepages), otherwise it is mapped normally and marked with
+ * MADV_HUGEPAGE so transparent huge pages may back it, otherwise, where
+ * neither is available, it comes from the global heap. get_stats reports
+ * which each region got.
+ *
+ * Like std::pmr::monotonic_buffer_resource, deallocate does nothing and the
+ * regions are released when the resource is destroyed. It is meant as the
+ * upstream of something that recycles blocks, such as a
+ * std::pmr::synchronized_pool_resource given to endpoint::set_memory_resource,
+ * or the read buffer pool, see endpoint::set_read_buffer_resource. Calls are
+ * serialized with a mutex.
+ *
+ * @since 0.9.0
+ */
+class huge_page_resource : public std::pmr::memory_resource {
+public:
+    /// Size of a huge page on common platforms
+    static constexpr size_t huge_page_size = size_t(2) << 20;
+
+    /// How regions are backed
+    enum mode {
+        /// MAP_HUGETLB, then transparent huge pages, then regular pages
+        explicit_pages,
+        /// Transparent huge pages, then regular pages
+        transparent_pages,
+        /// Regular pages only, for comparison
+        regular_pages
+    };
+
+    /// Regions reserved so far and how they are backed
+    struct stats {
+        stats()
+          : regions(0)
+          , explicit_regions(0)
+          , transparent_regions(0)
+          , reserved_bytes(0)
+          , used_bytes(0) {}
+
+        /// Regions reserved
+        size_t regions;
+        /// Regions mapped with MAP_HUGETLB
+        size_t explicit_regions;
+        /// Regions marked for transparent huge pages
+        size_t transparent_regions;
+        /// Bytes in all regions
+        size_t reserved_bytes;
+        /// Bytes handed out, including alignment padding
+        size_t used_bytes;
+    };
+
+    /// Construct a huge page resource
+    /**
+     * Nothing is reserved until the first allocation or call to reserve.
+     *
+     * @param region_size Bytes per region, rounded up to a multiple of 2 MB
+     * @param m How to back regions
+     */
+    explicit huge_page_resource(size_t region_size = huge_page_size * 16,
+        mode m = explicit_pages)
+      : m_region_size(round_up(region_size))
+      , m_mode(m)
+      , m_next(NULL)
+      , m_left(0) {}
+
+    ~huge_page_resource() {
+        for (size_t i = 0; i < m_regions.size(); ++i) {
+            unmap(m_regions[i]);
+        }
+        for (size_t i = 0; i < m_spare.size(); ++i) {
+            unmap(m_spare[i]);
+        }
+    }
+
+    /// Reserve regions up front
+    /**
+     * Touches every page so the memory is resident before traffic arrives.
+     * Allocations are served from the reserved regions in order.
+     *
+     * @param bytes Bytes to reserve, rounded up to whole regions
+     * @return Whether the regions could be reserved
+     */
+    bool reserve(size_t bytes) {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        size_t have = 0;
+        for (size_t i = 0; i < m_regions.size(); ++i) {
+            have += m_regions[i].size;
+        }
+        while (have < bytes) {
+            region r;
+            if (!map(m_region_size, r)) {
+                return false;
+            }
+            char * p = static_cast<char *>(r.base);
+            for (size_t off = 0; off < r.size; off += 4096) {
+                p[off] = 0;
+            }
+            m_spare.push_back(r);
+            have += r.size;
+        }
+        return true;
+    }
+
+    /// Get the regions reserved so far and how they are backed
+    stats get_stats() const {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        return m_stats;
+    }
+
+    /// Check whether a pointer points into one of the regions
+    bool owns(void const * p) const {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        char const * c = static_cast<char const *>(p);
+        for (size_t i = 0; i < m_regions.size(); ++i) {
+            char const * base = static_cast<char const *>(m_regions[i].base);
+            if (c >= base && c < base + m_regions[i].size) {
+                return true;
+            }
+        }
+        return false;
+    }
+private:
+    struct region {
+        region() : base(NULL), size(0), mapped(false) {}
+
+        void * base;
+        size_t size;
+        bool mapped;
+    };
+
+    huge_page_resource(huge_page_resource const &) = delete;
+    huge_page_resource & operator=(huge_page_resource const &) = delete;
+
+    static size_t round_up(size_t bytes) {
+        if (bytes == 0) {
+            return huge_page_size;
+        }
+        return (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+    }
+
+    void * do_allocate(size_t bytes, size_t alignment) override {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+
+        size_t pad = (alignment - reinterpret_cast<size_t>(m_next) %
+            alignment) % alignment;
+        if (!m_next || pad + bytes > m_left) {
+            region r;
+            if (!m_spare.empty() && bytes <= m_spare.front().size) {
+                r = m_spare.front();
+                m_spare.erase(m_spare.begin());
+            } else if (!map(bytes > m_region_size ? round_up(bytes) :
+                m_region_size, r))
+            {
+                throw std::bad_alloc();
+            }
+            m_regions.push_back(r);
+            m_next = static_cast<char *>(r.base);
+            m_left = r.size;
+            pad = 0;
+        }
+
+        void * p = m_next + pad;
+        m_next += pad + bytes;
+        m_left -= pad + bytes;
+        m_stats.used_bytes += pad + bytes;
+        return p;
+    }
+
+    void do_deallocate(void *, size_t, size_t) override {}
+
+    bool do_is_equal(std::pmr::memory_resource const & other) const noexcept
+        override
+    {
+        return this == &other;
+    }
+
+    /// Map a region, falling back as the mode allows
+    bool map(size_t size, region & r) {
+        r.size = size;
+#if !defined(_WIN32)
+#if defined(MAP_HUGETLB)
+        if (m_mode == explicit_pages) {
+            void * p = ::mmap(NULL, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED) {
+                r.base = p;
+                r.mapped = true;
+                count(r);
+                ++m_stats.explicit_regions;
+                return true;
+            }
+        }
+#endif
+        void * p = ::mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED) {
+            r.base = p;
+            r.mapped = true;
+            count(r);
+#if defined(MADV_HUGEPAGE)
+            if (m_mode != regular_pages &&
+                ::madvise(p, size, MADV_HUGEPAGE) == 0)
+            {
+                ++m_stats.transparent_regions;
+            }
+#endif
+            return true;
+        }
+#endif
+        r.base = ::operator new(size, std::align_val_t(huge_page_size),
+            std::nothrow);
+        r.mapped = false;
+        if (!r.base) {
+            return false;
+        }
+        count(r);
+        return true;
+    }
+
+    void count(region const & r) {
+        ++m_stats.regions;
+        m_stats.reserved_bytes += r.size;
+    }
+
+    static void unmap(region const & r) {
+#if !defined(_WIN32)
+        if (r.mapped) {
+            ::munmap(r.base, r.size);
+            return;
+        }
+#endif
+        ::operator delete(r.base, std::align_val_t(huge_page_size));
+    }
+
+    size_t const m_region_size;
+    mode const m_mode;
+
+    mutable lib::mutex m_lock;
+    /// Regions handed out from, the last one is current
+    std::vector<region> m_regions;
+    /// Regions reserved but not used yet
+    std::vector<region> m_spare;
+    char * m_next;
+    size_t m_left;
+    stats m_stats;
+};
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_COMMON_HUGE_PAGES_HPP
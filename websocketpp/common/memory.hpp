@@ -68,6 +68,7 @@ namespace lib {
     using std::enable_shared_from_this;
     using std::static_pointer_cast;
     using std::make_shared;
+    using std::allocate_shared;
     using std::unique_ptr;
 
     typedef std::unique_ptr<unsigned char[]> unique_ptr_uchar_array;
@@ -78,6 +79,7 @@ namespace lib {
     using boost::enable_shared_from_this;
     using boost::static_pointer_cast;
     using boost::make_shared;
+    using boost::allocate_shared;
 
     typedef boost::scoped_array<unsigned char> unique_ptr_uchar_array;
 #endif
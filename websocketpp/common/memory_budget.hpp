@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_COMMON_MEMORY_BUDGET_HPP
+#define WEBSOCKETPP_COMMON_MEMORY_BUDGET_HPP
+
+#include <websocketpp/common/memory.hpp>
+
+#include <atomic>
+#include <cstddef>
+
+namespace websocketpp {
+
+/// Limit on the memory held by a group of connections
+/**
+ * One budget is shared by every connection of an endpoint. Users reserve
+ * bytes before holding them and return them afterwards; what happens when a
+ * reservation does not fit is up to the user. See
+ * endpoint::set_deflate_memory_limit and endpoint::set_inbound_memory_limit.
+ *
+ * A budget may have a parent, typically the total of a memory_governor.
+ * Every byte reserved in the budget is also reserved in the parent,
+ * whether or not it fits there.
+ *
+ * @since 0.9.0
+ */
+class memory_budget {
+public:
+    /// Construct a budget
+    /**
+     * @param limit The number of bytes that may be reserved in total
+     */
+    explicit memory_budget(size_t limit) : m_limit(limit), m_used(0) {}
+
+    /// Construct a budget that also reserves its bytes in a parent
+    /**
+     * @param limit The number of bytes that may be reserved in total
+     * @param parent The budget charged along with this one
+     */
+    memory_budget(size_t limit, lib::shared_ptr<memory_budget> parent)
+      : m_limit(limit)
+      , m_used(0)
+      , m_parent(parent) {}
+
+    /// Reserve bytes only if they fit under the limit
+    /**
+     * @param bytes The number of bytes to reserve
+     * @return Whether or not the bytes were reserved
+     */
+    bool try_acquire(size_t bytes) {
+        size_t used = m_used.load(std::memory_order_relaxed);
+        do {
+            if (used > m_limit || bytes > m_limit - used) {
+                return false;
+            }
+        } while (!m_used.compare_exchange_weak(used, used + bytes,
+            std::memory_order_relaxed));
+        if (m_parent) {
+            m_parent->acquire(bytes);
+        }
+        return true;
+    }
+
+    /// Reserve bytes whether or not they fit under the limit
+    /**
+     * @param bytes The number of bytes to reserve
+     */
+    void acquire(size_t bytes) {
+        m_used.fetch_add(bytes, std::memory_order_relaxed);
+        if (m_parent) {
+            m_parent->acquire(bytes);
+        }
+    }
+
+    /// Return bytes reserved by try_acquire or acquire
+    /**
+     * @param bytes The number of bytes to return
+     */
+    void release(size_t bytes) {
+        m_used.fetch_sub(bytes, std::memory_order_relaxed);
+        if (m_parent) {
+            m_parent->release(bytes);
+        }
+    }
+
+    /// Get the limit
+    size_t get_limit() const {
+        return m_limit;
+    }
+
+    /// Get the number of bytes currently reserved
+    size_t get_used() const {
+        return m_used.load(std::memory_order_relaxed);
+    }
+private:
+    size_t const m_limit;
+    std::atomic<size_t> m_used;
+    lib::shared_ptr<memory_budget> const m_parent;
+};
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_COMMON_MEMORY_BUDGET_HPP
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_COMMON_MEMORY_RESOURCE_HPP
+#define WEBSOCKETPP_COMMON_MEMORY_RESOURCE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory_resource>
+
+namespace websocketpp {
+
+/// Memory resource that counts what passes through it to another
+/**
+ * Forwards every allocation to an upstream resource and keeps the number of
+ * bytes and blocks currently allocated and the peak, with relaxed atomics so
+ * it may be shared by threads if the upstream may. Giving each subsystem its
+ * own counting_resource over a common upstream, for example one passed to
+ * endpoint::set_memory_resource and another to a message manager, shows how
+ * much memory each holds.
+ *
+ * @since 0.9.0
+ */
+class counting_resource : public std::pmr::memory_resource {
+public:
+    /// Construct a counting resource
+    /**
+     * @param upstream The resource to allocate from, which must outlive
+     * this one
+     */
+    explicit counting_resource(std::pmr::memory_resource * upstream =
+        std::pmr::get_default_resource())
+      : m_upstream(upstream)
+      , m_bytes(0)
+      , m_peak(0)
+      , m_blocks(0)
+      , m_allocations(0) {}
+
+    /// Get the resource allocations are forwarded to
+    std::pmr::memory_resource * upstream() const {
+        return m_upstream;
+    }
+
+    /// Get the number of bytes currently allocated
+    size_t bytes() const {
+        return m_bytes.load(std::memory_order_relaxed);
+    }
+
+    /// Get the largest number of bytes allocated at once
+    size_t peak() const {
+        return m_peak.load(std::memory_order_relaxed);
+    }
+
+    /// Get the number of blocks currently allocated
+    size_t blocks() const {
+        return m_blocks.load(std::memory_order_relaxed);
+    }
+
+    /// Get the number of allocations made so far
+    size_t allocations() const {
+        return m_allocations.load(std::memory_order_relaxed);
+    }
+private:
+    void * do_allocate(size_t bytes, size_t alignment) override {
+        void * p = m_upstream->allocate(bytes, alignment);
+
+        size_t now = m_bytes.fetch_add(bytes, std::memory_order_relaxed) +
+            bytes;
+        size_t peak = m_peak.load(std::memory_order_relaxed);
+        while (now > peak && !m_peak.compare_exchange_weak(peak, now,
+            std::memory_order_relaxed)) {}
+        m_blocks.fetch_add(1, std::memory_order_relaxed);
+        m_allocations.fetch_add(1, std::memory_order_relaxed);
+        return p;
+    }
+
+    void do_deallocate(void * p, size_t bytes, size_t alignment) override {
+        m_upstream->deallocate(p, bytes, alignment);
+        m_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+        m_blocks.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    bool do_is_equal(std::pmr::memory_resource const & other) const noexcept
+        override
+    {
+        return this == &other;
+    }
+
+    std::pmr::memory_resource * m_upstream;
+    std::atomic<size_t> m_bytes;
+    std::atomic<size_t> m_peak;
+    std::atomic<size_t> m_blocks;
+    std::atomic<size_t> m_allocations;
+};
+
+/// Give a message manager a memory resource if it takes one
+/**
+ * Message managers are a config policy and need not support memory
+ * resources. alloc::con_msg_manager does.
+ *
+ * @since 0.9.0
+ *
+ * @return Whether the manager took the resource
+ */
+template <typename manager_type>
+bool set_manager_resource(manager_type & manager,
+    std::pmr::memory_resource * resource)
+{
+    if constexpr (requires { manager.set_memory_resource(resource); }) {
+        manager.set_memory_resource(resource);
+        return true;
+    } else {
+        return false;
+    }
+}
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_COMMON_MEMORY_RESOURCE_HPP
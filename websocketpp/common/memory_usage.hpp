@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_COMMON_MEMORY_USAGE_HPP
+#define WEBSOCKETPP_COMMON_MEMORY_USAGE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace websocketpp {
+
+/// Estimated memory held by connections, by component
+/**
+ * Estimates are taken from object sizes and buffer capacities rather than
+ * from the allocator, so they leave out allocator overhead, state kept by
+ * the TLS library and memory shared by several connections such as
+ * broadcast messages. See connection::get_memory_usage.
+ *
+ * @since 0.9.0
+ */
+struct memory_usage {
+    enum component {
+        /// The connection object, less the inline parts listed below
+        connection = 0,
+        /// The read buffer, owned or taken from the read buffer pool
+        read_buffer,
+        /// Handshake request and response and other handshake state
+        http,
+        /// The protocol processor, the messages it is reading and the spare
+        /// messages of the message manager
+        processor,
+        /// permessage-deflate contexts
+        deflate,
+        /// Payloads queued or being written and the write buffers
+        send_queue,
+        /// Armed timers
+        timers,
+        /// The Asio strand of the connection
+        strand,
+        /// Inline storage for Asio handler allocation
+        handler_allocators,
+        /// Number of components
+        count
+    };
+
+    memory_usage() {
+        std::fill(bytes, bytes + count, size_t(0));
+    }
+
+    /// Get the name of a component
+    static char const * get_name(component c) {
+        switch (c) {
+            case connection: return "connection";
+            case read_buffer: return "read_buffer";
+            case http: return "http";
+            case processor: return "processor";
+            case deflate: return "deflate";
+            case send_queue: return "send_queue";
+            case timers: return "timers";
+            case strand: return "strand";
+            case handler_allocators: return "handler_allocators";
+            default: return "unknown";
+        }
+    }
+
+    /// Get the sum of every component
+    size_t total() const {
+        size_t sum = 0;
+        for (size_t i = 0; i < count; ++i) {
+            sum += bytes[i];
+        }
+        return sum;
+    }
+
+    /// Move bytes stored inside the connection object to a component
+    /**
+     * @param c The component the bytes belong to
+     * @param inline_bytes Bytes of the connection object used by c
+     */
+    void claim(component c, size_t inline_bytes) {
+        bytes[connection] -= inline_bytes;
+        bytes[c] += inline_bytes;
+    }
+
+    memory_usage & operator+=(memory_usage const & other) {
+        for (size_t i = 0; i < count; ++i) {
+            bytes[i] += other.bytes[i];
+        }
+        return *this;
+    }
+
+    /// Heap bytes held by a string, 0 if its contents are stored inline
+    static size_t heap_bytes(std::string const & s) {
+        char const * object = reinterpret_cast<char const *>(&s);
+        if (s.data() >= object && s.data() < object + sizeof(s)) {
+            return 0;
+        }
+        return s.capacity() + 1;
+    }
+
+    /// Heap bytes held by the elements of a vector, not counting what they
+    /// point to
+    template <typename T>
+    static size_t heap_bytes(std::vector<T> const & v) {
+        return v.capacity() * sizeof(T);
+    }
+
+    /// Bytes held by each component
+    size_t bytes[count];
+};
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_COMMON_MEMORY_USAGE_HPP
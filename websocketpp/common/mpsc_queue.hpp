@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_COMMON_MPSC_QUEUE_HPP
+#define WEBSOCKETPP_COMMON_MPSC_QUEUE_HPP
+
+#include <websocketpp/common/slab_allocator.hpp>
+
+#include <atomic>
+#include <new>
+#include <utility>
+
+namespace websocketpp {
+
+/// Unbounded lock-free multi-producer single-consumer queue
+/**
+ * Any number of threads may push concurrently. Only one thread at a time may
+ * pop or test empty. Pushing never blocks and a push is visible to the
+ * consumer as soon as it returns.
+ *
+ * Based on Dmitry Vyukov's non-intrusive MPSC node queue. Nodes are taken
+ * from the pushing thread's slab_cache.
+ *
+ * @since 0.9.0
+ */
+template <typename T>
+class mpsc_queue {
+public:
+    mpsc_queue() : m_head(&m_stub), m_tail(&m_stub) {
+        m_stub.next.store(NULL, std::memory_order_relaxed);
+    }
+
+    ~mpsc_queue() {
+        T value;
+        while (pop(value)) {}
+
+        if (m_tail != &m_stub) {
+            destroy(m_tail);
+        }
+    }
+
+    /// Append a value to the queue. Safe to call from any thread.
+    void push(T const & value) {
+        node * n = new (node_cache::allocate()) node(value);
+
+        node * prev = m_head.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_seq_cst);
+    }
+
+    /// Remove the oldest value from the queue. Consumer only.
+    /**
+     * A push that has not yet returned may not be visible yet, in which case
+     * pop reports the queue as empty.
+     *
+     * @param value Set to the removed value on success
+     * @return Whether or not a value was removed
+     */
+    bool pop(T & value) {
+        node * tail = m_tail;
+        node * next = tail->next.load(std::memory_order_seq_cst);
+
+        if (!next) {
+            return false;
+        }
+
+        value = std::move(next->value);
+        next->value = T();
+        m_tail = next;
+
+        if (tail != &m_stub) {
+            destroy(tail);
+        }
+        return true;
+    }
+
+    /// Whether the queue has no visible values. Consumer only.
+    bool empty() const {
+        return m_tail->next.load(std::memory_order_seq_cst) == NULL;
+    }
+private:
+    mpsc_queue(mpsc_queue const &);
+    mpsc_queue & operator=(mpsc_queue const &);
+
+    struct node {
+        node() {}
+        explicit node(T const & v) : next(NULL), value(v) {}
+
+        std::atomic<node *> next;
+        T value;
+    };
+
+    typedef slab_cache<sizeof(node), alignof(node)> node_cache;
+
+    static void destroy(node * n) {
+        n->~node();
+        node_cache::release(n);
+    }
+
+    std::atomic<node *> m_head;
+    node * m_tail;
+    node m_stub;
+};
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_COMMON_MPSC_QUEUE_HPP
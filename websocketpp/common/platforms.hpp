@@ -43,4 +43,16 @@
     #define _VARIADIC_MAX 8
 #endif
 
+// Keeps a rarely called function, such as an error path or a detailed log
+// dump, out of line and away from the hot code that calls it.
+#ifndef WEBSOCKETPP_COLD
+    #if defined(__GNUC__)
+        #define WEBSOCKETPP_COLD __attribute__((cold, noinline))
+    #elif defined(_MSC_VER)
+        #define WEBSOCKETPP_COLD __declspec(noinline)
+    #else
+        #define WEBSOCKETPP_COLD
+    #endif
+#endif
+
 #endif // WEBSOCKETPP_COMMON_PLATFORMS_HPP
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_COMMON_RING_QUEUE_HPP
+#define WEBSOCKETPP_COMMON_RING_QUEUE_HPP
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace websocketpp {
+
+/// A FIFO queue over a ring of slots that keeps its capacity
+/**
+ * Holds the subset of the std::deque interface the connection send queues
+ * use. Unlike std::deque, which allocates a block every few dozen pushes as
+ * the queue moves through memory, a ring_queue only allocates when it grows
+ * past its largest size so far. The first `inline_slots` slots live in the
+ * queue itself, so short queues never allocate at all. Popped slots are reset
+ * at once so the elements they held are released.
+ *
+ * Elements may be moved in and out, which for shared pointers saves the
+ * reference count updates of a copy.
+ *
+ * erase moves the elements after the erased one forward, so it is linear in
+ * their number.
+ *
+ * @since 0.9.0
+ */
+template <typename T, size_t inline_slots = 4>
+class ring_queue {
+public:
+    static_assert(inline_slots > 0 && (inline_slots & (inline_slots - 1)) == 0,
+        "inline_slots must be a power of two");
+
+    template <typename queue_type, typename value_type>
+    class basic_iterator {
+    public:
+        basic_iterator() : m_queue(NULL), m_index(0) {}
+
+        /// Conversion from iterator to const_iterator
+        template <typename other_queue, typename other_value>
+        basic_iterator(basic_iterator<other_queue, other_value> const & other)
+          : m_queue(other.m_queue), m_index(other.m_index) {}
+
+        value_type & operator*() const {
+            return m_queue->at_index(m_index);
+        }
+
+        value_type * operator->() const {
+            return &m_queue->at_index(m_index);
+        }
+
+        basic_iterator & operator++() {
+            ++m_index;
+            return *this;
+        }
+
+        basic_iterator operator++(int) {
+            basic_iterator old = *this;
+            ++m_index;
+            return old;
+        }
+
+        friend bool operator==(basic_iterator const & a,
+            basic_iterator const & b)
+        {
+            return a.m_index == b.m_index;
+        }
+
+        friend bool operator!=(basic_iterator const & a,
+            basic_iterator const & b)
+        {
+            return a.m_index != b.m_index;
+        }
+    private:
+        friend class ring_queue;
+        template <typename, typename> friend class basic_iterator;
+
+        basic_iterator(queue_type * queue, size_t index)
+          : m_queue(queue), m_index(index) {}
+
+        queue_type * m_queue;
+        size_t m_index;
+    };
+
+    typedef T value_type;
+    typedef basic_iterator<ring_queue, T> iterator;
+    typedef basic_iterator<ring_queue const, T const> const_iterator;
+
+    ring_queue()
+      : m_data(m_inline)
+      , m_mask(inline_slots - 1)
+      , m_head(0)
+      , m_size(0) {}
+
+    ring_queue(ring_queue && other)
+      : m_data(m_inline)
+      , m_mask(inline_slots - 1)
+      , m_head(0)
+      , m_size(0)
+    {
+        take(other);
+    }
+
+    ring_queue & operator=(ring_queue && other) {
+        if (this != &other) {
+            clear();
+            std::vector<T>().swap(m_slots);
+            m_data = m_inline;
+            m_mask = inline_slots - 1;
+            take(other);
+        }
+        return *this;
+    }
+
+    ring_queue(ring_queue const &) = delete;
+    ring_queue & operator=(ring_queue const &) = delete;
+
+    bool empty() const {
+        return m_size == 0;
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+    /// Get the number of elements the queue holds before it allocates
+    size_t capacity() const {
+        return m_mask + 1;
+    }
+
+    /// Whether the elements have moved out of the inline slots
+    bool on_heap() const {
+        return m_data != m_inline;
+    }
+
+    T & front() {
+        return m_data[m_head];
+    }
+
+    T const & front() const {
+        return m_data[m_head];
+    }
+
+    void push_back(T const & value) {
+        if (m_size > m_mask) {
+            grow();
+        }
+        m_data[(m_head + m_size) & m_mask] = value;
+        ++m_size;
+    }
+
+    void push_back(T && value) {
+        if (m_size > m_mask) {
+            grow();
+        }
+        m_data[(m_head + m_size) & m_mask] = std::move(value);
+        ++m_size;
+    }
+
+    void pop_front() {
+        m_data[m_head] = T();
+        m_head = (m_head + 1) & m_mask;
+        --m_size;
+    }
+
+    /// Remove an element
+    /**
+     * @return An iterator to the element after the removed one
+     */
+    iterator erase(iterator it) {
+        for (size_t i = it.m_index; i + 1 < m_size; ++i) {
+            at_index(i) = std::move(at_index(i + 1));
+        }
+        at_index(m_size - 1) = T();
+        --m_size;
+        return it;
+    }
+
+    /// Remove all elements, keeping the capacity
+    void clear() {
+        while (m_size) {
+            pop_front();
+        }
+        m_head = 0;
+    }
+
+    /// Exchange the contents of two queues
+    /**
+     * Queues on the heap trade their slots. Elements in inline slots are
+     * moved.
+     */
+    void swap(ring_queue & other) {
+        ring_queue tmp(std::move(other));
+        other = std::move(*this);
+        *this = std::move(tmp);
+    }
+
+    iterator begin() {
+        return iterator(this, 0);
+    }
+
+    iterator end() {
+        return iterator(this, m_size);
+    }
+
+    const_iterator begin() const {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator end() const {
+        return const_iterator(this, m_size);
+    }
+private:
+    T & at_index(size_t i) {
+        return m_data[(m_head + i) & m_mask];
+    }
+
+    T const & at_index(size_t i) const {
+        return m_data[(m_head + i) & m_mask];
+    }
+
+    /// Double the number of slots, which stays a power of two
+    void grow() {
+        std::vector<T> slots((m_mask + 1) * 2);
+        for (size_t i = 0; i < m_size; ++i) {
+            slots[i] = std::move(at_index(i));
+        }
+        m_slots.swap(slots);
+        m_data = m_slots.data();
+        m_mask = m_slots.size() - 1;
+        m_head = 0;
+    }
+
+    /// Take the elements of another queue, this one being empty and inline
+    void take(ring_queue & other) {
+        if (other.on_heap()) {
+            m_slots.swap(other.m_slots);
+            m_data = m_slots.data();
+            m_mask = other.m_mask;
+            m_head = other.m_head;
+            m_size = other.m_size;
+
+            other.m_data = other.m_inline;
+            other.m_mask = inline_slots - 1;
+            other.m_head = 0;
+            other.m_size = 0;
+            return;
+        }
+
+        for (size_t i = 0; i < other.m_size; ++i) {
+            m_inline[i] = std::move(other.at_index(i));
+        }
+        m_size = other.m_size;
+        other.clear();
+    }
+
+    T m_inline[inline_slots];
+    std::vector<T> m_slots;
+    T * m_data;
+    size_t m_mask;
+    size_t m_head;
+    size_t m_size;
+};
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_COMMON_RING_QUEUE_HPP
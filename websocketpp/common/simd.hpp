@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_COMMON_SIMD_HPP
+#define WEBSOCKETPP_COMMON_SIMD_HPP
+
+/**
+ * This header detects which vector instruction sets the compiler has been
+ * told it may use and pulls in the matching intrinsics headers. Selection is
+ * done entirely at compile time based on the target flags (-msse2, -mavx2,
+ * /arch:AVX2, etc). Code that has vectorized kernels should test the
+ * _WEBSOCKETPP_SIMD_*_ macros below and keep a portable scalar path for the
+ * case where none are defined.
+ *
+ * Defining _WEBSOCKETPP_NO_SIMD_ before including any WebSocket++ header
+ * disables all vectorized kernels.
+ */
+
+#ifndef _WEBSOCKETPP_NO_SIMD_
+    #if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || \
+        (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #ifndef _WEBSOCKETPP_SIMD_SSE2_
+            #define _WEBSOCKETPP_SIMD_SSE2_
+        #endif
+    #endif
+
+    #if defined(__SSSE3__) || defined(__AVX__)
+        #ifndef _WEBSOCKETPP_SIMD_SSSE3_
+            #define _WEBSOCKETPP_SIMD_SSSE3_
+        #endif
+    #endif
+
+    #if defined(__AVX2__)
+        #ifndef _WEBSOCKETPP_SIMD_AVX2_
+            #define _WEBSOCKETPP_SIMD_AVX2_
+        #endif
+    #endif
+
+    #if defined(__ARM_NEON) || defined(__ARM_NEON__)
+        #ifndef _WEBSOCKETPP_SIMD_NEON_
+            #define _WEBSOCKETPP_SIMD_NEON_
+        #endif
+    #endif
+#endif // _WEBSOCKETPP_NO_SIMD_
+
+#if defined(_WEBSOCKETPP_SIMD_AVX2_)
+    #include <immintrin.h>
+#elif defined(_WEBSOCKETPP_SIMD_SSSE3_)
+    #include <tmmintrin.h>
+#elif defined(_WEBSOCKETPP_SIMD_SSE2_)
+    #include <emmintrin.h>
+#endif
+
+#if defined(_WEBSOCKETPP_SIMD_NEON_)
+    #include <arm_neon.h>
+#endif
+
+#endif // WEBSOCKETPP_COMMON_SIMD_HPP
@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_COMMON_SLAB_ALLOCATOR_HPP
+#define WEBSOCKETPP_COMMON_SLAB_ALLOCATOR_HPP
+
+#include <websocketpp/common/huge_pages.hpp>
+#include <websocketpp/common/thread.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+namespace websocketpp {
+
+/// Per-thread cache of free fixed size memory blocks
+/**
+ * Each thread keeps a singly linked list of released blocks of a given size
+ * and alignment. Blocks released by a thread are cached on that thread and
+ * reused by its next allocation of the same size, so steady state allocation
+ * involves no global allocator calls and no cross-thread synchronization.
+ *
+ * At most max_free blocks are cached per thread; further releases go back to
+ * the global allocator. Cached blocks are freed when the thread exits.
+ *
+ * With a backing resource set (see set_backing) blocks the threads have no
+ * cached block for come from that resource instead, and blocks from it that
+ * a thread does not cache go to a free list shared by all threads rather
+ * than back to the global allocator.
+ *
+ * @since 0.9.0
+ */
+template <size_t size, size_t align>
+class slab_cache {
+public:
+    /// Maximum number of free blocks cached by each thread
+    static size_t const max_free = 64;
+
+    /// Allocate a block
+    static void * allocate() {
+        free_list & list = get_list();
+
+        if (list.head) {
+            node * n = list.head;
+            list.head = n->next;
+            --list.count;
+            return n;
+        }
+
+        huge_page_resource * r = backing().load(std::memory_order_acquire);
+        if (r) {
+            shared_list & shared = get_shared();
+            {
+                lib::lock_guard<lib::mutex> guard(shared.lock);
+                if (shared.head) {
+                    node * n = shared.head;
+                    shared.head = n->next;
+                    --shared.count;
+                    return n;
+                }
+            }
+            return r->allocate(block_size, align);
+        }
+
+        return ::operator new(block_size, std::align_val_t(align));
+    }
+
+    /// Release a block previously returned by allocate
+    static void release(void * p) {
+        if (!thread_exited()) {
+            free_list & list = get_list();
+
+            if (list.count < max_free) {
+                node * n = static_cast<node *>(p);
+                n->next = list.head;
+                list.head = n;
+                ++list.count;
+                return;
+            }
+        }
+
+        release_block(p);
+    }
+
+    /// Number of free blocks cached by the calling thread
+    static size_t cached() {
+        return thread_exited() ? 0 : get_list().count;
+    }
+
+    /// Fill the free lists ahead of use
+    /**
+     * Allocates blocks and touches every page of them, so the first
+     * allocations after startup neither grow the heap nor fault pages in.
+     * With a backing resource the blocks go to the free list shared by all
+     * threads, which is filled up to n blocks. Otherwise they go to the
+     * calling thread's cache, which holds at most max_free of them.
+     *
+     * @since 0.9.0
+     *
+     * @param n The number of free blocks wanted
+     */
+    static void reserve(size_t n) {
+        huge_page_resource * r = backing().load(std::memory_order_acquire);
+        if (r) {
+            shared_list & shared = get_shared();
+            lib::lock_guard<lib::mutex> guard(shared.lock);
+            while (shared.count < n) {
+                node * b = touch(r->allocate(block_size, align));
+                b->next = shared.head;
+                shared.head = b;
+                ++shared.count;
+            }
+            return;
+        }
+
+        if (thread_exited()) {
+            return;
+        }
+        free_list & list = get_list();
+        while (list.count < n && list.count < max_free) {
+            node * b = touch(::operator new(block_size,
+                std::align_val_t(align)));
+            b->next = list.head;
+            list.head = b;
+            ++list.count;
+        }
+    }
+
+    /// Take blocks from a huge page resource
+    /**
+     * Applies to every slab_cache of the same size and alignment. Blocks
+     * already allocated from the global allocator keep going back to it.
+     * The resource must be set before threads allocate from it and must
+     * outlive every thread that did, as blocks cached by a thread are
+     * returned when it exits. For dedicated nodes this is usually a
+     * resource that lives as long as the process.
+     *
+     * @since 0.9.0
+     *
+     * @param r The resource to take blocks from, or null for the global
+     * allocator
+     */
+    static void set_backing(huge_page_resource * r) {
+        backing().store(r, std::memory_order_release);
+    }
+
+    /// Number of backed blocks in the free list shared by all threads
+    /**
+     * @since 0.9.0
+     */
+    static size_t shared_free() {
+        shared_list & shared = get_shared();
+        lib::lock_guard<lib::mutex> guard(shared.lock);
+        return shared.count;
+    }
+private:
+    struct node {
+        node * next;
+    };
+
+    static size_t const block_size = (size < sizeof(node) ? sizeof(node) : size);
+
+    struct free_list {
+        free_list() : head(NULL), count(0) {}
+
+        ~free_list() {
+            while (head) {
+                node * n = head;
+                head = n->next;
+                release_block(n);
+            }
+            count = 0;
+            thread_exited() = true;
+        }
+
+        node * head;
+        size_t count;
+    };
+
+    struct shared_list {
+        shared_list() : head(NULL), count(0) {}
+
+        lib::mutex lock;
+        node * head;
+        size_t count;
+    };
+
+    /// Write to every page of a new block so it is resident
+    static node * touch(void * p) {
+        char * c = static_cast<char *>(p);
+        for (size_t off = 0; off < block_size; off += 4096) {
+            c[off] = 0;
+        }
+        return static_cast<node *>(p);
+    }
+
+    /// Return a block to where it came from
+    static void release_block(void * p) {
+        huge_page_resource * r = backing().load(std::memory_order_acquire);
+        if (r && r->owns(p)) {
+            shared_list & shared = get_shared();
+            lib::lock_guard<lib::mutex> guard(shared.lock);
+            node * n = static_cast<node *>(p);
+            n->next = shared.head;
+            shared.head = n;
+            ++shared.count;
+            return;
+        }
+
+        ::operator delete(p, std::align_val_t(align));
+    }
+
+    static std::atomic<huge_page_resource *> & backing() {
+        static std::atomic<huge_page_resource *> r(NULL);
+        return r;
+    }
+
+    // Never destroyed, threads may release blocks into it during teardown.
+    static shared_list & get_shared() {
+        static shared_list * shared = new shared_list();
+        return *shared;
+    }
+
+    static free_list & get_list() {
+        static thread_local free_list list;
+        return list;
+    }
+
+    // Trivially destructible so that it remains usable by blocks released
+    // during thread teardown, after the free list itself is gone.
+    static bool & thread_exited() {
+        static thread_local bool exited = false;
+        return exited;
+    }
+};
+
+/// Allocator that serves single object allocations from a slab_cache
+/**
+ * Intended for use with allocate_shared, where the object and its shared
+ * pointer control block are placed in a single block that is recycled
+ * through the allocating thread's cache when the last reference is released.
+ * Array allocations fall through to the global allocator.
+ *
+ * @since 0.9.0
+ */
+template <typename T>
+class slab_allocator {
+public:
+    typedef T value_type;
+
+    slab_allocator() {}
+
+    template <typename U>
+    slab_allocator(slab_allocator<U> const &) {}
+
+    T * allocate(size_t n) {
+        if (n == 1) {
+            return static_cast<T *>(cache_type::allocate());
+        }
+        return static_cast<T *>(::operator new(n * sizeof(T),
+            std::align_val_t(alignof(T))));
+    }
+
+    void deallocate(T * p, size_t n) {
+        if (n == 1) {
+            cache_type::release(p);
+        } else {
+            ::operator delete(p, std::align_val_t(alignof(T)));
+        }
+    }
+
+    template <typename U>
+    bool operator==(slab_allocator<U> const &) const {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(slab_allocator<U> const &) const {
+        return false;
+    }
+private:
+    typedef slab_cache<sizeof(T), alignof(T)> cache_type;
+};
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_COMMON_SLAB_ALLOCATOR_HPP
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_COMMON_SPILL_FILE_HPP
+#define WEBSOCKETPP_COMMON_SPILL_FILE_HPP
+
+#include <websocketpp/common/file_map.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+    #include <fcntl.h>
+    #include <io.h>
+    #include <process.h>
+    #include <sys/stat.h>
+#else
+    #include <fcntl.h>
+    #include <stdlib.h>
+    #include <unistd.h>
+#endif
+
+namespace websocketpp {
+
+/// An anonymous temporary file that collects a payload
+/**
+ * The file is removed from its directory as soon as it is created, so it
+ * disappears with the last descriptor or mapping even if the process dies.
+ * Once written it is mapped as a file_map, so the payload comes from the
+ * page cache rather than the heap.
+ *
+ * @since 0.9.0
+ */
+class spill_file {
+public:
+    typedef lib::shared_ptr<spill_file> ptr;
+
+    ~spill_file() {
+        if (m_fd >= 0) {
+#if defined(_WIN32)
+            ::_close(m_fd);
+#else
+            ::close(m_fd);
+#endif
+        }
+    }
+
+    /// Create a temporary file
+    /**
+     * @param dir The directory to create it in, empty for TMPDIR or the
+     * system's temporary directory
+     * @param ec Set to a system error
+     * @return The file, or a null pointer on error
+     */
+    static ptr create(std::string const & dir, lib::error_code & ec) {
+        std::string path = dir;
+        if (path.empty()) {
+            char const * env = std::getenv("TMPDIR");
+#if defined(_WIN32)
+            if (!env) {
+                env = std::getenv("TEMP");
+            }
+            path = env ? env : ".";
+#else
+            path = env ? env : "/tmp";
+#endif
+        }
+
+        ptr f(new spill_file());
+#if defined(_WIN32)
+        static std::atomic<unsigned> counter(0);
+        for (int attempt = 0; attempt < 100 && f->m_fd < 0; ++attempt) {
+            std::string name = path + "\\websocketpp-" +
+                std::to_string(::_getpid()) + "-" +
+                std::to_string(counter++) + ".spill";
+            f->m_fd = ::_open(name.c_str(), _O_CREAT | _O_EXCL | _O_RDWR |
+                _O_BINARY | _O_TEMPORARY, _S_IREAD | _S_IWRITE);
+            if (f->m_fd < 0 && errno != EEXIST) {
+                break;
+            }
+        }
+#else
+        std::string name = path + "/websocketpp-XXXXXX";
+        std::vector<char> buf(name.begin(), name.end());
+        buf.push_back('\0');
+        f->m_fd = ::mkstemp(&buf[0]);
+        if (f->m_fd >= 0) {
+            ::unlink(&buf[0]);
+            ::fcntl(f->m_fd, F_SETFD, FD_CLOEXEC);
+        }
+#endif
+        if (f->m_fd < 0) {
+            ec = lib::error_code(errno, lib::system_category());
+            return ptr();
+        }
+        return f;
+    }
+
+    /// Append bytes to the file
+    /**
+     * @param data The bytes to append
+     * @param len The number of bytes
+     * @return A system error, or an empty error code
+     */
+    lib::error_code write(char const * data, size_t len) {
+        while (len > 0) {
+#if defined(_WIN32)
+            unsigned int chunk = static_cast<unsigned int>(
+                len < (1u << 30) ? len : (1u << 30));
+            int n = ::_write(m_fd, data, chunk);
+#else
+            ssize_t n = ::write(m_fd, data, len);
+#endif
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return lib::error_code(errno, lib::system_category());
+            }
+            data += n;
+            len -= static_cast<size_t>(n);
+            m_size += static_cast<uint64_t>(n);
+        }
+        return lib::error_code();
+    }
+
+    /// Get the number of bytes written
+    uint64_t size() const {
+        return m_size;
+    }
+
+    /// Map everything written so far
+    /**
+     * @param ec Set to a system error
+     * @return The mapping, or a null pointer on error
+     */
+    file_map::ptr map(lib::error_code & ec) const {
+        return file_map::map(m_fd, 0, file_map::to_end, ec);
+    }
+private:
+    spill_file() : m_fd(-1), m_size(0) {}
+
+    spill_file(spill_file const &) = delete;
+    spill_file & operator=(spill_file const &) = delete;
+
+    int m_fd;
+    uint64_t m_size;
+};
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_COMMON_SPILL_FILE_HPP
@@ -0,0 +1,375 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_COMMON_TIMER_WHEEL_HPP
+#define WEBSOCKETPP_COMMON_TIMER_WHEEL_HPP
+
+#include <websocketpp/common/chrono.hpp>
+#include <websocketpp/common/functional.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/thread.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace websocketpp {
+
+/// Coarse grained timers shared by many connections
+/**
+ * A hierarchical timing wheel: four levels of 256 slots each, the first
+ * covering 256 ticks, each further level 256 times the one before. Arming and
+ * cancelling a timer links or unlinks it from a slot in constant time and
+ * allocates nothing, the entries live in the objects using them. Timers
+ * expire on the first tick at or after their deadline, so they are late by
+ * up to one tick.
+ *
+ * Something has to call advance on every tick while timers are armed. The
+ * start handler is called whenever a timer is armed on an idle wheel, and
+ * advance returns false once the wheel went idle, so the driver may stop.
+ * See endpoint::set_timer_wheel.
+ *
+ * All member functions are thread safe. Handlers are called by advance
+ * without holding the wheel's lock, and may arm and cancel timers.
+ *
+ * @since 0.9.0
+ */
+class timer_wheel {
+public:
+    /// Type of the function called when a timer expires
+    typedef lib::function<void()> handler;
+
+    /// Type of the clock deadlines are measured with
+    typedef lib::chrono::steady_clock clock;
+
+    /// A timer, armed on at most one wheel at a time
+    /**
+     * Destroying an entry cancels it. It must not outlive the wheel it was
+     * last armed on.
+     */
+    class entry {
+    public:
+        entry()
+          : m_wheel(NULL)
+          , m_slot(NULL)
+          , m_prev(NULL)
+          , m_next(NULL)
+          , m_expiry(0) {}
+
+        ~entry() {
+            cancel();
+        }
+
+        /// Cancel the timer if it is armed
+        /**
+         * @return Whether the timer was armed
+         */
+        bool cancel() {
+            return m_wheel ? m_wheel->cancel(*this) : false;
+        }
+    private:
+        entry(entry const &);
+        entry & operator=(entry const &);
+
+        friend class timer_wheel;
+
+        timer_wheel * m_wheel;
+        entry ** m_slot;
+        entry * m_prev;
+        entry * m_next;
+        uint64_t m_expiry;
+        handler m_handler;
+    };
+
+    /// Construct a wheel
+    /**
+     * @param tick The length of a tick in milliseconds, at least 1
+     */
+    explicit timer_wheel(long tick)
+      : m_tick(tick > 0 ? tick : 1)
+      , m_start(clock::now())
+      , m_now(0)
+      , m_count(0)
+      , m_running(false)
+    {
+        for (size_t i = 0; i < levels; ++i) {
+            for (size_t j = 0; j < slots; ++j) {
+                m_slots[i][j] = NULL;
+            }
+        }
+    }
+
+    /// Get the length of a tick
+    /**
+     * @return The length of a tick in milliseconds
+     */
+    long get_tick() const {
+        return m_tick;
+    }
+
+    /// Whether no timers are armed
+    bool empty() const {
+        return size() == 0;
+    }
+
+    /// Get the number of armed timers
+    size_t size() const {
+        lib::lock_guard<lib::mutex> lock(m_lock);
+        return m_count;
+    }
+
+    /// Set the function called when a timer is armed on an idle wheel
+    /**
+     * Called by the thread arming the timer, without holding the wheel's
+     * lock. It should start calling advance every tick.
+     *
+     * @param h The start handler
+     */
+    void set_start_handler(handler h) {
+        lib::lock_guard<lib::mutex> lock(m_lock);
+        m_start_handler = h;
+    }
+
+    /// Arm a timer, replacing its deadline if it is armed already
+    /**
+     * @param e The timer
+     * @param duration Milliseconds until the handler is called
+     * @param h The handler
+     */
+    void arm(entry & e, long duration, handler h) {
+        if (e.m_wheel && e.m_wheel != this) {
+            e.m_wheel->cancel(e);
+        }
+
+        uint64_t ticks = duration > 0 ? (uint64_t(duration) + m_tick - 1) /
+            uint64_t(m_tick) : 0;
+
+        handler old;
+        handler start;
+        {
+            lib::lock_guard<lib::mutex> lock(m_lock);
+
+            unlink(e);
+            old.swap(e.m_handler);
+
+            uint64_t now = current_tick(clock::now());
+            if (m_count == 0 && now > m_now) {
+                // nothing is armed, so nothing needs stepping through
+                m_now = now;
+            }
+
+            e.m_wheel = this;
+            e.m_expiry = (now > m_now ? now : m_now) + (ticks > 0 ? ticks : 1);
+            e.m_handler.swap(h);
+            link(e);
+            ++m_count;
+
+            if (!m_running) {
+                m_running = true;
+                start = m_start_handler;
+            }
+        }
+
+        if (start) {
+            start();
+        }
+    }
+
+    /// Cancel a timer
+    /**
+     * @param e The timer
+     * @return Whether the timer was armed
+     */
+    bool cancel(entry & e) {
+        handler old;
+        lib::lock_guard<lib::mutex> lock(m_lock);
+
+        if (!e.m_slot) {
+            return false;
+        }
+        unlink(e);
+        --m_count;
+
+        // destroyed after the lock is released, it may own e
+        old.swap(e.m_handler);
+        return true;
+    }
+
+    /// Expire the timers due by now
+    /**
+     * @param now The current time
+     * @return Whether any timers remain armed. Once false, the start handler
+     * is called again when the next timer is armed.
+     */
+    bool advance(clock::time_point now = clock::now()) {
+        std::vector<handler> due;
+        bool running;
+        {
+            lib::lock_guard<lib::mutex> lock(m_lock);
+            due.swap(m_due);
+
+            uint64_t target = current_tick(now);
+            while (m_now < target) {
+                if (m_count == 0) {
+                    m_now = target;
+                    break;
+                }
+                step(due);
+            }
+
+            running = m_count > 0;
+            m_running = running;
+        }
+
+        for (size_t i = 0; i < due.size(); ++i) {
+            due[i]();
+        }
+
+        // keep the room for the next tick
+        if (due.capacity() > 0) {
+            due.clear();
+            lib::lock_guard<lib::mutex> lock(m_lock);
+            if (m_due.capacity() < due.capacity()) {
+                m_due.swap(due);
+            }
+        }
+        return running;
+    }
+
+    /// Reserve room for timers expiring in the same tick
+    /**
+     * Expired handlers are collected under the wheel's lock before they are
+     * called. Reserving room for as many as may expire together, such as the
+     * handshake timeouts of a burst of reconnects, keeps the collection from
+     * growing while the lock is held. The room is kept between ticks.
+     *
+     * @param n The number of timers
+     */
+    void reserve(size_t n) {
+        lib::lock_guard<lib::mutex> lock(m_lock);
+        m_due.reserve(n);
+    }
+private:
+    static size_t const levels = 4;
+    static size_t const bits = 8;
+    static size_t const slots = size_t(1) << bits;
+
+    uint64_t current_tick(clock::time_point now) const {
+        if (now <= m_start) {
+            return 0;
+        }
+        return uint64_t(lib::chrono::duration_cast<lib::chrono::milliseconds>(
+            now - m_start).count()) / uint64_t(m_tick);
+    }
+
+    /// Link an entry into the slot for its expiry, relative to m_now
+    void link(entry & e) {
+        uint64_t const horizon = uint64_t(1) << (bits * levels);
+        if (e.m_expiry - m_now >= horizon) {
+            e.m_expiry = m_now + horizon - 1;
+        }
+
+        uint64_t delta = e.m_expiry - m_now;
+        size_t level = 0;
+        while (level + 1 < levels && delta >= (uint64_t(1) << (bits * (level + 1)))) {
+            ++level;
+        }
+
+        entry ** slot = &m_slots[level][(e.m_expiry >> (bits * level)) &
+            (slots - 1)];
+
+        e.m_slot = slot;
+        e.m_prev = NULL;
+        e.m_next = *slot;
+        if (*slot) {
+            (*slot)->m_prev = &e;
+        }
+        *slot = &e;
+    }
+
+    void unlink(entry & e) {
+        if (!e.m_slot) {
+            return;
+        }
+        if (e.m_prev) {
+            e.m_prev->m_next = e.m_next;
+        } else {
+            *e.m_slot = e.m_next;
+        }
+        if (e.m_next) {
+            e.m_next->m_prev = e.m_prev;
+        }
+        e.m_slot = NULL;
+        e.m_prev = NULL;
+        e.m_next = NULL;
+    }
+
+    /// Advance by one tick, collecting the handlers that expire
+    void step(std::vector<handler> & due) {
+        ++m_now;
+
+        // bring timers of the next period of each level down a level
+        for (size_t level = 1; level < levels; ++level) {
+            if (m_now & ((uint64_t(1) << (bits * level)) - 1)) {
+                break;
+            }
+
+            entry * e = m_slots[level][(m_now >> (bits * level)) & (slots - 1)];
+            m_slots[level][(m_now >> (bits * level)) & (slots - 1)] = NULL;
+            while (e) {
+                entry * next = e->m_next;
+                e->m_slot = NULL;
+                link(*e);
+                e = next;
+            }
+        }
+
+        entry ** slot = &m_slots[0][m_now & (slots - 1)];
+        while (*slot) {
+            entry & e = **slot;
+            unlink(e);
+            --m_count;
+            due.push_back(handler());
+            due.back().swap(e.m_handler);
+        }
+    }
+
+    long const m_tick;
+    clock::time_point const m_start;
+
+    mutable lib::mutex m_lock;
+    entry * m_slots[levels][slots];
+    uint64_t m_now;
+    size_t m_count;
+    bool m_running;
+    handler m_start_handler;
+    std::vector<handler> m_due;
+};
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_COMMON_TIMER_WHEEL_HPP
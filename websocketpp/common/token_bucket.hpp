@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_COMMON_TOKEN_BUCKET_HPP
+#define WEBSOCKETPP_COMMON_TOKEN_BUCKET_HPP
+
+#include <websocketpp/common/chrono.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace websocketpp {
+
+/// A token bucket that may go into debt
+/**
+ * Fills at a steady rate up to a burst of one second's worth. Consuming
+ * always succeeds, since the work it pays for has already been done, and
+ * may leave the bucket negative; get_wait says how long until it is paid
+ * off. Not thread safe.
+ *
+ * @since 0.9.0
+ */
+class token_bucket {
+public:
+    typedef lib::chrono::steady_clock clock;
+
+    token_bucket() : m_rate(0), m_tokens(0) {}
+
+    /// Set the rate, which also refills the bucket
+    /**
+     * @param rate Tokens per second, 0 to disable the bucket
+     */
+    void set_rate(double rate) {
+        m_rate = rate;
+        m_tokens = rate;
+        m_last = clock::now();
+    }
+
+    /// Whether the bucket limits anything
+    bool enabled() const {
+        return m_rate > 0;
+    }
+
+    /// Take tokens out of the bucket
+    /**
+     * @param n The number of tokens
+     * @param now The current time
+     */
+    void consume(double n, clock::time_point now) {
+        if (!enabled()) {
+            return;
+        }
+        refill(now);
+        m_tokens -= n;
+    }
+
+    /// Get the time until the bucket is out of debt
+    /**
+     * @param now The current time
+     * @return The wait in ms, 0 if the bucket is not in debt
+     */
+    long get_wait(clock::time_point now) {
+        if (!enabled()) {
+            return 0;
+        }
+        refill(now);
+        if (m_tokens >= 0) {
+            return 0;
+        }
+        return static_cast<long>(std::ceil(-m_tokens * 1000 / m_rate));
+    }
+private:
+    void refill(clock::time_point now) {
+        double const elapsed = lib::chrono::duration<double>(
+            now - m_last).count();
+        m_last = now;
+        if (elapsed > 0) {
+            m_tokens = (std::min)(m_rate, m_tokens + elapsed * m_rate);
+        }
+    }
+
+    double m_rate;
+    double m_tokens;
+    clock::time_point m_last;
+};
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_COMMON_TOKEN_BUCKET_HPP
@@ -60,6 +60,27 @@ namespace lib {
 #endif
 
 } // namespace lib
+
+/// Stands in for a data member of type T that a config compiles out
+/**
+ * Declared `[[no_unique_address]]` it takes no space. It can be constructed
+ * from anything, so constructors initialise the member the same way either
+ * way. Code using the member is kept under `if constexpr` on the same flag.
+ *
+ * @since 0.9.0
+ */
+template <typename T>
+struct compiled_out {
+    compiled_out() {}
+
+    template <typename U>
+    explicit compiled_out(U const &) {}
+};
+
+/// A member of type T when enabled, otherwise an empty compiled_out<T>
+template <bool enabled, typename T>
+using member_if = typename std::conditional<enabled, T, compiled_out<T> >::type;
+
 } // namespace websocketpp
 
 #endif // WEBSOCKETPP_COMMON_TYPE_TRAITS_HPP
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_COMMON_WORKER_POOL_HPP
+#define WEBSOCKETPP_COMMON_WORKER_POOL_HPP
+
+#include <websocketpp/common/functional.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/thread.hpp>
+
+#include <cstddef>
+#include <queue>
+#include <vector>
+
+namespace websocketpp {
+
+/// Worker threads that run CPU heavy tasks off the io threads
+/**
+ * Shared by the connections of one or more endpoints, see
+ * endpoint::set_compression_offload, endpoint::set_message_dispatch and
+ * transport::asio::tls_socket::endpoint::set_handshake_offload. Tasks run in
+ * the order they were posted on whichever worker is free. Tasks must not
+ * block waiting for other tasks, as every worker may be busy with one.
+ *
+ * Destroying the pool runs the tasks already posted and then joins the
+ * workers.
+ *
+ * @since 0.9.0
+ */
+class worker_pool {
+public:
+    typedef lib::function<void()> task_type;
+
+    /// Start a pool
+    /**
+     * @param threads The number of worker threads, at least one is started
+     */
+    explicit worker_pool(size_t threads) : m_state(lib::make_shared<state>()) {
+        if (threads == 0) {
+            threads = 1;
+        }
+        m_workers.reserve(threads);
+        for (size_t i = 0; i < threads; ++i) {
+            m_workers.push_back(lib::make_shared<lib::thread>(
+                &worker_pool::run, m_state));
+        }
+    }
+
+    ~worker_pool() {
+        {
+            lib::lock_guard<lib::mutex> lock(m_state->lock);
+            m_state->stopping = true;
+        }
+        m_state->cond.notify_all();
+
+        for (size_t i = 0; i < m_workers.size(); ++i) {
+            // a task may release the last owner of the pool, such as a
+            // connection, on the worker running it; that worker finishes
+            // the queue on the shared state instead of joining itself
+            if (m_workers[i]->get_id() == lib::this_thread::get_id()) {
+                m_workers[i]->detach();
+            } else {
+                m_workers[i]->join();
+            }
+        }
+    }
+
+    /// Queue a task to run on a worker thread
+    void post(task_type task) {
+        {
+            lib::lock_guard<lib::mutex> lock(m_state->lock);
+            m_state->tasks.push(task);
+        }
+        m_state->cond.notify_one();
+    }
+
+    /// Get the number of worker threads
+    size_t size() const {
+        return m_workers.size();
+    }
+private:
+    /// The queue, shared with the workers so it may outlive the pool
+    struct state {
+        state() : stopping(false) {}
+
+        lib::mutex lock;
+        lib::condition_variable cond;
+        std::queue<task_type> tasks;
+        bool stopping;
+    };
+
+    static void run(lib::shared_ptr<state> s) {
+        for (;;) {
+            task_type task;
+            {
+                lib::unique_lock<lib::mutex> lock(s->lock);
+                while (s->tasks.empty() && !s->stopping) {
+                    s->cond.wait(lock);
+                }
+                if (s->tasks.empty()) {
+                    return;
+                }
+                task = s->tasks.front();
+                s->tasks.pop();
+            }
+            task();
+        }
+    }
+
+    // non-copyable
+    worker_pool(worker_pool const &);
+    worker_pool & operator=(worker_pool const &);
+
+    lib::shared_ptr<state> m_state;
+    std::vector<lib::shared_ptr<lib::thread> > m_workers;
+};
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_COMMON_WORKER_POOL_HPP
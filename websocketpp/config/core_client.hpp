@@ -53,6 +53,7 @@
 
 // Loggers
 #include <websocketpp/logger/basic.hpp>
+#include <websocketpp/trace/none.hpp>
 
 // RNG
 #include <websocketpp/random/random_device.hpp>
@@ -96,7 +97,15 @@ struct core_client {
     typedef websocketpp::log::basic<concurrency_type,
         websocketpp::log::alevel> alog_type;
 
+    /// Trace policy, see trace::point
+    typedef websocketpp::trace::none trace_type;
+
     /// RNG policies
+    /**
+     * Client frames take a masking key from this generator each.
+     * random::chacha::int_generator avoids a lock and system call per key
+     * where clients send at high rates.
+     */
     typedef websocketpp::random::random_device::int_generator<uint32_t,
         concurrency_type> rng_type;
 
@@ -143,6 +152,15 @@ struct core_client {
 
         /// Length of time to wait for socket shutdown
         static const long timeout_socket_shutdown = 5000;
+
+        /// Whether connections can tunnel through an HTTP proxy
+        /**
+         * When false the proxy settings of asio transport connections are
+         * compiled out and set_proxy is unavailable.
+         *
+         * @since 0.9.0
+         */
+        static const bool enable_proxy = true;
     };
 
     /// Transport Endpoint Component
@@ -238,6 +256,19 @@ struct core_client {
      */
     static const size_t max_message_size = 32000000;
 
+    /// Largest payload buffer reserved ahead of the bytes that fill it
+    /**
+     * Incoming data messages reserve room for the payload the frame header
+     * announces, but no more than this. Beyond it the buffer grows as bytes
+     * arrive, so a peer that announces a large frame and sends it slowly, or
+     * not at all, does not pin the whole size up front.
+     *
+     * The default is 64KiB
+     *
+     * @since 0.9.0
+     */
+    static const size_t message_reserve_step = 65536;
+
     /// Default maximum http body size
     /**
      * Default value for the http parser's maximum body size. Maximum body size
@@ -250,9 +281,154 @@ struct core_client {
      */
     static const size_t max_http_body_size = 32000000;
 
+    /// Frames smaller than this are coalesced into one contiguous write buffer
+    /**
+     * When writing, each message normally contributes two buffers (header and
+     * payload) to the scatter/gather list handed to the transport. Messages
+     * whose total framed size is below this threshold are instead copied into
+     * a per-connection buffer so that runs of small frames are written as a
+     * single contiguous buffer. This keeps the scatter/gather list short and,
+     * with TLS, avoids producing one record per tiny buffer. Larger messages
+     * are always written in place.
+     *
+     * The default is 0 (disabled)
+     *
+     * @since 0.9.0
+     */
+    static const size_t write_coalesce_threshold = 0;
+
+    /// Maximum number of messages gathered into a single transport write
+    /**
+     * Bounds the scatter/gather list built for each write so that it stays
+     * within the platform's iovec limit (IOV_MAX is commonly 1024 and each
+     * message uses up to two buffers) and so that one connection with a deep
+     * send queue does not issue arbitrarily long writes. Remaining messages
+     * are written by the next write. A value of 0 disables the limit.
+     *
+     * @since 0.9.0
+     */
+    static const size_t write_batch_max_messages = 512;
+
+    /// Maximum number of bytes gathered into a single transport write
+    /**
+     * Messages are added to a write until this many header and payload bytes
+     * have been gathered. A write always contains at least one message, so a
+     * single message larger than this limit is still written whole. A value of
+     * 0 disables the limit.
+     *
+     * @since 0.9.0
+     */
+    static const size_t write_batch_max_bytes = 1048576;
+
+    /// Smallest size of the per-connection read buffer
+    /**
+     * The read buffer starts at this size and grows by doubling, up to
+     * connection_read_buffer_size, whenever a read fills it completely. It
+     * shrinks back by halves after connection_read_buffer_shrink_reads
+     * consecutive reads that used a quarter of it or less, and is released
+     * entirely while reading is paused. Setting this equal to
+     * connection_read_buffer_size keeps the buffer at a fixed size.
+     *
+     * @since 0.9.0
+     */
+    static const size_t connection_read_buffer_min_size = 4096;
+
+    /// Number of consecutive small reads before the read buffer shrinks
+    /**
+     * @since 0.9.0
+     */
+    static const size_t connection_read_buffer_shrink_reads = 8;
+
+    /// Whether connection::send hands messages to the writer without locking
+    /**
+     * When true, messages sent with connection::send, ping, pong, and close
+     * are pushed onto a lock-free multi-producer queue instead of the mutex
+     * protected send queue, and frame preparation for unprepared messages is
+     * deferred to the thread that performs the write. Callers must not modify
+     * a message after passing it to send.
+     *
+     * @since 0.9.0
+     */
+    static const bool lock_free_send_queue = false;
+
+    /// Whether writes started from an io thread are batched per loop turn
+    /**
+     * When true, a connection without a strand that needs to start a write
+     * from the thread running its event loop joins a per thread list instead
+     * of dispatching its own write_frame handler. One handler, posted when
+     * the list starts, starts the writes of every listed connection. A
+     * broadcast from one io thread then costs one dispatch instead of one per
+     * connection.
+     *
+     * @since 0.9.0
+     */
+    static const bool batch_write_dispatch = true;
+
+    /// Whether connections speak only RFC6455 (WebSocket version 13)
+    /**
+     * When true, handshakes for the hybi00, hybi07 and hybi08 drafts are
+     * refused and each connection holds its hybi13 processor in place
+     * rather than allocating one behind the processor interface, so reads,
+     * writes and framing call it directly, without virtual dispatch.
+     *
+     * @since 0.9.0
+     */
+    static const bool rfc6455_only = false;
+
+    /// Whether connections send the endpoint's user agent
+    /**
+     * When false connections hold no copy of the user agent string and send
+     * no Server or User-Agent header of their own, as if it were empty.
+     *
+     * @since 0.9.0
+     */
+    static const bool enable_user_agent = true;
+
+    /// Whether connections support the HTTP client features
+    /**
+     * When false the redirect, progress, body data and body sink support of
+     * HTTP client connections is compiled out of each connection and their
+     * setters are unavailable. Servers never use them.
+     *
+     * @since 0.9.0
+     */
+    static const bool enable_http_client = true;
+
+    /// Whether connections release the handshake once they are open
+    /**
+     * When true the parsed handshake request and response, with their
+     * header maps and bodies, are released as soon as the open handler
+     * returns, as a hibernating connection does. The handshake accessors,
+     * such as get_request_header, then return empty values, except for the
+     * request headers named in retained_request_headers.
+     *
+     * @since 0.9.0
+     */
+    static const bool release_handshake = false;
+
+    /// Request headers kept when the handshake is released
+    /**
+     * Comma separated header names, matched case insensitively, whose
+     * values get_request_header still returns after release_handshake or
+     * hibernation released the handshake request.
+     *
+     * @since 0.9.0
+     */
+    static constexpr char const * retained_request_headers = "";
+
     /// Global flag for enabling/disabling extensions
     static const bool enable_extensions = true;
 
+    /// Offer and accept trusted-link mode
+    /**
+     * When both endpoints set this flag, clients send unmasked frames and
+     * neither side validates the UTF-8 of text messages. Only for links
+     * where both peers and the path between them are trusted.
+     *
+     * @since 0.9.0
+     */
+    static const bool enable_trusted_link = false;
+
     /// Extension specific settings:
 
     /// permessage_deflate extension
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_CONFIG_TRAITS_HPP
+#define WEBSOCKETPP_CONFIG_TRAITS_HPP
+
+#include <cstddef>
+
+namespace websocketpp {
+
+/// Config settings that a config may leave out
+/**
+ * Settings added to the config interface after it was established are read
+ * through this, so that custom configs written before them keep compiling.
+ * Each member is the config's own value when it declares one and the
+ * default otherwise.
+ *
+ * @since 0.9.0
+ */
+template <typename config>
+struct config_traits {
+    /// config::message_reserve_step, 64KiB by default
+    static constexpr size_t message_reserve_step = [] {
+        if constexpr (requires { config::message_reserve_step; }) {
+            return size_t(config::message_reserve_step);
+        } else {
+            return size_t(65536);
+        }
+    }();
+
+    /// config::enable_user_agent, true by default
+    static constexpr bool enable_user_agent = [] {
+        if constexpr (requires { config::enable_user_agent; }) {
+            return bool(config::enable_user_agent);
+        } else {
+            return true;
+        }
+    }();
+
+    /// config::enable_http_client, true by default
+    static constexpr bool enable_http_client = [] {
+        if constexpr (requires { config::enable_http_client; }) {
+            return bool(config::enable_http_client);
+        } else {
+            return true;
+        }
+    }();
+
+    /// transport_config::enable_proxy, true by default
+    static constexpr bool enable_proxy = [] {
+        if constexpr (requires { config::enable_proxy; }) {
+            return bool(config::enable_proxy);
+        } else {
+            return true;
+        }
+    }();
+
+    /// config::write_coalesce_threshold, 0 (off) by default
+    static constexpr size_t write_coalesce_threshold = [] {
+        if constexpr (requires { config::write_coalesce_threshold; }) {
+            return size_t(config::write_coalesce_threshold);
+        } else {
+            return size_t(0);
+        }
+    }();
+
+    /// config::write_batch_max_messages, 512 by default
+    static constexpr size_t write_batch_max_messages = [] {
+        if constexpr (requires { config::write_batch_max_messages; }) {
+            return size_t(config::write_batch_max_messages);
+        } else {
+            return size_t(512);
+        }
+    }();
+
+    /// config::write_batch_max_bytes, 1MiB by default
+    static constexpr size_t write_batch_max_bytes = [] {
+        if constexpr (requires { config::write_batch_max_bytes; }) {
+            return size_t(config::write_batch_max_bytes);
+        } else {
+            return size_t(1048576);
+        }
+    }();
+
+    /// config::connection_read_buffer_min_size, 4KiB by default
+    static constexpr size_t connection_read_buffer_min_size = [] {
+        if constexpr (requires { config::connection_read_buffer_min_size; }) {
+            return size_t(config::connection_read_buffer_min_size);
+        } else {
+            return size_t(4096);
+        }
+    }();
+
+    /// config::connection_read_buffer_shrink_reads, 8 by default
+    static constexpr size_t connection_read_buffer_shrink_reads = [] {
+        if constexpr (requires { config::connection_read_buffer_shrink_reads; }) {
+            return size_t(config::connection_read_buffer_shrink_reads);
+        } else {
+            return size_t(8);
+        }
+    }();
+
+    /// config::lock_free_send_queue, false by default
+    static constexpr bool lock_free_send_queue = [] {
+        if constexpr (requires { config::lock_free_send_queue; }) {
+            return bool(config::lock_free_send_queue);
+        } else {
+            return false;
+        }
+    }();
+
+    /// config::batch_write_dispatch, true by default
+    static constexpr bool batch_write_dispatch = [] {
+        if constexpr (requires { config::batch_write_dispatch; }) {
+            return bool(config::batch_write_dispatch);
+        } else {
+            return true;
+        }
+    }();
+
+    /// config::rfc6455_only, false by default
+    static constexpr bool rfc6455_only = [] {
+        if constexpr (requires { config::rfc6455_only; }) {
+            return bool(config::rfc6455_only);
+        } else {
+            return false;
+        }
+    }();
+
+    /// config::release_handshake, false by default
+    static constexpr bool release_handshake = [] {
+        if constexpr (requires { config::release_handshake; }) {
+            return bool(config::release_handshake);
+        } else {
+            return false;
+        }
+    }();
+
+    /// config::retained_request_headers, none by default
+    static constexpr char const * retained_request_headers =
+        []() -> char const * {
+        if constexpr (requires { config::retained_request_headers; }) {
+            return config::retained_request_headers;
+        } else {
+            return "";
+        }
+    }();
+};
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_CONFIG_TRAITS_HPP
@@ -28,27 +28,76 @@
 #ifndef WEBSOCKETPP_CONNECTION_HPP
 #define WEBSOCKETPP_CONNECTION_HPP
 
+#include <websocketpp/capture.hpp>
 #include <websocketpp/close.hpp>
+#include <websocketpp/connection_base.hpp>
+#include <websocketpp/connection_registry.hpp>
+#include <websocketpp/control_frame_cache.hpp>
+#include <websocketpp/config/traits.hpp>
 #include <websocketpp/error.hpp>
 #include <websocketpp/frame.hpp>
+#include <websocketpp/memory_governor.hpp>
+#include <websocketpp/metrics.hpp>
+#include <websocketpp/message_stream.hpp>
+#include <websocketpp/message_buffer/message.hpp>
+#include <websocketpp/validation_cache.hpp>
 
+#include <websocketpp/extensions/permessage_deflate/compression_policy.hpp>
+#include <websocketpp/extensions/permessage_deflate/compression_pool.hpp>
+
+#include <websocketpp/logger/event.hpp>
+#include <websocketpp/logger/lazy.hpp>
 #include <websocketpp/logger/levels.hpp>
+#include <websocketpp/processors/hybi13.hpp>
 #include <websocketpp/processors/processor.hpp>
+#include <websocketpp/trace/none.hpp>
 #include <websocketpp/transport/base/connection.hpp>
 #include <websocketpp/http/constants.hpp>
+#include <websocketpp/http/body_sink.hpp>
+#include <websocketpp/http/body_source.hpp>
+#include <websocketpp/http/conditional_cache.hpp>
+#include <websocketpp/http/encoding.hpp>
+#include <websocketpp/http/response_cache.hpp>
 
+#include <websocketpp/common/chrono.hpp>
 #include <websocketpp/common/connection_hdl.hpp>
+#include <websocketpp/common/token_bucket.hpp>
 #include <websocketpp/common/cpp11.hpp>
 #include <websocketpp/common/functional.hpp>
-
+#include <websocketpp/common/file_map.hpp>
+#include <websocketpp/common/memory_resource.hpp>
+#include <websocketpp/common/memory_usage.hpp>
+#include <websocketpp/common/mpsc_queue.hpp>
+#include <websocketpp/common/platforms.hpp>
+#include <websocketpp/common/ring_queue.hpp>
+#include <websocketpp/common/slab_allocator.hpp>
+#include <websocketpp/common/timer_wheel.hpp>
+#include <websocketpp/common/type_traits.hpp>
+#include <websocketpp/common/worker_pool.hpp>
+
+#include <atomic>
+#include <deque>
 #include <optional>
 #include <queue>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace websocketpp {
 
+namespace rate_limit {
+    /// What a connection does when its peer exceeds the inbound rate limit
+    enum action {
+        /// Stop reading until the limit allows more
+        pause_reading = 0,
+        /// Close the connection with a policy violation status
+        close = 1
+    };
+} // namespace rate_limit
+
 namespace session{
 	namespace validation {
     	// validation types supported by the validate handler
@@ -134,6 +183,58 @@ typedef lib::function<void(connection_hdl_ref,std::string)> pong_timeout_handler
  */
 typedef lib::function<void(connection_hdl_ref,size_t,size_t)> progress_handler;
 
+/// The type and function signature of a body data handler
+/**
+ * The body data handler is called with each part of the HTTP response body as
+ * it is received (for plain HTTP requests), after any Content-Encoding has
+ * been decoded. While one is set the body is not collected in the response.
+ */
+typedef lib::function<void(connection_hdl_ref,std::string_view)> body_data_handler;
+
+/// The type and function signature of a high watermark handler
+/**
+ * The high watermark handler is called by the thread calling send when the
+ * bytes buffered for writing on a connection rise above its high watermark.
+ * The size parameter is the buffered amount at that time. It is called once
+ * per crossing, the next call follows a call to the drain handler.
+ *
+ * @since 0.9.0
+ */
+typedef lib::function<void(connection_hdl_ref,size_t)> high_watermark_handler;
+
+/// The type and function signature of a drain handler
+/**
+ * The drain handler is called after a write when the bytes buffered for
+ * writing on a connection fell to its low watermark or below, following a
+ * call to the high watermark handler.
+ *
+ * @since 0.9.0
+ */
+typedef lib::function<void(connection_hdl_ref)> drain_handler;
+
+/// The type and function signature of a write complete handler
+/**
+ * The write complete handler is called with the completion id of each sent
+ * message that has one, see message::set_completion_id, once the transport
+ * write holding the message completed.
+ *
+ * @since 0.9.0
+ */
+typedef lib::function<void(connection_hdl_ref,uint64_t)>
+    write_complete_handler;
+
+/// The type and function signature of an event handler
+/**
+ * The event handler is called with a structured record of each connection
+ * lifecycle event also written to the access log as text: opened, failed,
+ * closed and plain HTTP requests answered. It is called whether or not the
+ * matching access log channel is enabled. See log::event_ring for a handler
+ * that writes the records to a memory mapped file.
+ *
+ * @since 0.9.0
+ */
+typedef lib::function<void(log::connection_event const &)> event_handler;
+
 /// The type and function signature of a validate handler
 /**
  * The validate handler is called after a WebSocket handshake has been received
@@ -147,6 +248,33 @@ typedef lib::function<void(connection_hdl_ref,size_t,size_t)> progress_handler;
  */
 typedef lib::function<session::validation::value(connection_hdl_ref)> validate_handler;
 
+/// The type and function signature of an early data handler
+/**
+ * The early data handler is called for a request that arrived in TLS 1.3
+ * early data, which an attacker may replay. Only GET and HEAD requests reach
+ * it. Returning false answers the request with 425 Too Early, after which
+ * the client may send it again once the handshake is complete.
+ */
+typedef lib::function<bool(connection_hdl)> early_data_handler;
+
+/// The type and function signature of the callback completing an
+/// asynchronous validation
+/**
+ * Called once with whether to accept the connection. It may be called from
+ * any thread, and after the connection is gone, in which case it does
+ * nothing.
+ */
+typedef lib::function<void(bool)> validate_callback;
+
+/// The type and function signature of an asynchronous validate handler
+/**
+ * Like the validate handler, but the decision is made later by calling the
+ * callback, so that it may wait for a remote service without holding up the
+ * thread that runs the connection.
+ */
+typedef lib::function<void(connection_hdl, validate_callback)>
+    async_validate_handler;
+
 /// The type and function signature of a http handler
 /**
  * The http handler is called when an HTTP connection is made that does not
@@ -181,6 +309,8 @@ typedef lib::function<void(lib::error_code const & ec)> write_frame_handler;
      * of protocol versions
      */
     static std::vector<int> const versions_supported = {0,7,8,13};
+    /// The protocol versions supported by configs with rfc6455_only set
+    static std::vector<int> const rfc6455_versions_supported = {13};
 #else
     /// Helper array to get around lack of initializer lists pre C++11
     static int const helper[] = {0,7,8,13};
@@ -190,6 +320,8 @@ typedef lib::function<void(lib::error_code const & ec)> write_frame_handler;
      * of protocol versions
      */
     static std::vector<int> const versions_supported(helper,helper+4);
+    /// The protocol versions supported by configs with rfc6455_only set
+    static std::vector<int> const rfc6455_versions_supported(helper+3,helper+4);
 #endif
 
 namespace session {
@@ -230,7 +362,8 @@ namespace internal_state {
         READ_HTTP_RESPONSE = 4,
         WRITE_HTTP_RESPONSE = 5,
         PROCESS_HTTP_REQUEST = 6,
-        PROCESS_CONNECTION = 7
+        PROCESS_CONNECTION = 7,
+        HTTP_IDLE = 8
     };
 } // namespace internal_state
 
@@ -249,6 +382,18 @@ namespace http_state {
 
 } // namespace session
 
+namespace slow_consumer {
+    // what a connection does about a send queue holding more than its slow
+    // consumer limit, see connection::set_slow_consumer_policy
+
+    enum value {
+        none = 0,           // keep queueing
+        drop_oldest = 1,    // drop the oldest droppable data messages
+        conflate = 2,       // keep only the latest message per conflation key
+        disconnect = 3      // close the connection after a grace period
+    };
+} // namespace slow_consumer
+
 namespace http{
 struct body_options{
 	// The encoding of the body that was given to connection::set_body()
@@ -283,6 +428,10 @@ public:
     typedef typename config::alog_type alog_type;
     /// Type of the error logging policy
     typedef typename config::elog_type elog_type;
+    /// Type of the trace policy, see trace::point
+    typedef typename trace::policy<config>::type trace_type;
+    /// Type of the per connection data, see get_user_data
+    typedef typename user_data_policy<config>::type user_data_type;
 
     /// Type of the transport component of this connection
     typedef typename config::transport_type::transport_con_type
@@ -292,6 +441,28 @@ public:
 
     typedef lib::function<void(ptr)> termination_handler;
 
+    /// Called when a keep-alive HTTP client connection becomes idle
+    /**
+     * Returns whether the connection was kept for reuse. If not it is closed.
+     */
+    typedef lib::function<bool(ptr)> http_idle_handler;
+
+    /// Called before an HTTP client connection follows a redirect
+    /**
+     * Receives the connection, the redirect target and whether the
+     * connection itself can be reused for the target. Returns whether the
+     * request was continued on another connection.
+     */
+    typedef lib::function<bool(ptr, uri_ptr, bool)> http_redirect_handler;
+
+    /// Called with the handshake response of an extended CONNECT stream
+    /**
+     * Runs where the response would otherwise be written, before the open or
+     * fail handler. The application sends get_response() as the HEADERS of
+     * the stream. See start_extended_connect.
+     */
+    typedef lib::function<void(connection_hdl_ref)> extended_connect_handler;
+
     typedef typename concurrency_type::scoped_lock_type scoped_lock_type;
     typedef typename concurrency_type::mutex_type mutex_type;
 
@@ -300,6 +471,7 @@ public:
 
     typedef typename config::message_type message_type;
     typedef typename message_type::ptr message_ptr;
+    typedef typename message_type::send_handler send_handler;
 
     typedef typename config::con_msg_manager_type con_msg_manager_type;
     typedef typename con_msg_manager_type::ptr con_msg_manager_ptr;
@@ -310,12 +482,130 @@ public:
     typedef processor::processor<config> processor_type;
     typedef lib::shared_ptr<processor_type> processor_ptr;
 
+    /// Type of the processor a connection uses, see config::rfc6455_only
+    typedef typename std::conditional<config_traits<config>::rfc6455_only,
+        processor::hybi13_final<config>, processor_type>::type
+        active_processor_type;
+    /// Type of pointer to the processor a connection uses
+    typedef typename std::conditional<config_traits<config>::rfc6455_only,
+        active_processor_type *, processor_ptr>::type active_processor_ptr;
+
+    /// Type of a shared pointer to a compression memory budget
+    typedef lib::shared_ptr<extensions::permessage_deflate::memory_budget>
+        deflate_budget_ptr;
+
+    /// Type of a shared pointer to an inbound message memory budget
+    typedef lib::shared_ptr<memory_budget> inbound_budget_ptr;
+
+    /// Type of a shared pointer to an endpoint wide memory governor
+    typedef lib::shared_ptr<memory_governor> memory_governor_ptr;
+
+    /// Type of the permessage-zstd extension, see config::permessage_zstd_type
+    typedef typename processor_type::permessage_zstd_type permessage_zstd_type;
+    /// Type of a shared pointer to a list of zstd dictionaries
+    typedef lib::shared_ptr<typename processor_type::zstd_dictionary_list
+        const> zstd_dictionaries_ptr;
+
+    /// Type of a shared pointer to a timer wheel
+    typedef lib::shared_ptr<timer_wheel> timer_wheel_ptr;
+
+    /// Type of a shared pointer to endpoint metrics
+    typedef lib::shared_ptr<metrics> metrics_ptr;
+
+    /// Type of a shared pointer to a traffic capture
+    typedef lib::shared_ptr<capture> capture_ptr;
+
+    /// Type of a registry of open connections
+    typedef connection_registry<type> registry_type;
+    /// Type of a shared pointer to a registry of open connections
+    typedef lib::shared_ptr<registry_type> registry_ptr;
+
+    /// Type of a shared pointer to a cache of serialized HTTP responses
+    typedef lib::shared_ptr<http::response_cache> response_cache_ptr;
+
+    /// Type of a shared pointer to the prepared control frames of a server
+    typedef lib::shared_ptr<control_frame_cache<message_type> const>
+        control_frames_ptr;
+
+    /// Type of a shared pointer to the handshake response template of a server
+    typedef lib::shared_ptr<processor::handshake_template const>
+        handshake_template_ptr;
+
+    /// Type of a shared pointer to the upgrade request templates of a client
+    typedef lib::shared_ptr<processor::request_template_cache<request_type> >
+        request_templates_ptr;
+
+    /// Type of the policy deciding which messages to compress
+    typedef extensions::permessage_deflate::compression_policy
+        compression_policy;
+
+    /// Type of a shared pointer to compression counters
+    typedef lib::shared_ptr<extensions::permessage_deflate::compression_stats>
+        compression_stats_ptr;
+
+    /// Type of a shared pointer to a compression worker pool
+    typedef lib::shared_ptr<extensions::permessage_deflate::compression_pool>
+        compression_pool_ptr;
+
+    /// Type of a shared pointer to a message handler worker pool
+    typedef lib::shared_ptr<worker_pool> dispatch_pool_ptr;
+
     // Message handler (needs to know message type)
     typedef lib::function<void(connection_hdl,message_ptr)> message_handler;
 
+    /// Send latency handler
+    /**
+     * Receives each message whose transport write completed, the time it
+     * waited in the send queue and the time its write took, see
+     * set_send_latency_handler.
+     *
+     * @since 0.9.0
+     */
+    typedef lib::function<void(connection_hdl,message_ptr,
+        latency_histogram::duration,latency_histogram::duration)>
+        send_latency_handler;
+
+    /// Message view handler
+    /**
+     * Receives the opcode and payload of a data message as a view into the
+     * connection's read buffer. The view is only valid for the duration of
+     * the call.
+     *
+     * @since 0.9.0
+     */
+    typedef lib::function<void(connection_hdl,frame::opcode::value,
+        std::string_view)> message_view_handler;
+
+    /// Message chunk handler
+    /**
+     * Receives the payload of a data message in pieces as it is read, with
+     * the message's opcode and whether the piece is the first and the last
+     * of its message. The view is only valid for the duration of the call.
+     *
+     * @since 0.9.0
+     */
+    typedef lib::function<void(connection_hdl,frame::opcode::value,
+        std::string_view,bool,bool)> message_chunk_handler;
+
+    /// Message batch handler
+    /**
+     * Receives every data message completed by a single transport read, in
+     * the order they arrived. The handler may move messages out of the
+     * vector; it is cleared once the handler returns.
+     *
+     * @since 0.9.0
+     */
+    typedef lib::function<void(connection_hdl,std::vector<message_ptr> &)>
+        message_batch_handler;
+
     /// Type of a pointer to a transport timer handle
     typedef typename transport_con_type::timer_ptr timer_ptr;
 
+    /// Type of a message sent in pieces, see create_stream
+    typedef message_stream<type> stream_type;
+    /// Type of a pointer to a message sent in pieces
+    typedef lib::shared_ptr<stream_type> stream_ptr;
+
     // Misc Convenience Types
     typedef session::internal_state::value istate_type;
 
@@ -330,30 +620,131 @@ public:
     explicit connection(bool p_is_server, std::string const & ua, const lib::shared_ptr<alog_type>& alog,
                         const lib::shared_ptr<elog_type>& elog, rng_type & rng)
       : transport_con_type(p_is_server, alog, elog)
-      , m_handle_read_frame(lib::bind(
-            &type::handle_read_frame,
-            this,
-            lib::placeholders::_1,
-            lib::placeholders::_2
-        ))
-      , m_write_frame_handler(lib::bind(
-            &type::handle_write_frame,
-            this,
-            lib::placeholders::_1
-        ))
+      // lambdas holding only this fit in the small buffer of lib::function,
+      // so the copies the transport makes of them never allocate
+      , m_handle_read_frame([this](lib::error_code const & ec, size_t n) {
+            this->handle_read_frame(ec, n);
+        })
+      , m_handle_read_payload([this](lib::error_code const & ec, size_t n) {
+            this->handle_read_payload(ec, n);
+        })
+      , m_write_frame_handler([this](lib::error_code const & ec) {
+            this->handle_write_frame(ec);
+        })
       , m_user_agent(ua)
 	  , m_max_redirects(0)
+      , m_slab_allocation(false)
+      , m_memory_resource(NULL)
+      , m_read_on_readiness(false)
+      , m_overloaded(false)
+      , m_read_budget(0)
+      , m_deflate_mem_level(0)
+      , m_deflate_idle_timeout(0)
+      , m_templated_response(false)
+      , m_templated_request(false)
+      , m_extended_connect(false)
+      , m_zstd_level(0)
+      , m_use_compression_policy(false)
+      , m_compression_level(0)
+      , m_compression_strategy(
+            extensions::permessage_deflate::strategy::default_strategy)
+      , m_compression_params_pending(false)
+      , m_offload_threshold(0)
+      , m_offload_part_size(0)
+      , m_offload_busy(false)
+      , m_dispatch_max(0)
+      , m_dispatch_pending(0)
+      , m_dispatch_busy(false)
       , m_open_handshake_timeout_dur(config::timeout_open_handshake)
+      , m_validate_timeout_dur(0)
       , m_close_handshake_timeout_dur(config::timeout_close_handshake)
       , m_http_response_timeout_dur(config::timeout_read_http_response)
+      , m_http_idle_timeout_dur(0)
       , m_pong_timeout_dur(config::timeout_pong)
+      , m_keepalive_interval(0)
+      , m_keepalive_jitter(0)
+      , m_keepalive_seed(uint32_t(reinterpret_cast<uintptr_t>(this)) | 1)
+      , m_read_count(0)
+      , m_keepalive_reads(0)
+      , m_keepalive_pending(false)
+      , m_pong_pending(false)
+      , m_rtt(0)
+      , m_hibernate_timeout(0)
+      , m_hibernate_reads(0)
+      , m_hibernating(false)
       , m_max_message_size(config::max_message_size)
+      , m_spill_threshold(0)
+      , m_spill_max_size(0)
       , m_state(session::state::connecting)
       , m_internal_state(session::internal_state::USER_INIT)
+      , m_buf_small_reads(0)
+      , m_read_buf(NULL)
+      , m_read_buf_pooled(false)
+      , m_read_waiting(false)
       , m_msg_manager(new con_msg_manager_type())
+      , m_processor()
+      , m_auto_pong_queued(false)
       , m_send_buffer_size(0)
+      , m_high_watermark(0)
+      , m_low_watermark(0)
+      , m_coalesce_max_delay(0)
+      , m_coalesce_max_bytes(size_t(-1))
+      , m_coalesce_interval(0)
+      , m_coalesce_write_time(0)
+      , m_coalesce_msg_size(0)
+      , m_coalesce_held(false)
+      , m_coalesce_bytes(0)
+      , m_coalesce_urgent(false)
+      , m_above_high_watermark(false)
+      , m_slow_consumer_policy(slow_consumer::none)
+      , m_slow_consumer_limit(0)
+      , m_slow_consumer_grace(0)
+      , m_backlog_start(0)
+      , m_slow_consumer_close(false)
+      , m_dropped_messages(0)
+      , m_send_pending(0)
+      , m_send_popped(0)
+      , m_fragment_size(0)
+      , m_fragment_offset(0)
+      , m_stream_open(false)
+      , m_stream_drain_limit(0)
+      , m_stream_drain_pending(false)
+      , m_stream_writing(false)
+      , m_coalesced_bytes(0)
+      , m_coalesced_messages(0)
+      , m_bytes_in(0)
+      , m_bytes_out(0)
+      , m_messages_in(0)
+      , m_messages_out(0)
+      , m_published_buffer(0)
+      , m_slow_handler_threshold(0)
+      , m_accounting(false)
+      , m_consume_time(0)
+      , m_prepare_time(0)
+      , m_handler_time(0)
+      , m_metrics_open(false)
+      , m_capture_id(0)
+      , m_id(0)
       , m_write_flag(false)
+      , m_cork_depth(0)
+      , m_cork_pending(false)
+      , m_open_response(NULL)
+      , m_opened_early(false)
+      , m_early_request(false)
       , m_read_flag(true)
+      , m_flow_max_messages(0)
+      , m_flow_max_bytes(0)
+      , m_flow_messages(0)
+      , m_flow_bytes(0)
+      , m_flow_paused(false)
+      , m_rate_action(rate_limit::pause_reading)
+      , m_rate_seen(0)
+      , m_rate_paused(false)
+      , m_governed_send(0)
+      , m_governed_read(0)
+      , m_governor_paused(false)
+      , m_governor_shrunk(false)
+      , m_governor_released(false)
       , m_is_server(p_is_server)
       , m_alog(alog)
       , m_elog(elog)
@@ -362,9 +753,35 @@ public:
       , m_remote_close_code(close::status::abnormal_close)
       , m_is_http(false)
       , m_http_state(session::http_state::init)
+      , m_http_reused(false)
+      , m_max_http_requests(1)
+      , m_http_requests(0)
+      , m_http_keep_alive(false)
+      , m_http_chunked(false)
+      , m_http_parts(0)
+      , m_in_http_handler(false)
+      , m_http_body_written(false)
+      , m_validating(false)
+      , m_idle_read_pending(false)
       , m_was_clean(false)
     {
         m_alog->write(log::alevel::devel,"connection constructor");
+
+        m_lane_weights[priority::control] = 0;
+        m_lane_weights[priority::high] = 4;
+        m_lane_weights[priority::normal] = 2;
+        m_lane_weights[priority::bulk] = 1;
+        for (size_t i = 0; i < close_lane; ++i) {
+            m_lane_credits[i] = m_lane_weights[i];
+        }
+    }
+
+    ~connection() {
+        release_pooled_read_buffer();
+        if (m_governor) {
+            release_memory_charge();
+            m_governor->detach();
+        }
     }
 
     /// Get a shared pointer to this component
@@ -499,6 +916,54 @@ public:
         m_validate_handler = h;
     }
 
+    /// Set early data handler
+    /**
+     * Servers accepting TLS 1.3 early data answer any request that arrived
+     * in it with 425 Too Early unless it is a GET or HEAD request and the
+     * early data handler, if there is one, returns true. This is where
+     * applications hook in replay protection, such as rejecting requests
+     * whose resource has side effects or tracking single use tokens.
+     *
+     * @since 0.9.0
+     *
+     * @param h The new early_data_handler
+     */
+    void set_early_data_handler(early_data_handler h) {
+        m_early_data_handler = h;
+    }
+
+    /// Set asynchronous validate handler
+    /**
+     * Replaces the validate handler. The handler is given a callback that
+     * accepts or rejects the connection, and the handshake waits for it
+     * within the validate timeout, see set_validate_timeout. Response headers
+     * and status codes must be set before the handler returns, since the
+     * callback may run on another thread.
+     *
+     * @since 0.9.0
+     *
+     * @param h The new async_validate_handler
+     */
+    void set_async_validate_handler(async_validate_handler h) {
+        m_async_validate_handler = h;
+    }
+
+    /// Set the time an asynchronous validation may take
+    /**
+     * Rearms the open handshake timer when the asynchronous validate handler
+     * is called. Handshakes whose validation takes longer are rejected with
+     * 503 Service Unavailable and the open_handshake_timeout error. A value
+     * of 0, the default, leaves the open handshake timeout in charge, which
+     * fails the connection without a response.
+     *
+     * @since 0.9.0
+     *
+     * @param dur The length of the validate timeout in ms
+     */
+    void set_validate_timeout(long dur) {
+        m_validate_timeout_dur = dur;
+    }
+
     /// Set message handler
     /**
      * The message handler is called after a new message has been received.
@@ -509,16 +974,210 @@ public:
         m_message_handler = h;
     }
 
+    /// Set message view handler
+    /**
+     * When set, uncompressed single frame data messages that arrive in one
+     * read are delivered to the message view handler as a view of the
+     * unmasked payload in the read buffer, without allocating or copying a
+     * message. The view is only valid until the handler returns; copy the
+     * bytes to keep them. All other data messages (fragmented, compressed, or
+     * split across reads) are delivered to the message handler as usual.
+     *
+     * Message views are not supported by the hybi00 protocol version; its
+     * messages always go to the message handler.
+     *
+     * @since 0.9.0
+     *
+     * @param h The new message_view_handler
+     */
+    void set_message_view_handler(message_view_handler h) {
+        m_message_view_handler = h;
+        if (m_processor) {
+            m_processor->set_message_views(bool(m_message_view_handler));
+        }
+    }
+
+    /// Set message chunk handler
+    /**
+     * When set, every data message is delivered to the message chunk handler
+     * in pieces as its frames are read, unmasked and decompressed, instead of
+     * being collected and passed to the message or message view handler. A
+     * piece holds at most what one transport read produced, so large
+     * messages can be written to disk or fed to a parser without buffering
+     * them whole. Text is UTF-8 validated as it arrives, though a piece may
+     * end part way through a code point.
+     *
+     * The maximum message size still limits the total size of each message.
+     * Pieces may be empty only when they are the last of their message.
+     *
+     * Not supported by the hybi00 protocol version; its messages always go to
+     * the message handler.
+     *
+     * @since 0.9.0
+     *
+     * @param h The new message_chunk_handler
+     */
+    void set_message_chunk_handler(message_chunk_handler h) {
+        m_message_chunk_handler = h;
+        if (m_processor) {
+            m_processor->set_message_chunks(bool(m_message_chunk_handler));
+        }
+    }
+
+    /// Set message batch handler
+    /**
+     * When set, data messages that would go to the message handler are
+     * collected while a read is processed and delivered together once the
+     * read buffer has been consumed, so that work such as locking or handing
+     * off to other threads can be done once per read instead of once per
+     * message. The message handler is not called while a batch handler is set.
+     *
+     * Messages delivered to the message view handler flush the pending batch
+     * first, so ordering between the two is preserved.
+     *
+     * @since 0.9.0
+     *
+     * @param h The new message_batch_handler
+     */
+    void set_message_batch_handler(message_batch_handler h) {
+        m_message_batch_handler = h;
+    }
+
 	/// Set progress handler
     /**
      * The progress handler is called when bytes making up a HTTP body are processed
      *
+     * Not available without config::enable_http_client.
+     *
      * @param h The new progress_handler
      */
     void set_progress_handler(progress_handler h) {
+        static_assert(config_traits<config>::enable_http_client,
+            "set_progress_handler needs config::enable_http_client");
         m_progress_handler = h;
     }
 
+    /// Set body data handler
+    /**
+     * The body data handler receives the decoded HTTP response body in parts
+     * as they arrive, instead of the body being collected in the response.
+     * Must be set before the connection is started. Not available without
+     * config::enable_http_client.
+     *
+     * @since 0.9.0
+     *
+     * @param h The new body_data_handler
+     */
+    void set_body_data_handler(body_data_handler h) {
+        static_assert(config_traits<config>::enable_http_client,
+            "set_body_data_handler needs config::enable_http_client");
+        m_body_data_handler = h;
+    }
+
+    /// Set a sink for the HTTP response body
+    /**
+     * Sends the decoded response body straight to the sink as it is parsed,
+     * for example an http::fd_sink or http::mmap_sink to download to a file in
+     * constant memory. The max_http_body_size limit does not apply while a
+     * sink is set. Takes precedence over a body data handler. Must be set
+     * before the connection is started. Not available without
+     * config::enable_http_client.
+     *
+     * @since 0.9.0
+     *
+     * @param sink The body sink, or null to collect the body
+     */
+    void set_body_sink(http::body_sink::ptr sink) {
+        static_assert(config_traits<config>::enable_http_client,
+            "set_body_sink needs config::enable_http_client");
+        m_body_sink = sink;
+    }
+
+    /// Set a source for the HTTP request body
+    /**
+     * Streams the request body from the source as the transport accepts it,
+     * for example an http::fd_source or http::mmap_source to upload a file in
+     * constant memory. The next part is only read once the previous one was
+     * written, so a slow server slows the reads down rather than letting
+     * them pile up in memory. Replaces any body set on the request. Must be
+     * set before the connection is started. Not available without
+     * config::enable_http_client.
+     *
+     * A body of known size without an encoding is sent with Content-Length,
+     * anything else with chunked transfer encoding, which needs HTTP/1.1.
+     * With an encoding the body is compressed as it is sent and the
+     * Content-Encoding header is set; support for the encoding must be
+     * compiled in, see http/encoding.hpp. The open handshake timeout applies
+     * to each part rather than to the whole upload. Redirects are not
+     * followed, as the body can't be read a second time.
+     *
+     * @since 0.9.0
+     *
+     * @param source The body source, or null to send the request body
+     * @param encoding The content encoding to apply to the body, if any
+     */
+    void set_request_body_source(http::body_source::ptr source,
+        std::optional<http::content_encoding::value> encoding = std::nullopt)
+    {
+        static_assert(config_traits<config>::enable_http_client,
+            "set_request_body_source needs config::enable_http_client");
+        m_upload.source = source;
+        m_upload.encoding = encoding;
+    }
+
+    /// Set high watermark handler
+    /**
+     * The high watermark handler is called when the buffered amount rises
+     * above the high watermark, see set_send_watermarks.
+     *
+     * @since 0.9.0
+     *
+     * @param h The new high_watermark_handler
+     */
+    void set_high_watermark_handler(high_watermark_handler h) {
+        m_high_watermark_handler = h;
+    }
+
+    /// Set drain handler
+    /**
+     * The drain handler is called when the buffered amount falls back to the
+     * low watermark, see set_send_watermarks.
+     *
+     * @since 0.9.0
+     *
+     * @param h The new drain_handler
+     */
+    void set_drain_handler(drain_handler h) {
+        m_drain_handler = h;
+    }
+
+    /// Set write complete handler
+    /**
+     * Gives a completion per send: the handler is called with the
+     * completion id of each message written, see write_complete_handler.
+     * Messages dropped by the slow consumer policy, or still queued when
+     * the connection ends, are not reported.
+     *
+     * @since 0.9.0
+     *
+     * @param h The new write_complete_handler
+     */
+    void set_write_complete_handler(write_complete_handler h) {
+        m_write_complete_handler = h;
+    }
+
+    /// Set event handler
+    /**
+     * See event_handler.
+     *
+     * @since 0.9.0
+     *
+     * @param h The new event_handler
+     */
+    void set_event_handler(event_handler h) {
+        m_event_handler = h;
+    }
+
     //////////////////////////////////////////
     // Connection timeouts and other limits //
     //////////////////////////////////////////
@@ -598,87 +1257,1014 @@ public:
         m_http_response_timeout_dur = dur;
     }
 
-    /// Set pong timeout
+    /// Set the idle handler of an HTTP client connection
     /**
-     * Sets the length of time the library will wait for a pong response to a
-     * ping. This can be used as a keepalive or to detect broken  connections.
+     * When set, an HTTP/1.1 client connection whose response was framed by
+     * Content-Length or chunked encoding and that neither side asked to close
+     * is not closed after the http handler returns. It is handed to the idle
+     * handler instead, which keeps it for a later request and returns true or
+     * returns false to have it closed. The client endpoint uses this for its
+     * connection pool, see client::set_http_pool_size.
      *
-     * Pong responses that time out will have the pong timeout handler called.
+     * @since 0.9.0
      *
-     * The default value is specified via the compile time config value
-     * 'timeout_pong'. The default value in the core config
-     * is 5000ms. A value of 0 will disable the timer entirely.
+     * @param h The new http_idle_handler
+     */
+    void set_http_idle_handler(http_idle_handler h) {
+        m_http_idle_handler = h;
+    }
+
+    /// Set the redirect handler of an HTTP client connection
+    /**
+     * Redirects to the same scheme, host and port are followed on the same
+     * connection when it can be kept alive. Otherwise the redirect handler
+     * may continue the request on another connection, see
+     * transfer_http_request. Without one, or if it returns false, the
+     * redirect response is the result of the request. The client endpoint
+     * uses this to follow redirects through its connection pool and to cache
+     * permanent redirects. Not available without config::enable_http_client.
      *
-     * To be effective, the transport you are using must support timers. See
-     * the documentation for your transport policy for details about its
-     * timer support.
+     * @since 0.9.0
      *
-     * @param dur The length of the pong timeout in ms
+     * @param h The new http_redirect_handler
      */
-    void set_pong_timeout(long dur) {
-        m_pong_timeout_dur = dur;
+    void set_http_redirect_handler(http_redirect_handler h) {
+        static_assert(config_traits<config>::enable_http_client,
+            "set_http_redirect_handler needs config::enable_http_client");
+        m_http_redirect_handler = h;
     }
 
-    /// Get maximum message size
+    /// Revalidate plain HTTP GET responses against a conditional cache
     /**
-     * Get maximum message size. Maximum message size determines the point at 
-     * which the connection will fail with the message_too_big protocol error.
+     * Requests of this connection get If-None-Match and If-Modified-Since
+     * for a response stored in the cache, and a 304 answer is replaced by
+     * the stored response before the http handler runs, see
+     * http::conditional_cache. Normally set by the client endpoint, see
+     * client::set_http_cache. Not available without
+     * config::enable_http_client.
      *
-     * The default is set by the endpoint that creates the connection.
+     * @since 0.9.0
      *
-     * @since 0.3.0
+     * @param value The cache, or null for none
      */
-    size_t get_max_message_size() const {
-        return m_max_message_size;
+    void set_http_cache(http::conditional_cache::ptr value) {
+        static_assert(config_traits<config>::enable_http_client,
+            "set_http_cache needs config::enable_http_client");
+        m_http_cache = value;
     }
-    
-    /// Set maximum message size
+
+    /// Set the idle timeout of a kept alive HTTP client connection
     /**
-     * Set maximum message size. Maximum message size determines the point at 
-     * which the connection will fail with the message_too_big protocol error. 
-     * This value may be changed during the connection.
-     *
-     * The default is set by the endpoint that creates the connection.
+     * An idle connection that was not reused within this many milliseconds is
+     * closed. A value of 0 keeps it until the server closes it.
      *
-     * @since 0.3.0
+     * @since 0.9.0
      *
-     * @param new_value The value to set as the maximum message size.
+     * @param dur The length of the idle timeout in ms
      */
-    void set_max_message_size(size_t new_value) {
-        m_max_message_size = new_value;
-        if (m_processor) {
-            m_processor->set_max_message_size(new_value);
-        }
+    void set_http_idle_timeout(long dur) {
+        m_http_idle_timeout_dur = dur;
     }
 
-	/// Get maximum number of redirects
+    /// Whether this HTTP client connection is idle and may be reused
     /**
-     * Get maximum number of redirects to follow before returning.
-	 * If 0, never follow redirects (default)
-     *
-     * @since 0.8.4
+     * @since 0.9.0
      */
-    size_t get_max_redirects() const {
-        return m_max_redirects;
+    bool is_http_idle() const {
+        scoped_lock_type lock(m_connection_state_lock);
+        return m_internal_state == session::internal_state::HTTP_IDLE &&
+            m_state == session::state::open;
     }
-    
-    /// Set maximum number of redirects
+
+    /// Prepare an idle HTTP client connection for another request
     /**
-     * Set maximum number of redirects to follow before returning.
-     * If 0, never follow redirects (default)
+     * Resets the request and the response and clears the handlers. The
+     * request can then be set up and the connection started as if it was
+     * new, except that the transport is not connected again. Only the
+     * endpoint should call this, see client::get_connection.
      *
-     * @since 0.8.4
+     * @since 0.9.0
      *
-     * @param new_value The value to set as the max number of redirects to.
+     * @param location The URI of the next request, on the same host
+     * @return Whether the connection was idle and could be reused
      */
-    void set_max_redirects(size_t new_value) {
-        m_max_redirects = new_value;
-    }
-    
-    /// Get maximum HTTP message body size
+    bool reuse_http(uri_ptr location);
+
+    /// Continue the HTTP request of this connection on another connection
     /**
-     * Get maximum HTTP message body size. Maximum message body size determines
-     * the point at which the connection will stop reading an HTTP request whose
+     * Copies the request, the request handlers and the remaining redirect
+     * allowance to next, which must not have been started yet. The request
+     * is addressed to target. Used by the endpoint to follow redirects to
+     * another origin.
+     *
+     * @since 0.9.0
+     *
+     * @param next The connection to continue on
+     * @param target The URI to request on next
+     */
+    void transfer_http_request(ptr next, uri_ptr target);
+
+    /// Whether this connection was reused from the HTTP connection pool
+    /**
+     * @since 0.9.0
+     */
+    bool is_http_reused() const {
+        return m_http_reused;
+    }
+
+    /// Set how many plain HTTP requests a server connection serves
+    /**
+     * With a value above 1, a server connection whose http handler answered
+     * a request is kept open for the next request when HTTP keep-alive
+     * applies: the request is HTTP/1.1 and neither side sent
+     * `Connection: close`, or it is HTTP/1.0 with `Connection: keep-alive`.
+     * Requests pipelined behind the first one are taken from the bytes
+     * already read. The wait for the next request is bounded by the open
+     * handshake timeout, and a later request may still be a WebSocket
+     * handshake. The response to the last request allowed carries
+     * `Connection: close`.
+     *
+     * The default of 1 closes the connection after each response.
+     *
+     * @since 0.9.0
+     *
+     * @param max The number of requests, 0 is taken as 1
+     */
+    void set_max_http_requests(size_t max) {
+        m_max_http_requests = max ? max : 1;
+    }
+
+    /// Get the number of plain HTTP requests this connection answered
+    /**
+     * @since 0.9.0
+     */
+    size_t get_http_request_count() const {
+        return m_http_requests;
+    }
+
+    /// Answer plain HTTP requests found in a cache without the http handler
+    /**
+     * Normally set by the endpoint, see endpoint::set_response_cache.
+     *
+     * @since 0.9.0
+     *
+     * @param value The cache, or null for none
+     */
+    void set_response_cache(response_cache_ptr value) {
+        m_response_cache = value;
+    }
+
+    /// Reuse validation results by the value of a request header
+    /**
+     * Normally set by the endpoint, see endpoint::set_validation_cache.
+     *
+     * @since 0.9.0
+     *
+     * @param value The cache, or null for none
+     */
+    void set_validation_cache(validation_cache::ptr value) {
+        m_validation_cache = value;
+    }
+
+    /// Set pong timeout
+    /**
+     * Sets the length of time the library will wait for a pong response to a
+     * ping. This can be used as a keepalive or to detect broken  connections.
+     *
+     * Pong responses that time out will have the pong timeout handler called.
+     *
+     * The default value is specified via the compile time config value
+     * 'timeout_pong'. The default value in the core config
+     * is 5000ms. A value of 0 will disable the timer entirely.
+     *
+     * To be effective, the transport you are using must support timers. See
+     * the documentation for your transport policy for details about its
+     * timer support.
+     *
+     * @param dur The length of the pong timeout in ms
+     */
+    void set_pong_timeout(long dur) {
+        m_pong_timeout_dur = dur;
+    }
+
+    /// Ping the peer whenever it has been silent for a while
+    /**
+     * Once open, the connection checks every interval whether anything was
+     * read since the last check, and sends an empty ping if not. The pong
+     * timeout applies to these pings as to any other, see set_pong_timeout,
+     * and their round trip time is reported by get_rtt.
+     *
+     * Each check is delayed by a random extra of up to jitter milliseconds so
+     * that the pings of connections opened together are spread out. The
+     * checks are armed on the timer wheel when there is one, see
+     * set_timer_wheel.
+     *
+     * The default is set by the endpoint that creates the connection. An
+     * interval of 0 disables keepalive pings. Must be set before the
+     * connection opens.
+     *
+     * @since 0.9.0
+     *
+     * @param interval Milliseconds of silence before a ping is sent
+     * @param jitter The largest extra delay of a check in milliseconds
+     */
+    void set_keepalive(long interval, long jitter) {
+        m_keepalive_interval = interval;
+        m_keepalive_jitter = jitter;
+    }
+
+    /// Get the keepalive interval
+    /**
+     * @since 0.9.0
+     *
+     * @return Milliseconds of silence before a ping is sent, 0 if disabled
+     */
+    long get_keepalive_interval() const {
+        return m_keepalive_interval;
+    }
+
+    /// Set the prepared control frames shared with other connections
+    /**
+     * Normally set by server endpoints, which prepare them once for all their
+     * connections. Empty pings and pongs and close frames without a reason
+     * are sent from the cache instead of being prepared for each connection.
+     *
+     * @since 0.9.0
+     *
+     * @param value The cache, or null to prepare every control frame
+     */
+    void set_control_frames(control_frames_ptr value) {
+        m_control_frames = value;
+    }
+
+    /// Set the handshake response template shared with other connections
+    /**
+     * Normally set by server endpoints. When the application leaves the
+     * response alone (no headers added, status or body changed in the
+     * validate handler) an accepted handshake is answered from the template
+     * and the standard handshake headers aren't added to the response
+     * object.
+     *
+     * @since 0.9.0
+     *
+     * @param value The template, or null to always build the response
+     */
+    void set_handshake_template(handshake_template_ptr value) {
+        m_handshake_template = value;
+    }
+
+    /// Set the upgrade request templates shared with other connections
+    /**
+     * Normally set by client endpoints, see endpoint::set_request_templates.
+     * When the application added no headers to the request, the upgrade
+     * request is written from the template of its target, or builds that
+     * template.
+     *
+     * @since 0.9.0
+     *
+     * @param value The templates, or null to always build the request
+     */
+    void set_request_templates(request_templates_ptr value) {
+        m_request_templates = value;
+    }
+
+    /// Release memory of connections that went idle
+    /**
+     * Once open, the connection checks every `timeout` milliseconds whether
+     * anything was read since the last check. If not and nothing is being
+     * sent, it hibernates: it releases the parsed handshake request and
+     * response, compression contexts where the negotiated parameters allow
+     * it, and the capacity of its send and receive bookkeeping. They are
+     * created again as needed when the connection wakes on the next read.
+     *
+     * The handshake accessors, such as get_request_header, return empty
+     * values once the connection has hibernated, except for the headers in
+     * config::retained_request_headers. Hibernation does not release
+     * a read buffer held by an outstanding read, together with
+     * set_read_on_readiness an idle connection holds none.
+     *
+     * The default is set by the endpoint that creates the connection. A
+     * timeout of 0 disables hibernation. Must be set before the connection
+     * opens.
+     *
+     * @since 0.9.0
+     *
+     * @param timeout Milliseconds without reads before hibernating
+     */
+    void set_hibernate_timeout(long timeout) {
+        m_hibernate_timeout = timeout;
+    }
+
+    /// Whether the connection is hibernating, see set_hibernate_timeout
+    /**
+     * @since 0.9.0
+     */
+    bool is_hibernating() const {
+        return m_hibernating;
+    }
+
+    /// Get the round trip time of the last answered keepalive ping
+    /**
+     * @since 0.9.0
+     *
+     * @return The round trip time in microseconds, or 0 if no keepalive ping
+     * was answered yet
+     */
+    long get_rtt() const {
+        return m_rtt;
+    }
+
+    /// Get maximum message size
+    /**
+     * Get maximum message size. Maximum message size determines the point at 
+     * which the connection will fail with the message_too_big protocol error.
+     *
+     * The default is set by the endpoint that creates the connection.
+     *
+     * @since 0.3.0
+     */
+    size_t get_max_message_size() const {
+        return m_max_message_size;
+    }
+    
+    /// Set maximum message size
+    /**
+     * Set maximum message size. Maximum message size determines the point at 
+     * which the connection will fail with the message_too_big protocol error. 
+     * This value may be changed during the connection.
+     *
+     * The default is set by the endpoint that creates the connection.
+     *
+     * @since 0.3.0
+     *
+     * @param new_value The value to set as the maximum message size.
+     */
+    void set_max_message_size(size_t new_value) {
+        m_max_message_size = new_value;
+        if (m_processor) {
+            m_processor->set_max_message_size(new_value);
+        }
+    }
+
+    /// Spill large incoming messages to a temporary file
+    /**
+     * Incoming data messages whose payload grows past `threshold` bytes are
+     * moved to an unlinked temporary file and delivered with their payload
+     * memory mapped from it, so a large upload does not need a heap buffer
+     * of its size. Read the payload with get_payload_data and
+     * get_payload_size, or copy it out with get_payload. Messages delivered
+     * in chunks are not spilled.
+     *
+     * Spilled messages may grow up to `max_size` bytes rather than the
+     * maximum message size.
+     *
+     * The default is set by the endpoint that creates the connection.
+     *
+     * @since 0.9.0
+     *
+     * @param threshold Payload bytes kept in memory, 0 to disable spilling
+     * @param max_size The largest spilled message accepted, 0 for the maximum
+     * message size
+     * @param dir The directory for the files, empty for $TMPDIR or /tmp
+     */
+    void set_message_spill(size_t threshold, size_t max_size = 0,
+        std::string const & dir = std::string())
+    {
+        m_spill_threshold = threshold;
+        m_spill_max_size = max_size;
+        m_spill_dir = dir;
+        if (m_processor) {
+            m_processor->set_message_spill(threshold, max_size, dir);
+        }
+    }
+
+    /// Get the payload size past which incoming messages are spilled
+    /**
+     * @since 0.9.0
+     *
+     * @return The threshold in bytes, 0 if spilling is disabled
+     */
+    size_t get_spill_threshold() const {
+        return m_spill_threshold;
+    }
+
+	/// Get maximum number of redirects
+    /**
+     * Get maximum number of redirects to follow before returning.
+	 * If 0, never follow redirects (default)
+     *
+     * @since 0.8.4
+     */
+    size_t get_max_redirects() const {
+        return m_max_redirects;
+    }
+    
+    /// Set maximum number of redirects
+    /**
+     * Set maximum number of redirects to follow before returning.
+     * If 0, never follow redirects (default)
+     *
+     * @since 0.8.4
+     *
+     * @param new_value The value to set as the max number of redirects to.
+     */
+    void set_max_redirects(size_t new_value) {
+        m_max_redirects = new_value;
+    }
+    
+    /// Set whether the protocol processor is allocated from per-thread slabs
+    /**
+     * Must be called before the handshake is processed to have any effect.
+     * Normally set by the endpoint, see endpoint::set_slab_allocation.
+     *
+     * @since 0.9.0
+     *
+     * @param value Whether or not to use slab allocation for the processor
+     */
+    void set_slab_allocation(bool value) {
+        m_slab_allocation = value;
+    }
+
+    /// Allocate the processor and messages from a memory resource
+    /**
+     * The protocol processor is allocated from the resource, in place of
+     * the slab allocator if that is enabled too, and so are the messages of
+     * the connection's message manager if it supports memory resources, as
+     * message_buffer::alloc::con_msg_manager does. The resource must outlive
+     * the connection and every message it handed out. Must be called before
+     * the handshake is processed. Normally set by the endpoint, see
+     * endpoint::set_memory_resource.
+     *
+     * @since 0.9.0
+     *
+     * @param resource The resource to allocate from, or null for the
+     * default allocation
+     */
+    void set_memory_resource(std::pmr::memory_resource * resource) {
+        m_memory_resource = resource;
+        set_manager_resource(*m_msg_manager, resource);
+    }
+
+    /// Take pooled read buffers from huge pages
+    /**
+     * @see endpoint::set_read_buffer_resource
+     *
+     * @since 0.9.0
+     */
+    static void set_read_buffer_resource(huge_page_resource * resource) {
+        read_buffer_pool::set_backing(resource);
+    }
+
+    /// Get the number of pooled read buffers in the shared free list
+    /**
+     * @see endpoint::get_read_buffer_shared_free
+     *
+     * @since 0.9.0
+     */
+    static size_t get_read_buffer_shared_free() {
+        return read_buffer_pool::shared_free();
+    }
+
+    /// Fill the read buffer pool ahead of use
+    /**
+     * Allocates read buffers for read on readiness mode and touches their
+     * pages. They go to the shared free list of the resource set with
+     * set_read_buffer_resource, or without one to the calling thread's pool.
+     * A thread holds a buffer only while it reads, so at most
+     * slab_cache::max_free are reserved.
+     *
+     * @since 0.9.0
+     *
+     * @param count The number of buffers wanted
+     */
+    static void reserve_read_buffers(size_t count) {
+        size_t const max = read_buffer_pool::max_free;
+        read_buffer_pool::reserve(count < max ? count : max);
+    }
+
+    /// Set whether reads wait for readiness and use pooled buffers
+    /**
+     * Takes effect on the next read issued after the opening handshake.
+     * Normally set by the endpoint, see endpoint::set_read_on_readiness.
+     *
+     * @since 0.9.0
+     *
+     * @param value Whether or not to read on readiness from pooled buffers
+     */
+    void set_read_on_readiness(bool value) {
+        m_read_on_readiness = value;
+    }
+
+    /// Hold an object for as long as the opening handshake runs
+    /**
+     * The slot is released once the handshake response was written or the
+     * connection ended, whichever comes first. Server endpoints use this to
+     * bound the number of connections in their handshake, see
+     * server::set_max_handshakes.
+     *
+     * @since 0.9.0
+     *
+     * @param slot The object to hold
+     */
+    void set_handshake_slot(lib::shared_ptr<void> slot) {
+        m_handshake_slot = slot;
+    }
+
+    /// Answer the opening handshake with 503 Service Unavailable
+    /**
+     * The request is read and answered without running the validate or
+     * http handlers. Must be called before the connection is started. Used
+     * by server endpoints for connections over their handshake limit.
+     *
+     * @since 0.9.0
+     *
+     * @param value Whether or not to reject the handshake
+     */
+    void set_overloaded(bool value) {
+        m_overloaded = value;
+    }
+
+    /// Drop the connection with a TCP reset
+    /**
+     * Terminates the connection without a closing handshake and, where the
+     * transport supports it, resets the TCP connection instead of closing
+     * it gracefully. Used by server endpoints for connections over their
+     * handshake limit.
+     *
+     * @since 0.9.0
+     *
+     * @param ec The error to terminate with
+     */
+    void abort(lib::error_code const & ec) {
+        transport_con_type::reset_on_close();
+        terminate(ec);
+    }
+
+    /// Set the number of bytes to drain per read before re-arming it
+    /**
+     * Normally set by the endpoint, see endpoint::set_read_budget.
+     *
+     * @since 0.9.0
+     *
+     * @param value The read budget in bytes, 0 to disable
+     */
+    void set_read_budget(size_t value) {
+        m_read_budget = value;
+    }
+
+    /// Set the deflate memory level
+    /**
+     * Normally set by the endpoint, see endpoint::set_deflate_mem_level. Must
+     * be set before the opening handshake.
+     *
+     * @since 0.9.0
+     *
+     * @param value The deflate memory level, 0 for the default
+     */
+    void set_deflate_mem_level(int value) {
+        m_deflate_mem_level = value;
+    }
+
+    /// Set the idle time after which compression contexts are released
+    /**
+     * Normally set by the endpoint, see endpoint::set_deflate_idle_timeout.
+     * Must be set before the opening handshake.
+     *
+     * @since 0.9.0
+     *
+     * @param value The idle timeout in milliseconds, 0 to disable
+     */
+    void set_deflate_idle_timeout(long value) {
+        m_deflate_idle_timeout = value;
+    }
+
+    /// Set the budget to charge compression memory to
+    /**
+     * Normally set by the endpoint, see endpoint::set_deflate_memory_limit.
+     * Must be set before the opening handshake.
+     *
+     * @since 0.9.0
+     *
+     * @param value The budget, or null for no limit
+     */
+    void set_deflate_memory_budget(deflate_budget_ptr value) {
+        m_deflate_budget = value;
+    }
+
+    /// Set the budget to charge incoming message buffers to
+    /**
+     * Normally set by the endpoint, see endpoint::set_inbound_memory_limit.
+     * Must be set before the opening handshake.
+     *
+     * @since 0.9.0
+     *
+     * @param value The budget, or null for no limit
+     */
+    void set_inbound_memory_budget(inbound_budget_ptr value) {
+        m_inbound_budget = value;
+    }
+
+    /// Set the governor to charge this connection's memory to
+    /**
+     * Normally set by the endpoint, see endpoint::set_memory_limit. Must be
+     * set before the connection is started.
+     *
+     * @since 0.9.0
+     *
+     * @param value The governor, or null for none
+     */
+    void set_memory_governor(memory_governor_ptr value) {
+        if (m_governor) {
+            m_governor->detach();
+        }
+        m_governor = value;
+        if (m_governor) {
+            m_governor->attach();
+        }
+    }
+
+    /// Get the governor this connection's memory is charged to
+    /**
+     * @since 0.9.0
+     *
+     * @return The governor, or null if there is none
+     */
+    memory_governor_ptr get_memory_governor() const {
+        return m_governor;
+    }
+
+    /// Set the wheel to run the connection's timeouts on
+    /**
+     * Normally set by the endpoint, see endpoint::set_timer_wheel. The
+     * handshake, pong, close and compression idle timeouts are armed on the
+     * wheel rather than as transport timers. Must be set before the
+     * connection is started.
+     *
+     * @since 0.9.0
+     *
+     * @param value The wheel, or null to use transport timers
+     */
+    void set_timer_wheel(timer_wheel_ptr value) {
+        m_timer_wheel = value;
+    }
+
+    /// Offer or accept a preset deflate dictionary
+    /**
+     * Normally set by the endpoint, see endpoint::set_deflate_dictionary.
+     * Must be set before the opening handshake.
+     *
+     * @since 0.9.0
+     *
+     * @param id Name of the dictionary exchanged during negotiation
+     * @param dictionary The dictionary contents
+     */
+    void set_deflate_dictionary(std::string const & id,
+        lib::shared_ptr<std::string const> dictionary)
+    {
+        m_deflate_dictionary_id = id;
+        m_deflate_dictionary = dictionary;
+    }
+
+    /// Configure the permessage-zstd extension
+    /**
+     * Normally set by the endpoint, see endpoint::set_zstd_compression_level
+     * and endpoint::add_zstd_dictionary. Must be set before the opening
+     * handshake. Ignored unless the config enables permessage-zstd.
+     *
+     * @since 0.9.0
+     *
+     * @param level The compression level, 0 for the extension's default
+     * @param dictionaries Dictionaries to offer or accept, or null for none
+     */
+    void set_zstd_params(int level, zstd_dictionaries_ptr dictionaries) {
+        m_zstd_level = level;
+        m_zstd_dictionaries = dictionaries;
+    }
+
+    /// Decide per message whether to compress
+    /**
+     * Normally set by the endpoint, see endpoint::set_compression_policy.
+     *
+     * @since 0.9.0
+     *
+     * @param value The policy to copy
+     */
+    void set_compression_policy(compression_policy const & value) {
+        scoped_lock_type lock(m_write_lock);
+        m_compression_policy = value;
+        m_use_compression_policy = true;
+    }
+
+    /// Change the compression level and strategy
+    /**
+     * Tunes the permessage-deflate compressor of this connection without
+     * renegotiating, so CPU spent on compression can be traded against ratio
+     * while the connection is open, for example lowering the level when
+     * the server is busy. Messages prepared afterwards use the new values,
+     * including any already queued but not yet written. Messages compressed
+     * once for many connections, see endpoint::prepare_broadcast, use the
+     * default level.
+     *
+     * May be called from any thread, before or after the connection opens.
+     *
+     * @since 0.9.0
+     *
+     * @param level The compression level, -1 for the default or 0 to 9
+     * @param strategy The compression strategy
+     * @return A status code, a permessage-deflate error if either value is
+     * out of range or the config has no permessage-deflate support
+     */
+    lib::error_code set_compression_params(int level,
+        extensions::permessage_deflate::strategy::value strategy);
+
+    /// Count compression work in a shared set of counters
+    /**
+     * Normally set by the endpoint, see endpoint::enable_compression_stats.
+     * Must be set before the opening handshake.
+     *
+     * @since 0.9.0
+     *
+     * @param value The counters to add to, or null to stop counting
+     */
+    void set_compression_stats(compression_stats_ptr value) {
+        m_compression_stats = value;
+    }
+
+    /// Record traffic, latencies and state changes in shared metrics
+    /**
+     * Normally set by the endpoint, see endpoint::set_metrics. Must be set
+     * before the connection starts.
+     *
+     * @since 0.9.0
+     *
+     * @param value The metrics to record into, or null for none
+     */
+    void set_metrics(metrics_ptr value) {
+        m_metrics = value;
+    }
+
+    /// Report handler calls that run longer than a threshold
+    /**
+     * Handlers run on the transport's event loop, so one that blocks holds
+     * up every other connection served by the same thread. With a threshold
+     * set, each call into a handler is timed and calls that take longer are
+     * logged to the error log at warning level, with the handler type and
+     * the remote endpoint, and counted in the metrics, if any are set.
+     *
+     * Normally set by the endpoint, see endpoint::set_slow_handler_threshold.
+     * Zero, the default, disables the timing.
+     *
+     * @since 0.9.0
+     *
+     * @param value The threshold in microseconds, or zero to disable
+     */
+    void set_slow_handler_threshold(long value) {
+        m_slow_handler_threshold = value;
+    }
+
+    /// Record the bytes read and written by this connection
+    /**
+     * Normally set by the endpoint, see endpoint::set_capture. Must be set
+     * before the connection starts. The connection gets the next id of the
+     * capture and records its role right away.
+     *
+     * @since 0.9.0
+     *
+     * @param value The capture to record into, or null for none
+     */
+    void set_capture(capture_ptr value) {
+        m_capture = value;
+        m_capture_id = 0;
+        if (m_capture) {
+            m_capture_id = m_capture->next_id();
+            char const role = m_is_server ? 1 : 0;
+            m_capture->record(m_capture_id, capture::open, &role, 1);
+        }
+    }
+
+    /// Register the connection while it is open
+    /**
+     * Normally set by the endpoint, see endpoint::set_connection_registry.
+     * Must be set before the connection opens.
+     *
+     * @since 0.9.0
+     *
+     * @param value The registry to join, or null for none
+     */
+    void set_connection_registry(registry_ptr value) {
+        m_registry = value;
+    }
+
+    /// Get the id of this connection in its registry
+    /**
+     * Assigned when the connection opens and kept after it closes, so close
+     * handlers can still use it to clean up. A connection that moves to
+     * another registry gets a new id there, see migrate.
+     *
+     * @since 0.9.0
+     *
+     * @return The id, 0 if the connection has no registry or has not opened
+     */
+    uint64_t get_id() const {
+        return m_id;
+    }
+
+    /// What a connection takes over from the endpoint it moves to
+    /**
+     * @see migrate
+     *
+     * @since 0.9.0
+     */
+    struct migration_target {
+        lib::shared_ptr<alog_type> alog;
+        lib::shared_ptr<elog_type> elog;
+        registry_ptr registry;
+        timer_wheel_ptr timer_wheel;
+    };
+
+    /// Type of the handler called once a migration ended
+    typedef lib::function<void(lib::error_code const &)> migrate_handler;
+
+    /// Move an idle connection to another io_context
+    /**
+     * Normally called through endpoint::adopt. Must be called on the thread
+     * running the connection. Only an open connection that is idle at that
+     * moment moves: it is reading, has nothing queued or being written, is
+     * not corked or holding writes back to coalesce them and is not waiting
+     * for a pong.
+     *
+     * The outstanding read is cancelled, the socket is released from the
+     * current io_context and assigned to a new socket on io_context, where
+     * reading resumes. The keepalive, hibernation and compression idle timers
+     * start over there. The connection leaves its registry and joins
+     * target.registry under a new id and logs to target's loggers. Its
+     * handlers, metrics and memory budgets stay those of the endpoint that
+     * created it, and handlers may run on another thread than before.
+     *
+     * handler is called on the new io_context once the connection moved,
+     * or otherwise on the old one with not_migratable for TLS, unix domain
+     * sockets, connections with a strand and connections that offload work
+     * to a pool, connection_busy if the connection was not idle, or
+     * invalid_state if it is not open.
+     *
+     * Only the asio transport supports this.
+     *
+     * @since 0.9.0
+     *
+     * @param io_context The io_context to move to
+     * @param target The state of the endpoint running io_context
+     * @param handler Called once the migration ended
+     */
+    template <typename io_context_type>
+    void migrate(io_context_type & io_context, migration_target const & target,
+        migrate_handler handler);
+
+    /// Get a compact handle to this connection
+    /**
+     * Accepted by endpoint functions in place of get_handle while the
+     * connection is in its registry, see connection_id.
+     *
+     * @since 0.9.0
+     *
+     * @return The handle, empty if the connection has no registry or has not
+     * opened
+     */
+    connection_id get_handle_id() const {
+        return connection_id(m_id);
+    }
+
+    /// Get the id of this connection in its capture
+    /**
+     * @since 0.9.0
+     *
+     * @return The id, 0 if the connection is not captured
+     */
+    uint64_t get_capture_id() const {
+        return m_capture_id;
+    }
+
+    /// Measure how long sent messages wait and take to write
+    /**
+     * When enabled, each message is stamped as send queues it. Once the
+     * transport write holding it completes, the time from being queued to
+     * being handed to the transport (queue wait) and from then to the write
+     * completing (write time) are recorded in two histograms, see
+     * get_send_queue_latency and get_send_write_latency. A long queue wait
+     * points at the connection's own backlog, a long write time at a full
+     * socket buffer, that is a slow network or peer.
+     *
+     * Costs two clock reads per message and a few relaxed atomic updates
+     * per write. Broadcast messages, which are shared, are not measured.
+     * Must be set before the connection opens.
+     *
+     * @since 0.9.0
+     *
+     * @param value Whether to measure send latency
+     */
+    void set_send_latency_tracking(bool value) {
+        if (!value) {
+            m_send_latency.reset();
+        } else if (!m_send_latency) {
+            m_send_latency = lib::make_shared<send_latency>();
+        }
+    }
+
+    /// Set a handler called with the send latency of each message
+    /**
+     * Enables send latency tracking. The handler is called once the
+     * transport write holding a message completes, with the message and its
+     * queue wait and write time, see set_send_latency_tracking. It runs in
+     * the write completion path and should not block.
+     *
+     * @since 0.9.0
+     *
+     * @param h The new send_latency_handler
+     */
+    void set_send_latency_handler(send_latency_handler h) {
+        m_send_latency_handler = h;
+        if (h) {
+            set_send_latency_tracking(true);
+        }
+    }
+
+    /// Get the time sent messages waited in the send queue
+    /**
+     * @since 0.9.0
+     *
+     * @return The recorded queue waits, empty unless tracking is enabled
+     */
+    latency_histogram get_send_queue_latency() const {
+        return m_send_latency ? m_send_latency->queued.snapshot() :
+            latency_histogram();
+    }
+
+    /// Get the time transport writes of sent messages took
+    /**
+     * @since 0.9.0
+     *
+     * @return The recorded write times, empty unless tracking is enabled
+     */
+    latency_histogram get_send_write_latency() const {
+        return m_send_latency ? m_send_latency->written.snapshot() :
+            latency_histogram();
+    }
+
+    /// Compress large messages on a worker pool
+    /**
+     * Normally set by the endpoint, see endpoint::set_compression_offload.
+     * Must be set before the connection opens. Has no effect with a lock free
+     * send queue, where messages are prepared by the writer.
+     *
+     * @since 0.9.0
+     *
+     * @param pool The worker pool, or null to compress on the sending thread
+     * @param threshold Compressed messages of at least this many bytes are
+     * compressed on the pool
+     * @param part_size Without context takeover, offloaded messages of at
+     * least twice this size are split into parts of about this many bytes
+     * that are compressed in parallel. 0 never splits.
+     */
+    void set_compression_offload(compression_pool_ptr pool, size_t threshold,
+        size_t part_size = 0)
+    {
+        scoped_lock_type lock(m_write_lock);
+        m_compression_pool = pool;
+        m_offload_threshold = threshold;
+        m_offload_part_size = part_size;
+    }
+
+    /// Run the message handler on a worker pool
+    /**
+     * Normally set by the endpoint, see endpoint::set_message_dispatch. Must
+     * be set before the connection opens.
+     *
+     * @since 0.9.0
+     *
+     * @param pool The worker pool, or null to call the message handler from
+     * the connection's read path
+     * @param max_queued The number of messages waiting for the pool at
+     * which the connection stops reading, 0 for no limit
+     */
+    void set_message_dispatch(dispatch_pool_ptr pool, size_t max_queued = 0) {
+        m_dispatch_pool = pool;
+        m_dispatch_max = max_queued;
+    }
+
+    /// Get the number of messages waiting for or running on the worker pool
+    /**
+     * @since 0.9.0
+     *
+     * @return The number of messages handed to the pool whose handler has
+     * not returned yet
+     */
+    size_t get_dispatch_pending() const {
+        return m_dispatch_pending;
+    }
+
+    /// Get maximum HTTP message body size
+    /**
+     * Get maximum HTTP message body size. Maximum message body size determines
+     * the point at which the connection will stop reading an HTTP request whose
      * body is too large.
      *
      * The default is set by the endpoint that creates the connection.
@@ -714,16 +2300,376 @@ public:
 
     /// Get the size of the outgoing write buffer (in payload bytes)
     /**
-     * Retrieves the number of bytes in the outgoing write buffer that have not
-     * already been dispatched to the transport layer. This represents the bytes
-     * that are presently cancelable without uncleanly ending the websocket
-     * connection
+     * Retrieves the number of bytes in the outgoing write buffer that have not
+     * already been dispatched to the transport layer. This represents the bytes
+     * that are presently cancelable without uncleanly ending the websocket
+     * connection
+     *
+     * This method invokes the m_write_lock mutex
+     *
+     * @return The current number of bytes in the outgoing send buffer.
+     */
+    size_t get_buffered_amount() const;
+
+    /// Estimate the memory held by the connection, by component
+    /**
+     * Sizes come from object sizes and buffer capacities, see memory_usage
+     * for what is left out. Broadcast messages in the send queue only count
+     * for the pointer to them, as do messages pushed to a lock free send
+     * queue.
+     *
+     * This method invokes the m_write_lock mutex. The read buffer, the
+     * processor and the HTTP messages are owned by the handlers of the
+     * connection, so with a multithreaded transport call this from one of
+     * them, for example the interrupt handler.
+     *
+     * @since 0.9.0
+     *
+     * @return The estimated bytes of each component
+     */
+    memory_usage get_memory_usage() const;
+
+    /// Set the buffered amounts that trigger the watermark handlers
+    /**
+     * When a send leaves more than `high` bytes buffered the high watermark
+     * handler is called, and once writing brings the buffered amount down to
+     * `low` the drain handler is called. Sending keeps working in between,
+     * it is up to the application to hold back.
+     *
+     * The default is 0, which disables the watermarks. A low watermark above
+     * the high one is lowered to it.
+     *
+     * @since 0.9.0
+     *
+     * @param high The high watermark in bytes, 0 to disable
+     * @param low The low watermark in bytes
+     */
+    void set_send_watermarks(size_t high, size_t low) {
+        m_high_watermark = high;
+        m_low_watermark = (std::min)(low, high);
+    }
+
+    /// Get the high watermark
+    /**
+     * @since 0.9.0
+     *
+     * @return The high watermark in bytes, 0 if disabled
+     */
+    size_t get_high_watermark() const {
+        return m_high_watermark;
+    }
+
+    /// Get the low watermark
+    /**
+     * @since 0.9.0
+     *
+     * @return The low watermark in bytes
+     */
+    size_t get_low_watermark() const {
+        return m_low_watermark;
+    }
+
+    /// Let small messages gather before the next write
+    /**
+     * Once a write completes with only small data messages queued, the
+     * next write waits for more to join them. The wait adapts to the
+     * connection: it covers about four of the recently observed intervals
+     * between messages, or the time recent writes took if that is longer,
+     * up to `max_delay`. Connections that send less often than `max_delay`
+     * do not wait at all. A wait ends early once the queue holds the bytes
+     * expected to arrive during it, at most `max_bytes`, or when a control
+     * frame is queued.
+     *
+     * Timers count whole milliseconds, so waits round up to one. Writes
+     * are not held with config::lock_free_send_queue.
+     *
+     * The default is 0, which disables coalescing.
+     *
+     * @since 0.9.0
+     *
+     * @param max_delay The longest wait in microseconds, 0 to disable
+     * @param max_bytes Queued bytes that end a wait in any case, 0 for no
+     * limit
+     */
+    void set_send_coalescing(long max_delay, size_t max_bytes) {
+        scoped_lock_type lock(m_write_lock);
+        m_coalesce_max_delay = max_delay > 0 ? max_delay : 0;
+        m_coalesce_max_bytes = max_bytes ? max_bytes : size_t(-1);
+    }
+
+    /// Get the longest wait of send coalescing
+    /**
+     * @since 0.9.0
+     *
+     * @return The longest wait in microseconds, 0 if disabled
+     */
+    long get_send_coalescing_delay() const {
+        return m_coalesce_max_delay;
+    }
+
+    /// Set what to do about a send queue that does not drain
+    /**
+     * - slow_consumer::drop_oldest: while more than `limit` bytes are
+     *   buffered, queued data messages are dropped from the front.
+     * - slow_consumer::conflate: a message with a conflation key replaces
+     *   the queued message with the same key, see
+     *   message::set_conflation_key. `limit` is not used.
+     * - slow_consumer::disconnect: once more than `limit` bytes stay
+     *   buffered for `grace` milliseconds, the connection is closed with
+     *   status 1008 (policy violation).
+     *
+     * Only whole, uncompressed data messages are dropped or replaced.
+     * Control frames, fragments and messages sharing a compression context
+     * with later ones are always sent. With config::lock_free_send_queue the
+     * queue cannot be edited and only slow_consumer::disconnect applies.
+     *
+     * The default is slow_consumer::none.
+     *
+     * @since 0.9.0
+     *
+     * @param policy The policy
+     * @param limit The buffered bytes above which the policy applies
+     * @param grace Milliseconds the backlog may last before disconnecting
+     */
+    void set_slow_consumer_policy(slow_consumer::value policy, size_t limit,
+        long grace = 0)
+    {
+        m_slow_consumer_policy = policy;
+        m_slow_consumer_limit = limit;
+        m_slow_consumer_grace = grace;
+    }
+
+    /// Get the slow consumer policy
+    /**
+     * @since 0.9.0
+     *
+     * @return The policy
+     */
+    slow_consumer::value get_slow_consumer_policy() const {
+        return m_slow_consumer_policy;
+    }
+
+    /// Get the number of queued messages dropped or replaced by the policy
+    /**
+     * @since 0.9.0
+     *
+     * @return The number of messages that were never written
+     */
+    size_t get_dropped_messages() const {
+        return m_dropped_messages;
+    }
+
+    /// Set how often each priority is served while several have messages
+    /**
+     * Out of a round of high + normal + bulk writes, each priority gets as
+     * many as its weight, as long as it has messages queued. Ping and pong
+     * frames always go first. Weights below 1 are raised to 1.
+     *
+     * Messages that share the permessage-deflate context must reach the peer
+     * in the order they were compressed, so compressed frames all use the
+     * normal lane whatever their priority. The lock free send queue has a
+     * single lane.
+     *
+     * The default is 4, 2 and 1.
+     *
+     * @since 0.9.0
+     *
+     * @param high The weight of priority::high
+     * @param normal The weight of priority::normal
+     * @param bulk The weight of priority::bulk
+     */
+    void set_priority_weights(size_t high, size_t normal, size_t bulk) {
+        scoped_lock_type lock(m_write_lock);
+        m_lane_weights[priority::high] = (std::max)(high, size_t(1));
+        m_lane_weights[priority::normal] = (std::max)(normal, size_t(1));
+        m_lane_weights[priority::bulk] = (std::max)(bulk, size_t(1));
+        for (size_t i = priority::high; i <= priority::bulk; ++i) {
+            m_lane_credits[i] = m_lane_weights[i];
+        }
+    }
+
+    /// Whether the buffered amount crossed the high watermark and not drained
+    /**
+     * @since 0.9.0
+     *
+     * @return True between a call to the high watermark handler and the
+     * following call to the drain handler
+     */
+    bool is_above_high_watermark() const {
+        return m_above_high_watermark;
+    }
+
+    /// Get the number of bytes written via the coalescing buffer
+    /**
+     * Returns the total number of frame bytes (headers and payloads) that were
+     * copied into the contiguous write buffer rather than written in place
+     * because the frame was smaller than config::write_coalesce_threshold.
+     *
+     * This method invokes the m_write_lock mutex
+     *
+     * @since 0.9.0
+     *
+     * @return The total number of coalesced bytes written on this connection
+     */
+    uint64_t get_coalesced_bytes() const;
+
+    /// Get the number of messages written via the coalescing buffer
+    /**
+     * This method invokes the m_write_lock mutex
+     *
+     * @since 0.9.0
+     *
+     * @return The total number of coalesced messages written on this
+     * connection
+     */
+    uint64_t get_coalesced_messages() const;
+
+    /// Get the number of bytes read from the transport
+    /**
+     * Counts handshake and frame bytes as they are read.
+     *
+     * @since 0.9.0
+     *
+     * @return The number of bytes received on this connection
+     */
+    uint64_t get_bytes_received() const {
+        return m_bytes_in.load(std::memory_order_relaxed);
+    }
+
+    /// Get the number of bytes handed to the transport for writing
+    /**
+     * @since 0.9.0
+     *
+     * @return The number of bytes sent on this connection
+     */
+    uint64_t get_bytes_sent() const {
+        return m_bytes_out.load(std::memory_order_relaxed);
+    }
+
+    /// Get the number of complete data messages received
+    /**
+     * @since 0.9.0
+     *
+     * @return The number of messages received on this connection
+     */
+    uint64_t get_messages_received() const {
+        return m_messages_in.load(std::memory_order_relaxed);
+    }
+
+    /// Get the number of complete data messages handed to the transport
+    /**
+     * @since 0.9.0
+     *
+     * @return The number of messages sent on this connection
+     */
+    uint64_t get_messages_sent() const {
+        return m_messages_out.load(std::memory_order_relaxed);
+    }
+
+    /// Measure the time this connection spends on the event loop
+    /**
+     * With accounting on, the connection adds up the time it spends
+     * consuming input, preparing output and in user handlers, see
+     * get_usage. Each is measured with two reads of the steady clock around
+     * the work. Off by default.
+     *
+     * Normally set by the endpoint, see endpoint::set_accounting.
+     *
+     * @since 0.9.0
+     *
+     * @param value Whether to measure time spent
+     */
+    void set_accounting(bool value) {
+        m_accounting = value;
+    }
+
+    /// Get how much of a resource this connection used
+    /**
+     * Byte and message counts are always kept, times only with accounting
+     * on, see set_accounting. May be called from any thread.
+     *
+     * @since 0.9.0
+     *
+     * @param metric The resource to read
+     * @return The amount used so far
+     */
+    uint64_t get_usage(usage::value metric) const {
+        switch (metric) {
+            case usage::bytes_in:
+                return get_bytes_received();
+            case usage::bytes_out:
+                return get_bytes_sent();
+            case usage::messages_in:
+                return get_messages_received();
+            case usage::messages_out:
+                return get_messages_sent();
+            case usage::consume_time:
+                return m_consume_time.load(std::memory_order_relaxed);
+            case usage::prepare_time:
+                return m_prepare_time.load(std::memory_order_relaxed);
+            case usage::handler_time:
+                return m_handler_time.load(std::memory_order_relaxed);
+            case usage::cpu_time:
+                return m_consume_time.load(std::memory_order_relaxed) +
+                    m_prepare_time.load(std::memory_order_relaxed) +
+                    m_handler_time.load(std::memory_order_relaxed);
+            default:
+                return 0;
+        }
+    }
+
+    /// Set the largest payload sent in a single frame
+    /**
+     * Data messages with larger payloads are written as a series of frames,
+     * a first frame followed by continuation frames, of at most this many
+     * payload bytes each. Ping and pong frames sent while a message is being
+     * written in pieces go out between its fragments rather than waiting
+     * for the whole message, and one transport write never holds more than
+     * one fragment. Other messages, including close frames, are written
+     * after the last fragment. When permessage-deflate is in use the
+     * compressed payload is what gets split.
+     *
+     * Normally set by the endpoint, see endpoint::set_fragment_size. Should
+     * be set before the connection opens.
+     *
+     * Messages compressed in parts on a worker pool, see
+     * endpoint::set_compression_offload, are written as a single frame.
+     *
+     * @since 0.9.0
+     *
+     * @param value The largest frame payload in bytes, 0 for no limit
+     */
+    void set_fragment_size(size_t value) {
+        m_fragment_size = value;
+    }
+
+    /// Get the largest payload sent in a single frame
+    /**
+     * @since 0.9.0
+     *
+     * @return The largest frame payload in bytes, 0 for no limit
+     */
+    size_t get_fragment_size() const {
+        return m_fragment_size;
+    }
+
+    /// Get the current size of the read buffer
+    /**
+     * The read buffer is sized adaptively between
+     * config::connection_read_buffer_min_size and
+     * config::connection_read_buffer_size based on how much of it recent reads
+     * used. It is empty before the first read and while reading is paused.
      *
-     * This method invokes the m_write_lock mutex
+     * This method is not thread safe and should only be called from within
+     * handlers running on this connection.
      *
-     * @return The current number of bytes in the outgoing send buffer.
+     * @since 0.9.0
+     *
+     * @return The size in bytes of the buffer used for transport reads
      */
-    size_t get_buffered_amount() const;
+    size_t get_read_buffer_size() const {
+        return m_buf.size();
+    }
 
     /// Get the size of the outgoing write buffer (in payload bytes)
     /**
@@ -769,21 +2715,173 @@ public:
     lib::error_code send(void const * payload, size_t len, frame::opcode::value
         op = frame::opcode::binary);
 
+    /// Send part of a file as one message
+    /**
+     * The range is memory mapped rather than read, see file_map, and the
+     * message references the mapping, see message::set_payload_ref. On
+     * server connections without compression the frame payload is written
+     * from the mapped pages, with no copy in user space; with the asio
+     * transport large writes may also skip the kernel copy, see
+     * socket_options::zerocopy_threshold. Memory use stays flat however
+     * large the file. The mapping is released once the message is written.
+     *
+     * The file must not be truncated or modified while the message is
+     * queued.
+     *
+     * @since 0.9.0
+     *
+     * @param path The file to send
+     * @param offset Where the range starts
+     * @param len The length of the range, file_map::to_end for the rest of
+     * the file
+     * @param op The opcode of the message. Default is frame::opcode::binary
+     * @return A system error if the file could not be mapped or the range
+     * does not lie within it, otherwise the result of send
+     */
+    lib::error_code send_file(std::string const & path, uint64_t offset = 0,
+        uint64_t len = file_map::to_end,
+        frame::opcode::value op = frame::opcode::binary);
+
+    /// Send part of an open file as one message
+    /**
+     * @see send_file(std::string const &, uint64_t, uint64_t,
+     * frame::opcode::value). The file descriptor is not kept, it may be
+     * closed once this returns.
+     *
+     * @since 0.9.0
+     */
+    lib::error_code send_file(int fd, uint64_t offset = 0,
+        uint64_t len = file_map::to_end,
+        frame::opcode::value op = frame::opcode::binary);
+
     /// Add a message to the outgoing send queue
     /**
      * If presented with a prepared message it is added without validation or
      * framing. If presented with an unprepared message it is validated, framed,
      * and then added
      *
+     * When the payload needs neither masking nor compression (server role,
+     * no permessage-deflate) the queued frame references the payload of msg
+     * rather than a copy of it. The payload of msg must not be modified
+     * after it is passed to send.
+     *
      * Errors are returned via an exception
      * \todo make exception system_error rather than error_code
      *
-     * This method invokes the m_write_lock mutex
+     * This method invokes the m_write_lock mutex, unless
+     * config::lock_free_send_queue is set. In that case the message is
+     * prepared later on the thread that writes it, so msg must not be modified
+     * after this call and framing errors are logged rather than returned.
      *
      * @param msg A message_ptr to the message to send.
      */
     lib::error_code send(message_ptr msg);
 
+    /// Add a message to the outgoing send queue and learn when it is written
+    /**
+     * Sets handler as the send handler of msg, see
+     * message::set_send_handler, then sends it. The handler is called once
+     * the transport write holding the message completed or failed, or with
+     * error::operation_canceled if the connection ends first. It is not
+     * called if this returns an error.
+     *
+     * With config::lock_free_send_queue, messages still queued when the
+     * connection ends are not reported.
+     *
+     * @since 0.9.0
+     *
+     * @param msg A message_ptr to the message to send.
+     * @param handler Called with the result of the write
+     * @return An error code, empty if the message was queued
+     */
+    lib::error_code send(message_ptr msg, send_handler handler);
+
+    /// Hold back transport writes until uncork
+    /**
+     * Messages sent while the connection is corked are queued but no write
+     * is started, so a burst sent from one handler, such as a snapshot and
+     * the deltas that follow it, goes out together in one gathered write
+     * when the connection is uncorked. A write already in progress finishes
+     * normally. Calls nest; writes resume when every cork has been matched
+     * by an uncork. See also cork_guard.
+     *
+     * Control frames, close included, are held back too, so keep the corked
+     * section short.
+     *
+     * May be called from any thread.
+     *
+     * @since 0.9.0
+     */
+    void cork() {
+        ++m_cork_depth;
+    }
+
+    /// Resume transport writes held back by cork
+    /**
+     * Starts one write for everything queued while corked once the last
+     * outstanding cork is removed. Does nothing if the connection is not
+     * corked.
+     *
+     * @since 0.9.0
+     */
+    void uncork();
+
+    /// Whether or not the connection is corked
+    /**
+     * @since 0.9.0
+     */
+    bool is_corked() const {
+        return m_cork_depth.load() > (m_coalesce_held.load() ? 1u : 0u);
+    }
+
+    /// Corks a connection for the lifetime of the guard
+    /**
+     * Usage:
+     *
+     *     {
+     *         connection_type::cork_guard cork(*con);
+     *         con->send(snapshot);
+     *         con->send(delta);
+     *     } // both messages are written together here
+     *
+     * @since 0.9.0
+     */
+    class cork_guard {
+    public:
+        explicit cork_guard(type & con) : m_con(con) {
+            m_con.cork();
+        }
+
+        ~cork_guard() {
+            m_con.uncork();
+        }
+    private:
+        cork_guard(cork_guard const &) = delete;
+        cork_guard & operator=(cork_guard const &) = delete;
+
+        type & m_con;
+    };
+
+    /// Start a message that is sent in pieces
+    /**
+     * For payloads that are very large or whose size is not known up front.
+     * The returned stream sends each chunk written to it as a frame of one
+     * message, see message_stream. Only one stream may be open at a time.
+     * Data messages sent while a stream is open are written after it is
+     * finished.
+     *
+     * With permessage-deflate the message is compressed, chunk by chunk, if
+     * compression was negotiated. The compression policy is not consulted as
+     * the size of the message is not known.
+     *
+     * @since 0.9.0
+     *
+     * @param op The opcode of the message, text or binary
+     * @param ec Set to indicate what error occurred, if any
+     * @return The new stream, or null if `ec` is set
+     */
+    stream_ptr create_stream(frame::opcode::value op, lib::error_code & ec);
+
     /// Asynchronously invoke handler::on_interrupt
     /**
      * Signals to the connection to asynchronously invoke the on_interrupt
@@ -839,6 +2937,112 @@ public:
     /// Resume reading callback
     void handle_resume_reading();
 
+    /// Pause reading automatically while delivered messages are unreleased
+    /**
+     * Once enabled, every message passed to the message handler or the
+     * message batch handler counts as outstanding until the application
+     * hands it back with release_message. When either the number of
+     * outstanding messages or their payload bytes reaches its limit the
+     * connection stops reading, as with pause_reading, and it resumes once
+     * releasing brings both below their limits. TCP flow control then slows
+     * down the remote endpoint.
+     *
+     * Messages delivered through the message view or chunk handlers are not
+     * counted, they end with the handler call.
+     *
+     * The default is 0 for both, which disables this. A manual pause_reading
+     * stays in effect until resume_reading regardless of releases.
+     *
+     * @since 0.9.0
+     *
+     * @param max_messages The number of outstanding messages to pause at, 0
+     * for no limit
+     * @param max_bytes The outstanding payload bytes to pause at, 0 for no
+     * limit
+     */
+    void set_inbound_flow_control(size_t max_messages, size_t max_bytes) {
+        m_flow_max_messages = max_messages;
+        m_flow_max_bytes = max_bytes;
+    }
+
+    /// Hand back a message delivered while inbound flow control is enabled
+    /**
+     * Call once per delivered message, from any thread, when the application
+     * is done with it. Reading resumes asynchronously if this brings the
+     * outstanding messages below the limits of set_inbound_flow_control.
+     *
+     * @since 0.9.0
+     *
+     * @param msg The message to release
+     * @return An error code indicating success or failure to schedule the
+     * release
+     */
+    lib::error_code release_message(message_ptr const & msg);
+
+    /// Release callback
+    void handle_release_message(size_t bytes);
+
+    /// Get the number of delivered messages not yet released
+    /**
+     * @since 0.9.0
+     *
+     * @return The number of outstanding messages
+     */
+    size_t get_unreleased_messages() const {
+        return m_flow_messages;
+    }
+
+    /// Get the payload bytes of delivered messages not yet released
+    /**
+     * @since 0.9.0
+     *
+     * @return The number of outstanding payload bytes
+     */
+    size_t get_unreleased_bytes() const {
+        return m_flow_bytes;
+    }
+
+    /// Limit the rate at which messages and bytes are read from the peer
+    /**
+     * Each limit is a token bucket that holds up to one second's worth. A
+     * read that leaves a bucket in debt, because the peer sent more than
+     * the limit allows, pauses reading until the debt is paid off; TCP flow
+     * control then slows the peer down, and connections sharing a thread
+     * get their turn. With rate_limit::close the connection is closed with
+     * a policy violation status instead.
+     *
+     * Messages and bytes of the read that went over the limit are still
+     * delivered. Pausing needs a transport with timers, without one the
+     * limit is not enforced.
+     *
+     * The default is 0 for both, which disables this.
+     *
+     * @since 0.9.0
+     *
+     * @param messages_per_second The number of data messages per second, 0
+     * for no limit
+     * @param bytes_per_second The number of bytes read per second, 0 for no
+     * limit
+     * @param action What to do once the peer exceeds a limit
+     */
+    void set_inbound_rate_limit(size_t messages_per_second,
+        size_t bytes_per_second,
+        rate_limit::action action = rate_limit::pause_reading)
+    {
+        m_rate_messages.set_rate(static_cast<double>(messages_per_second));
+        m_rate_bytes.set_rate(static_cast<double>(bytes_per_second));
+        m_rate_action = action;
+        m_rate_seen = m_messages_in.load(std::memory_order_relaxed);
+    }
+
+    /// Whether reading is paused by the inbound rate limit
+    /**
+     * @since 0.9.0
+     */
+    bool is_rate_limited() const {
+        return m_rate_paused;
+    }
+
     /// Send a ping
     /**
      * Initiates a ping with the given payload/
@@ -856,9 +3060,65 @@ public:
     /// exception free variant of ping
     void ping(std::string const & payload, lib::error_code & ec);
 
+    /// Get a shared control frame if this connection can send it as is
+    message_ptr shared_control_frame(message_ptr const & msg) const {
+        return msg && use_prepared(msg) ? msg : message_ptr();
+    }
+
+    /// Queue a prepared ping and arm the pong timeout
+    void write_ping(message_ptr const & msg, std::string const & payload);
+
     /// Utility method that gets called back when the ping timer expires
     void handle_pong_timeout(std::string payload, lib::error_code const & ec);
 
+    /// Arm the timer that checks whether a keepalive ping is due
+    void start_keepalive_timer();
+
+    /// Utility method that gets called back when the keepalive timer expires
+    void handle_keepalive_timer(lib::error_code const & ec);
+
+    /// Update the averages send coalescing adapts to, under m_write_lock
+    void note_coalesce_push(size_t size, size_t lane);
+
+    /// Start holding writes if small messages are likely to follow
+    /**
+     * Lock m_write_lock
+     *
+     * @return The wait in microseconds, 0 if writes are not held
+     */
+    long begin_coalesce_hold();
+
+    /// End a hold started by begin_coalesce_hold, if any
+    void release_coalesce_hold();
+
+    /// Utility method that gets called back when a coalescing wait expires
+    void handle_coalesce_timer(lib::error_code const & ec);
+
+    /// Arm the timer that checks whether the connection went idle
+    void start_hibernate_timer();
+
+    /// Utility method that gets called back when the hibernate timer expires
+    void handle_hibernate_timer(lib::error_code const & ec);
+
+    /// Release the resources an idle connection does not need
+    /**
+     * @return Whether the connection is hibernating, false if it is still
+     * writing
+     */
+    bool hibernate();
+
+    /// Release the parsed handshake, see config::release_handshake
+    /**
+     * Keeps the request headers named in config::retained_request_headers.
+     */
+    void release_handshake();
+
+    /// Arm the timer that releases idle compression contexts
+    void start_deflate_idle_timer();
+
+    /// Utility method that gets called back when the deflate idle timer expires
+    void handle_deflate_idle_timer(lib::error_code const & ec);
+
     /// Send a pong
     /**
      * Initiates a pong with the given payload.
@@ -874,6 +3134,17 @@ public:
     /// exception free variant of pong
     void pong(std::string const & payload, lib::error_code & ec);
 
+    /// Answer a ping without the application
+    /**
+     * Reuses m_auto_pong. If the pong for an earlier ping is still queued it
+     * is rewritten with the new payload instead, answering only the most
+     * recent ping as RFC6455 section 5.5.3 allows.
+     *
+     * @param payload Payload of the ping
+     * @param ec Set to indicate what error occurred, if any.
+     */
+    void auto_pong(std::string const & payload, lib::error_code & ec);
+
 #ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
     // exception variant of close
     void close(close::status::value const code, std::string const & reason);
@@ -902,6 +3173,37 @@ public:
     void close(close::status::value const code, std::string const & reason,
         lib::error_code & ec);
 
+    /// Close the connection as part of endpoint::close_all
+    /**
+     * Like close, except that the close frame is `frame`, prepared once by
+     * the endpoint for code and reason, if this connection can send it as
+     * is. Unless `timer` is set no close handshake timer is armed; the
+     * endpoint then ends the handshake at its shared deadline with
+     * expire_close.
+     *
+     * @since 0.9.0
+     *
+     * @param code The close code to send
+     * @param reason The close reason to send, at most 123 bytes
+     * @param frame The prepared close frame, or null
+     * @param timer Whether to arm the close handshake timer
+     * @param [out] ec Set to invalid_state unless the connection is open
+     */
+    void close_shared(close::status::value code, std::string const & reason,
+        message_ptr const & frame, bool timer, lib::error_code & ec);
+
+    /// End a close handshake that has not completed
+    /**
+     * If the connection is still closing it is terminated with
+     * close_handshake_timeout, as if its close handshake timer had expired.
+     * The connection's own handlers are not run concurrently with this, it is
+     * dispatched through the transport. Called at the deadline of
+     * endpoint::close_all.
+     *
+     * @since 0.9.0
+     */
+    void expire_close();
+
     ////////////////////////////////////////////////
     // Pass-through access to the uri information //
     ////////////////////////////////////////////////
@@ -973,6 +3275,21 @@ public:
      */
     std::string const & get_subprotocol() const;
 
+    /// Whether trusted-link mode was negotiated
+    /**
+     * Trusted-link mode is only negotiated when both endpoints set their
+     * config's `enable_trusted_link` flag. This method is valid in the open
+     * handler and later.
+     *
+     * @since 0.9.0
+     *
+     * @return Whether the client skips masking and neither side validates
+     * text
+     */
+    bool is_trusted_link() const {
+        return m_processor && m_processor->is_trusted_link();
+    }
+
     /// Gets all of the subprotocols requested by the client
     /**
      * Retrieves the subprotocols that were requested during the handshake. This
@@ -1044,6 +3361,10 @@ public:
     /**
      * Retrieve the value of a header from the handshake HTTP request.
      *
+     * With config::release_handshake, only the headers in
+     * config::retained_request_headers are still available once the open
+     * handler returned.
+     *
      * @param[in] key Name of the header to get
      * @return The value of the header
      */
@@ -1452,19 +3773,60 @@ public:
     /// Send deferred HTTP Response
     void send_http_response();
     
-    // TODO HTTPNBIO: write_headers
-    // function that processes headers + status so far and writes it to the wire
-    // beginning the HTTP response body state. This method will ignore anything
-    // in the response body.
-    
-    // TODO HTTPNBIO: write_body_message
-    // queues the specified message_buffer for async writing
-    
-    // TODO HTTPNBIO: finish connection
-    //
-    
-    // TODO HTTPNBIO: write_response
-    // Writes the whole response, headers + body and closes the connection
+    /// Start a streamed HTTP response (exception free)
+    /**
+     * Writes the status line and the headers set so far and leaves the body
+     * open for write_http_body. An HTTP/1.1 request gets a chunked body
+     * unless a Content-Length header was set. Other bodies are written as
+     * is and, without a Content-Length, end when the connection closes. A
+     * body already set with set_body is sent as the first part.
+     *
+     * The head and the body parts go through the send queue used for
+     * WebSocket frames, so get_buffered_amount and the watermark handlers,
+     * see set_send_watermarks, tell the application when to stop producing
+     * and when to resume.
+     *
+     * May be called from the http handler or after defer_http_response.
+     *
+     * @since 0.9.0
+     *
+     * @param ec A status code, zero on success, non-zero otherwise
+     */
+    void write_http_headers(lib::error_code & ec);
+
+    /// Start a streamed HTTP response
+    void write_http_headers();
+
+    /// Queue part of a streamed HTTP response body (exception free)
+    /**
+     * The bytes are copied. Empty parts are ignored, as an empty chunk would
+     * end a chunked body.
+     *
+     * @since 0.9.0
+     *
+     * @param data The bytes to send
+     * @param len The number of bytes
+     * @param ec A status code, zero on success, non-zero otherwise
+     */
+    void write_http_body(void const * data, size_t len, lib::error_code & ec);
+
+    /// Queue part of a streamed HTTP response body
+    void write_http_body(void const * data, size_t len);
+
+    /// End a streamed HTTP response (exception free)
+    /**
+     * Queues the end of the body. Once everything is written the connection
+     * closes, or reads its next request if it is kept alive, see
+     * set_max_http_requests.
+     *
+     * @since 0.9.0
+     *
+     * @param ec A status code, zero on success, non-zero otherwise
+     */
+    void end_http_response(lib::error_code & ec);
+
+    /// End a streamed HTTP response
+    void end_http_response();
     
     
 
@@ -1484,6 +3846,29 @@ public:
         return m_connection_hdl;
     }
 
+    /// Get the per connection data of the application
+    /**
+     * Configs name the type as `user_data_type`. The value lives inside the
+     * connection, so handlers reach it without a lookup or a lock. It is
+     * default constructed and destroyed with the connection; access is not
+     * synchronized beyond what the handlers already are.
+     *
+     * @since 0.9.0
+     *
+     * @return The data of this connection
+     */
+    user_data_type & get_user_data() {
+        return m_user_data;
+    }
+
+    /// Get the per connection data of the application
+    /**
+     * @since 0.9.0
+     */
+    user_data_type const & get_user_data() const {
+        return m_user_data;
+    }
+
     /// Get whether or not this connection is part of a server or client
     /**
      * @return whether or not the connection is attached to a server endpoint
@@ -1588,23 +3973,188 @@ public:
 
     
 
-    void read_handshake(size_t num_bytes);
+    void read_handshake(size_t num_bytes);
+
+    void handle_read_handshake(lib::error_code const & ec,
+        size_t bytes_transferred);
+    void handle_read_http_response(lib::error_code const & ec,
+        size_t bytes_transferred);
+
+    
+    void handle_write_http_response(lib::error_code const & ec);
+    void handle_write_open(lib::error_code const & ec);
+    void handle_send_http_request(lib::error_code const & ec);
+    void handle_write_request_body(lib::error_code const & ec);
+
+    void handle_open_handshake_timeout(lib::error_code const & ec);
+    void handle_validate_timeout(lib::error_code const & ec);
+
+    /// Answer a handshake with the result of the async validate handler
+    void handle_validation(bool accept);
+
+    /// Store the result of the validate handler in the validation cache
+    void cache_validation(bool accept);
+    void handle_close_handshake_timeout(lib::error_code const & ec);
+    void handle_read_response_timeout(lib::error_code const & ec);
+    void handle_http_idle_timeout(lib::error_code const & ec);
+
+    /// Whether the current response lets the connection be kept open
+    bool can_keep_alive() const;
+
+    /// Decide whether a server connection stays open after its HTTP response
+    /**
+     * Sets m_http_keep_alive and the Connection and Content-Length headers
+     * of m_response to match. Called before the response is serialized.
+     */
+    void prepare_http_keep_alive(lib::error_code const & ec);
+
+    /// Queue bytes of a streamed HTTP response behind a framing prefix
+    lib::error_code write_http_part(std::string const & prefix,
+        void const * data, size_t len, bool last);
+
+    /// Completes a streamed HTTP response once its end is written
+    void handle_write_http_body(lib::error_code const & ec);
+
+    /// Reset a kept alive server connection and read its next request
+    void next_http_request();
+
+    /// The user agent from the endpoint, empty without
+    /// config::enable_user_agent
+    std::string const & user_agent() const {
+        if constexpr (config_traits<config>::enable_user_agent) {
+            return m_user_agent;
+        } else {
+            static std::string const none;
+            return none;
+        }
+    }
+
+    /// Drop the handlers of the completed HTTP request
+    void clear_http_handlers();
+
+    /// The target of a redirect response, or null if it has no valid one
+    uri_ptr get_redirect_uri() const;
+
+    /// The URI actually requested, in the format of uri::str
+    std::string get_request_key() const;
+
+    /// Follow the redirect in m_redirect_uri once its response is complete
+    /**
+     * @param clean Whether the response ended at the end of the last read
+     */
+    void follow_redirect(bool clean);
+
+    /// Keep a completed HTTP client connection open for another request
+    /**
+     * @return Whether the connection was kept. If not it must be terminated.
+     */
+    bool park_http();
+
+    void handle_read_frame(lib::error_code const & ec, size_t bytes_transferred);
+    void handle_read_payload(lib::error_code const & ec,
+        size_t bytes_transferred);
+    /// Log a failed frame read and terminate unless it is expected
+    WEBSOCKETPP_COLD void fail_read_frame(lib::error_code const & ec);
+    /// Close or drop the connection after the processor failed to consume
+    WEBSOCKETPP_COLD void fail_consume(lib::error_code const & ec);
+    /// Hand the message, view or chunk the processor has ready to the
+    /// application
+    void deliver_ready_message();
+    /// Apply flow control, rate limits and the memory governor to a read
+    void account_read(size_t bytes_transferred);
+    void handle_read_ready(lib::error_code const & ec, size_t bytes_transferred);
+    void read_frame();
+
+    /// Read more data without blocking while within the read budget
+    /**
+     * @param used Bytes already consumed since the last transport read
+     * @return The number of bytes read into m_buf, or 0 to issue a new read
+     */
+    size_t read_within_budget(size_t used);
+
+    /// Deliver the messages collected for the batch handler, if any
+    void dispatch_message_batch();
+
+    /// A timeout, armed on the timer wheel or as a transport timer
+    struct deadline {
+        timer_ptr timer;
+        timer_wheel::entry entry;
+    };
+
+    /// Arm a timeout, cancelling it first if it is armed already
+    /**
+     * @return Whether the timeout was armed
+     */
+    bool arm_deadline(deadline & d, long duration,
+        transport::timer_handler callback);
+
+    /// Cancel a timeout if it is armed
+    void cancel_deadline(deadline & d);
+
+    /// Called by the timer wheel when a timeout expires
+    void handle_deadline(transport::timer_handler callback);
+
+    /// Why the connection can not move to another io_context right now
+    lib::error_code migration_blocker();
+
+    /// Restart the timers of an idle connection, after a migration
+    void restart_idle_timers();
+
+    /// Move to the new io_context once the read was cancelled, see migrate
+    template <typename io_context_type>
+    void handle_migrate_detached(io_context_type * io_context,
+        migration_target const & target, migrate_handler const & handler);
+
+    /// Resume on the new io_context, see migrate
+    void handle_migrate_arrived(migrate_handler const & handler);
+
+    /// Called instead of a timeout handler if timers are traced
+    void handle_traced_deadline(transport::timer_handler callback,
+        lib::error_code const & ec);
+
+    /// Whether reading is paused, manually or by inbound flow control
+    bool reading_paused() const {
+        return !m_read_flag || m_flow_paused || m_governor_paused ||
+            m_rate_paused;
+    }
+
+    /// Charge a read to the inbound rate limits, pausing or closing if the
+    /// peer went over them
+    void charge_rate_limit(size_t bytes);
+
+    /// Resume reading once the inbound rate limits allow it
+    void handle_rate_limit_timeout(lib::error_code const & ec);
+
+    /// Whether the unreleased messages reached a flow control limit
+    bool flow_over_limit() const {
+        return (m_flow_max_messages && m_flow_messages >= m_flow_max_messages)
+            || (m_flow_max_bytes && m_flow_bytes >= m_flow_max_bytes)
+            || (m_dispatch_max && m_dispatch_pending >= m_dispatch_max);
+    }
+
+    /// Count a message delivered to the application for flow control
+    void track_delivered(message_ptr const & msg) {
+        if (m_flow_max_messages || m_flow_max_bytes) {
+            ++m_flow_messages;
+            m_flow_bytes += msg->get_payload_size();
+        }
+    }
 
-    void handle_read_handshake(lib::error_code const & ec,
-        size_t bytes_transferred);
-    void handle_read_http_response(lib::error_code const & ec,
-        size_t bytes_transferred);
+    /// Per-thread pool of read buffers used by read on readiness mode
+    typedef slab_cache<config::connection_read_buffer_size, alignof(void *)>
+        read_buffer_pool;
 
-    
-    void handle_write_http_response(lib::error_code const & ec);
-    void handle_send_http_request(lib::error_code const & ec);
+    /// Return the pooled buffer held by the current read, if any
+    void release_pooled_read_buffer();
 
-    void handle_open_handshake_timeout(lib::error_code const & ec);
-    void handle_close_handshake_timeout(lib::error_code const & ec);
-    void handle_read_response_timeout(lib::error_code const & ec);
+    /// Allocate the read buffer if it is empty and return its size
+    size_t prepare_read_buffer();
 
-    void handle_read_frame(lib::error_code const & ec, size_t bytes_transferred);
-    void read_frame();
+    /// Grow or shrink the read buffer based on the size of the last read
+    /**
+     * Must only be called when no transport read is outstanding.
+     */
+    void adapt_read_buffer(size_t bytes_transferred);
 
     /// Get array of WebSocket protocol versions that this connection supports.
     std::vector<int> const & get_supported_versions() const;
@@ -1624,6 +4174,27 @@ public:
      */
     void write_frame();
 
+    /// Log the headers and payloads of the write being dispatched
+    WEBSOCKETPP_COLD void log_write_frame() const;
+
+    /// Arrange for write_frame to run on the transport's event loop
+    /**
+     * Joins the batch of the calling thread when the transport allows it,
+     * see config::batch_write_dispatch and get_write_batch_key, and
+     * dispatches write_frame on its own otherwise.
+     */
+    void schedule_write_frame();
+
+    /// Connections waiting for one pass of write_frame
+    struct write_batch {
+        void const * key;
+        std::vector<ptr> connections;
+    };
+    typedef lib::shared_ptr<write_batch> write_batch_ptr;
+
+    /// Run write_frame for each connection of a batch
+    static void flush_write_batch(write_batch_ptr batch);
+
     /// Process the results of a frame write operation and start the next write
     /**
      * \todo unit tests
@@ -1645,6 +4216,34 @@ public:
     /// Start the connection state machine
     void start();
 
+    /// Start a server connection on an extended CONNECT stream
+    /**
+     * For WebSockets multiplexed over HTTP/2 (RFC 8441) or over HTTP/3 and
+     * QUIC (RFC 9220). The application's HTTP/2 or HTTP/3 stack accepts a
+     * CONNECT stream whose :protocol is websocket and builds
+     * the request of the handshake from its header block: the :path as the
+     * uri, the :authority as the Host header and the regular headers, among
+     * them Sec-WebSocket-Version and any Sec-WebSocket-Protocol and
+     * Sec-WebSocket-Extensions. This sets the method, the upgrade token and,
+     * unless the request's version is HTTP/3, the version HTTP/2.
+     *
+     * The request is validated and negotiated as usual, with no key and no
+     * HTTP response written to the transport. Accepted streams get a 200
+     * response, which `h` hands to the application before the open handler
+     * runs; rejected ones get their error status before the fail handler.
+     * From then on the transport carries the DATA of the stream, typically
+     * through an iostream transport connection per stream. With QUIC each
+     * bidirectional stream is a connection of its own, so a lost packet only
+     * stalls the WebSocket whose stream it belongs to.
+     *
+     * @since 0.9.0
+     *
+     * @param req The request built from the HEADERS of the stream
+     * @param h Called with the response to send back on the stream
+     */
+    void start_extended_connect(request_type const & req,
+        extended_connect_handler h);
+
     /// Set Connection Handle
     /**
      * The connection handle is a token that can be shared outside the
@@ -1664,6 +4263,18 @@ public:
      * @param accept True to accept the websocket connection, false to reject it.
      */
 	lib::error_code deferred_accept(bool accept);
+
+    /// Complete an asynchronous validation, see set_async_validate_handler
+    /**
+     * Thread safe, the answer is handled on the thread of the connection.
+     * Answers after the validate timeout are ignored.
+     *
+     * @since 0.9.0
+     *
+     * @param accept True to accept the websocket connection, false to reject
+     * it.
+     */
+    void complete_validation(bool accept);
 protected:
     void handle_transport_init(lib::error_code const & ec);
 
@@ -1677,6 +4288,15 @@ protected:
 
 	lib::error_code finalize_handshake_response(bool accept);
 private:
+    /// Validate and answer the request of start_extended_connect
+    void process_extended_connect();
+
+    /// Get the status of a response that accepts the handshake
+    http::status_code::value accept_status() const {
+        return m_extended_connect ? http::status_code::ok :
+            http::status_code::switching_protocols;
+    }
+
 
  	/// Server-side check for valid content-encoding when replying to a request
  	void check_body_encoding(std::string & body, const http::body_options& opts, lib::error_code & ec);
@@ -1684,9 +4304,44 @@ private:
     /// Completes m_response, serializes it, and sends it out on the wire.
     void write_http_response(lib::error_code const & ec);
 
+    /// Sets up the processor and fills in the WebSocket connect request
+    bool prepare_handshake_request();
+
+    /// Serializes m_request into m_http_message_buffer
+    void build_http_request();
+
     /// Sends an opening WebSocket connect request
     void send_http_request();
 
+    /// Bytes read from a body source per write
+    static constexpr size_t upload_part_size = 65536;
+    /// Room before each part for the longest chunk size line
+    static constexpr size_t chunk_line_size = 2 * sizeof(size_t) + 2;
+
+    /// State of a request body streamed from a body source
+    struct request_upload {
+        request_upload() : remaining(0), chunked(false), finished(false) {}
+
+        http::body_source::ptr source;
+        std::optional<http::content_encoding::value> encoding;
+        /// Kept for the next request of a pooled connection
+        lib::shared_ptr<encoding::encoder> encoder;
+        /// The part being written, after room for a chunk size line
+        std::string buffer;
+        /// The encoded part being written, after the same room
+        std::string encoded;
+        /// Bytes still to be sent of a body of known size
+        uint64_t remaining;
+        bool chunked;
+        bool finished;
+    };
+
+    /// Sets the framing headers of a request whose body is streamed
+    lib::error_code prepare_request_body();
+
+    /// Reads the next part of a streamed request body into m_upload.buffer
+    lib::error_code read_request_body(bool & last);
+
     /// Alternate path for write_http_response in error conditions
     void write_http_response_error(lib::error_code const & ec);
 
@@ -1727,7 +4382,11 @@ private:
      */
     lib::error_code send_close_frame(close::status::value code =
         close::status::blank, std::string const & reason = std::string(), bool ack = false,
-        bool terminal = false);
+        bool terminal = false, message_ptr const & prepared = message_ptr(),
+        bool timer = true);
+
+    /// Terminate the connection if it is still closing, see expire_close
+    void handle_expire_close();
 
     /// Get a pointer to a new WebSocket protocol processor for a given version
     /**
@@ -1735,11 +4394,37 @@ private:
      * processor for. Negative values indicate invalid/unknown versions and will
      * always return a null ptr
      *
-     * @return A shared_ptr to a new instance of the appropriate processor or a
+     * With config::rfc6455_only set only version 13 is accepted and the
+     * processor is built in place in the connection, replacing any earlier
+     * one.
+     *
+     * @return A pointer to a new instance of the appropriate processor or a
      * null ptr if there is no installed processor that matches the version
      * number.
      */
-    processor_ptr get_processor(int version) const;
+    active_processor_ptr get_processor(int version);
+
+    /// Construct a processor, from the memory resource or slab allocator if
+    /// set
+    template <typename processor_impl, typename... args_type>
+    processor_ptr make_processor(args_type &&... args) const {
+        if (m_memory_resource) {
+            return lib::allocate_shared<processor_impl>(
+                std::pmr::polymorphic_allocator<processor_impl>(
+                    m_memory_resource),
+                std::forward<args_type>(args)...);
+        }
+        if (m_slab_allocation) {
+            return lib::allocate_shared<processor_impl>(
+                slab_allocator<processor_impl>(),
+                std::forward<args_type>(args)...);
+        }
+        return lib::make_shared<processor_impl>(
+            std::forward<args_type>(args)...);
+    }
+
+    /// Send a mapped file range, see send_file
+    lib::error_code send_mapped(file_map::ptr file, frame::opcode::value op);
 
     /// Add a message to the write queue
     /**
@@ -1758,7 +4443,9 @@ private:
      * Removes and returns a message from the write queue and updates any
      * associated shared state.
      *
-     * Must be called while holding m_write_lock
+     * Must be called while holding m_write_lock. In lock free send queue mode
+     * it must instead be called only by the current owner of the queue, and
+     * prepares messages that were queued unprepared.
      *
      * @todo unit tests
      *
@@ -1766,6 +4453,245 @@ private:
      */
     message_ptr write_pop();
 
+    /// Remove the next message from whichever send queue is in use
+    /**
+     * Same calling rules as write_pop. Does not prepare the message or count
+     * it as popped in lock free mode.
+     */
+    message_ptr write_dequeue(bool control_only = false);
+
+    /// Whether every lane of the locked send queue is empty
+    /**
+     * Lock m_write_lock
+     */
+    bool send_queue_empty() const;
+
+    /// Lane of the send queue a prepared message goes to
+    size_t send_lane(message_ptr const & msg) const;
+
+    /// Lane of the send queue to take the next message from
+    /**
+     * Lock m_write_lock
+     *
+     * @return The lane, or close_lane + 1 if there is nothing to send
+     */
+    size_t next_send_lane(bool control_only);
+
+    /// Prepare the next fragment of m_fragment_source
+    /**
+     * Same calling rules as write_pop.
+     */
+    message_ptr write_pop_fragment();
+
+    /// Queue a prepared message for writing
+    /**
+     * Pushes onto the send queue selected by config::lock_free_send_queue.
+     *
+     * @param msg The message to queue
+     * @return Whether the caller must dispatch write_frame
+     */
+    bool write_enqueue(message_ptr msg);
+
+    /// Whether a message can be written without preparing it first
+    bool use_prepared(message_ptr const & msg) const;
+
+    /// Copy a message with a prefix into one with a plain payload
+    WEBSOCKETPP_COLD message_ptr flatten_prefix(message_ptr const & msg);
+
+    /// Queue a data message from send
+    /**
+     * Must be called while holding m_write_lock and not in lock free send
+     * queue mode. `outgoing` is an empty message to prepare `msg` into, or
+     * null to get one here if needed.
+     */
+    lib::error_code send_locked(message_ptr msg, message_ptr outgoing);
+
+    /// Whether a message is a frame of a message_stream
+    /**
+     * Messages sent whole, including a stream finished without any chunks,
+     * have a data opcode and fin set.
+     */
+    static bool is_stream_part(message_ptr const & msg) {
+        return msg->get_opcode() == frame::opcode::CONTINUATION ||
+            (!frame::opcode::is_control(msg->get_opcode()) && !msg->get_fin());
+    }
+
+    /// Queue a frame of the open message_stream
+    lib::error_code send_stream_frame(frame::opcode::value op,
+        void const * data, size_t len, bool fin);
+
+    /// Whether the open stream is within its drain limit
+    bool stream_writable() const {
+        return m_stream_drain_limit == 0 ||
+            get_buffered_amount() <= m_stream_drain_limit;
+    }
+
+    /// Set the drain limit and handler of the open stream
+    void set_stream_drain_handler(size_t limit,
+        typename stream_type::drain_handler handler)
+    {
+        m_stream_drain_limit = limit;
+        m_stream_drain_handler = handler;
+    }
+
+    friend class message_stream<type>;
+
+    /// Call and clear the send handler of a message, if it has one
+    void complete_send(message_ptr const & msg, lib::error_code const & ec);
+
+    /// Report messages still queued as canceled, see send_handler
+    /**
+     * Locks m_write_lock, and calls the handlers without it
+     */
+    void cancel_queued_sends();
+
+    /// Move the send handlers of queued messages to out
+    template <typename queue_type>
+    static void take_send_handlers(queue_type & queue,
+        std::vector<send_handler> & out)
+    {
+        for (typename queue_type::iterator it = queue.begin();
+            it != queue.end(); ++it)
+        {
+            if ((*it)->has_send_handler() && !(*it)->get_broadcast()) {
+                out.push_back((*it)->take_send_handler());
+            }
+        }
+    }
+
+    /// Call the high watermark handler if a send crossed the high watermark
+    void check_high_watermark();
+
+    /// Call the drain handler if a write drained to the low watermark
+    void check_low_watermark();
+
+    /// Whether the slow consumer policy may drop a queued message
+    static bool droppable(message_ptr const & msg);
+
+    /// Whether a prepared message or fragment source uses the deflate context
+    static bool deflated(message_ptr const & msg);
+
+    /// Apply drop_oldest or conflate to a message about to be queued
+    /**
+     * Lock m_write_lock
+     *
+     * @return False if msg replaced a queued message and must not be queued
+     */
+    bool apply_slow_consumer_policy(message_ptr const & msg);
+
+    /// Drop droppable queued messages, lowest priority and oldest first
+    /**
+     * Lock m_write_lock
+     *
+     * @param size The size of the message about to be queued
+     * @param limit The number of bytes that may stay queued, including it
+     */
+    void drop_oldest(size_t size, size_t limit);
+
+    /// Close the connection if its backlog outlasted the grace period
+    void check_backlog();
+
+    /// Bring the send queue's charge to the memory governor up to date
+    /**
+     * May be called from any thread.
+     */
+    void govern_send_memory();
+
+    /// Charge the memory governor for reading and apply its policies
+    /**
+     * Must only be called by the read path, between reads.
+     */
+    void govern_read_memory();
+
+    /// Resume reading paused by memory pressure from any thread
+    void dispatch_memory_relief();
+
+    /// Resume reading paused by memory pressure. Not safe to call directly
+    void handle_memory_relief();
+
+    /// Release compression contexts under memory pressure
+    void shrink_deflate();
+
+    /// Return everything charged to the memory governor
+    /**
+     * Nothing is charged afterwards.
+     */
+    void release_memory_charge();
+
+    /// Prepare a data message, applying the compression policy
+    /**
+     * Must be called while holding m_write_lock, by the writer in lock free
+     * send queue mode, or by the worker that set m_offload_busy.
+     *
+     * @param apply_policy False if the policy has already decided whether
+     * `in` is compressed, its result is still recorded
+     */
+    lib::error_code prepare_data_message(message_ptr in, message_ptr out,
+        bool apply_policy = true);
+
+    /// Hand compression parameters from set_compression_params to the processor
+    /**
+     * Same calling rules as prepare_data_message.
+     */
+    void apply_compression_params();
+
+    /// Whether a data message should be compressed on the worker pool
+    bool should_offload(message_ptr const & msg) const;
+
+    /// Queue a message behind those waiting for the worker pool
+    /**
+     * Starts a worker if none is running. Must be called while holding
+     * m_write_lock.
+     */
+    void offload_push(message_ptr msg);
+
+    /// Prepare messages queued by offload_push, runs on the worker pool
+    void handle_offload();
+
+    /// Prepare one offloaded message, returns false if it was split
+    /**
+     * A split message is finished by the last of its parts to be compressed,
+     * which then resumes handle_offload.
+     */
+    bool offload_prepare(message_ptr in);
+
+    /// Shared state of a message compressed in parts
+    struct offload_parts {
+        message_ptr in;
+        std::vector<std::string> parts;
+        std::atomic<size_t> remaining;
+        std::atomic<bool> failed;
+    };
+    typedef lib::shared_ptr<offload_parts> offload_parts_ptr;
+
+    /// Compress one part of a split message, runs on the worker pool
+    void handle_offload_part(offload_parts_ptr job, size_t index);
+
+    /// Frame and queue a split message once all its parts are compressed
+    void finish_offload_parts(offload_parts_ptr job);
+
+    /// Queue a message prepared on the worker pool and start writing
+    void offload_complete(message_ptr msg);
+
+    /// Queue a received message for the message handler on the worker pool
+    /**
+     * Starts a worker if none is running for this connection. Called from
+     * the read path.
+     */
+    void dispatch_push(message_ptr msg);
+
+    /// Call the message handler for queued messages, runs on the worker pool
+    void handle_dispatch();
+
+    /// Count messages handled on the worker pool and resume reading
+    void handle_dispatch_done(size_t count);
+
+    /// Move the next batch of queued messages to m_current_msgs
+    /**
+     * Must be called by the owner of the send queue, see write_pop
+     */
+    void write_gather();
+
     /// Prints information about the incoming connection to the access log
     /**
      * Prints information about the incoming connection to the access log.
@@ -1774,6 +4700,13 @@ private:
      */
     void log_open_result();
 
+    /// Moves a connection whose handshake succeeded to the open state
+    /**
+     * Starts the timers of an open connection. The caller calls the open
+     * handler.
+     */
+    void open_connection();
+
     /// Prints information about a connection being closed to the access log
     /**
      * Includes: local and remote close codes and reasons
@@ -1792,27 +4725,219 @@ private:
      */
     void log_http_result();
 
+    /// Passes a structured record of a lifecycle event to the event handler
+    void emit_event(log::event_type::value type);
+
+    /// Times a call into a user handler, see set_slow_handler_threshold and
+    /// set_accounting
+    class handler_timer {
+    public:
+        handler_timer(type & con, handler_type::value t)
+          : m_con(con.m_slow_handler_threshold > 0 || con.m_accounting ?
+                &con : NULL)
+          , m_type(t)
+        {
+            if (m_con) {
+                m_start = lib::chrono::steady_clock::now();
+            }
+        }
+
+        ~handler_timer() {
+            if (m_con) {
+                m_con->check_handler_time(m_type, m_start);
+            }
+        }
+    private:
+        handler_timer(handler_timer const &) = delete;
+        handler_timer & operator=(handler_timer const &) = delete;
+
+        type * m_con;
+        handler_type::value m_type;
+        lib::chrono::steady_clock::time_point m_start;
+    };
+
+    /// Account a handler call and report it if it ran longer than the
+    /// threshold
+    void check_handler_time(handler_type::value t,
+        lib::chrono::steady_clock::time_point start);
+
+    /// Adds the time until it goes out of scope to a counter, see
+    /// set_accounting
+    class account_timer {
+    public:
+        account_timer(type const & con, std::atomic<uint64_t> & counter)
+          : m_counter(con.m_accounting ? &counter : NULL)
+        {
+            if (m_counter) {
+                m_start = lib::chrono::steady_clock::now();
+            }
+        }
+
+        ~account_timer() {
+            if (m_counter) {
+                m_counter->fetch_add(elapsed_ns(m_start),
+                    std::memory_order_relaxed);
+            }
+        }
+    private:
+        account_timer(account_timer const &) = delete;
+        account_timer & operator=(account_timer const &) = delete;
+
+        std::atomic<uint64_t> * m_counter;
+        lib::chrono::steady_clock::time_point m_start;
+    };
+
+    /// Nanoseconds from start until now
+    static uint64_t elapsed_ns(lib::chrono::steady_clock::time_point start) {
+        return static_cast<uint64_t>(lib::chrono::duration_cast<
+            lib::chrono::nanoseconds>(lib::chrono::steady_clock::now() -
+            start).count());
+    }
+
+    /// Count bytes read from the transport
+    void count_bytes_in(char const * data, size_t bytes) {
+        m_bytes_in.fetch_add(bytes, std::memory_order_relaxed);
+        if (m_metrics) {
+            m_metrics->record_bytes_in(bytes);
+        }
+        if (m_capture && bytes > 0) {
+            m_capture->record(m_capture_id, capture::inbound, data, bytes);
+        }
+    }
+
+    /// Count bytes handed to the transport for writing
+    /**
+     * Captured bytes are recorded by the caller, which knows the buffers.
+     */
+    void count_bytes_out(uint64_t bytes) {
+        m_bytes_out.fetch_add(bytes, std::memory_order_relaxed);
+        if (m_metrics) {
+            m_metrics->record_bytes_out(bytes);
+        }
+    }
+
+    /// Count one complete data message received
+    void count_message_in(size_t bytes) {
+        WEBSOCKETPP_TRACE(trace_type, trace::point::deliver, this, bytes, 0);
+        m_messages_in.fetch_add(1, std::memory_order_relaxed);
+        if (m_metrics) {
+            m_metrics->record_message_in();
+        }
+    }
+
+    /// Stamp a message being queued if send latency is tracked
+    void stamp_enqueue(message_ptr const & msg) {
+        if (m_send_latency && !msg->get_broadcast()) {
+            msg->set_enqueue_time(lib::chrono::duration_cast<
+                lib::chrono::nanoseconds>(lib::chrono::steady_clock::now()
+                .time_since_epoch()).count());
+        }
+    }
+
+    /// Record the send latency of the messages of a completed write
+    void record_send_latency();
+
+    /// Estimate the memory of a container of queued messages
+    /**
+     * Broadcast messages are shared with other connections and only count
+     * for their pointer.
+     */
+    template <typename container_type>
+    static size_t queued_memory_usage(container_type const & msgs) {
+        size_t bytes = msgs.size() * sizeof(message_ptr);
+        for (typename container_type::const_iterator it = msgs.begin();
+            it != msgs.end(); ++it)
+        {
+            if (*it && !(*it)->get_broadcast()) {
+                bytes += (*it)->get_memory_usage();
+            }
+        }
+        return bytes;
+    }
+
+    /// Bring the send buffer gauge of m_metrics up to date
+    /**
+     * @param closed Whether the connection is done and its buffer no longer
+     * counts
+     */
+    void publish_send_buffer(bool closed);
+
     /// Prints information about an arbitrary error code on the specified channel
     template <typename error_type>
-    void log_err(log::level l, char const * msg, error_type const & ec) {
-        std::stringstream s;
-        s << msg << " error: " << ec << " (" << ec.message() << ")";
-        m_elog->write(l, s.str());
+    WEBSOCKETPP_COLD void log_err(log::level l, char const * msg,
+        error_type const & ec)
+    {
+        WEBSOCKETPP_LOG(*m_elog, l,
+            msg << " error: " << ec << " (" << ec.message() << ")");
     }
 
     // internal handler functions
     read_handler            m_handle_read_frame;
+    read_handler            m_handle_read_payload;
     write_frame_handler     m_write_frame_handler;
 
     // static settings
-    std::string const       m_user_agent;
+    [[no_unique_address]] member_if<config_traits<config>::enable_user_agent,
+        std::string const>  m_user_agent;
 
 	// dynamic settings (per-connection)
 	size_t					m_max_redirects;
+    bool                    m_slab_allocation;
+    std::pmr::memory_resource * m_memory_resource;
+    bool                    m_read_on_readiness;
+    bool                    m_overloaded;
+    lib::shared_ptr<void>   m_handshake_slot;
+    size_t                  m_read_budget;
+    int                     m_deflate_mem_level;
+    long                    m_deflate_idle_timeout;
+    deflate_budget_ptr      m_deflate_budget;
+    inbound_budget_ptr      m_inbound_budget;
+    timer_wheel_ptr         m_timer_wheel;
+    control_frames_ptr      m_control_frames;
+    handshake_template_ptr  m_handshake_template;
+    /// Whether m_http_message_buffer already holds the handshake response
+    bool                    m_templated_response;
+    request_templates_ptr   m_request_templates;
+    /// Whether m_http_message_buffer already holds the handshake request
+    bool                    m_templated_request;
+    /// Whether the handshake came from start_extended_connect
+    bool                    m_extended_connect;
+    extended_connect_handler m_extended_connect_handler;
+    std::string             m_deflate_dictionary_id;
+    lib::shared_ptr<std::string const> m_deflate_dictionary;
+    int                     m_zstd_level;
+    zstd_dictionaries_ptr   m_zstd_dictionaries;
+    compression_policy      m_compression_policy;
+    bool                    m_use_compression_policy;
+    compression_stats_ptr   m_compression_stats;
+    /// Compression parameters waiting to be applied, under m_write_lock
+    int                     m_compression_level;
+    extensions::permessage_deflate::strategy::value m_compression_strategy;
+    std::atomic<bool>       m_compression_params_pending;
+    compression_pool_ptr    m_compression_pool;
+    size_t                  m_offload_threshold;
+    size_t                  m_offload_part_size;
+    /// Messages waiting for the worker pool, under m_write_lock
+    std::deque<message_ptr> m_offload_queue;
+    /// Whether a worker owns data frame preparation, under m_write_lock
+    bool                    m_offload_busy;
+    dispatch_pool_ptr       m_dispatch_pool;
+    size_t                  m_dispatch_max;
+    /// Messages handed to the pool and not yet handled
+    std::atomic<size_t>     m_dispatch_pending;
+    /// Messages waiting for the pool, under m_dispatch_lock
+    std::deque<message_ptr> m_dispatch_queue;
+    /// Whether a worker is handling this connection's messages, under
+    /// m_dispatch_lock
+    bool                    m_dispatch_busy;
+    mutex_type              m_dispatch_lock;
 
     /// Pointer to the connection handle
     connection_hdl          m_connection_hdl;
 
+    /// The data of the application, see get_user_data
+    [[no_unique_address]] user_data_type m_user_data;
+
     /// Handler objects
     open_handler            m_open_handler;
     close_handler           m_close_handler;
@@ -1823,21 +4948,71 @@ private:
     interrupt_handler       m_interrupt_handler;
     http_handler            m_http_handler;
     validate_handler        m_validate_handler;
+    early_data_handler      m_early_data_handler;
+    async_validate_handler  m_async_validate_handler;
     message_handler         m_message_handler;
-    progress_handler        m_progress_handler;
+    message_view_handler    m_message_view_handler;
+    message_chunk_handler   m_message_chunk_handler;
+    message_batch_handler   m_message_batch_handler;
+    // HTTP client features, compiled out without config::enable_http_client
+    [[no_unique_address]] member_if<config_traits<config>::enable_http_client,
+        progress_handler>   m_progress_handler;
+    [[no_unique_address]] member_if<config_traits<config>::enable_http_client,
+        body_data_handler>  m_body_data_handler;
+    [[no_unique_address]] member_if<config_traits<config>::enable_http_client,
+        http::body_sink::ptr> m_body_sink;
+    [[no_unique_address]] member_if<config_traits<config>::enable_http_client,
+        request_upload>     m_upload;
+    http_idle_handler       m_http_idle_handler;
+    [[no_unique_address]] member_if<config_traits<config>::enable_http_client,
+        http_redirect_handler> m_http_redirect_handler;
+    /// Target of the redirect whose response is being read
+    [[no_unique_address]] member_if<config_traits<config>::enable_http_client,
+        uri_ptr>            m_redirect_uri;
+    [[no_unique_address]] member_if<config_traits<config>::enable_http_client,
+        http::conditional_cache::ptr> m_http_cache;
+    high_watermark_handler  m_high_watermark_handler;
+    drain_handler           m_drain_handler;
+    write_complete_handler  m_write_complete_handler;
+    event_handler           m_event_handler;
+
+    /// Data messages completed by the current read, see message_batch_handler
+    std::vector<message_ptr> m_message_batch;
 
     /// constant values
     long                    m_open_handshake_timeout_dur;
+    long                    m_validate_timeout_dur;
     long                    m_close_handshake_timeout_dur;
     long                    m_http_response_timeout_dur;
+    long                    m_http_idle_timeout_dur;
     long                    m_pong_timeout_dur;
+    long                    m_keepalive_interval;
+    long                    m_keepalive_jitter;
+    uint32_t                m_keepalive_seed;
+    /// Number of reads that returned data
+    size_t                  m_read_count;
+    /// m_read_count as of the last keepalive check
+    size_t                  m_keepalive_reads;
+    bool                    m_keepalive_pending;
+    /// True while the pong timeout of a ping is armed
+    bool                    m_pong_pending;
+    lib::chrono::steady_clock::time_point m_keepalive_sent;
+    std::atomic<long>       m_rtt;
+    long                    m_hibernate_timeout;
+    /// m_read_count as of the last hibernation check
+    size_t                  m_hibernate_reads;
+    bool                    m_hibernating;
     size_t                  m_max_message_size;
+    size_t                  m_spill_threshold;
+    size_t                  m_spill_max_size;
+    std::string             m_spill_dir;
 
     /// External connection state
     /**
-     * Lock: m_connection_state_lock
+     * Lock: m_connection_state_lock for changes. Reads that only compare
+     * against open, as send, ping and pong do, need no lock.
      */
-    session::state::value   m_state;
+    std::atomic<session::state::value> m_state;
 
     /// Internal connection state
     /**
@@ -1852,20 +5027,36 @@ private:
      * Serializes access to the write queue as well as shared state within the
      * processor.
      */
-    mutex_type              m_write_lock;
+    mutable mutex_type      m_write_lock;
 
     // connection resources
-    char                    m_buf[config::connection_read_buffer_size];
+    std::vector<char>       m_buf;
     size_t                  m_buf_cursor;
+    size_t                  m_buf_small_reads;
+    /// Buffer the current read was issued with, m_buf or a pooled buffer
+    char *                  m_read_buf;
+    bool                    m_read_buf_pooled;
+    bool                    m_read_waiting;
     termination_handler     m_termination_handler;
     con_msg_manager_ptr     m_msg_manager;
-    timer_ptr               m_handshake_timer;
-    timer_ptr               m_ping_timer;
+    deadline                m_handshake_timer;
+    deadline                m_ping_timer;
+    deadline                m_deflate_idle_timer;
+    deadline                m_keepalive_timer;
+    deadline                m_hibernate_timer;
+    deadline                m_coalesce_timer;
 
     /// @todo this is not memory efficient. this value is not used after the
     /// handshake.
     std::string m_http_message_buffer;
 
+    /// Holds the processor when config::rfc6455_only is set
+    struct no_inline_processor {};
+    [[no_unique_address]] typename std::conditional<
+        config_traits<config>::rfc6455_only,
+        std::optional<active_processor_type>, no_inline_processor>::type
+        m_inline_processor;
+
     /// Pointer to the processor object for this connection
     /**
      * The processor provides functionality that is specific to the WebSocket
@@ -1874,20 +5065,157 @@ private:
      * WebSocket byte streams
      *
      * Use of the prepare_data_frame method requires lock: m_write_lock
+     *
+     * With config::rfc6455_only set this points into m_inline_processor.
+     */
+    active_processor_ptr    m_processor;
+
+    /// Lane of the send queue holding close frames
+    /**
+     * Drained only once every other lane is empty, nothing may follow a close
      */
-    processor_ptr           m_processor;
+    static size_t const close_lane = priority::bulk + 1;
 
-    /// Queue of unsent outgoing messages
+    /// Queues of unsent outgoing messages, one per priority and close_lane
     /**
+     * Rings rather than deques so a steady flow of sends does not allocate.
+     *
      * Lock: m_write_lock
      */
-    std::queue<message_ptr> m_send_queue;
+    ring_queue<message_ptr> m_send_queue[close_lane + 1];
 
-    /// Size in bytes of the outstanding payloads in the write queue
+    /// The pong auto_pong answers pings with, kept across pings
+    /**
+     * Lock: m_write_lock
+     */
+    message_ptr m_auto_pong;
+
+    /// Whether m_auto_pong is in the send queue and not yet written
+    /**
+     * Lock: m_write_lock
+     */
+    bool m_auto_pong_queued;
+
+    /// Weights and remaining credits of the high, normal and bulk lanes
     /**
+     * Indexed by priority, the control lane always goes first.
+     *
      * Lock: m_write_lock
      */
-    size_t m_send_buffer_size;
+    size_t m_lane_weights[close_lane];
+    size_t m_lane_credits[close_lane];
+
+    /// Size in bytes of the outstanding payloads in the write queue
+    /**
+     * Updated under m_write_lock, or atomically in lock free mode. Readable
+     * from any thread.
+     */
+    std::atomic<size_t> m_send_buffer_size;
+
+    /// Buffered amounts that trigger the watermark handlers
+    size_t m_high_watermark;
+    size_t m_low_watermark;
+
+    /// Send coalescing limits, see set_send_coalescing
+    long m_coalesce_max_delay;
+    size_t m_coalesce_max_bytes;
+    /// Averages of the time between messages and of writes in microseconds,
+    /// and of the message size. Lock m_write_lock
+    lib::chrono::steady_clock::time_point m_coalesce_last_push;
+    int64_t m_coalesce_interval;
+    int64_t m_coalesce_write_time;
+    int64_t m_coalesce_msg_size;
+    /// Whether writes are held by a coalescing cork
+    std::atomic<bool> m_coalesce_held;
+    /// Queued bytes that end the current hold early
+    std::atomic<size_t> m_coalesce_bytes;
+    /// Whether a control frame was queued during the current hold
+    std::atomic<bool> m_coalesce_urgent;
+
+    /// Whether the high watermark handler was called but not the drain handler
+    std::atomic<bool> m_above_high_watermark;
+
+    /// What to do about a send queue holding more than the limit
+    slow_consumer::value m_slow_consumer_policy;
+    size_t m_slow_consumer_limit;
+    long m_slow_consumer_grace;
+
+    /// Since when more than the limit is buffered, in steady clock ticks
+    /**
+     * 0 while the backlog is within the limit
+     */
+    std::atomic<lib::chrono::steady_clock::rep> m_backlog_start;
+
+    /// Set once the disconnect policy closed the connection
+    std::atomic<bool> m_slow_consumer_close;
+
+    std::atomic<size_t> m_dropped_messages;
+
+    /// Queue of unsent outgoing messages when config::lock_free_send_queue
+    /**
+     * Any thread may push. Only the thread that owns the queue may pop.
+     */
+    mpsc_queue<message_ptr> m_send_mpsc;
+
+    /// Number of messages pushed to m_send_mpsc and not yet written
+    /**
+     * Whoever increments this from zero owns m_send_mpsc until it returns to
+     * zero, and is responsible for writing what was pushed.
+     */
+    std::atomic<size_t> m_send_pending;
+
+    /// Number of messages popped by the queue owner for the current write
+    size_t m_send_popped;
+
+    /// Largest payload written as one frame, 0 for no limit
+    size_t m_fragment_size;
+
+    /// The data message being written in fragments, if any
+    /**
+     * Owned by the writer, as are the two members below. See write_pop.
+     */
+    message_ptr m_fragment_source;
+
+    /// Payload offset of the next fragment of m_fragment_source
+    size_t m_fragment_offset;
+
+    /// Messages popped while a message was being fragmented
+    /**
+     * Anything other than ping and pong frames waits here for the
+     * fragmented message to finish.
+     */
+    std::deque<message_ptr> m_fragment_deferred;
+
+    /// Whether a message_stream is open, set under m_write_lock
+    std::atomic<bool> m_stream_open;
+
+    /// Unprepared data messages sent while a stream is open
+    /**
+     * Only used when not in lock free send queue mode, where messages are
+     * prepared in send and so must not be compressed ahead of the rest of
+     * the stream. Lock m_write_lock
+     */
+    std::deque<message_ptr> m_stream_deferred;
+
+    /// Drain limit and handler of the open stream, see message_stream
+    size_t m_stream_drain_limit;
+    typename stream_type::drain_handler m_stream_drain_handler;
+
+    /// Whether a write left more than m_stream_drain_limit buffered
+    std::atomic<bool> m_stream_drain_pending;
+
+    /// Whether the writer has popped a stream's first frame but not its last
+    /**
+     * Owned by the writer, as is m_stream_held.
+     */
+    bool m_stream_writing;
+
+    /// Data messages popped between the frames of a stream
+    /**
+     * Written once the stream's last frame has been popped. In lock free
+     * mode they have already been counted in m_send_popped.
+     */
+    std::deque<message_ptr> m_stream_held;
 
     /// buffer holding the various parts of the current message being written
     /**
@@ -1899,15 +5227,118 @@ private:
     /// from going out of scope before the write is complete.
     std::vector<message_ptr> m_current_msgs;
 
+    /// contiguous copy of the small frames in the current write
+    /**
+     * See config::write_coalesce_threshold. Owned by the outstanding write.
+     */
+    std::string m_coalesce_buffer;
+
+    /// Total bytes and messages written through m_coalesce_buffer
+    uint64_t m_coalesced_bytes;
+    uint64_t m_coalesced_messages;
+
+    /// Transport bytes read and written, and when the connection started and
+    /// opened, for lifecycle events
+    std::atomic<uint64_t> m_bytes_in;
+    std::atomic<uint64_t> m_bytes_out;
+    lib::chrono::steady_clock::time_point m_start_time;
+    lib::chrono::steady_clock::time_point m_open_time;
+
+    /// Complete data messages received and sent
+    std::atomic<uint64_t> m_messages_in;
+    std::atomic<uint64_t> m_messages_out;
+
+    /// Endpoint metrics, see set_metrics
+    metrics_ptr m_metrics;
+    /// When the outstanding transport write started. Owned by the write.
+    lib::chrono::steady_clock::time_point m_write_start;
+    /// Send buffer size last added to m_metrics
+    std::atomic<size_t> m_published_buffer;
+    /// Handler calls longer than this many microseconds are reported
+    long m_slow_handler_threshold;
+    /// Whether time spent is added up, see set_accounting
+    bool m_accounting;
+    /// Nanoseconds spent consuming input, preparing output and in handlers
+    std::atomic<uint64_t> m_consume_time;
+    std::atomic<uint64_t> m_prepare_time;
+    std::atomic<uint64_t> m_handler_time;
+    /// Whether the open of this connection was recorded in m_metrics
+    bool m_metrics_open;
+
+    /// Traffic capture and the id of this connection in it, see set_capture
+    capture_ptr m_capture;
+    uint64_t m_capture_id;
+
+    /// Registry and the id of this connection in it, see get_id
+    registry_ptr m_registry;
+    uint64_t m_id;
+
+    /// Send latency histograms, see set_send_latency_tracking
+    struct send_latency {
+        atomic_histogram queued;
+        atomic_histogram written;
+    };
+    lib::shared_ptr<send_latency> m_send_latency;
+    send_latency_handler m_send_latency_handler;
+
     /// True if there is currently an outstanding transport write
     /**
      * Lock m_write_lock
      */
     bool m_write_flag;
 
+    /// Number of cork calls not yet matched by uncork
+    std::atomic<size_t> m_cork_depth;
+    /// True if a write was held back by cork, see schedule_write_frame
+    std::atomic<bool> m_cork_pending;
+
+    /// The handshake response that the next write_frame puts in front
+    /**
+     * Set by write_http_response when the open handler sent messages, so
+     * that they leave with the response. Lock m_write_lock
+     */
+    std::string const * m_open_response;
+    /// True if the open handler ran before the handshake response was written
+    bool m_opened_early;
+    /// True if the handshake request was handed to the transport as early
+    /// data before it was initialized
+    bool m_early_request;
+
     /// True if this connection is presently reading new data
     bool m_read_flag;
 
+    /// Limits and counts of delivered messages not yet released
+    size_t m_flow_max_messages;
+    size_t m_flow_max_bytes;
+    size_t m_flow_messages;
+    size_t m_flow_bytes;
+
+    /// True if reading stopped because of unreleased messages
+    bool m_flow_paused;
+
+    /// Inbound rate limits, see set_inbound_rate_limit
+    token_bucket m_rate_messages;
+    token_bucket m_rate_bytes;
+    rate_limit::action m_rate_action;
+    /// Value of m_messages_in already charged to m_rate_messages
+    uint64_t m_rate_seen;
+    /// True if reading stopped because the peer exceeded the rate limits
+    bool m_rate_paused;
+    deadline m_rate_timer;
+
+    /// Governor charged for this connection's memory, may be null
+    memory_governor_ptr m_governor;
+    /// Bytes of the send queue charged to the governor
+    std::atomic<size_t> m_governed_send;
+    /// Bytes held by the read path charged to the governor
+    size_t m_governed_read;
+    /// True if reading stopped because of memory pressure
+    bool m_governor_paused;
+    /// True if compression contexts were released for the current pressure
+    bool m_governor_shrunk;
+    /// Set once the charges were returned when the connection ended
+    std::atomic<bool> m_governor_released;
+
     // connection data
     request_type            m_request;
     response_type           m_response;
@@ -1919,8 +5350,9 @@ private:
     std::vector<std::string> m_requested_subprotocols;
 
     bool const              m_is_server;
-    const lib::shared_ptr<alog_type> m_alog;
-    const lib::shared_ptr<elog_type> m_elog;
+    /// Replaced by the loggers of the endpoint a connection moves to
+    lib::shared_ptr<alog_type> m_alog;
+    lib::shared_ptr<elog_type> m_elog;
 
     rng_type & m_rng;
 
@@ -1948,6 +5380,39 @@ private:
     /// deferred until later.
     session::http_state::value m_http_state;
 
+    /// Set when the connection was taken from the HTTP connection pool
+    bool m_http_reused;
+
+    /// Plain HTTP requests a server connection serves, see
+    /// set_max_http_requests
+    size_t m_max_http_requests;
+    /// Plain HTTP requests this server connection has answered
+    size_t m_http_requests;
+    /// Whether the response being written leaves the connection open
+    bool m_http_keep_alive;
+    /// Whether the streamed response body is chunked
+    bool m_http_chunked;
+    /// Body parts of the streamed response queued so far
+    size_t m_http_parts;
+    /// Set while the http handler runs
+    bool m_in_http_handler;
+    /// Set when a streamed response ended before its http handler returned
+    bool m_http_body_written;
+    lib::error_code m_http_body_ec;
+
+    /// Cache of serialized responses and the one being written from it
+    response_cache_ptr m_response_cache;
+    http::response_cache::entry_ptr m_cached_response;
+
+    /// Cache of validation results and the key of this handshake in it
+    validation_cache::ptr m_validation_cache;
+    std::string m_validation_key;
+    /// Set while the asynchronous validate handler has not answered
+    bool m_validating;
+
+    /// Set while the read issued when the connection went idle is pending
+    bool m_idle_read_pending;
+
     bool m_was_clean;
 };
 
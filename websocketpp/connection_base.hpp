@@ -28,11 +28,35 @@
 #ifndef WEBSOCKETPP_CONNECTION_BASE_HPP
 #define WEBSOCKETPP_CONNECTION_BASE_HPP
 
+#include <type_traits>
+
 namespace websocketpp {
 
 /// Stub for user supplied base class.
 class connection_base {};
 
+/// Stub for user supplied per connection data, takes no space
+struct no_user_data {};
+
+/// The per connection data of a config
+/**
+ * no_user_data unless the config has a `user_data_type`. Each connection
+ * holds one value of it inline, default constructed, see
+ * connection::get_user_data.
+ *
+ * @since 0.9.0
+ */
+template <typename config, typename = void>
+struct user_data_policy {
+    typedef no_user_data type;
+};
+
+template <typename config>
+struct user_data_policy<config, std::void_t<typename config::user_data_type> >
+{
+    typedef typename config::user_data_type type;
+};
+
 } // namespace websocketpp
 
 #endif // WEBSOCKETPP_CONNECTION_BASE_HPP
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_CONNECTION_REGISTRY_HPP
+#define WEBSOCKETPP_CONNECTION_REGISTRY_HPP
+
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/thread.hpp>
+
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace websocketpp {
+
+/// The open connections of one or more endpoints, by id
+/**
+ * Connections of an endpoint with set_connection_registry add themselves
+ * just before their open handler runs and remove themselves when they
+ * terminate, before the close or fail handler runs. Each gets a 64 bit id,
+ * see connection::get_id, unique within the registry, so endpoints such as
+ * the shards of a sharded_server may share one.
+ *
+ * Entries are spread over a power of two number of shards, each a hash map
+ * under its own mutex, so lookups from many threads rarely contend. The
+ * registry holds a connection_ptr to each open connection: find and
+ * for_each hand out connections without upgrading a connection_hdl, and
+ * applications need no set of handles of their own.
+ *
+ * @since 0.9.0
+ */
+template <typename connection_type>
+class connection_registry {
+public:
+    typedef lib::shared_ptr<connection_type> connection_ptr;
+
+    /// Construct a registry
+    /**
+     * @param shards The number of shards, rounded up to a power of two
+     */
+    explicit connection_registry(size_t shards = 16)
+      : m_next_id(0)
+      , m_size(0)
+    {
+        size_t n = 1;
+        while (n < shards) {
+            n <<= 1;
+        }
+        m_shards.reset(new shard[n]);
+        m_shard_count = n;
+    }
+
+    /// Add a connection and get its id
+    uint64_t insert(connection_ptr con) {
+        uint64_t id = m_next_id.fetch_add(1, std::memory_order_relaxed) + 1;
+
+        shard & s = get_shard(id);
+        lib::lock_guard<lib::mutex> guard(s.lock);
+        s.connections.insert(std::make_pair(id, con));
+        m_size.fetch_add(1, std::memory_order_relaxed);
+        return id;
+    }
+
+    /// Remove a connection
+    /**
+     * @return Whether the id was present
+     */
+    bool erase(uint64_t id) {
+        shard & s = get_shard(id);
+        lib::lock_guard<lib::mutex> guard(s.lock);
+        if (s.connections.erase(id) == 0) {
+            return false;
+        }
+        m_size.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /// Look a connection up by id
+    /**
+     * @return The connection, or null if it is not open
+     */
+    connection_ptr find(uint64_t id) const {
+        shard const & s = get_shard(id);
+        lib::lock_guard<lib::mutex> guard(s.lock);
+        typename map_type::const_iterator it = s.connections.find(id);
+        return it == s.connections.end() ? connection_ptr() : it->second;
+    }
+
+    /// Get the number of connections
+    size_t size() const {
+        return m_size.load(std::memory_order_relaxed);
+    }
+
+    /// Reserve room for a number of connections
+    /**
+     * Sizes each shard's table for its share, so registering that many
+     * connections does not rehash.
+     *
+     * @param count The number of connections
+     */
+    void reserve(size_t count) {
+        size_t per_shard = (count + m_shard_count - 1) / m_shard_count;
+        for (size_t i = 0; i < m_shard_count; ++i) {
+            lib::lock_guard<lib::mutex> guard(m_shards[i].lock);
+            m_shards[i].connections.reserve(per_shard);
+        }
+    }
+
+    /// Call a function for every connection
+    /**
+     * Each shard is copied under its lock and the function is called with
+     * no lock held, so it may send, close, or look up connections. It sees
+     * the connections that were registered when their shard was copied.
+     *
+     * @param f Called as `f(connection_ptr const &)`
+     */
+    template <typename function>
+    void for_each(function f) const {
+        std::vector<connection_ptr> batch;
+        for (size_t i = 0; i < m_shard_count; ++i) {
+            batch.clear();
+            {
+                lib::lock_guard<lib::mutex> guard(m_shards[i].lock);
+                batch.reserve(m_shards[i].connections.size());
+                for (typename map_type::const_iterator it =
+                    m_shards[i].connections.begin();
+                    it != m_shards[i].connections.end(); ++it)
+                {
+                    batch.push_back(it->second);
+                }
+            }
+            for (size_t j = 0; j < batch.size(); ++j) {
+                f(batch[j]);
+            }
+        }
+    }
+private:
+    typedef std::unordered_map<uint64_t, connection_ptr> map_type;
+
+    struct shard {
+        mutable lib::mutex lock;
+        map_type connections;
+    };
+
+    connection_registry(connection_registry const &) = delete;
+    connection_registry & operator=(connection_registry const &) = delete;
+
+    shard & get_shard(uint64_t id) {
+        return m_shards[id & (m_shard_count - 1)];
+    }
+
+    shard const & get_shard(uint64_t id) const {
+        return m_shards[id & (m_shard_count - 1)];
+    }
+
+    std::unique_ptr<shard[]> m_shards;
+    size_t m_shard_count;
+    std::atomic<uint64_t> m_next_id;
+    std::atomic<size_t> m_size;
+};
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_CONNECTION_REGISTRY_HPP
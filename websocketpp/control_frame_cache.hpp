@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_CONTROL_FRAME_CACHE_HPP
+#define WEBSOCKETPP_CONTROL_FRAME_CACHE_HPP
+
+#include <websocketpp/close.hpp>
+#include <websocketpp/frame.hpp>
+
+#include <websocketpp/common/network.hpp>
+
+#include <cstddef>
+#include <string>
+
+namespace websocketpp {
+
+/// Prepared control frames shared by all connections of a server
+/**
+ * Empty pings and pongs and close frames without a reason are the same bytes
+ * on every server connection. The endpoint prepares them once and connections
+ * queue the shared messages instead of preparing their own, so heartbeats and
+ * routine closes allocate nothing.
+ *
+ * The frames carry an unmasked RFC6455 header and are flagged as broadcasts,
+ * connections that frame messages differently prepare their own as before.
+ * The messages are never modified once the cache is built.
+ *
+ * @since 0.9.0
+ */
+template <typename message>
+class control_frame_cache {
+public:
+    typedef typename message::ptr message_ptr;
+
+    /// Prepare the frames
+    /**
+     * @param manager The message manager to get the messages from
+     */
+    template <typename manager_ptr>
+    explicit control_frame_cache(manager_ptr const & manager) {
+        m_ping = make_frame(manager,frame::opcode::PING,std::string(),false);
+        m_pong = make_frame(manager,frame::opcode::PONG,std::string(),false);
+
+        for (size_t i = 0; i < close_codes; ++i) {
+            std::string payload;
+            if (code(i) != close::status::no_status) {
+                close::code_converter val;
+                val.i = htons(code(i));
+                payload.assign(val.c,2);
+            }
+
+            for (size_t t = 0; t < 2; ++t) {
+                m_close[i][t] = make_frame(manager,frame::opcode::CLOSE,
+                    payload,t == 1);
+            }
+        }
+    }
+
+    /// Get the empty ping, null if it could not be prepared
+    message_ptr get_ping() const {
+        return m_ping;
+    }
+
+    /// Get the empty pong, null if it could not be prepared
+    message_ptr get_pong() const {
+        return m_pong;
+    }
+
+    /// Get a close frame without a reason
+    /**
+     * @param value The close code, close::status::no_status for an empty
+     * close frame
+     * @param terminal Whether the connection is dropped once it is written
+     * @return The frame, or null if none is cached for the code
+     */
+    message_ptr get_close(close::status::value value, bool terminal) const {
+        for (size_t i = 0; i < close_codes; ++i) {
+            if (code(i) == value) {
+                return m_close[i][terminal ? 1 : 0];
+            }
+        }
+        return message_ptr();
+    }
+private:
+    static size_t const close_codes = 4;
+
+    static close::status::value code(size_t i) {
+        static close::status::value const codes[close_codes] = {
+            close::status::no_status,
+            close::status::normal,
+            close::status::going_away,
+            close::status::policy_violation
+        };
+        return codes[i];
+    }
+
+    template <typename manager_ptr>
+    static message_ptr make_frame(manager_ptr const & manager,
+        frame::opcode::value op, std::string const & payload, bool terminal)
+    {
+        message_ptr msg = manager->get_message(op,payload.size());
+        if (!msg) {
+            return msg;
+        }
+
+        msg->set_payload(payload);
+
+        // server frames are never masked
+        frame::header_buffer header;
+        header.encode<false>(op,payload.size(),true);
+        msg->set_header(header);
+
+        msg->set_terminal(terminal);
+        msg->set_broadcast(true);
+        msg->set_prepared(true);
+        return msg;
+    }
+
+    message_ptr m_ping;
+    message_ptr m_pong;
+    message_ptr m_close[close_codes][2];
+};
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_CONTROL_FRAME_CACHE_HPP
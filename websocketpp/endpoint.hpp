@@ -37,6 +37,7 @@
 #include <websocketpp/version.hpp>
 
 #include <string>
+#include <vector>
 
 namespace websocketpp {
 
@@ -69,6 +70,17 @@ public:
 
     /// Type of message_handler
     typedef typename connection_type::message_handler message_handler;
+    /// Type of message_view_handler
+    typedef typename connection_type::message_view_handler message_view_handler;
+    /// Type of message_chunk_handler
+    typedef typename connection_type::message_chunk_handler
+        message_chunk_handler;
+    /// Type of message_batch_handler
+    typedef typename connection_type::message_batch_handler
+        message_batch_handler;
+    /// Type of send_latency_handler
+    typedef typename connection_type::send_latency_handler
+        send_latency_handler;
     /// Type of message pointers that this endpoint uses
     typedef typename connection_type::message_ptr message_ptr;
 
@@ -85,6 +97,54 @@ public:
     /// Type of RNG
     typedef typename config::rng_type rng_type;
 
+    /// Type of the message manager used for endpoint level messages
+    typedef typename connection_type::con_msg_manager_type con_msg_manager_type;
+    /// Type of a shared pointer to the endpoint level message manager
+    typedef typename connection_type::con_msg_manager_ptr con_msg_manager_ptr;
+    /// Type of a shared pointer to a compression memory budget
+    typedef typename connection_type::deflate_budget_ptr deflate_budget_ptr;
+    typedef typename connection_type::inbound_budget_ptr inbound_budget_ptr;
+    typedef typename connection_type::memory_governor_ptr memory_governor_ptr;
+    /// Type of the permessage-zstd extension, see config::permessage_zstd_type
+    typedef typename connection_type::permessage_zstd_type permessage_zstd_type;
+    typedef typename connection_type::zstd_dictionaries_ptr
+        zstd_dictionaries_ptr;
+    typedef typename connection_type::timer_wheel_ptr timer_wheel_ptr;
+    typedef typename connection_type::control_frames_ptr control_frames_ptr;
+    typedef typename connection_type::handshake_template_ptr
+        handshake_template_ptr;
+    typedef typename connection_type::request_templates_ptr
+        request_templates_ptr;
+    /// Type of the policy deciding which messages to compress
+    typedef typename connection_type::compression_policy compression_policy;
+    /// Type of a shared pointer to compression counters
+    typedef typename connection_type::compression_stats_ptr
+        compression_stats_ptr;
+    /// Type of a shared pointer to a compression worker pool
+    typedef typename connection_type::compression_pool_ptr
+        compression_pool_ptr;
+    /// Type of a shared pointer to a message handler worker pool
+    typedef typename connection_type::dispatch_pool_ptr dispatch_pool_ptr;
+    /// Type of a shared pointer to endpoint metrics
+    typedef typename connection_type::metrics_ptr metrics_ptr;
+    /// Type of a shared pointer to a traffic capture
+    typedef typename connection_type::capture_ptr capture_ptr;
+    /// Type of a registry of open connections
+    typedef typename connection_type::registry_type registry_type;
+    /// Type of a shared pointer to a registry of open connections
+    typedef typename connection_type::registry_ptr registry_ptr;
+    /// Type of a shared pointer to a cache of serialized HTTP responses
+    typedef typename connection_type::response_cache_ptr response_cache_ptr;
+    /// Type of the handlers accepted by adopt
+    typedef typename connection_type::migrate_handler migrate_handler;
+    /// Type of the per connection data, see connection::get_user_data
+    typedef typename connection_type::user_data_type user_data_type;
+    /// Type of the filters accepted by broadcast
+    typedef lib::function<bool(connection_ptr const &)> broadcast_filter;
+    /// Type of the per connection prefixes accepted by broadcast
+    typedef lib::function<std::string(connection_ptr const &)>
+        broadcast_prefix;
+
     // TODO: organize these
     typedef typename connection_type::termination_handler termination_handler;
 
@@ -97,11 +157,49 @@ public:
       , m_user_agent(::websocketpp::user_agent)
       , m_open_handshake_timeout_dur(config::timeout_open_handshake)
       , m_close_handshake_timeout_dur(config::timeout_close_handshake)
+      , m_validate_timeout_dur(0)
 	  , m_http_read_timeout_dur(config::timeout_read_http_response)
+      , m_max_http_requests(1)
       , m_pong_timeout_dur(config::timeout_pong)
+      , m_keepalive_interval(0)
+      , m_keepalive_jitter(0)
+      , m_hibernate_timeout(0)
       , m_max_message_size(config::max_message_size)
+      , m_spill_threshold(0)
+      , m_spill_max_size(0)
       , m_max_http_body_size(config::max_http_body_size)
 	  , m_max_redirects(0)
+      , m_slab_allocation(false)
+      , m_memory_resource(NULL)
+      , m_read_on_readiness(false)
+      , m_read_budget(0)
+      , m_deflate_mem_level(0)
+      , m_deflate_idle_timeout(0)
+      , m_deflate_limit(0)
+      , m_zstd_level(0)
+      , m_use_compression_policy(false)
+      , m_send_latency_tracking(false)
+      , m_slow_handler_threshold(0)
+      , m_pacing_window(0)
+      , m_pacing_rate(0)
+      , m_accounting(false)
+      , m_offload_threshold(0)
+      , m_offload_part_size(0)
+      , m_dispatch_max(0)
+      , m_fragment_size(0)
+      , m_high_watermark(0)
+      , m_low_watermark(0)
+      , m_coalesce_max_delay(0)
+      , m_coalesce_max_bytes(0)
+      , m_flow_max_messages(0)
+      , m_flow_max_bytes(0)
+      , m_rate_max_messages(0)
+      , m_rate_max_bytes(0)
+      , m_rate_action(rate_limit::pause_reading)
+      , m_slow_consumer_policy(slow_consumer::none)
+      , m_slow_consumer_limit(0)
+      , m_slow_consumer_grace(0)
+      , m_msg_manager(new con_msg_manager_type())
       , m_is_server(p_is_server)
     {
         m_alog->set_channels(config::alog_level);
@@ -110,6 +208,15 @@ public:
         m_alog->write(log::alevel::devel, "endpoint constructor");
 
         transport_type::init_logging(m_alog, m_elog);
+
+        if (m_is_server) {
+            // the same bytes on every connection, prepared once
+            m_control_frames = lib::make_shared<
+                control_frame_cache<typename config::message_type> >(
+                m_msg_manager);
+            m_handshake_template = lib::make_shared<
+                processor::handshake_template>(m_user_agent);
+        }
     }
 
 
@@ -126,7 +233,11 @@ public:
 
     #ifdef _WEBSOCKETPP_MOVE_SEMANTICS_
         /// Move constructor
-        endpoint(endpoint && o) 
+        /**
+         * Only available with a movable random number generator.
+         */
+        endpoint(endpoint && o)
+            requires std::is_move_constructible_v<rng_type>
          : config::transport_type(std::move(o))
          , config::endpoint_base(std::move(o))
          , m_alog(std::move(o.m_alog))
@@ -142,16 +253,83 @@ public:
          , m_interrupt_handler(std::move(o.m_interrupt_handler))
          , m_http_handler(std::move(o.m_http_handler))
          , m_validate_handler(std::move(o.m_validate_handler))
+         , m_early_data_handler(std::move(o.m_early_data_handler))
+         , m_async_validate_handler(std::move(o.m_async_validate_handler))
          , m_message_handler(std::move(o.m_message_handler))
+         , m_message_view_handler(std::move(o.m_message_view_handler))
+         , m_message_chunk_handler(std::move(o.m_message_chunk_handler))
+         , m_message_batch_handler(std::move(o.m_message_batch_handler))
+         , m_high_watermark_handler(std::move(o.m_high_watermark_handler))
+         , m_drain_handler(std::move(o.m_drain_handler))
+         , m_event_handler(std::move(o.m_event_handler))
 
          , m_open_handshake_timeout_dur(o.m_open_handshake_timeout_dur)
          , m_close_handshake_timeout_dur(o.m_close_handshake_timeout_dur)
+         , m_validate_timeout_dur(o.m_validate_timeout_dur)
 		 , m_http_read_timeout_dur(o.m_http_read_timeout_dur)
+         , m_max_http_requests(o.m_max_http_requests)
          , m_pong_timeout_dur(o.m_pong_timeout_dur)
+         , m_keepalive_interval(o.m_keepalive_interval)
+         , m_keepalive_jitter(o.m_keepalive_jitter)
+         , m_hibernate_timeout(o.m_hibernate_timeout)
          , m_max_message_size(o.m_max_message_size)
+         , m_spill_threshold(o.m_spill_threshold)
+         , m_spill_max_size(o.m_spill_max_size)
+         , m_spill_dir(std::move(o.m_spill_dir))
          , m_max_http_body_size(o.m_max_http_body_size)
+         , m_slab_allocation(o.m_slab_allocation)
+         , m_memory_resource(o.m_memory_resource)
+         , m_read_on_readiness(o.m_read_on_readiness)
+         , m_read_budget(o.m_read_budget)
+         , m_deflate_mem_level(o.m_deflate_mem_level)
+         , m_deflate_idle_timeout(o.m_deflate_idle_timeout)
+         , m_deflate_limit(o.m_deflate_limit)
+         , m_deflate_budget(std::move(o.m_deflate_budget))
+         , m_inbound_budget(std::move(o.m_inbound_budget))
+         , m_governor(std::move(o.m_governor))
+         , m_timer_wheel(std::move(o.m_timer_wheel))
+         , m_control_frames(std::move(o.m_control_frames))
+         , m_handshake_template(std::move(o.m_handshake_template))
+         , m_request_templates(std::move(o.m_request_templates))
+         , m_compression_policy(o.m_compression_policy)
+         , m_deflate_dictionary_id(std::move(o.m_deflate_dictionary_id))
+         , m_deflate_dictionary(std::move(o.m_deflate_dictionary))
+         , m_zstd_level(o.m_zstd_level)
+         , m_zstd_dictionaries(std::move(o.m_zstd_dictionaries))
+         , m_use_compression_policy(o.m_use_compression_policy)
+         , m_compression_stats(std::move(o.m_compression_stats))
+         , m_metrics(std::move(o.m_metrics))
+         , m_capture(std::move(o.m_capture))
+         , m_registry(std::move(o.m_registry))
+         , m_response_cache(std::move(o.m_response_cache))
+         , m_validation_cache(std::move(o.m_validation_cache))
+         , m_send_latency_tracking(o.m_send_latency_tracking)
+         , m_send_latency_handler(std::move(o.m_send_latency_handler))
+         , m_slow_handler_threshold(o.m_slow_handler_threshold)
+         , m_pacing_window(o.m_pacing_window)
+         , m_pacing_rate(o.m_pacing_rate)
+         , m_accounting(o.m_accounting)
+         , m_compression_pool(std::move(o.m_compression_pool))
+         , m_offload_threshold(o.m_offload_threshold)
+         , m_offload_part_size(o.m_offload_part_size)
+         , m_dispatch_pool(std::move(o.m_dispatch_pool))
+         , m_dispatch_max(o.m_dispatch_max)
+         , m_fragment_size(o.m_fragment_size)
+         , m_high_watermark(o.m_high_watermark)
+         , m_low_watermark(o.m_low_watermark)
+         , m_coalesce_max_delay(o.m_coalesce_max_delay)
+         , m_coalesce_max_bytes(o.m_coalesce_max_bytes)
+         , m_flow_max_messages(o.m_flow_max_messages)
+         , m_flow_max_bytes(o.m_flow_max_bytes)
+         , m_rate_max_messages(o.m_rate_max_messages)
+         , m_rate_max_bytes(o.m_rate_max_bytes)
+         , m_rate_action(o.m_rate_action)
+         , m_slow_consumer_policy(o.m_slow_consumer_policy)
+         , m_slow_consumer_limit(o.m_slow_consumer_limit)
+         , m_slow_consumer_grace(o.m_slow_consumer_grace)
 
          , m_rng(std::move(o.m_rng))
+         , m_msg_manager(std::move(o.m_msg_manager))
          , m_is_server(o.m_is_server)         
         {}
 
@@ -202,6 +380,10 @@ public:
     void set_user_agent(std::string const & ua) {
         scoped_lock_type guard(m_mutex);
         m_user_agent = ua;
+        if (m_is_server) {
+            m_handshake_template = lib::make_shared<
+                processor::handshake_template>(m_user_agent);
+        }
     }
 
     /// Returns whether or not this endpoint is a server.
@@ -325,11 +507,88 @@ public:
         scoped_lock_type guard(m_mutex);
         m_validate_handler = h;
     }
+    void set_early_data_handler(early_data_handler h) {
+        m_alog->write(log::alevel::devel,"set_early_data_handler");
+        scoped_lock_type guard(m_mutex);
+        m_early_data_handler = h;
+    }
+    void set_async_validate_handler(async_validate_handler h) {
+        m_alog->write(log::alevel::devel,"set_async_validate_handler");
+        scoped_lock_type guard(m_mutex);
+        m_async_validate_handler = h;
+    }
     void set_message_handler(message_handler h) {
         m_alog->write(log::alevel::devel,"set_message_handler");
         scoped_lock_type guard(m_mutex);
         m_message_handler = h;
     }
+    /// Set the message view handler for new connections
+    /**
+     * See connection::set_message_view_handler for details.
+     *
+     * @since 0.9.0
+     */
+    void set_message_view_handler(message_view_handler h) {
+        m_alog->write(log::alevel::devel,"set_message_view_handler");
+        scoped_lock_type guard(m_mutex);
+        m_message_view_handler = h;
+    }
+    /// Set the message chunk handler for new connections
+    /**
+     * See connection::set_message_chunk_handler for details.
+     *
+     * @since 0.9.0
+     */
+    void set_message_chunk_handler(message_chunk_handler h) {
+        m_alog->write(log::alevel::devel,"set_message_chunk_handler");
+        scoped_lock_type guard(m_mutex);
+        m_message_chunk_handler = h;
+    }
+    /// Set the message batch handler for new connections
+    /**
+     * See connection::set_message_batch_handler for details.
+     *
+     * @since 0.9.0
+     */
+    void set_message_batch_handler(message_batch_handler h) {
+        m_alog->write(log::alevel::devel,"set_message_batch_handler");
+        scoped_lock_type guard(m_mutex);
+        m_message_batch_handler = h;
+    }
+    /// Set the high watermark handler for new connections
+    /**
+     * See connection::set_high_watermark_handler for details.
+     *
+     * @since 0.9.0
+     */
+    void set_high_watermark_handler(high_watermark_handler h) {
+        m_alog->write(log::alevel::devel,"set_high_watermark_handler");
+        scoped_lock_type guard(m_mutex);
+        m_high_watermark_handler = h;
+    }
+    /// Set the drain handler for new connections
+    /**
+     * See connection::set_drain_handler for details.
+     *
+     * @since 0.9.0
+     */
+    void set_drain_handler(drain_handler h) {
+        m_alog->write(log::alevel::devel,"set_drain_handler");
+        scoped_lock_type guard(m_mutex);
+        m_drain_handler = h;
+    }
+
+    /// Set the event handler for new connections
+    /**
+     * See connection::set_event_handler for details.
+     *
+     * @since 0.9.0
+     */
+    void set_event_handler(event_handler h) {
+        m_alog->write(log::alevel::devel,"set_event_handler");
+        scoped_lock_type guard(m_mutex);
+        m_event_handler = h;
+    }
 
     //////////////////////////////////////////
     // Connection timeouts and other limits //
@@ -385,6 +644,20 @@ public:
         m_close_handshake_timeout_dur = dur;
     }
 
+    /// Set the time an asynchronous validation may take
+    /**
+     * See connection::set_validate_timeout. The default is 0, which leaves
+     * the open handshake timeout in charge.
+     *
+     * @since 0.9.0
+     *
+     * @param dur The length of the validate timeout in ms
+     */
+    void set_validate_timeout(long dur) {
+        scoped_lock_type guard(m_mutex);
+        m_validate_timeout_dur = dur;
+    }
+
 	/// Set http body read timeout
     /**
      * Sets the length of time the library will wait after the HTTP body begins
@@ -412,6 +685,111 @@ public:
         m_http_read_timeout_dur = dur;
     }
 
+    /// Set how many plain HTTP requests each server connection serves
+    /**
+     * Lets load balancer health checks and other plain HTTP clients reuse
+     * their connection rather than open one per request. See
+     * connection::set_max_http_requests. The default of 1 closes each
+     * connection after its response.
+     *
+     * @since 0.9.0
+     *
+     * @param max The number of requests per connection
+     */
+    void set_max_http_requests(size_t max) {
+        scoped_lock_type guard(m_mutex);
+        m_max_http_requests = max;
+    }
+
+    /// Answer plain HTTP requests from a cache of serialized responses
+    /**
+     * Server connections created afterwards look each plain HTTP request up
+     * in the cache and write a hit without calling the http handler, see
+     * http::response_cache. A cache may be shared between endpoints.
+     *
+     * @since 0.9.0
+     *
+     * @param value The cache, or null for none
+     */
+    void set_response_cache(response_cache_ptr value) {
+        scoped_lock_type guard(m_mutex);
+        m_response_cache = value;
+    }
+
+    /// Get the cache of serialized responses
+    /**
+     * @since 0.9.0
+     *
+     * @return The cache, or null if none is set
+     */
+    response_cache_ptr get_response_cache() const {
+        return m_response_cache;
+    }
+
+    /// Write upgrade requests from per target templates
+    /**
+     * Client connections created afterwards keep the serialized upgrade
+     * request of the first connection to each target, that is each URI,
+     * subprotocol list and user agent, and later connections to it copy
+     * those bytes with a new Sec-WebSocket-Key rather than building and
+     * serializing the request. Requests the application added headers to
+     * are always built.
+     *
+     * The extension offers are part of the template, so connections to one
+     * target must not differ in extension settings.
+     *
+     * @since 0.9.0
+     *
+     * @param capacity The most targets to keep templates of, 0 to build
+     * every request
+     */
+    void set_request_templates(size_t capacity) {
+        scoped_lock_type guard(m_mutex);
+        if (capacity == 0) {
+            m_request_templates.reset();
+        } else {
+            m_request_templates = lib::make_shared<
+                processor::request_template_cache<
+                typename connection_type::request_type> >(capacity);
+        }
+    }
+
+    /// Get the upgrade request templates
+    /**
+     * @since 0.9.0
+     *
+     * @return The templates, or null if set_request_templates was not used
+     */
+    request_templates_ptr get_request_templates() const {
+        return m_request_templates;
+    }
+
+    /// Reuse validation results by the value of a request header
+    /**
+     * Server connections created afterwards look the header value up in the
+     * cache before validating the handshake, and store the decision of the
+     * validate handler in it, see validation_cache. A cache may be shared
+     * between endpoints.
+     *
+     * @since 0.9.0
+     *
+     * @param value The cache, or null for none
+     */
+    void set_validation_cache(validation_cache::ptr value) {
+        scoped_lock_type guard(m_mutex);
+        m_validation_cache = value;
+    }
+
+    /// Get the cache of validation results
+    /**
+     * @since 0.9.0
+     *
+     * @return The cache, or null if none is set
+     */
+    validation_cache::ptr get_validation_cache() const {
+        return m_validation_cache;
+    }
+
     /// Set pong timeout
     /**
      * Sets the length of time the library will wait for a pong response to a
@@ -434,6 +812,64 @@ public:
         m_pong_timeout_dur = dur;
     }
 
+    /// Ping connections whenever their peer has been silent for a while
+    /**
+     * Connections created afterwards ping their peer with an empty ping once
+     * nothing was read from it for an interval, see connection::set_keepalive.
+     * Servers send the ping from their control frame cache.
+     *
+     * The default interval is 0, which disables keepalive pings.
+     *
+     * @since 0.9.0
+     *
+     * @param interval Milliseconds of silence before a ping is sent
+     * @param jitter The largest random delay added to each check in
+     * milliseconds
+     */
+    void set_keepalive(long interval, long jitter = 0) {
+        scoped_lock_type guard(m_mutex);
+        m_keepalive_interval = interval;
+        m_keepalive_jitter = jitter;
+    }
+
+    /// Get the keepalive interval
+    /**
+     * @since 0.9.0
+     *
+     * @return Milliseconds of silence before a ping is sent, 0 if disabled
+     */
+    long get_keepalive_interval() const {
+        return m_keepalive_interval;
+    }
+
+    /// Release memory of connections that went idle
+    /**
+     * Connections created afterwards hibernate once nothing was read from
+     * them for `timeout` milliseconds, see connection::set_hibernate_timeout.
+     * Combine with set_read_on_readiness so that idle connections hold no
+     * read buffer either.
+     *
+     * The default is 0, which disables hibernation.
+     *
+     * @since 0.9.0
+     *
+     * @param timeout Milliseconds without reads before hibernating
+     */
+    void set_hibernate_timeout(long timeout) {
+        scoped_lock_type guard(m_mutex);
+        m_hibernate_timeout = timeout;
+    }
+
+    /// Get the hibernate timeout
+    /**
+     * @since 0.9.0
+     *
+     * @return Milliseconds without reads before hibernating, 0 if disabled
+     */
+    long get_hibernate_timeout() const {
+        return m_hibernate_timeout;
+    }
+
     /// Get default maximum message size
     /**
      * Get the default maximum message size that will be used for new 
@@ -466,6 +902,37 @@ public:
         m_max_message_size = new_value;
     }
 
+    /// Set default spilling of large incoming messages to a temporary file
+    /**
+     * Sets the threshold past which new connections created by this endpoint
+     * move the payload of an incoming data message to an unlinked temporary
+     * file and deliver it memory mapped, see connection::set_message_spill.
+     *
+     * @since 0.9.0
+     *
+     * @param threshold Payload bytes kept in memory, 0 to disable spilling
+     * @param max_size The largest spilled message accepted, 0 for the maximum
+     * message size
+     * @param dir The directory for the files, empty for $TMPDIR or /tmp
+     */
+    void set_message_spill(size_t threshold, size_t max_size = 0,
+        std::string const & dir = std::string())
+    {
+        m_spill_threshold = threshold;
+        m_spill_max_size = max_size;
+        m_spill_dir = dir;
+    }
+
+    /// Get the default payload size past which incoming messages are spilled
+    /**
+     * @since 0.9.0
+     *
+     * @return The threshold in bytes, 0 if spilling is disabled
+     */
+    size_t get_spill_threshold() const {
+        return m_spill_threshold;
+    }
+
 	/// Get maximum number of redirects
     /**
      * Get maximum number of redirects to follow before returning.
@@ -490,142 +957,1152 @@ public:
         m_max_redirects = new_value;
     }
 
-    /// Get maximum HTTP message body size
+    /// Get whether new connections are allocated from per-thread slabs
     /**
-     * Get maximum HTTP message body size. Maximum message body size determines
-     * the point at which the connection will stop reading an HTTP request whose
-     * body is too large.
+     * @since 0.9.0
+     */
+    bool get_slab_allocation() const {
+        return m_slab_allocation;
+    }
+
+    /// Allocate new connections from per-thread slabs
+    /**
+     * When enabled, each new connection object (including its transport
+     * component, which is part of the same object) and its shared pointer
+     * control block are placed in one block taken from a per-thread free
+     * list, as is the protocol processor it creates after the handshake. When
+     * a connection is destroyed its blocks are returned to the free list of
+     * the thread that releases it, so that bursts of accepts after a burst of
+     * disconnects are served without going through the global allocator.
      *
-     * The default is set by the max_http_body_size value from the template
-     * config
+     * Each thread caches a bounded number of blocks (see slab_cache).
      *
-     * @since 0.5.0
+     * The default is false.
      *
-     * @return The maximum HTTP message body size
+     * @since 0.9.0
+     *
+     * @param value Whether or not to use slab allocation for new connections
      */
-    size_t get_max_http_body_size() const {
-        return m_max_http_body_size;
+    void set_slab_allocation(bool value) {
+        m_slab_allocation = value;
     }
-    
-    /// Set maximum HTTP message body size
+
+    /// Get the memory resource new connections are allocated from
     /**
-     * Set maximum HTTP message body size. Maximum message body size determines
-     * the point at which the connection will stop reading an HTTP request whose
-     * body is too large.
+     * @since 0.9.0
      *
-     * The default is set by the max_http_body_size value from the template
-     * config
+     * @return The resource, or null for the default allocation
+     */
+    std::pmr::memory_resource * get_memory_resource() const {
+        return m_memory_resource;
+    }
+
+    /// Allocate new connections from a memory resource
+    /**
+     * Each new connection object and its shared pointer control block are
+     * allocated from the resource, as are the protocol processor it creates
+     * and, with a message manager that supports memory resources such as
+     * message_buffer::alloc::con_msg_manager, its messages and the
+     * endpoint's own. This takes precedence over slab allocation.
      *
-     * @since 0.5.1
+     * Any std::pmr::memory_resource will do: a pool resource to recycle
+     * connections, or a counting_resource per endpoint to see how much memory
+     * each holds. The resource is used from every thread running the
+     * endpoint, so it must be synchronized if there are several, and it must
+     * outlive every connection and message allocated from it.
      *
-     * @param new_value The value to set as the maximum message size.
+     * HTTP headers, message payloads and transport handlers still use the
+     * global heap.
+     *
+     * The default is null, which uses make_shared or the slab allocator.
+     *
+     * @since 0.9.0
+     *
+     * @param resource The resource to allocate from, or null for the
+     * default allocation
      */
-    void set_max_http_body_size(size_t new_value) {
-        m_max_http_body_size = new_value;
+    void set_memory_resource(std::pmr::memory_resource * resource) {
+        m_memory_resource = resource;
+        set_manager_resource(*m_msg_manager, resource);
     }
 
-    /*************************************/
-    /* Connection pass through functions */
-    /*************************************/
-
+    /// Take pooled read buffers from huge pages
     /**
-     * These functions act as adaptors to their counterparts in connection. They
-     * can produce one additional type of error, the bad_connection error, that
-     * indicates that the conversion from connection_hdl to connection_ptr
-     * failed due to the connection not existing anymore. Each method has a
-     * default and an exception free variant.
+     * Connections reading on readiness (see set_read_on_readiness) take
+     * their read buffer from a per-thread pool. With a resource set, buffers
+     * the pool has to allocate come from its huge page regions, and
+     * buffers the threads do not cache go to a free list shared by all
+     * threads instead of back to the heap. With many connections reading at
+     * once this keeps the buffers on a few huge pages instead of scattered
+     * over many small ones, saving TLB misses.
+     *
+     * The pool is shared by every endpoint with the same
+     * config::connection_read_buffer_size, so this applies to all of them.
+     * Set it before connections start reading. The resource must outlive
+     * every thread that ran connections, see slab_cache::set_backing.
+     * Calling huge_page_resource::reserve first maps and touches the
+     * regions up front. huge_page_resource::get_stats reports how many
+     * regions got huge pages and how much of them is in use.
+     *
+     * @since 0.9.0
+     *
+     * @param resource The resource to take buffers from, or null for the
+     * global heap
      */
+    static void set_read_buffer_resource(huge_page_resource * resource) {
+        connection_type::set_read_buffer_resource(resource);
+    }
 
-    void interrupt(connection_hdl_ref hdl, lib::error_code & ec);
-    void interrupt(connection_hdl_ref hdl);
+    /// Get the number of pooled read buffers free for any thread to take
+    /**
+     * Counts the buffers from the resource set with set_read_buffer_resource
+     * that are in the shared free list. Buffers cached by each thread are
+     * not included.
+     *
+     * @since 0.9.0
+     */
+    static size_t get_read_buffer_shared_free() {
+        return connection_type::get_read_buffer_shared_free();
+    }
 
-    /// Pause reading of new data (exception free)
+    /// Prepare for an expected load before traffic arrives
     /**
-     * Signals to the connection to halt reading of new data. While reading is 
-     * paused, the connection will stop reading from its associated socket. In
-     * turn this will result in TCP based flow control kicking in and slowing
-     * data flow from the remote endpoint.
+     * Fills the pools that new connections and messages are taken from, so
+     * that the burst of connections a fresh server gets, for example the
+     * reconnects that follow a deploy, does not wait on the heap growing or
+     * pages faulting in. Call it once the endpoint is configured and before
+     * listening or connecting. Caches that are per thread are filled for the
+     * calling thread, so call it from the thread that will run the endpoint,
+     * or from each of them.
      *
-     * This is useful for applications that push new requests to a queue to be 
-     * processed by another thread and need a way to signal when their request
-     * queue is full without blocking the network processing thread.
+     * - With a memory resource, expected_connections connections are
+     *   allocated from it and released, leaving their memory to a pooling
+     *   resource. With slab allocation the calling thread's cache is filled.
+     *   The default allocation keeps nothing, so nothing is allocated.
+     * - With read on readiness, the read buffer pool is filled, see
+     *   connection::reserve_read_buffers.
+     * - If the message manager pools (message_buffer::pool), the endpoint's
+     *   pool gets 10ms worth of expected_msg_rate messages holding
+     *   expected_msg_size bytes. These are used by send and the broadcasts.
+     * - The timer wheel and the registry, if set, get room for
+     *   expected_connections.
      *
-     * Use `resume_reading()` to resume.
+     * Compression and TLS contexts are still created by each connection.
      *
-     * If supported by the transport this is done asynchronously. As such
-     * reading may not stop until the current read operation completes. 
-     * Typically you can expect to receive no more bytes after initiating a read
-     * pause than the size of the read buffer.
+     * @since 0.9.0
      *
-     * If reading is paused for this connection already nothing is changed.
+     * @param expected_connections The number of connections expected to be
+     * open at once
+     * @param expected_msg_rate The number of messages per second expected to
+     * be sent through the endpoint
+     * @param expected_msg_size The typical payload size of those messages
      */
-    void pause_reading(connection_hdl_ref hdl, lib::error_code & ec);
-    
-    /// Pause reading of new data
-    void pause_reading(connection_hdl_ref hdl);
+    void reserve(size_t expected_connections, size_t expected_msg_rate,
+        size_t expected_msg_size = 0);
 
-    /// Resume reading of new data (exception free)
+    /// Get whether open connections wait for readiness before taking a buffer
     /**
-     * Signals to the connection to resume reading of new data after it was 
-     * paused by `pause_reading()`.
-     *
-     * If reading is not paused for this connection already nothing is changed.
+     * @since 0.9.0
      */
-    void resume_reading(connection_hdl_ref hdl, lib::error_code & ec);
-
-    /// Resume reading of new data
-    void resume_reading(connection_hdl_ref hdl);
+    bool get_read_on_readiness() const {
+        return m_read_on_readiness;
+    }
 
-    /// Send deferred HTTP Response
+    /// Only hold a read buffer while data is available to read
     /**
-     * Sends an http response to an HTTP connection that was deferred. This will
-     * send a complete response including all headers, status line, and body
-     * text. The connection will be closed afterwards.
+     * When enabled, open connections do not keep a read buffer between reads.
+     * Instead they ask the transport to wait until the socket is readable,
+     * then take a buffer of config::connection_read_buffer_size bytes from a
+     * per-thread pool, read and process whatever is available, and return the
+     * buffer to the pool. Idle connections then cost no read buffer memory,
+     * which matters for servers with very large numbers of mostly idle
+     * connections, at the cost of an extra trip through the event loop per
+     * read.
      *
-     * Exception free variant
+     * Transports that cannot wait for readiness (for example TLS, where data
+     * may already be buffered inside the TLS engine) report readiness
+     * immediately, which keeps them correct but holds a pooled buffer for the
+     * duration of each read. The opening handshake always uses the regular
+     * connection buffer.
      *
-     * @since 0.6.0
+     * The default is false.
      *
-     * @param hdl The connection to send the response on
-     * @param ec A status code, zero on success, non-zero otherwise
+     * @since 0.9.0
+     *
+     * @param value Whether or not to read on readiness from pooled buffers
      */
-    void send_http_response(connection_hdl_ref hdl, lib::error_code & ec);
-        
-    /// Send deferred HTTP Response (exception free)
+    void set_read_on_readiness(bool value) {
+        m_read_on_readiness = value;
+    }
+
+    /// Get the number of bytes a connection drains per read
     /**
-     * Sends an http response to an HTTP connection that was deferred. This will
-     * send a complete response including all headers, status line, and body
-     * text. The connection will be closed afterwards.
+     * @since 0.9.0
+     */
+    size_t get_read_budget() const {
+        return m_read_budget;
+    }
+
+    /// Drain up to a number of bytes per read before re-arming it
+    /**
+     * Normally each completed read is consumed and then a new asynchronous
+     * read is issued, costing a trip through the event loop (and the strand,
+     * if there is one) even when the socket already holds more data. With a
+     * read budget, after consuming a read the connection keeps reading
+     * whatever the transport can supply without blocking, until that runs out
+     * or the budget is spent, and only then issues a new asynchronous read.
+     * Larger budgets cut per-read overhead on busy connections at the cost of
+     * fairness between connections served by the same thread.
      *
-     * Exception variant
+     * Transports that cannot read without blocking, and connections in read
+     * on readiness mode, ignore the budget.
      *
-     * @since 0.6.0
+     * The default is 0, which disables draining.
      *
-     * @param hdl The connection to send the response on
+     * @since 0.9.0
+     *
+     * @param value The read budget in bytes
      */
-    void send_http_response(connection_hdl_ref hdl);
+    void set_read_budget(size_t value) {
+        m_read_budget = value;
+    }
 
-    /// Create a message and add it to the outgoing send queue (exception free)
+    /// Get the deflate memory level for new connections
     /**
-     * Convenience method to send a message given a payload string and an opcode
-     *
-     * @param [in] hdl The handle identifying the connection to send via.
-     * @param [in] payload The payload string to generated the message with
-     * @param [in] op The opcode to generated the message with.
-     * @param [out] ec A code to fill in for errors
+     * @since 0.9.0
      */
-    void send(connection_hdl_ref hdl, std::string const & payload,
-        frame::opcode::value op, lib::error_code & ec);
-    /// Create a message and add it to the outgoing send queue
+    int get_deflate_mem_level() const {
+        return m_deflate_mem_level;
+    }
+
+    /// Set the deflate memory level for new connections
     /**
-     * Convenience method to send a message given a payload string and an opcode
+     * The memory level of the permessage-deflate compressor, from 1 to 9.
+     * Lower levels use less memory at some cost in speed and compression
+     * ratio. Values out of range are ignored. The default is 0, which keeps
+     * the extension's own default.
      *
-     * @param [in] hdl The handle identifying the connection to send via.
-     * @param [in] payload The payload string to generated the message with
-     * @param [in] op The opcode to generated the message with.
+     * @since 0.9.0
+     *
+     * @param value The deflate memory level
      */
-    void send(connection_hdl_ref hdl, std::string const & payload,
-        frame::opcode::value op);
+    void set_deflate_mem_level(int value) {
+        m_deflate_mem_level = value;
+    }
+
+    /// Get the idle time after which compression contexts are released
+    /**
+     * @since 0.9.0
+     */
+    long get_deflate_idle_timeout() const {
+        return m_deflate_idle_timeout;
+    }
+
+    /// Release compression contexts of idle connections
+    /**
+     * permessage-deflate contexts are created when a connection first sends
+     * or receives a compressed message. With an idle timeout, a context that
+     * has not been used for between one and two timeout periods is released
+     * if no_context_takeover was negotiated for its direction, and created
+     * again on next use. Requires a transport with timer support.
+     *
+     * With lock_free_send_queue only decompressors are released.
+     *
+     * The default is 0, which keeps contexts for the lifetime of the
+     * connection.
+     *
+     * @since 0.9.0
+     *
+     * @param value The idle timeout in milliseconds
+     */
+    void set_deflate_idle_timeout(long value) {
+        m_deflate_idle_timeout = value;
+    }
+
+    /// Get the budget charged for compression memory
+    /**
+     * @since 0.9.0
+     *
+     * @return The budget, or null if there is no limit
+     */
+    deflate_budget_ptr get_deflate_memory_budget() const {
+        return m_deflate_budget;
+    }
+
+    /// Limit the memory held by compression contexts of all connections
+    /**
+     * Connections created afterwards charge their permessage-deflate contexts
+     * to one budget with this limit. When a compressor would not fit, the
+     * connection sends its messages uncompressed until memory is returned by
+     * other connections. Decompressors are always created but count towards
+     * the limit.
+     *
+     * The default is 0, which sets no limit.
+     *
+     * @since 0.9.0
+     *
+     * @param value The limit in bytes
+     */
+    void set_deflate_memory_limit(size_t value) {
+        m_deflate_limit = value;
+        update_deflate_budget();
+    }
+
+    /// Get the budget charged for incoming message buffers
+    /**
+     * @since 0.9.0
+     *
+     * @return The budget, or null if there is no limit
+     */
+    inbound_budget_ptr get_inbound_memory_budget() const {
+        return m_inbound_budget;
+    }
+
+    /// Limit the memory held by incoming messages of all connections
+    /**
+     * Connections created afterwards charge the payload buffers of data
+     * messages being read to one budget with this limit, until the message
+     * is handed to the message handler. A connection whose next read does not
+     * fit fails with processor::error::inbound_memory_limit and is closed
+     * with status 1013 (try again later).
+     *
+     * The default is 0, which sets no limit.
+     *
+     * @since 0.9.0
+     *
+     * @param value The limit in bytes
+     */
+    void set_inbound_memory_limit(size_t value) {
+        if (value == 0) {
+            m_inbound_budget.reset();
+        } else {
+            m_inbound_budget = lib::make_shared<memory_budget>(value);
+        }
+    }
+
+    /// Get the governor of the memory held by all connections
+    /**
+     * @since 0.9.0
+     *
+     * @return The governor, or null if there is no limit
+     */
+    memory_governor_ptr get_memory_governor() const {
+        return m_governor;
+    }
+
+    /// Keep the memory held by all connections under a limit
+    /**
+     * Connections created afterwards charge their send queues, the messages
+     * and HTTP requests or responses they are reading, and their compression
+     * contexts to one memory_governor with this limit. As the total nears
+     * the limit the governor applies, in order:
+     *
+     * - at 70% connections holding more than their fair share pause reading
+     *   until the total drops below 70% again
+     * - at 80% connections release their compression contexts where the
+     *   negotiated parameters allow it
+     * - at 90% connections holding more than their fair share drop queued
+     *   messages as the slow_consumer::drop_oldest policy does
+     * - at 100% new handshakes are answered with 503 Service Unavailable
+     *
+     * The thresholds may be changed through get_memory_governor before
+     * connections are created. Unlike set_inbound_memory_limit, no
+     * connection fails for lack of memory.
+     *
+     * The default is 0, which sets no limit.
+     *
+     * @since 0.9.0
+     *
+     * @param value The limit in bytes
+     */
+    void set_memory_limit(size_t value) {
+        if (value == 0) {
+            m_governor.reset();
+        } else {
+            m_governor = lib::make_shared<memory_governor>(value);
+        }
+        update_deflate_budget();
+    }
+
+    /// Get the timer wheel connections run their timeouts on
+    /**
+     * @since 0.9.0
+     *
+     * @return The wheel, or null if connections use transport timers
+     */
+    timer_wheel_ptr get_timer_wheel() const {
+        return m_timer_wheel;
+    }
+
+    /// Run the timeouts of all connections on one timer wheel
+    /**
+     * Connections created afterwards arm their handshake, pong, close and
+     * compression idle timeouts on the wheel instead of creating a transport
+     * timer each, which makes arming and cancelling them cheap with many
+     * connections. Timeouts fire up to one tick late.
+     *
+     * The wheel only keeps time if something advances it. With the asio
+     * transport pass it to drive_timer_wheel, other transports have to call
+     * timer_wheel::advance themselves.
+     *
+     * The default is null, which uses transport timers.
+     *
+     * @since 0.9.0
+     *
+     * @param value The wheel, or null to use transport timers
+     */
+    void set_timer_wheel(timer_wheel_ptr value) {
+        m_timer_wheel = value;
+    }
+
+    /// Decide per message which outgoing messages to compress
+    /**
+     * Connections created afterwards get their own copy of the policy. It
+     * sets message::set_compressed on every data message they send,
+     * replacing the flag the message was sent with, based on its opcode, its
+     * size and how well earlier messages compressed. See
+     * extensions::permessage_deflate::compression_policy.
+     *
+     * Without a policy, messages sent as strings are compressed and others
+     * use their own flag. This only has an effect on connections that
+     * negotiated permessage-deflate.
+     *
+     * @since 0.9.0
+     *
+     * @param value The policy to copy into new connections
+     */
+    void set_compression_policy(compression_policy const & value) {
+        m_compression_policy = value;
+        m_use_compression_policy = true;
+    }
+
+    /// Count compression work across connections
+    /**
+     * When enabled, connections created afterwards add the bytes they
+     * compress and decompress, and the time spent doing so, to one set of
+     * counters returned by get_compression_stats. Together with
+     * connection::set_compression_params this allows the level to be
+     * balanced against CPU use at run time. Counting costs two clock reads
+     * per compressed message or frame, so it is disabled by default.
+     *
+     * Disabling drops the endpoint's counters but connections already
+     * counting keep theirs.
+     *
+     * @since 0.9.0
+     *
+     * @param value Whether to count compression work
+     */
+    void enable_compression_stats(bool value = true) {
+        if (!value) {
+            m_compression_stats.reset();
+        } else if (!m_compression_stats) {
+            m_compression_stats = lib::make_shared<
+                extensions::permessage_deflate::compression_stats>();
+        }
+    }
+
+    /// Get the compression counters
+    /**
+     * Ratios and rates can be computed from the counters, for example
+     * `get_compress_ratio()` or `get_compress_in()` divided by
+     * `get_compress_ns()`.
+     *
+     * @since 0.9.0
+     *
+     * @return The counters, or null if counting is disabled
+     */
+    compression_stats_ptr get_compression_stats() const {
+        return m_compression_stats;
+    }
+
+    /// Record traffic, latencies and state changes of connections
+    /**
+     * Connections created afterwards count the connections opened, failed
+     * and closed, the messages and bytes they receive and send and the
+     * payload bytes waiting to be sent, and record handshake, write and
+     * keepalive ping latencies, all in the given metrics. If compression
+     * stats are enabled (see enable_compression_stats) when this is called
+     * they are exported with the metrics.
+     *
+     * The metrics may be read at any time with metrics::get_snapshot, or
+     * served from an http_handler with metrics::respond.
+     *
+     * @since 0.9.0
+     *
+     * @param value The metrics to record into, or null to stop recording
+     */
+    void set_metrics(metrics_ptr value) {
+        if (value && m_compression_stats) {
+            value->set_compression_stats(m_compression_stats);
+        }
+        m_metrics = value;
+    }
+
+    /// Get the metrics connections record into
+    /**
+     * @since 0.9.0
+     *
+     * @return The metrics, or null if none are set
+     */
+    metrics_ptr get_metrics() const {
+        return m_metrics;
+    }
+
+    /// Report handler calls that run longer than a threshold
+    /**
+     * Applies to connections created afterwards, see
+     * connection::set_slow_handler_threshold. Slow calls are logged to the
+     * error log at warning level and counted in the metrics set with
+     * set_metrics.
+     *
+     * @since 0.9.0
+     *
+     * @param value The threshold in microseconds, or zero to disable
+     */
+    void set_slow_handler_threshold(long value) {
+        m_slow_handler_threshold = value;
+    }
+
+    /// Measure the time connections spend on the event loop
+    /**
+     * Applies to connections created afterwards, see
+     * connection::set_accounting. The busiest connections can then be found
+     * with get_top_connections.
+     *
+     * @since 0.9.0
+     *
+     * @param value Whether connections measure time spent
+     */
+    void set_accounting(bool value) {
+        m_accounting = value;
+    }
+
+    /// Measure how long work posted to the event loop waits to run
+    /**
+     * Every interval milliseconds a timestamped handler is posted to the
+     * io_context and the time it waited to be run is recorded in the loop
+     * lag histogram of the metrics set with set_metrics. A loop that is
+     * kept busy by slow handlers or too much traffic shows up as growing
+     * lag. With several threads running the io_context each probe measures
+     * whichever thread picks it up.
+     *
+     * The probe keeps the io_context from running out of work, stop it with
+     * an interval of zero. Must be called after init_asio. Only the asio
+     * transport supports this.
+     *
+     * @since 0.9.0
+     *
+     * @param interval Milliseconds between probes, or zero to stop probing
+     */
+    void set_loop_lag_probe(long interval) {
+        if (interval <= 0) {
+            transport_type::stop_loop_lag_probe();
+            return;
+        }
+        transport_type::start_loop_lag_probe(interval, lib::bind(
+            &type::record_loop_lag, this, lib::placeholders::_1));
+    }
+
+    /// Record the wire bytes of connections
+    /**
+     * Connections created afterwards record every chunk they read from and
+     * hand to the transport in the given capture, which is replayable with
+     * capture_reader, see benchmarks/replay.
+     *
+     * @since 0.9.0
+     *
+     * @param value The capture to record into, or null to stop recording
+     */
+    void set_capture(capture_ptr value) {
+        m_capture = value;
+    }
+
+    /// Get the capture connections record into
+    /**
+     * @since 0.9.0
+     *
+     * @return The capture, or null if none is set
+     */
+    capture_ptr get_capture() const {
+        return m_capture;
+    }
+
+    /// Keep track of open connections by id
+    /**
+     * Connections created afterwards add themselves to the registry when
+     * they open and remove themselves when they end, see connection::get_id
+     * and get_con_from_id. A registry may be shared between endpoints.
+     *
+     * @since 0.9.0
+     *
+     * @param value The registry to use, or null for none
+     */
+    void set_connection_registry(registry_ptr value) {
+        m_registry = value;
+    }
+
+    /// Get the registry of open connections
+    /**
+     * @since 0.9.0
+     *
+     * @return The registry, or null if none is set
+     */
+    registry_ptr get_connection_registry() const {
+        return m_registry;
+    }
+
+    /// Move an idle connection of another endpoint onto this one
+    /**
+     * Moves con to this endpoint's io_context, registry, timer wheel and
+     * loggers, see connection::migrate. Must be called on the thread running
+     * con. handler is called on this endpoint's io_context once con moved,
+     * or on con's own with the reason it did not.
+     *
+     * Only the asio transport supports this.
+     *
+     * @since 0.9.0
+     *
+     * @param con The connection to move
+     * @param handler Called once the migration ended
+     */
+    void adopt(connection_ptr con, migrate_handler handler) {
+        typename connection_type::migration_target target;
+        target.alog = m_alog;
+        target.elog = m_elog;
+        target.registry = m_registry;
+        target.timer_wheel = m_timer_wheel;
+        con->migrate(transport_type::get_io_context(), target, handler);
+    }
+
+    /// Measure how long messages sent by connections wait and take to write
+    /**
+     * Applies to connections created afterwards, see
+     * connection::set_send_latency_tracking.
+     *
+     * @since 0.9.0
+     *
+     * @param value Whether to measure send latency
+     */
+    void set_send_latency_tracking(bool value) {
+        m_send_latency_tracking = value;
+    }
+
+    /// Set the handler called with the send latency of each message
+    /**
+     * Applies to connections created afterwards and enables send latency
+     * tracking on them, see connection::set_send_latency_handler.
+     *
+     * @since 0.9.0
+     *
+     * @param h The new send_latency_handler
+     */
+    void set_send_latency_handler(send_latency_handler h) {
+        m_send_latency_handler = h;
+    }
+
+    /// Compress large outgoing messages on a worker pool
+    /**
+     * Compressing a multi-megabyte message takes long enough to hold up
+     * every other connection served by the same thread. With a pool set,
+     * compressed messages of at least `threshold` bytes sent on connections
+     * created afterwards are compressed by a worker thread, and the frame is
+     * then written from the connection's strand. Messages sent on the same
+     * connection while one is on the pool wait behind it, so the send order
+     * is kept. Ping and pong frames are not held back.
+     *
+     * When the connection resets its compression context after every message
+     * (server_no_context_takeover on a server) and no preset dictionary is in
+     * use, a message of at least twice `part_size` bytes is split into parts
+     * that are compressed at the same time on different workers. The joined
+     * parts form a single frame. Independent parts compress slightly worse
+     * than the whole message would.
+     *
+     * The pool may be shared with other endpoints. Has no effect with a lock
+     * free send queue.
+     *
+     * @since 0.9.0
+     *
+     * @param pool The worker pool, or null to compress on the sending thread
+     * @param threshold The smallest payload to compress on the pool
+     * @param part_size The size of parts to compress in parallel, 0 to never
+     * split messages
+     */
+    void set_compression_offload(compression_pool_ptr pool, size_t threshold,
+        size_t part_size = 0)
+    {
+        m_compression_pool = pool;
+        m_offload_threshold = threshold;
+        m_offload_part_size = part_size;
+    }
+
+    /// Run the message handler on a worker pool
+    /**
+     * A message handler that does heavy work holds up reading and writing
+     * for every connection served by the same thread. With a pool set, the
+     * messages of connections created afterwards are handed to a worker
+     * thread instead. Each connection's messages are handled one at a time
+     * and in the order they arrived, while different connections are
+     * handled in parallel, so the handler needs no locking of per
+     * connection state. connection::send may be called from the handler, it
+     * queues the message and writing is done from the connection's strand.
+     *
+     * Once `max_queued` messages of a connection wait for the pool it stops
+     * reading until the handler has caught up. The close and fail handlers
+     * may run while messages received before the close are still waiting.
+     * Only the message handler is dispatched: message view, chunk and batch
+     * handlers are still called from the read path.
+     *
+     * The pool may be shared with other endpoints and with compression
+     * offload, see set_compression_offload.
+     *
+     * @since 0.9.0
+     *
+     * @param pool The worker pool, or null to call the message handler from
+     * the read path
+     * @param max_queued The number of messages waiting for the pool at which
+     * a connection stops reading, 0 for no limit
+     */
+    void set_message_dispatch(dispatch_pool_ptr pool, size_t max_queued = 0) {
+        m_dispatch_pool = pool;
+        m_dispatch_max = max_queued;
+    }
+
+    /// Set the largest payload sent in a single frame
+    /**
+     * Connections created afterwards write data messages with larger
+     * payloads as a series of fragments, so a very large send does not hold
+     * up ping and pong frames until it is written in full. See
+     * connection::set_fragment_size.
+     *
+     * @since 0.9.0
+     *
+     * @param value The largest frame payload in bytes, 0 for no limit
+     */
+    void set_fragment_size(size_t value) {
+        m_fragment_size = value;
+    }
+
+    /// Get the largest payload sent in a single frame
+    /**
+     * @since 0.9.0
+     *
+     * @return The largest frame payload in bytes, 0 for no limit
+     */
+    size_t get_fragment_size() const {
+        return m_fragment_size;
+    }
+
+    /// Set the buffered amounts that trigger the watermark handlers
+    /**
+     * Applies to connections created afterwards, see
+     * connection::set_send_watermarks.
+     *
+     * @since 0.9.0
+     *
+     * @param high The high watermark in bytes, 0 to disable
+     * @param low The low watermark in bytes
+     */
+    void set_send_watermarks(size_t high, size_t low) {
+        m_high_watermark = high;
+        m_low_watermark = (std::min)(low, high);
+    }
+
+    /// Get the high watermark for new connections
+    /**
+     * @since 0.9.0
+     *
+     * @return The high watermark in bytes, 0 if disabled
+     */
+    size_t get_high_watermark() const {
+        return m_high_watermark;
+    }
+
+    /// Get the low watermark for new connections
+    /**
+     * @since 0.9.0
+     *
+     * @return The low watermark in bytes
+     */
+    size_t get_low_watermark() const {
+        return m_low_watermark;
+    }
+
+    /// Let small messages gather before the next write
+    /**
+     * Applies to connections created afterwards, see
+     * connection::set_send_coalescing.
+     *
+     * @since 0.9.0
+     *
+     * @param max_delay The longest wait in microseconds, 0 to disable
+     * @param max_bytes Queued bytes that end a wait in any case, 0 for no
+     * limit
+     */
+    void set_send_coalescing(long max_delay, size_t max_bytes) {
+        m_coalesce_max_delay = max_delay;
+        m_coalesce_max_bytes = max_bytes;
+    }
+
+    /// Get the longest wait of send coalescing for new connections
+    /**
+     * @since 0.9.0
+     *
+     * @return The longest wait in microseconds, 0 if disabled
+     */
+    long get_send_coalescing_delay() const {
+        return m_coalesce_max_delay;
+    }
+
+    /// Pause reading while delivered messages are unreleased
+    /**
+     * Applies to connections created afterwards, see
+     * connection::set_inbound_flow_control.
+     *
+     * @since 0.9.0
+     *
+     * @param max_messages The number of outstanding messages to pause at, 0
+     * for no limit
+     * @param max_bytes The outstanding payload bytes to pause at, 0 for no
+     * limit
+     */
+    void set_inbound_flow_control(size_t max_messages, size_t max_bytes) {
+        m_flow_max_messages = max_messages;
+        m_flow_max_bytes = max_bytes;
+    }
+
+    /// Limit the rate at which connections read from their peers
+    /**
+     * Applies to connections created afterwards, see
+     * connection::set_inbound_rate_limit.
+     *
+     * @since 0.9.0
+     *
+     * @param messages_per_second The number of data messages per second, 0
+     * for no limit
+     * @param bytes_per_second The number of bytes read per second, 0 for no
+     * limit
+     * @param action What to do once a peer exceeds a limit
+     */
+    void set_inbound_rate_limit(size_t messages_per_second,
+        size_t bytes_per_second,
+        rate_limit::action action = rate_limit::pause_reading)
+    {
+        m_rate_max_messages = messages_per_second;
+        m_rate_max_bytes = bytes_per_second;
+        m_rate_action = action;
+    }
+
+    /// Set what new connections do about a send queue that does not drain
+    /**
+     * See connection::set_slow_consumer_policy.
+     *
+     * @since 0.9.0
+     *
+     * @param policy The policy
+     * @param limit The buffered bytes above which the policy applies
+     * @param grace Milliseconds the backlog may last before disconnecting
+     */
+    void set_slow_consumer_policy(slow_consumer::value policy, size_t limit,
+        long grace = 0)
+    {
+        m_slow_consumer_policy = policy;
+        m_slow_consumer_limit = limit;
+        m_slow_consumer_grace = grace;
+    }
+
+    /// Get the slow consumer policy for new connections
+    /**
+     * @since 0.9.0
+     *
+     * @return The policy
+     */
+    slow_consumer::value get_slow_consumer_policy() const {
+        return m_slow_consumer_policy;
+    }
+
+    /// Offer or accept a preset deflate dictionary
+    /**
+     * Connections created afterwards exchange `id` in a private
+     * permessage-deflate parameter. Where the remote endpoint is a
+     * WebSocket++ endpoint configured with the same id, both compression
+     * contexts start primed with `dictionary`, which greatly improves the
+     * compression of small messages that share common strings. Other remote
+     * endpoints are unaffected.
+     *
+     * The dictionary is shared, not copied, between connections. Only its
+     * last 32KiB, or less with smaller windows, are used. See
+     * permessage_deflate::enabled::set_dictionary.
+     *
+     * @since 0.9.0
+     *
+     * @param id Name of the dictionary, an HTTP token
+     * @param dictionary The dictionary contents, or empty to stop using one
+     */
+    void set_deflate_dictionary(std::string const & id,
+        std::string const & dictionary)
+    {
+        m_deflate_dictionary_id = id;
+        if (dictionary.empty()) {
+            m_deflate_dictionary.reset();
+        } else {
+            m_deflate_dictionary =
+                lib::make_shared<std::string const>(dictionary);
+        }
+    }
+
+    /// Set the permessage-zstd compression level
+    /**
+     * Applies to connections created afterwards, where the config enables
+     * permessage-zstd and it is negotiated. Levels run from ZSTD_minCLevel(),
+     * the fastest, to ZSTD_maxCLevel(). 0 restores the default.
+     *
+     * @since 0.9.0
+     *
+     * @param level The compression level
+     * @return A status code, an extension disabled error if the config does
+     * not enable permessage-zstd
+     */
+    lib::error_code set_zstd_compression_level(int level) {
+        lib::error_code ec =
+            permessage_zstd_type::validate_compression_level(level);
+        if (!ec) {
+            m_zstd_level = level;
+        }
+        return ec;
+    }
+
+    /// Offer or accept a shared zstd dictionary
+    /**
+     * The dictionary is digested once and shared by every connection created
+     * afterwards. Clients offer their dictionaries in the order they were
+     * added, then no dictionary; servers use the first offered dictionary
+     * they also hold. Its id is exchanged in the handshake, so both
+     * endpoints must be given the same dictionary under the same id.
+     *
+     * @since 0.9.0
+     *
+     * @param content The dictionary, trained by zstd or raw content
+     * @param id The id to negotiate, or 0 to use the id a trained
+     * dictionary carries
+     * @return A status code, permessage_zstd::error::invalid_dictionary if
+     * the dictionary is empty or has no usable id
+     */
+    lib::error_code add_zstd_dictionary(std::string const & content,
+        uint32_t id = 0)
+    {
+        lib::error_code ec;
+        typename permessage_zstd_type::dictionary_ptr dict =
+            permessage_zstd_type::make_dictionary(content, id, ec);
+        if (ec) {
+            return ec;
+        }
+
+        // connections keep the list they were created with
+        lib::shared_ptr<typename permessage_zstd_type::dictionary_list> list =
+            lib::make_shared<typename permessage_zstd_type::dictionary_list>();
+        if (m_zstd_dictionaries) {
+            *list = *m_zstd_dictionaries;
+        }
+        list->push_back(dict);
+        m_zstd_dictionaries = list;
+        return lib::error_code();
+    }
+
+    /// Stop offering or accepting zstd dictionaries
+    /**
+     * @since 0.9.0
+     */
+    void clear_zstd_dictionaries() {
+        m_zstd_dictionaries.reset();
+    }
+
+    /// Get maximum HTTP message body size
+    /**
+     * Get maximum HTTP message body size. Maximum message body size determines
+     * the point at which the connection will stop reading an HTTP request whose
+     * body is too large.
+     *
+     * The default is set by the max_http_body_size value from the template
+     * config
+     *
+     * @since 0.5.0
+     *
+     * @return The maximum HTTP message body size
+     */
+    size_t get_max_http_body_size() const {
+        return m_max_http_body_size;
+    }
+    
+    /// Set maximum HTTP message body size
+    /**
+     * Set maximum HTTP message body size. Maximum message body size determines
+     * the point at which the connection will stop reading an HTTP request whose
+     * body is too large.
+     *
+     * The default is set by the max_http_body_size value from the template
+     * config
+     *
+     * @since 0.5.1
+     *
+     * @param new_value The value to set as the maximum message size.
+     */
+    void set_max_http_body_size(size_t new_value) {
+        m_max_http_body_size = new_value;
+    }
+
+    /*************************************/
+    /* Connection pass through functions */
+    /*************************************/
+
+    /**
+     * These functions act as adaptors to their counterparts in connection. They
+     * can produce one additional type of error, the bad_connection error, that
+     * indicates that the conversion from connection_hdl to connection_ptr
+     * failed due to the connection not existing anymore. Each method has a
+     * default and an exception free variant.
+     */
+
+    void interrupt(connection_hdl_ref hdl, lib::error_code & ec);
+    void interrupt(connection_hdl_ref hdl);
+
+    /// Pause reading of new data (exception free)
+    /**
+     * Signals to the connection to halt reading of new data. While reading is 
+     * paused, the connection will stop reading from its associated socket. In
+     * turn this will result in TCP based flow control kicking in and slowing
+     * data flow from the remote endpoint.
+     *
+     * This is useful for applications that push new requests to a queue to be 
+     * processed by another thread and need a way to signal when their request
+     * queue is full without blocking the network processing thread.
+     *
+     * Use `resume_reading()` to resume.
+     *
+     * If supported by the transport this is done asynchronously. As such
+     * reading may not stop until the current read operation completes. 
+     * Typically you can expect to receive no more bytes after initiating a read
+     * pause than the size of the read buffer.
+     *
+     * If reading is paused for this connection already nothing is changed.
+     */
+    void pause_reading(connection_hdl_ref hdl, lib::error_code & ec);
+    
+    /// Pause reading of new data
+    void pause_reading(connection_hdl_ref hdl);
+
+    /// Resume reading of new data (exception free)
+    /**
+     * Signals to the connection to resume reading of new data after it was 
+     * paused by `pause_reading()`.
+     *
+     * If reading is not paused for this connection already nothing is changed.
+     */
+    void resume_reading(connection_hdl_ref hdl, lib::error_code & ec);
+
+    /// Resume reading of new data
+    void resume_reading(connection_hdl_ref hdl);
+
+    /// Estimate the memory held by a connection (exception free)
+    /**
+     * See connection::get_memory_usage for what is counted and from which
+     * thread to call this.
+     *
+     * @since 0.9.0
+     *
+     * @param hdl The connection to look at
+     * @param ec Set to error::bad_connection if the connection is gone
+     * @return The estimated bytes of each component, all 0 on error
+     */
+    memory_usage get_memory_usage(connection_hdl_ref hdl,
+        lib::error_code & ec);
+
+    /// Estimate the memory held by a connection
+    memory_usage get_memory_usage(connection_hdl_ref hdl);
+
+    /// Estimate the memory held by several connections
+    /**
+     * Adds up the estimates of the connections in a range of handles.
+     * Connections that are gone are skipped. Divide by the count for the
+     * average per connection.
+     *
+     * @since 0.9.0
+     *
+     * @param begin The first handle
+     * @param end Past the last handle
+     * @param count Set to the number of connections counted, may be null
+     * @return The sum of the estimates
+     */
+    template <typename iterator_type>
+    memory_usage get_memory_usage(iterator_type begin, iterator_type end,
+        size_t * count = NULL)
+    {
+        memory_usage usage;
+        size_t counted = 0;
+        for (; begin != end; ++begin) {
+            lib::error_code ec;
+            connection_ptr con = get_con_from_hdl(*begin, ec);
+            if (ec) {
+                continue;
+            }
+            usage += con->get_memory_usage();
+            ++counted;
+        }
+        if (count) {
+            *count = counted;
+        }
+        return usage;
+    }
+
+    /// Send deferred HTTP Response
+    /**
+     * Sends an http response to an HTTP connection that was deferred. This will
+     * send a complete response including all headers, status line, and body
+     * text. The connection will be closed afterwards.
+     *
+     * Exception free variant
+     *
+     * @since 0.6.0
+     *
+     * @param hdl The connection to send the response on
+     * @param ec A status code, zero on success, non-zero otherwise
+     */
+    void send_http_response(connection_hdl_ref hdl, lib::error_code & ec);
+        
+    /// Send deferred HTTP Response (exception free)
+    /**
+     * Sends an http response to an HTTP connection that was deferred. This will
+     * send a complete response including all headers, status line, and body
+     * text. The connection will be closed afterwards.
+     *
+     * Exception variant
+     *
+     * @since 0.6.0
+     *
+     * @param hdl The connection to send the response on
+     */
+    void send_http_response(connection_hdl_ref hdl);
+
+    /// Create a message and add it to the outgoing send queue (exception free)
+    /**
+     * Convenience method to send a message given a payload string and an opcode
+     *
+     * @param [in] hdl The handle identifying the connection to send via.
+     * @param [in] payload The payload string to generated the message with
+     * @param [in] op The opcode to generated the message with.
+     * @param [out] ec A code to fill in for errors
+     */
+    void send(connection_hdl_ref hdl, std::string const & payload,
+        frame::opcode::value op, lib::error_code & ec);
+    /// Create a message and add it to the outgoing send queue
+    /**
+     * Convenience method to send a message given a payload string and an opcode
+     *
+     * @param [in] hdl The handle identifying the connection to send via.
+     * @param [in] payload The payload string to generated the message with
+     * @param [in] op The opcode to generated the message with.
+     */
+    void send(connection_hdl_ref hdl, std::string const & payload,
+        frame::opcode::value op);
 
     void send(connection_hdl_ref hdl, void const * payload, size_t len,
         frame::opcode::value op, lib::error_code & ec);
@@ -635,6 +2112,363 @@ public:
     void send(connection_hdl_ref hdl, message_ptr msg, lib::error_code & ec);
     void send(connection_hdl_ref hdl, message_ptr msg);
 
+    /// Build a pre-framed message for sending to many connections
+    /**
+     * Frames `payload` once as a single unmasked, uncompressed RFC6455 data
+     * frame and returns it as a prepared message. The returned message may be
+     * passed to `send` for any number of connections; server role RFC6455
+     * connections enqueue it as is, with no per-connection header generation,
+     * payload copy, validation, or compression. Connections that cannot use
+     * the pre-built frame (hybi00) frame the payload themselves as if it were
+     * an ordinary unprepared message.
+     *
+     * The returned message is shared between every connection it is sent on
+     * and must not be modified after it has been sent.
+     *
+     * Broadcast messages are never compressed, even on connections that have
+     * negotiated permessage-deflate, as the compressor state is per
+     * connection.
+     *
+     * Exception free variant
+     *
+     * @since 0.9.0
+     *
+     * @param [in] payload The payload of the message
+     * @param [in] op The opcode of the message. Must be a data opcode.
+     * @param [out] ec A code to fill in for errors
+     * @return The prepared message, or an empty pointer on error
+     */
+    message_ptr prepare_broadcast(std::string const & payload,
+        frame::opcode::value op, lib::error_code & ec);
+
+    /// Build a pre-framed message for sending to many connections
+    /**
+     * Exception variant of `prepare_broadcast`
+     *
+     * @since 0.9.0
+     *
+     * @param [in] payload The payload of the message
+     * @param [in] op The opcode of the message. Must be a data opcode.
+     * @return The prepared message
+     */
+    message_ptr prepare_broadcast(std::string const & payload,
+        frame::opcode::value op);
+
+    /// Build a pre-framed message around bytes owned elsewhere
+    /**
+     * Same as `prepare_broadcast` but the payload is the len bytes at
+     * payload, which are not copied, see message::set_payload_ref. Every
+     * connection the message is sent on writes those bytes straight to the
+     * wire, and owner is released once the last of them is done with it.
+     *
+     * The bytes must not change while the message is in use.
+     *
+     * Exception free variant
+     *
+     * @since 0.9.0
+     *
+     * @param [in] owner Keeps the payload bytes alive
+     * @param [in] payload A pointer to the payload bytes
+     * @param [in] len The length of the payload in bytes
+     * @param [in] op The opcode of the message. Must be a data opcode.
+     * @param [out] ec A code to fill in for errors
+     * @return The prepared message, or an empty pointer on error
+     */
+    message_ptr prepare_broadcast(lib::shared_ptr<void const> owner,
+        void const * payload, size_t len, frame::opcode::value op,
+        lib::error_code & ec);
+
+    /// Build a pre-framed message around bytes owned elsewhere
+    /**
+     * Exception variant of `prepare_broadcast`
+     *
+     * @since 0.9.0
+     *
+     * @param [in] owner Keeps the payload bytes alive
+     * @param [in] payload A pointer to the payload bytes
+     * @param [in] len The length of the payload in bytes
+     * @param [in] op The opcode of the message. Must be a data opcode.
+     * @return The prepared message
+     */
+    message_ptr prepare_broadcast(lib::shared_ptr<void const> owner,
+        void const * payload, size_t len, frame::opcode::value op);
+
+    /// Build a message for one recipient of a broadcast template
+    /**
+     * Returns a prepared message that writes `prefix` followed by the
+     * payload of `tmpl`, a message from prepare_broadcast, as one frame.
+     * Only the frame header and the prefix belong to the new message; the
+     * template's payload is shared and written from where it is, so
+     * broadcasts that differ per recipient only in a small field, such as a
+     * sequence number or subscriber id, are serialized once. Connections
+     * that frame messages themselves (hybi00) copy the prefix and the
+     * payload into one message instead.
+     *
+     * The recipient message is never compressed, as it has to be written in
+     * pieces, even where permessage-deflate was negotiated. For a text
+     * template the prefix must be valid UTF-8 on its own.
+     *
+     * Exception free variant
+     *
+     * @since 0.9.0
+     *
+     * @param [in] tmpl The template, from prepare_broadcast
+     * @param [in] prefix The bytes that go in front of the template's payload
+     * @param [out] ec A code to fill in for errors
+     * @return The prepared message, or an empty pointer on error
+     */
+    message_ptr prepare_recipient(message_ptr tmpl, std::string const & prefix,
+        lib::error_code & ec)
+    {
+        return make_recipient(m_msg_manager, tmpl, prefix, ec);
+    }
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+    /// Build a message for one recipient of a broadcast template
+    /**
+     * Exception variant of `prepare_recipient`
+     *
+     * @since 0.9.0
+     *
+     * @param [in] tmpl The template, from prepare_broadcast
+     * @param [in] prefix The bytes that go in front of the template's payload
+     * @return The prepared message
+     */
+    message_ptr prepare_recipient(message_ptr tmpl,
+        std::string const & prefix);
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
+    /// Spread broadcasts over time instead of queueing them all at once
+    /**
+     * A broadcast to many connections otherwise hands all of its bytes to
+     * the sockets in one go, which overflows NIC queues and switch buffers
+     * and delays other traffic. With pacing, broadcast sends to one slice of
+     * the connections at once and to the next slice every
+     * broadcast_pacing_tick milliseconds.
+     *
+     * With a window, slices are sized so the last connection is sent to
+     * within `window` milliseconds. With a rate, slices are sized to send
+     * about `rate` payload bytes per second. With both, the larger slice
+     * wins, so the rate is kept unless that would take longer than the
+     * window. For a sharded_server these apply per shard.
+     *
+     * Pacing needs transport timers. Without them, as with the iostream
+     * transport, everything is sent at once. To also pace each socket's
+     * own transmission see socket_options::max_pacing_rate.
+     *
+     * Zero for both, the default, sends at once.
+     *
+     * @since 0.9.0
+     *
+     * @param window Milliseconds to deliver each broadcast within, or 0
+     * @param rate Payload bytes per second to send, or 0
+     */
+    void set_broadcast_pacing(long window, uint64_t rate) {
+        m_pacing_window = window;
+        m_pacing_rate = rate;
+    }
+
+    /// Milliseconds between the slices of a paced broadcast
+    static long const broadcast_pacing_tick = 10;
+
+    /// Send a message to every open connection
+    /**
+     * Queues `msg` on each connection in the endpoint's registry, see
+     * set_connection_registry, that `filter` accepts. The registry is walked
+     * shard by shard with no lock held while sending. Normally `msg` comes
+     * from prepare_broadcast, so it is framed only once.
+     *
+     * With pacing (see set_broadcast_pacing) only the first slice of the
+     * connections is sent to right away and the rest follow on a timer.
+     * Connections that close meanwhile are skipped.
+     *
+     * To broadcast across threads, give each io_context its own endpoint and
+     * registry and call this on every one from its own thread, as
+     * sharded_server::broadcast does, so each connection is sent to by the
+     * thread that runs it.
+     *
+     * Exception free variant
+     *
+     * @since 0.9.0
+     *
+     * @param [in] msg The message to send
+     * @param [in] filter Called for each connection, which is only sent to if
+     * it returns true. Empty to send to all.
+     * @param [out] ec Set to invalid_state if the endpoint has no registry
+     * @return The number of connections the message was queued on, or with
+     * pacing will be sent to
+     */
+    size_t broadcast(message_ptr msg, broadcast_filter filter,
+        lib::error_code & ec);
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+    /// Send a message to every open connection
+    /**
+     * Exception variant of `broadcast`
+     *
+     * @since 0.9.0
+     *
+     * @param [in] msg The message to send
+     * @param [in] filter Called for each connection, which is only sent to if
+     * it returns true. Empty to send to all.
+     * @return The number of connections the message was queued on
+     */
+    size_t broadcast(message_ptr msg,
+        broadcast_filter filter = broadcast_filter());
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
+    /// Send a broadcast template with a prefix of its own to each connection
+    /**
+     * Same as `broadcast`, but each connection is sent
+     * prepare_recipient(tmpl, prefix(con)), so the template's payload is
+     * shared and only the prefix is built per connection. With pacing the
+     * prefix of a connection is asked for when its slice is sent.
+     * Connections whose recipient message cannot be built are skipped.
+     *
+     * Exception free variant
+     *
+     * @since 0.9.0
+     *
+     * @param [in] tmpl The template, from prepare_broadcast
+     * @param [in] prefix Called for each connection sent to for the bytes
+     * that go in front of the template's payload
+     * @param [in] filter Called for each connection, which is only sent to if
+     * it returns true. Empty to send to all.
+     * @param [out] ec Set to invalid_state if the endpoint has no registry
+     * @return The number of connections the message was queued on, or with
+     * pacing will be sent to
+     */
+    size_t broadcast(message_ptr tmpl, broadcast_prefix prefix,
+        broadcast_filter filter, lib::error_code & ec);
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+    /// Send a broadcast template with a prefix of its own to each connection
+    /**
+     * Exception variant of `broadcast`
+     *
+     * @since 0.9.0
+     *
+     * @param [in] tmpl The template, from prepare_broadcast
+     * @param [in] prefix Called for each connection sent to for the bytes
+     * that go in front of the template's payload
+     * @param [in] filter Called for each connection, which is only sent to if
+     * it returns true. Empty to send to all.
+     * @return The number of connections the message was queued on
+     */
+    size_t broadcast(message_ptr tmpl, broadcast_prefix prefix,
+        broadcast_filter filter);
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
+    /// Find the open connections that used the most of a resource
+    /**
+     * Walks the endpoint's registry, see set_connection_registry, keeping
+     * the n largest readings of connection::get_usage in a heap of size n,
+     * so it takes one pass and no more memory than the result. Times are
+     * only counted by connections with accounting on, see set_accounting.
+     * Usage is counted over the life of each connection; to find the
+     * busiest connections of the last minute compare two calls.
+     *
+     * @since 0.9.0
+     *
+     * @param metric The resource to rank connections by
+     * @param n The number of connections to return
+     * @return Up to n pairs of usage and connection, largest first. Empty
+     * if the endpoint has no registry.
+     */
+    std::vector<std::pair<uint64_t, connection_ptr> > get_top_connections(
+        usage::value metric, size_t n) const;
+
+    /// Close every open connection
+    /**
+     * Starts the close handshake on each connection in the endpoint's
+     * registry, see set_connection_registry, for draining a server. The
+     * close frame is prepared once and queued on every server connection that
+     * can send it as is.
+     *
+     * With a deadline, connections arm no close handshake timers of their
+     * own. A single timer instead expires at the deadline and terminates the
+     * connections still closing, `batch` of them per millisecond so the
+     * socket shutdowns are spread out. Transports without timers keep the
+     * per-connection close handshake timeout.
+     *
+     * Exception free variant
+     *
+     * @since 0.9.0
+     *
+     * @param [in] code The close code to send
+     * @param [in] reason The close reason to send, truncated to 123 bytes
+     * @param [in] deadline Milliseconds to wait for the close handshakes, or
+     * 0 to use each connection's close handshake timeout
+     * @param [in] batch The number of connections dropped per millisecond
+     * once the deadline expired, 0 for all at once
+     * @param [out] ec Set to invalid_state if the endpoint has no registry
+     * @return The number of connections that started closing
+     */
+    size_t close_all(close::status::value code, std::string const & reason,
+        long deadline, size_t batch, lib::error_code & ec);
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+    /// Close every open connection
+    /**
+     * Exception variant of `close_all`
+     *
+     * @since 0.9.0
+     *
+     * @param [in] code The close code to send
+     * @param [in] reason The close reason to send, truncated to 123 bytes
+     * @param [in] deadline Milliseconds to wait for the close handshakes, or
+     * 0 to use each connection's close handshake timeout
+     * @param [in] batch The number of connections dropped per millisecond
+     * once the deadline expired, 0 for all at once
+     * @return The number of connections that started closing
+     */
+    size_t close_all(close::status::value code, std::string const & reason,
+        long deadline = 0, size_t batch = 0);
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
+    /// Close every open connection at a random time within a window
+    /**
+     * For restarts without downtime: once the new process accepts, for
+     * example after the asio transport's release_listener and
+     * listen_native, closing the connections of the old one spread over
+     * `window` milliseconds lets their clients reconnect gradually instead of
+     * all at once. Each connection in the registry, see
+     * set_connection_registry, starts its close handshake after its own
+     * uniformly random delay. A code such as close::status::try_again_later
+     * or service_restart tells clients to reconnect. The close frame is
+     * prepared once, as for close_all.
+     *
+     * Transports without timers close all connections right away.
+     *
+     * Exception free variant
+     *
+     * @since 0.9.0
+     *
+     * @param [in] window Milliseconds to spread the closes over
+     * @param [in] code The close code to send
+     * @param [in] reason The close reason to send, truncated to 123 bytes
+     * @param [out] ec Set to invalid_state if the endpoint has no registry
+     * @return The number of connections scheduled or closed
+     */
+    size_t drain(long window, close::status::value code,
+        std::string const & reason, lib::error_code & ec);
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+    /// Close every open connection at a random time within a window
+    /**
+     * Exception variant of `drain`
+     *
+     * @since 0.9.0
+     *
+     * @param [in] window Milliseconds to spread the closes over
+     * @param [in] code The close code to send
+     * @param [in] reason The close reason to send, truncated to 123 bytes
+     * @return The number of connections scheduled or closed
+     */
+    size_t drain(long window, close::status::value code =
+        close::status::service_restart, std::string const & reason = "");
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
     void close(connection_hdl_ref hdl, close::status::value const code,
         std::string const & reason, lib::error_code & ec);
 #ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
@@ -718,9 +2552,321 @@ public:
         return con;
     }
 #endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
+    /// Get the per connection data of the connection of a handle
+    /**
+     * See connection::get_user_data. Like get_con_from_hdl, the result may
+     * be used for the remainder of a handler of the connection, but not held
+     * on to after it.
+     *
+     * @since 0.9.0
+     *
+     * @param hdl The connection handle
+     * @return The data, or NULL if the connection no longer exists
+     */
+    user_data_type * get_user_data(connection_hdl_ref hdl) {
+        connection_ptr con = lib::static_pointer_cast<connection_type>(
+            hdl.lock());
+        return con ? &con->get_user_data() : NULL;
+    }
+
+    /// Retrieves an open connection by its registry id
+    /**
+     * Requires a registry, see set_connection_registry. Unlike a
+     * connection_hdl, the returned connection_ptr keeps the connection
+     * alive; do not hold on to it after the connection closes.
+     *
+     * @since 0.9.0
+     *
+     * @param id The id of the connection, see connection::get_id
+     * @param ec Set to error::bad_connection if no open connection has the id
+     *
+     * @return the connection_ptr. May be NULL if the id was not found.
+     */
+    connection_ptr get_con_from_id(uint64_t id, lib::error_code & ec) {
+        connection_ptr con;
+        if (m_registry) {
+            con = m_registry->find(id);
+        }
+        if (!con) {
+            ec = error::make_error_code(error::bad_connection);
+        }
+        return con;
+    }
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+    /// Retrieves an open connection by its registry id (exception version)
+    connection_ptr get_con_from_id(uint64_t id) {
+        lib::error_code ec;
+        connection_ptr con = this->get_con_from_id(id,ec);
+        if (ec) {
+            throw exception(ec);
+        }
+        return con;
+    }
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
+    /// Retrieves an open connection by its compact handle
+    /**
+     * @see get_con_from_id
+     *
+     * @since 0.9.0
+     */
+    connection_ptr get_con_from_hdl(connection_id id, lib::error_code & ec) {
+        return this->get_con_from_id(id.value,ec);
+    }
+
+    /* connection_id overloads
+     *
+     * Each of the following resolves the id through the registry and does
+     * what the connection_hdl overload of the same name does. An id that no
+     * open connection has fails with error::bad_connection.
+     */
+
+    void interrupt(connection_id id, lib::error_code & ec) {
+        connection_ptr con = get_con_from_hdl(id,ec);
+        if (ec) {return;}
+        ec = con->interrupt();
+    }
+
+    void pause_reading(connection_id id, lib::error_code & ec) {
+        connection_ptr con = get_con_from_hdl(id,ec);
+        if (ec) {return;}
+        ec = con->pause_reading();
+    }
+
+    void resume_reading(connection_id id, lib::error_code & ec) {
+        connection_ptr con = get_con_from_hdl(id,ec);
+        if (ec) {return;}
+        ec = con->resume_reading();
+    }
+
+    memory_usage get_memory_usage(connection_id id, lib::error_code & ec) {
+        connection_ptr con = get_con_from_hdl(id,ec);
+        if (ec) {return memory_usage();}
+        return con->get_memory_usage();
+    }
+
+    void send_http_response(connection_id id, lib::error_code & ec) {
+        connection_ptr con = get_con_from_hdl(id,ec);
+        if (ec) {return;}
+        con->send_http_response(ec);
+    }
+
+    void send(connection_id id, std::string const & payload,
+        frame::opcode::value op, lib::error_code & ec)
+    {
+        connection_ptr con = get_con_from_hdl(id,ec);
+        if (ec) {return;}
+        ec = con->send(payload,op);
+    }
+
+    void send(connection_id id, void const * payload, size_t len,
+        frame::opcode::value op, lib::error_code & ec)
+    {
+        connection_ptr con = get_con_from_hdl(id,ec);
+        if (ec) {return;}
+        ec = con->send(payload,len,op);
+    }
+
+    void send(connection_id id, message_ptr msg, lib::error_code & ec) {
+        connection_ptr con = get_con_from_hdl(id,ec);
+        if (ec) {return;}
+        ec = con->send(msg);
+    }
+
+    void close(connection_id id, close::status::value const code,
+        std::string const & reason, lib::error_code & ec)
+    {
+        connection_ptr con = get_con_from_hdl(id,ec);
+        if (ec) {return;}
+        con->close(code,reason,ec);
+    }
+
+    void ping(connection_id id, std::string const & payload,
+        lib::error_code & ec)
+    {
+        connection_ptr con = get_con_from_hdl(id,ec);
+        if (ec) {return;}
+        con->ping(payload,ec);
+    }
+
+    void pong(connection_id id, std::string const & payload,
+        lib::error_code & ec)
+    {
+        connection_ptr con = get_con_from_hdl(id,ec);
+        if (ec) {return;}
+        con->pong(payload,ec);
+    }
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+    connection_ptr get_con_from_hdl(connection_id id) {
+        return this->get_con_from_id(id.value);
+    }
+
+    void interrupt(connection_id id) {
+        lib::error_code ec;
+        interrupt(id,ec);
+        if (ec) { throw exception(ec); }
+    }
+
+    void pause_reading(connection_id id) {
+        lib::error_code ec;
+        pause_reading(id,ec);
+        if (ec) { throw exception(ec); }
+    }
+
+    void resume_reading(connection_id id) {
+        lib::error_code ec;
+        resume_reading(id,ec);
+        if (ec) { throw exception(ec); }
+    }
+
+    memory_usage get_memory_usage(connection_id id) {
+        lib::error_code ec;
+        memory_usage usage = get_memory_usage(id,ec);
+        if (ec) { throw exception(ec); }
+        return usage;
+    }
+
+    void send_http_response(connection_id id) {
+        lib::error_code ec;
+        send_http_response(id,ec);
+        if (ec) { throw exception(ec); }
+    }
+
+    void send(connection_id id, std::string const & payload,
+        frame::opcode::value op)
+    {
+        lib::error_code ec;
+        send(id,payload,op,ec);
+        if (ec) { throw exception(ec); }
+    }
+
+    void send(connection_id id, void const * payload, size_t len,
+        frame::opcode::value op)
+    {
+        lib::error_code ec;
+        send(id,payload,len,op,ec);
+        if (ec) { throw exception(ec); }
+    }
+
+    void send(connection_id id, message_ptr msg) {
+        lib::error_code ec;
+        send(id,msg,ec);
+        if (ec) { throw exception(ec); }
+    }
+
+    void close(connection_id id, close::status::value const code,
+        std::string const & reason)
+    {
+        lib::error_code ec;
+        close(id,code,reason,ec);
+        if (ec) { throw exception(ec); }
+    }
+
+    void ping(connection_id id, std::string const & payload) {
+        lib::error_code ec;
+        ping(id,payload,ec);
+        if (ec) { throw exception(ec); }
+    }
+
+    void pong(connection_id id, std::string const & payload) {
+        lib::error_code ec;
+        pong(id,payload,ec);
+        if (ec) { throw exception(ec); }
+    }
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
 protected:
     connection_ptr create_connection(lib::error_code & ec);
 
+    /// Allocate a bare connection from the memory resource, slab or heap
+    connection_ptr allocate_connection();
+
+    /// Apply the endpoint's handlers and per request settings to con
+    /**
+     * Used by create_connection and again when an idle HTTP client
+     * connection is reused for another request.
+     */
+    void apply_request_defaults(connection_ptr con);
+
+    /// Replace the compression budget after its limit or the governor changed
+    /**
+     * With a memory governor the budget always exists, so compression
+     * contexts count towards the governor's total.
+     */
+    void update_deflate_budget();
+
+    /// Build a broadcast message, copying the payload unless owner is set
+    message_ptr make_broadcast(lib::shared_ptr<void const> owner,
+        char const * payload, size_t len, frame::opcode::value op,
+        lib::error_code & ec);
+
+    /// Build the message of one recipient of a broadcast template
+    static message_ptr make_recipient(con_msg_manager_ptr manager,
+        message_ptr tmpl, std::string const & prefix, lib::error_code & ec);
+
+    /// Build the close frame of close_all, or null if connections prepare
+    /// their own
+    message_ptr make_close_frame(close::status::value code,
+        std::string const & reason);
+
+    /// The connections closed by close_all that its deadline applies to
+    struct close_all_state {
+        std::vector<connection_weak_ptr> connections;
+        /// The first connection that has not been expired yet
+        size_t next;
+        size_t batch;
+    };
+
+    /// Expire the next batch of connections of a close_all
+    static void handle_close_all_deadline(
+        lib::shared_ptr<close_all_state> state, lib::error_code const & ec);
+
+    /// The close that drain starts on each connection
+    struct drain_state {
+        close::status::value code;
+        std::string reason;
+        message_ptr frame;
+    };
+
+    /// Start the close handshake of a draining connection
+    static void handle_drain_timer(connection_weak_ptr con,
+        lib::shared_ptr<drain_state const> state, lib::error_code const & ec);
+
+    /// The connections a paced broadcast has yet to send to
+    struct paced_broadcast_state {
+        message_ptr msg;
+        /// Set for a broadcast template, see prepare_recipient
+        broadcast_prefix prefix;
+        con_msg_manager_ptr manager;
+        std::vector<connection_weak_ptr> connections;
+        /// The first connection not sent to yet
+        size_t next;
+        /// Connections sent to per tick
+        size_t slice;
+    };
+
+    /// Send the next slice of a paced broadcast and wait for the one after
+    static void send_paced_slice(lib::shared_ptr<paced_broadcast_state> state);
+
+    /// Timer handler of a paced broadcast
+    static void handle_paced_broadcast(
+        lib::shared_ptr<paced_broadcast_state> state,
+        lib::error_code const & ec);
+
+    /// Send a paced broadcast's message to one connection
+    static void send_paced(paced_broadcast_state & state,
+        connection_ptr const & con);
+
+    /// Record a reading of the loop lag probe in the metrics, if any
+    void record_loop_lag(lib::chrono::microseconds lag) {
+        metrics_ptr m = m_metrics;
+        if (m) {
+            m->record_loop_lag(lag);
+        }
+    }
+
     lib::shared_ptr<alog_type> m_alog;
     lib::shared_ptr<elog_type> m_elog;
 private:
@@ -736,18 +2882,87 @@ private:
     interrupt_handler           m_interrupt_handler;
     http_handler                m_http_handler;
     validate_handler            m_validate_handler;
+    early_data_handler          m_early_data_handler;
+    async_validate_handler      m_async_validate_handler;
     message_handler             m_message_handler;
+    message_view_handler        m_message_view_handler;
+    message_chunk_handler       m_message_chunk_handler;
+    message_batch_handler       m_message_batch_handler;
+    high_watermark_handler      m_high_watermark_handler;
+    drain_handler               m_drain_handler;
+    event_handler               m_event_handler;
 
     long                        m_open_handshake_timeout_dur;
     long                        m_close_handshake_timeout_dur;
+    long                        m_validate_timeout_dur;
     long                        m_http_read_timeout_dur;
+    size_t                      m_max_http_requests;
     long                        m_pong_timeout_dur;
+    long                        m_keepalive_interval;
+    long                        m_keepalive_jitter;
+    long                        m_hibernate_timeout;
     size_t                      m_max_message_size;
+    size_t                      m_spill_threshold;
+    size_t                      m_spill_max_size;
+    std::string                 m_spill_dir;
     size_t                      m_max_http_body_size;
 	size_t						m_max_redirects;
+    bool                        m_slab_allocation;
+    std::pmr::memory_resource * m_memory_resource;
+    bool                        m_read_on_readiness;
+    size_t                      m_read_budget;
+    int                         m_deflate_mem_level;
+    long                        m_deflate_idle_timeout;
+    size_t                      m_deflate_limit;
+    deflate_budget_ptr          m_deflate_budget;
+    inbound_budget_ptr          m_inbound_budget;
+    memory_governor_ptr         m_governor;
+    timer_wheel_ptr             m_timer_wheel;
+    control_frames_ptr          m_control_frames;
+    handshake_template_ptr      m_handshake_template;
+    request_templates_ptr       m_request_templates;
+    compression_policy          m_compression_policy;
+    std::string                 m_deflate_dictionary_id;
+    lib::shared_ptr<std::string const> m_deflate_dictionary;
+    int                         m_zstd_level;
+    zstd_dictionaries_ptr       m_zstd_dictionaries;
+    bool                        m_use_compression_policy;
+    compression_stats_ptr       m_compression_stats;
+    metrics_ptr                 m_metrics;
+    capture_ptr                 m_capture;
+    registry_ptr                m_registry;
+    response_cache_ptr          m_response_cache;
+    validation_cache::ptr       m_validation_cache;
+    bool                        m_send_latency_tracking;
+    send_latency_handler        m_send_latency_handler;
+    long                        m_slow_handler_threshold;
+    long                        m_pacing_window;
+    uint64_t                    m_pacing_rate;
+    bool                        m_accounting;
+    compression_pool_ptr        m_compression_pool;
+    size_t                      m_offload_threshold;
+    size_t                      m_offload_part_size;
+    dispatch_pool_ptr           m_dispatch_pool;
+    size_t                      m_dispatch_max;
+    size_t                      m_fragment_size;
+    size_t                      m_high_watermark;
+    size_t                      m_low_watermark;
+    long                        m_coalesce_max_delay;
+    size_t                      m_coalesce_max_bytes;
+    size_t                      m_flow_max_messages;
+    size_t                      m_flow_max_bytes;
+    size_t                      m_rate_max_messages;
+    size_t                      m_rate_max_bytes;
+    rate_limit::action          m_rate_action;
+    slow_consumer::value        m_slow_consumer_policy;
+    size_t                      m_slow_consumer_limit;
+    long                        m_slow_consumer_grace;
 
     rng_type m_rng;
 
+    // message manager for endpoint level messages (broadcasts)
+    con_msg_manager_ptr         m_msg_manager;
+
     // static settings
     bool const                  m_is_server;
 
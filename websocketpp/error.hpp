@@ -149,7 +149,16 @@ enum value {
     transport_error,
 
 	/// Reading HTTP response timed out
-    http_read_response_timeout
+    http_read_response_timeout,
+
+    /// A request that is not safe to replay arrived in TLS early data
+    too_early,
+
+    /// The connection can not be moved to another io_context
+    not_migratable,
+
+    /// The connection was not idle when it was to be moved
+    connection_busy
 }; // enum value
 
 
@@ -231,6 +240,12 @@ public:
                 return "An error occurred in the underlying transport. Consult transport error code for more details.";
 			case error::http_read_response_timeout:
 				return "Reading the HTTP response timed out";
+            case error::too_early:
+                return "Request refused in TLS early data";
+            case error::not_migratable:
+                return "Connection can not be moved to another io_context";
+            case error::connection_busy:
+                return "Connection is busy";
             default:
                 return "Unknown";
         }
@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_EXTENSION_CHAIN_HPP
+#define WEBSOCKETPP_EXTENSION_CHAIN_HPP
+
+#include <websocketpp/common/system_error.hpp>
+#include <websocketpp/frame.hpp>
+#include <websocketpp/http/constants.hpp>
+
+#include <cstddef>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace websocketpp {
+namespace extensions {
+
+/// Whether no two extensions claim the same RSV bit
+template <typename... extension_types>
+constexpr bool rsv_bits_disjoint() {
+    [[maybe_unused]] uint8_t seen = 0;
+    bool ret = true;
+    ((ret = ret && !(seen & extension_types::rsv_bits),
+        seen |= extension_types::rsv_bits), ...);
+    return ret;
+}
+
+/// An ordered list of extensions composed at compile time
+/**
+ * Configs name a chain as their `extension_chain_type` to run further
+ * extensions next to permessage-deflate or permessage-zstd, without changes
+ * to the processor. Calls go straight to each extension, there is no
+ * virtual dispatch, and an empty chain compiles away.
+ *
+ * Outgoing messages pass through the extensions in order, then compression.
+ * Incoming messages are decompressed, then pass through the extensions that
+ * marked them in reverse order. Transforms work on whole messages, after
+ * the last frame has arrived.
+ *
+ * ### Extension interface
+ *
+ * **rsv_bits**\n
+ * `static constexpr uint8_t rsv_bits`\n
+ * RSV2 and/or RSV3, marking the messages the extension transformed.
+ * Messages without its bits pass through untouched, which lets the
+ * processor send some messages untransformed, such as streamed or shared
+ * broadcast frames. Extensions of a chain may not share bits.
+ *
+ * **name**\n
+ * `static char const * name()`\n
+ * Extension token used in Sec-WebSocket-Extensions
+ *
+ * **generate_offer**, **negotiate**, **init**, **is_enabled**\n
+ * As for permessage-deflate
+ *
+ * **encode**\n
+ * `lib::error_code encode(frame::opcode::value op, std::string & payload,
+ * bool & transformed)`\n
+ * Transform an outgoing data message in place, setting `transformed` if it
+ * did
+ *
+ * **decode**\n
+ * `lib::error_code decode(frame::opcode::value op, std::string & payload)`\n
+ * Undo the transform of an incoming data message carrying `rsv_bits`
+ *
+ * @since 0.9.0
+ */
+template <typename... extension_types>
+class chain {
+public:
+    typedef std::pair<lib::error_code,std::string> err_str_pair;
+
+    /// Number of extensions in the chain
+    static constexpr size_t size = sizeof...(extension_types);
+
+    /// RSV bits claimed by all extensions of the chain
+    static constexpr uint8_t reserved_bits =
+        (uint8_t(0) | ... | extension_types::rsv_bits);
+
+    static_assert((reserved_bits & frame::BHB0_RSV1) == 0,
+        "RSV1 marks messages of the compression extensions");
+    static_assert(((extension_types::rsv_bits != 0) && ...),
+        "extensions must mark the messages they transform");
+    static_assert(rsv_bits_disjoint<extension_types...>(),
+        "extensions of a chain may not share RSV bits");
+
+    /// Get an extension of the chain, to configure it before negotiation
+    template <size_t index>
+    typename std::tuple_element<index, std::tuple<extension_types...> >::type
+        & get()
+    {
+        return std::get<index>(m_extensions);
+    }
+
+    /// RSV bits of the extensions negotiated for this connection
+    uint8_t enabled_bits() const {
+        return std::apply([](extension_types const &... ext) {
+            return uint8_t((0 | ... |
+                (ext.is_enabled() ? ext.rsv_bits : 0)));
+        }, m_extensions);
+    }
+
+    /// Offers of every extension, in order
+    std::string generate_offer() const {
+        std::string ret;
+        std::apply([&ret](extension_types const &... ext) {
+            (append(ret, ext.generate_offer()), ...);
+        }, m_extensions);
+        return ret;
+    }
+
+    /// Negotiate every extension of the chain
+    /**
+     * Each extension takes the first offer of its name that it accepts.
+     * An extension that accepts an offer but then fails to initialize
+     * stops negotiation with its error.
+     *
+     * @param offers The parsed Sec-WebSocket-Extensions header
+     * @param is_server Whether this endpoint is the server
+     * @return Status code and the responses of the extensions that accepted
+     */
+    err_str_pair negotiate(http::parameter_list const & offers, bool is_server)
+    {
+        err_str_pair ret;
+        std::apply([&](extension_types &... ext) {
+            (negotiate_one(ext, offers, is_server, ret), ...);
+        }, m_extensions);
+        return ret;
+    }
+
+    /// Transform an outgoing data message
+    /**
+     * @param [in] op The opcode of the message
+     * @param [in] in The payload
+     * @param [out] out The transformed payload, valid if `bits` is set
+     * @param [out] bits The RSV bits of the extensions that transformed it
+     * @return A status code
+     */
+    lib::error_code encode(frame::opcode::value op, std::string const & in,
+        std::string & out, uint8_t & bits)
+    {
+        bits = 0;
+        if (enabled_bits() == 0) {
+            return lib::error_code();
+        }
+
+        out = in;
+        lib::error_code ec;
+        std::apply([&](extension_types &... ext) {
+            (encode_one(ext, op, out, bits, ec), ...);
+        }, m_extensions);
+        return ec;
+    }
+
+    /// Undo the transforms of an incoming data message
+    /**
+     * @param op The opcode of the message
+     * @param bits The RSV bits of the message's first frame
+     * @param payload The payload to transform in place
+     * @return A status code
+     */
+    lib::error_code decode(frame::opcode::value op, uint8_t bits,
+        std::string & payload)
+    {
+        lib::error_code ec;
+        decode_from<size>(op, bits, payload, ec);
+        return ec;
+    }
+
+private:
+    static void append(std::string & list, std::string const & item) {
+        if (item.empty()) {
+            return;
+        }
+        if (!list.empty()) {
+            list += ", ";
+        }
+        list += item;
+    }
+
+    template <typename extension_type>
+    static void negotiate_one(extension_type & ext,
+        http::parameter_list const & offers, bool is_server,
+        err_str_pair & ret)
+    {
+        if (ret.first) {
+            return;
+        }
+
+        http::parameter_list::const_iterator it;
+        for (it = offers.begin(); it != offers.end(); ++it) {
+            if (it->first != extension_type::name()) {
+                continue;
+            }
+
+            err_str_pair neg_ret = ext.negotiate(it->second);
+            if (neg_ret.first) {
+                continue;
+            }
+
+            ret.first = ext.init(is_server);
+            if (!ret.first) {
+                append(ret.second, neg_ret.second);
+            }
+            return;
+        }
+    }
+
+    template <typename extension_type>
+    static void encode_one(extension_type & ext, frame::opcode::value op,
+        std::string & payload, uint8_t & bits, lib::error_code & ec)
+    {
+        if (ec || !ext.is_enabled()) {
+            return;
+        }
+
+        bool transformed = false;
+        ec = ext.encode(op, payload, transformed);
+        if (transformed) {
+            bits |= extension_type::rsv_bits;
+        }
+    }
+
+    // runs the extensions before index, last first
+    template <size_t index>
+    void decode_from(frame::opcode::value op, uint8_t bits,
+        std::string & payload, lib::error_code & ec)
+    {
+        if constexpr (index > 0) {
+            typedef typename std::tuple_element<index - 1,
+                std::tuple<extension_types...> >::type extension_type;
+
+            if (bits & extension_type::rsv_bits) {
+                ec = std::get<index - 1>(m_extensions).decode(op, payload);
+                if (ec) {
+                    return;
+                }
+            }
+            decode_from<index - 1>(op, bits, payload, ec);
+        }
+    }
+
+    std::tuple<extension_types...> m_extensions;
+};
+
+/// The extension chain of a config, empty unless it has an
+/// extension_chain_type
+/**
+ * @since 0.9.0
+ */
+template <typename config, typename = void>
+struct chain_policy {
+    typedef chain<> type;
+};
+
+template <typename config>
+struct chain_policy<config,
+    std::void_t<typename config::extension_chain_type> >
+{
+    typedef typename config::extension_chain_type type;
+};
+
+} // namespace extensions
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_EXTENSION_CHAIN_HPP
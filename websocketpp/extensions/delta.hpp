@@ -0,0 +1,564 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_EXTENSION_DELTA_HPP
+#define WEBSOCKETPP_EXTENSION_DELTA_HPP
+
+#include <websocketpp/common/cpp11.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+#include <websocketpp/frame.hpp>
+#include <websocketpp/http/constants.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+namespace websocketpp {
+namespace extensions {
+
+/// Delta encoding of repeated state messages, a non-standard extension
+/**
+ * Messages are sorted into streams by a key. Each side remembers the last
+ * payload of every stream it sent or received, and a message whose
+ * payload is close to the previous one of its stream goes out as a patch
+ * against it: copies of ranges of the previous payload and the bytes in
+ * between, found by matching 16 byte blocks the way xdelta does. A patch
+ * is only sent when it is smaller than the payload. Deflate with context
+ * takeover finds some of these repeats too, but only within its 32KiB
+ * window, and the two combine: compression applies to the patch.
+ *
+ * Use it as an extension of config::extension_chain_type, on both ends:
+ *
+ *     typedef websocketpp::extensions::chain<
+ *         websocketpp::extensions::delta::extension<> > extension_chain_type;
+ *
+ * The key of a message comes from the `key_policy` of the sending side and
+ * travels with it, so the receiving side needs none. The default keys text
+ * and binary messages apart, one stream each. Applications whose state
+ * messages name what they describe key on that instead:
+ *
+ * **key**\n
+ * `static std::string_view key(frame::opcode::value op,
+ * std::string const & payload)`\n
+ * The stream of a message, at most 255 bytes
+ *
+ * Both sides keep at most `max_streams` streams, negotiated as the smaller
+ * of the two, and forget the least recently used one past that. Payloads
+ * over max_base_size are sent whole and not remembered. As both sides apply
+ * the same updates in the same order, their streams stay equal.
+ *
+ * That order is the one messages are prepared in, which is the one they
+ * are sent in unless the connection reorders or drops queued messages, such
+ * as with priority lanes or the conflate and drop_oldest slow consumer
+ * policies. Patches carry a hash of the payload they apply to, so a receiver
+ * that lost track fails the message rather than deliver a wrong one.
+ */
+namespace delta {
+
+/// Delta extension error values
+namespace error {
+enum value {
+    /// Catch all
+    general = 1,
+
+    /// Invalid extension attributes
+    invalid_attributes,
+
+    /// Invalid extension attribute value
+    invalid_attribute_value,
+
+    /// A patch or its framing did not parse
+    malformed_message,
+
+    /// A patch does not apply to the payload held for its stream
+    base_mismatch
+};
+
+/// Delta extension error category
+class category : public lib::error_category {
+public:
+    category() {}
+
+    char const * name() const _WEBSOCKETPP_NOEXCEPT_TOKEN_ {
+        return "websocketpp.extension.delta";
+    }
+
+    std::string message(int value) const {
+        switch(value) {
+            case general:
+                return "Generic delta extension error";
+            case invalid_attributes:
+                return "Invalid extension attributes";
+            case invalid_attribute_value:
+                return "Invalid extension attribute value";
+            case malformed_message:
+                return "Malformed delta encoded message";
+            case base_mismatch:
+                return "Delta does not apply to the previous payload";
+            default:
+                return "Unknown delta extension error";
+        }
+    }
+};
+
+/// Get a reference to a static copy of the delta extension error category
+inline lib::error_category const & get_category() {
+    static category instance;
+    return instance;
+}
+
+/// Create an error code in the delta extension category
+inline lib::error_code make_error_code(error::value e) {
+    return lib::error_code(static_cast<int>(e), get_category());
+}
+
+} // namespace error
+} // namespace delta
+} // namespace extensions
+} // namespace websocketpp
+
+_WEBSOCKETPP_ERROR_CODE_ENUM_NS_START_
+template<> struct is_error_code_enum
+    <websocketpp::extensions::delta::error::value>
+{
+    static bool const value = true;
+};
+_WEBSOCKETPP_ERROR_CODE_ENUM_NS_END_
+namespace websocketpp {
+namespace extensions {
+namespace delta {
+
+/// Extension parameter limiting the number of streams
+static char const max_streams_parameter[] = "max_streams";
+
+/// Default number of streams kept by each side
+static size_t const default_max_streams = 16;
+
+/// Largest payload remembered as the base of the next patch
+static size_t const max_base_size = 1048576;
+
+/// Length of the blocks matched between payloads
+static size_t const block_size = 16;
+
+/// Keys text and binary messages apart, one stream each
+struct opcode_key {
+    static std::string_view key(frame::opcode::value op, std::string const &)
+    {
+        return op == frame::opcode::text ? "t" : "b";
+    }
+};
+
+/// FNV-1a of a payload, identifying the base of a patch
+inline uint32_t hash(std::string const & s) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < s.size(); ++i) {
+        h = (h ^ uint8_t(s[i])) * 16777619u;
+    }
+    return h;
+}
+
+inline void put_varint(std::string & out, uint64_t v) {
+    while (v >= 0x80) {
+        out += char(uint8_t(v) | 0x80);
+        v >>= 7;
+    }
+    out += char(v);
+}
+
+inline bool get_varint(std::string const & in, size_t & pos, uint64_t & v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && pos < in.size(); shift += 7) {
+        uint8_t b = uint8_t(in[pos++]);
+        v |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Append a patch turning base into target to out
+/**
+ * Instructions are a varint of `length << 1 | add`: a copy is followed by
+ * a varint offset into base, an add by its bytes.
+ *
+ * @param base The previous payload
+ * @param target The new payload
+ * @param limit Give up once the patch grows past this size
+ * @param out Receives the instructions
+ * @return Whether the patch stayed within limit
+ */
+inline bool make_patch(std::string const & base, std::string const & target,
+    size_t limit, std::string & out)
+{
+    if (base.size() < block_size || target.size() < block_size) {
+        return false;
+    }
+
+    // first offset of each aligned block of base
+    std::unordered_map<std::string_view, size_t> blocks;
+    blocks.reserve(base.size() / block_size);
+    for (size_t i = 0; i + block_size <= base.size(); i += block_size) {
+        blocks.emplace(std::string_view(base.data() + i, block_size), i);
+    }
+
+    size_t const start = out.size();
+    size_t pending = 0;
+    size_t i = 0;
+    while (i + block_size <= target.size()) {
+        std::unordered_map<std::string_view, size_t>::const_iterator it =
+            blocks.find(std::string_view(target.data() + i, block_size));
+        if (it == blocks.end()) {
+            ++i;
+            continue;
+        }
+
+        size_t off = it->second;
+        size_t len = block_size;
+        while (i > pending && off > 0 && target[i - 1] == base[off - 1]) {
+            --i;
+            --off;
+            ++len;
+        }
+        while (i + len < target.size() && off + len < base.size() &&
+            target[i + len] == base[off + len])
+        {
+            ++len;
+        }
+
+        if (i > pending) {
+            put_varint(out, uint64_t(i - pending) << 1 | 1);
+            out.append(target, pending, i - pending);
+        }
+        put_varint(out, uint64_t(len) << 1);
+        put_varint(out, off);
+        i += len;
+        pending = i;
+
+        if (out.size() - start >= limit) {
+            return false;
+        }
+    }
+
+    if (pending < target.size()) {
+        put_varint(out, uint64_t(target.size() - pending) << 1 | 1);
+        out.append(target, pending, std::string::npos);
+    }
+    return out.size() - start < limit;
+}
+
+/// Apply the instructions of make_patch from in[pos] on
+inline lib::error_code apply_patch(std::string const & base,
+    std::string const & in, size_t pos, uint64_t size, std::string & out)
+{
+    if (size > max_base_size * 64) {
+        return make_error_code(error::malformed_message);
+    }
+    out.clear();
+    out.reserve(size);
+
+    while (pos < in.size()) {
+        uint64_t op;
+        if (!get_varint(in, pos, op)) {
+            return make_error_code(error::malformed_message);
+        }
+        uint64_t len = op >> 1;
+        if (len > size - out.size()) {
+            return make_error_code(error::malformed_message);
+        }
+
+        if (op & 1) {
+            if (len > in.size() - pos) {
+                return make_error_code(error::malformed_message);
+            }
+            out.append(in, pos, len);
+            pos += len;
+        } else {
+            uint64_t off;
+            if (!get_varint(in, pos, off) || off > base.size() ||
+                len > base.size() - off)
+            {
+                return make_error_code(error::malformed_message);
+            }
+            out.append(base, off, len);
+        }
+    }
+
+    if (out.size() != size) {
+        return make_error_code(error::malformed_message);
+    }
+    return lib::error_code();
+}
+
+/// The last payloads of a bounded number of streams
+class stream_table {
+public:
+    stream_table() : m_max(default_max_streams), m_clock(0) {}
+
+    void set_max(size_t max) {
+        m_max = max;
+    }
+
+    /// Get the last payload of a stream, NULL if there is none
+    std::string const * find(std::string const & key, uint32_t & h) const {
+        map_type::const_iterator it = m_streams.find(key);
+        if (it == m_streams.end()) {
+            return NULL;
+        }
+        h = it->second.hash;
+        return &it->second.payload;
+    }
+
+    /// Record the new payload of a stream
+    void update(std::string const & key, std::string const & payload) {
+        if (payload.size() > max_base_size) {
+            m_streams.erase(key);
+            return;
+        }
+
+        stream & s = m_streams[key];
+        s.payload = payload;
+        s.hash = hash(payload);
+        s.used = ++m_clock;
+
+        if (m_streams.size() > m_max) {
+            map_type::iterator oldest = m_streams.begin();
+            for (map_type::iterator it = m_streams.begin();
+                it != m_streams.end(); ++it)
+            {
+                if (it->second.used < oldest->second.used) {
+                    oldest = it;
+                }
+            }
+            m_streams.erase(oldest);
+        }
+    }
+
+    size_t size() const {
+        return m_streams.size();
+    }
+private:
+    struct stream {
+        std::string payload;
+        uint32_t hash;
+        uint64_t used;
+    };
+    typedef std::unordered_map<std::string, stream> map_type;
+
+    map_type m_streams;
+    size_t m_max;
+    uint64_t m_clock;
+};
+
+/// Name of the extension in Sec-WebSocket-Extensions
+static char const extension_name[] = "x-websocketpp-delta";
+
+/// Kinds of encoded messages, the first byte of each
+namespace kind {
+static uint8_t const whole = 0;
+static uint8_t const patch = 1;
+} // namespace kind
+
+/// The delta extension, for use in an extension chain
+/**
+ * Encoded messages are marked with RSV2. They start with their kind and
+ * key, a byte of its length then the key. A whole message follows with the
+ * payload, a patch with the hash of the payload it applies to (4 bytes,
+ * little endian), the size of the result as a varint and the instructions
+ * of make_patch.
+ *
+ * @since 0.9.0
+ */
+template <typename key_policy = opcode_key>
+class extension {
+public:
+    typedef std::pair<lib::error_code,std::string> err_str_pair;
+
+    static constexpr uint8_t rsv_bits = frame::BHB0_RSV2;
+
+    extension()
+      : m_max_streams(default_max_streams)
+      , m_enabled(false) {}
+
+    static char const * name() {
+        return extension_name;
+    }
+
+    /// Set the most streams kept, before negotiation
+    void set_max_streams(size_t max) {
+        m_max_streams = max;
+    }
+
+    std::string generate_offer() const {
+        return std::string(extension_name) + "; " + max_streams_parameter +
+            "=" + std::to_string(m_max_streams);
+    }
+
+    /// Negotiate an offer or accept a response
+    /**
+     * Both sides settle on the smaller max_streams.
+     */
+    err_str_pair negotiate(http::attribute_list const & offer) {
+        err_str_pair ret;
+        size_t max = m_max_streams;
+
+        http::attribute_list::const_iterator it;
+        for (it = offer.begin(); it != offer.end(); ++it) {
+            if (it->first != max_streams_parameter) {
+                ret.first = make_error_code(error::invalid_attributes);
+                return ret;
+            }
+            std::string const & v = it->second;
+            if (v.empty() || v.size() > 6 ||
+                v.find_first_not_of("0123456789") != std::string::npos)
+            {
+                ret.first = make_error_code(error::invalid_attribute_value);
+                return ret;
+            }
+            max = (std::min)(max, size_t(std::stoul(v)));
+        }
+
+        m_max_streams = max;
+        m_sent.set_max(max);
+        m_received.set_max(max);
+        m_enabled = true;
+        ret.second = std::string(extension_name) + "; " +
+            max_streams_parameter + "=" + std::to_string(max);
+        return ret;
+    }
+
+    lib::error_code init(bool) {
+        return lib::error_code();
+    }
+
+    bool is_enabled() const {
+        return m_enabled;
+    }
+
+    /// Get the number of streams kept for outgoing messages
+    size_t get_stream_count() const {
+        return m_sent.size();
+    }
+
+    lib::error_code encode(frame::opcode::value op, std::string & payload,
+        bool & transformed)
+    {
+        std::string_view k = key_policy::key(op, payload);
+        if (k.size() > 255) {
+            transformed = false;
+            return lib::error_code();
+        }
+        std::string key(k);
+
+        std::string out;
+        out += char(kind::patch);
+        out += char(key.size());
+        out += key;
+
+        uint32_t h;
+        std::string const * base = m_sent.find(key, h);
+        bool patched = false;
+        if (base) {
+            for (int i = 0; i < 4; ++i) {
+                out += char(h >> (8 * i));
+            }
+            put_varint(out, payload.size());
+            patched = make_patch(*base, payload, payload.size(), out);
+        }
+
+        if (!patched) {
+            out.resize(2 + key.size());
+            out[0] = char(kind::whole);
+            out += payload;
+        }
+
+        m_sent.update(key, payload);
+        payload.swap(out);
+        transformed = true;
+        return lib::error_code();
+    }
+
+    lib::error_code decode(frame::opcode::value, std::string & payload) {
+        if (payload.size() < 2) {
+            return make_error_code(error::malformed_message);
+        }
+        uint8_t k = uint8_t(payload[0]);
+        size_t key_size = uint8_t(payload[1]);
+        if (k > kind::patch || payload.size() < 2 + key_size) {
+            return make_error_code(error::malformed_message);
+        }
+        std::string key(payload, 2, key_size);
+        size_t pos = 2 + key_size;
+
+        std::string out;
+        if (k == kind::whole) {
+            out.assign(payload, pos, std::string::npos);
+        } else {
+            uint32_t h;
+            std::string const * base = m_received.find(key, h);
+            if (payload.size() < pos + 4) {
+                return make_error_code(error::malformed_message);
+            }
+            uint32_t expected = 0;
+            for (int i = 0; i < 4; ++i) {
+                expected |= uint32_t(uint8_t(payload[pos + i])) << (8 * i);
+            }
+            pos += 4;
+            if (!base || h != expected) {
+                return make_error_code(error::base_mismatch);
+            }
+
+            uint64_t size;
+            if (!get_varint(payload, pos, size)) {
+                return make_error_code(error::malformed_message);
+            }
+            lib::error_code ec = apply_patch(*base, payload, pos, size, out);
+            if (ec) {
+                return ec;
+            }
+        }
+
+        m_received.update(key, out);
+        payload.swap(out);
+        return lib::error_code();
+    }
+private:
+    size_t m_max_streams;
+    bool m_enabled;
+    stream_table m_sent;
+    stream_table m_received;
+};
+
+} // namespace delta
+} // namespace extensions
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_EXTENSION_DELTA_HPP
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_EXTENSION_PERMESSAGE_DEFLATE_COMPRESSION_POLICY_HPP
+#define WEBSOCKETPP_EXTENSION_PERMESSAGE_DEFLATE_COMPRESSION_POLICY_HPP
+
+#include <websocketpp/frame.hpp>
+
+#include <cstddef>
+
+namespace websocketpp {
+namespace extensions {
+namespace permessage_deflate {
+
+/// Decides which outgoing messages are worth compressing
+/**
+ * A connection with a compression policy sets message::set_compressed on
+ * each data message it prepares, instead of using the flag the message was
+ * sent with. Three rules apply, in order:
+ *
+ * - Opcode: text and binary messages can each be excluded.
+ * - Minimum size: messages smaller than this are sent uncompressed, as the
+ *   deflate overhead rarely pays off for them.
+ * - Observed ratio: every compressed message is a sample of how well that
+ *   opcode compresses. When the running average of compressed size over
+ *   original size rises above the threshold, the next messages of that
+ *   opcode are sent uncompressed and only one in every `backoff` is
+ *   compressed as a new sample. Normal compression resumes once the
+ *   average drops back under the threshold.
+ *
+ * Policies are copied into each connection, so each has its own samples.
+ * The defaults compress every data message.
+ *
+ * @since 0.9.0
+ */
+class compression_policy {
+public:
+    compression_policy()
+      : m_min_size(0)
+      , m_max_ratio(1.0)
+      , m_backoff(0)
+    {}
+
+    /// Set whether messages with an opcode may be compressed
+    /**
+     * @param op frame::opcode::text or frame::opcode::binary
+     * @param value Whether or not to compress messages with this opcode
+     */
+    void set_opcode(frame::opcode::value op, bool value) {
+        if (op == frame::opcode::text || op == frame::opcode::binary) {
+            m_state[index(op)].allowed = value;
+        }
+    }
+
+    /// Set the minimum payload size to compress
+    /**
+     * @param value The size in bytes, the default of 0 compresses everything
+     */
+    void set_min_size(size_t value) {
+        m_min_size = value;
+    }
+
+    /// Back off compressing when the observed ratio stays poor
+    /**
+     * @param max_ratio Average compressed size as a fraction of the original
+     * above which compression is backed off, for example 0.9
+     * @param backoff While backed off, compress one message in this many. 0
+     * disables backing off.
+     */
+    void set_ratio_threshold(double max_ratio, size_t backoff) {
+        m_max_ratio = max_ratio;
+        m_backoff = backoff;
+    }
+
+    /// Decide whether to compress a message
+    /**
+     * @param op The opcode of the message
+     * @param size The payload size of the message
+     * @return Whether or not the message should be compressed
+     */
+    bool should_compress(frame::opcode::value op, size_t size) {
+        if (op != frame::opcode::text && op != frame::opcode::binary) {
+            return false;
+        }
+
+        state & s = m_state[index(op)];
+        if (!s.allowed || size < m_min_size) {
+            return false;
+        }
+
+        if (m_backoff == 0 || s.samples == 0 || s.ratio <= m_max_ratio) {
+            return true;
+        }
+
+        if (++s.skipped < m_backoff) {
+            return false;
+        }
+        s.skipped = 0;
+        return true;
+    }
+
+    /// Record the result of compressing a message
+    /**
+     * @param op The opcode of the message
+     * @param in The payload size before compression
+     * @param out The payload size after compression
+     */
+    void record(frame::opcode::value op, size_t in, size_t out) {
+        if ((op != frame::opcode::text && op != frame::opcode::binary) ||
+            in == 0)
+        {
+            return;
+        }
+
+        state & s = m_state[index(op)];
+        double ratio = double(out) / double(in);
+
+        if (s.samples == 0) {
+            s.ratio = ratio;
+        } else {
+            s.ratio += (ratio - s.ratio) / 8;
+        }
+        ++s.samples;
+    }
+
+    /// Get the running average ratio observed for an opcode
+    /**
+     * @param op frame::opcode::text or frame::opcode::binary
+     * @return The average compressed size as a fraction of the original, or
+     * 0 if nothing has been compressed yet
+     */
+    double get_ratio(frame::opcode::value op) const {
+        if (op != frame::opcode::text && op != frame::opcode::binary) {
+            return 0;
+        }
+        return m_state[index(op)].ratio;
+    }
+private:
+    struct state {
+        state() : allowed(true), ratio(0), samples(0), skipped(0) {}
+
+        bool allowed;
+        double ratio;
+        size_t samples;
+        size_t skipped;
+    };
+
+    static size_t index(frame::opcode::value op) {
+        return op == frame::opcode::text ? 0 : 1;
+    }
+
+    size_t m_min_size;
+    double m_max_ratio;
+    size_t m_backoff;
+    state m_state[2];
+};
+
+} // namespace permessage_deflate
+} // namespace extensions
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_EXTENSION_PERMESSAGE_DEFLATE_COMPRESSION_POLICY_HPP
@@ -29,11 +29,14 @@
 #define WEBSOCKETPP_EXTENSION_PERMESSAGE_DEFLATE_DISABLED_HPP
 
 #include <websocketpp/common/cpp11.hpp>
+#include <websocketpp/common/memory.hpp>
 #include <websocketpp/common/stdint.hpp>
 #include <websocketpp/common/system_error.hpp>
 
 #include <websocketpp/http/constants.hpp>
 #include <websocketpp/extensions/extension.hpp>
+#include <websocketpp/extensions/permessage_deflate/memory_budget.hpp>
+#include <websocketpp/extensions/permessage_deflate/tuning.hpp>
 
 #include <map>
 #include <string>
@@ -110,6 +113,165 @@ public:
         return make_error_code(error::disabled);
     }
 
+    /// Compress one chunk of a message sent in pieces
+    /**
+     * @since 0.9.0
+     *
+     * @return Always a disabled error
+     */
+    lib::error_code compress_chunk(std::string const &, bool, bool,
+        std::string &)
+    {
+        return make_error_code(error::disabled);
+    }
+
+    /// Set the deflate memory level
+    /**
+     * @since 0.9.0
+     *
+     * @return Always a disabled error
+     */
+    lib::error_code set_mem_level(int) {
+        return make_error_code(error::disabled);
+    }
+
+    /// Charge compression contexts against a shared memory budget
+    /**
+     * The disabled extension holds no contexts, so this is a no-op.
+     *
+     * @since 0.9.0
+     */
+    void set_memory_budget(lib::shared_ptr<memory_budget>) {}
+
+    /// Get the memory held by the compression contexts
+    /**
+     * @since 0.9.0
+     *
+     * @return Always 0
+     */
+    size_t get_memory_usage() const {
+        return 0;
+    }
+
+    /// Check a compression level and strategy
+    /**
+     * @since 0.9.0
+     *
+     * @return Always a disabled error
+     */
+    static lib::error_code validate_compression_params(int, strategy::value)
+    {
+        return make_error_code(error::disabled);
+    }
+
+    /// Set the compression level and strategy
+    /**
+     * @since 0.9.0
+     *
+     * @return Always a disabled error
+     */
+    lib::error_code set_compression_params(int, strategy::value) {
+        return make_error_code(error::disabled);
+    }
+
+    /// Count compression work in a shared set of counters
+    /**
+     * The disabled extension does no compression work, so this is a no-op.
+     *
+     * @since 0.9.0
+     */
+    void set_stats(lib::shared_ptr<compression_stats>) {}
+
+    /// Make sure the compressor exists
+    /**
+     * @since 0.9.0
+     *
+     * @return Always a disabled error
+     */
+    lib::error_code reserve_compressor() {
+        return make_error_code(error::disabled);
+    }
+
+    /// Release contexts that have not been used recently
+    /**
+     * The disabled extension holds no contexts, so this is a no-op.
+     *
+     * @since 0.9.0
+     */
+    void release_idle(bool, bool) {}
+
+    /// Release contexts now
+    /**
+     * The disabled extension holds no contexts, so this is a no-op.
+     *
+     * @since 0.9.0
+     */
+    void release_contexts(bool, bool) {}
+
+    /// Use a preset dictionary known to both endpoints
+    /**
+     * @since 0.9.0
+     *
+     * @return Always a disabled error
+     */
+    lib::error_code set_dictionary(std::string const &,
+        lib::shared_ptr<std::string const>)
+    {
+        return make_error_code(error::disabled);
+    }
+
+    /// Prepare to decompress a new incoming message
+    /**
+     * @since 0.9.0
+     *
+     * @return Always a disabled error
+     */
+    lib::error_code begin_message() {
+        return make_error_code(error::disabled);
+    }
+
+    /// Window bits of outgoing compression that may be shared
+    /**
+     * @since 0.9.0
+     *
+     * @return Always 0, there is no compressed output to share
+     */
+    uint8_t get_shared_window_bits() const {
+        return 0;
+    }
+
+    /// Compress bytes for any connection without context takeover
+    /**
+     * @since 0.9.0
+     *
+     * @return Error or status code
+     */
+    static lib::error_code compress_shared(uint8_t, std::string const &,
+        std::string &)
+    {
+        return make_error_code(error::disabled);
+    }
+
+    /// Whether a message may be compressed in independent parts
+    /**
+     * @since 0.9.0
+     *
+     * @return Always false
+     */
+    bool can_compress_parts() const {
+        return false;
+    }
+
+    /// Compress one part of a message with a fresh context
+    /**
+     * @since 0.9.0
+     *
+     * @return Always a disabled error
+     */
+    lib::error_code compress_part(std::string const &, std::string &) const {
+        return make_error_code(error::disabled);
+    }
+
     /// Decompress bytes
     /**
      * @param buf Byte buffer to decompress
@@ -120,6 +282,17 @@ public:
     lib::error_code decompress(uint8_t const *, size_t, std::string &) {
         return make_error_code(error::disabled);
     }
+
+    /// Decompress bytes a piece at a time
+    /**
+     * @since 0.9.0
+     *
+     * @return Error or status code
+     */
+    template <typename handler_type>
+    lib::error_code decompress_chunks(uint8_t const *, size_t, handler_type) {
+        return make_error_code(error::disabled);
+    }
 };
 
 } // namespace permessage_deflate
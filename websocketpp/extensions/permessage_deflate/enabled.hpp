@@ -29,6 +29,7 @@
 #define WEBSOCKETPP_PROCESSOR_EXTENSION_PERMESSAGEDEFLATE_HPP
 
 
+#include <websocketpp/common/chrono.hpp>
 #include <websocketpp/common/cpp11.hpp>
 #include <websocketpp/common/memory.hpp>
 #include <websocketpp/common/platforms.hpp>
@@ -37,6 +38,10 @@
 #include <websocketpp/error.hpp>
 
 #include <websocketpp/extensions/extension.hpp>
+#include <websocketpp/extensions/permessage_deflate/memory_budget.hpp>
+#include <websocketpp/extensions/permessage_deflate/tuning.hpp>
+
+#include <websocketpp/http/constants.hpp>
 
 #include "zlib.h"
 
@@ -84,6 +89,50 @@ namespace extensions {
  * `lib::error_code decompress(uint8_t const * buf, size_t len, std::string &
  * out)`\n
  * Decompress `len` bytes from `buf` and append them to string `out`
+ *
+ * **decompress_chunks**\n
+ * `lib::error_code decompress_chunks(uint8_t const * buf, size_t len,
+ * handler_type handler)`\n
+ * Decompress `len` bytes from `buf`, passing the output to `handler` in
+ * pieces as it is produced
+ *
+ * **compress_chunk**\n
+ * `lib::error_code compress_chunk(std::string const & in, bool first, bool
+ * last, std::string & out)`\n
+ * Compress one chunk of a message sent in pieces and append it to `out`
+ *
+ * **set_mem_level**\n
+ * `lib::error_code set_mem_level(int level)`\n
+ * Set the memory level of the compressor
+ *
+ * **set_memory_budget**\n
+ * `void set_memory_budget(lib::shared_ptr<memory_budget> budget)`\n
+ * Charge compression contexts against a budget shared between connections
+ *
+ * **get_memory_usage**\n
+ * `size_t get_memory_usage() const`\n
+ * Estimate the bytes held by the compression contexts
+ *
+ * **reserve_compressor**\n
+ * `lib::error_code reserve_compressor()`\n
+ * Create the compressor if needed, fails if it would exceed the budget
+ *
+ * **release_idle**\n
+ * `void release_idle(bool outgoing, bool incoming)`\n
+ * Release contexts unused since the previous call, where history allows
+ *
+ * **release_contexts**\n
+ * `void release_contexts(bool outgoing, bool incoming)`\n
+ * Release contexts now, where history allows
+ *
+ * **set_dictionary**\n
+ * `lib::error_code set_dictionary(std::string const & id,
+ * lib::shared_ptr<std::string const> dictionary)`\n
+ * Offer or accept a preset dictionary known to both endpoints
+ *
+ * **begin_message**\n
+ * `lib::error_code begin_message()`\n
+ * Called before the first frame of each compressed incoming message
  */
 namespace permessage_deflate {
 
@@ -113,6 +162,18 @@ enum value {
 
     /// Uninitialized
     uninitialized,
+
+    /// Invalid value for the deflate memory level
+    invalid_mem_level,
+
+    /// Compression memory limit reached
+    memory_limit,
+
+    /// Invalid preset dictionary or dictionary id
+    invalid_dictionary,
+
+    /// Invalid compression level or strategy
+    invalid_compression_params
 };
 
 /// Permessage-deflate error category
@@ -142,6 +203,14 @@ public:
                 return "A zlib function returned an error";
             case uninitialized:
                 return "Deflate extension must be initialized before use";
+            case invalid_mem_level:
+                return "Invalid value for the deflate memory level";
+            case memory_limit:
+                return "Compression memory limit reached";
+            case invalid_dictionary:
+                return "Invalid preset dictionary or dictionary id";
+            case invalid_compression_params:
+                return "Invalid compression level or strategy";
             default:
                 return "Unknown permessage-compress error";
         }
@@ -201,6 +270,21 @@ static uint8_t const min_client_max_window_bits = 8;
 /// Maximum value for client_max_window_bits as defined by RFC 7692
 static uint8_t const max_client_max_window_bits = 15;
 
+/// Default deflate memory level
+static int const default_mem_level = 4;
+/// Minimum deflate memory level
+static int const min_mem_level = 1;
+/// Maximum deflate memory level
+static int const max_mem_level = 9;
+
+/// Private extension parameter naming a preset dictionary
+/**
+ * Not part of RFC 7692. Both endpoints must be configured with the same
+ * dictionary under the same id for it to be used, see
+ * enabled::set_dictionary.
+ */
+static char const dictionary_parameter[] = "x_dictionary";
+
 namespace mode {
 enum value {
     /// Accept any value the remote endpoint offers
@@ -214,9 +298,259 @@ enum value {
 };
 } // namespace mode
 
-template <typename config>
+/// Default compression backend, built on zlib
+/**
+ * enabled delegates all deflate work to a backend policy supplied as its
+ * second template parameter. This keeps negotiation independent of the
+ * library doing the compression, so zlib can be replaced by zlib-ng, a one
+ * shot compressor such as libdeflate, or a hardware offload engine without
+ * any change on the wire. zlib-ng in zlib compatible mode needs no backend of
+ * its own; linking it in place of zlib is enough.
+ *
+ * A backend provides two nested types:
+ *
+ * **compressor**\n
+ * `lib::error_code init(uint8_t window_bits, int mem_level)`\n
+ * Prepare a raw deflate stream with the given window bits and memory level.\n
+ * `lib::error_code compress(std::string const & in, bool reset,
+ * std::string & out)`\n
+ * Append the compressed form of `in` to `out`, ending on a byte boundary
+ * with an empty stored block (0x00 0x00 0xff 0xff). When `reset` is true no
+ * later output may refer back to `in` or anything before it, which also
+ * makes whole message one shot compression a valid implementation.\n
+ * `lib::error_code set_params(int level, strategy::value strategy)`\n
+ * Set the compression level, -1 to 9, and strategy. May be called before
+ * init, and between messages to change them for the rest of the stream.
+ * Backends without a matching setting may ignore either one.
+ *
+ * **decompressor**\n
+ * `lib::error_code init(uint8_t window_bits)`\n
+ * Prepare a raw inflate stream with the given window bits.\n
+ * `lib::error_code decompress(uint8_t const *& in, size_t & in_len,
+ * unsigned char *& out, size_t & out_len)`\n
+ * Inflate as much of `in` into `out` as fits, advancing both pointers and
+ * reducing both lengths by the bytes consumed and produced.
+ *
+ * Both types also provide\n
+ * `lib::error_code set_dictionary(uint8_t const * data, size_t len)`\n
+ * For the compressor this restarts the stream with `data` as its history.
+ * For the decompressor it adds `data` to the history, and is called at the
+ * start of a message. Backends that can not use a preset dictionary return
+ * an error, which makes the connection fall back to not using one.
+ *
+ * Both types are default constructible, release their resources when
+ * destroyed and are only used once init has succeeded.
+ *
+ * The backend itself provides estimates of the memory each type holds, which
+ * are charged against a memory_budget:
+ *
+ * `static size_t compressor_memory(uint8_t window_bits, int mem_level)`\n
+ * `static size_t decompressor_memory(uint8_t window_bits)`
+ *
+ * @since 0.9.0
+ */
+class zlib_backend {
+public:
+    /// Memory used by a deflate stream, from zlib's zconf.h
+    static size_t compressor_memory(uint8_t window_bits, int mem_level) {
+        return (size_t(1) << (window_bits + 2)) +
+            (size_t(1) << (mem_level + 9)) + 6 * 1024;
+    }
+
+    /// Memory used by an inflate stream, from zlib's zconf.h
+    static size_t decompressor_memory(uint8_t window_bits) {
+        return (size_t(1) << window_bits) + 7 * 1024;
+    }
+
+    /// Outgoing deflate stream
+    class compressor {
+    public:
+        compressor()
+          : m_initialized(false)
+          , m_params_changed(false)
+          , m_level(Z_DEFAULT_COMPRESSION)
+          , m_strategy(Z_DEFAULT_STRATEGY)
+        {
+            m_dstate.zalloc = Z_NULL;
+            m_dstate.zfree = Z_NULL;
+            m_dstate.opaque = Z_NULL;
+        }
+
+        ~compressor() {
+            if (m_initialized) {
+                deflateEnd(&m_dstate);
+            }
+        }
+
+        lib::error_code init(uint8_t window_bits, int mem_level) {
+            int ret = deflateInit2(
+                &m_dstate,
+                m_level,
+                Z_DEFLATED,
+                -1*window_bits,
+                mem_level,
+                m_strategy
+            );
+
+            if (ret != Z_OK) {
+                return make_error_code(error::zlib_error);
+            }
+
+            m_initialized = true;
+            m_params_changed = false;
+            return lib::error_code();
+        }
+
+        /// Change the compression level and strategy
+        /**
+         * Takes effect from the next call to compress. The flush that ends
+         * every message means deflateParams normally has no pending output
+         * to emit, any that it does is written ahead of the next message.
+         */
+        lib::error_code set_params(int level, strategy::value s) {
+            static int const strategies[] = {
+                Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE, Z_FIXED
+            };
+            m_level = level;
+            m_strategy = strategies[s];
+            m_params_changed = m_initialized;
+            return lib::error_code();
+        }
+
+        /// Deflate `in` straight into the end of `out`
+        /**
+         * `out` is grown by deflateBound up front, which normally lets the
+         * whole input go in a single pass, and trimmed afterwards.
+         */
+        lib::error_code compress(std::string const & in, bool reset,
+            std::string & out)
+        {
+            int flush = reset ? Z_FULL_FLUSH : Z_SYNC_FLUSH;
+
+            size_t offset = out.size();
+            out.resize(offset + deflateBound(&m_dstate, in.size()) + 6);
+
+            if (m_params_changed) {
+                m_dstate.avail_in = 0;
+                m_dstate.avail_out = out.size() - offset;
+                m_dstate.next_out =
+                    reinterpret_cast<unsigned char *>(&out[offset]);
+
+                int ret = deflateParams(&m_dstate, m_level, m_strategy);
+                if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                    return make_error_code(error::zlib_error);
+                }
+
+                offset = out.size() - m_dstate.avail_out;
+                m_params_changed = (ret != Z_OK);
+            }
+
+            m_dstate.avail_in = in.size();
+            m_dstate.next_in = (unsigned char *)(const_cast<char *>(in.data()));
+
+            do {
+                if (offset == out.size()) {
+                    out.resize(out.size() * 2);
+                }
+
+                m_dstate.avail_out = out.size() - offset;
+                m_dstate.next_out =
+                    reinterpret_cast<unsigned char *>(&out[offset]);
+
+                deflate(&m_dstate, flush);
+
+                offset = out.size() - m_dstate.avail_out;
+            } while (m_dstate.avail_out == 0);
+
+            out.resize(offset);
+
+            return lib::error_code();
+        }
+
+        lib::error_code set_dictionary(uint8_t const * data, size_t len) {
+            if (deflateReset(&m_dstate) != Z_OK ||
+                deflateSetDictionary(&m_dstate, data, len) != Z_OK)
+            {
+                return make_error_code(error::zlib_error);
+            }
+            return lib::error_code();
+        }
+    private:
+        bool m_initialized;
+        bool m_params_changed;
+        int m_level;
+        int m_strategy;
+        z_stream m_dstate;
+    };
+
+    /// Incoming inflate stream
+    class decompressor {
+    public:
+        decompressor() : m_initialized(false) {
+            m_istate.zalloc = Z_NULL;
+            m_istate.zfree = Z_NULL;
+            m_istate.opaque = Z_NULL;
+            m_istate.avail_in = 0;
+            m_istate.next_in = Z_NULL;
+        }
+
+        ~decompressor() {
+            if (m_initialized) {
+                inflateEnd(&m_istate);
+            }
+        }
+
+        lib::error_code init(uint8_t window_bits) {
+            int ret = inflateInit2(&m_istate, -1*window_bits);
+
+            if (ret != Z_OK) {
+                return make_error_code(error::zlib_error);
+            }
+
+            m_initialized = true;
+            return lib::error_code();
+        }
+
+        lib::error_code decompress(uint8_t const *& in, size_t & in_len,
+            unsigned char *& out, size_t & out_len)
+        {
+            m_istate.avail_in = in_len;
+            m_istate.next_in = const_cast<unsigned char *>(in);
+            m_istate.avail_out = out_len;
+            m_istate.next_out = out;
+
+            int ret = inflate(&m_istate, Z_SYNC_FLUSH);
+
+            in = m_istate.next_in;
+            in_len = m_istate.avail_in;
+            out = m_istate.next_out;
+            out_len = m_istate.avail_out;
+
+            if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR) {
+                return make_error_code(error::zlib_error);
+            }
+            return lib::error_code();
+        }
+
+        lib::error_code set_dictionary(uint8_t const * data, size_t len) {
+            // raw inflate streams accept a dictionary at any point
+            if (inflateSetDictionary(&m_istate, data, len) != Z_OK) {
+                return make_error_code(error::zlib_error);
+            }
+            return lib::error_code();
+        }
+    private:
+        bool m_initialized;
+        z_stream m_istate;
+    };
+};
+
+template <typename config, typename backend = zlib_backend>
 class enabled {
 public:
+    /// Type of the compression backend policy
+    typedef backend backend_type;
+
     enabled()
       : m_enabled(false)
       , m_server_no_context_takeover(false)
@@ -226,46 +560,34 @@ public:
       , m_server_max_window_bits_mode(mode::accept)
       , m_client_max_window_bits_mode(mode::accept)
       , m_initialized(false)
+      , m_reset_context(false)
+      , m_peer_resets_context(false)
+      , m_used(false)
+      , m_dictionary_active(false)
+      , m_inflate_primed(false)
+      , m_deflate_bits(15)
+      , m_inflate_bits(15)
+      , m_mem_level(default_mem_level)
+      , m_level(default_compression_level)
+      , m_strategy(strategy::default_strategy)
       , m_compress_buffer_size(8192)
-    {
-        m_dstate.zalloc = Z_NULL;
-        m_dstate.zfree = Z_NULL;
-        m_dstate.opaque = Z_NULL;
-
-        m_istate.zalloc = Z_NULL;
-        m_istate.zfree = Z_NULL;
-        m_istate.opaque = Z_NULL;
-        m_istate.avail_in = 0;
-        m_istate.next_in = Z_NULL;
-    }
+      , m_compressor_memory(0)
+      , m_decompressor_memory(0)
+    {}
 
     ~enabled() {
-        if (!m_initialized) {
-            return;
-        }
-
-        int ret = deflateEnd(&m_dstate);
-
-        if (ret != Z_OK) {
-            //std::cout << "error cleaning up zlib compression state"
-            //          << std::endl;
-        }
-
-        ret = inflateEnd(&m_istate);
-
-        if (ret != Z_OK) {
-            //std::cout << "error cleaning up zlib decompression state"
-            //          << std::endl;
-        }
+        release_compressor();
+        release_decompressor();
     }
 
-    /// Initialize zlib state
+    /// Initialize compression state
     /**
      * Note: this should be called *after* the negotiation methods. It will use
-     * information from the negotiation to determine how to initialize the zlib
-     * data structures.
+     * information from the negotiation to determine how to configure the
+     * backend's compressor and decompressor. Neither is created until it is
+     * first needed.
      *
-     * @todo memory level, strategy, etc are hardcoded
+     * @todo strategy, etc are hardcoded
      *
      * @param is_server True to initialize as a server, false for a client.
      * @return A code representing the error that occurred, if any
@@ -282,37 +604,12 @@ public:
             inflate_bits = m_server_max_window_bits;
         }
 
-        int ret = deflateInit2(
-            &m_dstate,
-            Z_DEFAULT_COMPRESSION,
-            Z_DEFLATED,
-            -1*deflate_bits,
-            4, // memory level 1-9
-            Z_DEFAULT_STRATEGY
-        );
-
-        if (ret != Z_OK) {
-            return make_error_code(error::zlib_error);
-        }
-
-        ret = inflateInit2(
-            &m_istate,
-            -1*inflate_bits
-        );
-
-        if (ret != Z_OK) {
-            return make_error_code(error::zlib_error);
-        }
-
-        m_compress_buffer.reset(new unsigned char[m_compress_buffer_size]);
-        m_decompress_buffer.reset(new unsigned char[m_compress_buffer_size]);
-        if ((m_server_no_context_takeover && is_server) ||
-            (m_client_no_context_takeover && !is_server))
-        {
-            m_flush = Z_FULL_FLUSH;
-        } else {
-            m_flush = Z_SYNC_FLUSH;
-        }
+        m_reset_context = (m_server_no_context_takeover && is_server) ||
+            (m_client_no_context_takeover && !is_server);
+        m_peer_resets_context = (m_client_no_context_takeover && is_server) ||
+            (m_server_no_context_takeover && !is_server);
+        m_deflate_bits = deflate_bits;
+        m_inflate_bits = inflate_bits;
         m_initialized = true;
         return lib::error_code();
     }
@@ -473,6 +770,300 @@ public:
         return lib::error_code();
     }
 
+    /// Set the deflate memory level
+    /**
+     * The memory level trades compressor memory for speed and ratio. Each
+     * step up doubles the size of the compressor's hash tables. The
+     * permitted range is 1 to 9 inclusive, the default is 4. This only
+     * affects the local compressor and is not negotiated.
+     *
+     * @since 0.9.0
+     *
+     * @param level The memory level to use for outgoing compression
+     * @return A status code
+     */
+    lib::error_code set_mem_level(int level) {
+        if (level < min_mem_level || level > max_mem_level) {
+            return make_error_code(error::invalid_mem_level);
+        }
+        m_mem_level = level;
+        return lib::error_code();
+    }
+
+    /// Check a compression level and strategy
+    /**
+     * @since 0.9.0
+     *
+     * @param level The compression level, -1 for the default or 0 to 9
+     * @param s The compression strategy
+     * @return A status code, error::invalid_compression_params if either is
+     * out of range
+     */
+    static lib::error_code validate_compression_params(int level,
+        strategy::value s)
+    {
+        if ((level < min_compression_level &&
+             level != default_compression_level) ||
+            level > max_compression_level ||
+            s < strategy::default_strategy || s > strategy::fixed)
+        {
+            return make_error_code(error::invalid_compression_params);
+        }
+        return lib::error_code();
+    }
+
+    /// Set the compression level and strategy
+    /**
+     * Unlike the negotiated settings these only affect the local compressor
+     * and may be changed at any point, including between messages of an
+     * open connection. The new values apply from the next message. Lower
+     * levels and the huffman_only or rle strategies spend less CPU time per
+     * byte at the cost of ratio.
+     *
+     * @since 0.9.0
+     *
+     * @param level The compression level, -1 for the default or 0 to 9
+     * @param s The compression strategy
+     * @return A status code
+     */
+    lib::error_code set_compression_params(int level, strategy::value s) {
+        lib::error_code ec = validate_compression_params(level, s);
+        if (ec) {
+            return ec;
+        }
+        m_level = level;
+        m_strategy = s;
+        if (m_compressor) {
+            return m_compressor->set_params(m_level, m_strategy);
+        }
+        return lib::error_code();
+    }
+
+    /// Get the compression level
+    /**
+     * @since 0.9.0
+     */
+    int get_compression_level() const {
+        return m_level;
+    }
+
+    /// Get the compression strategy
+    /**
+     * @since 0.9.0
+     */
+    strategy::value get_compression_strategy() const {
+        return m_strategy;
+    }
+
+    /// Count compression work in a shared set of counters
+    /**
+     * Every compress and decompress call adds its byte counts and the time it
+     * took to `stats`. Nothing is measured while no counters are set.
+     *
+     * @since 0.9.0
+     *
+     * @param stats The counters to add to, or null to stop counting
+     */
+    void set_stats(lib::shared_ptr<compression_stats> stats) {
+        m_stats = stats;
+    }
+
+    /// Charge compression contexts against a shared memory budget
+    /**
+     * While the compressor would not fit under the budget's limit, compress
+     * fails with error::memory_limit and reserve_compressor reports the same
+     * so that messages can be sent uncompressed instead.
+     *
+     * @since 0.9.0
+     *
+     * @param budget The budget to use, or null for no limit
+     */
+    void set_memory_budget(lib::shared_ptr<memory_budget> budget) {
+        m_budget = budget;
+    }
+
+    /// Get the memory held by the compression contexts
+    /**
+     * Uses the same estimates as set_memory_budget, including the buffer of
+     * decompress_chunks.
+     *
+     * @since 0.9.0
+     *
+     * @return The estimated number of bytes
+     */
+    size_t get_memory_usage() const {
+        return m_compressor_memory + m_decompressor_memory;
+    }
+
+    /// Make sure the compressor exists
+    /**
+     * Creates the compressor on first use, if it fits in the memory budget.
+     *
+     * @since 0.9.0
+     *
+     * @return A status code, error::memory_limit if the compressor does not
+     * fit in the memory budget
+     */
+    lib::error_code reserve_compressor() {
+        if (!m_initialized) {
+            return make_error_code(error::uninitialized);
+        }
+        if (m_compressor) {
+            return lib::error_code();
+        }
+
+        size_t size = backend::compressor_memory(m_deflate_bits, m_mem_level);
+        if (m_budget && !m_budget->try_acquire(size)) {
+            return make_error_code(error::memory_limit);
+        }
+
+        lib::shared_ptr<typename backend::compressor> c =
+            lib::make_shared<typename backend::compressor>();
+        lib::error_code ec = c->set_params(m_level, m_strategy);
+        if (!ec) {
+            ec = c->init(m_deflate_bits, m_mem_level);
+        }
+        if (!ec && m_dictionary_active && !m_reset_context) {
+            ec = c->set_dictionary(dictionary_data(), m_dictionary->size());
+        }
+        if (ec) {
+            if (m_budget) {
+                m_budget->release(size);
+            }
+            return ec;
+        }
+
+        m_compressor = c;
+        m_compressor_memory = size;
+        return lib::error_code();
+    }
+
+    /// Release contexts that have not been used recently
+    /**
+     * Contexts are only released when no history has to be kept: the
+     * compressor if it resets after every message, the decompressor if the
+     * remote endpoint does. A context used since the previous call is kept,
+     * so calling this once per idle period releases contexts that were idle
+     * for a whole period. They are created again when next needed.
+     *
+     * @since 0.9.0
+     *
+     * @param outgoing Whether the compressor may be released
+     * @param incoming Whether the decompressor may be released. Must be false
+     * while a compressed message is partly read.
+     */
+    void release_idle(bool outgoing, bool incoming) {
+        if (m_used) {
+            m_used = false;
+            return;
+        }
+
+        release_contexts(outgoing, incoming);
+    }
+
+    /// Release the contexts now, where history allows
+    /**
+     * Like release_idle, but regardless of when the contexts were last used.
+     *
+     * @since 0.9.0
+     *
+     * @param outgoing Whether the compressor may be released
+     * @param incoming Whether the decompressor may be released. Must be false
+     * while a compressed message is partly read.
+     */
+    void release_contexts(bool outgoing, bool incoming) {
+        if (outgoing && m_reset_context) {
+            release_compressor();
+        }
+        if (incoming && m_peer_resets_context) {
+            release_decompressor();
+        }
+    }
+
+    /// Whether a compressor or decompressor is currently held
+    /**
+     * @since 0.9.0
+     */
+    bool has_contexts() const {
+        return m_compressor || m_decompressor;
+    }
+
+    /// Use a preset dictionary known to both endpoints
+    /**
+     * Offers (as a client) or accepts (as a server) a private extension
+     * parameter, `x_dictionary=<id>`. When both endpoints name the same id,
+     * both compression contexts start out primed with `dictionary`, and
+     * contexts that reset after every message are primed again each time.
+     * Small messages that repeat the same strings, such as JSON keys,
+     * compress much better this way, most of all with no_context_takeover.
+     *
+     * Only the id is exchanged, the dictionary itself must already be known
+     * to both endpoints. A remote endpoint that does not know the parameter
+     * or names a different id is negotiated with as if no dictionary were
+     * set. Only the last window size bytes of the dictionary are used.
+     *
+     * @since 0.9.0
+     *
+     * @param id Name of the dictionary, an HTTP token
+     * @param dictionary The dictionary contents, shared between connections
+     * @return A status code, error::invalid_dictionary if the id is not a
+     * token or the dictionary is empty
+     */
+    lib::error_code set_dictionary(std::string const & id,
+        lib::shared_ptr<std::string const> dictionary)
+    {
+        if (id.empty() || !dictionary || dictionary->empty() ||
+            std::find_if(id.begin(), id.end(), http::is_not_token_char)
+                != id.end())
+        {
+            return make_error_code(error::invalid_dictionary);
+        }
+        m_dictionary_id = id;
+        m_dictionary = dictionary;
+        return lib::error_code();
+    }
+
+    /// Whether a preset dictionary was negotiated
+    /**
+     * @since 0.9.0
+     */
+    bool is_dictionary_active() const {
+        return m_dictionary_active;
+    }
+
+    /// Prepare to decompress a new incoming message
+    /**
+     * Processors call this before the first frame of each compressed message
+     * so that a negotiated preset dictionary can be applied.
+     *
+     * @since 0.9.0
+     *
+     * @return A status code
+     */
+    lib::error_code begin_message() {
+        if (!m_dictionary_active) {
+            return lib::error_code();
+        }
+        if (!m_initialized) {
+            return make_error_code(error::uninitialized);
+        }
+
+        lib::error_code ec = reserve_decompressor();
+        if (ec) {
+            return ec;
+        }
+
+        // with context takeover the dictionary is only needed once, at the
+        // start of the stream
+        if (m_inflate_primed && !m_peer_resets_context) {
+            return lib::error_code();
+        }
+
+        m_inflate_primed = true;
+        return m_decompressor->set_dictionary(dictionary_data(),
+            m_dictionary->size());
+    }
+
     /// Generate extension offer
     /**
      * Creates an offer string to include in the Sec-WebSocket-Extensions
@@ -482,7 +1073,14 @@ public:
      */
     std::string generate_offer() const {
         // TODO: this should be dynamically generated based on user settings
-        return "permessage-deflate; client_no_context_takeover; client_max_window_bits";
+        std::string ret = "permessage-deflate; client_no_context_takeover; client_max_window_bits";
+
+        if (m_dictionary) {
+            ret += std::string("; ") + dictionary_parameter + "=" +
+                m_dictionary_id;
+        }
+
+        return ret;
     }
 
     /// Validate extension response
@@ -508,6 +1106,7 @@ public:
      */
     err_str_pair negotiate(http::attribute_list const & offer) {
         err_str_pair ret;
+        m_dictionary_active = false;
 
         http::attribute_list::const_iterator it;
         for (it = offer.begin(); it != offer.end(); ++it) {
@@ -519,6 +1118,8 @@ public:
                 negotiate_server_max_window_bits(it->second,ret.first);
             } else if (it->first == "client_max_window_bits") {
                 negotiate_client_max_window_bits(it->second,ret.first);
+            } else if (it->first == dictionary_parameter) {
+                negotiate_dictionary(it->second);
             } else {
                 ret.first = make_error_code(error::invalid_attributes);
             }
@@ -550,34 +1151,227 @@ public:
             return make_error_code(error::uninitialized);
         }
 
-        size_t output;
+        if (in.empty()) {
+            uint8_t buf[6] = {0x02, 0x00, 0x00, 0x00, 0xff, 0xff};
+            out.append((char *)(buf),6);
+            return lib::error_code();
+        }
+
+        lib::error_code ec = reserve_compressor();
+        if (ec) {
+            return ec;
+        }
+
+        if (m_dictionary_active && m_reset_context) {
+            ec = m_compressor->set_dictionary(dictionary_data(),
+                m_dictionary->size());
+            if (ec) {
+                return ec;
+            }
+        }
+
+        m_used = true;
+
+        if (!m_stats) {
+            return m_compressor->compress(in, m_reset_context, out);
+        }
+
+        size_t offset = out.size();
+        lib::chrono::steady_clock::time_point start =
+            lib::chrono::steady_clock::now();
+
+        ec = m_compressor->compress(in, m_reset_context, out);
+
+        m_stats->record_compress(in.size(), out.size() - offset,
+            elapsed_ns(start));
+        return ec;
+    }
+
+    /// Compress one chunk of a message sent in pieces
+    /**
+     * Chunks are compressed with the connection's own compressor, in order,
+     * with the history of earlier chunks. Each ends with a flush on a byte
+     * boundary and the empty stored block 0x00 0x00 0xff 0xff, which stays
+     * in the message except at the end of the last chunk. The context is
+     * reset after the last chunk when the negotiated parameters ask for it.
+     *
+     * @since 0.9.0
+     *
+     * @param [in] in The chunk to compress, may be empty
+     * @param [in] first Whether this is the first chunk of the message
+     * @param [in] last Whether this is the last chunk of the message
+     * @param [out] out String to append compressed bytes to
+     * @return Error or status code
+     */
+    lib::error_code compress_chunk(std::string const & in, bool first,
+        bool last, std::string & out)
+    {
+        if (!m_initialized) {
+            return make_error_code(error::uninitialized);
+        }
+
+        lib::error_code ec = reserve_compressor();
+        if (ec) {
+            return ec;
+        }
+
+        if (first && m_dictionary_active && m_reset_context) {
+            ec = m_compressor->set_dictionary(dictionary_data(),
+                m_dictionary->size());
+            if (ec) {
+                return ec;
+            }
+        }
+
+        m_used = true;
+
+        bool reset = last && m_reset_context;
+        size_t offset = out.size();
+        lib::chrono::steady_clock::time_point start;
+        if (m_stats) {
+            start = lib::chrono::steady_clock::now();
+        }
+
+        // an empty chunk only has to reach a byte boundary again, unless the
+        // context is to be reset
+        if (!in.empty() || reset) {
+            ec = m_compressor->compress(in, reset, out);
+            if (ec) {
+                return ec;
+            }
+        }
 
+        if (out.size() == offset) {
+            uint8_t buf[6] = {0x02, 0x00, 0x00, 0x00, 0xff, 0xff};
+            out.append((char *)(buf),6);
+        }
+
+        if (m_stats) {
+            m_stats->record_compress(in.size(), out.size() - offset,
+                elapsed_ns(start));
+        }
+        return ec;
+    }
+
+    /// Window bits of outgoing compression that may be shared
+    /**
+     * When the outgoing direction resets its compression context after every
+     * message, the compressed form of a message depends only on the message
+     * and the window size. One compression, made with compress_shared, can
+     * then be written to every connection that reports the same value here.
+     *
+     * @since 0.9.0
+     *
+     * @return The outgoing window bits, or 0 if compressed output can not be
+     * shared with other connections
+     */
+    uint8_t get_shared_window_bits() const {
+        if (!m_initialized || !m_reset_context) {
+            return 0;
+        }
+        return m_deflate_bits;
+    }
+
+    /// Compress bytes for any connection without context takeover
+    /**
+     * Uses a one off compressor at the default memory level. The output
+     * appended to `out` can be sent on any connection whose
+     * get_shared_window_bits returns `window_bits`.
+     *
+     * @since 0.9.0
+     *
+     * @param [in] window_bits The outgoing window bits, 9 to 15
+     * @param [in] in String to compress
+     * @param [out] out String to append compressed bytes to
+     * @return Error or status code
+     */
+    static lib::error_code compress_shared(uint8_t window_bits,
+        std::string const & in, std::string & out)
+    {
         if (in.empty()) {
             uint8_t buf[6] = {0x02, 0x00, 0x00, 0x00, 0xff, 0xff};
             out.append((char *)(buf),6);
             return lib::error_code();
         }
 
-        m_dstate.avail_in = in.size();
-        m_dstate.next_in = (unsigned char *)(const_cast<char *>(in.data()));
+        typename backend::compressor compressor;
 
-        do {
-            // Output to local buffer
-            m_dstate.avail_out = m_compress_buffer_size;
-            m_dstate.next_out = m_compress_buffer.get();
+        lib::error_code ec = compressor.init(window_bits, default_mem_level);
+        if (ec) {
+            return ec;
+        }
 
-            deflate(&m_dstate, m_flush);
+        return compressor.compress(in, true, out);
+    }
 
-            output = m_compress_buffer_size - m_dstate.avail_out;
+    /// Whether a message may be compressed in independent parts
+    /**
+     * When the outgoing context is reset after every message and no preset
+     * dictionary is primed, the parts of a message can each be compressed
+     * from scratch with compress_part, for example on different threads.
+     * Each part ends with a flush on a byte boundary, so the parts joined in
+     * order are a valid compressed form of the whole message.
+     *
+     * @since 0.9.0
+     */
+    bool can_compress_parts() const {
+        return m_initialized && m_reset_context && !m_dictionary_active;
+    }
 
-            out.append((char *)(m_compress_buffer.get()),output);
-        } while (m_dstate.avail_out == 0);
+    /// Compress one part of a message with a fresh context
+    /**
+     * Uses a one off compressor with the negotiated window bits and the
+     * current level and strategy. Unlike compress this does not touch the
+     * connection's own compressor, so several parts may be compressed at once
+     * while nothing else changes the extension's settings. One off
+     * compressors are not charged to the memory budget.
+     *
+     * @since 0.9.0
+     *
+     * @param [in] in The part to compress, must not be empty
+     * @param [out] out String to append compressed bytes to
+     * @return Error or status code
+     */
+    lib::error_code compress_part(std::string const & in, std::string & out)
+        const
+    {
+        if (!m_initialized) {
+            return make_error_code(error::uninitialized);
+        }
+        if (!can_compress_parts()) {
+            // parts would need the history of earlier messages
+            return make_error_code(error::invalid_attributes);
+        }
 
-        return lib::error_code();
+        size_t offset = out.size();
+        lib::chrono::steady_clock::time_point start;
+        if (m_stats) {
+            start = lib::chrono::steady_clock::now();
+        }
+
+        typename backend::compressor compressor;
+
+        lib::error_code ec = compressor.set_params(m_level, m_strategy);
+        if (!ec) {
+            ec = compressor.init(m_deflate_bits, m_mem_level);
+        }
+        if (!ec) {
+            ec = compressor.compress(in, true, out);
+        }
+
+        if (!ec && m_stats) {
+            m_stats->record_compress(in.size(), out.size() - offset,
+                elapsed_ns(start));
+        }
+        return ec;
     }
 
     /// Decompress bytes
     /**
+     * Inflates straight into `out`. Room for twice the input is made first,
+     * then the space added doubles each time it fills, and `out` is trimmed to
+     * the bytes actually produced.
+     *
      * @param buf Byte buffer to decompress
      * @param len Length of buf
      * @param out String to append decompressed bytes to
@@ -590,30 +1384,192 @@ public:
             return make_error_code(error::uninitialized);
         }
 
-        int ret;
+        lib::error_code ec = reserve_decompressor();
+        if (ec) {
+            return ec;
+        }
+
+        if (m_dictionary_active && !m_inflate_primed) {
+            ec = begin_message();
+            if (ec) {
+                return ec;
+            }
+        }
 
-        m_istate.avail_in = len;
-        m_istate.next_in = const_cast<unsigned char *>(buf);
+        size_t offset = out.size();
+        size_t grow = (std::max)(2 * len, size_t(256));
+        size_t avail_out;
+
+        size_t const in_len = len;
+        size_t const start_size = offset;
+        lib::chrono::steady_clock::time_point start;
+        if (m_stats) {
+            start = lib::chrono::steady_clock::now();
+        }
 
         do {
-            m_istate.avail_out = m_compress_buffer_size;
-            m_istate.next_out = m_decompress_buffer.get();
+            if (offset == out.size()) {
+                out.resize(offset + grow);
+                grow = out.size();
+            }
 
-            ret = inflate(&m_istate, Z_SYNC_FLUSH);
+            avail_out = out.size() - offset;
+            unsigned char * next_out =
+                reinterpret_cast<unsigned char *>(&out[offset]);
 
-            if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR) {
-                return make_error_code(error::zlib_error);
+            ec = m_decompressor->decompress(buf, len, next_out, avail_out);
+
+            offset = out.size() - avail_out;
+
+            if (ec) {
+                out.resize(offset);
+                return ec;
             }
+        } while (avail_out == 0);
 
-            out.append(
-                reinterpret_cast<char *>(m_decompress_buffer.get()),
-                m_compress_buffer_size - m_istate.avail_out
-            );
-        } while (m_istate.avail_out == 0);
+        out.resize(offset);
+
+        if (m_stats) {
+            m_stats->record_decompress(in_len, offset - start_size,
+                elapsed_ns(start));
+        }
+
+        return lib::error_code();
+    }
+
+    /// Decompress bytes a piece at a time
+    /**
+     * Inflates through a fixed size buffer and calls `handler` with each
+     * piece of output, so that large messages can be consumed without first
+     * being stored whole. The buffer is allocated on first use.
+     *
+     * @since 0.9.0
+     *
+     * @param buf Byte buffer to decompress
+     * @param len Length of buf
+     * @param handler Callable as `handler(char const * data, size_t size)`
+     * @return Error or status code
+     */
+    template <typename handler_type>
+    lib::error_code decompress_chunks(uint8_t const * buf, size_t len,
+        handler_type handler)
+    {
+        if (!m_initialized) {
+            return make_error_code(error::uninitialized);
+        }
+
+        lib::error_code ec = reserve_decompressor();
+        if (ec) {
+            return ec;
+        }
+
+        if (m_dictionary_active && !m_inflate_primed) {
+            ec = begin_message();
+            if (ec) {
+                return ec;
+            }
+        }
+
+        if (!m_decompress_buffer) {
+            m_decompress_buffer.reset(new unsigned char[m_compress_buffer_size]);
+            m_decompressor_memory += m_compress_buffer_size;
+            if (m_budget) {
+                m_budget->acquire(m_compress_buffer_size);
+            }
+        }
+
+        size_t avail_out;
+
+        size_t const in_len = len;
+        size_t produced = 0;
+        lib::chrono::steady_clock::time_point start;
+        if (m_stats) {
+            start = lib::chrono::steady_clock::now();
+        }
+
+        do {
+            avail_out = m_compress_buffer_size;
+            unsigned char * next_out = m_decompress_buffer.get();
+
+            ec = m_decompressor->decompress(buf, len, next_out, avail_out);
+
+            if (ec) {
+                return ec;
+            }
+
+            size_t output = m_compress_buffer_size - avail_out;
+            if (output > 0) {
+                produced += output;
+                handler(reinterpret_cast<char const *>(
+                    m_decompress_buffer.get()), output);
+            }
+        } while (avail_out == 0);
+
+        // the handler's own time is included, chunks are usually consumed
+        // much faster than they are inflated
+        if (m_stats) {
+            m_stats->record_decompress(in_len, produced, elapsed_ns(start));
+        }
 
         return lib::error_code();
     }
 private:
+    static uint64_t elapsed_ns(lib::chrono::steady_clock::time_point start) {
+        return static_cast<uint64_t>(
+            lib::chrono::duration_cast<lib::chrono::nanoseconds>(
+                lib::chrono::steady_clock::now() - start).count());
+    }
+
+    /// Make sure the decompressor exists
+    /**
+     * The decompressor is charged to the memory budget but never refused, as
+     * compressed messages from the remote endpoint must still be read.
+     */
+    lib::error_code reserve_decompressor() {
+        m_used = true;
+        if (m_decompressor) {
+            return lib::error_code();
+        }
+
+        lib::shared_ptr<typename backend::decompressor> d =
+            lib::make_shared<typename backend::decompressor>();
+        lib::error_code ec = d->init(m_inflate_bits);
+        if (ec) {
+            return ec;
+        }
+
+        m_decompressor = d;
+        m_inflate_primed = false;
+        m_decompressor_memory = backend::decompressor_memory(m_inflate_bits);
+        if (m_budget) {
+            m_budget->acquire(m_decompressor_memory);
+        }
+        return lib::error_code();
+    }
+
+    void release_compressor() {
+        if (!m_compressor) {
+            return;
+        }
+        m_compressor.reset();
+        if (m_budget) {
+            m_budget->release(m_compressor_memory);
+        }
+        m_compressor_memory = 0;
+    }
+
+    void release_decompressor() {
+        if (!m_decompressor) {
+            return;
+        }
+        m_decompressor.reset();
+        m_decompress_buffer.reset();
+        if (m_budget) {
+            m_budget->release(m_decompressor_memory);
+        }
+        m_decompressor_memory = 0;
+    }
+
     /// Generate negotiation response
     /**
      * @return Generate extension negotiation reponse string to send to client
@@ -641,9 +1597,29 @@ private:
             ret += "; client_max_window_bits="+s.str();
         }
 
+        if (m_dictionary_active) {
+            ret += std::string("; ") + dictionary_parameter + "=" +
+                m_dictionary_id;
+        }
+
         return ret;
     }
 
+    /// Negotiate the private preset dictionary attribute
+    /**
+     * An id other than our own is not an error, the dictionary is simply
+     * not used.
+     *
+     * @param [in] value The value of the attribute from the offer
+     */
+    void negotiate_dictionary(std::string const & value) {
+        m_dictionary_active = m_dictionary && value == m_dictionary_id;
+    }
+
+    uint8_t const * dictionary_data() const {
+        return reinterpret_cast<uint8_t const *>(m_dictionary->data());
+    }
+
     /// Negotiate server_no_context_takeover attribute
     /**
      * @param [in] value The value of the attribute from the offer
@@ -802,12 +1778,33 @@ private:
     mode::value m_client_max_window_bits_mode;
 
     bool m_initialized;
-    int m_flush;
+    /// Whether the outgoing context is reset after every message
+    bool m_reset_context;
+    /// Whether the incoming context is reset after every message
+    bool m_peer_resets_context;
+    /// Whether a context was used since the last release_idle
+    bool m_used;
+    /// Whether both endpoints agreed on m_dictionary
+    bool m_dictionary_active;
+    /// Whether the current decompressor has been given the dictionary
+    bool m_inflate_primed;
+    uint8_t m_deflate_bits;
+    uint8_t m_inflate_bits;
+    int m_mem_level;
+    int m_level;
+    strategy::value m_strategy;
+    /// Size of the pieces produced by decompress_chunks
     size_t m_compress_buffer_size;
-    lib::unique_ptr_uchar_array m_compress_buffer;
     lib::unique_ptr_uchar_array m_decompress_buffer;
-    z_stream m_dstate;
-    z_stream m_istate;
+    lib::shared_ptr<typename backend::compressor> m_compressor;
+    lib::shared_ptr<typename backend::decompressor> m_decompressor;
+    lib::shared_ptr<memory_budget> m_budget;
+    lib::shared_ptr<compression_stats> m_stats;
+    std::string m_dictionary_id;
+    lib::shared_ptr<std::string const> m_dictionary;
+    /// Bytes charged to m_budget for each context
+    size_t m_compressor_memory;
+    size_t m_decompressor_memory;
 };
 
 } // namespace permessage_deflate
@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_EXTENSION_PERMESSAGE_DEFLATE_TUNING_HPP
+#define WEBSOCKETPP_EXTENSION_PERMESSAGE_DEFLATE_TUNING_HPP
+
+#include <websocketpp/common/stdint.hpp>
+
+#include <atomic>
+#include <cstddef>
+
+namespace websocketpp {
+namespace extensions {
+namespace permessage_deflate {
+
+/// Default compression level, a balance of speed and ratio
+static int const default_compression_level = -1;
+/// Minimum compression level, stored blocks only
+static int const min_compression_level = 0;
+/// Maximum compression level, best ratio
+static int const max_compression_level = 9;
+
+namespace strategy {
+/// Deflate compression strategies
+/**
+ * These match zlib's strategies. Backends without an equivalent treat them
+ * as a hint.
+ */
+enum value {
+    /// Normal LZ77 matching plus Huffman coding
+    default_strategy = 0,
+    /// Favor Huffman coding, for data of small random values
+    filtered,
+    /// Huffman coding only, no string matching. Cheapest on CPU.
+    huffman_only,
+    /// Only match runs of the same byte
+    rle,
+    /// Use fixed Huffman codes only
+    fixed
+};
+} // namespace strategy
+
+/// Counters of compression work, shared by the connections of an endpoint
+/**
+ * Every compress and decompress call on a connection using these counters
+ * adds the bytes it consumed and produced and the time it took. All counters
+ * are updated and read with relaxed atomics, so readings taken while
+ * connections are active may be slightly out of step with one another.
+ *
+ * @since 0.9.0
+ */
+class compression_stats {
+public:
+    compression_stats()
+      : m_compress_count(0)
+      , m_compress_in(0)
+      , m_compress_out(0)
+      , m_compress_ns(0)
+      , m_decompress_count(0)
+      , m_decompress_in(0)
+      , m_decompress_out(0)
+      , m_decompress_ns(0)
+    {}
+
+    /// Add one compressed message
+    void record_compress(uint64_t in, uint64_t out, uint64_t ns) {
+        m_compress_count.fetch_add(1, std::memory_order_relaxed);
+        m_compress_in.fetch_add(in, std::memory_order_relaxed);
+        m_compress_out.fetch_add(out, std::memory_order_relaxed);
+        m_compress_ns.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    /// Add one decompressed buffer
+    void record_decompress(uint64_t in, uint64_t out, uint64_t ns) {
+        m_decompress_count.fetch_add(1, std::memory_order_relaxed);
+        m_decompress_in.fetch_add(in, std::memory_order_relaxed);
+        m_decompress_out.fetch_add(out, std::memory_order_relaxed);
+        m_decompress_ns.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    /// Number of messages compressed
+    uint64_t get_compress_count() const {
+        return m_compress_count.load(std::memory_order_relaxed);
+    }
+
+    /// Uncompressed bytes given to the compressor
+    uint64_t get_compress_in() const {
+        return m_compress_in.load(std::memory_order_relaxed);
+    }
+
+    /// Compressed bytes produced by the compressor
+    uint64_t get_compress_out() const {
+        return m_compress_out.load(std::memory_order_relaxed);
+    }
+
+    /// Nanoseconds spent compressing
+    uint64_t get_compress_ns() const {
+        return m_compress_ns.load(std::memory_order_relaxed);
+    }
+
+    /// Number of buffers decompressed
+    uint64_t get_decompress_count() const {
+        return m_decompress_count.load(std::memory_order_relaxed);
+    }
+
+    /// Compressed bytes given to the decompressor
+    uint64_t get_decompress_in() const {
+        return m_decompress_in.load(std::memory_order_relaxed);
+    }
+
+    /// Uncompressed bytes produced by the decompressor
+    uint64_t get_decompress_out() const {
+        return m_decompress_out.load(std::memory_order_relaxed);
+    }
+
+    /// Nanoseconds spent decompressing
+    uint64_t get_decompress_ns() const {
+        return m_decompress_ns.load(std::memory_order_relaxed);
+    }
+
+    /// Compressed size as a fraction of the original for outgoing messages
+    /**
+     * @return The ratio, or 0 if nothing has been compressed
+     */
+    double get_compress_ratio() const {
+        uint64_t in = get_compress_in();
+        return in == 0 ? 0 : double(get_compress_out()) / double(in);
+    }
+
+    /// Compressed size as a fraction of the original for incoming messages
+    /**
+     * @return The ratio, or 0 if nothing has been decompressed
+     */
+    double get_decompress_ratio() const {
+        uint64_t out = get_decompress_out();
+        return out == 0 ? 0 : double(get_decompress_in()) / double(out);
+    }
+
+    /// Set all counters back to zero
+    void reset() {
+        m_compress_count.store(0, std::memory_order_relaxed);
+        m_compress_in.store(0, std::memory_order_relaxed);
+        m_compress_out.store(0, std::memory_order_relaxed);
+        m_compress_ns.store(0, std::memory_order_relaxed);
+        m_decompress_count.store(0, std::memory_order_relaxed);
+        m_decompress_in.store(0, std::memory_order_relaxed);
+        m_decompress_out.store(0, std::memory_order_relaxed);
+        m_decompress_ns.store(0, std::memory_order_relaxed);
+    }
+private:
+    std::atomic<uint64_t> m_compress_count;
+    std::atomic<uint64_t> m_compress_in;
+    std::atomic<uint64_t> m_compress_out;
+    std::atomic<uint64_t> m_compress_ns;
+    std::atomic<uint64_t> m_decompress_count;
+    std::atomic<uint64_t> m_decompress_in;
+    std::atomic<uint64_t> m_decompress_out;
+    std::atomic<uint64_t> m_decompress_ns;
+};
+
+} // namespace permessage_deflate
+} // namespace extensions
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_EXTENSION_PERMESSAGE_DEFLATE_TUNING_HPP
@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_EXTENSION_PERMESSAGE_ZSTD_DISABLED_HPP
+#define WEBSOCKETPP_EXTENSION_PERMESSAGE_ZSTD_DISABLED_HPP
+
+#include <websocketpp/common/cpp11.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+
+#include <websocketpp/http/constants.hpp>
+#include <websocketpp/extensions/extension.hpp>
+
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace websocketpp {
+namespace extensions {
+namespace permessage_zstd {
+
+/// Name of the extension in Sec-WebSocket-Extensions
+static char const extension_name[] = "permessage-zstd";
+
+/// Stub class for use when disabling the permessage-zstd extension
+/**
+ * This class is a stub that implements the permessage_zstd interface with
+ * minimal dependencies. It is the extension of every config that does not
+ * name a `permessage_zstd_type`, so that zstd is only required by programs
+ * that ask for it.
+ *
+ * @since 0.9.0
+ */
+template <typename config>
+class disabled {
+    typedef std::pair<lib::error_code,std::string> err_str_pair;
+
+public:
+    /// Placeholder for a shared dictionary, never created
+    struct dictionary_type {};
+    typedef lib::shared_ptr<dictionary_type const> dictionary_ptr;
+    typedef std::vector<dictionary_ptr> dictionary_list;
+
+    /// Prepare a dictionary for sharing between connections
+    /**
+     * @param [in] content The dictionary contents
+     * @param [in] id The dictionary id
+     * @param [out] ec Always set to a disabled error
+     * @return Always null
+     */
+    static dictionary_ptr make_dictionary(std::string const &, uint32_t,
+        lib::error_code & ec)
+    {
+        ec = make_error_code(extensions::error::disabled);
+        return dictionary_ptr();
+    }
+
+    /// Negotiate extension
+    /**
+     * The disabled extension always fails the negotiation with a disabled
+     * error.
+     *
+     * @param offer Attribute from the remote offer
+     * @return Status code and value to return to remote endpoint
+     */
+    err_str_pair negotiate(http::attribute_list const &) {
+        return make_pair(make_error_code(extensions::error::disabled),
+            std::string());
+    }
+
+    /// Initialize state
+    /**
+     * For the disabled extension state initialization is a no-op.
+     *
+     * @param is_server True to initialize as a server, false for a client.
+     * @return A code representing the error that occurred, if any
+     */
+    lib::error_code init(bool) {
+        return lib::error_code();
+    }
+
+    /// Returns true if the extension is capable of providing
+    /// permessage-zstd functionality
+    bool is_implemented() const {
+        return false;
+    }
+
+    /// Returns true if permessage-zstd functionality is active for this
+    /// connection
+    bool is_enabled() const {
+        return false;
+    }
+
+    /// Generate extension offer
+    /**
+     * @return Always an empty offer
+     */
+    std::string generate_offer() const {
+        return "";
+    }
+
+    /// Check a compression level
+    /**
+     * @return Always a disabled error
+     */
+    static lib::error_code validate_compression_level(int) {
+        return make_error_code(extensions::error::disabled);
+    }
+
+    /// Set the compression level
+    /**
+     * @return Always a disabled error
+     */
+    lib::error_code set_compression_level(int) {
+        return make_error_code(extensions::error::disabled);
+    }
+
+    /// Offer or accept shared dictionaries
+    /**
+     * The disabled extension negotiates nothing, so this is a no-op.
+     */
+    void set_dictionaries(lib::shared_ptr<dictionary_list const>) {}
+
+    /// Make sure the compressor exists
+    /**
+     * @return Always a disabled error
+     */
+    lib::error_code reserve_compressor() {
+        return make_error_code(extensions::error::disabled);
+    }
+
+    /// Release contexts now
+    /**
+     * The disabled extension holds no contexts, so this is a no-op.
+     */
+    void release_contexts(bool, bool) {}
+
+    /// Get the memory held by the compression contexts
+    /**
+     * @return Always 0
+     */
+    size_t get_memory_usage() const {
+        return 0;
+    }
+
+    /// Compress bytes
+    /**
+     * @return Always a disabled error
+     */
+    lib::error_code compress(std::string const &, std::string &) {
+        return make_error_code(extensions::error::disabled);
+    }
+
+    /// Prepare to decompress a new incoming message
+    /**
+     * @return Always a disabled error
+     */
+    lib::error_code begin_message() {
+        return make_error_code(extensions::error::disabled);
+    }
+
+    /// Decompress bytes
+    /**
+     * @return Always a disabled error
+     */
+    lib::error_code decompress(uint8_t const *, size_t, std::string &) {
+        return make_error_code(extensions::error::disabled);
+    }
+
+    /// Check that the incoming message ended with its frame
+    /**
+     * @return Always a disabled error
+     */
+    lib::error_code end_message() {
+        return make_error_code(extensions::error::disabled);
+    }
+};
+
+/// The permessage-zstd extension of a config
+/**
+ * disabled unless the config has a `permessage_zstd_type`, which is usually
+ * `permessage_zstd::enabled<...>`.
+ *
+ * @since 0.9.0
+ */
+template <typename config, typename = void>
+struct policy {
+    typedef disabled<config> type;
+};
+
+template <typename config>
+struct policy<config, std::void_t<typename config::permessage_zstd_type> > {
+    typedef typename config::permessage_zstd_type type;
+};
+
+} // namespace permessage_zstd
+} // namespace extensions
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_EXTENSION_PERMESSAGE_ZSTD_DISABLED_HPP
@@ -0,0 +1,739 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_EXTENSION_PERMESSAGE_ZSTD_ENABLED_HPP
+#define WEBSOCKETPP_EXTENSION_PERMESSAGE_ZSTD_ENABLED_HPP
+
+#include <websocketpp/common/cpp11.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+#include <websocketpp/common/thread.hpp>
+#include <websocketpp/error.hpp>
+
+#include <websocketpp/extensions/extension.hpp>
+#include <websocketpp/extensions/permessage_zstd/disabled.hpp>
+
+#include <websocketpp/http/constants.hpp>
+
+#include "zstd.h"
+
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace websocketpp {
+namespace extensions {
+
+/// permessage-zstd, a non-standard WebSocket extension
+/**
+ * Compresses each data message into one zstd frame, marked with RSV1 like
+ * permessage-deflate. It is only negotiated between endpoints that both
+ * enable it, and only one of the two compression extensions is ever in use
+ * on a connection. Configs enable it by naming
+ * `permessage_zstd::enabled<...>` as their `permessage_zstd_type`.
+ *
+ * Offers may name a dictionary with `dictionary_id=<id>`, where id is the
+ * zstd dictionary id. Both endpoints must already hold the dictionary, a
+ * server declines offers for dictionaries it does not have and the client
+ * lists a plain offer last to fall back on.
+ *
+ * The interface is that of permessage-deflate where the two overlap, plus:
+ *
+ * **begin_message**\n
+ * `lib::error_code begin_message()`\n
+ * Called before the first frame of each compressed incoming message
+ *
+ * **end_message**\n
+ * `lib::error_code end_message()`\n
+ * Called after the last frame, fails if the zstd frame was cut short
+ *
+ * **set_compression_level**\n
+ * `lib::error_code set_compression_level(int level)`\n
+ * Set the zstd level of outgoing messages
+ *
+ * **set_dictionaries**\n
+ * `void set_dictionaries(lib::shared_ptr<dictionary_list const> list)`\n
+ * Offer or accept dictionaries shared with other connections
+ */
+namespace permessage_zstd {
+
+/// Permessage zstd error values
+namespace error {
+enum value {
+    /// Catch all
+    general = 1,
+
+    /// Invalid extension attributes
+    invalid_attributes,
+
+    /// Invalid extension attribute value
+    invalid_attribute_value,
+
+    /// Unknown dictionary id
+    unknown_dictionary,
+
+    /// Invalid dictionary contents or id
+    invalid_dictionary,
+
+    /// Invalid compression level
+    invalid_level,
+
+    /// ZStandard Error
+    zstd_error,
+
+    /// Uninitialized
+    uninitialized,
+
+    /// A compressed message did not end with its zstd frame
+    incomplete_message
+};
+
+/// Permessage-zstd error category
+class category : public lib::error_category {
+public:
+    category() {}
+
+    char const * name() const _WEBSOCKETPP_NOEXCEPT_TOKEN_ {
+        return "websocketpp.extension.permessage-zstd";
+    }
+
+    std::string message(int value) const {
+        switch(value) {
+            case general:
+                return "Generic permessage-zstd error";
+            case invalid_attributes:
+                return "Invalid extension attributes";
+            case invalid_attribute_value:
+                return "Invalid extension attribute value";
+            case unknown_dictionary:
+                return "No dictionary with the offered id";
+            case invalid_dictionary:
+                return "Invalid zstd dictionary or dictionary id";
+            case invalid_level:
+                return "Invalid zstd compression level";
+            case zstd_error:
+                return "A zstd function returned an error";
+            case uninitialized:
+                return "Zstd extension must be initialized before use";
+            case incomplete_message:
+                return "Compressed message ended within its zstd frame";
+            default:
+                return "Unknown permessage-zstd error";
+        }
+    }
+};
+
+/// Get a reference to a static copy of the permessage-zstd error category
+inline lib::error_category const & get_category() {
+    static category instance;
+    return instance;
+}
+
+/// Create an error code in the permessage-zstd category
+inline lib::error_code make_error_code(error::value e) {
+    return lib::error_code(static_cast<int>(e), get_category());
+}
+
+} // namespace error
+} // namespace permessage_zstd
+} // namespace extensions
+} // namespace websocketpp
+
+_WEBSOCKETPP_ERROR_CODE_ENUM_NS_START_
+template<> struct is_error_code_enum
+    <websocketpp::extensions::permessage_zstd::error::value>
+{
+    static bool const value = true;
+};
+_WEBSOCKETPP_ERROR_CODE_ENUM_NS_END_
+namespace websocketpp {
+namespace extensions {
+namespace permessage_zstd {
+
+/// Extension parameter naming a dictionary
+static char const dictionary_parameter[] = "dictionary_id";
+
+/// Default compression level
+static int const default_compression_level = 3;
+
+/// Default log2 of the outgoing window
+/**
+ * Limits the compressor's memory and, as the window is written to each
+ * frame header, that of the remote decompressor. Messages larger than the
+ * window still compress, with references reaching at most this far back.
+ */
+static int const default_window_log = 17;
+
+/// A zstd dictionary digested once and shared between connections
+/**
+ * Holds the decompression dictionary and one compression dictionary per
+ * level in use. Connections keep a reference for as long as they may need
+ * it, so a dictionary may be replaced on the endpoint at any time.
+ *
+ * @since 0.9.0
+ */
+class dictionary {
+public:
+    dictionary(std::string const & content, uint32_t id)
+      : m_content(content)
+      , m_id(id)
+      , m_ddict(ZSTD_createDDict(m_content.data(), m_content.size())) {}
+
+    ~dictionary() {
+        ZSTD_freeDDict(m_ddict);
+        std::map<int, ZSTD_CDict *>::iterator it;
+        for (it = m_cdicts.begin(); it != m_cdicts.end(); ++it) {
+            ZSTD_freeCDict(it->second);
+        }
+    }
+
+    /// The id negotiated for this dictionary
+    uint32_t get_id() const {
+        return m_id;
+    }
+
+    /// The digested dictionary for decompression
+    ZSTD_DDict const * get_ddict() const {
+        return m_ddict;
+    }
+
+    /// The digested dictionary for compression at a level
+    /**
+     * Created the first time a level is asked for.
+     *
+     * @param level The compression level
+     * @return The dictionary, or null if zstd could not create it
+     */
+    ZSTD_CDict const * get_cdict(int level) const {
+        scoped_lock_type lock(m_lock);
+
+        std::map<int, ZSTD_CDict *>::iterator it = m_cdicts.find(level);
+        if (it != m_cdicts.end()) {
+            return it->second;
+        }
+
+        ZSTD_CDict * cdict = ZSTD_createCDict(m_content.data(),
+            m_content.size(), level);
+        if (cdict) {
+            m_cdicts[level] = cdict;
+        }
+        return cdict;
+    }
+
+    /// Bytes held by the digested dictionaries
+    size_t get_memory_usage() const {
+        scoped_lock_type lock(m_lock);
+
+        size_t bytes = m_content.capacity() + ZSTD_sizeof_DDict(m_ddict);
+        std::map<int, ZSTD_CDict *>::const_iterator it;
+        for (it = m_cdicts.begin(); it != m_cdicts.end(); ++it) {
+            bytes += ZSTD_sizeof_CDict(it->second);
+        }
+        return bytes;
+    }
+
+private:
+    typedef lib::lock_guard<lib::mutex> scoped_lock_type;
+
+    dictionary(dictionary const &) = delete;
+    dictionary & operator=(dictionary const &) = delete;
+
+    std::string const m_content;
+    uint32_t const m_id;
+    ZSTD_DDict * const m_ddict;
+    mutable lib::mutex m_lock;
+    mutable std::map<int, ZSTD_CDict *> m_cdicts;
+};
+
+/// Implementation of the permessage-zstd extension
+/**
+ * Contexts are created the first time they are needed and reused for every
+ * message, each message being one complete zstd frame. Nothing is carried
+ * over between messages except through a negotiated dictionary.
+ *
+ * @since 0.9.0
+ */
+template <typename config>
+class enabled {
+    typedef std::pair<lib::error_code,std::string> err_str_pair;
+
+public:
+    typedef dictionary dictionary_type;
+    typedef lib::shared_ptr<dictionary_type const> dictionary_ptr;
+    typedef std::vector<dictionary_ptr> dictionary_list;
+
+    enabled()
+      : m_enabled(false)
+      , m_initialized(false)
+      , m_frame_done(true)
+      , m_level(default_compression_level)
+      , m_cctx(NULL)
+      , m_dctx(NULL)
+    {}
+
+    ~enabled() {
+        ZSTD_freeCCtx(m_cctx);
+        ZSTD_freeDCtx(m_dctx);
+    }
+
+    /// Prepare a dictionary for sharing between connections
+    /**
+     * Dictionaries trained by zstd carry their id, which is used when `id`
+     * is 0. Raw content has no id of its own and must be given one, agreed
+     * with the remote endpoint.
+     *
+     * @param [in] content The dictionary contents
+     * @param [in] id The dictionary id, or 0 to use the one in `content`
+     * @param [out] ec error::invalid_dictionary if the dictionary is empty,
+     * has no id, or has an id other than `id`
+     * @return The dictionary, or null on error
+     */
+    static dictionary_ptr make_dictionary(std::string const & content,
+        uint32_t id, lib::error_code & ec)
+    {
+        if (content.empty()) {
+            ec = make_error_code(error::invalid_dictionary);
+            return dictionary_ptr();
+        }
+
+        uint32_t const own = ZSTD_getDictID_fromDict(content.data(),
+            content.size());
+
+        if ((own == 0 && id == 0) || (own != 0 && id != 0 && own != id)) {
+            ec = make_error_code(error::invalid_dictionary);
+            return dictionary_ptr();
+        }
+
+        lib::shared_ptr<dictionary> ret = lib::make_shared<dictionary>(
+            content, own != 0 ? own : id);
+        if (!ret->get_ddict()) {
+            ec = make_error_code(error::invalid_dictionary);
+            return dictionary_ptr();
+        }
+
+        ec = lib::error_code();
+        return ret;
+    }
+
+    /// Initialize compression state
+    /**
+     * Contexts are not created until they are first needed.
+     *
+     * @param is_server True to initialize as a server, false for a client.
+     * @return A code representing the error that occurred, if any
+     */
+    lib::error_code init(bool) {
+        m_initialized = true;
+        return lib::error_code();
+    }
+
+    /// Test if this object implements the permessage-zstd extension
+    bool is_implemented() const {
+        return true;
+    }
+
+    /// Test if the extension was negotiated for this connection
+    bool is_enabled() const {
+        return m_enabled;
+    }
+
+    /// Check a compression level
+    /**
+     * @param level The compression level
+     * @return A status code, error::invalid_level if out of range
+     */
+    static lib::error_code validate_compression_level(int level) {
+        if (level < ZSTD_minCLevel() || level > ZSTD_maxCLevel()) {
+            return make_error_code(error::invalid_level);
+        }
+        return lib::error_code();
+    }
+
+    /// Set the compression level
+    /**
+     * Applies from the next outgoing message. Levels run from
+     * ZSTD_minCLevel(), the fastest, to ZSTD_maxCLevel(), 0 means zstd's own
+     * default.
+     *
+     * @param level The compression level
+     * @return A status code, error::invalid_level if out of range
+     */
+    lib::error_code set_compression_level(int level) {
+        lib::error_code ec = validate_compression_level(level);
+        if (ec) {
+            return ec;
+        }
+        m_level = level;
+        if (m_cctx) {
+            ZSTD_CCtx_setParameter(m_cctx, ZSTD_c_compressionLevel, level);
+        }
+        return lib::error_code();
+    }
+
+    /// Get the compression level
+    int get_compression_level() const {
+        return m_level;
+    }
+
+    /// Offer or accept dictionaries shared with other connections
+    /**
+     * Must be set before negotiation. Clients offer the dictionaries in
+     * order, then no dictionary. Servers accept the first offer naming one
+     * of them, or an offer naming none.
+     *
+     * @param list The dictionaries, or null for none
+     */
+    void set_dictionaries(lib::shared_ptr<dictionary_list const> list) {
+        m_dictionaries = list;
+    }
+
+    /// The dictionary negotiated for this connection, if any
+    dictionary_ptr get_dictionary() const {
+        return m_dictionary;
+    }
+
+    /// Make sure the compressor exists
+    /**
+     * @return A status code, error::zstd_error if zstd is out of memory
+     */
+    lib::error_code reserve_compressor() {
+        if (m_cctx) {
+            return lib::error_code();
+        }
+
+        m_cctx = ZSTD_createCCtx();
+        if (!m_cctx) {
+            return make_error_code(error::zstd_error);
+        }
+        ZSTD_CCtx_setParameter(m_cctx, ZSTD_c_compressionLevel, m_level);
+        ZSTD_CCtx_setParameter(m_cctx, ZSTD_c_windowLog, default_window_log);
+        return lib::error_code();
+    }
+
+    /// Release the contexts now
+    /**
+     * Nothing is carried between messages, so the compressor may always go.
+     * The decompressor stays while a message is being read.
+     *
+     * @param outgoing Whether to release the compressor
+     * @param incoming Whether to release the decompressor
+     */
+    void release_contexts(bool outgoing, bool incoming) {
+        if (outgoing) {
+            ZSTD_freeCCtx(m_cctx);
+            m_cctx = NULL;
+        }
+        if (incoming && m_frame_done) {
+            ZSTD_freeDCtx(m_dctx);
+            m_dctx = NULL;
+        }
+    }
+
+    /// Get the memory held by the compression contexts
+    /**
+     * Shared dictionaries are not counted, they belong to the endpoint.
+     */
+    size_t get_memory_usage() const {
+        return ZSTD_sizeof_CCtx(m_cctx) + ZSTD_sizeof_DCtx(m_dctx);
+    }
+
+    /// Generate extension offer
+    /**
+     * One offer for each dictionary, in order, then one without.
+     *
+     * @return A WebSocket extension offer string for this extension
+     */
+    std::string generate_offer() const {
+        std::string ret;
+
+        if (m_dictionaries) {
+            typename dictionary_list::const_iterator it;
+            for (it = m_dictionaries->begin(); it != m_dictionaries->end();
+                ++it)
+            {
+                ret += offer_for(*it) + ", ";
+            }
+        }
+
+        return ret + extension_name;
+    }
+
+    /// Validate extension response
+    lib::error_code validate_offer(http::attribute_list const &) {
+        return lib::error_code();
+    }
+
+    /// Negotiate extension
+    /**
+     * Accepts an offer or response naming no dictionary or one we hold.
+     *
+     * @param offer Attributes of one offer or of the response
+     * @return Status code and value to return to remote endpoint
+     */
+    err_str_pair negotiate(http::attribute_list const & offer) {
+        err_str_pair ret;
+        dictionary_ptr selected;
+        bool named = false;
+
+        http::attribute_list::const_iterator it;
+        for (it = offer.begin(); it != offer.end(); ++it) {
+            if (it->first != dictionary_parameter || named) {
+                ret.first = make_error_code(error::invalid_attributes);
+                return ret;
+            }
+            named = true;
+
+            uint32_t id;
+            if (!parse_id(it->second, id)) {
+                ret.first = make_error_code(error::invalid_attribute_value);
+                return ret;
+            }
+
+            selected = find_dictionary(id);
+            if (!selected) {
+                ret.first = make_error_code(error::unknown_dictionary);
+                return ret;
+            }
+        }
+
+        m_dictionary = selected;
+        m_enabled = true;
+        ret.second = offer_for(selected);
+        return ret;
+    }
+
+    /// Compress bytes
+    /**
+     * Appends one complete zstd frame holding `in`.
+     *
+     * @param [in] in String to compress
+     * @param [out] out String to append compressed bytes to
+     * @return Error or status code
+     */
+    lib::error_code compress(std::string const & in, std::string & out) {
+        if (!m_initialized) {
+            return make_error_code(error::uninitialized);
+        }
+
+        lib::error_code ec = reserve_compressor();
+        if (ec) {
+            return ec;
+        }
+
+        ZSTD_CCtx_reset(m_cctx, ZSTD_reset_session_only);
+        size_t ret = ZSTD_CCtx_refCDict(m_cctx, m_dictionary ?
+            m_dictionary->get_cdict(m_level) : NULL);
+        if (!ZSTD_isError(ret)) {
+            ret = ZSTD_CCtx_setPledgedSrcSize(m_cctx, in.size());
+        }
+        if (ZSTD_isError(ret)) {
+            return make_error_code(error::zstd_error);
+        }
+
+        ZSTD_inBuffer input = {in.data(), in.size(), 0};
+        size_t const start = out.size();
+        size_t offset = start;
+
+        // with room for the bound the frame is finished in one call
+        out.resize(offset + ZSTD_compressBound(in.size()));
+        do {
+            if (offset == out.size()) {
+                out.resize(offset + ZSTD_CStreamOutSize());
+            }
+
+            ZSTD_outBuffer output = {&out[0], out.size(), offset};
+            ret = ZSTD_compressStream2(m_cctx, &output, &input, ZSTD_e_end);
+            offset = output.pos;
+
+            if (ZSTD_isError(ret)) {
+                out.resize(start);
+                return make_error_code(error::zstd_error);
+            }
+        } while (ret != 0);
+
+        out.resize(offset);
+        return lib::error_code();
+    }
+
+    /// Prepare to decompress a new incoming message
+    /**
+     * @return A status code
+     */
+    lib::error_code begin_message() {
+        if (!m_initialized) {
+            return make_error_code(error::uninitialized);
+        }
+
+        if (!m_dctx) {
+            m_dctx = ZSTD_createDCtx();
+            if (!m_dctx) {
+                return make_error_code(error::zstd_error);
+            }
+        }
+
+        ZSTD_DCtx_reset(m_dctx, ZSTD_reset_session_only);
+        size_t ret = ZSTD_DCtx_refDDict(m_dctx, m_dictionary ?
+            m_dictionary->get_ddict() : NULL);
+        if (ZSTD_isError(ret)) {
+            return make_error_code(error::zstd_error);
+        }
+
+        m_frame_done = false;
+        return lib::error_code();
+    }
+
+    /// Decompress bytes
+    /**
+     * Decompresses straight into `out`, growing it the same way as
+     * permessage-deflate. Bytes after the end of the frame are an error.
+     *
+     * @param buf Byte buffer to decompress
+     * @param len Length of buf
+     * @param out String to append decompressed bytes to
+     * @return Error or status code
+     */
+    lib::error_code decompress(uint8_t const * buf, size_t len, std::string &
+        out)
+    {
+        if (!m_initialized || !m_dctx) {
+            return make_error_code(error::uninitialized);
+        }
+
+        if (m_frame_done) {
+            return len == 0 ? lib::error_code() :
+                make_error_code(error::zstd_error);
+        }
+
+        ZSTD_inBuffer input = {buf, len, 0};
+        size_t offset = out.size();
+        size_t grow = (std::max)(2 * len, size_t(256));
+        size_t ret;
+
+        do {
+            if (offset == out.size()) {
+                out.resize(offset + grow);
+                grow = out.size();
+            }
+
+            ZSTD_outBuffer output = {&out[0], out.size(), offset};
+            ret = ZSTD_decompressStream(m_dctx, &output, &input);
+            offset = output.pos;
+
+            if (ZSTD_isError(ret)) {
+                out.resize(offset);
+                return make_error_code(error::zstd_error);
+            }
+        } while (ret != 0 && (input.pos < input.size || offset == out.size()));
+
+        out.resize(offset);
+
+        if (ret == 0) {
+            m_frame_done = true;
+            if (input.pos < input.size) {
+                return make_error_code(error::zstd_error);
+            }
+        }
+
+        return lib::error_code();
+    }
+
+    /// Check that the incoming message ended with its frame
+    /**
+     * @return A status code, error::incomplete_message if the frame is not
+     * finished
+     */
+    lib::error_code end_message() {
+        if (!m_frame_done) {
+            m_frame_done = true;
+            return make_error_code(error::incomplete_message);
+        }
+        return lib::error_code();
+    }
+
+private:
+    static std::string offer_for(dictionary_ptr const & dict) {
+        if (!dict) {
+            return extension_name;
+        }
+
+        std::stringstream s;
+        s << extension_name << "; " << dictionary_parameter << "="
+          << dict->get_id();
+        return s.str();
+    }
+
+    static bool parse_id(std::string const & value, uint32_t & id) {
+        if (value.empty() || value.size() > 10 || std::find_if(value.begin(),
+            value.end(), [](char c) {return c < '0' || c > '9';})
+                != value.end())
+        {
+            return false;
+        }
+
+        uint64_t v = std::stoull(value);
+        if (v == 0 || v > 0xffffffffull) {
+            return false;
+        }
+
+        id = static_cast<uint32_t>(v);
+        return true;
+    }
+
+    dictionary_ptr find_dictionary(uint32_t id) const {
+        if (m_dictionaries) {
+            typename dictionary_list::const_iterator it;
+            for (it = m_dictionaries->begin(); it != m_dictionaries->end();
+                ++it)
+            {
+                if (*it && (*it)->get_id() == id) {
+                    return *it;
+                }
+            }
+        }
+        return dictionary_ptr();
+    }
+
+    bool m_enabled;
+    bool m_initialized;
+    /// Whether the incoming message's frame is finished
+    bool m_frame_done;
+    int m_level;
+    ZSTD_CCtx * m_cctx;
+    ZSTD_DCtx * m_dctx;
+    lib::shared_ptr<dictionary_list const> m_dictionaries;
+    /// The dictionary negotiated for this connection, if any
+    dictionary_ptr m_dictionary;
+};
+
+} // namespace permessage_zstd
+} // namespace extensions
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_EXTENSION_PERMESSAGE_ZSTD_ENABLED_HPP
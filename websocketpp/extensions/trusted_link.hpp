@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_EXTENSION_TRUSTED_LINK_HPP
+#define WEBSOCKETPP_EXTENSION_TRUSTED_LINK_HPP
+
+#include <type_traits>
+
+namespace websocketpp {
+namespace extensions {
+/// Trusted-link mode for hops between cooperating endpoints
+/**
+ * A private extension for links where both ends belong to the same
+ * operator, for example between services of one datacenter. When both
+ * endpoints opt in through their config's `enable_trusted_link` flag and
+ * negotiate the extension, clients send unmasked frames and neither side
+ * validates the UTF-8 of text messages.
+ *
+ * Masking protects intermediaries from cache poisoning by scripts, and
+ * validation protects applications from malformed text. Neither threat
+ * exists when both peers and the path between them are trusted, but
+ * enabling the mode anywhere else breaks RFC 6455 guarantees, so it is
+ * off by default and never offered or accepted unless configured.
+ *
+ * The extension has no parameters and claims no RSV bits.
+ *
+ * @since 0.9.0
+ */
+namespace trusted_link {
+
+/// Name of the extension in Sec-WebSocket-Extensions
+static char const extension_name[] = "x-websocketpp-trusted-link";
+
+/// Whether a config opts in to trusted-link mode
+/**
+ * false unless the config has an `enable_trusted_link` flag set to true.
+ *
+ * @since 0.9.0
+ */
+template <typename config, typename = void>
+struct policy : std::false_type {};
+
+template <typename config>
+struct policy<config, std::void_t<decltype(config::enable_trusted_link)> >
+  : std::integral_constant<bool, config::enable_trusted_link> {};
+
+} // namespace trusted_link
+} // namespace extensions
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_EXTENSION_TRUSTED_LINK_HPP
@@ -29,12 +29,16 @@
 #define WEBSOCKETPP_FRAME_HPP
 
 #include <algorithm>
+#include <cstring>
+#include <ostream>
 #include <string>
 
 #include <websocketpp/common/system_error.hpp>
 #include <websocketpp/common/network.hpp>
+#include <websocketpp/common/simd.hpp>
 
 #include <websocketpp/utilities.hpp>
+#include <websocketpp/utf8_validator.hpp>
 
 namespace websocketpp {
 /// Data structures and utility functions for manipulating WebSocket frames
@@ -274,6 +278,159 @@ private:
     }
 };
 
+/// A complete encoded frame header, held inline
+/**
+ * Holds the up to MAX_HEADER_LENGTH bytes of a frame header so preparing a
+ * message needs no allocation for its header. It converts to std::string and
+ * compares equal to strings holding the same bytes, so code written against
+ * the std::string header of earlier versions keeps working.
+ *
+ * @since 0.9.0
+ */
+class header_buffer {
+public:
+    header_buffer() : m_size(0) {}
+
+    /// Encode a header for a payload of size bytes
+    /**
+     * Masked and unmasked headers are encoded by separate instantiations, so
+     * neither pays for the branches of the other. The caller picks one from
+     * its role: clients mask, servers do not.
+     *
+     * @param op The opcode
+     * @param size The payload length
+     * @param fin Whether this is the final frame of a message
+     * @param rsv1 Whether to set RSV1, which marks compressed messages
+     * @param key The masking key, ignored unless masked
+     */
+    template <bool masked>
+    void encode(opcode::value op, uint64_t size, bool fin, bool rsv1 = false,
+        masking_key_type key = masking_key_type())
+    {
+        uint8_t b0 = op & BHB0_OPCODE;
+        if (fin) {
+            b0 |= BHB0_FIN;
+        }
+        if (rsv1) {
+            b0 |= BHB0_RSV1;
+        }
+        uint8_t const b1 = masked ? BHB1_MASK : 0x00;
+
+        m_bytes[0] = static_cast<char>(b0);
+        size_t n;
+        if (size <= limits::payload_size_basic) {
+            m_bytes[1] = static_cast<char>(b1 | size);
+            n = 2;
+        } else if (size <= limits::payload_size_extended) {
+            m_bytes[1] = static_cast<char>(b1 | payload_size_code_16bit);
+            m_bytes[2] = static_cast<char>(size >> 8);
+            m_bytes[3] = static_cast<char>(size);
+            n = 4;
+        } else {
+            m_bytes[1] = static_cast<char>(b1 | payload_size_code_64bit);
+            for (size_t i = 0; i < 8; ++i) {
+                m_bytes[2+i] = static_cast<char>(size >> (56 - 8*i));
+            }
+            n = 10;
+        }
+
+        if constexpr (masked) {
+            std::memcpy(m_bytes+n,key.c,4);
+            n += 4;
+        }
+        m_size = static_cast<uint8_t>(n);
+    }
+
+    /// Encode a header, masked or not as decided at runtime
+    void encode(opcode::value op, uint64_t size, bool fin, bool masked,
+        bool rsv1, masking_key_type key)
+    {
+        if (masked) {
+            encode<true>(op,size,fin,rsv1,key);
+        } else {
+            encode<false>(op,size,fin,rsv1);
+        }
+    }
+
+    /// Set further RSV bits in an encoded header
+    /**
+     * @param bits RSV2 and RSV3, marking messages of negotiated extensions
+     */
+    void add_rsv_bits(uint8_t bits) {
+        m_bytes[0] = static_cast<char>(uint8_t(m_bytes[0]) |
+            (bits & (BHB0_RSV2 | BHB0_RSV3)));
+    }
+
+    /// Replace the contents, keeping at most MAX_HEADER_LENGTH bytes
+    void assign(char const * data, size_t len) {
+        m_size = static_cast<uint8_t>(std::min<size_t>(len,MAX_HEADER_LENGTH));
+        std::memcpy(m_bytes,data,m_size);
+    }
+
+    void clear() {
+        m_size = 0;
+    }
+
+    char const * data() const {
+        return m_bytes;
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+    bool empty() const {
+        return m_size == 0;
+    }
+
+    char const * begin() const {
+        return m_bytes;
+    }
+
+    char const * end() const {
+        return m_bytes + m_size;
+    }
+
+    char operator[](size_t i) const {
+        return m_bytes[i];
+    }
+
+    operator std::string() const {
+        return std::string(m_bytes,m_size);
+    }
+
+    friend bool operator==(header_buffer const & a, header_buffer const & b) {
+        return a.m_size == b.m_size && std::memcmp(a.m_bytes,b.m_bytes,
+            a.m_size) == 0;
+    }
+
+    friend bool operator==(header_buffer const & a, std::string const & b) {
+        return a.m_size == b.size() && std::memcmp(a.m_bytes,b.data(),
+            a.m_size) == 0;
+    }
+
+    friend bool operator==(header_buffer const & a, char const * b) {
+        return a == std::string(b);
+    }
+
+    friend std::string operator+(header_buffer const & a,
+        std::string const & b)
+    {
+        std::string ret(a.m_bytes,a.m_size);
+        ret += b;
+        return ret;
+    }
+
+    friend std::ostream & operator<<(std::ostream & o,
+        header_buffer const & h)
+    {
+        return o.write(h.m_bytes,h.m_size);
+    }
+private:
+    char m_bytes[MAX_HEADER_LENGTH];
+    uint8_t m_size;
+};
+
 bool get_fin(basic_header const &h);
 void set_fin(basic_header &h, bool value);
 bool get_rsv1(basic_header const &h);
@@ -305,13 +462,19 @@ void byte_mask(input_iter b, input_iter e, output_iter o, masking_key_type
 template <typename iter_type>
 void byte_mask(iter_type b, iter_type e, masking_key_type const & key,
     size_t key_offset = 0);
-void word_mask_exact(uint8_t * input, uint8_t * output, size_t length,
+void word_mask_exact(uint8_t const * input, uint8_t * output, size_t length,
     masking_key_type const & key);
 void word_mask_exact(uint8_t * data, size_t length, masking_key_type const &
     key);
-size_t word_mask_circ(uint8_t * input, uint8_t * output, size_t length,
+size_t word_mask_circ(uint8_t const * input, uint8_t * output, size_t length,
     size_t prepared_key);
 size_t word_mask_circ(uint8_t * data, size_t length, size_t prepared_key);
+void mask_exact(uint8_t const * input, uint8_t * output, size_t length,
+    masking_key_type const & key);
+void mask_exact(uint8_t * data, size_t length, masking_key_type const & key);
+size_t mask_circ(uint8_t const * input, uint8_t * output, size_t length,
+    size_t prepared_key);
+size_t mask_circ(uint8_t * data, size_t length, size_t prepared_key);
 
 /// Check whether the frame's FIN bit is set.
 /**
@@ -699,12 +862,12 @@ void byte_mask(iter_type b, iter_type e, masking_key_type const & key,
  *
  * @param key Masking key to use
  */
-inline void word_mask_exact(uint8_t* input, uint8_t* output, size_t length,
+inline void word_mask_exact(uint8_t const * input, uint8_t* output, size_t length,
     const masking_key_type& key)
 {
     size_t prepared_key = prepare_masking_key(key);
     size_t n = length/sizeof(size_t);
-    size_t* input_word = reinterpret_cast<size_t*>(input);
+    size_t const * input_word = reinterpret_cast<size_t const *>(input);
     size_t* output_word = reinterpret_cast<size_t*>(output);
 
     for (size_t i = 0; i < n; i++) {
@@ -765,12 +928,12 @@ inline void word_mask_exact(uint8_t* data, size_t length, const
  *
  * @return the prepared_key shifted to account for the input length
  */
-inline size_t word_mask_circ(uint8_t * input, uint8_t * output, size_t length,
+inline size_t word_mask_circ(uint8_t const * input, uint8_t * output, size_t length,
     size_t prepared_key)
 {
     size_t n = length / sizeof(size_t); // whole words
     size_t l = length - (n * sizeof(size_t)); // remaining bytes
-    size_t * input_word = reinterpret_cast<size_t *>(input);
+    size_t const * input_word = reinterpret_cast<size_t const *>(input);
     size_t * output_word = reinterpret_cast<size_t *>(output);
 
     // mask word by word
@@ -806,6 +969,325 @@ inline size_t word_mask_circ(uint8_t* data, size_t length, size_t prepared_key){
     return word_mask_circ(data,data,length,prepared_key);
 }
 
+/// Build a 16 byte repetition of a prepared masking key
+/**
+ * Vector kernels load their key from this buffer rather than broadcasting the
+ * integer so that the byte order within each lane always matches the byte
+ * order of the payload regardless of host endianness.
+ *
+ * @param prepared_key Prepared key to expand
+ *
+ * @param out Buffer of at least 16 bytes to write the expanded key to
+ */
+inline void expand_prepared_key(size_t prepared_key, uint8_t * out) {
+    for (size_t i = 0; i < 16; i += sizeof(size_t)) {
+        std::memcpy(out+i,&prepared_key,sizeof(size_t));
+    }
+}
+
+#ifdef _WEBSOCKETPP_SIMD_SSE2_
+/// Circular mask/unmask using SSE2 16 byte vectors
+/**
+ * Same contract as word_mask_circ. Whole 16 byte blocks are masked with SSE2
+ * and the remainder is handed to word_mask_circ. Input and output need not be
+ * aligned.
+ *
+ * @see word_mask_circ
+ */
+inline size_t sse2_mask_circ(uint8_t const * input, uint8_t * output,
+    size_t length, size_t prepared_key)
+{
+    uint8_t key_bytes[16];
+    expand_prepared_key(prepared_key,key_bytes);
+    __m128i const vkey = _mm_loadu_si128(
+        reinterpret_cast<__m128i const *>(key_bytes));
+
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<__m128i const *>(input+i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<__m128i const *>(input+i+16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<__m128i const *>(input+i+32));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<__m128i const *>(input+i+48));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output+i),_mm_xor_si128(a,vkey));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output+i+16),_mm_xor_si128(b,vkey));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output+i+32),_mm_xor_si128(c,vkey));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output+i+48),_mm_xor_si128(d,vkey));
+    }
+    for (; i + 16 <= length; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<__m128i const *>(input+i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output+i),_mm_xor_si128(a,vkey));
+    }
+
+    // i is a multiple of 16 so the key has not rotated
+    return word_mask_circ(input+i,output+i,length-i,prepared_key);
+}
+#endif // _WEBSOCKETPP_SIMD_SSE2_
+
+#ifdef _WEBSOCKETPP_SIMD_AVX2_
+/// Circular mask/unmask using AVX2 32 byte vectors
+/**
+ * Same contract as word_mask_circ. Whole 32 byte blocks are masked with AVX2
+ * and the remainder is handed to sse2_mask_circ. Input and output need not be
+ * aligned.
+ *
+ * @see word_mask_circ
+ */
+inline size_t avx2_mask_circ(uint8_t const * input, uint8_t * output,
+    size_t length, size_t prepared_key)
+{
+    uint8_t key_bytes[16];
+    expand_prepared_key(prepared_key,key_bytes);
+    __m128i const half = _mm_loadu_si128(
+        reinterpret_cast<__m128i const *>(key_bytes));
+    __m256i const vkey = _mm256_broadcastsi128_si256(half);
+
+    size_t i = 0;
+    for (; i + 128 <= length; i += 128) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(input+i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(input+i+32));
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(input+i+64));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(input+i+96));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(output+i),_mm256_xor_si256(a,vkey));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(output+i+32),_mm256_xor_si256(b,vkey));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(output+i+64),_mm256_xor_si256(c,vkey));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(output+i+96),_mm256_xor_si256(d,vkey));
+    }
+    for (; i + 32 <= length; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(input+i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(output+i),_mm256_xor_si256(a,vkey));
+    }
+
+    return sse2_mask_circ(input+i,output+i,length-i,prepared_key);
+}
+#endif // _WEBSOCKETPP_SIMD_AVX2_
+
+#ifdef _WEBSOCKETPP_SIMD_NEON_
+/// Circular mask/unmask using NEON 16 byte vectors
+/**
+ * Same contract as word_mask_circ. Whole 16 byte blocks are masked with NEON
+ * and the remainder is handed to word_mask_circ. Input and output need not be
+ * aligned.
+ *
+ * @see word_mask_circ
+ */
+inline size_t neon_mask_circ(uint8_t const * input, uint8_t * output,
+    size_t length, size_t prepared_key)
+{
+    uint8_t key_bytes[16];
+    expand_prepared_key(prepared_key,key_bytes);
+    uint8x16_t const vkey = vld1q_u8(key_bytes);
+
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        uint8x16_t a = vld1q_u8(input+i);
+        uint8x16_t b = vld1q_u8(input+i+16);
+        uint8x16_t c = vld1q_u8(input+i+32);
+        uint8x16_t d = vld1q_u8(input+i+48);
+        vst1q_u8(output+i,veorq_u8(a,vkey));
+        vst1q_u8(output+i+16,veorq_u8(b,vkey));
+        vst1q_u8(output+i+32,veorq_u8(c,vkey));
+        vst1q_u8(output+i+48,veorq_u8(d,vkey));
+    }
+    for (; i + 16 <= length; i += 16) {
+        vst1q_u8(output+i,veorq_u8(vld1q_u8(input+i),vkey));
+    }
+
+    return word_mask_circ(input+i,output+i,length-i,prepared_key);
+}
+#endif // _WEBSOCKETPP_SIMD_NEON_
+
+/// Circular mask/unmask using the fastest kernel available
+/**
+ * Dispatches to the widest vector kernel enabled at compile time (see
+ * websocketpp/common/simd.hpp) and falls back to word_mask_circ otherwise.
+ * Has the same contract as word_mask_circ, except that bytes beyond `length`
+ * are never read or written.
+ *
+ * @param input Buffer to mask or unmask
+ *
+ * @param output Buffer to store the output. May be the same as input.
+ *
+ * @param length Length of data
+ *
+ * @param prepared_key Prepared key to use.
+ *
+ * @return the prepared_key shifted to account for the input length
+ */
+inline size_t mask_circ(uint8_t const * input, uint8_t * output, size_t length,
+    size_t prepared_key)
+{
+#if defined(_WEBSOCKETPP_SIMD_AVX2_)
+    return avx2_mask_circ(input,output,length,prepared_key);
+#elif defined(_WEBSOCKETPP_SIMD_SSE2_)
+    return sse2_mask_circ(input,output,length,prepared_key);
+#elif defined(_WEBSOCKETPP_SIMD_NEON_)
+    return neon_mask_circ(input,output,length,prepared_key);
+#else
+    return word_mask_circ(input,output,length,prepared_key);
+#endif
+}
+
+/// Circular mask/unmask using the fastest kernel available (in place)
+/**
+ * In place version of mask_circ
+ *
+ * @see mask_circ
+ */
+inline size_t mask_circ(uint8_t * data, size_t length, size_t prepared_key) {
+    return mask_circ(data,data,length,prepared_key);
+}
+
+/// Exact mask/unmask using the fastest kernel available
+/**
+ * Masks a complete buffer starting at key offset zero. Equivalent to
+ * word_mask_exact but uses the vector kernels when they are available.
+ *
+ * @param input buffer to mask or unmask
+ *
+ * @param output buffer to store the output. May be the same as input.
+ *
+ * @param length length of data buffer
+ *
+ * @param key Masking key to use
+ */
+inline void mask_exact(uint8_t const * input, uint8_t * output, size_t length,
+    masking_key_type const & key)
+{
+    mask_circ(input,output,length,prepare_masking_key(key));
+}
+
+/// Exact mask/unmask using the fastest kernel available (in place)
+/**
+ * In place version of mask_exact
+ *
+ * @see mask_exact
+ */
+inline void mask_exact(uint8_t * data, size_t length,
+    masking_key_type const & key)
+{
+    mask_exact(data,data,length,key);
+}
+
+/// Circular mask/unmask with UTF8 validation in a single pass
+/**
+ * Unmasks a TEXT payload and feeds the unmasked bytes to a streaming UTF8
+ * validator while they are still in registers. Blocks that are entirely ASCII
+ * and that begin on a code point boundary skip the validator state machine
+ * entirely, which is the common case for JSON and other text protocols.
+ *
+ * Vector blocks are 32 bytes with AVX2 and 16 bytes with SSE2 or NEON. Other
+ * targets use machine words. Input and output need not be aligned and bytes
+ * beyond `length` are never read or written.
+ *
+ * Processing stops at the first block that contains invalid UTF8. In that
+ * case the contents of output and the values of prepared_key and validator
+ * are unspecified.
+ *
+ * @param input Buffer to unmask
+ *
+ * @param output Buffer to store the output. May be the same as input.
+ *
+ * @param length Length of data
+ *
+ * @param prepared_key Prepared key to use. Updated to account for length.
+ *
+ * @param validator Streaming validator to advance with the unmasked bytes.
+ *
+ * @return Whether or not the unmasked bytes were valid UTF8 so far
+ */
+inline bool mask_circ_utf8(uint8_t const * input, uint8_t * output,
+    size_t length, size_t & prepared_key,
+    utf8_validator::validator & validator)
+{
+    size_t i = 0;
+
+#if defined(_WEBSOCKETPP_SIMD_SSE2_) || defined(_WEBSOCKETPP_SIMD_NEON_)
+    uint8_t key_bytes[16];
+    expand_prepared_key(prepared_key,key_bytes);
+#endif
+
+#if defined(_WEBSOCKETPP_SIMD_AVX2_)
+    __m256i const vkey = _mm256_broadcastsi128_si256(_mm_loadu_si128(
+        reinterpret_cast<__m128i const *>(key_bytes)));
+
+    for (; i + 32 <= length; i += 32) {
+        __m256i v = _mm256_xor_si256(vkey, _mm256_loadu_si256(
+            reinterpret_cast<__m256i const *>(input+i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(output+i),v);
+
+        if (_mm256_movemask_epi8(v) == 0 && validator.complete()) {
+            continue;
+        }
+        if (!validator.decode(output+i,output+i+32)) {
+            return false;
+        }
+    }
+#endif
+
+#if defined(_WEBSOCKETPP_SIMD_SSE2_)
+    __m128i const skey = _mm_loadu_si128(
+        reinterpret_cast<__m128i const *>(key_bytes));
+
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_xor_si128(skey, _mm_loadu_si128(
+            reinterpret_cast<__m128i const *>(input+i)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(output+i),v);
+
+        if (_mm_movemask_epi8(v) == 0 && validator.complete()) {
+            continue;
+        }
+        if (!validator.decode(output+i,output+i+16)) {
+            return false;
+        }
+    }
+#elif defined(_WEBSOCKETPP_SIMD_NEON_)
+    uint8x16_t const nkey = vld1q_u8(key_bytes);
+
+    for (; i + 16 <= length; i += 16) {
+        uint8x16_t v = veorq_u8(nkey,vld1q_u8(input+i));
+        vst1q_u8(output+i,v);
+
+        uint64x2_t w = vreinterpretq_u64_u8(v);
+        uint64_t high = (vgetq_lane_u64(w,0) | vgetq_lane_u64(w,1)) &
+            0x8080808080808080ULL;
+        if (high == 0 && validator.complete()) {
+            continue;
+        }
+        if (!validator.decode(output+i,output+i+16)) {
+            return false;
+        }
+    }
+#endif
+
+    // whole words
+    size_t const high_bits = (~static_cast<size_t>(0) / 0xFF) * 0x80;
+    for (; i + sizeof(size_t) <= length; i += sizeof(size_t)) {
+        size_t word;
+        std::memcpy(&word,input+i,sizeof(size_t));
+        word ^= prepared_key;
+        std::memcpy(output+i,&word,sizeof(size_t));
+
+        if ((word & high_bits) == 0 && validator.complete()) {
+            continue;
+        }
+        if (!validator.decode(output+i,output+i+sizeof(size_t))) {
+            return false;
+        }
+    }
+
+    // everything so far was a whole number of words so the key has not
+    // rotated yet. Mask the partial word at the end.
+    size_t l = length - i;
+    uint8_t byte_key[sizeof(size_t)];
+    std::memcpy(byte_key,&prepared_key,sizeof(size_t));
+    for (size_t j = 0; j < l; ++j) {
+        output[i+j] = input[i+j] ^ byte_key[j];
+    }
+    prepared_key = circshift_prepared_key(prepared_key,l);
+
+    return validator.decode(output+i,output+length);
+}
+
 /// Circular byte aligned mask/unmask
 /**
  * Performs a circular mask/unmask in byte sized chunks using pre-prepared keys
@@ -827,7 +1309,7 @@ inline size_t word_mask_circ(uint8_t* data, size_t length, size_t prepared_key){
  *
  * @return the prepared_key shifted to account for the input length
  */
-inline size_t byte_mask_circ(uint8_t * input, uint8_t * output, size_t length,
+inline size_t byte_mask_circ(uint8_t const * input, uint8_t * output, size_t length,
     size_t prepared_key)
 {
     uint32_converter key;
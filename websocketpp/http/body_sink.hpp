@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef HTTP_PARSER_BODY_SINK_HPP
+#define HTTP_PARSER_BODY_SINK_HPP
+
+#include <websocketpp/common/functional.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+#include <websocketpp/http/constants.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string_view>
+
+#if !defined(_WIN32)
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+namespace websocketpp {
+namespace http {
+
+/// Destination for HTTP body bytes as they are parsed
+/**
+ * A sink set on a response receives the body in order, after any content
+ * encoding has been undone, instead of the body being collected in memory.
+ * Only the bytes of the current read are held at any time, so the size of the
+ * body is limited by the sink rather than by the maximum body size.
+ *
+ * @since 0.9.0
+ */
+class body_sink {
+public:
+    typedef lib::shared_ptr<body_sink> ptr;
+
+    virtual ~body_sink() {}
+
+    /// Store the next part of the body
+    /**
+     * @param data Pointer to the body bytes
+     * @param len Number of body bytes
+     * @return A status code, any error aborts parsing with that error
+     */
+    virtual lib::error_code write(char const * data, size_t len) = 0;
+
+    /// Store part of the body at an offset from its start
+    /**
+     * Used by ranged downloads, which receive the parts of a body out of
+     * order. Calls are never concurrent. Sinks that can only append fail with
+     * sink_not_seekable.
+     *
+     * @param offset Offset of the first byte from the start of the body
+     * @param data Pointer to the body bytes
+     * @param len Number of body bytes
+     * @return A status code, any error aborts the download with that error
+     */
+    virtual lib::error_code write_at(uint64_t /*offset*/,
+        char const * /*data*/, size_t /*len*/)
+    {
+        return error::make_error_code(error::sink_not_seekable);
+    }
+
+    /// Called once after the last part of the body
+    virtual lib::error_code finish() {
+        return lib::error_code();
+    }
+};
+
+/// Body sink that passes each part of the body to a callback
+class handler_sink : public body_sink {
+public:
+    typedef lib::function<void(std::string_view)> handler;
+
+    explicit handler_sink(handler h) : m_handler(h) {}
+
+    lib::error_code write(char const * data, size_t len) {
+        m_handler(std::string_view(data, len));
+        return lib::error_code();
+    }
+private:
+    handler m_handler;
+};
+
+/// Body sink that copies the body into a caller owned, pre-sized region
+/**
+ * The region may be any writable memory, such as a mapping the application
+ * set up itself. A body larger than the region fails with body_too_large.
+ */
+class buffer_sink : public body_sink {
+public:
+    buffer_sink(char * begin, size_t size)
+      : m_begin(begin)
+      , m_size(size)
+      , m_used(0) {}
+
+    lib::error_code write(char const * data, size_t len) {
+        if (len > m_size - m_used) {
+            return error::make_error_code(error::body_too_large);
+        }
+        std::memcpy(m_begin + m_used, data, len);
+        m_used += len;
+        return lib::error_code();
+    }
+
+    lib::error_code write_at(uint64_t offset, char const * data, size_t len) {
+        if (offset > m_size || len > m_size - offset) {
+            return error::make_error_code(error::body_too_large);
+        }
+        std::memcpy(m_begin + offset, data, len);
+        m_used = (std::max)(m_used, static_cast<size_t>(offset) + len);
+        return lib::error_code();
+    }
+
+    /// End of the furthest body byte written so far
+    size_t size() const {
+        return m_used;
+    }
+protected:
+    char *  m_begin;
+    size_t  m_size;
+    size_t  m_used;
+};
+
+#if !defined(_WIN32)
+/// Body sink that writes the body to a file descriptor
+/**
+ * Writes are blocking and happen on the thread parsing the response. The
+ * descriptor is not closed by the sink. write_at needs a regular file, as it
+ * writes with pwrite.
+ */
+class fd_sink : public body_sink {
+public:
+    explicit fd_sink(int fd) : m_fd(fd) {}
+
+    lib::error_code write(char const * data, size_t len) {
+        while (len > 0) {
+            ssize_t const n = ::write(m_fd, data, len);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return lib::error_code(errno, lib::system_category());
+            }
+            data += n;
+            len -= static_cast<size_t>(n);
+        }
+        return lib::error_code();
+    }
+
+    lib::error_code write_at(uint64_t offset, char const * data, size_t len) {
+        while (len > 0) {
+            ssize_t const n = ::pwrite(m_fd, data, len,
+                static_cast<off_t>(offset));
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return lib::error_code(errno, lib::system_category());
+            }
+            data += n;
+            offset += static_cast<uint64_t>(n);
+            len -= static_cast<size_t>(n);
+        }
+        return lib::error_code();
+    }
+private:
+    int m_fd;
+};
+
+/// Body sink that writes the body into a memory mapped file
+/**
+ * The file is extended to `size` bytes and mapped, body bytes are copied
+ * straight into the mapping and finish() truncates the file to the bytes
+ * actually received. Suits downloads whose size is known up front, such as
+ * from a Content-Length or a previous HEAD request. The descriptor must be
+ * open for reading and writing and is not closed by the sink.
+ */
+class mmap_sink : public buffer_sink {
+public:
+    mmap_sink(int fd, size_t size)
+      : buffer_sink(NULL, 0)
+      , m_fd(fd)
+      , m_error()
+    {
+        if (size == 0) {
+            return;
+        }
+        if (::ftruncate(m_fd, static_cast<off_t>(size)) != 0) {
+            m_error = lib::error_code(errno, lib::system_category());
+            return;
+        }
+        void * p = ::mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+            m_fd, 0);
+        if (p == MAP_FAILED) {
+            m_error = lib::error_code(errno, lib::system_category());
+            return;
+        }
+        m_begin = static_cast<char *>(p);
+        m_size = size;
+    }
+
+    mmap_sink(mmap_sink const &) = delete;
+    mmap_sink & operator=(mmap_sink const &) = delete;
+
+    ~mmap_sink() {
+        unmap();
+    }
+
+    lib::error_code write(char const * data, size_t len) {
+        if (m_error) {
+            return m_error;
+        }
+        if (!m_begin) {
+            // nothing was mapped, or the sink was already finished
+            return len ? error::make_error_code(error::body_too_large) :
+                lib::error_code();
+        }
+        return buffer_sink::write(data, len);
+    }
+
+    lib::error_code write_at(uint64_t offset, char const * data, size_t len) {
+        if (m_error) {
+            return m_error;
+        }
+        return buffer_sink::write_at(offset, data, len);
+    }
+
+    lib::error_code finish() {
+        if (m_error) {
+            return m_error;
+        }
+        unmap();
+        if (::ftruncate(m_fd, static_cast<off_t>(m_used)) != 0) {
+            return lib::error_code(errno, lib::system_category());
+        }
+        return lib::error_code();
+    }
+
+    /// The error from setting up the mapping, if any
+    lib::error_code get_error() const {
+        return m_error;
+    }
+private:
+    void unmap() {
+        if (m_begin) {
+            ::munmap(m_begin, m_size);
+            m_begin = NULL;
+        }
+    }
+
+    int             m_fd;
+    lib::error_code m_error;
+};
+#endif // !_WIN32
+
+} // namespace http
+} // namespace websocketpp
+
+#endif // HTTP_PARSER_BODY_SINK_HPP
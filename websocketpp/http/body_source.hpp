@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef HTTP_PARSER_BODY_SOURCE_HPP
+#define HTTP_PARSER_BODY_SOURCE_HPP
+
+#include <websocketpp/common/functional.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+#include <websocketpp/http/constants.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if !defined(_WIN32)
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace websocketpp {
+namespace http {
+
+/// Origin of an HTTP request body that is streamed as it is sent
+/**
+ * The counterpart of body_sink for uploads: a client connection with a source
+ * reads the body from it one part at a time, as the transport accepts the
+ * previous part, instead of the whole body being held in the request. Only
+ * one part is in memory at any time.
+ *
+ * @since 0.9.0
+ */
+class body_source {
+public:
+    typedef lib::shared_ptr<body_source> ptr;
+
+    /// Value of size for a body whose length is not known up front
+    static constexpr uint64_t unknown_size = uint64_t(-1);
+
+    virtual ~body_source() {}
+
+    /// Length of the whole body
+    /**
+     * A known length is sent as Content-Length, otherwise the body is sent
+     * with chunked transfer encoding.
+     *
+     * @return The length in bytes, or unknown_size
+     */
+    virtual uint64_t size() const {
+        return unknown_size;
+    }
+
+    /// Read the next part of the body
+    /**
+     * @param buf Buffer to read into
+     * @param len Size of buf
+     * @param [out] read Set to the number of bytes read, 0 at the end of the
+     * body
+     * @return A status code, any error aborts the request with that error
+     */
+    virtual lib::error_code read(char * buf, size_t len, size_t & read) = 0;
+};
+
+/// Body source that asks a callback for each part of the body
+class handler_source : public body_source {
+public:
+    typedef lib::function<lib::error_code(char *, size_t, size_t &)> handler;
+
+    /**
+     * @param h Called like body_source::read
+     * @param size The length of the body, if known
+     */
+    explicit handler_source(handler h, uint64_t size = unknown_size)
+      : m_handler(h)
+      , m_size(size) {}
+
+    uint64_t size() const {
+        return m_size;
+    }
+
+    lib::error_code read(char * buf, size_t len, size_t & read) {
+        return m_handler(buf, len, read);
+    }
+private:
+    handler         m_handler;
+    uint64_t const  m_size;
+};
+
+/// Body source that sends a caller owned region of memory
+/**
+ * The region must stay valid until the request was sent.
+ */
+class buffer_source : public body_source {
+public:
+    buffer_source(char const * begin, size_t size)
+      : m_begin(begin)
+      , m_size(size)
+      , m_read(0) {}
+
+    uint64_t size() const {
+        return m_size;
+    }
+
+    lib::error_code read(char * buf, size_t len, size_t & read) {
+        read = (std::min)(len, m_size - m_read);
+        if (read > 0) {
+            std::memcpy(buf, m_begin + m_read, read);
+        }
+        m_read += read;
+        return lib::error_code();
+    }
+protected:
+    char const *    m_begin;
+    size_t          m_size;
+    size_t          m_read;
+};
+
+#if !defined(_WIN32)
+/// Body source that reads the body from a file descriptor
+/**
+ * Reads are blocking and happen on the thread sending the request. The length
+ * of a regular file is sent as Content-Length, other descriptors such as
+ * pipes are read until end of file and sent chunked. The descriptor is not
+ * closed by the source.
+ */
+class fd_source : public body_source {
+public:
+    explicit fd_source(int fd) : m_fd(fd), m_size(unknown_size) {
+        struct stat st;
+        if (::fstat(m_fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            off_t const pos = ::lseek(m_fd, 0, SEEK_CUR);
+            if (pos >= 0 && pos <= st.st_size) {
+                m_size = uint64_t(st.st_size - pos);
+            }
+        }
+    }
+
+    uint64_t size() const {
+        return m_size;
+    }
+
+    lib::error_code read(char * buf, size_t len, size_t & read) {
+        for (;;) {
+            ssize_t const n = ::read(m_fd, buf, len);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                read = 0;
+                return lib::error_code(errno, lib::system_category());
+            }
+            read = static_cast<size_t>(n);
+            return lib::error_code();
+        }
+    }
+private:
+    int         m_fd;
+    uint64_t    m_size;
+};
+
+/// Body source that sends a whole file through a read only memory mapping
+/**
+ * Avoids the read system call per part of fd_source; parts are copied
+ * straight from the page cache into the send buffer. The descriptor must be
+ * open for reading and is not closed by the source.
+ */
+class mmap_source : public buffer_source {
+public:
+    explicit mmap_source(int fd)
+      : buffer_source(NULL, 0)
+      , m_error()
+    {
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            m_error = lib::error_code(errno, lib::system_category());
+            return;
+        }
+        if (st.st_size == 0) {
+            return;
+        }
+        void * p = ::mmap(NULL, size_t(st.st_size), PROT_READ, MAP_PRIVATE,
+            fd, 0);
+        if (p == MAP_FAILED) {
+            m_error = lib::error_code(errno, lib::system_category());
+            return;
+        }
+        ::madvise(p, size_t(st.st_size), MADV_SEQUENTIAL);
+        m_begin = static_cast<char const *>(p);
+        m_size = size_t(st.st_size);
+    }
+
+    mmap_source(mmap_source const &) = delete;
+    mmap_source & operator=(mmap_source const &) = delete;
+
+    ~mmap_source() {
+        if (m_begin) {
+            ::munmap(const_cast<char *>(m_begin), m_size);
+        }
+    }
+
+    lib::error_code read(char * buf, size_t len, size_t & read) {
+        if (m_error) {
+            read = 0;
+            return m_error;
+        }
+        return buffer_source::read(buf, len, read);
+    }
+
+    /// The error from setting up the mapping, if any
+    lib::error_code get_error() const {
+        return m_error;
+    }
+private:
+    lib::error_code m_error;
+};
+#endif // !_WIN32
+
+} // namespace http
+} // namespace websocketpp
+
+#endif // HTTP_PARSER_BODY_SOURCE_HPP
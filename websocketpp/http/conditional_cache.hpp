@@ -0,0 +1,327 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+
+#ifndef HTTP_PARSER_CONDITIONAL_CACHE_HPP
+#define HTTP_PARSER_CONDITIONAL_CACHE_HPP
+
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/system_error.hpp>
+#include <websocketpp/common/thread.hpp>
+#include <websocketpp/http/constants.hpp>
+#include <websocketpp/http/request.hpp>
+#include <websocketpp/http/response.hpp>
+#include <websocketpp/utilities.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+namespace websocketpp {
+namespace http {
+
+/// Responses to HTTP client GET requests, revalidated with conditional requests
+/**
+ * Client connections with a conditional cache, see client::set_http_cache,
+ * store each 200 response to a GET request that carries an ETag or a
+ * Last-Modified header, with its decoded body. The next GET request to the
+ * same URI is sent with If-None-Match and If-Modified-Since, and a 304 Not
+ * Modified answer is turned back into the stored response before the http
+ * handler sees it: the status, the headers updated by the 304 and the body,
+ * which is passed to the body sink instead if the request has one. An
+ * unchanged resource is neither downloaded nor decompressed again.
+ *
+ * Every request is revalidated, freshness information such as max-age is
+ * not used to skip requests. Responses marked no-store, responses that vary
+ * on request headers other than Accept-Encoding and responses whose body
+ * went to a body sink are not stored. Requests that already carry their own
+ * If-None-Match or If-Modified-Since header are sent unchanged.
+ *
+ * The cache may be shared between endpoints and used from several threads.
+ *
+ * @since 0.9.0
+ */
+class conditional_cache {
+public:
+    typedef lib::shared_ptr<conditional_cache> ptr;
+
+    /// Construct a cache
+    /**
+     * @param max_entries The number of URIs remembered. Once the cache is
+     * full the oldest entries are forgotten.
+     */
+    explicit conditional_cache(size_t max_entries = 64)
+      : m_max_entries(max_entries) {}
+
+    /// Add validators for the stored response to a request
+    /**
+     * Called by client connections just before the request is written.
+     *
+     * @param key The absolute URI of the request
+     * @param req The request to add If-None-Match and If-Modified-Since to
+     */
+    void prepare(std::string const & key, parser::request & req) const {
+        if (req.get_method() != "GET" ||
+            !req.get_header("If-None-Match").empty() ||
+            !req.get_header("If-Modified-Since").empty())
+        {
+            return;
+        }
+
+        entry_ptr e = this->find(key);
+        if (!e) {
+            return;
+        }
+
+        std::string const & etag = e->get_header("ETag");
+        if (!etag.empty()) {
+            req.replace_header("If-None-Match", etag);
+        }
+        std::string const & modified = e->get_header("Last-Modified");
+        if (!modified.empty()) {
+            req.replace_header("If-Modified-Since", modified);
+        }
+    }
+
+    /// Store a response, or restore the stored one from a 304
+    /**
+     * Called by client connections once the response is complete, before the
+     * http handler.
+     *
+     * @param key The absolute URI of the request
+     * @param req The request that was sent
+     * @param res The response, replaced by the stored one on a 304
+     * @return A status code, zero on success, non-zero otherwise
+     */
+    lib::error_code update(std::string const & key,
+        parser::request const & req, parser::response & res)
+    {
+        if (req.get_method() != "GET") {
+            return lib::error_code();
+        }
+
+        if (res.get_status_code() == status_code::not_modified) {
+            entry_ptr e = this->find(key);
+            if (!e || !validates(*e, req)) {
+                // not an answer to validators of ours
+                return lib::error_code();
+            }
+            return this->restore(key, *e, res);
+        }
+
+        if (res.get_status_code() != status_code::ok) {
+            return lib::error_code();
+        }
+
+        if (!storable(res)) {
+            this->remove(key);
+            return lib::error_code();
+        }
+
+        parser::response stored;
+        lib::error_code ec = copy(res, res.get_body(), stored);
+        if (!ec) {
+            this->insert(key, stored);
+        }
+        return ec;
+    }
+
+    /// Forget the response stored for a URI
+    /**
+     * @return Whether there was a response to forget
+     */
+    bool remove(std::string const & key) {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        if (m_entries.erase(key) == 0) {
+            return false;
+        }
+        m_order.erase(std::find(m_order.begin(), m_order.end(), key));
+        return true;
+    }
+
+    /// Forget every stored response
+    void clear() {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        m_entries.clear();
+        m_order.clear();
+    }
+
+    /// Get the number of stored responses
+    size_t size() const {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        return m_entries.size();
+    }
+private:
+    typedef lib::shared_ptr<parser::response const> entry_ptr;
+
+    entry_ptr find(std::string const & key) const {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        std::unordered_map<std::string, entry_ptr>::const_iterator it =
+            m_entries.find(key);
+        return it == m_entries.end() ? entry_ptr() : it->second;
+    }
+
+    void insert(std::string const & key, parser::response const & res) {
+        entry_ptr e = lib::make_shared<parser::response const>(res);
+
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        if (m_max_entries == 0) {
+            return;
+        }
+        if (m_entries.find(key) == m_entries.end()) {
+            if (m_entries.size() == m_max_entries) {
+                m_entries.erase(m_order.front());
+                m_order.pop_front();
+            }
+            m_order.push_back(key);
+        }
+        m_entries[key] = e;
+    }
+
+    static bool has_token(std::string const & value, char const * token) {
+        return utility::ci_find_substr(value, std::string(token)) !=
+            value.end();
+    }
+
+    static bool storable(parser::response const & res) {
+        if (res.get_body_sink() ||
+            has_token(res.get_header("Cache-Control"), "no-store"))
+        {
+            return false;
+        }
+        if (res.get_header("ETag").empty() &&
+            res.get_header("Last-Modified").empty())
+        {
+            return false;
+        }
+
+        // the body is stored decoded, so only a varying encoding is fine
+        std::string const & vary = res.get_header("Vary");
+        if (vary.empty()) {
+            return true;
+        }
+        return same_name(parser::strip_lws(vary), "Accept-Encoding");
+    }
+
+    static bool validates(parser::response const & stored, parser::request const & req)
+    {
+        std::string const & etag = stored.get_header("ETag");
+        std::string const & modified = stored.get_header("Last-Modified");
+        return (!etag.empty() && req.get_header("If-None-Match") == etag) ||
+            (!modified.empty() &&
+             req.get_header("If-Modified-Since") == modified);
+    }
+
+    // copy the status and headers of res to out, with body as its body
+    static lib::error_code copy(parser::response const & res, std::string body,
+        parser::response & out)
+    {
+        lib::error_code ec = out.set_version(res.get_version());
+        if (!ec) {
+            ec = out.set_status(res.get_status_code(), res.get_status_msg());
+        }
+        for (auto const & header : res.get_headers()) {
+            if (!ec && !body_header(header.first)) {
+                ec = out.append_header(header.first, header.second);
+            }
+        }
+        if (!ec) {
+            ec = out.set_body(std::move(body));
+        }
+        return ec;
+    }
+
+    static bool same_name(std::string const & a, std::string const & b) {
+        utility::ci_less less;
+        return !less(a, b) && !less(b, a);
+    }
+
+    // headers that describe the bytes on the wire rather than the resource
+    static bool body_header(std::string const & name) {
+        return same_name(name, Header_ContentLength) ||
+            same_name(name, Header_TransferEncoding) ||
+            same_name(name, Header_ContentEncoding);
+    }
+
+    // turn the 304 in res into the stored response, updated by its headers
+    lib::error_code restore(std::string const & key, parser::response const & stored,
+        parser::response & res)
+    {
+        parser::response updated;
+        lib::error_code ec = copy(stored, stored.get_body(), updated);
+        for (auto const & header : res.get_headers()) {
+            if (!ec && !body_header(header.first)) {
+                ec = updated.replace_header(header.first, header.second);
+            }
+        }
+        if (ec) {
+            return ec;
+        }
+        this->insert(key, updated);
+
+        // res keeps its parser state and body sink, only its contents change
+        res.set_status(stored.get_status_code(), stored.get_status_msg());
+        res.remove_header(Header_ContentLength);
+        res.remove_header(Header_TransferEncoding);
+        res.remove_header(Header_ContentEncoding);
+        for (auto const & header : stored.get_headers()) {
+            if (!ec && !body_header(header.first) &&
+                res.get_header(header.first).empty())
+            {
+                ec = res.append_header(header.first, header.second);
+            }
+        }
+        if (ec) {
+            return ec;
+        }
+
+        body_sink::ptr sink = res.get_body_sink();
+        if (!sink) {
+            return res.set_body(stored.get_body());
+        }
+        ec = res.replace_header(Header_ContentLength,
+            std::to_string(stored.get_body().size()));
+        if (!ec && !stored.get_body().empty()) {
+            ec = sink->write(stored.get_body().data(),
+                stored.get_body().size());
+        }
+        return ec;
+    }
+
+    size_t const m_max_entries;
+    std::unordered_map<std::string, entry_ptr> m_entries;
+    /// Keys of m_entries, oldest first
+    std::deque<std::string> m_order;
+    mutable lib::mutex m_lock;
+};
+
+} // namespace http
+} // namespace websocketpp
+
+#endif // HTTP_PARSER_CONDITIONAL_CACHE_HPP
@@ -145,6 +145,7 @@ enum value {
     not_modified = 304,
     use_proxy = 305,
     temporary_redirect = 307,
+    permanent_redirect = 308,
 
     bad_request = 400,
     unauthorized = 401,
@@ -165,6 +166,7 @@ enum value {
     request_range_not_satisfiable = 416,
     expectation_failed = 417,
     im_a_teapot = 418,
+    too_early = 425,
     upgrade_required = 426,
     precondition_required = 428,
     too_many_requests = 429,
@@ -189,7 +191,21 @@ enum value {
  */
 inline bool is_redirect(value code) {
 	// multiple_choices is not a valid redirect as we can't just go to the location specified in the Location header
-	return code > multiple_choices && code <= temporary_redirect;
+	return code > multiple_choices && code <= permanent_redirect &&
+		code != not_modified && code != use_proxy;
+}
+
+/// Given a status code value, return true if it is a permanent redirect
+/**
+ * Permanent redirects may be cached, the target replaces the original URI.
+ *
+ * @since 0.9.0
+ *
+ * @param[in] code The HTTP status code to check
+ * @return True if the status code is 301 or 308
+ */
+inline bool is_permanent_redirect(value code) {
+	return code == moved_permanently || code == permanent_redirect;
 }
 
 /// Given a status code value, return the default status message
@@ -235,6 +251,8 @@ inline std::string get_string(value code) {
             return "Use Proxy";
         case temporary_redirect:
             return "Temporary Redirect";
+        case permanent_redirect:
+            return "Permanent Redirect";
         case bad_request:
             return "Bad Request";
         case unauthorized:
@@ -273,6 +291,8 @@ inline std::string get_string(value code) {
             return "Expectation Failed";
         case im_a_teapot:
             return "I'm a teapot";
+        case too_early:
+            return "Too Early";
         case upgrade_required:
             return "Upgrade Required";
         case precondition_required:
@@ -380,6 +400,15 @@ enum value {
     /// An istream read succeeded but read (and discarded) more bits from the
     /// stream than it needed
     istream_overread,
+
+    /// The body is corrupt or truncated for its content encoding
+    invalid_content_encoding,
+
+    /// The body sink can only append, not write at an offset
+    sink_not_seekable,
+
+    /// The response does not hold the requested byte range
+    range_not_satisfied
 };
 
 /// Get the HTTP status code associated with the error
@@ -413,6 +442,12 @@ inline status_code::value get_status_code(error::value value) {
             return status_code::internal_server_error;
         case error::istream_overread:
             return status_code::internal_server_error;
+        case error::invalid_content_encoding:
+            return status_code::bad_request;
+        case error::sink_not_seekable:
+            return status_code::internal_server_error;
+        case error::range_not_satisfied:
+            return status_code::bad_gateway;
         default:
             return status_code::bad_request;
     }
@@ -451,6 +486,12 @@ public:
                 return "An istream read command returned with the bad flag set";
             case error::istream_overread:
                 return "An istream read succeeded but read (and discarded) more bits from the stream than it needed";
+            case error::invalid_content_encoding:
+                return "The body is corrupt or truncated for its content encoding";
+            case error::sink_not_seekable:
+                return "The body sink can not write at an offset";
+            case error::range_not_satisfied:
+                return "The response does not hold the requested byte range";
             default:
                 return "Unknown";
         }
@@ -7,6 +7,14 @@
 
 #include <websocketpp/http/constants.hpp>
 
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
 #ifndef WEBSOCKETPP_WITH_GZIP
 #define WEBSOCKETPP_WITH_GZIP 0
 #elif WEBSOCKETPP_WITH_GZIP
@@ -55,99 +63,225 @@ inline constexpr bool is_encoding_supported(content_encoding::value encoding)
 
 namespace encoding
 {
-#if WEBSOCKETPP_WITH_GZIP
-namespace gzip
-{
-constexpr int MOD_GZIP_ZLIB_WINDOWSIZE = 15;
-constexpr int MOD_GZIP_ZLIB_CFACTOR = 9;
-inline std::string compress(const std::string& str, lib::error_code& ec,
-                          int compressionlevel = Z_BEST_COMPRESSION)
+#if WEBSOCKETPP_WITH_GZIP || WEBSOCKETPP_WITH_DEFLATE
+namespace detail
 {
-	z_stream zs;                        // z_stream is zlib's control structure
-	memset(&zs, 0, sizeof(zs));
-
-	if (deflateInit2(&zs,
-	                 compressionlevel,
-	                 Z_DEFLATED,
-	                 MOD_GZIP_ZLIB_WINDOWSIZE + 16,
-	                 MOD_GZIP_ZLIB_CFACTOR,
-	                 Z_DEFAULT_STRATEGY) != Z_OK
-	) {
-		throw(std::runtime_error("deflateInit2 failed while compressing."));
+/// A zlib inflate context kept for reuse by the one-shot functions
+/**
+ * Setting up a z_stream allocates the window and state, which dominates the
+ * cost of decoding small bodies. The context is reset rather than rebuilt
+ * when the next call uses the same parameters.
+ */
+class zlib_inflater {
+public:
+	zlib_inflater() : m_window_bits(0), m_ready(false) {
+		memset(&m_zs, 0, sizeof(m_zs));
 	}
 
-	zs.next_in = (Bytef*)str.data();
-	zs.avail_in = str.size();           // set the z_stream's input
+	zlib_inflater(zlib_inflater const &) = delete;
+	zlib_inflater & operator=(zlib_inflater const &) = delete;
 
-	int ret;
-	char outbuffer[32768];
-	std::string outstring;
+	~zlib_inflater() {
+		if (m_ready) {
+			inflateEnd(&m_zs);
+		}
+	}
 
-	// retrieve the compressed bytes blockwise
-	do {
-		zs.next_out = reinterpret_cast<Bytef*>(outbuffer);
-		zs.avail_out = sizeof(outbuffer);
+	/// Return a stream ready for a new input, or null if zlib failed
+	z_stream * get(int window_bits) {
+		if (m_ready && window_bits == m_window_bits) {
+			if (inflateReset(&m_zs) == Z_OK) {
+				return &m_zs;
+			}
+		}
+
+		if (m_ready) {
+			inflateEnd(&m_zs);
+			memset(&m_zs, 0, sizeof(m_zs));
+			m_ready = false;
+		}
+		if (inflateInit2(&m_zs, window_bits) != Z_OK) {
+			return nullptr;
+		}
+		m_window_bits = window_bits;
+		m_ready = true;
+		return &m_zs;
+	}
+private:
+	z_stream m_zs;
+	int m_window_bits;
+	bool m_ready;
+};
+
+/// A zlib deflate context kept for reuse by the one-shot functions
+class zlib_deflater {
+public:
+	zlib_deflater() : m_level(0), m_window_bits(0), m_ready(false) {
+		memset(&m_zs, 0, sizeof(m_zs));
+	}
 
-		ret = deflate(&zs, Z_FINISH);
+	zlib_deflater(zlib_deflater const &) = delete;
+	zlib_deflater & operator=(zlib_deflater const &) = delete;
 
-		if (outstring.size() < zs.total_out) {
-			// append the block to the output string
-			outstring.append(outbuffer,
-			                 zs.total_out - outstring.size());
+	~zlib_deflater() {
+		if (m_ready) {
+			deflateEnd(&m_zs);
 		}
-	} while (ret == Z_OK);
+	}
+
+	/// Return a stream ready for a new input, or null if zlib failed
+	z_stream * get(int level, int window_bits, int mem_level) {
+		if (m_ready && level == m_level && window_bits == m_window_bits) {
+			if (deflateReset(&m_zs) == Z_OK) {
+				return &m_zs;
+			}
+		}
+
+		if (m_ready) {
+			deflateEnd(&m_zs);
+			memset(&m_zs, 0, sizeof(m_zs));
+			m_ready = false;
+		}
+		if (deflateInit2(&m_zs, level, Z_DEFLATED, window_bits, mem_level,
+			Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			return nullptr;
+		}
+		m_level = level;
+		m_window_bits = window_bits;
+		m_ready = true;
+		return &m_zs;
+	}
+private:
+	z_stream m_zs;
+	int m_level;
+	int m_window_bits;
+	bool m_ready;
+};
+
+/// The inflate context of the calling thread
+inline zlib_inflater & thread_inflater() {
+	static thread_local zlib_inflater instance;
+	return instance;
+}
+
+/// The deflate context of the calling thread
+inline zlib_deflater & thread_deflater() {
+	static thread_local zlib_deflater instance;
+	return instance;
+}
 
-	deflateEnd(&zs);
+/// Initial output size for inflating len bytes
+/**
+ * zlib cannot expand data by more than about 1032:1, which also bounds an
+ * untrusted size hint.
+ */
+inline size_t inflate_reserve(size_t len, size_t size_hint) {
+	size_t const limit = len * 1032 + 64;
+	if (size_hint) {
+		return std::min(size_hint, limit);
+	}
+	return std::min(len * 4 + 64, limit);
+}
+
+/// Compress str in a single deflate call into an output sized by deflateBound
+inline std::string deflate_all(const std::string& str, int level,
+	int window_bits, int mem_level)
+{
+	z_stream * zs = thread_deflater().get(level, window_bits, mem_level);
+	if (!zs) {
+		throw(std::runtime_error("deflateInit2 failed while compressing."));
+	}
+
+	std::string outstring;
+	outstring.resize(deflateBound(zs, static_cast<uLong>(str.size())));
 
+	zs->next_in = (Bytef*)str.data();
+	zs->avail_in = static_cast<uInt>(str.size());
+	zs->next_out = reinterpret_cast<Bytef*>(&outstring[0]);
+	zs->avail_out = static_cast<uInt>(outstring.size());
+
+	int const ret = deflate(zs, Z_FINISH);
 	if (ret != Z_STREAM_END) {          // an error occurred that was not EOF
 		std::ostringstream oss;
-		oss << "Exception during zlib compression: (" << ret << ") " << zs.msg;
+		oss << "Exception during zlib compression: (" << ret << ") "
+		    << (zs->msg ? zs->msg : "");
 		throw(std::runtime_error(oss.str()));
 	}
 
+	outstring.resize(zs->total_out);
 	return outstring;
 }
 
-inline std::string decompress(const std::string& str, lib::error_code& ec)
+/// Inflate str straight into the output string, growing it as needed
+inline std::string inflate_all(const std::string& str, int window_bits,
+	size_t size_hint)
 {
-	z_stream zs;                        // z_stream is zlib's control structure
-	memset(&zs, 0, sizeof(zs));
-
-	if (inflateInit2(&zs, MOD_GZIP_ZLIB_WINDOWSIZE + 16) != Z_OK)
+	z_stream * zs = thread_inflater().get(window_bits);
+	if (!zs) {
 		throw(std::runtime_error("inflateInit failed while decompressing."));
+	}
 
-	zs.next_in = (Bytef*)str.data();
-	zs.avail_in = str.size();
-
-	int ret;
-	char outbuffer[32768];
 	std::string outstring;
+	outstring.resize(inflate_reserve(str.size(), size_hint));
 
-	// get the decompressed bytes blockwise using repeated calls to inflate
-	do {
-		zs.next_out = reinterpret_cast<Bytef*>(outbuffer);
-		zs.avail_out = sizeof(outbuffer);
-
-		ret = inflate(&zs, 0);
+	zs->next_in = (Bytef*)str.data();
+	zs->avail_in = static_cast<uInt>(str.size());
 
-		if (outstring.size() < zs.total_out) {
-			outstring.append(outbuffer,
-			                 zs.total_out - outstring.size());
+	int ret;
+	do {
+		if (zs->total_out == outstring.size()) {
+			outstring.resize(outstring.size() * 2);
 		}
+		zs->next_out = reinterpret_cast<Bytef*>(&outstring[zs->total_out]);
+		zs->avail_out = static_cast<uInt>(outstring.size() - zs->total_out);
 
+		ret = inflate(zs, Z_NO_FLUSH);
 	} while (ret == Z_OK);
 
-	inflateEnd(&zs);
-
 	if (ret != Z_STREAM_END) {          // an error occurred that was not EOF
 		std::ostringstream oss;
 		oss << "Exception during zlib decompression: (" << ret << ") "
-		    << zs.msg;
+		    << (zs->msg ? zs->msg : "");
 		throw(std::runtime_error(oss.str()));
 	}
 
+	outstring.resize(zs->total_out);
 	return outstring;
 }
+}    // namespace detail
+#endif
+
+#if WEBSOCKETPP_WITH_GZIP
+namespace gzip
+{
+constexpr int MOD_GZIP_ZLIB_WINDOWSIZE = 15;
+constexpr int MOD_GZIP_ZLIB_CFACTOR = 9;
+inline std::string compress(const std::string& str, lib::error_code& ec,
+                          int compressionlevel = Z_BEST_COMPRESSION)
+{
+	return detail::deflate_all(str, compressionlevel,
+	                           MOD_GZIP_ZLIB_WINDOWSIZE + 16,
+	                           MOD_GZIP_ZLIB_CFACTOR);
+}
+
+/// Decompress a gzip stream
+/**
+ * @param size_hint The expected decompressed size, if known. Without one the
+ * size recorded in the gzip trailer is used.
+ */
+inline std::string decompress(const std::string& str, lib::error_code& ec,
+                              size_t size_hint = 0)
+{
+	if (!size_hint && str.size() >= 18) {
+		// ISIZE, the uncompressed length modulo 2^32, little endian
+		unsigned char const * t = reinterpret_cast<unsigned char const *>(
+			str.data() + str.size() - 4);
+		size_hint = size_t(t[0]) | (size_t(t[1]) << 8) |
+		            (size_t(t[2]) << 16) | (size_t(t[3]) << 24);
+	}
+	return detail::inflate_all(str, MOD_GZIP_ZLIB_WINDOWSIZE + 16, size_hint);
+}
 
 }    // namespace gzip
 #endif
@@ -158,85 +292,14 @@ constexpr int ZLIB_BUFFER_SIZE = 10240;
 /** Compress a STL string using zlib with given compression level and return* the binary data. */
 inline std::string compress(const std::string& str, lib::error_code& ec, int compressionlevel = Z_BEST_COMPRESSION)
 {
-	z_stream zs;    // z_stream is zlib's control structure
-	memset(&zs, 0, sizeof(zs));
-
-	if (deflateInit(&zs, compressionlevel) != Z_OK)
-		throw(std::runtime_error("deflateInit failed while compressing."));
-
-	zs.next_in = (Bytef*)str.data();
-	zs.avail_in = str.size();    // set the z_stream's input
-
-	int ret;
-	char outbuffer[ZLIB_BUFFER_SIZE];
-	std::string outstring;
-
-	// retrieve the compressed bytes blockwise
-	do {
-		zs.next_out = reinterpret_cast<Bytef*>(outbuffer);
-		zs.avail_out = sizeof(outbuffer);
-
-		ret = deflate(&zs, Z_FINISH);
-
-		if (outstring.size() < zs.total_out)
-		{
-			// append the block to the output string
-			outstring.append(outbuffer, zs.total_out - outstring.size());
-		}
-	} while (ret == Z_OK);
-
-	deflateEnd(&zs);
-
-	if (ret != Z_STREAM_END)
-	{    // an error occurred that was not EOF
-		std::ostringstream oss;
-		oss << "Exception during zlib compression: (" << ret << ") " << zs.msg;
-		throw(std::runtime_error(oss.str()));
-	}
-
-	return outstring;
+	return detail::deflate_all(str, compressionlevel, MAX_WBITS, 8);
 }
 
 /** Decompress an STL string using zlib and return the original data. */
-inline std::string decompress(const std::string& str, lib::error_code& ec)
+inline std::string decompress(const std::string& str, lib::error_code& ec,
+                              size_t size_hint = 0)
 {
-	z_stream zs;    // z_stream is zlib's control structure
-	memset(&zs, 0, sizeof(zs));
-
-	if (inflateInit(&zs) != Z_OK)
-		throw(std::runtime_error("inflateInit failed while decompressing."));
-
-	zs.next_in = (Bytef*)str.data();
-	zs.avail_in = str.size();
-
-	int ret;
-	char outbuffer[ZLIB_BUFFER_SIZE];
-	std::string outstring;
-
-	// get the decompressed bytes blockwise using repeated calls to inflate
-	do {
-		zs.next_out = reinterpret_cast<Bytef*>(outbuffer);
-		zs.avail_out = sizeof(outbuffer);
-
-		ret = inflate(&zs, 0);
-
-		if (outstring.size() < zs.total_out)
-		{
-			outstring.append(outbuffer, zs.total_out - outstring.size());
-		}
-
-	} while (ret == Z_OK);
-
-	inflateEnd(&zs);
-
-	if (ret != Z_STREAM_END)
-	{    // an error occurred that was not EOF
-		std::ostringstream oss;
-		oss << "Exception during zlib decompression: (" << ret << ") " << zs.msg;
-		throw(std::runtime_error(oss.str()));
-	}
-
-	return outstring;
+	return detail::inflate_all(str, MAX_WBITS, size_hint);
 }
 }    // namespace zlib
 #endif
@@ -247,51 +310,87 @@ namespace brotli
 constexpr size_t BROTLI_BUFFER_SIZE = 2048;
 inline std::string compress(const std::string& data, lib::error_code& ec)
 {
-	auto instance = BrotliEncoderCreateInstance(nullptr, nullptr, nullptr);
-	std::array<uint8_t, BROTLI_BUFFER_SIZE> buffer;
-	std::stringstream result;
-
-	size_t available_in = data.length(), available_out = buffer.size();
-	const uint8_t* next_in = reinterpret_cast<const uint8_t*>(data.c_str());
-	uint8_t* next_out = buffer.data();
+	// one shot into an output sized for the worst case
+	size_t encoded_size = BrotliEncoderMaxCompressedSize(data.size());
+	std::string result;
+	result.resize(encoded_size ? encoded_size : data.size() + 1024);
+	encoded_size = result.size();
+
+	if (!BrotliEncoderCompress(BROTLI_DEFAULT_QUALITY, BROTLI_DEFAULT_WINDOW,
+	                           BROTLI_MODE_GENERIC, data.size(),
+	                           reinterpret_cast<const uint8_t*>(data.data()),
+	                           &encoded_size,
+	                           reinterpret_cast<uint8_t*>(&result[0])))
+	{
+		throw(std::runtime_error("Exception during brotli compression"));
+	}
 
-	do {
-		BrotliEncoderCompressStream(instance, BROTLI_OPERATION_FINISH, &available_in, &next_in, &available_out, &next_out, nullptr);
-		result.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() - available_out);
-		available_out = buffer.size();
-		next_out = buffer.data();
-	} while (!(available_in == 0 && BrotliEncoderIsFinished(instance)));
-
-	BrotliEncoderDestroyInstance(instance);
-	return result.str();
+	result.resize(encoded_size);
+	return result;
 }
 
-inline std::string decompress(const std::string& data, lib::error_code& ec)
+inline std::string decompress(const std::string& data, lib::error_code& ec,
+                              size_t size_hint = 0)
 {
+	// brotli has no way to reset a decoder, so only the output is presized
 	auto instance = BrotliDecoderCreateInstance(nullptr, nullptr, nullptr);
-	std::array<uint8_t, BROTLI_BUFFER_SIZE> buffer;
-	std::stringstream result;
+	std::string result;
+	result.resize(size_hint ? size_hint : data.size() * 4 + 64);
 
-	size_t available_in = data.length(), available_out = buffer.size();
-	const uint8_t* next_in = reinterpret_cast<const uint8_t*>(data.c_str());
-	uint8_t* next_out = buffer.data();
+	size_t available_in = data.length();
+	const uint8_t* next_in = reinterpret_cast<const uint8_t*>(data.data());
+	size_t written = 0;
 	BrotliDecoderResult oneshot_result;
 
 	do {
+		if (written == result.size()) {
+			result.resize(result.size() * 2);
+		}
+		size_t available_out = result.size() - written;
+		uint8_t* next_out = reinterpret_cast<uint8_t*>(&result[written]);
+
 		oneshot_result = BrotliDecoderDecompressStream(instance, &available_in, &next_in, &available_out, &next_out, nullptr);
-		result.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() - available_out);
-		available_out = buffer.size();
-		next_out = buffer.data();
-	} while (!(available_in == 0 && oneshot_result == BROTLI_DECODER_RESULT_SUCCESS));
+		written = result.size() - available_out;
+	} while (oneshot_result == BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT);
 
 	BrotliDecoderDestroyInstance(instance);
-	return result.str();
+
+	if (oneshot_result != BROTLI_DECODER_RESULT_SUCCESS) {
+		throw(std::runtime_error("Exception during brotli decompression"));
+	}
+
+	result.resize(written);
+	return result;
 }
 }    // namespace brotli
 #endif
 
 #if WEBSOCKETPP_WITH_ZSTD
 namespace zstd {
+namespace detail {
+/// Compression context of the calling thread, reused across calls
+inline ZSTD_CCtx * thread_cctx() {
+	struct holder {
+		ZSTD_CCtx * ctx;
+		holder() : ctx(ZSTD_createCCtx()) {}
+		~holder() { ZSTD_freeCCtx(ctx); }
+	};
+	static thread_local holder instance;
+	return instance.ctx;
+}
+
+/// Decompression context of the calling thread, reused across calls
+inline ZSTD_DCtx * thread_dctx() {
+	struct holder {
+		ZSTD_DCtx * ctx;
+		holder() : ctx(ZSTD_createDCtx()) {}
+		~holder() { ZSTD_freeDCtx(ctx); }
+	};
+	static thread_local holder instance;
+	return instance.ctx;
+}
+} // namespace detail
+
 inline std::string compress(const std::string& data, lib::error_code& ec, int compress_level = ZSTD_CLEVEL_DEFAULT) {
 
 	size_t est_compress_size = ZSTD_compressBound(data.size());
@@ -300,56 +399,695 @@ inline std::string compress(const std::string& data, lib::error_code& ec, int co
 	comp_buffer.resize(est_compress_size);
 
 	auto compress_size =
-	  ZSTD_compress((void*)comp_buffer.data(), est_compress_size, data.data(),
-	                data.size(), compress_level);
+	  ZSTD_compressCCtx(detail::thread_cctx(), (void*)comp_buffer.data(),
+	                    est_compress_size, data.data(), data.size(),
+	                    compress_level);
+	if (ZSTD_isError(compress_size)) {
+		throw(std::runtime_error("Exception during zstd compression"));
+	}
 
 	comp_buffer.resize(compress_size);
-	comp_buffer.shrink_to_fit();
-
 	return comp_buffer;
 }
 
-inline std::string decompress(const std::string& data, lib::error_code& ec) {
+inline std::string decompress(const std::string& data, lib::error_code& ec,
+                              size_t size_hint = 0) {
+	ZSTD_DCtx * dctx = detail::thread_dctx();
+	ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
 
-	size_t const est_decomp_size =
-	  ZSTD_getDecompressedSize(data.data(), data.size());
+	unsigned long long const frame_size =
+	  ZSTD_getFrameContentSize(data.data(), data.size());
 
 	std::string decomp_buffer;
-	decomp_buffer.resize(est_decomp_size);
 
-	size_t const decomp_size = ZSTD_decompress(
-	  (void*)decomp_buffer.data(), est_decomp_size, data.data(), data.size());
+	if (frame_size != ZSTD_CONTENTSIZE_UNKNOWN &&
+	    frame_size != ZSTD_CONTENTSIZE_ERROR)
+	{
+		// the frame records its size, decompress in one call
+		decomp_buffer.resize(static_cast<size_t>(frame_size));
+		size_t const decomp_size = ZSTD_decompressDCtx(dctx,
+		  (void*)decomp_buffer.data(), decomp_buffer.size(), data.data(),
+		  data.size());
+		if (ZSTD_isError(decomp_size)) {
+			throw(std::runtime_error("Exception during zstd decompression"));
+		}
+		decomp_buffer.resize(decomp_size);
+		return decomp_buffer;
+	}
+
+	decomp_buffer.resize(size_hint ? size_hint : data.size() * 4 + 64);
+	ZSTD_inBuffer input = { data.data(), data.size(), 0 };
+	size_t written = 0;
+	size_t ret;
+
+	do {
+		if (written == decomp_buffer.size()) {
+			decomp_buffer.resize(decomp_buffer.size() * 2);
+		}
+		ZSTD_outBuffer output = { &decomp_buffer[0], decomp_buffer.size(), written };
+		ret = ZSTD_decompressStream(dctx, &output, &input);
+		if (ZSTD_isError(ret)) {
+			throw(std::runtime_error("Exception during zstd decompression"));
+		}
+		written = output.pos;
+	} while (ret != 0 && (input.pos < input.size || written == decomp_buffer.size()));
 
-	decomp_buffer.resize(decomp_size);
-	decomp_buffer.shrink_to_fit();
+	if (ret != 0) {
+		throw(std::runtime_error("Truncated input during zstd decompression"));
+	}
+
+	decomp_buffer.resize(written);
 	return decomp_buffer;
 }
 
 } // namespace zstd
 #endif
 
-inline std::string decompress(http::content_encoding::value encoding, bool is_transfer_encoding, const std::string& str, lib::error_code& ec)
+/// Incremental decoder for a single content encoding
+/**
+ * Decodes a body as it arrives instead of all at once at the end. A decoder
+ * can be reused for another body with init, which resets the existing
+ * compression context where the library allows it rather than allocating a
+ * new one.
+ *
+ * @since 0.9.0
+ */
+class decoder {
+public:
+	decoder()
+	  : m_encoding(http::content_encoding::value(0))
+	  , m_ready(false)
+	  , m_done(false)
+	  , m_fed(false)
+#if WEBSOCKETPP_WITH_BROTLI
+	  , m_brotli(nullptr)
+#endif
+#if WEBSOCKETPP_WITH_ZSTD
+	  , m_zstd(nullptr)
+#endif
+	{
+#if WEBSOCKETPP_WITH_GZIP || WEBSOCKETPP_WITH_DEFLATE
+		memset(&m_zs, 0, sizeof(m_zs));
+#endif
+	}
+
+	decoder(decoder const &) = delete;
+	decoder & operator=(decoder const &) = delete;
+
+	~decoder() {
+		release();
+	}
+
+	/// Prepare to decode a new body
+	/**
+	 * @param encoding The content encoding of the body
+	 * @return unsupported_content_encoding if support for the encoding was not
+	 * compiled in
+	 */
+	lib::error_code init(http::content_encoding::value encoding) {
+		m_done = false;
+		m_fed = false;
+
+		if (m_ready && encoding == m_encoding) {
+			switch (encoding) {
+#if WEBSOCKETPP_WITH_GZIP || WEBSOCKETPP_WITH_DEFLATE
+				case http::content_encoding::gzip:
+				case http::content_encoding::deflate:
+					inflateReset(&m_zs);
+					return lib::error_code();
+#endif
+#if WEBSOCKETPP_WITH_ZSTD
+				case http::content_encoding::zstd:
+					ZSTD_DCtx_reset(m_zstd, ZSTD_reset_session_only);
+					return lib::error_code();
+#endif
+				default:
+					// brotli has no reset, start over
+					break;
+			}
+		}
+
+		release();
+		m_encoding = encoding;
+
+		switch (encoding) {
+#if WEBSOCKETPP_WITH_GZIP
+			case http::content_encoding::gzip:
+				if (inflateInit2(&m_zs, gzip::MOD_GZIP_ZLIB_WINDOWSIZE + 16) != Z_OK) {
+					return http::error::make_error_code(http::error::general);
+				}
+				m_ready = true;
+				return lib::error_code();
+#endif
+#if WEBSOCKETPP_WITH_DEFLATE
+			case http::content_encoding::deflate:
+				if (inflateInit(&m_zs) != Z_OK) {
+					return http::error::make_error_code(http::error::general);
+				}
+				m_ready = true;
+				return lib::error_code();
+#endif
+#if WEBSOCKETPP_WITH_BROTLI
+			case http::content_encoding::brotli:
+				m_brotli = BrotliDecoderCreateInstance(nullptr, nullptr, nullptr);
+				if (!m_brotli) {
+					return http::error::make_error_code(http::error::general);
+				}
+				m_ready = true;
+				return lib::error_code();
+#endif
+#if WEBSOCKETPP_WITH_ZSTD
+			case http::content_encoding::zstd:
+				m_zstd = ZSTD_createDStream();
+				if (!m_zstd) {
+					return http::error::make_error_code(http::error::general);
+				}
+				ZSTD_initDStream(m_zstd);
+				m_ready = true;
+				return lib::error_code();
+#endif
+			default: break;
+		}
+
+		return http::error::make_error_code(http::error::unsupported_content_encoding);
+	}
+
+	/// Decode the next part of the body
+	/**
+	 * Decoded bytes are appended to out. Input after the end of the encoded
+	 * stream is ignored.
+	 *
+	 * @param in The encoded bytes
+	 * @param len The number of encoded bytes
+	 * @param out The string to append decoded bytes to
+	 * @return invalid_content_encoding if the input is corrupt
+	 */
+	lib::error_code decode(char const * in, size_t len, std::string & out) {
+		// unused when no encoding is compiled in
+		(void)in; (void)out;
+
+		if (!m_ready) {
+			return http::error::make_error_code(http::error::unsupported_content_encoding);
+		}
+		if (m_done || len == 0) {
+			return lib::error_code();
+		}
+		m_fed = true;
+
+		switch (m_encoding) {
+#if WEBSOCKETPP_WITH_GZIP || WEBSOCKETPP_WITH_DEFLATE
+			case http::content_encoding::gzip:
+			case http::content_encoding::deflate: {
+				char buffer[buffer_size];
+				m_zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in));
+				m_zs.avail_in = static_cast<uInt>(len);
+
+				do {
+					m_zs.next_out = reinterpret_cast<Bytef *>(buffer);
+					m_zs.avail_out = sizeof(buffer);
+
+					int const ret = inflate(&m_zs, Z_NO_FLUSH);
+					if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+						return http::error::make_error_code(http::error::invalid_content_encoding);
+					}
+					out.append(buffer, sizeof(buffer) - m_zs.avail_out);
+
+					if (ret == Z_STREAM_END) {
+						m_done = true;
+						break;
+					}
+					if (ret == Z_BUF_ERROR) {
+						// no progress was possible, more input is needed
+						break;
+					}
+				} while (m_zs.avail_in > 0 || m_zs.avail_out == 0);
+				return lib::error_code();
+			}
+#endif
+#if WEBSOCKETPP_WITH_BROTLI
+			case http::content_encoding::brotli: {
+				char buffer[buffer_size];
+				size_t available_in = len;
+				uint8_t const * next_in = reinterpret_cast<uint8_t const *>(in);
+
+				for (;;) {
+					size_t available_out = sizeof(buffer);
+					uint8_t * next_out = reinterpret_cast<uint8_t *>(buffer);
+
+					BrotliDecoderResult const ret = BrotliDecoderDecompressStream(
+						m_brotli, &available_in, &next_in, &available_out,
+						&next_out, nullptr);
+					if (ret == BROTLI_DECODER_RESULT_ERROR) {
+						return http::error::make_error_code(http::error::invalid_content_encoding);
+					}
+					out.append(buffer, sizeof(buffer) - available_out);
+
+					if (ret == BROTLI_DECODER_RESULT_SUCCESS) {
+						m_done = true;
+						break;
+					}
+					if (ret == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT) {
+						break;
+					}
+				}
+				return lib::error_code();
+			}
+#endif
+#if WEBSOCKETPP_WITH_ZSTD
+			case http::content_encoding::zstd: {
+				char buffer[buffer_size];
+				ZSTD_inBuffer input = { in, len, 0 };
+
+				while (input.pos < input.size) {
+					ZSTD_outBuffer output = { buffer, sizeof(buffer), 0 };
+
+					size_t const ret = ZSTD_decompressStream(m_zstd, &output, &input);
+					if (ZSTD_isError(ret)) {
+						return http::error::make_error_code(http::error::invalid_content_encoding);
+					}
+					out.append(buffer, output.pos);
+
+					if (ret == 0) {
+						m_done = true;
+						break;
+					}
+				}
+				return lib::error_code();
+			}
+#endif
+			default: break;
+		}
+
+		return http::error::make_error_code(http::error::unsupported_content_encoding);
+	}
+
+	/// Check that the body ended with a complete encoded stream
+	/**
+	 * An empty body is accepted, responses such as 204 or 304 may carry a
+	 * Content-Encoding without any content.
+	 *
+	 * @return invalid_content_encoding if the encoded stream was truncated
+	 */
+	lib::error_code finish() const {
+		if (m_fed && !m_done) {
+			return http::error::make_error_code(http::error::invalid_content_encoding);
+		}
+		return lib::error_code();
+	}
+private:
+	static size_t const buffer_size = 16384;
+
+	void release() {
+		if (!m_ready) {
+			return;
+		}
+		m_ready = false;
+
+		switch (m_encoding) {
+#if WEBSOCKETPP_WITH_GZIP || WEBSOCKETPP_WITH_DEFLATE
+			case http::content_encoding::gzip:
+			case http::content_encoding::deflate:
+				inflateEnd(&m_zs);
+				memset(&m_zs, 0, sizeof(m_zs));
+				break;
+#endif
+#if WEBSOCKETPP_WITH_BROTLI
+			case http::content_encoding::brotli:
+				BrotliDecoderDestroyInstance(m_brotli);
+				m_brotli = nullptr;
+				break;
+#endif
+#if WEBSOCKETPP_WITH_ZSTD
+			case http::content_encoding::zstd:
+				ZSTD_freeDStream(m_zstd);
+				m_zstd = nullptr;
+				break;
+#endif
+			default: break;
+		}
+	}
+
+	http::content_encoding::value m_encoding;
+	bool m_ready;
+	bool m_done;
+	bool m_fed;
+#if WEBSOCKETPP_WITH_GZIP || WEBSOCKETPP_WITH_DEFLATE
+	z_stream m_zs;
+#endif
+#if WEBSOCKETPP_WITH_BROTLI
+	BrotliDecoderState * m_brotli;
+#endif
+#if WEBSOCKETPP_WITH_ZSTD
+	ZSTD_DStream * m_zstd;
+#endif
+};
+
+/// Incremental decoder for a list of content encodings
+/**
+ * Undoes the encodings of a body in reverse order of application, passing the
+ * output of each stage to the next as it is produced.
+ *
+ * @since 0.9.0
+ */
+class decoder_chain {
+public:
+	/// Maximum number of encodings, matches the limit of the HTTP parser
+	static size_t const max_encodings = 3;
+
+	decoder_chain() : m_count(0) {}
+
+	/// Prepare to decode a new body
+	/**
+	 * @param encodings The content encodings in the order they were applied
+	 * @return A status code describing the outcome of the operation
+	 */
+	lib::error_code init(std::vector<http::content_encoding::value> const & encodings) {
+		if (encodings.size() > max_encodings) {
+			return http::error::make_error_code(http::error::unsupported_content_encoding);
+		}
+
+		m_count = encodings.size();
+		for (size_t i = 0; i < m_count; ++i) {
+			lib::error_code ec = m_stages[i].init(encodings[m_count - 1 - i]);
+			if (ec) {
+				m_count = 0;
+				return ec;
+			}
+		}
+		return lib::error_code();
+	}
+
+	/// Decode the next part of the body, appending the result to out
+	lib::error_code decode(char const * in, size_t len, std::string & out) {
+		for (size_t i = 0; i < m_count; ++i) {
+			std::string & dest = (i + 1 == m_count) ? out : m_scratch[i % 2];
+			if (&dest != &out) {
+				dest.clear();
+			}
+
+			lib::error_code ec = m_stages[i].decode(in, len, dest);
+			if (ec) {
+				return ec;
+			}
+
+			in = dest.data();
+			len = dest.size();
+		}
+		return lib::error_code();
+	}
+
+	/// Check that every stage ended with a complete encoded stream
+	lib::error_code finish() const {
+		for (size_t i = 0; i < m_count; ++i) {
+			lib::error_code ec = m_stages[i].finish();
+			if (ec) {
+				return ec;
+			}
+		}
+		return lib::error_code();
+	}
+private:
+	decoder m_stages[max_encodings];
+	size_t m_count;
+	// output of the intermediate stages, reused between calls
+	std::string m_scratch[2];
+};
+
+/// Incremental encoder for a single content encoding
+/**
+ * Compresses a body as it is produced instead of all at once, for streaming a
+ * body that is not held in memory whole. Like decoder, an encoder can be
+ * reused for another body with init, which resets the existing compression
+ * context where the library allows it.
+ *
+ * @since 0.9.0
+ */
+class encoder {
+public:
+	encoder()
+	  : m_encoding(http::content_encoding::value(0))
+	  , m_ready(false)
+#if WEBSOCKETPP_WITH_BROTLI
+	  , m_brotli(nullptr)
+#endif
+#if WEBSOCKETPP_WITH_ZSTD
+	  , m_zstd(nullptr)
+#endif
+	{
+#if WEBSOCKETPP_WITH_GZIP || WEBSOCKETPP_WITH_DEFLATE
+		memset(&m_zs, 0, sizeof(m_zs));
+#endif
+	}
+
+	encoder(encoder const &) = delete;
+	encoder & operator=(encoder const &) = delete;
+
+	~encoder() {
+		release();
+	}
+
+	/// Prepare to encode a new body
+	/**
+	 * @param encoding The content encoding to apply
+	 * @return unsupported_content_encoding if support for the encoding was not
+	 * compiled in
+	 */
+	lib::error_code init(http::content_encoding::value encoding) {
+		if (m_ready && encoding == m_encoding) {
+			switch (encoding) {
+#if WEBSOCKETPP_WITH_GZIP || WEBSOCKETPP_WITH_DEFLATE
+				case http::content_encoding::gzip:
+				case http::content_encoding::deflate:
+					deflateReset(&m_zs);
+					return lib::error_code();
+#endif
+#if WEBSOCKETPP_WITH_ZSTD
+				case http::content_encoding::zstd:
+					ZSTD_CCtx_reset(m_zstd, ZSTD_reset_session_only);
+					return lib::error_code();
+#endif
+				default:
+					// brotli has no reset, start over
+					break;
+			}
+		}
+
+		release();
+		m_encoding = encoding;
+
+		switch (encoding) {
+#if WEBSOCKETPP_WITH_GZIP
+			case http::content_encoding::gzip:
+				if (deflateInit2(&m_zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+					gzip::MOD_GZIP_ZLIB_WINDOWSIZE + 16,
+					gzip::MOD_GZIP_ZLIB_CFACTOR, Z_DEFAULT_STRATEGY) != Z_OK)
+				{
+					return http::error::make_error_code(http::error::general);
+				}
+				m_ready = true;
+				return lib::error_code();
+#endif
+#if WEBSOCKETPP_WITH_DEFLATE
+			case http::content_encoding::deflate:
+				if (deflateInit(&m_zs, Z_DEFAULT_COMPRESSION) != Z_OK) {
+					return http::error::make_error_code(http::error::general);
+				}
+				m_ready = true;
+				return lib::error_code();
+#endif
+#if WEBSOCKETPP_WITH_BROTLI
+			case http::content_encoding::brotli:
+				m_brotli = BrotliEncoderCreateInstance(nullptr, nullptr, nullptr);
+				if (!m_brotli) {
+					return http::error::make_error_code(http::error::general);
+				}
+				m_ready = true;
+				return lib::error_code();
+#endif
+#if WEBSOCKETPP_WITH_ZSTD
+			case http::content_encoding::zstd:
+				m_zstd = ZSTD_createCCtx();
+				if (!m_zstd) {
+					return http::error::make_error_code(http::error::general);
+				}
+				m_ready = true;
+				return lib::error_code();
+#endif
+			default: break;
+		}
+
+		return http::error::make_error_code(http::error::unsupported_content_encoding);
+	}
+
+	/// Encode the next part of the body
+	/**
+	 * Encoded bytes are appended to out. Compressors hold back input to find
+	 * matches, so a part may produce little or no output until the stream is
+	 * finished.
+	 *
+	 * @param in The body bytes
+	 * @param len The number of body bytes
+	 * @param finish Whether this is the last part, which ends the stream
+	 * @param out The string to append encoded bytes to
+	 * @return A status code describing the outcome of the operation
+	 */
+	lib::error_code encode(char const * in, size_t len, bool finish,
+		std::string & out)
+	{
+		// unused when no encoding is compiled in
+		(void)in; (void)len; (void)finish; (void)out;
+
+		if (!m_ready) {
+			return http::error::make_error_code(http::error::unsupported_content_encoding);
+		}
+
+		switch (m_encoding) {
+#if WEBSOCKETPP_WITH_GZIP || WEBSOCKETPP_WITH_DEFLATE
+			case http::content_encoding::gzip:
+			case http::content_encoding::deflate: {
+				char buffer[buffer_size];
+				m_zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in));
+				m_zs.avail_in = static_cast<uInt>(len);
+
+				int ret;
+				do {
+					m_zs.next_out = reinterpret_cast<Bytef *>(buffer);
+					m_zs.avail_out = sizeof(buffer);
+
+					ret = deflate(&m_zs, finish ? Z_FINISH : Z_NO_FLUSH);
+					if (ret == Z_STREAM_ERROR) {
+						return http::error::make_error_code(http::error::general);
+					}
+					out.append(buffer, sizeof(buffer) - m_zs.avail_out);
+				} while (m_zs.avail_out == 0 || (finish && ret != Z_STREAM_END));
+				return lib::error_code();
+			}
+#endif
+#if WEBSOCKETPP_WITH_BROTLI
+			case http::content_encoding::brotli: {
+				char buffer[buffer_size];
+				size_t available_in = len;
+				uint8_t const * next_in = reinterpret_cast<uint8_t const *>(in);
+				BrotliEncoderOperation const op = finish ?
+					BROTLI_OPERATION_FINISH : BROTLI_OPERATION_PROCESS;
+
+				do {
+					size_t available_out = sizeof(buffer);
+					uint8_t * next_out = reinterpret_cast<uint8_t *>(buffer);
+
+					if (!BrotliEncoderCompressStream(m_brotli, op, &available_in,
+						&next_in, &available_out, &next_out, nullptr))
+					{
+						return http::error::make_error_code(http::error::general);
+					}
+					out.append(buffer, sizeof(buffer) - available_out);
+				} while (available_in > 0 || BrotliEncoderHasMoreOutput(m_brotli) ||
+					(finish && !BrotliEncoderIsFinished(m_brotli)));
+				return lib::error_code();
+			}
+#endif
+#if WEBSOCKETPP_WITH_ZSTD
+			case http::content_encoding::zstd: {
+				char buffer[buffer_size];
+				ZSTD_inBuffer input = { in, len, 0 };
+				ZSTD_EndDirective const op = finish ? ZSTD_e_end : ZSTD_e_continue;
+
+				size_t ret;
+				do {
+					ZSTD_outBuffer output = { buffer, sizeof(buffer), 0 };
+
+					ret = ZSTD_compressStream2(m_zstd, &output, &input, op);
+					if (ZSTD_isError(ret)) {
+						return http::error::make_error_code(http::error::general);
+					}
+					out.append(buffer, output.pos);
+				} while (input.pos < input.size || (finish && ret != 0));
+				return lib::error_code();
+			}
+#endif
+			default: break;
+		}
+
+		return http::error::make_error_code(http::error::unsupported_content_encoding);
+	}
+private:
+	static size_t const buffer_size = 16384;
+
+	void release() {
+		if (!m_ready) {
+			return;
+		}
+		m_ready = false;
+
+		switch (m_encoding) {
+#if WEBSOCKETPP_WITH_GZIP || WEBSOCKETPP_WITH_DEFLATE
+			case http::content_encoding::gzip:
+			case http::content_encoding::deflate:
+				deflateEnd(&m_zs);
+				memset(&m_zs, 0, sizeof(m_zs));
+				break;
+#endif
+#if WEBSOCKETPP_WITH_BROTLI
+			case http::content_encoding::brotli:
+				BrotliEncoderDestroyInstance(m_brotli);
+				m_brotli = nullptr;
+				break;
+#endif
+#if WEBSOCKETPP_WITH_ZSTD
+			case http::content_encoding::zstd:
+				ZSTD_freeCCtx(m_zstd);
+				m_zstd = nullptr;
+				break;
+#endif
+			default: break;
+		}
+	}
+
+	http::content_encoding::value m_encoding;
+	bool m_ready;
+#if WEBSOCKETPP_WITH_GZIP || WEBSOCKETPP_WITH_DEFLATE
+	z_stream m_zs;
+#endif
+#if WEBSOCKETPP_WITH_BROTLI
+	BrotliEncoderState * m_brotli;
+#endif
+#if WEBSOCKETPP_WITH_ZSTD
+	ZSTD_CCtx * m_zstd;
+#endif
+};
+
+/// Decompress a complete body
+/**
+ * Decoding contexts are kept per thread and reused between calls.
+ *
+ * @param size_hint The expected decompressed size, if known, so the output can
+ * be allocated once. gzip and zstd read it from the stream if not given.
+ */
+inline std::string decompress(http::content_encoding::value encoding, bool is_transfer_encoding, const std::string& str, lib::error_code& ec, size_t size_hint = 0)
 {
+	// unused when no codec is compiled in
+	(void)str; (void)size_hint;
+
 	switch (encoding)
 	{
 #if WEBSOCKETPP_WITH_DEFLATE
 		case http::content_encoding::deflate:
-			return zlib::decompress(str, ec);
+			return zlib::decompress(str, ec, size_hint);
 			break;
 #endif
 #if WEBSOCKETPP_WITH_BROTLI
 		case http::content_encoding::brotli:
-			return brotli::decompress(str, ec);
+			return brotli::decompress(str, ec, size_hint);
 			break;
 #endif
 #if WEBSOCKETPP_WITH_GZIP
 		case http::content_encoding::gzip:
-			return gzip::decompress(str, ec);
+			return gzip::decompress(str, ec, size_hint);
 			break;
 #endif
 #if WEBSOCKETPP_WITH_ZSTD
 		case http::content_encoding::zstd:
-			return zstd::decompress(str, ec);
+			return zstd::decompress(str, ec, size_hint);
 			break;
 #endif
 		default: break;
@@ -361,6 +1099,9 @@ inline std::string decompress(http::content_encoding::value encoding, bool is_tr
 
 inline std::string compress(http::content_encoding::value encoding, bool is_transfer_encoding, const std::string& str, lib::error_code& ec)
 {
+	// unused when no codec is compiled in
+	(void)str;
+
 	switch (encoding)
 	{
 #if WEBSOCKETPP_WITH_DEFLATE
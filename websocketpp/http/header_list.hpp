@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef HTTP_PARSER_HEADER_LIST_HPP
+#define HTTP_PARSER_HEADER_LIST_HPP
+
+#include <websocketpp/common/memory_usage.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/utilities.hpp>
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace websocketpp {
+namespace http {
+namespace parser {
+
+/// Identifiers for the headers looked up during WebSocket handshakes
+namespace header_id {
+    enum value {
+        host = 0,
+        upgrade,
+        connection,
+        origin,
+        sec_websocket_key,
+        sec_websocket_version,
+        sec_websocket_protocol,
+        sec_websocket_extensions,
+        sec_websocket_accept,
+        content_length,
+        content_encoding,
+        transfer_encoding,
+        accept_encoding,
+        /// Number of well known headers. Also stands for any other header.
+        unknown
+    };
+
+    /// Case insensitive ASCII comparison of two header names
+    inline bool name_equals(std::string_view a, std::string_view b) {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); ++i) {
+            unsigned char x = static_cast<unsigned char>(a[i]);
+            unsigned char y = static_cast<unsigned char>(b[i]);
+            if (x >= 'A' && x <= 'Z') { x |= 0x20; }
+            if (y >= 'A' && y <= 'Z') { y |= 0x20; }
+            if (x != y) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// Map a header name to its well known identifier
+    /**
+     * Dispatches on the name length so at most one or two names are compared.
+     *
+     * @param name The header name, in any case.
+     * @return The identifier of the header, or `unknown`.
+     */
+    inline value identify(std::string_view name) {
+        switch (name.size()) {
+            case 4:
+                return name_equals(name, "Host") ? host : unknown;
+            case 6:
+                return name_equals(name, "Origin") ? origin : unknown;
+            case 7:
+                return name_equals(name, "Upgrade") ? upgrade : unknown;
+            case 10:
+                return name_equals(name, "Connection") ? connection : unknown;
+            case 14:
+                return name_equals(name, "Content-Length") ? content_length :
+                    unknown;
+            case 15:
+                return name_equals(name, "Accept-Encoding") ? accept_encoding :
+                    unknown;
+            case 16:
+                return name_equals(name, "Content-Encoding") ?
+                    content_encoding : unknown;
+            case 17:
+                if (name_equals(name, "Sec-WebSocket-Key")) {
+                    return sec_websocket_key;
+                }
+                return name_equals(name, "Transfer-Encoding") ?
+                    transfer_encoding : unknown;
+            case 20:
+                return name_equals(name, "Sec-WebSocket-Accept") ?
+                    sec_websocket_accept : unknown;
+            case 21:
+                return name_equals(name, "Sec-WebSocket-Version") ?
+                    sec_websocket_version : unknown;
+            case 22:
+                return name_equals(name, "Sec-WebSocket-Protocol") ?
+                    sec_websocket_protocol : unknown;
+            case 24:
+                return name_equals(name, "Sec-WebSocket-Extensions") ?
+                    sec_websocket_extensions : unknown;
+            default:
+                return unknown;
+        }
+    }
+} // namespace header_id
+
+/// Case insensitive map of HTTP header names to values
+/**
+ * A drop in replacement for the `std::map<std::string, std::string,
+ * utility::ci_less>` previously used to store headers. Entries are kept in
+ * one vector sorted case insensitively, so iteration order is unchanged, and
+ * the position of each of the `header_id` headers is tracked so the lookups
+ * done during a handshake don't search at all.
+ *
+ * Unlike std::map, adding or removing a header invalidates iterators and
+ * references to other headers.
+ *
+ * @since 0.9.0
+ */
+class header_list {
+public:
+    typedef std::string key_type;
+    typedef std::string mapped_type;
+    typedef std::pair<std::string, std::string> value_type;
+    typedef std::vector<value_type>::iterator iterator;
+    typedef std::vector<value_type>::const_iterator const_iterator;
+    typedef std::vector<value_type>::size_type size_type;
+
+    header_list() {
+        std::fill(m_slots, m_slots + header_id::unknown, uint16_t(0));
+    }
+
+    iterator begin() { return m_entries.begin(); }
+    iterator end() { return m_entries.end(); }
+    const_iterator begin() const { return m_entries.begin(); }
+    const_iterator end() const { return m_entries.end(); }
+
+    size_type size() const { return m_entries.size(); }
+    bool empty() const { return m_entries.empty(); }
+
+    void clear() {
+        m_entries.clear();
+        std::fill(m_slots, m_slots + header_id::unknown, uint16_t(0));
+    }
+
+    /// Estimate the heap bytes held by the headers
+    size_t get_memory_usage() const {
+        size_t bytes = memory_usage::heap_bytes(m_entries);
+        for (const_iterator it = m_entries.begin(); it != m_entries.end();
+            ++it)
+        {
+            bytes += memory_usage::heap_bytes(it->first) +
+                memory_usage::heap_bytes(it->second);
+        }
+        return bytes;
+    }
+
+    /// Find a header by well known identifier
+    const_iterator find(header_id::value id) const {
+        if (id == header_id::unknown || m_slots[id] == 0) {
+            return m_entries.end();
+        }
+        return m_entries.begin() + (m_slots[id] - 1);
+    }
+
+    /// Find a header by name
+    const_iterator find(std::string_view key) const {
+        header_id::value id = header_id::identify(key);
+        if (id != header_id::unknown) {
+            return find(id);
+        }
+
+        const_iterator it = lower_bound(key);
+        if (it != m_entries.end() && !utility::ci_less()(key, it->first)) {
+            return it;
+        }
+        return m_entries.end();
+    }
+
+    iterator find(std::string_view key) {
+        const_iterator it = static_cast<header_list const &>(*this).find(key);
+        return m_entries.begin() + (it - m_entries.cbegin());
+    }
+
+    size_type count(std::string_view key) const {
+        return find(key) == m_entries.end() ? 0 : 1;
+    }
+
+    /// Return the value of a header, inserting an empty one if needed
+    mapped_type & operator[](std::string const & key) {
+        return insert(value_type(key, std::string())).first->second;
+    }
+
+    /// Insert a header unless one with the same name exists
+    std::pair<iterator, bool> insert(value_type value) {
+        iterator it = find(value.first);
+        if (it != m_entries.end()) {
+            return std::make_pair(it, false);
+        }
+
+        size_t pos = lower_bound(value.first) - m_entries.cbegin();
+        header_id::value id = header_id::identify(value.first);
+
+        it = m_entries.insert(m_entries.begin() + pos, std::move(value));
+        shift_slots(pos, 1);
+        if (id != header_id::unknown) {
+            m_slots[id] = static_cast<uint16_t>(pos + 1);
+        }
+        return std::make_pair(it, true);
+    }
+
+    template <typename InputIterator>
+    void insert(InputIterator first, InputIterator last) {
+        for (; first != last; ++first) {
+            insert(value_type(*first));
+        }
+    }
+
+    /// Remove a header by position
+    iterator erase(const_iterator it) {
+        size_t pos = it - m_entries.cbegin();
+        header_id::value id = header_id::identify(it->first);
+        if (id != header_id::unknown) {
+            m_slots[id] = 0;
+        }
+        iterator next = m_entries.erase(m_entries.begin() + pos);
+        shift_slots(pos, -1);
+        return next;
+    }
+
+    /// Remove a header by name
+    size_type erase(std::string_view key) {
+        const_iterator it = static_cast<header_list const &>(*this).find(key);
+        if (it == m_entries.end()) {
+            return 0;
+        }
+        erase(it);
+        return 1;
+    }
+private:
+    const_iterator lower_bound(std::string_view key) const {
+        return std::lower_bound(m_entries.begin(), m_entries.end(), key,
+            [](value_type const & e, std::string_view k) {
+                return utility::ci_less()(e.first, k);
+            });
+    }
+
+    /// Adjust tracked positions after an insert or erase at pos
+    void shift_slots(size_t pos, int delta) {
+        for (size_t i = 0; i < header_id::unknown; ++i) {
+            if (m_slots[i] > pos + (delta < 0 ? 1 : 0)) {
+                m_slots[i] = static_cast<uint16_t>(m_slots[i] + delta);
+            }
+        }
+    }
+
+    std::vector<value_type> m_entries;
+    // position + 1 of each well known header, 0 if it is absent
+    uint16_t m_slots[header_id::unknown];
+};
+
+} // namespace parser
+} // namespace http
+} // namespace websocketpp
+
+#endif // HTTP_PARSER_HEADER_LIST_HPP
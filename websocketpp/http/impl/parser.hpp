@@ -46,8 +46,8 @@ inline lib::error_code parser::set_version(std::string const & version) {
 }
 
 inline std::string const & parser::get_header(std::string const & key) const {
-    // This find is case insensitive due to the case insensitive comparator
-    // templated into header_list.
+    // This find is case insensitive, header_list compares names with ci_less
+    // and resolves well known names directly.
     header_list::const_iterator h = m_headers.find(key);
 
     if (h == m_headers.end()) {
@@ -209,7 +209,8 @@ inline bool parser::prepare_body(lib::error_code & ec) {
             return false;
 		}
 
-        if (m_body_bytes_max && m_body_bytes_total > m_body_bytes_max) {
+        size_t const limit = get_body_limit();
+        if (limit && m_body_bytes_total > limit) {
             ec = error::make_error_code(error::body_too_large);
             return false;
         }
@@ -230,13 +231,12 @@ inline size_t parser::process_body(char const * buf, size_t len,
         // for chunked encoding, read chunks of the body
 		if (m_body_bytes_needed) { // reading previously started chunk, same as plain encoding!
 			const size_t processed = std::min(m_body_bytes_needed, len);
-			m_body.append(buf, processed);
 			m_body_bytes_needed -= processed;
-			ec = lib::error_code();
+			ec = this->append_body(buf, processed);
 			return processed;
 		} else { // new chunk
 			// sizes of chunks which are given by the first byte of the response body
-			const char* newline = std::search(buf, buf + len, http_crlf, http_crlf + sizeof(http_crlf) - 1);
+			const char* newline = find_crlf(buf, buf + len);
 			if (newline == buf + len)
 			{
 				ec = error::make_error_code(error::invalid_format);
@@ -252,7 +252,8 @@ inline size_t parser::process_body(char const * buf, size_t len,
 				return 0;
 			}
 
-			if (m_body_bytes_max && m_body_bytes_total > m_body_bytes_max) {
+			size_t const limit = get_body_limit();
+			if (limit && m_body_bytes_total > limit) {
 				ec = error::make_error_code(error::body_too_large);
 				return 0;
 			}
@@ -266,9 +267,8 @@ inline size_t parser::process_body(char const * buf, size_t len,
 		}
     } else {
 		const size_t processed = std::min(m_body_bytes_needed, len);
-		m_body.append(buf, processed);
 		m_body_bytes_needed -= processed;
-		ec = lib::error_code();
+		ec = this->append_body(buf, processed);
 		return processed;
     }
 }
@@ -276,12 +276,7 @@ inline size_t parser::process_body(char const * buf, size_t len,
 inline lib::error_code parser::process_header(std::string::iterator begin,
     std::string::iterator end)
 {
-    std::string::iterator cursor = std::search(
-        begin,
-        end,
-        header_separator,
-        header_separator + sizeof(header_separator) - 1
-    );
+    std::string::iterator cursor = find_char(begin, end, header_separator[0]);
 
     if (cursor == end) {
         return error::make_error_code(error::body_too_large);
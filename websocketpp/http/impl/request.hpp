@@ -70,6 +70,9 @@ inline size_t request::consume(char const * buf, size_t len, lib::error_code & e
     // leftover bytes from previous calls. Not all of these bytes are
     // necessarily header bytes (they might be body or even data after this
     // request entirely for a keepalive request)
+    if (!m_buf) {
+        m_buf = lib::make_shared<std::string>();
+    }
     m_buf->append(buf,len);
 
     // Search for delimiter in buf. If found read until then. If not read all
@@ -78,12 +81,7 @@ inline size_t request::consume(char const * buf, size_t len, lib::error_code & e
 
     for (;;) {
         // search for line delimiter in our local buffer
-        end = std::search(
-            begin,
-            m_buf->end(),
-            http_crlf,
-            http_crlf+sizeof(http_crlf)-1
-        );
+        end = find_crlf(begin, m_buf->end());
 
         if (end == m_buf->end()) {
             // we didn't find the delimiter
@@ -154,18 +152,9 @@ inline size_t request::consume(char const * buf, size_t len, lib::error_code & e
                 return 0;
             }
 
-			parameter_list acc_enc_list;
-			if (!get_header_as_plist(Header_AcceptEncoding, acc_enc_list)) {
-				m_accept_encoding = std::vector<content_encoding::value>();
-				for (const auto& param : acc_enc_list) {
-					auto encoding = content_encoding::from_string(param.first);
-					if (encoding) {
-						m_accept_encoding->push_back(*encoding);
-					} else {
-						ec = error::make_error_code(error::unknown_content_encoding);
-						return 0;
-					}
-				}
+			ec = process_accept_encoding(get_header(Header_AcceptEncoding));
+			if (ec) {
+				return 0;
 			}
 
             if (need_more) {
@@ -270,6 +259,27 @@ inline lib::error_code request::process(std::string::iterator begin, std::string
     return set_version(std::string(cursor_end+1,end));
 }
 
+inline lib::error_code request::process_accept_encoding(
+    std::string const & value)
+{
+	parameter_list acc_enc_list;
+	if (parse_parameter_list(value, acc_enc_list)) {
+		// not a valid list, accepted encodings stay unknown
+		return lib::error_code();
+	}
+
+	m_accept_encoding = std::vector<content_encoding::value>();
+	for (const auto& param : acc_enc_list) {
+		auto encoding = content_encoding::from_string(param.first);
+		if (encoding) {
+			m_accept_encoding->push_back(*encoding);
+		} else {
+			return error::make_error_code(error::unknown_content_encoding);
+		}
+	}
+	return lib::error_code();
+}
+
 inline void request::set_accepted_encodings(std::vector<content_encoding::value> encodings)
 {
 	m_accept_encoding = std::move(encodings);
@@ -43,11 +43,48 @@ namespace parser {
 inline void response::on_parsing_completed(lib::error_code & ec) {
 	m_state = state::DONE;
 
-	for (auto decode = m_content_encoding.rbegin(); !ec && decode != m_content_encoding.rend(); decode++) {
-		m_body = encoding::decompress(*decode, false, m_body, ec);
+	if (!ec && m_decoder) {
+		ec = m_decoder->finish();
+	}
+	if (!ec && m_sink) {
+		ec = m_sink->finish();
 	}
 }
 
+inline lib::error_code response::prepare_decoding() {
+	if (m_content_encoding.empty()) {
+		m_decoder.reset();
+		return lib::error_code();
+	}
+
+	if (!m_decoder) {
+		m_decoder = lib::make_shared<encoding::decoder_chain>();
+	}
+	return m_decoder->init(m_content_encoding);
+}
+
+inline lib::error_code response::append_body(char const * buf, size_t len) {
+	if (!m_sink) {
+		if (!m_decoder) {
+			return parser::append_body(buf, len);
+		}
+		return m_decoder->decode(buf, len, m_body);
+	}
+
+	if (!m_decoder) {
+		return m_sink->write(buf, len);
+	}
+
+	// decode into the body string to reuse its capacity, then hand it over
+	m_body.clear();
+	lib::error_code ec = m_decoder->decode(buf, len, m_body);
+	if (!ec && !m_body.empty()) {
+		ec = m_sink->write(m_body.data(), m_body.size());
+	}
+	m_body.clear();
+	return ec;
+}
+
 inline size_t response::consume(char const * buf, size_t len, lib::error_code & ec) {
     if (m_state == state::DONE) {
         // the response is already complete. End immediately without reading.
@@ -76,12 +113,7 @@ inline size_t response::consume(char const * buf, size_t len, lib::error_code &
 
     for (;;) {
         // search for delimiter
-        end = std::search(
-            begin,
-            m_buf->end(),
-            http_crlf,
-            http_crlf + sizeof(http_crlf) - 1
-        );
+        end = find_crlf(begin, m_buf->end());
 
         if (end == m_buf->end()) {
             // we didn't find the delimiter
@@ -139,6 +171,11 @@ inline size_t response::consume(char const * buf, size_t len, lib::error_code &
 				return 0;
 			}
 
+			ec = prepare_decoding();
+			if (ec) {
+				return 0;
+			}
+
             // calculate how many bytes in the local buffer are bytes we didn't
             // use for the headers. 
             size_t read = (
@@ -0,0 +1,387 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef HTTP_PARSER_VIEW_REQUEST_IMPL_HPP
+#define HTTP_PARSER_VIEW_REQUEST_IMPL_HPP
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include <websocketpp/http/request.hpp>
+
+namespace websocketpp {
+namespace http {
+namespace parser {
+
+inline size_t view_request::consume(char const * buf, size_t len,
+    lib::error_code & ec)
+{
+    if (m_ready) {
+        // the request is already complete. End immediately without reading.
+        ec = lib::error_code();
+        return 0;
+    }
+
+    if (m_body_bytes_needed > 0) {
+        // The headers are complete, but we are still expecting more body
+        // bytes. Process body bytes.
+        size_t bytes_processed = process_body(buf, len, ec);
+        if (ec) {
+            return bytes_processed;
+        }
+
+        if (body_ready()) {
+            m_ready = true;
+        }
+        return bytes_processed;
+    }
+
+    // Unlike request::consume processed lines are never discarded from the
+    // buffer, the index refers to them by offset.
+    m_raw.append(buf, len);
+
+    for (;;) {
+        char const * data = m_raw.data();
+        size_t end = static_cast<size_t>(
+            find_crlf(data + m_scan, data + m_raw.size()) - data);
+
+        if (end == m_raw.size()) {
+            if (m_raw.size() > max_header_size) {
+                ec = error::make_error_code(error::request_header_fields_too_large);
+                return 0;
+            }
+
+            // resume the search on the next call, a trailing \r may be the
+            // first half of a delimiter
+            m_scan = std::max(m_line, m_raw.size() - 1);
+
+            ec = lib::error_code();
+            return len;
+        }
+
+        size_t next = end + sizeof(http_crlf) - 1;
+
+        if (next > max_header_size) {
+            ec = error::make_error_code(error::request_header_fields_too_large);
+            return 0;
+        }
+        m_header_bytes = next;
+
+        if (end == m_line) {
+            // we got a blank line, which indicates the end of the headers.
+            // Anything after it in the buffer belongs to the caller.
+            size_t bytes_processed = len - (m_raw.size() - next);
+            m_raw.resize(next);
+
+            bool need_more = finish_headers(ec);
+            if (ec) {
+                return 0;
+            }
+
+            if (need_more) {
+                bytes_processed += process_body(buf+bytes_processed,
+                    len-bytes_processed,ec);
+                if (ec) {
+                    return 0;
+                }
+                if (body_ready()) {
+                    m_ready = true;
+                }
+            } else {
+                m_ready = true;
+            }
+
+            ec = lib::error_code();
+            return bytes_processed;
+        }
+
+        if (m_method.empty()) {
+            // the first line is the request line
+            ec = this->process(m_raw.begin() + m_line, m_raw.begin() + end);
+        } else {
+            ec = index_header(m_line, end);
+        }
+        if (ec) {
+            return 0;
+        }
+
+        m_line = m_scan = next;
+    }
+}
+
+inline bool view_request::finish_headers(lib::error_code & ec) {
+    // If we never got a valid method or are missing a host header then this
+    // request is invalid.
+    if (m_method.empty() || get_header_view("Host").empty()) {
+        ec = error::make_error_code(error::incomplete_request);
+        return false;
+    }
+
+    // Bodies are rare on handshakes. The body setup works on the header map
+    // so spill the index there when one is announced.
+    if (find(Header_ContentLength) || find(Header_TransferEncoding) ||
+        find(Header_ContentEncoding))
+    {
+        materialize();
+    }
+
+    bool need_more = prepare_body(ec);
+    if (ec) {
+        return false;
+    }
+
+    ec = process_accept_encoding(
+        std::string(get_header_view(Header_AcceptEncoding)));
+    if (ec) {
+        return false;
+    }
+
+    return need_more;
+}
+
+inline lib::error_code view_request::index_header(size_t begin, size_t end) {
+    char const * data = m_raw.data();
+    size_t sep = static_cast<size_t>(
+        find_char(data + begin, data + end, header_separator[0]) - data);
+    if (sep == end) {
+        return error::make_error_code(error::missing_header_separator);
+    }
+
+    // trim linear whitespace around the name and the value
+    size_t name = begin;
+    size_t name_end = sep;
+    while (name < name_end && is_whitespace_char(m_raw[name])) { ++name; }
+    while (name_end > name && is_whitespace_char(m_raw[name_end-1])) {
+        --name_end;
+    }
+
+    size_t value = sep + 1;
+    size_t value_end = end;
+    while (value < value_end && is_whitespace_char(m_raw[value])) { ++value; }
+    while (value_end > value && is_whitespace_char(m_raw[value_end-1])) {
+        --value_end;
+    }
+
+    std::string_view key(m_raw.data() + name, name_end - name);
+
+    if (std::find_if(key.begin(),key.end(),is_not_token_char) != key.end()) {
+        return error::make_error_code(error::invalid_header_name);
+    }
+
+    entry const * existing = find(key);
+    if (existing || m_count == max_indexed_headers ||
+        m_headers.find(key) != m_headers.end())
+    {
+        // repeated and overflow headers are combined in the map
+        std::string const k(key);
+        if (existing) {
+            parser::append_header(k, std::string(value_of(*existing)));
+
+            // leave a hole rather than shifting the rest of the index
+            entry & e = m_index[existing - m_index];
+            e.hash = 0;
+            e.name_len = 0;
+        }
+        return parser::append_header(k,
+            std::string(m_raw, value, value_end - value));
+    }
+
+    entry & e = m_index[m_count++];
+    e.hash = hash_name(key);
+    e.name = static_cast<uint16_t>(name);
+    e.name_len = static_cast<uint16_t>(name_end - name);
+    e.value = static_cast<uint16_t>(value);
+    e.value_len = static_cast<uint16_t>(value_end - value);
+
+    return lib::error_code();
+}
+
+inline uint32_t view_request::hash_name(std::string_view name) {
+    uint32_t h = 2166136261u;
+    for (unsigned char c : name) {
+        if (c >= 'A' && c <= 'Z') {
+            c |= 0x20;
+        }
+        h = (h ^ c) * 16777619u;
+    }
+    return h;
+}
+
+inline view_request::entry const * view_request::find(std::string_view key)
+    const
+{
+    if (!m_indexed) {
+        return NULL;
+    }
+
+    uint32_t const h = hash_name(key);
+
+    for (size_t i = 0; i < m_count; ++i) {
+        entry const & e = m_index[i];
+        if (e.hash != h || e.name_len != key.size()) {
+            continue;
+        }
+
+        std::string_view n = name_of(e);
+        if (!utility::ci_less()(n, key) && !utility::ci_less()(key, n)) {
+            return &e;
+        }
+    }
+    return NULL;
+}
+
+inline void view_request::materialize() {
+    if (!m_indexed) {
+        return;
+    }
+
+    for (size_t i = 0; i < m_count; ++i) {
+        if (m_index[i].name_len != 0) {
+            parser::append_header(std::string(name_of(m_index[i])),
+                std::string(value_of(m_index[i])));
+        }
+    }
+
+    m_indexed = false;
+    m_count = 0;
+    std::string().swap(m_raw);
+}
+
+inline std::string const & view_request::get_header(std::string const & key)
+    const
+{
+    entry const * e = find(key);
+    if (!e) {
+        return parser::get_header(key);
+    }
+
+    auto it = m_cache.find(key);
+    if (it == m_cache.end()) {
+        it = m_cache.insert(header_list::value_type(
+            std::string(name_of(*e)), std::string(value_of(*e)))).first;
+    }
+    return it->second;
+}
+
+inline std::string_view view_request::get_header_view(std::string_view key)
+    const
+{
+    entry const * e = find(key);
+    if (e) {
+        return value_of(*e);
+    }
+    return parser::get_header_view(key);
+}
+
+inline bool view_request::get_header_as_plist(std::string const & key,
+    parameter_list & out) const
+{
+    entry const * e = find(key);
+    if (!e) {
+        return parser::get_header_as_plist(key, out);
+    }
+
+    if (e->value_len == 0) {
+        return false;
+    }
+    return this->parse_parameter_list(std::string(value_of(*e)), out);
+}
+
+inline header_list const & view_request::get_headers() const {
+    if (!m_indexed) {
+        return parser::get_headers();
+    }
+
+    m_list = m_headers;
+    for (size_t i = 0; i < m_count; ++i) {
+        if (m_index[i].name_len != 0) {
+            m_list.insert(header_list::value_type(
+                std::string(name_of(m_index[i])),
+                std::string(value_of(m_index[i]))));
+        }
+    }
+    return m_list;
+}
+
+inline lib::error_code view_request::append_header(std::string const & key,
+    std::string const & val)
+{
+    materialize();
+    return parser::append_header(key, val);
+}
+
+inline lib::error_code view_request::replace_header(std::string const & key,
+    std::string const & val)
+{
+    materialize();
+    return parser::replace_header(key, val);
+}
+
+inline lib::error_code view_request::remove_header(std::string const & key) {
+    materialize();
+    return parser::remove_header(key);
+}
+
+inline lib::error_code view_request::set_body(std::string value) {
+    materialize();
+    return parser::set_body(std::move(value));
+}
+
+inline std::string view_request::raw() const {
+    if (!m_indexed) {
+        return request::raw();
+    }
+    return raw_head() + m_body;
+}
+
+inline std::string view_request::raw_head() const {
+    if (!m_indexed) {
+        return request::raw_head();
+    }
+
+    std::stringstream ret;
+
+    ret << m_method << " " << m_uri << " " << get_version() << "\r\n";
+
+    header_list const & headers = get_headers();
+    header_list::const_iterator it;
+    for (it = headers.begin(); it != headers.end(); it++) {
+        ret << it->first << ": " << it->second << "\r\n";
+    }
+
+    ret << "\r\n";
+
+    return ret.str();
+}
+
+} // namespace parser
+} // namespace http
+} // namespace websocketpp
+
+#endif // HTTP_PARSER_VIEW_REQUEST_IMPL_HPP
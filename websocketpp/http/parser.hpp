@@ -29,12 +29,16 @@
 #define HTTP_PARSER_HPP
 
 #include <algorithm>
+#include <cstring>
 #include <map>
 #include <string>
+#include <string_view>
 #include <utility>
 
 #include <websocketpp/utilities.hpp>
+#include <websocketpp/common/memory_usage.hpp>
 #include <websocketpp/http/constants.hpp>
+#include <websocketpp/http/header_list.hpp>
 
 namespace websocketpp {
 namespace http {
@@ -49,7 +53,87 @@ namespace state {
     };
 }
 
-typedef std::map<std::string, std::string, utility::ci_less > header_list;
+/// Find the first occurrence of a byte in a range
+/**
+ * Uses memchr, which standard libraries implement with vector instructions,
+ * rather than testing one byte at a time.
+ *
+ * @since 0.9.0
+ *
+ * @param begin Pointer to the beginning of the sequence
+ * @param end Pointer to the end of the sequence
+ * @param c The byte to search for
+ * @return A pointer to the first `c` in the range, or end if there is none.
+ */
+inline char const * find_char(char const * begin, char const * end, char c) {
+    if (begin >= end) {
+        return end;
+    }
+    void const * p = std::memchr(begin, c, static_cast<size_t>(end - begin));
+    return p ? static_cast<char const *>(p) : end;
+}
+
+/// Find the first occurrence of a byte in a string range
+/**
+ * @since 0.9.0
+ *
+ * @param begin An iterator to the beginning of the sequence
+ * @param end An iterator to the end of the sequence
+ * @param c The byte to search for
+ * @return An iterator to the first `c` in the range, or end if there is none.
+ */
+inline std::string::iterator find_char(std::string::iterator begin,
+    std::string::iterator end, char c)
+{
+    if (begin == end) {
+        return end;
+    }
+    char const * first = &*begin;
+    return begin + (find_char(first, first + (end - begin), c) - first);
+}
+
+/// Find the first CRLF line delimiter in a range
+/**
+ * Candidate carriage returns are located with find_char so bytes inside a
+ * line are skipped in bulk.
+ *
+ * @since 0.9.0
+ *
+ * @param begin Pointer to the beginning of the sequence
+ * @param end Pointer to the end of the sequence
+ * @return A pointer to the CR of the first CRLF, or end if there is none.
+ */
+inline char const * find_crlf(char const * begin, char const * end) {
+    for (;;) {
+        char const * cr = find_char(begin, end, '\r');
+        if (cr == end || (cr + 1 < end && cr[1] == '\n')) {
+            return cr;
+        }
+        if (cr + 1 == end) {
+            // a trailing CR may be completed by the next read
+            return end;
+        }
+        begin = cr + 1;
+    }
+}
+
+/// Find the first CRLF line delimiter in a string range
+/**
+ * @since 0.9.0
+ *
+ * @param begin An iterator to the beginning of the sequence
+ * @param end An iterator to the end of the sequence
+ * @return An iterator to the CR of the first CRLF, or end if there is none.
+ */
+inline std::string::iterator find_crlf(std::string::iterator begin,
+    std::string::iterator end)
+{
+    if (begin == end) {
+        return end;
+    }
+    char const * first = &*begin;
+    return begin + (find_crlf(first, first + (end - begin)) - first);
+}
 
 /// Read and return the next token in the stream
 /**
@@ -425,6 +509,21 @@ public:
      */
     std::string const & get_header(std::string const & key) const;
 
+    /// Get the value of an HTTP header without copying the key or value
+    /**
+     * Note: per HTTP specs header values are compared case insensitively.
+     *
+     * @since 0.9.0
+     *
+     * @param [in] key The name/key of the header to get.
+     * @return A view of the value, valid until the headers are changed.
+     */
+    std::string_view get_header_view(std::string_view key) const {
+        header_list::const_iterator h = m_headers.find(key);
+        return h == m_headers.end() ? std::string_view() :
+            std::string_view(h->second);
+    }
+
     /// Extract an HTTP parameter list from a parser header.
     /**
      * If the header requested doesn't exist or exists and is empty the
@@ -567,6 +666,22 @@ public:
         return m_body_bytes_max;
     }
 
+    /// Estimate the heap bytes held by this message
+    /**
+     * Counts the capacity of the headers, body and other strings, not the
+     * object itself.
+     *
+     * @since 0.9.0
+     *
+     * @return The estimated number of bytes
+     */
+    virtual size_t get_memory_usage() const {
+        return memory_usage::heap_bytes(m_version) +
+            m_headers.get_memory_usage() + memory_usage::heap_bytes(m_body) +
+            memory_usage::heap_bytes(m_transfer_encoding) +
+            memory_usage::heap_bytes(m_content_encoding);
+    }
+
 	/// Get transfer encoding
 	/**
      * The list of transfer encodings of the body, the order in which they were applied.
@@ -655,6 +770,30 @@ protected:
      */
     virtual size_t process_body(char const * buf, size_t len, lib::error_code & ec);
 
+    /// Store body bytes extracted by process_body
+    /**
+     * Appends the bytes to the body. Subclasses may override this to decode or
+     * redirect the body as it arrives.
+     *
+     * @since 0.9.0
+     *
+     * @param [in] buf Pointer to the body bytes
+     * @param [in] len Number of body bytes
+     * @return A status code describing the outcome of the operation.
+     */
+    virtual lib::error_code append_body(char const * buf, size_t len) {
+        m_body.append(buf, len);
+        return lib::error_code();
+    }
+
+    /// Maximum number of body bytes to accept while parsing, 0 for no limit
+    /**
+     * @since 0.9.0
+     */
+    virtual size_t get_body_limit() const {
+        return m_body_bytes_max;
+    }
+
     /// Check if the parser is done parsing the body
     /**
      * Behavior before a call to `prepare_body` is undefined.
@@ -53,8 +53,7 @@ public:
     typedef lib::shared_ptr<type> ptr;
 
     request()
-      : m_buf(lib::make_shared<std::string>())
-      , m_ready(false) {}
+      : m_ready(false) {}
 
     /// Process bytes in the input buffer
     /**
@@ -86,6 +85,17 @@ public:
         return m_ready;
     }
 
+    /// Mark a request set up element by element as complete
+    /**
+     * For requests that were not parsed from bytes, such as one built from
+     * the header block of an HTTP/2 stream.
+     *
+     * @since 0.9.0
+     */
+    void set_ready() {
+        m_ready = true;
+    }
+
     /// Returns the full raw request (including the body)
     std::string raw() const;
     
@@ -124,6 +134,24 @@ public:
         return m_uri;
     }
 
+    /// Estimate the heap bytes held by this request
+    /**
+     * @since 0.9.0
+     *
+     * @return The estimated number of bytes
+     */
+    size_t get_memory_usage() const override {
+        size_t bytes = parser::get_memory_usage() +
+            memory_usage::heap_bytes(m_method) + memory_usage::heap_bytes(m_uri);
+        if (m_buf) {
+            bytes += sizeof(std::string) + memory_usage::heap_bytes(*m_buf);
+        }
+        if (m_accept_encoding) {
+            bytes += memory_usage::heap_bytes(*m_accept_encoding);
+        }
+        return bytes;
+    }
+
 	const std::optional<std::vector<content_encoding::value>>& get_accepted_encodings() const {
 		return m_accept_encoding;
 	}
@@ -134,7 +162,16 @@ public:
 
 	void set_accepted_encodings(std::vector<content_encoding::value> encodings);
 
-private:
+protected:
+    /// Parse the Accept-Encoding header of a received request
+    /**
+     * @since 0.9.0
+     *
+     * @param [in] value The header value, which may be empty.
+     * @return A status code describing the outcome of the operation.
+     */
+    lib::error_code process_accept_encoding(std::string const & value);
+
     /// Helper function for message::consume. Process request line
     /**
      * @since 0.9.0 (ec parameter added, exceptions removed)
@@ -30,7 +30,12 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 
+#include <websocketpp/common/functional.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/http/body_sink.hpp>
+#include <websocketpp/http/encoding.hpp>
 #include <websocketpp/http/parser.hpp>
 
 namespace websocketpp {
@@ -53,12 +58,19 @@ namespace parser {
  * ready() will never return true. It is the responsibility of the caller to
  * consume to determine when the response is complete (ie when the connection
  * terminates, or some other metric).
+ *
+ * Bodies with a Content-Encoding are decoded as they arrive, so only the
+ * decoded body is ever held in memory. With a body sink or handler set the
+ * decoded bytes are passed on as they are produced and not stored at all.
  */
 class response : public parser {
 public:
     typedef response type;
     typedef lib::shared_ptr<type> ptr;
 
+    /// Type of a handler for decoded body bytes
+    typedef lib::function<void(std::string_view)> body_handler;
+
 	enum class state {
         RESPONSE_LINE = 0,
         HEADERS = 1,
@@ -196,16 +208,82 @@ public:
     const std::string& get_status_msg() const {
         return m_status_msg;
     }
+
+    /// Estimate the heap bytes held by this response
+    /**
+     * @since 0.9.0
+     *
+     * @return The estimated number of bytes
+     */
+    size_t get_memory_usage() const override {
+        size_t bytes = parser::get_memory_usage() +
+            memory_usage::heap_bytes(m_status_msg);
+        if (m_buf) {
+            bytes += sizeof(std::string) + memory_usage::heap_bytes(*m_buf);
+        }
+        return bytes;
+    }
+
+    /// Set a handler for decoded body bytes
+    /**
+     * When set, body bytes are passed to the handler after any content
+     * encoding has been undone and get_body() stays empty. Must be set before
+     * the body is consumed.
+     *
+     * @since 0.9.0
+     *
+     * @param h The new body handler, or an empty function to store the body.
+     */
+    void set_body_handler(body_handler h) {
+        if (h) {
+            m_sink = lib::make_shared<handler_sink>(h);
+        } else {
+            m_sink.reset();
+        }
+    }
+
+    /// Set a sink for decoded body bytes
+    /**
+     * Like set_body_handler, with the body going to a callback, file
+     * descriptor or memory region as provided by the sink. The maximum body
+     * size does not apply while a sink is set, the sink bounds the body
+     * instead. Must be set before the body is consumed.
+     *
+     * @since 0.9.0
+     *
+     * @param sink The new body sink, or null to store the body.
+     */
+    void set_body_sink(body_sink::ptr sink) {
+        m_sink = sink;
+    }
+
+    /// Get the body sink, if any
+    body_sink::ptr get_body_sink() const {
+        return m_sink;
+    }
 private:
     /// Helper function for consume. Process response line
     lib::error_code process(std::string::iterator begin, std::string::iterator end);
 
 	virtual size_t process_body(char const * buf, size_t len, lib::error_code & ec) override;
 
+    /// Decode body bytes and store or hand them to the body handler
+    virtual lib::error_code append_body(char const * buf, size_t len) override;
+
+    /// Set up decoding of the body once the headers are complete
+    lib::error_code prepare_decoding();
+
+    /// Body bytes are only limited by the sink while one is set
+    virtual size_t get_body_limit() const override {
+        return m_sink ? 0 : m_body_bytes_max;
+    }
+
 	void on_parsing_completed(lib::error_code & ec);
 
     std::string                     m_status_msg;
     lib::shared_ptr<std::string>    m_buf;
+    lib::shared_ptr<encoding::decoder_chain> m_decoder;
+    body_sink::ptr                  m_sink;
     status_code::value              m_status_code;
     state                           m_state;
 
@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef HTTP_PARSER_RESPONSE_CACHE_HPP
+#define HTTP_PARSER_RESPONSE_CACHE_HPP
+
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/system_error.hpp>
+#include <websocketpp/common/thread.hpp>
+#include <websocketpp/http/constants.hpp>
+#include <websocketpp/http/encoding.hpp>
+#include <websocketpp/http/request.hpp>
+#include <websocketpp/http/response.hpp>
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace websocketpp {
+namespace http {
+
+/// One serialized response held by a response_cache
+struct cached_response {
+    /// The status code, for logging and keep-alive decisions
+    status_code::value status;
+    /// Offset of the blank line that ends the headers in bytes
+    size_t head_size;
+    /// The status line, headers and body, ready for the wire
+    std::string bytes;
+};
+
+/// Fully serialized responses to plain HTTP requests, by method and target
+/**
+ * Server connections of an endpoint with set_response_cache look each plain
+ * HTTP request up here before calling the http handler. A hit is written
+ * straight from the shared bytes of the cached response, without building or
+ * serializing a response; only a Connection header needed for keep-alive
+ * makes a copy. The http handler is not called for hits.
+ *
+ * The target is matched exactly as it appears in the request line, query
+ * string included. Responses are stored as given: set a Server header on
+ * them if one is wanted.
+ *
+ * A response may be added with compressed variants. A request gets the
+ * first variant, in the order given to add, whose content encoding it
+ * accepts, and the identity variant otherwise.
+ *
+ * The cache may be shared between endpoints and changed while they run.
+ *
+ * @since 0.9.0
+ */
+class response_cache {
+public:
+    typedef lib::shared_ptr<cached_response const> entry_ptr;
+
+    /// Add or replace the response to a method and target
+    /**
+     * Encodings that are not compiled in, and variants that would not be
+     * smaller than the body, are left out.
+     *
+     * @param method The request method, such as "GET"
+     * @param target The request target, such as "/index.html"
+     * @param res The response. Its body gets a Content-Length header.
+     * @param encodings Content encodings to store compressed variants in, in
+     * order of preference
+     * @return A status code, zero on success, non-zero otherwise
+     */
+    lib::error_code add(std::string const & method, std::string const & target,
+        parser::response const & res,
+        std::vector<content_encoding::value> const & encodings =
+            std::vector<content_encoding::value>())
+    {
+        lib::error_code ec;
+        parser::response identity = res;
+        identity.set_version("HTTP/1.1");
+        identity.remove_header(Header_ContentEncoding);
+        ec = identity.set_body(res.get_body());
+        if (ec) {
+            return ec;
+        }
+
+        entry e;
+        for (size_t i = 0; i < encodings.size(); ++i) {
+            if (!is_encoding_supported(encodings[i])) {
+                continue;
+            }
+
+            std::string body = encoding::compress(encodings[i], false,
+                identity.get_body(), ec);
+            if (ec) {
+                return ec;
+            }
+            if (body.size() >= identity.get_body().size()) {
+                continue;
+            }
+
+            parser::response variant = identity;
+            ec = variant.set_body(std::move(body));
+            if (ec) {
+                return ec;
+            }
+            variant.replace_header(Header_ContentEncoding,
+                content_encoding::to_string(encodings[i]));
+            variant.replace_header("Vary", "Accept-Encoding");
+            e.variants.push_back(std::make_pair(encodings[i],
+                serialize(variant)));
+        }
+
+        if (!e.variants.empty()) {
+            identity.replace_header("Vary", "Accept-Encoding");
+        }
+        e.identity = serialize(identity);
+
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        m_entries[key(method, target)] = std::move(e);
+        return lib::error_code();
+    }
+
+    /// Remove the response to a method and target
+    /**
+     * Connections already writing it keep their copy.
+     *
+     * @return Whether there was a response to remove
+     */
+    bool remove(std::string const & method, std::string const & target) {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        return m_entries.erase(key(method, target)) > 0;
+    }
+
+    /// Remove every response
+    void clear() {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        m_entries.clear();
+    }
+
+    /// Get the number of method and target pairs held
+    size_t size() const {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        return m_entries.size();
+    }
+
+    /// Look up the response to a request
+    /**
+     * @param req The request
+     * @return The variant to send, or null if there is none
+     */
+    entry_ptr find(parser::request const & req) const {
+        std::string const k = key(req.get_method(), req.get_uri());
+
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        map_type::const_iterator it = m_entries.find(k);
+        if (it == m_entries.end()) {
+            return entry_ptr();
+        }
+        for (size_t i = 0; i < it->second.variants.size(); ++i) {
+            if (req.accepts_encoding(it->second.variants[i].first)) {
+                return it->second.variants[i].second;
+            }
+        }
+        return it->second.identity;
+    }
+private:
+    struct entry {
+        entry_ptr identity;
+        std::vector<std::pair<content_encoding::value, entry_ptr> > variants;
+    };
+
+    typedef std::unordered_map<std::string, entry> map_type;
+
+    static std::string key(std::string const & method,
+        std::string const & target)
+    {
+        std::string k;
+        k.reserve(method.size() + target.size() + 1);
+        k += method;
+        k += ' ';
+        k += target;
+        return k;
+    }
+
+    static entry_ptr serialize(parser::response const & res) {
+        lib::shared_ptr<cached_response> out =
+            lib::make_shared<cached_response>();
+        out->status = res.get_status_code();
+        out->bytes = res.raw();
+        out->head_size = out->bytes.size() - res.get_body().size() - 2;
+        return out;
+    }
+
+    mutable lib::mutex m_lock;
+    map_type m_entries;
+};
+
+} // namespace http
+} // namespace websocketpp
+
+#endif // HTTP_PARSER_RESPONSE_CACHE_HPP
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef HTTP_PARSER_VIEW_REQUEST_HPP
+#define HTTP_PARSER_VIEW_REQUEST_HPP
+
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/http/request.hpp>
+
+#include <map>
+#include <string>
+#include <string_view>
+
+namespace websocketpp {
+namespace http {
+namespace parser {
+
+/// HTTP request parser that indexes headers in place
+/**
+ * view_request is a drop in replacement for http::parser::request intended
+ * for servers that mostly parse WebSocket handshakes. Rather than copying
+ * every header name and value into a map, the raw header block is kept in a
+ * single buffer and up to `max_indexed_headers` headers are indexed by offset
+ * in a small flat array with a case insensitive hash of the name.
+ * `get_header_view` returns views into that buffer without allocating.
+ *
+ * Headers that don't fit in the index, repeated headers, and requests with a
+ * body fall back to the regular header map. Any call that modifies the
+ * headers moves the index into the map first, after which the request
+ * behaves exactly like http::parser::request.
+ *
+ * Select it with `typedef websocketpp::http::parser::view_request
+ * request_type;` in the endpoint config.
+ *
+ * @since 0.9.0
+ */
+class view_request : public request {
+public:
+    typedef view_request type;
+    typedef lib::shared_ptr<type> ptr;
+
+    /// Number of headers that are indexed in place
+    static size_t const max_indexed_headers = 32;
+
+    view_request()
+      : m_line(0)
+      , m_scan(0)
+      , m_count(0)
+      , m_indexed(true) {}
+
+    /// Process bytes in the input buffer
+    /**
+     * Behaves like request::consume.
+     *
+     * @since 0.9.0
+     *
+     * @param [in] buf Pointer to byte buffer
+     * @param [in] len Size of byte buffer
+     * @param [out] ec A status code describing the outcome of the operation.
+     * @return Number of bytes processed.
+     */
+    size_t consume(char const * buf, size_t len, lib::error_code & ec);
+
+    /// Returns the full raw request (including the body)
+    std::string raw() const;
+
+    /// Returns the raw request headers only (similar to an HTTP HEAD request)
+    std::string raw_head() const;
+
+    /// Get the value of an HTTP header
+    /**
+     * Values of indexed headers are copied into a lookup cache the first time
+     * they are requested so a stable reference can be returned. Prefer
+     * get_header_view where a view will do.
+     *
+     * @param [in] key The name/key of the header to get.
+     * @return The value associated with the given HTTP header key.
+     */
+    std::string const & get_header(std::string const & key) const;
+
+    /// Get the value of an HTTP header without copying the key or value
+    /**
+     * @since 0.9.0
+     *
+     * @param [in] key The name/key of the header to get.
+     * @return A view of the value, valid until the headers are changed.
+     */
+    std::string_view get_header_view(std::string_view key) const;
+
+    /// Extract an HTTP parameter list from a request header.
+    /**
+     * @param [in] key The name/key of the HTTP header to use as input.
+     * @param [out] out The parameter list to store extracted parameters in.
+     * @return Whether or not the input was a valid parameter list. (true means
+     * invalid, false means valid)
+     */
+    bool get_header_as_plist(std::string const & key, parameter_list & out)
+        const;
+
+    /// Return a list of all HTTP headers
+    /**
+     * Builds the list from the index on each call while the headers are
+     * indexed, which invalidates the list returned by the previous call.
+     *
+     * @return A list of all HTTP headers
+     */
+    header_list const & get_headers() const;
+
+    /// Append a value to an existing HTTP header
+    lib::error_code append_header(std::string const & key,
+        std::string const & val);
+
+    /// Set a value for an HTTP header, replacing an existing value
+    lib::error_code replace_header(std::string const & key,
+        std::string const & val);
+
+    /// Remove a header from the parser
+    lib::error_code remove_header(std::string const & key);
+
+    /// Set body content
+    lib::error_code set_body(std::string value);
+private:
+    // offsets are stored in 16 bits, which covers any valid header block
+    static_assert(max_header_size <= 0xffff,
+        "view_request offsets must be able to address a full header block");
+
+    /// A header indexed by its position in m_raw
+    struct entry {
+        uint32_t hash;
+        uint16_t name;
+        uint16_t name_len;
+        uint16_t value;
+        uint16_t value_len;
+    };
+
+    /// Case insensitive FNV-1a hash of a header name
+    static uint32_t hash_name(std::string_view name);
+
+    /// Find an indexed header, or return null
+    entry const * find(std::string_view key) const;
+
+    std::string_view name_of(entry const & e) const {
+        return std::string_view(m_raw.data() + e.name, e.name_len);
+    }
+
+    std::string_view value_of(entry const & e) const {
+        return std::string_view(m_raw.data() + e.value, e.value_len);
+    }
+
+    /// Index a header line in the range [begin,end) of m_raw
+    lib::error_code index_header(size_t begin, size_t end);
+
+    /// Validate the complete header block and prepare the body, if any
+    bool finish_headers(lib::error_code & ec);
+
+    /// Move indexed headers into the header map and drop the raw buffer
+    void materialize();
+
+    std::string         m_raw;
+    size_t              m_line;
+    size_t              m_scan;
+    entry               m_index[max_indexed_headers];
+    size_t              m_count;
+    bool                m_indexed;
+
+    // backs the references returned by get_header. Entries are only ever
+    // added and map nodes don't move, so earlier references stay valid.
+    mutable std::map<std::string, std::string, utility::ci_less> m_cache;
+    // rebuilt by each call to get_headers while the headers are indexed
+    mutable header_list m_list;
+};
+
+} // namespace parser
+} // namespace http
+} // namespace websocketpp
+
+#include <websocketpp/http/impl/view_request.hpp>
+
+#endif // HTTP_PARSER_VIEW_REQUEST_HPP
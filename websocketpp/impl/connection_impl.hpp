@@ -41,9 +41,11 @@
 #include <websocketpp/http/encoding.hpp>
 
 #include <algorithm>
+#include <cstring>
 #include <exception>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -69,16 +71,99 @@ std::string const & connection<config>::get_origin() const {
     return m_processor->get_origin(m_request);
 }
 
+template <typename config>
+uint64_t connection<config>::get_coalesced_bytes() const {
+    scoped_lock_type lock(m_write_lock);
+    return m_coalesced_bytes;
+}
+
+template <typename config>
+uint64_t connection<config>::get_coalesced_messages() const {
+    scoped_lock_type lock(m_write_lock);
+    return m_coalesced_messages;
+}
+
 template <typename config>
 size_t connection<config>::get_buffered_amount() const {
-    //scoped_lock_type lock(m_connection_state_lock);
-    return m_send_buffer_size;
+    return m_send_buffer_size.load(std::memory_order_relaxed);
+}
+
+template <typename config>
+memory_usage connection<config>::get_memory_usage() const {
+    memory_usage usage;
+    usage.bytes[memory_usage::connection] = sizeof(type) +
+        memory_usage::heap_bytes(this->user_agent()) +
+        memory_usage::heap_bytes(m_subprotocol) +
+        memory_usage::heap_bytes(m_requested_subprotocols) +
+        memory_usage::heap_bytes(m_local_close_reason) +
+        memory_usage::heap_bytes(m_remote_close_reason);
+    for (size_t i = 0; i < m_requested_subprotocols.size(); ++i) {
+        usage.bytes[memory_usage::connection] +=
+            memory_usage::heap_bytes(m_requested_subprotocols[i]);
+    }
+
+    // a pooled buffer is only held while a read is outstanding
+    usage.bytes[memory_usage::read_buffer] = memory_usage::heap_bytes(m_buf) +
+        (m_read_buf_pooled ? config::connection_read_buffer_size : 0);
+
+    usage.claim(memory_usage::http, sizeof(m_request) + sizeof(m_response));
+    usage.bytes[memory_usage::http] += m_request.get_memory_usage() +
+        m_response.get_memory_usage() +
+        memory_usage::heap_bytes(m_http_message_buffer);
+
+    usage.claim(memory_usage::timers, sizeof(m_handshake_timer) +
+        sizeof(m_ping_timer) + sizeof(m_deflate_idle_timer) +
+        sizeof(m_keepalive_timer) + sizeof(m_hibernate_timer) +
+        sizeof(m_rate_timer));
+    deadline const * const deadlines[] = {&m_handshake_timer, &m_ping_timer,
+        &m_deflate_idle_timer, &m_keepalive_timer, &m_hibernate_timer,
+        &m_rate_timer};
+    for (size_t i = 0; i < sizeof(deadlines)/sizeof(deadlines[0]); ++i) {
+        if (deadlines[i]->timer) {
+            usage.bytes[memory_usage::timers] +=
+                sizeof(typename timer_ptr::element_type);
+        }
+    }
+
+    if (m_msg_manager) {
+        usage.bytes[memory_usage::processor] +=
+            m_msg_manager->get_memory_usage();
+    }
+
+    {
+        scoped_lock_type lock(m_write_lock);
+
+        if (m_processor) {
+            usage.bytes[memory_usage::processor] +=
+                m_processor->get_memory_usage();
+            usage.bytes[memory_usage::deflate] =
+                m_processor->get_deflate_memory_usage();
+        }
+
+        size_t & queued = usage.bytes[memory_usage::send_queue];
+        for (size_t i = 0; i <= close_lane; ++i) {
+            queued += queued_memory_usage(m_send_queue[i]);
+        }
+        queued += queued_memory_usage(m_offload_queue) +
+            queued_memory_usage(m_fragment_deferred) +
+            queued_memory_usage(m_stream_deferred) +
+            queued_memory_usage(m_stream_held) +
+            queued_memory_usage(m_current_msgs) +
+            memory_usage::heap_bytes(m_send_buffer) +
+            memory_usage::heap_bytes(m_coalesce_buffer);
+        if (m_fragment_source && !m_fragment_source->get_broadcast()) {
+            queued += m_fragment_source->get_memory_usage();
+        }
+    }
+
+    transport_con_type::get_memory_usage(usage);
+
+    return usage;
 }
 
 template <typename config>
 session::state::value connection<config>::get_state() const {
-    //scoped_lock_type lock(m_connection_state_lock);
-    return m_state;
+    return m_state.load(std::memory_order_acquire);
 }
 
 template <typename config>
@@ -102,6 +187,43 @@ lib::error_code connection<config>::send(void const * payload, size_t len,
     return send(msg);
 }
 
+template <typename config>
+lib::error_code connection<config>::send_file(std::string const & path,
+    uint64_t offset, uint64_t len, frame::opcode::value op)
+{
+    lib::error_code ec;
+    file_map::ptr file = file_map::map(path,offset,len,ec);
+    if (ec) {
+        return ec;
+    }
+    return send_mapped(file,op);
+}
+
+template <typename config>
+lib::error_code connection<config>::send_file(int fd, uint64_t offset,
+    uint64_t len, frame::opcode::value op)
+{
+    lib::error_code ec;
+    file_map::ptr file = file_map::map(fd,offset,len,ec);
+    if (ec) {
+        return ec;
+    }
+    return send_mapped(file,op);
+}
+
+template <typename config>
+lib::error_code connection<config>::send_mapped(file_map::ptr file,
+    frame::opcode::value op)
+{
+    message_ptr msg = m_msg_manager->get_message(op,0);
+    if (!msg) {
+        return error::make_error_code(error::no_outgoing_buffers);
+    }
+    msg->set_payload_ref(file,file->data(),file->size());
+
+    return send(msg);
+}
+
 template <typename config>
 lib::error_code connection<config>::send(typename config::message_type::ptr msg)
 {
@@ -109,809 +231,1059 @@ lib::error_code connection<config>::send(typename config::message_type::ptr msg)
         m_alog->write(log::alevel::devel,"connection send");
     }
 
+    // The state is only read here. Transitions out of open take
+    // m_connection_state_lock, and a message that races one is cleaned up
+    // with the rest of the send queue.
+    if (m_state.load(std::memory_order_acquire) != session::state::open ||
+        m_is_http) [[unlikely]]
     {
-        scoped_lock_type lock(m_connection_state_lock);
-        if (m_state != session::state::open || m_is_http) {
-           return error::make_error_code(error::invalid_state);
-        }
+        return error::make_error_code(error::invalid_state);
     }
 
     message_ptr outgoing_msg;
     bool needs_writing = false;
 
-    if (msg->get_prepared()) {
-        outgoing_msg = msg;
+    if (msg->get_broadcast() && use_prepared(msg)) {
+        msg = m_processor->select_broadcast_frame(msg);
+    } else if (!msg->get_prefix().empty() && !use_prepared(msg)) {
+        // this connection frames the message itself, so the prefix and the
+        // shared payload have to become one payload
+        msg = flatten_prefix(msg);
+        if (!msg) [[unlikely]] {
+            return error::make_error_code(error::no_outgoing_buffers);
+        }
+    }
+
+    bool prepared = use_prepared(msg);
 
-        scoped_lock_type lock(m_write_lock);
-        write_push(outgoing_msg);
-        needs_writing = !m_write_flag && !m_send_queue.empty();
+    if (config_traits<config>::lock_free_send_queue ||
+        (prepared && !m_compression_pool && !m_stream_open))
+    {
+        // In lock free mode unprepared messages are queued as is and prepared
+        // by write_pop on the thread performing the write.
+        needs_writing = write_enqueue(msg);
     } else {
-        outgoing_msg = m_msg_manager->get_message();
+        if (!prepared) {
+            outgoing_msg = m_msg_manager->get_message();
 
-        if (!outgoing_msg) {
-            return error::make_error_code(error::no_outgoing_buffers);
+            if (!outgoing_msg) [[unlikely]] {
+                return error::make_error_code(error::no_outgoing_buffers);
+            }
         }
 
         scoped_lock_type lock(m_write_lock);
-        lib::error_code ec = m_processor->prepare_data_frame(msg,outgoing_msg);
 
-        if (ec) {
+        // Compressing this now would put it in the middle of the open
+        // stream's compressed data
+        if (m_stream_open) {
+            m_stream_deferred.push_back(msg);
+            return lib::error_code();
+        }
+
+        lib::error_code ec = send_locked(msg,outgoing_msg);
+        if (ec) [[unlikely]] {
             return ec;
         }
 
-        write_push(outgoing_msg);
-        needs_writing = !m_write_flag && !m_send_queue.empty();
+        needs_writing = !m_write_flag && !send_queue_empty();
     }
 
+    check_high_watermark();
+    check_backlog();
+    govern_send_memory();
+
     if (needs_writing) {
-        transport_con_type::dispatch(lib::bind(
-            &type::write_frame,
-            type::get_shared()
-        ));
+        schedule_write_frame();
     }
 
     return lib::error_code();
 }
 
 template <typename config>
-void connection<config>::ping(std::string const& payload, lib::error_code& ec) {
-    if (m_alog->static_test(log::alevel::devel)) {
-        m_alog->write(log::alevel::devel,"connection ping");
+lib::error_code connection<config>::send(message_ptr msg,
+    send_handler handler)
+{
+    msg->set_send_handler(handler);
+
+    lib::error_code ec = send(msg);
+    if (ec) {
+        msg->set_send_handler(send_handler());
     }
+    return ec;
+}
 
-    {
-        scoped_lock_type lock(m_connection_state_lock);
-        if (m_state != session::state::open || m_is_http) {
-            std::stringstream ss;
-            ss << "connection::ping called from invalid state " << m_state;
-            m_alog->write(log::alevel::devel,ss.str());
-            ec = error::make_error_code(error::invalid_state);
-            return;
-        }
+template <typename config>
+void connection<config>::complete_send(message_ptr const & msg,
+    lib::error_code const & ec)
+{
+    if (msg && msg->has_send_handler() && !msg->get_broadcast()) {
+        msg->take_send_handler()(ec);
     }
+}
 
-    message_ptr msg = m_msg_manager->get_message();
-    if (!msg) {
-        ec = error::make_error_code(error::no_outgoing_buffers);
+template <typename config>
+void connection<config>::cancel_queued_sends() {
+    if (config_traits<config>::lock_free_send_queue) {
         return;
     }
 
-    ec = m_processor->prepare_ping(payload,msg);
-    if (ec) {return;}
+    std::vector<send_handler> handlers;
+    {
+        scoped_lock_type lock(m_write_lock);
 
-    // set ping timer if we are listening for one
-    if (m_pong_timeout_handler) {
-        // Cancel any existing timers
-        if (m_ping_timer) {
-            m_ping_timer->cancel();
+        for (size_t i = 0; i <= close_lane; ++i) {
+            take_send_handlers(m_send_queue[i],handlers);
         }
-
-        if (m_pong_timeout_dur > 0) {
-            m_ping_timer = transport_con_type::set_timer(
-                m_pong_timeout_dur,
-                lib::bind(
-                    &type::handle_pong_timeout,
-                    type::get_shared(),
-                    payload,
-                    lib::placeholders::_1
-                )
-            );
+        take_send_handlers(m_fragment_deferred,handlers);
+        take_send_handlers(m_offload_queue,handlers);
+        take_send_handlers(m_stream_deferred,handlers);
+        if (m_fragment_source && m_fragment_source->has_send_handler()) {
+            handlers.push_back(m_fragment_source->take_send_handler());
         }
+    }
 
-        if (!m_ping_timer) {
-            // Our transport doesn't support timers
-            m_elog->write(log::elevel::warn,"Warning: a pong_timeout_handler is \
-                set but the transport in use does not support timeouts.");
-        }
+    lib::error_code ec = error::make_error_code(error::operation_canceled);
+    for (size_t i = 0; i < handlers.size(); ++i) {
+        handlers[i](ec);
     }
+}
 
-    bool needs_writing = false;
+template <typename config>
+void connection<config>::check_high_watermark() {
+    if (m_high_watermark == 0) {
+        return;
+    }
+
+    size_t buffered = get_buffered_amount();
+
+    if (buffered > m_high_watermark && !m_above_high_watermark.exchange(true)
+        && m_high_watermark_handler)
     {
-        scoped_lock_type lock(m_write_lock);
-        write_push(msg);
-        needs_writing = !m_write_flag && !m_send_queue.empty();
+        m_high_watermark_handler(m_connection_hdl,buffered);
     }
+}
 
-    if (needs_writing) {
-        transport_con_type::dispatch(lib::bind(
-            &type::write_frame,
-            type::get_shared()
-        ));
+template <typename config>
+void connection<config>::check_low_watermark() {
+    if (m_above_high_watermark &&
+        get_buffered_amount() <= m_low_watermark &&
+        m_above_high_watermark.exchange(false) && m_drain_handler)
+    {
+        m_drain_handler(m_connection_hdl);
     }
+}
 
-    ec = lib::error_code();
+template <typename config>
+bool connection<config>::droppable(message_ptr const & msg) {
+    frame::opcode::value op = msg->get_opcode();
+
+    if ((op != frame::opcode::TEXT && op != frame::opcode::BINARY) ||
+        !msg->get_prepared() || !msg->get_fin() || msg->get_terminal() ||
+        msg->has_send_handler())
+    {
+        return false;
+    }
+
+    // dropping a compressed frame would desynchronize the peer's inflater
+    return !deflated(msg);
 }
 
-#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
-template<typename config>
-void connection<config>::ping(std::string const & payload) {
-    lib::error_code ec;
-    ping(payload,ec);
-    if (ec) {
-        throw exception(ec);
+template <typename config>
+bool connection<config>::deflated(message_ptr const & msg) {
+    if (!msg->get_prepared()) {
+        // a fragment source, see prepare_data_message
+        return msg->get_compressed();
     }
+
+    frame::header_buffer const & header = msg->get_header();
+    return !header.empty() && (uint8_t(header[0]) & frame::BHB0_RSV1);
 }
-#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
 
-template<typename config>
-void connection<config>::handle_pong_timeout(std::string payload,
-    lib::error_code const & ec)
-{
-    if (ec) {
-        if (ec == transport::error::operation_aborted) {
-            // ignore, this is expected
-            return;
+template <typename config>
+bool connection<config>::apply_slow_consumer_policy(message_ptr const & msg) {
+    if (m_slow_consumer_policy == slow_consumer::conflate) {
+        std::string const & key = msg->get_conflation_key();
+        if (key.empty() || !droppable(msg)) {
+            return true;
         }
 
-        m_elog->write(log::elevel::devel,"pong_timeout error: "+ec.message());
-        return;
+        ring_queue<message_ptr> & lane = m_send_queue[send_lane(msg)];
+
+        typename ring_queue<message_ptr>::iterator it;
+        for (it = lane.begin(); it != lane.end(); ++it) {
+            if ((*it)->get_conflation_key() == key && droppable(*it)) {
+                // the newest value takes the place of the stale one
+                m_send_buffer_size -= (*it)->get_payload_size();
+                m_send_buffer_size += msg->get_payload_size();
+                *it = msg;
+                ++m_dropped_messages;
+                return false;
+            }
+        }
+    } else if (m_slow_consumer_policy == slow_consumer::drop_oldest) {
+        drop_oldest(msg->get_payload_size(), m_slow_consumer_limit);
     }
 
-    if (m_pong_timeout_handler) {
-        m_pong_timeout_handler(m_connection_hdl,payload);
+    if (m_governor && m_governor->get_pressure() >=
+        memory_pressure::drop_slow_consumers)
+    {
+        // under memory pressure every connection keeps at most its share
+        drop_oldest(msg->get_payload_size(), m_governor->get_fair_share());
     }
+    return true;
 }
 
 template <typename config>
-void connection<config>::pong(std::string const& payload, lib::error_code& ec) {
-    if (m_alog->static_test(log::alevel::devel)) {
-        m_alog->write(log::alevel::devel,"connection pong");
+void connection<config>::drop_oldest(size_t size, size_t limit) {
+    // lower priorities are dropped first
+    for (size_t i = priority::bulk; i >= priority::high; --i) {
+        ring_queue<message_ptr> & lane = m_send_queue[i];
+
+        typename ring_queue<message_ptr>::iterator it = lane.begin();
+        while (it != lane.end() && get_buffered_amount() + size > limit) {
+            if (droppable(*it)) {
+                m_send_buffer_size -= (*it)->get_payload_size();
+                it = lane.erase(it);
+                ++m_dropped_messages;
+            } else {
+                ++it;
+            }
+        }
     }
+}
 
-    {
-        scoped_lock_type lock(m_connection_state_lock);
-        if (m_state != session::state::open) {
-            std::stringstream ss;
-            ss << "connection::pong called from invalid state " << m_state;
-            m_alog->write(log::alevel::devel,ss.str());
-            ec = error::make_error_code(error::invalid_state);
-            return;
-        }
+template <typename config>
+void connection<config>::check_backlog() {
+    if (m_slow_consumer_policy != slow_consumer::disconnect) {
+        return;
     }
 
-    message_ptr msg = m_msg_manager->get_message();
-    if (!msg) {
-        ec = error::make_error_code(error::no_outgoing_buffers);
+    if (get_buffered_amount() <= m_slow_consumer_limit) {
+        m_backlog_start = 0;
         return;
     }
 
-    ec = m_processor->prepare_pong(payload,msg);
-    if (ec) {return;}
+    lib::chrono::steady_clock::rep now =
+        lib::chrono::steady_clock::now().time_since_epoch().count();
+    lib::chrono::steady_clock::rep start = 0;
 
-    bool needs_writing = false;
+    if (m_backlog_start.compare_exchange_strong(start,now)) {
+        start = now;
+    }
+
+    lib::chrono::steady_clock::duration backlog(now - start);
+    if (lib::chrono::duration_cast<lib::chrono::milliseconds>(backlog).count()
+        < m_slow_consumer_grace)
     {
-        scoped_lock_type lock(m_write_lock);
-        write_push(msg);
-        needs_writing = !m_write_flag && !m_send_queue.empty();
+        return;
     }
 
-    if (needs_writing) {
-        transport_con_type::dispatch(lib::bind(
-            &type::write_frame,
-            type::get_shared()
-        ));
+    if (m_slow_consumer_close.exchange(true)) {
+        return;
     }
 
-    ec = lib::error_code();
-}
+    m_alog->write(log::alevel::disconnect,
+        "Closing slow consumer, send backlog persisted");
 
-#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
-template<typename config>
-void connection<config>::pong(std::string const & payload) {
     lib::error_code ec;
-    pong(payload,ec);
+    this->close(close::status::policy_violation,"slow consumer",ec);
     if (ec) {
-        throw exception(ec);
+        log_err(log::elevel::rerror,"check_backlog",ec);
     }
 }
-#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
 
 template <typename config>
-void connection<config>::close(close::status::value const code,
-    std::string const & reason, lib::error_code & ec)
-{
-    if (m_alog->static_test(log::alevel::devel)) {
-        m_alog->write(log::alevel::devel,"connection close");
+void connection<config>::govern_send_memory() {
+    if (!m_governor || m_governor_released.load()) {
+        return;
     }
 
-    // Truncate reason to maximum size allowable in a close frame.
-    std::string tr(reason,0,std::min<size_t>(reason.size(),
-        frame::limits::close_reason_size));
-
-    scoped_lock_type lock(m_connection_state_lock);
+    size_t const now = get_buffered_amount();
+    size_t const granularity = m_governor->get_granularity();
 
-    if (m_state != session::state::open) {
-       ec = error::make_error_code(error::invalid_state);
-       return;
-    }
+    size_t old = m_governed_send.load(std::memory_order_relaxed);
+    do {
+        size_t const change = now > old ? now - old : old - now;
+        if (now == old || (now != 0 && change < granularity)) {
+            return;
+        }
+    } while (!m_governed_send.compare_exchange_weak(old, now));
 
-    ec = this->send_close_frame(code,tr,false,close::status::terminal(code));
-}
+    m_governor->charge(old, now);
 
-#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
-template<typename config>
-void connection<config>::close(close::status::value const code,
-    std::string const & reason)
-{
-    lib::error_code ec;
-    close(code,reason,ec);
-    if (ec) {
-        throw exception(ec);
+    if (m_governor_released.load()) {
+        // the connection ended while this was charged, return it
+        m_governor->charge(m_governed_send.exchange(0), 0);
     }
 }
-#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
 
-/// Trigger the on_interrupt handler
-/**
- * This is thread safe if the transport is thread safe
- */
 template <typename config>
-lib::error_code connection<config>::interrupt() {
-    m_alog->write(log::alevel::devel,"connection connection::interrupt");
-    return transport_con_type::interrupt(
-        lib::bind(
-            &type::handle_interrupt,
-            type::get_shared()
-        )
-    );
-}
+void connection<config>::govern_read_memory() {
+    if (!m_governor || m_governor_released.load(std::memory_order_relaxed)) {
+        return;
+    }
 
+    bool const framing = m_internal_state == istate::PROCESS_CONNECTION;
 
-template <typename config>
-void connection<config>::handle_interrupt() {
-    if (m_interrupt_handler) {
-        m_interrupt_handler(m_connection_hdl);
+    size_t now;
+    if (framing) {
+        now = m_processor->get_inbound_memory_usage();
+    } else {
+        now = m_request.get_memory_usage() + m_response.get_memory_usage();
     }
-}
-
-template <typename config>
-lib::error_code connection<config>::pause_reading() {
-    m_alog->write(log::alevel::devel,"connection connection::pause_reading");
-    return transport_con_type::dispatch(
-        lib::bind(
-            &type::handle_pause_reading,
-            type::get_shared()
-        )
-    );
-}
 
-/// Pause reading handler. Not safe to call directly
-template <typename config>
-void connection<config>::handle_pause_reading() {
-    m_alog->write(log::alevel::devel,"connection connection::handle_pause_reading");
-    m_read_flag = false;
+    size_t const change = now > m_governed_read ? now - m_governed_read :
+        m_governed_read - now;
+    if (now != m_governed_read &&
+        (now == 0 || change >= m_governor->get_granularity()))
+    {
+        m_governor->charge(m_governed_read, now);
+        m_governed_read = now;
+    }
+
+    if (!framing) {
+        // HTTP messages are read whole, only frames may be paused
+        return;
+    }
+
+    memory_pressure::value const pressure = m_governor->get_pressure();
+
+    if (pressure < memory_pressure::shrink_compression) {
+        m_governor_shrunk = false;
+    } else if (!m_governor_shrunk && m_state == session::state::open) {
+        m_governor_shrunk = true;
+        shrink_deflate();
+    }
+
+    // a connection holding everything is the largest consumer, even alone
+    size_t const held = m_governed_read +
+        m_governed_send.load(std::memory_order_relaxed);
+    if (pressure < memory_pressure::pause_reads || m_governor_paused ||
+        held == 0 || held < m_governor->get_fair_share())
+    {
+        return;
+    }
+
+    m_governor_paused = true;
+    if (!m_governor->wait_for_relief(lib::bind(
+        &type::dispatch_memory_relief,
+        type::get_shared()
+    )))
+    {
+        // the pressure eased in the meantime
+        m_governor_paused = false;
+        return;
+    }
+    m_alog->write(log::alevel::devel,"memory pressure paused reading");
 }
 
 template <typename config>
-lib::error_code connection<config>::resume_reading() {
-    m_alog->write(log::alevel::devel,"connection connection::resume_reading");
-    return transport_con_type::dispatch(
-        lib::bind(
-            &type::handle_resume_reading,
-            type::get_shared()
-        )
-    );
+void connection<config>::dispatch_memory_relief() {
+    transport_con_type::dispatch(lib::bind(
+        &type::handle_memory_relief,
+        type::get_shared()
+    ));
 }
 
-/// Resume reading helper method. Not safe to call directly
 template <typename config>
-void connection<config>::handle_resume_reading() {
-   m_read_flag = true;
-   read_frame();
+void connection<config>::handle_memory_relief() {
+    if (!m_governor_paused) {
+        return;
+    }
+
+    m_governor_paused = false;
+    if (m_governor_released.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    m_alog->write(log::alevel::devel,"memory pressure resumed reading");
+    read_frame();
 }
 
+template <typename config>
+void connection<config>::shrink_deflate() {
+    m_alog->write(log::alevel::devel,
+        "memory pressure released compression contexts");
 
+    if (config_traits<config>::lock_free_send_queue) {
+        // data frames are prepared by the writer without m_write_lock
+        m_processor->hibernate(false);
+    } else {
+        scoped_lock_type lock(m_write_lock);
+        // a worker may be using the compressor
+        m_processor->hibernate(!m_offload_busy);
+    }
+}
 
+template <typename config>
+void connection<config>::release_memory_charge() {
+    if (!m_governor || m_governor_released.exchange(true)) {
+        return;
+    }
 
+    m_governor->charge(m_governed_send.exchange(0) + m_governed_read, 0);
+    m_governed_read = 0;
+}
 
+template <typename config>
+lib::error_code connection<config>::send_locked(message_ptr msg,
+    message_ptr outgoing)
+{
+    bool prepared = use_prepared(msg);
 
+    // While a message is being compressed on the worker pool everything
+    // sent after it waits behind it, so the send order is kept.
+    if (m_offload_busy || (!prepared && should_offload(msg))) {
+        offload_push(msg);
+        return lib::error_code();
+    }
 
+    if (prepared) {
+        outgoing = msg;
+    } else {
+        if (!outgoing) {
+            outgoing = m_msg_manager->get_message();
 
+            if (!outgoing) {
+                return error::make_error_code(error::no_outgoing_buffers);
+            }
+        }
 
+        lib::error_code ec = prepare_data_message(msg,outgoing);
 
+        if (ec) {
+            return ec;
+        }
+    }
 
-template <typename config>
-bool connection<config>::get_secure() const {
-    //scoped_lock_type lock(m_connection_state_lock);
-    return m_uri->get_secure();
+    write_push(outgoing);
+    return lib::error_code();
 }
 
 template <typename config>
-std::string const & connection<config>::get_host() const {
-    //scoped_lock_type lock(m_connection_state_lock);
-    return m_uri->get_host();
-}
+typename connection<config>::stream_ptr connection<config>::create_stream(
+    frame::opcode::value op, lib::error_code & ec)
+{
+    {
+        scoped_lock_type lock(m_connection_state_lock);
+        if (m_state != session::state::open || m_is_http) {
+            ec = error::make_error_code(error::invalid_state);
+            return stream_ptr();
+        }
+    }
 
-template <typename config>
-std::string const & connection<config>::get_resource() const {
-    //scoped_lock_type lock(m_connection_state_lock);
-    return m_uri->get_resource();
-}
+    if (op != frame::opcode::TEXT && op != frame::opcode::BINARY) {
+        ec = processor::error::make_error_code(processor::error::invalid_opcode);
+        return stream_ptr();
+    }
 
-template <typename config>
-uint16_t connection<config>::get_port() const {
-    //scoped_lock_type lock(m_connection_state_lock);
-    return m_uri->get_port();
-}
+    if (m_processor->get_version() < 7) {
+        // hybi00 has no fragmented messages
+        ec = processor::error::make_error_code(
+            processor::error::not_implemented);
+        return stream_ptr();
+    }
 
-template <typename config>
-uri_ptr connection<config>::get_uri() const {
-    //scoped_lock_type lock(m_connection_state_lock);
-    return m_uri;
+    {
+        scoped_lock_type lock(m_write_lock);
+        if (m_stream_open) {
+            ec = error::make_error_code(error::invalid_state);
+            return stream_ptr();
+        }
+        m_stream_open = true;
+    }
+
+    ec = lib::error_code();
+    return lib::make_shared<stream_type>(type::get_shared(),op);
 }
 
 template <typename config>
-void connection<config>::set_uri(uri_ptr uri) {
-    //scoped_lock_type lock(m_connection_state_lock);
-    m_uri = uri;
-	m_is_http = m_uri && m_uri->get_type() == uri::http;
-}
+lib::error_code connection<config>::send_stream_frame(frame::opcode::value op,
+    void const * data, size_t len, bool fin)
+{
+    {
+        scoped_lock_type lock(m_connection_state_lock);
+        if (m_state != session::state::open || m_is_http) {
+            return error::make_error_code(error::invalid_state);
+        }
+    }
 
+    message_ptr msg = m_msg_manager->get_message(op,len);
+    if (!msg) {
+        return error::make_error_code(error::no_outgoing_buffers);
+    }
+    msg->append_payload(data,len);
+    msg->set_fin(fin);
+    msg->set_compressed(true);
 
+    bool needs_writing;
 
+    if (config_traits<config>::lock_free_send_queue) {
+        // the writer keeps other data messages from coming between the
+        // frames, see write_pop
+        needs_writing = write_enqueue(msg);
+        if (fin) {
+            m_stream_open = false;
+        }
+    } else {
+        message_ptr outgoing = m_msg_manager->get_message();
+        if (!outgoing) {
+            return error::make_error_code(error::no_outgoing_buffers);
+        }
 
+        scoped_lock_type lock(m_write_lock);
 
+        lib::error_code ec = send_locked(msg,outgoing);
+        if (ec) {
+            return ec;
+        }
 
-template <typename config>
-std::string const & connection<config>::get_subprotocol() const {
-    return m_subprotocol;
-}
+        if (fin) {
+            m_stream_open = false;
 
-template <typename config>
-std::vector<std::string> const &
-connection<config>::get_requested_subprotocols() const {
-    return m_requested_subprotocols;
-}
+            // messages sent meanwhile follow the stream, in order
+            while (!m_stream_deferred.empty()) {
+                ec = send_locked(m_stream_deferred.front(),message_ptr());
+                if (ec) {
+                    log_err(log::elevel::rerror,"send",ec);
+                }
+                m_stream_deferred.pop_front();
+            }
+        }
 
-template <typename config>
-void connection<config>::add_subprotocol(std::string const & value,
-    lib::error_code & ec)
-{
-    if (m_is_server) {
-        ec = error::make_error_code(error::client_only);
-        return;
+        needs_writing = !m_write_flag && !send_queue_empty();
     }
 
-    // If the value is empty or has a non-RFC2616 token character it is invalid.
-    if (value.empty() || std::find_if(value.begin(),value.end(),
-                                      http::is_not_token_char) != value.end())
+    if (!fin && m_stream_drain_limit > 0 &&
+        get_buffered_amount() > m_stream_drain_limit)
     {
-        ec = error::make_error_code(error::invalid_subprotocol);
-        return;
+        m_stream_drain_pending = true;
     }
 
-    m_requested_subprotocols.push_back(value);
-}
+    check_high_watermark();
 
-#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
-template <typename config>
-void connection<config>::add_subprotocol(std::string const & value) {
-    lib::error_code ec;
-    this->add_subprotocol(value,ec);
-    if (ec) {
-        throw exception(ec);
+    if (needs_writing) {
+        schedule_write_frame();
     }
-}
-#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
 
+    return lib::error_code();
+}
 
 template <typename config>
-void connection<config>::select_subprotocol(std::string const & value,
-    lib::error_code & ec)
-{
-    if (!m_is_server) {
-        ec = error::make_error_code(error::server_only);
-        return;
+void connection<config>::ping(std::string const& payload, lib::error_code& ec) {
+    if (m_alog->static_test(log::alevel::devel)) {
+        m_alog->write(log::alevel::devel,"connection ping");
     }
 
-    if (value.empty()) {
-        ec = lib::error_code();
+    session::state::value const state =
+        m_state.load(std::memory_order_acquire);
+    if (state != session::state::open || m_is_http) {
+        WEBSOCKETPP_LOG(*m_alog, log::alevel::devel,
+            "connection::ping called from invalid state " << state);
+        ec = error::make_error_code(error::invalid_state);
         return;
     }
 
-    std::vector<std::string>::iterator it;
+    message_ptr msg;
+    if (payload.empty() && m_control_frames) {
+        msg = shared_control_frame(m_control_frames->get_ping());
+    }
 
-    it = std::find(m_requested_subprotocols.begin(),
-                   m_requested_subprotocols.end(),
-                   value);
+    if (!msg) {
+        msg = m_msg_manager->get_message();
+        if (!msg) {
+            ec = error::make_error_code(error::no_outgoing_buffers);
+            return;
+        }
 
-    if (it == m_requested_subprotocols.end()) {
-        ec = error::make_error_code(error::unrequested_subprotocol);
-        return;
+        ec = m_processor->prepare_ping(payload,msg);
+        if (ec) {return;}
     }
 
-    m_subprotocol = value;
+    write_ping(msg,payload);
     ec = lib::error_code();
 }
 
-#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
 template <typename config>
-void connection<config>::select_subprotocol(std::string const & value) {
-    lib::error_code ec;
-    this->select_subprotocol(value,ec);
-    if (ec) {
-        throw exception(ec);
-    }
-}
-#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+void connection<config>::write_ping(message_ptr const & msg,
+    std::string const & payload)
+{
+    // set ping timer if we are listening for one
+    if (m_pong_timeout_handler) {
+        // Cancel any existing timers
+        cancel_deadline(m_ping_timer);
 
+        bool armed = false;
+        if (m_pong_timeout_dur > 0) {
+            armed = arm_deadline(
+                m_ping_timer,
+                m_pong_timeout_dur,
+                lib::bind(
+                    &type::handle_pong_timeout,
+                    type::get_shared(),
+                    payload,
+                    lib::placeholders::_1
+                )
+            );
+        }
 
-template <typename config>
-std::string const &
-connection<config>::get_request_header(std::string const & key) const {
-    return m_request.get_header(key);
-}
+        m_pong_pending = armed;
 
-template <typename config>
-std::string const &
-connection<config>::get_request_body() const {
-    return m_request.get_body();
-}
+        if (!armed) {
+            // Our transport doesn't support timers
+            m_elog->write(log::elevel::warn,"Warning: a pong_timeout_handler is \
+                set but the transport in use does not support timeouts.");
+        }
+    }
 
-template <typename config>
-std::string const &
-connection<config>::get_response_header(std::string const & key) const {
-    return m_response.get_header(key);
-}
+    bool needs_writing = write_enqueue(msg);
 
-template <typename config>
-void connection<config>::set_status(http::status_code::value code,
-    lib::error_code & ec)
-{
-    if (m_internal_state != istate::PROCESS_HTTP_REQUEST) {
-        ec = error::make_error_code(error::invalid_state);
-        return;
+    if (needs_writing) {
+        schedule_write_frame();
     }
-    ec = m_response.set_status(code);
 }
 
 #ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
-template <typename config>
-void connection<config>::set_status(http::status_code::value code)
-{
+template<typename config>
+void connection<config>::ping(std::string const & payload) {
     lib::error_code ec;
-    this->set_status(code, ec);
+    ping(payload,ec);
     if (ec) {
-        throw exception("Call to set_status from invalid state", ec);
+        throw exception(ec);
     }
 }
 #endif // _WEBSOCKETPP_NO_EXCEPTIONS_
 
-template <typename config>
-void connection<config>::set_status(http::status_code::value code,
-    std::string const & msg, lib::error_code & ec)
+template<typename config>
+void connection<config>::handle_pong_timeout(std::string payload,
+    lib::error_code const & ec)
 {
-    if (m_internal_state != istate::PROCESS_HTTP_REQUEST) {
-        ec = error::make_error_code(error::invalid_state);
+    if (ec) {
+        if (ec == transport::error::operation_aborted) {
+            // ignore, this is expected
+            return;
+        }
+
+        WEBSOCKETPP_LOG(*m_elog, log::elevel::devel,
+            "pong_timeout error: " << ec.message());
         return;
     }
 
-    ec = m_response.set_status(code,msg);
-}
+    m_pong_pending = false;
 
-#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
-template <typename config>
-void connection<config>::set_status(http::status_code::value code,
-    std::string const & msg)
-{
-    lib::error_code ec;
-    this->set_status(code, msg);
-    if (ec) {
-        throw exception("Call to set_status from invalid state", ec);
+    if (m_pong_timeout_handler) {
+        handler_timer timer(*this, handler_type::pong_timeout);
+        m_pong_timeout_handler(m_connection_hdl,payload);
     }
 }
-#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
 
 template <typename config>
-void connection<config>::check_body_encoding(std::string & body, const http::body_options& opts, lib::error_code & ec)
-{
-	remove_header(http::Header_ContentEncoding, ec);
-	if (opts.input_encoding)
-	{
-		if (m_request.accepts_encoding(*opts.input_encoding)) {
-			append_header(http::Header_ContentEncoding, http::content_encoding::to_string(*opts.input_encoding), ec);
-			return; // body already in correct format!
-		}
-		else {
-			body = encoding::decompress(*opts.input_encoding, false, body, ec);
-		}
-	}
+void connection<config>::start_keepalive_timer() {
+    if (m_keepalive_interval <= 0) {
+        return;
+    }
 
-	for (http::content_encoding::value encode_body : opts.output_encoding) {
-		if (ec) break;
+    m_keepalive_reads = m_read_count;
 
-		if (!http::is_encoding_supported(encode_body)) continue;
+    long delay = m_keepalive_interval;
+    if (m_keepalive_jitter > 0) {
+        // xorshift, spreads the pings of connections opened together
+        m_keepalive_seed ^= m_keepalive_seed << 13;
+        m_keepalive_seed ^= m_keepalive_seed >> 17;
+        m_keepalive_seed ^= m_keepalive_seed << 5;
+        delay += long(m_keepalive_seed % (uint32_t(m_keepalive_jitter) + 1));
+    }
 
-		if (!m_request.accepts_encoding(encode_body)) continue;
+    arm_deadline(
+        m_keepalive_timer,
+        delay,
+        lib::bind(
+            &type::handle_keepalive_timer,
+            type::get_shared(),
+            lib::placeholders::_1
+        )
+    );
+}
 
-		body = encoding::compress(encode_body, true, body, ec);
-		if (!ec) {
-			append_header(http::Header_ContentEncoding, http::content_encoding::to_string(encode_body), ec);
-		}
+template <typename config>
+void connection<config>::handle_keepalive_timer(lib::error_code const & ec) {
+    if (ec) {
+        if (ec == transport::error::operation_aborted) {
+            // ignore, this is expected
+            return;
+        }
 
-		break; // only encode in a single format
-	}
+        WEBSOCKETPP_LOG(*m_elog, log::elevel::devel,
+            "keepalive timer error: " << ec.message());
+        return;
+    }
 
-	for (http::transfer_encoding::value encode_body : opts.transfer_encoding) {
-		if (ec) break;
+    {
+        scoped_lock_type lock(m_connection_state_lock);
+        if (m_state != session::state::open) {
+            return;
+        }
+    }
 
-		if (encode_body == http::transfer_encoding::chunked) continue;
+    if (m_read_count != m_keepalive_reads) {
+        // the peer is evidently alive, check again an interval from now
+        start_keepalive_timer();
+        return;
+    }
 
-		const http::content_encoding::value as_content_encoding = static_cast<http::content_encoding::value>(encode_body);
+    message_ptr msg;
+    if (m_control_frames) {
+        msg = shared_control_frame(m_control_frames->get_ping());
+    }
 
-		if (!http::is_encoding_supported(as_content_encoding)) continue;
+    if (!msg) {
+        msg = m_msg_manager->get_message();
+        if (!msg) {
+            m_elog->write(log::elevel::devel,"keepalive ping: no buffers");
+            start_keepalive_timer();
+            return;
+        }
 
-		if (!m_request.accepts_encoding(as_content_encoding)) continue;
+        lib::error_code pec = m_processor->prepare_ping(std::string(),msg);
+        if (pec) {
+            log_err(log::elevel::devel,"keepalive ping",pec);
+            start_keepalive_timer();
+            return;
+        }
+    }
 
-		body = encoding::compress(as_content_encoding, true, body, ec);
-		if (!ec) {
-			append_header(http::Header_ContentEncoding, http::content_encoding::to_string(as_content_encoding), ec);
-		}
+    m_keepalive_sent = lib::chrono::steady_clock::now();
+    m_keepalive_pending = true;
+    write_ping(msg,std::string());
 
-		// allow multiple encodings
-	}
+    start_keepalive_timer();
 }
 
 template <typename config>
-void connection<config>::set_body(std::string const & value, const http::body_options& opts,
-    lib::error_code & ec)
-{
-    if (m_internal_state != istate::PROCESS_HTTP_REQUEST) {
-        ec = error::make_error_code(error::invalid_state);
+void connection<config>::start_hibernate_timer() {
+    if (m_hibernate_timeout <= 0) {
         return;
     }
 
-	std::string body(value);
-	check_body_encoding(body, opts, ec);
-	if (ec) {
-		return;
-	}
+    m_hibernate_reads = m_read_count;
 
-    ec = m_response.set_body(std::move(body));
+    arm_deadline(
+        m_hibernate_timer,
+        m_hibernate_timeout,
+        lib::bind(
+            &type::handle_hibernate_timer,
+            type::get_shared(),
+            lib::placeholders::_1
+        )
+    );
 }
 
-#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
 template <typename config>
-void connection<config>::set_body(std::string const & value, const http::body_options& opts) {
-    lib::error_code ec;
-    this->set_body(value, opts, ec);
+void connection<config>::handle_hibernate_timer(lib::error_code const & ec) {
     if (ec) {
-        throw exception("Call to set_body from invalid state", ec);
-    }
-}
-#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+        if (ec == transport::error::operation_aborted) {
+            // ignore, this is expected
+            return;
+        }
 
-#ifdef _WEBSOCKETPP_MOVE_SEMANTICS_
-template <typename config>
-void connection<config>::set_body(std::string && value, const http::body_options& opts,
-    lib::error_code & ec)
-{
-    if (m_internal_state != istate::PROCESS_HTTP_REQUEST) {
-        ec = error::make_error_code(error::invalid_state);
+        WEBSOCKETPP_LOG(*m_elog, log::elevel::devel,
+            "hibernate timer error: " << ec.message());
         return;
     }
 
-	check_body_encoding(value, opts, ec);
-	if (ec) {
-		return;
-	}
-
-    ec = m_response.set_body(std::move(value));
-}
+    {
+        scoped_lock_type lock(m_connection_state_lock);
+        if (m_state != session::state::open) {
+            return;
+        }
+    }
 
-#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
-template <typename config>
-void connection<config>::set_body(std::string && value, const http::body_options& opts) {
-    lib::error_code ec;
-    this->set_body(std::move(value), opts, ec);
-    if (ec) {
-        throw exception("Call to set_body from invalid state", ec);
+    if (m_read_count != m_hibernate_reads || !hibernate()) {
+        start_hibernate_timer();
     }
 }
-#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
-#endif // _WEBSOCKETPP_MOVE_SEMANTICS_
 
 template <typename config>
-void connection<config>::set_request(request_type req,
-	lib::error_code& ec)
-{
-    if (m_internal_state != istate::USER_INIT) {
-        ec = error::make_error_code(error::invalid_state);
-        return;
+bool connection<config>::hibernate() {
+    if (config_traits<config>::lock_free_send_queue) {
+        // the send side belongs to the writer, only the read side is idle
+        m_processor->hibernate(false);
+    } else {
+        scoped_lock_type lock(m_write_lock);
+
+        if (m_write_flag || !send_queue_empty() || m_offload_busy ||
+            m_fragment_source || !m_stream_held.empty())
+        {
+            return false;
+        }
+
+        m_processor->hibernate(true);
+
+        for (size_t i = 0; i <= close_lane; ++i) {
+            ring_queue<message_ptr>().swap(m_send_queue[i]);
+        }
+        m_auto_pong.reset();
+        m_auto_pong_queued = false;
+        std::deque<message_ptr>().swap(m_fragment_deferred);
+        std::vector<transport::buffer>().swap(m_send_buffer);
+        std::vector<message_ptr>().swap(m_current_msgs);
+        std::string().swap(m_coalesce_buffer);
     }
 
-	const size_t max_body_size = req.get_max_body_size();
-	m_request = std::move(req);
-	m_request.set_max_body_size(max_body_size);
+    release_handshake();
+    std::vector<message_ptr>().swap(m_message_batch);
+
+    m_alog->write(log::alevel::devel,"connection hibernating");
+    m_hibernating = true;
+    return true;
 }
 
 template <typename config>
-void connection<config>::append_header(std::string const & key,
-    std::string const & val, lib::error_code & ec)
-{
-    if (m_is_server) {
-        if (m_internal_state == istate::PROCESS_HTTP_REQUEST) {
-            // we are setting response headers for an incoming server connection
-            ec = m_response.append_header(key, val);
-        } else {
-            ec = error::make_error_code(error::invalid_state);
+void connection<config>::release_handshake() {
+    // The handshake is long over. Only the parts kept in members of their
+    // own, such as the uri and subprotocol, and the retained request headers
+    // are still needed.
+    request_type kept;
+
+    std::string_view names(config_traits<config>::retained_request_headers);
+    while (!names.empty()) {
+        size_t end = names.find(',');
+        std::string_view item = names.substr(0, end);
+        names = end == std::string_view::npos ? std::string_view() :
+            names.substr(end + 1);
+
+        while (!item.empty() && item.front() == ' ') {
+            item.remove_prefix(1);
         }
-    } else {
-        if (m_internal_state == istate::USER_INIT) {
-            // we are setting initial headers for an outgoing client connection
-            ec = m_request.append_header(key, val);
-        } else {
-            ec = error::make_error_code(error::invalid_state);
+        while (!item.empty() && item.back() == ' ') {
+            item.remove_suffix(1);
+        }
+        if (item.empty()) {
+            continue;
+        }
+
+        std::string name(item);
+
+        std::string const & value = m_request.get_header(name);
+        if (!value.empty()) {
+            kept.replace_header(name, value);
         }
     }
+
+    m_request = std::move(kept);
+    m_response = response_type();
+    std::string().swap(m_http_message_buffer);
 }
 
-#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
 template <typename config>
-void connection<config>::append_header(std::string const & key,
-    std::string const & val)
+bool connection<config>::arm_deadline(deadline & d, long duration,
+    transport::timer_handler callback)
 {
-    lib::error_code ec;
-    this->append_header(key, val, ec);
-    if (ec) {
-        throw exception("Call to append_header from invalid state", ec);
+    cancel_deadline(d);
+
+    if (trace_type::static_test(trace::point::timer)) {
+        callback = lib::bind(
+            &type::handle_traced_deadline,
+            type::get_shared(),
+            callback,
+            lib::placeholders::_1
+        );
+    }
+
+    if (m_timer_wheel) {
+        m_timer_wheel->arm(d.entry, duration, lib::bind(
+            &type::handle_deadline,
+            type::get_shared(),
+            callback
+        ));
+        return true;
     }
+
+    d.timer = transport_con_type::set_timer(duration, callback);
+    return !!d.timer;
 }
-#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
 
 template <typename config>
-void connection<config>::replace_header(std::string const & key,
-    std::string const & val, lib::error_code & ec)
-{
-    if (m_is_server) {
-        if (m_internal_state == istate::PROCESS_HTTP_REQUEST) {
-            // we are setting response headers for an incoming server connection
-            ec = m_response.replace_header(key, val);
-        } else {
-            ec = error::make_error_code(error::invalid_state);
-        }
-    } else {
-        if (m_internal_state == istate::USER_INIT) {
-            // we are setting initial headers for an outgoing client connection
-            ec = m_request.replace_header(key, val);
-        } else {
-            ec = error::make_error_code(error::invalid_state);
-        }
+void connection<config>::cancel_deadline(deadline & d) {
+    d.entry.cancel();
+    if (d.timer) {
+        d.timer->cancel();
+        d.timer.reset();
     }
 }
 
-#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
 template <typename config>
-void connection<config>::replace_header(std::string const & key,
-    std::string const & val)
-{
-    lib::error_code ec;
-    this->replace_header(key, val, ec);
-    if (ec) {
-        throw exception("Call to replace_header from invalid state", ec);
-    }
+void connection<config>::handle_deadline(transport::timer_handler callback) {
+    // the wheel expires timers on the endpoint's thread, run the handler
+    // where the transport runs the connection's other handlers
+    transport_con_type::dispatch(lib::bind(callback, lib::error_code()));
 }
-#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
 
 template <typename config>
-void connection<config>::remove_header(std::string const & key,
-    lib::error_code & ec)
+void connection<config>::handle_traced_deadline(
+    transport::timer_handler callback, lib::error_code const & ec)
 {
-    if (m_is_server) {
-        if (m_internal_state == istate::PROCESS_HTTP_REQUEST) {
-            // we are setting response headers for an incoming server connection
-            ec = m_response.remove_header(key);
-        } else {
-            ec = error::make_error_code(error::invalid_state);
-        }
-    } else {
-        if (m_internal_state == istate::USER_INIT) {
-            // we are setting initial headers for an outgoing client connection
-            ec = m_request.remove_header(key);
-        } else {
-            ec = error::make_error_code(error::invalid_state);
-        }
-    }
+    WEBSOCKETPP_TRACE(trace_type, trace::point::timer, this, ec.value(), 0);
+    callback(ec);
 }
 
-#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
 template <typename config>
-void connection<config>::remove_header(std::string const & key)
+template <typename io_context_type>
+void connection<config>::migrate(io_context_type & io_context,
+    migration_target const & target, migrate_handler handler)
 {
-    lib::error_code ec;
-    this->remove_header(key, ec);
+    lib::error_code ec = migration_blocker();
     if (ec) {
-        throw exception("Call to remove_header from invalid state", ec);
+        handler(ec);
+        return;
     }
+
+    m_alog->write(log::alevel::devel,"connection migrate");
+
+    // Handlers of timers that already expired are queued ahead of the next
+    // step, as is the completion of the cancelled read
+    cancel_deadline(m_keepalive_timer);
+    cancel_deadline(m_hibernate_timer);
+    cancel_deadline(m_deflate_idle_timer);
+    transport_con_type::begin_migration();
+
+    transport_con_type::dispatch(lib::bind(
+        &type::template handle_migrate_detached<io_context_type>,
+        type::get_shared(),
+        &io_context,
+        target,
+        handler
+    ));
 }
-#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
 
-/// Defer HTTP Response until later
-/**
- * Used in the http handler to defer the HTTP response for this connection
- * until later. Handshake timers will be canceled and the connection will be
- * left open until `send_http_response` or an equivalent is called.
- *
- * Warning: deferred connections won't time out and as a result can tie up
- * resources.
- *
- * @return A status code, zero on success, non-zero otherwise
- */
 template <typename config>
-lib::error_code connection<config>::defer_http_response() {
-    // Cancel handshake timer, otherwise the connection will time out and we'll
-    // close the connection before the app has a chance to send a response.
-    if (m_handshake_timer) {
-        m_handshake_timer->cancel();
-        m_handshake_timer.reset();
+lib::error_code connection<config>::migration_blocker() {
+    if (m_state != session::state::open ||
+        m_internal_state != istate::PROCESS_CONNECTION)
+    {
+        return error::make_error_code(error::invalid_state);
     }
-    
-    // Do something to signal deferral
-    m_http_state = session::http_state::deferred;
-    
+
+    if (!transport_con_type::is_migratable() || m_compression_pool ||
+        m_dispatch_pool)
+    {
+        return error::make_error_code(error::not_migratable);
+    }
+
+    if (reading_paused() || m_read_buf_pooled || m_pong_pending ||
+        m_coalesce_held.load() || m_cork_depth.load() > 0 ||
+        transport_con_type::migration_busy())
+    {
+        return error::make_error_code(error::connection_busy);
+    }
+
+    scoped_lock_type lock(m_write_lock);
+    if (m_write_flag || !send_queue_empty() || get_buffered_amount() > 0 ||
+        m_offload_busy || m_fragment_source || !m_stream_held.empty())
+    {
+        return error::make_error_code(error::connection_busy);
+    }
+
     return lib::error_code();
 }
 
-/// Send deferred HTTP Response (exception free)
-/**
- * Sends an http response to an HTTP connection that was deferred. This will
- * send a complete response including all headers, status line, and body
- * text. The connection will be closed afterwards.
- *
- * @since 0.6.0
- *
- * @param ec A status code, zero on success, non-zero otherwise
- */
 template <typename config>
-void connection<config>::send_http_response(lib::error_code & ec) {
-    {
-        scoped_lock_type lock(m_connection_state_lock);
-        if (m_http_state != session::http_state::deferred) {
-            ec = error::make_error_code(error::invalid_state);
-            return;
-        }
-    
-        m_http_state = session::http_state::body_written;
+void connection<config>::restart_idle_timers() {
+    start_keepalive_timer();
+    if (!m_hibernating) {
+        start_hibernate_timer();
     }
-    
-    this->write_http_response(lib::error_code());
-    ec = lib::error_code();
+    start_deflate_idle_timer();
 }
 
-#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
 template <typename config>
-void connection<config>::send_http_response() {
-    lib::error_code ec;
-    this->send_http_response(ec);
-    if (ec) {
-        throw exception(ec);
+template <typename io_context_type>
+void connection<config>::handle_migrate_detached(io_context_type * io_context,
+    migration_target const & target, migrate_handler const & handler)
+{
+    bool const detached = transport_con_type::end_migration();
+
+    // A read that completed before it could be cancelled was handled as
+    // usual and may have left the connection busy or closed
+    lib::error_code ec = migration_blocker();
+    if (!ec && !detached) {
+        ec = error::make_error_code(error::connection_busy);
     }
-}
-#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
 
+    if (!ec) {
+        // expired timer handlers that ran in the meantime may have rearmed
+        // these, a cancelled handler only looks at its error code
+        cancel_deadline(m_keepalive_timer);
+        cancel_deadline(m_hibernate_timer);
+        cancel_deadline(m_deflate_idle_timer);
+
+        ec = transport_con_type::move_io_context(io_context, target.alog,
+            target.elog);
+    }
 
+    if (ec) {
+        WEBSOCKETPP_LOG(*m_alog, log::alevel::devel,
+            "connection stays put: " << ec.message());
+        if (m_state == session::state::open) {
+            restart_idle_timers();
+        }
+        if (detached && m_state != session::state::closed) {
+            m_read_waiting = false;
+            read_frame();
+        }
+        handler(ec);
+        return;
+    }
 
+    if (m_registry && m_id) {
+        m_registry->erase(m_id);
+    }
+    m_id = 0;
+    m_registry = target.registry;
+    m_timer_wheel = target.timer_wheel;
+    m_alog = target.alog;
+    m_elog = target.elog;
 
-/******** logic thread ********/
+    // runs on the new io_context, behind anything posted there already
+    transport_con_type::dispatch(lib::bind(
+        &type::handle_migrate_arrived,
+        type::get_shared(),
+        handler
+    ));
+}
 
 template <typename config>
-void connection<config>::start() {
-    m_alog->write(log::alevel::devel,"connection start");
+void connection<config>::handle_migrate_arrived(
+    migrate_handler const & handler)
+{
+    m_alog->write(log::alevel::devel,"connection migrated");
 
-    if (m_internal_state != istate::USER_INIT) {
-        m_alog->write(log::alevel::devel,"Start called in invalid state");
-        this->terminate(error::make_error_code(error::invalid_state));
-        return;
+    // a handler posted here in the meantime may have started closing
+    if (m_state == session::state::open) {
+        if (m_registry) {
+            m_id = m_registry->insert(type::get_shared());
+        }
+        restart_idle_timers();
+    }
+    if (m_state != session::state::closed) {
+        m_read_waiting = false;
+        read_frame();
     }
 
-    m_internal_state = istate::TRANSPORT_INIT;
+    handler(lib::error_code());
+}
 
-    // Depending on how the transport implements init this function may return
-    // immediately and call handle_transport_init later or call
-    // handle_transport_init from this function.
-    transport_con_type::init(
+template <typename config>
+void connection<config>::start_deflate_idle_timer() {
+    if (m_deflate_idle_timeout <= 0) {
+        return;
+    }
+
+    arm_deadline(
+        m_deflate_idle_timer,
+        m_deflate_idle_timeout,
         lib::bind(
-            &type::handle_transport_init,
+            &type::handle_deflate_idle_timer,
             type::get_shared(),
             lib::placeholders::_1
         )
@@ -919,256 +1291,3107 @@ void connection<config>::start() {
 }
 
 template <typename config>
-void connection<config>::handle_transport_init(lib::error_code const & ec) {
-    m_alog->write(log::alevel::devel,"connection handle_transport_init");
+void connection<config>::handle_deflate_idle_timer(lib::error_code const & ec)
+{
+    if (ec) {
+        if (ec == transport::error::operation_aborted) {
+            // ignore, this is expected
+            return;
+        }
 
-    lib::error_code ecm = ec;
+        WEBSOCKETPP_LOG(*m_elog, log::elevel::devel,
+            "deflate idle timer error: " << ec.message());
+        return;
+    }
 
-    if (m_internal_state != istate::TRANSPORT_INIT) {
-        m_alog->write(log::alevel::devel,
-          "handle_transport_init must be called from transport init state");
-        ecm = error::make_error_code(error::invalid_state);
+    {
+        scoped_lock_type lock(m_connection_state_lock);
+        if (m_state != session::state::open) {
+            return;
+        }
     }
 
-    if (ecm) {
-        std::stringstream s;
-        s << "handle_transport_init received error: "<< ecm.message();
-        m_elog->write(log::elevel::rerror,s.str());
+    if (config_traits<config>::lock_free_send_queue) {
+        // data frames are prepared by the writer without m_write_lock
+        m_processor->release_idle_deflate(false);
+    } else {
+        scoped_lock_type lock(m_write_lock);
+        // a worker may be using the compressor
+        m_processor->release_idle_deflate(!m_offload_busy);
+    }
 
-        this->terminate(ecm);
-        return;
+    start_deflate_idle_timer();
+}
+
+template <typename config>
+void connection<config>::pong(std::string const& payload, lib::error_code& ec) {
+    if (m_alog->static_test(log::alevel::devel)) {
+        m_alog->write(log::alevel::devel,"connection pong");
     }
 
-    // At this point the transport is ready to read and write bytes.
-    if (m_is_server) {
-        m_internal_state = istate::READ_HTTP_REQUEST;
-        this->read_handshake(1);
-    } else {
-        // We are a client.
-		m_internal_state = istate::WRITE_HTTP_REQUEST;
-		if (!m_is_http)
-		{
-			// Set the processor to the version specified in the config file and send a handshake request.
-			m_processor = get_processor(config::client_version);
-
-			// Have the protocol processor fill in the appropriate fields based on the
-			// selected client version
-			if (m_processor) {
-				lib::error_code ec;
-				ec = m_processor->client_handshake_request(m_request,m_uri,
-					m_requested_subprotocols);
-
-				if (ec) {
-					log_err(log::elevel::fatal,"Internal library error: Processor",ec);
-					return;
-				}
-			} else {
-				m_elog->write(log::elevel::fatal,"Internal library error: missing processor");
-				return;
-			}
-		} else { // regular http request
-			if (m_request.get_version().empty())
-				m_request.set_version("HTTP/1.1");
-			
-			if (m_request.get_method().empty())
-				m_request.set_method("GET");
+    session::state::value const state =
+        m_state.load(std::memory_order_acquire);
+    if (state != session::state::open) {
+        WEBSOCKETPP_LOG(*m_alog, log::alevel::devel,
+            "connection::pong called from invalid state " << state);
+        ec = error::make_error_code(error::invalid_state);
+        return;
+    }
 
-			std::string host_port;
-			std::string resource;
+    message_ptr msg;
+    if (payload.empty() && m_control_frames) {
+        msg = shared_control_frame(m_control_frames->get_pong());
+    }
 
-			const uri request_uri(m_request.get_uri());
-			if (request_uri.is_absolute()) {
-				host_port = request_uri.get_host_port();
-				resource = request_uri.get_resource();
-			} else {
-				host_port = m_uri->get_host_port();
-				resource = m_uri->get_resource();
-				if (resource.ends_with('/')) // prevent double slashes!
-					resource.pop_back();
-				resource += request_uri.get_resource(); // get_resource should always have a leading slash
-			}
+    if (!msg) {
+        msg = m_msg_manager->get_message();
+        if (!msg) {
+            ec = error::make_error_code(error::no_outgoing_buffers);
+            return;
+        }
 
-			m_request.replace_header("Host", host_port);;
-			m_request.set_uri(resource);
-		}
-		this->send_http_request();
+        ec = m_processor->prepare_pong(payload,msg);
+        if (ec) {return;}
     }
-}
 
-template <typename config>
-void connection<config>::read_handshake(size_t num_bytes) {
-    m_alog->write(log::alevel::devel,"connection read_handshake");
+    bool needs_writing = write_enqueue(msg);
 
-    if (m_open_handshake_timeout_dur > 0) {
-        m_handshake_timer = transport_con_type::set_timer(
-            m_open_handshake_timeout_dur,
-            lib::bind(
-                &type::handle_open_handshake_timeout,
-                type::get_shared(),
-                lib::placeholders::_1
-            )
-        );
+    if (needs_writing) {
+        schedule_write_frame();
     }
 
-    transport_con_type::async_read_at_least(
-        num_bytes,
-        m_buf,
-        config::connection_read_buffer_size,
-        lib::bind(
-            &type::handle_read_handshake,
-            type::get_shared(),
-            lib::placeholders::_1,
-            lib::placeholders::_2
-        )
-    );
+    ec = lib::error_code();
 }
 
-// All exit paths for this function need to call write_http_response() or submit
-// a new read request with this function as the handler.
 template <typename config>
-void connection<config>::handle_read_handshake(lib::error_code const & ec,
-    size_t bytes_transferred)
+void connection<config>::auto_pong(std::string const & payload,
+    lib::error_code & ec)
 {
-    m_alog->write(log::alevel::devel,"connection handle_read_handshake");
-
-    lib::error_code ecm = ec;
+    if (config_traits<config>::lock_free_send_queue) {
+        // queued messages cannot be reached to rewrite them
+        pong(payload,ec);
+        return;
+    }
 
-    if (!ecm) {
+    {
         scoped_lock_type lock(m_connection_state_lock);
-        
-        if (m_state == session::state::connecting) {
-             if (m_internal_state != istate::READ_HTTP_REQUEST) {
-                ecm = error::make_error_code(error::invalid_state);
-             }
-        } else if (m_state == session::state::closed) {
-            // The connection was canceled while the response was being sent,
-            // usually by the handshake timer. This is basically expected
-            // (though hopefully rare) and there is nothing we can do so ignore.
-            m_alog->write(log::alevel::devel,
-                "handle_read_handshake invoked after connection was closed");
+        if (m_state != session::state::open) {
+            ec = error::make_error_code(error::invalid_state);
             return;
-        } else {
-            ecm = error::make_error_code(error::invalid_state);
         }
     }
 
-    if (ecm) {
-        if (ecm == transport::error::eof && m_state == session::state::closed) {
-            // we expect to get eof if the connection is closed already
-            m_alog->write(log::alevel::devel,
-                    "got (expected) eof/state error from closed con");
+    bool needs_writing;
+    {
+        scoped_lock_type lock(m_write_lock);
+
+        if (m_auto_pong_queued) {
+            size_t size = m_auto_pong->get_payload_size();
+            ec = m_processor->prepare_pong(payload,m_auto_pong);
+            m_send_buffer_size -= size;
+            m_send_buffer_size += m_auto_pong->get_payload_size();
             return;
         }
-        
-        log_err(log::elevel::rerror,"handle_read_handshake",ecm);
-        this->terminate(ecm);
-        return;
-    }
 
-    // Boundaries checking. TODO: How much of this should be done?
-    if (bytes_transferred > config::connection_read_buffer_size) {
-        m_elog->write(log::elevel::fatal,"Fatal boundaries checking error.");
-        this->terminate(make_error_code(error::general));
-        return;
-    }
+        // the last pong may still be in the write in progress
+        if (!m_auto_pong || m_auto_pong.use_count() > 1) {
+            m_auto_pong = m_msg_manager->get_message();
+            if (!m_auto_pong) {
+                ec = error::make_error_code(error::no_outgoing_buffers);
+                return;
+            }
+        }
 
-    size_t bytes_processed = 0;
-    lib::error_code consume_ec;
+        ec = m_processor->prepare_pong(payload,m_auto_pong);
+        if (ec) {return;}
 
-    bytes_processed = m_request.consume(m_buf, bytes_transferred, consume_ec);
-    if (consume_ec) {
-        // All HTTP errors will result in this request failing and an error
-        // response being returned. No more bytes will be read in this con.
-        m_response.set_status(http::error::get_status_code(http::error::value(consume_ec.value())));
-        log_err(log::elevel::fatal,"Fatal error reading request: ",consume_ec);
-        this->write_http_response_error(error::make_error_code(error::http_parse_error));
-        return;
+        write_push(m_auto_pong);
+        m_auto_pong_queued = true;
+        needs_writing = !m_write_flag && !send_queue_empty();
     }
 
-    // More paranoid boundaries checking.
-    // TODO: Is this overkill?
-    if (bytes_processed > bytes_transferred) {
-        m_elog->write(log::elevel::fatal,"Fatal boundaries checking error.");
-        this->terminate(make_error_code(error::general));
-        return;
+    if (needs_writing) {
+        schedule_write_frame();
     }
+}
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+template<typename config>
+void connection<config>::pong(std::string const & payload) {
+    lib::error_code ec;
+    pong(payload,ec);
+    if (ec) {
+        throw exception(ec);
+    }
+}
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
+template <typename config>
+void connection<config>::close(close::status::value const code,
+    std::string const & reason, lib::error_code & ec)
+{
+    if (m_alog->static_test(log::alevel::devel)) {
+        m_alog->write(log::alevel::devel,"connection close");
+    }
+
+    // Truncate reason to maximum size allowable in a close frame.
+    std::string tr(reason,0,std::min<size_t>(reason.size(),
+        frame::limits::close_reason_size));
+
+    scoped_lock_type lock(m_connection_state_lock);
+
+    if (m_state != session::state::open) {
+       ec = error::make_error_code(error::invalid_state);
+       return;
+    }
+
+    ec = this->send_close_frame(code,tr,false,close::status::terminal(code));
+}
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+template<typename config>
+void connection<config>::close(close::status::value const code,
+    std::string const & reason)
+{
+    lib::error_code ec;
+    close(code,reason,ec);
+    if (ec) {
+        throw exception(ec);
+    }
+}
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
+template <typename config>
+void connection<config>::close_shared(close::status::value code,
+    std::string const & reason, message_ptr const & frame, bool timer,
+    lib::error_code & ec)
+{
+    scoped_lock_type lock(m_connection_state_lock);
+
+    if (m_state != session::state::open) {
+       ec = error::make_error_code(error::invalid_state);
+       return;
+    }
+
+    ec = this->send_close_frame(code,reason,false,close::status::terminal(code),
+        frame,timer);
+}
+
+template <typename config>
+void connection<config>::expire_close() {
+    transport_con_type::dispatch(lib::bind(
+        &type::handle_expire_close,
+        type::get_shared()
+    ));
+}
+
+template <typename config>
+void connection<config>::handle_expire_close() {
+    {
+        scoped_lock_type lock(m_connection_state_lock);
+        if (m_state != session::state::closing) {
+            return;
+        }
+    }
+
+    m_alog->write(log::alevel::devel, "close_all deadline expired");
+    cancel_deadline(m_handshake_timer);
+    terminate(make_error_code(error::close_handshake_timeout));
+}
+
+/// Trigger the on_interrupt handler
+/**
+ * This is thread safe if the transport is thread safe
+ */
+template <typename config>
+lib::error_code connection<config>::interrupt() {
+    m_alog->write(log::alevel::devel,"connection connection::interrupt");
+    return transport_con_type::interrupt(
+        lib::bind(
+            &type::handle_interrupt,
+            type::get_shared()
+        )
+    );
+}
+
+
+template <typename config>
+void connection<config>::handle_interrupt() {
+    if (m_interrupt_handler) {
+        handler_timer timer(*this, handler_type::interrupt);
+        m_interrupt_handler(m_connection_hdl);
+    }
+}
+
+template <typename config>
+lib::error_code connection<config>::pause_reading() {
+    m_alog->write(log::alevel::devel,"connection connection::pause_reading");
+    return transport_con_type::dispatch(
+        lib::bind(
+            &type::handle_pause_reading,
+            type::get_shared()
+        )
+    );
+}
+
+/// Pause reading handler. Not safe to call directly
+template <typename config>
+void connection<config>::handle_pause_reading() {
+    m_alog->write(log::alevel::devel,"connection connection::handle_pause_reading");
+    m_read_flag = false;
+}
+
+template <typename config>
+lib::error_code connection<config>::resume_reading() {
+    m_alog->write(log::alevel::devel,"connection connection::resume_reading");
+    return transport_con_type::dispatch(
+        lib::bind(
+            &type::handle_resume_reading,
+            type::get_shared()
+        )
+    );
+}
+
+/// Resume reading helper method. Not safe to call directly
+template <typename config>
+void connection<config>::handle_resume_reading() {
+   m_read_flag = true;
+   read_frame();
+}
+
+template <typename config>
+lib::error_code connection<config>::release_message(message_ptr const & msg) {
+    return transport_con_type::dispatch(
+        lib::bind(
+            &type::handle_release_message,
+            type::get_shared(),
+            msg->get_payload_size()
+        )
+    );
+}
+
+/// Release handler. Not safe to call directly
+template <typename config>
+void connection<config>::handle_release_message(size_t bytes) {
+    if (m_flow_messages > 0) {
+        --m_flow_messages;
+    }
+    m_flow_bytes -= (std::min)(bytes, m_flow_bytes);
+
+    if (m_flow_paused && !flow_over_limit()) {
+        m_alog->write(log::alevel::devel,"inbound flow control resumed reading");
+        m_flow_paused = false;
+        read_frame();
+    }
+}
+
+
+
+
+
+
+
+
+
+
+
+template <typename config>
+bool connection<config>::get_secure() const {
+    //scoped_lock_type lock(m_connection_state_lock);
+    return m_uri->get_secure();
+}
+
+template <typename config>
+std::string const & connection<config>::get_host() const {
+    //scoped_lock_type lock(m_connection_state_lock);
+    return m_uri->get_host();
+}
+
+template <typename config>
+std::string const & connection<config>::get_resource() const {
+    //scoped_lock_type lock(m_connection_state_lock);
+    return m_uri->get_resource();
+}
+
+template <typename config>
+uint16_t connection<config>::get_port() const {
+    //scoped_lock_type lock(m_connection_state_lock);
+    return m_uri->get_port();
+}
+
+template <typename config>
+uri_ptr connection<config>::get_uri() const {
+    //scoped_lock_type lock(m_connection_state_lock);
+    return m_uri;
+}
+
+template <typename config>
+void connection<config>::set_uri(uri_ptr uri) {
+    //scoped_lock_type lock(m_connection_state_lock);
+    m_uri = uri;
+	m_is_http = m_uri && m_uri->get_type() == uri::http;
+}
+
+
+
+
+
+
+template <typename config>
+std::string const & connection<config>::get_subprotocol() const {
+    return m_subprotocol;
+}
+
+template <typename config>
+std::vector<std::string> const &
+connection<config>::get_requested_subprotocols() const {
+    return m_requested_subprotocols;
+}
+
+template <typename config>
+void connection<config>::add_subprotocol(std::string const & value,
+    lib::error_code & ec)
+{
+    if (m_is_server) {
+        ec = error::make_error_code(error::client_only);
+        return;
+    }
+
+    // If the value is empty or has a non-RFC2616 token character it is invalid.
+    if (value.empty() || std::find_if(value.begin(),value.end(),
+                                      http::is_not_token_char) != value.end())
+    {
+        ec = error::make_error_code(error::invalid_subprotocol);
+        return;
+    }
+
+    m_requested_subprotocols.push_back(value);
+}
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+template <typename config>
+void connection<config>::add_subprotocol(std::string const & value) {
+    lib::error_code ec;
+    this->add_subprotocol(value,ec);
+    if (ec) {
+        throw exception(ec);
+    }
+}
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
+
+template <typename config>
+void connection<config>::select_subprotocol(std::string const & value,
+    lib::error_code & ec)
+{
+    if (!m_is_server) {
+        ec = error::make_error_code(error::server_only);
+        return;
+    }
+
+    if (value.empty()) {
+        ec = lib::error_code();
+        return;
+    }
+
+    std::vector<std::string>::iterator it;
+
+    it = std::find(m_requested_subprotocols.begin(),
+                   m_requested_subprotocols.end(),
+                   value);
+
+    if (it == m_requested_subprotocols.end()) {
+        ec = error::make_error_code(error::unrequested_subprotocol);
+        return;
+    }
+
+    m_subprotocol = value;
+    ec = lib::error_code();
+}
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+template <typename config>
+void connection<config>::select_subprotocol(std::string const & value) {
+    lib::error_code ec;
+    this->select_subprotocol(value,ec);
+    if (ec) {
+        throw exception(ec);
+    }
+}
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
+
+template <typename config>
+std::string const &
+connection<config>::get_request_header(std::string const & key) const {
+    return m_request.get_header(key);
+}
+
+template <typename config>
+std::string const &
+connection<config>::get_request_body() const {
+    return m_request.get_body();
+}
+
+template <typename config>
+std::string const &
+connection<config>::get_response_header(std::string const & key) const {
+    return m_response.get_header(key);
+}
+
+template <typename config>
+void connection<config>::set_status(http::status_code::value code,
+    lib::error_code & ec)
+{
+    if (m_internal_state != istate::PROCESS_HTTP_REQUEST) {
+        ec = error::make_error_code(error::invalid_state);
+        return;
+    }
+    ec = m_response.set_status(code);
+}
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+template <typename config>
+void connection<config>::set_status(http::status_code::value code)
+{
+    lib::error_code ec;
+    this->set_status(code, ec);
+    if (ec) {
+        throw exception("Call to set_status from invalid state", ec);
+    }
+}
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
+template <typename config>
+void connection<config>::set_status(http::status_code::value code,
+    std::string const & msg, lib::error_code & ec)
+{
+    if (m_internal_state != istate::PROCESS_HTTP_REQUEST) {
+        ec = error::make_error_code(error::invalid_state);
+        return;
+    }
+
+    ec = m_response.set_status(code,msg);
+}
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+template <typename config>
+void connection<config>::set_status(http::status_code::value code,
+    std::string const & msg)
+{
+    lib::error_code ec;
+    this->set_status(code, msg);
+    if (ec) {
+        throw exception("Call to set_status from invalid state", ec);
+    }
+}
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
+template <typename config>
+void connection<config>::check_body_encoding(std::string & body, const http::body_options& opts, lib::error_code & ec)
+{
+	remove_header(http::Header_ContentEncoding, ec);
+	if (opts.input_encoding)
+	{
+		if (m_request.accepts_encoding(*opts.input_encoding)) {
+			append_header(http::Header_ContentEncoding, http::content_encoding::to_string(*opts.input_encoding), ec);
+			return; // body already in correct format!
+		}
+		else {
+			body = encoding::decompress(*opts.input_encoding, false, body, ec);
+		}
+	}
+
+	for (http::content_encoding::value encode_body : opts.output_encoding) {
+		if (ec) break;
+
+		if (!http::is_encoding_supported(encode_body)) continue;
+
+		if (!m_request.accepts_encoding(encode_body)) continue;
+
+		body = encoding::compress(encode_body, true, body, ec);
+		if (!ec) {
+			append_header(http::Header_ContentEncoding, http::content_encoding::to_string(encode_body), ec);
+		}
+
+		break; // only encode in a single format
+	}
+
+	for (http::transfer_encoding::value encode_body : opts.transfer_encoding) {
+		if (ec) break;
+
+		if (encode_body == http::transfer_encoding::chunked) continue;
+
+		const http::content_encoding::value as_content_encoding = static_cast<http::content_encoding::value>(encode_body);
+
+		if (!http::is_encoding_supported(as_content_encoding)) continue;
+
+		if (!m_request.accepts_encoding(as_content_encoding)) continue;
+
+		body = encoding::compress(as_content_encoding, true, body, ec);
+		if (!ec) {
+			append_header(http::Header_ContentEncoding, http::content_encoding::to_string(as_content_encoding), ec);
+		}
+
+		// allow multiple encodings
+	}
+}
+
+template <typename config>
+void connection<config>::set_body(std::string const & value, const http::body_options& opts,
+    lib::error_code & ec)
+{
+    if (m_internal_state != istate::PROCESS_HTTP_REQUEST) {
+        ec = error::make_error_code(error::invalid_state);
+        return;
+    }
+
+	std::string body(value);
+	check_body_encoding(body, opts, ec);
+	if (ec) {
+		return;
+	}
+
+    ec = m_response.set_body(std::move(body));
+}
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+template <typename config>
+void connection<config>::set_body(std::string const & value, const http::body_options& opts) {
+    lib::error_code ec;
+    this->set_body(value, opts, ec);
+    if (ec) {
+        throw exception("Call to set_body from invalid state", ec);
+    }
+}
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
+#ifdef _WEBSOCKETPP_MOVE_SEMANTICS_
+template <typename config>
+void connection<config>::set_body(std::string && value, const http::body_options& opts,
+    lib::error_code & ec)
+{
+    if (m_internal_state != istate::PROCESS_HTTP_REQUEST) {
+        ec = error::make_error_code(error::invalid_state);
+        return;
+    }
+
+	check_body_encoding(value, opts, ec);
+	if (ec) {
+		return;
+	}
+
+    ec = m_response.set_body(std::move(value));
+}
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+template <typename config>
+void connection<config>::set_body(std::string && value, const http::body_options& opts) {
+    lib::error_code ec;
+    this->set_body(std::move(value), opts, ec);
+    if (ec) {
+        throw exception("Call to set_body from invalid state", ec);
+    }
+}
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+#endif // _WEBSOCKETPP_MOVE_SEMANTICS_
+
+template <typename config>
+void connection<config>::set_request(request_type req,
+	lib::error_code& ec)
+{
+    if (m_internal_state != istate::USER_INIT) {
+        ec = error::make_error_code(error::invalid_state);
+        return;
+    }
+
+	const size_t max_body_size = req.get_max_body_size();
+	m_request = std::move(req);
+	m_request.set_max_body_size(max_body_size);
+}
+
+template <typename config>
+void connection<config>::append_header(std::string const & key,
+    std::string const & val, lib::error_code & ec)
+{
+    if (m_is_server) {
+        if (m_internal_state == istate::PROCESS_HTTP_REQUEST) {
+            // we are setting response headers for an incoming server connection
+            ec = m_response.append_header(key, val);
+        } else {
+            ec = error::make_error_code(error::invalid_state);
+        }
+    } else {
+        if (m_internal_state == istate::USER_INIT) {
+            // we are setting initial headers for an outgoing client connection
+            ec = m_request.append_header(key, val);
+        } else {
+            ec = error::make_error_code(error::invalid_state);
+        }
+    }
+}
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+template <typename config>
+void connection<config>::append_header(std::string const & key,
+    std::string const & val)
+{
+    lib::error_code ec;
+    this->append_header(key, val, ec);
+    if (ec) {
+        throw exception("Call to append_header from invalid state", ec);
+    }
+}
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
+template <typename config>
+void connection<config>::replace_header(std::string const & key,
+    std::string const & val, lib::error_code & ec)
+{
+    if (m_is_server) {
+        if (m_internal_state == istate::PROCESS_HTTP_REQUEST) {
+            // we are setting response headers for an incoming server connection
+            ec = m_response.replace_header(key, val);
+        } else {
+            ec = error::make_error_code(error::invalid_state);
+        }
+    } else {
+        if (m_internal_state == istate::USER_INIT) {
+            // we are setting initial headers for an outgoing client connection
+            ec = m_request.replace_header(key, val);
+        } else {
+            ec = error::make_error_code(error::invalid_state);
+        }
+    }
+}
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+template <typename config>
+void connection<config>::replace_header(std::string const & key,
+    std::string const & val)
+{
+    lib::error_code ec;
+    this->replace_header(key, val, ec);
+    if (ec) {
+        throw exception("Call to replace_header from invalid state", ec);
+    }
+}
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
+template <typename config>
+void connection<config>::remove_header(std::string const & key,
+    lib::error_code & ec)
+{
+    if (m_is_server) {
+        if (m_internal_state == istate::PROCESS_HTTP_REQUEST) {
+            // we are setting response headers for an incoming server connection
+            ec = m_response.remove_header(key);
+        } else {
+            ec = error::make_error_code(error::invalid_state);
+        }
+    } else {
+        if (m_internal_state == istate::USER_INIT) {
+            // we are setting initial headers for an outgoing client connection
+            ec = m_request.remove_header(key);
+        } else {
+            ec = error::make_error_code(error::invalid_state);
+        }
+    }
+}
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+template <typename config>
+void connection<config>::remove_header(std::string const & key)
+{
+    lib::error_code ec;
+    this->remove_header(key, ec);
+    if (ec) {
+        throw exception("Call to remove_header from invalid state", ec);
+    }
+}
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
+/// Defer HTTP Response until later
+/**
+ * Used in the http handler to defer the HTTP response for this connection
+ * until later. Handshake timers will be canceled and the connection will be
+ * left open until `send_http_response` or an equivalent is called.
+ *
+ * Warning: deferred connections won't time out and as a result can tie up
+ * resources.
+ *
+ * @return A status code, zero on success, non-zero otherwise
+ */
+template <typename config>
+lib::error_code connection<config>::defer_http_response() {
+    // Cancel handshake timer, otherwise the connection will time out and we'll
+    // close the connection before the app has a chance to send a response.
+    cancel_deadline(m_handshake_timer);
+    
+    // Do something to signal deferral
+    m_http_state = session::http_state::deferred;
+    
+    return lib::error_code();
+}
+
+/// Send deferred HTTP Response (exception free)
+/**
+ * Sends an http response to an HTTP connection that was deferred. This will
+ * send a complete response including all headers, status line, and body
+ * text. The connection will be closed afterwards.
+ *
+ * @since 0.6.0
+ *
+ * @param ec A status code, zero on success, non-zero otherwise
+ */
+template <typename config>
+void connection<config>::send_http_response(lib::error_code & ec) {
+    {
+        scoped_lock_type lock(m_connection_state_lock);
+        if (m_http_state != session::http_state::deferred) {
+            ec = error::make_error_code(error::invalid_state);
+            return;
+        }
+    
+        m_http_state = session::http_state::body_written;
+    }
+    
+    this->write_http_response(lib::error_code());
+    ec = lib::error_code();
+}
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+template <typename config>
+void connection<config>::send_http_response() {
+    lib::error_code ec;
+    this->send_http_response(ec);
+    if (ec) {
+        throw exception(ec);
+    }
+}
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
+template <typename config>
+void connection<config>::write_http_headers(lib::error_code & ec) {
+    {
+        scoped_lock_type lock(m_connection_state_lock);
+        if (!m_is_http || !m_is_server ||
+            m_internal_state != istate::PROCESS_HTTP_REQUEST ||
+            (m_http_state != session::http_state::init &&
+             m_http_state != session::http_state::deferred))
+        {
+            ec = error::make_error_code(error::invalid_state);
+            return;
+        }
+
+        m_http_state = session::http_state::headers_written;
+    }
+
+    cancel_deadline(m_handshake_timer);
+
+    if (m_response.get_status_code() == http::status_code::uninitialized) {
+        m_response.set_status(http::status_code::ok);
+    }
+
+    bool const sized = !m_response.get_header("Content-Length").empty();
+    m_http_chunked = !sized && m_request.get_version() == "HTTP/1.1";
+    m_http_parts = 0;
+
+    if (m_http_chunked) {
+        m_response.replace_header("Transfer-Encoding", "chunked");
+    }
+    if (sized || m_http_chunked) {
+        this->prepare_http_keep_alive(lib::error_code());
+    } else {
+        // the client finds the end of this body by the connection closing
+        ++m_http_requests;
+        m_http_keep_alive = false;
+        m_response.replace_header("Connection", "close");
+    }
+
+    m_response.set_version("HTTP/1.1");
+    if (m_response.get_header("Server").empty()) {
+        if (!this->user_agent().empty()) {
+            m_response.replace_header("Server",this->user_agent());
+        } else {
+            m_response.remove_header("Server");
+        }
+    }
+
+    // the body, if any, follows as the first part
+    std::string const & body = m_response.get_body();
+    std::string head = m_response.raw();
+    head.resize(head.size() - body.size());
+
+    if (log::enabled(*m_alog, log::alevel::devel)) {
+        m_alog->write(log::alevel::devel,"Streamed HTTP response head:\n"+head);
+    }
+
+    ec = this->write_http_part(std::string(), head.data(), head.size(), false);
+    if (ec) {
+        return;
+    }
+
+    this->write_http_body(body.data(), body.size(), ec);
+}
+
+template <typename config>
+void connection<config>::write_http_body(void const * data, size_t len,
+    lib::error_code & ec)
+{
+    {
+        scoped_lock_type lock(m_connection_state_lock);
+        if (m_http_state != session::http_state::headers_written) {
+            ec = error::make_error_code(error::invalid_state);
+            return;
+        }
+    }
+
+    // the chunk size line has to fit in a frame header buffer
+    static size_t const max_chunk = 0xffffffff;
+    char const * bytes = static_cast<char const *>(data);
+
+    ec = lib::error_code();
+    while (len > 0 && !ec) {
+        size_t const n = len < max_chunk ? len : max_chunk;
+
+        std::string prefix;
+        if (m_http_chunked) {
+            static char const digits[] = "0123456789abcdef";
+            char size_line[8];
+            size_t i = sizeof(size_line);
+            size_t v = n;
+            do {
+                size_line[--i] = digits[v & 0xf];
+                v >>= 4;
+            } while (v);
+
+            if (m_http_parts > 0) {
+                prefix = "\r\n";
+            }
+            prefix.append(size_line + i, sizeof(size_line) - i);
+            prefix += "\r\n";
+        }
+
+        ec = this->write_http_part(prefix, bytes, n, false);
+        ++m_http_parts;
+        bytes += n;
+        len -= n;
+    }
+}
+
+template <typename config>
+void connection<config>::end_http_response(lib::error_code & ec) {
+    {
+        scoped_lock_type lock(m_connection_state_lock);
+        if (m_http_state != session::http_state::headers_written) {
+            ec = error::make_error_code(error::invalid_state);
+            return;
+        }
+
+        m_http_state = session::http_state::body_written;
+    }
+
+    std::string prefix;
+    if (m_http_chunked) {
+        prefix = m_http_parts > 0 ? "\r\n0\r\n\r\n" : "0\r\n\r\n";
+    }
+    ec = this->write_http_part(prefix, NULL, 0, true);
+}
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+template <typename config>
+void connection<config>::write_http_headers() {
+    lib::error_code ec;
+    this->write_http_headers(ec);
+    if (ec) {
+        throw exception(ec);
+    }
+}
+
+template <typename config>
+void connection<config>::write_http_body(void const * data, size_t len) {
+    lib::error_code ec;
+    this->write_http_body(data, len, ec);
+    if (ec) {
+        throw exception(ec);
+    }
+}
+
+template <typename config>
+void connection<config>::end_http_response() {
+    lib::error_code ec;
+    this->end_http_response(ec);
+    if (ec) {
+        throw exception(ec);
+    }
+}
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
+
+
+
+/******** logic thread ********/
+
+template <typename config>
+void connection<config>::start() {
+    m_alog->write(log::alevel::devel,"connection start");
+
+    if (m_internal_state != istate::USER_INIT) {
+        m_alog->write(log::alevel::devel,"Start called in invalid state");
+        this->terminate(error::make_error_code(error::invalid_state));
+        return;
+    }
+
+    m_internal_state = istate::TRANSPORT_INIT;
+    m_start_time = lib::chrono::steady_clock::now();
+
+    if (m_http_reused) {
+        // the transport of a pooled connection is connected already
+        transport_con_type::dispatch(lib::bind(
+            &type::handle_transport_init,
+            type::get_shared(),
+            lib::error_code()
+        ));
+        return;
+    }
+
+    if (!m_is_server && !m_is_http && transport_con_type::wants_early_data()) {
+        // the request has to be ready for the transport to send it with the
+        // TLS handshake
+        if (!this->prepare_handshake_request()) {
+            return;
+        }
+        this->build_http_request();
+        m_early_request = true;
+        transport_con_type::set_early_data_payload(
+            m_http_message_buffer.data(), m_http_message_buffer.size());
+    }
+
+    // Depending on how the transport implements init this function may return
+    // immediately and call handle_transport_init later or call
+    // handle_transport_init from this function.
+    transport_con_type::init(
+        lib::bind(
+            &type::handle_transport_init,
+            type::get_shared(),
+            lib::placeholders::_1
+        )
+    );
+}
+
+template <typename config>
+void connection<config>::start_extended_connect(request_type const & req,
+    extended_connect_handler h)
+{
+    if (!m_is_server) {
+        m_alog->write(log::alevel::devel,
+            "start_extended_connect called on a client connection");
+        this->terminate(error::make_error_code(error::invalid_state));
+        return;
+    }
+
+    m_request = req;
+    m_request.set_method("CONNECT");
+    if (m_request.get_version() != "HTTP/3") {
+        m_request.set_version("HTTP/2");
+    }
+    m_request.replace_header("Upgrade", processor::constants::upgrade_token);
+    m_request.set_ready();
+
+    m_extended_connect = true;
+    m_extended_connect_handler = h;
+
+    this->start();
+}
+
+template <typename config>
+void connection<config>::process_extended_connect() {
+    m_alog->write(log::alevel::devel,"connection process_extended_connect");
+
+    if (m_overloaded || (m_governor && m_governor->get_pressure() >=
+        memory_pressure::reject_handshakes))
+    {
+        m_response.set_status(http::status_code::service_unavailable);
+        m_response.replace_header("Retry-After","1");
+        this->write_http_response_error(
+            error::make_error_code(error::rejected));
+        return;
+    }
+
+    lib::error_code processor_ec = this->initialize_processor();
+    if (processor_ec) {
+        this->write_http_response_error(processor_ec);
+        return;
+    }
+
+    m_internal_state = istate::PROCESS_HTTP_REQUEST;
+
+    // No handshake was read, so the frame reader starts from an empty buffer
+    this->prepare_read_buffer();
+    m_buf_cursor = 0;
+
+    lib::error_code handshake_ec;
+    session::validation::value action =
+        this->process_handshake_request(handshake_ec);
+
+    if (action != session::validation::defer) {
+        this->write_http_response(handshake_ec);
+    }
+}
+
+template <typename config>
+void connection<config>::handle_transport_init(lib::error_code const & ec) {
+    m_alog->write(log::alevel::devel,"connection handle_transport_init");
+
+    lib::error_code ecm = ec;
+
+    if (m_internal_state != istate::TRANSPORT_INIT) {
+        m_alog->write(log::alevel::devel,
+          "handle_transport_init must be called from transport init state");
+        ecm = error::make_error_code(error::invalid_state);
+    }
+
+    if (ecm) {
+        WEBSOCKETPP_LOG(*m_elog, log::elevel::rerror,
+            "handle_transport_init received error: " << ecm.message());
+
+        this->terminate(ecm);
+        return;
+    }
+
+    // At this point the transport is ready to read and write bytes.
+    if (m_is_server && m_extended_connect) {
+        m_internal_state = istate::READ_HTTP_REQUEST;
+        this->process_extended_connect();
+    } else if (m_is_server) {
+        m_internal_state = istate::READ_HTTP_REQUEST;
+        this->read_handshake(1);
+    } else {
+        // We are a client.
+		m_internal_state = istate::WRITE_HTTP_REQUEST;
+		if (!m_is_http)
+		{
+			if (!m_early_request && !this->prepare_handshake_request()) {
+				return;
+			}
+		} else { // regular http request
+			if (m_request.get_version().empty())
+				m_request.set_version("HTTP/1.1");
+			
+			if (m_request.get_method().empty())
+				m_request.set_method("GET");
+
+			std::string host_port;
+			std::string resource;
+
+			const uri request_uri(m_request.get_uri());
+			if (request_uri.is_absolute()) {
+				host_port = request_uri.get_host_port();
+				resource = request_uri.get_resource();
+			} else {
+				host_port = m_uri->get_host_port();
+				resource = m_uri->get_resource();
+				if (resource.ends_with('/')) // prevent double slashes!
+					resource.pop_back();
+				resource += request_uri.get_resource(); // get_resource should always have a leading slash
+			}
+
+			m_request.replace_header("Host", host_port);;
+			m_request.set_uri(resource);
+
+			if constexpr (config_traits<config>::enable_http_client) {
+				if (m_http_cache) {
+					m_http_cache->prepare(this->get_request_key(), m_request);
+				}
+			}
+		}
+		this->send_http_request();
+    }
+}
+
+template <typename config>
+void connection<config>::read_handshake(size_t num_bytes) {
+    m_alog->write(log::alevel::devel,"connection read_handshake");
+
+    if (m_open_handshake_timeout_dur > 0) {
+        arm_deadline(
+            m_handshake_timer,
+            m_open_handshake_timeout_dur,
+            lib::bind(
+                &type::handle_open_handshake_timeout,
+                type::get_shared(),
+                lib::placeholders::_1
+            )
+        );
+    }
+
+    size_t const buf_size = this->prepare_read_buffer();
+    transport_con_type::async_read_at_least(
+        num_bytes,
+        m_buf.data(),
+        buf_size,
+        lib::bind(
+            &type::handle_read_handshake,
+            type::get_shared(),
+            lib::placeholders::_1,
+            lib::placeholders::_2
+        )
+    );
+}
+
+// All exit paths for this function need to call write_http_response() or submit
+// a new read request with this function as the handler.
+template <typename config>
+void connection<config>::handle_read_handshake(lib::error_code const & ec,
+    size_t bytes_transferred)
+{
+    m_alog->write(log::alevel::devel,"connection handle_read_handshake");
+
+    lib::error_code ecm = ec;
+
+    if (!ecm) {
+        scoped_lock_type lock(m_connection_state_lock);
+        
+        if (m_state == session::state::connecting) {
+             if (m_internal_state != istate::READ_HTTP_REQUEST) {
+                ecm = error::make_error_code(error::invalid_state);
+             }
+        } else if (m_state == session::state::closed) {
+            // The connection was canceled while the response was being sent,
+            // usually by the handshake timer. This is basically expected
+            // (though hopefully rare) and there is nothing we can do so ignore.
+            m_alog->write(log::alevel::devel,
+                "handle_read_handshake invoked after connection was closed");
+            return;
+        } else {
+            ecm = error::make_error_code(error::invalid_state);
+        }
+    }
+
+    if (ecm) {
+        if (ecm == transport::error::eof && m_state == session::state::closed) {
+            // we expect to get eof if the connection is closed already
+            m_alog->write(log::alevel::devel,
+                    "got (expected) eof/state error from closed con");
+            return;
+        }
+        
+        log_err(log::elevel::rerror,"handle_read_handshake",ecm);
+        this->terminate(ecm);
+        return;
+    }
+
+    // Boundaries checking. TODO: How much of this should be done?
+    if (bytes_transferred > m_buf.size()) {
+        m_elog->write(log::elevel::fatal,"Fatal boundaries checking error.");
+        this->terminate(make_error_code(error::general));
+        return;
+    }
+
+    size_t bytes_processed = 0;
+    lib::error_code consume_ec;
+
+    bytes_processed = m_request.consume(m_buf.data(), bytes_transferred, consume_ec);
+    // bytes past the request are counted when they are processed as frames
+    count_bytes_in(m_buf.data(), bytes_processed);
+    if (consume_ec) {
+        // All HTTP errors will result in this request failing and an error
+        // response being returned. No more bytes will be read in this con.
+        m_response.set_status(http::error::get_status_code(http::error::value(consume_ec.value())));
+        log_err(log::elevel::fatal,"Fatal error reading request: ",consume_ec);
+        this->write_http_response_error(error::make_error_code(error::http_parse_error));
+        return;
+    }
+
+    // More paranoid boundaries checking.
+    // TODO: Is this overkill?
+    if (bytes_processed > bytes_transferred) {
+        m_elog->write(log::elevel::fatal,"Fatal boundaries checking error.");
+        this->terminate(make_error_code(error::general));
+        return;
+    }
+
+    WEBSOCKETPP_LOG(*m_alog, log::alevel::devel,
+        "bytes_transferred: " << bytes_transferred
+        << " bytes, bytes processed: " << bytes_processed << " bytes");
+
+    if (m_request.ready()) {
+        if (m_overloaded || (m_governor && m_governor->get_pressure()
+            >= memory_pressure::reject_handshakes))
+        {
+            m_response.set_status(http::status_code::service_unavailable);
+            m_response.replace_header("Retry-After","1");
+            this->write_http_response_error(
+                error::make_error_code(error::rejected));
+            return;
+        }
+
+        lib::error_code processor_ec = this->initialize_processor();
+        if (processor_ec) {
+            this->write_http_response_error(processor_ec);
+            return;
+        }
+
+        if (m_processor && m_processor->get_version() == 0) {
+            // Version 00 has an extra requirement to read some bytes after the
+            // handshake
+            if (bytes_transferred-bytes_processed >= 8) {
+                m_request.replace_header(
+                    "Sec-WebSocket-Key3",
+                    std::string(m_buf.data()+bytes_processed,m_buf.data()+bytes_processed+8)
+                );
+                bytes_processed += 8;
+            } else {
+                // TODO: need more bytes
+                m_alog->write(log::alevel::devel,"short key3 read");
+                m_response.set_status(http::status_code::internal_server_error);
+                this->write_http_response_error(processor::error::make_error_code(processor::error::short_key3));
+                return;
+            }
+        }
+
+        if (log::enabled(*m_alog, log::alevel::devel)) {
+            m_alog->write(log::alevel::devel,m_request.raw());
+            if (!m_request.get_header("Sec-WebSocket-Key3").empty()) {
+                m_alog->write(log::alevel::devel,
+                    utility::to_hex(m_request.get_header("Sec-WebSocket-Key3")));
+            }
+        }
+
+        // The remaining bytes in m_buf are frame data. Copy them to the
+        // beginning of the buffer and note the length. They will be read after
+        // the handshake completes and before more bytes are read.
+        std::copy(m_buf.data()+bytes_processed,m_buf.data()+bytes_transferred,m_buf.data());
+        m_buf_cursor = bytes_transferred-bytes_processed;
+
+
+        m_internal_state = istate::PROCESS_HTTP_REQUEST;
+        
+        // We have the complete request. Process it.
+        lib::error_code handshake_ec;
+		session::validation::value action = this->process_handshake_request(handshake_ec);
+        
+        // Write a response if this is a websocket connection or if it is an
+        // HTTP connection for which the response has not been deferred or
+        // started yet by a different system (i.e. still in init state).
+        if ((!m_is_http && action != session::validation::defer) || (m_is_http && m_http_state == session::http_state::init)) {
+            this->write_http_response(handshake_ec);
+        } else if (m_http_body_written) {
+            // a response streamed by the http handler finished writing
+            // before the handler returned
+            m_http_body_written = false;
+            this->handle_write_http_response(m_http_body_ec);
+        }
+    } else {
+        // The HTTP parser reported that it was not ready and wants more data.
+        // Assert that it actually consumed all the data present before overwriting
+        // the buffer. This should always be the case.
+        if (bytes_transferred != bytes_processed) {
+            m_elog->write(log::elevel::fatal,"Assertion Failed: HTTP request parser failed to consume all bytes from a read request.");
+            this->terminate(make_error_code(error::general));
+            return;
+        }
+
+        govern_read_memory();
+
+        // read at least 1 more byte
+        size_t const buf_size = this->prepare_read_buffer();
+        transport_con_type::async_read_at_least(
+            1,
+            m_buf.data(),
+            buf_size,
+            lib::bind(
+                &type::handle_read_handshake,
+                type::get_shared(),
+                lib::placeholders::_1,
+                lib::placeholders::_2
+            )
+        );
+    }
+}
+
+// write_http_response requires the request to be fully read and the connection
+// to be in the PROCESS_HTTP_REQUEST state. In some cases we can detect errors
+// before the request is fully read (specifically at a point where we aren't
+// sure if the hybi00 key3 bytes need to be read). This method sets the correct
+// state and calls write_http_response
+template <typename config>
+void connection<config>::write_http_response_error(lib::error_code const & ec) {
+    if (m_internal_state != istate::READ_HTTP_REQUEST) {
+        m_alog->write(log::alevel::devel,
+            "write_http_response_error called in invalid state");
+        this->terminate(error::make_error_code(error::invalid_state));
+        return;
+    }
+    
+    m_internal_state = istate::PROCESS_HTTP_REQUEST;
+    
+    this->write_http_response(ec);
+}
+
+// All exit paths for this function need to call write_http_response() or submit
+// a new read request with this function as the handler.
+template <typename config>
+void connection<config>::handle_read_frame(lib::error_code const & ec,
+    size_t bytes_transferred)
+{
+    //m_alog->write(log::alevel::devel,"connection handle_read_frame");
+
+    lib::error_code ecm = ec;
+
+    count_bytes_in(m_read_buf, bytes_transferred);
+    WEBSOCKETPP_TRACE(trace_type, trace::point::read, this, bytes_transferred,
+        0);
+
+    if (!ecm && m_internal_state != istate::PROCESS_CONNECTION) {
+        ecm = error::make_error_code(error::invalid_state);
+    }
+
+    if (ecm) [[unlikely]] {
+        this->fail_read_frame(ecm);
+        return;
+    }
+
+    if (bytes_transferred > 0) {
+        ++m_read_count;
+        if (m_hibernating) [[unlikely]] {
+            m_alog->write(log::alevel::devel,"connection woke from hibernation");
+            m_hibernating = false;
+            start_hibernate_timer();
+        }
+    }
+
+    // Boundaries checking. TODO: How much of this should be done?
+    /*if (bytes_transferred > config::connection_read_buffer_size) {
+        m_elog->write(log::elevel::fatal,"Fatal boundaries checking error");
+        this->terminate(make_error_code(error::general));
+        return;
+    }*/
+
+    // With a read budget, keep consuming whatever the transport can supply
+    // without blocking before handing control back to it.
+    size_t budget_used = 0;
+
+    for (;;) {
+        size_t p = 0;
+
+        WEBSOCKETPP_LOG(*m_alog, log::alevel::devel,
+            "p = " << p << " bytes transferred = " << bytes_transferred);
+
+        while (p < bytes_transferred) {
+            WEBSOCKETPP_LOG(*m_alog, log::alevel::devel,
+                "calling consume with " << bytes_transferred-p << " bytes");
+
+            lib::error_code consume_ec;
+
+            /*if (m_alog->static_test(log::alevel::devel)) {
+                std::stringstream s;
+                s << "Processing Bytes: " << utility::to_hex(reinterpret_cast<uint8_t*>(m_read_buf)+p,bytes_transferred-p);
+                m_alog->write(log::alevel::devel,s.str());
+            }*/
+
+            {
+                account_timer timer(*this, m_consume_time);
+                p += m_processor->consume(
+                    reinterpret_cast<uint8_t*>(m_read_buf)+p,
+                    bytes_transferred-p,
+                    consume_ec
+                );
+            }
+
+            WEBSOCKETPP_LOG(*m_alog, log::alevel::devel,
+                "bytes left after consume: " << bytes_transferred-p);
+            if (consume_ec) [[unlikely]] {
+                release_pooled_read_buffer();
+                this->fail_consume(consume_ec);
+                return;
+            }
+
+            if (m_processor->ready()) {
+                this->deliver_ready_message();
+            }
+        }
+
+        release_pooled_read_buffer();
+        dispatch_message_batch();
+        adapt_read_buffer(bytes_transferred);
+        account_read(bytes_transferred);
+
+        budget_used += bytes_transferred;
+        bytes_transferred = read_within_budget(budget_used);
+        if (bytes_transferred == 0) {
+            break;
+        }
+    }
+
+    read_frame();
+}
+
+template <typename config>
+void connection<config>::fail_read_frame(lib::error_code const & ec) {
+    release_pooled_read_buffer();
+
+    log::level echannel = log::elevel::rerror;
+
+    if (ec == transport::error::eof) {
+        if (m_state == session::state::closed) {
+            // we expect to get eof if the connection is closed already
+            // just ignore it
+            m_alog->write(log::alevel::devel,"got eof from closed con");
+            return;
+        } else if (m_state == session::state::closing && !m_is_server) {
+            // If we are a client we expect to get eof in the closing state,
+            // this is a signal to terminate our end of the connection after
+            // the closing handshake
+            terminate(lib::error_code());
+            return;
+        }
+    } else if (ec == error::invalid_state) {
+        // In general, invalid state errors in the closed state are the
+        // result of handlers that were in the system already when the state
+        // changed and should be ignored as they pose no problems and there
+        // is nothing useful that we can do about them.
+        if (m_state == session::state::closed) {
+            m_alog->write(log::alevel::devel,
+                "handle_read_frame: got invalid istate in closed state");
+            return;
+        }
+    } else if (ec == transport::error::action_after_shutdown) {
+        echannel = log::elevel::info;
+    } else {
+        // TODO: more generally should we do something different here in the
+        // case that m_state is cosed? Are errors after the connection is
+        // already closed really an rerror?
+    }
+
+    log_err(echannel, "handle_read_frame", ec);
+    this->terminate(ec);
+}
+
+template <typename config>
+void connection<config>::account_read(size_t bytes_transferred) {
+    if (!m_flow_paused && flow_over_limit()) {
+        // the rest of this read was processed, nothing more is read
+        // until the application releases messages
+        m_alog->write(log::alevel::devel,"inbound flow control paused reading");
+        m_flow_paused = true;
+    }
+
+    charge_rate_limit(bytes_transferred);
+
+    govern_read_memory();
+}
+
+/// Read handler of a read straight into the payload of a large frame
+template <typename config>
+void connection<config>::handle_read_payload(lib::error_code const & ec,
+    size_t bytes_transferred)
+{
+    if (ec || m_internal_state != istate::PROCESS_CONNECTION) {
+        this->handle_read_frame(ec, 0);
+        return;
+    }
+
+    // captured before commit_payload unmasks them in place
+    count_bytes_in(m_read_buf, bytes_transferred);
+    WEBSOCKETPP_TRACE(trace_type, trace::point::read, this, bytes_transferred,
+        0);
+    m_read_buf = NULL;
+
+    if (bytes_transferred > 0) {
+        ++m_read_count;
+    }
+
+    lib::error_code consume_ec;
+    {
+        account_timer timer(*this, m_consume_time);
+        m_processor->commit_payload(bytes_transferred, consume_ec);
+    }
+    if (consume_ec) {
+        this->fail_consume(consume_ec);
+        return;
+    }
+
+    if (m_processor->ready()) {
+        this->deliver_ready_message();
+    }
+    dispatch_message_batch();
+    account_read(bytes_transferred);
+
+    read_frame();
+}
+
+template <typename config>
+void connection<config>::fail_consume(lib::error_code const & consume_ec) {
+    dispatch_message_batch();
+    log_err(log::elevel::rerror, "consume", consume_ec);
+
+    if (config::drop_on_protocol_error) {
+        this->terminate(consume_ec);
+        return;
+    } else {
+        lib::error_code close_ec;
+        this->close(
+            processor::error::to_ws(consume_ec),
+            consume_ec.message(),
+            close_ec
+        );
+
+        if (close_ec) {
+            log_err(log::elevel::fatal, "Protocol error close frame ", close_ec);
+            this->terminate(close_ec);
+        }
+    }
+}
+
+template <typename config>
+void connection<config>::deliver_ready_message() {
+    m_alog->write(log::alevel::devel,
+        "Complete message received. Dispatching");
+
+    frame::opcode::value view_op;
+    std::string_view view;
+    bool first;
+    bool last;
+
+    if (m_processor->get_message_chunk(view_op,view,first,last)) {
+        // piece of a data message, dispatch to user
+        if (m_state != session::state::open) {
+            m_elog->write(log::elevel::warn, "got non-close frame while closing");
+        } else if (m_message_chunk_handler) {
+            if (last) {
+                count_message_in(view.size());
+            }
+            dispatch_message_batch();
+            m_message_chunk_handler(m_connection_hdl, view_op,
+                view, first, last);
+        }
+        return;
+    }
+
+    if (m_processor->get_message_view(view_op,view)) {
+        // data message processed in place, dispatch to user
+        if (m_state != session::state::open) {
+            m_elog->write(log::elevel::warn, "got non-close frame while closing");
+        } else if (m_message_view_handler) {
+            count_message_in(view.size());
+            dispatch_message_batch();
+            m_message_view_handler(m_connection_hdl, view_op, view);
+        }
+        return;
+    }
+
+    message_ptr msg = m_processor->get_message();
+
+    if (!msg) {
+        m_alog->write(log::alevel::devel, "null message from m_processor");
+    } else if (!is_control(msg->get_opcode())) {
+        // data message, dispatch to user
+        if (m_state != session::state::open) {
+            m_elog->write(log::elevel::warn, "got non-close frame while closing");
+        } else if (m_message_batch_handler) {
+            count_message_in(msg->get_payload_size());
+            track_delivered(msg);
+            m_message_batch.push_back(msg);
+        } else if (m_message_handler) {
+            count_message_in(msg->get_payload_size());
+            track_delivered(msg);
+            if (m_dispatch_pool) {
+                dispatch_push(msg);
+            } else {
+                handler_timer timer(*this, handler_type::message);
+                m_message_handler(m_connection_hdl, msg);
+            }
+        }
+    } else {
+        process_control_frame(msg);
+    }
+}
+
+template <typename config>
+void connection<config>::charge_rate_limit(size_t bytes) {
+    if (!m_rate_messages.enabled() && !m_rate_bytes.enabled()) {
+        return;
+    }
+
+    uint64_t const seen = m_messages_in.load(std::memory_order_relaxed);
+    token_bucket::clock::time_point const now = token_bucket::clock::now();
+    m_rate_messages.consume(static_cast<double>(seen - m_rate_seen), now);
+    m_rate_seen = seen;
+    m_rate_bytes.consume(static_cast<double>(bytes), now);
+
+    long const wait = (std::max)(m_rate_messages.get_wait(now),
+        m_rate_bytes.get_wait(now));
+    if (wait == 0 || m_rate_paused || m_state != session::state::open) {
+        return;
+    }
+
+    if (m_rate_action == rate_limit::close) {
+        m_alog->write(log::alevel::devel,"inbound rate limit closing");
+        lib::error_code ec;
+        this->close(close::status::policy_violation, "rate limit exceeded",
+            ec);
+        return;
+    }
+
+    if (arm_deadline(m_rate_timer, wait, lib::bind(
+        &type::handle_rate_limit_timeout,
+        type::get_shared(),
+        lib::placeholders::_1
+    )))
+    {
+        m_alog->write(log::alevel::devel,"inbound rate limit paused reading");
+        m_rate_paused = true;
+    }
+}
+
+template <typename config>
+void connection<config>::handle_rate_limit_timeout(lib::error_code const & ec)
+{
+    if (ec == transport::error::operation_aborted || !m_rate_paused) {
+        return;
+    }
+    if (ec) {
+        WEBSOCKETPP_LOG(*m_alog, log::alevel::devel,
+            "handle_rate_limit_timeout error: " << ec.message());
+    }
+
+    m_rate_paused = false;
+    m_alog->write(log::alevel::devel,"inbound rate limit resumed reading");
+    read_frame();
+}
+
+template <typename config>
+size_t connection<config>::read_within_budget(size_t used) {
+    if (m_read_budget == 0 || used >= m_read_budget || reading_paused() ||
+        m_read_on_readiness || m_state == session::state::closed)
+    {
+        return 0;
+    }
+
+    size_t const buf_size = this->prepare_read_buffer();
+    m_read_buf = m_buf.data();
+
+    size_t const bytes = transport_con_type::read_available(m_buf.data(),
+        (std::min)(buf_size, m_read_budget - used));
+    count_bytes_in(m_read_buf, bytes);
+    return bytes;
+}
+
+template <typename config>
+void connection<config>::dispatch_message_batch() {
+    if (m_message_batch.empty()) {
+        return;
+    }
+
+    if (m_message_batch_handler) {
+        m_message_batch_handler(m_connection_hdl, m_message_batch);
+    }
+
+    // keeps its capacity for the next read
+    m_message_batch.clear();
+}
+
+/// Readiness wait handler, takes a pooled buffer and reads into it
+template <typename config>
+void connection<config>::handle_read_ready(lib::error_code const & ec,
+    size_t)
+{
+    m_read_waiting = false;
+
+    if (ec) {
+        this->handle_read_frame(ec, 0);
+        return;
+    }
+
+    if (reading_paused()) {
+        // reading was paused while waiting, resuming issues a new wait
+        return;
+    }
+
+    m_read_buf = static_cast<char *>(read_buffer_pool::allocate());
+    m_read_buf_pooled = true;
+
+    transport_con_type::async_read_at_least(
+        1,
+        m_read_buf,
+        config::connection_read_buffer_size,
+        m_handle_read_frame
+    );
+}
+
+/// Issue a new transport read unless reading is paused.
+template <typename config>
+void connection<config>::read_frame() {
+    if (reading_paused()) {
+        // No read is outstanding while paused, release the buffer until
+        // reading resumes.
+        std::vector<char>().swap(m_buf);
+        m_buf_small_reads = 0;
+        return;
+    }
+
+    // the rest of a large frame goes straight into its message
+    size_t payload_len;
+    char * payload = m_processor ? m_processor->get_payload_buffer(
+        config::connection_read_buffer_size, payload_len) : NULL;
+    if (payload) {
+        m_read_buf = payload;
+        transport_con_type::async_read_at_least(
+            1,
+            payload,
+            payload_len,
+            m_handle_read_payload
+        );
+        return;
+    }
+
+    if (m_read_on_readiness) {
+        if (m_read_waiting) {
+            return;
+        }
+
+        // Hold no buffer while idle, one is taken from the pool once the
+        // transport reports that data is available.
+        std::vector<char>().swap(m_buf);
+        m_buf_small_reads = 0;
+        m_read_waiting = true;
+
+        transport_con_type::async_wait_readable(lib::bind(
+            &type::handle_read_ready,
+            type::get_shared(),
+            lib::placeholders::_1,
+            lib::placeholders::_2
+        ));
+        return;
+    }
+    
+    size_t const buf_size = this->prepare_read_buffer();
+    m_read_buf = m_buf.data();
+    transport_con_type::async_read_at_least(
+        // std::min wont work with undefined static const values.
+        // TODO: is there a more elegant way to do this?
+        // Need to determine if requesting 1 byte or the exact number of bytes
+        // is better here. 1 byte lets us be a bit more responsive at a
+        // potential expense of additional runs through handle_read_frame
+        /*(m_processor->get_bytes_needed() > config::connection_read_buffer_size ?
+         config::connection_read_buffer_size : m_processor->get_bytes_needed())*/
+        1,
+        m_buf.data(),
+        buf_size,
+        m_handle_read_frame
+    );
+}
+
+template <typename config>
+void connection<config>::release_pooled_read_buffer() {
+    if (m_read_buf_pooled) {
+        read_buffer_pool::release(m_read_buf);
+        m_read_buf_pooled = false;
+        m_read_buf = NULL;
+    }
+}
+
+template <typename config>
+size_t connection<config>::prepare_read_buffer() {
+    if (m_buf.empty()) {
+        m_buf.resize((std::min)(
+            config_traits<config>::connection_read_buffer_min_size,
+            size_t(config::connection_read_buffer_size)));
+    }
+    return m_buf.size();
+}
+
+template <typename config>
+void connection<config>::adapt_read_buffer(size_t bytes_transferred) {
+    size_t const size = m_buf.size();
+    size_t const max_size = config::connection_read_buffer_size;
+    size_t const min_size = (std::min)(
+        config_traits<config>::connection_read_buffer_min_size, max_size);
+
+    if (size == 0) {
+        return;
+    }
+
+    if (bytes_transferred >= size) {
+        // The last read filled the buffer, more data is likely waiting
+        m_buf_small_reads = 0;
+        if (size < max_size) {
+            std::vector<char>((std::min)(size*2, max_size)).swap(m_buf);
+        }
+    } else if (bytes_transferred <= size/4 && size > min_size) {
+        if (++m_buf_small_reads >=
+            config_traits<config>::connection_read_buffer_shrink_reads)
+        {
+            m_buf_small_reads = 0;
+            std::vector<char>((std::max)(size/2, min_size)).swap(m_buf);
+        }
+    } else {
+        m_buf_small_reads = 0;
+    }
+}
+
+template <typename config>
+lib::error_code connection<config>::initialize_processor() {
+    m_alog->write(log::alevel::devel,"initialize_processor");
+
+    // if it isn't a websocket handshake nothing to do.
+    if (!processor::is_websocket_handshake(m_request)) {
+        return lib::error_code();
+    }
+
+    int version = processor::get_websocket_version(m_request);
+
+    if (version < 0) {
+        m_alog->write(log::alevel::devel, "BAD REQUEST: can't determine version");
+        m_response.set_status(http::status_code::bad_request);
+        return error::make_error_code(error::invalid_version);
+    }
+
+    m_processor = get_processor(version);
+
+    // if the processor is not null we are done
+    if (m_processor) {
+        return lib::error_code();
+    }
+
+    // We don't have a processor for this version. Return bad request
+    // with Sec-WebSocket-Version header filled with values we do accept
+    m_alog->write(log::alevel::devel, "BAD REQUEST: no processor for version");
+    m_response.set_status(http::status_code::bad_request);
+
+    std::stringstream ss;
+    std::string sep;
+    std::vector<int>::const_iterator it;
+    std::vector<int> const & versions = get_supported_versions();
+    for (it = versions.begin(); it != versions.end(); it++)
+    {
+        ss << sep << *it;
+        sep = ",";
+    }
+
+    m_response.replace_header("Sec-WebSocket-Version",ss.str());
+    return error::make_error_code(error::unsupported_version);
+}
+
+template <typename config>
+session::validation::value connection<config>::process_handshake_request(lib::error_code & ec) {
+    m_alog->write(log::alevel::devel,"process handshake request");
+
+    if (m_http_requests == 0 && transport_con_type::is_early_data_accepted()) {
+        // early data may be replayed, only let through requests that are
+        // safe to process twice
+        std::string const & method = m_request.get_method();
+        bool const safe = (method == "GET" || method == "HEAD") &&
+            (!m_early_data_handler || m_early_data_handler(m_connection_hdl));
+        if (!safe) {
+            m_alog->write(log::alevel::devel,"Request refused in early data");
+            m_response.set_status(http::status_code::too_early);
+            ec = error::make_error_code(error::too_early);
+            return session::validation::reject;
+        }
+    }
+
+    if (!processor::is_websocket_handshake(m_request)) {
+        // this is not a websocket handshake. Process as plain HTTP
+        m_alog->write(log::alevel::devel,"HTTP REQUEST");
+
+        // extract URI from request
+        m_uri = processor::get_uri_from_host(m_request, uri::http, transport_con_type::is_secure());
+
+        if (!m_uri->get_valid()) {
+            m_alog->write(log::alevel::devel, "Bad request: failed to parse uri");
+            m_response.set_status(http::status_code::bad_request);
+            ec = error::make_error_code(error::invalid_uri);
+			return session::validation::reject;
+        }
+
+        if (m_response_cache && m_is_server) {
+            m_cached_response = m_response_cache->find(m_request);
+            if (m_cached_response) {
+                m_is_http = true;
+                m_response.set_status(m_cached_response->status);
+                ec.clear();
+                return session::validation::reject;
+            }
+        }
+
+        if (m_http_handler) {
+            m_is_http = true;
+            m_in_http_handler = true;
+            {
+                handler_timer timer(*this, handler_type::http);
+                m_http_handler(m_connection_hdl);
+            }
+            m_in_http_handler = false;
+            
+            if (m_state == session::state::closed) {
+                ec = error::make_error_code(error::http_connection_ended);
+				return session::validation::reject;
+            }
+        } else {
+            m_response.set_status(http::status_code::upgrade_required);
+            ec = error::make_error_code(error::upgrade_required);
+			return session::validation::reject;
+        }
+
+        ec.clear();
+		return session::validation::reject;
+    }
+
+    if (!m_extended_connect && processor::is_extended_connect(m_request)) {
+        // an extended CONNECT only exists on an HTTP/2 or HTTP/3 stream
+        m_alog->write(log::alevel::devel,
+            "Bad request: extended CONNECT outside of HTTP/2 or HTTP/3");
+        m_response.set_status(http::status_code::bad_request);
+        ec = processor::error::make_error_code(
+            processor::error::invalid_http_version);
+        return session::validation::reject;
+    }
+
+    ec = m_processor->validate_handshake(m_request);
+
+    // Validate: make sure all required elements are present.
+    if (ec){
+        // Not a valid handshake request
+        WEBSOCKETPP_LOG(*m_alog, log::alevel::devel,
+            "Bad request " << ec.message());
+        m_response.set_status(http::status_code::bad_request);
+        return session::validation::reject;
+    }
+
+    // Read extension parameters and set up values necessary for the end user
+    // to complete extension negotiation.
+    std::pair<lib::error_code,std::string> neg_results;
+    neg_results = m_processor->negotiate_extensions(m_request);
+
+    if (neg_results.first == processor::error::make_error_code(processor::error::extension_parse_error)) {
+        // There was a fatal error in extension parsing that should result in
+        // a failed connection attempt.
+        WEBSOCKETPP_LOG(*m_elog, log::elevel::info,
+            "Bad request: " << neg_results.first.message());
+        m_response.set_status(http::status_code::bad_request);
+        ec = neg_results.first;
+		return session::validation::reject;
+    } else if (neg_results.first) {
+        // There was a fatal error in extension processing that is probably our
+        // fault. Consider extension negotiation to have failed and continue as
+        // if extensions were not supported
+        WEBSOCKETPP_LOG(*m_elog, log::elevel::info,
+            "Extension negotiation failed: " << neg_results.first.message());
+    } else {
+        // extension negotiation succeeded, set response header accordingly
+        // we don't send an empty extensions header because it breaks many
+        // clients.
+        if (neg_results.second.size() > 0) {
+            m_response.replace_header("Sec-WebSocket-Extensions",
+                neg_results.second);
+        }
+    }
+
+    // extract URI from request
+    m_uri = m_processor->get_uri(m_request);
+
+
+    if (!m_uri->get_valid()) {
+        m_alog->write(log::alevel::devel, "Bad request: failed to parse uri");
+        m_response.set_status(http::status_code::bad_request);
+        ec = error::make_error_code(error::invalid_uri);
+		return session::validation::reject;
+    }
+
+    // extract subprotocols
+    lib::error_code subp_ec = m_processor->extract_subprotocols(m_request,
+        m_requested_subprotocols);
+
+    if (subp_ec) {
+        // should we do anything?
+    }
+
+    if (m_validation_cache) {
+        m_validation_key = m_request.get_header(
+            m_validation_cache->get_header());
+        validation_cache::result cached;
+        if (!m_validation_key.empty() &&
+            m_validation_cache->find(m_validation_key, cached))
+        {
+            m_alog->write(log::alevel::devel,"Validation result from cache");
+            if (!cached.accept) {
+                m_response.set_status(cached.status);
+            }
+            ec = finalize_handshake_response(cached.accept);
+            return cached.accept ? session::validation::accept :
+                session::validation::reject;
+        }
+    }
+
+    if (m_async_validate_handler) {
+        m_validating = true;
+        if (m_validate_timeout_dur > 0) {
+            arm_deadline(
+                m_handshake_timer,
+                m_validate_timeout_dur,
+                lib::bind(
+                    &type::handle_validate_timeout,
+                    type::get_shared(),
+                    lib::placeholders::_1
+                )
+            );
+        }
+
+        lib::weak_ptr<type> weak = type::get_shared();
+        m_async_validate_handler(m_connection_hdl, [weak](bool accept) {
+            lib::shared_ptr<type> con = weak.lock();
+            if (con) {
+                con->complete_validation(accept);
+            }
+        });
+        return session::validation::defer;
+    }
+
+    // Ask application to validate the connection
+	session::validation::value action = session::validation::accept;
+	if (m_validate_handler) {
+		handler_timer timer(*this, handler_type::validate);
+		action = m_validate_handler(m_connection_hdl);
+	}
+	
+	if (action != session::validation::defer) {
+		this->cache_validation(action == session::validation::accept);
+		ec = finalize_handshake_response(action == session::validation::accept);
+	}
+
+	return action;
+}
+
+template <typename config>
+void connection<config>::cache_validation(bool accept) {
+    if (!m_validation_cache || m_validation_key.empty()) {
+        return;
+    }
+
+    validation_cache::result r;
+    r.accept = accept;
+    r.status = m_response.get_status_code();
+    m_validation_cache->insert(m_validation_key, r);
+    m_validation_key.clear();
+}
+
+template <typename config>
+lib::error_code connection<config>::finalize_handshake_response(bool accept) {
+	lib::error_code ec;
+	if (accept) {
+        m_response.set_status(this->accept_status());
+
+        // An untouched response (extensions aside) is the same bytes on every
+        // connection except for the accept key, so write it from the template
+        std::string const & extensions =
+            m_response.get_header("Sec-WebSocket-Extensions");
+        if (m_handshake_template && !m_extended_connect &&
+            m_response.get_body().empty() &&
+            m_response.get_headers().size() == (extensions.empty() ? 0 : 1) &&
+            m_handshake_template->get_server() == this->user_agent())
+        {
+            ec = m_processor->write_handshake_response(m_request,
+                m_subprotocol, extensions, *m_handshake_template,
+                m_http_message_buffer);
+            if (!ec) {
+                m_templated_response = true;
+                return ec;
+            }
+            if (ec != processor::error::make_error_code(
+                processor::error::not_implemented))
+            {
+                log_err(log::elevel::devel, "Processing", ec);
+                m_response.set_status(http::status_code::internal_server_error);
+                return ec;
+            }
+        }
+
+        // Write the appropriate response headers based on request and
+        // processor version
+        ec = m_processor->process_handshake(m_request,m_subprotocol,m_response);
+
+        if (ec) {
+            log_err(log::elevel::devel, "Processing", ec);
+
+            m_response.set_status(http::status_code::internal_server_error);
+        }
+    } else {
+        // User application has rejected the handshake
+        m_alog->write(log::alevel::devel, "WebSocket connection rejected");
+
+        // Use Bad Request if the user handler did not provide a more
+        // specific http response error code.
+        // TODO: is there a better default?
+        if (m_response.get_status_code() == http::status_code::uninitialized) {
+            m_response.set_status(http::status_code::bad_request);
+        }
+        
+        ec = error::make_error_code(error::rejected);
+    }
+
+	return ec;
+}
+
+template <typename config>
+lib::error_code connection<config>::deferred_accept(bool accept)
+{
+	const lib::error_code ec = finalize_handshake_response(accept);
+	this->write_http_response(ec);
+	return get_ec();
+}
+
+template <typename config>
+void connection<config>::complete_validation(bool accept) {
+    transport_con_type::dispatch(lib::bind(
+        &type::handle_validation,
+        type::get_shared(),
+        accept
+    ));
+}
+
+template <typename config>
+void connection<config>::handle_validation(bool accept) {
+    if (!m_validating) {
+        m_alog->write(log::alevel::devel,
+            "Validation answered after timeout or close");
+        return;
+    }
+    m_validating = false;
+
+    if (m_internal_state != istate::PROCESS_HTTP_REQUEST ||
+        m_state != session::state::connecting)
+    {
+        return;
+    }
+
+    this->cache_validation(accept);
+    this->deferred_accept(accept);
+}
+
+template <typename config>
+void connection<config>::write_http_response(lib::error_code const & ec) {
+    m_alog->write(log::alevel::devel,"connection write_http_response");
+
+    if (ec == error::make_error_code(error::http_connection_ended)) {
+        m_alog->write(log::alevel::http,"An HTTP handler took over the connection.");
+        return;
+    }
+
+    if (m_response.get_status_code() == http::status_code::uninitialized) {
+        lib::error_code status_ec;
+        m_response.set_status(http::status_code::internal_server_error);
+        m_ec = error::make_error_code(error::general);
+    } else {
+        m_ec = ec;
+    }
+
+    if (m_extended_connect) {
+        // the HTTP/2 or HTTP/3 stack of the application sends the response
+        m_response.set_version(m_request.get_version());
+        if (m_extended_connect_handler) {
+            extended_connect_handler handler;
+            handler.swap(m_extended_connect_handler);
+            handler(m_connection_hdl);
+        }
+        this->handle_write_http_response(lib::error_code());
+        return;
+    }
+
+    if (m_is_http && m_is_server) {
+        this->prepare_http_keep_alive(m_ec);
+    }
+
+    m_response.set_version("HTTP/1.1");
+
+    // the bytes to write, m_http_message_buffer unless written from a cache
+    std::string const * out = &m_http_message_buffer;
+
+    if (m_cached_response) {
+        std::string const & connection = m_response.get_header("Connection");
+        if (connection.empty()) {
+            out = &m_cached_response->bytes;
+        } else {
+            // keep-alive needs a Connection header in the shared bytes
+            std::string const & bytes = m_cached_response->bytes;
+            size_t const head = m_cached_response->head_size;
+            m_http_message_buffer.clear();
+            m_http_message_buffer.reserve(bytes.size() + connection.size() +
+                14);
+            m_http_message_buffer.append(bytes, 0, head);
+            m_http_message_buffer += "Connection: ";
+            m_http_message_buffer += connection;
+            m_http_message_buffer += "\r\n";
+            m_http_message_buffer.append(bytes, head, std::string::npos);
+        }
+    } else if (m_templated_response && !ec) {
+        // m_http_message_buffer was written from the handshake template
+    } else {
+        m_templated_response = false;
+
+        // Set server header based on the user agent settings
+        if (m_response.get_header("Server").empty()) {
+            if (!this->user_agent().empty()) {
+                m_response.replace_header("Server",this->user_agent());
+            } else {
+                m_response.remove_header("Server");
+            }
+        }
+
+        // have the processor generate the raw bytes for the wire (if it exists)
+        if (m_processor) {
+            m_http_message_buffer = m_processor->get_raw(m_response);
+        } else {
+            // a processor wont exist for raw HTTP responses.
+            m_http_message_buffer = m_response.raw();
+        }
+    }
+
+    if (log::enabled(*m_alog, log::alevel::devel)) {
+        m_alog->write(log::alevel::devel,"Raw Handshake response:\n"+*out);
+        if (!m_response.get_header("Sec-WebSocket-Key3").empty()) {
+            m_alog->write(log::alevel::devel,
+                utility::to_hex(m_response.get_header("Sec-WebSocket-Key3")));
+        }
+    }
+
+    count_bytes_out(out->size());
+    if (m_capture) {
+        m_capture->record(m_capture_id, capture::outbound, out->data(),
+            out->size());
+    }
+
+    if (m_open_handler && m_processor && m_is_server && !m_is_http && !m_ec &&
+        m_response.get_status_code() == this->accept_status())
+    {
+        // Open before writing the response, corked until it is written, so
+        // that messages sent by the open handler leave in the same write.
+        m_opened_early = true;
+        this->cork();
+        this->open_connection();
+        {
+            handler_timer timer(*this, handler_type::open);
+            m_open_handler(m_connection_hdl);
+        }
+
+        if (m_cork_pending.exchange(false)) {
+            // the write is ours, see schedule_write_frame
+            {
+                scoped_lock_type lock(m_write_lock);
+                m_open_response = out;
+            }
+            this->write_frame();
+            return;
+        }
+    }
+
+    // write raw bytes
+    transport_con_type::async_write(
+        out->data(),
+        out->size(),
+        lib::bind(
+            &type::handle_write_http_response,
+            type::get_shared(),
+            lib::placeholders::_1
+        )
+    );
+}
+
+template <typename config>
+void connection<config>::handle_write_http_response(lib::error_code const & ec) {
+    m_alog->write(log::alevel::devel,"handle_write_http_response");
+
+    lib::error_code ecm = ec;
+
+    if (!ecm) {
+        scoped_lock_type lock(m_connection_state_lock);
+        
+        if (m_state == session::state::connecting) {
+             if (m_internal_state != istate::PROCESS_HTTP_REQUEST) {
+                ecm = error::make_error_code(error::invalid_state);
+             }
+        } else if (m_opened_early && (m_state == session::state::open ||
+            m_state == session::state::closing))
+        {
+            // the open handler already ran, see write_http_response
+        } else if (m_state == session::state::closed) {
+            // The connection was canceled while the response was being sent,
+            // usually by the handshake timer. This is basically expected
+            // (though hopefully rare) and there is nothing we can do so ignore.
+            m_alog->write(log::alevel::devel,
+                "handle_write_http_response invoked after connection was closed");
+            return;
+        } else {
+            ecm = error::make_error_code(error::invalid_state);
+        }
+    }
+
+    if (ecm) {
+        if (ecm == transport::error::eof && m_state == session::state::closed) {
+            // we expect to get eof if the connection is closed already
+            m_alog->write(log::alevel::devel,
+                    "got (expected) eof/state error from closed con");
+            return;
+        }
+        
+        log_err(log::elevel::rerror,"handle_write_http_response",ecm);
+        this->terminate(ecm);
+        return;
+    }
+
+    cancel_deadline(m_handshake_timer);
+    m_handshake_slot.reset();
+
+    if (m_response.get_status_code() != this->accept_status()) {
+        /*if (m_processor || m_ec == error::http_parse_error || 
+            m_ec == error::invalid_version || m_ec == error::unsupported_version
+            || m_ec == error::upgrade_required)
+        {*/
+        if (!m_is_http) {
+            WEBSOCKETPP_LOG(*m_elog, log::elevel::rerror,
+                "Handshake ended with HTTP error: "
+                << m_response.get_status_code());
+        } else {
+            // if this was not a websocket connection, we have written
+            // the expected response and the connection can be closed.
+            
+            this->log_http_result();
+
+            if (m_http_keep_alive) {
+                this->next_http_request();
+                return;
+            }
+            
+            if (m_ec) {
+                WEBSOCKETPP_LOG(*m_alog, log::alevel::devel,
+                    "got to writing HTTP results with m_ec set: "
+                    << m_ec.message());
+            }
+            m_ec = make_error_code(error::http_connection_ended);
+        }        
+        
+        this->terminate(m_ec);
+        return;
+    }
+
+    if (m_opened_early) {
+        // writes held back since the open handler ran may start now
+        this->uncork();
+    } else {
+        this->open_connection();
+
+        if (m_open_handler) {
+            handler_timer timer(*this, handler_type::open);
+            m_open_handler(m_connection_hdl);
+        }
+    }
+
+    if (config_traits<config>::release_handshake) {
+        release_handshake();
+    }
+
+    m_read_buf = m_buf.data();
+    this->handle_read_frame(lib::error_code(), m_buf_cursor);
+}
+
+template <typename config>
+void connection<config>::handle_write_open(lib::error_code const & ec) {
+    // the response and the frames the open handler sent
+    if (ec) {
+        this->handle_write_frame(ec);
+        return;
+    }
+    this->handle_write_frame(ec);
+    this->handle_write_http_response(ec);
+}
+
+template <typename config>
+void connection<config>::open_connection() {
+    this->log_open_result();
+
+    m_internal_state = istate::PROCESS_CONNECTION;
+    m_state = session::state::open;
+
+    if (m_registry) {
+        m_id = m_registry->insert(type::get_shared());
+    }
+
+    start_deflate_idle_timer();
+    start_keepalive_timer();
+    start_hibernate_timer();
+}
+
+template <typename config>
+bool connection<config>::prepare_handshake_request() {
+    // Set the processor to the version specified in the config file and send a handshake request.
+    m_processor = get_processor(config::client_version);
+
+    // Have the protocol processor fill in the appropriate fields based on the
+    // selected client version
+    if (!m_processor) {
+        m_elog->write(log::elevel::fatal,"Internal library error: missing processor");
+        return false;
+    }
+
+    // an untouched request is the same bytes for every connection to a
+    // target but for the key
+    std::string template_key;
+    bool const templated = m_request_templates &&
+        m_request.get_headers().empty();
+    if (templated) {
+        template_key = processor::request_template_cache<request_type>::
+            make_key(m_uri->str(), m_requested_subprotocols,
+            this->user_agent());
+
+        typename processor::request_template_cache<request_type>::entry_ptr
+            tpl = m_request_templates->find(template_key);
+        if (tpl) {
+            lib::error_code ec = m_processor->write_handshake_request(*tpl,
+                m_request, m_http_message_buffer);
+            if (!ec) {
+                m_templated_request = true;
+                return true;
+            }
+            if (ec != processor::error::make_error_code(
+                processor::error::not_implemented))
+            {
+                log_err(log::elevel::fatal,"Internal library error: Processor",
+                    ec);
+                return false;
+            }
+        }
+    }
+
+    lib::error_code ec = m_processor->client_handshake_request(m_request,
+        m_uri, m_requested_subprotocols);
+    if (ec) {
+        log_err(log::elevel::fatal,"Internal library error: Processor",ec);
+        return false;
+    }
+
+    if (templated) {
+        this->build_http_request();
+        m_templated_request = true;
+        m_request_templates->insert(template_key, m_request,
+            m_http_message_buffer);
+    }
+    return true;
+}
+
+template <typename config>
+void connection<config>::build_http_request() {
+    if (m_templated_request) {
+        m_templated_request = false;
+        return;
+    }
+
+    // TODO: origin header?
+
+    // Unless the user has overridden the user agent, send generic UA.
+    if (m_request.get_header("User-Agent").empty()) {
+        if (!this->user_agent().empty()) {
+            m_request.replace_header("User-Agent",this->user_agent());
+        } else {
+            m_request.remove_header("User-Agent");
+        }
+    }
+
+    m_http_message_buffer = m_request.raw();
+}
+
+template <typename config>
+void connection<config>::send_http_request() {
+    m_alog->write(log::alevel::devel,"connection send_http_request");
+
+    bool streaming = false;
+    if constexpr (config_traits<config>::enable_http_client) {
+        streaming = bool(m_upload.source);
+        if (streaming) {
+            lib::error_code ec = this->prepare_request_body();
+            if (ec) {
+                log_err(log::elevel::rerror,"send_http_request",ec);
+                this->terminate(ec);
+                return;
+            }
+        }
+    }
+
+    if (!m_early_request) {
+        this->build_http_request();
+    }
+
+    if constexpr (config_traits<config>::enable_http_client) {
+        if (m_body_sink) {
+            m_response.set_body_sink(m_body_sink);
+        } else if (m_body_data_handler) {
+            // the response is owned by this connection, which outlives it
+            m_response.set_body_handler([this](std::string_view data) {
+                m_body_data_handler(m_connection_hdl, data);
+            });
+        }
+    }
+
+    WEBSOCKETPP_LOG(*m_alog, log::alevel::devel,
+        "Raw Handshake request:\n" << m_http_message_buffer);
+
+    if (m_open_handshake_timeout_dur > 0) {
+        arm_deadline(
+            m_handshake_timer,
+            m_open_handshake_timeout_dur,
+            lib::bind(
+                &type::handle_open_handshake_timeout,
+                type::get_shared(),
+                lib::placeholders::_1
+            )
+        );
+    }
+
+    count_bytes_out(m_http_message_buffer.size());
+    if (m_capture) {
+        m_capture->record(m_capture_id, capture::outbound,
+            m_http_message_buffer.data(), m_http_message_buffer.size());
+    }
+
+    if (m_early_request) {
+        m_early_request = false;
+        if (transport_con_type::is_early_data_accepted()) {
+            // the request went out with the TLS handshake
+            m_alog->write(log::alevel::devel,"Request sent as early data");
+            this->handle_send_http_request(lib::error_code());
+            return;
+        }
+    }
+
+    transport_con_type::async_write(
+        m_http_message_buffer.data(),
+        m_http_message_buffer.size(),
+        lib::bind(
+            streaming ? &type::handle_write_request_body :
+                &type::handle_send_http_request,
+            type::get_shared(),
+            lib::placeholders::_1
+        )
+    );
+}
+
+template <typename config>
+lib::error_code connection<config>::prepare_request_body() {
+    request_upload & u = m_upload;
+    u.finished = false;
+
+    uint64_t const size = u.source->size();
+    u.chunked = u.encoding || size == http::body_source::unknown_size;
+    if (u.chunked && m_request.get_version() != "HTTP/1.1") {
+        return http::error::make_error_code(
+            http::error::unsupported_transfer_encoding);
+    }
+
+    if (u.encoding) {
+        if (!u.encoder) {
+            u.encoder = lib::make_shared<encoding::encoder>();
+        }
+        lib::error_code ec = u.encoder->init(*u.encoding);
+        if (ec) {
+            return ec;
+        }
+        m_request.replace_header("Content-Encoding",
+            http::content_encoding::to_string(*u.encoding));
+    }
+
+    // the source replaces any body set on the request
+    m_request.set_body(std::string());
+    if (u.chunked) {
+        m_request.replace_header("Transfer-Encoding", "chunked");
+        u.remaining = 0;
+    } else {
+        m_request.replace_header("Content-Length", std::to_string(size));
+        m_request.remove_header("Transfer-Encoding");
+        u.remaining = size;
+    }
+    return lib::error_code();
+}
+
+template <typename config>
+lib::error_code connection<config>::read_request_body(bool & last) {
+    request_upload & u = m_upload;
+
+    size_t want = upload_part_size;
+    if (!u.chunked && u.remaining < want) {
+        want = static_cast<size_t>(u.remaining);
+    }
+
+    u.buffer.resize(chunk_line_size + want);
+    size_t n = 0;
+    if (want > 0) {
+        lib::error_code ec = u.source->read(&u.buffer[chunk_line_size], want,
+            n);
+        if (ec) {
+            return ec;
+        }
+        n = (std::min)(n, want);
+    }
+    u.buffer.resize(chunk_line_size + n);
+
+    if (u.chunked) {
+        last = n == 0;
+        return lib::error_code();
+    }
+    if (n == 0 && u.remaining > 0) {
+        // the source ended before the announced Content-Length
+        return http::error::make_error_code(http::error::incomplete_request);
+    }
+    u.remaining -= n;
+    last = u.remaining == 0;
+    return lib::error_code();
+}
+
+template <typename config>
+void connection<config>::handle_write_request_body(lib::error_code const & ec)
+{
+    if constexpr (config_traits<config>::enable_http_client) {
+        request_upload & u = m_upload;
+        if (ec || u.finished || m_state == session::state::closed) {
+            std::string().swap(u.buffer);
+            std::string().swap(u.encoded);
+            this->handle_send_http_request(ec);
+            return;
+        }
+
+        // a stalled upload times out, a long one doesn't
+        if (m_open_handshake_timeout_dur > 0) {
+            arm_deadline(
+                m_handshake_timer,
+                m_open_handshake_timeout_dur,
+                lib::bind(
+                    &type::handle_open_handshake_timeout,
+                    type::get_shared(),
+                    lib::placeholders::_1
+                )
+            );
+        }
+
+        bool last = false;
+        lib::error_code rec;
+        std::string * out = &u.buffer;
+        if (u.encoding) {
+            // compressors hold back input, read until there is output
+            u.encoded.assign(chunk_line_size, '\0');
+            while (!last && u.encoded.size() == chunk_line_size && !rec) {
+                rec = this->read_request_body(last);
+                if (!rec) {
+                    rec = u.encoder->encode(u.buffer.data() + chunk_line_size,
+                        u.buffer.size() - chunk_line_size, last, u.encoded);
+                }
+            }
+            out = &u.encoded;
+        } else {
+            rec = this->read_request_body(last);
+        }
+        if (rec) {
+            log_err(log::elevel::rerror,"handle_write_request_body",rec);
+            this->terminate(rec);
+            return;
+        }
+
+        size_t begin = chunk_line_size;
+        if (u.chunked) {
+            size_t const len = out->size() - chunk_line_size;
+            if (len > 0) {
+                static char const digits[] = "0123456789abcdef";
+                size_t v = len;
+                (*out)[--begin] = '\n';
+                (*out)[--begin] = '\r';
+                do {
+                    (*out)[--begin] = digits[v & 0xf];
+                    v >>= 4;
+                } while (v);
+                out->append("\r\n");
+            }
+            if (last) {
+                out->append("0\r\n\r\n");
+            }
+        }
+        u.finished = last;
+
+        size_t const len = out->size() - begin;
+        count_bytes_out(len);
+        if (len == 0) {
+            // an empty body of known size
+            this->handle_write_request_body(lib::error_code());
+            return;
+        }
+        transport_con_type::async_write(
+            out->data() + begin,
+            len,
+            lib::bind(
+                &type::handle_write_request_body,
+                type::get_shared(),
+                lib::placeholders::_1
+            )
+        );
+    } else {
+        this->handle_send_http_request(ec);
+    }
+}
+
+template <typename config>
+void connection<config>::handle_send_http_request(lib::error_code const & ec) {
+    m_alog->write(log::alevel::devel,"handle_send_http_request");
+
+    lib::error_code ecm = ec;
+    bool reading = false;
+
+    if (!ecm) {
+        scoped_lock_type lock(m_connection_state_lock);
+        
+        if (m_state == session::state::connecting) {
+             if (m_internal_state != istate::WRITE_HTTP_REQUEST) {
+                ecm = error::make_error_code(error::invalid_state);
+             } else {
+                m_internal_state = istate::READ_HTTP_RESPONSE;
+				if (m_is_http)
+					m_state = session::state::open;
+             }
+        } else if (m_is_http && m_state == session::state::open &&
+            (m_internal_state == istate::READ_HTTP_RESPONSE ||
+             m_internal_state == istate::HTTP_IDLE))
+        {
+            // The response of a pooled connection started to arrive on the
+            // read issued while it was idle before this write completed.
+            if (m_internal_state == istate::HTTP_IDLE) {
+                return;
+            }
+            reading = true;
+        } else if (m_state == session::state::closed) {
+            // The connection was canceled while the response was being sent,
+            // usually by the handshake timer. This is basically expected
+            // (though hopefully rare) and there is nothing we can do so ignore.
+            m_alog->write(log::alevel::devel,
+                "handle_send_http_request invoked after connection was closed");
+            return;
+        } else {
+            ecm = error::make_error_code(error::invalid_state);
+        }
+    }
+
+    if (ecm) {
+        if (ecm == transport::error::eof && m_state == session::state::closed) {
+            // we expect to get eof if the connection is closed already
+            m_alog->write(log::alevel::devel,
+                    "got (expected) eof/state error from closed con");
+            return;
+        }
+        
+        log_err(log::elevel::rerror,"handle_send_http_request",ecm);
+        this->terminate(ecm);
+        return;
+    }
+
+	if (m_is_http)
+	{
+		cancel_deadline(m_handshake_timer);
+
+		// Start a timer so we don't wait forever for the http body
+		// it's okay to use the handskahe timer as it's not being used by anything else
+		if (m_http_response_timeout_dur > 0) {
+			arm_deadline(
+				m_handshake_timer,
+				m_http_response_timeout_dur,
+				lib::bind(
+					&type::handle_read_response_timeout,
+					type::get_shared(),
+					lib::placeholders::_1
+				)
+			);
+		}
+	}
+
+    if (reading || m_idle_read_pending) {
+        // the read issued while the connection was idle receives the response
+        return;
+    }
+
+    size_t const buf_size = this->prepare_read_buffer();
+    transport_con_type::async_read_at_least(
+        1,
+        m_buf.data(),
+        buf_size,
+        lib::bind(
+            &type::handle_read_http_response,
+            type::get_shared(),
+            lib::placeholders::_1,
+            lib::placeholders::_2
+        )
+    );
+}
+
+template <typename config>
+void connection<config>::handle_read_http_response(lib::error_code const & ec,
+    size_t bytes_transferred)
+{
+    m_alog->write(log::alevel::devel,"handle_read_http_response");
+
+    lib::error_code ecm = ec;
+
+    bool stale = false;
+    bool idle = false;
+    {
+        scoped_lock_type lock(m_connection_state_lock);
+
+        if (m_idle_read_pending) {
+            m_idle_read_pending = false;
+
+            if (!ecm && (m_internal_state == istate::WRITE_HTTP_REQUEST ||
+                m_internal_state == istate::READ_HTTP_RESPONSE))
+            {
+                // This is the response to the next request. It may arrive
+                // before the write of that request completed.
+                m_internal_state = istate::READ_HTTP_RESPONSE;
+                m_state = session::state::open;
+            } else if (m_state != session::state::closed) {
+                // The server closed the idle connection, or sent bytes that
+                // nobody asked for. Either way it can't be used anymore.
+                stale = true;
+                idle = m_internal_state == istate::HTTP_IDLE;
+            }
+        }
+    }
+
+    if (stale) {
+        m_alog->write(log::alevel::devel,
+            "pooled HTTP connection closed by the server");
+        if (idle) {
+            this->terminate(lib::error_code());
+        } else {
+            // a request was already made on it, report the failure
+            this->terminate(ecm ? ecm : make_error_code(error::general));
+        }
+        return;
+    }
+
+    if (!ecm) {
+        scoped_lock_type lock(m_connection_state_lock);
+        
+        if (m_state == session::state::connecting || (m_is_http && m_state == session::state::open)) {
+            if (m_internal_state != istate::READ_HTTP_RESPONSE) {
+                ecm = error::make_error_code(error::invalid_state);
+            }
+        } else if (m_state == session::state::closed) {
+            // The connection was canceled while the response was being sent,
+            // usually by the handshake timer. This is basically expected
+            // (though hopefully rare) and there is nothing we can do so ignore.
+            m_alog->write(log::alevel::devel,
+                "handle_read_http_response invoked after connection was closed");
+            return;
+        } else {
+            ecm = error::make_error_code(error::invalid_state);
+        }
+    }
+
+	bool should_parse = !ecm;
+    if (ecm.value() == transport::error::eof) {
+        if (m_state == session::state::closed) {
+            // we expect to get eof if the connection is closed already
+            m_alog->write(log::alevel::devel,
+                    "got (expected) eof/state error from closed con");
+            return;
+        } else if (m_is_http) {
+			// for http requests, it's normal to receive EOF
+			should_parse = true;
+		}
+    }
+	
+	if (!should_parse)
+	{
+		log_err(log::elevel::rerror,"handle_read_http_response",ecm);
+		this->terminate(ecm);
+		return;
+	}
+    
+    size_t bytes_processed = 0;
 
-    if (m_alog->static_test(log::alevel::devel)) {
-        std::stringstream s;
-        s << "bytes_transferred: " << bytes_transferred
-          << " bytes, bytes processed: " << bytes_processed << " bytes";
-        m_alog->write(log::alevel::devel,s.str());
+    lib::error_code consume_ec(ecm);
+
+    bytes_processed = m_response.consume(m_buf.data(), bytes_transferred, consume_ec);
+    // bytes past the response are counted when they are processed as frames
+    count_bytes_in(m_buf.data(), bytes_processed);
+    if (consume_ec) {
+        // An HTTP error while reading a response doesn't give us many options other than log
+        // and terminate.
+        m_response.set_status(http::error::get_status_code(http::error::value(consume_ec.value())));
+        log_err(log::elevel::rerror,"error in handle_read_http_response: ",consume_ec);
+        this->terminate(make_error_code(error::general));
+        return;
     }
 
-    if (m_request.ready()) {
-        lib::error_code processor_ec = this->initialize_processor();
-        if (processor_ec) {
-            this->write_http_response_error(processor_ec);
+    // m_alog->write(log::alevel::devel,std::string("Raw response: ")+m_response.raw());
+
+    // follow redirect if possible. The body of the redirect response is read
+    // first so the connection can be used again.
+    bool redirecting = false;
+    if constexpr (config_traits<config>::enable_http_client) {
+        if (m_response.has_received(response_type::state::HEADERS) &&
+            !m_redirect_uri && m_max_redirects && !m_upload.source &&
+            http::status_code::is_redirect(m_response.get_status_code()))
+        {
+            m_redirect_uri = this->get_redirect_uri();
+            if (m_redirect_uri) {
+                m_max_redirects--;
+                // the body of the redirect is not part of the result
+                m_response.set_body_sink(http::body_sink::ptr());
+            }
+        }
+
+        if (m_redirect_uri &&
+            m_response.has_received(response_type::state::BODY))
+        {
+            this->follow_redirect(bytes_processed == bytes_transferred);
             return;
         }
+        redirecting = bool(m_redirect_uri);
+    }
 
-        if (m_processor && m_processor->get_version() == 0) {
-            // Version 00 has an extra requirement to read some bytes after the
-            // handshake
-            if (bytes_transferred-bytes_processed >= 8) {
-                m_request.replace_header(
-                    "Sec-WebSocket-Key3",
-                    std::string(m_buf+bytes_processed,m_buf+bytes_processed+8)
-                );
-                bytes_processed += 8;
-            } else {
-                // TODO: need more bytes
-                m_alog->write(log::alevel::devel,"short key3 read");
-                m_response.set_status(http::status_code::internal_server_error);
-                this->write_http_response_error(processor::error::make_error_code(processor::error::short_key3));
-                return;
-            }
+    if (m_response.has_received(response_type::state::HEADERS) &&
+        !redirecting)
+    {
+		if (!m_is_http)
+		{
+			cancel_deadline(m_handshake_timer);
+		}
+
+		if (m_is_http) {
+			if constexpr (config_traits<config>::enable_http_client) {
+				if (m_progress_handler)
+					m_progress_handler(m_connection_hdl, m_response.get_transferred_body_size(), m_response.get_total_body_size());
+			}
+
+			if (m_response.has_received(response_type::state::BODY))
+			{
+				if constexpr (config_traits<config>::enable_http_client) {
+					if (m_http_cache) {
+						lib::error_code cache_ec = m_http_cache->update(
+							this->get_request_key(), m_request, m_response);
+						if (cache_ec) {
+							log_err(log::elevel::rerror,"http cache",cache_ec);
+							this->terminate(cache_ec);
+							return;
+						}
+					}
+				}
+				if (bytes_processed == bytes_transferred && this->park_http()) {
+					return;
+				}
+            	this->terminate({});
+			} else {
+				// The HTTP parser reported that it was not ready and wants more data.
+				// Assert that it actually consumed all the data present before overwriting
+				// the buffer. This should always be the case.
+				if (bytes_transferred != bytes_processed) {
+					m_elog->write(log::elevel::fatal,"Assertion Failed: HTTP response parser failed to consume all bytes from a read request.");
+					this->terminate(make_error_code(error::general));
+					return;
+				}
+
+				govern_read_memory();
+
+				size_t const buf_size = this->prepare_read_buffer();
+				transport_con_type::async_read_at_least(
+					1,
+					m_buf.data(),
+					buf_size,
+					lib::bind(
+						&type::handle_read_http_response,
+						type::get_shared(),
+						lib::placeholders::_1,
+						lib::placeholders::_2
+					)
+				);
+			}
+			return;
+		}
+
+        lib::error_code validate_ec = m_processor->validate_server_handshake_response(
+            m_request,
+            m_response
+        );
+        if (validate_ec) {
+            log_err(log::elevel::rerror,"Server handshake response",validate_ec);
+            this->terminate(validate_ec);
+            return;
         }
 
-        if (m_alog->static_test(log::alevel::devel)) {
-            m_alog->write(log::alevel::devel,m_request.raw());
-            if (!m_request.get_header("Sec-WebSocket-Key3").empty()) {
-                m_alog->write(log::alevel::devel,
-                    utility::to_hex(m_request.get_header("Sec-WebSocket-Key3")));
-            }
+        // Read extension parameters and set up values necessary for the end
+        // user to complete extension negotiation.
+        std::pair<lib::error_code,std::string> neg_results;
+        neg_results = m_processor->negotiate_extensions(m_response);
+
+        if (neg_results.first) {
+            // There was a fatal error in extension negotiation. For the moment
+            // kill all connections that fail extension negotiation.
+            
+            // TODO: deal with cases where the response is well formed but 
+            // doesn't match the options requested by the client. Its possible
+            // that the best behavior in this cases is to log and continue with
+            // an unextended connection.
+            WEBSOCKETPP_LOG(*m_alog, log::alevel::devel,
+                "Extension negotiation failed: "
+                << neg_results.first.message());
+            this->terminate(make_error_code(error::extension_neg_failed));
+            // TODO: close connection with reason 1010 (and list extensions)
+        }
+
+        // response is valid, connection can now be assumed to be open      
+        m_internal_state = istate::PROCESS_CONNECTION;
+        m_state = session::state::open;
+
+        if (m_registry) {
+            m_id = m_registry->insert(type::get_shared());
+        }
+
+        this->log_open_result();
+
+        start_deflate_idle_timer();
+        start_keepalive_timer();
+        start_hibernate_timer();
+
+        if (m_open_handler) {
+            handler_timer timer(*this, handler_type::open);
+            m_open_handler(m_connection_hdl);
+        }
+
+        if (config_traits<config>::release_handshake) {
+            release_handshake();
         }
 
         // The remaining bytes in m_buf are frame data. Copy them to the
         // beginning of the buffer and note the length. They will be read after
         // the handshake completes and before more bytes are read.
-        std::copy(m_buf+bytes_processed,m_buf+bytes_transferred,m_buf);
+        std::copy(m_buf.data()+bytes_processed,m_buf.data()+bytes_transferred,m_buf.data());
         m_buf_cursor = bytes_transferred-bytes_processed;
 
-
-        m_internal_state = istate::PROCESS_HTTP_REQUEST;
-        
-        // We have the complete request. Process it.
-        lib::error_code handshake_ec;
-		session::validation::value action = this->process_handshake_request(handshake_ec);
-        
-        // Write a response if this is a websocket connection or if it is an
-        // HTTP connection for which the response has not been deferred or
-        // started yet by a different system (i.e. still in init state).
-        if ((!m_is_http && action != session::validation::defer) || (m_is_http && m_http_state == session::http_state::init)) {
-            this->write_http_response(handshake_ec);
-        }
+        m_read_buf = m_buf.data();
+        this->handle_read_frame(lib::error_code(), m_buf_cursor);
     } else {
         // The HTTP parser reported that it was not ready and wants more data.
         // Assert that it actually consumed all the data present before overwriting
         // the buffer. This should always be the case.
         if (bytes_transferred != bytes_processed) {
-            m_elog->write(log::elevel::fatal,"Assertion Failed: HTTP request parser failed to consume all bytes from a read request.");
+            m_elog->write(log::elevel::fatal,"Assertion Failed: HTTP response parser failed to consume all bytes from a read request.");
             this->terminate(make_error_code(error::general));
             return;
         }
 
-        // read at least 1 more byte
+        govern_read_memory();
+
+        size_t const buf_size = this->prepare_read_buffer();
         transport_con_type::async_read_at_least(
             1,
-            m_buf,
-            config::connection_read_buffer_size,
+            m_buf.data(),
+            buf_size,
             lib::bind(
-                &type::handle_read_handshake,
+                &type::handle_read_http_response,
                 type::get_shared(),
                 lib::placeholders::_1,
                 lib::placeholders::_2
@@ -1177,1453 +4400,2121 @@ void connection<config>::handle_read_handshake(lib::error_code const & ec,
     }
 }
 
-// write_http_response requires the request to be fully read and the connection
-// to be in the PROCESS_HTTP_REQUEST state. In some cases we can detect errors
-// before the request is fully read (specifically at a point where we aren't
-// sure if the hybi00 key3 bytes need to be read). This method sets the correct
-// state and calls write_http_response
 template <typename config>
-void connection<config>::write_http_response_error(lib::error_code const & ec) {
-    if (m_internal_state != istate::READ_HTTP_REQUEST) {
-        m_alog->write(log::alevel::devel,
-            "write_http_response_error called in invalid state");
-        this->terminate(error::make_error_code(error::invalid_state));
-        return;
+void connection<config>::handle_open_handshake_timeout(
+    lib::error_code const & ec)
+{
+    if (ec == transport::error::operation_aborted) {
+        m_alog->write(log::alevel::devel,"open handshake timer cancelled");
+    } else if (ec) {
+        WEBSOCKETPP_LOG(*m_alog, log::alevel::devel,
+            "open handle_open_handshake_timeout error: " << ec.message());
+        // TODO: ignore or fail here?
+    } else {
+        m_alog->write(log::alevel::devel,"open handshake timer expired");
+        terminate(make_error_code(error::open_handshake_timeout));
     }
-    
-    m_internal_state = istate::PROCESS_HTTP_REQUEST;
-    
-    this->write_http_response(ec);
 }
 
-// All exit paths for this function need to call write_http_response() or submit
-// a new read request with this function as the handler.
 template <typename config>
-void connection<config>::handle_read_frame(lib::error_code const & ec,
-    size_t bytes_transferred)
+void connection<config>::handle_validate_timeout(lib::error_code const & ec)
 {
-    //m_alog->write(log::alevel::devel,"connection handle_read_frame");
+    if (ec == transport::error::operation_aborted) {
+        m_alog->write(log::alevel::devel,"validate timer cancelled");
+    } else if (ec) {
+        WEBSOCKETPP_LOG(*m_alog, log::alevel::devel,
+            "handle_validate_timeout error: " << ec.message());
+    } else if (m_validating) {
+        m_alog->write(log::alevel::devel,"validate timer expired");
+        m_validating = false;
+        m_response.set_status(http::status_code::service_unavailable);
+        this->write_http_response(
+            error::make_error_code(error::open_handshake_timeout));
+    }
+}
 
-    lib::error_code ecm = ec;
+template <typename config>
+void connection<config>::handle_close_handshake_timeout(
+    lib::error_code const & ec)
+{
+    if (ec == transport::error::operation_aborted) {
+        m_alog->write(log::alevel::devel,"asio close handshake timer cancelled");
+    } else if (ec) {
+        WEBSOCKETPP_LOG(*m_alog, log::alevel::devel,
+            "asio open handle_close_handshake_timeout error: " << ec.message());
+        // TODO: ignore or fail here?
+    } else {
+        m_alog->write(log::alevel::devel, "asio close handshake timer expired");
+        terminate(make_error_code(error::close_handshake_timeout));
+    }
+}
 
-    if (!ecm && m_internal_state != istate::PROCESS_CONNECTION) {
-        ecm = error::make_error_code(error::invalid_state);
+template <typename config>
+void connection<config>::handle_read_response_timeout(lib::error_code const & ec)
+{
+    if (ec == transport::error::operation_aborted) {
+        m_alog->write(log::alevel::devel,"asio read http response timer cancelled");
+    } else if (ec) {
+        WEBSOCKETPP_LOG(*m_alog, log::alevel::devel,
+            "asio handle_read_response_timeout error: " << ec.message());
+        // TODO: ignore or fail here?
+    } else {
+        m_alog->write(log::alevel::devel, "asio read http response timer expired");
+        terminate(make_error_code(error::http_read_response_timeout));
     }
+}
 
-    if (ecm) {
-        log::level echannel = log::elevel::rerror;
-        
-        if (ecm == transport::error::eof) {
-            if (m_state == session::state::closed) {
-                // we expect to get eof if the connection is closed already
-                // just ignore it
-                m_alog->write(log::alevel::devel,"got eof from closed con");
-                return;
-            } else if (m_state == session::state::closing && !m_is_server) {
-                // If we are a client we expect to get eof in the closing state,
-                // this is a signal to terminate our end of the connection after
-                // the closing handshake
-                terminate(lib::error_code());
-                return;
-            }
-        } else if (ecm == error::invalid_state) {
-            // In general, invalid state errors in the closed state are the
-            // result of handlers that were in the system already when the state
-            // changed and should be ignored as they pose no problems and there
-            // is nothing useful that we can do about them.
-            if (m_state == session::state::closed) {
-                m_alog->write(log::alevel::devel,
-                    "handle_read_frame: got invalid istate in closed state");
-                return;
-            }
-        } else if (ecm == transport::error::action_after_shutdown) {
-            echannel = log::elevel::info;
+template <typename config>
+void connection<config>::handle_http_idle_timeout(lib::error_code const & ec)
+{
+    if (ec == transport::error::operation_aborted) {
+        m_alog->write(log::alevel::devel,"http idle timer cancelled");
+    } else if (ec) {
+        WEBSOCKETPP_LOG(*m_alog, log::alevel::devel,
+            "handle_http_idle_timeout error: " << ec.message());
+    } else if (this->is_http_idle()) {
+        m_alog->write(log::alevel::devel,"http idle timer expired");
+        terminate(lib::error_code());
+    }
+}
+
+template <typename config>
+uri_ptr connection<config>::get_redirect_uri() const {
+    uri const location(m_response.get_header("Location"));
+    if (!location.get_valid()) {
+        return uri_ptr();
+    }
+    if (location.is_absolute()) {
+        return lib::make_shared<uri>(location);
+    }
+
+    std::string resource = m_uri->get_resource();
+    if (resource.ends_with('/')) // prevent double slashes!
+        resource.pop_back();
+    resource += location.get_resource(); // get_resource should always have a leading slash
+
+    return lib::make_shared<uri>(m_uri->get_type(), m_uri->get_secure(),
+        m_uri->get_host(), m_uri->get_port(), resource);
+}
+
+template <typename config>
+std::string connection<config>::get_request_key() const {
+    return m_uri->get_scheme() + "://" + m_request.get_header("Host") +
+        m_request.get_uri();
+}
+
+template <typename config>
+void connection<config>::follow_redirect(bool clean) {
+    uri_ptr target = m_redirect_uri;
+    m_redirect_uri.reset();
+
+    bool const reusable = clean && this->can_keep_alive() &&
+        target->get_type() == m_uri->get_type() &&
+        target->get_secure() == m_uri->get_secure() &&
+        target->get_host_port() == m_uri->get_host_port();
+
+    if (m_is_http && m_http_redirect_handler &&
+        m_http_redirect_handler(type::get_shared(), target, reusable))
+    {
+        // The request continues on another connection, which calls the
+        // handlers. This one is kept for another request if possible.
+        m_http_state = session::http_state::closed;
+        this->clear_http_handlers();
+        if (!clean || !this->park_http()) {
+            this->terminate(lib::error_code());
+        }
+        return;
+    }
+
+    if (!reusable) {
+        if (m_is_http) {
+            // the redirect response is the result of the request
+            this->terminate(lib::error_code());
         } else {
-            // TODO: more generally should we do something different here in the
-            // case that m_state is cosed? Are errors after the connection is
-            // already closed really an rerror?
+            // a WebSocket handshake can't move to another connection
+            lib::error_code ec = m_processor->validate_server_handshake_response(
+                m_request, m_response);
+            log_err(log::elevel::rerror,"Server handshake response",ec);
+            this->terminate(ec ? ec : make_error_code(error::invalid_state));
         }
-        
-        
-        
-        log_err(echannel, "handle_read_frame", ecm);
-        this->terminate(ecm);
         return;
     }
 
-    // Boundaries checking. TODO: How much of this should be done?
-    /*if (bytes_transferred > config::connection_read_buffer_size) {
-        m_elog->write(log::elevel::fatal,"Fatal boundaries checking error");
-        this->terminate(make_error_code(error::general));
-        return;
-    }*/
+    size_t const max_body_size = m_response.get_max_body_size();
+    m_response = response_type();
+    m_response.set_max_body_size(max_body_size);
+
+    {
+        scoped_lock_type lock(m_connection_state_lock);
+        m_state = session::state::connecting;
+        m_internal_state = istate::WRITE_HTTP_REQUEST;
+    }
+
+    // the scheme stays the same, so this stays an HTTP or WebSocket request
+    m_uri = target;
+    m_request.replace_header("Host", target->get_host_port());
+    m_request.set_uri(target->get_resource());
+    this->send_http_request();
+}
+
+template <typename config>
+void connection<config>::transfer_http_request(ptr next, uri_ptr target) {
+    // an absolute request URI makes next take the Host and resource from it
+    request_type req = m_request;
+    req.set_uri(target->str());
+
+    lib::error_code ec;
+    next->set_request(std::move(req), ec);
 
-    size_t p = 0;
+    next->m_http_handler = m_http_handler;
+    next->m_fail_handler = m_fail_handler;
+    next->m_close_handler = m_close_handler;
+    if constexpr (config_traits<config>::enable_http_client) {
+        next->m_progress_handler = m_progress_handler;
+        next->m_body_data_handler = m_body_data_handler;
+        next->m_body_sink = m_body_sink;
+    }
+    next->m_max_redirects = m_max_redirects;
+}
 
-    if (m_alog->static_test(log::alevel::devel)) {
-        std::stringstream s;
-        s << "p = " << p << " bytes transferred = " << bytes_transferred;
-        m_alog->write(log::alevel::devel,s.str());
+template <typename config>
+void connection<config>::clear_http_handlers() {
+    m_http_handler = http_handler();
+    m_fail_handler = fail_handler();
+    m_close_handler = close_handler();
+    if constexpr (config_traits<config>::enable_http_client) {
+        m_progress_handler = progress_handler();
+        m_body_data_handler = body_data_handler();
+        m_body_sink.reset();
+        m_upload.source.reset();
+        m_upload.encoding.reset();
     }
+}
 
-    while (p < bytes_transferred) {
-        if (m_alog->static_test(log::alevel::devel)) {
-            std::stringstream s;
-            s << "calling consume with " << bytes_transferred-p << " bytes";
-            m_alog->write(log::alevel::devel,s.str());
-        }
+template <typename config>
+bool connection<config>::can_keep_alive() const {
+    auto has_token = [](std::string const & value, std::string const & token) {
+        return utility::ci_find_substr(value, token) != value.end();
+    };
+
+    // Only keep connections where the end of the response is known and
+    // neither side asked for the connection to be closed
+    if (m_response.get_version() != "HTTP/1.1" ||
+        m_request.get_version() != "HTTP/1.1" ||
+        has_token(m_response.get_header("Connection"), "close") ||
+        has_token(m_request.get_header("Connection"), "close"))
+    {
+        return false;
+    }
+    if (m_response.get_header("Content-Length").empty() &&
+        !has_token(m_response.get_header("Transfer-Encoding"), "chunked"))
+    {
+        return false;
+    }
+    return true;
+}
 
-        lib::error_code consume_ec;
+template <typename config>
+void connection<config>::prepare_http_keep_alive(lib::error_code const & ec) {
+    auto has_token = [](std::string const & value, std::string const & token) {
+        return utility::ci_find_substr(value, token) != value.end();
+    };
+
+    ++m_http_requests;
+    m_http_keep_alive = false;
+    if (m_max_http_requests <= 1) {
+        return;
+    }
 
-        /*if (m_alog->static_test(log::alevel::devel)) {
-            std::stringstream s;
-            s << "Processing Bytes: " << utility::to_hex(reinterpret_cast<uint8_t*>(m_buf)+p,bytes_transferred-p);
-            m_alog->write(log::alevel::devel,s.str());
-        }*/
+    std::string const & request_connection = m_request.get_header("Connection");
+    bool wanted = false;
+    if (m_request.get_version() == "HTTP/1.1") {
+        wanted = !has_token(request_connection, "close");
+    } else if (m_request.get_version() == "HTTP/1.0") {
+        wanted = has_token(request_connection, "keep-alive");
+    }
 
-        p += m_processor->consume(
-            reinterpret_cast<uint8_t*>(m_buf)+p,
-            bytes_transferred-p,
-            consume_ec
-        );
+    m_http_keep_alive = wanted && !ec &&
+        m_http_requests < m_max_http_requests &&
+        !has_token(m_response.get_header("Connection"), "close");
 
-        if (m_alog->static_test(log::alevel::devel)) {
-            std::stringstream s;
-            s << "bytes left after consume: " << bytes_transferred-p;
-            m_alog->write(log::alevel::devel,s.str());
+    if (!m_http_keep_alive) {
+        if (wanted) {
+            m_response.replace_header("Connection", "close");
         }
-        if (consume_ec) {
-            log_err(log::elevel::rerror, "consume", consume_ec);
+        return;
+    }
 
-            if (config::drop_on_protocol_error) {
-                this->terminate(consume_ec);
-                return;
-            } else {
-                lib::error_code close_ec;
-                this->close(
-                    processor::error::to_ws(consume_ec),
-                    consume_ec.message(),
-                    close_ec
-                );
+    // without a known length the client could only find the end of the
+    // body by the connection closing
+    http::status_code::value const status = m_response.get_status_code();
+    if (m_response.get_header("Content-Length").empty() &&
+        !has_token(m_response.get_header("Transfer-Encoding"), "chunked") &&
+        status >= 200 && status != http::status_code::no_content &&
+        status != http::status_code::not_modified)
+    {
+        m_response.replace_header("Content-Length",
+            std::to_string(m_response.get_body().size()));
+    }
+    if (m_request.get_version() == "HTTP/1.0") {
+        m_response.replace_header("Connection", "keep-alive");
+    }
+}
 
-                if (close_ec) {
-                    log_err(log::elevel::fatal, "Protocol error close frame ", close_ec);
-                    this->terminate(close_ec);
-                    return;
-                }
-            }
-            return;
-        }
+template <typename config>
+lib::error_code connection<config>::write_http_part(std::string const & prefix,
+    void const * data, size_t len, bool last)
+{
+    message_ptr msg = m_msg_manager->get_message(frame::opcode::continuation,
+        len);
+    if (!msg) {
+        return error::make_error_code(error::no_outgoing_buffers);
+    }
 
-        if (m_processor->ready()) {
-            if (m_alog->static_test(log::alevel::devel)) {
-                std::stringstream s;
-                s << "Complete message received. Dispatching";
-                m_alog->write(log::alevel::devel,s.str());
-            }
+    // Written like a prepared stream frame whose header is the HTTP framing.
+    // Stream parts are never dropped or coalesced with other messages.
+    msg->set_header(prefix);
+    if (len > 0) {
+        msg->set_payload(data, len);
+    }
+    msg->set_fin(last);
+    msg->set_prepared(true);
+    if (last) {
+        msg->set_send_handler(lib::bind(
+            &type::handle_write_http_body,
+            type::get_shared(),
+            lib::placeholders::_1
+        ));
+    }
 
-            message_ptr msg = m_processor->get_message();
+    bool const needs_writing = write_enqueue(msg);
 
-            if (!msg) {
-                m_alog->write(log::alevel::devel, "null message from m_processor");
-            } else if (!is_control(msg->get_opcode())) {
-                // data message, dispatch to user
-                if (m_state != session::state::open) {
-                    m_elog->write(log::elevel::warn, "got non-close frame while closing");
-                } else if (m_message_handler) {
-                    m_message_handler(m_connection_hdl, msg);
-                }
-            } else {
-                process_control_frame(msg);
-            }
-        }
+    check_high_watermark();
+
+    if (needs_writing) {
+        schedule_write_frame();
     }
 
-    read_frame();
+    return lib::error_code();
 }
 
-/// Issue a new transport read unless reading is paused.
 template <typename config>
-void connection<config>::read_frame() {
-    if (!m_read_flag) {
+void connection<config>::handle_write_http_body(lib::error_code const & ec) {
+    if (m_in_http_handler) {
+        // finishing now would start the next request under the handler
+        m_http_body_written = true;
+        m_http_body_ec = ec;
         return;
     }
-    
-    transport_con_type::async_read_at_least(
-        // std::min wont work with undefined static const values.
-        // TODO: is there a more elegant way to do this?
-        // Need to determine if requesting 1 byte or the exact number of bytes
-        // is better here. 1 byte lets us be a bit more responsive at a
-        // potential expense of additional runs through handle_read_frame
-        /*(m_processor->get_bytes_needed() > config::connection_read_buffer_size ?
-         config::connection_read_buffer_size : m_processor->get_bytes_needed())*/
-        1,
-        m_buf,
-        config::connection_read_buffer_size,
-        m_handle_read_frame
-    );
+    this->handle_write_http_response(ec);
 }
 
 template <typename config>
-lib::error_code connection<config>::initialize_processor() {
-    m_alog->write(log::alevel::devel,"initialize_processor");
+void connection<config>::next_http_request() {
+    m_alog->write(log::alevel::devel,"connection next_http_request");
+
+    size_t const request_body_size = m_request.get_max_body_size();
+    size_t const response_body_size = m_response.get_max_body_size();
+    m_request = request_type();
+    m_response = response_type();
+    m_request.set_max_body_size(request_body_size);
+    m_response.set_max_body_size(response_body_size);
+
+    m_uri.reset();
+    m_ec = lib::error_code();
+    m_is_http = false;
+    m_http_state = session::http_state::init;
+    m_http_keep_alive = false;
+    m_http_chunked = false;
+    m_http_parts = 0;
+    m_cached_response.reset();
 
-    // if it isn't a websocket handshake nothing to do.
-    if (!processor::is_websocket_handshake(m_request)) {
-        return lib::error_code();
+    {
+        scoped_lock_type lock(m_connection_state_lock);
+        m_internal_state = istate::READ_HTTP_REQUEST;
     }
 
-    int version = processor::get_websocket_version(m_request);
+    // bytes read past the previous request start the next one
+    size_t const pipelined = m_buf_cursor;
+    m_buf_cursor = 0;
+    if (pipelined == 0) {
+        this->read_handshake(1);
+        return;
+    }
 
-    if (version < 0) {
-        m_alog->write(log::alevel::devel, "BAD REQUEST: can't determine version");
-        m_response.set_status(http::status_code::bad_request);
-        return error::make_error_code(error::invalid_version);
+    if (m_open_handshake_timeout_dur > 0) {
+        arm_deadline(
+            m_handshake_timer,
+            m_open_handshake_timeout_dur,
+            lib::bind(
+                &type::handle_open_handshake_timeout,
+                type::get_shared(),
+                lib::placeholders::_1
+            )
+        );
     }
+    this->handle_read_handshake(lib::error_code(), pipelined);
+}
 
-    m_processor = get_processor(version);
+template <typename config>
+bool connection<config>::park_http() {
+    if (!m_http_idle_handler || !this->can_keep_alive()) {
+        return false;
+    }
 
-    // if the processor is not null we are done
-    if (m_processor) {
-        return lib::error_code();
+    cancel_deadline(m_handshake_timer);
+
+    m_http_state = session::http_state::closed;
+    if (m_http_handler) {
+        handler_timer timer(*this, handler_type::http);
+        m_http_handler(m_connection_hdl);
     }
 
-    // We don't have a processor for this version. Return bad request
-    // with Sec-WebSocket-Version header filled with values we do accept
-    m_alog->write(log::alevel::devel, "BAD REQUEST: no processor for version");
-    m_response.set_status(http::status_code::bad_request);
+    // the handlers belong to the completed request
+    this->clear_http_handlers();
 
-    std::stringstream ss;
-    std::string sep;
-    std::vector<int>::const_iterator it;
-    for (it = versions_supported.begin(); it != versions_supported.end(); it++)
     {
-        ss << sep << *it;
-        sep = ",";
+        scoped_lock_type lock(m_connection_state_lock);
+        if (m_state != session::state::open) {
+            // the http handler closed the connection
+            return true;
+        }
+        m_internal_state = istate::HTTP_IDLE;
+        m_idle_read_pending = true;
     }
 
-    m_response.replace_header("Sec-WebSocket-Version",ss.str());
-    return error::make_error_code(error::unsupported_version);
+    if (m_http_idle_timeout_dur > 0) {
+        arm_deadline(
+            m_handshake_timer,
+            m_http_idle_timeout_dur,
+            lib::bind(
+                &type::handle_http_idle_timeout,
+                type::get_shared(),
+                lib::placeholders::_1
+            )
+        );
+    }
+
+    // Notice when the server closes the connection while it is idle.
+    // The next request on it reuses this read for its response.
+    size_t const buf_size = this->prepare_read_buffer();
+    transport_con_type::async_read_at_least(
+        1,
+        m_buf.data(),
+        buf_size,
+        lib::bind(
+            &type::handle_read_http_response,
+            type::get_shared(),
+            lib::placeholders::_1,
+            lib::placeholders::_2
+        )
+    );
+
+    return m_http_idle_handler(type::get_shared());
 }
 
 template <typename config>
-session::validation::value connection<config>::process_handshake_request(lib::error_code & ec) {
-    m_alog->write(log::alevel::devel,"process handshake request");
+bool connection<config>::reuse_http(uri_ptr location) {
+    scoped_lock_type lock(m_connection_state_lock);
 
-    if (!processor::is_websocket_handshake(m_request)) {
-        // this is not a websocket handshake. Process as plain HTTP
-        m_alog->write(log::alevel::devel,"HTTP REQUEST");
+    if (m_internal_state != istate::HTTP_IDLE ||
+        m_state != session::state::open)
+    {
+        return false;
+    }
 
-        // extract URI from request
-        m_uri = processor::get_uri_from_host(m_request, uri::http, transport_con_type::is_secure());
+    cancel_deadline(m_handshake_timer);
 
-        if (!m_uri->get_valid()) {
-            m_alog->write(log::alevel::devel, "Bad request: failed to parse uri");
-            m_response.set_status(http::status_code::bad_request);
-            ec = error::make_error_code(error::invalid_uri);
-			return session::validation::reject;
-        }
+    size_t const max_body_size = m_response.get_max_body_size();
+    m_request = request_type();
+    m_response = response_type();
+    m_request.set_max_body_size(max_body_size);
+    m_response.set_max_body_size(max_body_size);
 
-        if (m_http_handler) {
-            m_is_http = true;
-            m_http_handler(m_connection_hdl);
-            
-            if (m_state == session::state::closed) {
-                ec = error::make_error_code(error::http_connection_ended);
-				return session::validation::reject;
-            }
-        } else {
-            m_response.set_status(http::status_code::upgrade_required);
-            ec = error::make_error_code(error::upgrade_required);
-			return session::validation::reject;
-        }
+    this->set_uri(location);
+    m_ec = lib::error_code();
+    m_http_state = session::http_state::init;
+    m_internal_state = istate::USER_INIT;
+    m_state = session::state::connecting;
+    m_http_reused = true;
 
-        ec.clear();
-		return session::validation::reject;
+    return true;
+}
+
+template <typename config>
+void connection<config>::terminate(lib::error_code const & ec) {
+    if (m_alog->static_test(log::alevel::devel)) {
+        m_alog->write(log::alevel::devel,"connection terminate");
     }
 
-    ec = m_processor->validate_handshake(m_request);
+    // Cancel close handshake timer
+    cancel_deadline(m_handshake_timer);
 
-    // Validate: make sure all required elements are present.
-    if (ec){
-        // Not a valid handshake request
-        m_alog->write(log::alevel::devel, "Bad request " + ec.message());
-        m_response.set_status(http::status_code::bad_request);
-        return session::validation::reject;
+    // Cancel ping timer
+    cancel_deadline(m_ping_timer);
+
+    cancel_deadline(m_deflate_idle_timer);
+
+    cancel_deadline(m_keepalive_timer);
+
+    cancel_deadline(m_hibernate_timer);
+
+    cancel_deadline(m_coalesce_timer);
+
+    cancel_deadline(m_rate_timer);
+
+    m_handshake_slot.reset();
+    release_memory_charge();
+    if (m_metrics) {
+        publish_send_buffer(true);
     }
 
-    // Read extension parameters and set up values necessary for the end user
-    // to complete extension negotiation.
-    std::pair<lib::error_code,std::string> neg_results;
-    neg_results = m_processor->negotiate_extensions(m_request);
+    terminate_status tstat = unknown;
+    if (ec) {
+        m_ec = ec;
+        m_local_close_code = close::status::abnormal_close;
+        m_local_close_reason = ec.message();
+    }
 
-    if (neg_results.first == processor::error::make_error_code(processor::error::extension_parse_error)) {
-        // There was a fatal error in extension parsing that should result in
-        // a failed connection attempt.
-        m_elog->write(log::elevel::info, "Bad request: " + neg_results.first.message());
-        m_response.set_status(http::status_code::bad_request);
-        ec = neg_results.first;
-		return session::validation::reject;
-    } else if (neg_results.first) {
-        // There was a fatal error in extension processing that is probably our
-        // fault. Consider extension negotiation to have failed and continue as
-        // if extensions were not supported
-        m_elog->write(log::elevel::info, 
-            "Extension negotiation failed: " + neg_results.first.message());
-    } else {
-        // extension negotiation succeeded, set response header accordingly
-        // we don't send an empty extensions header because it breaks many
-        // clients.
-        if (neg_results.second.size() > 0) {
-            m_response.replace_header("Sec-WebSocket-Extensions",
-                neg_results.second);
+    // TODO: does any of this need a mutex?
+    if (m_is_http && m_http_state != session::http_state::closed) {
+        m_http_state = session::http_state::closed;
+		if (!m_is_server && m_http_handler) { // only call m_http_handler here for client connections
+			handler_timer timer(*this, handler_type::http);
+			m_http_handler(m_connection_hdl);
+		}
+    }
+    if (m_state == session::state::connecting) {
+        m_state = session::state::closed;
+        tstat = failed;
+        
+        // Log fail result here before socket is shut down and we can't get
+        // the remote address, etc anymore
+        if (m_ec != error::http_connection_ended) {
+            log_fail_result();
         }
+    } else if (m_state != session::state::closed) {
+        m_state = session::state::closed;
+        tstat = closed;
+    } else {
+        m_alog->write(log::alevel::devel,
+            "terminate called on connection that was already terminated");
+        return;
+    }
+
+    // TODO: choose between shutdown and close based on error code sent
+
+    transport_con_type::async_shutdown(
+        lib::bind(
+            &type::handle_terminate,
+            type::get_shared(),
+            tstat,
+            lib::placeholders::_1
+        )
+    );
+}
+
+template <typename config>
+void connection<config>::handle_terminate(terminate_status tstat,
+    lib::error_code const & ec)
+{
+    if (m_alog->static_test(log::alevel::devel)) {
+        m_alog->write(log::alevel::devel,"connection handle_terminate");
     }
 
-    // extract URI from request
-    m_uri = m_processor->get_uri(m_request);
+    if (ec) {
+        // there was an error actually shutting down the connection
+        log_err(log::elevel::devel,"handle_terminate",ec);
+    }
 
+    if (m_capture) {
+        m_capture->record(m_capture_id, capture::close, NULL, 0);
+    }
 
-    if (!m_uri->get_valid()) {
-        m_alog->write(log::alevel::devel, "Bad request: failed to parse uri");
-        m_response.set_status(http::status_code::bad_request);
-        ec = error::make_error_code(error::invalid_uri);
-		return session::validation::reject;
+    if (m_registry && m_id) {
+        m_registry->erase(m_id);
     }
 
-    // extract subprotocols
-    lib::error_code subp_ec = m_processor->extract_subprotocols(m_request,
-        m_requested_subprotocols);
+    cancel_queued_sends();
 
-    if (subp_ec) {
-        // should we do anything?
+    // clean shutdown
+    if (tstat == failed) {
+        if (m_ec != error::http_connection_ended) {
+            if (m_fail_handler) {
+                handler_timer timer(*this, handler_type::fail);
+                m_fail_handler(m_connection_hdl);
+            }
+        }
+    } else if (tstat == closed) {
+        if (m_close_handler) {
+            handler_timer timer(*this, handler_type::close);
+            m_close_handler(m_connection_hdl);
+        }
+        log_close_result();
+    } else {
+        m_elog->write(log::elevel::rerror,"Unknown terminate_status");
     }
 
-    // Ask application to validate the connection
-	session::validation::value action = session::validation::accept;
-	if (m_validate_handler)
-		action = m_validate_handler(m_connection_hdl);
-	
-	if (action != session::validation::defer)
-		ec = finalize_handshake_response(action == session::validation::accept);
-
-	return action;
+    // call the termination handler if it exists
+    // if it exists it might (but shouldn't) refer to a bad memory location.
+    // If it does, we don't care and should catch and ignore it.
+    // todo: there has to be a better way to do this.
+    if (m_termination_handler) {
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+        try {
+            m_termination_handler(type::get_shared());
+        } catch (std::exception const & e) {
+            m_elog->write(log::elevel::warn,
+                std::string("termination_handler call failed. Reason was: ")+e.what());
+        }
+#else
+        m_termination_handler(type::get_shared());
+#endif
+    }
 }
 
 template <typename config>
-lib::error_code connection<config>::finalize_handshake_response(bool accept) {
-	lib::error_code ec;
-	if (accept) {
-        m_response.set_status(http::status_code::switching_protocols);
+void connection<config>::uncork() {
+    size_t depth = m_cork_depth.load();
+    do {
+        if (depth == 0) {
+            return;
+        }
+    } while (!m_cork_depth.compare_exchange_weak(depth, depth - 1));
 
-        // Write the appropriate response headers based on request and
-        // processor version
-        ec = m_processor->process_handshake(m_request,m_subprotocol,m_response);
+    if (depth == 1 && m_cork_pending.exchange(false)) {
+        schedule_write_frame();
+    }
+}
 
-        if (ec) {
-            log_err(log::elevel::devel, "Processing", ec);
+template <typename config>
+void connection<config>::note_coalesce_push(size_t size, size_t lane) {
+    if (lane == priority::control || lane == close_lane) {
+        m_coalesce_urgent = true;
+        return;
+    }
 
-            m_response.set_status(http::status_code::internal_server_error);
-        }
+    lib::chrono::steady_clock::time_point now =
+        lib::chrono::steady_clock::now();
+    int64_t interval = (std::max)(int64_t(1), int64_t(
+        lib::chrono::duration_cast<lib::chrono::microseconds>(
+        now - m_coalesce_last_push).count()));
+
+    if (m_coalesce_last_push == lib::chrono::steady_clock::time_point()) {
+        // the first message, no interval yet
+        m_coalesce_msg_size = int64_t(size);
+    } else if (m_coalesce_interval == 0) {
+        m_coalesce_interval = interval;
     } else {
-        // User application has rejected the handshake
-        m_alog->write(log::alevel::devel, "WebSocket connection rejected");
+        m_coalesce_interval += (interval - m_coalesce_interval) / 8;
+        m_coalesce_msg_size += (int64_t(size) - m_coalesce_msg_size) / 8;
+    }
+    m_coalesce_last_push = now;
+}
 
-        // Use Bad Request if the user handler did not provide a more
-        // specific http response error code.
-        // TODO: is there a better default?
-        if (m_response.get_status_code() == http::status_code::uninitialized) {
-            m_response.set_status(http::status_code::bad_request);
-        }
-        
-        ec = error::make_error_code(error::rejected);
+template <typename config>
+long connection<config>::begin_coalesce_hold() {
+    int64_t interval = m_coalesce_interval;
+    if (interval == 0 || interval >= m_coalesce_max_delay) {
+        // no other message is expected within the longest wait
+        return 0;
+    }
+    if (!m_send_queue[priority::control].empty() ||
+        !m_send_queue[close_lane].empty() || m_fragment_source ||
+        !m_fragment_deferred.empty() || !m_stream_held.empty())
+    {
+        return 0;
     }
 
-	return ec;
+    int64_t delay = (std::min)(int64_t(m_coalesce_max_delay),
+        (std::max)(4 * interval, m_coalesce_write_time));
+
+    // the bytes expected to arrive meanwhile, at least a message's worth
+    int64_t size = (std::max)(m_coalesce_msg_size, int64_t(1));
+    size_t bytes = size_t((std::max)(size * delay / interval, size));
+    bytes = (std::min)(bytes, m_coalesce_max_bytes);
+
+    if (m_send_buffer_size.load() >= bytes) {
+        // large messages, or enough small ones, are waiting already
+        return 0;
+    }
+
+    m_coalesce_bytes = bytes;
+    m_coalesce_urgent = false;
+    ++m_cork_depth;
+    m_coalesce_held = true;
+    return long(delay);
 }
 
 template <typename config>
-lib::error_code connection<config>::deferred_accept(bool accept)
-{
-	const lib::error_code ec = finalize_handshake_response(accept);
-	this->write_http_response(ec);
-	return get_ec();
+void connection<config>::release_coalesce_hold() {
+    if (m_coalesce_held.exchange(false)) {
+        uncork();
+    }
 }
 
 template <typename config>
-void connection<config>::write_http_response(lib::error_code const & ec) {
-    m_alog->write(log::alevel::devel,"connection write_http_response");
-
-    if (ec == error::make_error_code(error::http_connection_ended)) {
-        m_alog->write(log::alevel::http,"An HTTP handler took over the connection.");
+void connection<config>::handle_coalesce_timer(lib::error_code const & ec) {
+    if (ec == transport::error::operation_aborted) {
+        // replaced by a later hold, or the connection ended
         return;
     }
+    release_coalesce_hold();
+}
 
-    if (m_response.get_status_code() == http::status_code::uninitialized) {
-        lib::error_code status_ec;
-        m_response.set_status(http::status_code::internal_server_error);
-        m_ec = error::make_error_code(error::general);
-    } else {
-        m_ec = ec;
+template <typename config>
+void connection<config>::schedule_write_frame() {
+    if (m_coalesce_held.load(std::memory_order_relaxed) &&
+        (m_coalesce_urgent.load(std::memory_order_relaxed) ||
+        m_send_buffer_size.load(std::memory_order_relaxed) >=
+        m_coalesce_bytes.load(std::memory_order_relaxed)))
+    {
+        // enough has gathered, or a control frame must not wait
+        release_coalesce_hold();
     }
 
-    m_response.set_version("HTTP/1.1");
+    if (m_cork_depth.load() > 0) {
+        // Hand the write to uncork. If the last cork was removed in the
+        // meantime uncork may already have looked at the flag, in which case
+        // whoever takes it back starts the write.
+        m_cork_pending = true;
+        if (m_cork_depth.load() > 0 || !m_cork_pending.exchange(false)) {
+            return;
+        }
+    }
 
-    // Set server header based on the user agent settings
-    if (m_response.get_header("Server").empty()) {
-        if (!m_user_agent.empty()) {
-            m_response.replace_header("Server",m_user_agent);
+    void const * key = config_traits<config>::batch_write_dispatch ?
+        transport_con_type::get_write_batch_key() : NULL;
+
+    if (!key) {
+        if constexpr (transport_con_type::inline_dispatch) {
+            // the same as dispatching, without building a handler
+            write_frame();
         } else {
-            m_response.remove_header("Server");
+            transport_con_type::dispatch(lib::bind(
+                &type::write_frame,
+                type::get_shared()
+            ));
         }
+        return;
     }
 
-    // have the processor generate the raw bytes for the wire (if it exists)
-    if (m_processor) {
-        m_http_message_buffer = m_processor->get_raw(m_response);
-    } else {
-        // a processor wont exist for raw HTTP responses.
-        m_http_message_buffer = m_response.raw();
-    }
+    // The open batch of this thread, until its flush handler runs. If the
+    // handler is destroyed without running, so is the batch.
+    static thread_local lib::weak_ptr<write_batch> open_batch;
 
-    if (m_alog->static_test(log::alevel::devel)) {
-        m_alog->write(log::alevel::devel,"Raw Handshake response:\n"+m_http_message_buffer);
-        if (!m_response.get_header("Sec-WebSocket-Key3").empty()) {
-            m_alog->write(log::alevel::devel,
-                utility::to_hex(m_response.get_header("Sec-WebSocket-Key3")));
-        }
+    write_batch_ptr batch = open_batch.lock();
+    if (!batch || batch->key != key) {
+        batch = lib::make_shared<write_batch>();
+        batch->key = key;
+        open_batch = batch;
+        transport_con_type::dispatch(lib::bind(
+            &type::flush_write_batch,
+            batch
+        ));
     }
+    batch->connections.push_back(type::get_shared());
+}
 
-    // write raw bytes
-    transport_con_type::async_write(
-        m_http_message_buffer.data(),
-        m_http_message_buffer.size(),
-        lib::bind(
-            &type::handle_write_http_response,
-            type::get_shared(),
-            lib::placeholders::_1
-        )
-    );
+template <typename config>
+void connection<config>::flush_write_batch(write_batch_ptr batch) {
+    // close the batch first: writes started below may schedule more
+    std::vector<ptr> connections;
+    connections.swap(batch->connections);
+    batch->key = NULL;
+
+    transport_con_type::begin_write_batch();
+    for (size_t i = 0; i < connections.size(); ++i) {
+        connections[i]->write_frame();
+    }
+    transport_con_type::end_write_batch();
 }
 
 template <typename config>
-void connection<config>::handle_write_http_response(lib::error_code const & ec) {
-    m_alog->write(log::alevel::devel,"handle_write_http_response");
+void connection<config>::write_frame() {
+    //m_alog->write(log::alevel::devel,"connection write_frame");
 
-    lib::error_code ecm = ec;
+    if (config_traits<config>::lock_free_send_queue) {
+        // Only the thread that moved m_send_pending away from zero (or the
+        // write handler that inherited it) gets here, so the queue has a
+        // single consumer and no lock is needed.
+        for (;;) {
+            write_gather();
 
-    if (!ecm) {
-        scoped_lock_type lock(m_connection_state_lock);
-        
-        if (m_state == session::state::connecting) {
-             if (m_internal_state != istate::PROCESS_HTTP_REQUEST) {
-                ecm = error::make_error_code(error::invalid_state);
-             }
-        } else if (m_state == session::state::closed) {
-            // The connection was canceled while the response was being sent,
-            // usually by the handshake timer. This is basically expected
-            // (though hopefully rare) and there is nothing we can do so ignore.
-            m_alog->write(log::alevel::devel,
-                "handle_write_http_response invoked after connection was closed");
-            return;
-        } else {
-            ecm = error::make_error_code(error::invalid_state);
+            if (!m_current_msgs.empty()) {
+                break;
+            }
+
+            // Everything popped was dropped, or a push is still linking its
+            // node into the queue. Give back what was popped and keep going
+            // while anything remains pending.
+            size_t popped = m_send_popped;
+            m_send_popped = 0;
+
+            if (m_send_pending.fetch_sub(popped) == popped) {
+                return;
+            }
+            if (popped == 0) {
+                std::this_thread::yield();
+            }
         }
-    }
+    } else {
+        scoped_lock_type lock(m_write_lock);
 
-    if (ecm) {
-        if (ecm == transport::error::eof && m_state == session::state::closed) {
-            // we expect to get eof if the connection is closed already
-            m_alog->write(log::alevel::devel,
-                    "got (expected) eof/state error from closed con");
+        // Check the write flag. If true, there is an outstanding transport
+        // write already. In this case we just return. The write handler will
+        // start a new write if the write queue isn't empty. If false, we set
+        // the write flag and proceed to initiate a transport write.
+        if (m_write_flag) {
             return;
         }
+
+        write_gather();
         
-        log_err(log::elevel::rerror,"handle_write_http_response",ecm);
-        this->terminate(ecm);
-        return;
+        if (m_current_msgs.empty()) {
+            // there was nothing to send
+            return;
+        } else {
+            // At this point we own the next messages to be sent and are
+            // responsible for holding the write flag until they are 
+            // successfully sent or there is some error
+            m_write_flag = true;
+        }
     }
 
-    if (m_handshake_timer) {
-        m_handshake_timer->cancel();
-        m_handshake_timer.reset();
-    }
+    typename std::vector<message_ptr>::iterator it;
 
-    if (m_response.get_status_code() != http::status_code::switching_protocols)
-    {
-        /*if (m_processor || m_ec == error::http_parse_error || 
-            m_ec == error::invalid_version || m_ec == error::unsupported_version
-            || m_ec == error::upgrade_required)
-        {*/
-        if (!m_is_http) {
-            std::stringstream s;
-            s << "Handshake ended with HTTP error: "
-              << m_response.get_status_code();
-            m_elog->write(log::elevel::rerror,s.str());
-        } else {
-            // if this was not a websocket connection, we have written
-            // the expected response and the connection can be closed.
-            
-            this->log_http_result();
-            
-            if (m_ec) {
-                m_alog->write(log::alevel::devel,
-                    "got to writing HTTP results with m_ec set: "+m_ec.message());
+    if (config_traits<config>::write_coalesce_threshold > 0) {
+        // Reserve room for every frame that will be coalesced up front so that
+        // buffers pointing into m_coalesce_buffer are not invalidated.
+        size_t coalesced = 0;
+        for (it = m_current_msgs.begin(); it != m_current_msgs.end(); ++it) {
+            size_t len = (*it)->get_header().size() +
+                (*it)->get_prefix().size() + (*it)->get_payload_size();
+            if (len < config_traits<config>::write_coalesce_threshold) {
+                coalesced += len;
             }
-            m_ec = make_error_code(error::http_connection_ended);
-        }        
-        
-        this->terminate(m_ec);
-        return;
-    }
-
-    this->log_open_result();
+        }
 
-    m_internal_state = istate::PROCESS_CONNECTION;
-    m_state = session::state::open;
+        m_coalesce_buffer.clear();
+        m_coalesce_buffer.reserve(coalesced);
+    }
 
-    if (m_open_handler) {
-        m_open_handler(m_connection_hdl);
+    std::string const * response = m_open_response;
+    if (response) {
+        m_open_response = NULL;
+        m_send_buffer.push_back(transport::buffer(response->data(),
+            response->size()));
     }
 
-    this->handle_read_frame(lib::error_code(), m_buf_cursor);
-}
+    // true if the last entry in m_send_buffer ends at the end of
+    // m_coalesce_buffer and may be extended by the next small frame
+    bool extend = false;
+    uint64_t coalesced_bytes = 0;
+    uint64_t coalesced_messages = 0;
+    uint64_t written = 0;
+    uint64_t messages_out = 0;
 
-template <typename config>
-void connection<config>::send_http_request() {
-    m_alog->write(log::alevel::devel,"connection send_http_request");
+    for (it = m_current_msgs.begin(); it != m_current_msgs.end(); ++it) {
+        frame::header_buffer const & header = (*it)->get_header();
+        std::string const & prefix = (*it)->get_prefix();
+        char const * payload = (*it)->get_payload_data();
+        size_t payload_size = (*it)->get_payload_size();
+        size_t frame_size = header.size() + prefix.size() + payload_size;
+        written += frame_size;
+        if ((*it)->get_fin() && !is_control((*it)->get_opcode())) {
+            ++messages_out;
+        }
 
-    // TODO: origin header?
+        if (frame_size < config_traits<config>::write_coalesce_threshold) {
+            size_t offset = m_coalesce_buffer.size();
+            m_coalesce_buffer.append(header.data(),header.size());
+            m_coalesce_buffer.append(prefix);
+            m_coalesce_buffer.append(payload,payload_size);
 
-    // Unless the user has overridden the user agent, send generic UA.
-    if (m_request.get_header("User-Agent").empty()) {
-        if (!m_user_agent.empty()) {
-            m_request.replace_header("User-Agent",m_user_agent);
+            size_t len = m_coalesce_buffer.size() - offset;
+            if (extend) {
+                m_send_buffer.back().len += len;
+            } else {
+                m_send_buffer.push_back(transport::buffer(
+                    m_coalesce_buffer.data() + offset, len));
+                extend = true;
+            }
+
+            coalesced_bytes += len;
+            ++coalesced_messages;
+        } else if ((*it)->get_header_in_place()) {
+            m_send_buffer.push_back(transport::buffer(payload - header.size(),
+                header.size() + payload_size));
+            extend = false;
         } else {
-            m_request.remove_header("User-Agent");
+            m_send_buffer.push_back(transport::buffer(header.data(),header.size()));
+            if (!prefix.empty()) {
+                // a recipient's own bytes in front of a shared payload
+                m_send_buffer.push_back(transport::buffer(prefix.data(),
+                    prefix.size()));
+            }
+            m_send_buffer.push_back(transport::buffer(payload,payload_size));
+            extend = false;
         }
     }
 
-    m_http_message_buffer = m_request.raw();
+    if (coalesced_messages > 0) {
+        scoped_lock_type lock(m_write_lock);
+        m_coalesced_bytes += coalesced_bytes;
+        m_coalesced_messages += coalesced_messages;
+    }
+    count_bytes_out(written);
+    if (m_capture) {
+        m_capture->record(m_capture_id, capture::outbound, m_send_buffer);
+    }
+    if (messages_out > 0) {
+        m_messages_out.fetch_add(messages_out, std::memory_order_relaxed);
+    }
+    if (m_metrics) {
+        if (messages_out > 0) {
+            m_metrics->record_messages_out(messages_out);
+        }
+        publish_send_buffer(false);
+    }
+    if (m_metrics || m_send_latency || m_coalesce_max_delay > 0) {
+        m_write_start = lib::chrono::steady_clock::now();
+    }
 
-    if (m_alog->static_test(log::alevel::devel)) {
-        m_alog->write(log::alevel::devel,"Raw Handshake request:\n"+m_http_message_buffer);
+    // Print detailed send stats if those log levels are enabled
+    if (log::enabled(*m_alog, log::alevel::frame_header)) [[unlikely]] {
+        log_write_frame();
     }
 
-    if (m_open_handshake_timeout_dur > 0) {
-        m_handshake_timer = transport_con_type::set_timer(
-            m_open_handshake_timeout_dur,
+    WEBSOCKETPP_TRACE(trace_type, trace::point::dispatch, this,
+        m_current_msgs.size(), written);
+
+    if (transport_con_type::wants_write_pin(size_t(written))) {
+        // zero copy sends read the messages after the write completes
+        transport_con_type::pin_write(
+            lib::make_shared<std::vector<message_ptr> >(m_current_msgs));
+    }
+
+    if (response) {
+        transport_con_type::async_write(
+            m_send_buffer,
             lib::bind(
-                &type::handle_open_handshake_timeout,
+                &type::handle_write_open,
                 type::get_shared(),
                 lib::placeholders::_1
             )
         );
+        return;
     }
 
     transport_con_type::async_write(
-        m_http_message_buffer.data(),
-        m_http_message_buffer.size(),
-        lib::bind(
-            &type::handle_send_http_request,
-            type::get_shared(),
-            lib::placeholders::_1
-        )
+        m_send_buffer,
+        m_write_frame_handler
     );
 }
 
 template <typename config>
-void connection<config>::handle_send_http_request(lib::error_code const & ec) {
-    m_alog->write(log::alevel::devel,"handle_send_http_request");
+void connection<config>::log_write_frame() const {
+    std::stringstream general,header,payload;
+
+    general << "Dispatching write containing " << m_current_msgs.size()
+            <<" message(s) containing ";
+    header << "Header Bytes: \n";
+    payload << "Payload Bytes: \n";
+
+    size_t hbytes = 0;
+    size_t pbytes = 0;
+
+    for (size_t i = 0; i < m_current_msgs.size(); i++) {
+        hbytes += m_current_msgs[i]->get_header().size();
+        pbytes += m_current_msgs[i]->get_payload_size();
+
+        header << "[" << i << "] ("
+               << m_current_msgs[i]->get_header().size() << ") "
+               << utility::to_hex(m_current_msgs[i]->get_header().data(),
+                   m_current_msgs[i]->get_header().size()) << "\n";
+
+        if (log::enabled(*m_alog, log::alevel::frame_payload)) {
+            payload << "[" << i << "] ("
+                    << m_current_msgs[i]->get_payload_size() << ") ["<<m_current_msgs[i]->get_opcode()<<"] "
+                    << (m_current_msgs[i]->get_opcode() == frame::opcode::text ?
+                            m_current_msgs[i]->get_payload() :
+                            utility::to_hex(m_current_msgs[i]->get_payload())
+                       )
+                    << "\n";
+        }
+    }
 
-    lib::error_code ecm = ec;
+    general << hbytes << " header bytes and " << pbytes << " payload bytes";
 
-    if (!ecm) {
-        scoped_lock_type lock(m_connection_state_lock);
-        
-        if (m_state == session::state::connecting) {
-             if (m_internal_state != istate::WRITE_HTTP_REQUEST) {
-                ecm = error::make_error_code(error::invalid_state);
-             } else {
-                m_internal_state = istate::READ_HTTP_RESPONSE;
-				if (m_is_http)
-					m_state = session::state::open;
-             }
-        } else if (m_state == session::state::closed) {
-            // The connection was canceled while the response was being sent,
-            // usually by the handshake timer. This is basically expected
-            // (though hopefully rare) and there is nothing we can do so ignore.
-            m_alog->write(log::alevel::devel,
-                "handle_send_http_request invoked after connection was closed");
-            return;
-        } else {
-            ecm = error::make_error_code(error::invalid_state);
-        }
+    m_alog->write(log::alevel::frame_header,general.str());
+    m_alog->write(log::alevel::frame_header,header.str());
+    m_alog->write(log::alevel::frame_payload,payload.str());
+}
+
+template <typename config>
+void connection<config>::handle_write_frame(lib::error_code const & ec)
+{
+    if (m_alog->static_test(log::alevel::devel)) {
+        m_alog->write(log::alevel::devel,"connection handle_write_frame");
     }
 
-    if (ecm) {
-        if (ecm == transport::error::eof && m_state == session::state::closed) {
-            // we expect to get eof if the connection is closed already
-            m_alog->write(log::alevel::devel,
-                    "got (expected) eof/state error from closed con");
-            return;
+    WEBSOCKETPP_TRACE(trace_type, trace::point::write, this, ec.value(), 0);
+
+    bool terminal = m_current_msgs.back()->get_terminal();
+
+    if (m_metrics && !ec) {
+        m_metrics->record_write(lib::chrono::duration_cast<
+            latency_histogram::duration>(lib::chrono::steady_clock::now() -
+            m_write_start));
+    }
+
+    if (m_send_latency && !ec) {
+        record_send_latency();
+    }
+
+    if (m_write_complete_handler && !ec) {
+        typename std::vector<message_ptr>::const_iterator it;
+        for (it = m_current_msgs.begin(); it != m_current_msgs.end(); ++it) {
+            uint64_t id = (*it)->get_completion_id();
+            if (id && !(*it)->get_broadcast()) {
+                m_write_complete_handler(m_connection_hdl, id);
+            }
         }
-        
-        log_err(log::elevel::rerror,"handle_send_http_request",ecm);
-        this->terminate(ecm);
+    }
+
+    for (size_t i = 0; i < m_current_msgs.size(); ++i) {
+        complete_send(m_current_msgs[i],ec);
+    }
+
+    m_send_buffer.clear();
+    // Releasing the messages hands them back to the message manager, which
+    // may recycle them (see message_buffer::pool)
+    m_current_msgs.clear();
+
+    if (ec) [[unlikely]] {
+        log_err(log::elevel::fatal,"handle_write_frame",ec);
+        this->terminate(ec);
         return;
     }
 
-	if (m_is_http)
-	{
-		if (m_handshake_timer) {
-			m_handshake_timer->cancel();
-			m_handshake_timer.reset();
-		}
+    if (terminal) {
+        this->terminate(lib::error_code());
+        return;
+    }
 
-		// Start a timer so we don't wait forever for the http body
-		// it's okay to use the handskahe timer as it's not being used by anything else
-		if (m_http_response_timeout_dur > 0) {
-			m_handshake_timer = transport_con_type::set_timer(
-				m_http_response_timeout_dur,
-				lib::bind(
-					&type::handle_read_response_timeout,
-					type::get_shared(),
-					lib::placeholders::_1
-				)
-			);
-		}
-	}
+    bool needs_writing = false;
+    long hold = 0;
+    if (config_traits<config>::lock_free_send_queue) {
+        // keep ownership of the queue if anything was pushed meanwhile
+        size_t popped = m_send_popped;
+        m_send_popped = 0;
 
-    transport_con_type::async_read_at_least(
-        1,
-        m_buf,
-        config::connection_read_buffer_size,
-        lib::bind(
-            &type::handle_read_http_response,
-            type::get_shared(),
-            lib::placeholders::_1,
-            lib::placeholders::_2
-        )
-    );
-}
+        needs_writing = (m_send_pending.fetch_sub(popped) != popped);
+    } else {
+        scoped_lock_type lock(m_write_lock);
 
-template <typename config>
-void connection<config>::handle_read_http_response(lib::error_code const & ec,
-    size_t bytes_transferred)
-{
-    m_alog->write(log::alevel::devel,"handle_read_http_response");
+        // release write flag
+        m_write_flag = false;
 
-    lib::error_code ecm = ec;
+        needs_writing = !send_queue_empty() || m_fragment_source ||
+            !m_fragment_deferred.empty() ||
+            (!m_stream_writing && !m_stream_held.empty());
 
-    if (!ecm) {
-        scoped_lock_type lock(m_connection_state_lock);
-        
-        if (m_state == session::state::connecting || (m_is_http && m_state == session::state::open)) {
-            if (m_internal_state != istate::READ_HTTP_RESPONSE) {
-                ecm = error::make_error_code(error::invalid_state);
+        if (m_coalesce_max_delay > 0) {
+            int64_t took = lib::chrono::duration_cast<
+                lib::chrono::microseconds>(lib::chrono::steady_clock::now() -
+                m_write_start).count();
+            m_coalesce_write_time += (took - m_coalesce_write_time) / 8;
+
+            if (needs_writing) {
+                hold = begin_coalesce_hold();
             }
-        } else if (m_state == session::state::closed) {
-            // The connection was canceled while the response was being sent,
-            // usually by the handshake timer. This is basically expected
-            // (though hopefully rare) and there is nothing we can do so ignore.
-            m_alog->write(log::alevel::devel,
-                "handle_read_http_response invoked after connection was closed");
-            return;
-        } else {
-            ecm = error::make_error_code(error::invalid_state);
         }
     }
 
-	bool should_parse = !ecm;
-    if (ecm.value() == transport::error::eof) {
-        if (m_state == session::state::closed) {
-            // we expect to get eof if the connection is closed already
-            m_alog->write(log::alevel::devel,
-                    "got (expected) eof/state error from closed con");
-            return;
-        } else if (m_is_http) {
-			// for http requests, it's normal to receive EOF
-			should_parse = true;
-		}
+    // whole milliseconds, without timers the hold ends at once
+    if (hold > 0 && !arm_deadline(m_coalesce_timer, (hold + 999) / 1000,
+        lib::bind(
+            &type::handle_coalesce_timer,
+            type::get_shared(),
+            lib::placeholders::_1
+        )))
+    {
+        release_coalesce_hold();
     }
-	
-	if (!should_parse)
-	{
-		log_err(log::elevel::rerror,"handle_read_http_response",ecm);
-		this->terminate(ecm);
-		return;
-	}
-    
-    size_t bytes_processed = 0;
 
-    lib::error_code consume_ec(ecm);
+    if (m_stream_drain_pending && stream_writable() &&
+        m_stream_drain_pending.exchange(false) && m_stream_drain_handler)
+    {
+        m_stream_drain_handler();
+    }
 
-    bytes_processed = m_response.consume(m_buf, bytes_transferred, consume_ec);
-    if (consume_ec) {
-        // An HTTP error while reading a response doesn't give us many options other than log
-        // and terminate.
-        m_response.set_status(http::error::get_status_code(http::error::value(consume_ec.value())));
-        log_err(log::elevel::rerror,"error in handle_read_http_response: ",consume_ec);
-        this->terminate(make_error_code(error::general));
-        return;
+    check_low_watermark();
+    govern_send_memory();
+
+    if (needs_writing) {
+        schedule_write_frame();
     }
+}
 
-    // m_alog->write(log::alevel::devel,std::string("Raw response: ")+m_response.raw());
+template <typename config>
+std::vector<int> const & connection<config>::get_supported_versions() const
+{
+    if constexpr (config_traits<config>::rfc6455_only) {
+        return rfc6455_versions_supported;
+    }
+    return versions_supported;
+}
 
-    if (m_response.has_received(response_type::state::HEADERS)) {
-		if (!m_is_http)
-		{
-			if (m_handshake_timer) {
-				m_handshake_timer->cancel();
-				m_handshake_timer.reset();
-			}
-		}
-		// follow redirect if possible
-		if (m_max_redirects && http::status_code::is_redirect(m_response.get_status_code())) {
-			m_max_redirects--;
-
-			const uri redirect_uri(m_response.get_header("Location"));
-			if (redirect_uri.get_valid()) {
-				std::string host_port;
-				std::string resource;
-
-				if (redirect_uri.is_absolute()) {
-					host_port = redirect_uri.get_host_port();
-					resource = redirect_uri.get_resource();
-				} else {
-					host_port = m_uri->get_host_port();
-					resource = m_uri->get_resource();
-					if (resource.ends_with('/')) // prevent double slashes!
-						resource.pop_back();
-					resource += redirect_uri.get_resource(); // get_resource should always have a leading slash
-				}
+template <typename config>
+void connection<config>::process_control_frame(typename config::message_type::ptr msg)
+{
+    m_alog->write(log::alevel::devel,"process_control_frame");
 
-				m_request.replace_header("Host", host_port);;
-				m_request.set_uri(resource);
-				this->send_http_request();
-				return;
-			}
-		}
+    frame::opcode::value op = msg->get_opcode();
+    lib::error_code ec;
 
-		if (m_is_http) {
-			if (m_progress_handler)
-				m_progress_handler(m_connection_hdl, m_response.get_transferred_body_size(), m_response.get_total_body_size());
+    WEBSOCKETPP_LOG(*m_alog, log::alevel::control,
+        "Control frame received with opcode " << op);
 
-			if (m_response.has_received(response_type::state::BODY))
-			{
-            	this->terminate({});
-			} else {
-				// The HTTP parser reported that it was not ready and wants more data.
-				// Assert that it actually consumed all the data present before overwriting
-				// the buffer. This should always be the case.
-				if (bytes_transferred != bytes_processed) {
-					m_elog->write(log::elevel::fatal,"Assertion Failed: HTTP response parser failed to consume all bytes from a read request.");
-					this->terminate(make_error_code(error::general));
-					return;
-				}
+    if (m_state == session::state::closed) {
+        m_elog->write(log::elevel::warn,"got frame in state closed");
+        return;
+    }
+    if (op != frame::opcode::CLOSE && m_state != session::state::open) {
+        m_elog->write(log::elevel::warn,"got non-close frame in state closing");
+        return;
+    }
 
-				transport_con_type::async_read_at_least(
-					1,
-					m_buf,
-					config::connection_read_buffer_size,
-					lib::bind(
-						&type::handle_read_http_response,
-						type::get_shared(),
-						lib::placeholders::_1,
-						lib::placeholders::_2
-					)
-				);
-			}
-			return;
-		}
+    if (op == frame::opcode::PING) {
+        bool should_reply = true;
 
-        lib::error_code validate_ec = m_processor->validate_server_handshake_response(
-            m_request,
-            m_response
-        );
-        if (validate_ec) {
-            log_err(log::elevel::rerror,"Server handshake response",validate_ec);
-            this->terminate(validate_ec);
+        if (m_ping_handler) {
+            handler_timer timer(*this, handler_type::ping);
+            should_reply = m_ping_handler(m_connection_hdl, msg->get_payload());
+        }
+
+        if (should_reply) {
+            this->auto_pong(msg->get_payload(),ec);
+            if (ec) {
+                log_err(log::elevel::devel,"Failed to send response pong",ec);
+            }
+        }
+    } else if (op == frame::opcode::PONG) {
+        cancel_deadline(m_ping_timer);
+        m_pong_pending = false;
+        if (m_keepalive_pending && msg->get_payload().empty()) {
+            m_keepalive_pending = false;
+            m_rtt = lib::chrono::duration_cast<lib::chrono::microseconds>(
+                lib::chrono::steady_clock::now() - m_keepalive_sent).count();
+            if (m_metrics) {
+                m_metrics->record_rtt(lib::chrono::microseconds(m_rtt));
+            }
+        }
+        if (m_pong_handler) {
+            handler_timer timer(*this, handler_type::pong);
+            m_pong_handler(m_connection_hdl, msg->get_payload());
+        }
+    } else if (op == frame::opcode::CLOSE) {
+        m_alog->write(log::alevel::devel,"got close frame");
+        // record close code and reason somewhere
+
+        m_remote_close_code = close::extract_code(msg->get_payload(),ec);
+        if (ec) {
+            if (config::drop_on_protocol_error) {
+                WEBSOCKETPP_LOG(*m_elog, log::elevel::devel,
+                    "Received invalid close code " << m_remote_close_code
+                    << " dropping connection per config.");
+                this->terminate(ec);
+            } else {
+                WEBSOCKETPP_LOG(*m_elog, log::elevel::devel,
+                    "Received invalid close code " << m_remote_close_code
+                    << " sending acknowledgement and closing");
+                ec = send_close_ack(close::status::protocol_error,
+                    "Invalid close code");
+                if (ec) {
+                    log_err(log::elevel::devel,"send_close_ack",ec);
+                }
+            }
             return;
         }
 
-        // Read extension parameters and set up values necessary for the end
-        // user to complete extension negotiation.
-        std::pair<lib::error_code,std::string> neg_results;
-        neg_results = m_processor->negotiate_extensions(m_response);
-
-        if (neg_results.first) {
-            // There was a fatal error in extension negotiation. For the moment
-            // kill all connections that fail extension negotiation.
-            
-            // TODO: deal with cases where the response is well formed but 
-            // doesn't match the options requested by the client. Its possible
-            // that the best behavior in this cases is to log and continue with
-            // an unextended connection.
-            m_alog->write(log::alevel::devel, "Extension negotiation failed: "
-                + neg_results.first.message());
-            this->terminate(make_error_code(error::extension_neg_failed));
-            // TODO: close connection with reason 1010 (and list extensions)
+        m_remote_close_reason = close::extract_reason(msg->get_payload(),ec);
+        if (ec) {
+            if (config::drop_on_protocol_error) {
+                m_elog->write(log::elevel::devel,
+                    "Received invalid close reason. Dropping connection per config");
+                this->terminate(ec);
+            } else {
+                m_elog->write(log::elevel::devel,
+                    "Received invalid close reason. Sending acknowledgement and closing");
+                ec = send_close_ack(close::status::protocol_error,
+                    "Invalid close reason");
+                if (ec) {
+                    log_err(log::elevel::devel,"send_close_ack",ec);
+                }
+            }
+            return;
         }
 
-        // response is valid, connection can now be assumed to be open      
-        m_internal_state = istate::PROCESS_CONNECTION;
-        m_state = session::state::open;
-
-        this->log_open_result();
+        if (m_state == session::state::open) {
+            WEBSOCKETPP_LOG(*m_alog, log::alevel::devel,
+                "Received close frame with code " << m_remote_close_code
+                << " and reason " << m_remote_close_reason);
 
-        if (m_open_handler) {
-            m_open_handler(m_connection_hdl);
-        }
+            ec = send_close_ack();
+            if (ec) {
+                log_err(log::elevel::devel,"send_close_ack",ec);
+            }
+        } else if (m_state == session::state::closing && !m_was_clean) {
+            // ack of our close
+            m_alog->write(log::alevel::devel, "Got acknowledgement of close");
 
-        // The remaining bytes in m_buf are frame data. Copy them to the
-        // beginning of the buffer and note the length. They will be read after
-        // the handshake completes and before more bytes are read.
-        std::copy(m_buf+bytes_processed,m_buf+bytes_transferred,m_buf);
-        m_buf_cursor = bytes_transferred-bytes_processed;
+            m_was_clean = true;
 
-        this->handle_read_frame(lib::error_code(), m_buf_cursor);
-    } else {
-        // The HTTP parser reported that it was not ready and wants more data.
-        // Assert that it actually consumed all the data present before overwriting
-        // the buffer. This should always be the case.
-        if (bytes_transferred != bytes_processed) {
-            m_elog->write(log::elevel::fatal,"Assertion Failed: HTTP response parser failed to consume all bytes from a read request.");
-            this->terminate(make_error_code(error::general));
-            return;
+            // If we are a server terminate the connection now. Clients should
+            // leave the connection open to give the server an opportunity to
+            // initiate the TCP close. The client's timer will handle closing
+            // its side of the connection if the server misbehaves.
+            //
+            // TODO: different behavior if the underlying transport doesn't
+            // support timers?
+            if (m_is_server) {
+                terminate(lib::error_code());
+            }
+        } else {
+            // spurious, ignore
+            m_elog->write(log::elevel::devel, "Got close frame in wrong state");
         }
-
-        transport_con_type::async_read_at_least(
-            1,
-            m_buf,
-            config::connection_read_buffer_size,
-            lib::bind(
-                &type::handle_read_http_response,
-                type::get_shared(),
-                lib::placeholders::_1,
-                lib::placeholders::_2
-            )
-        );
-    }
-}
-
-template <typename config>
-void connection<config>::handle_open_handshake_timeout(
-    lib::error_code const & ec)
-{
-    if (ec == transport::error::operation_aborted) {
-        m_alog->write(log::alevel::devel,"open handshake timer cancelled");
-    } else if (ec) {
-        m_alog->write(log::alevel::devel,
-            "open handle_open_handshake_timeout error: "+ec.message());
-        // TODO: ignore or fail here?
     } else {
-        m_alog->write(log::alevel::devel,"open handshake timer expired");
-        terminate(make_error_code(error::open_handshake_timeout));
+        // got an invalid control opcode
+        m_elog->write(log::elevel::devel, "Got control frame with invalid opcode");
+        // initiate protocol error shutdown
     }
 }
 
 template <typename config>
-void connection<config>::handle_close_handshake_timeout(
-    lib::error_code const & ec)
+lib::error_code connection<config>::send_close_ack(close::status::value code,
+    std::string const & reason)
 {
-    if (ec == transport::error::operation_aborted) {
-        m_alog->write(log::alevel::devel,"asio close handshake timer cancelled");
-    } else if (ec) {
-        m_alog->write(log::alevel::devel,
-            "asio open handle_close_handshake_timeout error: "+ec.message());
-        // TODO: ignore or fail here?
-    } else {
-        m_alog->write(log::alevel::devel, "asio close handshake timer expired");
-        terminate(make_error_code(error::close_handshake_timeout));
-    }
+    return send_close_frame(code,reason,true,m_is_server);
 }
 
 template <typename config>
-void connection<config>::handle_read_response_timeout(lib::error_code const & ec)
+lib::error_code connection<config>::send_close_frame(close::status::value code,
+    std::string const & reason, bool ack, bool terminal,
+    message_ptr const & prepared, bool timer)
 {
-    if (ec == transport::error::operation_aborted) {
-        m_alog->write(log::alevel::devel,"asio read http response timer cancelled");
-    } else if (ec) {
+    m_alog->write(log::alevel::devel,"send_close_frame");
+
+    // check for special codes
+
+    // If silent close is set, respect it and blank out close information
+    // Otherwise use whatever has been specified in the parameters. If
+    // parameters specifies close::status::blank then determine what to do
+    // based on whether or not this is an ack. If it is not an ack just
+    // send blank info. If it is an ack then echo the close information from
+    // the remote endpoint.
+    if (config::silent_close) {
+        m_alog->write(log::alevel::devel,"closing silently");
+        m_local_close_code = close::status::no_status;
+        m_local_close_reason.clear();
+    } else if (code != close::status::blank) {
+        m_alog->write(log::alevel::devel,"closing with specified codes");
+        m_local_close_code = code;
+        m_local_close_reason = reason;
+    } else if (!ack) {
+        m_alog->write(log::alevel::devel,"closing with no status code");
+        m_local_close_code = close::status::no_status;
+        m_local_close_reason.clear();
+    } else if (m_remote_close_code == close::status::no_status) {
         m_alog->write(log::alevel::devel,
-            "asio handle_read_response_timeout error: "+ec.message());
-        // TODO: ignore or fail here?
+            "acknowledging a no-status close with normal code");
+        m_local_close_code = close::status::normal;
+        m_local_close_reason.clear();
     } else {
-        m_alog->write(log::alevel::devel, "asio read http response timer expired");
-        terminate(make_error_code(error::http_read_response_timeout));
+        m_alog->write(log::alevel::devel,"acknowledging with remote codes");
+        m_local_close_code = m_remote_close_code;
+        m_local_close_reason = m_remote_close_reason;
     }
-}
 
-template <typename config>
-void connection<config>::terminate(lib::error_code const & ec) {
-    if (m_alog->static_test(log::alevel::devel)) {
-        m_alog->write(log::alevel::devel,"connection terminate");
+    WEBSOCKETPP_LOG(*m_alog, log::alevel::devel,
+        "Closing with code: " << m_local_close_code << ", and reason: "
+        << m_local_close_reason);
+
+    // Messages flagged terminal will result in the TCP connection being dropped
+    // after the message has been written. This is typically used when servers
+    // send an ack and when any endpoint encounters a protocol error
+    message_ptr msg;
+    if (prepared && m_local_close_code == code) {
+        msg = shared_control_frame(prepared);
+    }
+    if (!msg && m_local_close_reason.empty() && m_control_frames) {
+        msg = shared_control_frame(m_control_frames->get_close(
+            m_local_close_code,terminal));
     }
 
-    // Cancel close handshake timer
-    if (m_handshake_timer) {
-        m_handshake_timer->cancel();
-        m_handshake_timer.reset();
+    if (!msg) {
+        msg = m_msg_manager->get_message();
+        if (!msg) {
+            return error::make_error_code(error::no_outgoing_buffers);
+        }
+
+        lib::error_code ec = m_processor->prepare_close(m_local_close_code,
+            m_local_close_reason,msg);
+        if (ec) {
+            return ec;
+        }
+
+        if (terminal) {
+            msg->set_terminal(true);
+        }
     }
 
-    // Cancel ping timer
-    if (m_ping_timer) {
-        m_ping_timer->cancel();
-        m_ping_timer.reset();
+    m_state = session::state::closing;
+
+    // Cancel any outstanding ping timers. Once we are in state closing the
+    // library no longer processes non-close frames, so any pongs will be
+    // dropped.
+    cancel_deadline(m_ping_timer);
+
+    if (ack) {
+        m_was_clean = true;
     }
 
-    terminate_status tstat = unknown;
-    if (ec) {
-        m_ec = ec;
-        m_local_close_code = close::status::abnormal_close;
-        m_local_close_reason = ec.message();
+    // Start a timer so we don't wait forever for the acknowledgement close
+    // frame
+    if (timer && m_close_handshake_timeout_dur > 0) {
+        arm_deadline(
+            m_handshake_timer,
+            m_close_handshake_timeout_dur,
+            lib::bind(
+                &type::handle_close_handshake_timeout,
+                type::get_shared(),
+                lib::placeholders::_1
+            )
+        );
     }
 
-    // TODO: does any of this need a mutex?
-    if (m_is_http && m_http_state != session::http_state::closed) {
-        m_http_state = session::http_state::closed;
-		if (!m_is_server && m_http_handler) // only call m_http_handler here for client connections
-			m_http_handler(m_connection_hdl);
+    bool needs_writing = write_enqueue(msg);
+
+    if (needs_writing) {
+        schedule_write_frame();
     }
-    if (m_state == session::state::connecting) {
-        m_state = session::state::closed;
-        tstat = failed;
-        
-        // Log fail result here before socket is shut down and we can't get
-        // the remote address, etc anymore
-        if (m_ec != error::http_connection_ended) {
-            log_fail_result();
+
+    return lib::error_code();
+}
+
+template <typename config>
+typename connection<config>::active_processor_ptr
+connection<config>::get_processor(int version) {
+    active_processor_ptr p = active_processor_ptr();
+
+    if constexpr (config_traits<config>::rfc6455_only) {
+        if (version != 13) {
+            return p;
         }
-    } else if (m_state != session::state::closed) {
-        m_state = session::state::closed;
-        tstat = closed;
+        m_inline_processor.emplace(
+            transport_con_type::is_secure(),
+            m_is_server,
+            m_msg_manager,
+            lib::ref(m_rng)
+        );
+        p = &*m_inline_processor;
     } else {
-        m_alog->write(log::alevel::devel,
-            "terminate called on connection that was already terminated");
-        return;
+        switch (version) {
+            case 0:
+                p = this->make_processor<processor::hybi00<config> >(
+                    transport_con_type::is_secure(),
+                    m_is_server,
+                    m_msg_manager
+                );
+                break;
+            case 7:
+                p = this->make_processor<processor::hybi07<config> >(
+                    transport_con_type::is_secure(),
+                    m_is_server,
+                    m_msg_manager,
+                    lib::ref(m_rng)
+                );
+                break;
+            case 8:
+                p = this->make_processor<processor::hybi08<config> >(
+                    transport_con_type::is_secure(),
+                    m_is_server,
+                    m_msg_manager,
+                    lib::ref(m_rng)
+                );
+                break;
+            case 13:
+                p = this->make_processor<processor::hybi13<config> >(
+                    transport_con_type::is_secure(),
+                    m_is_server,
+                    m_msg_manager,
+                    lib::ref(m_rng)
+                );
+                break;
+            default:
+                return p;
+        }
     }
 
-    // TODO: choose between shutdown and close based on error code sent
-
-    transport_con_type::async_shutdown(
-        lib::bind(
-            &type::handle_terminate,
-            type::get_shared(),
-            tstat,
-            lib::placeholders::_1
-        )
-    );
+    // Settings not configured by the constructor
+    p->set_max_message_size(m_max_message_size);
+    if (m_spill_threshold) {
+        p->set_message_spill(m_spill_threshold, m_spill_max_size, m_spill_dir);
+    }
+    p->set_message_views(bool(m_message_view_handler));
+    p->set_message_chunks(bool(m_message_chunk_handler));
+    p->set_trace_id(reinterpret_cast<uintptr_t>(this));
+    p->set_deflate_memory(m_deflate_mem_level, m_deflate_budget);
+    p->set_inbound_memory_budget(m_inbound_budget);
+    if (m_deflate_dictionary) {
+        p->set_deflate_dictionary(m_deflate_dictionary_id,
+            m_deflate_dictionary);
+    }
+    p->set_zstd_params(m_zstd_level, m_zstd_dictionaries);
+    if (m_compression_stats) {
+        p->set_deflate_stats(m_compression_stats);
+    }
+    
+    return p;
 }
 
 template <typename config>
-void connection<config>::handle_terminate(terminate_status tstat,
-    lib::error_code const & ec)
+void connection<config>::write_push(typename config::message_type::ptr msg)
 {
-    if (m_alog->static_test(log::alevel::devel)) {
-        m_alog->write(log::alevel::devel,"connection handle_terminate");
+    if (!msg) {
+        return;
     }
 
-    if (ec) {
-        // there was an error actually shutting down the connection
-        log_err(log::elevel::devel,"handle_terminate",ec);
+    if (!apply_slow_consumer_policy(msg)) {
+        return;
+    }
+
+    size_t lane = send_lane(msg);
+
+    stamp_enqueue(msg);
+    if (m_coalesce_max_delay > 0) {
+        note_coalesce_push(msg->get_payload_size(), lane);
+    }
+    size_t payload_size = msg->get_payload_size();
+    m_send_buffer_size += payload_size;
+    m_send_queue[lane].push_back(std::move(msg));
+    WEBSOCKETPP_TRACE(trace_type, trace::point::push, this, payload_size, 0);
+    if (m_metrics) {
+        publish_send_buffer(false);
     }
 
-    // clean shutdown
-    if (tstat == failed) {
-        if (m_ec != error::http_connection_ended) {
-            if (m_fail_handler) {
-                m_fail_handler(m_connection_hdl);
-            }
-        }
-    } else if (tstat == closed) {
-        if (m_close_handler) {
-            m_close_handler(m_connection_hdl);
+    WEBSOCKETPP_LOG(*m_alog, log::alevel::devel,
+        "write_push: lane: " << lane
+        << " message count: " << m_send_queue[lane].size()
+        << " buffer size: " << m_send_buffer_size);
+}
+
+template <typename config>
+bool connection<config>::write_enqueue(message_ptr msg)
+{
+    if (config_traits<config>::lock_free_send_queue) {
+        stamp_enqueue(msg);
+        m_send_buffer_size += msg->get_payload_size();
+        m_send_mpsc.push(msg);
+        WEBSOCKETPP_TRACE(trace_type, trace::point::push, this,
+            msg->get_payload_size(), 0);
+        if (m_metrics) {
+            publish_send_buffer(false);
         }
-        log_close_result();
-    } else {
-        m_elog->write(log::elevel::rerror,"Unknown terminate_status");
+
+        // The producer that finds nothing pending owns the queue and must
+        // start the write.
+        return m_send_pending.fetch_add(1) == 0;
     }
 
-    // call the termination handler if it exists
-    // if it exists it might (but shouldn't) refer to a bad memory location.
-    // If it does, we don't care and should catch and ignore it.
-    // todo: there has to be a better way to do this.
-    if (m_termination_handler) {
-#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
-        try {
-            m_termination_handler(type::get_shared());
-        } catch (std::exception const & e) {
-            m_elog->write(log::elevel::warn,
-                std::string("termination_handler call failed. Reason was: ")+e.what());
-        }
-#else
-        m_termination_handler(type::get_shared());
-#endif
+    scoped_lock_type lock(m_write_lock);
+
+    // a close frame must not overtake data still on the worker pool
+    if (m_offload_busy && msg->get_opcode() == frame::opcode::close) {
+        m_offload_queue.push_back(msg);
+        return false;
     }
+
+    write_push(msg);
+    return !m_write_flag && !send_queue_empty();
 }
 
 template <typename config>
-void connection<config>::write_frame() {
-    //m_alog->write(log::alevel::devel,"connection write_frame");
+bool connection<config>::use_prepared(message_ptr const & msg) const {
+    // Broadcast messages carry an RFC6455 server frame header. Connections
+    // that would frame the message differently fall through and prepare the
+    // (unframed) broadcast payload like any other message.
+    return msg->get_prepared() && (!msg->get_broadcast() ||
+        (m_is_server && m_processor && m_processor->get_version() >= 7));
+}
 
-    {
-        scoped_lock_type lock(m_write_lock);
+template <typename config>
+typename connection<config>::message_ptr
+connection<config>::flatten_prefix(message_ptr const & msg) {
+    std::string const & prefix = msg->get_prefix();
+    size_t size = msg->get_payload_size();
+
+    message_ptr out = m_msg_manager->get_message(msg->get_opcode(),
+        prefix.size() + size);
+    if (!out) {
+        return out;
+    }
+
+    out->append_payload(prefix.data(), prefix.size());
+    out->append_payload(msg->get_payload_data(), size);
+    out->set_priority(msg->get_priority());
+    out->set_conflation_key(msg->get_conflation_key());
+    return out;
+}
 
-        // Check the write flag. If true, there is an outstanding transport
-        // write already. In this case we just return. The write handler will
-        // start a new write if the write queue isn't empty. If false, we set
-        // the write flag and proceed to initiate a transport write.
-        if (m_write_flag) {
-            return;
+template <typename config>
+void connection<config>::write_gather() {
+    // pull off the messages that are ready to write, up to the per-write
+    // message and byte limits. stop if we get a message marked terminal
+    size_t batch_bytes = 0;
+    message_ptr next_message = write_pop();
+    while (next_message) {
+        m_current_msgs.push_back(next_message);
+        batch_bytes += next_message->get_header().size() +
+            next_message->get_prefix().size() +
+            next_message->get_payload_size();
+
+        if (next_message->get_terminal()) {
+            break;
         }
-
-        // pull off all the messages that are ready to write.
-        // stop if we get a message marked terminal
-        message_ptr next_message = write_pop();
-        while (next_message) {
-            m_current_msgs.push_back(next_message);
-            if (!next_message->get_terminal()) {
-                next_message = write_pop();
-            } else {
-                next_message = message_ptr();
-            }
+        // one fragment per write, so control frames can get in between
+        if (m_fragment_source) {
+            break;
         }
-        
-        if (m_current_msgs.empty()) {
-            // there was nothing to send
-            return;
-        } else {
-            // At this point we own the next messages to be sent and are
-            // responsible for holding the write flag until they are 
-            // successfully sent or there is some error
-            m_write_flag = true;
+        if (config_traits<config>::write_batch_max_messages > 0 &&
+            m_current_msgs.size() >=
+            config_traits<config>::write_batch_max_messages)
+        {
+            break;
+        }
+        if (config_traits<config>::write_batch_max_bytes > 0 &&
+            batch_bytes >= config_traits<config>::write_batch_max_bytes)
+        {
+            break;
         }
-    }
 
-    typename std::vector<message_ptr>::iterator it;
-    for (it = m_current_msgs.begin(); it != m_current_msgs.end(); ++it) {
-        std::string const & header = (*it)->get_header();
-        std::string const & payload = (*it)->get_payload();
+        next_message = write_pop();
+    }
+}
 
-        m_send_buffer.push_back(transport::buffer(header.c_str(),header.size()));
-        m_send_buffer.push_back(transport::buffer(payload.c_str(),payload.size()));   
+template <typename config>
+lib::error_code connection<config>::set_compression_params(int level,
+    extensions::permessage_deflate::strategy::value strategy)
+{
+    lib::error_code ec = config::permessage_deflate_type::
+        validate_compression_params(level,strategy);
+    if (ec) {
+        return ec;
     }
 
-    // Print detailed send stats if those log levels are enabled
-    if (m_alog->static_test(log::alevel::frame_header)) {
-    if (m_alog->dynamic_test(log::alevel::frame_header)) {
-        std::stringstream general,header,payload;
-        
-        general << "Dispatching write containing " << m_current_msgs.size()
-                <<" message(s) containing ";
-        header << "Header Bytes: \n";
-        payload << "Payload Bytes: \n";
-        
-        size_t hbytes = 0;
-        size_t pbytes = 0;
-        
-        for (size_t i = 0; i < m_current_msgs.size(); i++) {
-            hbytes += m_current_msgs[i]->get_header().size();
-            pbytes += m_current_msgs[i]->get_payload().size();
+    // the compressor belongs to whoever prepares frames, so the values wait
+    // here until the next message is prepared
+    scoped_lock_type lock(m_write_lock);
+    m_compression_level = level;
+    m_compression_strategy = strategy;
+    m_compression_params_pending = true;
+    return ec;
+}
 
-            
-            header << "[" << i << "] (" 
-                   << m_current_msgs[i]->get_header().size() << ") " 
-                   << utility::to_hex(m_current_msgs[i]->get_header()) << "\n";
-
-            if (m_alog->static_test(log::alevel::frame_payload)) {
-            if (m_alog->dynamic_test(log::alevel::frame_payload)) {
-                payload << "[" << i << "] (" 
-                        << m_current_msgs[i]->get_payload().size() << ") ["<<m_current_msgs[i]->get_opcode()<<"] "
-                        << (m_current_msgs[i]->get_opcode() == frame::opcode::text ? 
-                                m_current_msgs[i]->get_payload() : 
-                                utility::to_hex(m_current_msgs[i]->get_payload())
-                           ) 
-                        << "\n";
-            }
-            }  
-        }
-        
-        general << hbytes << " header bytes and " << pbytes << " payload bytes";
-        
-        m_alog->write(log::alevel::frame_header,general.str());
-        m_alog->write(log::alevel::frame_header,header.str());
-        m_alog->write(log::alevel::frame_payload,payload.str());
-    }
+template <typename config>
+void connection<config>::apply_compression_params() {
+    int level;
+    extensions::permessage_deflate::strategy::value strategy;
+
+    // called with m_write_lock held unless on the lock free writer or an
+    // offload worker
+    if (config_traits<config>::lock_free_send_queue || m_offload_busy) {
+        scoped_lock_type lock(m_write_lock);
+        level = m_compression_level;
+        strategy = m_compression_strategy;
+        m_compression_params_pending = false;
+    } else {
+        level = m_compression_level;
+        strategy = m_compression_strategy;
+        m_compression_params_pending = false;
     }
 
-    transport_con_type::async_write(
-        m_send_buffer,
-        m_write_frame_handler
-    );
+    lib::error_code ec = m_processor->set_deflate_params(level,strategy);
+    if (ec) {
+        log_err(log::elevel::warn,"set_compression_params",ec);
+    }
 }
 
 template <typename config>
-void connection<config>::handle_write_frame(lib::error_code const & ec)
+lib::error_code connection<config>::prepare_data_message(message_ptr in,
+    message_ptr out, bool apply_policy)
 {
-    if (m_alog->static_test(log::alevel::devel)) {
-        m_alog->write(log::alevel::devel,"connection handle_write_frame");
+    account_timer timer(*this, m_prepare_time);
+
+    if (m_compression_params_pending) {
+        apply_compression_params();
     }
 
-    bool terminal = m_current_msgs.back()->get_terminal();
+    if (is_stream_part(in)) {
+        return m_processor->prepare_stream_frame(in,out);
+    }
 
-    m_send_buffer.clear();
-    m_current_msgs.clear();
-    // TODO: recycle instead of deleting
+    frame::opcode::value op = in->get_opcode();
+    size_t size = in->get_payload_size();
 
-    if (ec) {
-        log_err(log::elevel::fatal,"handle_write_frame",ec);
-        this->terminate(ec);
-        return;
+    // the frame is queued in place of the message, in its lane and
+    // conflated by its key
+    out->set_priority(in->get_priority());
+    out->set_completion_id(in->get_completion_id());
+    if (in->has_send_handler() && !in->get_broadcast()) {
+        out->set_send_handler(in->take_send_handler());
+    }
+    if (!in->get_conflation_key().empty()) {
+        out->set_conflation_key(in->get_conflation_key());
     }
 
-    if (terminal) {
-        this->terminate(lib::error_code());
-        return;
+    // larger messages are left for write_pop to send in fragments
+    bool fragment = m_fragment_size > 0 && size > m_fragment_size;
+
+    if (!m_use_compression_policy) {
+        if (fragment) {
+            return m_processor->prepare_fragment_source(in,out);
+        }
+        return m_processor->prepare_data_frame(in,out);
     }
 
-    bool needs_writing = false;
-    {
-        scoped_lock_type lock(m_write_lock);
+    if (apply_policy) {
+        in->set_compressed(m_compression_policy.should_compress(op,size));
+    }
 
-        // release write flag
-        m_write_flag = false;
+    lib::error_code ec;
+    if (fragment) {
+        ec = m_processor->prepare_fragment_source(in,out);
+    } else {
+        ec = m_processor->prepare_data_frame(in,out);
+    }
+
+    // only frames that went out with RSV1 set were actually compressed
+    bool deflated;
+    if (out->get_prepared()) {
+        frame::header_buffer const & header = out->get_header();
+        deflated = !header.empty() && (uint8_t(header[0]) & frame::BHB0_RSV1);
+    } else {
+        deflated = out->get_compressed();
+    }
 
-        needs_writing = !m_send_queue.empty();
+    if (!ec && in->get_compressed() && deflated) {
+        m_compression_policy.record(op,size,out->get_payload_size());
     }
+    return ec;
+}
 
-    if (needs_writing) {
-        transport_con_type::dispatch(lib::bind(
-            &type::write_frame,
+template <typename config>
+bool connection<config>::should_offload(message_ptr const & msg) const {
+    return m_compression_pool && msg->get_compressed() &&
+           msg->get_payload_size() >= m_offload_threshold &&
+           m_processor->has_permessage_compress();
+}
+
+template <typename config>
+void connection<config>::offload_push(message_ptr msg) {
+    m_offload_queue.push_back(msg);
+
+    if (!m_offload_busy) {
+        m_offload_busy = true;
+        m_compression_pool->post(lib::bind(
+            &type::handle_offload,
             type::get_shared()
         ));
     }
 }
 
 template <typename config>
-std::vector<int> const & connection<config>::get_supported_versions() const
-{
-    return versions_supported;
+void connection<config>::dispatch_push(message_ptr msg) {
+    ++m_dispatch_pending;
+
+    scoped_lock_type lock(m_dispatch_lock);
+    m_dispatch_queue.push_back(msg);
+
+    if (!m_dispatch_busy) {
+        m_dispatch_busy = true;
+        m_dispatch_pool->post(lib::bind(
+            &type::handle_dispatch,
+            type::get_shared()
+        ));
+    }
 }
 
 template <typename config>
-void connection<config>::process_control_frame(typename config::message_type::ptr msg)
-{
-    m_alog->write(log::alevel::devel,"process_control_frame");
-
-    frame::opcode::value op = msg->get_opcode();
-    lib::error_code ec;
+void connection<config>::handle_dispatch() {
+    // While m_dispatch_busy is set only this worker calls the message
+    // handler, so each connection's messages are handled one at a time and
+    // in order, while different connections run on different workers.
+    std::deque<message_ptr> batch;
+    for (;;) {
+        {
+            scoped_lock_type lock(m_dispatch_lock);
+            if (m_dispatch_queue.empty()) {
+                m_dispatch_busy = false;
+                return;
+            }
+            batch.swap(m_dispatch_queue);
+        }
 
-    std::stringstream s;
-    s << "Control frame received with opcode " << op;
-    m_alog->write(log::alevel::control,s.str());
+        size_t count = batch.size();
+        while (!batch.empty()) {
+            message_ptr msg = batch.front();
+            batch.pop_front();
+            m_message_handler(m_connection_hdl, msg);
+        }
 
-    if (m_state == session::state::closed) {
-        m_elog->write(log::elevel::warn,"got frame in state closed");
-        return;
-    }
-    if (op != frame::opcode::CLOSE && m_state != session::state::open) {
-        m_elog->write(log::elevel::warn,"got non-close frame in state closing");
-        return;
+        transport_con_type::dispatch(lib::bind(
+            &type::handle_dispatch_done,
+            type::get_shared(),
+            count
+        ));
     }
+}
 
-    if (op == frame::opcode::PING) {
-        bool should_reply = true;
+template <typename config>
+void connection<config>::handle_dispatch_done(size_t count) {
+    m_dispatch_pending -= count;
 
-        if (m_ping_handler) {
-            should_reply = m_ping_handler(m_connection_hdl, msg->get_payload());
-        }
+    if (m_flow_paused && !flow_over_limit()) {
+        m_alog->write(log::alevel::devel,"message dispatch resumed reading");
+        m_flow_paused = false;
+        read_frame();
+    }
+}
 
-        if (should_reply) {
-            this->pong(msg->get_payload(),ec);
-            if (ec) {
-                log_err(log::elevel::devel,"Failed to send response pong",ec);
+template <typename config>
+void connection<config>::handle_offload() {
+    // While m_offload_busy is set only this worker prepares data frames, so
+    // the processor is used without holding m_write_lock.
+    for (;;) {
+        message_ptr msg;
+        {
+            scoped_lock_type lock(m_write_lock);
+            if (m_offload_queue.empty()) {
+                m_offload_busy = false;
+                return;
             }
+            msg = m_offload_queue.front();
+            m_offload_queue.pop_front();
         }
-    } else if (op == frame::opcode::PONG) {
-        if (m_ping_timer) {
-            m_ping_timer->cancel();
-        }
-        if (m_pong_handler) {
-            m_pong_handler(m_connection_hdl, msg->get_payload());
-        }
-    } else if (op == frame::opcode::CLOSE) {
-        m_alog->write(log::alevel::devel,"got close frame");
-        // record close code and reason somewhere
 
-        m_remote_close_code = close::extract_code(msg->get_payload(),ec);
-        if (ec) {
-            s.str("");
-            if (config::drop_on_protocol_error) {
-                s << "Received invalid close code " << m_remote_close_code
-                  << " dropping connection per config.";
-                m_elog->write(log::elevel::devel,s.str());
-                this->terminate(ec);
-            } else {
-                s << "Received invalid close code " << m_remote_close_code
-                  << " sending acknowledgement and closing";
-                m_elog->write(log::elevel::devel,s.str());
-                ec = send_close_ack(close::status::protocol_error,
-                    "Invalid close code");
-                if (ec) {
-                    log_err(log::elevel::devel,"send_close_ack",ec);
-                }
-            }
+        if (use_prepared(msg)) {
+            offload_complete(msg);
+        } else if (!offload_prepare(msg)) {
             return;
         }
+    }
+}
 
-        m_remote_close_reason = close::extract_reason(msg->get_payload(),ec);
-        if (ec) {
-            if (config::drop_on_protocol_error) {
-                m_elog->write(log::elevel::devel,
-                    "Received invalid close reason. Dropping connection per config");
-                this->terminate(ec);
-            } else {
-                m_elog->write(log::elevel::devel,
-                    "Received invalid close reason. Sending acknowledgement and closing");
-                ec = send_close_ack(close::status::protocol_error,
-                    "Invalid close reason");
-                if (ec) {
-                    log_err(log::elevel::devel,"send_close_ack",ec);
-                }
-            }
-            return;
-        }
+template <typename config>
+bool connection<config>::offload_prepare(message_ptr in) {
+    if (m_compression_params_pending) {
+        apply_compression_params();
+    }
 
-        if (m_state == session::state::open) {
-            s.str("");
-            s << "Received close frame with code " << m_remote_close_code
-              << " and reason " << m_remote_close_reason;
-            m_alog->write(log::alevel::devel,s.str());
+    size_t size = in->get_payload_size();
+    frame::opcode::value op = in->get_opcode();
 
-            ec = send_close_ack();
-            if (ec) {
-                log_err(log::elevel::devel,"send_close_ack",ec);
-            }
-        } else if (m_state == session::state::closing && !m_was_clean) {
-            // ack of our close
-            m_alog->write(log::alevel::devel, "Got acknowledgement of close");
+    bool split = m_offload_part_size > 0 && size >= 2 * m_offload_part_size
+                 && in->get_compressed() && !is_stream_part(in)
+                 && m_processor->can_split_deflate();
+    bool apply_policy = m_use_compression_policy;
 
-            m_was_clean = true;
+    if (split && apply_policy) {
+        // the policy's rules run once, here rather than in
+        // prepare_data_message
+        split = m_compression_policy.should_compress(op,size);
+        in->set_compressed(split);
+        apply_policy = false;
+    }
 
-            // If we are a server terminate the connection now. Clients should
-            // leave the connection open to give the server an opportunity to
-            // initiate the TCP close. The client's timer will handle closing
-            // its side of the connection if the server misbehaves.
-            //
-            // TODO: different behavior if the underlying transport doesn't
-            // support timers?
-            if (m_is_server) {
-                terminate(lib::error_code());
+    if (split) {
+        size_t count = (std::min)(size / m_offload_part_size,
+            m_compression_pool->size());
+
+        if (count > 1) {
+            offload_parts_ptr job = lib::make_shared<offload_parts>();
+            job->in = in;
+            job->parts.resize(count);
+            job->remaining = count;
+            job->failed = false;
+
+            for (size_t i = 1; i < count; ++i) {
+                m_compression_pool->post(lib::bind(
+                    &type::handle_offload_part,
+                    type::get_shared(),
+                    job,
+                    i
+                ));
             }
-        } else {
-            // spurious, ignore
-            m_elog->write(log::elevel::devel, "Got close frame in wrong state");
+            handle_offload_part(job,0);
+            return false;
         }
-    } else {
-        // got an invalid control opcode
-        m_elog->write(log::elevel::devel, "Got control frame with invalid opcode");
-        // initiate protocol error shutdown
     }
+
+    message_ptr msg = m_msg_manager->get_message();
+    if (!msg) {
+        log_err(log::elevel::rerror,"handle_offload",
+            error::make_error_code(error::no_outgoing_buffers));
+        return true;
+    }
+
+    lib::error_code ec = prepare_data_message(in,msg,apply_policy);
+    if (ec) {
+        log_err(log::elevel::rerror,"handle_offload",ec);
+        complete_send(msg,ec);
+        return true;
+    }
+
+    offload_complete(msg);
+    return true;
 }
 
 template <typename config>
-lib::error_code connection<config>::send_close_ack(close::status::value code,
-    std::string const & reason)
+void connection<config>::handle_offload_part(offload_parts_ptr job,
+    size_t index)
 {
-    return send_close_frame(code,reason,true,m_is_server);
+    std::string const & payload = job->in->get_payload();
+    size_t count = job->parts.size();
+    size_t begin = payload.size() * index / count;
+    size_t end = payload.size() * (index + 1) / count;
+
+    if (!job->failed) {
+        lib::error_code ec = m_processor->deflate_part(
+            payload.substr(begin, end - begin), job->parts[index]);
+        if (ec) {
+            log_err(log::elevel::warn,"handle_offload_part",ec);
+            job->failed = true;
+        }
+    }
+
+    if (job->remaining.fetch_sub(1) == 1) {
+        finish_offload_parts(job);
+    }
 }
 
 template <typename config>
-lib::error_code connection<config>::send_close_frame(close::status::value code,
-    std::string const & reason, bool ack, bool terminal)
-{
-    m_alog->write(log::alevel::devel,"send_close_frame");
-
-    // check for special codes
+void connection<config>::finish_offload_parts(offload_parts_ptr job) {
+    message_ptr in = job->in;
+    message_ptr msg = m_msg_manager->get_message();
 
-    // If silent close is set, respect it and blank out close information
-    // Otherwise use whatever has been specified in the parameters. If
-    // parameters specifies close::status::blank then determine what to do
-    // based on whether or not this is an ack. If it is not an ack just
-    // send blank info. If it is an ack then echo the close information from
-    // the remote endpoint.
-    if (config::silent_close) {
-        m_alog->write(log::alevel::devel,"closing silently");
-        m_local_close_code = close::status::no_status;
-        m_local_close_reason.clear();
-    } else if (code != close::status::blank) {
-        m_alog->write(log::alevel::devel,"closing with specified codes");
-        m_local_close_code = code;
-        m_local_close_reason = reason;
-    } else if (!ack) {
-        m_alog->write(log::alevel::devel,"closing with no status code");
-        m_local_close_code = close::status::no_status;
-        m_local_close_reason.clear();
-    } else if (m_remote_close_code == close::status::no_status) {
-        m_alog->write(log::alevel::devel,
-            "acknowledging a no-status close with normal code");
-        m_local_close_code = close::status::normal;
-        m_local_close_reason.clear();
+    if (!msg) {
+        lib::error_code ec = error::make_error_code(
+            error::no_outgoing_buffers);
+        log_err(log::elevel::rerror,"handle_offload",ec);
+        complete_send(in,ec);
     } else {
-        m_alog->write(log::alevel::devel,"acknowledging with remote codes");
-        m_local_close_code = m_remote_close_code;
-        m_local_close_reason = m_remote_close_reason;
-    }
+        lib::error_code ec;
 
-    std::stringstream s;
-    s << "Closing with code: " << m_local_close_code << ", and reason: "
-      << m_local_close_reason;
-    m_alog->write(log::alevel::devel,s.str());
+        if (job->failed) {
+            // fall back to the connection's own compressor
+            ec = m_processor->prepare_data_frame(in,msg);
+        } else {
+            std::string & o = msg->get_raw_payload();
+            size_t total = 0;
+            for (size_t i = 0; i < job->parts.size(); ++i) {
+                total += job->parts[i].size();
+            }
+            o.reserve(total);
+            for (size_t i = 0; i < job->parts.size(); ++i) {
+                o.append(job->parts[i]);
+            }
+            job->parts.clear();
 
-    message_ptr msg = m_msg_manager->get_message();
-    if (!msg) {
-        return error::make_error_code(error::no_outgoing_buffers);
+            ec = m_processor->prepare_deflated_frame(in,msg);
+        }
+
+        if (ec) {
+            log_err(log::elevel::rerror,"handle_offload",ec);
+            complete_send(in,ec);
+        } else {
+            if (m_use_compression_policy) {
+                m_compression_policy.record(in->get_opcode(),
+                    in->get_payload_size(),msg->get_payload_size());
+            }
+            msg->set_completion_id(in->get_completion_id());
+            if (in->has_send_handler()) {
+                msg->set_send_handler(in->take_send_handler());
+            }
+            offload_complete(msg);
+        }
     }
 
-    lib::error_code ec = m_processor->prepare_close(m_local_close_code,
-        m_local_close_reason,msg);
-    if (ec) {
-        return ec;
+    handle_offload();
+}
+
+template <typename config>
+void connection<config>::offload_complete(message_ptr msg) {
+    bool needs_writing;
+    {
+        scoped_lock_type lock(m_write_lock);
+        write_push(msg);
+        needs_writing = !m_write_flag && !send_queue_empty();
     }
 
-    // Messages flagged terminal will result in the TCP connection being dropped
-    // after the message has been written. This is typically used when servers
-    // send an ack and when any endpoint encounters a protocol error
-    if (terminal) {
-        msg->set_terminal(true);
+    if (needs_writing) {
+        schedule_write_frame();
     }
+}
 
-    m_state = session::state::closing;
+template <typename config>
+typename config::message_type::ptr connection<config>::write_dequeue(
+    bool control_only)
+{
+    message_ptr msg;
 
-    // Cancel any outstanding ping timers. Once we are in state closing the
-    // library no longer processes non-close frames, so any pongs will be
-    // dropped.
-    if (m_ping_timer) {
-        m_ping_timer->cancel();
+    if (config_traits<config>::lock_free_send_queue) {
+        if (m_send_mpsc.pop(msg)) {
+            m_send_buffer_size -= msg->get_payload_size();
+        }
+        return msg;
     }
 
-    if (ack) {
-        m_was_clean = true;
+    size_t lane = next_send_lane(control_only);
+    if (lane > close_lane) {
+        return msg;
     }
 
-    // Start a timer so we don't wait forever for the acknowledgement close
-    // frame
-    if (m_close_handshake_timeout_dur > 0) {
-        m_handshake_timer = transport_con_type::set_timer(
-            m_close_handshake_timeout_dur,
-            lib::bind(
-                &type::handle_close_handshake_timeout,
-                type::get_shared(),
-                lib::placeholders::_1
-            )
-        );
+    msg = std::move(m_send_queue[lane].front());
+
+    m_send_buffer_size -= msg->get_payload_size();
+    m_send_queue[lane].pop_front();
+    if (msg == m_auto_pong) {
+        m_auto_pong_queued = false;
     }
 
-    bool needs_writing = false;
-    {
-        scoped_lock_type lock(m_write_lock);
-        write_push(msg);
-        needs_writing = !m_write_flag && !m_send_queue.empty();
+    WEBSOCKETPP_LOG(*m_alog, log::alevel::devel,
+        "write_pop: lane: " << lane
+        << " message count: " << m_send_queue[lane].size()
+        << " buffer size: " << m_send_buffer_size);
+    return msg;
+}
+
+template <typename config>
+bool connection<config>::send_queue_empty() const {
+    for (size_t i = 0; i <= close_lane; ++i) {
+        if (!m_send_queue[i].empty()) {
+            return false;
+        }
     }
+    return true;
+}
 
-    if (needs_writing) {
-        transport_con_type::dispatch(lib::bind(
-            &type::write_frame,
-            type::get_shared()
-        ));
+template <typename config>
+size_t connection<config>::send_lane(message_ptr const & msg) const {
+    frame::opcode::value op = msg->get_opcode();
+
+    if (op == frame::opcode::CLOSE) {
+        return close_lane;
+    }
+    if (frame::opcode::is_control(op)) {
+        return priority::control;
     }
 
-    return lib::error_code();
+    // Frames of a message_stream stay in order with each other, and frames
+    // sharing the deflate context with the order they were compressed in.
+    if (is_stream_part(msg) || deflated(msg)) {
+        return priority::normal;
+    }
+
+    // data frames must not go out between the fragments of another message
+    priority::value p = msg->get_priority();
+    return p == priority::control ? size_t(priority::high) : size_t(p);
 }
 
 template <typename config>
-typename connection<config>::processor_ptr
-connection<config>::get_processor(int version) const {
-    // TODO: allow disabling certain versions
-    
-    processor_ptr p;
-    
-    switch (version) {
-        case 0:
-            p = lib::make_shared<processor::hybi00<config> >(
-                transport_con_type::is_secure(),
-                m_is_server,
-                m_msg_manager
-            );
-            break;
-        case 7:
-            p = lib::make_shared<processor::hybi07<config> >(
-                transport_con_type::is_secure(),
-                m_is_server,
-                m_msg_manager,
-                lib::ref(m_rng)
-            );
-            break;
-        case 8:
-            p = lib::make_shared<processor::hybi08<config> >(
-                transport_con_type::is_secure(),
-                m_is_server,
-                m_msg_manager,
-                lib::ref(m_rng)
-            );
-            break;
-        case 13:
-            p = lib::make_shared<processor::hybi13<config> >(
-                transport_con_type::is_secure(),
-                m_is_server,
-                m_msg_manager,
-                lib::ref(m_rng)
-            );
+size_t connection<config>::next_send_lane(bool control_only) {
+    if (!m_send_queue[priority::control].empty()) {
+        return priority::control;
+    }
+    if (control_only) {
+        return close_lane + 1;
+    }
+
+    // Weighted round robin: a lane is served while it has credit left, a new
+    // round starts once no lane with messages has any.
+    for (int round = 0; round < 2; ++round) {
+        bool queued = false;
+        for (size_t i = priority::high; i <= priority::bulk; ++i) {
+            if (m_send_queue[i].empty()) {
+                continue;
+            }
+            queued = true;
+            if (m_lane_credits[i] > 0) {
+                --m_lane_credits[i];
+                return i;
+            }
+        }
+        if (!queued) {
             break;
-        default:
-            return p;
+        }
+        for (size_t i = priority::high; i <= priority::bulk; ++i) {
+            m_lane_credits[i] = m_lane_weights[i];
+        }
     }
-    
-    // Settings not configured by the constructor
-    p->set_max_message_size(m_max_message_size);
-    
-    return p;
+
+    if (!m_send_queue[close_lane].empty()) {
+        return close_lane;
+    }
+    return close_lane + 1;
 }
 
 template <typename config>
-void connection<config>::write_push(typename config::message_type::ptr msg)
+typename config::message_type::ptr connection<config>::write_pop()
 {
-    if (!msg) {
-        return;
-    }
+    for (;;) {
+        if (m_fragment_source) {
+            // Ping and pong frames queued meanwhile go out between fragments.
+            // Everything else waits for the fragmented message to finish, in
+            // its lane or, in lock free mode, in m_fragment_deferred.
+            message_ptr queued = write_dequeue(true);
+            while (queued) {
+                frame::opcode::value op = queued->get_opcode();
+                if (queued->get_prepared() && (op == frame::opcode::PING ||
+                    op == frame::opcode::PONG))
+                {
+                    if (config_traits<config>::lock_free_send_queue) {
+                        ++m_send_popped;
+                    }
+                    return queued;
+                }
+                m_fragment_deferred.push_back(queued);
+                queued = write_dequeue(true);
+            }
+            return write_pop_fragment();
+        }
 
-    m_send_buffer_size += msg->get_payload().size();
-    m_send_queue.push(msg);
+        message_ptr msg;
+        if (!m_stream_writing && !m_stream_held.empty()) {
+            msg = m_stream_held.front();
+            m_stream_held.pop_front();
+        } else if (!m_fragment_deferred.empty()) {
+            msg = m_fragment_deferred.front();
+            m_fragment_deferred.pop_front();
+        } else {
+            msg = write_dequeue();
+        }
 
-    if (m_alog->static_test(log::alevel::devel)) {
-        std::stringstream s;
-        s << "write_push: message count: " << m_send_queue.size()
-          << " buffer size: " << m_send_buffer_size;
-        m_alog->write(log::alevel::devel,s.str());
+        if (!msg) {
+            return msg;
+        }
+
+        frame::opcode::value op = msg->get_opcode();
+
+        if (m_stream_writing) {
+            if (op == frame::opcode::CLOSE) {
+                // the stream was abandoned, nothing else may follow a close
+                m_stream_writing = false;
+                m_stream_held.clear();
+            } else if (!frame::opcode::is_control(op) && !is_stream_part(msg))
+            {
+                // data messages sent while a stream is open wait for its last
+                // frame, unprepared so none are compressed out of order
+                if (config_traits<config>::lock_free_send_queue) {
+                    ++m_send_popped;
+                }
+                m_stream_held.push_back(msg);
+                continue;
+            }
+        }
+
+        if (is_stream_part(msg)) {
+            m_stream_writing = !msg->get_fin();
+
+            // held messages are owed a write again
+            if (config_traits<config>::lock_free_send_queue &&
+                !m_stream_writing)
+            {
+                m_send_pending += m_stream_held.size();
+            }
+        }
+
+        if (config_traits<config>::lock_free_send_queue) {
+            // In lock free mode unprepared messages are queued as is and
+            // prepared here.
+            ++m_send_popped;
+
+            if (!use_prepared(msg)) {
+                message_ptr raw = msg;
+
+                msg = m_msg_manager->get_message();
+                if (!msg) {
+                    log_err(log::elevel::rerror,"write_pop",
+                        error::make_error_code(error::no_outgoing_buffers));
+                    continue;
+                }
+
+                lib::error_code ec = prepare_data_message(raw,msg);
+                if (ec) {
+                    log_err(log::elevel::rerror,"write_pop",ec);
+                    continue;
+                }
+            }
+        }
+
+        if (msg->get_prepared()) {
+            return msg;
+        }
+
+        // A prepared data message that is not framed yet is a fragment
+        // source from prepare_data_message. In lock free mode it stays
+        // pending, keeping ownership of the queue, until its last fragment.
+        if (config_traits<config>::lock_free_send_queue) {
+            --m_send_popped;
+        }
+        m_fragment_source = msg;
+        m_fragment_offset = 0;
     }
 }
 
 template <typename config>
-typename config::message_type::ptr connection<config>::write_pop()
+typename config::message_type::ptr connection<config>::write_pop_fragment()
 {
-    message_ptr msg;
-
-    if (m_send_queue.empty()) {
+    message_ptr msg = m_msg_manager->get_message();
+    if (!msg) {
+        // try again with the next write
+        log_err(log::elevel::rerror,"write_pop",
+            error::make_error_code(error::no_outgoing_buffers));
         return msg;
     }
 
-    msg = m_send_queue.front();
+    message_ptr source = m_fragment_source;
+    size_t size = source->get_payload_size();
+    size_t step = m_fragment_size > 0 ? m_fragment_size : size;
+    size_t begin = m_fragment_offset;
+    size_t end = (size - begin > step) ? begin + step : size;
 
-    m_send_buffer_size -= msg->get_payload().size();
-    m_send_queue.pop();
+    m_fragment_offset = end;
+    if (end == size) {
+        m_fragment_source.reset();
+        if (config_traits<config>::lock_free_send_queue) {
+            ++m_send_popped;
+        }
+    }
 
-    if (m_alog->static_test(log::alevel::devel)) {
-        std::stringstream s;
-        s << "write_pop: message count: " << m_send_queue.size()
-          << " buffer size: " << m_send_buffer_size;
-        m_alog->write(log::alevel::devel,s.str());
+    lib::error_code ec;
+    {
+        account_timer timer(*this, m_prepare_time);
+        ec = m_processor->prepare_fragment(source,begin,end,msg);
+    }
+    if (ec) {
+        log_err(log::elevel::rerror,"write_pop",ec);
+        msg.reset();
+    } else if (end == size) {
+        // the message is written with its last fragment
+        msg->set_completion_id(source->get_completion_id());
+        if (source->has_send_handler()) {
+            msg->set_send_handler(source->take_send_handler());
+        }
     }
     return msg;
 }
@@ -2631,6 +6522,18 @@ typename config::message_type::ptr connection<config>::write_pop()
 template <typename config>
 void connection<config>::log_open_result()
 {
+    m_open_time = lib::chrono::steady_clock::now();
+    emit_event(log::event_type::open);
+    if (m_metrics) {
+        m_metrics_open = true;
+        m_metrics->record_open(lib::chrono::duration_cast<
+            latency_histogram::duration>(m_open_time - m_start_time));
+    }
+
+    if (!log::enabled(*m_alog, log::alevel::connect)) {
+        return;
+    }
+
     std::stringstream s;
 
     int version;
@@ -2672,6 +6575,16 @@ void connection<config>::log_open_result()
 template <typename config>
 void connection<config>::log_close_result()
 {
+    emit_event(log::event_type::close);
+    if (m_metrics && m_metrics_open) {
+        m_metrics_open = false;
+        m_metrics->record_close();
+    }
+
+    if (!log::enabled(*m_alog, log::alevel::disconnect)) {
+        return;
+    }
+
     std::stringstream s;
 
     s << "Disconnect "
@@ -2686,6 +6599,15 @@ void connection<config>::log_close_result()
 template <typename config>
 void connection<config>::log_fail_result()
 {
+    emit_event(log::event_type::fail);
+    if (m_metrics) {
+        m_metrics->record_fail();
+    }
+
+    if (!log::enabled(*m_alog, log::alevel::fail)) {
+        return;
+    }
+
     std::stringstream s;
     
     int version = processor::get_websocket_version(m_request);
@@ -2731,6 +6653,12 @@ void connection<config>::log_http_result() {
         return;
     }  
 
+    emit_event(log::event_type::http);
+
+    if (!log::enabled(*m_alog, log::alevel::http)) {
+        return;
+    }
+
     // Connection Type
     s << (m_request.get_header("host").empty() ? "-" : m_request.get_header("host"))
       << " " << transport_con_type::get_remote_endpoint()
@@ -2751,6 +6679,127 @@ void connection<config>::log_http_result() {
     m_alog->write(log::alevel::http,s.str());
 }
 
+template <typename config>
+void connection<config>::check_handler_time(handler_type::value t,
+    lib::chrono::steady_clock::time_point start)
+{
+    uint64_t ns = elapsed_ns(start);
+    if (m_accounting) {
+        m_handler_time.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    lib::chrono::microseconds elapsed(ns / 1000);
+    if (m_slow_handler_threshold <= 0 ||
+        elapsed.count() <= m_slow_handler_threshold)
+    {
+        return;
+    }
+
+    if (m_metrics) {
+        m_metrics->record_slow_handler(t, elapsed);
+    }
+
+    if (m_elog->static_test(log::elevel::warn) &&
+        m_elog->dynamic_test(log::elevel::warn))
+    {
+        std::stringstream s;
+        s << "Slow " << handler_type::name(t) << " handler: "
+          << elapsed.count() << "us, remote endpoint "
+          << transport_con_type::get_remote_endpoint();
+        m_elog->write(log::elevel::warn, s.str());
+    }
+}
+
+template <typename config>
+void connection<config>::emit_event(log::event_type::value type) {
+    if (!m_event_handler) {
+        return;
+    }
+
+    typedef lib::chrono::steady_clock steady_clock;
+    typedef lib::chrono::microseconds microseconds;
+    steady_clock::time_point now = steady_clock::now();
+
+    log::connection_event e;
+    std::memset(&e, 0, sizeof(e));
+    e.size = sizeof(e);
+    e.type = static_cast<uint16_t>(type);
+
+    if (processor::is_websocket_handshake(m_request)) {
+        e.version = static_cast<int16_t>(
+            processor::get_websocket_version(m_request));
+    } else {
+        e.version = -1;
+    }
+
+    e.time = static_cast<uint64_t>(lib::chrono::duration_cast<microseconds>(
+        lib::chrono::system_clock::now().time_since_epoch()).count());
+    if (m_open_time != steady_clock::time_point()) {
+        e.handshake_time = static_cast<uint64_t>(
+            lib::chrono::duration_cast<microseconds>(
+                m_open_time - m_start_time).count());
+    }
+    e.duration = static_cast<uint64_t>(
+        lib::chrono::duration_cast<microseconds>(now - m_start_time).count());
+    e.bytes_in = m_bytes_in.load(std::memory_order_relaxed);
+    e.bytes_out = m_bytes_out.load(std::memory_order_relaxed);
+
+    e.status = static_cast<uint16_t>(m_response.get_status_code());
+    if (type == log::event_type::close) {
+        e.local_close_code = m_local_close_code;
+        e.remote_close_code = m_remote_close_code;
+    }
+    e.error = m_ec.value();
+
+    log::connection_event::assign(e.remote_endpoint,
+        transport_con_type::get_remote_endpoint());
+    log::connection_event::assign(e.user_agent,
+        m_request.get_header("User-Agent"));
+    if (m_uri) {
+        log::connection_event::assign(e.resource, m_uri->get_resource());
+    }
+
+    m_event_handler(e);
+}
+
+template <typename config>
+void connection<config>::record_send_latency() {
+    typedef lib::chrono::steady_clock steady_clock;
+    typedef latency_histogram::duration duration;
+
+    steady_clock::time_point now = steady_clock::now();
+    duration written = lib::chrono::duration_cast<duration>(now -
+        m_write_start);
+    int64_t start = lib::chrono::duration_cast<lib::chrono::nanoseconds>(
+        m_write_start.time_since_epoch()).count();
+
+    typename std::vector<message_ptr>::iterator it;
+    for (it = m_current_msgs.begin(); it != m_current_msgs.end(); ++it) {
+        int64_t queued_at = (*it)->get_enqueue_time();
+        if (queued_at == 0 || (*it)->get_broadcast()) {
+            continue;
+        }
+
+        duration queued = lib::chrono::duration_cast<duration>(
+            lib::chrono::nanoseconds(start - queued_at));
+        m_send_latency->queued.record(queued);
+        m_send_latency->written.record(written);
+
+        if (m_send_latency_handler) {
+            m_send_latency_handler(m_connection_hdl, *it, queued, written);
+        }
+    }
+}
+
+template <typename config>
+void connection<config>::publish_send_buffer(bool closed) {
+    size_t now = closed ? 0 : get_buffered_amount();
+    size_t prev = m_published_buffer.exchange(now, std::memory_order_relaxed);
+    if (now != prev) {
+        m_metrics->add_send_buffer_bytes(int64_t(now) - int64_t(prev));
+    }
+}
+
 } // namespace websocketpp
 
 #endif // WEBSOCKETPP_CONNECTION_IMPL_HPP
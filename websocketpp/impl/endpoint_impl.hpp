@@ -28,10 +28,115 @@
 #ifndef WEBSOCKETPP_ENDPOINT_IMPL_HPP
 #define WEBSOCKETPP_ENDPOINT_IMPL_HPP
 
+#include <algorithm>
+#include <limits>
+#include <random>
 #include <string>
 
 namespace websocketpp {
 
+template <typename connection, typename config>
+void endpoint<connection,config>::update_deflate_budget() {
+    typedef extensions::permessage_deflate::memory_budget budget_type;
+
+    size_t const limit = m_deflate_limit != 0 ? m_deflate_limit :
+        (std::numeric_limits<size_t>::max)();
+
+    if (m_governor) {
+        m_deflate_budget = lib::make_shared<budget_type>(limit,
+            m_governor->get_total());
+    } else if (m_deflate_limit != 0) {
+        m_deflate_budget = lib::make_shared<budget_type>(limit);
+    } else {
+        m_deflate_budget.reset();
+    }
+}
+
+template <typename connection, typename config>
+void endpoint<connection,config>::apply_request_defaults(connection_ptr con) {
+    // Copy default handlers from the endpoint
+    con->set_open_handler(m_open_handler);
+    con->set_close_handler(m_close_handler);
+    con->set_fail_handler(m_fail_handler);
+    con->set_ping_handler(m_ping_handler);
+    con->set_pong_handler(m_pong_handler);
+    con->set_pong_timeout_handler(m_pong_timeout_handler);
+    con->set_interrupt_handler(m_interrupt_handler);
+    con->set_http_handler(m_http_handler);
+    con->set_validate_handler(m_validate_handler);
+    con->set_early_data_handler(m_early_data_handler);
+    con->set_async_validate_handler(m_async_validate_handler);
+    con->set_message_handler(m_message_handler);
+    con->set_message_view_handler(m_message_view_handler);
+    con->set_message_chunk_handler(m_message_chunk_handler);
+    con->set_message_batch_handler(m_message_batch_handler);
+    con->set_high_watermark_handler(m_high_watermark_handler);
+    con->set_drain_handler(m_drain_handler);
+    con->set_event_handler(m_event_handler);
+
+    con->set_max_redirects(m_max_redirects);
+}
+
+template <typename connection, typename config>
+void endpoint<connection,config>::reserve(size_t expected_connections,
+    size_t expected_msg_rate, size_t expected_msg_size)
+{
+    m_alog->write(log::alevel::devel,"reserve");
+
+    // Connections released here leave their memory in the resource or slab
+    // cache they came from. The default allocation has nowhere to keep it.
+    size_t connections = 0;
+    if (m_memory_resource) {
+        connections = expected_connections;
+    } else if (m_slab_allocation) {
+        size_t const max = slab_cache<sizeof(connection_type),
+            alignof(connection_type)>::max_free;
+        connections = (expected_connections < max ? expected_connections :
+            max);
+    }
+    std::vector<connection_ptr> warm;
+    warm.reserve(connections);
+    for (size_t i = 0; i < connections; ++i) {
+        warm.push_back(allocate_connection());
+    }
+    warm.clear();
+
+    if (m_read_on_readiness) {
+        connection_type::reserve_read_buffers(expected_connections);
+    }
+
+    // messages live from send until written, allow for 10ms worth
+    if constexpr (requires { m_msg_manager->reserve(size_t(), size_t()); }) {
+        m_msg_manager->reserve((expected_msg_rate + 99) / 100,
+            expected_msg_size);
+    }
+
+    if (m_timer_wheel) {
+        m_timer_wheel->reserve(expected_connections);
+    }
+    if (m_registry) {
+        m_registry->reserve(expected_connections);
+    }
+}
+
+template <typename connection, typename config>
+typename endpoint<connection,config>::connection_ptr
+endpoint<connection,config>::allocate_connection() {
+    if (m_memory_resource) {
+        return lib::allocate_shared<connection_type>(
+            std::pmr::polymorphic_allocator<connection_type>(
+                m_memory_resource), m_is_server, m_user_agent, m_alog, m_elog,
+            lib::ref(m_rng));
+    } else if (m_slab_allocation) {
+        return lib::allocate_shared<connection_type>(
+            slab_allocator<connection_type>(), m_is_server, m_user_agent,
+            m_alog, m_elog, lib::ref(m_rng));
+    } else {
+        return lib::make_shared<connection_type>(m_is_server, m_user_agent,
+            m_alog, m_elog, lib::ref(m_rng));
+    }
+}
+
 template <typename connection, typename config>
 typename endpoint<connection,config>::connection_ptr
 endpoint<connection,config>::create_connection(lib::error_code & ec) {
@@ -44,8 +149,7 @@ endpoint<connection,config>::create_connection(lib::error_code & ec) {
 
     //scoped_lock_type guard(m_mutex);
     // Create a connection on the heap and manage it using a shared pointer
-    connection_ptr con = lib::make_shared<connection_type>(m_is_server,
-        m_user_agent, m_alog, m_elog, lib::ref(m_rng));
+    connection_ptr con = allocate_connection();
 
     connection_weak_ptr w(con);
 
@@ -55,19 +159,67 @@ endpoint<connection,config>::create_connection(lib::error_code & ec) {
 
     con->set_handle(w);
 
-    // Copy default handlers from the endpoint
-    con->set_open_handler(m_open_handler);
-    con->set_close_handler(m_close_handler);
-    con->set_fail_handler(m_fail_handler);
-    con->set_ping_handler(m_ping_handler);
-    con->set_pong_handler(m_pong_handler);
-    con->set_pong_timeout_handler(m_pong_timeout_handler);
-    con->set_interrupt_handler(m_interrupt_handler);
-    con->set_http_handler(m_http_handler);
-    con->set_validate_handler(m_validate_handler);
-    con->set_message_handler(m_message_handler);
+    this->apply_request_defaults(con);
 
-    con->set_max_redirects(m_max_redirects);
+    con->set_slab_allocation(m_slab_allocation);
+    if (m_memory_resource) {
+        con->set_memory_resource(m_memory_resource);
+    }
+    con->set_read_on_readiness(m_read_on_readiness);
+    con->set_read_budget(m_read_budget);
+    con->set_deflate_mem_level(m_deflate_mem_level);
+    con->set_deflate_idle_timeout(m_deflate_idle_timeout);
+    con->set_deflate_memory_budget(m_deflate_budget);
+    con->set_inbound_memory_budget(m_inbound_budget);
+    if (m_governor) {
+        con->set_memory_governor(m_governor);
+    }
+    con->set_timer_wheel(m_timer_wheel);
+    if (m_use_compression_policy) {
+        con->set_compression_policy(m_compression_policy);
+    }
+    if (m_compression_stats) {
+        con->set_compression_stats(m_compression_stats);
+    }
+    con->set_metrics(m_metrics);
+    con->set_slow_handler_threshold(m_slow_handler_threshold);
+    con->set_accounting(m_accounting);
+    if (m_capture) {
+        con->set_capture(m_capture);
+    }
+    if (m_registry) {
+        con->set_connection_registry(m_registry);
+    }
+    con->set_send_latency_tracking(m_send_latency_tracking);
+    if (m_send_latency_handler) {
+        con->set_send_latency_handler(m_send_latency_handler);
+    }
+    if (m_fragment_size) {
+        con->set_fragment_size(m_fragment_size);
+    }
+    con->set_send_watermarks(m_high_watermark, m_low_watermark);
+    if (m_coalesce_max_delay > 0) {
+        con->set_send_coalescing(m_coalesce_max_delay, m_coalesce_max_bytes);
+    }
+    con->set_inbound_flow_control(m_flow_max_messages, m_flow_max_bytes);
+    if (m_rate_max_messages || m_rate_max_bytes) {
+        con->set_inbound_rate_limit(m_rate_max_messages, m_rate_max_bytes,
+            m_rate_action);
+    }
+    con->set_slow_consumer_policy(m_slow_consumer_policy,
+        m_slow_consumer_limit, m_slow_consumer_grace);
+    if (m_compression_pool) {
+        con->set_compression_offload(m_compression_pool, m_offload_threshold,
+            m_offload_part_size);
+    }
+    if (m_dispatch_pool) {
+        con->set_message_dispatch(m_dispatch_pool, m_dispatch_max);
+    }
+    if (m_deflate_dictionary) {
+        con->set_deflate_dictionary(m_deflate_dictionary_id,
+            m_deflate_dictionary);
+    }
+    con->set_zstd_params(m_zstd_level, m_zstd_dictionaries);
 
     if (m_open_handshake_timeout_dur != config::timeout_open_handshake) {
         con->set_open_handshake_timeout(m_open_handshake_timeout_dur);
@@ -78,12 +230,35 @@ endpoint<connection,config>::create_connection(lib::error_code & ec) {
 	if (m_http_read_timeout_dur != config::timeout_read_http_response) {
         con->set_http_response_timeout(m_http_read_timeout_dur);
     }
+    if (m_max_http_requests != 1) {
+        con->set_max_http_requests(m_max_http_requests);
+    }
+    if (m_response_cache) {
+        con->set_response_cache(m_response_cache);
+    }
+    if (m_validation_cache) {
+        con->set_validation_cache(m_validation_cache);
+    }
+    if (m_validate_timeout_dur > 0) {
+        con->set_validate_timeout(m_validate_timeout_dur);
+    }
     if (m_pong_timeout_dur != config::timeout_pong) {
         con->set_pong_timeout(m_pong_timeout_dur);
     }
+    con->set_keepalive(m_keepalive_interval,m_keepalive_jitter);
+    con->set_hibernate_timeout(m_hibernate_timeout);
+    con->set_control_frames(m_control_frames);
+    con->set_handshake_template(m_handshake_template);
+    if (!m_is_server) {
+        con->set_request_templates(m_request_templates);
+    }
     if (m_max_message_size != config::max_message_size) {
         con->set_max_message_size(m_max_message_size);
     }
+    if (m_spill_threshold) {
+        con->set_message_spill(m_spill_threshold, m_spill_max_size,
+            m_spill_dir);
+    }
     con->set_max_http_body_size(m_max_http_body_size);
 
     ec = transport_type::init(con);
@@ -124,6 +299,16 @@ void endpoint<connection,config>::resume_reading(connection_hdl_ref hdl, lib::er
     ec = con->resume_reading();
 }
 
+template <typename connection, typename config>
+memory_usage endpoint<connection,config>::get_memory_usage(
+    connection_hdl_ref hdl, lib::error_code & ec)
+{
+    connection_ptr con = get_con_from_hdl(hdl,ec);
+    if (ec) {return memory_usage();}
+
+    return con->get_memory_usage();
+}
+
 template <typename connection, typename config>
 void endpoint<connection,config>::send_http_response(connection_hdl_ref hdl,
     lib::error_code & ec)
@@ -161,6 +346,481 @@ void endpoint<connection,config>::send(connection_hdl_ref hdl, message_ptr msg,
     ec = con->send(msg);
 }
 
+template <typename connection, typename config>
+typename endpoint<connection,config>::message_ptr
+endpoint<connection,config>::prepare_broadcast(std::string const & payload,
+    frame::opcode::value op, lib::error_code & ec)
+{
+    return make_broadcast(lib::shared_ptr<void const>(), payload.data(),
+        payload.size(), op, ec);
+}
+
+template <typename connection, typename config>
+typename endpoint<connection,config>::message_ptr
+endpoint<connection,config>::prepare_broadcast(
+    lib::shared_ptr<void const> owner, void const * payload, size_t len,
+    frame::opcode::value op, lib::error_code & ec)
+{
+    if (!owner) {
+        ec = processor::error::make_error_code(
+            processor::error::invalid_arguments);
+        return message_ptr();
+    }
+    return make_broadcast(owner, static_cast<char const *>(payload), len, op,
+        ec);
+}
+
+template <typename connection, typename config>
+typename endpoint<connection,config>::message_ptr
+endpoint<connection,config>::make_broadcast(lib::shared_ptr<void const> owner,
+    char const * payload, size_t len, frame::opcode::value op,
+    lib::error_code & ec)
+{
+    if (!m_is_server) {
+        ec = error::make_error_code(error::server_only);
+        return message_ptr();
+    }
+
+    if (frame::opcode::is_control(op)) {
+        ec = processor::error::make_error_code(processor::error::invalid_opcode);
+        return message_ptr();
+    }
+
+    if (op == frame::opcode::text && !utf8_validator::validate(payload,len)) {
+        ec = processor::error::make_error_code(processor::error::invalid_payload);
+        return message_ptr();
+    }
+
+    message_ptr msg = m_msg_manager->get_message(op,owner ? 0 : len);
+    if (!msg) {
+        ec = error::make_error_code(error::no_outgoing_buffers);
+        return msg;
+    }
+
+    if (owner) {
+        msg->set_payload_ref(owner,payload,len);
+    } else {
+        msg->set_payload(payload,len);
+    }
+
+    // server frames are never masked
+    frame::header_buffer header;
+    header.encode<false>(op, len, true);
+    msg->set_header(header);
+
+    msg->set_broadcast(true);
+    msg->set_prepared(true);
+
+    // connections that negotiated compression without context takeover share
+    // one compressed copy per window size, see select_broadcast_frame
+    msg->set_compressed(true);
+    msg->enable_variants();
+
+    ec = lib::error_code();
+    return msg;
+}
+
+template <typename connection, typename config>
+typename endpoint<connection,config>::message_ptr
+endpoint<connection,config>::make_recipient(con_msg_manager_ptr manager,
+    message_ptr tmpl, std::string const & prefix, lib::error_code & ec)
+{
+    if (!tmpl || !tmpl->get_broadcast() || !tmpl->get_prefix().empty()) {
+        ec = processor::error::make_error_code(
+            processor::error::invalid_arguments);
+        return message_ptr();
+    }
+
+    frame::opcode::value op = tmpl->get_opcode();
+    if (op == frame::opcode::text &&
+        !utf8_validator::validate(prefix.data(),prefix.size()))
+    {
+        ec = processor::error::make_error_code(processor::error::invalid_payload);
+        return message_ptr();
+    }
+
+    message_ptr msg = manager->get_message(op,0);
+    if (!msg) {
+        ec = error::make_error_code(error::no_outgoing_buffers);
+        return msg;
+    }
+
+    msg->set_payload_source(tmpl);
+    msg->set_prefix(prefix);
+
+    frame::header_buffer header;
+    header.encode<false>(op, prefix.size() + tmpl->get_payload_size(), true);
+    msg->set_header(header);
+
+    msg->set_priority(tmpl->get_priority());
+    msg->set_broadcast(true);
+    msg->set_prepared(true);
+
+    ec = lib::error_code();
+    return msg;
+}
+
+template <typename connection, typename config>
+size_t endpoint<connection,config>::broadcast(message_ptr msg,
+    broadcast_filter filter, lib::error_code & ec)
+{
+    return broadcast(msg, broadcast_prefix(), filter, ec);
+}
+
+template <typename connection, typename config>
+size_t endpoint<connection,config>::broadcast(message_ptr msg,
+    broadcast_prefix prefix, broadcast_filter filter, lib::error_code & ec)
+{
+    if (!m_registry) {
+        ec = error::make_error_code(error::invalid_state);
+        return 0;
+    }
+
+    if (m_pacing_window > 0 || m_pacing_rate > 0) {
+        lib::shared_ptr<paced_broadcast_state> state =
+            lib::make_shared<paced_broadcast_state>();
+        state->msg = msg;
+        state->prefix = prefix;
+        state->manager = m_msg_manager;
+        state->next = 0;
+        m_registry->for_each([&](connection_ptr const & con) {
+            if (!filter || filter(con)) {
+                state->connections.push_back(con);
+            }
+        });
+
+        size_t const n = state->connections.size();
+        size_t slice = 0;
+        if (m_pacing_window > 0) {
+            size_t ticks = std::max<size_t>(1,
+                size_t(m_pacing_window / broadcast_pacing_tick));
+            slice = (n + ticks - 1) / ticks;
+        }
+        if (m_pacing_rate > 0) {
+            uint64_t bytes = m_pacing_rate * broadcast_pacing_tick / 1000;
+            uint64_t size = std::max<uint64_t>(1, msg->get_payload_size());
+            slice = std::max<size_t>(slice, size_t(bytes / size));
+        }
+        state->slice = std::max<size_t>(1, slice);
+
+        send_paced_slice(state);
+        ec = lib::error_code();
+        return n;
+    }
+
+    size_t sent = 0;
+    m_registry->for_each([&](connection_ptr const & con) {
+        if (filter && !filter(con)) {
+            return;
+        }
+        message_ptr m = msg;
+        if (prefix) {
+            lib::error_code pec;
+            m = make_recipient(m_msg_manager, msg, prefix(con), pec);
+            if (pec) {
+                return;
+            }
+        }
+        if (!con->send(m)) {
+            ++sent;
+        }
+    });
+
+    ec = lib::error_code();
+    return sent;
+}
+
+template <typename connection, typename config>
+void endpoint<connection,config>::send_paced(paced_broadcast_state & state,
+    connection_ptr const & con)
+{
+    if (!state.prefix) {
+        con->send(state.msg);
+        return;
+    }
+
+    lib::error_code ec;
+    message_ptr m = make_recipient(state.manager, state.msg,
+        state.prefix(con), ec);
+    if (!ec) {
+        con->send(m);
+    }
+}
+
+template <typename connection, typename config>
+void endpoint<connection,config>::send_paced_slice(
+    lib::shared_ptr<paced_broadcast_state> state)
+{
+    std::vector<connection_weak_ptr> & cons = state->connections;
+
+    size_t end = std::min(cons.size(), state->next + state->slice);
+    for (; state->next < end; ++state->next) {
+        connection_ptr con = cons[state->next].lock();
+        if (con) {
+            send_paced(*state, con);
+        }
+        cons[state->next].reset();
+    }
+
+    // the timer runs on a connection still waiting for its turn
+    while (state->next < cons.size()) {
+        connection_ptr con = cons[state->next].lock();
+        if (!con) {
+            ++state->next;
+            continue;
+        }
+        if (con->set_timer(broadcast_pacing_tick, lib::bind(
+            &type::handle_paced_broadcast, state, lib::placeholders::_1)))
+        {
+            return;
+        }
+
+        // no timers in this transport, send the rest at once
+        for (; state->next < cons.size(); ++state->next) {
+            con = cons[state->next].lock();
+            if (con) {
+                send_paced(*state, con);
+            }
+        }
+    }
+}
+
+template <typename connection, typename config>
+void endpoint<connection,config>::handle_paced_broadcast(
+    lib::shared_ptr<paced_broadcast_state> state, lib::error_code const & ec)
+{
+    if (ec == transport::error::operation_aborted) {
+        // the transport is shutting down
+        return;
+    }
+    send_paced_slice(state);
+}
+
+template <typename connection, typename config>
+std::vector<std::pair<uint64_t, typename endpoint<connection,config>::
+    connection_ptr> >
+endpoint<connection,config>::get_top_connections(usage::value metric,
+    size_t n) const
+{
+    typedef std::pair<uint64_t, connection_ptr> entry;
+    struct larger {
+        bool operator()(entry const & a, entry const & b) const {
+            return a.first > b.first;
+        }
+    };
+
+    // a min heap of the n largest seen so far
+    std::vector<entry> top;
+    if (!m_registry || n == 0) {
+        return top;
+    }
+    top.reserve(n);
+
+    m_registry->for_each([&](connection_ptr const & con) {
+        uint64_t value = con->get_usage(metric);
+        if (top.size() < n) {
+            top.push_back(entry(value, con));
+            std::push_heap(top.begin(), top.end(), larger());
+        } else if (value > top.front().first) {
+            std::pop_heap(top.begin(), top.end(), larger());
+            top.back() = entry(value, con);
+            std::push_heap(top.begin(), top.end(), larger());
+        }
+    });
+
+    std::sort_heap(top.begin(), top.end(), larger());
+    return top;
+}
+
+template <typename connection, typename config>
+size_t endpoint<connection,config>::close_all(close::status::value code,
+    std::string const & reason, long deadline, size_t batch,
+    lib::error_code & ec)
+{
+    if (!m_registry) {
+        ec = error::make_error_code(error::invalid_state);
+        return 0;
+    }
+
+    // what send_close_frame would put in the frame
+    std::string tr;
+    if (config::silent_close || code == close::status::blank) {
+        code = close::status::no_status;
+    } else {
+        tr.assign(reason,0,std::min<size_t>(reason.size(),
+            frame::limits::close_reason_size));
+    }
+    message_ptr frame = make_close_frame(code,tr);
+
+    lib::shared_ptr<close_all_state> state;
+    bool shared_timer = deadline > 0;
+    size_t closed = 0;
+
+    m_registry->for_each([&](connection_ptr const & con) {
+        if (shared_timer && !state) {
+            state = lib::make_shared<close_all_state>();
+            state->next = 0;
+            state->batch = batch;
+            if (!con->set_timer(deadline, lib::bind(
+                &type::handle_close_all_deadline, state,
+                lib::placeholders::_1)))
+            {
+                // no timers in this transport
+                state.reset();
+                shared_timer = false;
+            }
+        }
+
+        lib::error_code cec;
+        con->close_shared(code,tr,frame,!state,cec);
+        if (!cec) {
+            ++closed;
+            if (state) {
+                state->connections.push_back(con);
+            }
+        }
+    });
+
+    ec = lib::error_code();
+    return closed;
+}
+
+template <typename connection, typename config>
+size_t endpoint<connection,config>::drain(long window,
+    close::status::value code, std::string const & reason,
+    lib::error_code & ec)
+{
+    if (!m_registry) {
+        ec = error::make_error_code(error::invalid_state);
+        return 0;
+    }
+
+    lib::shared_ptr<drain_state> state = lib::make_shared<drain_state>();
+    if (config::silent_close || code == close::status::blank) {
+        state->code = close::status::no_status;
+    } else {
+        state->code = code;
+        state->reason.assign(reason,0,std::min<size_t>(reason.size(),
+            frame::limits::close_reason_size));
+    }
+    state->frame = make_close_frame(state->code,state->reason);
+
+    std::minstd_rand jitter(std::random_device{}());
+    std::uniform_int_distribution<long> delay(0, window > 0 ? window : 0);
+
+    size_t scheduled = 0;
+    m_registry->for_each([&](connection_ptr const & con) {
+        if (window > 0 && con->set_timer(delay(jitter), lib::bind(
+            &type::handle_drain_timer, connection_weak_ptr(con),
+            lib::shared_ptr<drain_state const>(state),
+            lib::placeholders::_1)))
+        {
+            ++scheduled;
+            return;
+        }
+
+        lib::error_code cec;
+        con->close_shared(state->code,state->reason,state->frame,true,cec);
+        if (!cec) {
+            ++scheduled;
+        }
+    });
+
+    ec = lib::error_code();
+    return scheduled;
+}
+
+template <typename connection, typename config>
+void endpoint<connection,config>::handle_drain_timer(connection_weak_ptr con,
+    lib::shared_ptr<drain_state const> state, lib::error_code const & ec)
+{
+    connection_ptr c = con.lock();
+    if (ec || !c) {
+        return;
+    }
+
+    // closed meanwhile is fine
+    lib::error_code cec;
+    c->close_shared(state->code,state->reason,state->frame,true,cec);
+}
+
+template <typename connection, typename config>
+typename endpoint<connection,config>::message_ptr
+endpoint<connection,config>::make_close_frame(close::status::value code,
+    std::string const & reason)
+{
+    // client frames are masked, each connection prepares its own
+    if (!m_is_server) {
+        return message_ptr();
+    }
+
+    bool const terminal = close::status::terminal(code);
+    if (reason.empty() && m_control_frames) {
+        message_ptr msg = m_control_frames->get_close(code,terminal);
+        if (msg) {
+            return msg;
+        }
+    }
+
+    std::string payload;
+    if (code != close::status::no_status) {
+        close::code_converter val;
+        val.i = htons(code);
+        payload.assign(val.c,2);
+        payload += reason;
+    }
+
+    message_ptr msg = m_msg_manager->get_message(frame::opcode::CLOSE,
+        payload.size());
+    if (!msg) {
+        return msg;
+    }
+    msg->set_payload(payload);
+
+    frame::header_buffer header;
+    header.encode<false>(frame::opcode::CLOSE,payload.size(),true);
+    msg->set_header(header);
+
+    msg->set_terminal(terminal);
+    msg->set_broadcast(true);
+    msg->set_prepared(true);
+    return msg;
+}
+
+template <typename connection, typename config>
+void endpoint<connection,config>::handle_close_all_deadline(
+    lib::shared_ptr<close_all_state> state, lib::error_code const & ec)
+{
+    if (ec) {
+        return;
+    }
+
+    size_t const count = state->connections.size();
+    size_t end = count;
+    if (state->batch > 0 && count - state->next > state->batch) {
+        end = state->next + state->batch;
+    }
+
+    for (; state->next < end; ++state->next) {
+        connection_ptr con = state->connections[state->next].lock();
+        state->connections[state->next].reset();
+        if (con) {
+            con->expire_close();
+        }
+    }
+
+    // the next batch, on a timer of a connection that is still there
+    while (state->next < count) {
+        connection_ptr con = state->connections[state->next].lock();
+        if (con) {
+            con->set_timer(1, lib::bind(&type::handle_close_all_deadline,
+                state, lib::placeholders::_1));
+            return;
+        }
+        ++state->next;
+    }
+}
+
 template <typename connection, typename config>
 void endpoint<connection,config>::close(connection_hdl_ref hdl, close::status::value
     const code, std::string const & reason,
@@ -213,6 +873,16 @@ void endpoint<connection,config>::resume_reading(connection_hdl_ref hdl) {
     if (ec) { throw exception(ec); }
 }
 
+template <typename connection, typename config>
+memory_usage endpoint<connection,config>::get_memory_usage(
+    connection_hdl_ref hdl)
+{
+    lib::error_code ec;
+    memory_usage usage = get_memory_usage(hdl,ec);
+    if (ec) { throw exception(ec); }
+    return usage;
+}
+
 template <typename connection, typename config>
 void endpoint<connection,config>::send_http_response(connection_hdl_ref hdl) {
     lib::error_code ec;
@@ -245,6 +915,80 @@ void endpoint<connection,config>::send(connection_hdl_ref hdl, message_ptr msg)
     if (ec) { throw exception(ec); }
 }
 
+template <typename connection, typename config>
+typename endpoint<connection,config>::message_ptr
+endpoint<connection,config>::prepare_broadcast(std::string const & payload,
+    frame::opcode::value op)
+{
+    lib::error_code ec;
+    message_ptr msg = prepare_broadcast(payload,op,ec);
+    if (ec) { throw exception(ec); }
+    return msg;
+}
+
+template <typename connection, typename config>
+typename endpoint<connection,config>::message_ptr
+endpoint<connection,config>::prepare_broadcast(
+    lib::shared_ptr<void const> owner, void const * payload, size_t len,
+    frame::opcode::value op)
+{
+    lib::error_code ec;
+    message_ptr msg = prepare_broadcast(owner,payload,len,op,ec);
+    if (ec) { throw exception(ec); }
+    return msg;
+}
+
+template <typename connection, typename config>
+size_t endpoint<connection,config>::broadcast(message_ptr msg,
+    broadcast_filter filter)
+{
+    lib::error_code ec;
+    size_t sent = broadcast(msg,filter,ec);
+    if (ec) { throw exception(ec); }
+    return sent;
+}
+
+template <typename connection, typename config>
+size_t endpoint<connection,config>::broadcast(message_ptr tmpl,
+    broadcast_prefix prefix, broadcast_filter filter)
+{
+    lib::error_code ec;
+    size_t sent = broadcast(tmpl,prefix,filter,ec);
+    if (ec) { throw exception(ec); }
+    return sent;
+}
+
+template <typename connection, typename config>
+typename endpoint<connection,config>::message_ptr
+endpoint<connection,config>::prepare_recipient(message_ptr tmpl,
+    std::string const & prefix)
+{
+    lib::error_code ec;
+    message_ptr msg = prepare_recipient(tmpl,prefix,ec);
+    if (ec) { throw exception(ec); }
+    return msg;
+}
+
+template <typename connection, typename config>
+size_t endpoint<connection,config>::close_all(close::status::value code,
+    std::string const & reason, long deadline, size_t batch)
+{
+    lib::error_code ec;
+    size_t closed = close_all(code,reason,deadline,batch,ec);
+    if (ec) { throw exception(ec); }
+    return closed;
+}
+
+template <typename connection, typename config>
+size_t endpoint<connection,config>::drain(long window,
+    close::status::value code, std::string const & reason)
+{
+    lib::error_code ec;
+    size_t scheduled = drain(window,code,reason,ec);
+    if (ec) { throw exception(ec); }
+    return scheduled;
+}
+
 template <typename connection, typename config>
 void endpoint<connection,config>::close(connection_hdl_ref hdl, close::status::value
     const code, std::string const & reason)
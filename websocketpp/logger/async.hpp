@@ -0,0 +1,472 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_LOGGER_ASYNC_HPP
+#define WEBSOCKETPP_LOGGER_ASYNC_HPP
+
+#include <websocketpp/logger/levels.hpp>
+
+#include <websocketpp/common/chrono.hpp>
+#include <websocketpp/common/cpp11.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/thread.hpp>
+#include <websocketpp/common/time.hpp>
+
+#include <atomic>
+#include <ctime>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace websocketpp {
+namespace log {
+
+/// What an async logger does when its queue is full
+namespace overflow {
+
+/// See async::set_overflow
+enum value {
+    /// Discard the line and count it, the count is logged later
+    drop = 0,
+    /// Wait for the writer thread to make room
+    block
+};
+
+} // namespace overflow
+
+/// Logger that hands lines to a background thread for writing to an ostream
+/**
+ * A drop in replacement for basic as the alog_type or elog_type of a
+ * config. write copies the line into a bounded lock-free ring and returns.
+ * A writer thread owned by the logger drains the rings, formats timestamps
+ * and writes everything it finds with a single flush. Each writing thread
+ * sticks to one of several rings, so io threads do not contend with each
+ * other or wait on the ostream.
+ *
+ * Lines show up on the ostream within a few milliseconds, call flush to wait
+ * for them. When a ring is full the line is dropped or the writing thread
+ * waits, see set_overflow.
+ *
+ * The logger always uses threads of its own, the concurrency policy is
+ * accepted for compatibility with basic and otherwise unused.
+ *
+ * @since 0.9.0
+ */
+template <typename concurrency, typename names>
+class async {
+public:
+    /// Number of rings lines are spread over
+    static constexpr size_t ring_count = 8;
+    /// Number of lines each ring holds, a power of two
+    static constexpr size_t ring_capacity = 1024;
+    /// Longest the writer thread sleeps before looking for lines, in ms
+    static constexpr long idle_wait = 10;
+
+    async(channel_type_hint::value h =
+        channel_type_hint::access)
+      : m_static_channels(0xffffffff)
+      , m_out(h == channel_type_hint::error ? &std::cerr : &std::cout)
+    {
+        start();
+    }
+
+    async(std::ostream * out)
+      : m_static_channels(0xffffffff)
+      , m_out(out)
+    {
+        start();
+    }
+
+    async(level c, channel_type_hint::value h =
+        channel_type_hint::access)
+      : m_static_channels(c)
+      , m_out(h == channel_type_hint::error ? &std::cerr : &std::cout)
+    {
+        start();
+    }
+
+    async(level c, std::ostream * out)
+      : m_static_channels(c)
+      , m_out(out)
+    {
+        start();
+    }
+
+    /// Destructor
+    /**
+     * Writes out any queued lines and stops the writer thread.
+     */
+    ~async() {
+        {
+            lib::lock_guard<lib::mutex> lock(m_wake_lock);
+            m_stopping = true;
+        }
+        m_wake.notify_one();
+        m_writer->join();
+    }
+
+    void set_ostream(std::ostream * out = &std::cout) {
+        lib::lock_guard<lib::mutex> lock(m_out_lock);
+        m_out = out;
+    }
+
+    /// Set what happens to lines written while the queue is full
+    /**
+     * The default is overflow::drop.
+     *
+     * @param policy The overflow policy
+     */
+    void set_overflow(overflow::value policy) {
+        m_overflow.store(policy, std::memory_order_relaxed);
+    }
+
+    void set_channels(level channels) {
+        if (channels == names::none) {
+            clear_channels(names::all);
+            return;
+        }
+
+        m_dynamic_channels.fetch_or(channels & m_static_channels,
+            std::memory_order_relaxed);
+    }
+
+    void clear_channels(level channels) {
+        m_dynamic_channels.fetch_and(~channels, std::memory_order_relaxed);
+    }
+
+    /// Write a string message to the given channel
+    /**
+     * @param channel The channel to write to
+     * @param msg The message to write
+     */
+    void write(level channel, std::string const & msg) {
+        if (!this->dynamic_test(channel)) { return; }
+        enqueue(channel, msg.data(), msg.size());
+    }
+
+    /// Write a cstring message to the given channel
+    /**
+     * @param channel The channel to write to
+     * @param msg The message to write
+     */
+    void write(level channel, char const * msg) {
+        if (!this->dynamic_test(channel)) { return; }
+        enqueue(channel, msg, std::char_traits<char>::length(msg));
+    }
+
+    /// Wait until the lines written so far are on the ostream
+    void flush() {
+        lib::unique_lock<lib::mutex> lock(m_wake_lock);
+        uint64_t request = ++m_flush_request;
+        m_wake.notify_one();
+        while (m_flush_done < request) {
+            m_flushed.wait(lock);
+        }
+    }
+
+    /// Get the number of lines dropped because the queue was full
+    uint64_t get_dropped() const {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+    _WEBSOCKETPP_CONSTEXPR_TOKEN_ bool static_test(level channel) const {
+        return ((channel & m_static_channels) != 0);
+    }
+
+    bool dynamic_test(level channel) {
+        return ((m_dynamic_channels.load(std::memory_order_relaxed) & channel)
+            != 0);
+    }
+private:
+    async(async const &);
+    async & operator=(async const &);
+
+    struct record {
+        level channel;
+        std::time_t time;
+        std::string msg;
+    };
+
+    struct cell {
+        std::atomic<size_t> seq;
+        record value;
+    };
+
+    /// Bounded multi-producer single-consumer ring
+    /**
+     * Dmitry Vyukov's bounded queue, with the consumer side simplified for
+     * the single writer thread. Messages are copied into strings kept in
+     * the cells, which keep their capacity so a warm ring does not allocate.
+     */
+    class ring {
+    public:
+        ring() : m_cells(new cell[ring_capacity]), m_push(0), m_pop(0) {
+            for (size_t i = 0; i < ring_capacity; ++i) {
+                m_cells[i].seq.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        ~ring() {
+            delete[] m_cells;
+        }
+
+        bool try_push(level channel, std::time_t t, char const * msg,
+            size_t len)
+        {
+            size_t pos = m_push.load(std::memory_order_relaxed);
+            cell * c;
+            for (;;) {
+                c = &m_cells[pos & (ring_capacity - 1)];
+                size_t seq = c->seq.load(std::memory_order_acquire);
+                intptr_t diff = static_cast<intptr_t>(seq) -
+                    static_cast<intptr_t>(pos);
+                if (diff == 0) {
+                    if (m_push.compare_exchange_weak(pos, pos + 1,
+                        std::memory_order_relaxed))
+                    {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = m_push.load(std::memory_order_relaxed);
+                }
+            }
+
+            c->value.channel = channel;
+            c->value.time = t;
+            c->value.msg.assign(msg, len);
+            c->seq.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// Get the oldest record, or NULL. Writer thread only.
+        record * front() {
+            cell & c = m_cells[m_pop & (ring_capacity - 1)];
+            if (c.seq.load(std::memory_order_acquire) != m_pop + 1) {
+                return NULL;
+            }
+            return &c.value;
+        }
+
+        /// Release the record returned by front. Writer thread only.
+        void pop() {
+            cell & c = m_cells[m_pop & (ring_capacity - 1)];
+            c.seq.store(m_pop + ring_capacity, std::memory_order_release);
+            ++m_pop;
+        }
+    private:
+        ring(ring const &);
+        ring & operator=(ring const &);
+
+        cell * m_cells;
+        std::atomic<size_t> m_push;
+        size_t m_pop;
+    };
+
+    void start() {
+        m_dynamic_channels.store(0, std::memory_order_relaxed);
+        m_overflow.store(overflow::drop, std::memory_order_relaxed);
+        m_dropped.store(0, std::memory_order_relaxed);
+        m_sleeping.store(false, std::memory_order_relaxed);
+        m_stopping = false;
+        m_flush_request = 0;
+        m_flush_done = 0;
+        m_reported_drops = 0;
+        m_last_time = 0;
+
+        for (size_t i = 0; i < ring_count; ++i) {
+            m_rings.push_back(lib::make_shared<ring>());
+        }
+        m_writer = lib::make_shared<lib::thread>(&async::run, this);
+    }
+
+    /// The ring the calling thread writes to
+    static size_t thread_ring() {
+        static std::atomic<size_t> next(0);
+        static thread_local size_t index =
+            next.fetch_add(1, std::memory_order_relaxed);
+        return index % ring_count;
+    }
+
+    void enqueue(level channel, char const * msg, size_t len) {
+        ring & r = *m_rings[thread_ring()];
+        std::time_t t = std::time(NULL);
+
+        while (!r.try_push(channel, t, msg, len)) {
+            if (m_overflow.load(std::memory_order_relaxed) == overflow::drop) {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            m_wake.notify_one();
+            std::this_thread::yield();
+        }
+
+        // pairs with the fence in run, so either the writer sees the line
+        // before sleeping or this thread sees that it sleeps
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sleeping.load(std::memory_order_relaxed)) {
+            m_wake.notify_one();
+        }
+    }
+
+    void run() {
+        for (;;) {
+            uint64_t request;
+            bool stopping;
+            {
+                lib::unique_lock<lib::mutex> lock(m_wake_lock);
+                if (!m_stopping && m_flush_request == m_flush_done) {
+                    m_sleeping.store(true, std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    if (empty()) {
+                        m_wake.wait_for(lock,
+                            lib::chrono::milliseconds(idle_wait));
+                    }
+                    m_sleeping.store(false, std::memory_order_relaxed);
+                }
+                request = m_flush_request;
+                stopping = m_stopping;
+            }
+
+            while (drain()) {}
+
+            if (request != m_flush_done) {
+                lib::lock_guard<lib::mutex> lock(m_wake_lock);
+                m_flush_done = request;
+                m_flushed.notify_all();
+            }
+
+            if (stopping) {
+                return;
+            }
+        }
+    }
+
+    bool empty() {
+        for (size_t i = 0; i < ring_count; ++i) {
+            if (m_rings[i]->front()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// Write out everything queued. Returns whether anything was written.
+    bool drain() {
+        m_batch.clear();
+
+        for (size_t i = 0; i < ring_count; ++i) {
+            ring & r = *m_rings[i];
+            size_t n = 0;
+            for (record * rec = r.front(); rec && n < ring_capacity;
+                rec = r.front(), ++n)
+            {
+                append(rec->time, names::channel_name(rec->channel),
+                    rec->msg);
+                r.pop();
+            }
+        }
+
+        uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+        if (dropped != m_reported_drops) {
+            std::stringstream s;
+            s << (dropped - m_reported_drops)
+              << " log lines dropped because the queue was full";
+            append(std::time(NULL), "logger", s.str());
+            m_reported_drops = dropped;
+        }
+
+        if (m_batch.empty()) {
+            return false;
+        }
+
+        lib::lock_guard<lib::mutex> lock(m_out_lock);
+        m_out->write(m_batch.data(), m_batch.size());
+        m_out->flush();
+        return true;
+    }
+
+    void append(std::time_t t, char const * channel, std::string const & msg) {
+        m_batch += '[';
+        m_batch += timestamp(t);
+        m_batch += "] [";
+        m_batch += channel;
+        m_batch += "] ";
+        m_batch += msg;
+        m_batch += '\n';
+    }
+
+    // Same format as basic, see the note on the time zone there. Formatted
+    // once per second rather than once per line.
+    std::string const & timestamp(std::time_t t) {
+        if (t != m_last_time || m_last_stamp.empty()) {
+            std::tm lt = lib::localtime(t);
+            char buffer[20];
+            size_t result = std::strftime(buffer,sizeof(buffer),
+                "%Y-%m-%d %H:%M:%S",&lt);
+            m_last_stamp = (result == 0 ? "Unknown" : buffer);
+            m_last_time = t;
+        }
+        return m_last_stamp;
+    }
+
+    level const m_static_channels;
+    std::atomic<level> m_dynamic_channels;
+    std::atomic<int> m_overflow;
+    std::atomic<uint64_t> m_dropped;
+
+    std::vector<lib::shared_ptr<ring> > m_rings;
+
+    lib::mutex m_out_lock;
+    std::ostream * m_out;
+
+    lib::mutex m_wake_lock;
+    lib::condition_variable m_wake;
+    lib::condition_variable m_flushed;
+    std::atomic<bool> m_sleeping;
+    bool m_stopping;
+    uint64_t m_flush_request;
+    uint64_t m_flush_done;
+
+    // writer thread only
+    std::string m_batch;
+    uint64_t m_reported_drops;
+    std::time_t m_last_time;
+    std::string m_last_stamp;
+
+    lib::shared_ptr<lib::thread> m_writer;
+};
+
+} // log
+} // websocketpp
+
+#endif // WEBSOCKETPP_LOGGER_ASYNC_HPP
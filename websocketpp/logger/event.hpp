@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_LOGGER_EVENT_HPP
+#define WEBSOCKETPP_LOGGER_EVENT_HPP
+
+#include <websocketpp/common/stdint.hpp>
+
+#include <cstring>
+#include <string>
+
+namespace websocketpp {
+namespace log {
+
+/// Kinds of connection lifecycle events
+namespace event_type {
+
+/// See connection_event
+enum value {
+    /// The opening handshake completed
+    open = 1,
+    /// The connection failed before it was opened
+    fail = 2,
+    /// An open connection closed
+    close = 3,
+    /// A plain HTTP request was answered
+    http = 4
+};
+
+} // namespace event_type
+
+/// A fixed layout record of a connection lifecycle event
+/**
+ * The structured counterpart of the connect, disconnect, fail and http
+ * access log lines. It has no pointers and a fixed size, so records can be
+ * copied into shared memory or files and read by other processes as is.
+ * The strings are NUL terminated and truncated to fit.
+ *
+ * Times are in microseconds. `duration` runs from the start of the
+ * connection to the event, `handshake_time` from the start to the opening
+ * handshake completing, 0 if it did not complete.
+ *
+ * @since 0.9.0
+ */
+struct connection_event {
+    /// sizeof(connection_event), to recognize the layout
+    uint32_t size;
+    /// An event_type value
+    uint16_t type;
+    /// WebSocket version of the handshake, -1 for plain HTTP
+    int16_t version;
+    /// Wall clock time of the event since the Unix epoch
+    uint64_t time;
+    uint64_t handshake_time;
+    uint64_t duration;
+    /// Bytes read from and written to the transport
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    /// HTTP status code of the handshake response
+    uint16_t status;
+    /// Close codes sent and received, for close events
+    uint16_t local_close_code;
+    uint16_t remote_close_code;
+    uint16_t reserved;
+    /// Value of the connection's error code, see connection::get_ec, 0 if
+    /// none
+    int32_t error;
+    char remote_endpoint[60];
+    char user_agent[128];
+    char resource[128];
+
+    /// Copy a string into one of the fixed size fields
+    template <size_t N>
+    static void assign(char (&field)[N], std::string const & value) {
+        size_t len = value.size() < N - 1 ? value.size() : N - 1;
+        std::memcpy(field, value.data(), len);
+        field[len] = '\0';
+    }
+};
+
+} // log
+} // websocketpp
+
+#endif // WEBSOCKETPP_LOGGER_EVENT_HPP
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_LOGGER_EVENT_RING_HPP
+#define WEBSOCKETPP_LOGGER_EVENT_RING_HPP
+
+#include <websocketpp/error.hpp>
+#include <websocketpp/logger/event.hpp>
+
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace websocketpp {
+namespace log {
+
+/// Writes connection events into a memory mapped ring file
+/**
+ * The file holds a header followed by a fixed number of slots, each holding
+ * a sequence number and a connection_event:
+ *
+ *     header: char magic[8] = "WSPPEV1\0", uint32_t header_size,
+ *             uint32_t slot_size, uint64_t capacity,
+ *             uint64_t next (atomic, events written so far)
+ *     slot:   uint64_t seq (atomic), connection_event event
+ *
+ * Event n goes into slot n % capacity. Its seq is 2n+1 while the event is
+ * being copied in and 2n+2 once it is complete, so a reader outside the
+ * process takes events whose seq is even and unchanged across its copy. Old
+ * events are overwritten once the ring wraps. All fields are in host byte
+ * order.
+ *
+ * write is lock-free and safe to call from any thread, typically through
+ * endpoint::set_event_handler:
+ *
+ *     ring->open("/var/log/ws.events", 65536);
+ *     s.set_event_handler(bind(&log::event_ring::write, ring, _1));
+ *
+ * Not available on Windows, where open fails with error::general.
+ *
+ * @since 0.9.0
+ */
+class event_ring {
+public:
+    event_ring() : m_map(NULL), m_map_size(0), m_header(NULL), m_slots(NULL) {}
+
+    ~event_ring() {
+        close();
+    }
+
+    /// Create or replace the ring file and map it
+    /**
+     * @param path The file to write to
+     * @param capacity The number of events the ring holds
+     * @return An error code, empty on success
+     */
+    lib::error_code open(std::string const & path, size_t capacity) {
+#ifdef _WIN32
+        return error::make_error_code(error::general);
+#else
+        close();
+        if (capacity == 0) {
+            return lib::error_code(EINVAL, lib::system_category());
+        }
+
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            return lib::error_code(errno, lib::system_category());
+        }
+
+        size_t size = sizeof(header) + capacity * sizeof(slot);
+        if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            int err = errno;
+            ::close(fd);
+            return lib::error_code(err, lib::system_category());
+        }
+
+        void * map = ::mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+            fd, 0);
+        int err = errno;
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            return lib::error_code(err, lib::system_category());
+        }
+
+        m_map = map;
+        m_map_size = size;
+        m_header = new (map) header();
+        m_slots = reinterpret_cast<slot *>(static_cast<char *>(map) +
+            sizeof(header));
+
+        std::memcpy(m_header->magic, "WSPPEV1", 8);
+        m_header->header_size = sizeof(header);
+        m_header->slot_size = sizeof(slot);
+        m_header->capacity = capacity;
+        for (size_t i = 0; i < capacity; ++i) {
+            new (&m_slots[i]) slot();
+        }
+        m_header->next.store(0, std::memory_order_release);
+        return lib::error_code();
+#endif
+    }
+
+    /// Unmap the ring file. Not safe while other threads write.
+    void close() {
+#ifndef _WIN32
+        if (m_map) {
+            ::munmap(m_map, m_map_size);
+        }
+#endif
+        m_map = NULL;
+        m_map_size = 0;
+        m_header = NULL;
+        m_slots = NULL;
+    }
+
+    /// Whether or not a ring file is mapped
+    bool is_open() const {
+        return m_header != NULL;
+    }
+
+    /// Append an event, overwriting the oldest once the ring is full
+    void write(connection_event const & e) {
+        if (!m_header) {
+            return;
+        }
+
+        uint64_t n = m_header->next.fetch_add(1, std::memory_order_relaxed);
+        slot & s = m_slots[n % m_header->capacity];
+
+        s.seq.store(2 * n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(&s.event, &e, sizeof(connection_event));
+        s.seq.store(2 * n + 2, std::memory_order_release);
+    }
+
+    /// Get the number of events written since the ring was opened
+    uint64_t size() const {
+        return m_header ? m_header->next.load(std::memory_order_acquire) : 0;
+    }
+
+    /// Copy out event n, if it is still in the ring and complete
+    /**
+     * This is how readers of the file find events, provided for tests and
+     * in process readers.
+     *
+     * @param n The event number, counting from 0
+     * @param [out] e Set to the event on success
+     * @return Whether or not the event was copied
+     */
+    bool read(uint64_t n, connection_event & e) const {
+        if (!m_header) {
+            return false;
+        }
+
+        slot const & s = m_slots[n % m_header->capacity];
+        if (s.seq.load(std::memory_order_acquire) != 2 * n + 2) {
+            return false;
+        }
+        std::memcpy(&e, &s.event, sizeof(connection_event));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return s.seq.load(std::memory_order_relaxed) == 2 * n + 2;
+    }
+private:
+    event_ring(event_ring const &);
+    event_ring & operator=(event_ring const &);
+
+    struct header {
+        char magic[8];
+        uint32_t header_size;
+        uint32_t slot_size;
+        uint64_t capacity;
+        std::atomic<uint64_t> next;
+    };
+
+    struct slot {
+        slot() : seq(0) {}
+
+        std::atomic<uint64_t> seq;
+        connection_event event;
+    };
+
+    void * m_map;
+    size_t m_map_size;
+    header * m_header;
+    slot * m_slots;
+};
+
+} // log
+} // websocketpp
+
+#endif // WEBSOCKETPP_LOGGER_EVENT_RING_HPP
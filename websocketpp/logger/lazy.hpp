@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_LOGGER_LAZY_HPP
+#define WEBSOCKETPP_LOGGER_LAZY_HPP
+
+#include <websocketpp/logger/levels.hpp>
+
+#include <sstream>
+
+namespace websocketpp {
+namespace log {
+
+/// Test whether a logger would write a line to the given channel
+/**
+ * Both the static and the dynamic channel sets are checked, so this is the
+ * test to make before spending any effort on building a message.
+ *
+ * @since 0.9.0
+ *
+ * @param logger The logger to test
+ * @param channel The channel to test
+ * @return Whether or not a line written to channel would be output
+ */
+template <typename logger_type>
+bool enabled(logger_type & logger, level channel) {
+    return logger.static_test(channel) && logger.dynamic_test(channel);
+}
+
+} // log
+} // websocketpp
+
+/// Write a streamed message to a logger, formatting it only if it is output
+/**
+ * `message` is a sequence of `<<` operands and is not evaluated at all
+ * unless the channel is enabled:
+ *
+ *     WEBSOCKETPP_LOG(*m_alog, log::alevel::devel,
+ *         "bytes left after consume: " << bytes_transferred-p);
+ *
+ * @since 0.9.0
+ */
+#define WEBSOCKETPP_LOG(logger, channel, message)                           \
+    do {                                                                    \
+        if (::websocketpp::log::enabled(logger, channel)) {                 \
+            std::stringstream websocketpp_log_s;                            \
+            websocketpp_log_s << message;                                   \
+            (logger).write(channel, websocketpp_log_s.str());               \
+        }                                                                   \
+    } while (false)
+
+#endif // WEBSOCKETPP_LOGGER_LAZY_HPP
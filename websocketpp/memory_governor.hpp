@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_MEMORY_GOVERNOR_HPP
+#define WEBSOCKETPP_MEMORY_GOVERNOR_HPP
+
+#include <websocketpp/common/functional.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/memory_budget.hpp>
+#include <websocketpp/common/thread.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+namespace websocketpp {
+
+/// How close the connections of a memory_governor are to its limit
+namespace memory_pressure {
+
+/// Each level also applies the policies of the levels below it
+enum value {
+    /// Below every threshold
+    normal = 0,
+    /// Connections holding more than their fair share stop reading
+    pause_reads,
+    /// Connections release their compression contexts where history allows
+    shrink_compression,
+    /// Droppable queued messages beyond the fair share are dropped
+    drop_slow_consumers,
+    /// Servers answer new handshakes with 503 Service Unavailable
+    reject_handshakes
+};
+
+} // namespace memory_pressure
+
+/// Memory budget for every connection of an endpoint
+/**
+ * Unlike memory_budget, which refuses reservations that do not fit, the
+ * governor counts what connections hold and reacts as the total crosses
+ * its thresholds, see memory_pressure. The default thresholds are 70, 80,
+ * 90 and 100 percent of the limit.
+ *
+ * Connections charge their send queue, the data message they are reading,
+ * including its decompression buffer, and the HTTP request or response they
+ * are reading. Compression contexts are charged through the deflate memory
+ * budget, whose parent is get_total. A connection only moves its charge
+ * once it changed by at least the granularity, so the total may be off by
+ * up to the granularity per connection.
+ *
+ * The fair share is the total divided by the number of connections. Only
+ * connections above it are paused or have messages dropped, so the largest
+ * consumers give way first. Paused connections resume once the total falls
+ * below the pause_reads threshold.
+ *
+ * See endpoint::set_memory_limit.
+ *
+ * @since 0.9.0
+ */
+class memory_governor {
+public:
+    /// A function called once memory pressure has eased
+    typedef lib::function<void()> relief_handler;
+
+    /// Construct a governor
+    /**
+     * @param limit The number of bytes connections should stay under
+     * @param granularity The smallest change of a connection's charge that
+     * is passed on to the total, 0 for 1/256 of the limit up to 16 KiB
+     */
+    explicit memory_governor(size_t limit, size_t granularity = 0)
+      : m_limit(limit)
+      , m_granularity(granularity != 0 ? granularity :
+            (std::max)(size_t(1), (std::min)(limit / 256, size_t(16384))))
+      , m_total(lib::make_shared<memory_budget>(
+            (std::numeric_limits<size_t>::max)()))
+      , m_connections(0)
+      , m_waiting(false)
+    {
+        m_thresholds[memory_pressure::normal] = 0;
+        m_thresholds[memory_pressure::pause_reads] = limit / 10 * 7;
+        m_thresholds[memory_pressure::shrink_compression] = limit / 10 * 8;
+        m_thresholds[memory_pressure::drop_slow_consumers] = limit / 10 * 9;
+        m_thresholds[memory_pressure::reject_handshakes] = limit;
+    }
+
+    /// Get the limit
+    size_t get_limit() const {
+        return m_limit;
+    }
+
+    /// Get the smallest change of a connection's charge that is passed on
+    size_t get_granularity() const {
+        return m_granularity;
+    }
+
+    /// Set the total at which a level of pressure starts
+    /**
+     * Must be set before connections use the governor. Thresholds should
+     * not decrease from one level to the next.
+     *
+     * @param level The level, above memory_pressure::normal
+     * @param bytes The total at which it starts
+     */
+    void set_threshold(memory_pressure::value level, size_t bytes) {
+        if (level != memory_pressure::normal) {
+            m_thresholds[level] = bytes;
+        }
+    }
+
+    /// Get the total at which a level of pressure starts
+    size_t get_threshold(memory_pressure::value level) const {
+        return m_thresholds[level];
+    }
+
+    /// Get the budget holding the total
+    /**
+     * Other budgets may use it as their parent to count towards the total,
+     * see memory_budget. Its own limit is never reached.
+     */
+    lib::shared_ptr<memory_budget> get_total() const {
+        return m_total;
+    }
+
+    /// Get the number of bytes currently charged
+    size_t get_used() const {
+        return m_total->get_used();
+    }
+
+    /// Get the current level of pressure
+    memory_pressure::value get_pressure() const {
+        size_t const used = get_used();
+
+        int level = memory_pressure::reject_handshakes;
+        while (level > memory_pressure::normal && used < m_thresholds[level]) {
+            --level;
+        }
+        return memory_pressure::value(level);
+    }
+
+    /// Count a connection towards the fair share
+    void attach() {
+        m_connections.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// Stop counting a connection towards the fair share
+    void detach() {
+        m_connections.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    /// Get the number of connections counted towards the fair share
+    size_t get_connections() const {
+        return m_connections.load(std::memory_order_relaxed);
+    }
+
+    /// Get the number of bytes each connection would hold if shared evenly
+    size_t get_fair_share() const {
+        size_t const n = get_connections();
+        return n == 0 ? get_used() : get_used() / n;
+    }
+
+    /// Replace a charge with a new one
+    /**
+     * @param old_bytes The bytes charged so far
+     * @param new_bytes The bytes charged from now on
+     */
+    void charge(size_t old_bytes, size_t new_bytes) {
+        if (new_bytes > old_bytes) {
+            m_total->acquire(new_bytes - old_bytes);
+        } else if (new_bytes < old_bytes) {
+            m_total->release(old_bytes - new_bytes);
+            relieve();
+        }
+    }
+
+    /// Call a handler once the total is below the pause_reads threshold
+    /**
+     * The handler is called from whichever thread lowers the total below
+     * the threshold. It must not block.
+     *
+     * @param handler The function to call
+     * @return False if the total already is below the threshold, in which
+     * case the handler is not stored and never called
+     */
+    bool wait_for_relief(relief_handler handler) {
+        scoped_lock_type guard(m_relief_lock);
+        m_relief.push_back(handler);
+        m_waiting.store(true);
+
+        // pairs with the fence in relieve, so either this sees the total
+        // drop or relieve sees the waiting handler
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (get_used() < m_thresholds[memory_pressure::pause_reads]) {
+            m_relief.pop_back();
+            m_waiting.store(!m_relief.empty());
+            return false;
+        }
+        return true;
+    }
+
+    /// Call the waiting relief handlers if the pressure has eased
+    /**
+     * Called whenever a connection lowers its charge. Memory returned
+     * through get_total alone, such as a released compression context, is
+     * only noticed at the next call.
+     */
+    void relieve() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!m_waiting.load() ||
+            get_used() >= m_thresholds[memory_pressure::pause_reads])
+        {
+            return;
+        }
+
+        std::vector<relief_handler> handlers;
+        {
+            scoped_lock_type guard(m_relief_lock);
+            handlers.swap(m_relief);
+            m_waiting.store(false);
+        }
+
+        for (size_t i = 0; i < handlers.size(); ++i) {
+            handlers[i]();
+        }
+    }
+private:
+    typedef lib::lock_guard<lib::mutex> scoped_lock_type;
+
+    memory_governor(memory_governor const &) = delete;
+    memory_governor & operator=(memory_governor const &) = delete;
+
+    size_t const m_limit;
+    size_t const m_granularity;
+    size_t m_thresholds[memory_pressure::reject_handshakes + 1];
+    lib::shared_ptr<memory_budget> const m_total;
+    std::atomic<size_t> m_connections;
+
+    lib::mutex m_relief_lock;
+    std::vector<relief_handler> m_relief;
+    std::atomic<bool> m_waiting;
+};
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_MEMORY_GOVERNOR_HPP
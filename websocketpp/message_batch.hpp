@@ -0,0 +1,399 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_MESSAGE_BATCH_HPP
+#define WEBSOCKETPP_MESSAGE_BATCH_HPP
+
+#include <websocketpp/common/functional.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+#include <websocketpp/common/thread.hpp>
+#include <websocketpp/error.hpp>
+#include <websocketpp/frame.hpp>
+#include <websocketpp/utf8_validator.hpp>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace websocketpp {
+
+/// Many small logical messages packed into each WebSocket message
+/**
+ * Clients that send a steady stream of tiny messages, such as telemetry,
+ * pay a frame header, a masking pass, a message buffer and a handler call
+ * per message on both ends. Both ends negotiate the subprotocol returned
+ * by subprotocol(), see offer and select, and wrap the connection in a
+ * batcher, which packs the logical messages sent in a short span of time
+ * into one binary WebSocket message.
+ *
+ * A batch is a sequence of records, each an unsigned LEB128 varint of the
+ * payload length shifted left by one, with the low bit set for binary and
+ * clear for text, followed by the payload.
+ *
+ * Sending coalesces like Nagle's algorithm: while a batch handed to the
+ * connection is not yet written, new messages collect and leave together
+ * once it is. With a delay, the first message after an idle period also
+ * waits up to that many milliseconds for company. A batch that reaches the
+ * size limit leaves at once, and flush sends whatever is collected. On
+ * transports without timers the delay is ignored.
+ *
+ * Call on_message from the connection's message handler. The batch
+ * handler receives every record of a batch in one call. Handlers run with
+ * no lock held and may send. The batcher does not keep the connection
+ * alive and must be destroyed on the connection's strand, for example in
+ * its close or fail handler.
+ *
+ * Usage:
+ *
+ *     // client, before connect
+ *     websocketpp::message_batcher<connection_type>::offer(con, ec);
+ *     // server, in the validate handler
+ *     websocketpp::message_batcher<connection_type>::select(con);
+ *     // both, once open
+ *     websocketpp::message_batcher<connection_type> batcher(con, 5);
+ *     batcher.set_batch_handler(telemetry_handler);
+ *     batcher.send("{\"cpu\":0.42}", websocketpp::frame::opcode::text);
+ *
+ * @since 0.9.0
+ */
+template <typename connection_type>
+class message_batcher {
+public:
+    typedef lib::shared_ptr<connection_type> connection_ptr;
+    typedef typename connection_type::message_ptr message_ptr;
+
+    /// One logical message of a received batch
+    struct record {
+        frame::opcode::value op;
+        /// Refers to the WebSocket message, valid during the handler call
+        std::string_view payload;
+    };
+
+    /// Called with all records of a received batch, in order
+    typedef lib::function<void(std::vector<record> const &)> batch_handler;
+
+    /// The subprotocol both ends negotiate
+    static char const * subprotocol() {
+        return "websocketpp.batch.v1";
+    }
+
+    /// Request the batching subprotocol on a client connection
+    static void offer(connection_ptr con, lib::error_code & ec) {
+        con->add_subprotocol(subprotocol(), ec);
+    }
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+    /// Request the batching subprotocol on a client connection
+    /// (exception version)
+    static void offer(connection_ptr con) {
+        con->add_subprotocol(subprotocol());
+    }
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
+    /// Accept the batching subprotocol on a server connection
+    /**
+     * Call from the validate handler.
+     *
+     * @return Whether the client requested the subprotocol, and so whether
+     * it was selected
+     */
+    static bool select(connection_ptr con) {
+        std::vector<std::string> const & requested =
+            con->get_requested_subprotocols();
+        for (size_t i = 0; i < requested.size(); ++i) {
+            if (requested[i] == subprotocol()) {
+                lib::error_code ec;
+                con->select_subprotocol(requested[i], ec);
+                return !ec;
+            }
+        }
+        return false;
+    }
+
+    /// Construct a batcher over an open connection
+    /**
+     * @param con The connection to carry the batches
+     * @param delay Milliseconds the first message after an idle period
+     * waits for others, 0 to only coalesce behind a batch being written
+     * @param max_batch Size in bytes at which a batch leaves at once
+     */
+    explicit message_batcher(connection_ptr con, long delay = 0,
+        size_t max_batch = 16*1024)
+      : m_con(con)
+      , m_delay(delay > 0 ? delay : 0)
+      , m_max_batch(max_batch ? max_batch : 1)
+      , m_queued(0)
+      , m_in_flight(0)
+      , m_timer_armed(false)
+      , m_sending(false)
+      , m_alive(lib::make_shared<bool>(true))
+    {}
+
+    /// Set the handler of received batches
+    void set_batch_handler(batch_handler h) {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        m_batch_handler = std::move(h);
+    }
+
+    /// Send a logical message
+    /**
+     * The message joins the batch being collected, see the class
+     * description for when it leaves.
+     *
+     * @param payload The payload of the message
+     * @param op The opcode of the message. Must be text or binary.
+     * @return An error code, empty if the message was queued
+     */
+    lib::error_code send(std::string_view payload,
+        frame::opcode::value op = frame::opcode::binary)
+    {
+        if (op != frame::opcode::text && op != frame::opcode::binary) {
+            return error::make_error_code(error::payload_violation);
+        }
+        if (op == frame::opcode::text &&
+            !utf8_validator::validate(payload.data(), payload.size()))
+        {
+            return error::make_error_code(error::invalid_utf8);
+        }
+        connection_ptr con = m_con.lock();
+        if (!con) {
+            return error::make_error_code(error::bad_connection);
+        }
+
+        bool arm;
+        {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            put_varint(m_pending, (uint64_t(payload.size()) << 1) |
+                (op == frame::opcode::binary ? 1 : 0));
+            m_pending.append(payload.data(), payload.size());
+            ++m_queued;
+
+            arm = m_delay > 0 && m_in_flight == 0 && !m_timer_armed;
+            if (arm) {
+                m_timer_armed = true;
+            }
+        }
+
+        if (arm) {
+            lib::weak_ptr<bool> alive = m_alive;
+            if (!con->set_timer(m_delay, [this, alive](lib::error_code const &)
+                {
+                    if (alive.expired()) {
+                        return;
+                    }
+                    {
+                        lib::lock_guard<lib::mutex> guard(m_lock);
+                        m_timer_armed = false;
+                    }
+                    this->pump(false);
+                }))
+            {
+                // no timers on this transport
+                lib::lock_guard<lib::mutex> guard(m_lock);
+                m_timer_armed = false;
+            }
+        }
+
+        this->pump(false);
+        return lib::error_code();
+    }
+
+    /// Send the messages collected so far now
+    void flush() {
+        this->pump(true);
+    }
+
+    /// Get the number of messages waiting for their batch to leave
+    size_t get_queued() const {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        return m_queued;
+    }
+
+    /// Process a message received on the connection
+    /**
+     * Must not be called concurrently, which holds when it is called from
+     * the connection's message handler.
+     *
+     * @param msg The message passed to the message handler
+     * @return error::payload_violation if the message is not a well formed
+     * batch, in which case the caller should close the connection. Otherwise
+     * an empty error code.
+     */
+    lib::error_code on_message(message_ptr msg) {
+        std::string const & raw = msg->get_payload();
+        if (msg->get_opcode() != frame::opcode::binary || raw.empty()) {
+            return error::make_error_code(error::payload_violation);
+        }
+
+        m_records.clear();
+        size_t pos = 0;
+        while (pos < raw.size()) {
+            uint64_t head;
+            if (!decode(raw, pos, head) || (head >> 1) > raw.size() - pos) {
+                return error::make_error_code(error::payload_violation);
+            }
+
+            record r;
+            r.op = (head & 1) ? frame::opcode::binary : frame::opcode::text;
+            r.payload = std::string_view(raw.data() + pos, size_t(head >> 1));
+            if (r.op == frame::opcode::text &&
+                !utf8_validator::validate(r.payload.data(), r.payload.size()))
+            {
+                return error::make_error_code(error::payload_violation);
+            }
+            m_records.push_back(r);
+            pos += r.payload.size();
+        }
+
+        batch_handler handler;
+        {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            handler = m_batch_handler;
+        }
+        if (handler) {
+            handler(m_records);
+        }
+        return lib::error_code();
+    }
+private:
+    message_batcher(message_batcher const &) = delete;
+    message_batcher & operator=(message_batcher const &) = delete;
+
+    static void put_varint(std::string & out, uint64_t value) {
+        do {
+            unsigned char b = static_cast<unsigned char>(value & 0x7f);
+            value >>= 7;
+            if (value) {
+                b |= 0x80;
+            }
+            out.push_back(static_cast<char>(b));
+        } while (value);
+    }
+
+    static bool decode(std::string const & in, size_t & pos, uint64_t & value)
+    {
+        value = 0;
+        for (unsigned shift = 0; shift < 64 && pos < in.size(); shift += 7) {
+            unsigned char b = static_cast<unsigned char>(in[pos++]);
+            value |= uint64_t(b & 0x7f) << shift;
+            if (!(b & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// Whether the collected batch should leave now, under m_lock
+    bool due(bool force) const {
+        if (m_pending.empty()) {
+            return false;
+        }
+        return force || m_pending.size() >= m_max_batch ||
+            (m_in_flight == 0 && !m_timer_armed);
+    }
+
+    /// Hand the collected batch to the connection once it is due
+    void pump(bool force) {
+        connection_ptr con = m_con.lock();
+        if (!con) {
+            return;
+        }
+
+        for (;;) {
+            std::string bytes;
+            {
+                lib::lock_guard<lib::mutex> guard(m_lock);
+                if (m_sending) {
+                    // a send handler ran within send or on another thread,
+                    // the loop already running picks up where it left off
+                    return;
+                }
+                if (!due(force)) {
+                    return;
+                }
+                bytes.swap(m_pending);
+                m_pending.reserve(bytes.capacity());
+                m_queued = 0;
+                ++m_in_flight;
+                m_sending = true;
+            }
+            force = false;
+
+            message_ptr msg = con->get_message(frame::opcode::binary,
+                bytes.size());
+            lib::error_code ec;
+            if (msg) {
+                msg->get_raw_payload().swap(bytes);
+                lib::weak_ptr<bool> alive = m_alive;
+                ec = con->send(msg, [this, alive](lib::error_code const &) {
+                    if (alive.expired()) {
+                        return;
+                    }
+                    {
+                        lib::lock_guard<lib::mutex> guard(m_lock);
+                        --m_in_flight;
+                    }
+                    this->pump(false);
+                });
+            } else {
+                ec = error::make_error_code(error::no_outgoing_buffers);
+            }
+
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            if (ec) {
+                // the send handler is not called for a refused message
+                --m_in_flight;
+            }
+            m_sending = false;
+        }
+    }
+
+    lib::weak_ptr<connection_type> m_con;
+    long const m_delay;
+    size_t const m_max_batch;
+
+    mutable lib::mutex m_lock;
+    batch_handler m_batch_handler;
+    /// Records collected for the next batch
+    std::string m_pending;
+    size_t m_queued;
+    /// Batches handed to the connection and not yet written
+    size_t m_in_flight;
+    bool m_timer_armed;
+    /// Whether or not a pump loop is running
+    bool m_sending;
+    /// Records of the batch being delivered, reused between batches
+    std::vector<record> m_records;
+    /// Expires with the batcher, for handlers that outlive it
+    lib::shared_ptr<bool> m_alive;
+};
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_MESSAGE_BATCH_HPP
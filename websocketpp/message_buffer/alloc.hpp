@@ -29,6 +29,7 @@
 #define WEBSOCKETPP_MESSAGE_BUFFER_ALLOC_HPP
 
 #include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/memory_resource.hpp>
 #include <websocketpp/frame.hpp>
 
 namespace websocketpp {
@@ -48,11 +49,34 @@ public:
 
     typedef typename message::ptr message_ptr;
 
+    con_msg_manager() : m_resource(NULL) {}
+
+    /// Allocate messages from a memory resource
+    /**
+     * Each message and its shared pointer control block are allocated
+     * together from the resource, which must outlive every message. The
+     * payload buffer is a std::string and still uses the global heap.
+     * Normally set by the connection, see connection::set_memory_resource.
+     *
+     * @since 0.9.0
+     *
+     * @param resource The resource to allocate from, or null for the
+     * global heap
+     */
+    void set_memory_resource(std::pmr::memory_resource * resource) {
+        m_resource = resource;
+    }
+
     /// Get an empty message buffer
     /**
      * @return A shared pointer to an empty new message
      */
     message_ptr get_message() {
+        if (m_resource) {
+            return lib::allocate_shared<message>(
+                std::pmr::polymorphic_allocator<message>(m_resource),
+                type::shared_from_this());
+        }
         return message_ptr(lib::make_shared<message>(type::shared_from_this()));
     }
 
@@ -64,6 +88,11 @@ public:
      * @return A shared pointer to a new message with specified size.
      */
     message_ptr get_message(frame::opcode::value op,size_t size) {
+        if (m_resource) {
+            return lib::allocate_shared<message>(
+                std::pmr::polymorphic_allocator<message>(m_resource),
+                type::shared_from_this(), op, size);
+        }
         return message_ptr(lib::make_shared<message>(type::shared_from_this(),op,size));
     }
 
@@ -80,6 +109,18 @@ public:
     bool recycle(message *) {
         return false;
     }
+
+    /// Estimate the memory held by the manager for later use
+    /**
+     * @since 0.9.0
+     *
+     * @return Always 0, messages are not kept
+     */
+    size_t get_memory_usage() const {
+        return 0;
+    }
+private:
+    std::pmr::memory_resource * m_resource;
 };
 
 /// An endpoint message manager that allocates a new manager for each
@@ -28,12 +28,35 @@
 #ifndef WEBSOCKETPP_MESSAGE_BUFFER_MESSAGE_HPP
 #define WEBSOCKETPP_MESSAGE_BUFFER_MESSAGE_HPP
 
+#include <websocketpp/common/functional.hpp>
 #include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/memory_usage.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+#include <websocketpp/common/thread.hpp>
 #include <websocketpp/frame.hpp>
 
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <span>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace websocketpp {
+
+namespace priority {
+    // send queue lanes of outgoing messages, see connection::write_push
+
+    enum value {
+        control = 0,    // ping and pong frames, always sent first
+        high = 1,
+        normal = 2,     // the default
+        bulk = 3
+    };
+} // namespace priority
+
 namespace message_buffer {
 
 /* # message:
@@ -75,6 +98,26 @@ namespace message_buffer {
  */
 
 
+/// Custom deleter for use in shared_ptrs to message.
+/**
+ * This is used to catch messages about to be deleted and offer the manager the
+ * ability to recycle them instead. Message::recycle will return true if it was
+ * successfully recycled and false otherwise. In the case of exceptions or error
+ * this deleter frees the memory.
+ *
+ * @since 0.9.0
+ */
+template <typename T>
+void message_deleter(T* msg) {
+    try {
+        if (!msg->recycle()) {
+            delete msg;
+        }
+    } catch (...) {
+        delete msg;
+    }
+}
+
 /// Represents a buffer for a single WebSocket message.
 /**
  *
@@ -85,6 +128,9 @@ class message {
 public:
     typedef lib::shared_ptr<message> ptr;
 
+    /// Called once the message is written or can no longer be
+    typedef lib::function<void(lib::error_code const &)> send_handler;
+
     typedef con_msg_manager<message> con_msg_man_type;
     typedef typename con_msg_man_type::ptr con_msg_man_ptr;
     typedef typename con_msg_man_type::weak_ptr con_msg_man_weak_ptr;
@@ -98,7 +144,12 @@ public:
       , m_prepared(false)
       , m_fin(true)
       , m_terminal(false)
-      , m_compressed(false) {}
+      , m_compressed(false)
+      , m_broadcast(false)
+      , m_header_in_place(false)
+      , m_priority(priority::normal)
+      , m_enqueue_time(0)
+      , m_completion_id(0) {}
 
     /// Construct a message and fill in some values
     /**
@@ -111,6 +162,11 @@ public:
       , m_fin(true)
       , m_terminal(false)
       , m_compressed(false)
+      , m_broadcast(false)
+      , m_header_in_place(false)
+      , m_priority(priority::normal)
+      , m_enqueue_time(0)
+      , m_completion_id(0)
     {
         m_payload.reserve(size);
     }
@@ -136,6 +192,238 @@ public:
         m_prepared = value;
     }
 
+    /// Return whether or not the message is a pre-framed broadcast message
+    /**
+     * Broadcast messages are produced by `endpoint::prepare_broadcast`. They
+     * hold an unmasked, uncompressed RFC6455 frame header and the unframed
+     * payload so that a single instance may be written to many server role
+     * connections. Connections that cannot use the pre-built frame as is
+     * (client role, or a pre-RFC6455 protocol version) frame the payload
+     * themselves instead.
+     *
+     * @since 0.9.0
+     *
+     * @return whether or not the message is a broadcast message
+     */
+    bool get_broadcast() const {
+        return m_broadcast;
+    }
+
+    /// Set or clear the flag that indicates a pre-framed broadcast message
+    /**
+     * This flag should not be set by end user code without a very good reason.
+     *
+     * @since 0.9.0
+     *
+     * @param value The value to set the broadcast flag to
+     */
+    void set_broadcast(bool value) {
+        m_broadcast = value;
+    }
+
+    /// Get the send priority of the message
+    /**
+     * @since 0.9.0
+     *
+     * @return The priority
+     */
+    priority::value get_priority() const {
+        return m_priority;
+    }
+
+    /// Set the send priority of the message
+    /**
+     * Queued messages of a higher priority are written before those of a
+     * lower one, with weighted fairness between high, normal and bulk so
+     * lower priorities are not starved, see connection::set_priority_weights.
+     * Data messages are never interleaved with each other, so a message
+     * begins only once the one being written, including all fragments, is
+     * done. Data messages set to priority::control are sent as high.
+     *
+     * @since 0.9.0
+     *
+     * @param value The priority
+     */
+    void set_priority(priority::value value) {
+        m_priority = value;
+    }
+
+    /// Get the key that queued messages are conflated by
+    /**
+     * @since 0.9.0
+     *
+     * @return The conflation key, empty if the message has none
+     */
+    std::string const & get_conflation_key() const {
+        return m_conflation_key;
+    }
+
+    /// Set the key that queued messages are conflated by
+    /**
+     * Connections using the slow_consumer::conflate policy keep only the
+     * latest of the queued messages sharing a non-empty key, see
+     * connection::set_slow_consumer_policy.
+     *
+     * @since 0.9.0
+     *
+     * @param key The conflation key, empty for none
+     */
+    void set_conflation_key(std::string const & key) {
+        m_conflation_key = key;
+    }
+
+    /// Get when the message was queued for sending
+    /**
+     * @since 0.9.0
+     *
+     * @return Nanoseconds on lib::chrono::steady_clock, or zero if the
+     * message was not stamped
+     */
+    int64_t get_enqueue_time() const {
+        return m_enqueue_time.load(std::memory_order_relaxed);
+    }
+
+    /// Stamp the time the message was queued for sending
+    /**
+     * Set by connections tracking send latency, see
+     * connection::set_send_latency_tracking. A message sent on several
+     * connections at once keeps the latest stamp.
+     *
+     * @since 0.9.0
+     *
+     * @param value Nanoseconds on lib::chrono::steady_clock, zero for none
+     */
+    void set_enqueue_time(int64_t value) {
+        m_enqueue_time.store(value, std::memory_order_relaxed);
+    }
+
+    /// Get the id reported once the message is written
+    /**
+     * @since 0.9.0
+     *
+     * @return The completion id, zero for none
+     */
+    uint64_t get_completion_id() const {
+        return m_completion_id;
+    }
+
+    /// Set an id to report once the message is written
+    /**
+     * A connection with a write complete handler calls it with this id once
+     * the transport write holding the message, or its last fragment,
+     * completed, see connection::set_write_complete_handler. Ignored on
+     * broadcast messages.
+     *
+     * @since 0.9.0
+     *
+     * @param value The completion id, zero for none
+     */
+    void set_completion_id(uint64_t value) {
+        m_completion_id = value;
+    }
+
+    /// Set a handler to call once the message is written
+    /**
+     * The connection the message is sent on calls the handler exactly once,
+     * from the write completion path: with no error once the transport write
+     * holding the message, or its last fragment, completed, with the write's
+     * error if it failed, and with error::operation_canceled if the message
+     * was still queued when the connection ended. Messages with a handler are
+     * never dropped by the slow consumer policy.
+     *
+     * Ignored on broadcast messages. A message with a handler must not be
+     * sent on more than one connection.
+     *
+     * @since 0.9.0
+     *
+     * @param h The handler, empty for none
+     */
+    void set_send_handler(send_handler h) {
+        m_send_handler = std::move(h);
+    }
+
+    /// Whether or not the message has a send handler
+    /**
+     * @since 0.9.0
+     */
+    bool has_send_handler() const {
+        return static_cast<bool>(m_send_handler);
+    }
+
+    /// Take the send handler, leaving the message without one
+    /**
+     * @since 0.9.0
+     */
+    send_handler take_send_handler() {
+        send_handler h = std::move(m_send_handler);
+        m_send_handler = send_handler();
+        return h;
+    }
+
+    /// Allow alternate frames of this message to be cached on it
+    /**
+     * Broadcast messages may be framed differently by connections that
+     * negotiated different extension parameters. Once enabled, the first
+     * connection to need a given framing stores it with add_variant and
+     * later connections with the same parameters reuse it.
+     *
+     * @since 0.9.0
+     */
+    void enable_variants() {
+        if (!m_variants) {
+            m_variants = lib::make_shared<variant_cache>();
+        }
+    }
+
+    /// Get a previously stored alternate frame of this message
+    /**
+     * Safe to call from several threads at once.
+     *
+     * @since 0.9.0
+     *
+     * @param key Identifies the framing parameters
+     * @return The stored frame, or a null pointer if there is none
+     */
+    ptr get_variant(size_t key) const {
+        if (!m_variants) {
+            return ptr();
+        }
+
+        lib::lock_guard<lib::mutex> guard(m_variants->lock);
+        for (size_t i = 0; i < m_variants->entries.size(); ++i) {
+            if (m_variants->entries[i].first == key) {
+                return m_variants->entries[i].second;
+            }
+        }
+        return ptr();
+    }
+
+    /// Store an alternate frame of this message
+    /**
+     * Safe to call from several threads at once. If another frame was stored
+     * for key first, that one is kept and returned instead.
+     *
+     * @since 0.9.0
+     *
+     * @param key Identifies the framing parameters
+     * @param variant The prepared frame
+     * @return The frame stored for key
+     */
+    ptr add_variant(size_t key, ptr variant) {
+        if (!m_variants) {
+            return variant;
+        }
+
+        lib::lock_guard<lib::mutex> guard(m_variants->lock);
+        for (size_t i = 0; i < m_variants->entries.size(); ++i) {
+            if (m_variants->entries[i].first == key) {
+                return m_variants->entries[i].second;
+            }
+        }
+        m_variants->entries.push_back(std::make_pair(key,variant));
+        return variant;
+    }
+
     /// Return whether or not the message is flagged as compressed
     /**
      * @return whether or not the message is/should be compressed
@@ -219,9 +507,10 @@ public:
     /// Return the prepared frame header
     /**
      * This value is typically set by a websocket protocol processor
-     * and shouldn't be tampered with.
+     * and shouldn't be tampered with. It is held inline in the message and
+     * converts to std::string.
      */
-    std::string const & get_header() const {
+    frame::header_buffer const & get_header() const {
         return m_header;
     }
 
@@ -229,10 +518,70 @@ public:
     /**
      * Under normal circumstances this should not be called by end users
      *
-     * @param header A string to set the header to.
+     * @param header A string to set the header to, at most
+     * frame::MAX_HEADER_LENGTH bytes.
      */
     void set_header(std::string const & header) {
+        m_header.assign(header.data(),header.size());
+        m_header_in_place = false;
+    }
+
+    /// Set prepared frame header
+    /**
+     * @since 0.9.0
+     *
+     * @param header The encoded header
+     */
+    void set_header(frame::header_buffer const & header) {
         m_header = header;
+        m_header_in_place = false;
+    }
+
+    /// Copy the frame header into the headroom in front of the payload
+    /**
+     * Works for a payload filled through writable_payload, or shared with
+     * a message that has one. The header then goes to the wire with the
+     * payload as one contiguous buffer, see get_header_in_place. Only the
+     * first message to place a header in a given payload's headroom gets
+     * it; others sharing the payload, for example the same broadcast sent
+     * to several connections, keep their header separate.
+     *
+     * Called by protocol processors once the header is encoded.
+     *
+     * @since 0.9.0
+     *
+     * @return Whether or not the header was placed
+     */
+    bool place_header() {
+        m_header_in_place = false;
+
+        message const * owner = this;
+        while (owner->m_payload_source) {
+            owner = owner->m_payload_source.get();
+        }
+
+        payload_ref * ref = owner->m_payload_ref.get();
+        if (!ref || ref->headroom < m_header.size() ||
+            ref->header_placed.exchange(true))
+        {
+            return false;
+        }
+
+        std::memcpy(const_cast<char *>(ref->data) - m_header.size(),
+            m_header.data(), m_header.size());
+        m_header_in_place = true;
+        return true;
+    }
+
+    /// Whether the header sits right in front of the payload bytes
+    /**
+     * If so the frame is the get_header().size() bytes before
+     * get_payload_data() followed by the payload.
+     *
+     * @since 0.9.0
+     */
+    bool get_header_in_place() const {
+        return m_header_in_place;
     }
 
     std::string const & get_extension_data() const {
@@ -241,20 +590,139 @@ public:
 
     /// Get a reference to the payload string
     /**
+     * If this message shares its payload with another message (see
+     * set_payload_source) the source message's payload is returned.
+     *
+     * A payload set with set_payload_ref is copied into a string the first
+     * time this is called, once no matter how many threads ask. Code that
+     * only needs the bytes should use get_payload_data and get_payload_size,
+     * which never copy.
+     *
      * @return A const reference to the message's payload string
      */
     std::string const & get_payload() const {
+        if (m_payload_source) {
+            return m_payload_source->get_payload();
+        }
+        if (m_payload_ref) {
+            return m_payload_ref->get_string();
+        }
         return m_payload;
     }
 
+    /// Get a pointer to the payload bytes
+    /**
+     * Unlike get_payload this does not copy a payload set with
+     * set_payload_ref.
+     *
+     * @since 0.9.0
+     *
+     * @return A pointer to get_payload_size bytes
+     */
+    char const * get_payload_data() const {
+        if (m_payload_source) {
+            return m_payload_source->get_payload_data();
+        }
+        if (m_payload_ref) {
+            return m_payload_ref->data;
+        }
+        return m_payload.data();
+    }
+
+    /// Get the size of the payload in bytes
+    /**
+     * @since 0.9.0
+     *
+     * @return The payload size
+     */
+    size_t get_payload_size() const {
+        if (m_payload_source) {
+            return m_payload_source->get_payload_size();
+        }
+        if (m_payload_ref) {
+            return m_payload_ref->len;
+        }
+        return m_payload.size();
+    }
+
     /// Get a non-const reference to the payload string
     /**
+     * If this message shares its payload with another message the shared
+     * payload is copied into this message first so that changes made through
+     * the returned reference never affect the source message.
+     *
      * @return A reference to the message's payload string
      */
     std::string & get_raw_payload() {
+        detach_payload();
         return m_payload;
     }
 
+    /// Share the payload of another message
+    /**
+     * After this call get_payload returns the payload of source rather than
+     * this message's own buffer and this message holds a reference to source
+     * until it is destroyed or the payload is replaced. This allows a
+     * protocol processor to prepare a frame for a payload that does not need
+     * to be transformed (unmasked and uncompressed) without copying it.
+     *
+     * The source payload must not be modified while this message is in use.
+     *
+     * This should not be called by end user code without a very good reason.
+     *
+     * @since 0.9.0
+     *
+     * @param source The message whose payload should be shared
+     */
+    void set_payload_source(ptr source) {
+        m_header_in_place = false;
+        m_payload.clear();
+        m_payload_ref.reset();
+        m_payload_source = source;
+    }
+
+    /// Get the message whose payload is shared by this message
+    /**
+     * @since 0.9.0
+     *
+     * @return The source message or a null pointer if this message uses its
+     * own payload buffer.
+     */
+    ptr get_payload_source() const {
+        return m_payload_source;
+    }
+
+    /// Get the bytes written between the frame header and the payload
+    /**
+     * @since 0.9.0
+     *
+     * @return The prefix, empty if the message has none
+     */
+    std::string const & get_prefix() const {
+        return m_prefix;
+    }
+
+    /// Set bytes to write between the frame header and the payload
+    /**
+     * Lets a message that shares the payload of a broadcast template, see
+     * set_payload_source, carry a few bytes of its own in front of it, such
+     * as a sequence number or subscriber id. The prefix is written as its
+     * own buffer, so the shared payload is never copied or changed. The
+     * prepared header must count the prefix in the payload length.
+     *
+     * Only prepared, uncompressed messages may have a prefix.
+     *
+     * This should not be called by end user code without a very good reason,
+     * see endpoint::prepare_recipient.
+     *
+     * @since 0.9.0
+     *
+     * @param prefix The bytes to write in front of the payload
+     */
+    void set_prefix(std::string const & prefix) {
+        m_prefix = prefix;
+    }
+
     /// Set payload data
     /**
      * Set the message buffer's payload to the given value.
@@ -262,6 +730,9 @@ public:
      * @param payload A string to set the payload to.
      */
     void set_payload(std::string const & payload) {
+        m_header_in_place = false;
+        m_payload_source.reset();
+        m_payload_ref.reset();
         m_payload = payload;
     }
 
@@ -273,11 +744,97 @@ public:
      * @param len The length of new payload in bytes.
      */
     void set_payload(void const * payload, size_t len) {
+        m_header_in_place = false;
+        m_payload_source.reset();
+        m_payload_ref.reset();
         m_payload.reserve(len);
         char const * pl = static_cast<char const *>(payload);
         m_payload.assign(pl, pl + len);
     }
 
+    /// Use bytes owned elsewhere as the payload
+    /**
+     * The payload becomes the len bytes at data, which are not copied. The
+     * message keeps a reference to owner until it is destroyed, recycled, or
+     * given another payload, so data may point into any buffer owner keeps
+     * alive: a serialization arena, a memory mapped file, or one shared by
+     * the messages of a fan out. Unmasked and uncompressed frames, the usual
+     * server case, go to the wire straight from data.
+     *
+     * The bytes must not change while the message is in use. Calling
+     * get_raw_payload or append_payload copies them into the message first.
+     *
+     * @since 0.9.0
+     *
+     * @param owner Keeps the payload bytes alive
+     * @param data A pointer to the payload bytes
+     * @param len The length of the payload in bytes
+     */
+    void set_payload_ref(lib::shared_ptr<void const> owner, void const * data,
+        size_t len)
+    {
+        m_header_in_place = false;
+        m_payload_source.reset();
+        m_payload.clear();
+        m_payload_ref = lib::make_shared<payload_ref>(owner,
+            static_cast<char const *>(data), len);
+    }
+
+    /// Get a new payload buffer of a given size to fill in place
+    /**
+     * Replaces the payload with size uninitialized bytes in a buffer that
+     * keeps frame::MAX_HEADER_LENGTH bytes of headroom in front. When the
+     * payload needs neither masking nor compression, the usual server case,
+     * the processor writes the frame header into that headroom and the
+     * frame leaves in one contiguous write, which also means one TLS record
+     * rather than two.
+     *
+     * Fill the bytes before sending. Like a payload set with
+     * set_payload_ref they must not change while the message is in use.
+     *
+     * @since 0.9.0
+     *
+     * @param size The payload size in bytes
+     * @return The payload bytes
+     */
+    std::span<char> writable_payload(size_t size) {
+        size_t const room = frame::MAX_HEADER_LENGTH;
+        lib::shared_ptr<char> buffer(new char[room + size],
+            std::default_delete<char[]>());
+
+        set_payload_ref(buffer, buffer.get() + room, size);
+        m_payload_ref->headroom = room;
+        return std::span<char>(buffer.get() + room, size);
+    }
+
+    /// Use bytes owned elsewhere as the payload, released by a deleter
+    /**
+     * Same as set_payload_ref with an owner that calls `d(data)` once the
+     * last message using the payload lets go of it.
+     *
+     * @since 0.9.0
+     *
+     * @param data A pointer to the payload bytes
+     * @param len The length of the payload in bytes
+     * @param d Called as `d(data)` to release the bytes
+     */
+    template <typename deleter>
+    void set_payload_ref(void const * data, size_t len, deleter d) {
+        set_payload_ref(lib::shared_ptr<void const>(data, d), data, len);
+    }
+
+    /// Get the owner of a payload set with set_payload_ref
+    /**
+     * @since 0.9.0
+     *
+     * @return The owner, or a null pointer if the message holds its own
+     * payload or shares that of another message
+     */
+    lib::shared_ptr<void const> get_payload_owner() const {
+        return m_payload_ref ? m_payload_ref->owner :
+            lib::shared_ptr<void const>();
+    }
+
     /// Append payload data
     /**
      * Append data to the message buffer's payload.
@@ -285,6 +842,7 @@ public:
      * @param payload A string containing the data array to append.
      */
     void append_payload(std::string const & payload) {
+        detach_payload();
         m_payload.append(payload);
     }
 
@@ -296,10 +854,59 @@ public:
      * @param len The length of payload in bytes
      */
     void append_payload(void const * payload, size_t len) {
+        detach_payload();
         m_payload.reserve(m_payload.size()+len);
         m_payload.append(static_cast<char const *>(payload),len);
     }
 
+    /// Reset the message so that it may be reused
+    /**
+     * Clears the header, extension data, and payload, releases any shared
+     * payload, and restores all flags to their default values. The capacity
+     * of the internal buffers is retained. The opcode is left unchanged.
+     *
+     * This is intended for message managers that recycle messages.
+     *
+     * @since 0.9.0
+     */
+    void reset() {
+        m_header.clear();
+        m_header_in_place = false;
+        m_extension_data.clear();
+        m_payload.clear();
+        m_payload_source.reset();
+        m_payload_ref.reset();
+        m_prefix.clear();
+        m_prepared = false;
+        m_fin = true;
+        m_terminal = false;
+        m_compressed = false;
+        m_broadcast = false;
+        m_priority = priority::normal;
+        m_conflation_key.clear();
+        set_enqueue_time(0);
+        m_completion_id = 0;
+        m_send_handler = send_handler();
+        m_variants.reset();
+    }
+
+    /// Estimate the memory held by the message
+    /**
+     * Counts the message object and the capacity of its buffers. A shared
+     * or referenced payload and the variant cache are left out, they may be shared with
+     * other messages.
+     *
+     * @since 0.9.0
+     *
+     * @return The estimated number of bytes
+     */
+    size_t get_memory_usage() const {
+        return sizeof(*this) + memory_usage::heap_bytes(m_extension_data) +
+            memory_usage::heap_bytes(m_payload) +
+            memory_usage::heap_bytes(m_prefix) +
+            memory_usage::heap_bytes(m_conflation_key);
+    }
+
     /// Recycle the message
     /**
      * A request to recycle this message was received. Forward that request to
@@ -323,15 +930,64 @@ public:
         }
     }
 private:
+    struct variant_cache {
+        lib::mutex lock;
+        std::vector<std::pair<size_t,ptr> > entries;
+    };
+
+    /// A payload set with set_payload_ref
+    struct payload_ref {
+        payload_ref(lib::shared_ptr<void const> o, char const * d, size_t l)
+          : owner(o), data(d), len(l), headroom(0), header_placed(false) {}
+
+        /// The bytes as a string, copied on first use
+        std::string const & get_string() {
+            std::call_once(copied, [this] { copy.assign(data, len); });
+            return copy;
+        }
+
+        lib::shared_ptr<void const> owner;
+        char const * data;
+        size_t len;
+        /// Writable bytes in front of data, see writable_payload
+        size_t headroom;
+        /// Set once a message placed its header in the headroom
+        std::atomic<bool> header_placed;
+        std::once_flag copied;
+        std::string copy;
+    };
+
+    /// Replace a shared or referenced payload with a private copy
+    void detach_payload() {
+        m_header_in_place = false;
+        if (m_payload_source || m_payload_ref) {
+            char const * data = get_payload_data();
+            m_payload.assign(data, data + get_payload_size());
+            m_payload_source.reset();
+            m_payload_ref.reset();
+        }
+    }
+
     con_msg_man_weak_ptr        m_manager;
-    std::string                 m_header;
+    frame::header_buffer        m_header;
     std::string                 m_extension_data;
     std::string                 m_payload;
+    ptr                         m_payload_source;
+    lib::shared_ptr<payload_ref> m_payload_ref;
+    std::string                 m_prefix;
     frame::opcode::value        m_opcode;
     bool                        m_prepared;
     bool                        m_fin;
     bool                        m_terminal;
     bool                        m_compressed;
+    bool                        m_broadcast;
+    bool                        m_header_in_place;
+    priority::value             m_priority;
+    std::string                 m_conflation_key;
+    std::atomic<int64_t>        m_enqueue_time;
+    uint64_t                    m_completion_id;
+    send_handler                m_send_handler;
+    lib::shared_ptr<variant_cache> m_variants;
 };
 
 } // namespace message_buffer
@@ -25,172 +25,267 @@
  *
  */
 
-#ifndef WEBSOCKETPP_MESSAGE_BUFFER_ALLOC_HPP
-#define WEBSOCKETPP_MESSAGE_BUFFER_ALLOC_HPP
+
+#ifndef WEBSOCKETPP_MESSAGE_BUFFER_POOL_HPP
+#define WEBSOCKETPP_MESSAGE_BUFFER_POOL_HPP
 
 #include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/memory_usage.hpp>
+#include <websocketpp/common/slab_allocator.hpp>
+#include <websocketpp/common/thread.hpp>
+#include <websocketpp/frame.hpp>
+#include <websocketpp/message_buffer/message.hpp>
 
 #include <string>
+#include <vector>
 
 namespace websocketpp {
 namespace message_buffer {
+namespace pool {
 
-/* # message:
- * object that stores a message while it is being sent or received. Contains
- * the message payload itself, the message header, the extension data, and the
- * opcode.
+/// A connection message manager that recycles messages through a pool
+/**
+ * Messages handed out by this manager are returned to it rather than freed
+ * when their last reference is released. Released messages keep the
+ * capacity of their payload buffer and are stored in free lists bucketed by
+ * power of two size class from `min_class_size` up to `max_class_size`.
+ * A request for a message of a given size is served from the first size
+ * class large enough to hold it.
  *
- * # connection_message_manager:
- * An object that manages all of the message_buffers associated with a given
- * connection. Implements the get_message_buffer(size) method that returns
- * a message buffer at least size bytes long.
+ * Messages larger than `max_class_size` are not pooled, and each size class
+ * holds at most `max_per_class` free messages, so a burst of large or
+ * numerous messages does not pin memory indefinitely.
  *
- * Message buffers are reference counted with shared ownership semantics. Once
- * requested from the manager the requester and it's associated downstream code
- * may keep a pointer to the message indefinitely at a cost of extra resource
- * usage. Once the reference count drops to the point where the manager is the
- * only reference the messages is recycled using whatever method is implemented
- * in the manager.
+ * Messages may be released from any thread; the free lists are protected by
+ * a mutex. Messages outliving their manager are freed normally. The shared
+ * pointer control blocks come from a slab_allocator, so once the pools are
+ * warm getting and releasing a message allocates nothing.
  *
- * # endpoint_message_manager:
- * An object that manages connection_message_managers. Implements the
- * get_message_manager() method. This is used once by each connection to
- * request the message manager that they are supposed to use to manage message
- * buffers for their own use.
+ * To use, set the following in the endpoint config:
  *
- * TYPES OF CONNECTION_MESSAGE_MANAGERS
- * - allocate a message with the exact size every time one is requested
- * - maintain a pool of pre-allocated messages and return one when needed.
- *   Recycle previously used messages back into the pool
+ * typedef message_buffer::message<message_buffer::pool::con_msg_manager>
+ *     message_type;
+ * typedef message_buffer::pool::con_msg_manager<message_type>
+ *     con_msg_manager_type;
+ * typedef message_buffer::pool::endpoint_msg_manager<con_msg_manager_type>
+ *     endpoint_msg_manager_type;
  *
- * TYPES OF ENDPOINT_MESSAGE_MANAGERS
- *  - allocate a new connection manager for each connection. Message pools
- *    become connection specific. This increases memory usage but improves
- *    concurrency.
- *  - allocate a single connection manager and share a pointer to it with all
- *    connections created by this endpoint. The message pool will be shared
- *    among all connections, improving memory usage and performance at the cost
- *    of reduced concurrency
+ * @since 0.9.0
  */
+template <typename message>
+class con_msg_manager
+  : public lib::enable_shared_from_this<con_msg_manager<message> >
+{
+public:
+    typedef con_msg_manager<message> type;
+    typedef lib::shared_ptr<con_msg_manager> ptr;
+    typedef lib::weak_ptr<con_msg_manager> weak_ptr;
 
-/// Custom deleter for use in shared_ptrs to message.
-/**
- * This is used to catch messages about to be deleted and offer the manager the
- * ability to recycle them instead. Message::recycle will return true if it was
- * successfully recycled and false otherwise. In the case of exceptions or error
- * this deleter frees the memory.
- */
-template <typename T>
-void message_deleter(T* msg) {
-    try {
-        if (!msg->recycle()) {
-            delete msg;
-        }
-    } catch (...) {
-        // TODO: is there a better way to ensure this function doesn't throw?
-        delete msg;
-    }
-}
+    typedef typename message::ptr message_ptr;
 
-/// Represents a buffer for a single WebSocket message.
-/**
- *
- *
- */
-template <typename con_msg_manager>
-class message {
-public:
-    typedef lib::shared_ptr<message> ptr;
+    /// Payload capacity of the smallest size class
+    static size_t const min_class_size = 128;
+    /// Number of size classes
+    static size_t const num_classes = 14;
+    /// Payload capacity of the largest size class
+    static size_t const max_class_size = min_class_size << (num_classes - 1);
 
-    typedef typename con_msg_manager::weak_ptr con_msg_man_ptr;
+    /// Default maximum number of free messages kept per size class
+    static size_t const default_max_per_class = 32;
 
-    message(con_msg_man_ptr manager, size_t size = 128)
-      : m_manager(manager)
-      , m_payload(size) {}
+    /// Construct a pooled message manager
+    /**
+     * @param max_per_class The maximum number of free messages to keep in
+     * each size class.
+     */
+    explicit con_msg_manager(size_t max_per_class = default_max_per_class)
+      : m_max_per_class(max_per_class)
+      , m_free(num_classes) {}
 
-    frame::opcode::value get_opcode() const {
-        return m_opcode;
-    }
-    const std::string& get_header() const {
-        return m_header;
+    ~con_msg_manager() {
+        for (size_t i = 0; i < m_free.size(); ++i) {
+            for (size_t j = 0; j < m_free[i].size(); ++j) {
+                delete m_free[i][j];
+            }
+        }
     }
-    const std::string& get_extension_data() const {
-        return m_extension_data;
+
+    /// Get an empty message buffer
+    /**
+     * @return A shared pointer to an empty message
+     */
+    message_ptr get_message() {
+        message * msg = this->pop(0);
+
+        if (!msg) {
+            msg = new message(type::shared_from_this());
+        }
+
+        return message_ptr(msg, &message_deleter<message>,
+            slab_allocator<message>());
     }
-    const std::string& get_payload() const {
-        return m_payload;
+
+    /// Get a message buffer with specified size and opcode
+    /**
+     * @param op The opcode to use
+     * @param size Minimum size in bytes to request for the message payload.
+     *
+     * @return A shared pointer to a message with specified size.
+     */
+    message_ptr get_message(frame::opcode::value op, size_t size) {
+        size_t c = get_size_class(size);
+        message * msg = (c < num_classes ? this->pop(c) : NULL);
+
+        if (msg) {
+            msg->set_opcode(op);
+            msg->get_raw_payload().reserve(size);
+        } else {
+            msg = new message(type::shared_from_this(), op,
+                (c < num_classes ? get_class_size(c) : size));
+        }
+
+        return message_ptr(msg, &message_deleter<message>,
+            slab_allocator<message>());
     }
 
-    /// Recycle the message
+    /// Recycle a message
     /**
-     * A request to recycle this message was received. Forward that request to
-     * the connection message manager for processing. Errors and exceptions
-     * from the manager's recycle member function should be passed back up the
-     * call chain. The caller to message::recycle will deal with them.
+     * Resets the message and returns it to the free list for its size class.
+     * If the message is too large to pool or its free list is full, false is
+     * returned and the caller frees it.
      *
-     * Recycle must *only* be called by the message shared_ptr's destructor.
-     * Once recycled successfully, ownership of the memory has been passed to
-     * another system and must not be accessed again.
+     * @param msg The message to be recycled.
      *
      * @return true if the message was successfully recycled, false otherwise.
      */
-    bool recycle() {
-        typename con_msg_manager::ptr shared = m_manager.lock();
+    bool recycle(message * msg) {
+        // Resetting releases any shared payload, which may recycle another
+        // message into this manager, so do it before taking the lock.
+        msg->reset();
 
-        if (shared) {
-            return shared->(recycle(this));
-        } else {
+        size_t capacity = msg->get_raw_payload().capacity();
+        if (capacity > max_class_size) {
             return false;
         }
-    }
-private:
-    con_msg_man_ptr             m_manager;
 
-    frame::opcode::value        m_opcode;
-    std::string                 m_header;
-    std::string                 m_extension_data;
-    std::string                 m_payload;
-};
+        // largest class that the retained capacity can satisfy
+        size_t c = 0;
+        while (c+1 < num_classes && get_class_size(c+1) <= capacity) {
+            ++c;
+        }
 
-namespace alloc {
+        lib::lock_guard<lib::mutex> guard(m_lock);
 
-/// A connection message manager that allocates a new message for each
-/// request.
-template <typename message>
-class con_msg_manager {
-public:
-    typedef lib::shared_ptr<con_msg_manager> ptr;
-    typedef lib::weak_ptr<con_msg_manager> weak_ptr;
+        if (m_free[c].size() >= m_max_per_class) {
+            return false;
+        }
 
-    typedef typename message::ptr message_ptr;
+        m_free[c].push_back(msg);
+        return true;
+    }
 
-    /// Get a message buffer with specified size
+    /// Fill the free list of a size class ahead of use
     /**
-     * @param size Minimum size in bytes to request for the message payload.
+     * Allocates messages with room for size bytes, writing to their payload
+     * buffers so the memory is resident, until the free list of that size
+     * class holds count messages or max_per_class, whichever is less. Sizes
+     * too large to pool are ignored.
      *
-     * @return A shared pointer to a new message with specified size.
+     * @since 0.9.0
+     *
+     * @param count The number of free messages wanted
+     * @param size The payload size they should hold
      */
-    message_ptr get_message(size_t size) const {
-        return lib::make_shared<message>(size);
+    void reserve(size_t count, size_t size) {
+        size_t c = get_size_class(size);
+        if (c >= num_classes) {
+            return;
+        }
+
+        lib::lock_guard<lib::mutex> guard(m_lock);
+
+        size_t want = (count < m_max_per_class ? count : m_max_per_class);
+        while (m_free[c].size() < want) {
+            message * msg = new message(type::shared_from_this(),
+                frame::opcode::binary, get_class_size(c));
+            std::string & payload = msg->get_raw_payload();
+            payload.resize(payload.capacity());
+            payload.clear();
+            m_free[c].push_back(msg);
+        }
     }
 
-    /// Recycle a message
+    /// Get the number of free messages currently held by the pool
     /**
-     * This method shouldn't be called. If it is, return false to indicate an
-     * error. The rest of the method recycle chain should notice this and free
-     * the memory.
-     *
-     * @param msg The message to be recycled.
+     * @return The total number of pooled messages across all size classes
+     */
+    size_t get_free_count() const {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+
+        size_t count = 0;
+        for (size_t i = 0; i < m_free.size(); ++i) {
+            count += m_free[i].size();
+        }
+        return count;
+    }
+
+    /// Estimate the memory held by the free messages of the pool
+    /**
+     * @since 0.9.0
      *
-     * @return true if the message was successfully recycled, false otherwse.
+     * @return The estimated number of bytes
      */
-    bool recycle(message * msg) {
-        return false;
+    size_t get_memory_usage() const {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+
+        size_t bytes = 0;
+        for (size_t i = 0; i < m_free.size(); ++i) {
+            bytes += memory_usage::heap_bytes(m_free[i]);
+            for (size_t j = 0; j < m_free[i].size(); ++j) {
+                bytes += m_free[i][j]->get_memory_usage();
+            }
+        }
+        return bytes;
+    }
+private:
+    static size_t get_class_size(size_t c) {
+        return min_class_size << c;
+    }
+
+    /// Returns the smallest size class holding size bytes or num_classes
+    static size_t get_size_class(size_t size) {
+        size_t c = 0;
+        while (c < num_classes && get_class_size(c) < size) {
+            ++c;
+        }
+        return c;
+    }
+
+    message * pop(size_t c) {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+
+        if (m_free[c].empty()) {
+            return NULL;
+        }
+
+        message * msg = m_free[c].back();
+        m_free[c].pop_back();
+        return msg;
     }
+
+    size_t const                        m_max_per_class;
+    std::vector<std::vector<message *> > m_free;
+    mutable lib::mutex                  m_lock;
 };
 
-/// An endpoint message manager that allocates a new manager for each
+/// An endpoint message manager that allocates a new pooled manager for each
 /// connection.
+/**
+ * Each connection gets its own pool so that connections never contend for
+ * the same free lists.
+ *
+ * @since 0.9.0
+ */
 template <typename con_msg_manager>
 class endpoint_msg_manager {
 public:
@@ -201,29 +296,12 @@ public:
      * @return A pointer to the requested connection message manager.
      */
     con_msg_man_ptr get_manager() const {
-        return lib::make_shared<con_msg_manager>();
+        return con_msg_man_ptr(lib::make_shared<con_msg_manager>());
     }
 };
 
-} // namespace alloc
-
-namespace pool {
-
-/// A connection messages manager that maintains a pool of messages that is
-/// used to fulfill get_message requests.
-class con_msg_manager {
-
-};
-
-/// An endpoint manager that maintains a shared pool of connection managers
-/// and returns an appropriate one for the requesting connection.
-class endpoint_msg_manager {
-
-};
-
 } // namespace pool
-
 } // namespace message_buffer
 } // namespace websocketpp
 
-#endif // WEBSOCKETPP_MESSAGE_BUFFER_ALLOC_HPP
+#endif // WEBSOCKETPP_MESSAGE_BUFFER_POOL_HPP
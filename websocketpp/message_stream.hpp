@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_MESSAGE_STREAM_HPP
+#define WEBSOCKETPP_MESSAGE_STREAM_HPP
+
+#include <websocketpp/error.hpp>
+#include <websocketpp/frame.hpp>
+
+#include <websocketpp/common/functional.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/system_error.hpp>
+
+#include <cstddef>
+#include <string>
+
+namespace websocketpp {
+
+/// A message sent in pieces as its payload becomes available
+/**
+ * Created with connection::create_stream. Each non-empty write is sent as
+ * one frame, the first with the stream's opcode and the rest as
+ * continuation frames, so the whole payload never has to be held in memory
+ * at once. finish sends the final frame. With permessage-deflate the chunks
+ * are compressed in order as parts of one compressed message.
+ *
+ * A connection has at most one open stream. Other data messages sent while
+ * it is open are held back and written after the stream is finished. Ping,
+ * pong and close frames are not held back. Destroying an unfinished stream
+ * finishes it.
+ *
+ * How much of the stream is still waiting to be written can be watched with
+ * is_writable and set_drain_handler.
+ *
+ * A stream is used from one thread at a time.
+ *
+ * @since 0.9.0
+ */
+template <typename connection>
+class message_stream {
+public:
+    /// Type of a handler called once buffered data has drained
+    typedef lib::function<void()> drain_handler;
+
+    message_stream(lib::weak_ptr<connection> con, frame::opcode::value op)
+      : m_con(con)
+      , m_opcode(op)
+      , m_started(false)
+      , m_finished(false) {}
+
+    ~message_stream() {
+        if (!m_finished) {
+            finish();
+        }
+    }
+
+    /// Send the next chunk of the message
+    /**
+     * @param chunk The next bytes of the payload
+     * @return Status code, zero on success
+     */
+    lib::error_code write(std::string const & chunk) {
+        return write(chunk.data(),chunk.size());
+    }
+
+    /// Send the next chunk of the message (raw array overload)
+    /**
+     * @param data A pointer to the next bytes of the payload
+     * @param len The number of bytes at data
+     * @return Status code, zero on success
+     */
+    lib::error_code write(void const * data, size_t len) {
+        if (m_finished) {
+            return error::make_error_code(error::invalid_state);
+        }
+        if (len == 0) {
+            return lib::error_code();
+        }
+
+        lib::shared_ptr<connection> con = m_con.lock();
+        if (!con) {
+            return error::make_error_code(error::bad_connection);
+        }
+
+        lib::error_code ec = con->send_stream_frame(m_started ?
+            frame::opcode::continuation : m_opcode, data, len, false);
+        if (!ec) {
+            m_started = true;
+        }
+        return ec;
+    }
+
+    /// Send the final frame of the message
+    /**
+     * The final frame has no payload of its own. Messages held back while
+     * the stream was open are sent after it.
+     *
+     * @return Status code, zero on success
+     */
+    lib::error_code finish() {
+        if (m_finished) {
+            return error::make_error_code(error::invalid_state);
+        }
+        m_finished = true;
+
+        lib::shared_ptr<connection> con = m_con.lock();
+        if (!con) {
+            return error::make_error_code(error::bad_connection);
+        }
+
+        return con->send_stream_frame(m_started ?
+            frame::opcode::continuation : m_opcode, NULL, 0, true);
+    }
+
+    /// Whether the buffered outgoing data is within the drain limit
+    /**
+     * @return True unless more than the limit given to set_drain_handler is
+     * waiting to be written on the connection
+     */
+    bool is_writable() const {
+        lib::shared_ptr<connection> con = m_con.lock();
+        return con && con->stream_writable();
+    }
+
+    /// Get notified when buffered outgoing data drains
+    /**
+     * After a write leaves more than `limit` payload bytes waiting to be
+     * written on the connection, `handler` is called once from the thread
+     * that writes to the transport when the amount has fallen back to
+     * `limit` or below. Should be set before the first write.
+     *
+     * @param limit The most buffered payload bytes that count as writable
+     * @param handler The handler to call, or an empty function for none
+     */
+    void set_drain_handler(size_t limit, drain_handler handler) {
+        lib::shared_ptr<connection> con = m_con.lock();
+        if (con) {
+            con->set_stream_drain_handler(limit,handler);
+        }
+    }
+
+    /// Get the opcode of the message
+    frame::opcode::value get_opcode() const {
+        return m_opcode;
+    }
+
+    /// Whether finish has been called
+    bool is_finished() const {
+        return m_finished;
+    }
+private:
+    lib::weak_ptr<connection> m_con;
+    frame::opcode::value m_opcode;
+    bool m_started;
+    bool m_finished;
+};
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_MESSAGE_STREAM_HPP
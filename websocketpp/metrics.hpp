@@ -0,0 +1,521 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_METRICS_HPP
+#define WEBSOCKETPP_METRICS_HPP
+
+#include <websocketpp/common/histogram.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+#include <websocketpp/extensions/permessage_deflate/tuning.hpp>
+#include <websocketpp/http/constants.hpp>
+
+#include <atomic>
+#include <sstream>
+#include <string>
+
+namespace websocketpp {
+
+/// Kinds of user handlers whose run time is measured
+/**
+ * @see connection::set_slow_handler_threshold
+ *
+ * @since 0.9.0
+ */
+namespace handler_type {
+    enum value {
+        open = 0,
+        close,
+        fail,
+        message,
+        http,
+        validate,
+        ping,
+        pong,
+        pong_timeout,
+        interrupt,
+        count
+    };
+
+    /// Name of a handler type, as used in logs and metric labels
+    inline char const * name(value t) {
+        switch (t) {
+            case open:
+                return "open";
+            case close:
+                return "close";
+            case fail:
+                return "fail";
+            case message:
+                return "message";
+            case http:
+                return "http";
+            case validate:
+                return "validate";
+            case ping:
+                return "ping";
+            case pong:
+                return "pong";
+            case pong_timeout:
+                return "pong_timeout";
+            case interrupt:
+                return "interrupt";
+            default:
+                return "unknown";
+        }
+    }
+} // namespace handler_type
+
+/// Resources a connection uses, see connection::get_usage
+/**
+ * @since 0.9.0
+ */
+namespace usage {
+    enum value {
+        /// Bytes read from the transport
+        bytes_in = 0,
+        /// Bytes handed to the transport
+        bytes_out,
+        /// Complete data messages received
+        messages_in,
+        /// Complete data messages sent
+        messages_out,
+        /// Nanoseconds spent parsing, unmasking and decompressing input
+        consume_time,
+        /// Nanoseconds spent framing and compressing output
+        prepare_time,
+        /// Nanoseconds spent in user handlers
+        handler_time,
+        /// The sum of consume_time, prepare_time and handler_time
+        cpu_time,
+        count
+    };
+} // namespace usage
+
+/// Readings of the metrics of an endpoint taken at one time
+/**
+ * @since 0.9.0
+ */
+struct metrics_snapshot {
+    metrics_snapshot()
+      : connections_opened(0)
+      , connections_failed(0)
+      , connections_closed(0)
+      , connections_open(0)
+      , messages_in(0)
+      , messages_out(0)
+      , bytes_in(0)
+      , bytes_out(0)
+      , writes(0)
+      , send_buffer_bytes(0)
+    {
+        for (size_t i = 0; i < handler_type::count; ++i) {
+            slow_handlers[i] = 0;
+        }
+    }
+
+    /// Connections whose opening handshake succeeded
+    uint64_t connections_opened;
+    /// Connections that failed before or during the opening handshake
+    uint64_t connections_failed;
+    /// Open connections that have since closed
+    uint64_t connections_closed;
+    /// Connections open at the time of the snapshot
+    int64_t connections_open;
+    /// Complete messages received
+    uint64_t messages_in;
+    /// Complete messages sent
+    uint64_t messages_out;
+    /// Bytes read from the transport, handshakes included
+    uint64_t bytes_in;
+    /// Bytes written to the transport, handshakes included
+    uint64_t bytes_out;
+    /// Transport writes completed
+    uint64_t writes;
+    /// Payload bytes queued for sending on all connections
+    int64_t send_buffer_bytes;
+
+    /// Time from accepting or connecting to the end of the opening handshake
+    latency_histogram handshake;
+    /// Time from starting a transport write to its completion
+    latency_histogram write;
+    /// Round trip time of keepalive pings
+    latency_histogram rtt;
+
+    /// Handler calls that took longer than the threshold, by handler_type
+    uint64_t slow_handlers[handler_type::count];
+    /// Run time of the handler calls counted in slow_handlers
+    latency_histogram slow_handler;
+    /// Time handlers posted by the loop lag probe waited to run
+    latency_histogram loop_lag;
+};
+
+/// Counters and histograms shared by the connections of an endpoint
+/**
+ * Connections created by an endpoint with metrics set (see
+ * endpoint::set_metrics) update these as they read, consume, write and
+ * change state. Everything is updated with relaxed atomics, so recording is
+ * lock free and readings taken while connections are active may be slightly
+ * out of step with one another.
+ *
+ * write_openmetrics renders a snapshot in the OpenMetrics text format, which
+ * Prometheus scrapes directly. An http_handler may serve it with respond.
+ *
+ * @since 0.9.0
+ */
+class metrics {
+public:
+    /// Type of a pointer to the compression counters exported alongside
+    typedef lib::shared_ptr<extensions::permessage_deflate::compression_stats>
+        compression_stats_ptr;
+
+    /// Content type of the text rendered by write_openmetrics
+    static char const * content_type() {
+        return "application/openmetrics-text; version=1.0.0; charset=utf-8";
+    }
+
+    metrics()
+      : m_connections_opened(0)
+      , m_connections_failed(0)
+      , m_connections_closed(0)
+      , m_connections_open(0)
+      , m_messages_in(0)
+      , m_messages_out(0)
+      , m_bytes_in(0)
+      , m_bytes_out(0)
+      , m_writes(0)
+      , m_send_buffer_bytes(0)
+    {
+        for (size_t i = 0; i < handler_type::count; ++i) {
+            m_slow_handlers[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /// Export compression counters with the other metrics
+    /**
+     * endpoint::set_metrics passes the endpoint's counters here when
+     * compression stats are enabled.
+     *
+     * @param value The counters to export, or null for none
+     */
+    void set_compression_stats(compression_stats_ptr value) {
+        m_compression_stats = value;
+    }
+
+    /// Record a connection whose opening handshake succeeded
+    /**
+     * @param handshake Time taken to open the connection
+     */
+    void record_open(latency_histogram::duration handshake) {
+        m_connections_opened.fetch_add(1, std::memory_order_relaxed);
+        m_connections_open.fetch_add(1, std::memory_order_relaxed);
+        m_handshake.record(handshake);
+    }
+
+    /// Record a connection that failed to open
+    void record_fail() {
+        m_connections_failed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// Record the close of a connection counted by record_open
+    void record_close() {
+        m_connections_closed.fetch_add(1, std::memory_order_relaxed);
+        m_connections_open.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    /// Record a complete message received
+    void record_message_in() {
+        m_messages_in.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// Record complete messages sent
+    void record_messages_out(uint64_t count) {
+        m_messages_out.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    /// Record bytes read from the transport
+    void record_bytes_in(uint64_t bytes) {
+        m_bytes_in.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    /// Record bytes written to the transport
+    void record_bytes_out(uint64_t bytes) {
+        m_bytes_out.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    /// Record the completion of a transport write
+    /**
+     * @param latency Time from starting the write to its completion
+     */
+    void record_write(latency_histogram::duration latency) {
+        m_writes.fetch_add(1, std::memory_order_relaxed);
+        m_write.record(latency);
+    }
+
+    /// Record the round trip time of a ping
+    void record_rtt(latency_histogram::duration rtt) {
+        m_rtt.record(rtt);
+    }
+
+    /// Record a handler call that took longer than the threshold
+    /**
+     * @param type The kind of handler
+     * @param elapsed How long the handler ran
+     */
+    void record_slow_handler(handler_type::value type,
+        latency_histogram::duration elapsed)
+    {
+        if (type < handler_type::count) {
+            m_slow_handlers[type].fetch_add(1, std::memory_order_relaxed);
+        }
+        m_slow_handler.record(elapsed);
+    }
+
+    /// Record how long a probe posted to the io_context waited to run
+    /**
+     * @see endpoint::set_loop_lag_probe
+     */
+    void record_loop_lag(latency_histogram::duration lag) {
+        m_loop_lag.record(lag);
+    }
+
+    /// Adjust the payload bytes queued for sending
+    /**
+     * @param delta Change in the bytes queued by one connection
+     */
+    void add_send_buffer_bytes(int64_t delta) {
+        m_send_buffer_bytes.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    /// Read every counter and histogram
+    metrics_snapshot get_snapshot() const {
+        metrics_snapshot s;
+        s.connections_opened = load(m_connections_opened);
+        s.connections_failed = load(m_connections_failed);
+        s.connections_closed = load(m_connections_closed);
+        s.connections_open = m_connections_open.load(
+            std::memory_order_relaxed);
+        s.messages_in = load(m_messages_in);
+        s.messages_out = load(m_messages_out);
+        s.bytes_in = load(m_bytes_in);
+        s.bytes_out = load(m_bytes_out);
+        s.writes = load(m_writes);
+        s.send_buffer_bytes = m_send_buffer_bytes.load(
+            std::memory_order_relaxed);
+        s.handshake = m_handshake.snapshot();
+        s.write = m_write.snapshot();
+        s.rtt = m_rtt.snapshot();
+        for (size_t i = 0; i < handler_type::count; ++i) {
+            s.slow_handlers[i] = load(m_slow_handlers[i]);
+        }
+        s.slow_handler = m_slow_handler.snapshot();
+        s.loop_lag = m_loop_lag.snapshot();
+        return s;
+    }
+
+    /// Render the metrics in the OpenMetrics text format
+    /**
+     * Counters are exported with a `_total` suffix, histograms as summaries
+     * in seconds with the 0.5, 0.9, 0.99 and 0.999 quantiles. The output ends
+     * with the `# EOF` marker the format requires.
+     *
+     * @param out The stream to write to
+     * @param prefix Prefix of every metric name
+     */
+    void write_openmetrics(std::ostream & out,
+        std::string const & prefix = "websocketpp") const
+    {
+        metrics_snapshot s = get_snapshot();
+
+        counter(out, prefix, "connections_opened",
+            "Connections whose opening handshake succeeded",
+            s.connections_opened);
+        counter(out, prefix, "connections_failed",
+            "Connections that failed to open", s.connections_failed);
+        counter(out, prefix, "connections_closed",
+            "Open connections that have since closed", s.connections_closed);
+        gauge(out, prefix, "connections_open", "Connections currently open",
+            s.connections_open);
+        counter(out, prefix, "messages_received",
+            "Complete messages received", s.messages_in);
+        counter(out, prefix, "messages_sent", "Complete messages sent",
+            s.messages_out);
+        counter(out, prefix, "received_bytes",
+            "Bytes read from the transport", s.bytes_in);
+        counter(out, prefix, "sent_bytes",
+            "Bytes written to the transport", s.bytes_out);
+        counter(out, prefix, "writes", "Transport writes completed",
+            s.writes);
+        gauge(out, prefix, "send_buffer_bytes",
+            "Payload bytes queued for sending", s.send_buffer_bytes);
+        summary(out, prefix, "handshake_seconds",
+            "Time taken by the opening handshake", s.handshake);
+        summary(out, prefix, "write_seconds",
+            "Time taken by transport writes", s.write);
+        summary(out, prefix, "ping_rtt_seconds",
+            "Round trip time of keepalive pings", s.rtt);
+
+        std::string n = prefix + "_slow_handlers";
+        header(out, n, "counter",
+            "Handler calls that took longer than the threshold");
+        for (size_t i = 0; i < handler_type::count; ++i) {
+            out << n << "_total{handler=\""
+                << handler_type::name(handler_type::value(i)) << "\"} "
+                << s.slow_handlers[i] << "\n";
+        }
+        summary(out, prefix, "slow_handler_seconds",
+            "Run time of handler calls that took longer than the threshold",
+            s.slow_handler);
+        summary(out, prefix, "loop_lag_seconds",
+            "Time work posted to the event loop waited to run", s.loop_lag);
+
+        compression_stats_ptr c = m_compression_stats;
+        if (c) {
+            counter(out, prefix, "compress_in_bytes",
+                "Bytes given to the compressor", c->get_compress_in());
+            counter(out, prefix, "compress_out_bytes",
+                "Bytes produced by the compressor", c->get_compress_out());
+            counter(out, prefix, "decompress_in_bytes",
+                "Bytes given to the decompressor", c->get_decompress_in());
+            counter(out, prefix, "decompress_out_bytes",
+                "Bytes produced by the decompressor",
+                c->get_decompress_out());
+        }
+
+        out << "# EOF\n";
+    }
+
+    /// Render the metrics in the OpenMetrics text format
+    /**
+     * @param prefix Prefix of every metric name
+     * @return The rendered metrics
+     */
+    std::string get_openmetrics(std::string const & prefix = "websocketpp")
+        const
+    {
+        std::stringstream s;
+        write_openmetrics(s, prefix);
+        return s.str();
+    }
+
+    /// Answer an HTTP request with the rendered metrics
+    /**
+     * Meant to be called from an http_handler, for example for requests to
+     * `/metrics`.
+     *
+     * @param con The connection whose request to answer
+     * @param ec Set to the error, if any, from setting the response
+     */
+    template <typename connection_ptr>
+    void respond(connection_ptr con, lib::error_code & ec) const {
+        con->set_status(http::status_code::ok, ec);
+        if (ec) {
+            return;
+        }
+        con->replace_header("Content-Type", content_type(), ec);
+        if (ec) {
+            return;
+        }
+        con->set_body(get_openmetrics(), {}, ec);
+    }
+private:
+    metrics(metrics const &) = delete;
+    metrics & operator=(metrics const &) = delete;
+
+    static uint64_t load(std::atomic<uint64_t> const & v) {
+        return v.load(std::memory_order_relaxed);
+    }
+
+    static void header(std::ostream & out, std::string const & name,
+        char const * type, char const * help)
+    {
+        out << "# TYPE " << name << " " << type << "\n"
+            << "# HELP " << name << " " << help << "\n";
+    }
+
+    static void counter(std::ostream & out, std::string const & prefix,
+        char const * name, char const * help, uint64_t value)
+    {
+        std::string n = prefix + "_" + name;
+        header(out, n, "counter", help);
+        out << n << "_total " << value << "\n";
+    }
+
+    static void gauge(std::ostream & out, std::string const & prefix,
+        char const * name, char const * help, int64_t value)
+    {
+        std::string n = prefix + "_" + name;
+        header(out, n, "gauge", help);
+        out << n << " " << value << "\n";
+    }
+
+    static void summary(std::ostream & out, std::string const & prefix,
+        char const * name, char const * help, latency_histogram const & h)
+    {
+        static double const quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+        std::string n = prefix + "_" + name;
+        header(out, n, "summary", help);
+        for (size_t i = 0; i < sizeof(quantiles)/sizeof(quantiles[0]); ++i) {
+            out << n << "{quantile=\"" << quantiles[i] << "\"} "
+                << seconds(h.percentile(quantiles[i] * 100)) << "\n";
+        }
+        out << n << "_sum "
+            << double(h.sum()) / 1e6 << "\n"
+            << n << "_count " << h.count() << "\n";
+    }
+
+    static double seconds(latency_histogram::duration d) {
+        return double(d.count()) / 1e6;
+    }
+
+    std::atomic<uint64_t> m_connections_opened;
+    std::atomic<uint64_t> m_connections_failed;
+    std::atomic<uint64_t> m_connections_closed;
+    std::atomic<int64_t> m_connections_open;
+    std::atomic<uint64_t> m_messages_in;
+    std::atomic<uint64_t> m_messages_out;
+    std::atomic<uint64_t> m_bytes_in;
+    std::atomic<uint64_t> m_bytes_out;
+    std::atomic<uint64_t> m_writes;
+    std::atomic<int64_t> m_send_buffer_bytes;
+
+    atomic_histogram m_handshake;
+    atomic_histogram m_write;
+    atomic_histogram m_rtt;
+
+    std::atomic<uint64_t> m_slow_handlers[handler_type::count];
+    atomic_histogram m_slow_handler;
+    atomic_histogram m_loop_lag;
+
+    compression_stats_ptr m_compression_stats;
+};
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_METRICS_HPP
@@ -0,0 +1,551 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_MULTIPLEX_HPP
+#define WEBSOCKETPP_MULTIPLEX_HPP
+
+#include <websocketpp/common/functional.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+#include <websocketpp/common/thread.hpp>
+#include <websocketpp/error.hpp>
+#include <websocketpp/frame.hpp>
+#include <websocketpp/utf8_validator.hpp>
+
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace websocketpp {
+
+/// Logical channels multiplexed over one WebSocket connection
+/**
+ * Clients that would otherwise open several WebSockets to the same server,
+ * one per feed, can run them as channels of one connection and pay for one
+ * handshake, one set of timers and one set of buffers. Both ends negotiate
+ * the subprotocol returned by subprotocol(), see offer and select, and wrap
+ * the connection in a multiplexer.
+ *
+ * Each channel message travels as one binary WebSocket message: a kind
+ * byte, the channel id as an unsigned LEB128 varint, then the payload.
+ *
+ *     kind 0: text message, the payload is UTF-8
+ *     kind 1: binary message
+ *     kind 2: credit, the payload is a varint number of bytes
+ *     kind 3: close the channel, no payload
+ *
+ * Channels open implicitly with their first message. Each direction of a
+ * channel has a flow control window of the same size on both ends: a
+ * message is only sent while the window holds its payload, or while the
+ * window is full so that oversized messages still get through one at a
+ * time. The receiver grants credit back once its handler consumed half a
+ * window, so a slow channel stalls on its own window rather than filling
+ * the connection's send queue.
+ *
+ * Messages waiting for the connection are kept per channel and scheduled
+ * round robin, one message per channel in turn, with no more than a set
+ * number of payload bytes handed to the connection and not yet written,
+ * see connection::send with a send handler. A bulk channel therefore cannot
+ * hold a small message of another channel behind all of its own.
+ *
+ * Call on_message from the connection's message handler. Handlers run with
+ * no lock held and may send. The multiplexer does not keep the connection
+ * alive and must be destroyed on the connection's strand, for example in
+ * its close or fail handler.
+ *
+ * Usage:
+ *
+ *     // client, before connect
+ *     websocketpp::multiplexer<connection_type>::offer(con, ec);
+ *     // server, in the validate handler
+ *     websocketpp::multiplexer<connection_type>::select(con);
+ *     // both, once open
+ *     websocketpp::multiplexer<connection_type> mux(con);
+ *     mux.set_handler(1, prices_handler);
+ *     mux.send(2, "subscribe news", websocketpp::frame::opcode::text);
+ *
+ * @since 0.9.0
+ */
+template <typename connection_type>
+class multiplexer {
+public:
+    typedef lib::shared_ptr<connection_type> connection_ptr;
+    typedef typename connection_type::message_ptr message_ptr;
+
+    /// Identifies a channel
+    typedef uint64_t channel_id;
+
+    /// Called with each message of a channel
+    /**
+     * The payload refers to the WebSocket message and is only valid during
+     * the call.
+     */
+    typedef lib::function<void(channel_id, frame::opcode::value,
+        std::string_view)> channel_handler;
+
+    /// Called when the peer closes its direction of a channel
+    typedef lib::function<void(channel_id)> close_handler;
+
+    /// The subprotocol both ends negotiate
+    static char const * subprotocol() {
+        return "websocketpp.mux.v1";
+    }
+
+    /// Request the multiplexing subprotocol on a client connection
+    static void offer(connection_ptr con, lib::error_code & ec) {
+        con->add_subprotocol(subprotocol(), ec);
+    }
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+    /// Request the multiplexing subprotocol on a client connection
+    /// (exception version)
+    static void offer(connection_ptr con) {
+        con->add_subprotocol(subprotocol());
+    }
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
+    /// Accept the multiplexing subprotocol on a server connection
+    /**
+     * Call from the validate handler.
+     *
+     * @return Whether the client requested the subprotocol, and so whether
+     * it was selected
+     */
+    static bool select(connection_ptr con) {
+        std::vector<std::string> const & requested =
+            con->get_requested_subprotocols();
+        for (size_t i = 0; i < requested.size(); ++i) {
+            if (requested[i] == subprotocol()) {
+                lib::error_code ec;
+                con->select_subprotocol(requested[i], ec);
+                return !ec;
+            }
+        }
+        return false;
+    }
+
+    /// Construct a multiplexer over an open connection
+    /**
+     * @param con The connection to carry the channels
+     * @param window The flow control window of each channel direction in
+     * payload bytes, the same on both ends
+     * @param in_flight The number of payload bytes handed to the connection
+     * and not yet written before further messages wait for their turn
+     */
+    explicit multiplexer(connection_ptr con, size_t window = 256*1024,
+        size_t in_flight = 64*1024)
+      : m_con(con)
+      , m_window(int64_t(window ? window : 1))
+      , m_in_flight_limit(in_flight ? in_flight : 1)
+      , m_in_flight(0)
+      , m_pumping(false)
+      , m_alive(lib::make_shared<bool>(true))
+    {}
+
+    /// Set the handler of a channel
+    void set_handler(channel_id id, channel_handler h) {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        m_handlers[id] = std::move(h);
+    }
+
+    /// Set the handler of channels with no handler of their own
+    void set_default_handler(channel_handler h) {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        m_default_handler = std::move(h);
+    }
+
+    /// Set the handler called when the peer closes a channel
+    void set_close_handler(close_handler h) {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        m_close_handler = std::move(h);
+    }
+
+    /// Send a message on a channel
+    /**
+     * The message is queued on the channel and handed to the connection on
+     * its turn, once the channel's window and the in flight limit allow.
+     *
+     * @param id The channel
+     * @param payload The payload of the message
+     * @param op The opcode of the message. Must be text or binary.
+     * @return An error code, empty if the message was queued
+     */
+    lib::error_code send(channel_id id, std::string_view payload,
+        frame::opcode::value op = frame::opcode::binary)
+    {
+        if (op != frame::opcode::text && op != frame::opcode::binary) {
+            return error::make_error_code(error::payload_violation);
+        }
+        if (m_con.expired()) {
+            return error::make_error_code(error::bad_connection);
+        }
+
+        std::string encoded;
+        encode(encoded, op == frame::opcode::text ? kind_text : kind_binary,
+            id, payload.size());
+        encoded.append(payload.data(), payload.size());
+
+        {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            out_channel & c = get_out(id);
+            c.queue.push_back(pending(std::move(encoded), payload.size()));
+            schedule(id, c);
+        }
+        this->pump();
+        return lib::error_code();
+    }
+
+    /// Close this end's direction of a channel once its queued messages are
+    /// sent
+    /**
+     * The peer's close handler runs when the close arrives. Sending on the
+     * channel again opens it afresh.
+     */
+    void close_channel(channel_id id) {
+        {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            out_channel & c = get_out(id);
+            std::string encoded;
+            encode(encoded, kind_close, id, 0);
+            c.queue.push_back(pending(std::move(encoded), 0));
+            schedule(id, c);
+        }
+        this->pump();
+    }
+
+    /// Get the payload bytes a channel may still send before it waits
+    int64_t get_send_window(channel_id id) const {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        typename out_map::const_iterator it = m_out.find(id);
+        return it == m_out.end() ? m_window : it->second.window;
+    }
+
+    /// Get the number of messages queued on a channel
+    size_t get_queued(channel_id id) const {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        typename out_map::const_iterator it = m_out.find(id);
+        return it == m_out.end() ? 0 : it->second.queue.size();
+    }
+
+    /// Process a message received on the connection
+    /**
+     * @param msg The message passed to the message handler
+     * @return error::payload_violation if the message is not a well formed
+     * channel message or overruns its channel's window, in which case the
+     * caller should close the connection. Otherwise an empty error code.
+     */
+    lib::error_code on_message(message_ptr msg) {
+        std::string const & raw = msg->get_payload();
+        if (msg->get_opcode() != frame::opcode::binary || raw.empty()) {
+            return error::make_error_code(error::payload_violation);
+        }
+
+        size_t pos = 1;
+        uint64_t id;
+        if (!decode(raw, pos, id)) {
+            return error::make_error_code(error::payload_violation);
+        }
+        unsigned char kind = static_cast<unsigned char>(raw[0]);
+
+        if (kind == kind_credit) {
+            uint64_t credit;
+            if (!decode(raw, pos, credit) || pos != raw.size()) {
+                return error::make_error_code(error::payload_violation);
+            }
+            {
+                lib::lock_guard<lib::mutex> guard(m_lock);
+                // credit for a channel closed since is stale
+                typename out_map::iterator it = m_out.find(id);
+                if (it != m_out.end()) {
+                    it->second.window += int64_t(credit);
+                    schedule(id, it->second);
+                }
+            }
+            this->pump();
+            return lib::error_code();
+        }
+
+        if (kind == kind_close) {
+            if (pos != raw.size()) {
+                return error::make_error_code(error::payload_violation);
+            }
+            close_handler handler;
+            {
+                lib::lock_guard<lib::mutex> guard(m_lock);
+                m_in.erase(id);
+                handler = m_close_handler;
+            }
+            if (handler) {
+                handler(id);
+            }
+            return lib::error_code();
+        }
+
+        if (kind != kind_text && kind != kind_binary) {
+            return error::make_error_code(error::payload_violation);
+        }
+
+        std::string_view payload(raw.data() + pos, raw.size() - pos);
+        if (kind == kind_text &&
+            !utf8_validator::validate(payload.data(), payload.size()))
+        {
+            return error::make_error_code(error::payload_violation);
+        }
+
+        channel_handler handler;
+        {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            in_channel & c = m_in.try_emplace(id, m_window).first->second;
+            int64_t size = int64_t(payload.size());
+            if (size > c.window && c.window != m_window) {
+                return error::make_error_code(error::payload_violation);
+            }
+            c.window -= size;
+
+            typename handler_map::const_iterator it = m_handlers.find(id);
+            handler = it == m_handlers.end() ? m_default_handler : it->second;
+        }
+
+        if (handler) {
+            handler(id, kind == kind_text ? frame::opcode::text :
+                frame::opcode::binary, payload);
+        }
+
+        // grant the consumed bytes back once they add up to half a window
+        std::string credit;
+        {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            typename in_map::iterator it = m_in.find(id);
+            if (it != m_in.end() && m_window - it->second.window >=
+                (m_window + 1) / 2)
+            {
+                uint64_t grant = uint64_t(m_window - it->second.window);
+                it->second.window = m_window;
+                encode(credit, kind_credit, id, 0);
+                put_varint(credit, grant);
+            }
+        }
+        if (!credit.empty()) {
+            if (connection_ptr con = m_con.lock()) {
+                con->send(credit.data(), credit.size(), frame::opcode::binary);
+            }
+        }
+        return lib::error_code();
+    }
+private:
+    enum {
+        kind_text = 0,
+        kind_binary = 1,
+        kind_credit = 2,
+        kind_close = 3
+    };
+
+    /// An encoded channel message waiting for its turn
+    struct pending {
+        pending(std::string && b, size_t s) : bytes(std::move(b)), size(s) {}
+
+        std::string bytes;
+        /// Payload bytes counted against the window
+        size_t size;
+    };
+
+    struct out_channel {
+        explicit out_channel(int64_t w) : window(w), scheduled(false) {}
+
+        std::deque<pending> queue;
+        int64_t window;
+        /// Whether or not the channel is in m_ready
+        bool scheduled;
+    };
+
+    struct in_channel {
+        explicit in_channel(int64_t w) : window(w) {}
+
+        int64_t window;
+    };
+
+    typedef std::unordered_map<channel_id, out_channel> out_map;
+    typedef std::unordered_map<channel_id, in_channel> in_map;
+    typedef std::unordered_map<channel_id, channel_handler> handler_map;
+
+    multiplexer(multiplexer const &) = delete;
+    multiplexer & operator=(multiplexer const &) = delete;
+
+    static void put_varint(std::string & out, uint64_t value) {
+        do {
+            unsigned char b = static_cast<unsigned char>(value & 0x7f);
+            value >>= 7;
+            if (value) {
+                b |= 0x80;
+            }
+            out.push_back(static_cast<char>(b));
+        } while (value);
+    }
+
+    static bool decode(std::string const & in, size_t & pos, uint64_t & value)
+    {
+        value = 0;
+        for (unsigned shift = 0; shift < 64 && pos < in.size(); shift += 7) {
+            unsigned char b = static_cast<unsigned char>(in[pos++]);
+            value |= uint64_t(b & 0x7f) << shift;
+            if (!(b & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void encode(std::string & out, unsigned char kind, channel_id id,
+        size_t reserve)
+    {
+        out.reserve(reserve + 11);
+        out.push_back(static_cast<char>(kind));
+        put_varint(out, id);
+    }
+
+    /// Get the sending side of a channel, opening it, under m_lock
+    out_channel & get_out(channel_id id) {
+        return m_out.try_emplace(id, m_window).first->second;
+    }
+
+    /// Whether or not the front message of a channel may be sent, under m_lock
+    bool sendable(out_channel const & c) const {
+        if (c.queue.empty()) {
+            return false;
+        }
+        int64_t size = int64_t(c.queue.front().size);
+        return size <= c.window || c.window == m_window;
+    }
+
+    /// Put a channel in the round robin if it can send, under m_lock
+    void schedule(channel_id id, out_channel & c) {
+        if (!c.scheduled && sendable(c)) {
+            c.scheduled = true;
+            m_ready.push_back(id);
+        }
+    }
+
+    /// Hand channel messages to the connection in round robin order
+    void pump() {
+        connection_ptr con = m_con.lock();
+        if (!con) {
+            return;
+        }
+
+        for (;;) {
+            std::string bytes;
+            size_t size = 0;
+            {
+                lib::lock_guard<lib::mutex> guard(m_lock);
+                if (m_pumping) {
+                    // a send handler ran within send or on another thread,
+                    // the loop already running picks up where it left off
+                    return;
+                }
+                if (m_ready.empty() || m_in_flight >= m_in_flight_limit) {
+                    return;
+                }
+
+                channel_id id = m_ready.front();
+                m_ready.pop_front();
+                typename out_map::iterator it = m_out.find(id);
+                out_channel & c = it->second;
+                c.scheduled = false;
+
+                pending & p = c.queue.front();
+                bool closing = p.bytes[0] == char(kind_close);
+                bytes.swap(p.bytes);
+                size = p.size;
+                c.window -= int64_t(size);
+                c.queue.pop_front();
+
+                if (closing && c.queue.empty()) {
+                    m_out.erase(it);
+                } else {
+                    schedule(id, c);
+                }
+
+                m_in_flight += size;
+                m_pumping = true;
+            }
+
+            message_ptr msg = con->get_message(frame::opcode::binary,
+                bytes.size());
+            lib::error_code ec;
+            if (msg) {
+                msg->get_raw_payload().swap(bytes);
+                lib::weak_ptr<bool> alive = m_alive;
+                ec = con->send(msg, [this, alive, size](lib::error_code const &)
+                {
+                    if (alive.expired()) {
+                        return;
+                    }
+                    {
+                        lib::lock_guard<lib::mutex> guard(m_lock);
+                        m_in_flight -= size;
+                    }
+                    this->pump();
+                });
+            } else {
+                ec = error::make_error_code(error::no_outgoing_buffers);
+            }
+
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            if (ec) {
+                // the send handler is not called for a refused message
+                m_in_flight -= size;
+            }
+            m_pumping = false;
+        }
+    }
+
+    lib::weak_ptr<connection_type> m_con;
+    int64_t const m_window;
+    size_t const m_in_flight_limit;
+
+    mutable lib::mutex m_lock;
+    out_map m_out;
+    in_map m_in;
+    handler_map m_handlers;
+    channel_handler m_default_handler;
+    close_handler m_close_handler;
+    /// Channels with a sendable message, in round robin order
+    std::deque<channel_id> m_ready;
+    size_t m_in_flight;
+    /// Whether or not a pump loop is running
+    bool m_pumping;
+    /// Expires with the multiplexer, for send handlers that outlive it
+    lib::shared_ptr<bool> m_alive;
+};
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_MULTIPLEX_HPP
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_PRECOMPILED_STOCK_HPP
+#define WEBSOCKETPP_PRECOMPILED_STOCK_HPP
+
+/// Explicitly instantiate the class templates behind a stock asio config
+/**
+ * Expands to explicit instantiation declarations with ext set to extern and
+ * to explicit instantiation definitions with ext left empty. Covers the
+ * role, its endpoint and connection, the asio transport and the processors.
+ * Member templates, and class templates not listed here, are still
+ * instantiated where they are used.
+ *
+ * @param ext extern, or nothing
+ * @param role server or client
+ * @param cfg The config, such as config::asio
+ */
+#define WEBSOCKETPP_STOCK_TEMPLATES(ext, role, cfg) \
+    namespace websocketpp { \
+    ext template class processor::hybi00<cfg>; \
+    ext template class processor::hybi13<cfg>; \
+    ext template class processor::hybi08<cfg>; \
+    ext template class processor::hybi07<cfg>; \
+    ext template class transport::asio::connection<cfg::transport_config>; \
+    ext template class transport::asio::endpoint<cfg::transport_config>; \
+    ext template class connection<cfg>; \
+    ext template class endpoint<connection<cfg>, cfg>; \
+    ext template class role<cfg>; \
+    }
+
+#endif // WEBSOCKETPP_PRECOMPILED_STOCK_HPP
@@ -154,7 +154,14 @@ enum processor_errors {
     
     /// Short Ke3 read. Hybi00 requires a third key to be read from the 8 bytes
     /// after the handshake. Less than 8 bytes were read.
-    short_key3
+    short_key3,
+
+    /// Incoming messages of all connections hold as much memory as allowed
+    inbound_memory_limit,
+
+    /// A message transformed by the extension chain can not be delivered in
+    /// chunks
+    extension_chunks
 };
 
 /// Category for processor errors
@@ -228,6 +235,11 @@ public:
                 return "Extensions are disabled";
             case error::short_key3:
                 return "Short Hybi00 Key 3 read";
+            case error::inbound_memory_limit:
+                return "Inbound message memory limit reached";
+            case error::extension_chunks:
+                return "Messages transformed by extensions can not be "
+                    "delivered in chunks";
             default:
                 return "Unknown";
         }
@@ -280,6 +292,8 @@ inline close::status::value to_ws(lib::error_code ec) {
             return close::status::invalid_payload;
         case error::message_too_big:
             return close::status::message_too_big;
+        case error::inbound_memory_limit:
+            return close::status::try_again_later;
         default:
             return close::status::internal_endpoint_error;
     }
@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_PROCESSOR_HANDSHAKE_TEMPLATE_HPP
+#define WEBSOCKETPP_PROCESSOR_HANDSHAKE_TEMPLATE_HPP
+
+#include <websocketpp/processors/base.hpp>
+
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/system_error.hpp>
+#include <websocketpp/common/thread.hpp>
+#include <websocketpp/http/constants.hpp>
+
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace websocketpp {
+namespace processor {
+
+/// Pre-serialized 101 response shared by all connections of a server
+/**
+ * Apart from the accept key and the negotiated extensions and subprotocol,
+ * the response to every accepted RFC6455 handshake is the same bytes. The
+ * endpoint builds this template once and processors that support it write
+ * the response by copying it and filling in the fixed width accept key slot,
+ * rather than inserting each header into an http::parser::response and
+ * serializing that.
+ *
+ * Headers are laid out in the same order http::parser::response::raw uses,
+ * so the bytes on the wire don't depend on which path produced them.
+ *
+ * @since 0.9.0
+ */
+class handshake_template {
+public:
+    /// Length of a base64 encoded Sec-WebSocket-Accept value
+    static size_t const accept_key_size = 28;
+
+    /// Build the template
+    /**
+     * @param server The value of the Server header, empty to leave it out
+     */
+    explicit handshake_template(std::string const & server)
+      : m_server(server)
+    {
+        m_head = "HTTP/1.1 101 ";
+        m_head += http::status_code::get_string(
+            http::status_code::switching_protocols);
+        m_head += "\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: ";
+        m_slot = m_head.size();
+        m_head.append(accept_key_size, ' ');
+        m_head += "\r\n";
+
+        if (!server.empty()) {
+            m_tail = "Server: " + server + "\r\n";
+        }
+        m_tail += "Upgrade: websocket\r\n\r\n";
+    }
+
+    /// Return the Server header value the template was built with
+    std::string const & get_server() const {
+        return m_server;
+    }
+
+    /// Write a response
+    /**
+     * @param [in] accept_key The Sec-WebSocket-Accept value
+     * @param [in] extensions The negotiated extensions, may be empty
+     * @param [in] subprotocol The selected subprotocol, may be empty
+     * @param [out] out The string to write the response to
+     * @return A status code, invalid_arguments if the key has the wrong size
+     */
+    lib::error_code write(std::string const & accept_key,
+        std::string const & extensions, std::string const & subprotocol,
+        std::string & out) const
+    {
+        if (accept_key.size() != accept_key_size) {
+            return error::make_error_code(error::invalid_arguments);
+        }
+
+        size_t size = m_head.size() + m_tail.size();
+        if (!extensions.empty()) {
+            size += sizeof(extensions_line) - 1 + extensions.size() + 2;
+        }
+        if (!subprotocol.empty()) {
+            size += sizeof(subprotocol_line) - 1 + subprotocol.size() + 2;
+        }
+
+        out.clear();
+        out.reserve(size);
+        out.append(m_head);
+        std::memcpy(&out[m_slot], accept_key.data(), accept_key_size);
+
+        if (!extensions.empty()) {
+            out.append(extensions_line, sizeof(extensions_line) - 1);
+            out.append(extensions);
+            out.append("\r\n", 2);
+        }
+        if (!subprotocol.empty()) {
+            out.append(subprotocol_line, sizeof(subprotocol_line) - 1);
+            out.append(subprotocol);
+            out.append("\r\n", 2);
+        }
+
+        out.append(m_tail);
+        return lib::error_code();
+    }
+private:
+    static constexpr char extensions_line[] = "Sec-WebSocket-Extensions: ";
+    static constexpr char subprotocol_line[] = "Sec-WebSocket-Protocol: ";
+
+    std::string m_server;
+    std::string m_head;
+    std::string m_tail;
+    size_t      m_slot;
+};
+
+/// Pre-serialized upgrade request of a client, for one target
+/**
+ * The handshake requests a client sends to one URI differ only in their
+ * Sec-WebSocket-Key. A request_template keeps a filled in request and its
+ * serialized bytes, so that processors that support it write later requests
+ * by copying both and filling in the fixed width key slot, rather than
+ * building the headers and serializing them for every connection.
+ *
+ * @since 0.9.0
+ */
+template <typename request_type>
+class request_template {
+public:
+    /// Length of a base64 encoded Sec-WebSocket-Key value
+    static size_t const key_size = 24;
+
+    /// Build the template from a request and its serialized bytes
+    /**
+     * Check valid() before using the template.
+     *
+     * @param req The request, with the key it was serialized with
+     * @param raw The serialized request
+     */
+    request_template(request_type const & req, std::string const & raw)
+      : m_request(req)
+      , m_bytes(raw)
+      , m_slot(std::string::npos)
+    {
+        static char const line[] = "\r\nSec-WebSocket-Key: ";
+        size_t const pos = m_bytes.find(line);
+        if (pos == std::string::npos) {
+            return;
+        }
+        size_t const slot = pos + sizeof(line) - 1;
+        if (m_bytes.size() >= slot + key_size + 2 &&
+            m_bytes.compare(slot + key_size, 2, "\r\n") == 0)
+        {
+            m_slot = slot;
+        }
+    }
+
+    /// Whether the request had a key slot to fill in
+    bool valid() const {
+        return m_slot != std::string::npos;
+    }
+
+    /// Get the request the template was built from
+    request_type const & get_request() const {
+        return m_request;
+    }
+
+    /// Write a request
+    /**
+     * @param [in] key The Sec-WebSocket-Key value, key_size characters
+     * @param [out] out The string to write the request to
+     */
+    void write(char const * key, std::string & out) const {
+        out = m_bytes;
+        std::memcpy(&out[m_slot], key, key_size);
+    }
+private:
+    request_type m_request;
+    std::string m_bytes;
+    size_t m_slot;
+};
+
+/// Request templates of a client endpoint, by target
+/**
+ * Holds the templates of up to a fixed number of targets. Once full, further
+ * targets are not added and their requests are built as usual. A target is
+ * the URI, requested subprotocols and user agent, which together decide
+ * the bytes of an untouched request.
+ *
+ * @since 0.9.0
+ */
+template <typename request_type>
+class request_template_cache {
+public:
+    typedef lib::shared_ptr<request_template<request_type> const> entry_ptr;
+
+    /// Create a cache
+    /**
+     * @param capacity The most targets held
+     */
+    explicit request_template_cache(size_t capacity)
+      : m_capacity(capacity) {}
+
+    /// Build the key of a target
+    static std::string make_key(std::string const & uri,
+        std::vector<std::string> const & subprotocols,
+        std::string const & user_agent)
+    {
+        std::string k = uri;
+        for (size_t i = 0; i < subprotocols.size(); ++i) {
+            k += '\n';
+            k += subprotocols[i];
+        }
+        k += '\0';
+        k += user_agent;
+        return k;
+    }
+
+    /// Look up the template of a target
+    /**
+     * @param key The target, see make_key
+     * @return The template, or null if there is none
+     */
+    entry_ptr find(std::string const & key) const {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        typename map_type::const_iterator it = m_entries.find(key);
+        return it == m_entries.end() ? entry_ptr() : it->second;
+    }
+
+    /// Add the template of a target, unless the cache is full
+    /**
+     * @param key The target, see make_key
+     * @param req The request, with the key it was serialized with
+     * @param raw The serialized request
+     */
+    void insert(std::string const & key, request_type const & req,
+        std::string const & raw)
+    {
+        entry_ptr e = lib::make_shared<request_template<request_type> const>(
+            req, raw);
+        if (!e->valid()) {
+            return;
+        }
+
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        if (m_entries.size() < m_capacity) {
+            m_entries.emplace(key, std::move(e));
+        }
+    }
+
+    /// Get the number of targets held
+    size_t size() const {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        return m_entries.size();
+    }
+
+    /// Remove every template
+    void clear() {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        m_entries.clear();
+    }
+private:
+    typedef std::unordered_map<std::string, entry_ptr> map_type;
+
+    mutable lib::mutex m_lock;
+    map_type m_entries;
+    size_t const m_capacity;
+};
+
+} // namespace processor
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_PROCESSOR_HANDSHAKE_TEMPLATE_HPP
@@ -30,19 +30,28 @@
 
 #include <websocketpp/processors/processor.hpp>
 
+#include <websocketpp/config/traits.hpp>
+
+#include <websocketpp/extensions/chain.hpp>
+#include <websocketpp/extensions/trusted_link.hpp>
+
 #include <websocketpp/frame.hpp>
 #include <websocketpp/http/constants.hpp>
 
 #include <websocketpp/utf8_validator.hpp>
+#include <websocketpp/common/spill_file.hpp>
 #include <websocketpp/sha1/sha1.hpp>
 #include <websocketpp/base64/base64.hpp>
+#include <websocketpp/trace/none.hpp>
 
 #include <websocketpp/common/network.hpp>
 #include <websocketpp/common/platforms.hpp>
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <utility>
 
@@ -56,6 +65,7 @@ public:
     typedef processor<config> base;
 
     typedef typename config::request_type request_type;
+    typedef typename base::request_template_type request_template_type;
     typedef typename config::response_type response_type;
 
     typedef typename config::message_type message_type;
@@ -66,6 +76,13 @@ public:
     typedef typename config::rng_type rng_type;
 
     typedef typename config::permessage_deflate_type permessage_deflate_type;
+    typedef typename base::permessage_zstd_type permessage_zstd_type;
+    typedef typename base::zstd_dictionary_list zstd_dictionary_list;
+    typedef typename extensions::chain_policy<config>::type
+        extension_chain_type;
+    typedef extensions::trusted_link::policy<config> trusted_link_policy;
+
+    typedef typename trace::policy<config>::type trace_type;
 
     typedef std::pair<lib::error_code,std::string> err_str_pair;
 
@@ -73,18 +90,137 @@ public:
       : processor<config>(secure, p_is_server)
       , m_msg_manager(manager)
       , m_rng(rng)
+      , m_view_ready(false)
+      , m_chunk_ready(false)
+      , m_chunk_first(false)
+      , m_chunk_last(false)
+      , m_chunk_total(0)
+      , m_inbound_charged(0)
+      , m_direct_payload(false)
+      , m_direct_cursor(0)
+      , m_stream_open(false)
+      , m_stream_text(false)
+      , m_stream_compressed(false)
+      , m_trusted_link(false)
     {
         reset_headers();
     }
 
+    ~hybi13() {
+        release_inbound();
+    }
+
     int get_version() const {
         return 13;
     }
 
+    /// The extensions of config::extension_chain_type
+    /**
+     * @since 0.9.0
+     */
+    extension_chain_type & get_extension_chain() {
+        return m_extension_chain;
+    }
+
+    /// Whether trusted-link mode was negotiated for this connection
+    /**
+     * @since 0.9.0
+     */
+    bool is_trusted_link() const {
+        return m_trusted_link;
+    }
+
     bool has_permessage_deflate() const {
         return m_permessage_deflate.is_implemented();
     }
 
+    void set_deflate_memory(int mem_level,
+        lib::shared_ptr<extensions::permessage_deflate::memory_budget> budget)
+    {
+        if (mem_level != 0) {
+            m_permessage_deflate.set_mem_level(mem_level);
+        }
+        m_permessage_deflate.set_memory_budget(budget);
+    }
+
+    void set_inbound_memory_budget(lib::shared_ptr<memory_budget> budget) {
+        release_inbound();
+        m_inbound_budget = budget;
+    }
+
+    void set_deflate_dictionary(std::string const & id,
+        lib::shared_ptr<std::string const> dictionary)
+    {
+        m_permessage_deflate.set_dictionary(id, dictionary);
+    }
+
+    lib::error_code set_deflate_params(int level,
+        extensions::permessage_deflate::strategy::value strategy)
+    {
+        return m_permessage_deflate.set_compression_params(level, strategy);
+    }
+
+    void set_deflate_stats(
+        lib::shared_ptr<extensions::permessage_deflate::compression_stats> stats)
+    {
+        m_permessage_deflate.set_stats(stats);
+    }
+
+    lib::error_code set_zstd_params(int level,
+        lib::shared_ptr<zstd_dictionary_list const> dictionaries)
+    {
+        if (!m_permessage_zstd.is_implemented()) {
+            return lib::error_code();
+        }
+        m_permessage_zstd.set_dictionaries(dictionaries);
+        if (level == 0) {
+            return lib::error_code();
+        }
+        return m_permessage_zstd.set_compression_level(level);
+    }
+
+    void release_idle_deflate(bool outgoing) {
+        // a partly read message still needs the inflate history
+        m_permessage_deflate.release_idle(outgoing, !m_data_msg.msg_ptr);
+    }
+
+    void hibernate(bool outgoing) {
+        // a partly read message still needs the inflate history and its
+        // chunk buffer, which is charged to the inbound budget
+        bool const between = !m_data_msg.msg_ptr;
+
+        m_permessage_deflate.release_contexts(outgoing, between);
+        m_permessage_zstd.release_contexts(outgoing, between);
+        if (between) {
+            std::string().swap(m_chunk_out);
+        }
+    }
+
+    size_t get_memory_usage() const {
+        size_t bytes = sizeof(*this) + memory_usage::heap_bytes(m_chunk_out);
+        if (m_data_msg.msg_ptr) {
+            bytes += m_data_msg.msg_ptr->get_memory_usage();
+        }
+        if (m_control_msg.msg_ptr) {
+            bytes += m_control_msg.msg_ptr->get_memory_usage();
+        }
+        return bytes;
+    }
+
+    size_t get_inbound_memory_usage() const {
+        size_t bytes = memory_usage::heap_bytes(m_chunk_out);
+        if (m_data_msg.msg_ptr) {
+            bytes += memory_usage::heap_bytes(
+                m_data_msg.msg_ptr->get_raw_payload());
+        }
+        return bytes;
+    }
+
+    size_t get_deflate_memory_usage() const {
+        return m_permessage_deflate.get_memory_usage() +
+            m_permessage_zstd.get_memory_usage();
+    }
+
     err_str_pair negotiate_extensions(request_type const & request) {
         return negotiate_extensions_helper(request);
     }
@@ -125,64 +261,98 @@ public:
 
         http::parameter_list::const_iterator it;
 
-        // look through the list of extension requests to find the first
-        // one that we can accept.
-        if (m_permessage_deflate.is_implemented()) {
-            err_str_pair neg_ret;
-            for (it = p.begin(); it != p.end(); ++it) {
-                // not a permessage-deflate extension request, ignore
-                if (it->first != "permessage-deflate") {
-                    continue;
-                }
+        // look through the list of extension requests, in the order of the
+        // remote endpoint's preference, to find the first one that we can
+        // accept. Both compression extensions mark frames with rsv1, so at
+        // most one of them is negotiated.
+        for (it = p.begin(); it != p.end(); ++it) {
+            bool done = false;
+
+            if (it->first == "permessage-deflate" &&
+                m_permessage_deflate.is_implemented())
+            {
+                done = negotiate_extension(m_permessage_deflate, it->second,
+                    ret);
+            } else if (it->first == extensions::permessage_zstd::extension_name
+                && m_permessage_zstd.is_implemented())
+            {
+                done = negotiate_extension(m_permessage_zstd, it->second, ret);
+            }
 
-                // if we have already successfully negotiated this extension
-                // then skip any other requests to negotiate the same one
-                // with different parameters 
-                if (m_permessage_deflate.is_enabled()) {
-                    continue;
-                }
-                
-                // attempt to negotiate this offer
-                neg_ret = m_permessage_deflate.negotiate(it->second);
+            if (done) {
+                break;
+            }
+        }
 
-                if (neg_ret.first) {
-                    // negotiation offer failed. Do nothing. We will continue
-                    // searching for a permessage-deflate config that succeeds
-                    continue;
+        // trusted-link mode is independent of the others and only accepted
+        // when this side opted in as well
+        if (trusted_link_policy::value && !ret.first) {
+            for (it = p.begin(); it != p.end(); ++it) {
+                if (it->first == extensions::trusted_link::extension_name) {
+                    m_trusted_link = true;
+                    if (!ret.second.empty()) {
+                        ret.second += ", ";
+                    }
+                    ret.second += extensions::trusted_link::extension_name;
+                    break;
                 }
+            }
+        }
+
+        // then the extensions of the chain, each independently
+        if (extension_chain_type::size > 0 && !ret.first) {
+            err_str_pair chain_ret = m_extension_chain.negotiate(p,
+                base::m_server);
 
-                // Negotiation tentatively succeeded
+            ret.first = chain_ret.first;
+            if (!ret.second.empty() && !chain_ret.second.empty()) {
+                ret.second += ", ";
+            }
+            ret.second += chain_ret.second;
+        }
 
-                // Actually try to initialize the extension before we
-                // deem negotiation complete
-                lib::error_code ec = m_permessage_deflate.init(base::m_server);
+        return ret;
+    }
 
-                if (ec) {
-                    // Negotiation succeeded but initialization failed this is 
-                    // an error that should stop negotiation of permessage 
-                    // deflate. Return the reason for the init failure
+    /// Negotiate one offer of a compression extension
+    /**
+     * @param ext The extension to negotiate
+     * @param offer The attributes of the offer
+     * @param ret Receives the response to append or the init error
+     * @return Whether to stop looking at further offers
+     */
+    template <typename extension_type>
+    bool negotiate_extension(extension_type & ext,
+        http::attribute_list const & offer, err_str_pair & ret)
+    {
+        err_str_pair neg_ret = ext.negotiate(offer);
 
-                    ret.first = ec;
-                    break;
-                } else {
-                    // Successfully initialized, push the negotiated response into
-                    // the reply and stop looking for additional permessage-deflate
-                    // extensions
-                    ret.second += neg_ret.second;
-                    break;
-                }
-            }
+        if (neg_ret.first) {
+            // negotiation offer failed. Do nothing. We will continue
+            // searching for an offer that succeeds
+            return false;
         }
 
-        // support for future extensions would go here. Should check the value of 
-        // ret.first before continuing. Might need to consider whether failure of
-        // negotiation of an earlier extension should stop negotiation of subsequent
-        // ones
+        // Actually try to initialize the extension before we deem
+        // negotiation complete. Failure to initialize stops negotiation,
+        // return the reason.
+        lib::error_code ec = ext.init(base::m_server);
 
-        return ret;
+        if (ec) {
+            ret.first = ec;
+        } else {
+            ret.second += neg_ret.second;
+        }
+        return true;
     }
 
     lib::error_code validate_handshake(request_type const & r) const {
+        if (is_extended_connect(r)) {
+            // RFC 8441 section 5: the stream is the connection, there is no
+            // key to prove the upgrade with
+            return lib::error_code();
+        }
+
         if (r.get_method() != "GET") {
             return make_error_code(error::invalid_http_method);
         }
@@ -195,7 +365,7 @@ public:
         // Host is required by HTTP/1.1
         // Connection is required by is_websocket_handshake
         // Upgrade is required by is_websocket_handshake
-        if (r.get_header("Sec-WebSocket-Key").empty()) {
+        if (r.get_header_view("Sec-WebSocket-Key").empty()) {
             return make_error_code(error::missing_required_header);
         }
 
@@ -209,7 +379,14 @@ public:
     lib::error_code process_handshake(request_type const & request, 
         std::string const & subprotocol, response_type & response) const
     {
-        std::string server_key = request.get_header("Sec-WebSocket-Key");
+        if (is_extended_connect(request)) {
+            if (!subprotocol.empty()) {
+                response.replace_header("Sec-WebSocket-Protocol",subprotocol);
+            }
+            return lib::error_code();
+        }
+
+        std::string server_key(request.get_header_view("Sec-WebSocket-Key"));
 
         lib::error_code ec = process_handshake_key(server_key);
 
@@ -228,6 +405,21 @@ public:
         return lib::error_code();
     }
 
+    lib::error_code write_handshake_response(request_type const & request,
+        std::string const & subprotocol, std::string const & extensions,
+        handshake_template const & tpl, std::string & out) const
+    {
+        std::string server_key(request.get_header_view("Sec-WebSocket-Key"));
+
+        lib::error_code ec = process_handshake_key(server_key);
+
+        if (ec) {
+            return ec;
+        }
+
+        return tpl.write(server_key, extensions, subprotocol, out);
+    }
+
     /// Fill in a set of request headers for a client connection request
     /**
      * @param [out] req  Set of headers to fill in
@@ -257,24 +449,49 @@ public:
             req.replace_header("Sec-WebSocket-Protocol",result.str());
         }
 
-        // Generate handshake key
-        frame::uint32_converter conv;
-        unsigned char raw_key[16];
-
-        for (int i = 0; i < 4; i++) {
-            conv.i = m_rng();
-            std::copy(conv.c,conv.c+4,&raw_key[i*4]);
-        }
-
-        req.replace_header("Sec-WebSocket-Key",base64_encode(raw_key, 16));
+        char key[request_template_type::key_size];
+        generate_handshake_key(key);
+        req.replace_header("Sec-WebSocket-Key",
+            std::string(key, request_template_type::key_size));
 
+        // permessage-zstd is only implemented where asked for, so it goes
+        // first
+        std::string offer = m_permessage_zstd.generate_offer();
         if (m_permessage_deflate.is_implemented()) {
-            std::string offer = m_permessage_deflate.generate_offer();
+            std::string deflate = m_permessage_deflate.generate_offer();
+            if (!offer.empty() && !deflate.empty()) {
+                offer += ", ";
+            }
+            offer += deflate;
+        }
+        std::string chain = m_extension_chain.generate_offer();
+        if (!offer.empty() && !chain.empty()) {
+            offer += ", ";
+        }
+        offer += chain;
+        if (trusted_link_policy::value) {
             if (!offer.empty()) {
-                req.replace_header("Sec-WebSocket-Extensions",offer);
+                offer += ", ";
             }
+            offer += extensions::trusted_link::extension_name;
         }
+        if (!offer.empty()) {
+            req.replace_header("Sec-WebSocket-Extensions",offer);
+        }
+
+        return lib::error_code();
+    }
+
+    lib::error_code write_handshake_request(request_template_type const & tpl,
+        request_type & req, std::string & out) const
+    {
+        char key[request_template_type::key_size];
+        generate_handshake_key(key);
 
+        req = tpl.get_request();
+        req.replace_header("Sec-WebSocket-Key",
+            std::string(key, request_template_type::key_size));
+        tpl.write(key, out);
         return lib::error_code();
     }
 
@@ -308,11 +525,14 @@ public:
             return error::make_error_code(error::missing_required_header);
         }
 
-        // And has a valid Sec-WebSocket-Accept value
-        std::string key = req.get_header("Sec-WebSocket-Key");
-        lib::error_code ec = process_handshake_key(key);
-
-        if (ec || key != res.get_header("Sec-WebSocket-Accept")) {
+        // And has a valid Sec-WebSocket-Accept value, checked without
+        // copying either header
+        char accept[handshake_template::accept_key_size];
+        size_t const accept_len = compute_accept_key(
+            req.get_header_view("Sec-WebSocket-Key"), accept);
+        if (res.get_header_view("Sec-WebSocket-Accept") !=
+            std::string_view(accept, accept_len))
+        {
             return error::make_error_code(error::missing_required_header);
         }
 
@@ -332,7 +552,7 @@ public:
     lib::error_code extract_subprotocols(request_type const & req,
         std::vector<std::string> & subprotocol_list)
     {
-        if (!req.get_header("Sec-WebSocket-Protocol").empty()) {
+        if (!req.get_header_view("Sec-WebSocket-Protocol").empty()) {
             http::parameter_list p;
 
              if (!req.get_header_as_plist("Sec-WebSocket-Protocol",p)) {
@@ -391,7 +611,39 @@ public:
         while (m_state != READY && m_state != FATAL_ERROR &&
                (p < len || m_bytes_needed == 0))
         {
-            if (m_state == HEADER_BASIC) {
+            if (m_state == HEADER_BASIC &&
+                m_bytes_needed == frame::BASIC_HEADER_LENGTH &&
+                len-p >= frame::BASIC_HEADER_LENGTH)
+            {
+                // Fast path for a header that starts in this buffer: decode
+                // the basic header straight from it and, if the rest of the
+                // header is there too, take that in the same step. Only a
+                // header split across reads goes through the byte copying
+                // states below.
+                m_basic_header.b0 = buf[p];
+                m_basic_header.b1 = buf[p+1];
+                p += frame::BASIC_HEADER_LENGTH;
+                m_bytes_needed = 0;
+
+                ec = this->validate_incoming_basic_header(
+                    m_basic_header, base::m_server, !m_data_msg.msg_ptr
+                );
+                if (ec) {break;}
+
+                size_t extended = frame::get_header_len(m_basic_header) -
+                    frame::BASIC_HEADER_LENGTH;
+
+                m_state = HEADER_EXTENDED;
+                if (extended <= len-p) {
+                    std::memcpy(m_extended_header.bytes,buf+p,extended);
+                    p += extended;
+                    m_cursor = extended;
+                    m_bytes_needed = 0;
+                } else {
+                    m_cursor = 0;
+                    m_bytes_needed = extended;
+                }
+            } else if (m_state == HEADER_BASIC) {
                 p += this->copy_basic_header_bytes(buf+p,len-p);
 
                 if (m_bytes_needed > 0) {
@@ -421,10 +673,29 @@ public:
                 m_state = APPLICATION;
                 m_bytes_needed = static_cast<size_t>(get_payload_size(m_basic_header,m_extended_header));
 
+                WEBSOCKETPP_TRACE(trace_type, trace::point::frame,
+                    base::m_trace_id, frame::get_opcode(m_basic_header),
+                    m_bytes_needed);
+
                 // check if this frame is the start of a new message and set up
                 // the appropriate message metadata.
                 frame::opcode::value op = frame::get_opcode(m_basic_header);
 
+                // A complete, single frame, uncompressed data message that is
+                // entirely in this buffer may be delivered in place.
+                if (base::m_message_views && !base::m_message_chunks &&
+                    !frame::opcode::is_control(op) &&
+                    !m_data_msg.msg_ptr && frame::get_fin(m_basic_header) &&
+                    !frame::get_rsv1(m_basic_header) &&
+                    !(m_basic_header.b0 & extension_chain_type::reserved_bits) &&
+                    m_bytes_needed <= len-p &&
+                    m_bytes_needed <= base::m_max_message_size)
+                {
+                    p += this->process_payload_view(buf+p,ec);
+                    if (ec) {break;}
+                    continue;
+                }
+
                 // TODO: get_message failure conditions
 
                 if (frame::opcode::is_control(op)) {
@@ -436,25 +707,70 @@ public:
                     m_current_msg = &m_control_msg;
                 } else {
                     if (!m_data_msg.msg_ptr) {
-                        if (m_bytes_needed > base::m_max_message_size) {
+                        // chain transforms need the whole message
+                        uint8_t extension_bits = m_basic_header.b0 &
+                            extension_chain_type::reserved_bits;
+                        bool spillable = base::m_spill_threshold > 0 &&
+                            !base::m_message_chunks && !extension_bits;
+
+                        if (m_bytes_needed > message_limit(spillable)) {
                             ec = make_error_code(error::message_too_big);
                             break;
                         }
                         
+                        // Reserve for the announced length up to a step, the
+                        // buffer grows beyond that as the payload arrives.
+                        // Chunks only ever hold what one read delivers.
+                        size_t const step =
+                            config_traits<config>::message_reserve_step;
+                        size_t reserve = base::m_message_chunks ? 0 :
+                            (std::min)(m_bytes_needed, step);
+
                         m_data_msg = msg_metadata(
-                            m_msg_manager->get_message(op,m_bytes_needed),
+                            m_msg_manager->get_message(op,reserve),
                             frame::get_masking_key(m_basic_header,m_extended_header)
                         );
+                        m_chunk_first = true;
+                        m_chunk_total = 0;
+
+                        m_data_msg.extension_bits = extension_bits;
+                        m_data_msg.spillable = spillable;
+                        if (m_data_msg.extension_bits &&
+                            base::m_message_chunks)
+                        {
+                            ec = make_error_code(error::extension_chunks);
+                            break;
+                        }
                         
                         if (m_permessage_deflate.is_enabled()) {
-                            m_data_msg.msg_ptr->set_compressed(frame::get_rsv1(m_basic_header));
+                            bool rsv1 = frame::get_rsv1(m_basic_header);
+                            m_data_msg.msg_ptr->set_compressed(rsv1);
+
+                            if (rsv1) {
+                                ec = m_permessage_deflate.begin_message();
+                                if (ec) {
+                                    break;
+                                }
+                            }
+                        } else if (m_permessage_zstd.is_enabled()) {
+                            bool rsv1 = frame::get_rsv1(m_basic_header);
+                            m_data_msg.msg_ptr->set_compressed(rsv1);
+
+                            if (rsv1) {
+                                ec = m_permessage_zstd.begin_message();
+                                if (ec) {
+                                    break;
+                                }
+                            }
                         }
                     } else {
                         // Fetch the underlying payload buffer from the data message we
                         // are writing into.
                         std::string & out = m_data_msg.msg_ptr->get_raw_payload();
                         
-                        if (out.size() + m_bytes_needed > base::m_max_message_size) {
+                        if (m_chunk_total + m_data_msg.spilled() + out.size() +
+                            m_bytes_needed > message_limit(m_data_msg.spillable))
+                        {
                             ec = make_error_code(error::message_too_big);
                             break;
                         }
@@ -468,9 +784,24 @@ public:
                             )
                         );
                         
-                        out.reserve(out.size() + m_bytes_needed);
+                        if (!base::m_message_chunks) {
+                            // Grow at least geometrically. Reserving only
+                            // this frame would copy the whole message again
+                            // for every small fragment.
+                            size_t const step =
+                                config_traits<config>::message_reserve_step;
+                            size_t const wanted = out.size() +
+                                (std::min)(m_bytes_needed, step);
+                            if (wanted > out.capacity()) {
+                                out.reserve((std::max)(wanted,
+                                    out.capacity() * 2));
+                            }
+                        }
                     }
                     m_current_msg = &m_data_msg;
+
+                    ec = charge_inbound();
+                    if (ec) {break;}
                 }
             } else if (m_state == EXTENSION) {
                 m_state = APPLICATION;
@@ -481,6 +812,33 @@ public:
                     p += this->process_payload_bytes(buf+p,bytes_to_process,ec);
 
                     if (ec) {break;}
+
+                    if (m_current_msg == &m_data_msg) {
+                        ec = charge_inbound();
+                        if (ec) {break;}
+                    }
+                }
+
+                if (base::m_message_chunks && m_current_msg == &m_data_msg) {
+                    // hand over what this read produced, and the end of the
+                    // message, see get_message_chunk
+                    bool fin = m_bytes_needed == 0 &&
+                        frame::get_fin(m_basic_header);
+                    if (fin) {
+                        ec = finalize_message();
+                        if (ec) {
+                            break;
+                        }
+                    }
+
+                    if (fin || !m_data_msg.msg_ptr->get_payload().empty()) {
+                        m_chunk_last = fin;
+                        m_chunk_ready = true;
+                        m_state = READY;
+                    } else if (m_bytes_needed == 0) {
+                        this->reset_headers();
+                    }
+                    continue;
                 }
 
                 if (m_bytes_needed > 0) {
@@ -531,6 +889,43 @@ public:
             if (ec) {
                 return ec;
             }
+        } else if (m_permessage_zstd.is_enabled()
+            && m_current_msg->msg_ptr->get_compressed())
+        {
+            lib::error_code ec = m_permessage_zstd.end_message();
+            if (ec) {
+                return ec;
+            }
+        }
+
+        // a spilled payload is delivered mapped from its file
+        if (m_current_msg->spill) {
+            lib::error_code ec = spill(out);
+            if (ec) {
+                return ec;
+            }
+            file_map::ptr file = m_current_msg->spill->map(ec);
+            if (ec) {
+                return ec;
+            }
+            m_current_msg->msg_ptr->set_payload_ref(file, file->data(),
+                file->size());
+            m_current_msg->spill.reset();
+        }
+
+        // text transformed by the chain is validated once decoded
+        if (m_current_msg->extension_bits) {
+            frame::opcode::value op = m_current_msg->msg_ptr->get_opcode();
+            lib::error_code ec = m_extension_chain.decode(op,
+                m_current_msg->extension_bits, out);
+            if (ec) {
+                return ec;
+            }
+            if (op == frame::opcode::TEXT && !m_trusted_link &&
+                !utf8_validator::validate(out))
+            {
+                return make_error_code(error::invalid_utf8);
+            }
         }
 
         // ensure that text messages end on a valid UTF8 code point
@@ -568,6 +963,17 @@ public:
         if (!ready()) {
             return message_ptr();
         }
+
+        if (m_view_ready) {
+            // A caller that doesn't handle views gets a copy of the payload
+            message_ptr ret = m_msg_manager->get_message(m_view_op,
+                m_view.size());
+            ret->append_payload(m_view.data(),m_view.size());
+            m_view_ready = false;
+            this->reset_headers();
+            return ret;
+        }
+
         message_ptr ret = m_current_msg->msg_ptr;
         m_current_msg->msg_ptr.reset();
 
@@ -575,6 +981,8 @@ public:
             m_control_msg.msg_ptr.reset();
         } else {
             m_data_msg.msg_ptr.reset();
+            // the message is the caller's now
+            release_inbound();
         }
 
         this->reset_headers();
@@ -582,6 +990,56 @@ public:
         return ret;
     }
 
+    bool get_message_chunk(frame::opcode::value & op, std::string_view & chunk,
+        bool & first, bool & last)
+    {
+        if (!ready() || !m_chunk_ready) {
+            return false;
+        }
+
+        // The chunk moves to m_chunk_out, so it outlives the next read into
+        // the message buffer. Both keep their capacity.
+        std::string & out = m_data_msg.msg_ptr->get_raw_payload();
+        m_chunk_out.swap(out);
+        out.clear();
+
+        op = m_data_msg.msg_ptr->get_opcode();
+        chunk = m_chunk_out;
+        first = m_chunk_first;
+        last = m_chunk_last;
+
+        m_chunk_total += m_chunk_out.size();
+        m_chunk_first = false;
+        m_chunk_ready = false;
+
+        if (last) {
+            m_data_msg.msg_ptr.reset();
+            release_inbound();
+            this->reset_headers();
+        } else if (m_bytes_needed > 0) {
+            // the rest of this frame is in the next read
+            m_state = APPLICATION;
+        } else {
+            this->reset_headers();
+        }
+
+        return true;
+    }
+
+    bool get_message_view(frame::opcode::value & op, std::string_view & payload)
+    {
+        if (!ready() || !m_view_ready) {
+            return false;
+        }
+
+        op = m_view_op;
+        payload = m_view;
+        m_view_ready = false;
+        this->reset_headers();
+
+        return true;
+    }
+
     /// Test whether or not the processor is in a fatal error state.
     bool get_error() const {
         return m_state == FATAL_ERROR;
@@ -591,11 +1049,91 @@ public:
         return m_bytes_needed;
     }
 
+    char * get_payload_buffer(size_t min_size, size_t & len) {
+        len = 0;
+        if (!m_direct_payload) {
+            if (m_state != APPLICATION || m_current_msg != &m_data_msg ||
+                m_bytes_needed < min_size || m_bytes_needed == 0 ||
+                base::m_message_chunks || m_data_msg.spillable ||
+                m_data_msg.extension_bits ||
+                m_data_msg.msg_ptr->get_compressed())
+            {
+                return NULL;
+            }
+
+            // the message takes the rest of the frame at once, what has not
+            // been read yet is filled in by commit_payload
+            std::string & out = m_data_msg.msg_ptr->get_raw_payload();
+            m_direct_cursor = out.size();
+            out.resize(m_direct_cursor + m_bytes_needed);
+            if (charge_inbound()) {
+                out.resize(m_direct_cursor);
+                return NULL;
+            }
+            m_direct_payload = true;
+        }
+
+        len = m_bytes_needed;
+        return &m_data_msg.msg_ptr->get_raw_payload()[m_direct_cursor];
+    }
+
+    void commit_payload(size_t len, lib::error_code & ec) {
+        ec = lib::error_code();
+        if (!m_direct_payload || len > m_bytes_needed) {
+            ec = make_error_code(error::general);
+            return;
+        }
+
+        std::string & out = m_data_msg.msg_ptr->get_raw_payload();
+        uint8_t * buf = reinterpret_cast<uint8_t *>(&out[m_direct_cursor]);
+        bool const masked = frame::get_masked(m_basic_header);
+        bool const text = m_data_msg.msg_ptr->get_opcode() ==
+            frame::opcode::TEXT && !m_trusted_link;
+
+        if (masked && text) {
+            if (!frame::mask_circ_utf8(buf, buf, len,
+                m_data_msg.prepared_key, m_data_msg.validator))
+            {
+                ec = make_error_code(error::invalid_utf8);
+                return;
+            }
+        } else {
+            if (masked) {
+                m_data_msg.prepared_key = frame::mask_circ(buf, len,
+                    m_data_msg.prepared_key);
+            }
+            if (text && !m_data_msg.validator.decode(
+                out.begin() + m_direct_cursor,
+                out.begin() + m_direct_cursor + len))
+            {
+                ec = make_error_code(error::invalid_utf8);
+                return;
+            }
+        }
+
+        m_direct_cursor += len;
+        m_bytes_needed -= len;
+        if (m_bytes_needed > 0) {
+            return;
+        }
+
+        m_direct_payload = false;
+        if (frame::get_fin(m_basic_header)) {
+            ec = finalize_message();
+        } else {
+            this->reset_headers();
+        }
+    }
+
     /// Prepare a user data message for writing
     /**
      * Performs validation, masking, compression, etc. will return an error if
      * there was an error, otherwise msg will be ready to be written
      *
+     * If the payload needs neither masking nor compression `out` shares the
+     * payload buffer of `in` rather than receiving a copy of it. In this case
+     * `in` must not be modified until `out` has been written.
+     *
      * TODO: tests
      *
      * @param in An unprepared message to prepare
@@ -615,20 +1153,49 @@ public:
             return make_error_code(error::invalid_opcode);
         }
 
-        std::string& i = in->get_raw_payload();
+        char const * data = in->get_payload_data();
+        size_t len = in->get_payload_size();
         std::string& o = out->get_raw_payload();
 
         // validate payload utf8
-        if (op == frame::opcode::TEXT && !utf8_validator::validate(i)) {
+        if (op == frame::opcode::TEXT && !m_trusted_link &&
+            !utf8_validator::validate(data,len))
+        {
             return make_error_code(error::invalid_payload);
         }
 
         frame::masking_key_type key;
-        bool masked = !base::m_server;
+        bool masked = mask_outgoing();
+        // Without room in the compression memory budget the message goes out
+        // uncompressed.
         bool compressed = m_permessage_deflate.is_enabled()
-                          && in->get_compressed();
+                          && in->get_compressed()
+                          && !m_permessage_deflate.reserve_compressor();
+        bool zstd = m_permessage_zstd.is_enabled()
+                    && in->get_compressed()
+                    && !m_permessage_zstd.reserve_compressor();
         bool fin = in->get_fin();
 
+        // The extensions of the chain transform whole messages first,
+        // compression applies to the result
+        std::string transformed;
+        uint8_t extension_bits = 0;
+        if (extension_chain_type::size > 0 && fin &&
+            op != frame::opcode::CONTINUATION)
+        {
+            lib::error_code ec = m_extension_chain.encode(op,
+                in->get_payload(), transformed, extension_bits);
+            if (ec) {
+                return ec;
+            }
+            if (extension_bits) {
+                data = transformed.data();
+                len = transformed.size();
+            }
+        }
+        std::string const & payload = extension_bits ? transformed :
+            in->get_payload();
+
         if (masked) {
             // Generate masking key.
             key.i = m_rng();
@@ -637,9 +1204,20 @@ public:
         }
 
         // prepare payload
-        if (compressed) {
+        if (zstd) {
+            // one complete zstd frame, nothing to strip
+            lib::error_code ec = m_permessage_zstd.compress(payload,o);
+            if (ec) {
+                return ec;
+            }
+            compressed = true;
+
+            if (masked) {
+                this->masked_copy(o,o,key);
+            }
+        } else if (compressed) {
             // compress and store in o after header.
-            m_permessage_deflate.compress(i,o);
+            m_permessage_deflate.compress(payload,o);
 
             if (o.size() < 4) {
                 return make_error_code(error::general);
@@ -653,29 +1231,33 @@ public:
             if (masked) {
                 this->masked_copy(o,o,key);
             }
-        } else {
-            // no compression, just copy data into the output buffer
-            o.resize(i.size());
-
-            // if we are masked, have the masking function write to the output
-            // buffer directly to avoid another copy. If not masked, copy
-            // directly without masking.
-            if (masked) {
-                this->masked_copy(i,o,key);
-            } else {
-                std::copy(i.begin(),i.end(),o.begin());
+        } else if (masked) {
+            // no compression, have the masking function write to the output
+            // buffer directly to avoid another copy.
+            o.resize(len);
+            if (len > 0) {
+                frame::mask_exact(
+                    reinterpret_cast<uint8_t const *>(data),
+                    reinterpret_cast<uint8_t *>(&o[0]),
+                    len,
+                    key
+                );
             }
+        } else if (extension_bits) {
+            o.swap(transformed);
+        } else {
+            // no compression or masking, the payload goes to the wire as is.
+            // Share the input buffer rather than copying it.
+            out->set_payload_source(in);
         }
 
         // generate header
-        frame::basic_header h(op,o.size(),fin,masked,compressed);
+        this->encode_header(out,op,out->get_payload_size(),fin,masked,
+            compressed,key,extension_bits);
 
-        if (masked) {
-            frame::extended_header e(o.size(),key.i);
-            out->set_header(frame::prepare_header(h,e));
-        } else {
-            frame::extended_header e(o.size());
-            out->set_header(frame::prepare_header(h,e));
+        if (!masked && !compressed && !extension_bits) {
+            // a payload with headroom goes out with its header as one buffer
+            out->place_header();
         }
 
         out->set_prepared(true);
@@ -684,14 +1266,299 @@ public:
         return lib::error_code();
     }
 
-    /// Get URI
-    lib::error_code prepare_ping(std::string const & in, message_ptr out) const {
-        return this->prepare_control(frame::opcode::PING,in,out);
-    }
+    lib::error_code prepare_fragment_source(message_ptr in, message_ptr out)
+    {
+        if (!in || !out) {
+            return make_error_code(error::invalid_arguments);
+        }
 
-    lib::error_code prepare_pong(std::string const & in, message_ptr out) const {
-        return this->prepare_control(frame::opcode::PONG,in,out);
-    }
+        frame::opcode::value op = in->get_opcode();
+
+        if (frame::opcode::is_control(op)) {
+            return make_error_code(error::invalid_opcode);
+        }
+
+        if (op == frame::opcode::TEXT && !m_trusted_link &&
+            !utf8_validator::validate(in->get_payload_data(),
+                in->get_payload_size()))
+        {
+            return make_error_code(error::invalid_payload);
+        }
+
+        bool compressed = m_permessage_deflate.is_enabled()
+                          && in->get_compressed()
+                          && !m_permessage_deflate.reserve_compressor();
+        bool zstd = m_permessage_zstd.is_enabled()
+                    && in->get_compressed()
+                    && !m_permessage_zstd.reserve_compressor();
+
+        if (zstd) {
+            lib::error_code ec = m_permessage_zstd.compress(in->get_payload(),
+                out->get_raw_payload());
+            if (ec) {
+                return ec;
+            }
+            compressed = true;
+        } else if (compressed) {
+            std::string & o = out->get_raw_payload();
+            m_permessage_deflate.compress(in->get_payload(),o);
+
+            if (o.size() < 4) {
+                return make_error_code(error::general);
+            }
+
+            // Strip trailing 4 0x00 0x00 0xff 0xff bytes, fragments carry
+            // pieces of what is left
+            o.resize(o.size()-4);
+        } else {
+            // fragments copy their piece of the payload, masked if need be
+            out->set_payload_source(in);
+        }
+
+        out->set_opcode(op);
+        out->set_fin(in->get_fin());
+        out->set_compressed(compressed);
+        out->set_prepared(false);
+
+        return lib::error_code();
+    }
+
+    lib::error_code prepare_fragment(message_ptr source, size_t begin,
+        size_t end, message_ptr out)
+    {
+        if (!source || !out) {
+            return make_error_code(error::invalid_arguments);
+        }
+
+        char const * data = source->get_payload_data();
+        size_t size = source->get_payload_size();
+
+        if (begin > end || end > size) {
+            return make_error_code(error::invalid_arguments);
+        }
+
+        bool first = (begin == 0);
+        frame::opcode::value op = first ? source->get_opcode() :
+            frame::opcode::CONTINUATION;
+        bool fin = (end == size) && source->get_fin();
+        bool compressed = first && source->get_compressed();
+        bool masked = mask_outgoing();
+        size_t len = end - begin;
+
+        frame::masking_key_type key;
+        key.i = masked ? m_rng() : 0;
+
+        std::string & o = out->get_raw_payload();
+        if (masked) {
+            o.resize(len);
+            if (len > 0) {
+                frame::mask_exact(
+                    reinterpret_cast<uint8_t const *>(data + begin),
+                    reinterpret_cast<uint8_t *>(&o[0]),
+                    len,
+                    key
+                );
+            }
+        } else {
+            o.assign(data + begin, len);
+        }
+
+        this->encode_header(out,op,len,fin,masked,compressed,key);
+
+        out->set_prepared(true);
+        out->set_opcode(op);
+
+        return lib::error_code();
+    }
+
+    lib::error_code prepare_stream_frame(message_ptr in, message_ptr out) {
+        if (!in || !out) {
+            return make_error_code(error::invalid_arguments);
+        }
+
+        frame::opcode::value op = in->get_opcode();
+        bool first = (op != frame::opcode::CONTINUATION);
+        bool fin = in->get_fin();
+
+        if (frame::opcode::is_control(op) || first == m_stream_open) {
+            return make_error_code(error::invalid_opcode);
+        }
+
+        if (first) {
+            // the whole message is compressed or not, decided up front
+            m_stream_text = (op == frame::opcode::TEXT) && !m_trusted_link;
+            m_stream_compressed = m_permessage_deflate.is_enabled()
+                                  && in->get_compressed()
+                                  && !m_permessage_deflate.reserve_compressor();
+            m_stream_validator.reset();
+        }
+        m_stream_open = !fin;
+
+        std::string const & i = in->get_payload();
+        std::string& o = out->get_raw_payload();
+
+        // code points may be split between frames of the message
+        if (m_stream_text && (!m_stream_validator.decode(i.begin(),i.end())
+            || (fin && !m_stream_validator.complete())))
+        {
+            return make_error_code(error::invalid_payload);
+        }
+
+        frame::masking_key_type key;
+        bool masked = mask_outgoing();
+
+        if (masked) {
+            key.i = m_rng();
+        } else {
+            key.i = 0;
+        }
+
+        if (m_stream_compressed) {
+            lib::error_code ec = m_permessage_deflate.compress_chunk(i,first,
+                fin,o);
+            if (ec) {
+                return ec;
+            }
+
+            // only the end of the message drops the trailing empty block
+            if (fin) {
+                if (o.size() < 4) {
+                    return make_error_code(error::general);
+                }
+                o.resize(o.size()-4);
+            }
+
+            if (masked) {
+                this->masked_copy(o,o,key);
+            }
+        } else if (masked) {
+            o.resize(i.size());
+            this->masked_copy(i,o,key);
+        } else {
+            out->set_payload_source(in);
+        }
+
+        this->encode_header(out,op,out->get_payload_size(),fin,masked,
+            m_stream_compressed && first,key);
+
+        out->set_prepared(true);
+        out->set_opcode(op);
+        out->set_fin(fin);
+
+        return lib::error_code();
+    }
+
+    /// Pick the frame to write for a broadcast message
+    /**
+     * When permessage-deflate was negotiated without server context takeover
+     * the payload is compressed once for each window size in use and the
+     * compressed frame is stored on the broadcast message for every other
+     * connection with the same window size. Otherwise, or if compression
+     * fails, the uncompressed broadcast frame is used.
+     */
+    message_ptr select_broadcast_frame(message_ptr in) {
+        uint8_t bits = m_permessage_deflate.get_shared_window_bits();
+
+        if (!in->get_compressed() || bits == 0 || !base::m_server) {
+            return in;
+        }
+
+        message_ptr out = in->get_variant(bits);
+        if (out) {
+            return out;
+        }
+
+        out = m_msg_manager->get_message();
+        if (!out) {
+            return in;
+        }
+
+        std::string & o = out->get_raw_payload();
+        lib::error_code ec = permessage_deflate_type::compress_shared(bits,
+            in->get_payload(), o);
+
+        if (ec || o.size() < 4) {
+            return in;
+        }
+
+        // Strip trailing 4 0x00 0x00 0xff 0xff bytes before writing to the
+        // wire
+        o.resize(o.size()-4);
+
+        frame::opcode::value op = in->get_opcode();
+        frame::header_buffer header;
+        header.encode<false>(op,o.size(),true,true);
+        out->set_header(header);
+        out->set_prepared(true);
+        out->set_opcode(op);
+
+        return in->add_variant(bits,out);
+    }
+
+    bool can_split_deflate() const {
+        return m_permessage_deflate.is_enabled() &&
+               m_permessage_deflate.can_compress_parts();
+    }
+
+    lib::error_code deflate_part(std::string const & in, std::string & out)
+        const
+    {
+        return m_permessage_deflate.compress_part(in, out);
+    }
+
+    /// Frame a data message compressed with deflate_part
+    /**
+     * Strips the trailing empty block, masks in place for clients and adds
+     * the header, as prepare_data_frame does for its own compressed output.
+     */
+    lib::error_code prepare_deflated_frame(message_ptr in, message_ptr out) {
+        if (!in || !out) {
+            return make_error_code(error::invalid_arguments);
+        }
+
+        frame::opcode::value op = in->get_opcode();
+        if (frame::opcode::is_control(op)) {
+            return make_error_code(error::invalid_opcode);
+        }
+        if (op == frame::opcode::TEXT && !m_trusted_link &&
+            !utf8_validator::validate(in->get_payload()))
+        {
+            return make_error_code(error::invalid_payload);
+        }
+
+        std::string & o = out->get_raw_payload();
+        if (o.size() < 4) {
+            return make_error_code(error::general);
+        }
+
+        // Strip trailing 4 0x00 0x00 0xff 0xff bytes before writing to the
+        // wire
+        o.resize(o.size()-4);
+
+        bool masked = mask_outgoing();
+        frame::masking_key_type key;
+        key.i = masked ? m_rng() : 0;
+
+        if (masked) {
+            this->masked_copy(o,o,key);
+        }
+
+        this->encode_header(out,op,o.size(),in->get_fin(),masked,true,key);
+
+        out->set_prepared(true);
+        out->set_opcode(op);
+
+        return lib::error_code();
+    }
+
+    /// Get URI
+    lib::error_code prepare_ping(std::string const & in, message_ptr out) const {
+        return this->prepare_control(frame::opcode::PING,in,out);
+    }
+
+    lib::error_code prepare_pong(std::string const & in, message_ptr out) const {
+        return this->prepare_control(frame::opcode::PONG,in,out);
+    }
 
     virtual lib::error_code prepare_close(close::status::value code,
         std::string const & reason, message_ptr out) const
@@ -729,17 +1596,56 @@ public:
         return this->prepare_control(frame::opcode::CLOSE,payload,out);
     }
 protected:
+    /// Compute the Sec-WebSocket-Accept value of a handshake key
+    /**
+     * @param [in] key The Sec-WebSocket-Key value
+     * @param [out] out At least handshake_template::accept_key_size bytes
+     * @return The length of the value written to out
+     */
+    size_t compute_accept_key(std::string_view key, char * out) const {
+        size_t const guid_len = sizeof(constants::handshake_guid) - 1;
+        unsigned char message_digest[20];
+
+        // A valid key is 24 characters, so key and GUID fit on the stack
+        char input[128];
+        if (key.size() + guid_len <= sizeof(input)) {
+            std::copy(key.begin(), key.end(), input);
+            std::copy(constants::handshake_guid,
+                constants::handshake_guid + guid_len, input + key.size());
+            sha1::calc(input, key.size() + guid_len, message_digest);
+        } else {
+            std::string long_key(key);
+            long_key.append(constants::handshake_guid);
+            sha1::calc(long_key.c_str(),long_key.length(),message_digest);
+        }
+
+        return base64_encode(message_digest, 20, out);
+    }
+
     /// Convert a client handshake key into a server response key in place
     lib::error_code process_handshake_key(std::string & key) const {
-        key.append(constants::handshake_guid);
-
-        unsigned char message_digest[20];
-        sha1::calc(key.c_str(),key.length(),message_digest);
-        key = base64_encode(message_digest,20);
+        char accept[handshake_template::accept_key_size];
+        key.assign(accept, compute_accept_key(key, accept));
 
         return lib::error_code();
     }
 
+    /// Generate a random Sec-WebSocket-Key
+    /**
+     * @param [out] out At least request_template_type::key_size bytes
+     */
+    void generate_handshake_key(char * out) const {
+        frame::uint32_converter conv;
+        unsigned char raw_key[16];
+
+        for (int i = 0; i < 4; i++) {
+            conv.i = m_rng();
+            std::copy(conv.c,conv.c+4,&raw_key[i*4]);
+        }
+
+        base64_encode(raw_key, 16, out);
+    }
+
     /// Reads bytes from buf into m_basic_header
     size_t copy_basic_header_bytes(uint8_t const * buf, size_t len) {
         if (len == 0 || m_bytes_needed == 0) {
@@ -798,24 +1704,68 @@ protected:
      */
     size_t process_payload_bytes(uint8_t * buf, size_t len, lib::error_code& ec)
     {
-        // unmask if masked
-        if (frame::get_masked(m_basic_header)) {
-            m_current_msg->prepared_key = frame::byte_mask_circ(
-                buf, len, m_current_msg->prepared_key);
-            // TODO: SIMD masking
+        std::string & out = m_current_msg->msg_ptr->get_raw_payload();
+
+        bool masked = frame::get_masked(m_basic_header);
+        bool text = m_current_msg->msg_ptr->get_opcode() == frame::opcode::TEXT
+            && !m_current_msg->extension_bits && !m_trusted_link;
+        bool compressed = (m_permessage_deflate.is_enabled()
+            || m_permessage_zstd.is_enabled())
+            && m_current_msg->msg_ptr->get_compressed();
+
+        if (masked && text && !compressed) {
+            // Uncompressed text: unmask and validate in a single pass over
+            // the input, then copy the validated bytes into the message.
+            if (!frame::mask_circ_utf8(buf, buf, len,
+                m_current_msg->prepared_key, m_current_msg->validator))
+            {
+                ec = make_error_code(error::invalid_utf8);
+                return 0;
+            }
+
+            out.append(reinterpret_cast<char *>(buf),len);
+        } else {
+            process_payload_copy(buf, len, out, masked, text, compressed, ec);
+            if (ec) {
+                return 0;
+            }
         }
 
-        std::string & out = m_current_msg->msg_ptr->get_raw_payload();
+        if (m_current_msg->spillable && out.size() >= base::m_spill_threshold)
+        {
+            ec = spill(out);
+            if (ec) {
+                return 0;
+            }
+        }
+
+        m_bytes_needed -= len;
+
+        return len;
+    }
+
+    /// Unmask, decompress and validate payload bytes into the message
+    void process_payload_copy(uint8_t * buf, size_t len, std::string & out,
+        bool masked, bool text, bool compressed, lib::error_code & ec)
+    {
         size_t offset = out.size();
 
+        // unmask if masked
+        if (masked) {
+            m_current_msg->prepared_key = frame::mask_circ(
+                buf, len, m_current_msg->prepared_key);
+        }
+
         // decompress message if needed.
-        if (m_permessage_deflate.is_enabled()
-            && m_current_msg->msg_ptr->get_compressed())
-        {
+        if (compressed) {
             // Decompress current buffer into the message buffer
-            ec = m_permessage_deflate.decompress(buf,len,out);
+            if (m_permessage_zstd.is_enabled()) {
+                ec = m_permessage_zstd.decompress(buf,len,out);
+            } else {
+                ec = m_permessage_deflate.decompress(buf,len,out);
+            }
             if (ec) {
-                return 0;
+                return;
             }
         } else {
             // No compression, straight copy
@@ -823,14 +1773,108 @@ protected:
         }
 
         // validate unmasked, decompressed values
-        if (m_current_msg->msg_ptr->get_opcode() == frame::opcode::TEXT) {
+        if (text) {
             if (!m_current_msg->validator.decode(out.begin()+offset,out.end())) {
                 ec = make_error_code(error::invalid_utf8);
-                return 0;
             }
         }
+    }
 
-        m_bytes_needed -= len;
+    /// The largest data message accepted
+    /**
+     * @param spillable Whether the message may spill to a file
+     */
+    size_t message_limit(bool spillable) const {
+        if (spillable && base::m_spill_max_size > 0) {
+            return (std::max)(base::m_spill_max_size,
+                base::m_max_message_size);
+        }
+        return base::m_max_message_size;
+    }
+
+    /// Move the payload collected in memory to the message's spill file
+    lib::error_code spill(std::string & out) {
+        lib::error_code ec;
+        if (!m_current_msg->spill) {
+            m_current_msg->spill = spill_file::create(base::m_spill_dir, ec);
+            if (ec) {
+                return ec;
+            }
+        }
+        ec = m_current_msg->spill->write(out.data(), out.size());
+        out.clear();
+        return ec;
+    }
+
+    /// Charge growth of the current data message's buffers to the budget
+    lib::error_code charge_inbound() {
+        if (!m_inbound_budget) {
+            return lib::error_code();
+        }
+
+        size_t size = m_data_msg.msg_ptr->get_raw_payload().capacity() +
+            m_chunk_out.capacity();
+
+        if (size > m_inbound_charged) {
+            if (!m_inbound_budget->try_acquire(size - m_inbound_charged)) {
+                return make_error_code(error::inbound_memory_limit);
+            }
+            m_inbound_charged = size;
+        }
+        return lib::error_code();
+    }
+
+    /// Return everything charged for the current data message
+    void release_inbound() {
+        if (m_inbound_charged > 0) {
+            m_inbound_budget->release(m_inbound_charged);
+            m_inbound_charged = 0;
+        }
+    }
+
+    /// Unmask and validate a complete message in place
+    /**
+     * Processes the entire payload of the current frame, which must be a
+     * complete, uncompressed data message of m_bytes_needed bytes starting at
+     * buf, without copying it into a message buffer. On success the message
+     * is made available via get_message_view.
+     *
+     * @param buf Pointer to the start of the payload in the read buffer
+     * @param ec A status code, zero on success, non-zero otherwise
+     * @return Number of bytes processed or zero on error
+     */
+    size_t process_payload_view(uint8_t * buf, lib::error_code & ec) {
+        size_t len = m_bytes_needed;
+        frame::opcode::value op = frame::get_opcode(m_basic_header);
+        bool text = (op == frame::opcode::TEXT) && !m_trusted_link;
+
+        utf8_validator::validator validator;
+        bool valid = true;
+
+        if (frame::get_masked(m_basic_header)) {
+            size_t key = prepare_masking_key(
+                frame::get_masking_key(m_basic_header,m_extended_header));
+
+            if (text) {
+                valid = frame::mask_circ_utf8(buf,buf,len,key,validator);
+            } else {
+                frame::mask_circ(buf,len,key);
+            }
+        } else if (text) {
+            valid = validator.decode(buf,buf+len);
+        }
+
+        if (!valid || (text && !validator.complete())) {
+            ec = make_error_code(error::invalid_utf8);
+            return 0;
+        }
+
+        m_view_op = op;
+        m_view = std::string_view(reinterpret_cast<char const *>(buf),len);
+        m_view_ready = true;
+
+        m_bytes_needed = 0;
+        m_state = READY;
 
         return len;
     }
@@ -858,18 +1902,25 @@ protected:
         }
 
         // Check that RSV bits are clear
-        // The only RSV bits allowed are rsv1 if the permessage_compress
-        // extension is enabled for this connection and the message is not
-        // a control message.
+        // The only RSV bits allowed are rsv1 if a compression extension is
+        // enabled for this connection and the message is not a control
+        // message.
         //
         // TODO: unit tests for this
-        if (frame::get_rsv1(h) && (!m_permessage_deflate.is_enabled()
+        if (frame::get_rsv1(h) && ((!m_permessage_deflate.is_enabled() &&
+                !m_permessage_zstd.is_enabled())
                 || frame::opcode::is_control(op)))
         {
             return make_error_code(error::invalid_rsv_bit);
         }
 
-        if (frame::get_rsv2(h) || frame::get_rsv3(h)) {
+        // RSV2 and RSV3 may mark the first frame of a data message for the
+        // extensions of the chain that were negotiated
+        uint8_t const chain_bits = h.b0 & (frame::BHB0_RSV2|frame::BHB0_RSV3);
+        if (chain_bits && ((chain_bits & ~m_extension_chain.enabled_bits())
+                || frame::opcode::is_control(op)
+                || op == frame::opcode::CONTINUATION))
+        {
             return make_error_code(error::invalid_rsv_bit);
         }
 
@@ -901,9 +1952,10 @@ protected:
             return make_error_code(error::invalid_continuation);
         }
 
-        // Servers should reject any unmasked frames from clients.
+        // Servers should reject any unmasked frames from clients, unless
+        // trusted-link mode lets clients skip masking.
         // Clients should reject any masked frames from servers.
-        if (is_server && !frame::get_masked(h)) {
+        if (is_server && !frame::get_masked(h) && !m_trusted_link) {
             return make_error_code(error::masking_required);
         } else if (!is_server && frame::get_masked(h)) {
             return make_error_code(error::masking_forbidden);
@@ -950,6 +2002,38 @@ protected:
         return lib::error_code();
     }
 
+    /// Encode the frame header of an outgoing message
+    /**
+     * The header is written inline into the message, by the masked encoder
+     * for clients and the unmasked one for servers.
+     *
+     * @param out The message to set the header of
+     * @param op The opcode
+     * @param size The payload length
+     * @param fin Whether this is the final frame of the message
+     * @param masked Whether the frame is masked, with key
+     * @param rsv1 Whether the payload is compressed
+     * @param key The masking key
+     * @param extension_bits RSV bits set by the extension chain
+     */
+    static void encode_header(message_ptr const & out, frame::opcode::value op,
+        uint64_t size, bool fin, bool masked, bool rsv1,
+        frame::masking_key_type key, uint8_t extension_bits = 0)
+    {
+        frame::header_buffer header;
+        header.encode(op,size,fin,masked,rsv1,key);
+        header.add_rsv_bits(extension_bits);
+        out->set_header(header);
+    }
+
+    /// Whether outgoing frames are masked
+    /**
+     * Clients mask, unless trusted-link mode was negotiated.
+     */
+    bool mask_outgoing() const {
+        return !base::m_server && !m_trusted_link;
+    }
+
     /// Copy and mask/unmask in one operation
     /**
      * Reads input from one string and writes unmasked output to another.
@@ -961,8 +2045,15 @@ protected:
     void masked_copy (std::string const & i, std::string & o,
         frame::masking_key_type key) const
     {
-        frame::byte_mask(i.begin(),i.end(),o.begin(),key);
-        // TODO: SIMD masking
+        if (i.empty()) {
+            return;
+        }
+        frame::mask_exact(
+            reinterpret_cast<uint8_t const *>(i.data()),
+            reinterpret_cast<uint8_t *>(&o[0]),
+            i.size(),
+            key
+        );
     }
 
     /// Generic prepare control frame with opcode and payload.
@@ -990,9 +2081,7 @@ protected:
         }
 
         frame::masking_key_type key;
-        bool masked = !base::m_server;
-
-        frame::basic_header h(op,payload.size(),true,masked);
+        bool masked = mask_outgoing();
 
         std::string & o = out->get_raw_payload();
         o.resize(payload.size());
@@ -1000,15 +2089,12 @@ protected:
         if (masked) {
             // Generate masking key.
             key.i = m_rng();
-
-            frame::extended_header e(payload.size(),key.i);
-            out->set_header(frame::prepare_header(h,e));
             this->masked_copy(payload,o,key);
         } else {
-            frame::extended_header e(payload.size());
-            out->set_header(frame::prepare_header(h,e));
+            key.i = 0;
             std::copy(payload.begin(),payload.end(),o.begin());
         }
+        this->encode_header(out,op,payload.size(),true,masked,false,key);
     
         out->set_opcode(op);
         out->set_prepared(true);
@@ -1029,15 +2115,29 @@ protected:
     /// the buffer it is being written to, its masking key, its UTF8 validation
     /// state, and sometimes its compression state.
     struct msg_metadata {
-        msg_metadata() {}
-        msg_metadata(message_ptr m, size_t p) : msg_ptr(m),prepared_key(p) {}
+        msg_metadata() : extension_bits(0), spillable(false) {}
+        msg_metadata(message_ptr m, size_t p)
+          : msg_ptr(m)
+          , prepared_key(p)
+          , extension_bits(0)
+          , spillable(false) {}
         msg_metadata(message_ptr m, frame::masking_key_type p)
           : msg_ptr(m)
-          , prepared_key(prepare_masking_key(p)) {}
+          , prepared_key(prepare_masking_key(p))
+          , extension_bits(0)
+          , spillable(false) {}
+
+        /// Payload bytes moved to the spill file
+        uint64_t spilled() const {
+            return spill ? spill->size() : 0;
+        }
 
         message_ptr msg_ptr;        // pointer to the message data buffer
         size_t      prepared_key;   // prepared masking key
         utf8_validator::validator validator; // utf8 validation state
+        uint8_t     extension_bits; // chain RSV bits of the first frame
+        bool        spillable;      // whether the payload may spill
+        spill_file::ptr spill;      // where the payload went, if it did
     };
 
     // Basic header of the frame being read
@@ -1068,8 +2168,58 @@ protected:
     // Overall state of the processor
     state m_state;
 
+    // Message delivered in place in the read buffer (see get_message_view)
+    bool                    m_view_ready;
+    frame::opcode::value    m_view_op;
+    std::string_view        m_view;
+
+    // Chunk of a data message ready for get_message_chunk
+    bool                    m_chunk_ready;
+    bool                    m_chunk_first;
+    bool                    m_chunk_last;
+    // Payload bytes of the current message already delivered in chunks
+    size_t                  m_chunk_total;
+    std::string             m_chunk_out;
+
+    // Budget charged for incoming data messages, and the amount charged for
+    // the current one
+    lib::shared_ptr<memory_budget> m_inbound_budget;
+    size_t                  m_inbound_charged;
+
+    // Whether the current payload is read straight into the message, see
+    // get_payload_buffer, and where the next bytes of it go
+    bool                    m_direct_payload;
+    size_t                  m_direct_cursor;
+
+    // Message sent in pieces with prepare_stream_frame
+    bool                        m_stream_open;
+    bool                        m_stream_text;
+    bool                        m_stream_compressed;
+    utf8_validator::validator   m_stream_validator;
+
+    // Whether trusted-link mode was negotiated: clients do not mask and
+    // text is not validated
+    bool                        m_trusted_link;
+
     // Extensions
     permessage_deflate_type m_permessage_deflate;
+    permessage_zstd_type m_permessage_zstd;
+    extension_chain_type m_extension_chain;
+};
+
+/// hybi13 with no further overrides
+/**
+ * Used by connections of configs with rfc6455_only set, which hold it
+ * directly rather than through the processor interface. Since the class is
+ * final, calls through a pointer to it are bound at compile time and may be
+ * inlined.
+ *
+ * @since 0.9.0
+ */
+template <typename config>
+class hybi13_final final : public hybi13<config> {
+public:
+    using hybi13<config>::hybi13;
 };
 
 } // namespace processor
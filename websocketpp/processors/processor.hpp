@@ -29,14 +29,24 @@
 #define WEBSOCKETPP_PROCESSOR_HPP
 
 #include <websocketpp/processors/base.hpp>
+#include <websocketpp/processors/handshake_template.hpp>
+#include <websocketpp/common/memory.hpp>
 #include <websocketpp/common/system_error.hpp>
+#include <websocketpp/common/memory_budget.hpp>
+#include <websocketpp/common/memory_usage.hpp>
+#include <websocketpp/extensions/permessage_deflate/memory_budget.hpp>
+#include <websocketpp/extensions/permessage_deflate/tuning.hpp>
+#include <websocketpp/extensions/permessage_zstd/disabled.hpp>
 
 #include <websocketpp/close.hpp>
+#include <websocketpp/frame.hpp>
 #include <websocketpp/utilities.hpp>
 #include <websocketpp/uri.hpp>
 
+#include <charconv>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
@@ -58,6 +68,26 @@ namespace websocketpp {
  */
 namespace processor {
 
+/// Determine whether or not a request is an extended CONNECT
+/**
+ * An HTTP/2 (RFC 8441) or HTTP/3 (RFC 9220) stream opened with an extended
+ * CONNECT carries a WebSocket without an upgrade. Such requests have the
+ * method CONNECT and the version HTTP/2 or HTTP/3, and hold the value of the
+ * :protocol pseudo header as their Upgrade header, see
+ * connection::start_extended_connect.
+ *
+ * @since 0.9.0
+ *
+ * @param r The HTTP request to read.
+ *
+ * @return True if the request is an extended CONNECT, false otherwise
+ */
+template <typename request_type>
+bool is_extended_connect(request_type const & r) {
+    return r.get_method() == "CONNECT" &&
+        (r.get_version() == "HTTP/2" || r.get_version() == "HTTP/3");
+}
+
 /// Determine whether or not a generic HTTP request is a WebSocket handshake
 /**
  * @param r The HTTP request to read.
@@ -68,7 +98,7 @@ template <typename request_type>
 bool is_websocket_handshake(request_type& r) {
     using utility::ci_find_substr;
 
-    std::string const & upgrade_header = r.get_header("Upgrade");
+    std::string_view upgrade_header = r.get_header_view("Upgrade");
 
     if (ci_find_substr(upgrade_header, constants::upgrade_token,
         sizeof(constants::upgrade_token)-1) == upgrade_header.end())
@@ -76,7 +106,12 @@ bool is_websocket_handshake(request_type& r) {
         return false;
     }
 
-    std::string const & con_header = r.get_header("Connection");
+    // HTTP/2 and HTTP/3 have no Connection header
+    if (is_extended_connect(r)) {
+        return true;
+    }
+
+    std::string_view con_header = r.get_header_view("Connection");
 
     if (ci_find_substr(con_header, constants::connection_token,
         sizeof(constants::connection_token)-1) == con_header.end())
@@ -109,14 +144,16 @@ int get_websocket_version(request_type& r) {
         return -2;
     }
     
-    if (r.get_header("Sec-WebSocket-Version").empty()) {
+    std::string_view value = r.get_header_view("Sec-WebSocket-Version");
+
+    if (value.empty()) {
         return 0;
     }
 
     int version;
-    std::istringstream ss(r.get_header("Sec-WebSocket-Version"));
-
-    if ((ss >> version).fail()) {
+    if (std::from_chars(value.data(), value.data() + value.size(),
+        version).ec != std::errc())
+    {
         return -1;
     }
 
@@ -134,7 +171,7 @@ int get_websocket_version(request_type& r) {
  */
 template <typename request_type>
 uri_ptr get_uri_from_host(request_type & request, uri::type scheme, bool secure) {
-    std::string h = request.get_header("Host");
+    std::string h(request.get_header_view("Host"));
 
     size_t last_colon = h.rfind(":");
     size_t last_sbrace = h.rfind("]");
@@ -168,14 +205,25 @@ class processor {
 public:
     typedef processor<config> type;
     typedef typename config::request_type request_type;
+    typedef websocketpp::processor::request_template<request_type>
+        request_template_type;
     typedef typename config::response_type response_type;
     typedef typename config::message_type::ptr message_ptr;
     typedef std::pair<lib::error_code,std::string> err_str_pair;
+    typedef typename extensions::permessage_zstd::policy<config>::type
+        permessage_zstd_type;
+    typedef typename permessage_zstd_type::dictionary_list
+        zstd_dictionary_list;
 
     explicit processor(bool secure, bool p_is_server)
       : m_secure(secure)
       , m_server(p_is_server)
       , m_max_message_size(config::max_message_size)
+      , m_message_views(false)
+      , m_message_chunks(false)
+      , m_spill_threshold(0)
+      , m_spill_max_size(0)
+      , m_trace_id(0)
     {}
 
     virtual ~processor() {}
@@ -211,6 +259,263 @@ public:
         m_max_message_size = new_value;
     }
 
+    /// Get whether small messages may be delivered as read buffer views
+    /**
+     * @since 0.9.0
+     */
+    bool get_message_views() const {
+        return m_message_views;
+    }
+
+    /// Set whether small messages may be delivered as read buffer views
+    /**
+     * When enabled, processors that support it deliver uncompressed, single
+     * frame data messages whose payload lies entirely within one consume call
+     * as a view of the unmasked bytes in the read buffer rather than copying
+     * them into a message. Such messages are retrieved with get_message_view.
+     *
+     * @since 0.9.0
+     *
+     * @param value Whether or not to enable message views
+     */
+    void set_message_views(bool value) {
+        m_message_views = value;
+    }
+
+    /// Set the id passed to the trace points of this processor
+    /**
+     * See trace::point. Connections set it to their address.
+     *
+     * @since 0.9.0
+     *
+     * @param value The id
+     */
+    void set_trace_id(uint64_t value) {
+        m_trace_id = value;
+    }
+
+    /// Get whether data messages are delivered in chunks
+    /**
+     * @since 0.9.0
+     */
+    bool get_message_chunks() const {
+        return m_message_chunks;
+    }
+
+    /// Set whether data messages are delivered in chunks
+    /**
+     * When enabled, processors that support it make the payload of data
+     * messages available as it is read, unmasked and decompressed, via
+     * get_message_chunk, instead of collecting whole messages. This takes
+     * precedence over message views.
+     *
+     * @since 0.9.0
+     *
+     * @param value Whether or not to deliver data messages in chunks
+     */
+    void set_message_chunks(bool value) {
+        m_message_chunks = value;
+    }
+
+    /// Spill large incoming data messages to a temporary file
+    /**
+     * Once the payload of a data message grows past `threshold` bytes,
+     * processors that support it move it to an unlinked temporary file in
+     * `dir` and append the rest there, holding at most `threshold` bytes in
+     * memory. The complete message is delivered with its payload memory
+     * mapped from the file, see spill_file.
+     *
+     * Spilled messages may grow up to `max_size` bytes rather than the
+     * maximum message size. Messages delivered in chunks, and messages
+     * transformed by an extension chain, are not spilled.
+     *
+     * @since 0.9.0
+     *
+     * @param threshold Payload bytes kept in memory, 0 to disable
+     * @param max_size The largest message accepted while spilling, 0 for
+     * the maximum message size
+     * @param dir The directory for the files, empty for the system default
+     */
+    void set_message_spill(size_t threshold, size_t max_size,
+        std::string const & dir)
+    {
+        m_spill_threshold = threshold;
+        m_spill_max_size = max_size;
+        m_spill_dir = dir;
+    }
+
+    /// Get the payload size past which data messages are spilled
+    /**
+     * @since 0.9.0
+     *
+     * @return The threshold in bytes, 0 if spilling is disabled
+     */
+    size_t get_spill_threshold() const {
+        return m_spill_threshold;
+    }
+
+    /// Configure the memory used by permessage-deflate contexts
+    /**
+     * Processors without permessage-deflate support ignore this.
+     *
+     * @since 0.9.0
+     *
+     * @param mem_level The deflate memory level, 0 to keep the default
+     * @param budget Budget to charge compression contexts to, may be null
+     */
+    virtual void set_deflate_memory(int,
+        lib::shared_ptr<extensions::permessage_deflate::memory_budget>) {}
+
+    /// Charge the buffers of incoming data messages to a budget
+    /**
+     * A message is charged for the capacity of its payload buffer as it
+     * grows, until it is retrieved. Reading fails with
+     * error::inbound_memory_limit if the growth does not fit. Processors that
+     * do not support this ignore it.
+     *
+     * @since 0.9.0
+     *
+     * @param budget The budget, or null for no limit
+     */
+    virtual void set_inbound_memory_budget(lib::shared_ptr<memory_budget>) {}
+
+    /// Release permessage-deflate contexts that have been idle
+    /**
+     * Contexts unused since the previous call are released if the negotiated
+     * parameters allow it. Must not be called concurrently with reading, or
+     * with preparing data frames if `outgoing` is true.
+     *
+     * @since 0.9.0
+     *
+     * @param outgoing Whether the compressor may be released
+     */
+    virtual void release_idle_deflate(bool) {}
+
+    /// Release memory held between messages
+    /**
+     * Called when the connection goes idle. Releases permessage-deflate
+     * contexts where the negotiated parameters allow it and buffers kept for
+     * reuse. Everything is created again when next needed. Must not be called
+     * concurrently with reading, or with preparing data frames if `outgoing`
+     * is true.
+     *
+     * @since 0.9.0
+     *
+     * @param outgoing Whether the compressor may be released
+     */
+    virtual void hibernate(bool) {}
+
+    /// Estimate the memory held by the processor
+    /**
+     * Counts the processor object, the messages it is reading and its
+     * buffers, but not its permessage-deflate contexts. Must not be called
+     * concurrently with reading.
+     *
+     * @since 0.9.0
+     *
+     * @return The estimated number of bytes, 0 if the processor does not
+     * support estimates
+     */
+    virtual size_t get_memory_usage() const {
+        return 0;
+    }
+
+    /// Estimate the memory held by the data message being read
+    /**
+     * Counts the payload buffer of a partly read data message and the buffer
+     * it is decompressed through. Must not be called concurrently with
+     * reading.
+     *
+     * @since 0.9.0
+     *
+     * @return The estimated number of bytes, 0 if the processor does not
+     * support estimates
+     */
+    virtual size_t get_inbound_memory_usage() const {
+        return 0;
+    }
+
+    /// Whether trusted-link mode was negotiated
+    /**
+     * In trusted-link mode clients do not mask and text is not validated.
+     *
+     * @since 0.9.0
+     *
+     * @return Whether the connection runs in trusted-link mode
+     */
+    virtual bool is_trusted_link() const {
+        return false;
+    }
+
+    /// Estimate the memory held by the permessage-deflate contexts
+    /**
+     * @since 0.9.0
+     *
+     * @return The estimated number of bytes
+     */
+    virtual size_t get_deflate_memory_usage() const {
+        return 0;
+    }
+
+    /// Offer or accept a permessage-deflate preset dictionary
+    /**
+     * Must be called before extensions are negotiated. Processors without
+     * permessage-deflate support ignore this.
+     *
+     * @since 0.9.0
+     *
+     * @param id Name of the dictionary exchanged during negotiation
+     * @param dictionary The dictionary contents
+     */
+    virtual void set_deflate_dictionary(std::string const &,
+        lib::shared_ptr<std::string const>) {}
+
+    /// Change the permessage-deflate compression level and strategy
+    /**
+     * Applies from the next outgoing message. Must not be called concurrently
+     * with preparing data frames. Processors without permessage-deflate
+     * support ignore this.
+     *
+     * @since 0.9.0
+     *
+     * @param level The compression level, -1 for the default or 0 to 9
+     * @param strategy The compression strategy
+     * @return A status code
+     */
+    virtual lib::error_code set_deflate_params(int,
+        extensions::permessage_deflate::strategy::value)
+    {
+        return lib::error_code();
+    }
+
+    /// Count permessage-deflate work in a shared set of counters
+    /**
+     * Processors without permessage-deflate support ignore this.
+     *
+     * @since 0.9.0
+     *
+     * @param stats The counters to add to, or null to stop counting
+     */
+    virtual void set_deflate_stats(
+        lib::shared_ptr<extensions::permessage_deflate::compression_stats>) {}
+
+    /// Configure the permessage-zstd extension
+    /**
+     * Must be called before extensions are negotiated. Processors without
+     * permessage-zstd support ignore this.
+     *
+     * @since 0.9.0
+     *
+     * @param level The compression level, 0 for zstd's default
+     * @param dictionaries Dictionaries to offer or accept, or null for none
+     * @return A status code
+     */
+    virtual lib::error_code set_zstd_params(int,
+        lib::shared_ptr<zstd_dictionary_list const>)
+    {
+        return lib::error_code();
+    }
+
     /// Returns whether or not the permessage_compress extension is implemented
     /**
      * Compile time flag that indicates whether this processor has implemented
@@ -271,6 +576,29 @@ public:
     virtual lib::error_code process_handshake(request_type const & req,
         std::string const & subprotocol, response_type& res) const = 0;
 
+    /// Write the response to an accepted request from a template
+    /**
+     * Processors whose accepted handshake responses fit handshake_template
+     * write the raw response to `out` directly, without filling in a
+     * response object. Others return not_implemented and the caller uses
+     * process_handshake and get_raw instead.
+     *
+     * @since 0.9.0
+     *
+     * @param req The request to process
+     * @param subprotocol The subprotocol in use
+     * @param extensions The negotiated extensions header value
+     * @param tpl The response template to write from
+     * @param out The string to write the raw response to
+     * @return An error code, 0 on success, non-zero for other errors
+     */
+    virtual lib::error_code write_handshake_response(request_type const &,
+        std::string const &, std::string const &, handshake_template const &,
+        std::string &) const
+    {
+        return error::make_error_code(error::not_implemented);
+    }
+
     /// Fill in an HTTP request for an outgoing connection handshake
     /**
      * @param req The request to process.
@@ -280,6 +608,26 @@ public:
     virtual lib::error_code client_handshake_request(request_type & req,
         uri_ptr uri, std::vector<std::string> const & subprotocols) const = 0;
 
+    /// Write an outgoing handshake request from a template
+    /**
+     * Processors whose requests fit request_template copy the request of
+     * the template into `req` with a new key and write its raw bytes to
+     * `out`. Others return not_implemented and the caller uses
+     * client_handshake_request instead.
+     *
+     * @since 0.9.0
+     *
+     * @param tpl The request template to write from
+     * @param req The request to fill in
+     * @param out The string to write the raw request to
+     * @return An error code, 0 on success, non-zero for other errors
+     */
+    virtual lib::error_code write_handshake_request(
+        request_template_type const &, request_type &, std::string &) const
+    {
+        return error::make_error_code(error::not_implemented);
+    }
+
     /// Validate the server's response to an outgoing handshake request
     /**
      * @param req The original request sent
@@ -347,6 +695,52 @@ public:
      */
     virtual message_ptr get_message() = 0;
 
+    /// Retrieves the most recently processed message as a read buffer view
+    /**
+     * If the ready message was processed in place (see set_message_views)
+     * this fills in its opcode and a view of its payload, resets the ready
+     * state, and returns true. The view points into the buffer most recently
+     * passed to consume and is only valid until that buffer is reused.
+     *
+     * If there is no ready message or the ready message is not a view this
+     * returns false, changes nothing, and the message should be retrieved
+     * with get_message instead.
+     *
+     * @since 0.9.0
+     *
+     * @param [out] op The opcode of the message
+     * @param [out] payload The payload of the message
+     * @return Whether or not a message view was retrieved
+     */
+    virtual bool get_message_view(frame::opcode::value &, std::string_view &) {
+        return false;
+    }
+
+    /// Retrieves the most recently processed chunk of a data message
+    /**
+     * If the ready state is a chunk of a data message (see
+     * set_message_chunks) this fills in the opcode of its message, a view of
+     * the chunk, and whether it is the first and the last chunk of the
+     * message, resets the ready state, and returns true. The view is valid
+     * until the next call. Text is validated before it is delivered, but a
+     * chunk may end part way through a code point.
+     *
+     * Otherwise this returns false and changes nothing.
+     *
+     * @since 0.9.0
+     *
+     * @param [out] op The opcode of the message
+     * @param [out] chunk The next bytes of the message's payload
+     * @param [out] first Whether this is the first chunk of the message
+     * @param [out] last Whether this is the last chunk of the message
+     * @return Whether or not a chunk was retrieved
+     */
+    virtual bool get_message_chunk(frame::opcode::value &, std::string_view &,
+        bool &, bool &)
+    {
+        return false;
+    }
+
     /// Tests whether the processor is in a fatal error state
     virtual bool get_error() const = 0;
 
@@ -357,6 +751,42 @@ public:
         return 1;
     }
 
+    /// Get memory to read the rest of the current frame's payload into
+    /**
+     * When consume stopped part way through a large payload that needs no
+     * transform beyond unmasking, processors that support it hand out the
+     * unfilled part of the message's own buffer, so that the rest of the
+     * frame can be read straight into it rather than through the
+     * connection's read buffer. Report the bytes read with commit_payload.
+     * The buffer stays valid until the frame is complete.
+     *
+     * @since 0.9.0
+     *
+     * @param [in] min_size Only give out a buffer for at least this many
+     * remaining bytes
+     * @param [out] len Set to the size of the buffer, 0 if there is none
+     * @return The buffer, or NULL to read through consume
+     */
+    virtual char * get_payload_buffer(size_t, size_t & len) {
+        len = 0;
+        return NULL;
+    }
+
+    /// Process bytes read into the buffer from get_payload_buffer
+    /**
+     * Unmasks and validates the bytes in place. Once the frame is complete
+     * this does what consume does at the end of a frame, so ready() may
+     * report a message.
+     *
+     * @since 0.9.0
+     *
+     * @param [in] len The number of bytes read into the buffer
+     * @param [out] ec A status code, non-zero on protocol errors
+     */
+    virtual void commit_payload(size_t, lib::error_code & ec) {
+        ec = error::make_error_code(error::not_implemented);
+    }
+
     /// Prepare a data message for writing
     /**
      * Performs validation, masking, compression, etc. will return an error if
@@ -364,6 +794,124 @@ public:
      */
     virtual lib::error_code prepare_data_frame(message_ptr in, message_ptr out) = 0;
 
+    /// Prepare a data message to be written as several fragments
+    /**
+     * Performs the validation and compression of prepare_data_frame but
+     * leaves `out` unprepared, holding the whole unmasked payload to be
+     * framed piece by piece with prepare_fragment. The opcode, fin and
+     * compressed flags of `out` describe the message as a whole.
+     *
+     * Processors that can not fragment messages prepare a single frame
+     * instead, which the caller can tell by `out` being prepared. This is
+     * what the default does.
+     *
+     * @since 0.9.0
+     *
+     * @param in An unprepared message to prepare
+     * @param out A message to be overwritten with the fragment source
+     * @return Status code, zero on success, non-zero on failure
+     */
+    virtual lib::error_code prepare_fragment_source(message_ptr in,
+        message_ptr out)
+    {
+        return prepare_data_frame(in,out);
+    }
+
+    /// Prepare one fragment of a message from prepare_fragment_source
+    /**
+     * The first fragment carries the message's opcode and compression flag,
+     * later ones are continuation frames. The fragment ending the payload
+     * has fin set if the message does.
+     *
+     * @since 0.9.0
+     *
+     * @param source An unprepared message from prepare_fragment_source
+     * @param begin Offset into the payload of the fragment's first byte
+     * @param end Offset into the payload just past the fragment's last byte
+     * @param out A message to be overwritten with the fragment's frame
+     * @return Status code, zero on success, non-zero on failure
+     */
+    virtual lib::error_code prepare_fragment(message_ptr, size_t, size_t,
+        message_ptr)
+    {
+        return error::make_error_code(error::not_implemented);
+    }
+
+    /// Prepare one frame of a message sent in pieces
+    /**
+     * The first frame of the message has a data opcode in `in`, later frames
+     * the continuation opcode, and the last one has fin set. Frames must be
+     * prepared in order, one message at a time. Text is validated across
+     * frame boundaries and, if the first frame is compressed, the following
+     * ones continue the same compressed stream.
+     *
+     * @since 0.9.0
+     *
+     * @param in The chunk of payload with its opcode, fin and compressed flags
+     * @param out A message to be overwritten with the prepared frame
+     * @return Status code, zero on success, non-zero on failure
+     */
+    virtual lib::error_code prepare_stream_frame(message_ptr, message_ptr) {
+        return error::make_error_code(error::not_implemented);
+    }
+
+    /// Pick the frame to write for a broadcast message
+    /**
+     * Broadcast messages carry an uncompressed frame. Processors that can
+     * send a compressed frame shared with other connections return that
+     * instead. The default returns the broadcast message itself.
+     *
+     * @since 0.9.0
+     *
+     * @param in A message produced by endpoint::prepare_broadcast
+     * @return The message to write
+     */
+    virtual message_ptr select_broadcast_frame(message_ptr in) {
+        return in;
+    }
+
+    /// Whether data messages may be compressed in independent parts
+    /**
+     * If true, the payload of a message may be split and each part
+     * compressed with deflate_part, possibly concurrently, then the joined
+     * parts framed with prepare_deflated_frame. The default returns false.
+     *
+     * @since 0.9.0
+     */
+    virtual bool can_split_deflate() const {
+        return false;
+    }
+
+    /// Compress one part of a data message payload
+    /**
+     * Does not change the processor, so may be called from several threads
+     * at once as long as nothing else uses the processor's outgoing side.
+     *
+     * @since 0.9.0
+     *
+     * @param in The part to compress
+     * @param out String to append the compressed part to
+     * @return Status code, zero on success, non-zero on failure
+     */
+    virtual lib::error_code deflate_part(std::string const &, std::string &)
+        const
+    {
+        return error::make_error_code(error::not_implemented);
+    }
+
+    /// Frame a data message compressed with deflate_part
+    /**
+     * @since 0.9.0
+     *
+     * @param in The unprepared message
+     * @param out A message whose raw payload holds the joined compressed
+     * parts, to be prepared in place
+     * @return Status code, zero on success, non-zero on failure
+     */
+    virtual lib::error_code prepare_deflated_frame(message_ptr, message_ptr) {
+        return error::make_error_code(error::not_implemented);
+    }
+
     /// Prepare a ping frame
     /**
      * Ping preparation is entirely state free. There is no payload validation
@@ -406,6 +954,12 @@ protected:
     bool const m_secure;
     bool const m_server;
     size_t m_max_message_size;
+    bool m_message_views;
+    bool m_message_chunks;
+    size_t m_spill_threshold;
+    size_t m_spill_max_size;
+    std::string m_spill_dir;
+    uint64_t m_trace_id;
 };
 
 } // namespace processor
@@ -0,0 +1,436 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_PUBSUB_HPP
+#define WEBSOCKETPP_PUBSUB_HPP
+
+#include <websocketpp/common/connection_hdl.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/ring_queue.hpp>
+#include <websocketpp/common/system_error.hpp>
+#include <websocketpp/common/thread.hpp>
+#include <websocketpp/error.hpp>
+#include <websocketpp/frame.hpp>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace websocketpp {
+
+/// Topic based publish and subscribe over the connections of an endpoint
+/**
+ * Connections are subscribed to named topics and a message published to a
+ * topic is sent to every subscriber. The message is framed once, see
+ * endpoint::prepare_broadcast, and the same frame is queued on each
+ * subscriber with connection::send, so each write still runs on the
+ * subscriber's own strand and is subject to its slow consumer policy.
+ * Published messages carry the topic as their conflation key: subscribers
+ * using slow_consumer::conflate keep only the latest queued message of each
+ * topic.
+ *
+ * Topics are spread over a power of two number of shards, each under its own
+ * mutex. The subscribers of a topic are an immutable list replaced on every
+ * change, so publish only holds a shard lock while copying a pointer and
+ * sends with no lock held. Subscribing and unsubscribing copy the list of
+ * the topic, which suits topics that are published to far more often than
+ * their subscribers change.
+ *
+ * With set_cache_depth, the last few messages of each topic are kept, still
+ * framed, and queued on a new subscriber as it subscribes, so it gets the
+ * current state with no help from the application.
+ *
+ * Subscribers are held by connection_hdl and do not keep connections alive.
+ * Call unsubscribe_all from the close and fail handlers to forget a
+ * connection's subscriptions; until then publish skips it.
+ *
+ * Usage:
+ *
+ *     websocketpp::pubsub<server> topics(endpoint);
+ *     topics.subscribe(hdl, "prices");
+ *     topics.publish("prices", payload, websocketpp::frame::opcode::text, ec);
+ *
+ * @since 0.9.0
+ */
+template <typename endpoint_type>
+class pubsub {
+public:
+    typedef typename endpoint_type::connection_ptr connection_ptr;
+    typedef typename endpoint_type::message_ptr message_ptr;
+
+    /// Construct a topic table publishing through an endpoint
+    /**
+     * The endpoint must outlive the table.
+     *
+     * @param e The endpoint whose connections subscribe
+     * @param shards The number of shards, rounded up to a power of two
+     */
+    explicit pubsub(endpoint_type & e, size_t shards = 16)
+      : m_endpoint(e)
+      , m_cache_depth(0)
+    {
+        size_t n = 1;
+        while (n < shards) {
+            n <<= 1;
+        }
+        m_shards.reset(new shard[n]);
+        m_shard_count = n;
+    }
+
+    /// Set the number of recent messages kept per topic for new subscribers
+    /**
+     * Published messages are kept as framed, the last `depth` of each
+     * topic, including topics with no subscribers. Each new subscriber of a
+     * topic is sent its cached messages, oldest first, before anything
+     * published after it subscribed. Cached messages stay until replaced or
+     * dropped with clear_cache.
+     *
+     * Set before publishing. The default of 0 caches nothing.
+     *
+     * @param depth The number of messages kept per topic
+     */
+    void set_cache_depth(size_t depth) {
+        m_cache_depth = depth;
+    }
+
+    /// Get the number of messages cached for a topic
+    size_t cached(std::string const & topic) const {
+        shard & s = get_shard(topic);
+        lib::lock_guard<lib::mutex> guard(s.lock);
+        typename cache_map::const_iterator it = s.cache.find(topic);
+        return it == s.cache.end() ? 0 : it->second.size();
+    }
+
+    /// Drop the cached messages of a topic
+    void clear_cache(std::string const & topic) {
+        shard & s = get_shard(topic);
+        lib::lock_guard<lib::mutex> guard(s.lock);
+        s.cache.erase(topic);
+    }
+
+    /// Subscribe a connection to a topic
+    /**
+     * The messages cached for the topic are queued on the connection.
+     *
+     * @param hdl The connection to subscribe
+     * @param topic The topic to subscribe to
+     * @return Whether the connection was not already subscribed
+     */
+    bool subscribe(connection_hdl hdl, std::string const & topic) {
+        {
+            shard & s = get_shard(topic);
+            lib::lock_guard<lib::mutex> guard(s.lock);
+            subscriber_list_ptr & list = s.topics[topic];
+            if (list && find(*list, hdl) != list->size()) {
+                return false;
+            }
+
+            // queued under the lock, so that a concurrent publish that
+            // missed the cache sends after them
+            typename cache_map::iterator cached = s.cache.find(topic);
+            if (cached != s.cache.end()) {
+                lib::error_code ec;
+                connection_ptr con = m_endpoint.get_con_from_hdl(hdl, ec);
+                typename ring_queue<message_ptr>::iterator it;
+                for (it = cached->second.begin(); !ec &&
+                    it != cached->second.end(); ++it)
+                {
+                    con->send(*it);
+                }
+            }
+
+            lib::shared_ptr<subscriber_list> next =
+                lib::make_shared<subscriber_list>();
+            if (list) {
+                next->reserve(list->size() + 1);
+                *next = *list;
+            }
+            next->push_back(hdl);
+            list = next;
+        }
+
+        lib::lock_guard<lib::mutex> guard(m_index_lock);
+        m_index[hdl].push_back(topic);
+        return true;
+    }
+
+    /// Unsubscribe a connection from a topic
+    /**
+     * @param hdl The connection to unsubscribe
+     * @param topic The topic to unsubscribe from
+     * @return Whether the connection was subscribed
+     */
+    bool unsubscribe(connection_hdl hdl, std::string const & topic) {
+        if (!remove(hdl, topic)) {
+            return false;
+        }
+
+        lib::lock_guard<lib::mutex> guard(m_index_lock);
+        typename index_type::iterator it = m_index.find(hdl);
+        if (it != m_index.end()) {
+            std::vector<std::string> & topics = it->second;
+            for (size_t i = 0; i < topics.size(); ++i) {
+                if (topics[i] == topic) {
+                    topics[i] = topics.back();
+                    topics.pop_back();
+                    break;
+                }
+            }
+            if (topics.empty()) {
+                m_index.erase(it);
+            }
+        }
+        return true;
+    }
+
+    /// Unsubscribe a connection from every topic
+    /**
+     * Meant to be called from the close and fail handlers.
+     *
+     * @param hdl The connection to unsubscribe
+     * @return The number of topics it was subscribed to
+     */
+    size_t unsubscribe_all(connection_hdl hdl) {
+        std::vector<std::string> topics;
+        {
+            lib::lock_guard<lib::mutex> guard(m_index_lock);
+            typename index_type::iterator it = m_index.find(hdl);
+            if (it == m_index.end()) {
+                return 0;
+            }
+            topics.swap(it->second);
+            m_index.erase(it);
+        }
+
+        size_t removed = 0;
+        for (size_t i = 0; i < topics.size(); ++i) {
+            if (remove(hdl, topics[i])) {
+                ++removed;
+            }
+        }
+        return removed;
+    }
+
+    /// Get the number of subscribers of a topic
+    size_t subscriber_count(std::string const & topic) const {
+        subscriber_list_ptr list = get_subscribers(topic);
+        return list ? list->size() : 0;
+    }
+
+    /// Get the number of topics with at least one subscriber
+    size_t topic_count() const {
+        size_t count = 0;
+        for (size_t i = 0; i < m_shard_count; ++i) {
+            lib::lock_guard<lib::mutex> guard(m_shards[i].lock);
+            count += m_shards[i].topics.size();
+        }
+        return count;
+    }
+
+    /// Publish a payload to the subscribers of a topic
+    /**
+     * Frames the payload once with endpoint::prepare_broadcast and sends the
+     * frame to each subscriber. Nothing is framed if the topic has no
+     * subscribers and there is no cache.
+     *
+     * @param topic The topic to publish to
+     * @param payload The payload of the message
+     * @param op The opcode of the message. Must be a data opcode.
+     * @param [out] ec Set if the message could not be prepared. Errors
+     * sending to individual subscribers are only reflected in the result.
+     * @return The number of subscribers the message was queued on
+     */
+    size_t publish(std::string const & topic, std::string const & payload,
+        frame::opcode::value op, lib::error_code & ec)
+    {
+        ec = lib::error_code();
+        if (m_cache_depth == 0 && !get_subscribers(topic)) {
+            return 0;
+        }
+
+        message_ptr msg = m_endpoint.prepare_broadcast(payload, op, ec);
+        if (ec) {
+            return 0;
+        }
+        return this->publish(topic, msg);
+    }
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+    /// Publish a payload to the subscribers of a topic (exception version)
+    size_t publish(std::string const & topic, std::string const & payload,
+        frame::opcode::value op)
+    {
+        lib::error_code ec;
+        size_t sent = this->publish(topic, payload, op, ec);
+        if (ec) {
+            throw exception(ec);
+        }
+        return sent;
+    }
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
+    /// Publish a message to the subscribers of a topic
+    /**
+     * For messages prepared by the caller, normally with
+     * endpoint::prepare_broadcast. The message is shared between the
+     * subscribers. Its conflation key is set to the topic unless it already
+     * has one.
+     *
+     * @param topic The topic to publish to
+     * @param msg The message to send
+     * @return The number of subscribers the message was queued on
+     */
+    size_t publish(std::string const & topic, message_ptr msg) {
+        if (!msg) {
+            return 0;
+        }
+        if (msg->get_conflation_key().empty()) {
+            msg->set_conflation_key(topic);
+        }
+
+        subscriber_list_ptr list;
+        {
+            shard & s = get_shard(topic);
+            lib::lock_guard<lib::mutex> guard(s.lock);
+            if (m_cache_depth > 0) {
+                ring_queue<message_ptr> & cache = s.cache[topic];
+                cache.push_back(msg);
+                while (cache.size() > m_cache_depth) {
+                    cache.pop_front();
+                }
+            }
+            typename topic_map::const_iterator it = s.topics.find(topic);
+            if (it != s.topics.end()) {
+                list = it->second;
+            }
+        }
+
+        if (!list) {
+            return 0;
+        }
+        return send(*list, msg);
+    }
+private:
+    typedef std::vector<connection_hdl> subscriber_list;
+    typedef lib::shared_ptr<subscriber_list const> subscriber_list_ptr;
+    typedef std::unordered_map<std::string, subscriber_list_ptr> topic_map;
+    typedef std::unordered_map<std::string, ring_queue<message_ptr> >
+        cache_map;
+    typedef std::map<connection_hdl, std::vector<std::string>,
+        std::owner_less<connection_hdl> > index_type;
+
+    struct shard {
+        mutable lib::mutex lock;
+        topic_map topics;
+        /// Recent messages of each topic, oldest first
+        cache_map cache;
+    };
+
+    pubsub(pubsub const &) = delete;
+    pubsub & operator=(pubsub const &) = delete;
+
+    shard & get_shard(std::string const & topic) const {
+        return m_shards[std::hash<std::string>()(topic) & (m_shard_count - 1)];
+    }
+
+    subscriber_list_ptr get_subscribers(std::string const & topic) const {
+        shard & s = get_shard(topic);
+        lib::lock_guard<lib::mutex> guard(s.lock);
+        typename topic_map::const_iterator it = s.topics.find(topic);
+        return it == s.topics.end() ? subscriber_list_ptr() : it->second;
+    }
+
+    /// Position of hdl in list, list.size() if absent
+    static size_t find(subscriber_list const & list, connection_hdl const & hdl)
+    {
+        for (size_t i = 0; i < list.size(); ++i) {
+            if (!list[i].owner_before(hdl) && !hdl.owner_before(list[i])) {
+                return i;
+            }
+        }
+        return list.size();
+    }
+
+    /// Remove hdl from the subscribers of topic, leaving the index alone
+    bool remove(connection_hdl const & hdl, std::string const & topic) {
+        shard & s = get_shard(topic);
+        lib::lock_guard<lib::mutex> guard(s.lock);
+        typename topic_map::iterator it = s.topics.find(topic);
+        if (it == s.topics.end()) {
+            return false;
+        }
+
+        subscriber_list const & list = *it->second;
+        size_t i = find(list, hdl);
+        if (i == list.size()) {
+            return false;
+        }
+
+        if (list.size() == 1) {
+            s.topics.erase(it);
+            return true;
+        }
+
+        lib::shared_ptr<subscriber_list> next =
+            lib::make_shared<subscriber_list>(list);
+        (*next)[i] = next->back();
+        next->pop_back();
+        it->second = next;
+        return true;
+    }
+
+    size_t send(subscriber_list const & list, message_ptr const & msg) {
+        size_t sent = 0;
+        for (size_t i = 0; i < list.size(); ++i) {
+            lib::error_code ec;
+            connection_ptr con = m_endpoint.get_con_from_hdl(list[i], ec);
+            if (ec) {
+                continue;
+            }
+            if (!con->send(msg)) {
+                ++sent;
+            }
+        }
+        return sent;
+    }
+
+    endpoint_type & m_endpoint;
+    std::unique_ptr<shard[]> m_shards;
+    size_t m_shard_count;
+    size_t m_cache_depth;
+
+    /// Topics of each subscribed connection, for unsubscribe_all
+    mutable lib::mutex m_index_lock;
+    index_type m_index;
+};
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_PUBSUB_HPP
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_RANDOM_CHACHA_HPP
+#define WEBSOCKETPP_RANDOM_CHACHA_HPP
+
+#include <websocketpp/common/random.hpp>
+#include <websocketpp/common/stdint.hpp>
+
+#include <cstring>
+
+namespace websocketpp {
+namespace random {
+/// RNG policy based on a per thread ChaCha20 stream
+namespace chacha {
+
+namespace detail {
+
+inline uint32_t rotl(uint32_t v, int n) {
+    return (v << n) | (v >> (32 - n));
+}
+
+inline void quarter_round(uint32_t * x, int a, int b, int c, int d) {
+    x[a] += x[b]; x[d] = rotl(x[d] ^ x[a], 16);
+    x[c] += x[d]; x[b] = rotl(x[b] ^ x[c], 12);
+    x[a] += x[b]; x[d] = rotl(x[d] ^ x[a], 8);
+    x[c] += x[d]; x[b] = rotl(x[b] ^ x[c], 7);
+}
+
+/// Compute one ChaCha20 block as laid out in RFC 8439
+/**
+ * @param key The 256 bit key as eight little endian words
+ * @param counter The block counter
+ * @param nonce The 96 bit nonce as three little endian words
+ * @param [out] out The sixteen words of the block
+ */
+inline void block(uint32_t const * key, uint32_t counter,
+    uint32_t const * nonce, uint32_t * out)
+{
+    uint32_t in[16] = {
+        0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+        key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+        counter, nonce[0], nonce[1], nonce[2]
+    };
+
+    std::memcpy(out, in, sizeof(in));
+    for (int i = 0; i < 10; ++i) {
+        quarter_round(out, 0, 4, 8, 12);
+        quarter_round(out, 1, 5, 9, 13);
+        quarter_round(out, 2, 6, 10, 14);
+        quarter_round(out, 3, 7, 11, 15);
+        quarter_round(out, 0, 5, 10, 15);
+        quarter_round(out, 1, 6, 11, 12);
+        quarter_round(out, 2, 7, 8, 13);
+        quarter_round(out, 3, 4, 9, 14);
+    }
+    for (int i = 0; i < 16; ++i) {
+        out[i] += in[i];
+    }
+}
+
+/// The key stream of one thread
+/**
+ * Keyed from lib::random_device on first use. Each refill computes four
+ * blocks; the first eight words become the next key and are never handed
+ * out, so a later compromise of the state does not reveal earlier output.
+ */
+class stream {
+public:
+    stream() : m_next(words) {
+        lib::random_device rd;
+        for (int i = 0; i < 8; ++i) {
+            m_key[i] = rd();
+        }
+    }
+
+    ~stream() {
+        // do not leave key material behind in thread storage
+        volatile uint32_t * p = m_key;
+        for (int i = 0; i < 8; ++i) {
+            p[i] = 0;
+        }
+    }
+
+    uint32_t next() {
+        if (m_next == words) {
+            refill();
+        }
+        return m_buffer[m_next++];
+    }
+private:
+    static int const blocks = 4;
+    static int const words = 16 * blocks;
+
+    void refill() {
+        uint32_t const nonce[3] = {0, 0, 0};
+        for (int i = 0; i < blocks; ++i) {
+            block(m_key, static_cast<uint32_t>(i), nonce, m_buffer + 16 * i);
+        }
+        std::memcpy(m_key, m_buffer, sizeof(m_key));
+        m_next = 8;
+    }
+
+    uint32_t m_key[8];
+    uint32_t m_buffer[words];
+    int m_next;
+};
+
+inline stream & thread_stream() {
+    static thread_local stream s;
+    return s;
+}
+
+} // namespace detail
+
+/// Fast non-deterministic random integer generator.
+/**
+ * A drop in replacement for random_device::int_generator for connections
+ * that need many random numbers, such as the masking keys of client
+ * frames. Numbers come from a ChaCha20 key stream kept per thread and
+ * keyed once per thread from lib::random_device, so generating one takes
+ * no lock and no system call, while staying unpredictable to a peer as
+ * RFC 6455 requires of masking keys.
+ *
+ * Numbers are produced in a uniformly distributed range from the smallest
+ * to largest value that int_type can store. The concurrency parameter is
+ * unused; it keeps the signature of random_device::int_generator.
+ *
+ * Call operator() to generate the next number
+ *
+ * @since 0.9.0
+ */
+template <typename int_type, typename concurrency>
+class int_generator {
+    public:
+        int_generator() {}
+
+        /// advances the engine's state and returns the generated value
+        int_type operator()() {
+            detail::stream & s = detail::thread_stream();
+
+            uint32_t words[(sizeof(int_type) + 3) / 4];
+            for (size_t i = 0; i < sizeof(words) / 4; ++i) {
+                words[i] = s.next();
+            }
+
+            int_type value;
+            std::memcpy(&value, words, sizeof(value));
+            return value;
+        }
+};
+
+} // namespace chacha
+} // namespace random
+} // namespace websocketpp
+
+#endif //WEBSOCKETPP_RANDOM_CHACHA_HPP
@@ -0,0 +1,381 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_RECONNECT_HPP
+#define WEBSOCKETPP_RECONNECT_HPP
+
+#include <websocketpp/close.hpp>
+#include <websocketpp/common/connection_hdl.hpp>
+#include <websocketpp/common/functional.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <string>
+
+namespace websocketpp {
+
+/// Keeps a client connected to a URI, with warm standby connections
+/**
+ * The manager opens one active connection and up to `standby` more that
+ * stay open unused. When the active connection closes, the oldest standby
+ * takes over at once and a replacement is opened in the background.
+ *
+ * Connections that fail to open are retried with exponential backoff and
+ * full jitter: the n-th consecutive failure waits a uniformly random time
+ * between 0 and min(max, initial * multiplier^(n-1)), so clients that lost
+ * the same server don't come back in lockstep. Replacing a closed
+ * connection waits up to the initial backoff for the same reason.
+ *
+ * Each connection comes from get_connection on the endpoint and gets the
+ * endpoint's handlers, except that the manager sets its own open, fail and
+ * close handlers and forwards what concerns the active connection to the
+ * handlers set on the manager. The init handler may configure each
+ * connection before it connects.
+ *
+ * Reconnects benefit from the caches of the endpoint: set_dns_cache_ttl
+ * skips resolving the host again, and for TLS configs set_session_cache
+ * resumes the previous session.
+ *
+ * The endpoint must outlive the manager, and the manager must outlive its
+ * connections. Apart from start and stop, call it only from the thread
+ * running the endpoint, such as from its handlers.
+ *
+ * Usage:
+ *
+ *     websocketpp::reconnect_manager<client> link(endpoint, "ws://host/");
+ *     link.set_standby(1);
+ *     link.set_open_handler(...);
+ *     link.start();
+ *     endpoint.run();
+ *
+ * @since 0.9.0
+ */
+template <typename endpoint_type>
+class reconnect_manager {
+public:
+    typedef reconnect_manager<endpoint_type> type;
+    typedef typename endpoint_type::connection_ptr connection_ptr;
+    typedef typename endpoint_type::timer_ptr timer_ptr;
+
+    /// Type of the handlers called about the active connection
+    typedef lib::function<void(connection_hdl)> connection_handler;
+    /// Type of the handler that configures each new connection
+    typedef lib::function<void(connection_ptr const &)> init_handler;
+
+    /// Construct a manager connecting through an endpoint
+    /**
+     * @param e The client endpoint
+     * @param uri The URI to keep a connection to
+     */
+    reconnect_manager(endpoint_type & e, std::string const & uri)
+      : m_endpoint(e)
+      , m_uri(uri)
+      , m_initial_backoff(100)
+      , m_max_backoff(30000)
+      , m_multiplier(2.0)
+      , m_standby(0)
+      , m_running(false)
+      , m_failures(0)
+      , m_attempts(0)
+      , m_pending(0)
+      , m_retry_waiting(false)
+      , m_rng(std::random_device()()) {}
+
+    /// Set the backoff between failed attempts
+    /**
+     * The default is 100ms, doubling up to 30s.
+     *
+     * @param initial The most the first retry waits in ms
+     * @param max The most any retry waits in ms
+     * @param multiplier The growth of the wait per consecutive failure
+     */
+    void set_backoff(long initial, long max, double multiplier = 2.0) {
+        m_initial_backoff = initial;
+        m_max_backoff = max;
+        m_multiplier = multiplier;
+    }
+
+    /// Set the number of standby connections kept open
+    /**
+     * @param count The number of standby connections, 0 (the default) for
+     * none
+     */
+    void set_standby(size_t count) {
+        m_standby = count;
+    }
+
+    /// Set the handler that configures each connection before it connects
+    void set_init_handler(init_handler h) {
+        m_init_handler = h;
+    }
+
+    /// Set the handler called when a connection becomes the active one
+    void set_open_handler(connection_handler h) {
+        m_open_handler = h;
+    }
+
+    /// Set the handler called when the active connection closed
+    /**
+     * A standby connection, if any, becomes active right after it returns.
+     */
+    void set_close_handler(connection_handler h) {
+        m_close_handler = h;
+    }
+
+    /// Start connecting
+    /**
+     * May be called from any thread, the connections are opened once the
+     * endpoint runs.
+     */
+    void start() {
+        m_endpoint.get_io_context().post(lib::bind(&type::handle_start,
+            this));
+    }
+
+    /// Stop reconnecting and close every connection
+    /**
+     * May be called from any thread. The close handler is called for the
+     * active connection once it closed.
+     */
+    void stop() {
+        m_endpoint.get_io_context().post(lib::bind(&type::handle_stop,
+            this));
+    }
+
+    /// Get the active connection
+    /**
+     * @return The handle of the active connection, empty if there is none
+     */
+    connection_hdl get_active() const {
+        return m_active;
+    }
+
+    /// Get the number of open standby connections
+    size_t get_standby_count() const {
+        return m_standbys.size();
+    }
+
+    /// Get the number of connection attempts made
+    uint64_t get_attempts() const {
+        return m_attempts;
+    }
+
+    /// Get the number of consecutive failed attempts
+    size_t get_failures() const {
+        return m_failures;
+    }
+
+    /// Get the most a retry waits after a number of consecutive failures
+    /**
+     * @param failures The number of consecutive failures
+     * @return The upper bound of the wait in ms
+     */
+    long get_backoff_cap(size_t failures) const {
+        double cap = static_cast<double>(m_initial_backoff);
+        for (size_t i = 1; i < failures && cap < m_max_backoff; ++i) {
+            cap *= m_multiplier;
+        }
+        return static_cast<long>((std::min)(cap,
+            static_cast<double>(m_max_backoff)));
+    }
+private:
+    static bool same(connection_hdl const & a, connection_hdl const & b) {
+        return !a.owner_before(b) && !b.owner_before(a);
+    }
+
+    void handle_start() {
+        m_running = true;
+        this->fill();
+    }
+
+    void handle_stop() {
+        m_running = false;
+        if (m_retry_timer) {
+            m_retry_timer->cancel();
+        }
+
+        lib::error_code ec;
+        if (!m_active.expired()) {
+            m_endpoint.close(m_active, close::status::going_away, "", ec);
+        }
+        std::deque<connection_hdl> standbys;
+        standbys.swap(m_standbys);
+        for (size_t i = 0; i < standbys.size(); ++i) {
+            m_endpoint.close(standbys[i], close::status::going_away, "", ec);
+        }
+    }
+
+    /// Open connections until there is an active one and enough standbys
+    void fill() {
+        while (m_running && !m_retry_waiting &&
+            (m_active.expired() ? 0 : 1) + m_standbys.size() + m_pending <
+                1 + m_standby)
+        {
+            this->launch();
+        }
+    }
+
+    void launch() {
+        ++m_attempts;
+
+        lib::error_code ec;
+        connection_ptr con = m_endpoint.get_connection(m_uri, ec);
+        if (ec) {
+            ++m_failures;
+            this->schedule_retry();
+            return;
+        }
+
+        if (m_init_handler) {
+            m_init_handler(con);
+        }
+        con->set_open_handler(lib::bind(&type::handle_open, this,
+            lib::placeholders::_1));
+        con->set_fail_handler(lib::bind(&type::handle_fail, this,
+            lib::placeholders::_1));
+        con->set_close_handler(lib::bind(&type::handle_close, this,
+            lib::placeholders::_1));
+
+        ++m_pending;
+        m_endpoint.connect(con);
+    }
+
+    /// Wait a random time up to the backoff of the current failures
+    void schedule_retry() {
+        if (!m_running || m_retry_waiting) {
+            return;
+        }
+
+        std::uniform_int_distribution<long> jitter(0,
+            get_backoff_cap(m_failures));
+        m_retry_waiting = true;
+        m_retry_timer = m_endpoint.set_timer(jitter(m_rng), lib::bind(
+            &type::handle_retry, this, lib::placeholders::_1));
+    }
+
+    void handle_retry(lib::error_code const & ec) {
+        m_retry_waiting = false;
+        if (ec) {
+            return;
+        }
+        this->fill();
+    }
+
+    void handle_open(connection_hdl hdl) {
+        --m_pending;
+        m_failures = 0;
+
+        if (!m_running) {
+            lib::error_code ec;
+            m_endpoint.close(hdl, close::status::going_away, "", ec);
+            return;
+        }
+
+        if (m_active.expired()) {
+            m_active = hdl;
+            if (m_open_handler) {
+                m_open_handler(hdl);
+            }
+        } else {
+            m_standbys.push_back(hdl);
+        }
+    }
+
+    void handle_fail(connection_hdl) {
+        --m_pending;
+        ++m_failures;
+        this->schedule_retry();
+    }
+
+    void handle_close(connection_hdl hdl) {
+        if (same(hdl, m_active)) {
+            m_active.reset();
+            if (m_close_handler) {
+                m_close_handler(hdl);
+            }
+            this->promote();
+        } else {
+            m_standbys.erase(std::remove_if(m_standbys.begin(),
+                m_standbys.end(), [&hdl](connection_hdl const & s) {
+                    return same(s, hdl);
+                }), m_standbys.end());
+        }
+
+        // the replacement is jittered like a retry
+        this->schedule_retry();
+    }
+
+    /// Make the oldest standby connection that is still open active
+    void promote() {
+        while (m_running && !m_standbys.empty()) {
+            connection_hdl hdl = m_standbys.front();
+            m_standbys.pop_front();
+            if (hdl.expired()) {
+                continue;
+            }
+            m_active = hdl;
+            if (m_open_handler) {
+                m_open_handler(hdl);
+            }
+            return;
+        }
+    }
+
+    endpoint_type & m_endpoint;
+    std::string const m_uri;
+
+    long m_initial_backoff;
+    long m_max_backoff;
+    double m_multiplier;
+    size_t m_standby;
+
+    init_handler m_init_handler;
+    connection_handler m_open_handler;
+    connection_handler m_close_handler;
+
+    bool m_running;
+    size_t m_failures;
+    uint64_t m_attempts;
+    // connections connecting that haven't opened or failed yet
+    size_t m_pending;
+
+    connection_hdl m_active;
+    std::deque<connection_hdl> m_standbys;
+
+    bool m_retry_waiting;
+    timer_ptr m_retry_timer;
+    std::mt19937 m_rng;
+};
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_RECONNECT_HPP
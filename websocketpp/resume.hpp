@@ -0,0 +1,584 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_RESUME_HPP
+#define WEBSOCKETPP_RESUME_HPP
+
+#include <websocketpp/close.hpp>
+#include <websocketpp/common/connection_hdl.hpp>
+#include <websocketpp/common/ring_queue.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+#include <websocketpp/error.hpp>
+#include <websocketpp/frame.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace websocketpp {
+namespace resume {
+
+/// Build the subprotocol token offering a session
+/**
+ * `<protocol>.<id>` asks for a fresh session, `<protocol>.<id>.<last>`
+ * asks to resume one after the message with sequence number `last`.
+ */
+inline std::string make_token(std::string const & protocol,
+    std::string const & id)
+{
+    return protocol + "." + id;
+}
+
+inline std::string make_token(std::string const & protocol,
+    std::string const & id, uint64_t last)
+{
+    return protocol + "." + id + "." + std::to_string(last);
+}
+
+/// Parse a subprotocol token of make_token
+/**
+ * @param [in] protocol The protocol name the token starts with
+ * @param [in] token The token
+ * @param [out] id The session id
+ * @param [out] last The last sequence number, if the token has one
+ * @param [out] resuming Whether the token has a sequence number
+ * @return Whether the token is a session token of protocol
+ */
+inline bool parse_token(std::string const & protocol, std::string const & token,
+    std::string & id, uint64_t & last, bool & resuming)
+{
+    if (token.size() <= protocol.size() + 1 ||
+        token.compare(0, protocol.size(), protocol) != 0 ||
+        token[protocol.size()] != '.')
+    {
+        return false;
+    }
+
+    size_t start = protocol.size() + 1;
+    size_t dot = token.find('.', start);
+    id = token.substr(start, dot - start);
+    if (id.empty() || id.size() > 64) {
+        return false;
+    }
+    for (size_t i = 0; i < id.size(); ++i) {
+        char c = id[i];
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+            (c >= 'A' && c <= 'Z') || c == '-' || c == '_'))
+        {
+            return false;
+        }
+    }
+
+    resuming = dot != std::string::npos;
+    last = 0;
+    if (resuming) {
+        std::string digits = token.substr(dot + 1);
+        if (digits.empty() || digits.size() > 19 ||
+            digits.find_first_not_of("0123456789") != std::string::npos)
+        {
+            return false;
+        }
+        last = std::strtoull(digits.c_str(), NULL, 10);
+    }
+    return true;
+}
+
+/// Server side store of resumable sessions
+/**
+ * A session outlives the connections it runs over. Messages sent to a
+ * session with send are numbered from 1 and framed once, see
+ * endpoint::prepare_broadcast, and the most recent of them are kept in a
+ * bounded replay buffer. When the connection drops, the session and its
+ * buffer are kept for a TTL. A client that reconnects within it tells the
+ * server the last sequence number it received, and only the messages after
+ * it are sent again, rather than a full snapshot of the application state.
+ *
+ * The session is negotiated in the opening handshake as a subprotocol. The
+ * client picks a random session id and offers `<protocol>.<id>.<last>` to
+ * resume it, followed by `<protocol>.<id>` for a fresh session should the
+ * server not be able to resume. The server selects one of the two, so the
+ * client learns whether it has to start over. session_cursor does the
+ * client's part. Session ids are bearer secrets: anyone who knows one may
+ * take the session over.
+ *
+ * The store hooks into the handlers of the endpoint:
+ *
+ *     websocketpp::resume::session_store<server> sessions(endpoint);
+ *     // validate handler
+ *     sessions.accept(con, ec);
+ *     // open handler
+ *     sessions.attach(hdl);
+ *     // close and fail handlers
+ *     sessions.detach(hdl);
+ *     // anywhere
+ *     sessions.send(sessions.get_session(hdl), payload, opcode, ec);
+ *
+ * Every message of a session has to go through send for the sequence
+ * numbers of server and client to agree. Call expire now and then to drop
+ * sessions whose TTL is up; accept does so as well.
+ *
+ * The endpoint must outlive the store. Call it only from the thread running
+ * the endpoint, such as from its handlers.
+ *
+ * @since 0.9.0
+ */
+template <typename endpoint_type>
+class session_store {
+public:
+    typedef typename endpoint_type::connection_ptr connection_ptr;
+    typedef typename endpoint_type::message_ptr message_ptr;
+    typedef std::chrono::steady_clock clock_type;
+
+    /// Construct a store sending through an endpoint
+    /**
+     * @param e The server endpoint
+     * @param protocol The subprotocol name session tokens start with
+     */
+    explicit session_store(endpoint_type & e,
+        std::string const & protocol = "resume")
+      : m_endpoint(e)
+      , m_protocol(protocol)
+      , m_max_messages(256)
+      , m_max_bytes(1048576)
+      , m_ttl(60000) {}
+
+    /// Set the bounds of each session's replay buffer
+    /**
+     * The oldest messages are dropped past either bound. A client that
+     * missed a dropped message can't resume. The default is 256 messages
+     * and 1MB.
+     *
+     * @param messages The most messages kept
+     * @param bytes The most payload bytes kept
+     */
+    void set_replay_limit(size_t messages, size_t bytes) {
+        m_max_messages = messages;
+        m_max_bytes = bytes;
+    }
+
+    /// Set how long a session is kept after its connection closed
+    /**
+     * @param ttl The time in ms, 60s by default
+     */
+    void set_ttl(long ttl) {
+        m_ttl = ttl;
+    }
+
+    /// Get the subprotocol name of session tokens
+    std::string const & get_protocol() const {
+        return m_protocol;
+    }
+
+    /// Negotiate the session of a connection
+    /**
+     * Meant to be called from the validate handler. Selects the resume
+     * token of the connection's offer if its session still has every
+     * message after the last one the client received, otherwise selects
+     * the fresh token and starts the session over, dropping what it had
+     * buffered.
+     *
+     * @param [in] con The connection being validated
+     * @param [out] ec invalid_subprotocol if the client offered no session
+     * @return Whether the session is resumed
+     */
+    bool accept(connection_ptr const & con, lib::error_code & ec) {
+        ec = lib::error_code();
+        expire();
+
+        std::vector<std::string> const & offers =
+            con->get_requested_subprotocols();
+
+        std::string id;
+        uint64_t last;
+        bool resuming;
+        std::string fresh;
+        for (size_t i = 0; i < offers.size(); ++i) {
+            if (!parse_token(m_protocol, offers[i], id, last, resuming)) {
+                continue;
+            }
+
+            if (!resuming) {
+                if (fresh.empty()) {
+                    fresh = offers[i];
+                }
+                continue;
+            }
+
+            typename session_map::iterator it = m_sessions.find(id);
+            if (it == m_sessions.end() || !it->second.can_resume(last)) {
+                continue;
+            }
+
+            con->select_subprotocol(offers[i], ec);
+            if (ec) {
+                return false;
+            }
+            m_pending[con->get_handle()] = pending(id, last);
+            return true;
+        }
+
+        if (fresh.empty() || !parse_token(m_protocol, fresh, id, last,
+            resuming))
+        {
+            ec = error::make_error_code(error::invalid_subprotocol);
+            return false;
+        }
+
+        con->select_subprotocol(fresh, ec);
+        if (ec) {
+            return false;
+        }
+
+        session & s = m_sessions[id];
+        s.reset();
+        s.detached_at = clock_type::now();
+        m_pending[con->get_handle()] = pending(id, 0);
+        return false;
+    }
+
+    /// Run a negotiated session over a connection
+    /**
+     * Meant to be called from the open handler. Sends the buffered
+     * messages the client missed. A connection the session was still
+     * attached to, which happens when the server hasn't noticed the drop
+     * yet, is closed.
+     *
+     * @param hdl The connection that opened
+     * @return Whether the connection negotiated a session
+     */
+    bool attach(connection_hdl hdl) {
+        typename pending_map::iterator p = m_pending.find(hdl);
+        if (p == m_pending.end()) {
+            return false;
+        }
+        std::string id = p->second.id;
+        uint64_t last = p->second.last;
+        m_pending.erase(p);
+
+        typename session_map::iterator it = m_sessions.find(id);
+        if (it == m_sessions.end()) {
+            return false;
+        }
+        session & s = it->second;
+
+        connection_ptr old = get_connection(s.hdl);
+        if (old) {
+            m_attached.erase(s.hdl);
+            lib::error_code ec;
+            old->close(close::status::going_away, "session resumed", ec);
+        }
+
+        s.hdl = hdl;
+        m_attached[hdl] = id;
+
+        // the client has everything up to last
+        while (!s.replay.empty() && s.first_seq <= last) {
+            s.drop_front();
+        }
+
+        connection_ptr con = get_connection(hdl);
+        if (con) {
+            typename ring_queue<message_ptr>::iterator r;
+            for (r = s.replay.begin(); r != s.replay.end(); ++r) {
+                con->send(*r);
+            }
+        }
+        return true;
+    }
+
+    /// Keep the session of a closed connection for the TTL
+    /**
+     * Meant to be called from the close and fail handlers.
+     *
+     * @param hdl The connection that closed
+     */
+    void detach(connection_hdl hdl) {
+        m_pending.erase(hdl);
+
+        typename attached_map::iterator a = m_attached.find(hdl);
+        if (a == m_attached.end()) {
+            return;
+        }
+
+        typename session_map::iterator it = m_sessions.find(a->second);
+        m_attached.erase(a);
+        if (it != m_sessions.end()) {
+            it->second.hdl.reset();
+            it->second.detached_at = clock_type::now();
+        }
+    }
+
+    /// Get the session id of a connection
+    /**
+     * @param hdl The connection
+     * @return The id, empty if the connection runs no session
+     */
+    std::string get_session(connection_hdl hdl) const {
+        typename attached_map::const_iterator a = m_attached.find(hdl);
+        return a == m_attached.end() ? std::string() : a->second;
+    }
+
+    /// Send a message to a session
+    /**
+     * The message is numbered and buffered, and sent right away if the
+     * session has a connection.
+     *
+     * @param [in] id The session
+     * @param [in] payload The payload of the message
+     * @param [in] op The opcode of the message. Must be a data opcode.
+     * @param [out] ec bad_connection if there is no such session
+     * @return The sequence number of the message, 0 on error
+     */
+    uint64_t send(std::string const & id, std::string const & payload,
+        frame::opcode::value op, lib::error_code & ec)
+    {
+        typename session_map::iterator it = m_sessions.find(id);
+        if (it == m_sessions.end()) {
+            ec = error::make_error_code(error::bad_connection);
+            return 0;
+        }
+
+        message_ptr msg = m_endpoint.prepare_broadcast(payload, op, ec);
+        if (ec) {
+            return 0;
+        }
+
+        session & s = it->second;
+        s.replay.push_back(msg);
+        s.bytes += msg->get_payload_size();
+        uint64_t seq = s.next_seq++;
+        while (!s.replay.empty() && (s.replay.size() > m_max_messages ||
+            s.bytes > m_max_bytes))
+        {
+            s.drop_front();
+        }
+
+        connection_ptr con = get_connection(s.hdl);
+        if (con) {
+            con->send(msg);
+        }
+        return seq;
+    }
+
+    /// Drop the sessions whose connection closed more than the TTL ago
+    /**
+     * @return The number of sessions dropped
+     */
+    size_t expire() {
+        clock_type::time_point deadline = clock_type::now() -
+            std::chrono::milliseconds(m_ttl);
+
+        size_t dropped = 0;
+        typename session_map::iterator it = m_sessions.begin();
+        while (it != m_sessions.end()) {
+            if (it->second.hdl.expired() && it->second.detached_at <= deadline)
+            {
+                it = m_sessions.erase(it);
+                ++dropped;
+            } else {
+                ++it;
+            }
+        }
+        return dropped;
+    }
+
+    /// Get the number of sessions kept
+    size_t size() const {
+        return m_sessions.size();
+    }
+
+    /// Get the number of messages buffered for a session
+    size_t buffered(std::string const & id) const {
+        typename session_map::const_iterator it = m_sessions.find(id);
+        return it == m_sessions.end() ? 0 : it->second.replay.size();
+    }
+private:
+    struct session {
+        session() : next_seq(1), first_seq(1), bytes(0) {}
+
+        void reset() {
+            replay.clear();
+            next_seq = 1;
+            first_seq = 1;
+            bytes = 0;
+        }
+
+        /// Whether every message after last is still buffered
+        bool can_resume(uint64_t last) const {
+            return last + 1 >= first_seq && last < next_seq;
+        }
+
+        void drop_front() {
+            bytes -= replay.front()->get_payload_size();
+            replay.pop_front();
+            ++first_seq;
+        }
+
+        connection_hdl hdl;
+        clock_type::time_point detached_at;
+        ring_queue<message_ptr> replay;
+        /// Sequence number of the next message sent
+        uint64_t next_seq;
+        /// Sequence number of the front of replay
+        uint64_t first_seq;
+        size_t bytes;
+    };
+
+    /// Session negotiated by a connection that has not opened yet
+    struct pending {
+        pending() : last(0) {}
+        pending(std::string const & i, uint64_t l) : id(i), last(l) {}
+
+        std::string id;
+        uint64_t last;
+    };
+
+    typedef std::unordered_map<std::string, session> session_map;
+    typedef std::map<connection_hdl, pending,
+        std::owner_less<connection_hdl> > pending_map;
+    typedef std::map<connection_hdl, std::string,
+        std::owner_less<connection_hdl> > attached_map;
+
+    session_store(session_store const &) = delete;
+    session_store & operator=(session_store const &) = delete;
+
+    connection_ptr get_connection(connection_hdl hdl) {
+        if (hdl.expired()) {
+            return connection_ptr();
+        }
+        lib::error_code ec;
+        connection_ptr con = m_endpoint.get_con_from_hdl(hdl, ec);
+        return ec ? connection_ptr() : con;
+    }
+
+    endpoint_type & m_endpoint;
+    std::string const m_protocol;
+    size_t m_max_messages;
+    size_t m_max_bytes;
+    long m_ttl;
+
+    session_map m_sessions;
+    pending_map m_pending;
+    attached_map m_attached;
+};
+
+/// Client side state of a resumable session
+/**
+ * Picks a random session id, offers the session on each new connection and
+ * counts the messages received, so that a reconnect resumes after the last
+ * of them.
+ *
+ * Usage:
+ *
+ *     websocketpp::resume::session_cursor cursor;
+ *     // before connecting
+ *     cursor.offer(con);
+ *     // open handler
+ *     if (!cursor.opened(con)) { ... fetch a snapshot ... }
+ *     // message handler
+ *     cursor.received();
+ *
+ * @since 0.9.0
+ */
+class session_cursor {
+public:
+    /// Construct a cursor for a new session
+    /**
+     * @param protocol The subprotocol name of the server's session_store
+     */
+    explicit session_cursor(std::string const & protocol = "resume")
+      : m_protocol(protocol)
+      , m_last(0)
+      , m_started(false)
+    {
+        std::random_device rd;
+        std::mt19937_64 rng(rd());
+        static char const hex[] = "0123456789abcdef";
+        for (int i = 0; i < 32; ++i) {
+            m_id += hex[rng() & 15];
+        }
+    }
+
+    /// Get the session id
+    std::string const & get_id() const {
+        return m_id;
+    }
+
+    /// Get the sequence number of the last message received
+    uint64_t get_last() const {
+        return m_last;
+    }
+
+    /// Offer the session on a connection that has not connected yet
+    /**
+     * Offers to resume once a session was started, and a fresh session.
+     */
+    template <typename connection_ptr>
+    void offer(connection_ptr const & con) {
+        if (m_started) {
+            con->add_subprotocol(make_token(m_protocol, m_id, m_last));
+        }
+        con->add_subprotocol(make_token(m_protocol, m_id));
+    }
+
+    /// Learn the outcome of the offer from an opened connection
+    /**
+     * @return Whether the session was resumed. If not, the session starts
+     * over and the application has to resynchronize its state.
+     */
+    template <typename connection_ptr>
+    bool opened(connection_ptr const & con) {
+        bool resumed = m_started &&
+            con->get_subprotocol() == make_token(m_protocol, m_id, m_last);
+        if (!resumed) {
+            m_last = 0;
+        }
+        m_started = true;
+        return resumed;
+    }
+
+    /// Count a message received on the session
+    void received() {
+        ++m_last;
+    }
+private:
+    std::string const m_protocol;
+    std::string m_id;
+    uint64_t m_last;
+    bool m_started;
+};
+
+} // namespace resume
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_RESUME_HPP
@@ -31,11 +31,20 @@
 #include <websocketpp/endpoint.hpp>
 #include <websocketpp/uri.hpp>
 
+#include <websocketpp/http/body_sink.hpp>
+#include <websocketpp/http/conditional_cache.hpp>
+
 #include <websocketpp/logger/levels.hpp>
 
 #include <websocketpp/common/system_error.hpp>
 
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <map>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace websocketpp {
 
@@ -58,6 +67,13 @@ public:
     typedef connection<config> connection_type;
     /// Type of a shared pointer to the connections this server will create
     typedef typename connection_type::ptr connection_ptr;
+    /// Type of a weak pointer to the connections this server will create
+    typedef typename connection_type::weak_ptr connection_weak_ptr;
+
+    /// Type of a lock of the endpoint concurrency component
+    typedef typename concurrency_type::scoped_lock_type scoped_lock_type;
+    /// Type of a mutex of the endpoint concurrency component
+    typedef typename concurrency_type::mutex_type mutex_type;
 
     /// Type of the connection transport component
     typedef typename transport_type::transport_con_type transport_con_type;
@@ -67,9 +83,29 @@ public:
     /// Type of the endpoint component of this server
     typedef endpoint<connection_type,config> endpoint_type;
 
+    /// Type of the handler called once a download ends
+    /**
+     * Called with the error that ended the download, or a default error code
+     * once the whole body is in the sink.
+     */
+    typedef lib::function<void(lib::error_code const &)> download_handler;
+    /// Type of the handler reporting the progress of a download
+    /**
+     * Called with the number of body bytes written to the sink so far and the
+     * size of the body, which is 0 until it is known.
+     */
+    typedef lib::function<void(size_t,size_t)> download_progress_handler;
+
     friend class connection<config>;
 
-    explicit client() : endpoint_type(false)
+    explicit client()
+      : endpoint_type(false)
+      , m_http_pool_size(0)
+      , m_http_idle_timeout(4000)
+      , m_redirect_cache_size(0)
+      , m_uri_cache_size(0)
+      , m_download_parts(4)
+      , m_download_part_size(1024 * 1024)
     {
         endpoint_type::m_alog->write(log::alevel::devel, "client constructor");
     }
@@ -92,7 +128,23 @@ public:
             return connection_ptr();
         }
 
-        connection_ptr con = endpoint_type::create_connection(ec);
+        bool const http = location->get_type() == uri::http;
+        if (http && m_redirect_cache_size > 0) {
+            location = this->resolve_redirects(location);
+        }
+
+        bool const pooled = http && m_http_pool_size > 0;
+
+        connection_ptr con;
+        if (pooled) {
+            con = this->take_pooled(location);
+            if (con) {
+                ec = lib::error_code();
+                return con;
+            }
+        }
+
+        con = endpoint_type::create_connection(ec);
 
         if (!con) {
             // if the transport doesn't have a more specific error, set
@@ -105,6 +157,27 @@ public:
 
         con->set_uri(location);
 
+        if constexpr (config_traits<config>::enable_http_client) {
+            if (http) {
+                con->set_http_redirect_handler(lib::bind(
+                    &type::handle_http_redirect,
+                    this,
+                    lib::placeholders::_1,
+                    lib::placeholders::_2,
+                    lib::placeholders::_3
+                ));
+                con->set_http_cache(m_http_cache);
+            }
+        }
+        if (pooled) {
+            con->set_http_idle_handler(lib::bind(
+                &type::handle_http_idle,
+                this,
+                lib::placeholders::_1
+            ));
+            con->set_http_idle_timeout(m_http_idle_timeout);
+        }
+
         ec = lib::error_code();
         return con;
     }
@@ -121,7 +194,7 @@ public:
      * @return A connection_ptr to the new connection
      */
     connection_ptr get_connection(std::string const & u, lib::error_code & ec) {
-        uri_ptr location = lib::make_shared<uri>(u);
+        uri_ptr location = this->parse_uri(u);
 
         if (!location->get_valid()) {
             ec = error::make_error_code(error::invalid_uri);
@@ -141,6 +214,12 @@ public:
      * @return The pointer to the connection originally passed in.
      */
     connection_ptr connect(connection_ptr con) {
+        if (con->is_http_reused()) {
+            // connections from the HTTP connection pool are connected already
+            con->start();
+            return con;
+        }
+
         // Ask transport to perform a connection
         transport_type::async_connect(
             lib::static_pointer_cast<transport_con_type>(con),
@@ -155,7 +234,643 @@ public:
 
         return con;
     }
+
+    /// Set the number of idle HTTP connections kept per host
+    /**
+     * With a non-zero pool size plain HTTP requests made through this
+     * endpoint keep their connection open once the response is complete, if
+     * the server allows it, and get_connection hands it out again for the
+     * next request to the same scheme, host and port. This saves the TCP and
+     * TLS handshakes of repeated requests to the same server.
+     *
+     * A pooled connection keeps the connection handle and the per connection
+     * settings of its first request. The request, the response and the
+     * handlers are reset for each request, so the response may only be used
+     * until the http handler returns. Idle connections are closed silently
+     * when the idle timeout expires or the server closes them. Requests are
+     * not pipelined, a connection is only reused once its response is
+     * complete.
+     *
+     * The default value is 0, which disables pooling.
+     *
+     * @since 0.9.0
+     *
+     * @param per_host The maximum number of idle connections per host
+     */
+    void set_http_pool_size(size_t per_host) {
+        m_http_pool_size = per_host;
+    }
+
+    /// Get the number of idle HTTP connections kept per host
+    /**
+     * @since 0.9.0
+     *
+     * @return The maximum number of idle connections per host
+     */
+    size_t get_http_pool_size() const {
+        return m_http_pool_size;
+    }
+
+    /// Set how long an idle pooled HTTP connection is kept
+    /**
+     * Applies to connections created after this call. The default of 4000ms
+     * stays below the keep-alive timeout common servers use, which avoids
+     * reusing a connection just as the server closes it. A value of 0 keeps
+     * idle connections until the server closes them.
+     *
+     * @since 0.9.0
+     *
+     * @param dur The idle timeout in ms
+     */
+    void set_http_idle_timeout(long dur) {
+        m_http_idle_timeout = dur;
+    }
+
+    /// Set the number of permanent redirects remembered by this endpoint
+    /**
+     * When non-zero the targets of HTTP 301 and 308 redirects followed by
+     * connections of this endpoint are remembered, and get_connection
+     * requests the target directly instead of the original URI. Once the
+     * cache is full the oldest entries are forgotten.
+     *
+     * The default value is 0, which disables the cache.
+     *
+     * @since 0.9.0
+     *
+     * @param entries The maximum number of cached redirects
+     */
+    void set_redirect_cache_size(size_t entries) {
+        scoped_lock_type lock(m_http_pool_lock);
+        m_redirect_cache_size = entries;
+        while (m_redirect_order.size() > m_redirect_cache_size) {
+            m_redirects.erase(m_redirect_order.front());
+            m_redirect_order.pop_front();
+        }
+    }
+
+    /// Forget all cached permanent redirects
+    /**
+     * @since 0.9.0
+     */
+    void clear_redirect_cache() {
+        scoped_lock_type lock(m_http_pool_lock);
+        m_redirects.clear();
+        m_redirect_order.clear();
+    }
+
+    /// Revalidate HTTP GET responses instead of downloading them again
+    /**
+     * Plain HTTP connections created afterwards store 200 responses to GET
+     * requests that carry an ETag or Last-Modified header in the cache, send
+     * the validators with the next GET request to the same URI and hand a 304
+     * answer to the http handler as the stored response, body included. See
+     * http::conditional_cache for what is stored. A cache may be shared
+     * between endpoints. Not available without config::enable_http_client.
+     *
+     * The default is no cache.
+     *
+     * @since 0.9.0
+     *
+     * @param value The cache, or null for none
+     */
+    void set_http_cache(http::conditional_cache::ptr value) {
+        static_assert(config_traits<config>::enable_http_client,
+            "set_http_cache needs config::enable_http_client");
+        m_http_cache = value;
+    }
+
+    /// Get the cache HTTP GET responses are revalidated against
+    /**
+     * @since 0.9.0
+     *
+     * @return The cache, or null if none is set
+     */
+    http::conditional_cache::ptr get_http_cache() const {
+        return m_http_cache;
+    }
+
+    /// Set the number of parsed URIs remembered by this endpoint
+    /**
+     * When non-zero, get_connection(std::string) keeps the uri parsed from
+     * each string and hands the same uri_ptr to later connections to that
+     * string instead of parsing it again. Clients opening many connections
+     * to a few targets parse each target once. Once the cache is full the
+     * oldest entries are forgotten. Invalid URIs are not cached.
+     *
+     * The default value is 0, which disables the cache.
+     *
+     * @since 0.9.0
+     *
+     * @param entries The maximum number of cached URIs
+     */
+    void set_uri_cache_size(size_t entries) {
+        scoped_lock_type lock(m_uri_cache_lock);
+        m_uri_cache_size = entries;
+        while (m_uri_order.size() > m_uri_cache_size) {
+            m_uri_cache.erase(m_uri_order.front());
+            m_uri_order.pop_front();
+        }
+    }
+
+    /// Forget all cached URIs
+    /**
+     * @since 0.9.0
+     */
+    void clear_uri_cache() {
+        scoped_lock_type lock(m_uri_cache_lock);
+        m_uri_cache.clear();
+        m_uri_order.clear();
+    }
+
+    /// Set the number of concurrent Range requests a download is split into
+    /**
+     * See download. A value of 1 fetches the body with a single plain GET.
+     *
+     * The default value is 4.
+     *
+     * @since 0.9.0
+     *
+     * @param parts The maximum number of concurrent requests per download
+     */
+    void set_download_parts(size_t parts) {
+        m_download_parts = (std::max)(parts, size_t(1));
+    }
+
+    /// Set the smallest part a download is split into
+    /**
+     * The first request of a download asks for this many bytes, and the rest
+     * of the body is only split into parts of at least this size, so small
+     * bodies are not spread over more connections than they are worth.
+     *
+     * The default value is 1 MiB.
+     *
+     * @since 0.9.0
+     *
+     * @param bytes The minimum number of bytes per part
+     */
+    void set_download_part_size(size_t bytes) {
+        m_download_part_size = (std::max)(bytes, size_t(1));
+    }
+
+    /// Download an HTTP resource over several concurrent Range requests
+    /**
+     * One TCP stream can't fill a link with a large bandwidth delay product,
+     * so the body is fetched as byte ranges over up to set_download_parts
+     * connections at once, each written to the sink at its offset with
+     * body_sink::write_at. Connections come from the HTTP connection pool
+     * when it is enabled, see set_http_pool_size.
+     *
+     * The first request asks for the first set_download_part_size bytes. Once
+     * its `206 Partial Content` headers tell the size of the body, the rest
+     * is split evenly and requested right away. A server that ignores Range
+     * sends the whole body with `200 OK` to the first request, which is then
+     * the only one. Parts are requested with `Accept-Encoding: identity` so
+     * offsets are those of the stored body.
+     *
+     * Writes to the sink are serialized, so it needs no locking of its own
+     * even when the endpoint runs on several threads. finish is called on
+     * the sink once every part arrived. The first part that fails cancels the
+     * others and the download ends with its error, leaving the sink
+     * unfinished.
+     *
+     * The request, response and http handlers of the connections are used
+     * by the download and not available to the application.
+     *
+     * @since 0.9.0
+     *
+     * @param u The http or https URI to download
+     * @param sink The sink to write the body to, see http::buffer_sink,
+     * http::mmap_sink and http::fd_sink
+     * @param done The handler to call once the download ended
+     * @param progress The handler to call as the body arrives, may be empty
+     * @param [out] ec Set to the error of starting the download, if any. The
+     * done handler is not called in that case.
+     */
+    void download(std::string const & u, http::body_sink::ptr sink,
+        download_handler done, download_progress_handler progress,
+        lib::error_code & ec)
+    {
+        static_assert(config_traits<config>::enable_http_client,
+            "download needs config::enable_http_client");
+
+        uri_ptr location = this->parse_uri(u);
+        if (!location->get_valid() || location->get_type() != uri::http) {
+            ec = error::make_error_code(error::invalid_uri);
+            return;
+        }
+
+        download_ptr d = lib::make_shared<download_state>();
+        d->location = location;
+        d->sink = sink;
+        d->done = done;
+        d->progress = progress;
+        d->parts = m_download_parts;
+        d->part_size = m_download_part_size;
+
+        ec = this->start_download_part(d, 0,
+            d->parts > 1 ? d->part_size : 0);
+    }
 private:
+    typedef std::vector<connection_weak_ptr> idle_list;
+
+    static std::string pool_key(uri const & location) {
+        return (location.get_secure() ? "https://" : "http://") +
+            location.get_host_port();
+    }
+
+    // take the most recently idle connection to the host of location, if any
+    connection_ptr take_pooled(uri_ptr location) {
+        scoped_lock_type lock(m_http_pool_lock);
+
+        typename std::map<std::string, idle_list>::iterator it =
+            m_http_pool.find(pool_key(*location));
+        if (it == m_http_pool.end()) {
+            return connection_ptr();
+        }
+
+        idle_list & idle = it->second;
+        while (!idle.empty()) {
+            connection_ptr con = idle.back().lock();
+            idle.pop_back();
+
+            if (con && con->reuse_http(location)) {
+                endpoint_type::apply_request_defaults(con);
+                return con;
+            }
+        }
+        m_http_pool.erase(it);
+        return connection_ptr();
+    }
+
+    // called by connections that finished a request and may be reused
+    bool handle_http_idle(connection_ptr con) {
+        scoped_lock_type lock(m_http_pool_lock);
+
+        idle_list & idle = m_http_pool[pool_key(*con->get_uri())];
+        idle.erase(std::remove_if(idle.begin(), idle.end(),
+            [](connection_weak_ptr const & w) { return w.expired(); }),
+            idle.end());
+
+        if (idle.size() >= m_http_pool_size) {
+            return false;
+        }
+        idle.push_back(con);
+        return true;
+    }
+
+    // parse u, or find it in the URI cache
+    uri_ptr parse_uri(std::string const & u) {
+        {
+            scoped_lock_type lock(m_uri_cache_lock);
+            if (m_uri_cache_size == 0) {
+                return lib::make_shared<uri>(u);
+            }
+            typename std::unordered_map<std::string, uri_ptr>::const_iterator
+                it = m_uri_cache.find(u);
+            if (it != m_uri_cache.end()) {
+                return it->second;
+            }
+        }
+
+        // parsed without the lock held
+        uri_ptr location = lib::make_shared<uri>(u);
+        if (!location->get_valid()) {
+            return location;
+        }
+
+        scoped_lock_type lock(m_uri_cache_lock);
+        if (m_uri_cache_size > 0 && m_uri_cache.insert(
+            std::make_pair(u, location)).second)
+        {
+            if (m_uri_order.size() == m_uri_cache_size) {
+                m_uri_cache.erase(m_uri_order.front());
+                m_uri_order.pop_front();
+            }
+            m_uri_order.push_back(u);
+        }
+        return location;
+    }
+
+    // replace location with the target of the permanent redirects it is known
+    // to lead to
+    uri_ptr resolve_redirects(uri_ptr location) {
+        scoped_lock_type lock(m_http_pool_lock);
+
+        // at most one hop per entry, so a redirect loop ends as well
+        for (size_t hops = 0; hops < m_redirects.size(); ++hops) {
+            typename std::map<std::string, uri_ptr>::const_iterator it =
+                m_redirects.find(location->str());
+            if (it == m_redirects.end()) {
+                break;
+            }
+            location = it->second;
+        }
+        return location;
+    }
+
+    // called by connections before they follow a redirect
+    bool handle_http_redirect(connection_ptr con, uri_ptr target,
+        bool reusable)
+    {
+        if (m_redirect_cache_size > 0 && http::status_code::is_permanent_redirect(
+            con->get_response().get_status_code()))
+        {
+            scoped_lock_type lock(m_http_pool_lock);
+
+            // the URI that was actually requested, in the format of uri::str
+            std::string const key = con->get_uri()->get_scheme() + "://" +
+                con->get_request().get_header("Host") +
+                con->get_request().get_uri();
+            if (m_redirects.find(key) == m_redirects.end()) {
+                if (m_redirect_order.size() == m_redirect_cache_size) {
+                    m_redirects.erase(m_redirect_order.front());
+                    m_redirect_order.pop_front();
+                }
+                m_redirect_order.push_back(key);
+            }
+            m_redirects[key] = target;
+        }
+
+        if (reusable || target->get_type() != uri::http) {
+            // the connection follows same origin redirects itself
+            return false;
+        }
+
+        lib::error_code ec;
+        connection_ptr next = this->get_connection(target, ec);
+        if (!next) {
+            endpoint_type::m_elog->write(log::elevel::rerror,
+                "Could not follow redirect: "+ec.message());
+            return false;
+        }
+
+        con->transfer_http_request(next, target);
+        this->connect(next);
+        return true;
+    }
+
+    /// State shared by the parts of a download
+    struct download_state {
+        download_state()
+          : parts(1)
+          , part_size(0)
+          , total(0)
+          , received(0)
+          , outstanding(0)
+          , split(false) {}
+
+        uri_ptr                     location;
+        http::body_sink::ptr        sink;
+        download_handler            done;
+        download_progress_handler   progress;
+        size_t                      parts;
+        size_t                      part_size;
+        /// Size of the body, 0 until it is known
+        size_t                      total;
+        size_t                      received;
+        /// Parts whose request has not ended yet
+        size_t                      outstanding;
+        /// Whether the rest of the body was requested after the first part
+        bool                        split;
+        /// The first error of any part
+        lib::error_code             ec;
+        /// Guards the members above and serializes writes to sink
+        mutex_type                  lock;
+    };
+
+    typedef lib::shared_ptr<download_state> download_ptr;
+
+    /// Body sink of one part, writing to the download's sink at its offset
+    class part_sink : public http::body_sink {
+    public:
+        part_sink(download_ptr d, size_t offset)
+          : m_download(d)
+          , m_offset(offset)
+          , m_written(0) {}
+
+        lib::error_code write(char const * data, size_t len) {
+            size_t received;
+            size_t total;
+            {
+                scoped_lock_type lock(m_download->lock);
+                if (m_download->ec) {
+                    // another part failed, stop reading this one
+                    return m_download->ec;
+                }
+                lib::error_code ec = m_download->sink->write_at(
+                    m_offset + m_written, data, len);
+                if (ec) {
+                    return ec;
+                }
+                m_written += len;
+                m_download->received += len;
+                received = m_download->received;
+                total = m_download->total;
+            }
+            if (m_download->progress && len > 0) {
+                m_download->progress(received, total);
+            }
+            return lib::error_code();
+        }
+
+        size_t written() const {
+            return m_written;
+        }
+    private:
+        download_ptr    m_download;
+        size_t const    m_offset;
+        size_t          m_written;
+    };
+
+    // request length bytes of the body from offset, or the whole body if
+    // length is 0
+    lib::error_code start_download_part(download_ptr d, size_t offset,
+        size_t length)
+    {
+        lib::error_code ec;
+        connection_ptr con = this->get_connection(d->location, ec);
+        if (!con) {
+            return ec;
+        }
+        if (length > 0) {
+            con->replace_header("Range", "bytes=" + std::to_string(offset) +
+                "-" + std::to_string(offset + length - 1), ec);
+            if (!ec) {
+                con->replace_header("Accept-Encoding", "identity", ec);
+            }
+            if (ec) {
+                return ec;
+            }
+        }
+
+        lib::shared_ptr<part_sink> sink = lib::make_shared<part_sink>(d,
+            offset);
+        con->set_body_sink(sink);
+        con->set_http_handler(lib::bind(
+            &type::handle_download_part,
+            this,
+            d,
+            sink,
+            offset,
+            length,
+            lib::placeholders::_1
+        ));
+        if (offset == 0 && length > 0) {
+            // split as soon as the headers tell the size of the body
+            con->set_progress_handler(lib::bind(
+                &type::handle_download_headers,
+                this,
+                d,
+                lib::placeholders::_1,
+                lib::placeholders::_2,
+                lib::placeholders::_3
+            ));
+        }
+
+        {
+            scoped_lock_type lock(d->lock);
+            ++d->outstanding;
+        }
+        this->connect(con);
+        return lib::error_code();
+    }
+
+    // parse a Content-Range value of the form `bytes first-last/total`
+    static bool parse_content_range(std::string const & value, size_t & first,
+        size_t & last, size_t & total)
+    {
+        if (value.compare(0, 6, "bytes ") != 0) {
+            return false;
+        }
+        char const * p = value.c_str() + 6;
+        char * end;
+        first = std::strtoull(p, &end, 10);
+        if (end == p || *end != '-') {
+            return false;
+        }
+        p = end + 1;
+        last = std::strtoull(p, &end, 10);
+        if (end == p || *end != '/') {
+            return false;
+        }
+        p = end + 1;
+        total = std::strtoull(p, &end, 10);
+        return end != p && *end == '\0' && first <= last && last < total;
+    }
+
+    // called on every read of the first part once its headers arrived
+    void handle_download_headers(download_ptr d, connection_hdl_ref hdl,
+        size_t, size_t)
+    {
+        {
+            scoped_lock_type lock(d->lock);
+            if (d->split) {
+                return;
+            }
+            d->split = true;
+        }
+
+        lib::error_code ec;
+        connection_ptr con = endpoint_type::get_con_from_hdl(hdl, ec);
+        if (!con) {
+            return;
+        }
+        typename connection_type::response_type const & res =
+            con->get_response();
+
+        size_t first, last, total;
+        if (res.get_status_code() != http::status_code::partial_content ||
+            !parse_content_range(res.get_header("Content-Range"), first, last,
+                total))
+        {
+            // the whole body comes with this response, or it fails
+            if (res.get_status_code() == http::status_code::ok) {
+                scoped_lock_type lock(d->lock);
+                d->total = res.get_total_body_size();
+            }
+            return;
+        }
+
+        size_t offset = last + 1;
+        size_t const rest = total - offset;
+        size_t const count = (std::min)(d->parts - 1,
+            (rest + d->part_size - 1) / d->part_size);
+        {
+            scoped_lock_type lock(d->lock);
+            d->total = total;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            size_t const length = rest / count + (i < rest % count ? 1 : 0);
+            ec = this->start_download_part(d, offset, length);
+            if (ec) {
+                scoped_lock_type lock(d->lock);
+                if (!d->ec) {
+                    d->ec = ec;
+                }
+                break;
+            }
+            offset += length;
+        }
+    }
+
+    // called once per part when its request ended
+    void handle_download_part(download_ptr d, lib::shared_ptr<part_sink> sink,
+        size_t offset, size_t length, connection_hdl_ref hdl)
+    {
+        lib::error_code ec;
+        connection_ptr con = endpoint_type::get_con_from_hdl(hdl, ec);
+        if (con) {
+            ec = con->get_ec();
+        }
+
+        if (!ec) {
+            typename connection_type::response_type const & res =
+                con->get_response();
+            http::status_code::value const status = res.get_status_code();
+
+            size_t first, last, total;
+            bool valid = res.has_received(
+                connection_type::response_type::state::BODY);
+            if (status == http::status_code::ok) {
+                // a server that ignores Range sends everything at once
+                valid = valid && offset == 0;
+            } else if (status == http::status_code::partial_content) {
+                scoped_lock_type lock(d->lock);
+                valid = valid && length > 0 &&
+                    parse_content_range(res.get_header("Content-Range"),
+                        first, last, total) &&
+                    first == offset && total == d->total &&
+                    sink->written() == last - first + 1 &&
+                    (last == offset + length - 1 ||
+                        (offset == 0 && last + 1 == total));
+            } else {
+                valid = false;
+            }
+            if (!valid) {
+                ec = http::error::make_error_code(
+                    http::error::range_not_satisfied);
+            }
+        }
+
+        {
+            scoped_lock_type lock(d->lock);
+            if (ec && !d->ec) {
+                d->ec = ec;
+            }
+            if (--d->outstanding > 0) {
+                return;
+            }
+            ec = d->ec;
+            if (!ec) {
+                ec = d->sink->finish();
+            }
+        }
+        if (d->done) {
+            d->done(ec);
+        }
+    }
+
     // handle_connect
     void handle_connect(connection_ptr con, lib::error_code const & ec) {
         if (ec) {
@@ -170,6 +885,29 @@ private:
             con->start();
         }
     }
+
+    size_t                              m_http_pool_size;
+    long                                m_http_idle_timeout;
+    std::map<std::string, idle_list>    m_http_pool;
+
+    size_t                              m_redirect_cache_size;
+    std::map<std::string, uri_ptr>      m_redirects;
+    /// Keys of m_redirects, oldest first
+    std::deque<std::string>             m_redirect_order;
+
+    /// Guards the connection pool and the redirect cache
+    mutex_type                          m_http_pool_lock;
+
+    http::conditional_cache::ptr        m_http_cache;
+
+    size_t                              m_uri_cache_size;
+    std::unordered_map<std::string, uri_ptr> m_uri_cache;
+    /// Keys of m_uri_cache, oldest first
+    std::deque<std::string>             m_uri_order;
+    mutex_type                          m_uri_cache_lock;
+
+    size_t                              m_download_parts;
+    size_t                              m_download_part_size;
 };
 
 } // namespace websocketpp
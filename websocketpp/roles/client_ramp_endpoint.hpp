@@ -0,0 +1,548 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_CLIENT_RAMP_ENDPOINT_HPP
+#define WEBSOCKETPP_CLIENT_RAMP_ENDPOINT_HPP
+
+#include <websocketpp/roles/client_endpoint.hpp>
+#include <websocketpp/transport/asio/connection.hpp>
+
+#include <websocketpp/common/asio.hpp>
+#include <websocketpp/common/chrono.hpp>
+#include <websocketpp/common/connection_hdl.hpp>
+#include <websocketpp/common/functional.hpp>
+#include <websocketpp/common/histogram.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+#include <websocketpp/common/thread.hpp>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace websocketpp {
+
+/// Outcome of the connections opened by a client_ramp
+/**
+ * Each phase histogram holds one value per opened connection, except tls
+ * which only counts secure connections.
+ *
+ * @since 0.9.0
+ */
+struct ramp_stats {
+    ramp_stats() : opened(0), failed(0) {}
+
+    /// Add the outcome of another ramp or shard
+    void merge(ramp_stats const & other) {
+        opened += other.opened;
+        failed += other.failed;
+        dns.merge(other.dns);
+        tcp.merge(other.tcp);
+        tls.merge(other.tls);
+        upgrade.merge(other.upgrade);
+        total.merge(other.total);
+    }
+
+    /// Connections whose WebSocket handshake completed
+    uint64_t opened;
+    /// Connections that failed before opening
+    uint64_t failed;
+
+    /// Time spent resolving the host
+    latency_histogram dns;
+    /// Time spent establishing the TCP connection
+    latency_histogram tcp;
+    /// Time spent in proxy negotiation and the TLS handshake
+    latency_histogram tls;
+    /// Time spent in the WebSocket opening handshake
+    latency_histogram upgrade;
+    /// Time from the start of the connect until the connection opened
+    latency_histogram total;
+};
+
+/// Opens large numbers of client connections at a controlled pace
+/**
+ * A client_ramp owns a fixed number of client endpoints (shards), each with
+ * its own io_context run by exactly one thread, like sharded_server. start
+ * spreads the connections evenly over the shards and over the target URIs.
+ * Each shard paces its share on its own thread, so no state is shared while
+ * ramping up:
+ *
+ * - set_rate limits how many connections are started per second
+ * - set_max_pending limits how many connections may be establishing at once
+ *
+ * Both limits are split evenly between the shards.
+ *
+ * Every shard caches DNS results (see set_dns_cache_ttl) so each name is
+ * resolved about once per shard rather than once per connection. For TLS
+ * configs, pass one session_cache to set_session_cache of every shard to
+ * share resumable sessions between them.
+ *
+ * The ramp installs its own open and fail handlers on the connections it
+ * creates and forwards them to the handlers set on the ramp. All other
+ * handlers, such as message and close handlers, are taken from the shard.
+ *
+ * @since 0.9.0
+ */
+template <typename config>
+class client_ramp {
+public:
+    /// Type of this endpoint
+    typedef client_ramp<config> type;
+
+    /// Type of each shard
+    typedef client<config> shard_type;
+    /// Type of a shared pointer to a shard
+    typedef lib::shared_ptr<shard_type> shard_ptr;
+
+    /// Type of the connections created by the shards
+    typedef typename shard_type::connection_type connection_type;
+    /// Type of a shared pointer to a connection
+    typedef typename shard_type::connection_ptr connection_ptr;
+
+    /// Type of the open and fail handlers, called with the shard index
+    typedef lib::function<void(size_t,connection_hdl)> connection_handler;
+    /// Type of the handler called once every connection opened or failed
+    typedef lib::function<void()> done_handler;
+
+    /// How long shards cache DNS results by default, in milliseconds
+    static constexpr long dns_cache_ttl = 30000;
+
+    /// Construct a client ramp
+    /**
+     * @param shards The number of shards. Zero uses the number of hardware
+     * threads, or one if that is unknown.
+     */
+    explicit client_ramp(size_t shards = 0)
+      : m_rate(0)
+      , m_max_pending(0)
+      , m_active(0)
+    {
+        if (shards == 0) {
+            shards = lib::thread::hardware_concurrency();
+        }
+        if (shards == 0) {
+            shards = 1;
+        }
+
+        m_shards.reserve(shards);
+        for (size_t i = 0; i < shards; ++i) {
+            m_shards.push_back(lib::make_shared<shard_type>());
+        }
+        m_states.resize(shards);
+    }
+
+    /// Get the number of shards
+    size_t size() const {
+        return m_shards.size();
+    }
+
+    /// Get a shard by index
+    /**
+     * Shards may be configured freely before start is called. Once running,
+     * a shard must only be used from handlers running on it.
+     *
+     * @param index The index of the shard, less than size()
+     * @return A reference to the shard
+     */
+    shard_type & get_shard(size_t index) {
+        return *m_shards[index];
+    }
+
+    /// Add a URI to connect to
+    /**
+     * Connections are assigned to the targets round robin.
+     *
+     * @param uri The URI to connect to
+     */
+    void add_target(std::string const & uri) {
+        m_targets.push_back(uri);
+    }
+
+    /// Limit the number of connections started per second
+    /**
+     * @param per_second The rate limit, 0 or less for no limit (the default)
+     */
+    void set_rate(double per_second) {
+        m_rate = per_second;
+    }
+
+    /// Limit the number of connections establishing at the same time
+    /**
+     * Each shard allows at least one.
+     *
+     * @param pending The limit, 0 for no limit (the default)
+     */
+    void set_max_pending(size_t pending) {
+        m_max_pending = pending;
+    }
+
+    /// Set the handler called when a connection opened
+    void set_open_handler(connection_handler h) {
+        m_open_handler = h;
+    }
+
+    /// Set the handler called when a connection failed before opening
+    void set_fail_handler(connection_handler h) {
+        m_fail_handler = h;
+    }
+
+    /// Set the handler called once every connection opened or failed
+    /**
+     * Called on the thread of the shard that finished last.
+     */
+    void set_done_handler(done_handler h) {
+        m_done_handler = h;
+    }
+
+    /// Initialize the Asio transport of every shard (exception free)
+    /**
+     * Each shard gets its own internal io_context, run by a single thread,
+     * and caches DNS results for dns_cache_ttl.
+     *
+     * @param ec Set to indicate what error occurred, if any.
+     */
+    void init_asio(lib::error_code & ec) {
+        for (size_t i = 0; i < m_shards.size(); ++i) {
+            m_shards[i]->init_asio(ec);
+            if (ec) {
+                return;
+            }
+            m_shards[i]->set_single_threaded_io(true);
+            m_shards[i]->set_dns_cache_ttl(dns_cache_ttl);
+        }
+    }
+
+    /// Initialize the Asio transport of every shard
+    /**
+     * @see init_asio(lib::error_code &)
+     */
+    void init_asio() {
+        lib::error_code ec;
+        init_asio(ec);
+        if (ec) {
+            throw exception(ec);
+        }
+    }
+
+    /// Start opening connections (exception free)
+    /**
+     * The connections are opened once the shards run. Returns invalid_uri
+     * if no target was added and invalid_state if a previous ramp hasn't
+     * finished yet.
+     *
+     * @param count The number of connections to open
+     * @param ec Set to indicate what error occurred, if any.
+     */
+    void start(size_t count, lib::error_code & ec) {
+        if (m_targets.empty()) {
+            ec = error::make_error_code(error::invalid_uri);
+            return;
+        }
+
+        {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            if (m_active != 0) {
+                ec = error::make_error_code(error::invalid_state);
+                return;
+            }
+            m_active = m_shards.size();
+        }
+
+        size_t const n = m_shards.size();
+        for (size_t i = 0; i < n; ++i) {
+            shard_state & state = m_states[i];
+            state = shard_state();
+            state.remaining = count / n + (i < count % n ? 1 : 0);
+            state.max_pending = m_max_pending == 0 ? 0 : std::max(
+                m_max_pending / n + (i < m_max_pending % n ? 1 : 0),
+                size_t(1));
+            if (m_rate > 0) {
+                state.interval = lib::chrono::duration_cast<
+                    lib::chrono::steady_clock::duration>(
+                        lib::chrono::duration<double>(double(n) / m_rate));
+            }
+            state.next_target = i;
+
+            m_shards[i]->get_io_context().post(lib::bind(&type::pump, this,
+                i));
+        }
+
+        ec = lib::error_code();
+    }
+
+    /// Start opening connections
+    /**
+     * @see start(size_t, lib::error_code &)
+     */
+    void start(size_t count) {
+        lib::error_code ec;
+        start(count, ec);
+        if (ec) {
+            throw exception(ec);
+        }
+    }
+
+    /// Run every shard, each on its own thread
+    /**
+     * The last shard is run by the calling thread and one new thread is
+     * started for each of the others. Returns once all shards have run out of
+     * work or have been stopped.
+     */
+    void run() {
+        std::vector<lib::thread> threads;
+        threads.reserve(m_shards.size()-1);
+
+        for (size_t i = 0; i+1 < m_shards.size(); ++i) {
+            threads.push_back(lib::thread(&type::run_shard, m_shards[i]));
+        }
+
+        run_shard(m_shards.back());
+
+        for (size_t i = 0; i < threads.size(); ++i) {
+            threads[i].join();
+        }
+    }
+
+    /// Stop the io_context of every shard
+    /**
+     * May be called from any thread.
+     */
+    void stop() {
+        for (size_t i = 0; i < m_shards.size(); ++i) {
+            m_shards[i]->stop();
+        }
+    }
+
+    /// Get the outcome of the connections opened so far
+    /**
+     * Only call this from the done handler or once run returned, the shards
+     * update their statistics without locking.
+     *
+     * @return The statistics of all shards combined
+     */
+    ramp_stats get_stats() const {
+        ramp_stats stats;
+        for (size_t i = 0; i < m_states.size(); ++i) {
+            stats.merge(m_states[i].stats);
+        }
+        return stats;
+    }
+private:
+    typedef lib::chrono::steady_clock::time_point time_point;
+
+    /// Pacing state of a shard, only touched by the thread running it
+    struct shard_state {
+        shard_state()
+          : remaining(0)
+          , pending(0)
+          , max_pending(0)
+          , next_target(0)
+          , interval(0)
+          , waiting(false)
+          , done(false) {}
+
+        size_t remaining;
+        size_t pending;
+        size_t max_pending;
+        size_t next_target;
+        lib::chrono::steady_clock::duration interval;
+        time_point next_at;
+        lib::shared_ptr<lib::asio::steady_timer> timer;
+        // whether the timer is armed
+        bool waiting;
+        bool done;
+        ramp_stats stats;
+    };
+
+    static void run_shard(shard_ptr shard) {
+        shard->run();
+    }
+
+    /// Start as many connections as the limits of a shard allow
+    void pump(size_t index) {
+        shard_state & state = m_states[index];
+
+        if (state.waiting) {
+            return;
+        }
+
+        while (state.remaining > 0 &&
+            (state.max_pending == 0 || state.pending < state.max_pending))
+        {
+            if (state.interval.count() > 0) {
+                time_point const now = lib::chrono::steady_clock::now();
+
+                if (now < state.next_at) {
+                    this->wait(index, state.next_at);
+                    return;
+                }
+
+                // don't make up for time the shard spent at max_pending
+                state.next_at = std::max(state.next_at, now - state.interval) +
+                    state.interval;
+            }
+
+            this->launch(index);
+        }
+
+        if (state.remaining == 0 && state.pending == 0 && !state.done) {
+            state.done = true;
+            this->shard_done();
+        }
+    }
+
+    void wait(size_t index, time_point at) {
+        shard_state & state = m_states[index];
+
+        if (!state.timer) {
+            state.timer = lib::make_shared<lib::asio::steady_timer>(
+                m_shards[index]->get_io_context());
+        }
+
+        state.waiting = true;
+        state.timer->expires_at(at);
+        state.timer->async_wait(lib::bind(&type::handle_wait, this, index,
+            lib::placeholders::_1));
+    }
+
+    void handle_wait(size_t index, lib::asio::error_code const & ec) {
+        m_states[index].waiting = false;
+
+        if (ec) {
+            return;
+        }
+        this->pump(index);
+    }
+
+    void launch(size_t index) {
+        shard_state & state = m_states[index];
+        shard_type & shard = *m_shards[index];
+
+        std::string const & uri =
+            m_targets[state.next_target++ % m_targets.size()];
+        --state.remaining;
+
+        lib::error_code ec;
+        connection_ptr con = shard.get_connection(uri, ec);
+        if (ec) {
+            shard.get_elog().write(log::elevel::info,
+                "client_ramp connection to "+uri+" failed: "+ec.message());
+            ++state.stats.failed;
+            return;
+        }
+
+        ++state.pending;
+
+        con->set_open_handler(lib::bind(&type::handle_open, this, index,
+            lib::placeholders::_1));
+        con->set_fail_handler(lib::bind(&type::handle_fail, this, index,
+            lib::placeholders::_1));
+
+        shard.connect(con);
+    }
+
+    void handle_open(size_t index, connection_hdl hdl) {
+        shard_state & state = m_states[index];
+        time_point const now = lib::chrono::steady_clock::now();
+
+        lib::error_code ec;
+        connection_ptr con = m_shards[index]->get_con_from_hdl(hdl, ec);
+        if (con) {
+            transport::asio::connect_timing const & t =
+                con->get_connect_timing();
+
+            state.stats.dns.record(elapsed(t.start, t.resolved));
+            state.stats.tcp.record(elapsed(t.resolved, t.connected));
+            if (con->is_secure()) {
+                state.stats.tls.record(elapsed(t.connected, t.secured));
+            }
+            state.stats.upgrade.record(elapsed(t.secured, now));
+            state.stats.total.record(elapsed(t.start, now));
+        }
+
+        ++state.stats.opened;
+        --state.pending;
+
+        if (m_open_handler) {
+            m_open_handler(index, hdl);
+        }
+        this->pump(index);
+    }
+
+    void handle_fail(size_t index, connection_hdl hdl) {
+        shard_state & state = m_states[index];
+
+        ++state.stats.failed;
+        --state.pending;
+
+        if (m_fail_handler) {
+            m_fail_handler(index, hdl);
+        }
+        this->pump(index);
+    }
+
+    void shard_done() {
+        {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            if (--m_active != 0) {
+                return;
+            }
+        }
+
+        if (m_done_handler) {
+            m_done_handler();
+        }
+    }
+
+    static latency_histogram::duration elapsed(time_point from,
+        time_point to)
+    {
+        return lib::chrono::duration_cast<latency_histogram::duration>(
+            to - from);
+    }
+
+    std::vector<shard_ptr> m_shards;
+    std::vector<shard_state> m_states;
+    std::vector<std::string> m_targets;
+
+    double m_rate;
+    size_t m_max_pending;
+
+    connection_handler m_open_handler;
+    connection_handler m_fail_handler;
+    done_handler m_done_handler;
+
+    lib::mutex m_lock;
+    // shards that haven't finished the current ramp
+    size_t m_active;
+};
+
+} // namespace websocketpp
+
+#endif //WEBSOCKETPP_CLIENT_RAMP_ENDPOINT_HPP
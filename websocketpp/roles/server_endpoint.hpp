@@ -32,10 +32,29 @@
 
 #include <websocketpp/logger/levels.hpp>
 
+#include <websocketpp/common/functional.hpp>
+#include <websocketpp/common/memory.hpp>
 #include <websocketpp/common/system_error.hpp>
 
+#include <vector>
+
 namespace websocketpp {
 
+/// What a server does with connections beyond its handshake limit
+namespace overload {
+
+/// See server::set_max_handshakes
+enum value {
+    /// Stop accepting, new connections wait in the listen backlog
+    pause = 0,
+    /// Accept and answer the handshake with 503 Service Unavailable
+    reject,
+    /// Accept and reset the TCP connection right away
+    reset
+};
+
+} // namespace overload
+
 /// Server endpoint role based on the given config
 /**
  *
@@ -64,12 +83,23 @@ public:
     /// Type of the endpoint component of this server
     typedef endpoint<connection_type,config> endpoint_type;
 
+    /// Type of a mutex of the endpoint concurrency component
+    typedef typename concurrency_type::mutex_type mutex_type;
+    /// Type of a lock of the endpoint concurrency component
+    typedef typename concurrency_type::scoped_lock_type scoped_lock_type;
+
     /// The type and signature of the callback passed to the start_accept method
     typedef lib::function<void(lib::error_code const &, lib::error_code const &)> accept_loop_handler;
 
     friend class connection<config>;
 
-    explicit server() : endpoint_type(true)
+    explicit server()
+      : endpoint_type(true)
+      , m_accept_batch(1)
+      , m_max_handshakes(0)
+      , m_overload_policy(overload::pause)
+      , m_handshakes(0)
+      , m_rejecting(0)
     {
         endpoint_type::m_alog->write(log::alevel::devel, "server constructor");
     }
@@ -87,7 +117,13 @@ public:
 
 #ifdef _WEBSOCKETPP_MOVE_SEMANTICS_
     /// Move constructor
-    server(server<config> && o) : endpoint<connection<config>,config>(std::move(o)) {}
+    server(server<config> && o)
+      : endpoint<connection<config>,config>(std::move(o))
+      , m_accept_batch(o.m_accept_batch)
+      , m_max_handshakes(o.m_max_handshakes)
+      , m_overload_policy(o.m_overload_policy)
+      , m_handshakes(0)
+      , m_rejecting(0) {}
 
 #ifdef _WEBSOCKETPP_DEFAULT_DELETE_FUNCTIONS_
     // no move assignment operator because of const member variables
@@ -134,6 +170,77 @@ public:
         return endpoint_type::create_connection(ec);
     }
 
+    /// Set the number of accepts kept outstanding
+    /**
+     * start_accept issues this many accepts, each renewing itself, so a
+     * burst of connections is drained from the listen backlog without
+     * waiting for each accept to be handled in turn. Set before
+     * start_accept.
+     *
+     * The default is 1.
+     *
+     * @since 0.9.0
+     *
+     * @param batch The number of outstanding accepts, at least 1
+     */
+    void set_accept_batch(size_t batch) {
+        m_accept_batch = batch == 0 ? 1 : batch;
+    }
+
+    /// Limit the number of connections in their opening handshake
+    /**
+     * A connection counts from being accepted until its handshake response
+     * is written, or until it ends. Once the limit is reached new
+     * connections are handled according to policy:
+     *
+     * - overload::pause stops accepting until a handshake finishes. Excess
+     *   connections wait in the listen backlog, then the kernel drops them.
+     *   Up to the accept batch size of connections may still be admitted.
+     * - overload::reject answers new handshakes with 503 Service
+     *   Unavailable. At most limit connections are being rejected at a
+     *   time, beyond that they are reset.
+     * - overload::reset resets new connections right away.
+     *
+     * Rejected and reset connections are reported to the fail handler with
+     * the rejected error.
+     *
+     * @since 0.9.0
+     *
+     * @param limit The number of concurrent handshakes, 0 for no limit (the
+     * default)
+     * @param policy What to do with connections over the limit
+     */
+    void set_max_handshakes(size_t limit,
+        overload::value policy = overload::pause)
+    {
+        std::vector<lib::function<void()> > resume;
+        {
+            scoped_lock_type guard(m_admission_lock);
+            m_max_handshakes = limit;
+            m_overload_policy = policy;
+            if (limit == 0 || policy != overload::pause) {
+                resume.swap(m_paused);
+            }
+        }
+
+        for (size_t i = 0; i < resume.size(); ++i) {
+            resume[i]();
+        }
+    }
+
+    /// Get the number of connections in their opening handshake
+    /**
+     * Only counted while a handshake limit is set.
+     *
+     * @since 0.9.0
+     *
+     * @return The number of connections in their opening handshake
+     */
+    size_t get_handshake_count() const {
+        scoped_lock_type guard(m_admission_lock);
+        return m_handshakes;
+    }
+
     /// Starts the server's async connection acceptance loop (exception free)
     /**
      * Initiates the server connection acceptance loop. Must be called after
@@ -156,29 +263,11 @@ public:
      * @param [out] ec A status code indicating an error, if any.
      */
     void start_accept(lib::error_code & ec) {
-        if (!transport_type::is_listening()) {
-            ec = error::make_error_code(error::async_accept_not_listening);
-            return;
-        }
-        
-        ec = lib::error_code();
-        connection_ptr con = get_connection(ec);
-
-        if (!con) {
-          ec = error::make_error_code(error::con_creation_failed);
-          return;
-        }
-
-        transport_type::async_accept(
-            lib::static_pointer_cast<transport_con_type>(con),
-            lib::bind(&type::handle_accept_legacy,this,con,lib::placeholders::_1),
-            ec
-        );
-
-        if (ec && con) {
-            // If the connection was constructed but the accept failed,
-            // terminate the connection to prevent memory leaks
-            con->terminate(lib::error_code());
+        for (size_t i = 0; i < m_accept_batch; ++i) {
+            accept_one_legacy(ec);
+            if (ec) {
+                return;
+            }
         }
     }
 
@@ -201,6 +290,10 @@ public:
      * will be called with two status codes. The first is the library level status
      * code the second is the underlying transport status code (if any).
      * 
+     * With an accept batch above one (see set_accept_batch) each outstanding
+     * accept renews itself and ends on its own, and reports to
+     * `completion_handler` when it does.
+     *
      * @since 0.9.0
      * 
      * @param completion_handler A handler function to be called when the async
@@ -215,36 +308,9 @@ public:
                                error::make_error_code(error::async_accept_not_listening));
             return;
         }
-        
-        lib::error_code tec;
-        connection_ptr con = get_connection(tec);
 
-        if (!con) {
-          completion_handler(error::make_error_code(error::con_creation_failed),tec);
-          return;
-        }
-
-        transport_type::async_accept(
-            lib::static_pointer_cast<transport_con_type>(con),
-            lib::bind(&type::handle_accept,this,
-                      con,
-                      completion_handler,
-                      lib::placeholders::_1),
-            tec
-        );
-
-        if (tec) {
-            if (con) {
-                // If the connection was constructed but the accept failed,
-                // terminate the connection to prevent memory leaks.
-                con->terminate(lib::error_code());
-            }
-
-            endpoint_type::m_elog->write(log::elevel::rerror,
-                "Async_accept failed: "+tec.message());
-
-            // let the end user know about the error
-            completion_handler(error::make_error_code(error::transport_error),tec);
+        for (size_t i = 0; i < m_accept_batch; ++i) {
+            accept_one(completion_handler);
         }
     }
 
@@ -294,18 +360,13 @@ public:
                     "handle_accept error: "+ec.message());
             }
         } else {
-            con->start();
+            admit(con);
         }
 
-        lib::error_code start_ec;
-        start_accept(start_ec);
-        if (start_ec == error::async_accept_not_listening) {
-            endpoint_type::m_elog->write(log::elevel::info,
-                "Stopping acceptance of new connections because the underlying transport is no longer listening.");
-        } else if (start_ec) {
-            endpoint_type::m_elog->write(log::elevel::rerror,
-                "Restarting async_accept loop failed: "+ec.message());
+        if (pause_accept(lib::bind(&type::restart_accept_legacy,this))) {
+            return;
         }
+        restart_accept_legacy();
     }
 
     /// Handler callback for start_accept
@@ -328,16 +389,194 @@ public:
                     "handle_accept error: "+tec.message());
             }
         } else {
-            con->start();
+            admit(con);
         }
 
         // todo: are there any `tec` codes that should prompt us to end
         // without restarting the loop?
 
         // attempt to restart the async accept loop for the next connection
-        // this method will deliver any errors via the completion_handler
-        start_accept(completion_handler);
+        // this method will deliver any errors via the completion_handler,
+        // unless the accept waits for handshakes to finish
+        if (pause_accept(lib::bind(&type::accept_one,this,completion_handler)))
+        {
+            return;
+        }
+        accept_one(completion_handler);
+    }
+private:
+    /// Issue one accept of the legacy accept loop
+    void accept_one_legacy(lib::error_code & ec) {
+        if (!transport_type::is_listening()) {
+            ec = error::make_error_code(error::async_accept_not_listening);
+            return;
+        }
+
+        scoped_lock_type guard(m_accept_lock);
+        
+        ec = lib::error_code();
+        connection_ptr con = get_connection(ec);
+
+        if (!con) {
+          ec = error::make_error_code(error::con_creation_failed);
+          return;
+        }
+
+        transport_type::async_accept(
+            lib::static_pointer_cast<transport_con_type>(con),
+            lib::bind(&type::handle_accept_legacy,this,con,lib::placeholders::_1),
+            ec
+        );
+
+        if (ec && con) {
+            // If the connection was constructed but the accept failed,
+            // terminate the connection to prevent memory leaks
+            con->terminate(lib::error_code());
+        }
+    }
+
+    /// Issue one accept of the accept loop
+    void accept_one(accept_loop_handler completion_handler) {
+        // This check will happen again in async_accept but if we do it here we can
+        // avoid setting up and tearing down a connection if we know that we can't
+        // actually accept a connection.
+        if (!transport_type::is_listening()) {
+            completion_handler(error::make_error_code(error::transport_error),
+                               error::make_error_code(error::async_accept_not_listening));
+            return;
+        }
+
+        scoped_lock_type guard(m_accept_lock);
+        
+        lib::error_code tec;
+        connection_ptr con = get_connection(tec);
+
+        if (!con) {
+          completion_handler(error::make_error_code(error::con_creation_failed),tec);
+          return;
+        }
+
+        transport_type::async_accept(
+            lib::static_pointer_cast<transport_con_type>(con),
+            lib::bind(&type::handle_accept,this,
+                      con,
+                      completion_handler,
+                      lib::placeholders::_1),
+            tec
+        );
+
+        if (tec) {
+            if (con) {
+                // If the connection was constructed but the accept failed,
+                // terminate the connection to prevent memory leaks.
+                con->terminate(lib::error_code());
+            }
+
+            endpoint_type::m_elog->write(log::elevel::rerror,
+                "Async_accept failed: "+tec.message());
+
+            // let the end user know about the error
+            completion_handler(error::make_error_code(error::transport_error),tec);
+        }
     }
+
+    /// Restart one accept of the legacy accept loop
+    void restart_accept_legacy() {
+        lib::error_code start_ec;
+        accept_one_legacy(start_ec);
+        if (start_ec == error::async_accept_not_listening) {
+            endpoint_type::m_elog->write(log::elevel::info,
+                "Stopping acceptance of new connections because the underlying transport is no longer listening.");
+        } else if (start_ec) {
+            endpoint_type::m_elog->write(log::elevel::rerror,
+                "Restarting async_accept loop failed: "+start_ec.message());
+        }
+    }
+
+    /// Start a newly accepted connection, subject to the handshake limit
+    void admit(connection_ptr con) {
+        bool reject = false;
+        bool reset = false;
+        {
+            scoped_lock_type guard(m_admission_lock);
+            if (m_max_handshakes == 0) {
+                // no limit, nothing to count
+            } else if (m_handshakes < m_max_handshakes ||
+                m_overload_policy == overload::pause)
+            {
+                ++m_handshakes;
+                con->set_handshake_slot(make_slot(false));
+            } else if (m_overload_policy == overload::reject &&
+                m_rejecting < m_max_handshakes)
+            {
+                ++m_rejecting;
+                reject = true;
+                con->set_handshake_slot(make_slot(true));
+            } else {
+                reset = true;
+            }
+        }
+
+        if (reset) {
+            endpoint_type::m_alog->write(log::alevel::fail,
+                "Handshake limit reached, resetting connection");
+            con->abort(error::make_error_code(error::rejected));
+            return;
+        }
+
+        con->set_overloaded(reject);
+        con->start();
+    }
+
+    /// Build the token a connection holds while in its opening handshake
+    lib::shared_ptr<void> make_slot(bool reject) {
+        return lib::shared_ptr<void>(static_cast<void *>(this),
+            lib::bind(&type::release_handshake,this,reject));
+    }
+
+    /// Release a handshake slot, resuming one paused accept if there is room
+    void release_handshake(bool reject) {
+        lib::function<void()> resume;
+        {
+            scoped_lock_type guard(m_admission_lock);
+            if (reject) {
+                --m_rejecting;
+                return;
+            }
+            --m_handshakes;
+            if (m_paused.empty() || m_handshakes >= m_max_handshakes) {
+                return;
+            }
+            resume = m_paused.back();
+            m_paused.pop_back();
+        }
+        resume();
+    }
+
+    /// Park an accept while the pause policy's handshake limit is reached
+    /**
+     * @param resume The function that issues the parked accept
+     * @return Whether the accept was parked
+     */
+    bool pause_accept(lib::function<void()> resume) {
+        scoped_lock_type guard(m_admission_lock);
+        if (m_max_handshakes == 0 || m_overload_policy != overload::pause ||
+            m_handshakes < m_max_handshakes)
+        {
+            return false;
+        }
+        m_paused.push_back(resume);
+        return true;
+    }
+
+    size_t                              m_accept_batch;
+    size_t                              m_max_handshakes;
+    overload::value                     m_overload_policy;
+    size_t                              m_handshakes;
+    size_t                              m_rejecting;
+    std::vector<lib::function<void()> > m_paused;
+    mutable mutex_type                  m_admission_lock;
+    mutex_type                          m_accept_lock;
 };
 
 } // namespace websocketpp
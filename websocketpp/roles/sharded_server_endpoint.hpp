@@ -0,0 +1,869 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_SHARDED_SERVER_ENDPOINT_HPP
+#define WEBSOCKETPP_SHARDED_SERVER_ENDPOINT_HPP
+
+#include <websocketpp/roles/server_endpoint.hpp>
+
+#include <websocketpp/common/asio.hpp>
+#include <websocketpp/common/chrono.hpp>
+#include <websocketpp/common/connection_hdl.hpp>
+#include <websocketpp/common/functional.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/system_error.hpp>
+#include <websocketpp/common/thread.hpp>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace websocketpp {
+
+/// Thread per core server built from N independent Asio server endpoints
+/**
+ * A sharded_server owns a fixed number of server endpoints (shards). Each
+ * shard has its own io_context, its own SO_REUSEPORT acceptor on the shared
+ * port, and is run by exactly one thread. The kernel distributes incoming
+ * connections across the acceptors and a connection is handled on the thread
+ * that accepted it for its whole lifetime.
+ *
+ * Because no shard is ever touched by more than one thread, shards are
+ * intended to use a config without locking, such as config::asio_shard. The
+ * connection and endpoint mutexes then compile to nothing and no strand is
+ * allocated per connection.
+ *
+ * Handlers are registered per shard through get_shard so that each handler
+ * can know which shard it is running on. Code running on any thread may use
+ * post and send to act on a connection, the work is executed on the thread
+ * that owns it. Work that is not tied to a connection may be spread over
+ * all shards with post_any.
+ *
+ * On machines with several NUMA nodes, set_cpu_affinity pins each shard's
+ * thread to a core so its connections stay where their memory is.
+ *
+ * Over time some shards may end up with much busier connections than
+ * others. set_load_sampling measures the load of each shard and
+ * set_rebalancing moves connections that are idle at that moment from a
+ * shard whose loop lags to the least loaded one, see migrate. Connections
+ * that moved keep the handlers of the shard that accepted them, which then
+ * run on another thread.
+ *
+ * @since 0.9.0
+ */
+template <typename config>
+class sharded_server {
+public:
+    /// Type of this endpoint
+    typedef sharded_server<config> type;
+
+    /// Type of each shard
+    typedef server<config> shard_type;
+    /// Type of a shared pointer to a shard
+    typedef lib::shared_ptr<shard_type> shard_ptr;
+
+    /// Type of the connections created by the shards
+    typedef typename shard_type::connection_type connection_type;
+    /// Type of a shared pointer to a connection
+    typedef typename shard_type::connection_ptr connection_ptr;
+    /// Type of a shared pointer to a message
+    typedef typename shard_type::message_ptr message_ptr;
+    /// Type of the filters accepted by broadcast
+    typedef typename shard_type::broadcast_filter broadcast_filter;
+    /// Type of the per connection prefixes accepted by broadcast
+    typedef typename shard_type::broadcast_prefix broadcast_prefix;
+
+    /// Type of the handlers accepted by post
+    typedef lib::function<void()> post_handler;
+    /// Type of the handlers accepted by migrate
+    typedef typename shard_type::migrate_handler migrate_handler;
+
+    /// The load of a shard, see get_load
+    struct shard_load {
+        shard_load()
+          : loop_lag(0)
+          , bytes_per_second(0)
+          , connections(0)
+          , migrated(0) {}
+
+        /// How late the last sample ran, in microseconds
+        int64_t loop_lag;
+        /// Bytes read and written per second by its connections between the
+        /// last two samples
+        uint64_t bytes_per_second;
+        /// Open connections it runs
+        size_t connections;
+        /// Connections rebalancing moved off it
+        uint64_t migrated;
+    };
+
+    /// Construct a sharded server
+    /**
+     * @param shards The number of shards. Zero uses the number of hardware
+     * threads, or one if that is unknown.
+     */
+    explicit sharded_server(size_t shards = 0)
+      : m_sample_interval(0)
+      , m_lag_threshold(0)
+      , m_max_moves(0)
+      , m_any_next(0)
+    {
+        if (shards == 0) {
+            shards = lib::thread::hardware_concurrency();
+        }
+        if (shards == 0) {
+            shards = 1;
+        }
+
+        m_loads.reset(new load_state[shards]);
+
+        m_shards.reserve(shards);
+        for (size_t i = 0; i < shards; ++i) {
+            m_shards.push_back(lib::make_shared<shard_type>());
+            // each shard walks only its own connections in broadcast
+            m_shards.back()->set_connection_registry(lib::make_shared<
+                typename shard_type::registry_type>());
+        }
+    }
+
+    /// Get the number of shards
+    size_t size() const {
+        return m_shards.size();
+    }
+
+    /// Pin each shard's thread to a CPU
+    /**
+     * Shard i is run by a thread pinned to `cpus[i % cpus.size()]`, and its
+     * listening socket prefers connections whose packets arrive on that
+     * CPU, see transport::asio::endpoint::set_incoming_cpu. A connection is
+     * created and served on its shard's thread, so with Linux's default
+     * first touch policy its memory, read buffers and message pool are
+     * allocated on the NUMA node of that core, and the packets, connection
+     * and handlers of a socket stay on one core.
+     *
+     * Must be called before listen. The thread calling run is pinned as
+     * well, as it runs the last shard. Pinning is only supported on Linux;
+     * elsewhere listen fails with operation_not_supported and threads are
+     * not pinned.
+     *
+     * @since 0.9.0
+     *
+     * @param cpus The CPU numbers to pin the shards to, empty to not pin
+     */
+    void set_cpu_affinity(std::vector<int> const & cpus) {
+        m_cpus = cpus;
+        for (size_t i = 0; i < m_shards.size(); ++i) {
+            m_shards[i]->set_incoming_cpu(cpus.empty() ? -1 :
+                cpus[i % cpus.size()]);
+        }
+    }
+
+    /// Measure the load of each shard at an interval
+    /**
+     * Each shard samples itself on its own thread: the loop lag is how late
+     * its sampling timer fires, and the bytes per second are added up over
+     * the connections it runs, found through its connection registry. Must
+     * be called before run. Sampling stops with stop_listening.
+     *
+     * @since 0.9.0
+     *
+     * @param interval Milliseconds between samples, 0 to not sample
+     */
+    void set_load_sampling(long interval) {
+        m_sample_interval = interval;
+    }
+
+    /// Get the load of a shard as of its last sample
+    /**
+     * May be called from any thread.
+     *
+     * @since 0.9.0
+     *
+     * @param index The index of the shard, less than size()
+     * @return The load of the shard
+     */
+    shard_load get_load(size_t index) const {
+        load_state const & l = m_loads[index];
+        shard_load load;
+        load.loop_lag = l.loop_lag.load(std::memory_order_relaxed);
+        load.bytes_per_second = l.bytes_per_second.load(
+            std::memory_order_relaxed);
+        load.connections = l.connections.load(std::memory_order_relaxed);
+        load.migrated = l.migrated.load(std::memory_order_relaxed);
+        return load;
+    }
+
+    /// Move idle connections off shards whose loop lags
+    /**
+     * Needs set_load_sampling. After each sample, a shard whose loop lag
+     * reached lag_threshold tries to move its busiest connections, by bytes
+     * since the sample before, to the shard with the least loop lag, if that
+     * is below half of lag_threshold. Only connections that are idle at that
+     * moment move, see migrate, the others are tried again after the next
+     * sample. Must be called before run.
+     *
+     * @since 0.9.0
+     *
+     * @param lag_threshold Loop lag in microseconds from which a shard sheds
+     * connections, 0 to not rebalance
+     * @param max_moves The most connections a shard tries to move per sample
+     */
+    void set_rebalancing(int64_t lag_threshold, size_t max_moves = 16) {
+        m_lag_threshold = lag_threshold;
+        m_max_moves = max_moves;
+    }
+
+    /// Move a connection to another shard
+    /**
+     * May be called from any thread. The connection moves once it is idle
+     * on its own thread, see endpoint::adopt and connection::migrate. Its
+     * socket is released from its shard's io_context and assigned to the
+     * other one, and its timers start over there. Only plain TCP connections
+     * move.
+     *
+     * handler is called on the new shard's thread once the connection moved,
+     * or otherwise on its old one with the reason it did not, such as
+     * connection_busy.
+     *
+     * @since 0.9.0
+     *
+     * @param hdl The connection to move
+     * @param index The index of the shard to move it to, less than size()
+     * @param handler Called once the migration ended
+     * @return bad_connection if hdl no longer refers to a connection
+     */
+    lib::error_code migrate(connection_hdl hdl, size_t index,
+        migrate_handler handler)
+    {
+        shard_ptr shard = get_owner(hdl);
+
+        if (!shard) {
+            return error::make_error_code(error::bad_connection);
+        }
+
+        shard->get_io_context().post(lib::bind(&type::migrate_from, this,
+            shard, hdl, index, handler));
+        return lib::error_code();
+    }
+
+    /// Get a shard by index
+    /**
+     * Shards may be configured freely before run is called. Once running, a
+     * shard must only be used from handlers running on it, or through post.
+     *
+     * @param index The index of the shard, less than size()
+     * @return A reference to the shard
+     */
+    shard_type & get_shard(size_t index) {
+        return *m_shards[index];
+    }
+
+    /// Initialize the Asio transport of every shard (exception free)
+    /**
+     * Each shard gets its own internal io_context, run by a single thread, and
+     * is set to listen with SO_REUSEPORT.
+     *
+     * @param ec Set to indicate what error occurred, if any.
+     */
+    void init_asio(lib::error_code & ec) {
+        for (size_t i = 0; i < m_shards.size(); ++i) {
+            m_shards[i]->init_asio(ec);
+            if (ec) {
+                return;
+            }
+            m_shards[i]->set_reuse_port(true);
+            m_shards[i]->set_single_threaded_io(true);
+        }
+    }
+
+    /// Initialize the Asio transport of every shard
+    /**
+     * @see init_asio(lib::error_code &)
+     */
+    void init_asio() {
+        lib::error_code ec;
+        init_asio(ec);
+        if (ec) {
+            throw exception(ec);
+        }
+    }
+
+    /// Listen on a port with every shard (exception free)
+    /**
+     * @param port The port to listen on.
+     * @param ec Set to indicate what error occurred, if any.
+     */
+    void listen(uint16_t port, lib::error_code & ec) {
+        for (size_t i = 0; i < m_shards.size(); ++i) {
+            m_shards[i]->listen(port, ec);
+            if (ec) {
+                return;
+            }
+        }
+    }
+
+    /// Listen on a port with every shard
+    /**
+     * @see listen(uint16_t, lib::error_code &)
+     */
+    void listen(uint16_t port) {
+        lib::error_code ec;
+        listen(port, ec);
+        if (ec) {
+            throw exception(ec);
+        }
+    }
+
+    /// Start the accept loop of every shard (exception free)
+    /**
+     * @param ec Set to indicate what error occurred, if any.
+     */
+    void start_accept(lib::error_code & ec) {
+        for (size_t i = 0; i < m_shards.size(); ++i) {
+            m_shards[i]->start_accept(ec);
+            if (ec) {
+                return;
+            }
+        }
+    }
+
+    /// Start the accept loop of every shard
+    /**
+     * @see start_accept(lib::error_code &)
+     */
+    void start_accept() {
+        lib::error_code ec;
+        start_accept(ec);
+        if (ec) {
+            throw exception(ec);
+        }
+    }
+
+    /// Run every shard, each on its own thread
+    /**
+     * The last shard is run by the calling thread and one new thread is
+     * started for each of the others. Returns once all shards have run out of
+     * work or have been stopped.
+     */
+    void run() {
+        std::vector<lib::thread> threads;
+        threads.reserve(m_shards.size()-1);
+
+        if (m_sample_interval > 0) {
+            for (size_t i = 0; i < m_shards.size(); ++i) {
+                m_loads[i].sampled = lib::chrono::steady_clock::now();
+                schedule_sample(i);
+            }
+        }
+
+        for (size_t i = 0; i+1 < m_shards.size(); ++i) {
+            threads.push_back(lib::thread(&type::run_shard, m_shards[i],
+                get_cpu(i)));
+        }
+
+        run_shard(m_shards.back(), get_cpu(m_shards.size()-1));
+
+        for (size_t i = 0; i < threads.size(); ++i) {
+            threads[i].join();
+        }
+    }
+
+    /// Stop the io_context of every shard
+    /**
+     * May be called from any thread.
+     */
+    void stop() {
+        for (size_t i = 0; i < m_shards.size(); ++i) {
+            m_shards[i]->stop();
+        }
+    }
+
+    /// Stop listening on every shard
+    /**
+     * May be called from any thread. Each shard closes its acceptor on its
+     * own thread.
+     */
+    void stop_listening() {
+        for (size_t i = 0; i < m_shards.size(); ++i) {
+            m_shards[i]->get_io_context().post(lib::bind(
+                &type::stop_listening_shard, this, i));
+        }
+    }
+
+    /// Run a handler on the thread that owns a connection
+    /**
+     * May be called from any thread.
+     *
+     * @param hdl The connection whose thread should run handler
+     * @param handler The handler to run
+     * @return bad_connection if hdl no longer refers to a connection
+     */
+    lib::error_code post(connection_hdl hdl, post_handler handler) {
+        shard_ptr shard = get_owner(hdl);
+
+        if (!shard) {
+            return error::make_error_code(error::bad_connection);
+        }
+
+        shard->get_io_context().post(lib::bind(&type::post_to, this, shard,
+            hdl, handler));
+        return lib::error_code();
+    }
+
+    /// Run a handler on whichever shard gets to it first
+    /**
+     * May be called from any thread. The handler joins a queue shared by all
+     * shards and one wakeup is posted to the shards in turn. Each wakeup
+     * runs the oldest handler still queued, so a handler is not held up
+     * behind a shard that is busy: an idle shard's wakeup takes it first.
+     * Connections and their sockets stay on the shard that accepted them,
+     * only these handlers move between threads.
+     *
+     * Handlers still queued when the shards stop are not run.
+     *
+     * @since 0.9.0
+     *
+     * @param handler The handler to run
+     */
+    void post_any(post_handler handler) {
+        {
+            lib::lock_guard<lib::mutex> guard(m_any_lock);
+            m_any_tasks.push_back(handler);
+        }
+
+        size_t index = m_any_next.fetch_add(1, std::memory_order_relaxed) %
+            m_shards.size();
+        m_shards[index]->get_io_context().post(lib::bind(&type::run_any,
+            this));
+    }
+
+    /// Send a message to a connection from any thread
+    /**
+     * The payload is copied and sent from the thread that owns the
+     * connection. Errors that occur there, such as the connection having
+     * closed in the meantime, are logged to the owning shard's error log.
+     *
+     * @param hdl The connection to send to
+     * @param payload The payload to send
+     * @param op The opcode to send with
+     * @return bad_connection if hdl no longer refers to a connection
+     */
+    lib::error_code send(connection_hdl hdl, std::string const & payload,
+        frame::opcode::value op)
+    {
+        shard_ptr shard = get_owner(hdl);
+
+        if (!shard) {
+            return error::make_error_code(error::bad_connection);
+        }
+
+        shard->get_io_context().post(lib::bind(&type::send_payload, this,
+            shard, hdl, payload, op));
+        return lib::error_code();
+    }
+
+    /// Send a prepared message to a connection from any thread
+    /**
+     * @see send(connection_hdl, std::string const &, frame::opcode::value)
+     *
+     * @param hdl The connection to send to
+     * @param msg The message to send
+     * @return bad_connection if hdl no longer refers to a connection
+     */
+    lib::error_code send(connection_hdl hdl, message_ptr msg) {
+        shard_ptr shard = get_owner(hdl);
+
+        if (!shard) {
+            return error::make_error_code(error::bad_connection);
+        }
+
+        shard->get_io_context().post(lib::bind(&type::send_message, this,
+            shard, hdl, msg));
+        return lib::error_code();
+    }
+
+    /// Build a pre-framed message for broadcast
+    /**
+     * @see endpoint::prepare_broadcast. The message is built by the first
+     * shard and may be sent on any of them.
+     *
+     * @param payload The payload of the message
+     * @param op The opcode of the message. Must be a data opcode.
+     * @param ec Set to indicate what error occurred, if any.
+     * @return The prepared message, or an empty pointer on error
+     */
+    message_ptr prepare_broadcast(std::string const & payload,
+        frame::opcode::value op, lib::error_code & ec)
+    {
+        return m_shards[0]->prepare_broadcast(payload, op, ec);
+    }
+
+    /// Send a message to every open connection from any thread
+    /**
+     * Posts one task to each shard, which queues msg on the connections it
+     * owns that filter accepts, see endpoint::broadcast. Each connection is
+     * sent to from its own thread, with one cross thread post per shard
+     * rather than one per connection. The filter is called on every shard's
+     * thread and must be safe to call concurrently.
+     *
+     * @param msg The message to send, normally from prepare_broadcast
+     * @param filter Called for each connection, which is only sent to if it
+     * returns true. Empty to send to all.
+     */
+    void broadcast(message_ptr msg,
+        broadcast_filter filter = broadcast_filter())
+    {
+        for (size_t i = 0; i < m_shards.size(); ++i) {
+            m_shards[i]->get_io_context().post(lib::bind(
+                &type::broadcast_shard, m_shards[i], msg, broadcast_prefix(),
+                filter));
+        }
+    }
+
+    /// Send a broadcast template with a prefix per connection from any thread
+    /**
+     * Same as `broadcast`, with each connection sent the template's payload
+     * behind prefix(con), see endpoint::prepare_recipient. Like the filter,
+     * prefix is called on every shard's thread.
+     *
+     * @param tmpl The template, from prepare_broadcast
+     * @param prefix Called for each connection sent to for the bytes that go
+     * in front of the template's payload
+     * @param filter Called for each connection, which is only sent to if it
+     * returns true. Empty to send to all.
+     */
+    void broadcast(message_ptr tmpl, broadcast_prefix prefix,
+        broadcast_filter filter)
+    {
+        for (size_t i = 0; i < m_shards.size(); ++i) {
+            m_shards[i]->get_io_context().post(lib::bind(
+                &type::broadcast_shard, m_shards[i], tmpl, prefix, filter));
+        }
+    }
+private:
+    /// Get the CPU shard i is pinned to, -1 for none
+    int get_cpu(size_t i) const {
+        return m_cpus.empty() ? -1 : m_cpus[i % m_cpus.size()];
+    }
+
+    static void run_shard(shard_ptr shard, int cpu) {
+        if (cpu >= 0 && !pin_thread(cpu)) {
+            shard->get_elog().write(log::elevel::warn,
+                "sharded_server could not pin its thread to a CPU");
+        }
+        shard->run();
+    }
+
+    /// Pin the calling thread to a CPU
+    static bool pin_thread(int cpu) {
+#ifdef __linux__
+        if (cpu >= CPU_SETSIZE) {
+            return false;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        (void)cpu;
+        return false;
+#endif
+    }
+
+    /// Run the oldest handler queued by post_any, if any is left
+    void run_any() {
+        post_handler handler;
+        {
+            lib::lock_guard<lib::mutex> guard(m_any_lock);
+            if (m_any_tasks.empty()) {
+                return;
+            }
+            handler.swap(m_any_tasks.front());
+            m_any_tasks.pop_front();
+        }
+        handler();
+    }
+
+    void stop_listening_shard(size_t index) {
+        lib::error_code ec;
+        m_shards[index]->stop_listening(ec);
+
+        // the sampling timer would keep the shard from running out of work
+        if (m_loads[index].timer) {
+            m_loads[index].timer->cancel();
+        }
+    }
+
+    /// Find the shard whose io_context runs the connection hdl refers to
+    shard_ptr get_owner(connection_hdl hdl) const {
+        connection_ptr con = lib::static_pointer_cast<connection_type>(
+            hdl.lock());
+
+        if (con) {
+            for (size_t i = 0; i < m_shards.size(); ++i) {
+                if (&m_shards[i]->get_io_context() == &con->get_io_context()) {
+                    return m_shards[i];
+                }
+            }
+        }
+
+        return shard_ptr();
+    }
+
+    /// Whether the connection hdl refers to runs on shard
+    /**
+     * A connection that moved to another shard after a handler was posted
+     * for it has the handler posted again to its new shard.
+     */
+    static bool runs_on(shard_ptr const & shard, connection_hdl hdl) {
+        connection_ptr con = lib::static_pointer_cast<connection_type>(
+            hdl.lock());
+        return !con || &con->get_io_context() == &shard->get_io_context();
+    }
+
+    void post_to(shard_ptr shard, connection_hdl hdl, post_handler handler) {
+        if (!runs_on(shard, hdl)) {
+            post(hdl, handler);
+            return;
+        }
+        handler();
+    }
+
+    void migrate_from(shard_ptr shard, connection_hdl hdl, size_t index,
+        migrate_handler handler)
+    {
+        connection_ptr con = lib::static_pointer_cast<connection_type>(
+            hdl.lock());
+
+        if (!con) {
+            handler(error::make_error_code(error::bad_connection));
+        } else if (!runs_on(shard, hdl)) {
+            migrate(hdl, index, handler);
+        } else if (m_shards[index] == shard) {
+            handler(lib::error_code());
+        } else {
+            m_shards[index]->adopt(con, handler);
+        }
+    }
+
+    /// Per shard load, written by the shard's own thread
+    struct load_state {
+        load_state()
+          : loop_lag(0)
+          , bytes_per_second(0)
+          , connections(0)
+          , migrated(0) {}
+
+        std::atomic<int64_t> loop_lag;
+        std::atomic<uint64_t> bytes_per_second;
+        std::atomic<size_t> connections;
+        std::atomic<uint64_t> migrated;
+
+        lib::shared_ptr<lib::asio::steady_timer> timer;
+        /// When the next sample is due and when the last one ran
+        lib::chrono::steady_clock::time_point due;
+        lib::chrono::steady_clock::time_point sampled;
+        /// Bytes each connection had read and written as of the last sample
+        std::unordered_map<connection_type const *, uint64_t> bytes;
+    };
+
+    void schedule_sample(size_t index) {
+        load_state & l = m_loads[index];
+
+        if (!l.timer) {
+            l.timer = lib::make_shared<lib::asio::steady_timer>(
+                m_shards[index]->get_io_context());
+        }
+
+        l.due = lib::chrono::steady_clock::now() +
+            lib::chrono::milliseconds(m_sample_interval);
+        l.timer->expires_at(l.due);
+        l.timer->async_wait(lib::bind(&type::handle_sample, this, index,
+            lib::placeholders::_1));
+    }
+
+    void handle_sample(size_t index, lib::asio::error_code const & ec) {
+        if (ec) {
+            return;
+        }
+
+        load_state & l = m_loads[index];
+        shard_ptr shard = m_shards[index];
+
+        lib::chrono::steady_clock::time_point now =
+            lib::chrono::steady_clock::now();
+        int64_t lag = lib::chrono::duration_cast<lib::chrono::microseconds>(
+            now - l.due).count();
+        int64_t elapsed = lib::chrono::duration_cast<
+            lib::chrono::microseconds>(now - l.sampled).count();
+        l.sampled = now;
+
+        // bytes of each connection since the last sample, busiest first
+        std::vector<std::pair<uint64_t, connection_ptr> > busy;
+        std::unordered_map<connection_type const *, uint64_t> bytes;
+        uint64_t total = 0;
+
+        typename shard_type::registry_ptr registry =
+            shard->get_connection_registry();
+        if (registry) {
+            registry->for_each([&](connection_ptr const & con) {
+                if (&con->get_io_context() != &shard->get_io_context()) {
+                    return;
+                }
+                uint64_t b = con->get_bytes_received() + con->get_bytes_sent();
+                typename std::unordered_map<connection_type const *,
+                    uint64_t>::const_iterator it = l.bytes.find(con.get());
+                uint64_t delta = it != l.bytes.end() && b > it->second ?
+                    b - it->second : 0;
+                bytes[con.get()] = b;
+                total += delta;
+                if (delta > 0) {
+                    busy.push_back(std::make_pair(delta, con));
+                }
+            });
+        }
+        l.bytes.swap(bytes);
+
+        l.loop_lag.store(lag > 0 ? lag : 0, std::memory_order_relaxed);
+        l.bytes_per_second.store(elapsed > 0 ?
+            uint64_t(double(total) * 1000000.0 / double(elapsed)) : 0,
+            std::memory_order_relaxed);
+        l.connections.store(l.bytes.size(), std::memory_order_relaxed);
+
+        if (m_lag_threshold > 0 && lag >= m_lag_threshold) {
+            rebalance(index, busy);
+        }
+
+        schedule_sample(index);
+    }
+
+    /// Move the busiest idle connections of a lagging shard, see
+    /// set_rebalancing
+    void rebalance(size_t index,
+        std::vector<std::pair<uint64_t, connection_ptr> > & busy)
+    {
+        size_t target = index;
+        int64_t least = m_lag_threshold / 2;
+        for (size_t i = 0; i < m_shards.size(); ++i) {
+            int64_t lag = m_loads[i].loop_lag.load(std::memory_order_relaxed);
+            if (i != index && lag < least) {
+                target = i;
+                least = lag;
+            }
+        }
+        if (target == index) {
+            return;
+        }
+
+        size_t moves = (std::min)(m_max_moves, busy.size());
+        std::partial_sort(busy.begin(), busy.begin() + moves, busy.end(),
+            [](std::pair<uint64_t, connection_ptr> const & a,
+                std::pair<uint64_t, connection_ptr> const & b)
+            {
+                return a.first > b.first;
+            });
+
+        for (size_t i = 0; i < moves; ++i) {
+            m_shards[target]->adopt(busy[i].second, lib::bind(
+                &type::handle_rebalanced, this, index, lib::placeholders::_1));
+        }
+    }
+
+    void handle_rebalanced(size_t index, lib::error_code const & ec) {
+        if (!ec) {
+            m_loads[index].migrated.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void send_payload(shard_ptr shard, connection_hdl hdl,
+        std::string const & payload, frame::opcode::value op)
+    {
+        if (!runs_on(shard, hdl)) {
+            send(hdl, payload, op);
+            return;
+        }
+
+        lib::error_code ec;
+        shard->send(hdl, payload, op, ec);
+        if (ec) {
+            shard->get_elog().write(log::elevel::info,
+                "sharded_server send failed: " + ec.message());
+        }
+    }
+
+    static void broadcast_shard(shard_ptr shard, message_ptr msg,
+        broadcast_prefix prefix, broadcast_filter filter)
+    {
+        lib::error_code ec;
+        shard->broadcast(msg, prefix, filter, ec);
+        if (ec) {
+            shard->get_elog().write(log::elevel::info,
+                "sharded_server broadcast failed: " + ec.message());
+        }
+    }
+
+    void send_message(shard_ptr shard, connection_hdl hdl, message_ptr msg) {
+        if (!runs_on(shard, hdl)) {
+            send(hdl, msg);
+            return;
+        }
+
+        lib::error_code ec;
+        shard->send(hdl, msg, ec);
+        if (ec) {
+            shard->get_elog().write(log::elevel::info,
+                "sharded_server send failed: " + ec.message());
+        }
+    }
+
+    std::vector<shard_ptr> m_shards;
+    std::vector<int> m_cpus;
+
+    std::unique_ptr<load_state[]> m_loads;
+    long m_sample_interval;
+    int64_t m_lag_threshold;
+    size_t m_max_moves;
+
+    /// Handlers posted by post_any, oldest first, under m_any_lock
+    lib::mutex m_any_lock;
+    std::deque<post_handler> m_any_tasks;
+    std::atomic<size_t> m_any_next;
+};
+
+} // namespace websocketpp
+
+#endif //WEBSOCKETPP_SHARDED_SERVER_ENDPOINT_HPP
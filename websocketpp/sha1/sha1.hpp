@@ -37,6 +37,17 @@ under the same license as the original, which is listed below.
 #define SHA1_DEFINED
 
 #include <cstddef>
+#include <cstring>
+
+#if defined(WEBSOCKETPP_SHA1_OPENSSL)
+    // hash with OpenSSL, for builds that link it for TLS anyway
+    #include <openssl/evp.h>
+#elif defined(__SHA__) && defined(__SSE4_1__)
+    // the compiler targets the x86 SHA extensions (e.g. -msha -msse4.1 or a
+    // -march that includes them)
+    #define _WEBSOCKETPP_SHA1_SHANI_
+    #include <immintrin.h>
+#endif
 
 namespace websocketpp {
 namespace sha1 {
@@ -117,16 +128,145 @@ inline void innerHash(unsigned int * result, unsigned int * w)
     result[4] += e;
 }
 
+
+/// Compress whole 64 byte blocks into the hash state, portable version
+inline void compress_generic(unsigned int * result, unsigned char const * data,
+    size_t blocks)
+{
+    // The reusable round buffer
+    unsigned int w[80];
+
+    for (; blocks > 0; --blocks, data += 64) {
+        for (int pos = 0; pos < 16; ++pos) {
+            // This line will swap endian on big endian and keep endian on
+            // little endian.
+            w[pos] = (unsigned int) data[pos*4 + 3]
+                    | (((unsigned int) data[pos*4 + 2]) << 8)
+                    | (((unsigned int) data[pos*4 + 1]) << 16)
+                    | (((unsigned int) data[pos*4]) << 24);
+        }
+        innerHash(result, w);
+    }
+}
+
+#ifdef _WEBSOCKETPP_SHA1_SHANI_
+/// Compress whole 64 byte blocks into the hash state with SHA-NI
+/**
+ * Four rounds per sha1rnds4 instruction, with the message schedule computed
+ * by sha1msg1/sha1msg2 four words at a time.
+ */
+inline void compress_shani(unsigned int * result, unsigned char const * data,
+    size_t blocks)
+{
+    __m128i const mask = _mm_set_epi64x(0x0001020304050607LL,
+        0x08090a0b0c0d0e0fLL);
+
+    __m128i abcd = _mm_loadu_si128(reinterpret_cast<__m128i const *>(result));
+    abcd = _mm_shuffle_epi32(abcd, 0x1B);
+    __m128i e0 = _mm_set_epi32(static_cast<int>(result[4]), 0, 0, 0);
+    __m128i e1;
+    __m128i m0, m1, m2, m3;
+
+    // four rounds using message words a, finishing the schedule of b and
+    // advancing that of c and d
+    #define sha1rounds(ein, eout, a, b, c, d, f) \
+        ein = _mm_sha1nexte_epu32(ein, a); \
+        eout = abcd; \
+        b = _mm_sha1msg2_epu32(b, a); \
+        abcd = _mm_sha1rnds4_epu32(abcd, ein, f); \
+        d = _mm_sha1msg1_epu32(d, a); \
+        c = _mm_xor_si128(c, a);
+
+    for (; blocks > 0; --blocks, data += 64) {
+        __m128i const abcd_save = abcd;
+        __m128i const e0_save = e0;
+
+        // rounds 0-15 load the block
+        m0 = _mm_shuffle_epi8(_mm_loadu_si128(
+            reinterpret_cast<__m128i const *>(data)), mask);
+        e0 = _mm_add_epi32(e0, m0);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+        m1 = _mm_shuffle_epi8(_mm_loadu_si128(
+            reinterpret_cast<__m128i const *>(data + 16)), mask);
+        e1 = _mm_sha1nexte_epu32(e1, m1);
+        e0 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+        m0 = _mm_sha1msg1_epu32(m0, m1);
+
+        m2 = _mm_shuffle_epi8(_mm_loadu_si128(
+            reinterpret_cast<__m128i const *>(data + 32)), mask);
+        e0 = _mm_sha1nexte_epu32(e0, m2);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+        m1 = _mm_sha1msg1_epu32(m1, m2);
+        m0 = _mm_xor_si128(m0, m2);
+
+        m3 = _mm_shuffle_epi8(_mm_loadu_si128(
+            reinterpret_cast<__m128i const *>(data + 48)), mask);
+        sha1rounds(e1, e0, m3, m0, m1, m2, 0)
+
+        // rounds 16-79
+        sha1rounds(e0, e1, m0, m1, m2, m3, 0)
+        sha1rounds(e1, e0, m1, m2, m3, m0, 1)
+        sha1rounds(e0, e1, m2, m3, m0, m1, 1)
+        sha1rounds(e1, e0, m3, m0, m1, m2, 1)
+        sha1rounds(e0, e1, m0, m1, m2, m3, 1)
+        sha1rounds(e1, e0, m1, m2, m3, m0, 1)
+        sha1rounds(e0, e1, m2, m3, m0, m1, 2)
+        sha1rounds(e1, e0, m3, m0, m1, m2, 2)
+        sha1rounds(e0, e1, m0, m1, m2, m3, 2)
+        sha1rounds(e1, e0, m1, m2, m3, m0, 2)
+        sha1rounds(e0, e1, m2, m3, m0, m1, 2)
+        sha1rounds(e1, e0, m3, m0, m1, m2, 3)
+        sha1rounds(e0, e1, m0, m1, m2, m3, 3)
+        sha1rounds(e1, e0, m1, m2, m3, m0, 3)
+        sha1rounds(e0, e1, m2, m3, m0, m1, 3)
+
+        e1 = _mm_sha1nexte_epu32(e1, m3);
+        e0 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+        e0 = _mm_sha1nexte_epu32(e0, e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+
+    #undef sha1rounds
+
+    abcd = _mm_shuffle_epi32(abcd, 0x1B);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(result), abcd);
+    result[4] = static_cast<unsigned int>(_mm_extract_epi32(e0, 3));
+}
+#endif // _WEBSOCKETPP_SHA1_SHANI_
+
+/// Compress whole 64 byte blocks with the best implementation available
+inline void compress(unsigned int * result, unsigned char const * data,
+    size_t blocks)
+{
+#ifdef _WEBSOCKETPP_SHA1_SHANI_
+    compress_shani(result, data, blocks);
+#else
+    compress_generic(result, data, blocks);
+#endif
+}
+
 } // namespace
 
 /// Calculate a SHA1 hash
 /**
+ * Uses OpenSSL if WEBSOCKETPP_SHA1_OPENSSL is defined, the x86 SHA
+ * extensions if the compiler targets them, and portable code otherwise.
+ *
  * @param src points to any kind of data to be hashed.
  * @param bytelength the number of bytes to hash from the src pointer.
  * @param hash should point to a buffer of at least 20 bytes of size for storing
  * the sha1 result in.
  */
 inline void calc(void const * src, size_t bytelength, unsigned char * hash) {
+#ifdef WEBSOCKETPP_SHA1_OPENSSL
+    EVP_Digest(src, bytelength, hash, NULL, EVP_sha1(), NULL);
+#else
     // Init the result array.
     unsigned int result[5] = { 0x67452301, 0xefcdab89, 0x98badcfe,
                                0x10325476, 0xc3d2e1f0 };
@@ -134,55 +274,35 @@ inline void calc(void const * src, size_t bytelength, unsigned char * hash) {
     // Cast the void src pointer to be the byte array we can work with.
     unsigned char const * sarray = (unsigned char const *) src;
 
-    // The reusable round buffer
-    unsigned int w[80];
-
     // Loop through all complete 64byte blocks.
+    size_t const full_blocks = bytelength / 64;
+    compress(result, sarray, full_blocks);
 
-    size_t endCurrentBlock;
-    size_t currentBlock = 0;
-
-    if (bytelength >= 64) {
-        size_t const endOfFullBlocks = bytelength - 64;
-
-        while (currentBlock <= endOfFullBlocks) {
-            endCurrentBlock = currentBlock + 64;
-
-            // Init the round buffer with the 64 byte block data.
-            for (int roundPos = 0; currentBlock < endCurrentBlock; currentBlock += 4)
-            {
-                // This line will swap endian on big endian and keep endian on
-                // little endian.
-                w[roundPos++] = (unsigned int) sarray[currentBlock + 3]
-                        | (((unsigned int) sarray[currentBlock + 2]) << 8)
-                        | (((unsigned int) sarray[currentBlock + 1]) << 16)
-                        | (((unsigned int) sarray[currentBlock]) << 24);
-            }
-            innerHash(result, w);
-        }
-    }
-
-    // Handle the last and not full 64 byte block if existing.
-    endCurrentBlock = bytelength - currentBlock;
-    clearWBuffert(w);
-    size_t lastBlockBytes = 0;
-    for (;lastBlockBytes < endCurrentBlock; ++lastBlockBytes) {
-        w[lastBlockBytes >> 2] |= (unsigned int) sarray[lastBlockBytes + currentBlock] << ((3 - (lastBlockBytes & 3)) << 3);
+    // Pad the remaining bytes into one or two final blocks, the message
+    // length in bits goes in the last 8 bytes.
+    size_t const rest = bytelength - full_blocks * 64;
+    unsigned char last[128];
+    std::memset(last, 0, sizeof(last));
+    if (rest) {
+        std::memcpy(last, sarray + full_blocks * 64, rest);
     }
+    last[rest] = 0x80;
 
-    w[lastBlockBytes >> 2] |= 0x80 << ((3 - (lastBlockBytes & 3)) << 3);
-    if (endCurrentBlock >= 56) {
-        innerHash(result, w);
-        clearWBuffert(w);
+    size_t const last_blocks = (rest >= 56 ? 2 : 1);
+    unsigned long long const bits =
+        static_cast<unsigned long long>(bytelength) << 3;
+    for (int i = 0; i < 8; ++i) {
+        last[last_blocks * 64 - 1 - i] =
+            static_cast<unsigned char>(bits >> (i * 8));
     }
-    w[15] = static_cast<unsigned int>(bytelength << 3);
-    innerHash(result, w);
+    compress(result, last, last_blocks);
 
     // Store hash in result pointer, and make sure we get in in the correct
     // order on both endian models.
     for (int hashByte = 20; --hashByte >= 0;) {
         hash[hashByte] = (result[hashByte >> 2] >> (((3 - hashByte) & 0x3) << 3)) & 0xff;
     }
+#endif
 }
 
 } // namespace sha1
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_TRACE_HOOK_HPP
+#define WEBSOCKETPP_TRACE_HOOK_HPP
+
+#include <websocketpp/trace/points.hpp>
+
+#include <atomic>
+
+namespace websocketpp {
+namespace trace {
+
+/// Trace policy calling a function installed at run time
+/**
+ * Meant for tracing systems with an API of their own such as Perfetto or
+ * LTTng-UST tracepoints: install a function emitting their events with
+ * set_handler. Until one is installed, and after it is removed, each point
+ * costs an atomic load and a branch.
+ *
+ * The handler is shared by every config using this policy. It is called on
+ * the thread running the connection and must not block.
+ *
+ * @since 0.9.0
+ */
+class hook {
+public:
+    /// Type of a trace handler
+    typedef void (*handler)(point::value p, uint64_t id, uint64_t a,
+        uint64_t b);
+
+    /// Install the trace handler
+    /**
+     * @param h The handler, or null to stop tracing
+     */
+    static void set_handler(handler h) {
+        s_handler.store(h, std::memory_order_release);
+    }
+
+    static constexpr bool static_test(point::value) {
+        return true;
+    }
+
+    static void emit(point::value p, uint64_t id, uint64_t a, uint64_t b) {
+        handler h = s_handler.load(std::memory_order_acquire);
+        if (h) {
+            h(p, id, a, b);
+        }
+    }
+private:
+    static inline std::atomic<handler> s_handler{nullptr};
+};
+
+} // namespace trace
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_TRACE_HOOK_HPP
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_TRACE_NONE_HPP
+#define WEBSOCKETPP_TRACE_NONE_HPP
+
+#include <websocketpp/trace/points.hpp>
+
+#include <type_traits>
+
+namespace websocketpp {
+namespace trace {
+
+/// Trace policy that traces nothing
+/**
+ * @since 0.9.0
+ */
+class none {
+public:
+    static constexpr bool static_test(point::value) {
+        return false;
+    }
+
+    static void emit(point::value, uint64_t, uint64_t, uint64_t) {}
+};
+
+/// The trace policy of a config, trace::none unless it has a trace_type
+template <typename config, typename = void>
+struct policy {
+    typedef none type;
+};
+
+template <typename config>
+struct policy<config, std::void_t<typename config::trace_type> > {
+    typedef typename config::trace_type type;
+};
+
+} // namespace trace
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_TRACE_NONE_HPP
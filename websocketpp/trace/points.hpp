@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_TRACE_POINTS_HPP
+#define WEBSOCKETPP_TRACE_POINTS_HPP
+
+#include <websocketpp/common/stdint.hpp>
+
+namespace websocketpp {
+/// Compile time selectable hooks at points of the message pipeline
+/**
+ * A config selects a trace policy with a `trace_type` typedef, trace::none
+ * if it has none. A policy has a constexpr `static_test(point)` saying
+ * whether a point is traced and a static `emit(point, id, a, b)` called at
+ * the point when it is. Points not traced compile to nothing. `id` is the
+ * address of the connection, `a` and `b` depend on the point, see
+ * trace::point.
+ *
+ * @since 0.9.0
+ */
+namespace trace {
+
+/// Points of the message pipeline that may be traced
+namespace point {
+enum value {
+    /// A transport read completed. a: bytes read
+    read = 0,
+    /// The header of an incoming frame was parsed. a: opcode b: payload
+    /// length
+    frame = 1,
+    /// A complete data message is handed to the application. a: payload
+    /// length
+    deliver = 2,
+    /// A message was queued for sending. a: payload length
+    push = 3,
+    /// Queued messages were handed to the transport. a: messages b: bytes
+    dispatch = 4,
+    /// A transport write completed. a: error code value
+    write = 5,
+    /// A connection timer fired. a: error code value
+    timer = 6
+};
+
+/// Number of trace points
+static constexpr int count = 7;
+
+/// Get the name of a trace point
+inline char const * get_name(value p) {
+    switch (p) {
+        case read:
+            return "read";
+        case frame:
+            return "frame";
+        case deliver:
+            return "deliver";
+        case push:
+            return "push";
+        case dispatch:
+            return "dispatch";
+        case write:
+            return "write";
+        case timer:
+            return "timer";
+        default:
+            return "unknown";
+    }
+}
+} // namespace point
+
+} // namespace trace
+} // namespace websocketpp
+
+/// Emit a trace point if the policy traces it
+/**
+ * Arguments are only evaluated if the point is traced.
+ *
+ * @since 0.9.0
+ */
+#define WEBSOCKETPP_TRACE(policy, p, id, a, b)                               \
+    do {                                                                     \
+        if (policy::static_test(p)) {                                        \
+            policy::emit(p, uint64_t(id), uint64_t(a), uint64_t(b));         \
+        }                                                                    \
+    } while (0)
+
+#endif // WEBSOCKETPP_TRACE_POINTS_HPP
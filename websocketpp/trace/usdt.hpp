@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_TRACE_USDT_HPP
+#define WEBSOCKETPP_TRACE_USDT_HPP
+
+#include <websocketpp/trace/points.hpp>
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define WEBSOCKETPP_TRACE_USDT_AVAILABLE
+#endif
+#endif
+
+namespace websocketpp {
+namespace trace {
+
+/// Trace policy firing Linux USDT probes
+/**
+ * Each point is a statically defined probe of provider `websocketpp` named
+ * after the point, with the id, a and b arguments, for example
+ * `usdt:websocketpp:deliver` for bpftrace, or a perf, SystemTap or LTTng
+ * probe on the same. A probe that is not attached costs a single no-op
+ * instruction.
+ *
+ * Requires `<sys/sdt.h>`, from systemtap-sdt-dev or similar. Without it,
+ * nothing is traced.
+ *
+ * @since 0.9.0
+ */
+class usdt {
+public:
+    static constexpr bool static_test(point::value) {
+#ifdef WEBSOCKETPP_TRACE_USDT_AVAILABLE
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    static void emit(point::value p, uint64_t id, uint64_t a, uint64_t b) {
+#ifdef WEBSOCKETPP_TRACE_USDT_AVAILABLE
+        // probe names are part of the binary, so each needs its own site
+        switch (p) {
+            case point::read:
+                DTRACE_PROBE3(websocketpp, read, id, a, b);
+                break;
+            case point::frame:
+                DTRACE_PROBE3(websocketpp, frame, id, a, b);
+                break;
+            case point::deliver:
+                DTRACE_PROBE3(websocketpp, deliver, id, a, b);
+                break;
+            case point::push:
+                DTRACE_PROBE3(websocketpp, push, id, a, b);
+                break;
+            case point::dispatch:
+                DTRACE_PROBE3(websocketpp, dispatch, id, a, b);
+                break;
+            case point::write:
+                DTRACE_PROBE3(websocketpp, write, id, a, b);
+                break;
+            case point::timer:
+                DTRACE_PROBE3(websocketpp, timer, id, a, b);
+                break;
+        }
+#else
+        (void)p; (void)id; (void)a; (void)b;
+#endif
+    }
+};
+
+} // namespace trace
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_TRACE_USDT_HPP
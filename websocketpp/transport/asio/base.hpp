@@ -31,10 +31,14 @@
 #include <websocketpp/common/asio.hpp>
 #include <websocketpp/common/cpp11.hpp>
 #include <websocketpp/common/functional.hpp>
+#include <websocketpp/common/slab_allocator.hpp>
 #include <websocketpp/common/system_error.hpp>
 #include <websocketpp/common/type_traits.hpp>
 
+#include <atomic>
+#include <cstddef>
 #include <string>
+#include <utility>
 
 namespace websocketpp {
 namespace transport {
@@ -53,7 +57,7 @@ class handler_allocator {
 public:
     static const size_t size = 1024;
     
-    handler_allocator() : m_in_use(false) {}
+    handler_allocator() : m_in_use(false), m_heap_bytes(0) {}
 
 #ifdef _WEBSOCKETPP_DEFAULT_DELETE_FUNCTIONS_
 	handler_allocator(handler_allocator const & cpy) = delete;
@@ -65,24 +69,75 @@ public:
             m_in_use = true;
             return static_cast<void*>(&m_storage);
         } else {
-            return ::operator new(memsize);
+            void * pointer = ::operator new(memsize);
+            m_heap_bytes.fetch_add(memsize, std::memory_order_relaxed);
+            return pointer;
         }
     }
 
-    void deallocate(void * pointer) {
+    void deallocate(void * pointer, std::size_t memsize) {
         if (pointer == &m_storage) {
             m_in_use = false;
         } else {
+            m_heap_bytes.fetch_sub(memsize, std::memory_order_relaxed);
             ::operator delete(pointer);
         }
     }
 
+    // Bytes of the handlers that did not fit the storage space and are
+    // currently allocated from the heap.
+    size_t get_heap_bytes() const {
+        return m_heap_bytes.load(std::memory_order_relaxed);
+    }
+
 private:
     // Storage space used for handler-based custom memory allocation.
     lib::aligned_storage<size>::type m_storage;
 
     // Whether the handler-based custom allocation storage has been used.
     bool m_in_use;
+
+    // Heap bytes currently allocated for handlers that did not fit.
+    std::atomic<size_t> m_heap_bytes;
+};
+
+// Standard allocator interface to a handler_allocator. This is the
+// associated allocator of custom_alloc_handler, used by Asio versions that
+// have replaced the asio_handler_allocate hooks with associated_allocator.
+template <typename T>
+class handler_allocator_adaptor {
+public:
+    typedef T value_type;
+
+    explicit handler_allocator_adaptor(handler_allocator & a) : m_alloc(&a) {}
+
+    template <typename U>
+    handler_allocator_adaptor(handler_allocator_adaptor<U> const & other)
+      : m_alloc(other.get_handler_allocator()) {}
+
+    T * allocate(std::size_t n) {
+        return static_cast<T *>(m_alloc->allocate(sizeof(T) * n));
+    }
+
+    void deallocate(T * p, std::size_t n) {
+        m_alloc->deallocate(p, sizeof(T) * n);
+    }
+
+    handler_allocator * get_handler_allocator() const {
+        return m_alloc;
+    }
+
+    template <typename U>
+    bool operator==(handler_allocator_adaptor<U> const & other) const {
+        return m_alloc == other.get_handler_allocator();
+    }
+
+    template <typename U>
+    bool operator!=(handler_allocator_adaptor<U> const & other) const {
+        return m_alloc != other.get_handler_allocator();
+    }
+private:
+    handler_allocator * m_alloc;
 };
 
 // Wrapper class template for handler objects to allow handler memory
@@ -91,11 +146,17 @@ private:
 template <typename Handler>
 class custom_alloc_handler {
 public:
+    typedef handler_allocator_adaptor<void> allocator_type;
+
     custom_alloc_handler(handler_allocator& a, Handler h)
       : allocator_(a),
-        handler_(h)
+        handler_(std::move(h))
     {}
 
+    allocator_type get_allocator() const _WEBSOCKETPP_NOEXCEPT_TOKEN_ {
+        return allocator_type(allocator_);
+    }
+
     template <typename Arg1>
     void operator()(Arg1 arg1) {
         handler_(arg1);
@@ -112,10 +173,10 @@ public:
         return this_handler->allocator_.allocate(size);
     }
 
-    friend void asio_handler_deallocate(void* pointer, std::size_t /*size*/,
+    friend void asio_handler_deallocate(void* pointer, std::size_t size,
         custom_alloc_handler<Handler> * this_handler)
     {
-        this_handler->allocator_.deallocate(pointer);
+        this_handler->allocator_.deallocate(pointer, size);
     }
 
 private:
@@ -128,7 +189,98 @@ template <typename Handler>
 inline custom_alloc_handler<Handler> make_custom_alloc_handler(
     handler_allocator & a, Handler h)
 {
-    return custom_alloc_handler<Handler>(a, h);
+    return custom_alloc_handler<Handler>(a, std::move(h));
+}
+
+// Recycling allocator for handlers that may have several operations
+// outstanding at once or be allocated from several threads, such as timers.
+// Blocks up to block_size bytes are recycled through per-thread free lists.
+template <typename T>
+class recycling_handler_allocator {
+public:
+    typedef T value_type;
+
+    static const size_t block_size = 256;
+
+    recycling_handler_allocator() {}
+
+    template <typename U>
+    recycling_handler_allocator(recycling_handler_allocator<U> const &) {}
+
+    T * allocate(std::size_t n) {
+        if (sizeof(T) * n <= block_size && alignof(T) <= alignof(std::max_align_t)) {
+            return static_cast<T *>(cache_type::allocate());
+        }
+        return static_cast<T *>(::operator new(sizeof(T) * n));
+    }
+
+    void deallocate(T * p, std::size_t n) {
+        if (sizeof(T) * n <= block_size && alignof(T) <= alignof(std::max_align_t)) {
+            cache_type::release(p);
+        } else {
+            ::operator delete(p);
+        }
+    }
+
+    template <typename U>
+    bool operator==(recycling_handler_allocator<U> const &) const {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(recycling_handler_allocator<U> const &) const {
+        return false;
+    }
+private:
+    typedef slab_cache<block_size, alignof(std::max_align_t)> cache_type;
+};
+
+// Wrapper class template for handler objects that allocates handler memory
+// with a recycling_handler_allocator. Calls to operator() are forwarded to the
+// encapsulated handler.
+template <typename Handler>
+class recycling_alloc_handler {
+public:
+    typedef recycling_handler_allocator<void> allocator_type;
+
+    explicit recycling_alloc_handler(Handler h) : handler_(std::move(h)) {}
+
+    allocator_type get_allocator() const _WEBSOCKETPP_NOEXCEPT_TOKEN_ {
+        return allocator_type();
+    }
+
+    template <typename Arg1>
+    void operator()(Arg1 arg1) {
+        handler_(arg1);
+    }
+
+    template <typename Arg1, typename Arg2>
+    void operator()(Arg1 arg1, Arg2 arg2) {
+        handler_(arg1, arg2);
+    }
+
+    friend void* asio_handler_allocate(std::size_t size,
+        recycling_alloc_handler<Handler> *)
+    {
+        return recycling_handler_allocator<char>().allocate(size);
+    }
+
+    friend void asio_handler_deallocate(void* pointer, std::size_t size,
+        recycling_alloc_handler<Handler> *)
+    {
+        recycling_handler_allocator<char>().deallocate(
+            static_cast<char *>(pointer), size);
+    }
+
+private:
+    Handler handler_;
+};
+
+// Helper function to wrap a handler object to add recycling allocation.
+template <typename Handler>
+inline recycling_alloc_handler<Handler> make_recycling_alloc_handler(Handler h)
+{
+    return recycling_alloc_handler<Handler>(std::move(h));
 }
 
 
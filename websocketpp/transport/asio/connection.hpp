@@ -29,9 +29,12 @@
 #define WEBSOCKETPP_TRANSPORT_ASIO_CON_HPP
 
 #include <websocketpp/transport/asio/base.hpp>
+#include <websocketpp/transport/asio/socket_options.hpp>
 
 #include <websocketpp/transport/base/connection.hpp>
 
+#include <websocketpp/config/traits.hpp>
+
 #include <websocketpp/logger/levels.hpp>
 #include <websocketpp/http/constants.hpp>
 
@@ -43,20 +46,54 @@
 #include <websocketpp/common/chrono.hpp>
 #include <websocketpp/common/cpp11.hpp>
 #include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/memory_usage.hpp>
+#include <websocketpp/common/type_traits.hpp>
 #include <websocketpp/common/functional.hpp>
 #include <websocketpp/common/connection_hdl.hpp>
 
+#include <atomic>
+#include <deque>
 #include <istream>
 #include <sstream>
 #include <string>
+#include <utility>
 #include <vector>
 
+#ifdef _WEBSOCKETPP_ASIO_ZEROCOPY_
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
 namespace websocketpp {
 namespace transport {
 namespace asio {
 
 typedef lib::function<void(connection_hdl)> tcp_init_handler;
 
+/// Times at which the phases of establishing a connection completed
+/**
+ * Phases that haven't completed, or don't apply to the connection, such as
+ * resolving for accepted connections, hold the epoch of the clock.
+ *
+ * @since 0.9.0
+ */
+struct connect_timing {
+    typedef lib::chrono::steady_clock::time_point time_point;
+
+    /// When the endpoint started connecting
+    time_point start;
+    /// When the remote host was resolved
+    time_point resolved;
+    /// When the TCP connection was established
+    time_point connected;
+    /// When proxy negotiation and the TLS handshake, if any, completed
+    time_point secured;
+};
+
 /// Asio based connection transport component
 /**
  * transport::asio::connection implements a connection transport component using
@@ -102,6 +139,15 @@ public:
       : m_is_server(is_server)
       , m_alog(alog)
       , m_elog(elog)
+      , m_io_context(NULL)
+      , m_migration(migration_none)
+      , m_single_threaded_io(false)
+#ifdef _WEBSOCKETPP_ASIO_ZEROCOPY_
+      , m_zerocopy(false)
+      , m_zc_issued(0)
+      , m_zc_completed(0)
+      , m_zc_waiting(false)
+#endif
     {
         m_alog->write(log::alevel::devel,"asio con transport constructor");
     }
@@ -176,6 +222,52 @@ public:
         m_tcp_post_init_handler = h;
     }
 
+    /// Set the options applied to the socket of this connection
+    /**
+     * The options are applied once the TCP connection is established, before
+     * the tcp pre init handler is called. Defaults to the options of the
+     * endpoint, see endpoint::set_socket_options.
+     *
+     * @since 0.9.0
+     *
+     * @param options The socket options to apply
+     */
+    void set_socket_options(socket_options const & options) {
+        m_socket_options = options;
+    }
+
+    /// Connect over a unix domain socket
+    /**
+     * Client connections with a path connect to the unix domain socket at
+     * path rather than resolving and connecting to the host of their uri.
+     * The uri still supplies the Host header and the resource of the
+     * handshake. Only the buffer sizes of the socket options apply, and no
+     * proxy is used. Must be set before the connection is connected.
+     *
+     * The connections a server accepts after endpoint::listen_local report
+     * the path they were accepted on.
+     *
+     * Needs an Asio with local socket support, see
+     * _WEBSOCKETPP_ASIO_LOCAL_SOCKETS_; without it connecting fails.
+     *
+     * @since 0.9.0
+     *
+     * @param path The path of the socket, empty to use TCP
+     */
+    void set_local_path(std::string const & path) {
+        m_local_path = path;
+    }
+
+    /// Get the unix domain socket path of the connection
+    /**
+     * @since 0.9.0
+     *
+     * @return The path, empty for TCP connections
+     */
+    std::string const & get_local_path() const {
+        return m_local_path;
+    }
+
     /// Set the proxy to connect through (exception free)
     /**
      * The URI passed should be a complete URI including scheme. For example:
@@ -183,12 +275,15 @@ public:
      *
      * The proxy must be set up as an explicit (CONNECT) proxy allowed to
      * connect to the port you specify. Traffic to the proxy is not encrypted.
+     * Not available without config::enable_proxy.
      *
      * @param uri The full URI of the proxy to connect to.
      *
      * @param ec A status value
      */
     void set_proxy(std::string const & uri, lib::error_code & ec) {
+        static_assert(config_traits<config>::enable_proxy,
+            "set_proxy needs config::enable_proxy");
         // TODO: return errors for illegal URIs here?
         // TODO: should https urls be illegal for the moment?
         m_proxy = uri;
@@ -221,6 +316,8 @@ public:
     void set_proxy_basic_auth(std::string const & username, std::string const &
         password, lib::error_code & ec)
     {
+        static_assert(config_traits<config>::enable_proxy,
+            "set_proxy_basic_auth needs config::enable_proxy");
         if (!m_proxy_data) {
             ec = make_error_code(websocketpp::error::invalid_state);
             return;
@@ -254,6 +351,8 @@ public:
      * @param ec A status value
      */
     void set_proxy_timeout(long duration, lib::error_code & ec) {
+        static_assert(config_traits<config>::enable_proxy,
+            "set_proxy_timeout needs config::enable_proxy");
         if (!m_proxy_data) {
             ec = make_error_code(websocketpp::error::invalid_state);
             return;
@@ -272,8 +371,14 @@ public:
     }
 #endif // _WEBSOCKETPP_NO_EXCEPTIONS_
 
+    /// Get the proxy URI, empty if there is none
     std::string const & get_proxy() const {
-        return m_proxy;
+        if constexpr (config_traits<config>::enable_proxy) {
+            return m_proxy;
+        } else {
+            static std::string const none;
+            return none;
+        }
     }
 
     /// Get the remote endpoint address
@@ -287,6 +392,11 @@ public:
      * @return A string identifying the address of the remote endpoint
      */
     std::string get_remote_endpoint() const {
+        if (!m_local_path.empty()) {
+            // unix domain peers are mostly unnamed, report the path
+            return "unix:" + m_local_path;
+        }
+
         lib::error_code ec;
 
         std::string ret = socket_con_type::get_remote_endpoint(ec);
@@ -321,23 +431,27 @@ public:
     timer_ptr set_timer(long duration, timer_handler callback) {
         timer_ptr new_timer(
             new lib::asio::steady_timer(
-                *m_io_context,
+                get_io_context(),
                 lib::asio::milliseconds(duration))
         );
 
-        if (config::enable_multithreading) {
-            new_timer->async_wait(m_strand->wrap(lib::bind(
-                &type::handle_timer, get_shared(),
-                new_timer,
-                callback,
-                lib::placeholders::_1
+        if (strand_enabled()) {
+            new_timer->async_wait(bind_strand(make_recycling_alloc_handler(
+                lib::bind(
+                    &type::handle_timer, get_shared(),
+                    new_timer,
+                    callback,
+                    lib::placeholders::_1
+                )
             )));
         } else {
-            new_timer->async_wait(lib::bind(
-                &type::handle_timer, get_shared(),
-                new_timer,
-                callback,
-                lib::placeholders::_1
+            new_timer->async_wait(make_recycling_alloc_handler(
+                lib::bind(
+                    &type::handle_timer, get_shared(),
+                    new_timer,
+                    callback,
+                    lib::placeholders::_1
+                )
             ));
         }
 
@@ -371,10 +485,67 @@ public:
     }
 
     /// Get a pointer to this connection's strand
+    /**
+     * Returns a null pointer if multithreading is disabled or the connection
+     * was set up for a single threaded io_context.
+     */
     strand_ptr get_strand() {
         return m_strand;
     }
 
+    /// Add the memory held by the transport to an estimate
+    /**
+     * Counts the strand, the handler allocators, the write buffer list and
+     * the state of a proxy handshake. The storage of the handler allocators
+     * is part of the connection object and moves from the connection
+     * component to their own. Socket and TLS library state is left out.
+     *
+     * @since 0.9.0
+     *
+     * @param usage The estimate to add to
+     */
+    void get_memory_usage(memory_usage & usage) const {
+        if (m_strand) {
+            usage.bytes[memory_usage::strand] +=
+                sizeof(lib::asio::io_context::strand);
+        }
+
+        usage.claim(memory_usage::handler_allocators,
+            sizeof(m_read_handler_allocator) +
+            sizeof(m_write_handler_allocator));
+        usage.bytes[memory_usage::handler_allocators] +=
+            m_read_handler_allocator.get_heap_bytes() +
+            m_write_handler_allocator.get_heap_bytes();
+
+        usage.bytes[memory_usage::send_queue] +=
+            memory_usage::heap_bytes(m_bufs) +
+            memory_usage::heap_bytes(m_write_rest);
+
+        if constexpr (config_traits<config>::enable_proxy) {
+            if (m_proxy_data) {
+                usage.bytes[memory_usage::http] += sizeof(proxy_data) +
+                    m_proxy_data->req.get_memory_usage() +
+                    m_proxy_data->res.get_memory_usage() +
+                    memory_usage::heap_bytes(m_proxy_data->write_buf);
+            }
+        }
+    }
+
+    /// Declare whether the io_context is run by a single thread
+    /**
+     * A strand serializes handlers that may otherwise run concurrently on the
+     * threads running the io_context. If only one thread ever runs it the
+     * strand is redundant, and setting this skips allocating it and wrapping
+     * handlers with it. Must be set before init_asio.
+     *
+     * @since 0.9.0
+     *
+     * @param value Whether or not the io_context is single threaded
+     */
+    void set_single_threaded_io(bool value) {
+        m_single_threaded_io = value;
+    }
+
     /// Get the internal transport error code for a closed/failed connection
     /**
      * Retrieves a machine readable detailed error code indicating the reason
@@ -398,6 +569,124 @@ public:
         return m_tec;
     }
 
+    /// Retrieve a reference to the io_context this connection runs on
+    /**
+     * Only valid after the connection has been initialized by its endpoint.
+     *
+     * @since 0.9.0
+     *
+     * @return A reference to the connection's io_context
+     */
+    lib::asio::io_context & get_io_context() {
+        return *m_io_context.load();
+    }
+
+    /// Whether this connection could move to another io_context at all
+    /**
+     * Plain TCP sockets without a strand may move, see connection::migrate.
+     *
+     * @since 0.9.0
+     */
+    bool is_migratable() const {
+        if constexpr (!socket_con_type::supports_migration) {
+            return false;
+        } else {
+            return !m_strand && m_local_path.empty();
+        }
+    }
+
+    /// Whether anything but the read keeps the socket busy
+    /**
+     * @since 0.9.0
+     *
+     * @return Whether part of a write or zero copy completions are
+     * outstanding
+     */
+    bool migration_busy() const {
+#ifdef _WEBSOCKETPP_ASIO_ZEROCOPY_
+        if (m_zc_waiting || !m_zc_pins.empty()) {
+            return true;
+        }
+#endif
+        return !m_write_rest.empty();
+    }
+
+    /// Cancel the outstanding read ahead of a move to another io_context
+    /**
+     * The read completes with operation_aborted, which is swallowed rather
+     * than passed to its handler. A read that completes normally first is
+     * passed on as usual. Whichever happened is queued on the io_context
+     * before any handler posted after this call, see end_migration.
+     *
+     * @since 0.9.0
+     */
+    void begin_migration() {
+        m_migration = migration_cancelling;
+        lib::asio::error_code ec = socket_con_type::cancel_socket();
+        if (ec) {
+            log_err(log::elevel::info,"asio begin_migration",ec);
+        }
+    }
+
+    /// Find out how the read cancelled by begin_migration ended
+    /**
+     * @since 0.9.0
+     *
+     * @return Whether the read was cancelled and no read is outstanding
+     */
+    bool end_migration() {
+        bool detached = m_migration == migration_detached;
+        m_migration = migration_none;
+        return detached;
+    }
+
+    /// Move the socket and handlers of this connection to another io_context
+    /**
+     * Nothing may be outstanding on the socket, see begin_migration. Handlers
+     * posted afterwards run on io_context, and the connection logs to the
+     * new loggers.
+     *
+     * @since 0.9.0
+     *
+     * @param io_context The io_context to move to
+     * @param alog The access logger of the new io_context's endpoint
+     * @param elog The error logger of the new io_context's endpoint
+     * @return The error that occurred, if any. The connection stays where
+     * it was.
+     */
+    lib::error_code move_io_context(io_context_ptr io_context,
+        lib::shared_ptr<alog_type> const & alog,
+        lib::shared_ptr<elog_type> const & elog)
+    {
+        if constexpr (!socket_con_type::supports_migration) {
+            return make_error_code(transport::error::operation_not_supported);
+        } else {
+            lib::asio::error_code aec =
+                socket_con_type::move_socket(io_context);
+            if (aec) {
+                log_err(log::elevel::info,"asio move_io_context",aec);
+                m_tec = aec;
+                return socket_con_type::translate_ec(aec);
+            }
+
+            m_alog = alog;
+            m_elog = elog;
+            m_io_context = io_context;
+            return lib::error_code();
+        }
+    }
+
+    /// Get the times at which the phases of establishing this connection
+    /// completed
+    /**
+     * @since 0.9.0
+     *
+     * @return The connect timing of this connection
+     */
+    connect_timing const & get_connect_timing() const {
+        return m_connect_timing;
+    }
+
     /// Initialize transport for reading
     /**
      * init_asio is called once immediately after construction to initialize
@@ -421,6 +710,34 @@ protected:
             m_alog->write(log::alevel::devel,"asio connection init");
         }
 
+        // the TCP options do not apply to unix domain sockets
+        lib::asio::error_code ec = m_local_path.empty() ?
+            apply_socket_options(socket_con_type::get_raw_socket(),
+                m_socket_options) :
+            apply_buffer_options(socket_con_type::get_raw_socket(),
+                m_socket_options);
+        if (ec) {
+            log_err(log::elevel::info,"asio apply_socket_options",ec);
+        }
+
+#ifdef _WEBSOCKETPP_ASIO_ZEROCOPY_
+        if constexpr (socket_con_type::supports_inline_write) {
+            if (m_socket_options.zerocopy_threshold > 0 &&
+                m_local_path.empty())
+            {
+                typedef lib::asio::detail::socket_option::boolean<SOL_SOCKET,
+                    SO_ZEROCOPY> zerocopy;
+                socket_con_type::get_raw_socket().set_option(zerocopy(true),
+                    ec);
+                if (ec) {
+                    log_err(log::elevel::info,"asio SO_ZEROCOPY",ec);
+                } else {
+                    m_zerocopy = true;
+                }
+            }
+        }
+#endif
+
         // TODO: pre-init timeout. Right now no implemented socket policies
         // actually have an asyncronous pre-init
 
@@ -443,17 +760,22 @@ protected:
      * @return Status code indicating what errors occurred, if any
      */
     lib::error_code proxy_init(std::string const & authority) {
-        if (!m_proxy_data) {
+        if constexpr (config_traits<config>::enable_proxy) {
+            if (!m_proxy_data) {
+                return websocketpp::error::make_error_code(
+                    websocketpp::error::invalid_state);
+            }
+            m_proxy_data->req.set_version("HTTP/1.1");
+            m_proxy_data->req.set_method("CONNECT");
+
+            m_proxy_data->req.set_uri(authority);
+            m_proxy_data->req.replace_header("Host",authority);
+
+            return lib::error_code();
+        } else {
             return websocketpp::error::make_error_code(
                 websocketpp::error::invalid_state);
         }
-        m_proxy_data->req.set_version("HTTP/1.1");
-        m_proxy_data->req.set_method("CONNECT");
-
-        m_proxy_data->req.set_uri(authority);
-        m_proxy_data->req.replace_header("Host",authority);
-
-        return lib::error_code();
     }
 
     /// Finish constructing the transport
@@ -469,7 +791,7 @@ protected:
     lib::error_code init_asio (io_context_ptr io_context) {
         m_io_context = io_context;
 
-        if (config::enable_multithreading) {
+        if (config::enable_multithreading && !m_single_threaded_io) {
             m_strand.reset(new lib::asio::io_context::strand(*io_context));
         }
 
@@ -484,6 +806,8 @@ protected:
             m_alog->write(log::alevel::devel,"asio connection handle pre_init");
         }
 
+        m_connect_timing.connected = lib::chrono::steady_clock::now();
+
         if (m_tcp_pre_init_handler) {
             m_tcp_pre_init_handler(m_connection_hdl);
         }
@@ -494,11 +818,13 @@ protected:
 
         // If we have a proxy set issue a proxy connect, otherwise skip to
         // post_init
-        if (!m_proxy.empty()) {
-            proxy_write(callback);
-        } else {
-            post_init(callback);
+        if constexpr (config_traits<config>::enable_proxy) {
+            if (!m_proxy.empty()) {
+                proxy_write(callback);
+                return;
+            }
         }
+        post_init(callback);
     }
 
     void post_init(init_handler callback) {
@@ -595,6 +921,10 @@ protected:
             m_alog->write(log::alevel::devel,"asio connection handle_post_init");
         }
 
+        if (!ec) {
+            m_connect_timing.secured = lib::chrono::steady_clock::now();
+        }
+
         if (m_tcp_post_init_handler) {
             m_tcp_post_init_handler(m_connection_hdl);
         }
@@ -633,11 +963,11 @@ protected:
         );
 
         // Send proxy request
-        if (config::enable_multithreading) {
+        if (strand_enabled()) {
             lib::asio::async_write(
                 socket_con_type::get_next_layer(),
                 m_bufs,
-                m_strand->wrap(lib::bind(
+                bind_strand(lib::bind(
                     &type::handle_proxy_write, get_shared(),
                     callback,
                     lib::placeholders::_1
@@ -715,22 +1045,23 @@ protected:
             return;
         }
 
-        if (config::enable_multithreading) {
-            lib::asio::async_read_until(
-                socket_con_type::get_next_layer(),
-                m_proxy_data->read_buf,
-                "\r\n\r\n",
-                m_strand->wrap(lib::bind(
+        // Only the response can arrive before the tunnel is used, so reads
+        // go straight into a small buffer and through the response parser,
+        // with no streambuf or istream in between.
+        if (strand_enabled()) {
+            socket_con_type::get_next_layer().async_read_some(
+                lib::asio::buffer(m_proxy_data->read_buf,
+                    sizeof(m_proxy_data->read_buf)),
+                bind_strand(lib::bind(
                     &type::handle_proxy_read, get_shared(),
                     callback,
                     lib::placeholders::_1, lib::placeholders::_2
                 ))
             );
         } else {
-            lib::asio::async_read_until(
-                socket_con_type::get_next_layer(),
-                m_proxy_data->read_buf,
-                "\r\n\r\n",
+            socket_con_type::get_next_layer().async_read_some(
+                lib::asio::buffer(m_proxy_data->read_buf,
+                    sizeof(m_proxy_data->read_buf)),
                 lib::bind(
                     &type::handle_proxy_read, get_shared(),
                     callback,
@@ -747,7 +1078,7 @@ protected:
      * @param bytes_transferred The number of bytes read
      */
     void handle_proxy_read(init_handler callback,
-        lib::asio::error_code const & ec, size_t)
+        lib::asio::error_code const & ec, size_t bytes_transferred)
     {
         if (m_alog->static_test(log::alevel::devel)) {
             m_alog->write(log::alevel::devel,
@@ -764,10 +1095,8 @@ protected:
             return;
         }
 
-        // At this point there is no need to wait for the timer anymore
-        m_proxy_data->timer->cancel();
-
         if (ec) {
+            m_proxy_data->timer->cancel();
             m_elog->write(log::elevel::info,
                 "asio handle_proxy_read error: "+ec.message());
             callback(make_error_code(error::pass_through));
@@ -779,24 +1108,35 @@ protected:
                 return;
             }
 
-            // todo: switch this to using non-istream based consume
-            std::istream input(&m_proxy_data->read_buf);
-
-            lib::error_code istream_ec;
-            m_proxy_data->res.consume(input, istream_ec);
-            if (istream_ec) {
+            lib::error_code parse_ec;
+            size_t consumed = m_proxy_data->res.consume(
+                m_proxy_data->read_buf, bytes_transferred, parse_ec);
+            if (parse_ec) {
                 // there was an error while reading from the proxy
+                m_proxy_data->timer->cancel();
                 m_elog->write(log::elevel::info,
-                    "An HTTP handling error occurred while reading a response from the proxy server: "+istream_ec.message());
+                    "An HTTP handling error occurred while reading a response from the proxy server: "+parse_ec.message());
                 // todo: do we need to translate this error?
-                callback(istream_ec);
+                callback(parse_ec);
                 return;
             }
 
             if (!m_proxy_data->res.has_received(response_type::state::HEADERS)) {
-                // we read until the headers were done in theory but apparently
-                // they aren't. Internal endpoint error.
-                callback(make_error_code(error::general));
+                // the rest of the headers is still on its way
+                proxy_read(callback);
+                return;
+            }
+
+            // At this point there is no need to wait for the timer anymore
+            m_proxy_data->timer->cancel();
+
+            if (consumed != bytes_transferred) {
+                // a 2xx response to CONNECT has no body and the destination
+                // only speaks once the client has, so these bytes would
+                // otherwise be lost
+                m_elog->write(log::elevel::info,
+                    "Proxy sent data past its response to CONNECT");
+                callback(make_error_code(error::proxy_failed));
                 return;
             }
 
@@ -853,18 +1193,24 @@ protected:
             return;
         }*/
 
-        if (config::enable_multithreading) {
+        if constexpr (socket_con_type::supports_direct_io) {
+            if (socket_con_type::is_direct_io()) {
+                // the socket policy runs handlers on the strand itself
+                socket_con_type::async_read_direct(buf, len, num_bytes,
+                    read_op(take_read_self(), std::move(handler))
+                );
+                return;
+            }
+        }
+
+        if (strand_enabled()) {
             lib::asio::async_read(
                 socket_con_type::get_socket(),
                 lib::asio::buffer(buf,len),
                 lib::asio::transfer_at_least(num_bytes),
-                m_strand->wrap(make_custom_alloc_handler(
+                bind_strand(make_custom_alloc_handler(
                     m_read_handler_allocator,
-                    lib::bind(
-                        &type::handle_async_read, get_shared(),
-                        handler,
-                        lib::placeholders::_1, lib::placeholders::_2
-                    )
+                    read_op(take_read_self(), std::move(handler))
                 ))
             );
         } else {
@@ -874,22 +1220,115 @@ protected:
                 lib::asio::transfer_at_least(num_bytes),
                 make_custom_alloc_handler(
                     m_read_handler_allocator,
-                    lib::bind(
-                        &type::handle_async_read, get_shared(),
-                        handler,
-                        lib::placeholders::_1, lib::placeholders::_2
-                    )
+                    read_op(take_read_self(), std::move(handler))
                 )
             );    
         }
         
     }
 
-    void handle_async_read(read_handler handler, lib::asio::error_code const & ec,
-        size_t bytes_transferred)
+    /// Reset the TCP connection instead of closing it gracefully
+    /**
+     * Sets a zero linger time, closing the socket then sends a RST and
+     * releases it without going through TIME_WAIT.
+     *
+     * @since 0.9.0
+     */
+    void reset_on_close() {
+        lib::asio::error_code ec;
+        socket_con_type::get_raw_socket().set_option(
+            lib::asio::socket_base::linger(true, 0), ec);
+        if (ec) {
+            log_err(log::elevel::info,"asio reset_on_close",ec);
+        }
+    }
+
+    /// Wait until data is available to read and then call handler
+    /**
+     * Plain sockets wait for readability without consuming any data. Secure
+     * sockets and Asio versions without `async_wait` support call handler
+     * immediately because the TLS engine may already hold decrypted data
+     * that the socket itself will never signal.
+     *
+     * @since 0.9.0
+     *
+     * @param handler The callback to invoke when data may be read
+     */
+    void async_wait_readable(read_handler handler) {
+        m_alog->write(log::alevel::devel, "asio async_wait_readable");
+
+#ifdef _WEBSOCKETPP_ASIO_EXECUTORS_
+        if (!socket_con_type::is_secure()) {
+            if (strand_enabled()) {
+                socket_con_type::get_raw_socket().async_wait(
+                    lib::asio::socket_base::wait_read,
+                    bind_strand(make_custom_alloc_handler(
+                        m_read_handler_allocator,
+                        read_op(take_read_self(), std::move(handler))
+                    ))
+                );
+            } else {
+                socket_con_type::get_raw_socket().async_wait(
+                    lib::asio::socket_base::wait_read,
+                    make_custom_alloc_handler(
+                        m_read_handler_allocator,
+                        read_op(take_read_self(), std::move(handler))
+                    )
+                );
+            }
+            return;
+        }
+#endif
+
+        handler(lib::error_code(),size_t(0));
+    }
+
+    /// Read whatever the socket holds without blocking
+    /**
+     * Secure sockets always return 0, the TLS engine rather than the socket
+     * knows whether decrypted data is available.
+     *
+     * @since 0.9.0
+     *
+     * @param buf Buffer to read into
+     * @param len Maximum number of bytes to read
+     * @return The number of bytes read, 0 if none could be read right away
+     */
+    size_t read_available(char * buf, size_t len) {
+        if (socket_con_type::is_secure()) {
+            return 0;
+        }
+
+        lib::asio::error_code aec;
+        size_t avail = socket_con_type::get_next_layer().available(aec);
+        if (aec || avail == 0) {
+            return 0;
+        }
+
+        size_t n = socket_con_type::get_next_layer().read_some(
+            lib::asio::buffer(buf, (std::min)(avail, len)), aec);
+        return aec ? 0 : n;
+    }
+
+    void handle_async_read(read_handler const & handler,
+        lib::asio::error_code const & ec, size_t bytes_transferred)
     {
         m_alog->write(log::alevel::devel, "asio con handle_async_read");
 
+        if (m_migration == migration_cancelling) {
+            if (ec == lib::asio::error::operation_aborted) {
+                // cancelled by begin_migration, the handler is not called
+                m_migration = migration_detached;
+                return;
+            }
+            m_migration = migration_none;
+        }
+
+        if (!ec && m_socket_options.quick_ack) {
+            // the kernel falls back to delayed acks on its own
+            apply_quick_ack(socket_con_type::get_raw_socket());
+        }
+
         // translate asio error codes into more lib::error_codes
         lib::error_code tec;
         if (ec == lib::asio::error::eof) {
@@ -919,76 +1358,222 @@ protected:
         }
     }
 
+    /// Whether handlers must be bound to this connection's strand
+    bool strand_enabled() const {
+        return config::enable_multithreading && m_strand;
+    }
+
+    /// Bind a handler to this connection's strand
+    /**
+     * Where available this uses bind_executor rather than strand::wrap so
+     * that the handler's associated allocator remains visible to Asio.
+     */
+    template <typename Handler>
+    auto bind_strand(Handler h) {
+#ifdef _WEBSOCKETPP_ASIO_EXECUTORS_
+        return lib::asio::bind_executor(*m_strand, std::move(h));
+#else
+        return m_strand->wrap(std::move(h));
+#endif
+    }
+
+    /// Completion handler of a read or a wait for readability
+    /**
+     * Holds the one reference to the connection that keeps it alive while
+     * the operation is outstanding, moved rather than copied from there on.
+     * While the read handler runs the reference is parked in m_read_self,
+     * so a read started from the handler takes it over, see take_read_self,
+     * and a connection that reads continuously does not touch its shared
+     * count at all.
+     */
+    struct read_op {
+        read_op(ptr c, read_handler h)
+          : con(std::move(c)), handler(std::move(h)) {}
+
+        void operator()(lib::asio::error_code const & ec, size_t bytes) {
+            type & c = *con;
+            c.m_read_self = std::move(con);
+            c.handle_async_read(handler, ec, bytes);
+            // dropped here, possibly the last reference, unless taken over
+            ptr done = std::move(c.m_read_self);
+        }
+
+        void operator()(lib::asio::error_code const & ec) {
+            (*this)(ec, 0);
+        }
+
+        ptr con;
+        read_handler handler;
+    };
+
+    /// Completion handler of a write, see read_op
+    struct write_op {
+        write_op(ptr c, write_handler h)
+          : con(std::move(c)), handler(std::move(h)) {}
+
+        void operator()(lib::asio::error_code const & ec, size_t bytes) {
+            type & c = *con;
+            c.m_write_self = std::move(con);
+            c.handle_async_write(handler, ec, bytes);
+            ptr done = std::move(c.m_write_self);
+        }
+
+        ptr con;
+        write_handler handler;
+    };
+
+    /// Get the reference a new read keeps the connection alive with
+    /**
+     * Reuses the reference of the read whose handler is running, if any.
+     * Completion handlers of a connection never run concurrently, they are
+     * on its strand or on the one thread running its io_context, and the
+     * next read is started from the handler of the previous one.
+     */
+    ptr take_read_self() {
+        if (m_read_self) {
+            return std::move(m_read_self);
+        }
+        return get_shared();
+    }
+
+    /// Get the reference a new write keeps the connection alive with
+    /**
+     * @see take_read_self
+     */
+    ptr take_write_self() {
+        if (m_write_self) {
+            return std::move(m_write_self);
+        }
+        return get_shared();
+    }
+
     /// Initiate a potentially asyncronous write of the given buffer
     void async_write(const char* buf, size_t len, write_handler handler) {
         m_bufs.push_back(lib::asio::buffer(buf,len));
 
-        if (config::enable_multithreading) {
-            lib::asio::async_write(
-                socket_con_type::get_socket(),
-                m_bufs,
-                m_strand->wrap(make_custom_alloc_handler(
-                    m_write_handler_allocator,
-                    lib::bind(
-                        &type::handle_async_write, get_shared(),
-                        handler,
-                        lib::placeholders::_1, lib::placeholders::_2
-                    )
-                ))
-            );
-        } else {
-            lib::asio::async_write(
-                socket_con_type::get_socket(),
-                m_bufs,
-                make_custom_alloc_handler(
-                    m_write_handler_allocator,
-                    lib::bind(
-                        &type::handle_async_write, get_shared(),
-                        handler,
-                        lib::placeholders::_1, lib::placeholders::_2
-                    )
-                )
-            );
+        std::vector<lib::asio::const_buffer> const & out =
+            socket_con_type::prepare_write(m_bufs);
+
+        if constexpr (socket_con_type::supports_direct_io) {
+            if (socket_con_type::is_direct_io()) {
+                // the socket policy runs handlers on the strand itself
+                socket_con_type::async_write_direct(out,
+                    write_op(take_write_self(), std::move(handler))
+                );
+                return;
+            }
         }
+
+        start_write(out, std::move(handler));
     }
 
     /// Initiate a potentially asyncronous write of the given buffers
     void async_write(std::vector<buffer> const & bufs, write_handler handler) {
         std::vector<buffer>::const_iterator it;
 
-        // todo: check if this underlying socket supports efficient scatter/gather io
-        // if not, coalesce buffers before we send to the underlying transport.
-
         for (it = bufs.begin(); it != bufs.end(); ++it) {
             m_bufs.push_back(lib::asio::buffer((*it).buf,(*it).len));
         }
 
-        if (config::enable_multithreading) {
-            lib::asio::async_write(
-                socket_con_type::get_socket(),
-                m_bufs,
-                m_strand->wrap(make_custom_alloc_handler(
-                    m_write_handler_allocator,
-                    lib::bind(
-                        &type::handle_async_write, get_shared(),
-                        handler,
-                        lib::placeholders::_1, lib::placeholders::_2
-                    )
-                ))
-            );
-        } else {
-            lib::asio::async_write(
-                socket_con_type::get_socket(),
-                m_bufs,
-                make_custom_alloc_handler(
-                    m_write_handler_allocator,
-                    lib::bind(
-                        &type::handle_async_write, get_shared(),
-                        handler,
-                        lib::placeholders::_1, lib::placeholders::_2
-                    )
-                )
-            );
+        std::vector<lib::asio::const_buffer> const & out =
+            socket_con_type::prepare_write(m_bufs);
+
+        if constexpr (socket_con_type::supports_direct_io) {
+            if (socket_con_type::is_direct_io()) {
+                // the socket policy runs handlers on the strand itself
+                socket_con_type::async_write_direct(out,
+                    write_op(take_write_self(), std::move(handler))
+                );
+                return;
+            }
+        }
+
+        start_write(out, std::move(handler));
+    }
+
+    /// Whether the next write should come with a pin, see pin_write
+    /**
+     * @since 0.9.0
+     *
+     * @param bytes The size of the next write
+     * @return Whether the write may be sent with MSG_ZEROCOPY, see
+     * socket_options::zerocopy_threshold
+     */
+    bool wants_write_pin(size_t bytes) const {
+#ifdef _WEBSOCKETPP_ASIO_ZEROCOPY_
+        return m_zerocopy && bytes >= m_socket_options.zerocopy_threshold;
+#else
+        (void)bytes;
+        return false;
+#endif
+    }
+
+    /// Keep the memory of the next write alive until the kernel is done
+    /**
+     * The pin is released once every zero copy send of the next write has
+     * been reported complete by the kernel, which may be well after the
+     * write handler has run, or when the connection is destroyed.
+     *
+     * @since 0.9.0
+     *
+     * @param pin An owner of the buffers of the next async_write
+     */
+    void pin_write(lib::shared_ptr<void> pin) {
+#ifdef _WEBSOCKETPP_ASIO_ZEROCOPY_
+        m_zc_next_pin = pin;
+#else
+        (void)pin;
+#endif
+    }
+
+    /// Get the number of writes whose memory the kernel still references
+    /**
+     * @since 0.9.0
+     */
+    size_t get_pinned_writes() const {
+#ifdef _WEBSOCKETPP_ASIO_ZEROCOPY_
+        return m_zc_pins.size();
+#else
+        return 0;
+#endif
+    }
+
+    /// Begin a pass that starts the writes of many connections
+    /**
+     * Called by connection::flush_write_batch around the write_frame calls
+     * of one batch, on the thread running the io_context. Until the matching
+     * end_write_batch, writes of plain sockets without a strand are first
+     * tried synchronously without blocking. Writes that complete this way
+     * skip Asio's completion queue: their handlers run together in
+     * end_write_batch, so the writes of a broadcast are all submitted before
+     * any of them completes, with no per connection completion post.
+     *
+     * @since 0.9.0
+     */
+    static void begin_write_batch() {
+        ++write_batch_depth();
+    }
+
+    /// End a pass started by begin_write_batch
+    /**
+     * Runs the handlers of the writes completed inline during the pass.
+     *
+     * @since 0.9.0
+     */
+    static void end_write_batch() {
+        if (--write_batch_depth() > 0) {
+            return;
+        }
+
+        std::vector<inline_write> & done = inline_writes();
+        while (!done.empty()) {
+            // handlers may start writes of their own in a new pass
+            std::vector<inline_write> batch;
+            batch.swap(done);
+            for (size_t i = 0; i < batch.size(); ++i) {
+                batch[i].con->handle_async_write(batch[i].handler,
+                    lib::asio::error_code(), batch[i].bytes);
+            }
         }
     }
 
@@ -997,8 +1582,11 @@ protected:
      * @param ec The status code
      * @param bytes_transferred The number of bytes read
      */
-    void handle_async_write(write_handler handler, lib::asio::error_code const & ec, size_t) {
+    void handle_async_write(write_handler const & handler,
+        lib::asio::error_code const & ec, size_t)
+    {
         m_bufs.clear();
+        m_write_rest.clear();
         lib::error_code tec;
         if (ec) {
             log_err(log::elevel::info,"asio async_write",ec);
@@ -1014,6 +1602,347 @@ protected:
         }
     }
 
+    /// A write that completed during a write batch, see begin_write_batch
+    struct inline_write {
+        ptr con;
+        write_handler handler;
+        size_t bytes;
+    };
+
+    static size_t & write_batch_depth() {
+        static thread_local size_t depth = 0;
+        return depth;
+    }
+
+    static std::vector<inline_write> & inline_writes() {
+        static thread_local std::vector<inline_write> done;
+        return done;
+    }
+
+    /// Write out, inline during a write batch where possible
+    void start_write(std::vector<lib::asio::const_buffer> const & out,
+        write_handler handler)
+    {
+        if constexpr (socket_con_type::supports_inline_write) {
+#ifdef _WEBSOCKETPP_ASIO_ZEROCOPY_
+            if (m_zc_next_pin) {
+                start_zerocopy_write(out, std::move(handler));
+                return;
+            }
+#endif
+            if (write_batch_depth() > 0 && !strand_enabled() &&
+                try_write_inline(out, handler))
+            {
+                return;
+            }
+        }
+
+        std::vector<lib::asio::const_buffer> const & rest =
+            m_write_rest.empty() ? out : m_write_rest;
+
+        if (strand_enabled()) {
+            lib::asio::async_write(
+                socket_con_type::get_socket(),
+                rest,
+                bind_strand(make_custom_alloc_handler(
+                    m_write_handler_allocator,
+                    write_op(take_write_self(), std::move(handler))
+                ))
+            );
+        } else {
+            lib::asio::async_write(
+                socket_con_type::get_socket(),
+                rest,
+                make_custom_alloc_handler(
+                    m_write_handler_allocator,
+                    write_op(take_write_self(), std::move(handler))
+                )
+            );
+        }
+    }
+
+    /// Try to write out without blocking
+    /**
+     * @return Whether the write completed and handler was queued for
+     * end_write_batch. Otherwise whatever was not written, all of out or the
+     * remainder in m_write_rest, is left for an asynchronous write.
+     */
+    bool try_write_inline(std::vector<lib::asio::const_buffer> const & out,
+        write_handler & handler) requires socket_con_type::supports_inline_write
+    {
+        lib::asio::ip::tcp::socket & socket = socket_con_type::get_socket();
+        lib::asio::error_code ec;
+
+        if (!socket.non_blocking()) {
+            socket.non_blocking(true, ec);
+            if (ec) {
+                return false;
+            }
+        }
+
+        size_t total = lib::asio::buffer_size(out);
+        size_t written = socket.write_some(out, ec);
+        if (ec) {
+            // would_block, or an error the asynchronous write will report
+            return false;
+        }
+
+        if (written < total) {
+            for (size_t i = 0; i < out.size(); ++i) {
+                size_t len = out[i].size();
+                if (written >= len) {
+                    written -= len;
+                    continue;
+                }
+                m_write_rest.push_back(out[i] + written);
+                written = 0;
+            }
+            return false;
+        }
+
+        inline_write w;
+        w.con = take_write_self();
+        w.handler = std::move(handler);
+        w.bytes = total;
+        inline_writes().push_back(w);
+        return true;
+    }
+
+#ifdef _WEBSOCKETPP_ASIO_ZEROCOPY_
+    /// Write out, large buffers with MSG_ZEROCOPY
+    /**
+     * The buffers are written with non-blocking sendmsg calls, one per run
+     * of buffers that are all at least zerocopy_threshold bytes, which get
+     * MSG_ZEROCOPY, or all shorter. Asio only waits for the socket to become
+     * writable. The pin is kept in m_zc_pins until the kernel reports the
+     * last zero copy send of this write complete.
+     */
+    void start_zerocopy_write(std::vector<lib::asio::const_buffer> const &
+        out, write_handler handler)
+        requires socket_con_type::supports_inline_write
+    {
+        m_zc_rest.assign(out.begin(), out.end());
+        m_zc_handler = std::move(handler);
+        m_zc_pin = m_zc_next_pin;
+        m_zc_next_pin.reset();
+
+        reap_zerocopy();
+        continue_zerocopy_write(lib::asio::error_code());
+    }
+
+    void continue_zerocopy_write(lib::asio::error_code const & wait_ec)
+        requires socket_con_type::supports_inline_write
+    {
+        if (wait_ec) {
+            finish_zerocopy_write(wait_ec);
+            return;
+        }
+
+        int fd = socket_con_type::get_raw_socket().native_handle();
+        size_t threshold = m_socket_options.zerocopy_threshold;
+        size_t first = 0;
+
+        while (first < m_zc_rest.size()) {
+            bool zc = m_zerocopy && m_zc_rest[first].size() >= threshold;
+
+            iovec iov[64];
+            size_t n = 0;
+            while (first + n < m_zc_rest.size() && n < 64 &&
+                (m_zerocopy && m_zc_rest[first + n].size() >= threshold) == zc)
+            {
+                iov[n].iov_base = const_cast<void *>(m_zc_rest[first + n].data());
+                iov[n].iov_len = m_zc_rest[first + n].size();
+                ++n;
+            }
+
+            msghdr msg = msghdr();
+            msg.msg_iov = iov;
+            msg.msg_iovlen = n;
+
+            ssize_t sent = ::sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL |
+                (zc ? MSG_ZEROCOPY : 0));
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    m_zc_rest.erase(m_zc_rest.begin(), m_zc_rest.begin() +
+                        first);
+                    wait_zerocopy_writable();
+                    return;
+                } else if (errno == ENOBUFS && zc) {
+                    // out of locked memory for pinned pages, copy instead
+                    m_zerocopy = false;
+                    continue;
+                }
+                finish_zerocopy_write(lib::asio::error_code(errno,
+                    lib::asio::error::get_system_category()));
+                return;
+            }
+
+            if (zc) {
+                ++m_zc_issued;
+            }
+
+            // skip what was sent; a short send leaves the rest of a buffer
+            size_t left = size_t(sent);
+            while (left > 0 && left >= m_zc_rest[first].size()) {
+                left -= m_zc_rest[first].size();
+                ++first;
+            }
+            if (left > 0) {
+                m_zc_rest[first] = m_zc_rest[first] + left;
+            }
+        }
+
+        m_zc_rest.clear();
+        finish_zerocopy_write(lib::asio::error_code());
+    }
+
+    void wait_zerocopy_writable()
+        requires socket_con_type::supports_inline_write
+    {
+        lib::asio::ip::tcp::socket & socket =
+            socket_con_type::get_raw_socket();
+        if (strand_enabled()) {
+            socket.async_wait(lib::asio::socket_base::wait_write,
+                bind_strand(lib::bind(&type::continue_zerocopy_write,
+                    get_shared(), lib::placeholders::_1)));
+        } else {
+            socket.async_wait(lib::asio::socket_base::wait_write,
+                lib::bind(&type::continue_zerocopy_write, get_shared(),
+                    lib::placeholders::_1));
+        }
+    }
+
+    void finish_zerocopy_write(lib::asio::error_code const & ec)
+        requires socket_con_type::supports_inline_write
+    {
+        if (m_zc_pin) {
+            m_zc_pins.push_back(std::make_pair(m_zc_issued, m_zc_pin));
+            m_zc_pin.reset();
+        }
+        // a write that made no zero copy sends is done with its memory
+        release_zerocopy_pins();
+        wait_zerocopy_completions();
+
+        write_handler handler = std::move(m_zc_handler);
+        m_zc_handler = write_handler();
+
+        // never call the handler from within async_write
+        if (write_batch_depth() > 0 && !strand_enabled() && !ec) {
+            inline_write w;
+            w.con = take_write_self();
+            w.handler = std::move(handler);
+            w.bytes = 0;
+            inline_writes().push_back(w);
+        } else if (strand_enabled()) {
+            lib::asio::post(get_io_context(), bind_strand(lib::bind(
+                &type::handle_async_write, get_shared(), handler, ec,
+                size_t(0))));
+        } else {
+            lib::asio::post(get_io_context(), lib::bind(
+                &type::handle_async_write, get_shared(), handler, ec,
+                size_t(0)));
+        }
+    }
+
+    /// Read the zero copy completions the kernel has queued
+    /**
+     * @return Whether any completion was read
+     */
+    bool reap_zerocopy() {
+        int fd = socket_con_type::get_raw_socket().native_handle();
+        bool progress = false;
+
+        for (;;) {
+            char control[128];
+            msghdr msg = msghdr();
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+
+            if (::recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+                break;
+            }
+
+            for (cmsghdr * cm = CMSG_FIRSTHDR(&msg); cm;
+                cm = CMSG_NXTHDR(&msg, cm))
+            {
+                if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                    && !(cm->cmsg_level == SOL_IPV6 &&
+                    cm->cmsg_type == IPV6_RECVERR))
+                {
+                    continue;
+                }
+
+                sock_extended_err err;
+                std::memcpy(&err, CMSG_DATA(cm), sizeof(err));
+                if (err.ee_errno != 0 ||
+                    err.ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                {
+                    continue;
+                }
+
+                // sends ee_info through ee_data are done, in order for TCP
+                m_zc_completed = err.ee_data + 1;
+                progress = true;
+                if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                    // the kernel copied the data anyway, loopback does
+                    m_zerocopy = false;
+                }
+            }
+        }
+
+        release_zerocopy_pins();
+        return progress;
+    }
+
+    void release_zerocopy_pins() {
+        while (!m_zc_pins.empty() &&
+            int32_t(m_zc_completed - m_zc_pins.front().first) >= 0)
+        {
+            m_zc_pins.pop_front();
+        }
+    }
+
+    /// Wait on the error queue while pins are held
+    /**
+     * Completions that arrive without waking the wait are picked up by the
+     * next write instead.
+     */
+    void wait_zerocopy_completions()
+        requires socket_con_type::supports_inline_write
+    {
+        if (m_zc_pins.empty() || m_zc_waiting) {
+            return;
+        }
+        m_zc_waiting = true;
+
+        lib::asio::ip::tcp::socket & socket =
+            socket_con_type::get_raw_socket();
+        if (strand_enabled()) {
+            socket.async_wait(lib::asio::socket_base::wait_error,
+                bind_strand(lib::bind(&type::handle_zerocopy_wait,
+                    get_shared(), lib::placeholders::_1)));
+        } else {
+            socket.async_wait(lib::asio::socket_base::wait_error,
+                lib::bind(&type::handle_zerocopy_wait, get_shared(),
+                    lib::placeholders::_1));
+        }
+    }
+
+    void handle_zerocopy_wait(lib::asio::error_code const & ec)
+        requires socket_con_type::supports_inline_write
+    {
+        m_zc_waiting = false;
+        // stop on errors and on wakeups that brought nothing, which a
+        // socket error would otherwise turn into a busy loop
+        if (ec || !reap_zerocopy()) {
+            return;
+        }
+        wait_zerocopy_completions();
+    }
+#endif
+
     /// Set Connection Handle
     /**
      * See common/connection_hdl.hpp for information
@@ -1031,19 +1960,54 @@ protected:
      * This needs to be thread safe
      */
     lib::error_code interrupt(interrupt_handler handler) {
-        if (config::enable_multithreading) {
-            m_io_context->post(m_strand->wrap(handler));
+        if (strand_enabled()) {
+#ifdef _WEBSOCKETPP_ASIO_EXECUTORS_
+            lib::asio::post(get_io_context(), bind_strand(handler));
+#else
+            get_io_context().post(m_strand->wrap(handler));
+#endif
         } else {
-            m_io_context->post(handler);
+            get_io_context().post(handler);
         }
         return lib::error_code();
     }
 
+    /// Get the event loop that deferred writes of this connection run on
+    /**
+     * Non-null only when the calling thread is running this connection's
+     * io_context and the connection has no strand, so a handler posted to
+     * the io_context may call into many such connections in one pass.
+     * Connections returning the same key may have their writes started
+     * together, see connection::schedule_write_frame.
+     *
+     * @since 0.9.0
+     *
+     * @return The io_context, or null if writes may not be batched
+     */
+    void const * get_write_batch_key() const {
+#ifdef _WEBSOCKETPP_ASIO_EXECUTORS_
+        io_context_ptr io_context = m_io_context.load();
+        if (!strand_enabled() && io_context &&
+            io_context->get_executor().running_in_this_thread())
+        {
+            return io_context;
+        }
+#endif
+        return NULL;
+    }
+
+    /// dispatch posts its handler, see dispatch
+    static bool const inline_dispatch = false;
+
     lib::error_code dispatch(dispatch_handler handler) {
-        if (config::enable_multithreading) {
-            m_io_context->post(m_strand->wrap(handler));
+        if (strand_enabled()) {
+#ifdef _WEBSOCKETPP_ASIO_EXECUTORS_
+            lib::asio::post(get_io_context(), bind_strand(handler));
+#else
+            get_io_context().post(m_strand->wrap(handler));
+#endif
         } else {
-            m_io_context->post(handler);
+            get_io_context().post(handler);
         }
         return lib::error_code();
     }
@@ -1183,24 +2147,65 @@ private:
         request_type req;
         response_type res;
         std::string write_buf;
-        lib::asio::streambuf read_buf;
+        char read_buf[512];
         long timeout_proxy;
         timer_ptr timer;
     };
 
-    std::string m_proxy;
-    lib::shared_ptr<proxy_data> m_proxy_data;
+    // compiled out without config::enable_proxy
+    [[no_unique_address]] member_if<config_traits<config>::enable_proxy,
+        std::string> m_proxy;
+    [[no_unique_address]] member_if<config_traits<config>::enable_proxy,
+        lib::shared_ptr<proxy_data> > m_proxy_data;
+
+    /// How far the read cancelled by begin_migration got
+    enum migration_state {
+        migration_none,
+        migration_cancelling,
+        migration_detached
+    };
 
     // transport resources
-    io_context_ptr  m_io_context;
+    /// Read from any thread by get_io_context, changes when the connection
+    /// moves to another io_context
+    std::atomic<io_context_ptr> m_io_context;
+    migration_state m_migration;
     strand_ptr      m_strand;
+    bool            m_single_threaded_io;
     connection_hdl  m_connection_hdl;
+    /// The reference of the read or write whose handler is running, see
+    /// read_op
+    ptr             m_read_self;
+    ptr             m_write_self;
 
     std::vector<lib::asio::const_buffer> m_bufs;
+    /// What an inline write left for async_write, see try_write_inline
+    std::vector<lib::asio::const_buffer> m_write_rest;
+
+#ifdef _WEBSOCKETPP_ASIO_ZEROCOPY_
+    /// Zero copy sends, see socket_options::zerocopy_threshold
+    bool m_zerocopy;
+    lib::shared_ptr<void> m_zc_next_pin;
+    lib::shared_ptr<void> m_zc_pin;
+    std::vector<lib::asio::const_buffer> m_zc_rest;
+    write_handler m_zc_handler;
+    /// MSG_ZEROCOPY sends made and reported complete, wrapping like the
+    /// kernel's counter
+    uint32_t m_zc_issued;
+    uint32_t m_zc_completed;
+    /// Pins and the send count that completes each
+    std::deque<std::pair<uint32_t, lib::shared_ptr<void> > > m_zc_pins;
+    bool m_zc_waiting;
+#endif
 
     /// Detailed internal error code
     lib::asio::error_code m_tec;
 
+    connect_timing  m_connect_timing;
+    socket_options  m_socket_options;
+    /// Unix domain socket path, empty for TCP, see set_local_path
+    std::string     m_local_path;
+
     // Handlers
     tcp_init_handler    m_tcp_pre_init_handler;
     tcp_init_handler    m_tcp_post_init_handler;
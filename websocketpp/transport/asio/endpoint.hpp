@@ -36,10 +36,16 @@
 #include <websocketpp/logger/levels.hpp>
 
 #include <websocketpp/common/asio.hpp>
+#include <websocketpp/common/chrono.hpp>
 #include <websocketpp/common/functional.hpp>
+#include <websocketpp/common/thread.hpp>
+#include <websocketpp/common/timer_wheel.hpp>
 
+#include <filesystem>
+#include <map>
 #include <sstream>
 #include <string>
+#include <vector>
 
 namespace websocketpp {
 namespace transport {
@@ -85,18 +91,38 @@ public:
     typedef lib::shared_ptr<lib::asio::ip::tcp::resolver> resolver_ptr;
     /// Type of timer handle
     typedef lib::shared_ptr<lib::asio::steady_timer> timer_ptr;
+    /// Type of a native listening socket
+    typedef lib::asio::ip::tcp::acceptor::native_handle_type native_handle_type;
     /// Type of a shared pointer to an io_context work object
     typedef lib::shared_ptr<lib::asio::io_context::work> work_ptr;
 
+    /// Type of the handler called with each reading of the loop lag probe
+    typedef lib::function<void(lib::chrono::microseconds)> loop_lag_handler;
+
     /// Type of socket pre-bind handler
     typedef lib::function<lib::error_code(acceptor_ptr)> tcp_pre_bind_handler;
 
+    /// Type of the callback a resolve handler reports its results to
+    typedef lib::function<void(lib::asio::error_code const &,
+        lib::asio::ip::tcp::resolver::iterator)> resolve_callback;
+    /// Type of a handler that resolves host names in place of asio
+    typedef lib::function<void(std::string const &, std::string const &,
+        resolve_callback)> resolve_handler;
+
     // generate and manage our own io_context
     explicit endpoint()
       : m_io_context(NULL)
       , m_external_io_context(false)
       , m_listen_backlog(lib::asio::socket_base::max_connections)
       , m_reuse_addr(false)
+      , m_reuse_port(false)
+      , m_incoming_cpu(-1)
+      , m_single_threaded_io(false)
+      , m_connect_attempt_delay(250)
+      , m_dns_cache_ttl(0)
+      , m_dns_cache_negative_ttl(1000)
+      , m_dns_cache(lib::make_shared<dns_cache>())
+      , m_loop_lag_interval(0)
       , m_state(UNINITIALIZED)
     {
         //std::cout << "transport::asio::endpoint constructor" << std::endl;
@@ -137,8 +163,18 @@ public:
       , m_acceptor(src.m_acceptor)
       , m_listen_backlog(lib::asio::socket_base::max_connections)
       , m_reuse_addr(src.m_reuse_addr)
+      , m_reuse_port(src.m_reuse_port)
+      , m_incoming_cpu(src.m_incoming_cpu)
+      , m_local_path(src.m_local_path)
+      , m_single_threaded_io(src.m_single_threaded_io)
+      , m_connect_attempt_delay(src.m_connect_attempt_delay)
+      , m_dns_cache_ttl(src.m_dns_cache_ttl)
+      , m_dns_cache_negative_ttl(src.m_dns_cache_negative_ttl)
+      , m_dns_cache(src.m_dns_cache)
+      , m_socket_options(src.m_socket_options)
       , m_elog(src.m_elog)
       , m_alog(src.m_alog)
+      , m_loop_lag_interval(0)
       , m_state(src.m_state)
     {
         src.m_io_context = NULL;
@@ -154,6 +190,8 @@ public:
             m_acceptor = rhs.m_acceptor;
             m_listen_backlog = rhs.m_listen_backlog;
             m_reuse_addr = rhs.m_reuse_addr;
+            m_reuse_port = rhs.m_reuse_port;
+            m_single_threaded_io = rhs.m_single_threaded_io;
             m_state = rhs.m_state;
 
             rhs.m_io_context = NULL;
@@ -322,6 +360,25 @@ public:
         m_tcp_post_init_handler = h;
     }
 
+    /// Sets the resolve handler
+    /**
+     * The resolve handler replaces asio's resolver for outgoing connections.
+     * It is called with the host and port of each lookup and must call the
+     * callback it is given exactly once, with the resolved addresses or the
+     * error that prevented resolving them. The results are delivered through
+     * the io_context, so the callback may be called from within the handler.
+     *
+     * DNS timeouts and the DNS cache apply as usual. A lookup that times out
+     * is not cancelled, its results are ignored when they arrive.
+     *
+     * @since 0.9.0
+     *
+     * @param h The handler to resolve host names with
+     */
+    void set_resolve_handler(resolve_handler h) {
+        m_resolve_handler = h;
+    }
+
     /// Sets the maximum length of the queue of pending connections.
     /**
      * Sets the maximum length of the queue of pending connections. Increasing
@@ -368,6 +425,187 @@ public:
         m_reuse_addr = value;
     }
 
+    /// Sets whether to use the SO_REUSEPORT flag when opening listening sockets
+    /**
+     * Specifies whether or not to use the SO_REUSEPORT socket option. On Linux
+     * this allows several endpoints, typically one per core each running its
+     * own io_context on its own thread, to listen on the same address and
+     * port. The kernel then distributes incoming connections between their
+     * acceptors, so that accepting and serving a connection happens entirely
+     * on one thread without any cross-thread handoff.
+     *
+     * All sockets sharing a port must set this option and must be opened by
+     * the same effective user. On platforms without SO_REUSEPORT, listen fails
+     * with operation_not_supported while this option is set.
+     *
+     * New values affect future calls to listen only so set this value prior to
+     * calling listen.
+     *
+     * The default is false.
+     *
+     * @since 0.9.0
+     *
+     * @param value Whether or not to use the SO_REUSEPORT option
+     */
+    void set_reuse_port(bool value) {
+        m_reuse_port = value;
+    }
+
+    /// Sets the CPU whose connections the listening socket prefers
+    /**
+     * Sets SO_INCOMING_CPU on the listening socket. Among sockets sharing a
+     * port through set_reuse_port, Linux hands a new connection to the one
+     * whose CPU matches the CPU that received its packets, so with receive
+     * queues steered to the CPUs the io threads are pinned to, a connection
+     * is accepted and served on the core its packets arrive on.
+     *
+     * On platforms without SO_INCOMING_CPU, listen fails with
+     * operation_not_supported while this is set.
+     *
+     * New values affect future calls to listen only. The default is -1,
+     * which leaves the option unset.
+     *
+     * @since 0.9.0
+     *
+     * @param cpu The CPU number, or -1 for none
+     */
+    void set_incoming_cpu(int cpu) {
+        m_incoming_cpu = cpu;
+    }
+
+    /// Declare that the io_context is run by exactly one thread
+    /**
+     * With multithreading enabled each connection normally allocates a strand
+     * and binds every read, write, and timer handler to it. When only one
+     * thread runs the io_context, as in a thread per core deployment, handlers
+     * are serialized already and setting this skips the strand entirely.
+     *
+     * Calling run on the io_context from more than one thread while this is
+     * set is not safe.
+     *
+     * New values affect future connections only so set this value prior to
+     * creating connections.
+     *
+     * The default is false.
+     *
+     * @since 0.9.0
+     *
+     * @param value Whether or not the io_context is single threaded
+     */
+    void set_single_threaded_io(bool value) {
+        m_single_threaded_io = value;
+    }
+
+    /// Set the delay between racing connection attempts
+    /**
+     * Outgoing connections follow Happy Eyeballs (RFC 8305). The resolved
+     * addresses are interleaved by family, starting with the most preferred
+     * one. A new attempt starts whenever the previous one hasn't completed
+     * within this delay, or as soon as it fails. The first attempt to
+     * succeed wins and the others are closed. The whole race is bounded by
+     * timeout_connect.
+     *
+     * A value of 0 or less tries the addresses strictly one after the other.
+     * See socket_options::fast_open_connect for how it affects the race.
+     *
+     * New values affect future connections only.
+     *
+     * The default is 250, the delay recommended by RFC 8305.
+     *
+     * @since 0.9.0
+     *
+     * @param delay The delay in milliseconds
+     */
+    void set_connect_attempt_delay(long delay) {
+        m_connect_attempt_delay = delay;
+    }
+
+    /// Set the options applied to the acceptor and every new socket
+    /**
+     * Buffer sizes are set on the acceptor when listening and, for outgoing
+     * connections, before connecting. All options are applied to each
+     * socket once it is connected, before the tcp pre init handler runs, so
+     * that handler may still override them.
+     *
+     * socket_options::low_latency and socket_options::high_throughput
+     * provide presets. With notsent_lowat set, unsent data waits in the
+     * connection's send queue rather than in the kernel, which makes
+     * set_send_watermarks track the real backlog.
+     *
+     * New values affect future connections and listens only.
+     *
+     * @since 0.9.0
+     *
+     * @param options The socket options to apply
+     */
+    void set_socket_options(socket_options const & options) {
+        m_socket_options = options;
+    }
+
+    /// Get the options applied to new sockets
+    /**
+     * @since 0.9.0
+     *
+     * @return The socket options applied to new sockets
+     */
+    socket_options const & get_socket_options() const {
+        return m_socket_options;
+    }
+
+    /// Set how long resolved addresses are cached
+    /**
+     * With a positive ttl the results of resolving a host and port are
+     * shared by all connections of this endpoint for that long. Concurrent
+     * connects to a name that isn't cached yet wait on a single lookup. A
+     * name that is used after three quarters of its ttl is resolved again
+     * in the background, connections keep using the cached addresses
+     * meanwhile.
+     *
+     * The system resolver doesn't report record TTLs, so one ttl applies to
+     * every name.
+     *
+     * The default is 0, every connect resolves its host.
+     *
+     * @since 0.9.0
+     *
+     * @param ttl The time to keep resolved addresses in milliseconds
+     */
+    void set_dns_cache_ttl(long ttl) {
+        m_dns_cache_ttl = ttl;
+    }
+
+    /// Set how long failed lookups are cached
+    /**
+     * Connects to a name whose lookup failed fail with the same error for
+     * this long without resolving it again. A value of 0 or less doesn't
+     * cache failures. Failures never replace addresses that are still valid,
+     * those keep being used until they expire.
+     *
+     * Only used when set_dns_cache_ttl enabled the cache. The default is
+     * 1000.
+     *
+     * @since 0.9.0
+     *
+     * @param ttl The time to keep lookup failures in milliseconds
+     */
+    void set_dns_cache_negative_ttl(long ttl) {
+        m_dns_cache_negative_ttl = ttl;
+    }
+
+    /// Get the number of host names in the DNS cache
+    /**
+     * Counts the names that are cached or being resolved. Entries are
+     * dropped some time after they expire, when a later lookup completes.
+     *
+     * @since 0.9.0
+     *
+     * @return The number of entries in the DNS cache
+     */
+    size_t get_dns_cache_size() const {
+        lib::lock_guard<lib::mutex> guard(m_dns_cache->lock);
+        return m_dns_cache->entries.size();
+    }
+
     /// Retrieve a reference to the endpoint's io_context
     /**
      * The io_context may be an internal or external one. This may be used to
@@ -432,6 +670,37 @@ public:
         
         m_acceptor->set_option(lib::asio::socket_base::reuse_address(m_reuse_addr),bec);
         if (bec) {ec = clean_up_listen_after_error(bec);return;}
+
+        if (m_reuse_port) {
+#ifdef SO_REUSEPORT
+            typedef lib::asio::detail::socket_option::boolean<SOL_SOCKET,
+                SO_REUSEPORT> reuse_port;
+            m_acceptor->set_option(reuse_port(true),bec);
+#else
+            bec = lib::asio::error::make_error_code(
+                lib::asio::error::operation_not_supported);
+#endif
+            if (bec) {ec = clean_up_listen_after_error(bec);return;}
+        }
+
+        if (m_incoming_cpu >= 0) {
+#ifdef SO_INCOMING_CPU
+            typedef lib::asio::detail::socket_option::integer<SOL_SOCKET,
+                SO_INCOMING_CPU> incoming_cpu;
+            m_acceptor->set_option(incoming_cpu(m_incoming_cpu),bec);
+#else
+            bec = lib::asio::error::make_error_code(
+                lib::asio::error::operation_not_supported);
+#endif
+            if (bec) {ec = clean_up_listen_after_error(bec);return;}
+        }
+
+        // accepted sockets inherit the buffer sizes
+        bec = apply_buffer_options(*m_acceptor, m_socket_options);
+        if (bec) {ec = clean_up_listen_after_error(bec);return;}
+
+        bec = apply_fast_open(*m_acceptor, m_socket_options);
+        if (bec) {ec = clean_up_listen_after_error(bec);return;}
         
         // if a TCP pre-bind handler is present, run it
         if (m_tcp_pre_bind_handler) {
@@ -557,7 +826,184 @@ public:
 
         m_acceptor->close();
         m_state = READY;
+
+        if (!m_local_path.empty()) {
+            std::error_code fec;
+            std::filesystem::remove(m_local_path, fec);
+            m_local_path.clear();
+        }
+        ec = lib::error_code();
+    }
+
+    /// Listen on a unix domain socket (exception free)
+    /**
+     * Binds a unix domain stream socket to path, for peers on the same host
+     * such as a local proxy, so their traffic skips the TCP/IP stack. A
+     * socket file left at path, for example by a process that crashed, is
+     * removed first. stop_listening removes the file.
+     *
+     * The listen backlog and the buffer sizes of the socket options apply.
+     * set_reuse_addr, set_reuse_port, set_incoming_cpu and the tcp pre-bind
+     * handler do not. Accepted connections report "unix:" and the path as
+     * their remote endpoint, see connection::get_local_path. Clients connect
+     * with connection::set_local_path.
+     *
+     * Needs an Asio with local socket support, see
+     * _WEBSOCKETPP_ASIO_LOCAL_SOCKETS_; otherwise ec is set to
+     * operation_not_supported.
+     *
+     * The endpoint must have been initialized by calling init_asio before
+     * listening.
+     *
+     * @since 0.9.0
+     *
+     * @param path The file system path of the socket
+     * @param ec Set to indicate what error occurred, if any.
+     */
+    void listen_local(std::string const & path, lib::error_code & ec) {
+        if (m_state != READY) {
+            m_elog->write(log::elevel::library,
+                "asio::listen_local called from the wrong state");
+            using websocketpp::error::make_error_code;
+            ec = make_error_code(websocketpp::error::invalid_state);
+            return;
+        }
+
+        m_alog->write(log::alevel::devel,"asio::listen_local");
+
+        lib::asio::error_code bec;
+#ifdef _WEBSOCKETPP_ASIO_LOCAL_SOCKETS_
+        typedef lib::asio::local::stream_protocol local;
+
+        std::error_code fec;
+        if (std::filesystem::is_socket(path, fec)) {
+            std::filesystem::remove(path, fec);
+        }
+
+        local::acceptor acceptor(*m_io_context);
+        if (path.empty() || path.size() >= local::endpoint().capacity()) {
+            bec = lib::asio::error::make_error_code(
+                lib::asio::error::name_too_long);
+        } else {
+            local::endpoint ep(path);
+            acceptor.open(ep.protocol(),bec);
+            if (!bec) {
+                bec = apply_buffer_options(acceptor, m_socket_options);
+            }
+            if (!bec) {
+                acceptor.bind(ep,bec);
+            }
+            if (!bec) {
+                acceptor.listen(m_listen_backlog,bec);
+            }
+        }
+
+        // The tcp acceptor takes over the socket, accepting works the same
+        // for any stream socket.
+        if (!bec) {
+            native_handle_type fd = acceptor.release(bec);
+            if (!bec) {
+                m_acceptor->assign(lib::asio::ip::tcp::v4(),fd,bec);
+                if (bec) {
+                    // hand it back to be closed
+                    lib::asio::error_code ignored;
+                    acceptor.assign(local(),fd,ignored);
+                }
+            }
+        }
+        if (bec) {
+            ec = clean_up_listen_after_error(bec);
+            return;
+        }
+
+        m_local_path = path;
+        m_state = LISTENING;
+        ec = lib::error_code();
+#else
+        (void)path;
+        bec = lib::asio::error::make_error_code(
+            lib::asio::error::operation_not_supported);
+        ec = clean_up_listen_after_error(bec);
+#endif
+    }
+
+    /// Listen on a socket that is listening already (exception free)
+    /**
+     * Takes over a socket that is bound and listening, typically one handed
+     * over by the process this one replaces, see release_listener. The
+     * socket keeps the options it was created with; set_reuse_addr, the
+     * buffer options and the tcp pre-bind handler are not applied. Once
+     * accepting, the endpoint owns the socket and closes it on
+     * stop_listening.
+     *
+     * The endpoint must have been initialized by calling init_asio before
+     * listening.
+     *
+     * @since 0.9.0
+     *
+     * @param protocol The protocol of the socket, lib::asio::ip::tcp::v4() or
+     * lib::asio::ip::tcp::v6()
+     * @param fd The listening socket
+     * @param ec Set to indicate what error occurred, if any. The caller keeps
+     * the socket on error.
+     */
+    void listen_native(lib::asio::ip::tcp const & protocol,
+        native_handle_type fd, lib::error_code & ec)
+    {
+        if (m_state != READY) {
+            m_elog->write(log::elevel::library,
+                "asio::listen_native called from the wrong state");
+            using websocketpp::error::make_error_code;
+            ec = make_error_code(websocketpp::error::invalid_state);
+            return;
+        }
+
+        m_alog->write(log::alevel::devel,"asio::listen_native");
+
+        lib::asio::error_code bec;
+        m_acceptor->assign(protocol,fd,bec);
+        if (bec) {ec = clean_up_listen_after_error(bec);return;}
+
+        m_state = LISTENING;
+        ec = lib::error_code();
+    }
+
+    /// Stop listening and hand over the listening socket (exception free)
+    /**
+     * Like stop_listening, except that the socket is not closed. It stays
+     * bound and listening and belongs to the caller, who passes it to the
+     * process taking over, by fork and exec or over a unix domain socket
+     * with SCM_RIGHTS, where listen_native adopts it. Connections that
+     * arrive in between wait in the listen backlog rather than being
+     * refused. Existing connections are not affected, see endpoint::drain.
+     *
+     * @since 0.9.0
+     *
+     * @param ec Set to indicate what error occurred, if any.
+     * @return The listening socket, or -1 on error
+     */
+    native_handle_type release_listener(lib::error_code & ec) {
+        if (m_state != LISTENING) {
+            m_elog->write(log::elevel::library,
+                "asio::release_listener called from the wrong state");
+            using websocketpp::error::make_error_code;
+            ec = make_error_code(websocketpp::error::invalid_state);
+            return static_cast<native_handle_type>(-1);
+        }
+
+        lib::asio::error_code bec;
+        native_handle_type fd = m_acceptor->release(bec);
+        if (bec) {
+            log_err(log::elevel::info,"asio release_listener",bec);
+            ec = socket_con_type::translate_ec(bec);
+            return static_cast<native_handle_type>(-1);
+        }
+
+        // the new owner keeps the socket file
+        m_local_path.clear();
+        m_state = READY;
         ec = lib::error_code();
+        return fd;
     }
 
 #ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
@@ -575,6 +1021,18 @@ public:
         if (ec) { throw exception(ec); }
     }
 
+    /// Listen on a unix domain socket
+    /**
+     * @see listen_local(std::string const &, lib::error_code &)
+     *
+     * @since 0.9.0
+     */
+    void listen_local(std::string const & path) {
+        lib::error_code ec;
+        listen_local(path,ec);
+        if (ec) { throw exception(ec); }
+    }
+
     /// Set up endpoint for listening with protocol and port
     /**
      * Bind the internal acceptor using the given internet protocol and port.
@@ -653,6 +1111,32 @@ public:
         stop_listening(ec);
         if (ec) { throw exception(ec); }
     }
+
+    /// Listen on a socket that is listening already
+    /**
+     * @since 0.9.0
+     * @see listen_native(lib::asio::ip::tcp const &, native_handle_type,
+     * lib::error_code &)
+     */
+    void listen_native(lib::asio::ip::tcp const & protocol,
+        native_handle_type fd)
+    {
+        lib::error_code ec;
+        listen_native(protocol,fd,ec);
+        if (ec) { throw exception(ec); }
+    }
+
+    /// Stop listening and hand over the listening socket
+    /**
+     * @since 0.9.0
+     * @see release_listener(lib::error_code &)
+     */
+    native_handle_type release_listener() {
+        lib::error_code ec;
+        native_handle_type fd = release_listener(ec);
+        if (ec) { throw exception(ec); }
+        return fd;
+    }
 #endif // _WEBSOCKETPP_NO_EXCEPTIONS_
 
     /// Check if the endpoint is listening
@@ -676,6 +1160,43 @@ public:
         return m_io_context->run_one();
     }
 
+    /// Run the io_context, spinning before each wait for new events
+    /**
+     * Like run, but while no handler is ready the thread keeps polling the
+     * io_context for up to `spin` since the last handler ran, and only then
+     * blocks in run_one until the next one. This trades a busy core for not
+     * paying the wakeup latency of sleeping in epoll when events arrive
+     * within `spin` of each other. Combine with socket_options::busy_poll
+     * to also spin in the kernel on the device queue.
+     *
+     * Returns when the io_context is stopped or runs out of work, like run.
+     *
+     * @since 0.9.0
+     *
+     * @param spin How long to keep polling once no handler is ready
+     * @return The number of handlers that were run
+     */
+    std::size_t run_busy(lib::chrono::microseconds spin) {
+        typedef lib::chrono::steady_clock clock;
+
+        std::size_t count = 0;
+        clock::time_point idle_since = clock::now();
+        while (!m_io_context->stopped()) {
+            std::size_t n = m_io_context->poll();
+            if (n == 0 && clock::now() - idle_since >= spin) {
+                n = m_io_context->run_one();
+                if (n == 0) {
+                    break;
+                }
+            }
+            if (n > 0) {
+                count += n;
+                idle_since = clock::now();
+            }
+        }
+        return count;
+    }
+
     /// wraps the stop method of the internal io_context object
     void stop() {
         m_io_context->stop();
@@ -786,6 +1307,130 @@ public:
         }
     }
 
+    /// Drive a timer wheel from this endpoint's io_context
+    /**
+     * Advances the wheel once per tick while it has timers armed. Once the
+     * wheel is idle no timer is left pending, so the wheel does not keep
+     * run() from returning. Must be called after init_asio.
+     *
+     * @since 0.9.0
+     *
+     * @param wheel The wheel to drive
+     */
+    void drive_timer_wheel(lib::shared_ptr<timer_wheel> wheel) {
+        wheel->set_start_handler(lib::bind(
+            &type::schedule_timer_wheel_tick,
+            this,
+            lib::weak_ptr<timer_wheel>(wheel)
+        ));
+    }
+
+    /// Arm the timer for the next tick of a timer wheel
+    void schedule_timer_wheel_tick(lib::weak_ptr<timer_wheel> w) {
+        lib::shared_ptr<timer_wheel> wheel = w.lock();
+        if (!wheel) {
+            return;
+        }
+
+        set_timer(wheel->get_tick(), lib::bind(
+            &type::handle_timer_wheel_tick,
+            this,
+            w,
+            lib::placeholders::_1
+        ));
+    }
+
+    /// Advance a timer wheel by the time passed and wait for the next tick
+    void handle_timer_wheel_tick(lib::weak_ptr<timer_wheel> w,
+        lib::error_code const & ec)
+    {
+        lib::shared_ptr<timer_wheel> wheel = w.lock();
+        if (!wheel) {
+            return;
+        }
+
+        if (ec == transport::error::operation_aborted) {
+            // the io_context is shutting down
+            return;
+        } else if (ec) {
+            m_elog->write(log::elevel::info,
+                "timer wheel tick error: "+ec.message());
+        }
+
+        if (wheel->advance()) {
+            schedule_timer_wheel_tick(w);
+        }
+    }
+
+    /// Measure how long handlers posted to the io_context wait to run
+    /**
+     * Every interval milliseconds a handler stamped with the current time is
+     * posted to the io_context. When it runs, handler is called with the
+     * time it waited, which grows when the threads running the io_context
+     * are kept busy. The probe keeps the io_context from running out of
+     * work until stop_loop_lag_probe is called. Must be called after
+     * init_asio, and from the thread running the io_context once it runs.
+     *
+     * @since 0.9.0
+     *
+     * @param interval Milliseconds between probes
+     * @param handler Called with the lag measured by each probe
+     */
+    void start_loop_lag_probe(long interval, loop_lag_handler handler) {
+        bool running = m_loop_lag_interval > 0;
+        m_loop_lag_interval = interval;
+        m_loop_lag_handler = handler;
+        if (!running) {
+            schedule_loop_lag_probe();
+        }
+    }
+
+    /// Stop the loop lag probe started by start_loop_lag_probe
+    void stop_loop_lag_probe() {
+        m_loop_lag_interval = 0;
+        if (m_loop_lag_timer) {
+            m_loop_lag_timer->cancel();
+            m_loop_lag_timer.reset();
+        }
+    }
+
+    /// Arm the timer for the next loop lag probe
+    void schedule_loop_lag_probe() {
+        m_loop_lag_timer = set_timer(m_loop_lag_interval, lib::bind(
+            &type::handle_loop_lag_timer,
+            this,
+            lib::placeholders::_1
+        ));
+    }
+
+    /// Post a probe stamped with the current time
+    void handle_loop_lag_timer(lib::error_code const & ec) {
+        if (ec || m_loop_lag_interval <= 0) {
+            return;
+        }
+
+        lib::asio::post(*m_io_context, lib::bind(
+            &type::handle_loop_lag_probe,
+            this,
+            lib::chrono::steady_clock::now()
+        ));
+    }
+
+    /// Report the time a probe waited to run and wait for the next one
+    void handle_loop_lag_probe(lib::chrono::steady_clock::time_point posted) {
+        if (m_loop_lag_interval <= 0) {
+            return;
+        }
+
+        if (m_loop_lag_handler) {
+            m_loop_lag_handler(lib::chrono::duration_cast<
+                lib::chrono::microseconds>(lib::chrono::steady_clock::now() -
+                posted));
+        }
+
+        schedule_loop_lag_probe();
+    }
+
     /// Accept the next connection attempt and assign it to con (exception free)
     /**
      * @param tcon The connection to accept into.
@@ -803,10 +1448,12 @@ public:
 
         m_alog->write(log::alevel::devel, "asio::async_accept");
 
-        if (config::enable_multithreading) {
+        tcon->m_local_path = m_local_path;
+
+        if (tcon->strand_enabled()) {
             m_acceptor->async_accept(
                 tcon->get_raw_socket(),
-                tcon->get_strand()->wrap(lib::bind(
+                tcon->bind_strand(lib::bind(
                     &type::handle_accept,
                     this,
                     callback,
@@ -838,6 +1485,51 @@ public:
         if (ec) { throw exception(ec); }
     }
 #endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+private:
+    /// Connection attempts racing to connect one connection
+    struct connect_race {
+        connect_race() : next(0), pending(0), done(false) {}
+
+        std::vector<lib::asio::ip::tcp::endpoint> candidates;
+        // index of the next candidate to try
+        size_t next;
+        std::vector<lib::shared_ptr<lib::asio::ip::tcp::socket> > attempts;
+        // attempts that haven't completed yet
+        size_t pending;
+        timer_ptr con_timer;
+        timer_ptr stagger_timer;
+        bool done;
+    };
+    typedef lib::shared_ptr<connect_race> race_ptr;
+
+    /// A connection waiting for a DNS cache lookup
+    struct dns_waiter {
+        transport_con_ptr tcon;
+        timer_ptr dns_timer;
+        connect_handler callback;
+    };
+
+    /// Cached result of resolving one host and port
+    struct dns_entry {
+        dns_entry() : cached(false), resolving(false) {}
+
+        lib::asio::ip::tcp::resolver::iterator results;
+        lib::asio::error_code ec;
+        lib::chrono::steady_clock::time_point refresh_at;
+        lib::chrono::steady_clock::time_point expires;
+        // whether results or ec hold a usable answer
+        bool cached;
+        bool resolving;
+        std::vector<dns_waiter> waiters;
+    };
+    typedef std::map<std::string,dns_entry> dns_entry_map;
+
+    /// DNS cache shared by the connections of an endpoint
+    struct dns_cache {
+        lib::mutex lock;
+        dns_entry_map entries;
+    };
+
 protected:
     /// Initialize logging
     /**
@@ -884,6 +1576,12 @@ protected:
         }
 
         tcon->set_uri(u);
+        tcon->m_connect_timing.start = lib::chrono::steady_clock::now();
+
+        if (!tcon->get_local_path().empty()) {
+            this->connect_local(tcon, cb);
+            return;
+        }
 
         std::string proxy = tcon->get_proxy();
         std::string host;
@@ -912,6 +1610,11 @@ protected:
             port = pu->get_port_str();
         }
 
+        if (m_dns_cache_ttl > 0) {
+            this->cached_resolve(tcon, host, port, cb);
+            return;
+        }
+
         if (m_alog->static_test(log::alevel::devel)) {
             m_alog->write(log::alevel::devel,
                 "starting async DNS resolve for "+host+":"+port);
@@ -922,15 +1625,16 @@ protected:
             lib::bind(
                 &type::handle_resolve_timeout,
                 this,
+                true,
                 cb,
                 lib::placeholders::_1
             )
         );
 
-        if (config::enable_multithreading) {
-            m_resolver->async_resolve(
+        if (tcon->strand_enabled()) {
+            this->async_resolve(
                 host, port,
-                tcon->get_strand()->wrap(lib::bind(
+                tcon->bind_strand(lib::bind(
                     &type::handle_resolve,
                     this,
                     tcon,
@@ -941,7 +1645,7 @@ protected:
                 ))
             );
         } else {
-            m_resolver->async_resolve(
+            this->async_resolve(
                 host, port,
                 lib::bind(
                     &type::handle_resolve,
@@ -956,16 +1660,295 @@ protected:
         }
     }
 
+    /// Connect a connection to its unix domain socket path
+    /**
+     * Connecting to a local socket completes or fails at once, there is no
+     * resolve step and no connect timeout.
+     */
+    void connect_local(transport_con_ptr tcon, connect_handler callback) {
+#ifdef _WEBSOCKETPP_ASIO_LOCAL_SOCKETS_
+        typedef lib::asio::local::stream_protocol local;
+
+        std::string const & path = tcon->get_local_path();
+        if (path.size() >= local::endpoint().capacity()) {
+            callback(socket_con_type::translate_ec(
+                lib::asio::error::make_error_code(
+                lib::asio::error::name_too_long)));
+            return;
+        }
+
+        lib::shared_ptr<local::socket> attempt =
+            lib::make_shared<local::socket>(*m_io_context);
+
+        lib::asio::error_code oec;
+        attempt->open(local::endpoint().protocol(), oec);
+        if (!oec) {
+            oec = apply_buffer_options(*attempt, m_socket_options);
+        }
+        if (oec) {
+            log_err(log::elevel::info,"asio apply_buffer_options",oec);
+        }
+
+        if (m_alog->static_test(log::alevel::devel)) {
+            m_alog->write(log::alevel::devel,"Connecting to unix:"+path);
+        }
+
+        if (tcon->strand_enabled()) {
+            attempt->async_connect(local::endpoint(path), tcon->bind_strand(
+                lib::bind(
+                    &type::handle_connect_local<local::socket>,
+                    this,
+                    tcon,
+                    attempt,
+                    callback,
+                    lib::placeholders::_1
+                )));
+        } else {
+            attempt->async_connect(local::endpoint(path), lib::bind(
+                &type::handle_connect_local<local::socket>,
+                this,
+                tcon,
+                attempt,
+                callback,
+                lib::placeholders::_1
+            ));
+        }
+#else
+        (void)tcon;
+        callback(socket_con_type::translate_ec(
+            lib::asio::error::make_error_code(
+            lib::asio::error::operation_not_supported)));
+#endif
+    }
+
+    template <typename local_socket>
+    void handle_connect_local(transport_con_ptr tcon,
+        lib::shared_ptr<local_socket> attempt, connect_handler callback,
+        lib::asio::error_code const & ec)
+    {
+        lib::asio::error_code aec = ec;
+
+        // the connection's tcp socket takes over, reads and writes work the
+        // same for any stream socket
+        if (!aec) {
+            typename local_socket::native_handle_type fd =
+                attempt->release(aec);
+            if (!aec) {
+                tcon->get_raw_socket().assign(lib::asio::ip::tcp::v4(), fd,
+                    aec);
+                if (aec) {
+                    // hand it back to be closed
+                    lib::asio::error_code ignored;
+                    attempt->assign(typename local_socket::protocol_type(),
+                        fd, ignored);
+                }
+            }
+        }
+
+        if (aec) {
+            log_err(log::elevel::info,"asio async_connect",aec);
+            callback(socket_con_type::translate_ec(aec));
+            return;
+        }
+
+        if (m_alog->static_test(log::alevel::devel)) {
+            m_alog->write(log::alevel::devel,
+                "Async connect to unix:"+tcon->get_local_path()+" successful.");
+        }
+        callback(lib::error_code());
+    }
+
+    /// Resolve a host through the endpoint's DNS cache
+    void cached_resolve(transport_con_ptr tcon, std::string const & host,
+        std::string const & port, connect_handler callback)
+    {
+        std::string const key = host + ":" + port;
+        lib::chrono::steady_clock::time_point const now =
+            lib::chrono::steady_clock::now();
+
+        lib::asio::ip::tcp::resolver::iterator results;
+        lib::asio::error_code ec;
+        {
+            lib::lock_guard<lib::mutex> guard(m_dns_cache->lock);
+            dns_entry & entry = m_dns_cache->entries[key];
+
+            if (!entry.cached || now >= entry.expires) {
+                // wait for the lookup in flight, or start one
+                dns_waiter waiter;
+                waiter.tcon = tcon;
+                waiter.callback = callback;
+                waiter.dns_timer = tcon->set_timer(
+                    config::timeout_dns_resolve,
+                    lib::bind(
+                        &type::handle_resolve_timeout,
+                        this,
+                        false,
+                        callback,
+                        lib::placeholders::_1
+                    )
+                );
+                entry.waiters.push_back(waiter);
+
+                if (!entry.resolving) {
+                    if (m_alog->static_test(log::alevel::devel)) {
+                        m_alog->write(log::alevel::devel,
+                            "starting async DNS resolve for "+key);
+                    }
+                    this->start_lookup(entry, host, port, key);
+                }
+                return;
+            }
+
+            if (!entry.ec && !entry.resolving && now >= entry.refresh_at) {
+                if (m_alog->static_test(log::alevel::devel)) {
+                    m_alog->write(log::alevel::devel,
+                        "refreshing cached DNS results for "+key);
+                }
+                this->start_lookup(entry, host, port, key);
+            }
+
+            results = entry.results;
+            ec = entry.ec;
+        }
+
+        if (m_alog->static_test(log::alevel::devel)) {
+            m_alog->write(log::alevel::devel,"DNS cache hit for "+key);
+        }
+
+        tcon->dispatch(lib::bind(
+            &type::handle_resolved,
+            this,
+            tcon,
+            callback,
+            ec,
+            results
+        ));
+    }
+
+    /// Start resolving a cache entry, the cache lock must be held
+    void start_lookup(dns_entry & entry, std::string const & host,
+        std::string const & port, std::string const & key)
+    {
+        entry.resolving = true;
+
+        this->async_resolve(
+            host, port,
+            lib::bind(
+                &type::handle_lookup,
+                this,
+                key,
+                lib::placeholders::_1,
+                lib::placeholders::_2
+            )
+        );
+    }
+
+    /// Resolve a host with the resolve handler if one is set, or asio
+    template <typename handler>
+    void async_resolve(std::string const & host, std::string const & port,
+        handler h)
+    {
+        if (!m_resolve_handler) {
+            m_resolver->async_resolve(host, port, h);
+            return;
+        }
+
+        m_resolve_handler(host, port, lib::bind(
+            &type::post_resolved,
+            this,
+            resolve_callback(h),
+            lib::placeholders::_1,
+            lib::placeholders::_2
+        ));
+    }
+
+    /// Deliver the results of a resolve handler through the io_context
+    /**
+     * Like asio's resolver this never calls the handler from within the
+     * lookup, which start_lookup relies on as it holds the cache lock.
+     */
+    void post_resolved(resolve_callback h, lib::asio::error_code const & ec,
+        lib::asio::ip::tcp::resolver::iterator iterator)
+    {
+        lib::asio::post(*m_io_context, lib::bind(h, ec, iterator));
+    }
+
+    /// Store the result of a cache lookup and pass it to the waiters
+    void handle_lookup(std::string const & key,
+        lib::asio::error_code const & ec,
+        lib::asio::ip::tcp::resolver::iterator iterator)
+    {
+        lib::chrono::steady_clock::time_point const now =
+            lib::chrono::steady_clock::now();
+
+        std::vector<dns_waiter> waiters;
+        {
+            lib::lock_guard<lib::mutex> guard(m_dns_cache->lock);
+
+            typename dns_entry_map::iterator it =
+                m_dns_cache->entries.find(key);
+            if (it == m_dns_cache->entries.end()) {
+                return;
+            }
+
+            dns_entry & entry = it->second;
+            entry.resolving = false;
+            waiters.swap(entry.waiters);
+
+            if (!ec) {
+                entry.results = iterator;
+                entry.ec = lib::asio::error_code();
+                entry.cached = true;
+                entry.expires = now + lib::chrono::milliseconds(
+                    m_dns_cache_ttl);
+                entry.refresh_at = now + lib::chrono::milliseconds(
+                    m_dns_cache_ttl - m_dns_cache_ttl / 4);
+            } else if (ec != lib::asio::error::operation_aborted &&
+                (!entry.cached || now >= entry.expires))
+            {
+                entry.results = lib::asio::ip::tcp::resolver::iterator();
+                entry.ec = ec;
+                entry.cached = m_dns_cache_negative_ttl > 0;
+                entry.expires = now + lib::chrono::milliseconds(
+                    m_dns_cache_negative_ttl);
+                entry.refresh_at = entry.expires;
+            }
+
+            // drop the expired entries nobody is waiting on
+            for (it = m_dns_cache->entries.begin();
+                it != m_dns_cache->entries.end();)
+            {
+                if (!it->second.resolving && it->second.waiters.empty() &&
+                    (!it->second.cached || now >= it->second.expires))
+                {
+                    m_dns_cache->entries.erase(it++);
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        for (size_t i = 0; i < waiters.size(); ++i) {
+            waiters[i].tcon->dispatch(lib::bind(
+                &type::handle_resolve,
+                this,
+                waiters[i].tcon,
+                waiters[i].dns_timer,
+                waiters[i].callback,
+                ec,
+                iterator
+            ));
+        }
+    }
+
     /// DNS resolution timeout handler
     /**
-     * The timer pointer is included to ensure the timer isn't destroyed until
-     * after it has expired.
-     *
-     * @param dns_timer Pointer to the timer in question
+     * @param cancel Whether to cancel the lookup. Cached lookups are shared
+     * and keep running for the other connections.
      * @param callback The function to call back
      * @param ec A status code indicating an error, if any.
      */
-    void handle_resolve_timeout(connect_handler callback,
+    void handle_resolve_timeout(bool cancel, connect_handler callback,
         lib::error_code const & ec)
     {
         lib::error_code ret_ec;
@@ -984,7 +1967,9 @@ protected:
         }
 
         m_alog->write(log::alevel::devel,"DNS resolution timed out");
-        m_resolver->cancel();
+        if (cancel) {
+            m_resolver->cancel();
+        }
         callback(ret_ec);
     }
 
@@ -1001,6 +1986,16 @@ protected:
 
         dns_timer->cancel();
 
+        this->handle_resolved(tcon, callback, ec, iterator);
+    }
+
+    /// Connect to the results of a completed resolve
+    void handle_resolved(transport_con_ptr tcon, connect_handler callback,
+        lib::asio::error_code const & ec,
+        lib::asio::ip::tcp::resolver::iterator iterator)
+    {
+        tcon->m_connect_timing.resolved = lib::chrono::steady_clock::now();
+
         if (ec) {
             log_err(log::elevel::info,"asio async_resolve",ec);
             callback(socket_con_type::translate_ec(ec));
@@ -1021,6 +2016,13 @@ protected:
 
         m_alog->write(log::alevel::devel,"Starting async connect");
 
+        // fast open is set up between opening and connecting the socket,
+        // which only the race does
+        if (m_connect_attempt_delay > 0 || m_socket_options.fast_open_connect) {
+            this->start_connect_race(tcon, iterator, callback);
+            return;
+        }
+
         timer_ptr con_timer;
 
         con_timer = tcon->set_timer(
@@ -1035,11 +2037,11 @@ protected:
             )
         );
 
-        if (config::enable_multithreading) {
+        if (tcon->strand_enabled()) {
             lib::asio::async_connect(
                 tcon->get_raw_socket(),
                 iterator,
-                tcon->get_strand()->wrap(lib::bind(
+                tcon->bind_strand(lib::bind(
                     &type::handle_connect,
                     this,
                     tcon,
@@ -1123,6 +2125,227 @@ protected:
         callback(lib::error_code());
     }
 
+    /// Start racing connection attempts to the resolved addresses
+    void start_connect_race(transport_con_ptr tcon,
+        lib::asio::ip::tcp::resolver::iterator iterator,
+        connect_handler callback)
+    {
+        race_ptr race = lib::make_shared<connect_race>();
+
+        // alternate between address families, starting with the family of
+        // the most preferred address (RFC 8305 section 4)
+        std::vector<lib::asio::ip::tcp::endpoint> first;
+        std::vector<lib::asio::ip::tcp::endpoint> second;
+        lib::asio::ip::tcp::resolver::iterator end;
+        for (; iterator != end; ++iterator) {
+            lib::asio::ip::tcp::endpoint const ep = (*iterator).endpoint();
+            if (first.empty() || ep.protocol() == first.front().protocol()) {
+                first.push_back(ep);
+            } else {
+                second.push_back(ep);
+            }
+        }
+        for (size_t i = 0; i < first.size() || i < second.size(); ++i) {
+            if (i < first.size()) {
+                race->candidates.push_back(first[i]);
+            }
+            if (i < second.size()) {
+                race->candidates.push_back(second[i]);
+            }
+        }
+
+        if (race->candidates.empty()) {
+            callback(make_error_code(transport::error::resolve_failed));
+            return;
+        }
+
+        race->con_timer = tcon->set_timer(
+            config::timeout_connect,
+            lib::bind(
+                &type::handle_race_timeout,
+                this,
+                race,
+                callback,
+                lib::placeholders::_1
+            )
+        );
+
+        this->start_attempt(tcon, race, callback);
+    }
+
+    /// Start a connection attempt to the next candidate address
+    void start_attempt(transport_con_ptr tcon, race_ptr race,
+        connect_handler callback)
+    {
+        size_t const index = race->next++;
+        lib::asio::ip::tcp::endpoint const & ep = race->candidates[index];
+
+        lib::shared_ptr<lib::asio::ip::tcp::socket> attempt =
+            lib::make_shared<lib::asio::ip::tcp::socket>(*m_io_context);
+        race->attempts.push_back(attempt);
+        ++race->pending;
+
+        // buffer sizes set after connecting don't affect the window scale
+        lib::asio::error_code oec;
+        attempt->open(ep.protocol(), oec);
+        if (!oec) {
+            oec = apply_buffer_options(*attempt, m_socket_options);
+        }
+        if (oec) {
+            log_err(log::elevel::info,"asio apply_buffer_options",oec);
+        }
+        if (attempt->is_open()) {
+            oec = apply_fast_open_connect(*attempt, m_socket_options);
+            if (oec) {
+                log_err(log::elevel::info,"asio apply_fast_open_connect",oec);
+            }
+        }
+
+        if (m_alog->static_test(log::alevel::devel)) {
+            std::stringstream s;
+            s << "Connection attempt " << index + 1 << " to " << ep;
+            m_alog->write(log::alevel::devel,s.str());
+        }
+
+        if (tcon->strand_enabled()) {
+            attempt->async_connect(ep, tcon->bind_strand(lib::bind(
+                &type::handle_attempt,
+                this,
+                tcon,
+                race,
+                callback,
+                index,
+                lib::placeholders::_1
+            )));
+        } else {
+            attempt->async_connect(ep, lib::bind(
+                &type::handle_attempt,
+                this,
+                tcon,
+                race,
+                callback,
+                index,
+                lib::placeholders::_1
+            ));
+        }
+
+        if (race->stagger_timer) {
+            race->stagger_timer->cancel();
+            race->stagger_timer.reset();
+        }
+        if (race->next < race->candidates.size() &&
+            m_connect_attempt_delay > 0)
+        {
+            race->stagger_timer = tcon->set_timer(
+                m_connect_attempt_delay,
+                lib::bind(
+                    &type::handle_attempt_delay,
+                    this,
+                    tcon,
+                    race,
+                    callback,
+                    lib::placeholders::_1
+                )
+            );
+        }
+    }
+
+    /// The previous attempt is still pending after the attempt delay
+    void handle_attempt_delay(transport_con_ptr tcon, race_ptr race,
+        connect_handler callback, lib::error_code const & ec)
+    {
+        if (ec || race->done) {
+            return;
+        }
+        this->start_attempt(tcon, race, callback);
+    }
+
+    void handle_attempt(transport_con_ptr tcon, race_ptr race,
+        connect_handler callback, size_t index,
+        lib::asio::error_code const & ec)
+    {
+        if (race->done) {
+            // lost the race or timed out, the socket is closed already
+            return;
+        }
+
+        lib::asio::error_code cec;
+        if (!ec) {
+            this->end_race(race, index);
+            tcon->get_raw_socket() = std::move(*race->attempts[index]);
+
+            if (m_alog->static_test(log::alevel::devel)) {
+                m_alog->write(log::alevel::devel,
+                    "Async connect to "+tcon->get_remote_endpoint()+" successful.");
+            }
+
+            callback(lib::error_code());
+            return;
+        }
+
+        log_err(log::elevel::devel,"asio connection attempt",ec);
+        race->attempts[index]->close(cec);
+        --race->pending;
+
+        if (race->next < race->candidates.size()) {
+            // no need to wait out the delay after a failure
+            this->start_attempt(tcon, race, callback);
+            return;
+        }
+
+        if (race->pending == 0) {
+            this->end_race(race, race->attempts.size());
+            log_err(log::elevel::info,"asio async_connect",ec);
+            callback(socket_con_type::translate_ec(ec));
+        }
+    }
+
+    void handle_race_timeout(race_ptr race, connect_handler callback,
+        lib::error_code const & ec)
+    {
+        lib::error_code ret_ec;
+
+        if (ec) {
+            if (ec == transport::error::operation_aborted) {
+                m_alog->write(log::alevel::devel,
+                    "asio handle_race_timeout timer cancelled");
+                return;
+            }
+
+            log_err(log::elevel::devel,"asio handle_race_timeout",ec);
+            ret_ec = ec;
+        } else {
+            ret_ec = make_error_code(transport::error::timeout);
+        }
+
+        if (race->done) {
+            return;
+        }
+
+        m_alog->write(log::alevel::devel,"TCP connect timed out");
+        this->end_race(race, race->attempts.size());
+        callback(ret_ec);
+    }
+
+    /// Stop the timers and close every attempt other than the winner
+    void end_race(race_ptr race, size_t winner) {
+        race->done = true;
+
+        if (race->con_timer) {
+            race->con_timer->cancel();
+        }
+        if (race->stagger_timer) {
+            race->stagger_timer->cancel();
+        }
+
+        lib::asio::error_code cec;
+        for (size_t i = 0; i < race->attempts.size(); ++i) {
+            if (i != winner) {
+                race->attempts[i]->close(cec);
+            }
+        }
+    }
+
     /// Initialize a connection
     /**
      * init is called by an endpoint once for each newly created connection.
@@ -1143,11 +2366,13 @@ protected:
 
         lib::error_code ec;
 
+        tcon->set_single_threaded_io(m_single_threaded_io);
         ec = tcon->init_asio(m_io_context);
         if (ec) {return ec;}
 
         tcon->set_tcp_pre_init_handler(m_tcp_pre_init_handler);
         tcon->set_tcp_post_init_handler(m_tcp_post_init_handler);
+        tcon->set_socket_options(m_socket_options);
 
         return lib::error_code();
     }
@@ -1180,6 +2405,7 @@ private:
     tcp_pre_bind_handler    m_tcp_pre_bind_handler;
     tcp_init_handler    m_tcp_pre_init_handler;
     tcp_init_handler    m_tcp_post_init_handler;
+    resolve_handler     m_resolve_handler;
 
     // Network Resources
     io_context_ptr      m_io_context;
@@ -1191,10 +2417,25 @@ private:
     // Network constants
     int                 m_listen_backlog;
     bool                m_reuse_addr;
+    bool                m_reuse_port;
+    int                 m_incoming_cpu;
+    /// Path of the unix domain socket listened on, see listen_local
+    std::string         m_local_path;
+    bool                m_single_threaded_io;
+    long                m_connect_attempt_delay;
+    long                m_dns_cache_ttl;
+    long                m_dns_cache_negative_ttl;
+    lib::shared_ptr<dns_cache> m_dns_cache;
+    socket_options      m_socket_options;
 
     lib::shared_ptr<elog_type> m_elog;
     lib::shared_ptr<alog_type> m_alog;
 
+    // Loop lag probe
+    long                m_loop_lag_interval;
+    loop_lag_handler    m_loop_lag_handler;
+    timer_ptr           m_loop_lag_timer;
+
     // Transport state
     state               m_state;
 };
@@ -38,6 +38,7 @@
 
 #include <sstream>
 #include <string>
+#include <vector>
 
 namespace websocketpp {
 namespace transport {
@@ -89,6 +90,42 @@ public:
         return false;
     }
 
+    /// Plain sockets are always read and written through the socket itself
+    static constexpr bool supports_direct_io = false;
+
+    /// Plain sockets may be written without blocking during a write batch
+    static constexpr bool supports_inline_write = true;
+
+    /// Plain sockets have no TLS early data
+    static constexpr bool supports_early_data = false;
+
+    /// Plain sockets may move to another io_context, see
+    /// connection::migrate
+    static constexpr bool supports_migration = true;
+
+    /// Whether a client wants its first request sent as early data
+    /**
+     * @since 0.9.0
+     *
+     * @return Always false
+     */
+    bool wants_early_data() const {
+        return false;
+    }
+
+    /// Hand over the bytes to send as early data, unused by plain sockets
+    void set_early_data_payload(char const *, size_t) {}
+
+    /// Whether early data was accepted
+    /**
+     * @since 0.9.0
+     *
+     * @return Always false
+     */
+    bool is_early_data_accepted() const {
+        return false;
+    }
+
     /// Set the socket initialization handler
     /**
      * The socket initialization handler is called after the socket object is
@@ -193,6 +230,21 @@ protected:
      */
     void set_uri(uri_ptr) {}
 
+    /// Get the buffers to hand to the socket for a write
+    /**
+     * Plain sockets take scatter/gather buffers as they are.
+     *
+     * @since 0.9.0
+     *
+     * @param bufs The buffers of the write
+     * @return The buffers to write, valid until the write completes
+     */
+    std::vector<lib::asio::const_buffer> const & prepare_write(
+        std::vector<lib::asio::const_buffer> const & bufs)
+    {
+        return bufs;
+    }
+
     /// Pre-initialize security policy
     /**
      * Called by the transport after a new connection is accepted to initialize
@@ -255,6 +307,46 @@ protected:
         return ec;
     }
 
+    /// Move the socket to another io_context
+    /**
+     * Takes the native socket out of the socket object, which stays with the
+     * old io_context, and assigns it to a new one created on service. No
+     * operation may be outstanding on the socket. If the new socket can not
+     * take it, the native socket goes back to the old one.
+     *
+     * @since 0.9.0
+     *
+     * @param service The io_context to move to
+     * @return The error that occurred, if any
+     */
+    lib::asio::error_code move_socket(io_context_ptr service) {
+        lib::asio::error_code ec;
+#ifdef _WEBSOCKETPP_ASIO_EXECUTORS_
+        lib::asio::ip::tcp::endpoint local = m_socket->local_endpoint(ec);
+        if (ec) {
+            return ec;
+        }
+
+        socket_type::native_handle_type native = m_socket->release(ec);
+        if (ec) {
+            return ec;
+        }
+
+        socket_ptr moved(new socket_type(*service));
+        moved->assign(local.protocol(), native, ec);
+        if (ec) {
+            lib::asio::error_code ignored;
+            m_socket->assign(local.protocol(), native, ignored);
+            return ec;
+        }
+        m_socket = moved;
+#else
+        (void)service;
+        ec = lib::asio::error::operation_not_supported;
+#endif
+        return ec;
+    }
+
     void async_shutdown(socket::shutdown_handler h) {
         lib::asio::error_code ec;
         m_socket->shutdown(lib::asio::ip::tcp::socket::shutdown_both, ec);
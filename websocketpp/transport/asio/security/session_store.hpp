@@ -0,0 +1,485 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_TRANSPORT_SECURITY_SESSION_STORE_HPP
+#define WEBSOCKETPP_TRANSPORT_SECURITY_SESSION_STORE_HPP
+
+#include <websocketpp/common/asio_ssl.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/thread.hpp>
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    #include <openssl/core_names.h>
+    #define _WEBSOCKETPP_ASIO_TLS_TICKET_KEYS_
+#endif
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include <atomic>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace websocketpp {
+namespace transport {
+namespace asio {
+namespace tls_socket {
+
+/// Server side store of TLS sessions
+/**
+ * Replaces the session cache OpenSSL keeps inside each TLS context, so that
+ * connections accepted through different contexts, endpoints or processes
+ * can resume each others sessions. Sessions are passed around in their DER
+ * encoding. Implementations must be safe to call from any thread.
+ *
+ * See tls_socket::endpoint::set_session_store.
+ *
+ * @since 0.9.0
+ */
+class session_store {
+public:
+    typedef lib::shared_ptr<session_store> ptr;
+
+    virtual ~session_store() {}
+
+    /// Store a session
+    /**
+     * @param id The session id
+     * @param session The DER encoded session
+     * @param expires The time the session expires at
+     */
+    virtual void store(std::string const & id, std::string const & session,
+        std::time_t expires) = 0;
+
+    /// Look up a session
+    /**
+     * Expired sessions may be returned, OpenSSL rejects them.
+     *
+     * @param id The session id
+     * @param session Set to the DER encoded session, if found
+     * @return Whether the session was found
+     */
+    virtual bool find(std::string const & id, std::string & session) = 0;
+
+    /// Remove a session
+    virtual void erase(std::string const & id) = 0;
+};
+
+/// In process session store split into independently locked shards
+/**
+ * Meant to be shared by the endpoints of a sharded_server, or any set of
+ * endpoints in one process. The shard of a session is picked by its id so
+ * threads handshaking at the same time rarely contend.
+ *
+ * @since 0.9.0
+ */
+class sharded_session_store : public session_store {
+public:
+    /// Construct a store
+    /**
+     * @param capacity The maximum number of sessions kept
+     * @param shards The number of independently locked shards
+     */
+    explicit sharded_session_store(size_t capacity, size_t shards = 16)
+      : m_shards(shards ? shards : 1)
+      , m_shard_capacity((capacity + m_shards.size() - 1) / m_shards.size())
+    {}
+
+    void store(std::string const & id, std::string const & session,
+        std::time_t expires)
+    {
+        shard & s = get_shard(id);
+        lib::lock_guard<lib::mutex> guard(s.lock);
+
+        if (s.entries.size() >= m_shard_capacity &&
+            s.entries.find(id) == s.entries.end())
+        {
+            // drop expired sessions, or failing that the oldest lookup key
+            std::time_t const now = std::time(NULL);
+            for (entry_map::iterator it = s.entries.begin();
+                it != s.entries.end();)
+            {
+                if (it->second.second <= now) {
+                    s.entries.erase(it++);
+                } else {
+                    ++it;
+                }
+            }
+            if (s.entries.size() >= m_shard_capacity) {
+                if (m_shard_capacity == 0) {
+                    return;
+                }
+                s.entries.erase(s.entries.begin());
+            }
+        }
+
+        s.entries[id] = std::make_pair(session, expires);
+    }
+
+    bool find(std::string const & id, std::string & session) {
+        shard & s = get_shard(id);
+        lib::lock_guard<lib::mutex> guard(s.lock);
+
+        entry_map::const_iterator it = s.entries.find(id);
+        if (it == s.entries.end()) {
+            return false;
+        }
+        session = it->second.first;
+        return true;
+    }
+
+    void erase(std::string const & id) {
+        shard & s = get_shard(id);
+        lib::lock_guard<lib::mutex> guard(s.lock);
+        s.entries.erase(id);
+    }
+
+    /// Number of sessions stored
+    size_t size() const {
+        size_t n = 0;
+        for (size_t i = 0; i < m_shards.size(); ++i) {
+            lib::lock_guard<lib::mutex> guard(m_shards[i].lock);
+            n += m_shards[i].entries.size();
+        }
+        return n;
+    }
+private:
+    typedef std::map<std::string, std::pair<std::string, std::time_t> >
+        entry_map;
+
+    struct shard {
+        mutable lib::mutex lock;
+        entry_map entries;
+    };
+
+    shard & get_shard(std::string const & id) {
+        return m_shards[std::hash<std::string>()(id) % m_shards.size()];
+    }
+
+    std::vector<shard>  m_shards;
+    size_t const        m_shard_capacity;
+};
+
+#ifndef _WIN32
+/// Session store in POSIX shared memory
+/**
+ * Shares sessions between worker processes on one host. Every process opens
+ * the store under the same name; the first one creates it. The store is a
+ * fixed table of slots, a session goes to the slot picked by its id and
+ * replaces whatever was there. Each slot is guarded by a sequence counter
+ * so readers never block and a reader racing a writer simply misses.
+ *
+ * Sessions larger than max_session_size, which only happens with large
+ * client certificates, are not stored.
+ *
+ * @since 0.9.0
+ */
+class shared_memory_session_store : public session_store {
+public:
+    /// Largest session id, as allowed by TLS
+    static size_t const max_id_size = 32;
+    /// Largest DER encoded session that fits in a slot
+    static size_t const max_session_size = 2048;
+
+    /// Open or create a shared store
+    /**
+     * Check is_open afterwards, a store that failed to open keeps nothing.
+     *
+     * @param name The shm_open name of the store, starting with a slash
+     * @param slots The number of slots. Processes sharing a store must agree.
+     */
+    shared_memory_session_store(std::string const & name, size_t slots)
+      : m_slots(NULL)
+      , m_count(slots)
+      , m_size(slots * sizeof(slot))
+    {
+        if (slots == 0) {
+            return;
+        }
+
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0600);
+        if (fd < 0) {
+            return;
+        }
+
+        // a new object is zero filled, which is a table of empty slots
+        struct stat st;
+        if (fstat(fd, &st) == 0 && (static_cast<size_t>(st.st_size) ==
+            m_size || (st.st_size == 0 && ftruncate(fd,
+            static_cast<off_t>(m_size)) == 0)))
+        {
+            void * p = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                fd, 0);
+            if (p != MAP_FAILED) {
+                m_slots = static_cast<slot *>(p);
+            }
+        }
+        ::close(fd);
+    }
+
+    ~shared_memory_session_store() {
+        if (m_slots) {
+            munmap(m_slots, m_size);
+        }
+    }
+
+    /// Remove a store from the system
+    /**
+     * Processes that have it open keep using it.
+     */
+    static void unlink(std::string const & name) {
+        shm_unlink(name.c_str());
+    }
+
+    /// Whether the shared memory could be opened
+    bool is_open() const {
+        return m_slots != NULL;
+    }
+
+    void store(std::string const & id, std::string const & session,
+        std::time_t expires)
+    {
+        if (!m_slots || id.size() > max_id_size ||
+            session.size() > max_session_size)
+        {
+            return;
+        }
+
+        slot & s = get_slot(id);
+        uint32_t seq = s.seq.load(std::memory_order_relaxed);
+        if ((seq & 1) || !s.seq.compare_exchange_strong(seq, seq + 1,
+            std::memory_order_acquire))
+        {
+            // another writer has the slot, our session is just not cached
+            return;
+        }
+
+        s.id_len = static_cast<uint16_t>(id.size());
+        s.len = static_cast<uint16_t>(session.size());
+        s.expires = static_cast<int64_t>(expires);
+        std::memcpy(s.id, id.data(), id.size());
+        std::memcpy(s.data, session.data(), session.size());
+
+        s.seq.store(seq + 2, std::memory_order_release);
+    }
+
+    bool find(std::string const & id, std::string & session) {
+        if (!m_slots || id.size() > max_id_size) {
+            return false;
+        }
+
+        slot & s = get_slot(id);
+        uint32_t const seq = s.seq.load(std::memory_order_acquire);
+        if (seq & 1) {
+            return false;
+        }
+
+        size_t const id_len = s.id_len;
+        size_t const len = s.len;
+        if (id_len != id.size() || len > max_session_size ||
+            std::memcmp(s.id, id.data(), id_len) != 0)
+        {
+            return false;
+        }
+        std::string copy(reinterpret_cast<char const *>(s.data), len);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.seq.load(std::memory_order_relaxed) != seq) {
+            return false;
+        }
+        session.swap(copy);
+        return true;
+    }
+
+    void erase(std::string const & id) {
+        if (!m_slots || id.size() > max_id_size) {
+            return;
+        }
+
+        slot & s = get_slot(id);
+        uint32_t seq = s.seq.load(std::memory_order_relaxed);
+        if ((seq & 1) || !s.seq.compare_exchange_strong(seq, seq + 1,
+            std::memory_order_acquire))
+        {
+            return;
+        }
+        if (s.id_len == id.size() && std::memcmp(s.id, id.data(),
+            id.size()) == 0)
+        {
+            s.id_len = 0;
+        }
+        s.seq.store(seq + 2, std::memory_order_release);
+    }
+private:
+    // the counter is shared between processes, which needs it lock free
+    static_assert(std::atomic<uint32_t>::is_always_lock_free,
+        "shared_memory_session_store needs lock free 32 bit atomics");
+
+    struct slot {
+        std::atomic<uint32_t> seq;
+        uint16_t id_len;
+        uint16_t len;
+        int64_t expires;
+        unsigned char id[max_id_size];
+        unsigned char data[max_session_size];
+    };
+
+    slot & get_slot(std::string const & id) {
+        // FNV-1a, std::hash may differ between the processes' builds
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < id.size(); ++i) {
+            h = (h ^ static_cast<unsigned char>(id[i])) * 16777619u;
+        }
+        return m_slots[h % m_count];
+    }
+
+    slot *          m_slots;
+    size_t const    m_count;
+    size_t const    m_size;
+};
+#endif // _WIN32
+
+/// Rotating TLS session ticket keys
+/**
+ * Servers encrypt session tickets with these keys instead of the random
+ * keys of each TLS context, so any endpoint or process built with the same
+ * secret can resume a ticket issued by another. Keys are derived from the
+ * secret and the current period of `lifetime` seconds, which rotates them
+ * without coordination as long as clocks roughly agree. Tickets from the
+ * previous `keep` periods are still accepted and renewed, as are tickets
+ * from the next period to tolerate clock skew.
+ *
+ * Requires OpenSSL 3, otherwise it has no effect.
+ *
+ * @since 0.9.0
+ */
+class ticket_keys {
+public:
+    typedef lib::shared_ptr<ticket_keys> ptr;
+
+    /// The keys of one period
+    struct key {
+        unsigned char name[16];
+        unsigned char aes[32];
+        unsigned char hmac[32];
+    };
+
+    /// Construct with a random secret, shared within this process only
+    explicit ticket_keys(long lifetime = 3600, unsigned int keep = 1)
+      : m_secret(32, '\0')
+      , m_lifetime(lifetime > 0 ? lifetime : 1)
+      , m_keep(keep)
+    {
+        RAND_bytes(reinterpret_cast<unsigned char *>(&m_secret[0]),
+            static_cast<int>(m_secret.size()));
+    }
+
+    /// Construct with a secret shared by all servers that should resume
+    /// each others tickets
+    ticket_keys(std::string const & secret, long lifetime = 3600,
+        unsigned int keep = 1)
+      : m_secret(secret)
+      , m_lifetime(lifetime > 0 ? lifetime : 1)
+      , m_keep(keep)
+    {}
+
+    /// Get the key to encrypt new tickets with
+    key current() const {
+        return derive(period(std::time(NULL)));
+    }
+
+    /// Find the key a ticket was encrypted with
+    /**
+     * @param name The key name from the ticket
+     * @param out Set to the key, if found
+     * @param renew Set to whether the ticket should be replaced by one
+     * encrypted with the current key
+     * @return Whether the key is still accepted
+     */
+    bool find(unsigned char const * name, key & out, bool & renew) const {
+        int64_t const now = period(std::time(NULL));
+        for (int64_t p = now + 1; p >= now - int64_t(m_keep); --p) {
+            out = derive(p);
+            if (std::memcmp(out.name, name, sizeof(out.name)) == 0) {
+                renew = p != now;
+                return true;
+            }
+        }
+        return false;
+    }
+private:
+    int64_t period(std::time_t t) const {
+        return static_cast<int64_t>(t) / m_lifetime;
+    }
+
+    key derive(int64_t p) const {
+        key k;
+        expand(p, 'n', k.name, sizeof(k.name));
+        expand(p, 'a', k.aes, sizeof(k.aes));
+        expand(p, 'h', k.hmac, sizeof(k.hmac));
+        return k;
+    }
+
+    /// HMAC-SHA256 of the period and a label under the secret
+    void expand(int64_t p, char label, unsigned char * out, size_t len) const {
+        unsigned char msg[9];
+        for (int i = 0; i < 8; ++i) {
+            msg[i] = static_cast<unsigned char>(uint64_t(p) >> (56 - 8 * i));
+        }
+        msg[8] = static_cast<unsigned char>(label);
+
+        unsigned char md[EVP_MAX_MD_SIZE];
+        unsigned int md_len = 0;
+        HMAC(EVP_sha256(), m_secret.data(), static_cast<int>(m_secret.size()),
+            msg, sizeof(msg), md, &md_len);
+        std::memcpy(out, md, len < md_len ? len : md_len);
+    }
+
+    std::string     m_secret;
+    long const      m_lifetime;
+    unsigned int const m_keep;
+};
+
+} // namespace tls_socket
+} // namespace asio
+} // namespace transport
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_TRANSPORT_SECURITY_SESSION_STORE_HPP
@@ -29,17 +29,39 @@
 #define WEBSOCKETPP_TRANSPORT_SECURITY_TLS_HPP
 
 #include <websocketpp/transport/asio/security/base.hpp>
+#include <websocketpp/transport/asio/security/session_store.hpp>
 
 #include <websocketpp/uri.hpp>
 
 #include <websocketpp/common/asio_ssl.hpp>
 #include <websocketpp/common/asio.hpp>
+#include <websocketpp/common/chrono.hpp>
 #include <websocketpp/common/connection_hdl.hpp>
 #include <websocketpp/common/functional.hpp>
 #include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/thread.hpp>
+#include <websocketpp/common/worker_pool.hpp>
 
+#include <algorithm>
+#include <list>
+#include <map>
 #include <sstream>
 #include <string>
+#include <utility>
+#include <vector>
+
+// Driving OpenSSL on the socket itself needs Asio's socket wait operations
+// and the _ex read and write calls of OpenSSL 1.1.1.
+#if defined(_WEBSOCKETPP_ASIO_EXECUTORS_) && \
+    OPENSSL_VERSION_NUMBER >= 0x10101000L
+    #define _WEBSOCKETPP_ASIO_TLS_DIRECT_
+#endif
+
+// Kernel TLS additionally needs OpenSSL 3 built with kTLS support.
+#if defined(_WEBSOCKETPP_ASIO_TLS_DIRECT_) && defined(SSL_OP_ENABLE_KTLS) && \
+    !defined(OPENSSL_NO_KTLS)
+    #define _WEBSOCKETPP_ASIO_KTLS_
+#endif
 
 namespace websocketpp {
 namespace transport {
@@ -55,6 +77,142 @@ typedef lib::function<void(connection_hdl,lib::asio::ssl::stream<
 typedef lib::function<lib::shared_ptr<lib::asio::ssl::context>(connection_hdl_ref)>
     tls_init_handler;
 
+/// How writes are split into TLS records
+namespace record_sizing {
+    enum value {
+        /// One record per buffer handed to the transport
+        scatter = 0,
+        /// Coalesce writes into full size records to minimize overhead
+        throughput,
+        /// Records that fit one TCP segment while a burst ramps up, so the
+        /// peer can decrypt the first bytes without waiting for more
+        /// segments, then full size records
+        latency
+    };
+} // namespace record_sizing
+
+/// Client side cache of TLS sessions for resumption
+/**
+ * Holds at most one SSL_SESSION per key, the most recent one, and drops the
+ * least recently stored key once the capacity is reached. TLS 1.3 tickets
+ * are handed out once because servers may reject a reused ticket, the
+ * server sends fresh ones after each resumed handshake. May be shared by
+ * any number of connections and threads.
+ *
+ * @since 0.9.0
+ */
+class session_cache {
+public:
+    typedef lib::shared_ptr<session_cache> ptr;
+
+    explicit session_cache(size_t capacity) : m_capacity(capacity) {}
+
+    ~session_cache() {
+        clear();
+    }
+
+    /// Store a session, taking over the reference held by the caller
+    void store(std::string const & key, SSL_SESSION * session) {
+        SSL_SESSION * old = NULL;
+        SSL_SESSION * evicted = NULL;
+        {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            entry_map::iterator it = m_entries.find(key);
+            if (it != m_entries.end()) {
+                old = it->second.first;
+                m_order.erase(it->second.second);
+                m_entries.erase(it);
+            } else if (m_entries.size() >= m_capacity && !m_order.empty()) {
+                it = m_entries.find(m_order.front());
+                evicted = it->second.first;
+                m_entries.erase(it);
+                m_order.pop_front();
+            }
+
+            if (m_capacity > 0) {
+                m_order.push_back(key);
+                m_entries[key] = std::make_pair(session, --m_order.end());
+                session = NULL;
+            }
+        }
+
+        // free outside the lock, the session may still be shared by SSLs
+        SSL_SESSION_free(old);
+        SSL_SESSION_free(evicted);
+        SSL_SESSION_free(session);
+    }
+
+    /// Get a session to resume
+    /**
+     * @param key The key to look up
+     * @return A session the caller owns a reference to, or NULL
+     */
+    SSL_SESSION * take(std::string const & key) {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        entry_map::iterator it = m_entries.find(key);
+        if (it == m_entries.end()) {
+            return NULL;
+        }
+
+        SSL_SESSION * session = it->second.first;
+        if (SSL_SESSION_get_protocol_version(session) >= TLS1_3_VERSION) {
+            // single use, pass our reference on
+            m_order.erase(it->second.second);
+            m_entries.erase(it);
+        } else {
+            SSL_SESSION_up_ref(session);
+        }
+        return session;
+    }
+
+    /// Forget the session stored for key, if any
+    void erase(std::string const & key) {
+        SSL_SESSION * session = NULL;
+        {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            entry_map::iterator it = m_entries.find(key);
+            if (it == m_entries.end()) {
+                return;
+            }
+            session = it->second.first;
+            m_order.erase(it->second.second);
+            m_entries.erase(it);
+        }
+        SSL_SESSION_free(session);
+    }
+
+    /// Forget all sessions
+    void clear() {
+        entry_map entries;
+        {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            entries.swap(m_entries);
+            m_order.clear();
+        }
+        for (entry_map::iterator it = entries.begin(); it != entries.end();
+            ++it)
+        {
+            SSL_SESSION_free(it->second.first);
+        }
+    }
+
+    /// Number of keys with a stored session
+    size_t size() const {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        return m_entries.size();
+    }
+private:
+    typedef std::list<std::string> order_list;
+    typedef std::map<std::string, std::pair<SSL_SESSION *,
+        order_list::iterator> > entry_map;
+
+    size_t const        m_capacity;
+    entry_map           m_entries;
+    // keys from least to most recently stored
+    order_list          m_order;
+    mutable lib::mutex  m_lock;
+};
+
 /// TLS enabled Asio connection socket component
 /**
  * transport::asio::tls_socket::connection implements a secure connection socket
@@ -78,7 +236,54 @@ public:
     /// Type of a shared pointer to the ASIO TLS context being used
     typedef lib::shared_ptr<lib::asio::ssl::context> context_ptr;
 
-    explicit connection() {
+    /// Type of a shared pointer to the worker pool handshakes run on
+    typedef lib::shared_ptr<worker_pool> handshake_pool_ptr;
+
+    /// Type of the completion handlers of direct reads and writes
+    typedef lib::function<void(lib::asio::error_code const &, size_t)>
+        io_handler;
+
+    /// Whether this socket policy can bypass the ssl::stream, see set_ktls
+#ifdef _WEBSOCKETPP_ASIO_TLS_DIRECT_
+    static constexpr bool supports_direct_io = true;
+#else
+    static constexpr bool supports_direct_io = false;
+#endif
+
+    /// TLS records must go through the ssl::stream asynchronously
+    static constexpr bool supports_inline_write = false;
+
+    /// Whether this socket policy can send and receive TLS 1.3 early data
+    static constexpr bool supports_early_data = supports_direct_io;
+
+    /// The TLS engine's state is tied to its io_context, see
+    /// connection::migrate
+    static constexpr bool supports_migration = false;
+
+    explicit connection()
+      : m_record_sizing(record_sizing::throughput)
+      , m_record_sent(0)
+      , m_early_data(false)
+      , m_max_early_data(0)
+      , m_early_out(NULL)
+      , m_early_out_len(0)
+      , m_early_written(0)
+      , m_early_reading(false)
+      , m_early_accepted(false)
+      , m_early_in_offset(0)
+      , m_ktls(false)
+      , m_direct_io(false)
+      , m_handshake_running(false)
+      , m_ktls_send(false)
+      , m_ktls_recv(false)
+      , m_read_buf(NULL)
+      , m_read_len(0)
+      , m_read_min(0)
+      , m_read_done(0)
+      , m_write_index(0)
+      , m_write_offset(0)
+      , m_write_done(0)
+    {
         //std::cout << "transport::asio::tls_socket::connection constructor"
         //          << std::endl;
     }
@@ -149,6 +354,242 @@ public:
         m_tls_init_handler = h;
     }
 
+    /// Request kernel TLS offload
+    /**
+     * When enabled the TLS handshake is run by OpenSSL on the socket itself
+     * with SSL_OP_ENABLE_KTLS set, instead of through the memory buffers of
+     * the Asio ssl::stream. If the kernel accepts the negotiated cipher it
+     * encrypts and decrypts records from then on: frames are written to the
+     * raw socket in one gather write, and reads are decrypted by the kernel
+     * as OpenSSL receives them. Otherwise OpenSSL encrypts in user space but
+     * still reads and writes the socket directly, saving a copy of each
+     * record.
+     *
+     * Has no effect without OpenSSL 3 built with kTLS support. The
+     * socket_init_handler must not replace the I/O of the ssl::stream.
+     *
+     * @since 0.9.0
+     *
+     * @param enable Whether to use kernel TLS where available
+     */
+    void set_ktls(bool enable) {
+        m_ktls = enable;
+    }
+
+    /// Largest TLS record payload
+    static constexpr size_t max_record_size = 16384;
+    /// Record payload that fits one TCP segment with the record overhead
+    static constexpr size_t small_record_size = 1360;
+    /// Bytes sent in small records before record_sizing::latency switches
+    /// to full size records
+    static constexpr size_t small_record_bytes = 1024 * 1024;
+    /// Milliseconds of idle time after which small records are used again
+    static constexpr long small_record_idle = 1000;
+
+    /// Choose how writes are split into TLS records
+    /**
+     * Asio's ssl::stream encrypts each buffer of a scatter/gather write on
+     * its own, so the small frame headers written by the transport each end
+     * up in a record of their own. Other strategies than
+     * record_sizing::scatter re-split the write into records of the chosen
+     * size, copying only where a record spans buffers. The default is
+     * record_sizing::throughput.
+     *
+     * Kernel TLS builds its own full size records from a gather write, the
+     * strategy is not applied while it encrypts.
+     *
+     * @since 0.9.0
+     *
+     * @param strategy The record sizing strategy
+     */
+    void set_record_sizing(record_sizing::value strategy) {
+        m_record_sizing = strategy;
+    }
+
+    /// Run the CPU heavy steps of the TLS handshake on a worker pool
+    /**
+     * The private key operations of a handshake, such as the RSA or ECDSA
+     * signature and the ECDHE key exchange of a server, otherwise run on the
+     * io thread and stall every other connection on it. With a pool, each
+     * SSL_do_handshake call runs on a worker while the io thread only waits
+     * for the socket in between. An asynchronous OpenSSL engine or provider
+     * configured in the TLS context then blocks a worker rather than the
+     * io thread as well.
+     *
+     * This drives the handshake on the socket itself like set_ktls, so it
+     * has no effect without Asio executors and OpenSSL 1.1.1.
+     *
+     * @since 0.9.0
+     *
+     * @param pool The pool to run handshakes on, null to run on the io
+     * thread
+     */
+    void set_handshake_offload(handshake_pool_ptr pool) {
+        m_handshake_pool = pool;
+    }
+
+    /// Whether the kernel encrypts the records written by this connection
+    /**
+     * If true, bytes written to the native socket directly, for example
+     * with sendfile, are sent as TLS application data.
+     *
+     * @since 0.9.0
+     */
+    bool is_ktls_send_active() const {
+        return m_ktls_send;
+    }
+
+    /// Whether the kernel decrypts the records read by this connection
+    /**
+     * @since 0.9.0
+     */
+    bool is_ktls_recv_active() const {
+        return m_ktls_recv;
+    }
+
+    /// Set the cache client sessions are resumed from and saved to
+    /**
+     * Clients look up a session for the host, port and SNI name of the uri
+     * before the handshake. Sessions the server issues, including TLS 1.3
+     * tickets that arrive after the handshake, are stored back through the
+     * new session callback of the TLS context, which this installs together
+     * with client side session caching. A null cache, the default, disables
+     * resumption. Has no effect on server connections.
+     *
+     * @since 0.9.0
+     *
+     * @param cache The session cache to use
+     */
+    void set_session_cache(session_cache::ptr cache) {
+        m_session_cache = cache;
+    }
+
+    /// Set the store server sessions are saved to and resumed from
+    /**
+     * Replaces the internal session cache of the TLS context, and unless
+     * ticket keys are set also turns off stateless tickets so TLS 1.3
+     * resumption goes through the store as well. Has no effect on client
+     * connections.
+     *
+     * @since 0.9.0
+     *
+     * @param store The session store to use, null for OpenSSL's default
+     */
+    void set_session_store(session_store::ptr store) {
+        m_session_store = store;
+    }
+
+    /// Set the keys server session tickets are encrypted with
+    /**
+     * Has no effect on client connections.
+     *
+     * @since 0.9.0
+     *
+     * @param keys The ticket keys to use, null for the keys of the context
+     */
+    void set_ticket_keys(ticket_keys::ptr keys) {
+        m_ticket_keys = keys;
+    }
+
+    /// Send the first request of client connections in TLS 1.3 early data
+    /**
+     * When the cached session of the server allows it, the bytes handed
+     * over with set_early_data_payload, the WebSocket upgrade request, are
+     * sent as 0-RTT data right behind the ClientHello instead of one round
+     * trip later. If the server rejects them they are written again once
+     * the handshake is done. Needs a session cache, see set_session_cache.
+     *
+     * Early data can be replayed by an attacker, so only requests that are
+     * safe to process more than once belong there. This drives the
+     * handshake on the socket itself like set_ktls, so it has no effect
+     * without Asio executors and OpenSSL 1.1.1. Has no effect on server
+     * connections.
+     *
+     * @since 0.9.0
+     *
+     * @param enable Whether to send the upgrade request as early data
+     */
+    void set_early_data(bool enable) {
+        m_early_data = enable;
+    }
+
+    /// Accept TLS 1.3 early data on server connections
+    /**
+     * Sessions issued by this connection allow clients to send up to
+     * `max` bytes of early data when resuming them. Early data is handed
+     * to the connection before the handshake completes, and responses
+     * written until then go out as 0.5-RTT data. See
+     * connection::set_early_data_handler for deciding which requests may
+     * be served from early data.
+     *
+     * Has no effect on client connections, or without Asio executors and
+     * OpenSSL 1.1.1.
+     *
+     * @since 0.9.0
+     *
+     * @param max The most early data accepted in bytes, 0 to refuse it
+     */
+    void set_max_early_data(uint32_t max) {
+        m_max_early_data = max;
+    }
+
+    /// Whether a client wants its first request sent as early data
+    /**
+     * @since 0.9.0
+     */
+    bool wants_early_data() const {
+        return supports_early_data && m_early_data;
+    }
+
+    /// Hand over the bytes to send as early data
+    /**
+     * Called by clients before the handshake, see set_early_data. The bytes
+     * must stay valid until the connection is initialized.
+     *
+     * @since 0.9.0
+     *
+     * @param data The bytes to send
+     * @param len The number of bytes
+     */
+    void set_early_data_payload(char const * data, size_t len) {
+        m_early_out = data;
+        m_early_out_len = len;
+    }
+
+    /// Whether early data was accepted
+    /**
+     * For clients, whether the server accepted the early data payload, in
+     * which case it must not be written again. For servers, whether the
+     * connection received early data. Valid once the connection is
+     * initialized.
+     *
+     * @since 0.9.0
+     */
+    bool is_early_data_accepted() const {
+        return m_early_accepted;
+    }
+
+    /// Whether the handshake resumed a previous session
+    /**
+     * @since 0.9.0
+     */
+    bool is_session_reused() const {
+        return m_socket && SSL_session_reused(
+            const_cast<socket_type &>(*m_socket).native_handle()) == 1;
+    }
+
+    /// Whether reads and writes bypass the ssl::stream
+    /**
+     * True once the handshake was started on the socket itself, see
+     * set_ktls. The transport then uses async_read_direct and
+     * async_write_direct.
+     *
+     * @since 0.9.0
+     */
+    bool is_direct_io() const {
+        return m_direct_io;
+    }
+
     /// Get the remote endpoint address
     /**
      * The iostream transport has no information about the ultimate remote
@@ -199,6 +640,17 @@ protected:
         }
         m_socket.reset(new socket_type(*service, *m_context));
 
+        if (!is_server && m_session_cache) {
+            SSL_CTX * ctx = m_context->native_handle();
+            SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT |
+                SSL_SESS_CACHE_NO_INTERNAL_STORE);
+            SSL_CTX_sess_set_new_cb(ctx, &type::handle_new_session);
+        }
+
+        if (is_server && (m_session_store || m_ticket_keys)) {
+            this->init_server_sessions();
+        }
+
         m_io_context = service;
         m_strand = strand;
         m_is_server = is_server;
@@ -222,6 +674,80 @@ protected:
         m_uri = u;
     }
 
+    /// Get the buffers to hand to the socket for a write
+    /**
+     * Re-splits the write into records according to the record sizing
+     * strategy. Only one write may be outstanding at a time.
+     *
+     * @since 0.9.0
+     *
+     * @param bufs The buffers of the write
+     * @return The buffers to write, valid until the next call
+     */
+    std::vector<lib::asio::const_buffer> const & prepare_write(
+        std::vector<lib::asio::const_buffer> const & bufs)
+    {
+        if (m_record_sizing == record_sizing::scatter || m_ktls_send ||
+            bufs.empty())
+        {
+            return bufs;
+        }
+
+        size_t total = 0;
+        for (size_t i = 0; i < bufs.size(); ++i) {
+            total += bufs[i].size();
+        }
+
+        // Only records that span buffers are copied. There is at most one
+        // per boundary between buffers, so this never reallocates.
+        m_records.clear();
+        m_coalesced.clear();
+        m_coalesced.reserve((std::min)(total, bufs.size() * max_record_size));
+
+        size_t i = 0;
+        size_t off = 0;
+        while (i < bufs.size()) {
+            size_t const avail = bufs[i].size() - off;
+            if (avail == 0) {
+                ++i;
+                off = 0;
+                continue;
+            }
+
+            size_t const record = this->next_record_size();
+            char const * data = static_cast<char const *>(bufs[i].data());
+
+            if (avail >= record || i + 1 == bufs.size()) {
+                size_t const n = (std::min)(avail, record);
+                m_records.push_back(lib::asio::buffer(data + off, n));
+                off += n;
+                m_record_sent += n;
+                continue;
+            }
+
+            size_t const start = m_coalesced.size();
+            size_t need = record;
+            while (need > 0 && i < bufs.size()) {
+                size_t const n = (std::min)(need, bufs[i].size() - off);
+                data = static_cast<char const *>(bufs[i].data());
+                m_coalesced.insert(m_coalesced.end(), data + off,
+                    data + off + n);
+                off += n;
+                need -= n;
+                if (off == bufs[i].size()) {
+                    ++i;
+                    off = 0;
+                }
+            }
+            m_records.push_back(lib::asio::buffer(&m_coalesced[start],
+                m_coalesced.size() - start));
+            m_record_sent += m_coalesced.size() - start;
+        }
+
+        m_record_last = lib::chrono::steady_clock::now();
+        return m_records;
+    }
+
     /// Pre-initialize security policy
     /**
      * Called by the transport after a new connection is created to initialize
@@ -267,6 +793,10 @@ protected:
             m_socket_init_handler(m_hdl, get_socket());
         }
 
+        if (!m_is_server && m_session_cache) {
+            this->resume_session();
+        }
+
         callback(lib::error_code());
     }
 
@@ -281,6 +811,19 @@ protected:
     void post_init(init_handler callback) {
         m_ec = socket::make_error_code(socket::error::tls_handshake_timeout);
 
+#ifdef _WEBSOCKETPP_ASIO_TLS_DIRECT_
+        bool direct = !!m_handshake_pool;
+#ifdef _WEBSOCKETPP_ASIO_KTLS_
+        direct = direct || m_ktls;
+#endif
+        // early data is read and written with OpenSSL on the socket
+        direct = direct || this->prepare_early_data();
+        if (direct) {
+            this->start_direct_handshake(callback);
+            return;
+        }
+#endif
+
         // TLS handshake
         if (m_strand) {
             m_socket->async_handshake(
@@ -316,6 +859,10 @@ protected:
 
     void handle_init(init_handler callback,lib::asio::error_code const & ec) {
         if (ec) {
+            if (!m_session_key.empty()) {
+                // don't offer a session the server may have choked on again
+                m_session_cache->erase(m_session_key);
+            }
             m_ec = socket::make_error_code(socket::error::tls_handshake_failed);
         } else {
             m_ec = lib::error_code();
@@ -344,6 +891,17 @@ protected:
     }
 
     void async_shutdown(socket::shutdown_handler callback) {
+#ifdef _WEBSOCKETPP_ASIO_TLS_DIRECT_
+        if (m_handshake_running) {
+            // a worker is using the SSL, finish once it is done with it
+            m_pending_shutdown = callback;
+            return;
+        }
+        if (m_direct_io) {
+            this->shutdown_direct(callback);
+            return;
+        }
+#endif
 		callback = lib::bind(&connection::handle_async_shutdown, this, callback, lib::placeholders::_1);
         if (m_strand) {
             m_socket->async_shutdown(m_strand->wrap(callback));
@@ -374,6 +932,53 @@ protected:
 		callback(code);
     }
 
+#ifdef _WEBSOCKETPP_ASIO_TLS_DIRECT_
+    /// Read at least min bytes into buf without the ssl::stream
+    /**
+     * Only valid while is_direct_io() is true. handler is always called
+     * through the io_context, on the strand if there is one.
+     */
+    void async_read_direct(char * buf, size_t len, size_t min,
+        io_handler handler)
+    {
+        m_read_buf = buf;
+        m_read_len = len;
+        m_read_min = (std::max)(min, size_t(1));
+        m_read_done = 0;
+        m_read_handler = handler;
+
+        this->read_direct(lib::asio::error_code());
+    }
+
+    /// Write all of bufs without the ssl::stream
+    /**
+     * Only valid while is_direct_io() is true. The buffers must stay valid
+     * until handler is called, which is always called through the
+     * io_context, on the strand if there is one.
+     */
+    void async_write_direct(std::vector<lib::asio::const_buffer> const & bufs,
+        io_handler handler)
+    {
+        if (m_ktls_send) {
+            // the kernel frames and encrypts whatever is written to the socket
+            if (m_strand) {
+                lib::asio::async_write(get_next_layer(), bufs,
+                    lib::asio::bind_executor(*m_strand, handler));
+            } else {
+                lib::asio::async_write(get_next_layer(), bufs, handler);
+            }
+            return;
+        }
+
+        m_write_bufs = bufs;
+        m_write_index = 0;
+        m_write_done = 0;
+        m_write_handler = handler;
+
+        this->write_direct(lib::asio::error_code());
+    }
+#endif // _WEBSOCKETPP_ASIO_TLS_DIRECT_
+
 public:
     /// Translate any security policy specific information about an error code
     /**
@@ -415,6 +1020,600 @@ public:
         return ec;
     }
 private:
+    /// Size of the next record of the current write
+    size_t next_record_size() {
+        if (m_record_sizing != record_sizing::latency) {
+            return max_record_size;
+        }
+
+        if (m_record_sent > 0 && lib::chrono::steady_clock::now() -
+            m_record_last > lib::chrono::milliseconds(small_record_idle))
+        {
+            // the congestion window may have collapsed, ramp up again
+            m_record_sent = 0;
+        }
+        return m_record_sent < small_record_bytes ? small_record_size :
+            max_record_size;
+    }
+
+    /// Index of the SSL ex_data slot that points back at the connection
+    static int session_ex_index() {
+        static int const index = SSL_get_ex_new_index(0, NULL, NULL, NULL,
+            NULL);
+        return index;
+    }
+
+    /// Offer the cached session for this host, port and SNI name, if any
+    void resume_session() {
+        SSL * ssl = get_socket().native_handle();
+
+        char const * sni = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+        m_session_key = m_uri->get_host_port();
+        m_session_key += '/';
+        if (sni) {
+            m_session_key += sni;
+        }
+
+        SSL_set_ex_data(ssl, session_ex_index(), this);
+
+        SSL_SESSION * session = m_session_cache->take(m_session_key);
+        if (session) {
+            SSL_set_session(ssl, session);
+            SSL_SESSION_free(session);
+        }
+    }
+
+    /// New session callback of client TLS contexts with a session cache
+    static int handle_new_session(SSL * ssl, SSL_SESSION * session) {
+        connection * con = static_cast<connection *>(
+            SSL_get_ex_data(ssl, session_ex_index()));
+        if (!con || con->m_session_key.empty() ||
+            !SSL_SESSION_is_resumable(session))
+        {
+            return 0;
+        }
+
+        con->m_session_cache->store(con->m_session_key, session);
+        return 1;
+    }
+
+    /// Route the session and ticket callbacks of a server context here
+    void init_server_sessions() {
+        SSL_CTX * ctx = m_context->native_handle();
+        SSL * ssl = get_socket().native_handle();
+
+        if (m_session_store) {
+            SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER |
+                SSL_SESS_CACHE_NO_INTERNAL);
+            SSL_CTX_sess_set_new_cb(ctx, &type::handle_new_server_session);
+            SSL_CTX_sess_set_get_cb(ctx, &type::handle_get_server_session);
+            if (!m_ticket_keys) {
+                // the SSL took its copy of the context options already
+                SSL_set_options(ssl, SSL_OP_NO_TICKET);
+            }
+        }
+#ifdef _WEBSOCKETPP_ASIO_TLS_TICKET_KEYS_
+        if (m_ticket_keys) {
+            SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, &type::handle_ticket_key);
+        }
+#endif
+
+        SSL_set_ex_data(ssl, session_ex_index(), this);
+    }
+
+    /// New session callback of server TLS contexts with a session store
+    static int handle_new_server_session(SSL * ssl, SSL_SESSION * session) {
+        connection * con = static_cast<connection *>(
+            SSL_get_ex_data(ssl, session_ex_index()));
+        int const len = i2d_SSL_SESSION(session, NULL);
+        if (!con || !con->m_session_store || len <= 0) {
+            return 0;
+        }
+
+        std::string der(static_cast<size_t>(len), '\0');
+        unsigned char * p = reinterpret_cast<unsigned char *>(&der[0]);
+        i2d_SSL_SESSION(session, &p);
+
+        unsigned int id_len = 0;
+        unsigned char const * id = SSL_SESSION_get_id(session, &id_len);
+        con->m_session_store->store(
+            std::string(reinterpret_cast<char const *>(id), id_len), der,
+            static_cast<std::time_t>(SSL_SESSION_get_time(session) +
+                SSL_SESSION_get_timeout(session)));
+
+        // the store keeps a copy, not our reference
+        return 0;
+    }
+
+    /// Session lookup callback of server TLS contexts with a session store
+    static SSL_SESSION * handle_get_server_session(SSL * ssl,
+        unsigned char const * id, int id_len, int * copy)
+    {
+        *copy = 0;
+
+        connection * con = static_cast<connection *>(
+            SSL_get_ex_data(ssl, session_ex_index()));
+        std::string der;
+        if (!con || !con->m_session_store || !con->m_session_store->find(
+            std::string(reinterpret_cast<char const *>(id), id_len), der))
+        {
+            return NULL;
+        }
+
+        unsigned char const * p =
+            reinterpret_cast<unsigned char const *>(der.data());
+        return d2i_SSL_SESSION(NULL, &p, static_cast<long>(der.size()));
+    }
+
+#ifdef _WEBSOCKETPP_ASIO_TLS_TICKET_KEYS_
+    /// Ticket key callback of server TLS contexts with ticket keys
+    static int handle_ticket_key(SSL * ssl, unsigned char * name,
+        unsigned char * iv, EVP_CIPHER_CTX * cctx, EVP_MAC_CTX * hctx, int enc)
+    {
+        connection * con = static_cast<connection *>(
+            SSL_get_ex_data(ssl, session_ex_index()));
+        if (!con || !con->m_ticket_keys) {
+            // issue no ticket, or treat the ticket as unknown
+            return 0;
+        }
+
+        ticket_keys::key k;
+        bool renew = false;
+        int ret = 1;
+        if (enc) {
+            k = con->m_ticket_keys->current();
+            std::memcpy(name, k.name, sizeof(k.name));
+            if (RAND_bytes(iv, EVP_CIPHER_get_iv_length(EVP_aes_256_cbc()))
+                    <= 0 ||
+                !EVP_EncryptInit_ex(cctx, EVP_aes_256_cbc(), NULL, k.aes, iv))
+            {
+                ret = -1;
+            }
+        } else if (!con->m_ticket_keys->find(name, k, renew)) {
+            return 0;
+        } else if (!EVP_DecryptInit_ex(cctx, EVP_aes_256_cbc(), NULL, k.aes,
+            iv))
+        {
+            ret = -1;
+        } else if (renew || SSL_version(ssl) >= TLS1_3_VERSION) {
+            // TLS 1.3 tickets are single use, a resumed handshake only
+            // issues a new one when asked to renew
+            ret = 2;
+        }
+
+        if (ret > 0) {
+            OSSL_PARAM params[3];
+            params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY,
+                k.hmac, sizeof(k.hmac));
+            params[1] = OSSL_PARAM_construct_utf8_string(
+                OSSL_MAC_PARAM_DIGEST, const_cast<char *>("SHA256"), 0);
+            params[2] = OSSL_PARAM_construct_end();
+            if (!EVP_MAC_CTX_set_params(hctx, params)) {
+                ret = -1;
+            }
+        }
+
+        OPENSSL_cleanse(&k, sizeof(k));
+        return ret;
+    }
+#endif // _WEBSOCKETPP_ASIO_TLS_TICKET_KEYS_
+
+#ifdef _WEBSOCKETPP_ASIO_TLS_DIRECT_
+    /// Call h once the socket is ready for w, on the strand if there is one
+    template <typename Handler>
+    void wait_socket(lib::asio::socket_base::wait_type w, Handler h) {
+        if (m_strand) {
+            get_raw_socket().async_wait(w,
+                lib::asio::bind_executor(*m_strand, h));
+        } else {
+            get_raw_socket().async_wait(w, h);
+        }
+    }
+
+    /// Call h without nesting it in the current call stack
+    template <typename Handler>
+    void post_completion(Handler h) {
+        if (m_strand) {
+            lib::asio::post(*m_strand, h);
+        } else {
+            lib::asio::post(*m_io_context, h);
+        }
+    }
+
+    /// The error of an SSL call that didn't ask to be retried
+    static lib::asio::error_code get_ssl_error(SSL * ssl, int result) {
+        int const err = SSL_get_error(ssl, result);
+        if (err == SSL_ERROR_ZERO_RETURN ||
+            (err == SSL_ERROR_SYSCALL && ERR_peek_error() == 0))
+        {
+            // a clean close_notify, or the peer closed the socket
+            ERR_clear_error();
+            return lib::asio::error::eof;
+        }
+        return lib::asio::error_code(static_cast<int>(ERR_get_error()),
+            lib::asio::error::get_ssl_category());
+    }
+
+    /// Move the SSL object of the stream onto the socket and start the
+    /// handshake there
+    void start_direct_handshake(init_handler callback) {
+        SSL * ssl = get_socket().native_handle();
+
+        lib::asio::error_code aec;
+        get_raw_socket().native_non_blocking(true, aec);
+        if (aec || SSL_set_fd(ssl, static_cast<int>(
+            get_raw_socket().native_handle())) != 1)
+        {
+            this->handle_init(callback, lib::asio::error::invalid_argument);
+            return;
+        }
+        m_direct_io = true;
+
+#ifdef _WEBSOCKETPP_ASIO_KTLS_
+        if (m_ktls) {
+            SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
+        }
+#endif
+        if (m_is_server) {
+            SSL_set_accept_state(ssl);
+        } else {
+            SSL_set_connect_state(ssl);
+        }
+
+        this->handle_direct_handshake(callback, lib::asio::error_code());
+    }
+
+    void handle_direct_handshake(init_handler callback,
+        lib::asio::error_code const & ec)
+    {
+        if (ec) {
+            this->handle_init(callback, ec);
+            return;
+        }
+
+        if (m_handshake_pool) {
+            // private key operations run on the worker, this thread only
+            // waits for the socket in between
+            m_handshake_running = true;
+            m_handshake_pool->post(lib::bind(
+                &type::run_handshake_step, get_shared(),
+                callback
+            ));
+            return;
+        }
+
+        lib::asio::socket_base::wait_type want;
+        lib::asio::error_code hec;
+        int const state = this->do_handshake_step(want, hec);
+        this->handle_handshake_step(callback, state, want, hec);
+    }
+
+    /// Run one handshake step on a handshake pool worker
+    void run_handshake_step(init_handler callback) {
+        lib::asio::socket_base::wait_type want =
+            lib::asio::socket_base::wait_read;
+        lib::asio::error_code hec;
+        int const state = this->do_handshake_step(want, hec);
+
+        this->post_completion(lib::bind(
+            &type::handle_handshake_step, get_shared(),
+            callback,
+            state,
+            want,
+            hec
+        ));
+    }
+
+    /// Call SSL_do_handshake once
+    /**
+     * Reads the OpenSSL error queue, which is per thread, so it has to run
+     * on the thread that made the call.
+     *
+     * @param want Set to what to wait for if the handshake has to wait
+     * @param ec Set to the error if the handshake failed
+     * @return 1 if the handshake is done, 2 if the server received early
+     * data and completes the handshake while reading it, 0 if it has to
+     * wait, -1 on error
+     */
+    int do_handshake_step(lib::asio::socket_base::wait_type & want,
+        lib::asio::error_code & ec)
+    {
+        SSL * ssl = get_socket().native_handle();
+        int r;
+        if (m_early_reading) {
+            r = this->read_early_data(ssl);
+            if (r == 1 && m_early_in.empty()) {
+                // the client sent none, finish the handshake as usual
+                r = SSL_do_handshake(ssl);
+            } else if (r == 1) {
+                // serve the early data now, the handshake completes in a
+                // later read
+                return 2;
+            }
+        } else if (m_early_written < m_early_out_len) {
+            r = this->write_early_data(ssl);
+            if (r == 1) {
+                r = SSL_do_handshake(ssl);
+            }
+        } else {
+            r = SSL_do_handshake(ssl);
+        }
+        if (r == 1) {
+            if (m_early_out_len > 0) {
+                m_early_accepted = SSL_get_early_data_status(ssl) ==
+                    SSL_EARLY_DATA_ACCEPTED;
+            }
+            return 1;
+        }
+
+        int const err = SSL_get_error(ssl, r);
+        if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+            want = err == SSL_ERROR_WANT_READ ?
+                lib::asio::socket_base::wait_read :
+                lib::asio::socket_base::wait_write;
+            return 0;
+        }
+
+        ec = get_ssl_error(ssl, r);
+        return -1;
+    }
+
+    void handle_handshake_step(init_handler callback, int state,
+        lib::asio::socket_base::wait_type want,
+        lib::asio::error_code const & ec)
+    {
+        m_handshake_running = false;
+
+        if (m_pending_shutdown) {
+            socket::shutdown_handler shutdown;
+            shutdown.swap(m_pending_shutdown);
+            this->shutdown_direct(shutdown);
+            this->handle_init(callback, lib::asio::error::operation_aborted);
+            return;
+        }
+
+        if (state == 0) {
+            this->wait_socket(want, lib::bind(
+                &type::handle_direct_handshake, get_shared(),
+                callback,
+                lib::placeholders::_1
+            ));
+            return;
+        }
+
+        if (state == 2) {
+            m_early_accepted = true;
+        }
+
+#ifdef _WEBSOCKETPP_ASIO_KTLS_
+        if (state == 1) {
+            SSL * ssl = get_socket().native_handle();
+            m_ktls_send = BIO_get_ktls_send(SSL_get_wbio(ssl)) != 0;
+            m_ktls_recv = BIO_get_ktls_recv(SSL_get_rbio(ssl)) != 0;
+        }
+#endif
+
+        this->handle_init(callback, ec);
+    }
+
+    void read_direct(lib::asio::error_code const & ec) {
+        SSL * ssl = get_socket().native_handle();
+
+        lib::asio::error_code rec = ec;
+        if (!rec && m_early_in_offset < m_early_in.size()) {
+            // early data read along with the handshake comes first
+            size_t const n = (std::min)(m_read_len - m_read_done,
+                m_early_in.size() - m_early_in_offset);
+            std::copy(m_early_in.begin() + m_early_in_offset,
+                m_early_in.begin() + m_early_in_offset + n,
+                m_read_buf + m_read_done);
+            m_read_done += n;
+            m_early_in_offset += n;
+            if (m_early_in_offset == m_early_in.size()) {
+                std::string().swap(m_early_in);
+                m_early_in_offset = 0;
+            }
+        }
+        while (!rec && m_read_done < m_read_min) {
+            size_t n = 0;
+            int r;
+            if (m_early_reading) {
+                r = SSL_read_early_data(ssl, m_read_buf + m_read_done,
+                    m_read_len - m_read_done, &n);
+                if (r == SSL_READ_EARLY_DATA_FINISH) {
+                    // SSL_read_ex completes the handshake from here
+                    m_early_reading = false;
+                    r = 1;
+                } else if (r == SSL_READ_EARLY_DATA_SUCCESS) {
+                    r = 1;
+                } else {
+                    r = 0;
+                }
+            } else {
+                r = SSL_read_ex(ssl, m_read_buf + m_read_done,
+                    m_read_len - m_read_done, &n);
+            }
+            if (r == 1) {
+                m_read_done += n;
+                continue;
+            }
+
+            int const err = SSL_get_error(ssl, r);
+            if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+                this->wait_socket(err == SSL_ERROR_WANT_READ ?
+                    lib::asio::socket_base::wait_read :
+                    lib::asio::socket_base::wait_write,
+                    lib::bind(
+                        &type::read_direct, get_shared(),
+                        lib::placeholders::_1
+                    )
+                );
+                return;
+            }
+            rec = get_ssl_error(ssl, r);
+        }
+
+        io_handler handler;
+        handler.swap(m_read_handler);
+        this->post_completion(lib::bind(handler, rec, m_read_done));
+    }
+
+    void write_direct(lib::asio::error_code const & ec) {
+        SSL * ssl = get_socket().native_handle();
+
+        lib::asio::error_code wec = ec;
+        while (!wec && m_write_index < m_write_bufs.size()) {
+            lib::asio::const_buffer const & b = m_write_bufs[m_write_index];
+            if (m_write_offset == b.size()) {
+                ++m_write_index;
+                m_write_offset = 0;
+                continue;
+            }
+
+            size_t n = 0;
+            char const * data = static_cast<char const *>(b.data()) +
+                m_write_offset;
+            // 0.5-RTT data while the handshake isn't complete
+            int const r = m_early_reading ?
+                SSL_write_early_data(ssl, data, b.size() - m_write_offset, &n) :
+                SSL_write_ex(ssl, data, b.size() - m_write_offset, &n);
+            if (r == 1) {
+                m_write_offset += n;
+                m_write_done += n;
+                continue;
+            }
+
+            int const err = SSL_get_error(ssl, r);
+            if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+                this->wait_socket(err == SSL_ERROR_WANT_READ ?
+                    lib::asio::socket_base::wait_read :
+                    lib::asio::socket_base::wait_write,
+                    lib::bind(
+                        &type::write_direct, get_shared(),
+                        lib::placeholders::_1
+                    )
+                );
+                return;
+            }
+            wec = get_ssl_error(ssl, r);
+        }
+
+        io_handler handler;
+        handler.swap(m_write_handler);
+        this->post_completion(lib::bind(handler, wec, m_write_done));
+    }
+
+    /// Decide whether the handshake sends or receives early data
+    /**
+     * @return Whether it does, which needs the handshake on the socket
+     */
+    bool prepare_early_data() {
+        SSL * ssl = get_socket().native_handle();
+
+        if (m_is_server) {
+            if (m_max_early_data == 0) {
+                return false;
+            }
+            SSL_set_max_early_data(ssl, m_max_early_data);
+            m_early_reading = true;
+            return true;
+        }
+
+        SSL_SESSION * session = SSL_get_session(ssl);
+        if (!m_early_data || m_early_out_len == 0 || !session ||
+            SSL_SESSION_get_max_early_data(session) == 0)
+        {
+            m_early_out_len = 0;
+            return false;
+        }
+        return true;
+    }
+
+    /// Read early data with the ClientHello into m_early_in
+    /**
+     * @return 1 once the client sent all of its early data, or at least some
+     * of it that is available now, otherwise as SSL_do_handshake
+     */
+    int read_early_data(SSL * ssl) {
+        char buf[4096];
+        for (;;) {
+            size_t n = 0;
+            int const r = SSL_read_early_data(ssl, buf, sizeof(buf), &n);
+            if (r == SSL_READ_EARLY_DATA_SUCCESS) {
+                m_early_in.append(buf, n);
+                continue;
+            }
+            if (r == SSL_READ_EARLY_DATA_FINISH) {
+                m_early_reading = false;
+                return 1;
+            }
+            if (!m_early_in.empty() &&
+                SSL_get_error(ssl, r) == SSL_ERROR_WANT_READ)
+            {
+                return 1;
+            }
+            return 0;
+        }
+    }
+
+    /// Write the early data payload behind the ClientHello
+    /**
+     * @return 1 once all of it was written, otherwise as SSL_do_handshake
+     */
+    int write_early_data(SSL * ssl) {
+        while (m_early_written < m_early_out_len) {
+            size_t n = 0;
+            int const r = SSL_write_early_data(ssl,
+                m_early_out + m_early_written,
+                m_early_out_len - m_early_written, &n);
+            if (r != 1) {
+                return r;
+            }
+            m_early_written += n;
+        }
+        return 1;
+    }
+
+    /// Send close_notify without waiting for the one of the peer
+    void shutdown_direct(socket::shutdown_handler callback) {
+        SSL * ssl = get_socket().native_handle();
+
+        lib::asio::error_code ec;
+        if (SSL_is_init_finished(ssl)) {
+            int const r = SSL_shutdown(ssl);
+            if (r < 0) {
+                if (SSL_get_error(ssl, r) == SSL_ERROR_WANT_WRITE) {
+                    this->wait_socket(lib::asio::socket_base::wait_write,
+                        lib::bind(
+                            &type::handle_shutdown_direct, get_shared(),
+                            callback,
+                            lib::placeholders::_1
+                        )
+                    );
+                    return;
+                }
+                ec = get_ssl_error(ssl, r);
+                if (ec == lib::asio::error::eof) {
+                    // the peer is gone already, there is nobody to tell
+                    ec.clear();
+                }
+            }
+        }
+
+        this->post_completion(lib::bind(callback, ec));
+    }
+
+    void handle_shutdown_direct(socket::shutdown_handler callback,
+        lib::asio::error_code const & ec)
+    {
+        if (ec) {
+            callback(ec);
+            return;
+        }
+        this->shutdown_direct(callback);
+    }
+#endif // _WEBSOCKETPP_ASIO_TLS_DIRECT_
+
     socket_type::handshake_type get_handshake_type() {
         if (m_is_server) {
             return lib::asio::ssl::stream_base::server;
@@ -435,6 +1634,49 @@ private:
     connection_hdl      m_hdl;
     socket_init_handler m_socket_init_handler;
     tls_init_handler    m_tls_init_handler;
+
+    session_cache::ptr  m_session_cache;
+    std::string         m_session_key;
+    session_store::ptr  m_session_store;
+    ticket_keys::ptr    m_ticket_keys;
+
+    record_sizing::value m_record_sizing;
+    std::vector<lib::asio::const_buffer> m_records;
+    std::vector<char>   m_coalesced;
+    size_t              m_record_sent;
+    lib::chrono::steady_clock::time_point m_record_last;
+
+    // TLS 1.3 early data, see set_early_data and set_max_early_data
+    bool                m_early_data;
+    uint32_t            m_max_early_data;
+    char const *        m_early_out;
+    size_t              m_early_out_len;
+    size_t              m_early_written;
+    bool                m_early_reading;
+    bool                m_early_accepted;
+    std::string         m_early_in;
+    size_t              m_early_in_offset;
+
+    bool                m_ktls;
+    bool                m_direct_io;
+    handshake_pool_ptr  m_handshake_pool;
+    bool                m_handshake_running;
+    socket::shutdown_handler m_pending_shutdown;
+    bool                m_ktls_send;
+    bool                m_ktls_recv;
+
+    // state of the outstanding direct read and write
+    char *              m_read_buf;
+    size_t              m_read_len;
+    size_t              m_read_min;
+    size_t              m_read_done;
+    io_handler          m_read_handler;
+
+    std::vector<lib::asio::const_buffer> m_write_bufs;
+    size_t              m_write_index;
+    size_t              m_write_offset;
+    size_t              m_write_done;
+    io_handler          m_write_handler;
 };
 
 /// TLS enabled Asio endpoint socket component
@@ -453,7 +1695,11 @@ public:
     /// component.
     typedef socket_con_type::ptr socket_con_ptr;
 
-    explicit endpoint() {}
+    explicit endpoint()
+      : m_ktls(false)
+      , m_early_data(false)
+      , m_max_early_data(0)
+      , m_record_sizing(record_sizing::throughput) {}
 
     /// Checks whether the endpoint creates secure connections
     /**
@@ -487,6 +1733,141 @@ public:
     void set_tls_init_handler(tls_init_handler h) {
         m_tls_init_handler = h;
     }
+
+    /// Request kernel TLS offload for new connections
+    /**
+     * See connection::set_ktls. The default is false.
+     *
+     * @since 0.9.0
+     *
+     * @param enable Whether to use kernel TLS where available
+     */
+    void set_ktls(bool enable) {
+        m_ktls = enable;
+    }
+
+    /// Send the upgrade request of new client connections as early data
+    /**
+     * See connection::set_early_data. The default is false.
+     *
+     * @since 0.9.0
+     *
+     * @param enable Whether to send the upgrade request as early data
+     */
+    void set_early_data(bool enable) {
+        m_early_data = enable;
+    }
+
+    /// Accept TLS 1.3 early data on new server connections
+    /**
+     * See connection::set_max_early_data. The default is 0, which refuses
+     * early data.
+     *
+     * @since 0.9.0
+     *
+     * @param max The most early data accepted in bytes
+     */
+    void set_max_early_data(uint32_t max) {
+        m_max_early_data = max;
+    }
+
+    /// Resume TLS sessions of client connections
+    /**
+     * Keeps up to `size` sessions, one per host, port and SNI name, shared
+     * by all connections of this endpoint so reconnects can skip the full
+     * handshake. A size of 0, the default, disables resumption. Replacing
+     * the cache drops the sessions stored so far. See
+     * connection::set_session_cache.
+     *
+     * @since 0.9.0
+     *
+     * @param size The maximum number of sessions to keep
+     */
+    void set_session_cache_size(size_t size) {
+        if (size == 0) {
+            m_session_cache.reset();
+        } else {
+            m_session_cache = lib::make_shared<session_cache>(size);
+        }
+    }
+
+    /// Resume TLS sessions of client connections through a given cache
+    /**
+     * Pass the same cache to several endpoints, such as the shards of a
+     * client_ramp, to let all of them resume the sessions any of them
+     * established.
+     *
+     * @since 0.9.0
+     *
+     * @param cache The session cache to use, null to disable resumption
+     */
+    void set_session_cache(session_cache::ptr cache) {
+        m_session_cache = cache;
+    }
+
+    /// Share server sessions through a session store
+    /**
+     * Pass the same store to several endpoints, such as the shards of a
+     * sharded_server, or use a shared_memory_session_store to resume
+     * sessions across processes. See connection::set_session_store.
+     *
+     * @since 0.9.0
+     *
+     * @param store The session store to use, null for OpenSSL's default
+     */
+    void set_session_store(session_store::ptr store) {
+        m_session_store = store;
+    }
+
+    /// Encrypt server session tickets with shared, rotating keys
+    /**
+     * Endpoints and processes using ticket keys built from the same secret
+     * resume each others tickets without sharing any state. See
+     * connection::set_ticket_keys.
+     *
+     * @since 0.9.0
+     *
+     * @param keys The ticket keys to use, null for the keys of the context
+     */
+    void set_ticket_keys(ticket_keys::ptr keys) {
+        m_ticket_keys = keys;
+    }
+
+    /// Choose how writes of new connections are split into TLS records
+    /**
+     * See connection::set_record_sizing.
+     *
+     * @since 0.9.0
+     *
+     * @param strategy The record sizing strategy
+     */
+    void set_record_sizing(record_sizing::value strategy) {
+        m_record_sizing = strategy;
+    }
+
+    /// Run the CPU heavy steps of TLS handshakes on a worker pool
+    /**
+     * The pool may be shared with other endpoints. See
+     * connection::set_handshake_offload.
+     *
+     * @since 0.9.0
+     *
+     * @param pool The pool to run handshakes on, null to run on the io
+     * thread
+     */
+    void set_handshake_offload(socket_con_type::handshake_pool_ptr pool) {
+        m_handshake_pool = pool;
+    }
+
+    /// Get the session cache shared by the connections of this endpoint
+    /**
+     * @since 0.9.0
+     *
+     * @return The session cache, null if resumption is disabled
+     */
+    session_cache::ptr get_session_cache() const {
+        return m_session_cache;
+    }
 protected:
     /// Initialize a connection
     /**
@@ -500,12 +1881,28 @@ protected:
     lib::error_code init(socket_con_ptr scon) {
         scon->set_socket_init_handler(m_socket_init_handler);
         scon->set_tls_init_handler(m_tls_init_handler);
+        scon->set_ktls(m_ktls);
+        scon->set_early_data(m_early_data);
+        scon->set_max_early_data(m_max_early_data);
+        scon->set_session_cache(m_session_cache);
+        scon->set_session_store(m_session_store);
+        scon->set_ticket_keys(m_ticket_keys);
+        scon->set_handshake_offload(m_handshake_pool);
+        scon->set_record_sizing(m_record_sizing);
         return lib::error_code();
     }
 
 private:
     socket_init_handler m_socket_init_handler;
     tls_init_handler m_tls_init_handler;
+    bool m_ktls;
+    bool m_early_data;
+    uint32_t m_max_early_data;
+    session_cache::ptr m_session_cache;
+    session_store::ptr m_session_store;
+    ticket_keys::ptr m_ticket_keys;
+    socket_con_type::handshake_pool_ptr m_handshake_pool;
+    record_sizing::value m_record_sizing;
 };
 
 } // namespace tls_socket
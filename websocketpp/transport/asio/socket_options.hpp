@@ -0,0 +1,380 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_TRANSPORT_ASIO_SOCKET_OPTIONS_HPP
+#define WEBSOCKETPP_TRANSPORT_ASIO_SOCKET_OPTIONS_HPP
+
+#include <websocketpp/common/asio.hpp>
+
+#include <cstddef>
+
+// Zero copy sends need SO_ZEROCOPY and MSG_ZEROCOPY, Linux 4.14 and later
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+    #define _WEBSOCKETPP_ASIO_ZEROCOPY_
+#endif
+
+namespace websocketpp {
+namespace transport {
+namespace asio {
+
+/// Options applied to the sockets of an asio transport endpoint
+/**
+ * Zero and false leave the system default in place. Setting an option the
+ * platform doesn't support reports operation_not_supported, the other
+ * options are still applied.
+ *
+ * @since 0.9.0
+ */
+struct socket_options {
+    socket_options()
+      : no_delay(false)
+      , quick_ack(false)
+      , send_buffer(0)
+      , receive_buffer(0)
+      , notsent_lowat(0)
+      , busy_poll(0)
+      , user_timeout(0)
+      , max_pacing_rate(0)
+      , zerocopy_threshold(0)
+      , fast_open(0)
+      , fast_open_connect(false) {}
+
+    /// Options for small, latency sensitive messages
+    /**
+     * Disables Nagle's algorithm and delayed acks and keeps at most 16KiB of
+     * unsent data in the kernel. busy_poll isn't set as raising it needs
+     * CAP_NET_ADMIN.
+     */
+    static socket_options low_latency() {
+        socket_options o;
+        o.no_delay = true;
+        o.quick_ack = true;
+        o.notsent_lowat = 16384;
+        return o;
+    }
+
+    /// Options for bulk transfers over long fat links
+    /**
+     * Uses 4MiB kernel buffers and keeps at most 256KiB of unsent data in
+     * the kernel.
+     */
+    static socket_options high_throughput() {
+        socket_options o;
+        o.no_delay = true;
+        o.send_buffer = 4194304;
+        o.receive_buffer = 4194304;
+        o.notsent_lowat = 262144;
+        return o;
+    }
+
+    /// Disable Nagle's algorithm (TCP_NODELAY)
+    bool no_delay;
+    /// Acknowledge received data right away (TCP_QUICKACK, Linux only)
+    /**
+     * The kernel leaves quick ack mode on its own, the transport enables it
+     * again after every read.
+     */
+    bool quick_ack;
+    /// Size of the kernel send buffer in bytes (SO_SNDBUF)
+    int send_buffer;
+    /// Size of the kernel receive buffer in bytes (SO_RCVBUF)
+    /**
+     * Also set on the acceptor and on client sockets before connecting, so
+     * the TCP window scale is chosen accordingly.
+     */
+    int receive_buffer;
+    /// Unsent bytes the kernel accepts before writes wait (TCP_NOTSENT_LOWAT)
+    /**
+     * Without it a write completes once the data is copied into the kernel
+     * send buffer, which may hold megabytes. A small value keeps the backlog
+     * in the connection's send queue instead, where the send watermarks
+     * (endpoint::set_send_watermarks) see it and high watermark handlers
+     * can react, while the kernel still has enough queued to keep the link
+     * busy.
+     */
+    int notsent_lowat;
+    /// Microseconds to busy poll the device queue when waiting for data
+    /// (SO_BUSY_POLL, Linux only)
+    /**
+     * Raising it above net.core.busy_read needs CAP_NET_ADMIN. See also
+     * endpoint::run_busy, which spins in user space before waiting.
+     */
+    int busy_poll;
+    /// Milliseconds sent data may stay unacknowledged before the connection
+    /// is dropped (TCP_USER_TIMEOUT, Linux only)
+    unsigned int user_timeout;
+    /// Bytes per second the kernel transmits at most (SO_MAX_PACING_RATE,
+    /// Linux only)
+    /**
+     * The kernel spaces out the packets of the socket instead of sending
+     * its whole send buffer as one burst. Needs the fq qdisc, or TCP
+     * internal pacing on Linux 4.13 and later. Together with paced
+     * broadcasts (endpoint::set_broadcast_pacing) this keeps egress smooth
+     * when many connections are sent to at once.
+     */
+    unsigned int max_pacing_rate;
+    /// Smallest buffer sent with MSG_ZEROCOPY (SO_ZEROCOPY, Linux only)
+    /**
+     * Buffers of at least this many bytes, normally the payloads of large
+     * messages, are sent without copying them into the kernel. The kernel
+     * reads them while they are transmitted, so their messages stay
+     * referenced until it reports it is done with them, which takes about a
+     * round trip. Zero copy costs page pinning and completion handling that
+     * only pay off for large buffers; 64KiB or more is a reasonable start.
+     *
+     * Applies to plain sockets only, TLS records are written by the
+     * ssl::stream. A connection goes back to copying if the kernel reports
+     * it copied the data anyway, as it does over loopback, or runs out of
+     * locked memory (ENOBUFS). Set by the connection rather than
+     * apply_socket_options, as it changes how writes are made.
+     */
+    size_t zerocopy_threshold;
+    /// Length of the queue of pending TCP Fast Open requests of a listening
+    /// socket (TCP_FASTOPEN)
+    /**
+     * Clients that connected before send a cookie with their next SYN,
+     * together with the first data they write, and the server reads that
+     * data without waiting for the handshake to complete. Linux also needs
+     * bit 2 (0x2) of net.ipv4.tcp_fastopen set for servers.
+     */
+    int fast_open;
+    /// Send the first data written with the SYN (TCP_FASTOPEN_CONNECT,
+    /// Linux only)
+    /**
+     * Connecting completes at once and the SYN leaves with the first write,
+     * the upgrade request or the TLS ClientHello, saving a round trip on
+     * connections to servers that handed out a cookie before. The kernel
+     * falls back to a plain handshake otherwise. Needs bit 1 (0x1) of
+     * net.ipv4.tcp_fastopen, which is set by default.
+     *
+     * As every attempt appears to succeed at once, addresses that can't be
+     * reached fail at the first write rather than moving on to the next
+     * resolved address.
+     */
+    bool fast_open_connect;
+};
+
+namespace detail {
+
+inline void keep_first(lib::asio::error_code & ret,
+    lib::asio::error_code const & ec)
+{
+    if (ec && !ret) {
+        ret = ec;
+    }
+}
+
+inline lib::asio::error_code not_supported() {
+    return lib::asio::error::make_error_code(
+        lib::asio::error::operation_not_supported);
+}
+
+} // namespace detail
+
+/// Apply the buffer sizes of a set of socket options
+/**
+ * Works on sockets and acceptors, which pass them on to accepted sockets.
+ *
+ * @since 0.9.0
+ *
+ * @param s The socket or acceptor, must be open
+ * @param o The options to apply
+ * @return The first error that occurred, if any
+ */
+template <typename socket_type>
+lib::asio::error_code apply_buffer_options(socket_type & s,
+    socket_options const & o)
+{
+    lib::asio::error_code ret;
+    lib::asio::error_code ec;
+
+    if (o.send_buffer > 0) {
+        s.set_option(lib::asio::socket_base::send_buffer_size(o.send_buffer),
+            ec);
+        detail::keep_first(ret, ec);
+    }
+    if (o.receive_buffer > 0) {
+        s.set_option(lib::asio::socket_base::receive_buffer_size(
+            o.receive_buffer), ec);
+        detail::keep_first(ret, ec);
+    }
+
+    return ret;
+}
+
+/// Enable TCP Fast Open on a listening socket
+/**
+ * @since 0.9.0
+ *
+ * @param s The acceptor, must be open
+ * @param o The options to apply
+ * @return The error that occurred, if any
+ */
+template <typename acceptor_type>
+lib::asio::error_code apply_fast_open(acceptor_type & s,
+    socket_options const & o)
+{
+    lib::asio::error_code ec;
+    if (o.fast_open <= 0) {
+        return ec;
+    }
+#ifdef TCP_FASTOPEN
+    typedef lib::asio::detail::socket_option::integer<IPPROTO_TCP,
+        TCP_FASTOPEN> fast_open;
+    s.set_option(fast_open(o.fast_open), ec);
+#else
+    (void)s;
+    ec = detail::not_supported();
+#endif
+    return ec;
+}
+
+/// Have a client socket send its first data with the SYN
+/**
+ * @since 0.9.0
+ *
+ * @param s The socket, must be open and not yet connected
+ * @param o The options to apply
+ * @return The error that occurred, if any
+ */
+template <typename socket_type>
+lib::asio::error_code apply_fast_open_connect(socket_type & s,
+    socket_options const & o)
+{
+    lib::asio::error_code ec;
+    if (!o.fast_open_connect) {
+        return ec;
+    }
+#ifdef TCP_FASTOPEN_CONNECT
+    typedef lib::asio::detail::socket_option::boolean<IPPROTO_TCP,
+        TCP_FASTOPEN_CONNECT> fast_open_connect;
+    s.set_option(fast_open_connect(true), ec);
+#else
+    (void)s;
+    ec = detail::not_supported();
+#endif
+    return ec;
+}
+
+/// Enable quick ack mode on a socket
+/**
+ * @since 0.9.0
+ *
+ * @param s The socket, must be open
+ * @return The error that occurred, if any
+ */
+template <typename socket_type>
+lib::asio::error_code apply_quick_ack(socket_type & s) {
+    lib::asio::error_code ec;
+#ifdef TCP_QUICKACK
+    typedef lib::asio::detail::socket_option::boolean<IPPROTO_TCP,
+        TCP_QUICKACK> quick_ack;
+    s.set_option(quick_ack(true), ec);
+#else
+    (void)s;
+    ec = detail::not_supported();
+#endif
+    return ec;
+}
+
+/// Apply a set of socket options to a connected socket
+/**
+ * @since 0.9.0
+ *
+ * @param s The socket, must be open
+ * @param o The options to apply
+ * @return The first error that occurred, if any
+ */
+template <typename socket_type>
+lib::asio::error_code apply_socket_options(socket_type & s,
+    socket_options const & o)
+{
+    lib::asio::error_code ret = apply_buffer_options(s, o);
+    lib::asio::error_code ec;
+
+    if (o.no_delay) {
+        s.set_option(lib::asio::ip::tcp::no_delay(true), ec);
+        detail::keep_first(ret, ec);
+    }
+
+    if (o.quick_ack) {
+        detail::keep_first(ret, apply_quick_ack(s));
+    }
+
+    if (o.notsent_lowat > 0) {
+#ifdef TCP_NOTSENT_LOWAT
+        typedef lib::asio::detail::socket_option::integer<IPPROTO_TCP,
+            TCP_NOTSENT_LOWAT> notsent_lowat;
+        s.set_option(notsent_lowat(o.notsent_lowat), ec);
+#else
+        ec = detail::not_supported();
+#endif
+        detail::keep_first(ret, ec);
+    }
+
+    if (o.busy_poll > 0) {
+#ifdef SO_BUSY_POLL
+        typedef lib::asio::detail::socket_option::integer<SOL_SOCKET,
+            SO_BUSY_POLL> busy_poll;
+        s.set_option(busy_poll(o.busy_poll), ec);
+#else
+        ec = detail::not_supported();
+#endif
+        detail::keep_first(ret, ec);
+    }
+
+    if (o.user_timeout > 0) {
+#ifdef TCP_USER_TIMEOUT
+        typedef lib::asio::detail::socket_option::integer<IPPROTO_TCP,
+            TCP_USER_TIMEOUT> user_timeout;
+        s.set_option(user_timeout(int(o.user_timeout)), ec);
+#else
+        ec = detail::not_supported();
+#endif
+        detail::keep_first(ret, ec);
+    }
+
+    if (o.max_pacing_rate > 0) {
+#ifdef SO_MAX_PACING_RATE
+        // read by the kernel as an unsigned 32 bit value
+        typedef lib::asio::detail::socket_option::integer<SOL_SOCKET,
+            SO_MAX_PACING_RATE> max_pacing_rate;
+        s.set_option(max_pacing_rate(int(o.max_pacing_rate)), ec);
+#else
+        ec = detail::not_supported();
+#endif
+        detail::keep_first(ret, ec);
+    }
+
+    return ret;
+}
+
+} // namespace asio
+} // namespace transport
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_TRANSPORT_ASIO_SOCKET_OPTIONS_HPP
@@ -63,6 +63,26 @@ namespace websocketpp {
  * time. The transport must promise to only call read_handler once per async
  * read.
  *
+ * **async_wait_readable**\n
+ * `void async_wait_readable(read_handler handler)`\n
+ * Call handler once data is available to be read, without reading it. The
+ * second handler argument is unused and should be zero. Transports that cannot
+ * detect readiness may call handler immediately. Only one wait or read is in
+ * flight at a time.
+ *
+ * **reset_on_close**\n
+ * `void reset_on_close()`\n
+ * Drop the connection abortively (TCP RST) rather than gracefully once it is
+ * shut down, so the remote end can't keep server resources busy. Transports
+ * without such a notion may ignore it.
+ *
+ * **read_available**\n
+ * `size_t read_available(char * buf, size_t len)`\n
+ * Copy up to len bytes that can be read without blocking into buf and return
+ * how many were copied. Return 0 if nothing is available, on error (the next
+ * async read reports it), or if the transport cannot read without blocking.
+ * Only called while no read is in flight.
+ *
  * **async_write**\n
  * `void async_write(const char* buf, size_t len, write_handler handler)`\n
  * `void async_write(std::vector<buffer> & bufs, write_handler handler)`\n
@@ -105,7 +125,19 @@ namespace websocketpp {
  * **dispatch**\n
  * `lib::error_code dispatch(dispatch_handler handler)`: invoke handler within
  * the transport's event system if it uses one. Otherwise, this method should
- * simply call `handler` immediately.
+ * simply call `handler` immediately, and the transport sets
+ * `static bool const inline_dispatch = true` so the connection may skip
+ * building the handler.
+ *
+ * **wants_early_data**, **set_early_data_payload**,
+ * **is_early_data_accepted**\n
+ * `bool wants_early_data() const`,
+ * `void set_early_data_payload(char const * data, size_t len)`,
+ * `bool is_early_data_accepted() const`\n
+ * TLS 1.3 early data. Clients that want it hand the upgrade request over
+ * before init and skip writing it if the server accepted it. Servers refuse
+ * requests that arrived in early data unless they are safe to replay.
+ * Transports without early data return false from both queries.
  *
  * **async_shutdown**\n
  * `void async_shutdown(shutdown_handler handler)`\n
@@ -37,6 +37,7 @@
 
 #include <websocketpp/common/connection_hdl.hpp>
 #include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/memory_usage.hpp>
 #include <websocketpp/common/platforms.hpp>
 
 #include <string>
@@ -155,6 +156,16 @@ public:
         return connection_hdl();
     }
 
+    /// Add the memory held by the transport to an estimate
+    /**
+     * This transport keeps nothing worth counting.
+     *
+     * @since 0.9.0
+     *
+     * @param usage The estimate to add to
+     */
+    void get_memory_usage(memory_usage &) const {}
+
     /// Call back a function after a period of time.
     /**
      * Timers are not implemented in this transport. The timer pointer will
@@ -273,6 +284,39 @@ protected:
         m_reading = true;
     }
 
+    /// Reset the connection instead of closing it gracefully
+    /**
+     * This transport has no notion of an abortive close, ignored.
+     *
+     * @since 0.9.0
+     */
+    void reset_on_close() {}
+
+    /// Wait until data is available to read
+    /**
+     * The debug transport cannot detect readiness so handler is called
+     * immediately.
+     *
+     * @since 0.9.0
+     *
+     * @param handler The callback to invoke when data may be read
+     */
+    void async_wait_readable(read_handler handler) {
+        handler(lib::error_code(),size_t(0));
+    }
+
+    /// Read whatever is available without blocking
+    /**
+     * Not supported by the debug transport, always returns 0.
+     *
+     * @since 0.9.0
+     *
+     * @return 0
+     */
+    size_t read_available(char *, size_t) {
+        return 0;
+    }
+
     /// Asyncronous Transport Write
     /**
      * Write len bytes in buf to the output stream. Call handler to report
@@ -312,6 +356,73 @@ protected:
      */
     void set_handle(connection_hdl) {}
 
+    /// Whether a client wants its first request sent as early data
+    /**
+     * This transport has no TLS early data.
+     *
+     * @since 0.9.0
+     *
+     * @return Always false
+     */
+    bool wants_early_data() const {
+        return false;
+    }
+
+    /// Hand over the bytes to send as early data, unused by this transport
+    void set_early_data_payload(char const *, size_t) {}
+
+    /// Whether early data was accepted
+    /**
+     * @since 0.9.0
+     *
+     * @return Always false
+     */
+    bool is_early_data_accepted() const {
+        return false;
+    }
+
+    /// Whether the next write should come with a pin, see pin_write
+    /**
+     * This transport is done with the buffers of a write when it completes.
+     *
+     * @since 0.9.0
+     *
+     * @return Always false
+     */
+    bool wants_write_pin(size_t) const {
+        return false;
+    }
+
+    /// Keep the memory of the next write alive, unused by this transport
+    void pin_write(lib::shared_ptr<void>) {}
+
+    /// Begin a pass that starts the writes of many connections
+    /**
+     * This transport completes writes as they are made, so there is
+     * nothing to batch.
+     *
+     * @since 0.9.0
+     */
+    static void begin_write_batch() {}
+
+    /// End a pass started by begin_write_batch
+    static void end_write_batch() {}
+
+    /// Get the event loop that deferred writes of this connection run on
+    /**
+     * This transport has no event loop to defer writes to.
+     *
+     * @since 0.9.0
+     *
+     * @return Always null
+     */
+    void const * get_write_batch_key() const {
+        return NULL;
+    }
+
+    /// dispatch calls its handler immediately, see dispatch
+    static bool const inline_dispatch = true;
+
     /// Call given handler back within the transport's event system (if present)
     /**
      * Invoke a callback within the transport's event system if it has one. If
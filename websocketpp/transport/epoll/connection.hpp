@@ -0,0 +1,910 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_TRANSPORT_EPOLL_CON_HPP
+#define WEBSOCKETPP_TRANSPORT_EPOLL_CON_HPP
+
+#include <websocketpp/transport/epoll/base.hpp>
+#include <websocketpp/transport/epoll/loop.hpp>
+
+#include <websocketpp/transport/base/connection.hpp>
+#include <websocketpp/transport/base/endpoint.hpp>
+
+#include <websocketpp/uri.hpp>
+
+#include <websocketpp/logger/levels.hpp>
+
+#include <websocketpp/common/connection_hdl.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/memory_usage.hpp>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace websocketpp {
+namespace transport {
+namespace epoll {
+
+/// Connection transport component over a non-blocking TCP socket
+/**
+ * The socket is registered with the loop once, edge triggered for both
+ * directions, with the connection as its watcher. Reads go straight into
+ * the library's buffer with recv and writes hand the whole buffer list to
+ * sendmsg, as writev would; a write that fits in the socket buffer completes
+ * without waiting for an event. Readiness is remembered between events, so a read or write
+ * only waits for the loop once the socket returned EAGAIN.
+ *
+ * All of a connection's transport state is touched only from its loop's
+ * thread: dispatch and interrupt post there from other threads. The last
+ * reference to a connection should be released on that thread too, as its
+ * socket is closed by the destructor.
+ *
+ * @since 0.9.0
+ */
+template <typename config>
+class connection
+  : public lib::enable_shared_from_this< connection<config> >
+  , public loop::watcher
+{
+public:
+    /// Type of this connection transport component
+    typedef connection<config> type;
+    /// Type of a shared pointer to this connection transport component
+    typedef lib::shared_ptr<type> ptr;
+
+    /// transport concurrency policy
+    typedef typename config::concurrency_type concurrency_type;
+    /// Type of this transport's access logging policy
+    typedef typename config::alog_type alog_type;
+    /// Type of this transport's error logging policy
+    typedef typename config::elog_type elog_type;
+
+    typedef loop::timer_ptr timer_ptr;
+
+    explicit connection(bool is_server, const lib::shared_ptr<alog_type> & alog, const lib::shared_ptr<elog_type> & elog)
+      : m_fd(-1)
+      , m_registered(false)
+      , m_readable(false)
+      , m_writable(false)
+      , m_eof(false)
+      , m_hangup(false)
+      , m_reading(false)
+      , m_driving_read(false)
+      , m_read_scheduled(false)
+      , m_write_index(0)
+      , m_writing(false)
+      , m_driving_write(false)
+      , m_next_address(0)
+      , m_is_server(is_server)
+      , m_alog(alog)
+      , m_elog(elog)
+    {
+        m_alog->write(log::alevel::devel,"epoll con transport constructor");
+    }
+
+    ~connection() {
+        close_socket();
+    }
+
+    /// Get a shared pointer to this component
+    ptr get_shared() {
+        return type::shared_from_this();
+    }
+
+    /// Get the loop this connection runs on
+    /**
+     * @since 0.9.0
+     *
+     * @return The loop, null before the endpoint set it up
+     */
+    loop::ptr get_loop() const {
+        return m_loop;
+    }
+
+    /// Get the socket of this connection
+    /**
+     * @since 0.9.0
+     *
+     * @return The file descriptor, -1 if there is none
+     */
+    int get_native_handle() const {
+        return m_fd;
+    }
+
+    /// Tests whether or not the underlying transport is secure
+    /**
+     * This transport has no TLS.
+     *
+     * @return Always false
+     */
+    bool is_secure() const {
+        return false;
+    }
+
+    /// Set uri hook
+    /**
+     * This transport policy doesn't use the uri so it is ignored.
+     *
+     * @param u The uri to set
+     */
+    void set_uri(uri_ptr) {}
+
+    /// Get human readable remote endpoint address
+    /**
+     * @return The address and port of the peer
+     */
+    std::string get_remote_endpoint() const {
+        return m_remote_endpoint;
+    }
+
+    /// Get the connection handle
+    /**
+     * @return The handle for this connection.
+     */
+    connection_hdl get_handle() const {
+        return m_connection_hdl;
+    }
+
+    /// Add the memory held by the transport to an estimate
+    /**
+     * @since 0.9.0
+     *
+     * @param usage The estimate to add to
+     */
+    void get_memory_usage(memory_usage & usage) const {
+        usage.bytes[memory_usage::send_queue] += m_iov.capacity() *
+            sizeof(struct iovec);
+    }
+
+    /// Call back a function after a period of time.
+    /**
+     * The handler runs on the connection's loop, with
+     * transport::error::operation_aborted if the timer is cancelled first.
+     *
+     * @param duration Length of time to wait in milliseconds
+     * @param callback The function to call back when the timer has expired
+     * @return A handle that can be used to cancel the timer if it is no longer
+     * needed.
+     */
+    timer_ptr set_timer(long duration, timer_handler callback) {
+        if (!m_loop) {
+            return timer_ptr();
+        }
+        return m_loop->set_timer(duration, callback);
+    }
+
+    /// Take over an accepted socket
+    /**
+     * Called by the endpoint.
+     *
+     * @param fd The non-blocking socket
+     * @return The error of registering it with the loop, if any
+     */
+    lib::error_code adopt(int fd) {
+        m_fd = fd;
+        set_no_delay();
+        m_remote_endpoint = format_peer(fd);
+
+        // whatever arrived before the socket was registered is read by the
+        // first read rather than waiting for an edge
+        m_readable = true;
+        m_writable = true;
+        return register_socket();
+    }
+
+    /// Connect to the first of addresses that accepts
+    /**
+     * Called by the endpoint. The handler runs on the loop.
+     *
+     * @param addresses The addresses to try in order
+     * @param handler Called once connected or once every address failed
+     */
+    void connect(std::vector<struct sockaddr_storage> const & addresses,
+        connect_handler handler)
+    {
+        m_addresses = addresses;
+        m_next_address = 0;
+        m_connect_handler = handler;
+        hold_self();
+        m_loop->post(lib::bind(&type::connect_next, get_shared(),
+            lib::error_code()));
+    }
+
+    /// Handle the events of the socket
+    void on_events(uint32_t events) {
+        lib::weak_ptr<type> weak = type::weak_from_this();
+        ptr self = weak.lock();
+        if (!self) {
+            return;
+        }
+
+        if (m_connect_handler) {
+            if (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+                finish_connect();
+            }
+            return;
+        }
+
+        if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+            // no further edge follows, reads go on until recv reports the
+            // end of the stream or the error
+            m_hangup = true;
+        }
+        if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+            m_readable = true;
+            drive_read();
+        }
+        if (events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+            m_writable = true;
+            drive_write();
+        }
+    }
+protected:
+    /// Set the loop this connection runs on, called by the endpoint
+    void set_loop(loop::ptr l) {
+        m_loop = l;
+    }
+
+    /// Initialize the connection transport
+    /**
+     * @param handler The `init_handler` to call when initialization is done
+     */
+    void init(init_handler handler) {
+        m_alog->write(log::alevel::devel,"epoll connection init");
+        handler(lib::error_code());
+    }
+
+    /// Initiate an async_read for at least num_bytes bytes into buf
+    /**
+     * Completes on the loop, from the event that makes the bytes available
+     * or, if the socket is already known to be readable, from a posted
+     * handler.
+     *
+     * @param num_bytes Don't call handler until at least this many bytes have
+     * been read.
+     * @param buf The buffer to read bytes into
+     * @param len The size of buf. At maximum, this many bytes will be read.
+     * @param handler The callback to invoke when the operation is complete or
+     * ends in an error
+     */
+    void async_read_at_least(size_t num_bytes, char *buf, size_t len,
+        read_handler handler)
+    {
+        if (m_alog->static_test(log::alevel::devel)) {
+            std::stringstream s;
+            s << "epoll_con async_read_at_least: " << num_bytes;
+            m_alog->write(log::alevel::devel,s.str());
+        }
+
+        if (num_bytes > len) {
+            handler(make_error_code(error::invalid_num_bytes),size_t(0));
+            return;
+        }
+
+        if (m_reading || m_wait_handler) {
+            handler(make_error_code(error::double_read),size_t(0));
+            return;
+        }
+
+        m_buf = buf;
+        m_len = len;
+        m_bytes_needed = num_bytes;
+        m_cursor = 0;
+        m_read_handler = handler;
+        m_reading = true;
+        hold_self();
+
+        schedule_read();
+    }
+
+    /// Reset the connection instead of closing it gracefully
+    /**
+     * Sets a zero linger time, so closing the socket sends a RST.
+     *
+     * @since 0.9.0
+     */
+    void reset_on_close() {
+        if (m_fd != -1) {
+            struct linger l = {1, 0};
+            ::setsockopt(m_fd, SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+        }
+    }
+
+    /// Wait until data is available to read
+    /**
+     * @since 0.9.0
+     *
+     * @param handler The callback to invoke when data may be read
+     */
+    void async_wait_readable(read_handler handler) {
+        m_alog->write(log::alevel::devel,"epoll_con async_wait_readable");
+
+        if (m_reading || m_wait_handler) {
+            handler(make_error_code(error::double_read),size_t(0));
+            return;
+        }
+
+        m_wait_handler = handler;
+        hold_self();
+        schedule_read();
+    }
+
+    /// Read whatever is available without blocking
+    /**
+     * @since 0.9.0
+     *
+     * @param buf The buffer to read into
+     * @param len The size of buf
+     * @return The number of bytes read, 0 if none were available
+     */
+    size_t read_available(char * buf, size_t len) {
+        if (!m_readable || m_eof || m_fd == -1) {
+            return 0;
+        }
+
+        ssize_t n = ::recv(m_fd, buf, len, 0);
+        if (n > 0) {
+            if (size_t(n) < len && !m_hangup) {
+                m_readable = false;
+            }
+            return size_t(n);
+        }
+        if (n == 0) {
+            // left for the next read to report
+            m_eof = true;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            m_readable = false;
+        }
+        return 0;
+    }
+
+    /// Asyncronous Transport Write
+    /**
+     * @param buf buffer to read bytes from
+     * @param len number of bytes to write
+     * @param handler Callback to invoke with operation status.
+     */
+    void async_write(char const * buf, size_t len, transport::write_handler
+        handler)
+    {
+        std::vector<buffer> bufs(1, buffer(buf, len));
+        async_write(bufs, handler);
+    }
+
+    /// Asyncronous Transport Write (scatter-gather)
+    /**
+     * Writes as much as the socket takes right away with sendmsg. The handler
+     * runs on the loop once everything was written, never from this call.
+     *
+     * @param bufs vector of buffers to write
+     * @param handler Callback to invoke with operation status.
+     */
+    void async_write(std::vector<buffer> const & bufs, transport::write_handler
+        handler)
+    {
+        m_alog->write(log::alevel::devel,"epoll_con async_write");
+
+        if (m_writing) {
+            handler(make_error_code(error::double_write));
+            return;
+        }
+
+        m_iov.clear();
+        for (size_t i = 0; i < bufs.size(); ++i) {
+            if (bufs[i].len == 0) {
+                continue;
+            }
+            struct iovec v;
+            v.iov_base = const_cast<char *>(bufs[i].buf);
+            v.iov_len = bufs[i].len;
+            m_iov.push_back(v);
+        }
+        m_write_index = 0;
+        m_write_handler = handler;
+        m_writing = true;
+
+        if (m_driving_write || !m_writable) {
+            // completed by drive_write
+            hold_self();
+            return;
+        }
+
+        lib::error_code ec;
+        if (flush_write(ec)) {
+            m_writing = false;
+            transport::write_handler h;
+            h.swap(m_write_handler);
+            m_loop->post(lib::bind(&type::complete_write, get_shared(), h,
+                ec));
+        } else {
+            hold_self();
+        }
+    }
+
+    /// Set Connection Handle
+    /**
+     * @param hdl The new handle
+     */
+    void set_handle(connection_hdl_ref hdl) {
+        m_connection_hdl = hdl;
+    }
+
+    /// Whether a client wants its first request sent as early data
+    /**
+     * This transport has no TLS early data.
+     *
+     * @since 0.9.0
+     *
+     * @return Always false
+     */
+    bool wants_early_data() const {
+        return false;
+    }
+
+    /// Hand over the bytes to send as early data, unused by this transport
+    void set_early_data_payload(char const *, size_t) {}
+
+    /// Whether early data was accepted
+    /**
+     * @since 0.9.0
+     *
+     * @return Always false
+     */
+    bool is_early_data_accepted() const {
+        return false;
+    }
+
+    /// Whether the next write should come with a pin, see pin_write
+    /**
+     * A write holds on to its buffers until its handler runs, which the
+     * library already guarantees.
+     *
+     * @since 0.9.0
+     *
+     * @return Always false
+     */
+    bool wants_write_pin(size_t) const {
+        return false;
+    }
+
+    /// Keep the memory of the next write alive, unused by this transport
+    void pin_write(lib::shared_ptr<void>) {}
+
+    /// Begin a pass that starts the writes of many connections
+    /**
+     * Writes are issued directly on the loop, so there is nothing to batch.
+     *
+     * @since 0.9.0
+     */
+    static void begin_write_batch() {}
+
+    /// End a pass started by begin_write_batch
+    static void end_write_batch() {}
+
+    /// Get the event loop that deferred writes of this connection run on
+    /**
+     * @since 0.9.0
+     *
+     * @return Always null
+     */
+    void const * get_write_batch_key() const {
+        return NULL;
+    }
+
+    /// dispatch posts its handler when called off the loop's thread
+    static bool const inline_dispatch = false;
+
+    /// Call given handler back within the transport's event system
+    /**
+     * Runs handler before returning when called on the loop's thread and
+     * posts it to the loop otherwise.
+     *
+     * @param handler The callback to invoke
+     *
+     * @return Whether or not the transport was able to register the handler for
+     * callback.
+     */
+    lib::error_code dispatch(dispatch_handler handler) {
+        if (m_loop->running_in_this_thread()) {
+            handler();
+        } else {
+            m_loop->post(handler);
+        }
+        return lib::error_code();
+    }
+
+    /// Trigger the on_interrupt handler
+    /**
+     * Posts handler to the connection's loop.
+     *
+     * @param handler The callback to invoke
+     */
+    lib::error_code interrupt(interrupt_handler handler) {
+        m_loop->post(handler);
+        return lib::error_code();
+    }
+
+    /// Perform cleanup on socket shutdown_handler
+    /**
+     * Shuts down both directions, so the peer reads the end of the stream
+     * after the last write and a read still outstanding here ends. The
+     * socket is closed once the connection is destroyed.
+     *
+     * @param handler The `shutdown_handler` to call back when complete
+     */
+    void async_shutdown(transport::shutdown_handler handler) {
+        lib::error_code ec;
+        if (m_fd != -1) {
+            if (::shutdown(m_fd, SHUT_RDWR) == -1 && errno != ENOTCONN) {
+                ec = error::make_errno_code(errno);
+            }
+            m_readable = true;
+            schedule_read();
+        }
+        handler(ec);
+    }
+private:
+    /// Arrange for drive_read to run if it can make progress
+    void schedule_read() {
+        if (m_driving_read || m_read_scheduled || !(m_readable || m_eof)) {
+            return;
+        }
+        m_read_scheduled = true;
+        m_loop->post(lib::bind(&type::handle_scheduled_read, get_shared()));
+    }
+
+    void handle_scheduled_read() {
+        m_read_scheduled = false;
+        drive_read();
+    }
+
+    /// Fill pending reads while the socket is readable
+    /**
+     * Handlers run from here may issue the next read, which this loop then
+     * fills, without recursing.
+     */
+    void drive_read() {
+        m_driving_read = true;
+        while (m_readable || m_eof) {
+            if (m_wait_handler) {
+                read_handler h;
+                h.swap(m_wait_handler);
+                h(lib::error_code(), size_t(0));
+                continue;
+            }
+            if (!m_reading) {
+                break;
+            }
+
+            if (m_eof) {
+                complete_read(make_error_code(transport::error::eof));
+                break;
+            }
+
+            ssize_t n = ::recv(m_fd, m_buf + m_cursor, m_len - m_cursor, 0);
+            if (n > 0) {
+                // a stream socket returns less than asked for only once it
+                // has been drained, the next bytes come with a new edge
+                // unless the peer already hung up
+                if (size_t(n) < m_len - m_cursor && !m_hangup) {
+                    m_readable = false;
+                }
+                m_cursor += size_t(n);
+                if (m_cursor >= m_bytes_needed) {
+                    complete_read(lib::error_code());
+                }
+            } else if (n == 0) {
+                m_eof = true;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                m_readable = false;
+            } else if (errno != EINTR) {
+                complete_read(error::make_errno_code(errno));
+                break;
+            }
+        }
+        m_driving_read = false;
+        release_self();
+    }
+
+    void complete_read(lib::error_code const & ec) {
+        m_reading = false;
+        read_handler h;
+        h.swap(m_read_handler);
+        h(ec, m_cursor);
+    }
+
+    /// Write the pending buffers while the socket takes them
+    /**
+     * @param ec Set to the error that ended the write, if any
+     * @return Whether the write is done, successfully or not
+     */
+    bool flush_write(lib::error_code & ec) {
+        while (m_write_index < m_iov.size()) {
+            // sendmsg rather than writev for MSG_NOSIGNAL, so a reset peer
+            // is an error rather than SIGPIPE
+            struct msghdr msg;
+            std::memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &m_iov[m_write_index];
+            msg.msg_iovlen = std::min<size_t>(m_iov.size() - m_write_index,
+                IOV_MAX);
+            ssize_t n = ::sendmsg(m_fd, &msg, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    m_writable = false;
+                    return false;
+                }
+                ec = error::make_errno_code(errno);
+                return true;
+            }
+
+            size_t left = size_t(n);
+            while (left > 0 && left >= m_iov[m_write_index].iov_len) {
+                left -= m_iov[m_write_index].iov_len;
+                ++m_write_index;
+            }
+            if (left > 0) {
+                // a partial write means the socket buffer is full
+                struct iovec & v = m_iov[m_write_index];
+                v.iov_base = static_cast<char *>(v.iov_base) + left;
+                v.iov_len -= left;
+                m_writable = false;
+                return false;
+            }
+        }
+        ec = lib::error_code();
+        return true;
+    }
+
+    /// Continue the pending write while the socket is writable
+    void drive_write() {
+        m_driving_write = true;
+        while (m_writing && m_writable) {
+            lib::error_code ec;
+            if (!flush_write(ec)) {
+                break;
+            }
+            m_writing = false;
+            transport::write_handler h;
+            h.swap(m_write_handler);
+            h(ec);
+        }
+        m_driving_write = false;
+        release_self();
+    }
+
+    void complete_write(transport::write_handler h, lib::error_code ec) {
+        h(ec);
+    }
+
+    /// Keep the connection and the loop going while it owes a callback
+    /**
+     * The library's read and write handlers may hold only a raw pointer to
+     * the connection, so, as the handlers bound into asio operations do, the
+     * transport holds a reference to itself and counts as work on the loop
+     * until its outstanding operations completed.
+     */
+    void hold_self() {
+        if (!m_self) {
+            m_self = get_shared();
+            m_loop->add_work();
+        }
+    }
+
+    /// Drop what hold_self took once no operation is outstanding
+    /**
+     * Callers hold their own reference.
+     */
+    void release_self() {
+        if (m_self && !m_reading && !m_wait_handler && !m_writing &&
+            !m_connect_handler)
+        {
+            m_loop->remove_work();
+            m_self.reset();
+        }
+    }
+
+    /// Start connecting to the next address, or report the last error
+    void connect_next(lib::error_code ec) {
+        close_socket();
+
+        while (m_next_address < m_addresses.size()) {
+            struct sockaddr_storage const & a = m_addresses[m_next_address++];
+            socklen_t len = a.ss_family == AF_INET6 ?
+                sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+
+            int fd = ::socket(a.ss_family, SOCK_STREAM | SOCK_NONBLOCK |
+                SOCK_CLOEXEC, 0);
+            if (fd == -1) {
+                ec = error::make_errno_code(errno);
+                continue;
+            }
+            m_fd = fd;
+
+            if (::connect(fd, reinterpret_cast<struct sockaddr const *>(&a),
+                len) == 0 || errno == EINPROGRESS)
+            {
+                m_readable = false;
+                m_writable = false;
+                m_hangup = false;
+                ec = register_socket();
+                if (!ec) {
+                    return;
+                }
+            } else {
+                ec = error::make_errno_code(errno);
+            }
+            close_socket();
+        }
+
+        if (!ec) {
+            ec = make_error_code(error::invalid_host);
+        }
+        connect_handler h;
+        h.swap(m_connect_handler);
+        h(ec);
+        release_self();
+    }
+
+    /// Check the outcome of a connect that became writable
+    void finish_connect() {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (::getsockopt(m_fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1) {
+            err = errno;
+        }
+        if (err == EINPROGRESS) {
+            return;
+        }
+        if (err != 0) {
+            connect_next(error::make_errno_code(err));
+            return;
+        }
+
+        set_no_delay();
+        m_remote_endpoint = format_peer(m_fd);
+        m_readable = true;
+        m_writable = true;
+        m_addresses.clear();
+
+        connect_handler h;
+        h.swap(m_connect_handler);
+        h(lib::error_code());
+        release_self();
+    }
+
+    void set_no_delay() {
+        int one = 1;
+        ::setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    lib::error_code register_socket() {
+        lib::error_code ec = m_loop->add(m_fd, this,
+            EPOLLIN | EPOLLOUT | EPOLLRDHUP);
+        m_registered = !ec;
+        return ec;
+    }
+
+    void close_socket() {
+        if (m_fd == -1) {
+            return;
+        }
+        if (m_registered) {
+            m_loop->remove(m_fd, this);
+            m_registered = false;
+        }
+        ::close(m_fd);
+        m_fd = -1;
+    }
+
+    static std::string format_peer(int fd) {
+        struct sockaddr_storage a;
+        socklen_t len = sizeof(a);
+        if (::getpeername(fd, reinterpret_cast<struct sockaddr *>(&a), &len)
+            == -1)
+        {
+            return "Unknown";
+        }
+
+        char host[INET6_ADDRSTRLEN] = {};
+        std::stringstream s;
+        if (a.ss_family == AF_INET6) {
+            struct sockaddr_in6 const & v6 =
+                reinterpret_cast<struct sockaddr_in6 const &>(a);
+            ::inet_ntop(AF_INET6, &v6.sin6_addr, host, sizeof(host));
+            s << "[" << host << "]:" << ntohs(v6.sin6_port);
+        } else {
+            struct sockaddr_in const & v4 =
+                reinterpret_cast<struct sockaddr_in const &>(a);
+            ::inet_ntop(AF_INET, &v4.sin_addr, host, sizeof(host));
+            s << host << ":" << ntohs(v4.sin_port);
+        }
+        return s.str();
+    }
+
+    template <typename> friend class endpoint;
+
+    loop::ptr       m_loop;
+    ptr             m_self;
+    int             m_fd;
+    bool            m_registered;
+    bool            m_readable;
+    bool            m_writable;
+    bool            m_eof;
+    bool            m_hangup;
+
+    // Read state
+    char *          m_buf;
+    size_t          m_len;
+    size_t          m_bytes_needed;
+    size_t          m_cursor;
+    read_handler    m_read_handler;
+    read_handler    m_wait_handler;
+    bool            m_reading;
+    bool            m_driving_read;
+    bool            m_read_scheduled;
+
+    // Write state
+    std::vector<struct iovec> m_iov;
+    size_t          m_write_index;
+    transport::write_handler m_write_handler;
+    bool            m_writing;
+    bool            m_driving_write;
+
+    // Connect state
+    std::vector<struct sockaddr_storage> m_addresses;
+    size_t          m_next_address;
+    connect_handler m_connect_handler;
+
+    connection_hdl  m_connection_hdl;
+    bool const      m_is_server;
+    lib::shared_ptr<alog_type>     m_alog;
+    lib::shared_ptr<elog_type>     m_elog;
+    std::string     m_remote_endpoint;
+};
+
+
+} // namespace epoll
+} // namespace transport
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_TRANSPORT_EPOLL_CON_HPP
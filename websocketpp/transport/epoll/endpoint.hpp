@@ -0,0 +1,598 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_TRANSPORT_EPOLL_HPP
+#define WEBSOCKETPP_TRANSPORT_EPOLL_HPP
+
+#include <websocketpp/transport/base/endpoint.hpp>
+#include <websocketpp/transport/epoll/connection.hpp>
+#include <websocketpp/transport/epoll/loop.hpp>
+
+#include <websocketpp/uri.hpp>
+#include <websocketpp/error.hpp>
+#include <websocketpp/logger/levels.hpp>
+
+#include <websocketpp/common/memory.hpp>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace websocketpp {
+namespace transport {
+namespace epoll {
+
+/// Endpoint transport component over an epoll loop
+/**
+ * A Linux only alternative to the asio transport with less between the
+ * socket and the library: one edge triggered epoll loop per thread, the
+ * connection itself as the state the loop calls back into, and reads and
+ * writes made directly with recv and sendmsg. See loop for the threading
+ * rules.
+ *
+ * Call init_epoll, then listen and start_accept for a server or connect
+ * for a client, then run. To spread connections over several threads give
+ * each thread an endpoint of its own.
+ *
+ * There is no TLS, proxy support or connection migration.
+ *
+ * @since 0.9.0
+ */
+template <typename config>
+class endpoint : public loop::watcher {
+public:
+    /// Type of this endpoint transport component
+    typedef endpoint type;
+    /// Type of a pointer to this endpoint transport component
+    typedef lib::shared_ptr<type> ptr;
+
+    /// Type of this endpoint's concurrency policy
+    typedef typename config::concurrency_type concurrency_type;
+    /// Type of this endpoint's error logging policy
+    typedef typename config::elog_type elog_type;
+    /// Type of this endpoint's access logging policy
+    typedef typename config::alog_type alog_type;
+
+    /// Type of this endpoint transport component's associated connection
+    /// transport component.
+    typedef epoll::connection<config> transport_con_type;
+    /// Type of a shared pointer to this endpoint transport component's
+    /// associated connection transport component
+    typedef typename transport_con_type::ptr transport_con_ptr;
+
+    /// Type of a pointer to the loop
+    typedef loop::ptr loop_ptr;
+
+    explicit endpoint()
+      : m_listen_fd(-1)
+      , m_reuse_addr(false)
+      , m_listen_backlog(SOMAXCONN)
+      , m_accepting(false) {}
+
+    ~endpoint() {
+        close_listener();
+    }
+
+    /// transport::epoll objects are moveable but not copyable or assignable.
+    /// A listening endpoint keeps listening once moved.
+    endpoint(endpoint const & src) = delete;
+    endpoint & operator=(endpoint const & rhs) = delete;
+
+    endpoint(endpoint && src)
+      : m_loop(std::move(src.m_loop))
+      , m_listen_fd(src.m_listen_fd)
+      , m_reuse_addr(src.m_reuse_addr)
+      , m_listen_backlog(src.m_listen_backlog)
+      , m_pending(std::move(src.m_pending))
+      , m_accepting(false)
+      , m_elog(src.m_elog)
+      , m_alog(src.m_alog)
+    {
+        src.m_listen_fd = -1;
+        if (m_listen_fd != -1) {
+            // the loop calls back the watcher it was given
+            m_loop->remove(m_listen_fd, &src);
+            m_loop->add(m_listen_fd, this, EPOLLIN);
+        }
+    }
+
+    /// Create a loop for this endpoint (exception free)
+    /**
+     * @param ec Set to the error of creating the loop, if any
+     */
+    void init_epoll(lib::error_code & ec) {
+        loop_ptr l = lib::make_shared<loop>();
+        l->open(ec);
+        if (!ec) {
+            init_epoll(l, ec);
+        }
+    }
+
+    /// Run this endpoint on an existing loop (exception free)
+    /**
+     * Endpoints sharing a loop, for example a server and the client
+     * connections it makes to other servers, run on the same thread.
+     *
+     * @param l The loop, which open was called on
+     * @param ec Set to no_loop if l is not open
+     */
+    void init_epoll(loop_ptr l, lib::error_code & ec) {
+        if (!l || !l->is_open()) {
+            ec = make_error_code(error::no_loop);
+            return;
+        }
+        m_loop = l;
+        ec = lib::error_code();
+    }
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+    /// Create a loop for this endpoint
+    void init_epoll() {
+        lib::error_code ec;
+        init_epoll(ec);
+        if (ec) { throw exception(ec); }
+    }
+
+    /// Run this endpoint on an existing loop
+    /**
+     * @param l The loop, which open was called on
+     */
+    void init_epoll(loop_ptr l) {
+        lib::error_code ec;
+        init_epoll(l, ec);
+        if (ec) { throw exception(ec); }
+    }
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
+    /// Get the loop of this endpoint
+    /**
+     * @return The loop, null before init_epoll
+     */
+    loop_ptr get_loop() const {
+        return m_loop;
+    }
+
+    /// Run the loop until there is no more work or stop is called
+    /**
+     * @return The number of handlers, events and timers run
+     */
+    size_t run() {
+        return m_loop->run();
+    }
+
+    /// Run what is ready on the loop without waiting
+    /**
+     * @return The number of handlers, events and timers run
+     */
+    size_t poll() {
+        return m_loop->poll();
+    }
+
+    /// Make run return as soon as possible, see loop::stop
+    void stop() {
+        m_loop->stop();
+    }
+
+    /// Whether the loop was stopped
+    bool stopped() const {
+        return m_loop->stopped();
+    }
+
+    /// Set whether listening sockets use SO_REUSEADDR
+    /**
+     * Must be called before listen.
+     *
+     * @param value Whether or not to use the SO_REUSEADDR option
+     */
+    void set_reuse_addr(bool value) {
+        m_reuse_addr = value;
+    }
+
+    /// Set the backlog of listening sockets
+    /**
+     * Must be called before listen. The default is SOMAXCONN.
+     *
+     * @param backlog The maximum length of the queue of pending connections
+     */
+    void set_listen_backlog(int backlog) {
+        m_listen_backlog = backlog;
+    }
+
+    /// Listen on a port of every local address (exception free)
+    /**
+     * Listens on IPv6 with IPv4 mapped addresses, or on IPv4 alone where
+     * IPv6 is not available.
+     *
+     * @param port The port to listen on
+     * @param ec Set to indicate what error occurred, if any.
+     */
+    void listen(uint16_t port, lib::error_code & ec) {
+        struct sockaddr_in6 v6;
+        std::memset(&v6, 0, sizeof(v6));
+        v6.sin6_family = AF_INET6;
+        v6.sin6_addr = in6addr_any;
+        v6.sin6_port = htons(port);
+        listen(reinterpret_cast<struct sockaddr const *>(&v6), sizeof(v6),
+            ec);
+        if (ec != lib::error_code(EAFNOSUPPORT, lib::system_category())) {
+            return;
+        }
+
+        struct sockaddr_in v4;
+        std::memset(&v4, 0, sizeof(v4));
+        v4.sin_family = AF_INET;
+        v4.sin_addr.s_addr = htonl(INADDR_ANY);
+        v4.sin_port = htons(port);
+        listen(reinterpret_cast<struct sockaddr const *>(&v4), sizeof(v4),
+            ec);
+    }
+
+    /// Listen on a host and service (exception free)
+    /**
+     * host and service are resolved with getaddrinfo and the first address
+     * is used.
+     *
+     * @param host The address or name to listen on
+     * @param service The port number or service name to listen on
+     * @param ec Set to indicate what error occurred, if any.
+     */
+    void listen(std::string const & host, std::string const & service,
+        lib::error_code & ec)
+    {
+        struct addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+
+        struct addrinfo * res = NULL;
+        if (::getaddrinfo(host.c_str(), service.c_str(), &hints, &res) != 0 ||
+            !res)
+        {
+            ec = make_error_code(transport::error::resolve_failed);
+            return;
+        }
+        listen(res->ai_addr, res->ai_addrlen, ec);
+        ::freeaddrinfo(res);
+    }
+
+    /// Listen on an address (exception free)
+    /**
+     * @param addr The address to listen on
+     * @param len The length of addr
+     * @param ec Set to indicate what error occurred, if any.
+     */
+    void listen(struct sockaddr const * addr, socklen_t len,
+        lib::error_code & ec)
+    {
+        if (!m_loop) {
+            ec = make_error_code(error::no_loop);
+            return;
+        }
+        if (m_listen_fd != -1) {
+            ec = websocketpp::error::make_error_code(
+                websocketpp::error::invalid_state);
+            return;
+        }
+
+        m_alog->write(log::alevel::devel,"epoll::listen");
+
+        int fd = ::socket(addr->sa_family, SOCK_STREAM | SOCK_NONBLOCK |
+            SOCK_CLOEXEC, 0);
+        if (fd == -1) {
+            ec = error::make_errno_code(errno);
+            return;
+        }
+
+        int one = 1;
+        int zero = 0;
+        if (m_reuse_addr) {
+            ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        }
+        if (addr->sa_family == AF_INET6) {
+            ::setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+        }
+
+        if (::bind(fd, addr, len) == -1 ||
+            ::listen(fd, m_listen_backlog) == -1)
+        {
+            ec = error::make_errno_code(errno);
+            ::close(fd);
+            return;
+        }
+
+        ec = m_loop->add(fd, this, EPOLLIN);
+        if (ec) {
+            ::close(fd);
+            return;
+        }
+        m_listen_fd = fd;
+    }
+
+    /// Stop listening (exception free)
+    /**
+     * Closes the listening socket. Pending accepts fail with
+     * operation_canceled, which ends the server's accept loop.
+     *
+     * @param ec Set to indicate what error occurred, if any.
+     */
+    void stop_listening(lib::error_code & ec) {
+        if (m_listen_fd == -1) {
+            ec = websocketpp::error::make_error_code(
+                websocketpp::error::async_accept_not_listening);
+            return;
+        }
+
+        m_alog->write(log::alevel::devel,"epoll::stop_listening");
+        close_listener();
+        ec = lib::error_code();
+    }
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+    /// Listen on a port of every local address
+    void listen(uint16_t port) {
+        lib::error_code ec;
+        listen(port,ec);
+        if (ec) { throw exception(ec); }
+    }
+
+    /// Listen on a host and service
+    void listen(std::string const & host, std::string const & service) {
+        lib::error_code ec;
+        listen(host,service,ec);
+        if (ec) { throw exception(ec); }
+    }
+
+    /// Stop listening
+    void stop_listening() {
+        lib::error_code ec;
+        stop_listening(ec);
+        if (ec) { throw exception(ec); }
+    }
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
+    /// Check if the endpoint is listening
+    /**
+     * @return Whether or not the endpoint is listening.
+     */
+    bool is_listening() const {
+        return m_listen_fd != -1;
+    }
+
+    /// Tests whether or not the underlying transport is secure
+    /**
+     * @return Always false, this transport has no TLS
+     */
+    bool is_secure() const {
+        return false;
+    }
+
+    /// Accept the connections waiting on the listening socket
+    void on_events(uint32_t) {
+        accept_pending();
+    }
+protected:
+    /// Initialize logging
+    /**
+     * The loggers are located in the main endpoint class. As such, the
+     * transport doesn't have direct access to them. This method is called
+     * by the endpoint constructor to allow shared logging from the transport
+     * component.
+     *
+     * @param a A pointer to the access logger to use.
+     * @param e A pointer to the error logger to use.
+     */
+    void init_logging(lib::shared_ptr<alog_type> a, lib::shared_ptr<elog_type> e) {
+        m_elog = e;
+        m_alog = a;
+    }
+
+    /// Accept the next connection attempt into tcon (exception free)
+    /**
+     * The callback always runs on the loop, never from this call.
+     *
+     * @param tcon The connection to accept into.
+     * @param callback The function to call when the operation is complete.
+     * @param ec A status code indicating an error, if any.
+     */
+    void async_accept(transport_con_ptr tcon, accept_handler callback,
+        lib::error_code & ec)
+    {
+        if (m_listen_fd == -1) {
+            ec = websocketpp::error::make_error_code(
+                websocketpp::error::async_accept_not_listening);
+            return;
+        }
+
+        m_alog->write(log::alevel::devel, "epoll::async_accept");
+
+        m_loop->post(lib::bind(&type::queue_accept, this, tcon, callback));
+        ec = lib::error_code();
+    }
+
+#ifndef _WEBSOCKETPP_NO_EXCEPTIONS_
+    /// Accept the next connection attempt into tcon
+    /**
+     * @param tcon The connection to accept into.
+     * @param callback The function to call when the operation is complete.
+     */
+    void async_accept(transport_con_ptr tcon, accept_handler callback) {
+        lib::error_code ec;
+        async_accept(tcon,callback,ec);
+        if (ec) { throw exception(ec); }
+    }
+#endif // _WEBSOCKETPP_NO_EXCEPTIONS_
+
+    /// Initiate a new connection
+    /**
+     * The host of u is resolved with getaddrinfo, which blocks, and each
+     * address is tried in turn.
+     *
+     * @param tcon A pointer to the transport connection component of the
+     * connection to connect.
+     * @param u A URI pointer to the URI to connect to.
+     * @param cb The function to call back with the results when complete.
+     */
+    void async_connect(transport_con_ptr tcon, uri_ptr u, connect_handler cb) {
+        struct addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        std::string host = u->get_host();
+        if (host.size() > 1 && host[0] == '[') {
+            host = host.substr(1, host.size() - 2);
+        }
+
+        struct addrinfo * res = NULL;
+        if (::getaddrinfo(host.c_str(), u->get_port_str().c_str(), &hints,
+            &res) != 0)
+        {
+            cb(make_error_code(transport::error::resolve_failed));
+            return;
+        }
+
+        std::vector<struct sockaddr_storage> addresses;
+        for (struct addrinfo * a = res; a; a = a->ai_next) {
+            struct sockaddr_storage s;
+            std::memset(&s, 0, sizeof(s));
+            std::memcpy(&s, a->ai_addr, a->ai_addrlen);
+            addresses.push_back(s);
+        }
+        ::freeaddrinfo(res);
+
+        tcon->connect(addresses, cb);
+    }
+
+    /// Initialize a connection
+    /**
+     * @param tcon A pointer to the transport portion of the connection.
+     * @return A status code indicating the success or failure of the operation
+     */
+    lib::error_code init(transport_con_ptr tcon) {
+        if (!m_loop) {
+            return make_error_code(error::no_loop);
+        }
+        tcon->set_loop(m_loop);
+        return lib::error_code();
+    }
+private:
+    typedef std::pair<transport_con_ptr, accept_handler> pending_accept;
+
+    void queue_accept(transport_con_ptr tcon, accept_handler callback) {
+        if (m_listen_fd == -1) {
+            callback(websocketpp::error::make_error_code(
+                websocketpp::error::operation_canceled));
+            return;
+        }
+        // a pending accept keeps the loop running, as a listening socket
+        // alone does not
+        m_pending.push_back(pending_accept(tcon, callback));
+        m_loop->add_work();
+        accept_pending();
+    }
+
+    /// Accept into the pending connections while there are connections to
+    /// accept
+    /**
+     * Callbacks run from here may queue the next accept, which is posted, so
+     * this never recurses.
+     */
+    void accept_pending() {
+        if (m_accepting) {
+            return;
+        }
+        m_accepting = true;
+
+        while (!m_pending.empty() && m_listen_fd != -1) {
+            int fd = ::accept4(m_listen_fd, NULL, NULL,
+                SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd == -1) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                }
+            }
+
+            // the callback may stop listening, which takes m_pending
+            pending_accept p = m_pending.front();
+            m_pending.erase(m_pending.begin());
+            lib::error_code ec = fd == -1 ? error::make_errno_code(errno) :
+                p.first->adopt(fd);
+            if (ec && fd != -1) {
+                ::close(fd);
+            }
+            p.second(ec);
+            m_loop->remove_work();
+        }
+        m_accepting = false;
+    }
+
+    void close_listener() {
+        if (m_listen_fd == -1) {
+            return;
+        }
+        m_loop->remove(m_listen_fd, this);
+        ::close(m_listen_fd);
+        m_listen_fd = -1;
+
+        std::vector<pending_accept> pending;
+        pending.swap(m_pending);
+        for (size_t i = 0; i < pending.size(); ++i) {
+            m_loop->post(lib::bind(pending[i].second,
+                websocketpp::error::make_error_code(
+                    websocketpp::error::operation_canceled)));
+            m_loop->remove_work();
+        }
+    }
+
+    loop_ptr        m_loop;
+    int             m_listen_fd;
+    bool            m_reuse_addr;
+    int             m_listen_backlog;
+    std::vector<pending_accept> m_pending;
+    bool            m_accepting;
+
+    lib::shared_ptr<elog_type>     m_elog;
+    lib::shared_ptr<alog_type>     m_alog;
+};
+
+} // namespace epoll
+} // namespace transport
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_TRANSPORT_EPOLL_HPP
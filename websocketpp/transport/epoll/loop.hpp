@@ -0,0 +1,517 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_TRANSPORT_EPOLL_LOOP_HPP
+#define WEBSOCKETPP_TRANSPORT_EPOLL_LOOP_HPP
+
+#include <websocketpp/transport/epoll/base.hpp>
+#include <websocketpp/transport/base/connection.hpp>
+
+#include <websocketpp/common/chrono.hpp>
+#include <websocketpp/common/functional.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/thread.hpp>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <vector>
+
+namespace websocketpp {
+namespace transport {
+namespace epoll {
+
+/// A single threaded event loop over an edge triggered epoll set
+/**
+ * Each loop is run by one thread. File descriptors are registered once,
+ * with EPOLLET, together with a watcher that the loop calls with their
+ * events; the watcher is the state of the connection itself, so there is
+ * no operation object or handler allocation per read or write.
+ *
+ * post and set_timer may be called from any thread. Everything else, and
+ * every watcher, runs on the thread calling run or poll. Handlers posted
+ * from that thread are queued without a lock or a wakeup.
+ *
+ * @since 0.9.0
+ */
+class loop {
+public:
+    /// Type of a shared pointer to a loop
+    typedef lib::shared_ptr<loop> ptr;
+    /// Type of the handlers accepted by post
+    typedef lib::function<void()> handler;
+    /// Type of the clock timers run on
+    typedef lib::chrono::steady_clock clock;
+
+    /// Receives the readiness events of a registered file descriptor
+    class watcher {
+    public:
+        /// Called on the loop's thread with the epoll events of the fd
+        virtual void on_events(uint32_t events) = 0;
+    protected:
+        ~watcher() {}
+    };
+
+    /// A pending timer, see set_timer
+    class timer {
+    public:
+        explicit timer(loop * l, timer_handler h)
+          : m_loop(l), m_handler(h), m_done(false) {}
+
+        /// Cancel the timer
+        /**
+         * Unless it already ran, the handler is posted with
+         * transport::error::operation_aborted.
+         */
+        void cancel() {
+            m_loop->cancel_timer(*this);
+        }
+    private:
+        friend class loop;
+
+        loop * m_loop;
+        timer_handler m_handler;
+        bool m_done;
+    };
+
+    /// Type of a shared pointer to a timer
+    typedef lib::shared_ptr<timer> timer_ptr;
+
+    loop()
+      : m_epoll(-1)
+      , m_wake(-1)
+      , m_work(0)
+      , m_stopped(false)
+      , m_wake_pending(false)
+      , m_removals(0)
+      , m_live_timers(0) {}
+
+    ~loop() {
+        if (m_wake != -1) {
+            ::close(m_wake);
+        }
+        if (m_epoll != -1) {
+            ::close(m_epoll);
+        }
+    }
+
+    /// Create the epoll set and the wakeup eventfd
+    /**
+     * @param ec Set to the errno of a failed system call
+     */
+    void open(lib::error_code & ec) {
+        if (m_epoll != -1) {
+            ec = lib::error_code();
+            return;
+        }
+
+        m_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+        if (m_epoll == -1) {
+            ec = error::make_errno_code(errno);
+            return;
+        }
+
+        m_wake = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.ptr = NULL;
+        if (m_wake == -1 ||
+            ::epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wake, &ev) == -1)
+        {
+            ec = error::make_errno_code(errno);
+            return;
+        }
+        ec = lib::error_code();
+    }
+
+    /// Whether open succeeded
+    bool is_open() const {
+        return m_wake != -1;
+    }
+
+    /// Register fd for edge triggered events
+    /**
+     * A registered fd alone does not keep run going, its owner counts the
+     * operations it waits on with add_work.
+     *
+     * @param fd The file descriptor
+     * @param w The watcher to call with its events
+     * @param events The epoll events to wait for, EPOLLET is added
+     * @return The errno of a failed epoll_ctl, if any
+     */
+    lib::error_code add(int fd, watcher * w, uint32_t events) {
+        struct epoll_event ev = {};
+        ev.events = events | EPOLLET;
+        ev.data.ptr = w;
+        if (::epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            return error::make_errno_code(errno);
+        }
+        return lib::error_code();
+    }
+
+    /// Unregister an fd added with add
+    /**
+     * Events of fd already read by the loop are not delivered to w.
+     *
+     * @param fd The file descriptor
+     * @param w The watcher it was added with
+     */
+    void remove(int fd, watcher * w) {
+        ::epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, NULL);
+        {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            m_removed.push_back(w);
+        }
+        ++m_removals;
+        wake();
+    }
+
+    /// Count an operation that will complete from an event
+    /**
+     * run keeps going while there is work, as it does for asio's pending
+     * operations. Every add_work is matched by a remove_work once the
+     * operation completed.
+     */
+    void add_work() {
+        ++m_work;
+    }
+
+    /// End an operation counted by add_work
+    void remove_work() {
+        if (--m_work == 0) {
+            wake();
+        }
+    }
+
+    /// Whether the calling thread is the one running this loop
+    bool running_in_this_thread() const {
+        return current() == this;
+    }
+
+    /// Run handler on the loop's thread
+    /**
+     * Safe to call from any thread.
+     *
+     * @param h The handler
+     */
+    void post(handler h) {
+        if (running_in_this_thread()) {
+            m_local.push_back(std::move(h));
+            return;
+        }
+
+        {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            m_remote.push_back(std::move(h));
+        }
+        wake();
+    }
+
+    /// Call handler after a number of milliseconds
+    /**
+     * Safe to call from any thread. A pending timer counts as work.
+     *
+     * @param duration Milliseconds to wait
+     * @param h The handler, called with no error once the timer expires
+     * @return The timer, which may be cancelled
+     */
+    timer_ptr set_timer(long duration, timer_handler h) {
+        timer_ptr t = lib::make_shared<timer>(this, h);
+        clock::time_point at = clock::now() +
+            lib::chrono::milliseconds(duration);
+
+        bool earliest;
+        {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            m_timers.push_back(entry(at, t));
+            std::push_heap(m_timers.begin(), m_timers.end(), later());
+            earliest = m_timers.front().second == t;
+            ++m_live_timers;
+        }
+        ++m_work;
+
+        if (earliest && !running_in_this_thread()) {
+            wake();
+        }
+        return t;
+    }
+
+    /// Run handlers and watchers until there is no work left or stop is
+    /// called
+    /**
+     * @return The number of handlers, watchers and timers run
+     */
+    size_t run() {
+        return run_loop(true);
+    }
+
+    /// Run what is ready without waiting
+    /**
+     * @return The number of handlers, watchers and timers run
+     */
+    size_t poll() {
+        return run_loop(false);
+    }
+
+    /// Make run return as soon as possible
+    /**
+     * Safe to call from any thread. Later calls to run return at once until
+     * restart is called.
+     */
+    void stop() {
+        m_stopped = true;
+        wake();
+    }
+
+    /// Whether stop was called since the last restart
+    bool stopped() const {
+        return m_stopped;
+    }
+
+    /// Allow run to be called again after stop
+    void restart() {
+        m_stopped = false;
+    }
+private:
+    typedef std::pair<clock::time_point, timer_ptr> entry;
+
+    struct later {
+        bool operator()(entry const & a, entry const & b) const {
+            return a.first > b.first;
+        }
+    };
+
+    static loop *& current() {
+        static thread_local loop * instance = NULL;
+        return instance;
+    }
+
+    void wake() {
+        if (m_wake_pending.exchange(true)) {
+            return;
+        }
+        uint64_t one = 1;
+        ssize_t r = ::write(m_wake, &one, sizeof(one));
+        (void)r;
+    }
+
+    void cancel_timer(timer & t) {
+        timer_handler h;
+        {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            if (t.m_done) {
+                return;
+            }
+            t.m_done = true;
+            h.swap(t.m_handler);
+            --m_live_timers;
+        }
+        --m_work;
+        post(lib::bind(h, transport::error::make_error_code(
+            transport::error::operation_aborted)));
+
+        prune_timers();
+    }
+
+    /// Drop cancelled timers once they make up most of the heap
+    void prune_timers() {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        if (m_timers.size() < 64 || m_timers.size() < m_live_timers * 4) {
+            return;
+        }
+        m_timers.erase(std::remove_if(m_timers.begin(), m_timers.end(),
+            [](entry const & e) { return e.second->m_done; }),
+            m_timers.end());
+        std::make_heap(m_timers.begin(), m_timers.end(), later());
+    }
+
+    /// Milliseconds until the next timer, -1 for none
+    int next_timeout() {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        if (m_timers.empty()) {
+            return -1;
+        }
+        clock::duration left = m_timers.front().first - clock::now();
+        if (left <= clock::duration::zero()) {
+            return 0;
+        }
+        // round up, so the timer has expired when epoll_wait returns
+        return int(lib::chrono::duration_cast<lib::chrono::milliseconds>(
+            left + lib::chrono::milliseconds(1) -
+            lib::chrono::nanoseconds(1)).count());
+    }
+
+    size_t run_timers() {
+        std::vector<timer_handler> ready;
+        {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            clock::time_point now = clock::now();
+            while (!m_timers.empty() && m_timers.front().first <= now) {
+                timer & t = *m_timers.front().second;
+                if (!t.m_done) {
+                    t.m_done = true;
+                    ready.push_back(timer_handler());
+                    ready.back().swap(t.m_handler);
+                    --m_live_timers;
+                }
+                std::pop_heap(m_timers.begin(), m_timers.end(), later());
+                m_timers.pop_back();
+            }
+        }
+
+        for (size_t i = 0; i < ready.size(); ++i) {
+            --m_work;
+            ready[i](lib::error_code());
+        }
+        return ready.size();
+    }
+
+    size_t run_handlers() {
+        {
+            lib::lock_guard<lib::mutex> guard(m_lock);
+            if (!m_remote.empty()) {
+                m_local.insert(m_local.end(),
+                    std::make_move_iterator(m_remote.begin()),
+                    std::make_move_iterator(m_remote.end()));
+                m_remote.clear();
+            }
+        }
+
+        m_running.swap(m_local);
+        size_t n = m_running.size();
+        for (size_t i = 0; i < n; ++i) {
+            m_running[i]();
+        }
+        m_running.clear();
+        return n;
+    }
+
+    bool has_handlers() {
+        if (!m_local.empty()) {
+            return true;
+        }
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        return !m_remote.empty();
+    }
+
+    size_t wait_events(int timeout) {
+        struct epoll_event events[64];
+        uint64_t removals = m_removals.load();
+
+        int n = ::epoll_wait(m_epoll, events, 64, timeout);
+        size_t ran = 0;
+        for (int i = 0; i < n; ++i) {
+            watcher * w = static_cast<watcher *>(events[i].data.ptr);
+            if (!w) {
+                // cleared first, so a wake racing the read is not lost
+                m_wake_pending = false;
+                uint64_t count;
+                ssize_t r = ::read(m_wake, &count, sizeof(count));
+                (void)r;
+                continue;
+            }
+            if (m_removals.load() != removals && was_removed(w)) {
+                continue;
+            }
+            w->on_events(events[i].events);
+            ++ran;
+        }
+
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        m_removed.clear();
+        return ran;
+    }
+
+    bool was_removed(watcher * w) {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        return std::find(m_removed.begin(), m_removed.end(), w) !=
+            m_removed.end();
+    }
+
+    size_t run_loop(bool block) {
+        loop * outer = current();
+        current() = this;
+
+        size_t ran = 0;
+        while (!m_stopped) {
+            ran += run_handlers();
+            ran += run_timers();
+
+            bool const idle = m_work.load() == 0 && !has_handlers();
+            if (idle && block) {
+                break;
+            }
+
+            int timeout = 0;
+            if (block && !has_handlers()) {
+                timeout = next_timeout();
+            }
+            ran += wait_events(timeout);
+            ran += run_timers();
+
+            if (!block) {
+                ran += run_handlers();
+                break;
+            }
+        }
+
+        current() = outer;
+        return ran;
+    }
+
+    int m_epoll;
+    int m_wake;
+    /// Outstanding operations and pending timers
+    std::atomic<long> m_work;
+    std::atomic<bool> m_stopped;
+    std::atomic<bool> m_wake_pending;
+
+    lib::mutex m_lock;
+    /// Handlers posted from other threads, protected by m_lock
+    std::vector<handler> m_remote;
+    /// Watchers removed since the last epoll_wait, protected by m_lock
+    std::vector<watcher *> m_removed;
+    std::atomic<uint64_t> m_removals;
+    /// Timer heap, protected by m_lock
+    std::vector<entry> m_timers;
+    size_t m_live_timers;
+
+    /// Handlers posted from the loop's own thread
+    std::vector<handler> m_local;
+    std::vector<handler> m_running;
+};
+
+} // namespace epoll
+} // namespace transport
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_TRANSPORT_EPOLL_LOOP_HPP
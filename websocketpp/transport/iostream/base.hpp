@@ -60,6 +60,10 @@ typedef lib::function<lib::error_code(connection_hdl, std::vector<transport::buf
 /// a transport shutdown.
 typedef lib::function<lib::error_code(connection_hdl)> shutdown_handler;
 
+/// The type and signature of the callback used by iostream transport to
+/// signal that pulled output is waiting, see connection::set_pull_output
+typedef lib::function<void(connection_hdl)> output_ready_handler;
+
 /// iostream transport errors
 namespace error {
 enum value {
@@ -78,7 +82,10 @@ enum value {
     output_stream_required,
 
     /// stream error
-    bad_stream
+    bad_stream,
+
+    /// async_write called while pulled output was still pending
+    double_write
 };
 
 /// iostream transport error category
@@ -102,6 +109,8 @@ class category : public lib::error_category {
                 return "An output stream to be set before async_write can be used";
             case bad_stream:
                 return "A stream operation returned ios::bad";
+            case double_write:
+                return "Async write already in progress";
             default:
                 return "Unknown";
         }
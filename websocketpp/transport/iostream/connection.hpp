@@ -38,6 +38,7 @@
 
 #include <websocketpp/common/connection_hdl.hpp>
 #include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/memory_usage.hpp>
 #include <websocketpp/common/platforms.hpp>
 
 #include <algorithm>
@@ -56,6 +57,33 @@ struct timer {
     void cancel() {}
 };
 
+/// Connection transport component for bytes moved by the application
+/**
+ * Input is pushed in with read_some, read_all or operator>>, and output goes
+ * to a registered ostream or write handler.
+ *
+ * To embed connections in an event loop of its own, an application can
+ * instead move bytes without copies. get_read_buffer hands out the free
+ * part of the library's pending read buffer to read a socket into, and
+ * commit_read reports how much was read. With set_pull_output writes are
+ * held as a list of buffers, get_output, for the loop to gather into one
+ * writev when the socket is writable. consume_output reports how much was
+ * written and completes the write once all of it is:
+ *
+ *     size_t len;
+ *     char * in = con->get_read_buffer(len);
+ *     if (in) {
+ *         ssize_t n = ::read(fd, in, len);
+ *         if (n > 0) con->commit_read(n); else if (n == 0) con->eof();
+ *     }
+ *
+ *     size_t count;
+ *     transport::buffer const * out = con->get_output(count);
+ *     if (count) {
+ *         // copy out[i].buf and out[i].len into an iovec array
+ *         con->consume_output(::writev(fd, iov, count));
+ *     }
+ */
 template <typename config>
 class connection : public lib::enable_shared_from_this< connection<config> > {
 public:
@@ -78,7 +106,9 @@ public:
     typedef lib::shared_ptr<timer> timer_ptr;
 
     explicit connection(bool is_server, const lib::shared_ptr<alog_type> & alog, const lib::shared_ptr<elog_type> & elog)
-      : m_output_stream(NULL)
+      : m_output_index(0)
+      , m_pull_output(false)
+      , m_output_stream(NULL)
       , m_reading(false)
       , m_is_server(is_server)
       , m_is_secure(false)
@@ -200,6 +230,64 @@ public:
         return total_read;
     }
 
+    /// Get the free part of the pending read buffer
+    /**
+     * Gives out the memory the library is reading into, so that input can
+     * be read from its source straight into it rather than copied by
+     * read_some. Report the bytes stored with commit_read. A pending
+     * readiness wait is completed first so that it may issue its read.
+     *
+     * The buffer is valid until commit_read, eof or fatal_error.
+     *
+     * @since 0.9.0
+     *
+     * @param [out] len Set to the size of the buffer, 0 if no read is
+     * pending
+     * @return The buffer, or NULL if no read is pending
+     */
+    char * get_read_buffer(size_t & len) {
+        scoped_lock_type lock(m_read_mutex);
+
+        if (!m_reading && m_wait_handler) {
+            complete_wait(lib::error_code());
+        }
+
+        if (!m_reading) {
+            len = 0;
+            return NULL;
+        }
+
+        len = m_len - m_cursor;
+        return m_buf + m_cursor;
+    }
+
+    /// Report bytes stored into the buffer from get_read_buffer
+    /**
+     * Completes the pending read if it has enough bytes, which may issue the
+     * next read and so change what get_read_buffer returns.
+     *
+     * @since 0.9.0
+     *
+     * @param len The number of bytes stored
+     * @return The number of bytes accepted, at most the size of the buffer
+     */
+    size_t commit_read(size_t len) {
+        scoped_lock_type lock(m_read_mutex);
+
+        if (!m_reading) {
+            return 0;
+        }
+
+        len = (std::min)(len, m_len - m_cursor);
+        m_cursor += len;
+
+        if (m_cursor >= m_bytes_needed) {
+            complete_read(lib::error_code());
+        }
+
+        return len;
+    }
+
     /// Manual input supply (DEPRECATED)
     /**
      * @deprecated DEPRECATED in favor of read_some()
@@ -223,6 +311,10 @@ public:
         if (m_reading) {
             complete_read(make_error_code(transport::error::eof));
         }
+        if (m_wait_handler) {
+            complete_wait(make_error_code(transport::error::eof));
+        }
+        complete_output(make_error_code(transport::error::eof));
     }
 
     /// Signal transport error
@@ -239,6 +331,10 @@ public:
         if (m_reading) {
             complete_read(make_error_code(transport::error::pass_through));
         }
+        if (m_wait_handler) {
+            complete_wait(make_error_code(transport::error::pass_through));
+        }
+        complete_output(make_error_code(transport::error::pass_through));
     }
 
     /// Set whether or not this connection is secure
@@ -314,6 +410,16 @@ public:
         return m_connection_hdl;
     }
 
+    /// Add the memory held by the transport to an estimate
+    /**
+     * This transport keeps nothing worth counting.
+     *
+     * @since 0.9.0
+     *
+     * @param usage The estimate to add to
+     */
+    void get_memory_usage(memory_usage &) const {}
+
     /// Call back a function after a period of time.
     /**
      * Timers are not implemented in this transport. The timer pointer will
@@ -400,6 +506,90 @@ public:
     void set_shutdown_handler(shutdown_handler h) {
         m_shutdown_handler = h;
     }
+
+    /// Hold output for the application to pull
+    /**
+     * When set, writes are neither sent to the ostream nor to the write
+     * handlers. Their buffers are held, without copying, until the
+     * application takes them with get_output and reports them written with
+     * consume_output. The output ready handler is called as each write is
+     * held.
+     *
+     * @since 0.9.0
+     *
+     * @param value Whether or not to hold output
+     */
+    void set_pull_output(bool value) {
+        scoped_lock_type lock(m_write_mutex);
+        m_pull_output = value;
+    }
+
+    /// Sets the handler called when output is held, see set_pull_output
+    /**
+     * The handler is called from async_write, which runs on whatever thread
+     * sends, so event loops typically use it to schedule a flush.
+     *
+     * @since 0.9.0
+     *
+     * @param h The handler to call when output is waiting
+     */
+    void set_output_ready_handler(output_ready_handler h) {
+        m_output_ready_handler = h;
+    }
+
+    /// Get the output waiting to be written, see set_pull_output
+    /**
+     * The buffers are valid until the next consume_output, eof or
+     * fatal_error.
+     *
+     * @since 0.9.0
+     *
+     * @param [out] count Set to the number of buffers, 0 if none are waiting
+     * @return The first waiting buffer
+     */
+    buffer const * get_output(size_t & count) const {
+        scoped_lock_type lock(m_write_mutex);
+        count = m_output.size() - m_output_index;
+        return count ? &m_output[m_output_index] : NULL;
+    }
+
+    /// Report bytes of get_output written
+    /**
+     * Completes the write once all of its bytes were consumed. Its handler
+     * may hold the next write.
+     *
+     * @since 0.9.0
+     *
+     * @param len The number of bytes written, from the first waiting buffer
+     */
+    void consume_output(size_t len) {
+        transport::write_handler handler;
+        {
+            scoped_lock_type lock(m_write_mutex);
+            while (len && m_output_index < m_output.size()) {
+                buffer & b = m_output[m_output_index];
+                size_t const n = (std::min)(len, b.len);
+                b.buf += n;
+                b.len -= n;
+                len -= n;
+                if (b.len == 0) {
+                    ++m_output_index;
+                }
+            }
+            while (m_output_index < m_output.size() &&
+                m_output[m_output_index].len == 0)
+            {
+                ++m_output_index;
+            }
+            if (m_output_index < m_output.size() || !m_output_handler) {
+                return;
+            }
+            m_output.clear();
+            m_output_index = 0;
+            handler.swap(m_output_handler);
+        }
+        handler(lib::error_code());
+    }
 protected:
     /// Initialize the connection transport
     /**
@@ -439,9 +629,11 @@ protected:
     void async_read_at_least(size_t num_bytes, char *buf, size_t len,
         read_handler handler)
     {
-        std::stringstream s;
-        s << "iostream_con async_read_at_least: " << num_bytes;
-        m_alog->write(log::alevel::devel,s.str());
+        if (m_alog->static_test(log::alevel::devel)) {
+            std::stringstream s;
+            s << "iostream_con async_read_at_least: " << num_bytes;
+            m_alog->write(log::alevel::devel,s.str());
+        }
 
         if (num_bytes > len) {
             handler(make_error_code(error::invalid_num_bytes),size_t(0));
@@ -466,6 +658,51 @@ protected:
         m_reading = true;
     }
 
+    /// Reset the connection instead of closing it gracefully
+    /**
+     * This transport has no notion of an abortive close, ignored.
+     *
+     * @since 0.9.0
+     */
+    void reset_on_close() {}
+
+    /// Wait until data is available to read
+    /**
+     * The handler is called from the next call to read_some or read_all,
+     * before any bytes are copied, so that it may issue the read that receives
+     * them. eof and fatal_error complete a pending wait with an error.
+     *
+     * Waiting while a read or another wait is outstanding calls handler back
+     * immediately with a double_read error.
+     *
+     * @since 0.9.0
+     *
+     * @param handler The callback to invoke when data may be read
+     */
+    void async_wait_readable(read_handler handler) {
+        m_alog->write(log::alevel::devel,"iostream_con async_wait_readable");
+
+        if (m_reading || m_wait_handler) {
+            handler(make_error_code(error::double_read),size_t(0));
+            return;
+        }
+
+        m_wait_handler = handler;
+    }
+
+    /// Read whatever is available without blocking
+    /**
+     * Input is pushed into this transport with read_some and read_all, so
+     * nothing is ever available to pull and this always returns 0.
+     *
+     * @since 0.9.0
+     *
+     * @return 0
+     */
+    size_t read_available(char *, size_t) {
+        return 0;
+    }
+
     /// Asyncronous Transport Write
     /**
      * Write len bytes in buf to the output method. Call handler to report
@@ -490,6 +727,12 @@ protected:
         m_alog->write(log::alevel::devel,"iostream_con async_write");
         // TODO: lock transport state?
 
+        if (this->pull_output()) {
+            buffer const b(buf,len);
+            this->hold_output(&b, &b + 1, handler);
+            return;
+        }
+
         lib::error_code ec;
 
         if (m_output_stream) {
@@ -530,6 +773,12 @@ protected:
         m_alog->write(log::alevel::devel,"iostream_con async_write buffer list");
         // TODO: lock transport state?
 
+        if (this->pull_output()) {
+            this->hold_output(bufs.data(), bufs.data() + bufs.size(),
+                handler);
+            return;
+        }
+
         lib::error_code ec;
 
         if (m_output_stream) {
@@ -566,6 +815,73 @@ protected:
         m_connection_hdl = hdl;
     }
 
+    /// Whether a client wants its first request sent as early data
+    /**
+     * This transport has no TLS early data.
+     *
+     * @since 0.9.0
+     *
+     * @return Always false
+     */
+    bool wants_early_data() const {
+        return false;
+    }
+
+    /// Hand over the bytes to send as early data, unused by this transport
+    void set_early_data_payload(char const *, size_t) {}
+
+    /// Whether early data was accepted
+    /**
+     * @since 0.9.0
+     *
+     * @return Always false
+     */
+    bool is_early_data_accepted() const {
+        return false;
+    }
+
+    /// Whether the next write should come with a pin, see pin_write
+    /**
+     * This transport is done with the buffers of a write when it completes.
+     *
+     * @since 0.9.0
+     *
+     * @return Always false
+     */
+    bool wants_write_pin(size_t) const {
+        return false;
+    }
+
+    /// Keep the memory of the next write alive, unused by this transport
+    void pin_write(lib::shared_ptr<void>) {}
+
+    /// Begin a pass that starts the writes of many connections
+    /**
+     * This transport completes writes as they are made, so there is
+     * nothing to batch.
+     *
+     * @since 0.9.0
+     */
+    static void begin_write_batch() {}
+
+    /// End a pass started by begin_write_batch
+    static void end_write_batch() {}
+
+    /// Get the event loop that deferred writes of this connection run on
+    /**
+     * This transport has no event loop to defer writes to.
+     *
+     * @since 0.9.0
+     *
+     * @return Always null
+     */
+    void const * get_write_batch_key() const {
+        return NULL;
+    }
+
+    /// dispatch calls its handler immediately, see dispatch
+    static bool const inline_dispatch = true;
+
     /// Call given handler back within the transport's event system (if present)
     /**
      * Invoke a callback within the transport's event system if it has one. If
@@ -600,6 +916,50 @@ protected:
         handler(ec);
     }
 private:
+    bool pull_output() const {
+        scoped_lock_type lock(m_write_mutex);
+        return m_pull_output;
+    }
+
+    /// Hold the buffers of a write until they are consumed
+    void hold_output(buffer const * first, buffer const * last,
+        transport::write_handler handler)
+    {
+        {
+            scoped_lock_type lock(m_write_mutex);
+            if (!m_output_handler) {
+                m_output.assign(first, last);
+                m_output_index = 0;
+                m_output_handler = handler;
+                handler = transport::write_handler();
+            }
+        }
+        if (handler) {
+            handler(make_error_code(error::double_write));
+            return;
+        }
+
+        if (m_output_ready_handler) {
+            m_output_ready_handler(m_connection_hdl);
+        }
+        // an empty write is done already
+        this->consume_output(0);
+    }
+
+    /// Fail held output, eof and fatal_error end the connection
+    void complete_output(lib::error_code const & ec) {
+        transport::write_handler handler;
+        {
+            scoped_lock_type lock(m_write_mutex);
+            m_output.clear();
+            m_output_index = 0;
+            handler.swap(m_output_handler);
+        }
+        if (handler) {
+            handler(ec);
+        }
+    }
+
     void read(std::istream &in) {
         m_alog->write(log::alevel::devel,"iostream_con read");
 
@@ -634,6 +994,10 @@ private:
     size_t read_some_impl(char const * buf, size_t len) {
         m_alog->write(log::alevel::devel,"iostream_con read_some");
 
+        if (!m_reading && m_wait_handler) {
+            complete_wait(lib::error_code());
+        }
+
         if (!m_reading) {
             m_elog->write(log::elevel::devel,"write while not reading");
             return 0;
@@ -677,13 +1041,34 @@ private:
         handler(ec,m_cursor);
     }
 
+    /// Signal that a requested readiness wait is complete
+    /**
+     * It MUST be called while holding the read lock
+     *
+     * @param ec The error code to forward to the wait handler
+     */
+    void complete_wait(lib::error_code const & ec) {
+        read_handler handler = m_wait_handler;
+        m_wait_handler = read_handler();
+
+        handler(ec,size_t(0));
+    }
+
     // Read space (Protected by m_read_mutex)
     char *          m_buf;
     size_t          m_len;
     size_t          m_bytes_needed;
     read_handler    m_read_handler;
+    read_handler    m_wait_handler;
     size_t          m_cursor;
 
+    // Held output (Protected by m_write_mutex)
+    std::vector<buffer> m_output;
+    size_t          m_output_index;
+    transport::write_handler m_output_handler;
+    output_ready_handler m_output_ready_handler;
+    bool            m_pull_output;
+
     // transport resources
     std::ostream *  m_output_stream;
     connection_hdl  m_connection_hdl;
@@ -704,6 +1089,7 @@ private:
     // parallelized, the locking is here to prevent intra-connection concurrency
     // in order to allow inter-connection concurrency.
     mutex_type      m_read_mutex;
+    mutable mutex_type m_write_mutex;
 };
 
 
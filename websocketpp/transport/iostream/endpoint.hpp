@@ -65,7 +65,10 @@ public:
     typedef typename transport_con_type::ptr transport_con_ptr;
 
     // generate and manage our own io_context
-    explicit endpoint() : m_output_stream(NULL), m_is_secure(false)
+    explicit endpoint()
+      : m_output_stream(NULL)
+      , m_pull_output(false)
+      , m_is_secure(false)
     {
         //std::cout << "transport::iostream::endpoint constructor" << std::endl;
     }
@@ -154,6 +157,31 @@ public:
     void set_shutdown_handler(shutdown_handler h) {
         m_shutdown_handler = h;
     }
+
+    /// Hold the output of future connections for the application to pull
+    /**
+     * See connection::set_pull_output, the way to run connections from an
+     * event loop of the application's own.
+     *
+     * @since 0.9.0
+     *
+     * @param value Whether or not new connections hold their output
+     */
+    void set_pull_output(bool value) {
+        m_pull_output = value;
+    }
+
+    /// Sets the output ready handler of future connections
+    /**
+     * See connection::set_output_ready_handler.
+     *
+     * @since 0.9.0
+     *
+     * @param h The handler to call when output is waiting
+     */
+    void set_output_ready_handler(output_ready_handler h) {
+        m_output_ready_handler = h;
+    }
 protected:
     /// Initialize logging
     /**
@@ -202,12 +230,18 @@ protected:
         if (m_write_handler) {
             tcon->set_write_handler(m_write_handler);
         }
+        tcon->set_pull_output(m_pull_output);
+        if (m_output_ready_handler) {
+            tcon->set_output_ready_handler(m_output_ready_handler);
+        }
         return lib::error_code();
     }
 private:
     std::ostream *  m_output_stream;
     shutdown_handler m_shutdown_handler;
     write_handler   m_write_handler;
+    output_ready_handler m_output_ready_handler;
+    bool            m_pull_output;
     
     lib::shared_ptr<elog_type>     m_elog;
     lib::shared_ptr<alog_type>     m_alog;
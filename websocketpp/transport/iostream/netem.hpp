@@ -0,0 +1,341 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_TRANSPORT_IOSTREAM_NETEM_HPP
+#define WEBSOCKETPP_TRANSPORT_IOSTREAM_NETEM_HPP
+
+#include <websocketpp/transport/iostream/base.hpp>
+
+#include <websocketpp/common/connection_hdl.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <random>
+#include <string>
+
+namespace websocketpp {
+namespace transport {
+namespace iostream {
+
+/// Impairments of one direction of an emulated link
+/**
+ * Times are in microseconds of the link's virtual clock. Zero turns an
+ * impairment off.
+ *
+ * @since 0.9.0
+ */
+struct link_profile {
+    /// One way delay of every segment
+    uint64_t latency = 0;
+    /// Extra delay of each segment, uniform in [0, jitter]. Segments still
+    /// arrive in order, as over TCP.
+    uint64_t jitter = 0;
+    /// Bytes per second the link serializes, 0 for unlimited
+    uint64_t bandwidth = 0;
+    /// Largest segment, 1 delivers one byte per read. 0 sends what the
+    /// sender had waiting as one segment.
+    size_t max_segment = 0;
+    /// Bytes sent but not yet read by the peer, beyond which the sender's
+    /// writes stay incomplete. 0 for unlimited.
+    size_t window = 0;
+    /// Chance that a segment stalls the link, as a lost packet would
+    double stall_probability = 0;
+    /// How long a stall holds up the segment and all that follow it
+    uint64_t stall = 0;
+};
+
+/// A network link between two iostream connections, emulated in virtual time
+/**
+ * Joins two connections of the iostream transport, usually a client and a
+ * server, and carries their bytes with configurable latency, jitter,
+ * bandwidth, segmentation and stalls. Time is a virtual clock that step and
+ * run advance from one delivery to the next, so a benchmark of
+ * backpressure, coalescing or fragmentation runs as fast as the CPU allows
+ * and gives the same result on every run with the same seed.
+ *
+ * The link takes over the pull output and shutdown handler of both
+ * connections. Writes complete as the link takes their bytes, so a full
+ * window holds them back as a full socket buffer would. A shutdown reaches
+ * the peer as an eof once the bytes before it were read.
+ *
+ * Not thread safe, the connections must only be driven through the link,
+ * which must outlive them.
+ *
+ * @since 0.9.0
+ */
+template <typename connection_type>
+class emulated_link {
+public:
+    typedef lib::shared_ptr<connection_type> connection_ptr;
+
+    /// Join two connections, before they are started
+    /**
+     * @param a The first connection
+     * @param b The second connection
+     * @param seed Seed of the jitter and stall draws
+     */
+    emulated_link(connection_ptr a, connection_ptr b, uint32_t seed = 1)
+      : m_now(0)
+      , m_rng(seed)
+    {
+        m_dir[0].src = a;
+        m_dir[0].dst = b;
+        m_dir[1].src = b;
+        m_dir[1].dst = a;
+
+        for (size_t i = 0; i < 2; ++i) {
+            m_dir[i].src->set_pull_output(true);
+            m_dir[i].src->set_shutdown_handler(lib::bind(
+                &emulated_link::handle_shutdown, this, i,
+                lib::placeholders::_1));
+        }
+    }
+
+    /// Set the impairments of both directions
+    void set_profile(link_profile const & p) {
+        m_dir[0].profile = p;
+        m_dir[1].profile = p;
+    }
+
+    /// Set the impairments of each direction
+    /**
+     * @param a_to_b The impairments of bytes sent by the first connection
+     * @param b_to_a The impairments of bytes sent by the second connection
+     */
+    void set_profile(link_profile const & a_to_b, link_profile const & b_to_a)
+    {
+        m_dir[0].profile = a_to_b;
+        m_dir[1].profile = b_to_a;
+    }
+
+    /// Carry the next segment
+    /**
+     * Takes the output waiting on both connections, then advances the clock
+     * to the earliest segment that can be read and delivers it.
+     *
+     * @return Whether a segment was delivered. False when the link is idle
+     * or the peers of all segments stopped reading.
+     */
+    bool step() {
+        take_output(0);
+        take_output(1);
+
+        size_t order[2] = {0, 1};
+        if (!m_dir[1].segments.empty() && (m_dir[0].segments.empty() ||
+            m_dir[1].segments.front().arrival <
+            m_dir[0].segments.front().arrival))
+        {
+            std::swap(order[0], order[1]);
+        }
+
+        for (size_t i = 0; i < 2; ++i) {
+            direction & d = m_dir[order[i]];
+            if (d.segments.empty()) {
+                continue;
+            }
+
+            uint64_t const now = m_now;
+            m_now = (std::max)(m_now, d.segments.front().arrival);
+            if (deliver(d)) {
+                return true;
+            }
+            // the peer stopped reading, time waits for it
+            m_now = now;
+        }
+        return false;
+    }
+
+    /// Carry segments until the link is idle or the clock passes a limit
+    /**
+     * @param limit Virtual time to stop at, in microseconds
+     * @return The number of segments delivered
+     */
+    size_t run(uint64_t limit = (std::numeric_limits<uint64_t>::max)()) {
+        size_t count = 0;
+        while (m_now <= limit && step()) {
+            ++count;
+        }
+        return count;
+    }
+
+    /// Get the virtual time, in microseconds since the link was made
+    uint64_t get_time() const {
+        return m_now;
+    }
+
+    /// Get the bytes read by the second connection
+    uint64_t get_bytes_a_to_b() const {
+        return m_dir[0].delivered;
+    }
+
+    /// Get the bytes read by the first connection
+    uint64_t get_bytes_b_to_a() const {
+        return m_dir[1].delivered;
+    }
+
+    /// Get the bytes taken from the first connection but not yet read
+    size_t get_in_flight_a_to_b() const {
+        return m_dir[0].in_flight;
+    }
+
+    /// Get the bytes taken from the second connection but not yet read
+    size_t get_in_flight_b_to_a() const {
+        return m_dir[1].in_flight;
+    }
+private:
+    struct segment {
+        std::string data;
+        size_t offset = 0;
+        uint64_t arrival = 0;
+        bool fin = false;
+    };
+
+    struct direction {
+        connection_ptr src;
+        connection_ptr dst;
+        link_profile profile;
+        std::deque<segment> segments;
+        // when the link finishes serializing what it was given
+        uint64_t free_at = 0;
+        uint64_t last_arrival = 0;
+        size_t in_flight = 0;
+        uint64_t delivered = 0;
+        bool shutdown = false;
+    };
+
+    // queue a segment sent now, after the ones before it
+    void send(direction & d, segment s) {
+        link_profile const & p = d.profile;
+
+        uint64_t depart = (std::max)(m_now, d.free_at);
+        if (p.stall && p.stall_probability > 0 &&
+            std::bernoulli_distribution(p.stall_probability)(m_rng))
+        {
+            depart += p.stall;
+        }
+        if (p.bandwidth) {
+            depart += s.data.size() * 1000000 / p.bandwidth;
+        }
+        d.free_at = depart;
+
+        uint64_t arrival = depart + p.latency;
+        if (p.jitter) {
+            arrival += std::uniform_int_distribution<uint64_t>(0,
+                p.jitter)(m_rng);
+        }
+        s.arrival = (std::max)(arrival, d.last_arrival);
+        d.last_arrival = s.arrival;
+
+        d.in_flight += s.data.size();
+        d.segments.push_back(std::move(s));
+    }
+
+    // take the output the window has room for, in segments
+    void take_output(size_t i) {
+        direction & d = m_dir[i];
+        link_profile const & p = d.profile;
+
+        size_t count;
+        buffer const * bufs;
+        while ((bufs = d.src->get_output(count)) != NULL) {
+            size_t room = (std::numeric_limits<size_t>::max)();
+            if (p.window) {
+                if (d.in_flight >= p.window) {
+                    return;
+                }
+                room = p.window - d.in_flight;
+            }
+
+            segment s;
+            for (size_t j = 0; j < count && s.data.size() < room; ++j) {
+                s.data.append(bufs[j].buf,
+                    (std::min)(bufs[j].len, room - s.data.size()));
+            }
+
+            size_t const len = s.data.size();
+            if (p.max_segment && len > p.max_segment) {
+                for (size_t off = 0; off < len; off += p.max_segment) {
+                    segment part;
+                    part.data = s.data.substr(off, p.max_segment);
+                    send(d, std::move(part));
+                }
+            } else {
+                send(d, std::move(s));
+            }
+
+            // may complete the write and hold the next one
+            d.src->consume_output(len);
+        }
+    }
+
+    // hand the first segment to the peer, false if it took nothing
+    bool deliver(direction & d) {
+        segment & s = d.segments.front();
+
+        if (s.fin) {
+            d.segments.pop_front();
+            d.dst->eof();
+            return true;
+        }
+
+        size_t const n = d.dst->read_all(s.data.data() + s.offset,
+            s.data.size() - s.offset);
+        s.offset += n;
+        d.in_flight -= n;
+        d.delivered += n;
+
+        if (s.offset == s.data.size()) {
+            d.segments.pop_front();
+        }
+        return n != 0;
+    }
+
+    lib::error_code handle_shutdown(size_t i, connection_hdl) {
+        direction & d = m_dir[i];
+        if (!d.shutdown) {
+            d.shutdown = true;
+            segment s;
+            s.fin = true;
+            send(d, std::move(s));
+        }
+        return lib::error_code();
+    }
+
+    direction m_dir[2];
+    uint64_t m_now;
+    std::mt19937 m_rng;
+};
+
+} // namespace iostream
+} // namespace transport
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_TRANSPORT_IOSTREAM_NETEM_HPP
@@ -0,0 +1,437 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_TRANSPORT_SHM_CHANNEL_HPP
+#define WEBSOCKETPP_TRANSPORT_SHM_CHANNEL_HPP
+
+#include <websocketpp/transport/shm/base.hpp>
+
+#include <websocketpp/common/chrono.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+#include <websocketpp/common/thread.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <string>
+
+namespace websocketpp {
+namespace transport {
+namespace shm {
+
+/// A pair of single producer, single consumer byte rings in shared memory
+/**
+ * A channel connects two sides, 0 and 1. Each side writes into its own ring
+ * and reads from the ring of the other side. The region holds
+ *
+ *     header, ring state 0, ring state 1, side state 0, side state 1,
+ *     char ring0[capacity], char ring1[capacity]
+ *
+ * with every part that one side writes on a cache line of its own. Ring
+ * positions count bytes and never wrap, so a ring is empty when its head and
+ * tail are equal and full when they are capacity apart.
+ *
+ * A side with nothing to do sleeps on its doorbell, a 32 bit word that the
+ * other side increments and wakes whenever it writes into or reads from a
+ * ring while the sleeping flag is set. On Linux the wait is a futex in the
+ * shared region, so no descriptors have to be passed between processes;
+ * elsewhere the waiter polls the doorbell.
+ *
+ * A channel is created with a name, see create, and opened by name from the
+ * other process, see open. An unnamed channel is an anonymous shared mapping,
+ * for two connections of the same process or a child sharing it after
+ * fork.
+ *
+ * Each side must be driven by one thread at a time. The layout of the region
+ * is only compatible between builds using the same version, alignas and
+ * atomic representation.
+ *
+ * @since 0.9.0
+ */
+class channel {
+public:
+    typedef lib::shared_ptr<channel> ptr;
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free,
+        "shm channels need lock free 64 bit atomics");
+    static_assert(std::atomic<uint32_t>::is_always_lock_free,
+        "shm channels need lock free 32 bit atomics");
+
+    /// Create a channel
+    /**
+     * A named channel is created with shm_open and fails if the name exists.
+     * The name is unlinked when the channel that created it is destroyed. An
+     * empty name creates an anonymous channel.
+     *
+     * @param name The shm_open name, such as "/app-worker-1", or empty
+     * @param capacity The size of each ring, rounded up to a power of two
+     * @param ec Set to indicate what error occurred, if any
+     * @return The channel, or null on error
+     */
+    static ptr create(std::string const & name, size_t capacity,
+        lib::error_code & ec)
+    {
+        size_t cap = 64;
+        while (cap < capacity && cap < (size_t(1) << 30)) {
+            cap <<= 1;
+        }
+        if (capacity == 0 || cap < capacity) {
+            ec = make_error_code(error::invalid_capacity);
+            return ptr();
+        }
+
+        size_t const size = sizeof(layout) + 2 * cap;
+        int fd = -1;
+        if (!name.empty()) {
+            fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+            if (fd < 0) {
+                ec = lib::error_code(errno, lib::system_category());
+                return ptr();
+            }
+            if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+                ec = lib::error_code(errno, lib::system_category());
+                ::close(fd);
+                ::shm_unlink(name.c_str());
+                return ptr();
+            }
+        }
+
+        void * base = ::mmap(NULL, size, PROT_READ | PROT_WRITE, fd < 0 ?
+            MAP_SHARED | MAP_ANONYMOUS : MAP_SHARED, fd, 0);
+        int const map_errno = errno;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        if (base == MAP_FAILED) {
+            ec = lib::error_code(map_errno, lib::system_category());
+            if (!name.empty()) {
+                ::shm_unlink(name.c_str());
+            }
+            return ptr();
+        }
+
+        layout * l = new (base) layout();
+        l->capacity = cap;
+        l->magic.store(magic_value, std::memory_order_release);
+
+        ec = lib::error_code();
+        return ptr(new channel(l, size, name));
+    }
+
+    /// Open a channel created by another process
+    /**
+     * @param name The name the channel was created with
+     * @param ec Set to indicate what error occurred, if any
+     * @return The channel, or null on error
+     */
+    static ptr open(std::string const & name, lib::error_code & ec) {
+        int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0) {
+            ec = lib::error_code(errno, lib::system_category());
+            return ptr();
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ec = lib::error_code(errno, lib::system_category());
+            ::close(fd);
+            return ptr();
+        }
+        size_t const size = static_cast<size_t>(st.st_size);
+        if (size < sizeof(layout)) {
+            ::close(fd);
+            ec = make_error_code(error::bad_channel);
+            return ptr();
+        }
+
+        void * base = ::mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+            fd, 0);
+        int const map_errno = errno;
+        ::close(fd);
+        if (base == MAP_FAILED) {
+            ec = lib::error_code(map_errno, lib::system_category());
+            return ptr();
+        }
+
+        layout * l = static_cast<layout *>(base);
+        if (l->magic.load(std::memory_order_acquire) != magic_value ||
+            size != sizeof(layout) + 2 * l->capacity)
+        {
+            ::munmap(base, size);
+            ec = make_error_code(error::bad_channel);
+            return ptr();
+        }
+
+        ec = lib::error_code();
+        return ptr(new channel(l, size, std::string()));
+    }
+
+    ~channel() {
+        ::munmap(m_layout, m_size);
+        if (!m_owned_name.empty()) {
+            ::shm_unlink(m_owned_name.c_str());
+        }
+    }
+
+    /// Get the size of each ring
+    size_t capacity() const {
+        return static_cast<size_t>(m_layout->capacity);
+    }
+
+    /// Copy bytes into the ring written by a side
+    /**
+     * Does not wake the other side, see notify_peer.
+     *
+     * @param side The writing side, 0 or 1
+     * @return The number of bytes copied, less than len if the ring is full
+     */
+    size_t push(unsigned side, char const * buf, size_t len) {
+        ring_state & r = m_layout->rings[side];
+        uint64_t const head = r.head.load(std::memory_order_relaxed);
+        uint64_t const tail = r.tail.load(std::memory_order_acquire);
+
+        size_t const n = (std::min)(len, capacity() - size_t(head - tail));
+        copy_in(ring_data(side), head, buf, n);
+        r.head.store(head + n, std::memory_order_release);
+        return n;
+    }
+
+    /// Copy bytes out of the ring read by a side
+    /**
+     * Does not wake the other side, see notify_peer.
+     *
+     * @param side The reading side, 0 or 1
+     * @return The number of bytes copied, 0 if the ring is empty
+     */
+    size_t pop(unsigned side, char * buf, size_t len) {
+        ring_state & r = m_layout->rings[side ^ 1];
+        uint64_t const tail = r.tail.load(std::memory_order_relaxed);
+        uint64_t const head = r.head.load(std::memory_order_acquire);
+
+        size_t const n = (std::min)(len, size_t(head - tail));
+        copy_out(ring_data(side ^ 1), tail, buf, n);
+        r.tail.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+    /// Get the number of bytes a side may read
+    size_t readable(unsigned side) const {
+        ring_state const & r = m_layout->rings[side ^ 1];
+        return size_t(r.head.load(std::memory_order_acquire) -
+            r.tail.load(std::memory_order_relaxed));
+    }
+
+    /// Get the number of bytes a side may write
+    size_t writable(unsigned side) const {
+        ring_state const & r = m_layout->rings[side];
+        return capacity() - size_t(r.head.load(std::memory_order_relaxed) -
+            r.tail.load(std::memory_order_acquire));
+    }
+
+    /// Wake the other side if it sleeps, after a push or pop
+    void notify_peer(unsigned side) {
+        side_state & peer = m_layout->sides[side ^ 1];
+
+        // pairs with the fence in wait, either the peer sees the ring
+        // positions stored before this or this sees its sleeping flag
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (peer.sleeping.load(std::memory_order_relaxed)) {
+            peer.doorbell.fetch_add(1, std::memory_order_release);
+            wake(peer.doorbell);
+        }
+    }
+
+    /// Mark a side as done writing and wake the other side
+    void close(unsigned side) {
+        m_layout->sides[side].closed.store(1, std::memory_order_release);
+        notify_peer(side);
+    }
+
+    /// Whether the other side has closed
+    /**
+     * Bytes it wrote before closing may still be readable.
+     */
+    bool peer_closed(unsigned side) const {
+        return m_layout->sides[side ^ 1].closed.load(
+            std::memory_order_acquire) != 0;
+    }
+
+    /// Sleep until the other side notifies, the predicate holds, or timeout
+    /**
+     * The predicate is checked once after the side is marked as sleeping,
+     * so a notification racing with the call is never lost.
+     *
+     * @param side The waiting side
+     * @param ready Called as `ready()`, true if there is work to do
+     * @param timeout Longest time to sleep, negative to sleep until woken
+     * @return false if the wait timed out
+     */
+    template <typename predicate>
+    bool wait(unsigned side, predicate ready, lib::chrono::microseconds
+        timeout)
+    {
+        side_state & self = m_layout->sides[side];
+        uint32_t const seen = self.doorbell.load(std::memory_order_acquire);
+
+        self.sleeping.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        bool woken = true;
+        if (!ready()) {
+            woken = sleep(self.doorbell, seen, timeout);
+        }
+        self.sleeping.store(0, std::memory_order_relaxed);
+        return woken;
+    }
+private:
+    static uint64_t const magic_value = 0x315050534d485357ull;
+
+    struct ring_state {
+        /// Bytes written, stored by the writing side
+        alignas(64) std::atomic<uint64_t> head;
+        /// Bytes read, stored by the reading side
+        alignas(64) std::atomic<uint64_t> tail;
+    };
+
+    struct alignas(64) side_state {
+        std::atomic<uint32_t> doorbell;
+        std::atomic<uint32_t> sleeping;
+        std::atomic<uint32_t> closed;
+    };
+
+    struct layout {
+        layout() : magic(0), capacity(0) {
+            for (int i = 0; i < 2; ++i) {
+                rings[i].head.store(0, std::memory_order_relaxed);
+                rings[i].tail.store(0, std::memory_order_relaxed);
+                sides[i].doorbell.store(0, std::memory_order_relaxed);
+                sides[i].sleeping.store(0, std::memory_order_relaxed);
+                sides[i].closed.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        alignas(64) std::atomic<uint64_t> magic;
+        uint64_t capacity;
+        ring_state rings[2];
+        side_state sides[2];
+    };
+
+    channel(layout * l, size_t size, std::string const & owned_name)
+      : m_layout(l)
+      , m_size(size)
+      , m_owned_name(owned_name) {}
+
+    channel(channel const &) = delete;
+    channel & operator=(channel const &) = delete;
+
+    char * ring_data(unsigned side) {
+        return reinterpret_cast<char *>(m_layout + 1) + side * capacity();
+    }
+
+    void copy_in(char * ring, uint64_t pos, char const * buf, size_t n) {
+        size_t const offset = size_t(pos) & (capacity() - 1);
+        size_t const first = (std::min)(n, capacity() - offset);
+        std::memcpy(ring + offset, buf, first);
+        std::memcpy(ring, buf + first, n - first);
+    }
+
+    void copy_out(char const * ring, uint64_t pos, char * buf, size_t n) {
+        size_t const offset = size_t(pos) & (capacity() - 1);
+        size_t const first = (std::min)(n, capacity() - offset);
+        std::memcpy(buf, ring + offset, first);
+        std::memcpy(buf + first, ring, n - first);
+    }
+
+#ifdef __linux__
+    static void wake(std::atomic<uint32_t> & word) {
+        ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE,
+            1, NULL, NULL, 0);
+    }
+
+    static bool sleep(std::atomic<uint32_t> & word, uint32_t seen,
+        lib::chrono::microseconds timeout)
+    {
+        struct timespec ts;
+        struct timespec * tsp = NULL;
+        if (timeout.count() >= 0) {
+            ts.tv_sec = static_cast<time_t>(timeout.count() / 1000000);
+            ts.tv_nsec = static_cast<long>(timeout.count() % 1000000) * 1000;
+            tsp = &ts;
+        }
+
+        long const r = ::syscall(SYS_futex,
+            reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT, seen, tsp,
+            NULL, 0);
+        return r == 0 || errno != ETIMEDOUT;
+    }
+#else
+    static void wake(std::atomic<uint32_t> &) {}
+
+    static bool sleep(std::atomic<uint32_t> & word, uint32_t seen,
+        lib::chrono::microseconds timeout)
+    {
+        lib::chrono::steady_clock::time_point const end =
+            lib::chrono::steady_clock::now() + timeout;
+        while (word.load(std::memory_order_acquire) == seen) {
+            if (timeout.count() >= 0 && lib::chrono::steady_clock::now() >=
+                end)
+            {
+                return false;
+            }
+            lib::this_thread::sleep_for(lib::chrono::microseconds(50));
+        }
+        return true;
+    }
+#endif
+
+    layout * m_layout;
+    size_t m_size;
+    /// The name to unlink, set on the channel that created it
+    std::string m_owned_name;
+};
+
+} // namespace shm
+} // namespace transport
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_TRANSPORT_SHM_CHANNEL_HPP
@@ -0,0 +1,728 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_TRANSPORT_SHM_CON_HPP
+#define WEBSOCKETPP_TRANSPORT_SHM_CON_HPP
+
+#include <websocketpp/transport/shm/base.hpp>
+#include <websocketpp/transport/shm/channel.hpp>
+
+#include <websocketpp/transport/base/connection.hpp>
+
+#include <websocketpp/uri.hpp>
+
+#include <websocketpp/logger/levels.hpp>
+
+#include <websocketpp/common/chrono.hpp>
+#include <websocketpp/common/connection_hdl.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/memory_usage.hpp>
+#include <websocketpp/common/platforms.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace websocketpp {
+namespace transport {
+namespace shm {
+
+/// Empty timer class to stub out for timer functionality that shm
+/// transport doesn't support
+struct timer {
+    void cancel() {}
+};
+
+/// Connection transport component over one side of a shm::channel
+/**
+ * Like the iostream transport this transport has no event loop of its own.
+ * The application drives each connection by calling poll, which moves bytes
+ * between the channel and the library's pending read and write, and wait,
+ * which sleeps until the other side makes progress:
+ *
+ *     while (con->get_state() != websocketpp::session::state::closed) {
+ *         if (con->poll() == 0) {
+ *             con->wait(lib::chrono::milliseconds(100));
+ *         }
+ *     }
+ *
+ * Writes are copied into the ring as they are made and complete at once
+ * when they fit; the rest is copied by later polls as the other side reads.
+ * Read handlers run from poll. Bytes are copied once into the ring and once
+ * out of it, with no system call while both sides are busy.
+ */
+template <typename config>
+class connection : public lib::enable_shared_from_this< connection<config> > {
+public:
+    /// Type of this connection transport component
+    typedef connection<config> type;
+    /// Type of a shared pointer to this connection transport component
+    typedef lib::shared_ptr<type> ptr;
+
+    /// transport concurrency policy
+    typedef typename config::concurrency_type concurrency_type;
+    /// Type of this transport's access logging policy
+    typedef typename config::alog_type alog_type;
+    /// Type of this transport's error logging policy
+    typedef typename config::elog_type elog_type;
+
+    // Concurrency policy types
+    typedef typename concurrency_type::scoped_lock_type scoped_lock_type;
+    typedef typename concurrency_type::mutex_type mutex_type;
+
+    typedef lib::shared_ptr<timer> timer_ptr;
+
+    explicit connection(bool is_server, const lib::shared_ptr<alog_type> & alog, const lib::shared_ptr<elog_type> & elog)
+      : m_side(0)
+      , m_reading(false)
+      , m_write_index(0)
+      , m_write_offset(0)
+      , m_writing(false)
+      , m_is_server(is_server)
+      , m_is_secure(false)
+      , m_alog(alog)
+      , m_elog(elog)
+      , m_remote_endpoint("shm transport")
+    {
+        m_alog->write(log::alevel::devel,"shm con transport constructor");
+    }
+
+    /// Get a shared pointer to this component
+    ptr get_shared() {
+        return type::shared_from_this();
+    }
+
+    /// Set the channel this connection reads from and writes to
+    /**
+     * Must be called before the connection is started. The two connections
+     * of a channel use different sides; by convention the process that
+     * created the channel uses side 0.
+     *
+     * @since 0.9.0
+     *
+     * @param c The channel
+     * @param side The side of the channel this connection uses, 0 or 1
+     */
+    void set_channel(channel::ptr c, unsigned side) {
+        scoped_lock_type lock(m_read_mutex);
+        m_channel = c;
+        m_side = side & 1;
+    }
+
+    /// Get the channel of this connection
+    /**
+     * @since 0.9.0
+     *
+     * @return The channel, null if none was set
+     */
+    channel::ptr get_channel() const {
+        return m_channel;
+    }
+
+    /// Move bytes between the channel and the pending read and write
+    /**
+     * Copies what fits of a pending write into the ring, completing it once
+     * it is all copied, then fills pending reads from the ring until there
+     * are no more bytes or no more reads. Read, readiness and write handlers
+     * run from here. A pending read or wait completes with an eof error once
+     * the other side closed and its ring is drained.
+     *
+     * @since 0.9.0
+     *
+     * @return The number of bytes moved, 0 if there was nothing to do
+     */
+    size_t poll() {
+        // this serializes calls to external read.
+        scoped_lock_type lock(m_read_mutex);
+
+        if (!m_channel) {
+            return 0;
+        }
+
+        size_t moved = this->flush_write();
+
+        while (true) {
+            bool const closed = m_channel->peer_closed(m_side);
+
+            if (!m_reading) {
+                if (m_wait_handler && (closed ||
+                    m_channel->readable(m_side) != 0))
+                {
+                    complete_wait(closed && m_channel->readable(m_side) == 0 ?
+                        make_error_code(transport::error::eof) :
+                        lib::error_code());
+                    continue;
+                }
+                break;
+            }
+
+            size_t const n = m_channel->pop(m_side, m_buf + m_cursor,
+                m_len - m_cursor);
+            if (n == 0) {
+                if (closed) {
+                    complete_read(make_error_code(transport::error::eof));
+                }
+                break;
+            }
+
+            m_channel->notify_peer(m_side);
+            moved += n;
+            m_cursor += n;
+
+            if (m_cursor >= m_bytes_needed) {
+                complete_read(lib::error_code());
+            }
+        }
+
+        // a read handler may have started a write
+        return moved + this->flush_write();
+    }
+
+    /// Sleep until poll has something to do
+    /**
+     * Returns at once if bytes are readable for a pending read or wait, if
+     * space opened up for a pending write, or if the other side closed.
+     * Otherwise sleeps until the other side reads or writes, or the timeout
+     * expires.
+     *
+     * @since 0.9.0
+     *
+     * @param timeout Longest time to sleep, negative to sleep until woken
+     * @return false if the wait timed out
+     */
+    bool wait(lib::chrono::microseconds timeout) {
+        channel::ptr c = m_channel;
+        if (!c) {
+            return false;
+        }
+
+        return c->wait(m_side, [this, &c]() {
+            return c->readable(m_side) != 0 || c->peer_closed(m_side) ||
+                (this->write_pending() && c->writable(m_side) != 0);
+        }, timeout);
+    }
+
+    /// Set whether or not this connection is secure
+    /**
+     * The shm transport does not encrypt; the channel is only as private as
+     * the permissions of its shared memory. This allows an application to
+     * flag connections it considers secure.
+     *
+     * @since 0.9.0
+     *
+     * @param value Whether or not this connection is secure.
+     */
+    void set_secure(bool value) {
+        m_is_secure = value;
+    }
+
+    /// Tests whether or not the underlying transport is secure
+    /**
+     * @return Whether or not the underlying transport is secure
+     */
+    bool is_secure() const {
+        return m_is_secure;
+    }
+
+    /// Set uri hook
+    /**
+     * This transport policy doesn't use the uri so it is ignored.
+     *
+     * @param u The uri to set
+     */
+    void set_uri(uri_ptr) {}
+
+    /// Set human readable remote endpoint address
+    /**
+     * If none is set the default is "shm transport".
+     *
+     * @param value The remote endpoint address to set.
+     */
+    void set_remote_endpoint(std::string value) {
+        m_remote_endpoint = value;
+    }
+
+    /// Get human readable remote endpoint address
+    /**
+     * @return A string identifying the address of the remote endpoint
+     */
+    std::string get_remote_endpoint() const {
+        return m_remote_endpoint;
+    }
+
+    /// Get the connection handle
+    /**
+     * @return The handle for this connection.
+     */
+    connection_hdl get_handle() const {
+        return m_connection_hdl;
+    }
+
+    /// Add the memory held by the transport to an estimate
+    /**
+     * The rings live in the shared mapping of the channel and are not
+     * counted.
+     *
+     * @since 0.9.0
+     *
+     * @param usage The estimate to add to
+     */
+    void get_memory_usage(memory_usage & usage) const {
+        usage.bytes[memory_usage::send_queue] += m_write_bufs.capacity() *
+            sizeof(buffer);
+    }
+
+    /// Call back a function after a period of time.
+    /**
+     * Timers are not implemented in this transport. The timer pointer will
+     * always be empty. The handler will never be called.
+     *
+     * @param duration Length of time to wait in milliseconds
+     * @param callback The function to call back when the timer has expired
+     * @return A handle that can be used to cancel the timer if it is no longer
+     * needed.
+     */
+    timer_ptr set_timer(long, timer_handler) {
+        return timer_ptr();
+    }
+protected:
+    /// Initialize the connection transport
+    /**
+     * Fails with channel_required if no channel was set.
+     *
+     * @param handler The `init_handler` to call when initialization is done
+     */
+    void init(init_handler handler) {
+        m_alog->write(log::alevel::devel,"shm connection init");
+        if (!m_channel) {
+            handler(make_error_code(error::channel_required));
+            return;
+        }
+        handler(lib::error_code());
+    }
+
+    /// Initiate an async_read for at least num_bytes bytes into buf
+    /**
+     * The read is filled by later calls to poll.
+     *
+     * The application should never call this method a second time before it has
+     * been called back for the first read. If this is done, the second read
+     * will be called back immediately with a double_read error.
+     *
+     * If num_bytes or len are zero handler will be called back immediately
+     * indicating success.
+     *
+     * @param num_bytes Don't call handler until at least this many bytes have
+     * been read.
+     * @param buf The buffer to read bytes into
+     * @param len The size of buf. At maximum, this many bytes will be read.
+     * @param handler The callback to invoke when the operation is complete or
+     * ends in an error
+     */
+    void async_read_at_least(size_t num_bytes, char *buf, size_t len,
+        read_handler handler)
+    {
+        if (m_alog->static_test(log::alevel::devel)) {
+            std::stringstream s;
+            s << "shm_con async_read_at_least: " << num_bytes;
+            m_alog->write(log::alevel::devel,s.str());
+        }
+
+        if (num_bytes > len) {
+            handler(make_error_code(error::invalid_num_bytes),size_t(0));
+            return;
+        }
+
+        if (m_reading == true) {
+            handler(make_error_code(error::double_read),size_t(0));
+            return;
+        }
+
+        if (num_bytes == 0 || len == 0) {
+            handler(lib::error_code(),size_t(0));
+            return;
+        }
+
+        m_buf = buf;
+        m_len = len;
+        m_bytes_needed = num_bytes;
+        m_read_handler = handler;
+        m_cursor = 0;
+        m_reading = true;
+    }
+
+    /// Reset the connection instead of closing it gracefully
+    /**
+     * This transport has no notion of an abortive close, ignored.
+     *
+     * @since 0.9.0
+     */
+    void reset_on_close() {}
+
+    /// Wait until data is available to read
+    /**
+     * The handler is called from poll once bytes are readable, before any
+     * are copied, so that it may issue the read that receives them.
+     *
+     * Waiting while a read or another wait is outstanding calls handler back
+     * immediately with a double_read error.
+     *
+     * @since 0.9.0
+     *
+     * @param handler The callback to invoke when data may be read
+     */
+    void async_wait_readable(read_handler handler) {
+        m_alog->write(log::alevel::devel,"shm_con async_wait_readable");
+
+        if (m_reading || m_wait_handler) {
+            handler(make_error_code(error::double_read),size_t(0));
+            return;
+        }
+
+        m_wait_handler = handler;
+    }
+
+    /// Read whatever is available without blocking
+    /**
+     * Copies bytes straight out of the ring.
+     *
+     * @since 0.9.0
+     *
+     * @param buf The buffer to read into
+     * @param len The size of buf
+     * @return The number of bytes read, 0 if none were available
+     */
+    size_t read_available(char * buf, size_t len) {
+        if (!m_channel) {
+            return 0;
+        }
+
+        size_t const n = m_channel->pop(m_side, buf, len);
+        if (n) {
+            m_channel->notify_peer(m_side);
+        }
+        return n;
+    }
+
+    /// Asyncronous Transport Write
+    /**
+     * Copies what fits of buf into the ring. The handler is called before
+     * this returns if all of it fits and otherwise from the poll that copies
+     * the last byte. The other side closing fails the write with eof.
+     *
+     * @param buf buffer to read bytes from
+     * @param len number of bytes to write
+     * @param handler Callback to invoke with operation status.
+     */
+    void async_write(char const * buf, size_t len, transport::write_handler
+        handler)
+    {
+        m_alog->write(log::alevel::devel,"shm_con async_write");
+
+        bool started = false;
+        {
+            scoped_lock_type lock(m_write_mutex);
+            if (!m_writing) {
+                m_write_bufs.clear();
+                m_write_bufs.push_back(buffer(buf,len));
+                this->begin_write(handler);
+                started = true;
+            }
+        }
+        this->finish_start_write(started, handler);
+    }
+
+    /// Asyncronous Transport Write (scatter-gather)
+    /**
+     * Copies the buffers into the ring in order, see the single buffer
+     * async_write.
+     *
+     * @param bufs vector of buffers to write
+     * @param handler Callback to invoke with operation status.
+     */
+    void async_write(std::vector<buffer> const & bufs, transport::write_handler
+        handler)
+    {
+        m_alog->write(log::alevel::devel,"shm_con async_write buffer list");
+
+        bool started = false;
+        {
+            scoped_lock_type lock(m_write_mutex);
+            if (!m_writing) {
+                m_write_bufs.assign(bufs.begin(), bufs.end());
+                this->begin_write(handler);
+                started = true;
+            }
+        }
+        this->finish_start_write(started, handler);
+    }
+
+    /// Set Connection Handle
+    /**
+     * @param hdl The new handle
+     */
+    void set_handle(connection_hdl_ref hdl) {
+        m_connection_hdl = hdl;
+    }
+
+    /// Whether a client wants its first request sent as early data
+    /**
+     * This transport has no TLS early data.
+     *
+     * @since 0.9.0
+     *
+     * @return Always false
+     */
+    bool wants_early_data() const {
+        return false;
+    }
+
+    /// Hand over the bytes to send as early data, unused by this transport
+    void set_early_data_payload(char const *, size_t) {}
+
+    /// Whether early data was accepted
+    /**
+     * @since 0.9.0
+     *
+     * @return Always false
+     */
+    bool is_early_data_accepted() const {
+        return false;
+    }
+
+    /// Whether the next write should come with a pin, see pin_write
+    /**
+     * A write holds on to its buffers until its handler runs, which the
+     * library already guarantees.
+     *
+     * @since 0.9.0
+     *
+     * @return Always false
+     */
+    bool wants_write_pin(size_t) const {
+        return false;
+    }
+
+    /// Keep the memory of the next write alive, unused by this transport
+    void pin_write(lib::shared_ptr<void>) {}
+
+    /// Begin a pass that starts the writes of many connections
+    /**
+     * Each connection has a channel of its own, so there is nothing to
+     * batch.
+     *
+     * @since 0.9.0
+     */
+    static void begin_write_batch() {}
+
+    /// End a pass started by begin_write_batch
+    static void end_write_batch() {}
+
+    /// Get the event loop that deferred writes of this connection run on
+    /**
+     * This transport has no event loop to defer writes to.
+     *
+     * @since 0.9.0
+     *
+     * @return Always null
+     */
+    void const * get_write_batch_key() const {
+        return NULL;
+    }
+
+    /// dispatch calls its handler immediately, see dispatch
+    static bool const inline_dispatch = true;
+
+    /// Call given handler back within the transport's event system (if present)
+    /**
+     * This transport has no event system, the handler is invoked before this
+     * function returns.
+     *
+     * @param handler The callback to invoke
+     *
+     * @return Whether or not the transport was able to register the handler for
+     * callback.
+     */
+    lib::error_code dispatch(dispatch_handler handler) {
+        handler();
+        return lib::error_code();
+    }
+
+    /// Perform cleanup on socket shutdown_handler
+    /**
+     * Marks this side of the channel closed, which the other side reads as
+     * eof once it drained the ring.
+     *
+     * @param handler The `shutdown_handler` to call back when complete
+     */
+    void async_shutdown(transport::shutdown_handler handler) {
+        if (m_channel) {
+            m_channel->close(m_side);
+        }
+        handler(lib::error_code());
+    }
+private:
+    /// Store a write, must be called holding m_write_mutex
+    void begin_write(transport::write_handler const & handler) {
+        m_write_handler = handler;
+        m_write_index = 0;
+        m_write_offset = 0;
+        m_writing = true;
+    }
+
+    /// Copy a write stored by begin_write, or refuse a second write
+    void finish_start_write(bool started,
+        transport::write_handler const & handler)
+    {
+        if (!started) {
+            handler(make_error_code(error::double_write));
+            return;
+        }
+        this->flush_write();
+    }
+
+    bool write_pending() {
+        scoped_lock_type lock(m_write_mutex);
+        return m_writing;
+    }
+
+    /// Copy what fits of the pending write, completing it if it is done
+    /**
+     * The handler is called with no lock held, so that it may start the
+     * next write.
+     *
+     * @return The number of bytes copied
+     */
+    size_t flush_write() {
+        transport::write_handler handler;
+        lib::error_code ec;
+        size_t moved = 0;
+
+        {
+            scoped_lock_type lock(m_write_mutex);
+            if (!m_writing) {
+                return 0;
+            }
+
+            if (m_channel->peer_closed(m_side)) {
+                ec = make_error_code(transport::error::eof);
+            } else {
+                while (m_write_index < m_write_bufs.size()) {
+                    buffer const & b = m_write_bufs[m_write_index];
+                    size_t const n = m_channel->push(m_side,
+                        b.buf + m_write_offset, b.len - m_write_offset);
+                    moved += n;
+                    m_write_offset += n;
+                    if (m_write_offset < b.len) {
+                        break;
+                    }
+                    ++m_write_index;
+                    m_write_offset = 0;
+                }
+                if (moved) {
+                    m_channel->notify_peer(m_side);
+                }
+                if (m_write_index < m_write_bufs.size()) {
+                    return moved;
+                }
+            }
+
+            m_writing = false;
+            m_write_bufs.clear();
+            handler.swap(m_write_handler);
+        }
+
+        handler(ec);
+        return moved;
+    }
+
+    /// Signal that a requested read is complete
+    /**
+     * It MUST NOT be called when m_reading is false.
+     * it MUST be called while holding the read lock
+     *
+     * @param ec The error code to forward to the read handler
+     */
+    void complete_read(lib::error_code const & ec) {
+        m_reading = false;
+
+        read_handler handler = m_read_handler;
+        m_read_handler = read_handler();
+
+        handler(ec,m_cursor);
+    }
+
+    /// Signal that a requested readiness wait is complete
+    /**
+     * It MUST be called while holding the read lock
+     *
+     * @param ec The error code to forward to the wait handler
+     */
+    void complete_wait(lib::error_code const & ec) {
+        read_handler handler = m_wait_handler;
+        m_wait_handler = read_handler();
+
+        handler(ec,size_t(0));
+    }
+
+    channel::ptr    m_channel;
+    unsigned        m_side;
+
+    // Read space (Protected by m_read_mutex)
+    char *          m_buf;
+    size_t          m_len;
+    size_t          m_bytes_needed;
+    read_handler    m_read_handler;
+    read_handler    m_wait_handler;
+    size_t          m_cursor;
+    bool            m_reading;
+
+    // Write space (Protected by m_write_mutex)
+    std::vector<buffer> m_write_bufs;
+    size_t          m_write_index;
+    size_t          m_write_offset;
+    transport::write_handler m_write_handler;
+    bool            m_writing;
+
+    connection_hdl  m_connection_hdl;
+    bool const      m_is_server;
+    bool            m_is_secure;
+    lib::shared_ptr<alog_type>     m_alog;
+    lib::shared_ptr<elog_type>     m_elog;
+    std::string     m_remote_endpoint;
+
+    mutex_type      m_read_mutex;
+    mutex_type      m_write_mutex;
+};
+
+
+} // namespace shm
+} // namespace transport
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_TRANSPORT_SHM_CON_HPP
@@ -36,6 +36,7 @@
 #include <algorithm>
 #include <sstream>
 #include <string>
+#include <string_view>
 
 namespace websocketpp {
 
@@ -407,190 +408,111 @@ public:
 
 	uri() = default;
 
-    explicit uri(std::string const & uri_string) : m_ipv6_literal(false) {
-		
-		if (uri_string.empty())
-			return;
-		
-		const size_t schema_end = uri_string.find(uri_helper::schema_separtator);
-		if (schema_end != std::string::npos)
-		{
-			const std::string schema(uri_string.substr(0, schema_end));
-			if (schema == "wss")
-			{
-				m_secure = true;
-				m_type = websocket;
-			}
-			else if (schema == "ws")
-			{
-				m_secure = false;
-           		m_type = websocket;
-			}
-			else if (schema == "https")
-			{
-				m_secure = true;
-            	m_type = http;
-			}
-			else if (schema == "http")
-			{
-				m_secure = false;
-            	m_type = http;
-			} else {
-				return;
-			}
-		} else if (uri_string.starts_with('/')) {
-			m_type = relative;
-			m_resource = uri_string;
-			return;
-		} else {
-			return; // invalid!
-		}
-
-		std::string::const_iterator it = uri_string.begin() + schema_end + uri_helper::schema_separtator.length();
-        std::string::const_iterator temp;
-
-        int state = 0;
-
-		std::string schema;
-
-        // extract host.
-        // either a host string
-        // an IPv4 address
-        // or an IPv6 address
-        if (*it == '[') {
-            ++it;
-            // IPv6 literal
-            // extract IPv6 digits until ]
+    /// Parse a URI
+    /**
+     * The string is read in a single pass. Each part is found by position
+     * and copied out once, and the port is read as a number, so parsing does
+     * not allocate beyond the host and resource strings.
+     *
+     * @param uri_string The URI to parse, get_valid tells whether it was
+     * understood
+     */
+    explicit uri(std::string const & uri_string) {
+        char const * const begin = uri_string.data();
+        char const * const end = begin + uri_string.size();
 
-            // TODO: this doesn't work on g++... not sure why
-            //temp = std::find(it,it2,']');
+        if (begin == end) {
+            return;
+        }
 
-            temp = it;
-            while (temp != uri_string.end()) {
-                if (*temp == ']') {
-                    break;
-                }
-                ++temp;
+        std::string_view const whole(begin, uri_string.size());
+        size_t const schema_end = whole.find("://");
+        if (schema_end == std::string_view::npos) {
+            if (*begin == '/') {
+                m_type = relative;
+                m_resource = uri_string;
             }
+            return;
+        }
 
-            if (temp == uri_string.end()) {
-				m_type = invalid;
+        std::string_view const schema = whole.substr(0, schema_end);
+        if (schema == "wss") {
+            m_secure = true;
+            m_type = websocket;
+        } else if (schema == "ws") {
+            m_secure = false;
+            m_type = websocket;
+        } else if (schema == "https") {
+            m_secure = true;
+            m_type = http;
+        } else if (schema == "http") {
+            m_secure = false;
+            m_type = http;
+        } else {
+            return;
+        }
+
+        char const * it = begin + schema_end + 3;
+
+        // extract host, an IPv6 literal in brackets or a registered name,
+        // which includes IPv4 addresses
+        if (it != end && *it == '[') {
+            char const * const host_end = std::find(it+1, end, ']');
+            if (host_end == end) {
+                m_type = invalid;
                 return;
-            } else {
-                // validate IPv6 literal parts
-                if (!uri_helper::ipv6_literal(it,temp)) {
-					m_type = invalid;
-                    return;
-                } else {
-                    m_ipv6_literal = true;
-                }
-                m_host.append(it,temp);
             }
-            it = temp+1;
-            if (it == uri_string.end()) {
-                state = 2;
-            } else if (*it == '/' || *it == '?' || *it == '#') {
-                // todo: better path parsing
-                state = 2;
-                
-                // we don't increment the iterator here because we want the 
-                // delimiter to be read again as a part of the path
-            } else if (*it == ':') {
-                state = 1;
-
-                // start reading port after the delimiter
-                ++it;
-            } else {
-                // problem
-				m_type = invalid;
+            m_host.assign(it+1, host_end);
+            if (!uri_helper::ipv6_literal(m_host.begin(), m_host.end())) {
+                m_type = invalid;
                 return;
             }
+            m_ipv6_literal = true;
+            it = host_end+1;
         } else {
-            // IPv4 or hostname
-            // extract until : or first path component
-            while (state == 0) {
-                if (it == uri_string.end()) {
-                    state = 2;
-                    break;
-                } else if (*it == '%') {
-                    // check for valid % encoded char
-                    if (it+2 < uri_string.end() && uri_helper::pct_encoded(it+1)) {
-                        m_host.append(it,it+2);
-                        it += 3;
-                    }
-                } else if (!uri_helper::reg_name(*it)) {
-                    // we hit one of the general delimiters
-                    if (*it == ':') {
-                        // got host vs port delimiter
-                        // end hostname start port
-                        state = 1;
-
-                        // start reading port after the delimiter
-                        ++it;
-                    } else if (*it == '/' || *it == '#' || *it == '?') {
-                        // one of the normal authority vs path delimiters
-                        // end hostname and start parsing path
-                        state = 2;
-
-                        // we don't increment the iterator here because we want the 
-                        // delimiter to be read again as a part of the path
-                    } else {
-                        // either @, [, or ]
-                        // @ = userinfo fragment
-                        // [ and ] = illegal, basically
-						m_type = invalid;
-                        return;
-                    }
-                } else {
-                    m_host += *it;
+            char const * const host_begin = it;
+            while (it != end) {
+                if (uri_helper::reg_name(*it)) {
                     ++it;
+                } else if (*it == '%' && end-it > 2 &&
+                    uri_helper::hexdigit(it[1]) && uri_helper::hexdigit(it[2]))
+                {
+                    it += 3;
+                } else {
+                    break;
                 }
-                
             }
+            m_host.assign(host_begin, it);
         }
 
-        // parse port
-        std::string port;
-        while (state == 1) {
-            if (it == uri_string.end()) {
-                // if we stop parsing the port and there wasn't actually a port
-                // we have an invalid URI
-                if (port.empty()) {
-					m_type = invalid;
-                    return;
+        // the host ends the URI, or is followed by a port or the path
+        m_port = m_secure ? uri_default_secure_port : uri_default_port;
+        if (it != end && *it == ':') {
+            ++it;
+            char const * const port_begin = it;
+            unsigned int port = 0;
+            while (it != end && uri_helper::digit(*it)) {
+                if (port <= 65535) {
+                    port = port * 10 + static_cast<unsigned int>(*it - '0');
                 }
-                state = 3;
-            } else if (uri_helper::digit(it)) {
-                port += *it;
                 ++it;
-            } else {
-                // if we stop parsing the port and there wasn't actually a port
-                // we have an invalid URI
-                if (port.empty()) {
-					m_type = invalid;
-                    return;
-                }
-                state = 3;
-
-                // we don't increment the iterator here because we want the 
-                // delimiter to be read again as a part of the path
             }
-            
-        }
-
-        lib::error_code ec;
-        m_port = get_port_from_string(port, ec);
-
-        if (ec) {
-			m_type = invalid;
+            if (it == port_begin || port == 0 || port > 65535) {
+                m_type = invalid;
+                return;
+            }
+            m_port = static_cast<uint16_t>(port);
+        } else if (it != end && *it != '/' && *it != '?' && *it != '#') {
+            // @ starts userinfo, which is not supported, anything else is
+            // not allowed here
+            m_type = invalid;
             return;
         }
 
-        // step back one so the first char of the path delimiter doesn't get eaten
-        m_resource.append(it,uri_string.end());
-        
-        if (m_resource.empty()) {
+        if (it == end) {
             m_resource = "/";
+        } else {
+            m_resource.assign(it, end);
         }
 
         // todo: validate path component
@@ -785,9 +707,9 @@ private:
     type        m_type = invalid;
     std::string m_host;
     std::string m_resource;
-    uint16_t    m_port;
-    bool        m_secure;
-    bool        m_ipv6_literal;
+    uint16_t    m_port = 0;
+    bool        m_secure = false;
+    bool        m_ipv6_literal = false;
 };
 
 /// Pointer to a URI
@@ -29,8 +29,12 @@
 #ifndef UTF8_VALIDATOR_HPP
 #define UTF8_VALIDATOR_HPP
 
+#include <websocketpp/common/simd.hpp>
 #include <websocketpp/common/stdint.hpp>
 
+#include <cstring>
+#include <iterator>
+#include <memory>
 #include <string>
 
 namespace websocketpp {
@@ -77,6 +81,177 @@ inline uint32_t decode(uint32_t * state, uint32_t * codep, uint8_t byte) {
   return *state;
 }
 
+/// Count the number of leading ASCII bytes in a buffer
+/**
+ * Checks 32 (AVX2) or 16 (SSE2/NEON) bytes at a time when vector support is
+ * available and a machine word at a time otherwise.
+ *
+ * @param [in] data The buffer to scan
+ * @param [in] len The length of data
+ * @return The number of bytes at the start of data that are below 0x80
+ */
+inline size_t ascii_prefix(uint8_t const * data, size_t len) {
+    size_t i = 0;
+
+#if defined(_WEBSOCKETPP_SIMD_AVX2_)
+    for (; i + 32 <= len; i += 32) {
+        int mask = _mm256_movemask_epi8(_mm256_loadu_si256(
+            reinterpret_cast<__m256i const *>(data+i)));
+        if (mask != 0) {
+            break;
+        }
+    }
+#endif
+
+#if defined(_WEBSOCKETPP_SIMD_SSE2_)
+    for (; i + 16 <= len; i += 16) {
+        int mask = _mm_movemask_epi8(_mm_loadu_si128(
+            reinterpret_cast<__m128i const *>(data+i)));
+        if (mask != 0) {
+            break;
+        }
+    }
+#elif defined(_WEBSOCKETPP_SIMD_NEON_)
+    for (; i + 16 <= len; i += 16) {
+        uint64x2_t w = vreinterpretq_u64_u8(vld1q_u8(data+i));
+        if ((vgetq_lane_u64(w,0) | vgetq_lane_u64(w,1)) & 0x8080808080808080ULL) {
+            break;
+        }
+    }
+#endif
+
+    size_t const high_bits = (~static_cast<size_t>(0) / 0xFF) * 0x80;
+    for (; i + sizeof(size_t) <= len; i += sizeof(size_t)) {
+        size_t word;
+        std::memcpy(&word,data+i,sizeof(size_t));
+        if (word & high_bits) {
+            break;
+        }
+    }
+
+    while (i < len && data[i] < 0x80) {
+        ++i;
+    }
+
+    return i;
+}
+
+#ifdef _WEBSOCKETPP_SIMD_SSSE3_
+/// Validate whole 16 byte blocks of UTF8 with SSSE3
+/**
+ * Implements the lookup algorithm described by Keiser and Lemire in
+ * "Validating UTF-8 In Less Than One Instruction Per Byte". Each byte is
+ * classified together with the byte before it using three 16 entry nibble
+ * tables and errors are accumulated across blocks.
+ *
+ * Validation must start on a code point boundary. The returned length is
+ * always a multiple of 16. A multi byte sequence that is cut off by the end of
+ * the last block is not reported as an error; the caller must resume
+ * validation of the tail from the start of that sequence.
+ *
+ * @param [in] data The buffer to validate
+ * @param [in] len The length of data
+ * @param [out] valid Set to false if any whole block was invalid
+ * @return The number of bytes examined
+ */
+inline size_t ssse3_validate_blocks(uint8_t const * data, size_t len,
+    bool & valid)
+{
+    // error classes, see the paper for the full derivation
+    uint8_t const too_short = 1<<0;
+    uint8_t const too_long = 1<<1;
+    uint8_t const overlong_3 = 1<<2;
+    uint8_t const too_large = 1<<3;
+    uint8_t const surrogate = 1<<4;
+    uint8_t const overlong_2 = 1<<5;
+    uint8_t const too_large_1000 = 1<<6;
+    uint8_t const overlong_4 = 1<<6;
+    uint8_t const two_conts = 1<<7;
+    uint8_t const carry = too_short | too_long | two_conts;
+
+    __m128i const byte_1_high_table = _mm_setr_epi8(
+        too_long, too_long, too_long, too_long,
+        too_long, too_long, too_long, too_long,
+        two_conts, two_conts, two_conts, two_conts,
+        too_short | overlong_2,
+        too_short,
+        too_short | overlong_3 | surrogate,
+        static_cast<char>(too_short | too_large | too_large_1000 | overlong_4)
+    );
+    __m128i const byte_1_low_table = _mm_setr_epi8(
+        static_cast<char>(carry | overlong_3 | overlong_2 | overlong_4),
+        static_cast<char>(carry | overlong_2),
+        static_cast<char>(carry),
+        static_cast<char>(carry),
+        static_cast<char>(carry | too_large),
+        static_cast<char>(carry | too_large | too_large_1000),
+        static_cast<char>(carry | too_large | too_large_1000),
+        static_cast<char>(carry | too_large | too_large_1000),
+        static_cast<char>(carry | too_large | too_large_1000),
+        static_cast<char>(carry | too_large | too_large_1000),
+        static_cast<char>(carry | too_large | too_large_1000),
+        static_cast<char>(carry | too_large | too_large_1000),
+        static_cast<char>(carry | too_large | too_large_1000),
+        static_cast<char>(carry | too_large | too_large_1000 | surrogate),
+        static_cast<char>(carry | too_large | too_large_1000),
+        static_cast<char>(carry | too_large | too_large_1000)
+    );
+    __m128i const byte_2_high_table = _mm_setr_epi8(
+        too_short, too_short, too_short, too_short,
+        too_short, too_short, too_short, too_short,
+        static_cast<char>(too_long | overlong_2 | two_conts | overlong_3 |
+            too_large_1000 | overlong_4),
+        static_cast<char>(too_long | overlong_2 | two_conts | overlong_3 |
+            too_large),
+        static_cast<char>(too_long | overlong_2 | two_conts | surrogate |
+            too_large),
+        static_cast<char>(too_long | overlong_2 | two_conts | surrogate |
+            too_large),
+        too_short, too_short, too_short, too_short
+    );
+
+    __m128i const low_nibble = _mm_set1_epi8(0x0F);
+    __m128i const third_byte_min = _mm_set1_epi8(static_cast<char>(0xE0-0x80));
+    __m128i const fourth_byte_min = _mm_set1_epi8(static_cast<char>(0xF0-0x80));
+    __m128i const high_bit = _mm_set1_epi8(static_cast<char>(0x80));
+
+    __m128i prev_input = _mm_setzero_si128();
+    __m128i error = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i input = _mm_loadu_si128(
+            reinterpret_cast<__m128i const *>(data+i));
+
+        __m128i prev1 = _mm_alignr_epi8(input,prev_input,15);
+
+        __m128i byte_1_high = _mm_shuffle_epi8(byte_1_high_table,
+            _mm_and_si128(_mm_srli_epi16(prev1,4),low_nibble));
+        __m128i byte_1_low = _mm_shuffle_epi8(byte_1_low_table,
+            _mm_and_si128(prev1,low_nibble));
+        __m128i byte_2_high = _mm_shuffle_epi8(byte_2_high_table,
+            _mm_and_si128(_mm_srli_epi16(input,4),low_nibble));
+
+        __m128i special_cases = _mm_and_si128(
+            _mm_and_si128(byte_1_high,byte_1_low),byte_2_high);
+
+        __m128i prev2 = _mm_alignr_epi8(input,prev_input,14);
+        __m128i prev3 = _mm_alignr_epi8(input,prev_input,13);
+        __m128i must23 = _mm_or_si128(
+            _mm_subs_epu8(prev2,third_byte_min),
+            _mm_subs_epu8(prev3,fourth_byte_min));
+        __m128i must23_80 = _mm_and_si128(must23,high_bit);
+
+        error = _mm_or_si128(error,_mm_xor_si128(must23_80,special_cases));
+        prev_input = input;
+    }
+
+    valid = _mm_movemask_epi8(_mm_cmpeq_epi8(error,_mm_setzero_si128()))
+        == 0xFFFF;
+    return i;
+}
+#endif // _WEBSOCKETPP_SIMD_SSSE3_
+
 /// Provides streaming UTF8 validation functionality
 class validator {
 public:
@@ -103,6 +278,20 @@ public:
      */
     template <typename iterator_type>
     bool decode (iterator_type begin, iterator_type end) {
+        // Contiguous byte ranges (pointers, std::string iterators, etc) can
+        // use the block based validator.
+        if constexpr (std::contiguous_iterator<iterator_type> &&
+            sizeof(typename std::iterator_traits<iterator_type>::value_type)
+                == 1)
+        {
+            if (begin == end) {
+                return true;
+            }
+            uint8_t const * first = reinterpret_cast<uint8_t const *>(
+                std::to_address(begin));
+            return decode_block(first, first + (end - begin));
+        }
+
         for (iterator_type it = begin; it != end; ++it) {
             unsigned int result = utf8_validator::decode(
                 &m_state,
@@ -131,6 +320,75 @@ public:
         m_codepoint = 0;
     }
 private:
+    /// Validate a contiguous byte range
+    /**
+     * Runs of ASCII that start on a code point boundary are skipped with
+     * ascii_prefix. Longer stretches of multi byte text use the SSSE3 block
+     * validator when it is available. Everything else, including sequences
+     * that are split across calls, goes through the state machine so the
+     * streaming semantics are identical to consume().
+     */
+    bool decode_block(uint8_t const * p, uint8_t const * end) {
+#ifdef _WEBSOCKETPP_SIMD_SSSE3_
+        size_t const block_min = 64;
+#else
+        size_t const block_min = ~static_cast<size_t>(0);
+#endif
+
+        while (p != end) {
+            if (m_state == utf8_accept) {
+                p += ascii_prefix(p, static_cast<size_t>(end - p));
+                if (p == end) {
+                    break;
+                }
+
+#ifdef _WEBSOCKETPP_SIMD_SSSE3_
+                size_t remaining = static_cast<size_t>(end - p);
+                if (remaining >= block_min) {
+                    bool valid;
+                    uint8_t const * q = p + ssse3_validate_blocks(
+                        p, remaining, valid);
+                    if (!valid) {
+                        return false;
+                    }
+
+                    // Rewind to the start of a multi byte sequence that
+                    // the last block may have cut off.
+                    for (int j = 1; j <= 3; ++j) {
+                        uint8_t b = q[-j];
+                        if (b < 0x80) {
+                            break;
+                        }
+                        if (b >= 0xC0) {
+                            int needed = b >= 0xF0 ? 4 : (b >= 0xE0 ? 3 : 2);
+                            if (j < needed) {
+                                q -= j;
+                            }
+                            break;
+                        }
+                    }
+                    m_codepoint = 0;
+                    p = q;
+                    continue;
+                }
+#endif
+            }
+
+            // Run the state machine until we are back on a code point
+            // boundary that is followed by ASCII or by enough bytes to make
+            // the block validator worthwhile.
+            do {
+                if (utf8_validator::decode(&m_state,&m_codepoint,*p++)
+                    == utf8_reject)
+                {
+                    return false;
+                }
+            } while (p != end && (m_state != utf8_accept ||
+                (*p >= 0x80 && static_cast<size_t>(end - p) < block_min)));
+        }
+        return true;
+    }
+
     uint32_t    m_state;
     uint32_t    m_codepoint;
 };
@@ -148,6 +406,19 @@ inline bool validate(std::string const & s) {
     return v.complete();
 }
 
+/// Validate a complete UTF8 buffer
+/**
+ * @param data A pointer to the bytes to validate
+ * @param len The number of bytes
+ */
+inline bool validate(char const * data, size_t len) {
+    validator v;
+    if (!v.decode(data,data+len)) {
+        return false;
+    }
+    return v.complete();
+}
+
 } // namespace utf8_validator
 } // namespace websocketpp
 
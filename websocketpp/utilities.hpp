@@ -32,6 +32,7 @@
 
 #include <algorithm>
 #include <string>
+#include <string_view>
 #include <locale>
 
 namespace websocketpp {
@@ -79,7 +80,10 @@ struct ci_less {
             return tolower (c1) < tolower (c2);
         }
     };
-    bool operator() (std::string const & s1, std::string const & s2) const {
+    // lets maps keyed with ci_less be searched with a string_view
+    typedef void is_transparent;
+
+    bool operator() (std::string_view s1, std::string_view s2) const {
         return std::lexicographical_compare
             (s1.begin (), s1.end (),   // source range
             s2.begin (), s2.end (),   // dest range
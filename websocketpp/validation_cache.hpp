@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2014, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_VALIDATION_CACHE_HPP
+#define WEBSOCKETPP_VALIDATION_CACHE_HPP
+
+#include <websocketpp/common/chrono.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/thread.hpp>
+#include <websocketpp/http/constants.hpp>
+
+#include <cstddef>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace websocketpp {
+
+/// Results of handshake validation, by the value of a request header
+/**
+ * Server connections of an endpoint with set_validation_cache look the value
+ * of the header, usually an auth token, up here before calling the validate
+ * handler. A hit accepts or rejects the handshake without calling it, so
+ * reconnect storms don't repeat the validation for every connection.
+ *
+ * Only the decision and the status of a rejection are kept: subprotocols,
+ * extensions and headers chosen by the validate handler are not, so the
+ * cache only fits handlers whose decision depends on the header alone.
+ * Requests without the header are always validated.
+ *
+ * Holds up to a fixed number of results, dropping the least recently used
+ * one first, each for a limited time. The cache may be shared between
+ * endpoints.
+ *
+ * @since 0.9.0
+ */
+class validation_cache {
+public:
+    typedef lib::shared_ptr<validation_cache> ptr;
+
+    /// A validation result
+    struct result {
+        /// Whether the handshake was accepted
+        bool accept;
+        /// The status of a rejection
+        http::status_code::value status;
+    };
+
+    /// Create a cache
+    /**
+     * @param header The name of the request header to key results by
+     * @param capacity The most results held
+     * @param ttl How long a result is valid in ms, 0 for no limit
+     */
+    validation_cache(std::string const & header, size_t capacity, long ttl)
+      : m_header(header)
+      , m_capacity(capacity)
+      , m_ttl(ttl) {}
+
+    /// Get the name of the header results are keyed by
+    std::string const & get_header() const {
+        return m_header;
+    }
+
+    /// Look up the result for a header value
+    /**
+     * @param [in] key The header value
+     * @param [out] r Set to the result on a hit
+     * @return Whether there was a valid result
+     */
+    bool find(std::string const & key, result & r) {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        map_type::iterator it = m_entries.find(key);
+        if (it == m_entries.end()) {
+            return false;
+        }
+        if (m_ttl > 0 && clock::now() >= it->second->expires) {
+            m_lru.erase(it->second);
+            m_entries.erase(it);
+            return false;
+        }
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        r = it->second->value;
+        return true;
+    }
+
+    /// Store the result for a header value
+    /**
+     * @param key The header value
+     * @param r The result
+     */
+    void insert(std::string const & key, result const & r) {
+        if (m_capacity == 0) {
+            return;
+        }
+
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        map_type::iterator it = m_entries.find(key);
+        if (it != m_entries.end()) {
+            m_lru.erase(it->second);
+            m_entries.erase(it);
+        } else if (m_entries.size() >= m_capacity) {
+            m_entries.erase(m_lru.back().key);
+            m_lru.pop_back();
+        }
+
+        entry e;
+        e.key = key;
+        e.value = r;
+        e.expires = clock::now() + lib::chrono::milliseconds(m_ttl);
+        m_lru.push_front(std::move(e));
+        m_entries[key] = m_lru.begin();
+    }
+
+    /// Drop the result for a header value, such as a revoked token
+    /**
+     * @return Whether there was a result to drop
+     */
+    bool erase(std::string const & key) {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        map_type::iterator it = m_entries.find(key);
+        if (it == m_entries.end()) {
+            return false;
+        }
+        m_lru.erase(it->second);
+        m_entries.erase(it);
+        return true;
+    }
+
+    /// Drop every result
+    void clear() {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        m_entries.clear();
+        m_lru.clear();
+    }
+
+    /// Get the number of results held, including expired ones
+    size_t size() const {
+        lib::lock_guard<lib::mutex> guard(m_lock);
+        return m_entries.size();
+    }
+private:
+    typedef lib::chrono::steady_clock clock;
+
+    struct entry {
+        std::string key;
+        result value;
+        clock::time_point expires;
+    };
+
+    typedef std::list<entry> list_type;
+    typedef std::unordered_map<std::string, list_type::iterator> map_type;
+
+    std::string const m_header;
+    size_t const m_capacity;
+    long const m_ttl;
+
+    mutable lib::mutex m_lock;
+    list_type m_lru;
+    map_type m_entries;
+};
+
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_VALIDATION_CACHE_HPP